@@ -22,8 +22,115 @@
 #include "map.h"
 #include "editor.h"
 #include "gui.h"
+#include "creature.h"
+#include "iomap_otbm.h"
+#include "thread_pool.h"
+#include "reclaimer.h"
+#include "tracing.h"
+#include "filehandle.h"
+
+#include <zlib.h>
+#include <unordered_map>
+
+namespace {
+	// The history never leaves memory, any version that keeps every attribute will do
+	const VirtualIOMap history_version(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE));
+
+	// Writes the items of the tile as consecutive OTBM nodes, ground first,
+	// offsets receives where each of them starts and where the last one ends
+	void writeTileItems(const Tile* tile, NodeFileWriteHandle& writer, std::vector<size_t>& offsets)
+	{
+		if(tile && tile->ground) {
+			offsets.push_back(writer.getOffset());
+			tile->ground->writeItemNode_OTBM(history_version, writer);
+		}
+		if(tile) {
+			for(const Item* item : tile->items) {
+				offsets.push_back(writer.getOffset());
+				item->writeItemNode_OTBM(history_version, writer);
+			}
+		}
+		offsets.push_back(writer.getOffset());
+	}
+
+	template <typename T>
+	void writeValue(std::string& data, const T& value)
+	{
+		data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void writeString(std::string& data, const std::string& value)
+	{
+		writeValue<uint32_t>(data, value.size());
+		data.append(value);
+	}
+
+	template <typename T>
+	bool readValue(const std::string& data, size_t& position, T& value)
+	{
+		if(position + sizeof(T) > data.size()) {
+			return false;
+		}
+		memcpy(&value, data.data() + position, sizeof(T));
+		position += sizeof(T);
+		return true;
+	}
+
+	bool readString(const std::string& data, size_t& position, std::string& value)
+	{
+		uint32_t size;
+		if(!readValue(data, position, size) || position + size > data.size()) {
+			return false;
+		}
+		value.assign(data, position, size);
+		position += size;
+		return true;
+	}
+
+	void writePosition(std::string& data, const Position& position)
+	{
+		writeValue<int32_t>(data, position.x);
+		writeValue<int32_t>(data, position.y);
+		writeValue<int32_t>(data, position.z);
+	}
+
+	bool readPosition(const std::string& data, size_t& position, Position& value)
+	{
+		int32_t x, y, z;
+		if(!readValue(data, position, x) || !readValue(data, position, y) || !readValue(data, position, z)) {
+			return false;
+		}
+		value = Position(x, y, z);
+		return true;
+	}
+
+	void getTileItems(const Tile* tile, std::vector<const Item*>& items)
+	{
+		if(!tile) {
+			return;
+		}
+		if(tile->ground) {
+			items.push_back(tile->ground);
+		}
+		items.insert(items.end(), tile->items.begin(), tile->items.end());
+	}
+}
 
-Change::Change() : type(CHANGE_NONE), data(nullptr)
+TileDelta::~TileDelta()
+{
+	delete spawn;
+	delete creature;
+}
+
+uint32_t TileDelta::memsize() const
+{
+	uint32_t mem = sizeof(*this);
+	mem += selected.capacity() / 8;
+	mem += items.capacity();
+	return mem;
+}
+
+Change::Change() : type(CHANGE_NONE), data(nullptr), size(sizeof(Change))
 {
 	////
 }
@@ -32,6 +139,7 @@ Change::Change(Tile* tile) : type(CHANGE_TILE)
 {
 	ASSERT(tile);
 	data = tile;
+	updateSize();
 }
 
 Change* Change::Create(House* house, const Position& position)
@@ -39,6 +147,7 @@ Change* Change::Create(House* house, const Position& position)
 	Change* change = new Change();
 	change->type = CHANGE_MOVE_HOUSE_EXIT;
 	change->data = new HouseData { house->id, position };
+	change->updateSize();
 	return change;
 }
 
@@ -47,6 +156,7 @@ Change* Change::Create(Waypoint* waypoint, const Position& position)
 	Change* change = new Change();
 	change->type = CHANGE_MOVE_WAYPOINT;
 	change->data = new WaypointData { waypoint->name, position };
+	change->updateSize();
 	return change;
 }
 
@@ -62,6 +172,10 @@ void Change::clear()
 			ASSERT(data);
 			delete reinterpret_cast<Tile*>(data);
 			break;
+		case CHANGE_TILE_DELTA:
+			ASSERT(data);
+			delete reinterpret_cast<TileDelta*>(data);
+			break;
 		case CHANGE_MOVE_HOUSE_EXIT:
 			ASSERT(data);
 			delete reinterpret_cast<HouseData*>(data);
@@ -82,21 +196,190 @@ void Change::clear()
 
 	type = CHANGE_NONE;
 	data = nullptr;
+	size = sizeof(Change);
 }
 
-uint32_t Change::memsize() const
+Position Change::getPosition() const
 {
-	uint32_t mem = sizeof(*this);
+	if(type == CHANGE_TILE_DELTA) {
+		return reinterpret_cast<TileDelta*>(data)->location->getPosition();
+	}
+	ASSERT(type == CHANGE_TILE);
+	return reinterpret_cast<Tile*>(data)->getPosition();
+}
+
+void Change::compact(const Tile* base)
+{
+	ASSERT(type == CHANGE_TILE);
+	Tile* tile = reinterpret_cast<Tile*>(data);
+
+	// Both item lists go into the same buffer so they can be compared bytewise
+	MemoryNodeFileWriteHandle writer;
+	std::vector<size_t> offsets;
+	std::vector<size_t> base_offsets;
+	writeTileItems(tile, writer, offsets);
+	writeTileItems(base, writer, base_offsets);
+	const uint8_t* memory = writer.getMemory();
+
+	auto same = [&](size_t index, size_t base_index) {
+		size_t size = offsets[index + 1] - offsets[index];
+		return size == base_offsets[base_index + 1] - base_offsets[base_index] &&
+			memcmp(memory + offsets[index], memory + base_offsets[base_index], size) == 0;
+	};
+
+	size_t count = offsets.size() - 1;
+	size_t base_count = base_offsets.size() - 1;
+	size_t bottom = 0;
+	while(bottom < count && bottom < base_count && same(bottom, bottom)) {
+		++bottom;
+	}
+	size_t top = 0;
+	while(bottom + top < count && bottom + top < base_count && same(count - top - 1, base_count - top - 1)) {
+		++top;
+	}
+
+	TileDelta* delta = newd TileDelta;
+	delta->location = tile->getLocation();
+	delta->house_id = tile->house_id;
+	delta->mapflags = tile->getMapFlags();
+	delta->statflags = tile->getStatFlags();
+	delta->zone_set = tile->getZoneSet();
+	delta->spawn = tile->spawn;
+	delta->creature = tile->creature;
+	delta->has_ground = tile->ground != nullptr;
+	delta->base_count = base_count;
+	delta->base_crc = crc32(0L, memory + base_offsets.front(), base_offsets.back() - base_offsets.front());
+	delta->shared_bottom = bottom;
+	delta->shared_top = top;
+
+	std::vector<const Item*> items;
+	getTileItems(tile, items);
+	delta->selected.reserve(items.size());
+	for(const Item* item : items) {
+		delta->selected.push_back(item->isSelected());
+	}
+
+	if(bottom + top < count) {
+		// The reader skips the first byte, it expects the start of the root node there
+		size_t begin = offsets[bottom];
+		size_t end = offsets[count - top];
+		delta->items.reserve(end - begin + 2);
+		delta->items.push_back(static_cast<char>(NODE_START));
+		delta->items.append(reinterpret_cast<const char*>(memory + begin), end - begin);
+		delta->items.push_back(static_cast<char>(NODE_END));
+	}
+
+	// The delta keeps the spawn and creature, they are rare enough
+	tile->spawn = nullptr;
+	tile->creature = nullptr;
+	delete tile;
+
+	type = CHANGE_TILE_DELTA;
+	data = delta;
+	updateSize();
+}
+
+bool Change::expand(BaseMap& map)
+{
+	ASSERT(type == CHANGE_TILE_DELTA);
+	TileDelta* delta = reinterpret_cast<TileDelta*>(data);
+	// Reads a paged out area back into the same locations
+	map.getTileL(delta->location->getPosition());
+
+	std::vector<const Item*> base_items;
+	getTileItems(delta->location->get(), base_items);
+
+	// Whatever lined up with another tile would make up a tile that never was
+	MemoryNodeFileWriteHandle writer;
+	std::vector<size_t> base_offsets;
+	writeTileItems(delta->location->get(), writer, base_offsets);
+	if(base_items.size() != delta->base_count || crc32(0L, writer.getMemory() + base_offsets.front(), base_offsets.back() - base_offsets.front()) != delta->base_crc) {
+		clear();
+		return false;
+	}
+
+	const size_t base_count = base_items.size();
+	const size_t bottom = delta->shared_bottom;
+	const size_t top = delta->shared_top;
+
+	std::vector<Item*> items;
+	items.reserve(delta->selected.size());
+	for(size_t index = 0; index < bottom; ++index) {
+		items.push_back(base_items[index]->deepCopy());
+	}
+
+	if(!delta->items.empty()) {
+		MemoryNodeFileReadHandle reader(reinterpret_cast<const uint8_t*>(delta->items.data()), delta->items.size());
+		BinaryNode* itemNode = reader.getRootNode()->getChild();
+		if(itemNode) do {
+			uint8_t itemType;
+			if(!itemNode->getByte(itemType) || itemType != OTBM_ITEM) {
+				continue;
+			}
+
+			Item* item = Item::Create_OTBM(history_version, itemNode);
+			if(item) {
+				item->unserializeItemNode_OTBM(history_version, itemNode);
+				items.push_back(item);
+			}
+		} while(itemNode->advance());
+	}
+
+	for(size_t index = base_count - top; index < base_count; ++index) {
+		items.push_back(base_items[index]->deepCopy());
+	}
+
+	Tile* tile = map.allocator(delta->location);
+	for(size_t index = 0; index < items.size(); ++index) {
+		Item* item = items[index];
+		if(index < delta->selected.size() && delta->selected[index]) {
+			item->select();
+		} else {
+			item->deselect();
+		}
+
+		if(index == 0 && delta->has_ground) {
+			tile->ground = item;
+		} else {
+			tile->items.push_back(item);
+		}
+	}
+
+	tile->house_id = delta->house_id;
+	tile->setZoneSet(delta->zone_set);
+	tile->spawn = delta->spawn;
+	tile->creature = delta->creature;
+	delta->spawn = nullptr;
+	delta->creature = nullptr;
+
+	// Update picks the minimap color, the flags are restored as they were
+	tile->update();
+	tile->unsetStatFlags(tile->getStatFlags());
+	tile->setStatFlags(delta->statflags);
+	tile->setMapFlags(delta->mapflags);
+
+	delete delta;
+	type = CHANGE_TILE;
+	data = tile;
+	updateSize();
+	return true;
+}
+
+void Change::updateSize()
+{
+	size = sizeof(*this);
 	if(type == CHANGE_TILE) {
-		mem += reinterpret_cast<Tile*>(data)->memsize();
+		size += reinterpret_cast<Tile*>(data)->memsize();
+	} else if(type == CHANGE_TILE_DELTA) {
+		size += reinterpret_cast<TileDelta*>(data)->memsize();
 	}
-	return mem;
 }
 
 Action::Action(Editor& editor, ActionIdentifier ident) :
 	commited(false),
 	editor(editor),
-	type(ident)
+	type(ident),
+	memory_size(sizeof(Action))
 {
 }
 
@@ -108,270 +391,616 @@ Action::~Action()
 	changes.clear();
 }
 
-size_t Action::approx_memsize() const
+bool Action::serialize(std::string& data) const
 {
-	uint32_t mem = sizeof(*this);
-	mem += changes.size() * (sizeof(Change) + sizeof(Tile) + sizeof(Item) + 6/* approx overhead*/);
-	return mem;
-}
+	writeValue<uint8_t>(data, commited);
+	writeValue<uint32_t>(data, changes.size());
+	for(const Change* change : changes) {
+		writeValue<uint8_t>(data, change->type);
+		switch(change->type) {
+			case CHANGE_NONE:
+				break;
 
-size_t Action::memsize() const
-{
-	uint32_t mem = sizeof(*this);
-	mem += sizeof(Change*) * 3 * changes.size();
+			case CHANGE_TILE_DELTA: {
+				const TileDelta* delta = reinterpret_cast<const TileDelta*>(change->data);
+				writePosition(data, delta->location->getPosition());
+				writeValue<uint32_t>(data, delta->house_id);
+				writeValue<uint16_t>(data, delta->mapflags);
+				writeValue<uint16_t>(data, delta->statflags);
+				const std::vector<uint16_t>& zones = ZoneSets::get(delta->zone_set);
+				writeValue<uint16_t>(data, zones.size());
+				for(uint16_t zoneId : zones) {
+					writeValue<uint16_t>(data, zoneId);
+				}
 
-	for(const Change* change : changes) {
-		if(change && change->getType() == CHANGE_TILE) {
-			mem += reinterpret_cast<Tile*>(change->getData())->memsize();
+				writeValue<uint8_t>(data, delta->spawn != nullptr);
+				if(delta->spawn) {
+					writeValue<int32_t>(data, delta->spawn->getSize());
+					writeValue<uint8_t>(data, delta->spawn->isSelected());
+				}
+
+				writeValue<uint8_t>(data, delta->creature != nullptr);
+				if(delta->creature) {
+					writeString(data, delta->creature->getName());
+					writeValue<int32_t>(data, delta->creature->getSpawnTime());
+					writeValue<uint8_t>(data, delta->creature->getDirection());
+					writeValue<uint8_t>(data, delta->creature->isSelected());
+					writeValue<uint8_t>(data, delta->creature->isSaved());
+				}
+
+				writeValue<uint8_t>(data, delta->has_ground);
+				writeValue<uint16_t>(data, delta->base_count);
+				writeValue<uint32_t>(data, delta->base_crc);
+				writeValue<uint16_t>(data, delta->shared_bottom);
+				writeValue<uint16_t>(data, delta->shared_top);
+				writeValue<uint16_t>(data, delta->selected.size());
+				for(size_t first = 0; first < delta->selected.size(); first += 8) {
+					uint8_t bits = 0;
+					for(size_t bit = 0; bit < 8 && first + bit < delta->selected.size(); ++bit) {
+						bits |= delta->selected[first + bit] << bit;
+					}
+					writeValue<uint8_t>(data, bits);
+				}
+				writeString(data, delta->items);
+				break;
+			}
+
+			case CHANGE_MOVE_HOUSE_EXIT: {
+				const HouseData* house = reinterpret_cast<const HouseData*>(change->data);
+				writeValue<uint32_t>(data, house->id);
+				writePosition(data, house->position);
+				break;
+			}
+
+			case CHANGE_MOVE_WAYPOINT: {
+				const WaypointData* waypoint = reinterpret_cast<const WaypointData*>(change->data);
+				writeString(data, waypoint->id);
+				writePosition(data, waypoint->position);
+				break;
+			}
+
+			default:
+				// Full tiles point into the map, they only make sense in memory
+				return false;
 		}
 	}
-
-	return mem;
+	return true;
 }
 
-void Action::commit(DirtyList* dirty_list)
+bool Action::unserialize(const std::string& data, size_t& position)
 {
 	Map& map = editor.getMap();
-	Selection& selection = editor.getSelection();
-	selection.start(Selection::INTERNAL);
-
-	for (Change* change : changes) {
-		switch(change->getType()) {
-			case CHANGE_TILE: {
-				void** data = &change->data;
-				Tile* new_tile = reinterpret_cast<Tile*>(*data);
-				ASSERT(new_tile);
-
-				const Position& pos = new_tile->getPosition();
-
-				if(editor.IsLiveClient()) {
-					QTreeNode* node = map.getLeaf(pos.x, pos.y);
-					if(!node || !node->isVisible(pos.z > rme::MapGroundLayer)) {
-						change->clear();
-						continue;
-					}
-				}
 
-				Tile* old_tile = map.swapTile(pos, new_tile);
-				TileLocation* location = new_tile->getLocation();
+	uint8_t wasCommited;
+	uint32_t count;
+	if(!readValue(data, position, wasCommited) || !readValue(data, position, count)) {
+		return false;
+	}
+	commited = wasCommited != 0;
 
-				// Update other nodes in the network
-				if(editor.IsLiveServer() && dirty_list)
-					dirty_list->AddPosition(pos.x, pos.y, pos.z);
+	for(uint32_t index = 0; index < count; ++index) {
+		uint8_t changeType;
+		if(!readValue(data, position, changeType)) {
+			return false;
+		}
 
-				new_tile->update();
+		Change* change = new Change();
+		switch(changeType) {
+			case CHANGE_NONE:
+				break;
 
-				//std::cout << "\tSwitched tile at " << pos.x << ";" << pos.y << ";" << pos.z << " from " << (void*)oldtile << " to " << *data <<  std::endl;
-				if(new_tile->isSelected())
-					selection.addInternal(new_tile);
+			case CHANGE_TILE_DELTA: {
+				TileDelta* delta = newd TileDelta { };
+				change->type = CHANGE_TILE_DELTA;
+				change->data = delta;
+
+				Position tilePosition;
+				uint16_t zoneCount;
+				if(!readPosition(data, position, tilePosition) ||
+					!readValue(data, position, delta->house_id) ||
+					!readValue(data, position, delta->mapflags) ||
+					!readValue(data, position, delta->statflags) ||
+					!readValue(data, position, zoneCount)) {
+					delete change;
+					return false;
+				}
 
-				if(old_tile) {
-					if(new_tile->getHouseID() != old_tile->getHouseID()) {
-						// oooooomggzzz we need to add it to the appropriate house!
-						House* house = map.houses.getHouse(old_tile->getHouseID());
-						if(house)
-							house->removeTile(old_tile);
+				delta->location = map.createTileL(tilePosition);
+				std::vector<uint16_t> zones(zoneCount);
+				for(uint16_t& zoneId : zones) {
+					if(!readValue(data, position, zoneId)) {
+						delete change;
+						return false;
+					}
+				}
+				delta->zone_set = ZoneSets::intern(std::move(zones));
 
-						house = map.houses.getHouse(new_tile->getHouseID());
-						if(house)
-							house->addTile(new_tile);
+				uint8_t hasSpawn;
+				if(!readValue(data, position, hasSpawn)) {
+					delete change;
+					return false;
+				}
+				if(hasSpawn) {
+					int32_t size;
+					uint8_t selected;
+					if(!readValue(data, position, size) || !readValue(data, position, selected)) {
+						delete change;
+						return false;
 					}
-					if(old_tile->spawn) {
-						if(new_tile->spawn) {
-							if(*old_tile->spawn != *new_tile->spawn) {
-								map.removeSpawn(old_tile);
-								map.addSpawn(new_tile);
-							}
-						} else {
-							map.removeSpawn(old_tile);
-						}
-					} else if(new_tile->spawn) {
-						map.addSpawn(new_tile);
+					delta->spawn = newd Spawn(size);
+					if(selected) {
+						delta->spawn->select();
 					}
+				}
 
-					//oldtile->update();
-					if(old_tile->isSelected())
-						selection.removeInternal(old_tile);
-
-					*data = old_tile;
-				} else {
-					*data = map.allocator(location);
-					if(new_tile->getHouseID() != 0) {
-						// oooooomggzzz we need to add it to the appropriate house!
-						House* house = map.houses.getHouse(new_tile->getHouseID());
-						if(house) {
-							house->addTile(new_tile);
-						}
+				uint8_t hasCreature;
+				if(!readValue(data, position, hasCreature)) {
+					delete change;
+					return false;
+				}
+				if(hasCreature) {
+					std::string name;
+					int32_t spawnTime;
+					uint8_t direction, selected, saved;
+					if(!readString(data, position, name) ||
+						!readValue(data, position, spawnTime) ||
+						!readValue(data, position, direction) ||
+						!readValue(data, position, selected) ||
+						!readValue(data, position, saved)) {
+						delete change;
+						return false;
 					}
+					delta->creature = newd Creature(name);
+					delta->creature->setSpawnTime(spawnTime);
+					delta->creature->setDirection(static_cast<Direction>(direction));
+					if(selected) {
+						delta->creature->select();
+					}
+					if(saved) {
+						delta->creature->save();
+					}
+				}
 
-					if(new_tile->spawn)
-						map.addSpawn(new_tile);
-
+				uint8_t hasGround;
+				uint16_t selectedCount;
+				if(!readValue(data, position, hasGround) ||
+					!readValue(data, position, delta->base_count) ||
+					!readValue(data, position, delta->base_crc) ||
+					!readValue(data, position, delta->shared_bottom) ||
+					!readValue(data, position, delta->shared_top) ||
+					!readValue(data, position, selectedCount)) {
+					delete change;
+					return false;
+				}
+				delta->has_ground = hasGround != 0;
+
+				delta->selected.resize(selectedCount);
+				for(size_t first = 0; first < selectedCount; first += 8) {
+					uint8_t bits;
+					if(!readValue(data, position, bits)) {
+						delete change;
+						return false;
+					}
+					for(size_t bit = 0; bit < 8 && first + bit < selectedCount; ++bit) {
+						delta->selected[first + bit] = (bits >> bit) & 1;
+					}
 				}
-				new_tile->modify();
 
-				// Update client dirty list
-				if(editor.IsLiveClient() && dirty_list && type != ACTION_REMOTE) {
-					dirty_list->AddChange(change);
+				if(!readString(data, position, delta->items)) {
+					delete change;
+					return false;
 				}
 				break;
 			}
 
 			case CHANGE_MOVE_HOUSE_EXIT: {
-				HouseData* data = reinterpret_cast<HouseData*>(change->data);
-				ASSERT(data);
-
-				House* house = map.houses.getHouse(data->id);
-				if(house) {
-					const Position& old_pos = house->getExit();
-					house->setExit(data->position);
-					data->position = old_pos;
+				HouseData* house = new HouseData { };
+				change->type = CHANGE_MOVE_HOUSE_EXIT;
+				change->data = house;
+				if(!readValue(data, position, house->id) || !readPosition(data, position, house->position)) {
+					delete change;
+					return false;
 				}
 				break;
 			}
 
 			case CHANGE_MOVE_WAYPOINT: {
-				WaypointData* data = reinterpret_cast<WaypointData*>(change->data);
-				ASSERT(data);
-
-				Waypoint* waypoint = map.waypoints.getWaypoint(data->id);
-				if(waypoint) {
-					TileLocation* old_tile = map.getTileL(waypoint->pos);
-					TileLocation* new_tile = map.getTileL(data->position);
-
-					if(data->position.isValid() && old_tile && old_tile->getWaypointCount() > 0)
-						old_tile->decreaseWaypointCount();
-
-					new_tile->increaseWaypointCount();
-
-					Position old_pos = waypoint->pos;
-					waypoint->pos = data->position;
-					data->position = old_pos;
+				WaypointData* waypoint = new WaypointData { };
+				change->type = CHANGE_MOVE_WAYPOINT;
+				change->data = waypoint;
+				if(!readString(data, position, waypoint->id) || !readPosition(data, position, waypoint->position)) {
+					delete change;
+					return false;
 				}
 				break;
 			}
 
 			default:
-				break;
+				delete change;
+				return false;
 		}
+		change->updateSize();
+		addChange(change);
 	}
-	selection.finish(Selection::INTERNAL);
-	commited = true;
+	return true;
 }
 
-void Action::undo(DirtyList* dirty_list)
+// Tile changes are committed and undone leaf by leaf in the order of the tree, so the swaps
+// and the selection don't jump around it. Refreshing the new tiles and compacting the history
+// only touch the tiles of one change, with enough of them they run on the pool.
+static const size_t ParallelCommitSize = 1024;
+
+struct CommittedTile
 {
-	if(changes.empty())
+	Change* change;
+	Tile* old_tile; // An empty tile when there was none, made after the swap
+	Tile* new_tile;
+	bool created;
+};
+
+static uint64_t getCommitKey(const Position& pos)
+{
+	return (uint64_t(pos.x >> 2) << 36) | (uint64_t(pos.y >> 2) << 20) | (uint64_t(pos.x & 3) << 16) | (uint64_t(pos.y & 3) << 8) | uint64_t(pos.z);
+}
+
+// Changes to the same tile keep their order
+static std::vector<Change*> sortTileChanges(const ChangeList& changes)
+{
+	std::vector<std::pair<uint64_t, Change*>> keyed;
+	for(Change* change : changes) {
+		if(change->getType() == CHANGE_TILE || change->getType() == CHANGE_TILE_DELTA) {
+			keyed.emplace_back(getCommitKey(change->getPosition()), change);
+		}
+	}
+	std::stable_sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) {
+		return a.first < b.first;
+	});
+
+	std::vector<Change*> sorted;
+	sorted.reserve(keyed.size());
+	for(const auto& [key, change] : keyed) {
+		sorted.push_back(change);
+	}
+	return sorted;
+}
+
+template <typename Func>
+static void forEachCommittedTile(std::vector<CommittedTile>& tiles, Func&& func)
+{
+	if(tiles.size() < ParallelCommitSize) {
+		for(CommittedTile& tile : tiles) {
+			func(tile);
+		}
 		return;
+	}
+
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(std::min(tiles.size() / 256, pool.getWorkerCount() * 8), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t end = tiles.size() * (chunk + 1) / chunk_count;
+		for(size_t i = tiles.size() * chunk / chunk_count; i < end; ++i) {
+			func(tiles[i]);
+		}
+	});
+}
+
+// An action can change the same tile more than once, the tiles in between are the old tile of one
+// change and the new tile of the one before. Only the first change of such a run is kept, with the
+// tile that was there before the action, so every change is compacted against the tile on the map
+// and no two of them share a tile
+static void foldRepeatedTiles(std::vector<CommittedTile>& tiles)
+{
+	size_t kept = 0;
+	for(size_t i = 0; i < tiles.size(); ++i) {
+		if(kept != 0 && tiles[kept - 1].new_tile->getLocation() == tiles[i].new_tile->getLocation()) {
+			tiles[kept - 1].new_tile = tiles[i].new_tile;
+			tiles[i].change->clear();
+			continue;
+		}
+		tiles[kept++] = tiles[i];
+	}
+	tiles.resize(kept);
+}
+
+// House exits and waypoints swap their position with the one kept in the change, both ways
+static void swapMarkerPosition(Map& map, Change* change)
+{
+	switch(change->getType()) {
+		case CHANGE_MOVE_HOUSE_EXIT: {
+			HouseData* data = reinterpret_cast<HouseData*>(change->getData());
+			ASSERT(data);
+
+			House* house = map.houses.getHouse(data->id);
+			if(house) {
+				const Position& old_pos = house->getExit();
+				house->setExit(data->position);
+				data->position = old_pos;
+			}
+			break;
+		}
 
+		case CHANGE_MOVE_WAYPOINT: {
+			WaypointData* data = reinterpret_cast<WaypointData*>(change->getData());
+			ASSERT(data);
+
+			Waypoint* waypoint = map.waypoints.getWaypoint(data->id);
+			if(waypoint) {
+				TileLocation* old_tile = map.getTileL(waypoint->pos);
+				TileLocation* new_tile = map.getTileL(data->position);
+
+				if(data->position.isValid() && old_tile && old_tile->getWaypointCount() > 0)
+					old_tile->decreaseWaypointCount();
+
+				new_tile->increaseWaypointCount();
+
+				Position old_pos = waypoint->pos;
+				map.waypoints.moveWaypoint(waypoint, data->position);
+				data->position = old_pos;
+			}
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+// Houses are looked up once for all of their tiles
+class HouseLookup
+{
+public:
+	explicit HouseLookup(Map& map) : map(map) {}
+
+	House* operator()(uint32_t id) {
+		auto it = houses.find(id);
+		if(it == houses.end()) {
+			it = houses.emplace(id, map.houses.getHouse(id)).first;
+		}
+		return it->second;
+	}
+
+private:
+	Map& map;
+	std::unordered_map<uint32_t, House*> houses;
+};
+
+void Action::commit(DirtyList* dirty_list)
+{
+	RME_TRACE_ZONE("action", "Action::commit");
 	Map& map = editor.getMap();
 	Selection& selection = editor.getSelection();
 	selection.start(Selection::INTERNAL);
 
-	for (Change* change : changes) {
-		switch(change->getType()) {
-			case CHANGE_TILE: {
-				void** data = &change->data;
-				Tile* old_tile = reinterpret_cast<Tile*>(*data);
-				ASSERT(old_tile);
-				const Position& pos = old_tile->getPosition();
-
-				if(editor.IsLiveClient()) {
-					QTreeNode* node = map.getLeaf(pos.x, pos.y);
-					if(!node || !node->isVisible(pos.z > rme::MapGroundLayer)) {
-						// Delete all changes that affect tiles outside our view
-						change->clear();
-						continue;
-					}
-				}
+	// Remote changes can touch a tile between two of our own, so a delta could
+	// no longer be applied, live sessions keep full tiles in the history
+	const bool compact = !editor.IsLive();
 
-				Tile* new_tile = map.swapTile(pos, old_tile);
+	for(Change* change : changes) {
+		memory_size -= change->memsize();
+	}
 
-				// Update server side change list (for broadcast)
-				if(editor.IsLiveServer() && dirty_list)
-					dirty_list->AddPosition(pos.x, pos.y, pos.z);
+	// A selection only swaps tiles for copies selected differently, the node cache of the map
+	// drawer keeps the leaves and shades the selection over them
+	map.setSelectionSwaps(type == ACTION_SELECT || type == ACTION_UNSELECT);
 
+	std::vector<CommittedTile> committed;
+	for(Change* change : sortTileChanges(changes)) {
+		if(change->getType() == CHANGE_TILE_DELTA && !change->expand(map)) {
+			continue;
+		}
+		Tile* new_tile = reinterpret_cast<Tile*>(change->data);
+		ASSERT(new_tile);
 
-				if(old_tile->isSelected())
-					selection.addInternal(old_tile);
-				if(new_tile->isSelected())
-					selection.removeInternal(new_tile);
+		const Position& pos = new_tile->getPosition();
 
-				if(new_tile->getHouseID() != old_tile->getHouseID()) {
-					// oooooomggzzz we need to remove it from the appropriate house!
-					House* house = map.houses.getHouse(new_tile->getHouseID());
-					if(house) {
-						house->removeTile(new_tile);
-					} else {
-						new_tile->setHouse(nullptr);
-					}
+		if(editor.IsLiveClient()) {
+			QTreeNode* node = map.getLeaf(pos.x, pos.y);
+			if(!node || !node->isVisible(pos.z > rme::MapGroundLayer)) {
+				change->clear();
+				continue;
+			}
+		}
 
-					house = map.houses.getHouse(old_tile->getHouseID());
-					if(house) {
-						house->addTile(old_tile);
-					}
-				}
+		Tile* old_tile = map.swapTile(pos, new_tile);
+
+		// Update other nodes in the network
+		if(editor.IsLiveServer() && dirty_list)
+			dirty_list->AddPosition(pos.x, pos.y, pos.z);
 
-				if(old_tile->spawn) {
-					if(new_tile->spawn) {
-						if(*old_tile->spawn != *new_tile->spawn) {
-							map.removeSpawn(new_tile);
-							map.addSpawn(old_tile);
-						}
-					} else {
-						map.addSpawn(old_tile);
+		committed.push_back(CommittedTile { change, old_tile, new_tile, old_tile == nullptr });
+		if(!old_tile) {
+			committed.back().old_tile = map.allocator(new_tile->getLocation());
+		}
+		change->data = committed.back().old_tile;
+		if(!compact) {
+			change->updateSize();
+		}
+	}
+	map.setSelectionSwaps(false);
+
+	forEachCommittedTile(committed, [](CommittedTile& tile) {
+		tile.new_tile->update();
+		tile.new_tile->modify();
+	});
+
+	HouseLookup getHouse(map);
+	for(CommittedTile& tile : committed) {
+		Tile* old_tile = tile.old_tile;
+		Tile* new_tile = tile.new_tile;
+
+		if(new_tile->isSelected())
+			selection.addInternal(new_tile);
+
+		if(!tile.created) {
+			if(new_tile->getHouseID() != old_tile->getHouseID()) {
+				// oooooomggzzz we need to add it to the appropriate house!
+				House* house = getHouse(old_tile->getHouseID());
+				if(house)
+					house->removeTile(old_tile);
+
+				house = getHouse(new_tile->getHouseID());
+				if(house)
+					house->addTile(new_tile);
+				else if(new_tile->isHouseTile())
+					map.houses.setOrphanedTiles(true);
+			}
+			if(old_tile->spawn) {
+				if(new_tile->spawn) {
+					if(*old_tile->spawn != *new_tile->spawn) {
+						map.removeSpawn(old_tile);
+						map.addSpawn(new_tile);
 					}
-				} else if(new_tile->spawn) {
-					map.removeSpawn(new_tile);
+				} else {
+					map.removeSpawn(old_tile);
 				}
-				*data = new_tile;
+			} else if(new_tile->spawn) {
+				map.addSpawn(new_tile);
+			}
 
-				// Update client dirty list
-				if(editor.IsLiveClient() && dirty_list && type != ACTION_REMOTE) {
-					dirty_list->AddChange(change);
+			if(old_tile->isSelected())
+				selection.removeInternal(old_tile);
+		} else {
+			if(new_tile->getHouseID() != 0) {
+				// oooooomggzzz we need to add it to the appropriate house!
+				House* house = getHouse(new_tile->getHouseID());
+				if(house) {
+					house->addTile(new_tile);
+				} else {
+					map.houses.setOrphanedTiles(true);
 				}
-				break;
 			}
 
-			case CHANGE_MOVE_HOUSE_EXIT: {
-				HouseData* data = reinterpret_cast<HouseData*>(change->data);
-				ASSERT(data);
+			if(new_tile->spawn)
+				map.addSpawn(new_tile);
+		}
 
-				House* house = map.houses.getHouse(data->id);
-				if(house) {
-					const Position& oldpos = house->getExit();
-					house->setExit(data->position);
-					data->position = oldpos;
-				}
-				break;
+		// Update client dirty list
+		if(editor.IsLiveClient() && dirty_list && type != ACTION_REMOTE) {
+			dirty_list->AddChange(tile.change);
+		}
+	}
+
+	if(compact) {
+		foldRepeatedTiles(committed);
+		forEachCommittedTile(committed, [](CommittedTile& tile) {
+			tile.change->compact(tile.new_tile);
+		});
+	}
+
+	for(Change* change : changes) {
+		swapMarkerPosition(map, change);
+		memory_size += change->memsize();
+	}
+	selection.finish(Selection::INTERNAL);
+	commited = true;
+}
+
+void Action::undo(DirtyList* dirty_list)
+{
+	if(changes.empty())
+		return;
+
+	Map& map = editor.getMap();
+	Selection& selection = editor.getSelection();
+	selection.start(Selection::INTERNAL);
+
+	const bool compact = !editor.IsLive();
+
+	for(Change* change : changes) {
+		memory_size -= change->memsize();
+	}
+
+	// Here the old tile goes back on the map and the new one into the change
+	std::vector<CommittedTile> undone;
+	map.setSelectionSwaps(type == ACTION_SELECT || type == ACTION_UNSELECT);
+	for(Change* change : sortTileChanges(changes)) {
+		if(change->getType() == CHANGE_TILE_DELTA && !change->expand(map)) {
+			continue;
+		}
+		Tile* old_tile = reinterpret_cast<Tile*>(change->data);
+		ASSERT(old_tile);
+		const Position& pos = old_tile->getPosition();
+
+		if(editor.IsLiveClient()) {
+			QTreeNode* node = map.getLeaf(pos.x, pos.y);
+			if(!node || !node->isVisible(pos.z > rme::MapGroundLayer)) {
+				// Delete all changes that affect tiles outside our view
+				change->clear();
+				continue;
 			}
+		}
 
-			case CHANGE_MOVE_WAYPOINT: {
-				WaypointData* data = reinterpret_cast<WaypointData*>(change->data);
-				ASSERT(data);
+		Tile* new_tile = map.swapTile(pos, old_tile);
 
-				Waypoint* waypoint = map.waypoints.getWaypoint(data->id);
-				if(waypoint) {
-					TileLocation* old_tile = map.getTileL(waypoint->pos);
-					TileLocation* new_tile = map.getTileL(data->position);
+		// Update server side change list (for broadcast)
+		if(editor.IsLiveServer() && dirty_list)
+			dirty_list->AddPosition(pos.x, pos.y, pos.z);
 
-					if(data->position.isValid() && old_tile && old_tile->getWaypointCount() > 0)
-						old_tile->decreaseWaypointCount();
+		change->data = new_tile;
+		if(!compact) {
+			change->updateSize();
+		}
+		undone.push_back(CommittedTile { change, old_tile, new_tile, false });
+	}
+	map.setSelectionSwaps(false);
+
+	HouseLookup getHouse(map);
+	for(CommittedTile& tile : undone) {
+		Tile* old_tile = tile.old_tile;
+		Tile* new_tile = tile.new_tile;
+
+		if(old_tile->isSelected())
+			selection.addInternal(old_tile);
+		if(new_tile->isSelected())
+			selection.removeInternal(new_tile);
+
+		if(new_tile->getHouseID() != old_tile->getHouseID()) {
+			// oooooomggzzz we need to remove it from the appropriate house!
+			House* house = getHouse(new_tile->getHouseID());
+			if(house) {
+				house->removeTile(new_tile);
+			} else {
+				new_tile->setHouse(nullptr);
+			}
 
-					new_tile->increaseWaypointCount();
+			house = getHouse(old_tile->getHouseID());
+			if(house) {
+				house->addTile(old_tile);
+			} else if(old_tile->isHouseTile()) {
+				map.houses.setOrphanedTiles(true);
+			}
+		}
 
-					Position old_pos = waypoint->pos;
-					waypoint->pos = data->position;
-					data->position = old_pos;
+		if(old_tile->spawn) {
+			if(new_tile->spawn) {
+				if(*old_tile->spawn != *new_tile->spawn) {
+					map.removeSpawn(new_tile);
+					map.addSpawn(old_tile);
 				}
-				break;
+			} else {
+				map.addSpawn(old_tile);
 			}
+		} else if(new_tile->spawn) {
+			map.removeSpawn(new_tile);
+		}
 
-			default:
-				break;
+		// Update client dirty list
+		if(editor.IsLiveClient() && dirty_list && type != ACTION_REMOTE) {
+			dirty_list->AddChange(tile.change);
 		}
 	}
 
+	if(compact) {
+		forEachCommittedTile(undone, [](CommittedTile& tile) {
+			tile.change->compact(tile.old_tile);
+		});
+	}
+
+	for(Change* change : changes) {
+		swapMarkerPosition(map, change);
+		memory_size += change->memsize();
+	}
+
 	selection.finish(Selection::INTERNAL);
 	commited = false;
 }
@@ -379,8 +1008,11 @@ void Action::undo(DirtyList* dirty_list)
 BatchAction::BatchAction(Editor& editor, ActionIdentifier ident) :
 	editor(editor),
     timestamp(0),
-    memory_size(0),
-    type(ident)
+    memory_size(sizeof(BatchAction)),
+    type(ident),
+    progress_total(0),
+    progress_done(0),
+    progress_shown(-1)
 {
     ////
 }
@@ -394,29 +1026,6 @@ BatchAction::~BatchAction()
 	batch.clear();
 }
 
-size_t BatchAction::memsize(bool recalc) const
-{
-	// Expensive operation, only evaluate once (won't change anyways)
-	if(!recalc && memory_size > 0) {
-		return memory_size;
-	}
-
-	uint32_t mem = sizeof(*this);
-	mem += sizeof(Action*) * 3 * batch.size();
-
-	for(const Action* action : batch) {
-#ifdef __USE_EXACT_MEMSIZE__
-		mem += action->memsize();
-#else
-		// Less exact but MUCH faster
-		mem += action->approx_memsize();
-#endif
-	}
-
-	const_cast<BatchAction*>(this)->memory_size = mem;
-	return mem;
-}
-
 bool BatchAction::isNoSelection() const noexcept
 {
 	return type != ACTION_SELECT && type != ACTION_UNSELECT;
@@ -436,6 +1045,7 @@ void BatchAction::addAction(Action* action)
 	ASSERT(action->getType() == type);
 
 	batch.push_back(action);
+	memory_size += sizeof(Action*) + action->memsize();
 	timestamp = time(nullptr);
 }
 
@@ -452,6 +1062,7 @@ void BatchAction::addAndCommitAction(Action* action)
 
 	action->commit(nullptr);
 	batch.push_back(action);
+	memory_size += sizeof(Action*) + action->memsize();
 	timestamp = time(nullptr);
 }
 
@@ -459,7 +1070,7 @@ void BatchAction::commit()
 {
 	for(Action* action : batch) {
 		if(action && !action->isCommited()) {
-			action->commit(nullptr);
+			commitAction(action, nullptr);
 		}
 	}
 }
@@ -467,35 +1078,75 @@ void BatchAction::commit()
 void BatchAction::undo()
 {
 	for(Action* action : std::views::reverse(batch)) {
-		action->undo(nullptr);
+		undoAction(action, nullptr);
 	}
 }
 
 void BatchAction::redo()
 {
 	for(Action* action : batch) {
-		action->redo(nullptr);
+		commitAction(action, nullptr);
+	}
+}
+
+void BatchAction::commitAction(Action* action, DirtyList* dirty_list)
+{
+	memory_size -= action->memsize();
+	action->commit(dirty_list);
+	memory_size += action->memsize();
+	reportProgress(action);
+}
+
+void BatchAction::undoAction(Action* action, DirtyList* dirty_list)
+{
+	memory_size -= action->memsize();
+	action->undo(dirty_list);
+	memory_size += action->memsize();
+	reportProgress(action);
+}
+
+void BatchAction::reportProgress(const Action* action)
+{
+	if(progress_total == 0) {
+		return;
+	}
+
+	// The view is redrawn with the load bar, so the change spreads over the map as it goes
+	progress_done += action->size();
+	const int32_t done = static_cast<int32_t>(std::min<size_t>(progress_done * 100 / progress_total, 99));
+	if(done != progress_shown) {
+		progress_shown = done;
+		g_gui.RefreshView();
+		g_gui.SetLoadDone(done);
 	}
 }
 
+size_t BatchAction::getChangeCount() const
+{
+	size_t count = 0;
+	for(const Action* action : batch) {
+		count += action->size();
+	}
+	return count;
+}
+
 void BatchAction::merge(BatchAction* other)
 {
 	batch.insert(batch.end(), other->batch.begin(), other->batch.end());
+	memory_size += other->memory_size - sizeof(BatchAction);
 	other->batch.clear();
+	other->memory_size = sizeof(BatchAction);
 }
 
 ActionQueue::ActionQueue(Editor& editor) :
-	current(0), memory_size(0), editor(editor)
+	current(0), memory_size(0), editor(editor), history_file(nullptr), spilled_batches(0), changes { 0, true }
 {
 	////
 }
 
 ActionQueue::~ActionQueue()
 {
-	for(BatchAction* batch : actions) {
-		delete batch;
-	}
-	actions.clear();
+	clear();
 }
 
 Action* ActionQueue::createAction(ActionIdentifier identifier) const
@@ -524,6 +1175,9 @@ void ActionQueue::addBatch(BatchAction* batch, int stacking_delay)
 	ASSERT(batch);
 	ASSERT(current <= actions.size());
 
+	// Committing swaps the copies in, and the batches dropped below free theirs
+	MapAllocator::Scope allocation_scope;
+
 	if(batch->empty()) {
 		delete batch;
 		return;
@@ -543,44 +1197,62 @@ void ActionQueue::addBatch(BatchAction* batch, int stacking_delay)
 	}
 
 	while(current != actions.size()) {
-		memory_size -= actions.back()->memsize();
 		BatchAction* todelete = actions.back();
 		actions.pop_back();
-		delete todelete;
+		deleteBatch(todelete);
 	}
 
-	while(memory_size > size_t(1024 * 1024 * g_settings.getInteger(Config::UNDO_MEM_SIZE)) && !actions.empty()) {
-		memory_size -= actions.front()->memsize();
-		delete actions.front();
-		actions.pop_front();
-		current--;
-	}
-
-	if(actions.size() > size_t(g_settings.getInteger(Config::UNDO_SIZE)) && !actions.empty()) {
-		memory_size -= actions.front()->memsize();
+	const std::shared_ptr<const SettingsSnapshot> settings = g_settings.getSnapshot();
+	if(actions.size() > settings->undo_size && !actions.empty()) {
 		BatchAction* todelete = actions.front();
 		actions.pop_front();
-		delete todelete;
+		deleteBatch(todelete);
 		current--;
+		changes.shifted = true;
 	}
 
 	do {
 		if(!actions.empty()) {
 			BatchAction* lastAction = actions.back();
-			if(lastAction->type == batch->type && g_settings.getInteger(Config::GROUP_ACTIONS) && time(nullptr) - stacking_delay < lastAction->timestamp) {
+			if(lastAction->type == batch->type && !lastAction->isSpilled() && settings->group_actions && time(nullptr) - stacking_delay < lastAction->timestamp) {
+				memory_size -= lastAction->memsize();
 				lastAction->merge(batch);
 				lastAction->timestamp = time(nullptr);
-				memory_size -= lastAction->memsize();
-				memory_size += lastAction->memsize(true);
+				memory_size += lastAction->memsize();
 				delete batch;
 				break;
 			}
 		}
+		// Merged batches are of the same type, the label stays
+		batch->label = createLabel(batch->getType());
 		memory_size += batch->memsize();
 		actions.push_back(batch);
 		batch->timestamp = time(nullptr);
 		current++;
 	} while(false);
+	changes.from = std::min(changes.from, actions.size() - 1);
+
+	// Over the budget the oldest batches go to the history file, the newest
+	// one stays in memory even if it is over the budget on its own
+	const size_t budget = settings->undo_mem_size;
+	size_t index = 0;
+	while(memory_size > budget && index + 1 < actions.size()) {
+		BatchAction* oldest = actions[index];
+		if(oldest->isSpilled() || spillBatch(oldest)) {
+			++index;
+			continue;
+		}
+
+		// It can't be written out, the history up to it is dropped instead
+		for(size_t count = 0; count <= index; ++count) {
+			BatchAction* todelete = actions.front();
+			actions.pop_front();
+			deleteBatch(todelete);
+			current--;
+		}
+		changes.shifted = true;
+		index = 0;
+	}
 }
 
 void ActionQueue::addAction(Action* action, int stacking_delay)
@@ -603,22 +1275,37 @@ const BatchAction* ActionQueue::getAction(size_t index) const
 	return nullptr;
 }
 
-void ActionQueue::generateLabels()
+ActionQueue::Changes ActionQueue::takeChanges() noexcept
 {
-	for(BatchAction* batch : actions) {
-		if(batch && batch->label.IsEmpty()) {
-			batch->label = createLabel(batch->getType());
-		}
-	}
+	const Changes taken = changes;
+	changes = { actions.size(), false };
+	return taken;
 }
 
 bool ActionQueue::undo()
 {
+	RME_TRACE_ZONE("action", "ActionQueue::undo");
 	if(current > 0) {
+		BatchAction* batch = actions.at(current - 1);
+		if(batch->isSpilled() && !restoreBatch(batch)) {
+			// Nothing from here on can be undone anymore
+			while(current > 0) {
+				BatchAction* todelete = actions.front();
+				actions.pop_front();
+				deleteBatch(todelete);
+				current--;
+			}
+			changes.shifted = true;
+			return false;
+		}
+
 		current--;
-		BatchAction* batch = actions.at(current);
 		if(batch) {
+			memory_size -= batch->memsize();
+			startProgress(batch, "Undoing " + createLabel(batch->getType()) + "...");
 			batch->undo();
+			finishProgress(batch);
+			memory_size += batch->memsize();
 		}
 
 		// Update title
@@ -632,10 +1319,25 @@ bool ActionQueue::undo()
 
 bool ActionQueue::redo()
 {
+	RME_TRACE_ZONE("action", "ActionQueue::redo");
 	if(current < actions.size()) {
 		BatchAction* batch = actions.at(current);
+		if(batch->isSpilled() && !restoreBatch(batch)) {
+			while(current < actions.size()) {
+				BatchAction* todelete = actions.back();
+				actions.pop_back();
+				deleteBatch(todelete);
+			}
+			changes.from = std::min(changes.from, actions.size());
+			return false;
+		}
+
 		if(batch) {
+			memory_size -= batch->memsize();
+			startProgress(batch, "Redoing " + createLabel(batch->getType()) + "...");
 			batch->redo();
+			finishProgress(batch);
+			memory_size += batch->memsize();
 		}
 		current++;
 
@@ -648,6 +1350,29 @@ bool ActionQueue::redo()
 	return false;
 }
 
+void ActionQueue::startProgress(BatchAction* batch, const wxString& message)
+{
+	const size_t count = batch->getChangeCount();
+	if(count < LargeBatchSize) {
+		return;
+	}
+
+	g_gui.CreateLoadBar(message);
+	batch->progress_total = count;
+	batch->progress_done = 0;
+	batch->progress_shown = -1;
+}
+
+void ActionQueue::finishProgress(BatchAction* batch)
+{
+	if(batch->progress_total == 0) {
+		return;
+	}
+
+	batch->progress_total = 0;
+	g_gui.DestroyLoadBar();
+}
+
 bool ActionQueue::hasChanges() const
 {
 	for(const BatchAction* batch : actions) {
@@ -660,11 +1385,132 @@ bool ActionQueue::hasChanges() const
 
 void ActionQueue::clear()
 {
-	for(BatchAction* batch : actions) {
-		delete batch;
+	// The batches hold copies of every tile they touched, they are freed off the UI thread
+	if(!actions.empty()) {
+		Reclaimer::getInstance().submit([batches = std::move(actions)]() {
+			for(BatchAction* batch : batches) {
+				delete batch;
+			}
+		});
 	}
 	actions.clear();
 	current = 0;
+	memory_size = 0;
+	changes = { 0, true };
+
+	if(history_file) {
+		fclose(history_file);
+		history_file = nullptr;
+	}
+	spilled_batches = 0;
+}
+
+void ActionQueue::deleteBatch(BatchAction* batch)
+{
+	memory_size -= batch->memsize();
+	if(batch->isSpilled() && --spilled_batches == 0) {
+		// Nothing in the file is used anymore, start over with an empty one
+		fclose(history_file);
+		history_file = nullptr;
+	}
+	delete batch;
+}
+
+bool ActionQueue::spillBatch(BatchAction* batch)
+{
+	// Only tile deltas can be written out, live sessions keep full tiles
+	if(editor.IsLive()) {
+		return false;
+	}
+
+	std::string data;
+	for(const Action* action : batch->batch) {
+		if(!action->serialize(data)) {
+			return false;
+		}
+	}
+
+	uLongf length = compressBound(data.size());
+	std::vector<uint8_t> compressed(length);
+	if(compress2(compressed.data(), &length, reinterpret_cast<const Bytef*>(data.data()), data.size(), Z_BEST_SPEED) != Z_OK) {
+		return false;
+	}
+
+	if(!history_file) {
+		history_file = tmpfile();
+		if(!history_file) {
+			return false;
+		}
+	}
+
+	if(!fileSeek(history_file, 0, SEEK_END)) {
+		return false;
+	}
+
+	int64_t offset = fileTell(history_file);
+	if(offset < 0 || fwrite(compressed.data(), 1, length, history_file) != length) {
+		return false;
+	}
+
+	memory_size -= batch->memsize();
+	batch->spill.offset = offset;
+	batch->spill.size = length;
+	batch->spill.raw_size = data.size();
+	batch->spill.actions = batch->batch.size();
+	for(Action* action : batch->batch) {
+		delete action;
+	}
+	batch->batch.clear();
+	batch->batch.shrink_to_fit();
+	batch->memory_size = sizeof(BatchAction);
+	memory_size += batch->memsize();
+
+	++spilled_batches;
+	return true;
+}
+
+bool ActionQueue::restoreBatch(BatchAction* batch)
+{
+	ASSERT(batch->isSpilled());
+	ASSERT(history_file);
+
+	std::vector<uint8_t> compressed(batch->spill.size);
+	if(!fileSeek(history_file, batch->spill.offset, SEEK_SET) || fread(compressed.data(), 1, compressed.size(), history_file) != compressed.size()) {
+		return false;
+	}
+
+	std::string data(batch->spill.raw_size, '\0');
+	uLongf length = data.size();
+	if(uncompress(reinterpret_cast<Bytef*>(data.data()), &length, compressed.data(), compressed.size()) != Z_OK || length != data.size()) {
+		return false;
+	}
+
+	ActionVector restored;
+	size_t position = 0;
+	for(uint32_t index = 0; index < batch->spill.actions; ++index) {
+		Action* action = createAction(batch);
+		restored.push_back(action);
+		if(!action->unserialize(data, position)) {
+			for(Action* action : restored) {
+				delete action;
+			}
+			return false;
+		}
+	}
+
+	memory_size -= batch->memsize();
+	batch->batch = std::move(restored);
+	batch->spill = BatchAction::Spill();
+	for(const Action* action : batch->batch) {
+		batch->memory_size += sizeof(Action*) + action->memsize();
+	}
+	memory_size += batch->memsize();
+
+	if(--spilled_batches == 0) {
+		fclose(history_file);
+		history_file = nullptr;
+	}
+	return true;
 }
 
 wxString ActionQueue::createLabel(ActionIdentifier type)
@@ -691,27 +1537,61 @@ wxString ActionQueue::createLabel(ActionIdentifier type)
 void DirtyList::AddPosition(int x, int y, int z)
 {
 	uint32_t m = ((x >> 2) << 18) | ((y >> 2) << 4);
-	ValueType fi = {m, 0};
-	SetType::iterator s = iset.find(fi);
-	if(s != iset.end()) {
-		ValueType v = *s;
-		iset.erase(s);
-		v.floors = (1 << z) | v.floors;
-		iset.insert(v);
+
+	ValueType* value;
+	if(ilast != 0 && inodes[ilast - 1].pos == m) {
+		value = &inodes[ilast - 1];
 	} else {
-		ValueType v = {m, (uint32_t)(1 << z)};
-		iset.insert(v);
+		if((inodes.size() + 1) * 2 > islots.size()) {
+			Grow();
+		}
+
+		uint32_t& slot = islots[FindSlot(m)];
+		if(slot == 0) {
+			inodes.push_back(ValueType { m, 0, { } });
+			slot = inodes.size();
+		}
+		ilast = slot;
+		value = &inodes[slot - 1];
 	}
+
+	value->floors |= (1 << z);
+	value->tiles[z] |= (1 << (((x & 3) * 4) + (y & 3)));
 }
 
-void DirtyList::AddChange(Change* c)
+size_t DirtyList::FindSlot(uint32_t pos) const
 {
-	ichanges.push_back(c);
+	// Node keys have their low bits clear, fold the high bits of the product down
+	const size_t mask = islots.size() - 1;
+	uint32_t hash = pos * 0x9E3779B1u;
+	size_t slot = (hash ^ (hash >> 16)) & mask;
+	while(islots[slot] != 0 && inodes[islots[slot] - 1].pos != pos) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+void DirtyList::Grow()
+{
+	islots.assign(std::max<size_t>(islots.size() * 2, 64), 0);
+	for(size_t index = 0; index < inodes.size(); ++index) {
+		islots[FindSlot(inodes[index].pos)] = index + 1;
+	}
+}
+
+uint16_t DirtyList::GetTileMask(uint32_t pos, int z) const
+{
+	if(islots.empty()) {
+		return 0;
+	}
+
+	uint32_t slot = islots[FindSlot(pos)];
+	return slot != 0 ? inodes[slot - 1].tiles[z] : 0;
 }
 
-DirtyList::SetType& DirtyList::GetPosList()
+void DirtyList::AddChange(Change* c)
 {
-	return iset;
+	ichanges.push_back(c);
 }
 
 ChangeList& DirtyList::GetChanges()
@@ -20,10 +20,15 @@
 
 #include "position.h"
 
+#include <array>
 #include <deque>
 
 class Editor;
+class BaseMap;
 class Tile;
+class TileLocation;
+class Spawn;
+class Creature;
 class House;
 class Waypoint;
 class Change;
@@ -52,6 +57,7 @@ enum ActionIdentifier {
 enum ChangeType {
 	CHANGE_NONE,
 	CHANGE_TILE,
+	CHANGE_TILE_DELTA,
 	CHANGE_MOVE_HOUSE_EXIT,
 	CHANGE_MOVE_WAYPOINT,
 };
@@ -66,6 +72,34 @@ struct WaypointData {
 	Position position;
 };
 
+// A tile kept in the history as its difference to the tile on the map at
+// the same location, instead of as a full copy. The items both have in
+// common at the bottom and at the top are only counted, the ones in between
+// are stored as OTBM item nodes.
+struct TileDelta {
+	~TileDelta();
+
+	uint32_t memsize() const;
+
+	TileLocation* location;
+	uint32_t house_id;
+	uint16_t mapflags;
+	uint16_t statflags;
+	ZoneSets::Handle zone_set;
+	Spawn* spawn;
+	Creature* creature;
+	bool has_ground;
+	// Items (ground included) of the map tile when the delta was made, and the crc32 of them as
+	// written, so the delta is never applied to a tile that has changed outside of the history
+	uint16_t base_count;
+	uint32_t base_crc;
+	uint16_t shared_bottom;
+	uint16_t shared_top;
+	// Selection state of every item, ground first
+	std::vector<bool> selected;
+	std::string items;
+};
+
 class Change
 {
 	Change();
@@ -81,12 +115,26 @@ public:
 
 	ChangeType getType() const noexcept { return type; }
 	void* getData() const noexcept { return data; }
+	// Position of the tile of a tile change
+	Position getPosition() const;
 
-	uint32_t memsize() const;
+	// Replaces the tile of a tile change by its delta to base, the tile
+	// that is on the map at its position
+	void compact(const Tile* base);
+	// Rebuilds the full tile of a delta change from the tile now on the map. Refused if that
+	// isn't the tile the delta was made against (remote edits in a live session, changes in
+	// place), the change is cleared then and false returned.
+	bool expand(BaseMap& map);
+
+	// Worked out whenever the data is replaced, the queue adds it up for every batch
+	uint32_t memsize() const noexcept { return size; }
 
 private:
+	void updateSize();
+
 	ChangeType type;
 	void* data;
+	uint32_t size;
 
 	friend class Action;
 };
@@ -100,29 +148,33 @@ public:
 	struct ValueType {
 		uint32_t pos;
 		uint32_t floors;
+		// Which of the 16 tiles of the node changed, per floor
+		std::array<uint16_t, rme::MapLayers> tiles;
 	};
 
 	uint32_t owner = 0;
 
-protected:
-	struct Comparator {
-		bool operator()(const ValueType& a, const ValueType& b) const {
-			return a.pos < b.pos;
-		}
-	};
-
-public:
-
-	typedef std::set<ValueType, Comparator> SetType;
+	typedef std::vector<ValueType> NodeList;
 
 	void AddPosition(int x, int y, int z);
 	void AddChange(Change* c);
-	bool Empty() const { return iset.empty() && ichanges.empty(); }
-	SetType& GetPosList();
+	bool Empty() const { return inodes.empty() && ichanges.empty(); }
+	// The changed nodes in the order they were first touched
+	const NodeList& GetPosList() const noexcept { return inodes; }
 	ChangeList& GetChanges();
+	// Which of the 16 tiles of the node changed on floor z, bit (x * 4) + y as in the live packets
+	uint16_t GetTileMask(uint32_t pos, int z) const;
 
 protected:
-	SetType iset;
+	// Slot of pos in the open addressing table, either holding it or empty
+	size_t FindSlot(uint32_t pos) const;
+	void Grow();
+
+	NodeList inodes;
+	// Index + 1 into inodes, 0 for an empty slot, the size is a power of two
+	std::vector<uint32_t> islots;
+	// The node most brush strokes keep hitting
+	uint32_t ilast = 0;
 	ChangeList ichanges;
 };
 
@@ -133,11 +185,11 @@ public:
 
 	void addChange(Change* t) {
 		changes.push_back(t);
+		memory_size += sizeof(Change*) + t->memsize();
 	}
 
-	// Get memory footprint
-	size_t approx_memsize() const;
-	size_t memsize() const;
+	// Get memory footprint, kept up to date as changes are added, committed and undone
+	size_t memsize() const noexcept { return memory_size; }
 	size_t size() const noexcept { return changes.size(); }
 	bool empty() const noexcept { return changes.empty(); }
 	ActionIdentifier getType() const noexcept { return type; }
@@ -150,10 +202,15 @@ public:
 protected:
 	Action(Editor& editor, ActionIdentifier ident);
 
+	// Appends the changes to data, false if some of them can only live in memory
+	bool serialize(std::string& data) const;
+	bool unserialize(const std::string& data, size_t& position);
+
 	bool commited;
 	ChangeList changes;
 	Editor& editor;
 	ActionIdentifier type;
+	size_t memory_size;
 
 	friend class ActionQueue;
 };
@@ -167,13 +224,17 @@ public:
 
 	void resetTimer() noexcept { timestamp = 0; }
 
-	// Get memory footprint
-	size_t memsize(bool resize = false) const;
-	size_t size() const noexcept { return batch.size(); }
-	bool empty() const noexcept { return batch.empty(); }
+	// Get memory footprint, kept up to date by the batch and its queue
+	size_t memsize() const noexcept { return memory_size; }
+	size_t size() const noexcept { return isSpilled() ? spill.actions : batch.size(); }
+	bool empty() const noexcept { return size() == 0; }
+	// The actions are in the history file of the queue, not in memory
+	bool isSpilled() const noexcept { return spill.size != 0; }
 	ActionIdentifier getType() const noexcept { return type; }
 	const wxString& getLabel() const noexcept { return label; }
 	bool isNoSelection() const noexcept;
+	// Changes of all of the actions
+	size_t getChangeCount() const;
 
 	virtual void addAction(Action* action);
 	virtual void addAndCommitAction(Action* action);
@@ -185,14 +246,33 @@ protected:
 	virtual void undo();
 	virtual void redo();
 
+	// Commit or undo one of the actions of the batch, keeping the footprint current
+	void commitAction(Action* action, DirtyList* dirty_list);
+	void undoAction(Action* action, DirtyList* dirty_list);
+	// Advances the load bar while the queue undoes or redoes a large batch
+	void reportProgress(const Action* action);
+
 	void merge(BatchAction* other);
 
+	// Where the actions are kept while the batch is spilled
+	struct Spill {
+		int64_t offset = 0;
+		uint32_t size = 0;
+		uint32_t raw_size = 0;
+		uint32_t actions = 0;
+	};
+
 	Editor& editor;
 	int timestamp;
-	uint32_t memory_size;
+	size_t memory_size;
 	ActionIdentifier type;
 	ActionVector batch;
+	Spill spill;
 	wxString label;
+	// Changes to go and done, no progress is shown while the total is 0
+	size_t progress_total;
+	size_t progress_done;
+	int32_t progress_shown;
 
 	friend class ActionQueue;
 };
@@ -225,18 +305,47 @@ public:
 	bool canRedo() const noexcept { return current < actions.size(); }
 	size_t size() const noexcept { return actions.size(); }
 	bool empty() const noexcept { return actions.empty(); }
+	// Of the batches in memory, spilled ones are on disk
+	size_t memsize() const noexcept { return memory_size; }
 
 	bool hasChanges() const;
 
-	void generateLabels();
+	// What changed in the history since the last call, for a view of it to
+	// redraw only those rows
+	struct Changes {
+		// The batches from this index on were added, merged or dropped at the back
+		size_t from;
+		// Batches were dropped from the front, every index moved
+		bool shifted;
+	};
+	Changes takeChanges() noexcept;
 
 protected:
 	static wxString createLabel(ActionIdentifier type);
 
+	// Moves the actions of an old batch to the history file, false if they
+	// can't be written out
+	bool spillBatch(BatchAction* batch);
+	// Reads the actions of a spilled batch back into memory
+	bool restoreBatch(BatchAction* batch);
+	void deleteBatch(BatchAction* batch);
+	// Batches with at least LargeBatchSize changes are undone and redone under the load bar,
+	// which keeps the map painting but takes the input until they are done
+	void startProgress(BatchAction* batch, const wxString& message);
+	void finishProgress(BatchAction* batch);
+
+	static const size_t LargeBatchSize = 50000;
+
 	size_t current;
+	// Of the batches in memory, spilled ones only count their own size
 	size_t memory_size;
 	Editor& editor;
 	ActionList actions;
+	// Compressed actions of the spilled batches, removed once there are none left
+	FILE* history_file;
+	size_t spilled_batches;
+	// Since the last takeChanges
+	Changes changes;
 };
 
 #endif
@@ -117,7 +117,8 @@ const wxBitmap& HistoryListBox::getIconBitmap(ActionIdentifier identifier) const
 }
 
 ActionsHistoryWindow::ActionsHistoryWindow(wxWindow* parent) :
-	wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(230, 250))
+	wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(230, 250)),
+	shown(nullptr)
 {
 	SetSizeHints(wxDefaultSize, wxDefaultSize);
 
@@ -145,24 +146,34 @@ void ActionsHistoryWindow::RefreshActions()
 		return;
 
 	const Editor* editor = g_gui.GetCurrentEditor();
-	if(!editor) {
-		list->SetItemCount(0);
+	ActionQueue* actions = editor ? editor->getHistoryActions() : nullptr;
+	if(!actions) {
+		shown = nullptr;
+		list->SetItemCount(editor ? 1 : 0);
 		list->Refresh();
 		return;
 	}
 
-	size_t count = 1;
-	int selection = 0;
-
-	const ActionQueue* actions = editor->getHistoryActions();
-	if(actions) {
-		count += actions->size();
-		selection += actions->getCurrentIndex();
+	// The first row is the map as it was opened
+	const ActionQueue::Changes changes = actions->takeChanges();
+	const size_t count = actions->size() + 1;
+	if(actions != shown || changes.shifted) {
+		shown = actions;
+		list->SetItemCount(count);
+		list->SetSelection(actions->getCurrentIndex());
+		list->Refresh();
+		return;
 	}
 
-	list->SetItemCount(count);
-	list->SetSelection(selection);
-	list->Refresh();
+	// Setting the count redraws every row shown, only done when there are more or fewer
+	if(count != list->GetItemCount()) {
+		list->SetItemCount(count);
+	} else if(changes.from + 1 < count) {
+		list->RefreshRows(changes.from + 1, count - 1);
+	}
+	if(list->GetSelection() != actions->getCurrentIndex()) {
+		list->SetSelection(actions->getCurrentIndex());
+	}
 }
 
 void ActionsHistoryWindow::OnListSelected(wxCommandEvent& event)
@@ -56,12 +56,16 @@ public:
 	ActionsHistoryWindow(wxWindow* parent);
 	virtual ~ActionsHistoryWindow();
 
+	// Redraws the rows of the batches that changed since, all of them when
+	// another map is shown or the oldest batches were dropped
 	void RefreshActions();
 
 	void OnListSelected(wxCommandEvent& event);
 
 protected:
 	HistoryListBox* list;
+	// The history the rows are of, never dereferenced
+	const ActionQueue* shown;
 };
 
 #endif
@@ -20,6 +20,7 @@
 #include "application.h"
 #include "sprites.h"
 #include "editor.h"
+#include "map_autosave.h"
 #include "common_windows.h"
 #include "palette_window.h"
 #include "preferences.h"
@@ -29,6 +30,9 @@
 #include "main_menubar.h"
 #include "updater.h"
 #include "artprovider.h"
+#include "batch_mode.h"
+#include "thread_pool.h"
+#include "tracing.h"
 
 #include "materials.h"
 #include "map.h"
@@ -45,6 +49,7 @@
 
 BEGIN_EVENT_TABLE(MainFrame, wxFrame)
 	EVT_CLOSE(MainFrame::OnExit)
+	EVT_ACTIVATE(MainFrame::OnActivate)
 
 	// Update check complete
 #ifdef _USE_UPDATER_
@@ -109,42 +114,52 @@ bool Application::OnInit()
 	// Discover data directory
 	g_gui.discoverDataDirectory("clients.xml");
 
+	RME_TRACE_THREAD("main");
+
 	// Tell that we are the real thing
 	wxAppConsole::SetInstance(this);
 	wxArtProvider::Push(new ArtProvider());
 
+	std::vector<std::string> arguments;
+	for(int index = 0; index < argc; ++index) {
+		arguments.push_back(nstr(argv[index]));
+	}
+	const bool batch = BatchMode::isRequested(arguments);
+
+	g_settings.load();
+
+#ifdef _USE_PROCESS_COM
+	// Before anything heavy is loaded, the running instance has all the client data already
+	if(!batch && ForwardToRunningInstance()) {
+		return false; //Since we return false - OnExit is never called
+	}
+#endif
+
 #if defined(__LINUX__) || defined(__WINDOWS__)
-	int argc = 1;
-	char* argv[1] = { wxString(this->argv[0]).char_str() };
-	glutInit(&argc, argv);
+	if(!batch) {
+		int argc = 1;
+		char* argv[1] = { wxString(this->argv[0]).char_str() };
+		glutInit(&argc, argv);
+	}
 #endif
 
 	// Load some internal stuff
-	g_settings.load();
 	FixVersionDiscrapencies();
 	g_gui.LoadHotkeys();
 	ClientVersion::loadVersions();
 
-#ifdef _USE_PROCESS_COM
-	m_single_instance_checker = newd wxSingleInstanceChecker; //Instance checker has to stay alive throughout the applications lifetime
-	if(g_settings.getInteger(Config::ONLY_ONE_INSTANCE) && m_single_instance_checker->IsAnotherRunning()) {
-		RMEProcessClient client;
-		wxConnectionBase* connection = client.MakeConnection("localhost", "rme_host", "rme_talk");
-		if(connection) {
-			wxString fileName;
-			if(ParseCommandLineMap(fileName)) {
-				wxLogNull nolog; //We might get a timeout message if the file fails to open on the running instance. Let's not show that message.
-				connection->Execute(fileName);
-			}
-			connection->Disconnect();
-			wxDELETE(connection);
-		}
-		wxDELETE(m_single_instance_checker);
-		return false; //Since we return false - OnExit is never called
+	if(batch) {
+		// No windows at all, OnRun runs the command instead of the event loop
+		g_gui.SetHeadless(true);
+		wxImage::AddHandler(newd wxPNGHandler);
+		m_batch = std::make_unique<BatchMode>(arguments);
+		return true;
 	}
+
+#ifdef _USE_PROCESS_COM
 	// We act as server then
 	m_proc_server = newd RMEProcessServer();
-	if(!m_proc_server->Create("rme_host")) {
+	if(!m_proc_server->Create(RMEProcessServer::GetServiceName())) {
 		wxLogWarning("Could not register IPC service!");
 	}
 #endif
@@ -261,6 +276,11 @@ bool Application::OnInit()
 			}
 		}
 	}
+
+	// Maps that had unsaved changes when the editor went down, from their last autosave
+	if(MapAutosave::Recover()) {
+		return true;
+	}
     // Keep track of first event loop entry
     m_startup = true;
 	return true;
@@ -321,6 +341,7 @@ void Application::Unload()
 {
 	g_gui.CloseAllEditors();
 	g_gui.UnloadVersion();
+	g_gui.UnloadResidentVersions();
 	g_gui.SaveHotkeys();
 	g_gui.SavePerspective();
 	g_gui.root->SaveRecentFiles();
@@ -330,6 +351,14 @@ void Application::Unload()
 	g_gui.root = nullptr;
 }
 
+int Application::OnRun()
+{
+	if(m_batch) {
+		return m_batch->run();
+	}
+	return wxApp::OnRun();
+}
+
 int Application::OnExit()
 {
 #ifdef _USE_PROCESS_COM
@@ -344,6 +373,33 @@ void Application::OnFatalException()
 	////
 }
 
+#ifdef _USE_PROCESS_COM
+bool Application::ForwardToRunningInstance()
+{
+	m_single_instance_checker = newd wxSingleInstanceChecker; //Instance checker has to stay alive throughout the applications lifetime
+	if(!g_settings.getInteger(Config::ONLY_ONE_INSTANCE) || !m_single_instance_checker->IsAnotherRunning()) {
+		return false;
+	}
+
+	// If the other instance doesn't answer this one starts as usual, without telling about it
+	wxLogNull nolog;
+	RMEProcessClient client;
+	wxConnectionBase* connection = client.MakeConnection("localhost", RMEProcessServer::GetServiceName(), "rme_talk");
+	if(!connection) {
+		return false;
+	}
+
+	wxString fileName;
+	if(ParseCommandLineMap(fileName)) {
+		connection->Execute(fileName);
+	}
+	// The client owns the connection
+	connection->Disconnect();
+	wxDELETE(m_single_instance_checker);
+	return true;
+}
+#endif
+
 bool Application::ParseCommandLineMap(wxString& fileName)
 {
 	if(argc == 2) {
@@ -398,7 +454,65 @@ MainFrame::~MainFrame() = default;
 
 void MainFrame::OnIdle(wxIdleEvent& event)
 {
-	////
+	// Idle events come during load bars and modal dialogs too, while the tasks on the pool may be
+	// reading the tiles that would be dropped
+	if(g_gui.IsLoadBarShown() || ThreadPool::getInstance().isBusy()) {
+		return;
+	}
+
+	// Paged maps drop the areas far from every view of them once they are over budget
+	std::map<Map*, std::vector<Position>> views;
+	for(int i = 0; i < g_gui.GetTabCount(); ++i) {
+		MapTab* tab = dynamic_cast<MapTab*>(g_gui.GetTab(i));
+		if(tab && tab->GetMap()->isPaged()) {
+			views[tab->GetMap()].push_back(tab->GetView()->GetScreenCenterPosition());
+		}
+	}
+	for(auto& [map, positions] : views) {
+		map->trimPagedAreas(positions);
+	}
+
+	// The maps that haven't been shown for a while hibernate, the one shown is kept awake
+	Editor* current = g_gui.GetCurrentEditor();
+	if(current) {
+		current->markActive();
+	}
+	std::set<Editor*> background;
+	for(int i = 0; i < g_gui.GetTabCount(); ++i) {
+		MapTab* tab = dynamic_cast<MapTab*>(g_gui.GetTab(i));
+		if(tab && tab->GetEditor() != current) {
+			background.insert(tab->GetEditor());
+		}
+	}
+	for(Editor* editor : background) {
+		editor->hibernateIfIdle();
+	}
+}
+
+void MainFrame::OnActivate(wxActivateEvent& event)
+{
+	// Another instance of the editor might have copied tiles in the meantime
+	if(event.GetActive() && g_gui.copybuffer.fetchClipboard()) {
+		UpdateMenubar();
+	}
+
+	// The brush files might have been edited in the meantime as well, they are reloaded once the
+	// activation went through so no dialog is shown from within it
+	if(event.GetActive() && g_settings.getInteger(Config::RELOAD_CHANGED_MATERIALS) && g_gui.IsVersionLoaded()) {
+		const std::vector<wxString> changed = g_materials.getChangedFiles();
+		if(!changed.empty()) {
+			CallAfter([changed]() {
+				wxString error;
+				wxArrayString warnings;
+				if(!g_gui.ReloadMaterials(error, warnings)) {
+					return;
+				}
+				g_gui.SetStatusText(wxString::Format("Reloaded the brushes, %d file(s) changed", (int)changed.size()));
+				g_gui.ListDialog("Warnings", warnings);
+			});
+		}
+	}
+	event.Skip();
 }
 
 #ifdef _USE_UPDATER_
@@ -647,8 +761,8 @@ int main(int argc, char** argv)
 	wxEntryStart(argc, argv); // Start the wxWidgets library
 	Application* app = new Application(); // Create the application object
 	wxApp::SetInstance(app); // Informs wxWidgets that app is the application object
-	wxEntry(); // Call the wxEntry() function to start the application execution
+	const int result = wxEntry(); // Call the wxEntry() function to start the application execution
 	wxEntryCleanup(); // Clear the wxWidgets library
-	return 0;
+	return result; // Batch mode reports through the exit code
 }
 #endif
@@ -34,6 +34,7 @@ class MainFrame;
 class MapWindow;
 class wxEventLoopBase;
 class wxSingleInstanceChecker;
+class BatchMode;
 
 class Application : public wxApp
 {
@@ -42,14 +43,20 @@ public:
 	virtual bool OnInit();
     virtual void OnEventLoopEnter(wxEventLoopBase* loop);
 	virtual void MacOpenFiles(const wxArrayString& fileNames);
+	virtual int OnRun();
 	virtual int OnExit();
 	void Unload();
 
 private:
     bool m_startup;
     wxString m_file_to_open;
+	std::unique_ptr<BatchMode> m_batch;
 	void FixVersionDiscrapencies();
 	bool ParseCommandLineMap(wxString& fileName);
+#ifdef _USE_PROCESS_COM
+	// Hands the map of the command line over to the instance already running, true if it took it
+	bool ForwardToRunningInstance();
+#endif
 
 	virtual void OnFatalException();
 
@@ -87,6 +94,7 @@ public:
 	void UpdateFloorMenu();
 	void UpdateIndicatorsMenu();
 	void OnIdle(wxIdleEvent& event);
+	void OnActivate(wxActivateEvent& event);
 	void OnExit(wxCloseEvent& event);
 
 #ifdef _USE_UPDATER_
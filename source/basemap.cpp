@@ -19,10 +19,25 @@
 
 #include "tile.h"
 #include "basemap.h"
+#include "reclaimer.h"
+
+#include <atomic>
+#include <numeric>
+
+namespace {
+	std::atomic<uint32_t> next_instance_id(0);
+}
 
 BaseMap::BaseMap() :
 	allocator(),
 	tilecount(0),
+	all_areas_dirty(false),
+	paged_out_count(0),
+	revision(0),
+	tiles_revision(0),
+	instance_id(++next_instance_id),
+	summaries_stale(false),
+	selection_swaps(false),
 	root(*this)
 {
 	////
@@ -30,21 +45,192 @@ BaseMap::BaseMap() :
 
 BaseMap::~BaseMap()
 {
-	////
+	// Freeing the tiles of a large map takes seconds, the tree goes to the reclaimer whole
+	std::vector<QTreeNode*> children = root.detachChildren();
+	if(!children.empty()) {
+		Reclaimer::getInstance().submit([children = std::move(children)]() {
+			for(QTreeNode* node : children)
+				MapAllocator::freeNode(node);
+		});
+	}
 }
 
 void BaseMap::clear(bool del)
 {
-	PositionVector pos_vec;
+	// Collect the locations first, they stay valid while the tiles are removed
+	// and spares us a tree lookup for every tile.
+	std::vector<TileLocation*> locations;
+	locations.reserve(tilecount);
 	for(MapIterator map_iter = begin(); map_iter != end(); ++map_iter) {
-		Tile* t = (*map_iter)->get();
-		pos_vec.push_back(t->getPosition());
+		locations.push_back(*map_iter);
+	}
+	for(TileLocation* location : locations) {
+		Tile* old_tile = location->tile;
+		location->tile = nullptr;
+		location->floor->setOccupied(location->getIndex(), false);
+		--tilecount;
+
+		if(del) {
+			updateItemIndex(old_tile, nullptr);
+			allocator.freeTile(old_tile);
+		}
+	}
+	paged_out.reset();
+	paged_out_count = 0;
+	std::fill(std::begin(floor_bounds), std::end(floor_bounds), TileBounds());
+	markAllAreasDirty();
+	markAllTilesChanged();
+}
+
+BaseMap::TileBounds BaseMap::getBounds() const noexcept
+{
+	TileBounds bounds;
+	for(const TileBounds& floor : floor_bounds) {
+		if(!floor.empty()) {
+			bounds.min_x = std::min(bounds.min_x, floor.min_x);
+			bounds.min_y = std::min(bounds.min_y, floor.min_y);
+			bounds.max_x = std::max(bounds.max_x, floor.max_x);
+			bounds.max_y = std::max(bounds.max_y, floor.max_y);
+		}
+	}
+	return bounds;
+}
+
+void BaseMap::setAreaPagedOut(uint32_t area, bool value)
+{
+	if(paged_out.test(area) != value) {
+		paged_out.set(area, value);
+		paged_out_count += value ? 1 : -1;
+	}
+}
+
+void BaseMap::pageInAll()
+{
+	for(uint32_t area = 0; area < paged_out.size() && paged_out_count != 0; ++area) {
+		if(paged_out.test(area))
+			loadPagedArea(area);
+	}
+}
+
+void BaseMap::pageInArea(int start_x, int start_y, int end_x, int end_y)
+{
+	if(paged_out_count == 0)
+		return;
+	start_x = std::max(start_x, 0) & 0xFF00;
+	start_y = std::max(start_y, 0) & 0xFF00;
+	end_x = std::min(end_x, rme::MapMaxWidth);
+	end_y = std::min(end_y, rme::MapMaxHeight);
+	for(int y = start_y; y <= end_y; y += 0x100) {
+		for(int x = start_x; x <= end_x; x += 0x100) {
+			pageIn(x, y);
+		}
 	}
-	for(PositionVector::iterator pos_iter = pos_vec.begin(); pos_iter != pos_vec.end(); ++pos_iter) {
-		setTile(*pos_iter, nullptr, del);
+}
+
+void BaseMap::releaseArea(int x, int y)
+{
+	x &= 0xFF00;
+	y &= 0xFF00;
+
+	// Through setTile, so the tile count and the item indexes follow
+	visitFloors(x, y, x + 0xFF, y + 0xFF, rme::MapMinLayer, rme::MapMaxLayer, [&](Floor* floor, int, int, int) {
+		for(TileLocation& location : floor->locs) {
+			if(location.get()) {
+				setTile(location.getPosition(), nullptr, true);
+			}
+		}
+	});
+
+	markAllTilesChanged();
+}
+
+QTreeNode* BaseMap::forceLeaf(int x, int y)
+{
+	QTreeNode* leaf = findLeaf(x, y);
+	return leaf? leaf : root.getLeafForce(x, y);
+}
+
+void BaseMap::registerLeaf(int x, int y, QTreeNode* leaf)
+{
+	if(!leaf_grid)
+		leaf_grid = std::make_unique<std::unique_ptr<LeafBlock>[]>(0x10000);
+	std::unique_ptr<LeafBlock>& block = leaf_grid[getAreaIndex(x, y)];
+	if(!block)
+		block = std::make_unique<LeafBlock>();
+	block->leaves[(uint32_t(x) >> 2) & 63][(uint32_t(y) >> 2) & 63] = leaf;
+}
+
+size_t BaseMap::compact()
+{
+	MapAllocator::beginCompaction();
+	visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [this](QTreeNode* leaf, int, int) {
+		bool moved = false;
+		for(Floor* floor : std::span(leaf->getFloors(), rme::MapLayers)) {
+			if(!floor)
+				continue;
+			for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1) {
+				TileLocation& location = floor->locs[std::countr_zero(mask)];
+				Tile* tile = location.tile;
+				if(tile->isSelected())
+					continue;
+				// The copy holds the same, the item indexes and summaries stay as they are
+				location.tile = tile->deepCopy(*this);
+				delete tile;
+				moved = true;
+			}
+		}
+		// The drawing caches may point at the old tiles
+		if(moved) {
+			leaf->revision = nextRevision();
+			leaf->draw_revision = leaf->revision;
+		}
+	});
+	return MapAllocator::endCompaction();
+}
+
+void BaseMap::markTileChanged(int x, int y)
+{
+	QTreeNode* leaf = getLeaf(x, y);
+	if(leaf) {
+		leaf->revision = nextRevision();
+		leaf->draw_revision = leaf->revision;
+		// The tiles may have gained anything, their summary goes up the tree again
+		if(!summaries_stale)
+			addSummary(x, y, leaf->rebuildSummary());
 	}
 }
 
+void BaseMap::addSummary(int x, int y, const TileSummary& summary)
+{
+	if(summaries_stale)
+		return;
+
+	QTreeNode* node = &root;
+	uint32_t cx = x, cy = y;
+	while(node) {
+		node->summary.add(summary);
+		if(node->isLeaf)
+			break;
+		node = node->child[((cx & 0xC000) >> 14) | ((cy & 0xC000) >> 12)];
+		cx <<= 2;
+		cy <<= 2;
+	}
+}
+
+void BaseMap::updateSummaries()
+{
+	if(summaries_stale) {
+		root.rebuildSummary();
+		summaries_stale = false;
+	}
+}
+
+const TileSummary& BaseMap::getSummary()
+{
+	updateSummaries();
+	return root.summary;
+}
+
 void BaseMap::clearVisible(uint32_t mask)
 {
 	root.clearVisible(mask);
@@ -53,7 +239,8 @@ void BaseMap::clearVisible(uint32_t mask)
 Tile* BaseMap::createTile(int x, int y, int z)
 {
 	ASSERT(z < rme::MapLayers);
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	pageIn(x, y);
+	QTreeNode* leaf = forceLeaf(x, y);
 	TileLocation* loc = leaf->createTile(x, y, z);
 	if(loc->get())
 		return loc->get();
@@ -65,7 +252,8 @@ Tile* BaseMap::createTile(int x, int y, int z)
 TileLocation* BaseMap::getTileL(int x, int y, int z)
 {
 	ASSERT(z < rme::MapLayers);
-	QTreeNode* leaf = root.getLeaf(x, y);
+	pageIn(x, y);
+	QTreeNode* leaf = findLeaf(x, y);
 	if(leaf) {
 		Floor* floor = leaf->getFloor(z);
 		if(floor)
@@ -74,6 +262,30 @@ TileLocation* BaseMap::getTileL(int x, int y, int z)
 	return nullptr;
 }
 
+TileNeighbourhood::TileNeighbourhood(BaseMap& map, const Position& center) :
+	x(center.x), y(center.y),
+	leaf_x((center.x - 1) >> 2), leaf_y((center.y - 1) >> 2)
+{
+	ASSERT(center.z < rme::MapLayers);
+	// The square only reaches into the second column or row of leaves when the center is on a leaf edge
+	const int last_x = (x + 1) >> 2;
+	const int last_y = (y + 1) >> 2;
+	for(int i = 0; i < 2; ++i) {
+		for(int j = 0; j < 2; ++j) {
+			floors[i][j] = nullptr;
+			int lx = leaf_x + i;
+			int ly = leaf_y + j;
+			if(lx < 0 || ly < 0 || lx > last_x || ly > last_y)
+				continue;
+			if(lx * 4 > rme::MapMaxWidth || ly * 4 > rme::MapMaxHeight)
+				continue;
+			QTreeNode* leaf = map.getLeaf(lx * 4, ly * 4);
+			if(leaf)
+				floors[i][j] = leaf->getFloor(center.z);
+		}
+	}
+}
+
 const TileLocation* BaseMap::getTileL(int x, int y, int z) const
 {
 	// Don't create static const maps!
@@ -95,7 +307,8 @@ TileLocation* BaseMap::createTileL(int x, int y, int z)
 {
 	ASSERT(z < rme::MapLayers);
 
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	pageIn(x, y);
+	QTreeNode* leaf = forceLeaf(x, y);
 	Floor* floor = leaf->createFloor(x, y, z);
 	uint32_t offsetX = x & 3;
 	uint32_t offsetY = y & 3;
@@ -108,17 +321,73 @@ TileLocation* BaseMap::createTileL(const Position& pos)
 	return createTileL(pos.x, pos.y, pos.z);
 }
 
+namespace
+{
+	// Indices of the positions, ordered by the leaf they are on
+	std::vector<size_t> sortByLeaf(const PositionVector& positions)
+	{
+		std::vector<size_t> order(positions.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&positions](size_t a, size_t b) {
+			const Position& pa = positions[a];
+			const Position& pb = positions[b];
+			return std::make_pair(pa.x >> 2, pa.y >> 2) < std::make_pair(pb.x >> 2, pb.y >> 2);
+		});
+		return order;
+	}
+}
+
+std::vector<TileLocation*> BaseMap::createTileLocations(const PositionVector& positions)
+{
+	std::vector<TileLocation*> locations(positions.size(), nullptr);
+	QTreeNode* leaf = nullptr;
+	int leaf_x = 0, leaf_y = 0;
+	for(size_t index : sortByLeaf(positions)) {
+		const Position& pos = positions[index];
+		ASSERT(pos.z < rme::MapLayers);
+		if(!leaf || (pos.x >> 2) != leaf_x || (pos.y >> 2) != leaf_y) {
+			pageIn(pos.x, pos.y);
+			leaf = forceLeaf(pos.x, pos.y);
+			leaf_x = pos.x >> 2;
+			leaf_y = pos.y >> 2;
+		}
+		locations[index] = leaf->createTile(pos.x, pos.y, pos.z);
+	}
+	return locations;
+}
+
+void BaseMap::createTiles(const PositionVector& positions)
+{
+	QTreeNode* leaf = nullptr;
+	int leaf_x = 0, leaf_y = 0;
+	for(size_t index : sortByLeaf(positions)) {
+		const Position& pos = positions[index];
+		ASSERT(pos.z < rme::MapLayers);
+		if(!leaf || (pos.x >> 2) != leaf_x || (pos.y >> 2) != leaf_y) {
+			pageIn(pos.x, pos.y);
+			leaf = forceLeaf(pos.x, pos.y);
+			leaf_x = pos.x >> 2;
+			leaf_y = pos.y >> 2;
+		}
+		TileLocation* location = leaf->createTile(pos.x, pos.y, pos.z);
+		if(!location->get()) {
+			leaf->setTile(pos.x, pos.y, pos.z, allocator(location));
+		}
+	}
+}
+
 void BaseMap::setTile(int x, int y, int z, Tile* new_tile, bool remove)
 {
 	ASSERT(!new_tile || new_tile->getX() == x);
 	ASSERT(!new_tile || new_tile->getY() == y);
 	ASSERT(!new_tile || new_tile->getZ() == z);
 
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	pageIn(x, y);
+	QTreeNode* leaf = forceLeaf(x, y);
 	Tile* old_tile = leaf->setTile(x, y, z, new_tile);
 
 	if ((remove && old_tile) || new_tile)
-		updateUniqueIds(remove ? old_tile : nullptr, new_tile);
+		updateItemIndex(remove ? old_tile : nullptr, new_tile);
 
 	if (remove) {
 		delete old_tile;
@@ -145,11 +414,12 @@ Tile* BaseMap::swapTile(int x, int y, int z, Tile* new_tile)
 	ASSERT(!new_tile || new_tile->getY() == y);
 	ASSERT(!new_tile || new_tile->getZ() == z);
 
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	pageIn(x, y);
+	QTreeNode* leaf = forceLeaf(x, y);
 	Tile* old_tile = leaf->setTile(x, y, z, new_tile);
 
 	if (old_tile || new_tile)
-		updateUniqueIds(old_tile, new_tile);
+		updateItemIndex(old_tile, new_tile);
 
 	return old_tile;
 }
@@ -190,51 +460,8 @@ MapIterator BaseMap::begin()
 {
 	MapIterator it(this);
 	it.nodestack.push_back(MapIterator::NodeIndex(&root));
-
-	while(true) {
-		MapIterator::NodeIndex& current = it.nodestack.back();
-		QTreeNode* node = current.node;
-		int& index = current.index;
-		//printf("Contemplating %p of %p (stack size %d)\n", node, this, it.nodestack.size());
-
-		bool unwind = false;
-		for(; index < 16; ++index) {
-			//printf("\tChecking index %d of %p\n", index, node);
-			if(QTreeNode* child = node->child[index]) {
-				if(child->isLeaf) {
-					QTreeNode* leaf = child;
-					//printf("\t%p is leaf\n", child);
-					for(it.local_z = 0; it.local_z < rme::MapLayers; ++it.local_z) {
-						if(Floor* floor = leaf->array[it.local_z]) {
-							for(it.local_i = 0; it.local_i < 16; ++it.local_i) {
-								//printf("\tit(%d;%d;%d)\n", it.local_x, it.local_y, it.local_z);
-								TileLocation& t = floor->locs[it.local_i];
-								if(t.get()) {
-									//printf("return it\n");
-									it.current_tile = &t;
-									return it;
-								}
-							}
-						}
-					}
-				} else {
-					//printf("\tAdding %p\n", child);
-					++index;
-					it.nodestack.push_back(MapIterator::NodeIndex(child));
-					unwind = true;
-					break;
-				}
-			}
-		}
-		if(unwind)
-			continue;
-
-		//printf("Discarding dead node %p\n", node);
-		it.nodestack.pop_back();
-		if(it.nodestack.empty())
-			break;
-	}
-	return end();
+	it.seek();
+	return it;
 }
 
 MapIterator BaseMap::end()
@@ -257,77 +484,55 @@ TileLocation* MapIterator::operator->()
 
 MapIterator& MapIterator::operator++()
 {
-	//printf("MapIterator::operator++");
-	bool increased = false;
-	bool first = true;
-	while(true) {
-		MapIterator::NodeIndex& current = nodestack.back();
+	++local_i;
+	seek();
+	return *this;
+}
+
+bool MapIterator::seek()
+{
+	while(!nodestack.empty()) {
+		NodeIndex& current = nodestack.back();
 		QTreeNode* node = current.node;
 		int& index = current.index;
-		//printf("Contemplating %p (stack size %d)\n", node, nodestack.size());
-
-		bool unwind = false;
-		for(; index < rme::MapLayers; ++index) {
-			//printf("\tChecking index %d of %p\n", index, node);
-			if(QTreeNode* child = node->child[index]) {
-				if(child->isLeaf) {
-					QTreeNode* leaf = child;
-					//printf("\t%p is leaf\n", child);
-					for(; local_z < rme::MapLayers; ++local_z) {
-						//printf("\t\tIterating over Z:%d of %p", local_z, child);
-						if(Floor* floor = leaf->array[local_z]) {
-							//printf("\n");
-							for(; local_i < rme::MapLayers; ++local_i) {
-								//printf("\t\tIterating over Y:%d of %p\n", local_y, child);
-								TileLocation& t = floor->locs[local_i];
-								if(t.get()) {
-									if(increased) {
-										//printf("Modified %p to %p\n", current_tile, t);
-										current_tile = &t;
-										return *this;
-									} else {
-										increased = true;
-									}
-								} else if(first) {
-									increased = true;
-									first = false;
-								}
-							}
-
-							if(local_i > rme::MapMaxLayer) {
-								//printf("\t\tReset local_x\n");
-								local_i = 0;
-							}
-						} else {
-							//printf(":dead floor\n");
-						}
-					} if(local_z == rme::MapLayers) {
-							//printf("\t\tReset local_z\n");
-							local_z = 0;
-					}
-				} else {
-					//printf("\tAdding %p\n", child);
-					++index;
-					nodestack.push_back(MapIterator::NodeIndex(child));
-					unwind = true;
-					break;
+
+		bool descended = false;
+		for(; index < QTreeNode::ChildCount; ++index) {
+			QTreeNode* child = node->child[index];
+			if(!child)
+				continue;
+
+			if(!child->isLeaf) {
+				++index;
+				nodestack.push_back(NodeIndex(child));
+				descended = true;
+				break;
+			}
+
+			for(; local_z < rme::MapLayers; ++local_z, local_i = 0) {
+				Floor* floor = child->array[local_z];
+				if(!floor)
+					continue;
+				// The slots from local_i on that hold a tile
+				const uint32_t mask = floor->getOccupied() & (0xFFFFu << local_i);
+				if(mask != 0) {
+					local_i = std::countr_zero(mask);
+					current_tile = &floor->locs[local_i];
+					return true;
 				}
 			}
+			local_z = 0;
+			local_i = 0;
 		}
-		if(unwind)
-			continue;
-
-		//printf("Discarding dead node %p\n", node);
-		nodestack.pop_back();
-		if(nodestack.size() == 0) {
-			// Set all values to "end"
-			//printf("END\n");
-			local_z = -1;
-			local_i = -1;
-			return *this;
-		}
+		if(!descended)
+			nodestack.pop_back();
 	}
-	return *this;
+
+	// Set all values to "end"
+	local_z = -1;
+	local_i = -1;
+	current_tile = nullptr;
+	return false;
 }
 
 MapIterator MapIterator::operator++(int)
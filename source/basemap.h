@@ -24,6 +24,11 @@
 #include "map_allocator.h"
 #include "tile.h"
 
+#include <bit>
+#include <bitset>
+#include <memory>
+#include <span>
+
 // Class declarations
 class QTreeNode;
 class BaseMap;
@@ -65,6 +70,9 @@ public:
 		}
 	};
 private:
+	// Moves to the first tile from the current slot on, false at the end of the map
+	bool seek();
+
 	std::vector<NodeIndex> nodestack;
 	int local_i, local_z;
 	TileLocation* current_tile;
@@ -95,12 +103,38 @@ public:
 	TileLocation* getTileL(const Position& pos);
 	TileLocation* createTileL(int x, int y, int z);
 	TileLocation* createTileL(const Position& pos);
+	// Batched createTileL/createTile, the tree is descended once per leaf instead of once per position.
+	// The locations are returned in the order of the positions, which all have to be valid.
+	std::vector<TileLocation*> createTileLocations(const PositionVector& positions);
+	void createTiles(const PositionVector& positions);
 	const TileLocation* getTileL(int x, int y, int z) const;
 	const TileLocation* getTileL(const Position& pos) const;
 
 	// Get a Quad Tree Leaf from the map
-	QTreeNode* getLeaf(int x, int y) { return root.getLeaf(x, y); }
-	QTreeNode* createLeaf(int x, int y) { return root.getLeafForce(x, y); }
+	QTreeNode* getLeaf(int x, int y) { pageIn(x, y); return findLeaf(x, y); }
+	QTreeNode* createLeaf(int x, int y) { pageIn(x, y); return forceLeaf(x, y); }
+
+	// Range queries, the box is inclusive and only the parts of the tree that exist are visited.
+	// func(QTreeNode* leaf, int x, int y) gets every leaf intersecting the box, x/y being its first tile.
+	template <typename Func>
+	void visitLeaves(int start_x, int start_y, int end_x, int end_y, Func&& func);
+	// func(Floor* floor, int x, int y, int z) gets the 4x4 tiles a leaf has on each floor from min_z to max_z,
+	// floor->locs[(x & 3) * 4 + (y & 3)], tiles of the floor outside the box have to be skipped by the caller.
+	template <typename Func>
+	void visitFloors(int start_x, int start_y, int end_x, int end_y, int min_z, int max_z, Func&& func);
+
+	// As visitLeaves, leaving out the subtrees whose TileSummary can't match the filter. The summaries
+	// follow the tiles set through the map and the leaves marked changed, like the drawing caches, and
+	// are made again here after markAllTilesChanged. Not to be called while other threads change the map.
+	template <typename Func>
+	void visitLeavesMatching(int start_x, int start_y, int end_x, int end_y, const TileSummary& filter, Func&& func);
+	// What the whole map may hold
+	const TileSummary& getSummary();
+
+	// Full map scans, func(std::span<Tile* const> tiles) gets the tiles of a leaf all at once, leaf
+	// after leaf, without the empty slots and floors.
+	template <typename Func>
+	void visitTileChunks(Func&& func);
 
 	// Assigns a tile, it might seem pointless to provide position, but it is not, as the passed tile may be nullptr
 	void setTile(int x, int y, int z, Tile* new_tile, bool remove = false);
@@ -113,20 +147,200 @@ public:
 	// Clears the visiblity according to the mask passed
 	void clearVisible(uint32_t mask);
 
+	// Copies the tiles and items of the map leaf after leaf, in the order of the tree, into slabs
+	// of their own and frees the old ones. After a long session they are spread over the pools in
+	// the order they were edited in, scans and drawing run as they did after loading again.
+	// Selected tiles are left where they are, the selection holds them. Returns the bytes of the
+	// slabs handed back to the system. Not to be called while other threads use the map.
+	size_t compact();
+
 	uint64_t getTileCount() const noexcept { return tilecount; }
 
+	// Extent of the tiles put on a floor, kept as they are added so nothing has to walk the map
+	// for it. Removing tiles doesn't shrink it, it may be larger than what is left on the floor.
+	struct TileBounds {
+		int min_x = rme::MapMaxWidth + 1;
+		int min_y = rme::MapMaxHeight + 1;
+		int max_x = -1;
+		int max_y = -1;
+
+		bool empty() const noexcept { return max_x < min_x; }
+	};
+	const TileBounds& getFloorBounds(int z) const { return floor_bounds[z]; }
+	// The bounds of every floor together
+	TileBounds getBounds() const noexcept;
+
+	// Tracks which 256x256 areas have changed since the map was last loaded or saved,
+	// so saving can reuse the unchanged parts of the previous file
+	void markAreaDirty(int x, int y) { dirty_areas.set(getAreaIndex(x, y)); }
+	void markAllAreasDirty() noexcept { all_areas_dirty = true; }
+	bool isAreaDirty(int x, int y) const { return all_areas_dirty || dirty_areas.test(getAreaIndex(x, y)); }
+	bool areAllAreasDirty() const noexcept { return all_areas_dirty; }
+	void clearDirtyAreas() { dirty_areas.reset(); all_areas_dirty = false; }
+
+	static uint32_t getAreaIndex(int x, int y) noexcept { return ((uint32_t(y) & 0xFF00) | ((uint32_t(x) & 0xFF00) >> 8)); }
+
+	// A paged map keeps the tiles of some 256x256 areas in its file only. Looking up a tile or a leaf
+	// of such an area reads it back first, range queries and iterators only see the areas in memory.
+	bool isAreaPagedOut(int x, int y) const { return paged_out_count != 0 && paged_out.test(getAreaIndex(x, y)); }
+	size_t getPagedOutCount() const noexcept { return paged_out_count; }
+	// Reads paged out areas back in, every one of them or those overlapping the rectangle. Tasks on
+	// the ThreadPool can't, to them a paged out area is empty, so what they read is paged in before.
+	void pageInAll();
+	void pageInArea(int start_x, int start_y, int end_x, int end_y);
+
+	// Drawing caches keep what they made of a leaf as long as its revision stays the same,
+	// tiles that are changed in place instead of through setTile have to be marked
+	void markTileChanged(int x, int y);
+	void markAllTilesChanged() noexcept { tiles_revision = nextRevision(); summaries_stale = true; }
+	uint32_t getTilesRevision() const noexcept { return tiles_revision; }
+	// The latest revision handed out, it changes whenever any leaf does
+	uint32_t getRevision() const noexcept { return revision; }
+	uint32_t nextRevision() noexcept { return ++revision; }
+	// While set, tiles put through setTile only differ in what is selected on them, the leaves
+	// keep their draw revision
+	void setSelectionSwaps(bool swaps) noexcept { selection_swaps = swaps; }
+	bool isSelectionSwaps() const noexcept { return selection_swaps; }
+	// Tells apart maps that were allocated at the same address, the revisions of each start over
+	uint32_t getInstanceId() const noexcept { return instance_id; }
+
 	MapAllocator allocator;
 
 protected:
-	virtual void updateUniqueIds(Tile* old_tile, Tile* new_tile) { }
+	// Called whenever a tile leaves or enters the map, so derived maps can keep item indexes
+	virtual void updateItemIndex(Tile* old_tile, Tile* new_tile) { }
+
+	void pageIn(int x, int y) {
+		if(isAreaPagedOut(x, y))
+			loadPagedArea(getAreaIndex(x, y));
+	}
+	// Reads a paged out area back in, it has to clear the area with setAreaPagedOut before
+	virtual void loadPagedArea(uint32_t area) { }
+	void setAreaPagedOut(uint32_t area, bool value);
+	// Frees the tiles of the 256x256 area holding x/y, its leaves and locations stay as the undo
+	// history points at them
+	void releaseArea(int x, int y);
+	void clearAreaDirty(uint32_t area) { dirty_areas.reset(area); }
+
+	// Adds to the summaries of the nodes down to the leaf holding x/y
+	void addSummary(int x, int y, const TileSummary& summary);
+	void updateSummaries();
+
+	// The leaf holding x/y from the leaf grid, two array reads instead of a descent of the tree
+	QTreeNode* findLeaf(int x, int y) const noexcept;
+	QTreeNode* forceLeaf(int x, int y);
+	// Called by the tree for every leaf it makes
+	void registerLeaf(int x, int y, QTreeNode* leaf);
+
+	void extendBounds(int x, int y, int z) noexcept {
+		TileBounds& bounds = floor_bounds[z];
+		bounds.min_x = std::min(bounds.min_x, x);
+		bounds.min_y = std::min(bounds.min_y, y);
+		bounds.max_x = std::max(bounds.max_x, x);
+		bounds.max_y = std::max(bounds.max_y, y);
+	}
 
 	uint64_t tilecount;
+	TileBounds floor_bounds[rme::MapLayers];
+
+	std::bitset<0x10000> dirty_areas;
+	bool all_areas_dirty;
+
+	std::bitset<0x10000> paged_out;
+	size_t paged_out_count;
+
+	uint32_t revision;
+	uint32_t tiles_revision;
+	const uint32_t instance_id;
+	bool summaries_stale;
+	bool selection_swaps;
 
 	QTreeNode root; // The Quad Tree root
 
+	// Every leaf of the tree by position, a block of 64x64 leaves per 256x256 area. The table of
+	// areas is made along with the first leaf and a block along with the first leaf of its area.
+	struct LeafBlock {
+		QTreeNode* leaves[64][64] = {};
+	};
+	std::unique_ptr<std::unique_ptr<LeafBlock>[]> leaf_grid;
+
 	friend class QTreeNode;
 };
 
+// The tiles of one floor in the 3x3 square around a position. The leaves
+// covering the square are looked up once, so reading a neighbour is an
+// array access instead of a descent of the tree.
+class TileNeighbourhood
+{
+public:
+	TileNeighbourhood(BaseMap& map, const Position& center);
+
+	// dx and dy are offsets from the center, -1 to 1
+	Tile* getTile(int dx, int dy) const;
+
+private:
+	int x, y;
+	int leaf_x, leaf_y; // The leaf, in leaf units, holding the north-west corner of the square
+	Floor* floors[2][2];
+};
+
+template <typename Func>
+inline void BaseMap::visitLeaves(int start_x, int start_y, int end_x, int end_y, Func&& func)
+{
+	if(start_x > end_x || start_y > end_y || end_x < 0 || end_y < 0)
+		return;
+	root.visitLeaves(0, 0, 0x10000, start_x, start_y, end_x, end_y, func);
+}
+
+template <typename Func>
+inline void BaseMap::visitFloors(int start_x, int start_y, int end_x, int end_y, int min_z, int max_z, Func&& func)
+{
+	min_z = std::max(min_z, rme::MapMinLayer);
+	max_z = std::min(max_z, rme::MapMaxLayer);
+	visitLeaves(start_x, start_y, end_x, end_y, [&](QTreeNode* leaf, int x, int y) {
+		for(int z = min_z; z <= max_z; ++z) {
+			Floor* floor = leaf->getFloor(z);
+			if(floor)
+				func(floor, x, y, z);
+		}
+	});
+}
+
+template <typename Func>
+inline void BaseMap::visitLeavesMatching(int start_x, int start_y, int end_x, int end_y, const TileSummary& filter, Func&& func)
+{
+	if(start_x > end_x || start_y > end_y || end_x < 0 || end_y < 0)
+		return;
+	updateSummaries();
+	root.visitLeavesMatching(0, 0, 0x10000, start_x, start_y, end_x, end_y, filter, func);
+}
+
+template <typename Func>
+inline void BaseMap::visitTileChunks(Func&& func)
+{
+	visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int, int) {
+		Tile* tiles[rme::MapLayers * 16];
+		size_t count = 0;
+		for(Floor* floor : std::span(leaf->getFloors(), rme::MapLayers)) {
+			if(!floor)
+				continue;
+			for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1)
+				tiles[count++] = floor->locs[std::countr_zero(mask)].get();
+		}
+		if(count != 0)
+			func(std::span<Tile* const>(tiles, count));
+	});
+}
+
+inline QTreeNode* BaseMap::findLeaf(int x, int y) const noexcept
+{
+	if(!leaf_grid)
+		return nullptr;
+	// The tree only goes by the low 16 bits of the coordinates, so does the grid
+	const LeafBlock* block = leaf_grid[getAreaIndex(x, y)].get();
+	return block? block->leaves[(uint32_t(x) >> 2) & 63][(uint32_t(y) >> 2) & 63] : nullptr;
+}
+
 inline Tile* BaseMap::getTile(int x, int y, int z)
 {
 	TileLocation* l = getTileL(x, y, z);
@@ -151,4 +365,14 @@ inline const Tile* BaseMap::getTile(const Position& pos) const
 	return l? l->get() : nullptr;
 }
 
+inline Tile* TileNeighbourhood::getTile(int dx, int dy) const
+{
+	int nx = x + dx;
+	int ny = y + dy;
+	if(nx < 0 || ny < 0)
+		return nullptr;
+	Floor* floor = floors[(nx >> 2) - leaf_x][(ny >> 2) - leaf_y];
+	return floor? floor->locs[(nx & 3)*4 + (ny & 3)].get() : nullptr;
+}
+
 #endif
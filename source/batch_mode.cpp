@@ -0,0 +1,662 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "batch_mode.h"
+#include "decoder_fuzzer.h"
+#include "editor.h"
+#include "gui.h"
+#include "iomap_otbm.h"
+#include "iominimap.h"
+#include "items.h"
+#include "map_benchmark.h"
+#include "map_generator.h"
+#include "map_hash.h"
+#include "session_recorder.h"
+#include "settings.h"
+#include "thread_pool.h"
+#include "tracing.h"
+
+BatchMode::BatchMode(const std::vector<std::string>& arguments)
+{
+	// Options come first, then the command and what it works on
+	size_t index = 1;
+	for(; index < arguments.size(); ++index) {
+		const std::string& argument = arguments[index];
+		if(argument == "--batch") {
+			continue;
+		} else if(argument.compare(0, 10, "--threads=") == 0) {
+			// The pool is only started on first use, so this is still in time
+			g_settings.setInteger(Config::WORKER_THREADS, std::max(std::atoi(argument.c_str() + 10), 1));
+		} else if(argument.compare(0, 8, "--trace=") == 0) {
+			trace_path = argument.substr(8);
+		} else {
+			break;
+		}
+	}
+
+	if(index < arguments.size()) {
+		command = arguments[index++];
+	}
+	parameters.assign(arguments.begin() + std::min(index, arguments.size()), arguments.end());
+}
+
+BatchMode::~BatchMode()
+{
+	////
+}
+
+bool BatchMode::isRequested(const std::vector<std::string>& arguments)
+{
+	return arguments.size() > 1 && arguments[1] == "--batch";
+}
+
+int BatchMode::run()
+{
+	const Clock::time_point start = Clock::now();
+	if(!trace_path.empty()) {
+#if RME_TRACING > 0
+		Tracer::getInstance().start(trace_path);
+#else
+		std::cerr << "This build has no tracing, set RME_TRACING to build it in." << std::endl;
+#endif
+	}
+
+	int result = 1;
+	if(command == "validate" && parameters.size() == 1) {
+		result = validate();
+	} else if(command == "stats" && parameters.size() == 1) {
+		result = statistics();
+	} else if(command == "convert" && parameters.size() == 3) {
+		result = convert();
+	} else if(command == "borderize" && parameters.size() == 2) {
+		result = borderize();
+	} else if(command == "randomize" && parameters.size() >= 2 && parameters.size() <= 3) {
+		result = randomize();
+	} else if(command == "clean" && parameters.size() == 2) {
+		result = clean();
+	} else if(command == "export" && (parameters.size() == 2 || (parameters.size() == 3 && parameters[2] == "index"))) {
+		result = exportServer();
+	} else if(command == "minimap" && parameters.size() >= 2 && parameters.size() <= 4) {
+		result = minimap();
+	} else if(command == "benchmark" && parameters.size() >= 1 && parameters.size() <= 2) {
+		result = benchmark();
+	} else if(command == "generate" && parameters.size() >= 3 && parameters.size() <= 5) {
+		result = generate();
+	} else if(command == "replay" && parameters.size() == 2) {
+		result = replay();
+	} else if(command == "fuzz" && parameters.size() >= 1 && parameters.size() <= 3) {
+		result = fuzz();
+	} else if(command == "diff" && parameters.size() == 2) {
+		result = diff();
+	} else {
+		usage();
+		return 1;
+	}
+
+	report("total", start, "\"command\": " + quote(command) +
+		", \"threads\": " + std::to_string(ThreadPool::getInstance().getWorkerCount()) +
+		", \"exit\": " + std::to_string(result));
+
+	// The map is freed here, the client data is left to the process exit since it owns GL objects
+	editor.reset();
+
+#if RME_TRACING > 0
+	if(!trace_path.empty() && !Tracer::getInstance().stop()) {
+		std::cerr << "Could not write the trace to \"" << trace_path << "\"." << std::endl;
+	}
+#endif
+	return result;
+}
+
+bool BatchMode::loadMap(const std::string& path)
+{
+	const FileName filename(wxstr(path));
+	MapVersion version;
+	if(!IOMapOTBM::getVersionInfo(filename, version)) {
+		std::cerr << "Could not open \"" << path << "\", this is not a valid OTBM file or it does not exist." << std::endl;
+		return false;
+	}
+
+	// Loaded on its own so it gets a timing of its own, the editor then finds it loaded
+	Clock::time_point start = Clock::now();
+	wxString error;
+	wxArrayString warnings;
+	if(!g_gui.LoadVersion(version.client, error, warnings)) {
+		std::cerr << "Couldn't load the client version: " << error << std::endl;
+		return false;
+	}
+	g_gui.ListDialog("Client data", warnings);
+	report("client", start, "\"version\": " + quote(g_gui.GetCurrentVersion().getName()));
+
+	start = Clock::now();
+	try {
+		editor.reset(newd Editor(g_gui.copybuffer, filename));
+	} catch(std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+
+	Map& map = editor->getMap();
+	if(!map.getError().empty()) {
+		std::cerr << "Couldn't load the map: " << map.getError() << std::endl;
+		return false;
+	}
+	g_gui.ListDialog("Map loader errors", map.getWarnings());
+
+	uint64_t size = 0;
+	if(wxFileName::FileExists(wxstr(path))) {
+		size = wxFileName::GetSize(wxstr(path)).GetValue();
+	}
+	report("load", start, "\"map\": " + quote(path) +
+		", \"bytes\": " + std::to_string(size) +
+		", \"tiles\": " + std::to_string(map.getTileCount()) +
+		", \"warnings\": " + std::to_string(map.getWarnings().size()));
+	report("load", map.getIOTelemetry());
+	return true;
+}
+
+bool BatchMode::saveMap(const std::string& path)
+{
+	const Clock::time_point start = Clock::now();
+	editor->saveMap(FileName(wxstr(path)), false);
+
+	if(!wxFileName::FileExists(wxstr(path))) {
+		std::cerr << "Couldn't save the map to \"" << path << "\"." << std::endl;
+		return false;
+	}
+	report("save", start, "\"map\": " + quote(path) +
+		", \"bytes\": " + std::to_string(wxFileName::GetSize(wxstr(path)).GetValue()));
+	report("save", editor->getMap().getIOTelemetry());
+	return true;
+}
+
+uint64_t BatchMode::countInvalidItems()
+{
+	// The same items cleanInvalidTiles removes
+	struct InvalidItems
+	{
+		uint64_t count = 0;
+
+		void operator()(const Map& map, Tile* tile)
+		{
+			for(const Item* item : tile->items) {
+				if(!g_items.isValidID(item->getID()))
+					++count;
+			}
+		}
+	};
+
+	uint64_t count = 0;
+	for(const InvalidItems& chunk : parallel_foreach_TileOnMap(editor->getMap(), InvalidItems())) {
+		count += chunk.count;
+	}
+	return count;
+}
+
+int BatchMode::validate()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const Clock::time_point start = Clock::now();
+	const uint64_t invalid = countInvalidItems();
+	const size_t warnings = editor->getMap().getWarnings().size();
+	report("validate", start, "\"invalid_items\": " + std::to_string(invalid) +
+		", \"warnings\": " + std::to_string(warnings));
+	return (invalid == 0 && warnings == 0) ? 0 : 2;
+}
+
+int BatchMode::statistics()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	// Every chunk of the map counts on its own, the counts are summed afterwards
+	struct TileStatistics
+	{
+		uint64_t tiles = 0;
+		uint64_t items = 0;
+		uint64_t blocking = 0;
+		uint64_t spawns = 0;
+		uint64_t creatures = 0;
+		uint64_t house_tiles = 0;
+
+		void operator()(const Map& map, Tile* tile)
+		{
+			if(tile->empty())
+				return;
+
+			++tiles;
+			items += tile->items.size() + (tile->ground ? 1 : 0);
+			if(tile->isBlocking())
+				++blocking;
+			if(tile->spawn)
+				++spawns;
+			if(tile->creature)
+				++creatures;
+			if(tile->isHouseTile())
+				++house_tiles;
+		}
+	};
+
+	const Clock::time_point start = Clock::now();
+	Map& map = editor->getMap();
+	TileStatistics total;
+	for(const TileStatistics& chunk : parallel_foreach_TileOnMap(map, TileStatistics())) {
+		total.tiles += chunk.tiles;
+		total.items += chunk.items;
+		total.blocking += chunk.blocking;
+		total.spawns += chunk.spawns;
+		total.creatures += chunk.creatures;
+		total.house_tiles += chunk.house_tiles;
+	}
+
+	report("stats", start, "\"tiles\": " + std::to_string(total.tiles) +
+		", \"items\": " + std::to_string(total.items) +
+		", \"blocking_tiles\": " + std::to_string(total.blocking) +
+		", \"spawns\": " + std::to_string(total.spawns) +
+		", \"creatures\": " + std::to_string(total.creatures) +
+		", \"house_tiles\": " + std::to_string(total.house_tiles) +
+		", \"houses\": " + std::to_string(map.houses.count()) +
+		", \"towns\": " + std::to_string(map.towns.count()));
+	return 0;
+}
+
+int BatchMode::convert()
+{
+	const int otbm = std::atoi(parameters[2].c_str());
+	if(otbm < 1 || otbm > 4) {
+		std::cerr << "The OTBM version has to be 1 to 4." << std::endl;
+		return 1;
+	}
+
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const Clock::time_point start = Clock::now();
+	Map& map = editor->getMap();
+	MapVersion version = map.getVersion();
+	version.otbm = MapVersionID(otbm - 1);
+	if(!map.convert(version, false)) {
+		std::cerr << "The map can't be converted to OTBM " << otbm << "." << std::endl;
+		return 1;
+	}
+	report("convert", start, "\"otbm\": " + std::to_string(otbm));
+
+	return saveMap(parameters[1]) ? 0 : 1;
+}
+
+int BatchMode::borderize()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const Clock::time_point start = Clock::now();
+	editor->borderizeMap(false);
+	report("borderize", start);
+
+	return saveMap(parameters[1]) ? 0 : 1;
+}
+
+int BatchMode::randomize()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const uint32_t seed = parameters.size() > 2 ? uint32_t(std::strtoul(parameters[2].c_str(), nullptr, 10)) : 0;
+	const Clock::time_point start = Clock::now();
+	editor->randomizeMap(false, seed);
+	report("randomize", start, "\"seed\": " + std::to_string(seed));
+
+	return saveMap(parameters[1]) ? 0 : 1;
+}
+
+int BatchMode::clean()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const Clock::time_point start = Clock::now();
+	const uint64_t invalid = countInvalidItems();
+	editor->getMap().cleanInvalidTiles(false);
+	report("clean", start, "\"removed_items\": " + std::to_string(invalid));
+
+	return saveMap(parameters[1]) ? 0 : 1;
+}
+
+int BatchMode::exportServer()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const std::string& path = parameters[1];
+	const Clock::time_point start = Clock::now();
+	Map& map = editor->getMap();
+	IOMapOTBM exporter(map.getVersion());
+	exporter.setServerProfile(true, parameters.size() > 2);
+	if(!exporter.exportMap(map, FileName(wxstr(path)))) {
+		std::cerr << "Couldn't export the map to \"" << path << "\": " << exporter.getError() << std::endl;
+		return 1;
+	}
+	report("export", start, "\"map\": " + quote(path) +
+		", \"bytes\": " + std::to_string(wxFileName::GetSize(wxstr(path)).GetValue()));
+	report("export", exporter.getTelemetry());
+	return 0;
+}
+
+int BatchMode::minimap()
+{
+	MinimapExportFormat format = MinimapExportFormat::Png;
+	if(parameters.size() >= 3) {
+		if(parameters[2] == "otmm") {
+			format = MinimapExportFormat::Otmm;
+		} else if(parameters[2] == "bmp") {
+			format = MinimapExportFormat::Bmp;
+		} else if(parameters[2] != "png") {
+			std::cerr << "The minimap format has to be png, bmp or otmm." << std::endl;
+			return 1;
+		}
+	}
+	const int floor = parameters.size() == 4 ? std::atoi(parameters[3].c_str()) : -1;
+
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const Clock::time_point start = Clock::now();
+	const MinimapExportMode mode = floor >= 0 ? MinimapExportMode::SpecificFloor : MinimapExportMode::AllFloors;
+	IOMinimap io(editor.get(), format, mode, false);
+	const std::string name = nstr(FileName(wxstr(parameters[0])).GetName());
+	if(!io.saveMinimap(parameters[1], name, floor)) {
+		std::cerr << "Couldn't export the minimap: " << io.getError() << std::endl;
+		return 1;
+	}
+	report("minimap", start, "\"directory\": " + quote(parameters[1]) + ", \"floor\": " + std::to_string(floor));
+	return 0;
+}
+
+int BatchMode::benchmark()
+{
+	const int repeat = parameters.size() == 2 ? std::atoi(parameters[1].c_str()) : 3;
+	if(repeat < 1) {
+		std::cerr << "The benchmark has to run at least once." << std::endl;
+		return 1;
+	}
+
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const std::string directory = nstr(wxFileName::GetTempDir()) + "/rme-benchmark-" + std::to_string(wxGetProcessId());
+	MapBenchmark benchmark(*editor, directory, repeat);
+	const bool ok = benchmark.run([this](const MapBenchmark::Result& result) {
+		std::ostringstream rate;
+		rate.setf(std::ios::fixed, std::ios::floatfield);
+		rate.precision(3);
+		rate << result.rate;
+		report("benchmark." + result.name, result.ms, "\"rate\": " + rate.str() + ", \"unit\": " + quote(result.unit));
+	});
+	if(!ok) {
+		std::cerr << "Couldn't write the benchmark files to \"" << directory << "\"." << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int BatchMode::generate()
+{
+	MapGenerator::Options options;
+	options.width = std::atoi(parameters[1].c_str());
+	options.height = std::atoi(parameters[2].c_str());
+	if(parameters.size() >= 4) {
+		options.floors = std::atoi(parameters[3].c_str());
+	}
+	if(parameters.size() == 5) {
+		options.seed = uint32_t(std::strtoul(parameters[4].c_str(), nullptr, 10));
+	}
+	if(options.width <= 0 || options.height <= 0 || options.floors <= 0) {
+		std::cerr << "The size and the floors of the map have to be positive." << std::endl;
+		return 1;
+	}
+
+	// A new map, this loads the default client version for its brushes
+	Clock::time_point start = Clock::now();
+	try {
+		editor.reset(newd Editor(g_gui.copybuffer));
+	} catch(std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	report("client", start, "\"version\": " + quote(g_gui.GetCurrentVersion().getName()));
+
+	start = Clock::now();
+	Map& map = editor->getMap();
+	MapGenerator generator(map, options);
+	if(!generator.generate(FileName(wxstr(parameters[0])))) {
+		std::cerr << "Couldn't generate the map: " << generator.getError() << std::endl;
+		return 1;
+	}
+
+	uint64_t size = 0;
+	if(wxFileName::FileExists(wxstr(parameters[0]))) {
+		size = wxFileName::GetSize(wxstr(parameters[0])).GetValue();
+	}
+	report("generate", start, "\"map\": " + quote(parameters[0]) +
+		", \"width\": " + std::to_string(map.getWidth()) +
+		", \"height\": " + std::to_string(map.getHeight()) +
+		", \"seed\": " + std::to_string(options.seed) +
+		", \"bytes\": " + std::to_string(size) +
+		", \"tiles\": " + std::to_string(generator.getTileCount()) +
+		", \"items\": " + std::to_string(generator.getItemCount()) +
+		", \"houses\": " + std::to_string(map.houses.count()) +
+		", \"spawns\": " + std::to_string(generator.getSpawnCount()));
+	return 0;
+}
+
+int BatchMode::replay()
+{
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	SessionReplay session(*editor);
+	if(!session.load(parameters[1])) {
+		std::cerr << "Couldn't read the recorded session \"" << parameters[1] << "\"." << std::endl;
+		return 1;
+	}
+
+	const Clock::time_point start = Clock::now();
+	session.run([this](const SessionReplay::Result& result) {
+		std::ostringstream fields;
+		fields.setf(std::ios::fixed, std::ios::floatfield);
+		fields.precision(3);
+		fields << "\"count\": " << result.count <<
+			", \"p50\": " << result.p50_ms <<
+			", \"p90\": " << result.p90_ms <<
+			", \"p99\": " << result.p99_ms <<
+			", \"max\": " << result.max_ms;
+		report("replay." + result.operation, result.total_ms, fields.str());
+	});
+	report("replay", start, "\"session\": " + quote(parameters[1]) +
+		", \"operations\": " + std::to_string(session.getOperationCount()) +
+		", \"skipped\": " + std::to_string(session.getSkippedCount()));
+	return 0;
+}
+
+int BatchMode::fuzz()
+{
+	const int iterations = parameters.size() > 1 ? std::atoi(parameters[1].c_str()) : 1000;
+	if(iterations < 1) {
+		std::cerr << "The decoders have to be fed at least one input." << std::endl;
+		return 1;
+	}
+	const uint32_t seed = parameters.size() > 2 ? uint32_t(std::strtoul(parameters[2].c_str(), nullptr, 10)) : 0;
+
+	if(!loadMap(parameters[0]))
+		return 1;
+
+	const std::string directory = nstr(wxFileName::GetTempDir()) + "/rme-fuzz-" + std::to_string(wxGetProcessId());
+	DecoderFuzzer fuzzer(*editor, directory, seed);
+	const Clock::time_point start = Clock::now();
+	const bool ok = fuzzer.run(iterations, [this](const DecoderFuzzer::Result& result) {
+		std::ostringstream rate;
+		rate.setf(std::ios::fixed, std::ios::floatfield);
+		rate.precision(3);
+		rate << (result.ms > 0.0 ? result.bytes / 1048576.0 * 1000.0 / result.ms : 0.0);
+		report("fuzz." + result.name, result.ms, "\"inputs\": " + std::to_string(result.inputs) +
+			", \"rejected\": " + std::to_string(result.rejected) +
+			", \"rate\": " + rate.str() + ", \"unit\": \"MB/s\"");
+	});
+	if(!ok) {
+		std::cerr << "Couldn't write the fuzzing files to \"" << directory << "\"." << std::endl;
+		return 1;
+	}
+	report("fuzz", start, "\"seed\": " + std::to_string(seed));
+	return 0;
+}
+
+void BatchMode::report(const std::string& step, Clock::time_point start, const std::string& fields)
+{
+	report(step, std::chrono::duration<double, std::milli>(Clock::now() - start).count(), fields);
+}
+
+void BatchMode::report(const std::string& step, double ms, const std::string& fields)
+{
+	std::ostringstream line;
+	line.setf(std::ios::fixed, std::ios::floatfield);
+	line.precision(3);
+	line << "{\"step\": " << quote(step) << ", \"ms\": " << ms;
+	if(!fields.empty()) {
+		line << ", " << fields;
+	}
+	line << "}";
+	std::cout << line.str() << std::endl;
+}
+
+void BatchMode::report(const std::string& step, const IOTelemetry& telemetry)
+{
+	for(int index = 0; index < IOTelemetry::PHASE_COUNT; ++index) {
+		const IOTelemetry::Phase phase = IOTelemetry::Phase(index);
+		const IOTelemetry::Counters& counters = telemetry[phase];
+		report(step + "." + IOTelemetry::getPhaseName(phase), counters.ms,
+			"\"tiles\": " + std::to_string(counters.tiles) +
+			", \"items\": " + std::to_string(counters.items) +
+			", \"bytes\": " + std::to_string(counters.bytes));
+	}
+}
+
+std::string BatchMode::quote(const std::string& text)
+{
+	std::string quoted = "\"";
+	for(char c : text) {
+		switch(c) {
+			case '"': quoted += "\\\""; break;
+			case '\\': quoted += "\\\\"; break;
+			case '\n': quoted += "\\n"; break;
+			case '\r': quoted += "\\r"; break;
+			case '\t': quoted += "\\t"; break;
+			default:
+				if(static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					quoted += escaped;
+				} else {
+					quoted += c;
+				}
+				break;
+		}
+	}
+	return quoted + "\"";
+}
+
+int BatchMode::diff()
+{
+	MapVersion first_version, second_version;
+	if(IOMapOTBM::getVersionInfo(FileName(wxstr(parameters[0])), first_version) &&
+		IOMapOTBM::getVersionInfo(FileName(wxstr(parameters[1])), second_version) &&
+		first_version.client != second_version.client) {
+		std::cerr << "The maps are of different client versions, their items can't be compared." << std::endl;
+		return 1;
+	}
+
+	auto hash = [this](MapHashCache& hashes, const std::string& path) {
+		const Clock::time_point start = Clock::now();
+		hashes.update(editor->getMap());
+		std::ostringstream root;
+		root << std::hex << std::setw(16) << std::setfill('0') << hashes.getRoot();
+		report("hash", start, "\"map\": " + quote(path) + ", \"root\": " + quote(root.str()));
+	};
+
+	// The first map is kept aside while the second one loads, the tiles of both are looked at
+	if(!loadMap(parameters[0]))
+		return 1;
+	MapHashCache first_hashes;
+	hash(first_hashes, parameters[0]);
+	std::unique_ptr<Editor> first = std::move(editor);
+
+	if(!loadMap(parameters[1]))
+		return 1;
+	MapHashCache second_hashes;
+	hash(second_hashes, parameters[1]);
+
+	const Clock::time_point start = Clock::now();
+	const PositionVector positions = MapHashCache::compare(first_hashes, first->getMap(), second_hashes, editor->getMap());
+
+	// The first ones are enough to go and look, a map saved by another editor may differ everywhere
+	const size_t listed = std::min<size_t>(positions.size(), 1000);
+	std::string list;
+	for(size_t i = 0; i < listed; ++i) {
+		const Position& position = positions[i];
+		list += (i == 0 ? "[" : ", [") + std::to_string(position.x) + ", " + std::to_string(position.y) + ", " + std::to_string(position.z) + "]";
+	}
+	report("diff", start, "\"tiles\": " + std::to_string(positions.size()) +
+		", \"positions\": [" + list + "]" +
+		", \"truncated\": " + (listed < positions.size() ? "true" : "false"));
+	return positions.empty() ? 0 : 2;
+}
+
+void BatchMode::usage()
+{
+	std::cerr <<
+		"Usage: rme --batch [--threads=N] [--trace=file] <command> [arguments]\n"
+		"Commands:\n"
+		"  validate <map>                              counts invalid items and loader warnings\n"
+		"  stats <map>                                 tile, item, spawn and house counts\n"
+		"  convert <map> <output> <otbm 1-4>           converts and saves to the OTBM version\n"
+		"  borderize <map> <output>                    borderizes the whole map\n"
+		"  randomize <map> <output> [seed]             redraws the grounds of the whole map, the same\n"
+		"                                              seed (0 by default) always gives the same map\n"
+		"  clean <map> <output>                        removes items with an invalid id\n"
+		"  export <map> <output> [index]               writes the map ordered and packed for a server to\n"
+		"                                              load, with the tile index if index is given\n"
+		"  minimap <map> <directory> [png|bmp|otmm] [floor]\n"
+		"                                              exports the minimap, all floors by default\n"
+		"  benchmark <map> [repeat]                    times the core operations on the map, the fastest\n"
+		"                                              of repeat runs (3 by default) is reported\n"
+		"  generate <output> <width> <height> [floors] [seed]\n"
+		"                                              streams a synthetic map made of the brushes of the\n"
+		"                                              default client version, 3 floors and seed 0 by default\n"
+		"  replay <map> <session>                      plays back a session recorded in the editor and reports\n"
+		"                                              the latency percentiles of every kind of operation\n"
+		"  fuzz <map> [iterations] [seed]              decodes damaged copies of the live nodes and the OTBM\n"
+		"                                              file of the map, iterations (1000 by default) of each,\n"
+		"                                              for builds with sanitizers; use a small map\n"
+		"  diff <map> <other map>                      lists the tiles differing between two maps of the\n"
+		"                                              same client version, found through content hashes\n"
+		"Every step prints a line of JSON with its time in milliseconds. --trace writes the zones\n"
+		"of the run as a Chrome trace, for builds with RME_TRACING set.\n"
+		"Exit codes: 0 success, 1 failure, 2 the map didn't validate or the maps differ." << std::endl;
+}
@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_BATCH_MODE_H_
+#define RME_BATCH_MODE_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Editor;
+class IOTelemetry;
+
+// Runs a map operation from the command line without creating any window or GL context,
+// for build pipelines:
+//   rme --batch [--threads=N] [--trace=file] <command> [arguments]
+// Every step writes a line of JSON with its timing to stdout, messages go to stderr.
+// The operations run on the shared thread pool like they do in the editor.
+class BatchMode
+{
+public:
+	explicit BatchMode(const std::vector<std::string>& arguments);
+	~BatchMode();
+
+	static bool isRequested(const std::vector<std::string>& arguments);
+
+	// Returns the exit code, 0 on success, 1 when something failed and 2 when a map didn't validate
+	// or two maps differ
+	int run();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	bool loadMap(const std::string& path);
+	bool saveMap(const std::string& path);
+	uint64_t countInvalidItems();
+
+	int validate();
+	int statistics();
+	int convert();
+	int borderize();
+	int randomize();
+	int clean();
+	int exportServer();
+	int minimap();
+	int benchmark();
+	int generate();
+	int replay();
+	int fuzz();
+	int diff();
+
+	// Writes {"step": step, "ms": ..., fields} to stdout, fields is a list of "key": value
+	void report(const std::string& step, Clock::time_point start, const std::string& fields = "");
+	void report(const std::string& step, double ms, const std::string& fields = "");
+	// A step for every phase of a load or save, named step.phase
+	void report(const std::string& step, const IOTelemetry& telemetry);
+	static std::string quote(const std::string& text);
+	static void usage();
+
+	std::string command;
+	std::vector<std::string> parameters;
+	// Where the trace of the run goes, none if empty
+	std::string trace_path;
+	std::unique_ptr<Editor> editor;
+};
+
+#endif
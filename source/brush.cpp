@@ -41,6 +41,7 @@
 #include "map.h"
 
 #include "gui.h"
+#include "tracing.h"
 
 Brushes g_brushes;
 
@@ -59,6 +60,7 @@ void Brushes::clear()
 	for(auto brushEntry : brushes) {
 		delete brushEntry.second;
 	}
+	names.clear();
 	brushes.clear();
 
 	for(auto borderEntry : borders) {
@@ -67,8 +69,16 @@ void Brushes::clear()
 	borders.clear();
 }
 
+void Brushes::swap(Brushes& other)
+{
+	brushes.swap(other.brushes);
+	names.swap(other.names);
+	borders.swap(other.borders);
+}
+
 void Brushes::init()
 {
+	RME_TRACE_ZONE("load", "Brushes::init");
 	addBrush(g_gui.optional_brush = newd OptionalBorderBrush());
 	addBrush(g_gui.eraser = newd EraserBrush());
 	addBrush(g_gui.spawn_brush = newd SpawnBrush());
@@ -92,6 +102,12 @@ void Brushes::init()
 	WallBrush::init();
 	TableBrush::init();
 	CarpetBrush::init();
+
+	for(const auto& entry : brushes) {
+		if(entry.second->isWall()) {
+			entry.second->asWall()->resolveAlignments();
+		}
+	}
 }
 
 bool Brushes::unserializeBrush(pugi::xml_node node, wxArrayString& warnings)
@@ -138,7 +154,7 @@ bool Brushes::unserializeBrush(pugi::xml_node node, wxArrayString& warnings)
 	}
 
 	if(!node.first_child()) {
-		brushes.insert(std::make_pair(brush->getName(), brush));
+		addBrush(brush);
 		return true;
 	}
 
@@ -166,7 +182,7 @@ bool Brushes::unserializeBrush(pugi::xml_node node, wxArrayString& warnings)
 		}
 	}
 
-	brushes.insert(std::make_pair(brush->getName(), brush));
+	addBrush(brush);
 	return true;
 }
 
@@ -192,16 +208,32 @@ bool Brushes::unserializeBorder(pugi::xml_node node, wxArrayString& warnings)
 
 void Brushes::addBrush(Brush *brush)
 {
-	brushes.insert(std::make_pair(brush->getName(), brush));
+	auto it = brushes.insert(std::make_pair(brush->getName(), brush));
+	names.emplace(it->first, brush);
 }
 
-Brush* Brushes::getBrush(const std::string& name) const
+Brush* Brushes::getBrush(std::string_view name) const
 {
-	auto it = brushes.find(name);
-	if(it != brushes.end()) {
+	auto it = names.find(name);
+	if(it != names.end()) {
 		return it->second;
 	}
-	return nullptr;
+
+	// The RAW brushes of the "Others" tileset are named "<id> - <name>" and only
+	// added once made, a hotkey or a recording might ask for one before that
+	uint32_t id = 0;
+	size_t digits = 0;
+	while(digits < name.size() && digits < 6 && name[digits] >= '0' && name[digits] <= '9') {
+		id = id * 10 + (name[digits++] - '0');
+	}
+	if(digits == 0 || id > 0xFFFF || name.substr(digits, 3) != " - ") {
+		return nullptr;
+	}
+	const ItemType* type = g_items.getRawItemType(static_cast<uint16_t>(id));
+	if(!type || type->raw_brush || !type->in_other_tileset || RAWBrush::getName(*type) != name) {
+		return nullptr;
+	}
+	return g_items.getRAWBrush(type->id);
 }
 
 // Brush
@@ -301,7 +333,7 @@ void FlagBrush::undraw(BaseMap* map, Tile* tile)
 		else
 		{
 			tile->removeZoneId(zoneId);
-			if (tile->getZoneIds().empty())
+			if (!tile->hasZones())
 				tile->unsetMapFlags(flag);
 		}
 	}
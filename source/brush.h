@@ -23,6 +23,9 @@
 
 #include "brush_enums.h"
 
+#include <string_view>
+#include <unordered_map>
+
 // Thanks to a million forward declarations, we don't have to include any files!
 // TODO move to a declarations file.
 class ItemType;
@@ -65,8 +68,11 @@ public:
 
 	void init();
 	void clear();
+	// Exchanges all brushes and borders with other, they keep their addresses
+	void swap(Brushes& other);
 
-	Brush* getBrush(const std::string& name) const;
+	// Doesn't allocate, the first brush added under a name is returned
+	Brush* getBrush(std::string_view name) const;
 
 	void addBrush(Brush* brush);
 
@@ -78,6 +84,8 @@ public:
 protected:
 	typedef std::map<uint32_t, AutoBorder*> BorderMap;
 	BrushMap brushes;
+	// Hashed lookups by name, the keys view the names held by the brush map
+	std::unordered_map<std::string_view, Brush*> names;
 	BorderMap borders;
 
 	friend class AutoBorder;
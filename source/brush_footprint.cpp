@@ -0,0 +1,56 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "brush_footprint.h"
+
+BrushFootprint::BrushFootprint(BrushShape shape, int size)
+{
+	for(int y = -size - 1; y <= size + 1; y++) {
+		for(int x = -size - 1; x <= size + 1; x++) {
+			if(shape == BRUSHSHAPE_SQUARE) {
+				if(x >= -size && x <= size && y >= -size && y <= size) {
+					tiles.push_back(Position(x, y, 0));
+				}
+				if(std::abs(x) - size < 2 && std::abs(y) - size < 2) {
+					border.push_back(Position(x, y, 0));
+				}
+			} else if(shape == BRUSHSHAPE_CIRCLE) {
+				double distance = sqrt(double(x * x) + double(y * y));
+				if(distance < size + 0.005) {
+					tiles.push_back(Position(x, y, 0));
+				}
+				if(std::abs(distance - size) < 1.5) {
+					border.push_back(Position(x, y, 0));
+				}
+			}
+		}
+	}
+}
+
+const BrushFootprint& BrushFootprint::get(BrushShape shape, int size)
+{
+	// Only ever used from the UI thread
+	static std::map<std::pair<BrushShape, int>, std::unique_ptr<BrushFootprint>> cache;
+
+	std::unique_ptr<BrushFootprint>& footprint = cache[std::make_pair(shape, size)];
+	if(!footprint) {
+		footprint.reset(newd BrushFootprint(shape, size));
+	}
+	return *footprint;
+}
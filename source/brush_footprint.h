@@ -0,0 +1,44 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_BRUSH_FOOTPRINT_H_
+#define RME_BRUSH_FOOTPRINT_H_
+
+#include "position.h"
+#include "gui_ids.h"
+
+// The squares a brush of a shape and size covers, relative to the cursor, in
+// rows from the top. Made once per shape and size, the drawing code and the
+// brush preview translate them instead of testing every square again.
+class BrushFootprint
+{
+public:
+	static const BrushFootprint& get(BrushShape shape, int size);
+
+	// The squares that are drawn
+	const std::vector<Position>& getTiles() const noexcept { return tiles; }
+	// The squares bordered after drawing, the drawn ones and a ring around them
+	const std::vector<Position>& getBorder() const noexcept { return border; }
+
+private:
+	BrushFootprint(BrushShape shape, int size);
+
+	std::vector<Position> tiles;
+	std::vector<Position> border;
+};
+
+#endif
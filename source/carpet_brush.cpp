@@ -177,8 +177,8 @@ void CarpetBrush::undraw(BaseMap* map, Tile* tile)
 
 void CarpetBrush::doCarpets(BaseMap* map, Tile* tile)
 {
-	static const auto hasMatchingCarpetBrushAtTile = [](BaseMap* map, CarpetBrush* carpetBrush, uint32_t x, uint32_t y, uint32_t z) -> bool {
-		Tile* tile = map->getTile(x, y, z);
+	static const auto hasMatchingCarpetBrushAtTile = [](const TileNeighbourhood& around, CarpetBrush* carpetBrush, int dx, int dy) -> bool {
+		Tile* tile = around.getTile(dx, dy);
 		if(!tile) {
 			return false;
 		}
@@ -196,20 +196,7 @@ void CarpetBrush::doCarpets(BaseMap* map, Tile* tile)
 		return;
 	}
 
-	const Position& position = tile->getPosition();
-	uint32_t x = position.x;
-	uint32_t y = position.y;
-	uint32_t z = position.z;
-	/*
-	static const std::pair<int32_t, int32_t> positionOffset[8] = {
-		{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}
-	};
-
-	const auto& offset = positionOffset[i];
-	if(neighbours[i] && hasMatchingCarpetBrushAtTile(map, carpetBrush, x + offset.first, y + offset.second, z)) {
-		//
-	}
-	*/
+	const TileNeighbourhood around(*map, tile->getPosition());
 	for(Item* item : tile->items) {
 		ASSERT(item);
 
@@ -219,45 +206,14 @@ void CarpetBrush::doCarpets(BaseMap* map, Tile* tile)
 		}
 
 		bool neighbours[8] = { false };
-		if(x == 0) {
-			if(y == 0) {
-				neighbours[0] = false;
-				neighbours[1] = false;
-				neighbours[2] = false;
-				neighbours[3] = false;
-				neighbours[4] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y,     z);
-				neighbours[5] = false;
-				neighbours[6] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x,     y + 1, z);
-				neighbours[7] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y + 1, z);
-			} else {
-				neighbours[0] = false;
-				neighbours[1] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x,     y - 1, z);
-				neighbours[2] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y - 1, z);
-				neighbours[3] = false;
-				neighbours[4] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y,     z);
-				neighbours[5] = false;
-				neighbours[6] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x,     y + 1, z);
-				neighbours[7] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y + 1, z);
-			}
-		} else if(y == 0) {
-			neighbours[0] = false;
-			neighbours[1] = false;
-			neighbours[2] = false;
-			neighbours[3] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x - 1, y,     z);
-			neighbours[4] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y,     z);
-			neighbours[5] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x - 1, y + 1, z);
-			neighbours[6] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x,     y + 1, z);
-			neighbours[7] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y + 1, z);
-		} else {
-			neighbours[0] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x - 1, y - 1, z);
-			neighbours[1] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x,     y - 1, z);
-			neighbours[2] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y - 1, z);
-			neighbours[3] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x - 1, y,     z);
-			neighbours[4] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y,     z);
-			neighbours[5] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x - 1, y + 1, z);
-			neighbours[6] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x,     y + 1, z);
-			neighbours[7] = hasMatchingCarpetBrushAtTile(map, carpetBrush, x + 1, y + 1, z);
-		}
+		neighbours[0] = hasMatchingCarpetBrushAtTile(around, carpetBrush, -1, -1);
+		neighbours[1] = hasMatchingCarpetBrushAtTile(around, carpetBrush,  0, -1);
+		neighbours[2] = hasMatchingCarpetBrushAtTile(around, carpetBrush,  1, -1);
+		neighbours[3] = hasMatchingCarpetBrushAtTile(around, carpetBrush, -1,  0);
+		neighbours[4] = hasMatchingCarpetBrushAtTile(around, carpetBrush,  1,  0);
+		neighbours[5] = hasMatchingCarpetBrushAtTile(around, carpetBrush, -1,  1);
+		neighbours[6] = hasMatchingCarpetBrushAtTile(around, carpetBrush,  0,  1);
+		neighbours[7] = hasMatchingCarpetBrushAtTile(around, carpetBrush,  1,  1);
 
 		uint32_t tileData = 0;
 		for(uint32_t i = 0; i < 8; ++i) {
@@ -194,6 +194,23 @@ int random(int high)
 	return random(0,high);
 }
 
+int position_random(int x, int y, int z, uint32_t seed, int low, int high)
+{
+	if(low >= high) {
+		return low;
+	}
+
+	uint32_t value = seed * 0x9E3779B9u;
+	value ^= uint32_t(x) * 0x85EBCA6Bu;
+	value = (value ^ (value >> 13)) * 0xC2B2AE35u;
+	value ^= uint32_t(y) * 0x27D4EB2Fu;
+	value = (value ^ (value >> 15)) * 0x165667B1u;
+	value ^= uint32_t(z) * 0x9E3779B1u;
+	value = (value ^ (value >> 16)) * 0x85EBCA6Bu;
+	value ^= value >> 13;
+	return low + int(value % uint32_t(high - low + 1));
+}
+
 std::wstring string2wstring(const std::string& utf8string)
 {
 	wxString s(utf8string.c_str(), wxConvUTF8);
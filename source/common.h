@@ -65,6 +65,9 @@ bool isTrueString(std::string& str);
 // Generates a random number between low and high using the mersenne twister
 int random(int high);
 int random(int low, int high);
+// A number between low and high that only depends on the position and the seed, so work
+// split over threads draws the same numbers however it is split
+int position_random(int x, int y, int z, uint32_t seed, int low, int high);
 
 // Unicode conversions
 std::wstring string2wstring(const std::string& utf8string);
@@ -351,13 +351,14 @@ MapPropertiesWindow::~MapPropertiesWindow() = default;
 
 BEGIN_EVENT_TABLE(ImportMapWindow, wxDialog)
 EVT_BUTTON(MAP_WINDOW_FILE_BUTTON, ImportMapWindow::OnClickBrowse)
+EVT_CHECKBOX(IMPORT_MAP_AREA_CHECKBOX, ImportMapWindow::OnToggleArea)
 EVT_BUTTON(wxID_OK, ImportMapWindow::OnClickOK)
 EVT_BUTTON(wxID_CANCEL, ImportMapWindow::OnClickCancel)
 END_EVENT_TABLE()
 
 ImportMapWindow::ImportMapWindow(wxWindow *parent, Editor &editor)
 	: wxDialog(parent, wxID_ANY, "Import Map", wxDefaultPosition,
-			   wxSize(420, 315)),
+			   wxSize(420, 400)),
 	  editor(editor) {
 	wxBoxSizer *sizer = newd wxBoxSizer(wxVERTICAL);
 	wxStaticBoxSizer *tmpsizer;
@@ -400,6 +401,33 @@ ImportMapWindow::ImportMapWindow(wxWindow *parent, Editor &editor)
 	tmpsizer->Add(z_offset_ctrl, 0, wxALL, 5);
 	sizer->Add(tmpsizer, 1, wxEXPAND | wxLEFT | wxRIGHT, 5);
 
+	// Import area
+	tmpsizer = newd wxStaticBoxSizer(
+		new wxStaticBox(this, wxID_ANY, "Import Area"), wxVERTICAL);
+	area_checkbox = newd wxCheckBox(tmpsizer->GetStaticBox(),
+									IMPORT_MAP_AREA_CHECKBOX,
+									"Only import the tiles from/to");
+	tmpsizer->Add(area_checkbox, 0, wxALL, 5);
+	wxBoxSizer *area_sizer = newd wxBoxSizer(wxHORIZONTAL);
+	area_start_x_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxWidth);
+	area_sizer->Add(area_start_x_ctrl, 0, wxALL, 5);
+	area_start_y_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxHeight);
+	area_sizer->Add(area_start_y_ctrl, 0, wxALL, 5);
+	area_end_x_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxWidth, rme::MapMaxWidth);
+	area_sizer->Add(area_end_x_ctrl, 0, wxALL, 5);
+	area_end_y_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxHeight, rme::MapMaxHeight);
+	area_sizer->Add(area_end_y_ctrl, 0, wxALL, 5);
+	tmpsizer->Add(area_sizer, 0, wxEXPAND);
+	sizer->Add(tmpsizer, 1, wxEXPAND | wxLEFT | wxRIGHT, 5);
+
 	// Import options
 	wxArrayString house_choices;
 	house_choices.Add("Smart Merge");
@@ -441,12 +469,23 @@ ImportMapWindow::ImportMapWindow(wxWindow *parent, Editor &editor)
 	SetSizer(sizer);
 	Layout();
 	Centre(wxBOTH);
+
+	wxCommandEvent dummy;
+	OnToggleArea(dummy);
 }
 
 ImportMapWindow::~ImportMapWindow() = default;
 
+void ImportMapWindow::OnToggleArea(wxCommandEvent &WXUNUSED(event)) {
+	const bool enable = area_checkbox->GetValue();
+	area_start_x_ctrl->Enable(enable);
+	area_start_y_ctrl->Enable(enable);
+	area_end_x_ctrl->Enable(enable);
+	area_end_y_ctrl->Enable(enable);
+}
+
 void ImportMapWindow::OnClickBrowse(wxCommandEvent &WXUNUSED(event)) {
-	wxFileDialog dialog(this, "Import...", "", "", "*.otbm",
+	wxFileDialog dialog(this, "Import...", "", "", MAP_LOAD_FILE_WILDCARD,
 						wxFD_OPEN | wxFD_FILE_MUST_EXIST);
 	int ok = dialog.ShowModal();
 
@@ -490,11 +529,19 @@ void ImportMapWindow::OnClickOK(wxCommandEvent &WXUNUSED(event)) {
 			break;
 		}
 
+		MapArea area;
+		if (area_checkbox->GetValue()) {
+			area.start.x = std::min(area_start_x_ctrl->GetValue(), area_end_x_ctrl->GetValue());
+			area.start.y = std::min(area_start_y_ctrl->GetValue(), area_end_y_ctrl->GetValue());
+			area.end.x = std::max(area_start_x_ctrl->GetValue(), area_end_x_ctrl->GetValue());
+			area.end.y = std::max(area_start_y_ctrl->GetValue(), area_end_y_ctrl->GetValue());
+		}
+
 		EndModal(1);
 
 		editor.importMap(fn, x_offset_ctrl->GetValue(),
 						 y_offset_ctrl->GetValue(), z_offset_ctrl->GetValue(),
-						 house_import_type, spawn_import_type);
+						 house_import_type, spawn_import_type, area);
 	}
 }
 
@@ -503,6 +550,118 @@ void ImportMapWindow::OnClickCancel(wxCommandEvent &WXUNUSED(event)) {
 	EndModal(0);
 }
 
+// ============================================================================
+// Open Map Area Window
+
+BEGIN_EVENT_TABLE(OpenMapAreaWindow, wxDialog)
+EVT_BUTTON(MAP_WINDOW_FILE_BUTTON, OpenMapAreaWindow::OnClickBrowse)
+EVT_BUTTON(wxID_OK, OpenMapAreaWindow::OnClickOK)
+EVT_BUTTON(wxID_CANCEL, OpenMapAreaWindow::OnClickCancel)
+END_EVENT_TABLE()
+
+OpenMapAreaWindow::OpenMapAreaWindow(wxWindow *parent)
+	: wxDialog(parent, wxID_ANY, "Open Map Area", wxDefaultPosition,
+			   wxSize(420, 300)) {
+	wxBoxSizer *sizer = newd wxBoxSizer(wxVERTICAL);
+	wxStaticBoxSizer *tmpsizer;
+
+	// File
+	tmpsizer = newd wxStaticBoxSizer(
+		new wxStaticBox(this, wxID_ANY, "Map File"), wxHORIZONTAL);
+	file_text_field = newd wxTextCtrl(tmpsizer->GetStaticBox(), wxID_ANY, "",
+									  wxDefaultPosition, wxSize(300, 23));
+	tmpsizer->Add(file_text_field, 0, wxALL, 5);
+	wxButton *browse_button =
+		newd wxButton(tmpsizer->GetStaticBox(), MAP_WINDOW_FILE_BUTTON,
+					  "Browse...", wxDefaultPosition, wxSize(80, 23));
+	tmpsizer->Add(browse_button, 0, wxALL, 5);
+	sizer->Add(tmpsizer, 1, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 5);
+
+	// Area, loaded in whole 256x256 tile areas
+	tmpsizer = newd wxStaticBoxSizer(
+		new wxStaticBox(this, wxID_ANY, "Area (From X, Y To X, Y)"), wxHORIZONTAL);
+	start_x_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxWidth);
+	tmpsizer->Add(start_x_ctrl, 0, wxALL, 5);
+	start_y_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxHeight);
+	tmpsizer->Add(start_y_ctrl, 0, wxALL, 5);
+	end_x_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxWidth, 1024);
+	tmpsizer->Add(end_x_ctrl, 0, wxALL, 5);
+	end_y_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, 0, rme::MapMaxHeight, 1024);
+	tmpsizer->Add(end_y_ctrl, 0, wxALL, 5);
+	sizer->Add(tmpsizer, 1, wxEXPAND | wxLEFT | wxRIGHT, 5);
+
+	// Floors
+	tmpsizer = newd wxStaticBoxSizer(
+		new wxStaticBox(this, wxID_ANY, "Floors"), wxHORIZONTAL);
+	tmpsizer->Add(
+		newd wxStaticText(tmpsizer->GetStaticBox(), wxID_ANY, "From:"), 0,
+		wxALL, 5);
+	start_z_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, rme::MapMinLayer, rme::MapMaxLayer, rme::MapMinLayer);
+	tmpsizer->Add(start_z_ctrl, 0, wxALL, 5);
+	tmpsizer->Add(
+		newd wxStaticText(tmpsizer->GetStaticBox(), wxID_ANY, "To:"), 0,
+		wxALL, 5);
+	end_z_ctrl = newd wxSpinCtrl(
+		tmpsizer->GetStaticBox(), wxID_ANY, wxEmptyString, wxDefaultPosition,
+		wxSize(60, 23), wxSP_ARROW_KEYS, rme::MapMinLayer, rme::MapMaxLayer, rme::MapMaxLayer);
+	tmpsizer->Add(end_z_ctrl, 0, wxALL, 5);
+	sizer->Add(tmpsizer, 1, wxEXPAND | wxLEFT | wxRIGHT, 5);
+
+	// OK/Cancel buttons
+	wxBoxSizer *buttons = newd wxBoxSizer(wxHORIZONTAL);
+	buttons->Add(newd wxButton(this, wxID_OK, "Ok"), 0, wxALL, 5);
+	buttons->Add(newd wxButton(this, wxID_CANCEL, "Cancel"), 0, wxALL, 5);
+	sizer->Add(buttons, wxSizerFlags(1).Center());
+
+	SetSizer(sizer);
+	Layout();
+	Centre(wxBOTH);
+}
+
+OpenMapAreaWindow::~OpenMapAreaWindow() = default;
+
+MapArea OpenMapAreaWindow::GetArea() const {
+	MapArea area;
+	area.start.x = std::min(start_x_ctrl->GetValue(), end_x_ctrl->GetValue());
+	area.start.y = std::min(start_y_ctrl->GetValue(), end_y_ctrl->GetValue());
+	area.start.z = std::min(start_z_ctrl->GetValue(), end_z_ctrl->GetValue());
+	area.end.x = std::max(start_x_ctrl->GetValue(), end_x_ctrl->GetValue());
+	area.end.y = std::max(start_y_ctrl->GetValue(), end_y_ctrl->GetValue());
+	area.end.z = std::max(start_z_ctrl->GetValue(), end_z_ctrl->GetValue());
+	return area;
+}
+
+void OpenMapAreaWindow::OnClickBrowse(wxCommandEvent &WXUNUSED(event)) {
+	wxFileDialog dialog(this, "Open map file", "", "", MAP_LOAD_FILE_WILDCARD,
+						wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+	if (dialog.ShowModal() == wxID_OK)
+		file_text_field->ChangeValue(dialog.GetPath());
+}
+
+void OpenMapAreaWindow::OnClickOK(wxCommandEvent &WXUNUSED(event)) {
+	if (!GetFile().FileExists()) {
+		g_gui.PopupDialog(this, "Error",
+						  "The specified map file doesn't exist", wxOK);
+		return;
+	}
+	EndModal(1);
+}
+
+void OpenMapAreaWindow::OnClickCancel(wxCommandEvent &WXUNUSED(event)) {
+	// Just close this window
+	EndModal(0);
+}
+
 // ============================================================================
 // Export Minimap window
 
@@ -874,16 +1033,15 @@ void FindBrushDialog::OnClickOKInternal() {
 						if (type.id == 0)
 							continue;
 
-						RAWBrush *raw_brush = type.raw_brush;
-						if (!raw_brush)
+						if (!type.hasRAWBrush())
 							continue;
 
-						if (as_lower_str(raw_brush->getName())
+						if (as_lower_str(RAWBrush::getName(type))
 								.find(search_string) == std::string::npos)
 							continue;
 
 						// Found one!
-						result_brush = raw_brush;
+						result_brush = g_items.getRAWBrush(type.id);
 						break;
 					}
 				}
@@ -931,16 +1089,15 @@ void FindBrushDialog::RefreshContentsInternal() {
 			if (type.id == 0)
 				continue;
 
-			RAWBrush *raw_brush = type.raw_brush;
-			if (!raw_brush)
+			if (!type.hasRAWBrush())
 				continue;
 
-			if (as_lower_str(raw_brush->getName()).find(search_string) ==
+			if (as_lower_str(RAWBrush::getName(type)).find(search_string) ==
 				std::string::npos)
 				continue;
 
 			found_search_results = true;
-			item_list->AddBrush(raw_brush);
+			item_list->AddBrush(g_items.getRAWBrush(type.id));
 		}
 
 		while (raws.size() > 0) {
@@ -1025,7 +1182,7 @@ void FindDialogListBox::OnDrawItem(wxDC &dc, const wxRect &rect,
 			auto creatureSprite =
 				g_gui.gfx.getCreatureSprite(creatureType->outfit.lookType);
 			if (creatureSprite) {
-				creatureSprite->DrawTo(&dc, rect, creatureType->outfit);
+				creatureSprite->DrawTo(&dc, rect, creatureType->outfit, this);
 			}
 		}
 
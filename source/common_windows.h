@@ -22,6 +22,7 @@
 
 #include "dcbutton.h"
 #include "positionctrl.h"
+#include "iomap.h"
 
 class GameSprite;
 class MapTab;
@@ -90,6 +91,7 @@ public:
 	virtual ~ImportMapWindow();
 
 	void OnClickBrowse(wxCommandEvent&);
+	void OnToggleArea(wxCommandEvent&);
 	void OnClickOK(wxCommandEvent&);
 	void OnClickCancel(wxCommandEvent&);
 protected:
@@ -100,12 +102,46 @@ protected:
 	wxSpinCtrl* y_offset_ctrl;
 	wxSpinCtrl* z_offset_ctrl;
 
+	// Only the tiles in this box of the imported map, on every floor
+	wxCheckBox* area_checkbox;
+	wxSpinCtrl* area_start_x_ctrl;
+	wxSpinCtrl* area_start_y_ctrl;
+	wxSpinCtrl* area_end_x_ctrl;
+	wxSpinCtrl* area_end_y_ctrl;
+
 	wxChoice* house_options;
 	wxChoice* spawn_options;
 
 	DECLARE_EVENT_TABLE();
 };
 
+/**
+ * The open area dialog, select a map file and the part of it to load.
+ */
+class OpenMapAreaWindow : public wxDialog
+{
+public:
+	OpenMapAreaWindow(wxWindow* parent);
+	virtual ~OpenMapAreaWindow();
+
+	void OnClickBrowse(wxCommandEvent&);
+	void OnClickOK(wxCommandEvent&);
+	void OnClickCancel(wxCommandEvent&);
+
+	FileName GetFile() const { return file_text_field->GetValue(); }
+	MapArea GetArea() const;
+protected:
+	wxTextCtrl* file_text_field;
+	wxSpinCtrl* start_x_ctrl;
+	wxSpinCtrl* start_y_ctrl;
+	wxSpinCtrl* end_x_ctrl;
+	wxSpinCtrl* end_y_ctrl;
+	wxSpinCtrl* start_z_ctrl;
+	wxSpinCtrl* end_z_ctrl;
+
+	DECLARE_EVENT_TABLE();
+};
+
 /**
  * The export minimap dialog, select output path and what floors to export.
  */
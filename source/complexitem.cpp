@@ -24,7 +24,7 @@
 // Container
 Container::Container(const uint16_t type) : Item(type, 0)
 {
-	////
+	plain = false;
 }
 
 Container::~Container()
@@ -58,7 +58,7 @@ Item* Container::getItem(size_t index) const
 Teleport::Teleport(const uint16_t type) : Item(type, 0),
 	destination(0, 0, 0)
 {
-	////
+	plain = false;
 }
 
 Item* Teleport::deepCopy() const
@@ -74,7 +74,7 @@ Item* Teleport::deepCopy() const
 Door::Door(const uint16_t type) : Item(type, 0),
 	doorId(0)
 {
-	////
+	plain = false;
 }
 
 Item* Door::deepCopy() const
@@ -90,7 +90,7 @@ Item* Door::deepCopy() const
 Depot::Depot(const uint16_t type) : Item(type, 0),
 	depotId(0)
 {
-	////
+	plain = false;
 }
 
 Item* Depot::deepCopy() const
@@ -44,9 +44,9 @@ public:
 	}
 
 	T& locate(size_t index) {
-		// Masterly inefficient!
-		while(index >= sz) {
-			resize(sz+REALLOC_INCREASE);
+		if(index >= sz) {
+			// One reallocation, at least doubling, instead of a loop of small steps
+			resize(std::max(index + 1, std::max(sz * 2, sz + REALLOC_INCREASE)));
 		}
 		return start[index];
 	}
@@ -62,6 +62,11 @@ public:
 		locate(index) = value;
 	}
 
+	void swap(contigous_vector& other) {
+		std::swap(start, other.start);
+		std::swap(sz, other.sz);
+	}
+
 	T operator[](size_t index) { return at(index); }
 	const T operator[](size_t index) const { return at(index); }
 private:
@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "conversion_table.h"
+
+ConversionTable::ConversionTable(const ConversionMap& conversion)
+{
+	if(!conversion.stm.empty()) {
+		single.resize(size_t(conversion.stm.rbegin()->first) + 1, nullptr);
+		for(const auto& entry : conversion.stm) {
+			single[entry.first] = &entry.second;
+		}
+	}
+
+	if(conversion.mtm.empty()) {
+		return;
+	}
+
+	many.push_back(nullptr);
+	for(const auto& entry : conversion.mtm) {
+		uint32_t node = 0;
+		for(uint16_t id : entry.first) {
+			auto it = edges.find(edge(node, id));
+			if(it == edges.end()) {
+				it = edges.emplace(edge(node, id), uint32_t(many.size())).first;
+				many.push_back(nullptr);
+			}
+			node = it->second;
+		}
+		many[node] = &entry;
+	}
+}
+
+const ConversionMap::MTM::value_type* ConversionTable::findMany(const uint16_t* ids, size_t count) const
+{
+	const ConversionMap::MTM::value_type* found = nullptr;
+	uint32_t node = 0;
+	for(size_t index = 0; index < count && !many.empty(); ++index) {
+		auto it = edges.find(edge(node, ids[index]));
+		if(it == edges.end()) {
+			break;
+		}
+		node = it->second;
+		if(many[node]) {
+			found = many[node];
+		}
+	}
+	return found;
+}
@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_CONVERSION_TABLE_H_
+#define RME_CONVERSION_TABLE_H_
+
+#include "templates.h"
+
+#include <unordered_map>
+
+// A ConversionMap laid out for the lookups of Map::convert. Single items are found by
+// indexing a table with their id, the many to many keys are kept in a trie keyed by the
+// sorted ids of a tile. It points into the ConversionMap, which has to outlive it.
+class ConversionTable
+{
+public:
+	explicit ConversionTable(const ConversionMap& conversion);
+
+	// The items that replace an item of that id, nullptr if it is kept
+	const std::vector<uint16_t>* findSingle(uint16_t id) const noexcept {
+		return id < single.size() ? single[id] : nullptr;
+	}
+
+	// The entry of the longest run of ids, from the first one on, that is a many to many key.
+	// The ids must be sorted, nullptr if not even the first one is a key.
+	const ConversionMap::MTM::value_type* findMany(const uint16_t* ids, size_t count) const;
+
+	bool hasMany() const noexcept { return !many.empty(); }
+
+private:
+	static uint64_t edge(uint32_t node, uint16_t id) noexcept { return (uint64_t(node) << 16) | id; }
+
+	std::vector<const std::vector<uint16_t>*> single;
+	// Node 0 is the root, a node its key ends at has the entry
+	std::vector<const ConversionMap::MTM::value_type*> many;
+	std::unordered_map<uint64_t, uint32_t> edges;
+};
+
+#endif
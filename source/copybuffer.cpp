@@ -17,25 +17,212 @@
 
 #include "main.h"
 
+#include <tuple>
+
 #include "copybuffer.h"
 #include "editor.h"
 #include "gui.h"
 #include "creature.h"
+#include "spawn.h"
+#include "iomap_otbm.h"
+#include "session_recorder.h"
+#include "thread_pool.h"
+
+namespace
+{
+	const char clipboard_magic[4] = { 'R', 'M', 'E', 'C' };
+	const uint32_t clipboard_format_version = 1;
+
+	enum : uint8_t {
+		CLIPBOARD_CREATURE = 1 << 0,
+		CLIPBOARD_SPAWN = 1 << 1,
+	};
+
+	const wxDataFormat& clipboardFormat()
+	{
+		// Created on first use, the clipboard isn't available before wx is initialized
+		static const wxDataFormat format("application/x-rme-tiles");
+		return format;
+	}
+
+	template <typename T>
+	void append(std::vector<uint8_t>& out, T value)
+	{
+		const size_t at = out.size();
+		out.resize(at + sizeof(T));
+		memcpy(&out[at], &value, sizeof(T));
+	}
+
+	template <typename T>
+	bool take(const uint8_t*& in, const uint8_t* end, T& value)
+	{
+		if(static_cast<size_t>(end - in) < sizeof(T)) {
+			return false;
+		}
+		memcpy(&value, in, sizeof(T));
+		in += sizeof(T);
+		return true;
+	}
+
+	bool sameLeaf(const Position& a, const Position& b)
+	{
+		return (a.x >> 2) == (b.x >> 2) && (a.y >> 2) == (b.y >> 2);
+	}
+
+	// Writes the selected parts of the tile, returns the number of items written
+	size_t writeTile(const IOMap& iomap, MemoryNodeFileWriteHandle& writer, Tile* tile)
+	{
+		const Position& position = tile->getPosition();
+		// The house and the tile flags go along with the ground
+		const bool whole = tile->ground && tile->ground->isSelected();
+
+		writer.addNode(OTBM_TILE);
+		writer.addU16(position.x);
+		writer.addU16(position.y);
+		writer.addU8(position.z);
+		writer.addU32(whole ? tile->house_id : 0);
+		writer.addU16(whole ? tile->getMapFlags() : 0);
+
+		const std::vector<uint16_t>& zones = tile->getZoneIds();
+		writer.addU16(whole ? zones.size() : 0);
+		if(whole) {
+			for(uint16_t zone : zones) {
+				writer.addU16(zone);
+			}
+		}
+
+		const bool creature = tile->creature && tile->creature->isSelected();
+		const bool spawn = tile->spawn && tile->spawn->isSelected();
+		writer.addU8((creature ? CLIPBOARD_CREATURE : 0) | (spawn ? CLIPBOARD_SPAWN : 0));
+		if(creature) {
+			writer.addString(tile->creature->getName());
+			writer.addU8(tile->creature->getDirection());
+			writer.addU32(tile->creature->getSpawnTime());
+		}
+		if(spawn) {
+			writer.addU32(tile->spawn->getSize());
+		}
+
+		ItemVector items = tile->getSelectedItems();
+		for(const Item* item : items) {
+			item->writeItemNode_OTBM(iomap, writer);
+		}
+
+		writer.endNode();
+		return items.size();
+	}
+
+	// Everything read is selected, just like the tiles it was copied from.
+	// The creature database can't be changed off the main thread, so a creature
+	// of an unknown type is left without one and its name returned in missing_creature.
+	Tile* readTile(const IOMap& iomap, BinaryNode* node, Position& position, std::string& missing_creature)
+	{
+		uint8_t type;
+		uint16_t x, y, flags, zone_count;
+		uint8_t z, extras;
+		uint32_t house_id;
+		if(!node->getByte(type) || type != OTBM_TILE ||
+			!node->getU16(x) || !node->getU16(y) || !node->getU8(z) ||
+			!node->getU32(house_id) || !node->getU16(flags) || !node->getU16(zone_count)) {
+			return nullptr;
+		}
+
+		position = Position(x, y, z);
+		Tile* tile = newd Tile(x, y, z);
+		tile->house_id = house_id;
+		tile->setMapFlags(flags);
+		for(uint16_t index = 0; index < zone_count; ++index) {
+			uint16_t zone;
+			if(node->getU16(zone)) {
+				tile->addZoneId(zone);
+			}
+		}
+
+		if(!node->getU8(extras)) {
+			extras = 0;
+		}
+		if(extras & CLIPBOARD_CREATURE) {
+			std::string name;
+			uint8_t direction;
+			uint32_t spawntime;
+			if(node->getString(name) && node->getU8(direction) && node->getU32(spawntime)) {
+				Creature* creature = newd Creature(name);
+				if(!creature->getType()) {
+					missing_creature = name;
+				}
+				creature->setDirection(static_cast<Direction>(direction));
+				creature->setSpawnTime(spawntime);
+				creature->select();
+				tile->creature = creature;
+			}
+		}
+		if(extras & CLIPBOARD_SPAWN) {
+			uint32_t size;
+			if(node->getU32(size)) {
+				tile->spawn = newd Spawn(size);
+				tile->spawn->select();
+			}
+		}
+
+		for(BinaryNode* itemNode = node->getChild(); itemNode != nullptr; itemNode = itemNode->advance()) {
+			uint8_t item_type;
+			if(!itemNode->getByte(item_type) || item_type != OTBM_ITEM) {
+				continue;
+			}
+			Item* item = Item::Create_OTBM(iomap, itemNode);
+			if(item) {
+				item->unserializeItemNode_OTBM(iomap, itemNode);
+				item->select();
+				tile->addItem(item);
+			}
+		}
+
+		tile->update();
+		return tile;
+	}
+
+	size_t chunkCount(size_t count, size_t grain = 64)
+	{
+		return std::max<size_t>(std::min(count / grain, ThreadPool::getInstance().getWorkerCount() * 8), 1);
+	}
+}
 
 CopyBuffer::CopyBuffer() :
-	tiles(newd BaseMap())
+	owner(0),
+	sequence(0),
+	tile_count(0),
+	tiles(nullptr)
 {
 	;
 }
 
 size_t CopyBuffer::GetTileCount()
 {
-	return tiles ? (size_t)tiles->size() : 0;
+	return tile_count;
+}
+
+size_t CopyBuffer::memsize() const
+{
+	size_t mem = data.capacity() + blocks.capacity() * sizeof(Block);
+	if(tiles) {
+		for(MapIterator it = tiles->begin(); it != tiles->end(); ++it) {
+			if(const Tile* tile = (*it)->get()) {
+				mem += tile->memsize();
+			}
+		}
+	}
+	return mem;
 }
 
 BaseMap& CopyBuffer::getBufferMap()
 {
-	ASSERT(tiles);
+	if(!tiles) {
+		tiles = newd BaseMap();
+		for(const DecodedTile& entry : decode()) {
+			entry.tile->setLocation(tiles->createTileL(entry.position));
+			tiles->setTile(entry.tile);
+		}
+	}
 	return *tiles;
 }
 
@@ -46,7 +233,6 @@ CopyBuffer::~CopyBuffer()
 
 Position CopyBuffer::getPosition() const
 {
-	ASSERT(tiles);
 	return copyPos;
 }
 
@@ -54,57 +240,220 @@ void CopyBuffer::clear()
 {
 	delete tiles;
 	tiles = nullptr;
+	data.clear();
+	blocks.clear();
+	tile_count = 0;
 }
 
-void CopyBuffer::copy(Editor& editor, int floor)
+size_t CopyBuffer::serialize(Editor& editor, int floor)
 {
-	if(!editor.hasSelection()) {
-		g_gui.SetStatusText("No tiles to copy.");
-		return;
-	}
-
-	clear();
-	tiles = newd BaseMap();
+	const Selection& selection = editor.getSelection();
+	std::vector<Tile*> selected(selection.begin(), selection.end());
+	// Tiles of one leaf end up in the same block, on all floors
+	std::sort(selected.begin(), selected.end(), [](const Tile* a, const Tile* b) {
+		const Position& pa = a->getPosition();
+		const Position& pb = b->getPosition();
+		return std::make_tuple(pa.x >> 2, pa.y >> 2, pa.z, pa.y, pa.x) < std::make_tuple(pb.x >> 2, pb.y >> 2, pb.z, pb.y, pb.x);
+	});
 
-	int tile_count = 0;
-	int item_count = 0;
 	copyPos = Position(0xFFFF, 0xFFFF, floor);
+	std::vector<std::pair<size_t, size_t>> runs;
+	for(size_t index = 0; index < selected.size();) {
+		size_t next = index + 1;
+		while(next < selected.size() && sameLeaf(selected[index]->getPosition(), selected[next]->getPosition())) {
+			++next;
+		}
+		runs.emplace_back(index, next);
+		index = next;
+	}
+	for(const Tile* tile : selected) {
+		copyPos.x = std::min(copyPos.x, tile->getX());
+		copyPos.y = std::min(copyPos.y, tile->getY());
+	}
 
-	for(Tile* tile : editor.getSelection()) {
-		++tile_count;
+	version = editor.getMap().getVersion();
+	const VirtualIOMap iomap(version);
+	std::vector<std::vector<uint8_t>> encoded(runs.size());
+	std::vector<size_t> item_counts(runs.size(), 0);
+	const size_t chunk_count = chunkCount(runs.size());
+	ThreadPool::getInstance().parallelFor(chunk_count, [&](size_t chunk) {
+		MemoryNodeFileWriteHandle writer;
+		const size_t end = runs.size() * (chunk + 1) / chunk_count;
+		for(size_t run = runs.size() * chunk / chunk_count; run < end; ++run) {
+			writer.reset();
+			writer.addNode(OTBM_TILE_AREA);
+			for(size_t index = runs[run].first; index < runs[run].second; ++index) {
+				item_counts[run] += writeTile(iomap, writer, selected[index]);
+			}
+			writer.endNode();
+			encoded[run].assign(writer.getMemory(), writer.getMemory() + writer.getSize());
+		}
+	});
+
+	owner = wxGetProcessId();
+	++sequence;
+	tile_count = selected.size();
+
+	data.insert(data.end(), clipboard_magic, clipboard_magic + sizeof(clipboard_magic));
+	append<uint32_t>(data, clipboard_format_version);
+	append<uint32_t>(data, owner);
+	append<uint32_t>(data, sequence);
+	append<uint32_t>(data, version.otbm);
+	append<uint32_t>(data, version.client);
+	append<uint16_t>(data, copyPos.x);
+	append<uint16_t>(data, copyPos.y);
+	append<uint8_t>(data, copyPos.z);
+	append<uint32_t>(data, tile_count);
+	append<uint32_t>(data, encoded.size());
+	for(const std::vector<uint8_t>& block : encoded) {
+		append<uint32_t>(data, block.size());
+	}
 
-		TileLocation* newlocation = tiles->createTileL(tile->getPosition());
-		Tile* copied_tile = tiles->allocator(newlocation);
+	size_t item_count = 0;
+	for(size_t run = 0; run < encoded.size(); ++run) {
+		blocks.push_back({ data.size(), encoded[run].size() });
+		data.insert(data.end(), encoded[run].begin(), encoded[run].end());
+		std::vector<uint8_t>().swap(encoded[run]);
+		item_count += item_counts[run];
+	}
+	return item_count;
+}
 
-		if(tile->ground && tile->ground->isSelected()) {
-			copied_tile->house_id = tile->house_id;
-			copied_tile->setMapFlags(tile->getMapFlags());
-			copied_tile->setZoneIds(tile);
+std::vector<CopyBuffer::DecodedTile> CopyBuffer::decode() const
+{
+	const VirtualIOMap iomap(version);
+	std::vector<std::vector<DecodedTile>> decoded(blocks.size());
+	const size_t chunk_count = chunkCount(blocks.size());
+	ThreadPool::getInstance().parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t end = blocks.size() * (chunk + 1) / chunk_count;
+		for(size_t index = blocks.size() * chunk / chunk_count; index < end; ++index) {
+			MemoryNodeFileReadHandle handle(&data[blocks[index].offset], blocks[index].size);
+			BinaryNode* root = handle.getRootNode();
+			for(BinaryNode* node = root ? root->getChild() : nullptr; node != nullptr; node = node->advance()) {
+				DecodedTile entry;
+				entry.tile = readTile(iomap, node, entry.position, entry.missing_creature);
+				if(entry.tile) {
+					decoded[index].push_back(entry);
+				}
+			}
 		}
-
-		ItemVector tile_selection = tile->getSelectedItems();
-		for(ItemVector::iterator iit = tile_selection.begin(); iit != tile_selection.end(); ++iit) {
-			++item_count;
-			// Copy items to copybuffer
-			copied_tile->addItem((*iit)->deepCopy());
+	});
+
+	std::vector<DecodedTile> result;
+	result.reserve(tile_count);
+	for(const std::vector<DecodedTile>& block : decoded) {
+		for(const DecodedTile& entry : block) {
+			if(!entry.missing_creature.empty()) {
+				CreatureType* type = g_creatures[entry.missing_creature];
+				if(!type) {
+					type = g_creatures.addMissingCreatureType(entry.missing_creature, false);
+				}
+				entry.tile->creature->setType(type);
+			}
+			result.push_back(entry);
 		}
+	}
+	return result;
+}
 
-		if(tile->creature && tile->creature->isSelected()) {
-			copied_tile->creature = tile->creature->deepCopy();
-		}
-		if(tile->spawn && tile->spawn->isSelected()) {
-			copied_tile->spawn = tile->spawn->deepCopy();
+void CopyBuffer::publish()
+{
+	// Batch mode has no clipboard to share with
+	if(data.empty() || g_gui.IsHeadless() || !wxTheClipboard->Open()) {
+		return;
+	}
+
+	wxCustomDataObject* object = newd wxCustomDataObject(clipboardFormat());
+	object->SetData(data.size(), data.data());
+	wxTheClipboard->SetData(object);
+	wxTheClipboard->Close();
+}
+
+bool CopyBuffer::fetchClipboard()
+{
+	if(!wxTheClipboard->Open()) {
+		return false;
+	}
+
+	bool changed = false;
+	if(wxTheClipboard->IsSupported(clipboardFormat())) {
+		wxCustomDataObject object(clipboardFormat());
+		if(wxTheClipboard->GetData(object)) {
+			changed = adopt(static_cast<const uint8_t*>(object.GetData()), object.GetSize());
 		}
+	}
+	wxTheClipboard->Close();
+	return changed;
+}
 
-		tiles->setTile(copied_tile);
+bool CopyBuffer::adopt(const uint8_t* in, size_t size)
+{
+	const uint8_t* const start = in;
+	const uint8_t* const end = in + size;
+
+	uint32_t format, copy_owner, copy_sequence, otbm, client, count, block_count;
+	uint16_t x, y;
+	uint8_t z;
+	if(size < sizeof(clipboard_magic) || memcmp(in, clipboard_magic, sizeof(clipboard_magic)) != 0) {
+		return false;
+	}
+	in += sizeof(clipboard_magic);
+	if(!take(in, end, format) || format != clipboard_format_version ||
+		!take(in, end, copy_owner) || !take(in, end, copy_sequence)) {
+		return false;
+	}
+
+	if(copy_owner == owner && copy_sequence == sequence) {
+		// Still the same copy
+		return false;
+	}
+
+	if(!take(in, end, otbm) || !take(in, end, client) ||
+		!take(in, end, x) || !take(in, end, y) || !take(in, end, z) ||
+		!take(in, end, count) || !take(in, end, block_count)) {
+		return false;
+	}
+
+	// Item ids only mean the same thing with the same client version
+	if(client != static_cast<uint32_t>(g_gui.GetCurrentVersionID())) {
+		return false;
+	}
+
+	std::vector<Block> copy_blocks;
+	size_t offset = (in - start) + block_count * sizeof(uint32_t);
+	for(uint32_t index = 0; index < block_count; ++index) {
+		uint32_t block_size;
+		if(!take(in, end, block_size) || offset + block_size > size) {
+			return false;
+		}
+		copy_blocks.push_back({ offset, block_size });
+		offset += block_size;
+	}
 
-		if(copied_tile->getX() < copyPos.x)
-			copyPos.x = copied_tile->getX();
+	clear();
+	data.assign(start, end);
+	blocks = std::move(copy_blocks);
+	owner = copy_owner;
+	sequence = copy_sequence;
+	version = MapVersion(static_cast<MapVersionID>(otbm), static_cast<ClientVersionID>(client));
+	copyPos = Position(x, y, z);
+	tile_count = count;
+	return true;
+}
 
-		if(copied_tile->getY() < copyPos.y)
-			copyPos.y = copied_tile->getY();
+void CopyBuffer::copy(Editor& editor, int floor)
+{
+	if(!editor.hasSelection()) {
+		g_gui.SetStatusText("No tiles to copy.");
+		return;
 	}
 
+	g_session_recorder.recordCopy(editor, floor, false);
+
+	clear();
+	const size_t item_count = serialize(editor, floor);
+	publish();
+
 	std::ostringstream ss;
 	ss << "Copied " << tile_count << " tile" << (tile_count > 1 ? "s" : "") <<  " (" << item_count << " item" << (item_count > 1? "s" : "") << ")";
 	g_gui.SetStatusText(wxstr(ss.str()));
@@ -117,13 +466,13 @@ void CopyBuffer::cut(Editor& editor, int floor)
 		return;
 	}
 
+	g_session_recorder.recordCopy(editor, floor, true);
+
 	clear();
-	tiles = newd BaseMap();
+	const size_t item_count = serialize(editor, floor);
+	publish();
 
 	Map& map = editor.getMap();
-	int tile_count = 0;
-	int item_count = 0;
-	copyPos = Position(0xFFFF, 0xFFFF, floor);
 
 	BatchAction* batch = editor.createBatch(ACTION_CUT_TILES);
 	Action* action = editor.createAction(batch);
@@ -131,47 +480,29 @@ void CopyBuffer::cut(Editor& editor, int floor)
 	PositionList tilestoborder;
 
 	for(Tile* tile : editor.getSelection()) {
-		tile_count++;
-
 		Tile* newtile = tile->deepCopy(map);
-		Tile* copied_tile = tiles->allocator(tile->getLocation());
 
 		if(tile->ground && tile->ground->isSelected()) {
-			copied_tile->house_id = newtile->house_id;
 			newtile->house_id = 0;
-			copied_tile->setMapFlags(tile->getMapFlags());
-			copied_tile->setZoneIds(tile);
 			newtile->setMapFlags(TILESTATE_NONE);
 			newtile->clearZoneId();
 		}
 
-		ItemVector tile_selection = newtile->popSelectedItems();
-		for(ItemVector::iterator iit = tile_selection.begin(); iit != tile_selection.end(); ++iit) {
-			item_count++;
-			// Add items to copybuffer
-			copied_tile->addItem(*iit);
+		// The copybuffer has its own serialized copy of these
+		for(Item* item : newtile->popSelectedItems()) {
+			delete item;
 		}
 
 		if(newtile->creature && newtile->creature->isSelected()) {
-			copied_tile->creature = newtile->creature;
+			delete newtile->creature;
 			newtile->creature = nullptr;
 		}
 
 		if(newtile->spawn && newtile->spawn->isSelected()) {
-			copied_tile->spawn = newtile->spawn;
+			delete newtile->spawn;
 			newtile->spawn = nullptr;
 		}
 
-		tiles->setTile(copied_tile->getPosition(), copied_tile);
-
-		if(copied_tile->getX() < copyPos.x) {
-			copyPos.x = copied_tile->getX();
-		}
-
-		if(copied_tile->getY() < copyPos.y) {
-			copyPos.y = copied_tile->getY();
-		}
-
 		if(g_settings.getInteger(Config::USE_AUTOMAGIC)) {
 			for(int y = -1; y <= 1; y++)
 				for(int x = -1; x <= 1; x++)
@@ -219,92 +550,143 @@ void CopyBuffer::cut(Editor& editor, int floor)
 
 void CopyBuffer::paste(Editor& editor, const Position& toPosition)
 {
-	if(!tiles) {
+	if(!canPaste()) {
 		return;
 	}
 
+	g_session_recorder.recordPaste(editor, toPosition);
 	Map& map = editor.getMap();
 
-	BatchAction* batchAction = editor.createBatch(ACTION_PASTE_TILES);
-	Action* action = editor.createAction(batchAction);
-	for(MapIterator it = tiles->begin(); it != tiles->end(); ++it) {
-		Tile* buffer_tile = (*it)->get();
-		Position pos = buffer_tile->getPosition() - copyPos + toPosition;
-
-		if(!pos.isValid())
+	// Decoded straight from the serialized copy, there is no intermediate map
+	std::vector<DecodedTile> decoded = decode();
+	PositionVector pasted;
+	pasted.reserve(decoded.size());
+
+	PositionVector destinations;
+	std::vector<Tile*> copies;
+	destinations.reserve(decoded.size());
+	copies.reserve(decoded.size());
+	for(DecodedTile& entry : decoded) {
+		Position pos = entry.position - copyPos + toPosition;
+		pasted.push_back(pos);
+
+		if(!pos.isValid()) {
+			delete entry.tile;
 			continue;
-
-		TileLocation* location = map.createTileL(pos);
-		Tile* copy_tile = buffer_tile->deepCopy(map);
-		Tile* old_dest_tile = location->get();
-		Tile* new_dest_tile = nullptr;
-		copy_tile->setLocation(location);
-
-		if(g_settings.getInteger(Config::MERGE_PASTE) || !copy_tile->ground) {
-			if(old_dest_tile)
-				new_dest_tile = old_dest_tile->deepCopy(map);
-			else
-				new_dest_tile = map.allocator(location);
-			new_dest_tile->merge(copy_tile);
-			delete copy_tile;
-		} else {
-			// If the copied tile has ground, replace target tile
-			new_dest_tile = copy_tile;
 		}
+		destinations.push_back(pos);
+		copies.push_back(entry.tile);
+	}
 
-		// Add all surrounding tiles to the map, so they get borders
-		map.createTile(pos.x-1, pos.y-1, pos.z);
-		map.createTile(pos.x  , pos.y-1, pos.z);
-		map.createTile(pos.x+1, pos.y-1, pos.z);
-		map.createTile(pos.x-1, pos.y  , pos.z);
-		map.createTile(pos.x+1, pos.y  , pos.z);
-		map.createTile(pos.x-1, pos.y+1, pos.z);
-		map.createTile(pos.x  , pos.y+1, pos.z);
-		map.createTile(pos.x+1, pos.y+1, pos.z);
+	// The destinations are all different tiles, so they are merged side by side
+	const std::vector<TileLocation*> locations = map.createTileLocations(destinations);
+	const bool merge_paste = g_settings.getInteger(Config::MERGE_PASTE);
+	std::vector<Tile*> new_tiles(copies.size());
+	size_t chunk_count = chunkCount(copies.size(), 256);
+	ThreadPool::getInstance().parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t end = copies.size() * (chunk + 1) / chunk_count;
+		for(size_t index = copies.size() * chunk / chunk_count; index < end; ++index) {
+			TileLocation* location = locations[index];
+			Tile* copy_tile = copies[index];
+			Tile* old_dest_tile = location->get();
+			copy_tile->setLocation(location);
+
+			if(merge_paste || !copy_tile->ground) {
+				Tile* new_dest_tile;
+				if(old_dest_tile)
+					new_dest_tile = old_dest_tile->deepCopy(map);
+				else
+					new_dest_tile = map.allocator(location);
+				new_dest_tile->merge(copy_tile);
+				delete copy_tile;
+				new_tiles[index] = new_dest_tile;
+			} else {
+				// If the copied tile has ground, replace target tile
+				new_tiles[index] = copy_tile;
+			}
+		}
+	});
 
+	BatchAction* batchAction = editor.createBatch(ACTION_PASTE_TILES);
+	Action* action = editor.createAction(batchAction);
+	for(Tile* new_dest_tile : new_tiles) {
 		action->addChange(newd Change(new_dest_tile));
 	}
 	batchAction->addAndCommitAction(action);
 
+	// Add all surrounding tiles to the map, so they get borders
+	PositionVector around;
+	around.reserve(destinations.size() * 9);
+	for(const Position& pos : destinations) {
+		for(int y = -1; y <= 1; ++y) {
+			for(int x = -1; x <= 1; ++x) {
+				Position neighbour(pos.x + x, pos.y + y, pos.z);
+				if(neighbour.isValid()) {
+					around.push_back(neighbour);
+				}
+			}
+		}
+	}
+	std::sort(around.begin(), around.end());
+	around.erase(std::unique(around.begin(), around.end()), around.end());
+	map.createTiles(around);
+
 	if(g_settings.getInteger(Config::USE_AUTOMAGIC) && g_settings.getInteger(Config::BORDERIZE_PASTE)) {
 		action = editor.createAction(batchAction);
-		TileList borderize_tiles;
+		std::vector<const Tile*> borderize_tiles;
 
 		// Go through all modified (selected) tiles (might be slow)
-		for(MapIterator it = tiles->begin(); it != tiles->end(); ++it) {
+		for(const Position& pos : pasted) {
 			bool add_me = false; // If this tile is touched
-			Position pos = (*it)->getPosition() - copyPos + toPosition;
 			if(pos.z < rme::MapMinLayer || pos.z > rme::MapMaxLayer) {
 				continue;
 			}
 			// Go through all neighbours
-			Tile* t;
-			t = map.getTile(pos.x-1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x  , pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x+1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x-1, pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x+1, pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x-1, pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x  , pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x+1, pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			if(add_me) borderize_tiles.push_back(map.getTile(pos));
+			for(int y = -1; y <= 1; ++y) {
+				for(int x = -1; x <= 1; ++x) {
+					if(x == 0 && y == 0) {
+						continue;
+					}
+					const Tile* t = map.getTile(pos.x + x, pos.y + y, pos.z);
+					if(t && !t->isSelected()) {
+						borderize_tiles.push_back(t);
+						add_me = true;
+					}
+				}
+			}
+			const Tile* tile = map.getTile(pos);
+			if(add_me && tile) {
+				borderize_tiles.push_back(tile);
+			}
 		}
 		// Remove duplicates
-		borderize_tiles.sort();
-		borderize_tiles.unique();
+		std::sort(borderize_tiles.begin(), borderize_tiles.end());
+		borderize_tiles.erase(std::unique(borderize_tiles.begin(), borderize_tiles.end()), borderize_tiles.end());
 
-		for(Tile* tile : borderize_tiles) {
-			if(tile) {
-				Tile* newTile = tile->deepCopy(map);
-				newTile->borderize(&map);
-
-				if(tile->ground && tile->ground->isSelected()) {
-					newTile->selectGround();
-				}
+		// The copies aren't on the map, borderizing them only reads it. The neighbours have to be
+		// paged in first, the pool can't read them back
+		for(const Tile* tile : borderize_tiles) {
+			map.pageInArea(tile->getX() - 1, tile->getY() - 1, tile->getX() + 1, tile->getY() + 1);
+		}
+		std::vector<Tile*> bordered(borderize_tiles.size());
+		chunk_count = chunkCount(borderize_tiles.size(), 256);
+		ThreadPool::getInstance().parallelFor(chunk_count, [&](size_t chunk) {
+			const size_t end = borderize_tiles.size() * (chunk + 1) / chunk_count;
+			for(size_t index = borderize_tiles.size() * chunk / chunk_count; index < end; ++index) {
+				bordered[index] = borderize_tiles[index]->deepCopy(map);
+				bordered[index]->borderize(&map);
+			}
+		});
 
-				newTile->wallize(&map);
-				action->addChange(newd Change(newTile));
+		for(size_t index = 0; index < bordered.size(); ++index) {
+			const Tile* tile = borderize_tiles[index];
+			Tile* newTile = bordered[index];
+			if(tile->ground && tile->ground->isSelected()) {
+				newTile->selectGround();
 			}
+
+			newTile->wallize(&map);
+			action->addChange(newd Change(newTile));
 		}
 
 		// Commit changes to map
@@ -317,6 +699,7 @@ void CopyBuffer::paste(Editor& editor, const Position& toPosition)
 
 bool CopyBuffer::canPaste() const
 {
-	return tiles && tiles->size() != 0;
+	// The items were copied with the ids of their version, another one loaded
+	// in the meantime would read them as something else
+	return tile_count != 0 && version.client == g_gui.GetCurrentVersionID();
 }
-
@@ -22,9 +22,14 @@
 
 #include "position.h"
 #include "basemap.h"
+#include "client_version.h"
 
 class Editor;
 
+// The copied tiles are kept serialized in the OTBM item encoding, one block per
+// map leaf, and are only turned into tiles when they are pasted or previewed.
+// The same bytes are put on the system clipboard, so other instances of the
+// editor can paste them too.
 class CopyBuffer
 {
 public:
@@ -39,15 +44,50 @@ public:
 	// Returns the upper-left corner of the copybuffer
 	Position getPosition() const;
 
+	// Takes over tiles that another editor instance put on the system clipboard,
+	// returns true if the buffer changed
+	bool fetchClipboard();
+
 	// Clears the copybuffer (eg. resets it)
 	void clear();
 
 	size_t GetTileCount();
+	// The serialized leaves, and the tiles once they have been decoded
+	size_t memsize() const;
 
+	// Decodes the tiles on first use
 	BaseMap& getBufferMap();
 
 private:
+	struct DecodedTile {
+		Position position;
+		Tile* tile;
+		std::string missing_creature;
+	};
+
+	// Serializes the selected parts of the selected tiles, returns the number of items
+	size_t serialize(Editor& editor, int floor);
+	// Decodes the leaf blocks on the thread pool, the tiles have no location yet.
+	// Creature types missing from the database are added afterwards, on the calling thread.
+	std::vector<DecodedTile> decode() const;
+	// Returns false if the data is invalid, from another client version or already held
+	bool adopt(const uint8_t* data, size_t size);
+	void publish();
+
+	struct Block {
+		size_t offset;
+		size_t size;
+	};
+
 	Position copyPos;
+	MapVersion version;
+	// Process id and copy count of the instance that made the copy
+	uint32_t owner;
+	uint32_t sequence;
+	size_t tile_count;
+	// Header followed by the leaf blocks, exactly as it is put on the clipboard
+	std::vector<uint8_t> data;
+	std::vector<Block> blocks;
 	BaseMap* tiles;
 };
 
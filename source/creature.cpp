@@ -20,28 +20,24 @@
 #include "creature.h"
 
 Creature::Creature(CreatureType* type) :
+	type(type),
 	direction(NORTH),
 	spawntime(0),
 	saved(false),
 	selected(false)
 {
-	if(type)
-		type_name = type->name;
+	////
 }
 
-Creature::Creature(const std::string& type_name) :
-	type_name(type_name),
-	direction(NORTH),
-	spawntime(0),
-	saved(false),
-	selected(false)
+Creature::Creature(std::string_view type_name) :
+	Creature(g_creatures[type_name])
 {
 	////
 }
 
 Creature* Creature::deepCopy() const
 {
-	Creature* copy = new Creature(type_name);
+	Creature* copy = new Creature(type);
 	copy->spawntime = spawntime;
 	copy->direction = direction;
 	copy->selected = selected;
@@ -51,7 +47,6 @@ Creature* Creature::deepCopy() const
 
 const Outfit& Creature::getLookType() const
 {
-	const CreatureType* type = g_creatures[type_name];
 	if(type)
 		return type->outfit;
 	static const Outfit otfi; // Empty outfit
@@ -60,7 +55,6 @@ const Outfit& Creature::getLookType() const
 
 bool Creature::isNpc() const
 {
-	const CreatureType* type = g_creatures[type_name];
 	if(type) {
 		return type->isNpc;
 	}
@@ -69,7 +63,6 @@ bool Creature::isNpc() const
 
 std::string Creature::getName() const
 {
-	const CreatureType* type = g_creatures[type_name];
 	if(type) {
 		return type->name;
 	}
@@ -78,7 +71,6 @@ std::string Creature::getName() const
 
 CreatureBrush* Creature::getBrush() const
 {
-	const CreatureType* type = g_creatures[type_name];
 	if(type) {
 		return type->brush;
 	}
@@ -36,7 +36,8 @@ IMPLEMENT_INCREMENT_OP(Direction)
 class Creature {
   public:
 	Creature(CreatureType *type);
-	Creature(const std::string &type_name);
+	// Looks the type up by name, the creature has no type if there is none
+	Creature(std::string_view type_name);
 
 	Creature *deepCopy() const;
 
@@ -52,6 +53,8 @@ class Creature {
 
 	bool isNpc() const;
 
+	CreatureType *getType() const noexcept { return type; }
+	void setType(CreatureType *_type) noexcept { type = _type; }
 	std::string getName() const;
 	CreatureBrush *getBrush() const;
 
@@ -66,7 +69,8 @@ class Creature {
 	static uint16_t DirName2ID(std::string id);
 
   protected:
-	std::string type_name;
+	// Owned by the creature database, which outlives the maps of its version
+	CreatureType *type;
 	Direction direction;
 	int spawntime;
 	bool saved;
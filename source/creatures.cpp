@@ -22,6 +22,7 @@
 #include "brush.h"
 #include "creatures.h"
 #include "creature_brush.h"
+#include "tracing.h"
 
 CreatureDatabase g_creatures;
 
@@ -194,6 +195,29 @@ CreatureType* CreatureType::loadFromOTXML(const FileName& filename, pugi::xml_do
 	return ct;
 }
 
+size_t CreatureNameHash::operator()(std::string_view name) const noexcept
+{
+	// FNV-1a over the lowered characters
+	size_t hash = 14695981039346656037ull;
+	for(char c : name) {
+		hash = (hash ^ static_cast<unsigned char>(tolower(static_cast<unsigned char>(c)))) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool CreatureNameEqual::operator()(std::string_view lhs, std::string_view rhs) const noexcept
+{
+	if(lhs.size() != rhs.size()) {
+		return false;
+	}
+	for(size_t i = 0; i < lhs.size(); ++i) {
+		if(tolower(static_cast<unsigned char>(lhs[i])) != tolower(static_cast<unsigned char>(rhs[i]))) {
+			return false;
+		}
+	}
+	return true;
+}
+
 CreatureDatabase::CreatureDatabase()
 {
 	////
@@ -209,13 +233,37 @@ void CreatureDatabase::clear()
 	for(CreatureMap::iterator iter = creature_map.begin(); iter != creature_map.end(); ++iter) {
 		delete iter->second;
 	}
+	creature_index.clear();
 	creature_map.clear();
 }
 
-CreatureType* CreatureDatabase::operator[](const std::string& name)
+void CreatureDatabase::swap(CreatureDatabase& other)
+{
+	// The index views the keys of the map nodes, which move along with them
+	creature_map.swap(other.creature_map);
+	creature_index.swap(other.creature_index);
+}
+
+void CreatureDatabase::clearBrushes()
+{
+	for(auto& entry : creature_map) {
+		entry.second->brush = nullptr;
+		entry.second->in_other_tileset = false;
+	}
+}
+
+void CreatureDatabase::insert(CreatureType* type)
+{
+	auto result = creature_map.emplace(as_lower_str(type->name), type);
+	if(result.second) {
+		creature_index.emplace(result.first->first, type);
+	}
+}
+
+CreatureType* CreatureDatabase::operator[](std::string_view name) const
 {
-	CreatureMap::iterator iter = creature_map.find(as_lower_str(name));
-	if(iter != creature_map.end()) {
+	auto iter = creature_index.find(name);
+	if(iter != creature_index.end()) {
 		return iter->second;
 	}
 	return nullptr;
@@ -231,7 +279,7 @@ CreatureType* CreatureDatabase::addMissingCreatureType(const std::string& name,
 	ct->missing = true;
 	ct->outfit.lookType = 130;
 
-	creature_map.insert(std::make_pair(as_lower_str(name), ct));
+	insert(ct);
 	return ct;
 }
 
@@ -245,7 +293,7 @@ CreatureType* CreatureDatabase::addCreatureType(const std::string& name, bool is
 	ct->missing = false;
 	ct->outfit = outfit;
 
-	creature_map.insert(std::make_pair(as_lower_str(name), ct));
+	insert(ct);
 	return ct;
 }
 
@@ -261,6 +309,7 @@ bool CreatureDatabase::hasMissing() const
 
 bool CreatureDatabase::loadFromXML(const FileName& filename, bool standard, wxString& error, wxArrayString& warnings)
 {
+	RME_TRACE_ZONE("load", "CreatureDatabase::loadFromXML");
 	pugi::xml_document doc;
 	pugi::xml_parse_result result = doc.load_file(filename.GetFullPath().mb_str());
 	if(!result) {
@@ -286,7 +335,7 @@ bool CreatureDatabase::loadFromXML(const FileName& filename, bool standard, wxSt
 				warnings.push_back("Duplicate creature type name \"" + wxstr(creatureType->name) + "\"! Discarding...");
 				delete creatureType;
 			} else {
-				creature_map[as_lower_str(creatureType->name)] = creatureType;
+				insert(creatureType);
 			}
 		}
 	}
@@ -330,7 +379,7 @@ bool CreatureDatabase::importXMLFromOT(const FileName& filename, wxString& error
 					*current = *creatureType;
 					delete creatureType;
 				} else {
-					creature_map[as_lower_str(creatureType->name)] = creatureType;
+					insert(creatureType);
 
 					Tileset* tileSet = nullptr;
 					if(creatureType->isNpc) {
@@ -357,7 +406,7 @@ bool CreatureDatabase::importXMLFromOT(const FileName& filename, wxString& error
 				*current = *creatureType;
 				delete creatureType;
 			} else {
-				creature_map[as_lower_str(creatureType->name)] = creatureType;
+				insert(creatureType);
 
 				Tileset* tileSet = nullptr;
 				if(creatureType->isNpc) {
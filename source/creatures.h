@@ -23,6 +23,8 @@
 
 #include <map>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <wx/arrstr.h>
 #include <wx/filename.h>
 #include <wx/string.h>
@@ -34,9 +36,25 @@ class CreatureBrush;
 
 typedef std::map<std::string, CreatureType *> CreatureMap;
 
+// Hash and equality of creature names ignoring case, names are looked up as
+// they come without lowering a copy of them first
+struct CreatureNameHash {
+	size_t operator()(std::string_view name) const noexcept;
+};
+struct CreatureNameEqual {
+	bool operator()(std::string_view lhs, std::string_view rhs) const noexcept;
+};
+
 class CreatureDatabase {
   protected:
+	// Ordered by lowered name, the order the types are listed and saved in
 	CreatureMap creature_map;
+	// Views of the keys of creature_map, for the lookups by name
+	std::unordered_map<std::string_view, CreatureType *, CreatureNameHash,
+					   CreatureNameEqual>
+		creature_index;
+
+	void insert(CreatureType *type);
 
   public:
 	typedef CreatureMap::iterator iterator;
@@ -46,8 +64,12 @@ class CreatureDatabase {
 	~CreatureDatabase();
 
 	void clear();
+	// Exchanges all creature types with other, they keep their addresses
+	void swap(CreatureDatabase &other);
+	// Forgets the brushes of the types, before the brushes are loaded again
+	void clearBrushes();
 
-	CreatureType *operator[](const std::string &name);
+	CreatureType *operator[](std::string_view name) const;
 	CreatureType *addMissingCreatureType(const std::string &name, bool isNpc);
 	CreatureType *addCreatureType(const std::string &name, bool isNpc,
 								  const Outfit &outfit);
@@ -103,16 +103,6 @@ void DCButton::OnPaint(wxPaintEvent& event)
 		return;
 	}
 
-	static std::unique_ptr<wxPen> highlight_pen;
-	static std::unique_ptr<wxPen> dark_highlight_pen;
-	static std::unique_ptr<wxPen> light_shadow_pen;
-	static std::unique_ptr<wxPen> shadow_pen;
-
-	if(highlight_pen.get() == nullptr)      highlight_pen.reset(newd wxPen(wxColor(0xFF,0xFF,0xFF), 1, wxSOLID));
-	if(dark_highlight_pen.get() == nullptr) dark_highlight_pen.reset(newd wxPen(wxColor(0xD4,0xD0,0xC8), 1, wxSOLID));
-	if(light_shadow_pen.get() == nullptr)   light_shadow_pen.reset(newd wxPen(wxColor(0x80,0x80,0x80), 1, wxSOLID));
-	if(shadow_pen.get() == nullptr)         shadow_pen.reset(newd wxPen(wxColor(0x40,0x40,0x40), 1, wxSOLID));
-
 	int size_x = 20, size_y = 20;
 
 	if(size == RENDER_SIZE_16x16) {
@@ -123,35 +113,7 @@ void DCButton::OnPaint(wxPaintEvent& event)
 		size_y = 36;
 	}
 
-	pdc.SetBrush(*wxBLACK);
-	pdc.DrawRectangle(0,0,size_x,size_y);
-	if(type == DC_BTN_TOGGLE && GetValue()) {
-		pdc.SetPen(*shadow_pen);
-		pdc.DrawLine(0 ,0 ,size_x-1,0 );
-		pdc.DrawLine(0 ,1 ,0 ,size_y-1);
-		pdc.SetPen(*light_shadow_pen);
-		pdc.DrawLine(1 ,1 ,size_x-2,1 );
-		pdc.DrawLine(1 ,2 ,1 ,size_y-2);
-		pdc.SetPen(*dark_highlight_pen);
-		pdc.DrawLine(size_x-2,1 ,size_x-2,size_y-2);
-		pdc.DrawLine(1 ,size_y-2,size_x-1,size_y-2);
-		pdc.SetPen(*highlight_pen);
-		pdc.DrawLine(size_x-1,0 ,size_x-1,size_y-1);
-		pdc.DrawLine(0 ,size_y-1,size_y,size_y-1);
-	} else {
-		pdc.SetPen(*highlight_pen);
-		pdc.DrawLine(0 ,0 ,size_x-1,0 );
-		pdc.DrawLine(0 ,1 ,0 ,size_y-1);
-		pdc.SetPen(*dark_highlight_pen);
-		pdc.DrawLine(1 ,1 ,size_x-2,1 );
-		pdc.DrawLine(1 ,2 ,1 ,size_y-2);
-		pdc.SetPen(*light_shadow_pen);
-		pdc.DrawLine(size_x-2,1 ,size_x-2,size_y-2);
-		pdc.DrawLine(1 ,size_y-2,size_x-1,size_y-2);
-		pdc.SetPen(*shadow_pen);
-		pdc.DrawLine(size_x-1,0 ,size_x-1,size_y-1);
-		pdc.DrawLine(0 ,size_y-1,size_y,size_y-1);
-	}
+	DrawFrame(pdc, wxRect(0, 0, size_x, size_y), type == DC_BTN_TOGGLE && GetValue());
 
 	if(sprite) {
 		if(size == RENDER_SIZE_16x16) {
@@ -174,6 +136,52 @@ void DCButton::OnPaint(wxPaintEvent& event)
 	}
 }
 
+void DCButton::DrawFrame(wxDC& pdc, const wxRect& rect, bool pressed)
+{
+	static std::unique_ptr<wxPen> highlight_pen;
+	static std::unique_ptr<wxPen> dark_highlight_pen;
+	static std::unique_ptr<wxPen> light_shadow_pen;
+	static std::unique_ptr<wxPen> shadow_pen;
+
+	if(highlight_pen.get() == nullptr)      highlight_pen.reset(newd wxPen(wxColor(0xFF,0xFF,0xFF), 1, wxSOLID));
+	if(dark_highlight_pen.get() == nullptr) dark_highlight_pen.reset(newd wxPen(wxColor(0xD4,0xD0,0xC8), 1, wxSOLID));
+	if(light_shadow_pen.get() == nullptr)   light_shadow_pen.reset(newd wxPen(wxColor(0x80,0x80,0x80), 1, wxSOLID));
+	if(shadow_pen.get() == nullptr)         shadow_pen.reset(newd wxPen(wxColor(0x40,0x40,0x40), 1, wxSOLID));
+
+	const int x = rect.x, y = rect.y;
+	const int right = rect.x + rect.width, bottom = rect.y + rect.height;
+
+	pdc.SetBrush(*wxBLACK);
+	pdc.DrawRectangle(rect);
+	if(pressed) {
+		pdc.SetPen(*shadow_pen);
+		pdc.DrawLine(x, y, right-1, y);
+		pdc.DrawLine(x, y+1, x, bottom-1);
+		pdc.SetPen(*light_shadow_pen);
+		pdc.DrawLine(x+1, y+1, right-2, y+1);
+		pdc.DrawLine(x+1, y+2, x+1, bottom-2);
+		pdc.SetPen(*dark_highlight_pen);
+		pdc.DrawLine(right-2, y+1, right-2, bottom-2);
+		pdc.DrawLine(x+1, bottom-2, right-1, bottom-2);
+		pdc.SetPen(*highlight_pen);
+		pdc.DrawLine(right-1, y, right-1, bottom-1);
+		pdc.DrawLine(x, bottom-1, right, bottom-1);
+	} else {
+		pdc.SetPen(*highlight_pen);
+		pdc.DrawLine(x, y, right-1, y);
+		pdc.DrawLine(x, y+1, x, bottom-1);
+		pdc.SetPen(*dark_highlight_pen);
+		pdc.DrawLine(x+1, y+1, right-2, y+1);
+		pdc.DrawLine(x+1, y+2, x+1, bottom-2);
+		pdc.SetPen(*light_shadow_pen);
+		pdc.DrawLine(right-2, y+1, right-2, bottom-2);
+		pdc.DrawLine(x+1, bottom-2, right-1, bottom-2);
+		pdc.SetPen(*shadow_pen);
+		pdc.DrawLine(right-1, y, right-1, bottom-1);
+		pdc.DrawLine(x, bottom-1, right, bottom-1);
+	}
+}
+
 void DCButton::OnClick(wxMouseEvent& WXUNUSED(evt))
 {
 	wxCommandEvent event(type == DC_BTN_TOGGLE? wxEVT_COMMAND_TOGGLEBUTTON_CLICKED : wxEVT_COMMAND_BUTTON_CLICKED, GetId());
@@ -47,6 +47,9 @@ public:
 
 	void OnPaint(wxPaintEvent&);
 	void OnClick(wxMouseEvent&);
+
+	// The black box with a raised or pressed border the buttons are drawn in
+	static void DrawFrame(wxDC& dc, const wxRect& rect, bool pressed);
 protected:
 	void SetOverlay(Sprite* espr);
 
@@ -0,0 +1,221 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "decoder_fuzzer.h"
+#include "action.h"
+#include "editor.h"
+#include "filehandle.h"
+#include "iomap_otbm.h"
+#include "live_socket.h"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+namespace {
+	// Live nodes encoded to be damaged, enough to cover the kinds of tiles of most maps
+	constexpr size_t SampleSize = 1024;
+
+	// Decodes the nodes of the live protocol without a connection
+	class FuzzSocket : public LiveSocket
+	{
+	public:
+		void receiveHeader() override { }
+		void receive(uint32_t) override { }
+		void send(NetworkMessage&) override { }
+		void updateCursor(const Position&) override { }
+
+		void encode(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy) {
+			writeNode(message, node, ndx, ndy, 0xFFFF);
+		}
+
+		void decode(NetworkMessage& message, Editor& editor, Action* action) {
+			message.read<uint8_t>();
+			const uint32_t position = message.read<uint32_t>();
+			receiveNode(message, editor, action, position >> 18, (position >> 4) & 0x3FFF, (position & 1) != 0);
+		}
+	};
+
+	// The packet type and the position of the node, a node that isn't on the map is
+	// logged instead of decoded
+	constexpr size_t LiveHeaderSize = 5;
+	// The identifier of the file, anything else is rejected before the nodes are read
+	constexpr size_t OTBMHeaderSize = 4;
+
+	bool readFile(const std::string& path, std::vector<uint8_t>& data)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if(!file.is_open()) {
+			return false;
+		}
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	bool writeFile(const std::string& path, const std::vector<uint8_t>& data)
+	{
+		std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+		if(!file.is_open()) {
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return file.good();
+	}
+}
+
+DecoderFuzzer::DecoderFuzzer(Editor& editor, const std::string& directory, uint32_t seed) :
+	editor(editor),
+	directory(directory),
+	random(seed)
+{
+	////
+}
+
+bool DecoderFuzzer::run(int iterations, const Report& report)
+{
+	if(!wxFileName::Mkdir(wxstr(directory), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+		return false;
+	}
+
+	report(liveNodes(iterations));
+
+	Result result;
+	const bool ok = otbm(iterations, result);
+	if(ok) {
+		report(result);
+	}
+
+	wxFileName::Rmdir(wxstr(directory), wxPATH_RMDIR_RECURSIVE);
+	return ok;
+}
+
+void DecoderFuzzer::mutate(std::vector<uint8_t>& data, size_t header)
+{
+	// Node markers and the ends of the ranges of values are the bytes decoders trip on
+	static const uint8_t values[] = { 0x00, 0x01, 0x7F, 0x80, ESCAPE_CHAR, NODE_START, NODE_END };
+
+	std::uniform_int_distribution<int> operations(1, 4);
+	for(int count = operations(random); count > 0 && data.size() > header; --count) {
+		std::uniform_int_distribution<size_t> offsets(header, data.size() - 1);
+		const size_t offset = offsets(random);
+		switch(random() % 4) {
+			case 0:
+				data[offset] ^= static_cast<uint8_t>(1 << (random() % 8));
+				break;
+			case 1:
+				data[offset] = values[random() % sizeof(values)];
+				break;
+			case 2: {
+				const size_t length = std::min<size_t>(random() % 16 + 1, data.size() - offset);
+				data.erase(data.begin() + offset, data.begin() + offset + length);
+				break;
+			}
+			default:
+				data.resize(offset);
+				break;
+		}
+	}
+}
+
+DecoderFuzzer::Result DecoderFuzzer::liveNodes(int iterations)
+{
+	using Clock = std::chrono::steady_clock;
+
+	Map& map = editor.getMap();
+	std::vector<std::pair<QTreeNode*, Position>> leaves;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int x, int y) {
+		if(leaves.size() < SampleSize) {
+			leaves.emplace_back(leaf, Position(x, y, 0));
+		}
+	});
+
+	FuzzSocket socket;
+	std::vector<std::vector<uint8_t>> nodes;
+	for(const auto& leaf : leaves) {
+		NetworkMessage message;
+		socket.encode(message, leaf.first, leaf.second.x >> 2, leaf.second.y >> 2);
+		nodes.emplace_back(message.buffer.begin() + 4, message.buffer.begin() + message.position);
+	}
+
+	Result result { "live_node", 0.0, 0, 0, 0 };
+	if(nodes.empty()) {
+		return result;
+	}
+
+	// Decoding makes the changes a peer would get, they are never committed
+	const Clock::time_point start = Clock::now();
+	std::vector<uint8_t> data;
+	for(int iteration = 0; iteration < iterations; ++iteration) {
+		data = nodes[random() % nodes.size()];
+		mutate(data, LiveHeaderSize);
+
+		NetworkMessage message;
+		message.buffer.resize(4);
+		message.buffer.insert(message.buffer.end(), data.begin(), data.end());
+		message.size = data.size();
+
+		Action* action = editor.createAction(ACTION_REMOTE);
+		socket.decode(message, editor, action);
+		delete action;
+
+		++result.inputs;
+		result.bytes += data.size();
+	}
+	result.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return result;
+}
+
+bool DecoderFuzzer::otbm(int iterations, Result& result)
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Only the map file, the houses and spawns aren't decoded by the same code
+	Map& map = editor.getMap();
+	const wxFileName original(wxstr(directory), "original.otbm");
+	IOMapOTBM writer(map.getVersion());
+	std::vector<uint8_t> encoded;
+	if(!writer.exportMap(map, original) || !readFile(nstr(original.GetFullPath()), encoded)) {
+		return false;
+	}
+
+	const wxFileName input(wxstr(directory), "input.otbm");
+	const std::string path = nstr(input.GetFullPath());
+
+	result = Result { "otbm", 0.0, 0, 0, 0 };
+	const Clock::time_point start = Clock::now();
+	std::vector<uint8_t> data;
+	for(int iteration = 0; iteration < iterations; ++iteration) {
+		data = encoded;
+		mutate(data, OTBMHeaderSize);
+		if(!writeFile(path, data)) {
+			return false;
+		}
+
+		Map loaded;
+		IOMapOTBM io(map.getVersion());
+		if(!io.loadMap(loaded, input)) {
+			++result.rejected;
+		}
+
+		++result.inputs;
+		result.bytes += data.size();
+	}
+	result.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return true;
+}
@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_DECODER_FUZZER_H_
+#define RME_DECODER_FUZZER_H_
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+class Editor;
+
+// Feeds damaged copies of what the map of an editor encodes to back to the decoders:
+// the nodes of the live protocol and the OTBM file. Every input is a valid encoding
+// with a few bits flipped, bytes overwritten by node markers, ranges dropped or the
+// tail cut off. Nothing is checked besides the decoders coming back, so it is meant
+// for a build with sanitizers, where reading out of bounds stops the process.
+// The same seed always gives the same inputs.
+class DecoderFuzzer
+{
+public:
+	struct Result {
+		std::string name;
+		double ms;
+		uint64_t inputs;
+		uint64_t bytes;
+		// Files that didn't load, a live node has no way to be refused
+		uint64_t rejected;
+	};
+	using Report = std::function<void(const Result& result)>;
+
+	DecoderFuzzer(Editor& editor, const std::string& directory, uint32_t seed);
+
+	// Decodes iterations inputs of each kind, false if the files couldn't be written
+	bool run(int iterations, const Report& report);
+
+private:
+	void mutate(std::vector<uint8_t>& data, size_t header);
+
+	Result liveNodes(int iterations);
+	bool otbm(int iterations, Result& result);
+
+	Editor& editor;
+	// Scratch space for the files written, removed afterwards
+	std::string directory;
+	std::mt19937 random;
+};
+
+#endif
@@ -26,7 +26,7 @@
 #define __RME_VERSION_MINOR__      8
 #define __RME_SUBVERSION__         0
 
-#define __LIVE_NET_VERSION__       5
+#define __LIVE_NET_VERSION__       6
 
 #define MAKE_VERSION_ID(major, minor, subversion) \
 	((major)      * 10000000 + \
@@ -51,6 +51,12 @@
 // OS
 
 #define OTGZ_SUPPORT 0
+// Allocate tiles, floors and tree nodes from slabs instead of one by one
+#define RME_POOLED_MAP_ALLOCATOR 1
+// Build in the trace zones of tracing.h, recorded from View > Record Trace or --trace= in batch mode
+#ifndef RME_TRACING
+#define RME_TRACING 0
+#endif
 #define ASSETS_NAME "Tibia"
 
 #ifdef __VISUALC__
@@ -100,16 +106,17 @@
 #endif
 
 #ifndef _DONT_USE_PROCESS_COM
-#   if defined __WINDOWS__ && !defined _USE_PROCESS_COM
+#   ifndef _USE_PROCESS_COM
 #       define _USE_PROCESS_COM
 #   endif
 #endif
 
-#define MAP_LOAD_FILE_WILDCARD_OTGZ "OpenTibia Binary Map (*.otbm;*.otgz)|*.otbm;*.otgz"
-#define MAP_SAVE_FILE_WILDCARD_OTGZ "OpenTibia Binary Map (*.otbm)|*.otbm|Compressed OpenTibia Binary Map (*.otgz)|*.otgz"
+#define MAP_LOAD_FILE_WILDCARD_OTGZ "OpenTibia Binary Map (*.otbm;*.otbz;*.otgz)|*.otbm;*.otbz;*.otgz"
+#define MAP_SAVE_FILE_WILDCARD_OTGZ "OpenTibia Binary Map (*.otbm)|*.otbm|Compressed OpenTibia Binary Map (*.otbz)|*.otbz|Compressed OpenTibia Binary Map (*.otgz)|*.otgz"
 
-#define MAP_LOAD_FILE_WILDCARD "OpenTibia Binary Map (*.otbm)|*.otbm"
-#define MAP_SAVE_FILE_WILDCARD "OpenTibia Binary Map (*.otbm)|*.otbm"
+#define MAP_LOAD_FILE_WILDCARD "OpenTibia Binary Map (*.otbm;*.otbz)|*.otbm;*.otbz"
+#define MAP_SAVE_FILE_WILDCARD "OpenTibia Binary Map (*.otbm)|*.otbm|Compressed OpenTibia Binary Map (*.otbz)|*.otbz"
+#define MAP_EXPORT_FILE_WILDCARD "OpenTibia Binary Map (*.otbm)|*.otbm"
 
 // wxString conversions
 #define nstr(str) std::string((const char*)(str.mb_str(wxConvUTF8)))
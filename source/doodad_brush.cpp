@@ -17,8 +17,11 @@
 
 #include "main.h"
 
+#include <unordered_set>
+
 #include "doodad_brush.h"
 #include "basemap.h"
+#include "thread_pool.h"
 
 //=============================================================================
 // Doodad brush
@@ -159,9 +162,21 @@ bool DoodadBrush::loadAlternative(pugi::xml_node node, wxArrayString& warnings,
 				}
 
 				if(!items.empty()) {
-					cb.items.push_back(std::make_pair(Position(x, y, z), items));
+					const Position offset(x, y, z);
+					if(cb.items.empty()) {
+						cb.low = offset;
+						cb.high = offset;
+					}
+					cb.low = Position(std::min(cb.low.x, x), std::min(cb.low.y, y), std::min(cb.low.z, z));
+					cb.high = Position(std::max(cb.high.x, x), std::max(cb.high.y, y), std::max(cb.high.z, z));
+					cb.items.push_back(std::make_pair(offset, items));
 				}
 			}
+
+			Position& low = alternativeBlock->reach_low;
+			Position& high = alternativeBlock->reach_high;
+			low = Position(std::min(low.x, cb.low.x), std::min(low.y, cb.low.y), std::min(low.z, cb.low.z));
+			high = Position(std::max(high.x, cb.high.x), std::max(high.y, cb.high.y), std::max(high.z, cb.high.z));
 			alternativeBlock->composite_items.push_back(cb);
 		}
 	}
@@ -349,6 +364,17 @@ void DoodadBrush::draw(BaseMap* map, Tile* tile, void* parameter)
 	}
 }
 
+const DoodadBrush::CompositeBlock* DoodadBrush::pickComposite(const AlternativeBlock& block) const
+{
+	int roll = random(1, block.composite_chance);
+	for(const CompositeBlock& cb : block.composite_items) {
+		if(roll <= cb.chance) {
+			return &cb;
+		}
+	}
+	return nullptr;
+}
+
 const CompositeTileList& DoodadBrush::getComposite(int variation) const
 {
 	static CompositeTileList empty;
@@ -360,14 +386,169 @@ const CompositeTileList& DoodadBrush::getComposite(int variation) const
 	const AlternativeBlock* ab_ptr = alternatives[variation];
 	ASSERT(ab_ptr);
 
-	int roll = random(1, ab_ptr->composite_chance);
-	for(std::vector<CompositeBlock>::const_iterator block_iter = ab_ptr->composite_items.begin(); block_iter != ab_ptr->composite_items.end(); ++block_iter) {
-		const CompositeBlock& cb = *block_iter;
-		if(roll <= cb.chance) {
-			return cb.items;
+	const CompositeBlock* cb = pickComposite(*ab_ptr);
+	return cb ? cb->items : empty;
+}
+
+namespace {
+	// Tiles taken by the objects of a spray so far, a bitmap over every tile
+	// they can reach. Composites reaching unusually far are tracked in a set.
+	class SprayOccupancy
+	{
+	public:
+		SprayOccupancy(const Position& low, const Position& high) :
+			low(low),
+			width(high.x - low.x + 1),
+			height(high.y - low.y + 1)
+		{
+			const size_t cells = size_t(width) * height * (high.z - low.z + 1);
+			if(cells <= MaxCells) {
+				bits.assign(cells, false);
+			}
+		}
+
+		bool test(const Position& position) const {
+			if(bits.empty()) {
+				return sparse.count(packPosition(position)) != 0;
+			}
+			return bits[index(position)];
+		}
+
+		void set(const Position& position) {
+			if(bits.empty()) {
+				sparse.insert(packPosition(position));
+			} else {
+				bits[index(position)] = true;
+			}
+		}
+
+	private:
+		static const size_t MaxCells = 1 << 24;
+
+		size_t index(const Position& position) const {
+			return (size_t(position.z - low.z) * height + (position.y - low.y)) * width + (position.x - low.x);
 		}
+
+		Position low;
+		int width;
+		int height;
+		std::vector<bool> bits;
+		std::unordered_set<PositionKey> sparse;
+	};
+
+	// Tiles whose items are copied by one task of the pool
+	const size_t SprayTilesPerTask = 64;
+}
+
+void DoodadBrush::spray(BaseMap* map, const Position& center, int variation, int radius, bool circle, int count)
+{
+	if(alternatives.empty())
+		return;
+
+	variation %= alternatives.size();
+	const AlternativeBlock& block = *alternatives[variation];
+	const int total_chance = block.composite_chance + block.single_chance;
+
+	const Position low(center.x - radius + block.reach_low.x, center.y - radius + block.reach_low.y, center.z + block.reach_low.z);
+	const Position high(center.x + radius + block.reach_high.x, center.y + radius + block.reach_high.y, center.z + block.reach_high.z);
+	SprayOccupancy occupied(low, high);
+
+	// Nothing is put on the map while the spots are picked, a single object is
+	// one without a composite
+	struct Placement {
+		Position position;
+		const CompositeBlock* composite;
+	};
+	std::vector<Placement> placements;
+
+	for(int object = 0; object < count; ++object) {
+		// Only a spot outside of the circle is tried again, an object that
+		// doesn't fit is left out
+		for(int retries = 0; retries < 5; ++retries) {
+			int xpos = 0, ypos = 0;
+			bool found_pos = !circle;
+			if(circle) {
+				for(int pos_retries = 0; pos_retries < 5 && !found_pos; ++pos_retries) {
+					xpos = random(-radius, radius);
+					ypos = random(-radius, radius);
+					found_pos = sqrt(float(xpos*xpos) + float(ypos*ypos)) < radius + 0.005;
+				}
+			} else {
+				xpos = random(-radius, radius);
+				ypos = random(-radius, radius);
+			}
+
+			if(!found_pos)
+				continue;
+
+			const Position position = center + Position(xpos, ypos, 0);
+			if(random(total_chance) <= block.composite_chance) {
+				const CompositeBlock* composite = pickComposite(block);
+				if(!composite)
+					break;
+
+				bool fits = true;
+				for(const auto& tile : composite->items) {
+					if(occupied.test(position + tile.first)) {
+						fits = false;
+						break;
+					}
+				}
+				if(!fits)
+					break;
+
+				for(const auto& tile : composite->items) {
+					occupied.set(position + tile.first);
+				}
+				placements.push_back({ position, composite });
+			} else if(block.single_chance > 0) {
+				if(occupied.test(position))
+					break;
+				occupied.set(position);
+				placements.push_back({ position, nullptr });
+			}
+			break;
+		}
+	}
+
+	// The tiles are made here, the composites never overlap so every tile is
+	// filled by a single task
+	std::vector<std::pair<Tile*, const ItemVector*>> fills;
+	std::vector<Tile*> tiles;
+	for(const Placement& placement : placements) {
+		if(!placement.composite) {
+			Tile* tile = map->getTile(placement.position);
+			if(!tile)
+				tile = map->allocator(map->createTileL(placement.position));
+			draw(map, tile, &variation);
+			tiles.push_back(tile);
+			continue;
+		}
+
+		for(const auto& composite : placement.composite->items) {
+			const Position position = placement.position + composite.first;
+			Tile* tile = map->getTile(position);
+			if(!tile)
+				tile = map->allocator(map->createTileL(position));
+			fills.emplace_back(tile, &composite.second);
+			tiles.push_back(tile);
+		}
+	}
+
+	const size_t tasks = (fills.size() + SprayTilesPerTask - 1) / SprayTilesPerTask;
+	ThreadPool::getInstance().parallelFor(tasks, [&fills](size_t task) {
+		const size_t last = std::min(fills.size(), (task + 1) * SprayTilesPerTask);
+		for(size_t index = task * SprayTilesPerTask; index < last; ++index) {
+			Tile* tile = fills[index].first;
+			for(const Item* item : *fills[index].second) {
+				tile->addItem(item->deepCopy());
+			}
+		}
+	});
+
+	for(Tile* tile : tiles) {
+		map->setTile(tile->getPosition(), tile);
 	}
-	return empty;
 }
 
 bool DoodadBrush::isEmpty(int variation) const
@@ -45,6 +45,11 @@ public:
 	virtual void draw(BaseMap* map, Tile* tile, void* parameter);
 	const CompositeTileList& getComposite(int variation) const;
 	virtual void undraw(BaseMap* map, Tile* tile);
+	// Scatters count objects within radius of center onto a buffer map, each
+	// retried at another spot if it doesn't fit. Where they go is worked out on
+	// an occupancy bitmap first, the items of all tiles are then copied at once
+	// on the thread pool.
+	void spray(BaseMap* map, const Position& center, int variation, int radius, bool circle, int count);
 
 	bool isEmpty(int variation) const;
 
@@ -94,6 +99,9 @@ protected:
 	struct CompositeBlock {
 		int chance;
 		CompositeTileList items;
+		// Bounds of the tile offsets, the footprint checked when spraying
+		Position low;
+		Position high;
 	};
 
 	struct AlternativeBlock {
@@ -105,8 +113,13 @@ protected:
 
 		int composite_chance; // Total chance of a composite
 		int single_chance; // Total chance of a single object
+		// Bounds of the offsets of all composites and of the origin
+		Position reach_low;
+		Position reach_high;
 	};
 
+	const CompositeBlock* pickComposite(const AlternativeBlock& block) const;
+
 	std::vector<AlternativeBlock*> alternatives;
 };
 
@@ -83,44 +83,40 @@ void DuplicatedItemsWindow::StartSearch(MapTab* tab, bool selection)
 	g_gui.CreateLoadBar(message);
 
 	Map* map = map_tab->GetMap();
-	auto ibegin = map->begin();
-	auto iend = map->end();
-	long progress = 0;
+	uint64_t progress = 0;
 	std::vector<DuplicatedItem*> result;
 
-	while(ibegin != iend) {
-		++progress;
-		Tile* tile = (*ibegin)->get();
-		if(selection && !tile->isSelected()) {
-			++ibegin;
-			continue;
-		}
-
-		if(progress % 0x8000 == 0) {
-			g_gui.SetLoadDone((int)(100 * progress / map->getTileCount()));
+	map->visitTileChunks([&](std::span<Tile* const> tiles) {
+		if((progress + tiles.size()) / 0x8000 != progress / 0x8000) {
+			g_gui.SetLoadDone((int)(100 * (progress + tiles.size()) / map->getTileCount()));
 		}
+		progress += tiles.size();
 
-		auto& position = tile->getPosition();
-		uint16_t prevId = 0;
-		uint16_t count = 0;
+		for(Tile* tile : tiles) {
+			if(selection && !tile->isSelected()) {
+				continue;
+			}
 
-		for(Item* item : tile->items) {
-			uint16_t id = item->getID();
-			if(id == prevId) {
-				count++;
-			} else if(count > 0) {
+			const Position position = tile->getPosition();
+			uint16_t prevId = 0;
+			uint16_t count = 0;
+
+			for(Item* item : tile->items) {
+				uint16_t id = item->getID();
+				if(id == prevId) {
+					count++;
+				} else if(count > 0) {
+					result.push_back(new DuplicatedItem(position, prevId, count));
+					count = 0;
+				}
+				prevId = id;
+			}
+			// Check for the last item
+			if(count > 0) {
 				result.push_back(new DuplicatedItem(position, prevId, count));
-				count = 0;
 			}
-			prevId = id;
-		}
-		// Check for the last item
-		if(count > 0) {
-			result.push_back(new DuplicatedItem(position, prevId, count));
 		}
-
-		++ibegin;
-	}
+	});
 
 	g_gui.DestroyLoadBar();
 
@@ -20,6 +20,8 @@
 #include "editor.h"
 #include "materials.h"
 #include "map.h"
+#include "iomap_otbm.h"
+#include "iominimap.h"
 #include "complexitem.h"
 #include "settings.h"
 #include "gui.h"
@@ -35,6 +37,10 @@
 #include "creature_brush.h"
 #include "spawn_brush.h"
 
+#include "map_autosave.h"
+#include "session_recorder.h"
+#include "tracing.h"
+
 #include "live_server.h"
 #include "live_client.h"
 #include "live_action.h"
@@ -42,8 +48,10 @@
 Editor::Editor(CopyBuffer& copybuffer) :
 	live_server(nullptr),
 	live_client(nullptr),
+	autosave(nullptr),
 	actionQueue(newd ActionQueue(*this)),
 	selection(*this),
+	minimap_cache(map),
 	copybuffer(copybuffer),
 	replace_brush(nullptr)
 {
@@ -56,7 +64,7 @@ Editor::Editor(CopyBuffer& copybuffer) :
 		defaultVersion = ClientVersion::getLatestVersion()->getID();
 
 	if(g_gui.GetCurrentVersionID() != defaultVersion) {
-		if(g_gui.CloseAllEditors()) {
+		if(g_gui.KeepsVersionsResident() || g_gui.CloseAllEditors()) {
 			ok = g_gui.LoadVersion(defaultVersion, error, warnings);
 			g_gui.PopupDialog("Error", error, wxOK);
 			g_gui.ListDialog("Warnings", warnings);
@@ -86,13 +94,16 @@ Editor::Editor(CopyBuffer& copybuffer) :
 	map.unnamed = true;
 
 	map.doChange();
+	autosave = newd MapAutosave(*this);
 }
 
-Editor::Editor(CopyBuffer& copybuffer, const FileName& fn) :
+Editor::Editor(CopyBuffer& copybuffer, const FileName& fn, const MapArea& area) :
 	live_server(nullptr),
 	live_client(nullptr),
+	autosave(nullptr),
 	actionQueue(newd ActionQueue(*this)),
 	selection(*this),
+	minimap_cache(map),
 	copybuffer(copybuffer),
 	replace_brush(nullptr)
 {
@@ -116,7 +127,7 @@ Editor::Editor(CopyBuffer& copybuffer, const FileName& fn) :
 	if(g_gui.GetCurrentVersionID() != ver.client) {
 		wxString error;
 		wxArrayString warnings;
-		if(g_gui.CloseAllEditors()) {
+		if(g_gui.KeepsVersionsResident() || g_gui.CloseAllEditors()) {
 			success = g_gui.LoadVersion(ver.client, error, warnings);
 			if(!success)
 				g_gui.PopupDialog("Error", error, wxOK);
@@ -129,7 +140,7 @@ Editor::Editor(CopyBuffer& copybuffer, const FileName& fn) :
 
 	if(success) {
 		ScopedLoadingBar LoadingBar("Loading OTBM map...");
-		success = map.open(nstr(fn.GetFullPath()));
+		success = map.open(nstr(fn.GetFullPath()), area);
 		/* TODO
 		if(success && ver.client == CLIENT_VERSION_854_BAD) {
 			int ok = g_gui.PopupDialog("Incorrect OTB", "This map has been saved with an incorrect OTB version, do you want to convert it to the new OTB version?\n\nIf you are not sure, click Yes.", wxYES | wxNO);
@@ -141,13 +152,16 @@ Editor::Editor(CopyBuffer& copybuffer, const FileName& fn) :
 		}
 		*/
 	}
+	autosave = newd MapAutosave(*this);
 }
 
 Editor::Editor(CopyBuffer& copybuffer, LiveClient* client) :
 	live_server(nullptr),
 	live_client(client),
+	autosave(nullptr),
 	actionQueue(newd NetworkedActionQueue(*this)),
 	selection(*this),
+	minimap_cache(map),
 	copybuffer(copybuffer),
 	replace_brush(nullptr)
 {
@@ -160,8 +174,13 @@ Editor::~Editor()
 		CloseLiveServer();
 	}
 
+	if(g_session_recorder.isRecording(*this)) {
+		g_session_recorder.stop();
+	}
+
 	UnnamedRenderingLock();
 	selection.clear();
+	delete autosave;
 	delete actionQueue;
 }
 
@@ -205,6 +224,8 @@ void Editor::undo(int indexes)
 	if(indexes <= 0 || !actionQueue->canUndo())
 		return;
 
+	g_session_recorder.recordUndo(*this, indexes, false);
+
 	while(indexes > 0) {
 		if(!actionQueue->undo())
 			break;
@@ -219,6 +240,8 @@ void Editor::redo(int indexes)
 	if(indexes <= 0 || !actionQueue->canRedo())
 		return;
 
+	g_session_recorder.recordUndo(*this, indexes, true);
+
 	while(indexes > 0) {
 		if(!actionQueue->redo())
 			break;
@@ -230,7 +253,6 @@ void Editor::redo(int indexes)
 
 void Editor::updateActions()
 {
-	actionQueue->generateLabels();
 	g_gui.UpdateMenus();
 	g_gui.UpdateActions();
 }
@@ -267,6 +289,10 @@ void Editor::saveMap(FileName filename, bool showdialog)
 	std::string savefile = filename.GetFullPath().mb_str(wxConvUTF8).data();
 	bool save_as = false;
 	bool save_otgz = false;
+	// Stays empty unless the save gets through
+	map.telemetry.clear();
+	// Saving only goes over the tiles in memory
+	map.wake();
 
 	if(savefile.empty()) {
 		savefile = map.filename;
@@ -276,6 +302,12 @@ void Editor::saveMap(FileName filename, bool showdialog)
 		save_as = c1 != c2;
 	}
 
+	// Unchanged areas can only be taken from the file the map was loaded from or last saved to,
+	// as can the areas a partial map didn't load
+	const bool save_in_place = !map.filename.empty() && FileName(wxstr(savefile)) == FileName(wxstr(map.filename));
+	const bool save_incremental = g_settings.getBoolean(Config::INCREMENTAL_SAVE) && save_in_place;
+	const std::string partial_source = map.filename;
+
 	// If not named yet, propagate the file name to the auxilliary files
 	if(map.unnamed) {
 		FileName _name(filename);
@@ -293,6 +325,8 @@ void Editor::saveMap(FileName filename, bool showdialog)
 	FileName converter;
 	converter.Assign(wxstr(savefile));
 	std::string map_path = nstr(converter.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME));
+	// Plain and compressed maps are backed up under their own extension
+	const std::string map_ext = "." + nstr(converter.GetExt());
 
 	// Make temporary backups
 	//converter.Assign(wxstr(savefile));
@@ -307,7 +341,7 @@ void Editor::saveMap(FileName filename, bool showdialog)
 		}
 	} else {
 		if(converter.FileExists()) {
-			backup_otbm = map_path + nstr(converter.GetName()) + ".otbm~";
+			backup_otbm = map_path + nstr(converter.GetName()) + map_ext + "~";
 			std::remove(backup_otbm.c_str());
 			std::rename(savefile.c_str(), backup_otbm.c_str());
 		}
@@ -349,7 +383,17 @@ void Editor::saveMap(FileName filename, bool showdialog)
 
 		// Perform the actual save
 		IOMapOTBM mapsaver(map.getVersion());
+		if(save_incremental && !save_otgz && !backup_otbm.empty()) {
+			mapsaver.setIncrementalSource(wxstr(backup_otbm));
+		}
+		if(map.isPartial()) {
+			mapsaver.setPartialSource(wxstr(save_in_place && !backup_otbm.empty() ? backup_otbm : partial_source));
+		}
 		bool success = mapsaver.saveMap(map, fn);
+		if(success) {
+			map.telemetry = mapsaver.getTelemetry();
+			map.telemetry.log("Saved " + fn.GetFullName());
+		}
 
 		if(showdialog)
 			g_gui.DestroyLoadBar();
@@ -360,7 +404,7 @@ void Editor::saveMap(FileName filename, bool showdialog)
 			if(!backup_otbm.empty()) {
 				converter.SetFullName(wxstr(savefile));
 				std::string otbm_filename = map_path + nstr(converter.GetName());
-				std::rename(backup_otbm.c_str(), std::string(otbm_filename + (save_otgz ? ".otgz" : ".otbm")).c_str());
+				std::rename(backup_otbm.c_str(), std::string(otbm_filename + map_ext).c_str());
 			}
 
 			if(!backup_house.empty()) {
@@ -411,7 +455,7 @@ void Editor::saveMap(FileName filename, bool showdialog)
 		if(!backup_otbm.empty()) {
 			converter.SetFullName(wxstr(savefile));
 			std::string otbm_filename = map_path + nstr(converter.GetName());
-			std::rename(backup_otbm.c_str(), std::string(otbm_filename + "." + date.str() + (save_otgz ? ".otgz" : ".otbm")).c_str());
+			std::rename(backup_otbm.c_str(), std::string(otbm_filename + "." + date.str() + map_ext).c_str());
 		}
 
 		if(!backup_house.empty()) {
@@ -432,27 +476,125 @@ void Editor::saveMap(FileName filename, bool showdialog)
 		std::remove(backup_spawn.c_str());
 	}
 
+	// The snapshot has to match the files just written
+	if(g_settings.getBoolean(Config::SESSION_SNAPSHOTS) && !save_otgz && !map.isPartial()) {
+		IOMapOTBM snapshot(map.getVersion());
+		snapshot.saveSession(map, wxstr(savefile));
+	}
+
 	clearChanges();
+	if(autosave) {
+		autosave->reset();
+	}
 }
 
-bool Editor::importMiniMap(FileName filename, int import, int import_x_offset, int import_y_offset, int import_z_offset)
+void Editor::markActive()
 {
-	return false;
+	last_active = std::chrono::steady_clock::now();
+	if(map.isHibernating()) {
+		map.wake();
+	}
 }
 
-bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offset, int import_z_offset, ImportType house_import_type, ImportType spawn_import_type)
+bool Editor::hibernateIfIdle()
+{
+	const int minutes = g_settings.getInteger(Config::HIBERNATE_INACTIVE_MAPS);
+	if(minutes <= 0 || map.isHibernating() || IsLive()) {
+		return false;
+	}
+	// Items are written through the data of their client version
+	if(map.getVersion().client != g_gui.GetCurrentVersionID()) {
+		return false;
+	}
+	const auto now = std::chrono::steady_clock::now();
+	if(now - last_active < std::chrono::minutes(minutes)) {
+		return false;
+	}
+
+	// Tried again a while later if the map had nothing to take
+	last_active = now;
+	const size_t tiles = map.hibernate();
+	if(tiles == 0) {
+		return false;
+	}
+	g_gui.SetStatusText(wxString::Format("%s hibernates, %llu tiles kept in %.1f MB", wxstr(map.getName()), (unsigned long long)tiles, map.getHibernatedBytes() / (1024.0 * 1024.0)));
+	return true;
+}
+
+bool Editor::exportMap(const FileName& filename, bool for_server, bool with_index)
+{
+	// The map is read from its file while it is written, the unloaded areas of a partial map too
+	if(!map.filename.empty() && FileName(wxstr(map.filename)) == filename) {
+		g_gui.PopupDialog("Error", "Maps can't be exported over the file they were opened from.", wxOK);
+		return false;
+	}
+
+	map.wake();
+	g_gui.CreateLoadBar("Exporting OTBM map...");
+	IOMapOTBM exporter(map.getVersion());
+	if(map.isPartial()) {
+		exporter.setPartialSource(wxstr(map.filename));
+	}
+	exporter.setServerProfile(for_server, with_index);
+	bool success = exporter.exportMap(map, filename);
+	g_gui.DestroyLoadBar();
+
+	if(!success) {
+		g_gui.PopupDialog("Error", "Could not export the map.\n" + exporter.getError(), wxOK);
+	}
+	g_gui.ListDialog("Export warnings", exporter.getWarnings());
+	return success;
+}
+
+bool Editor::importMiniMap(FileName filename, int import_x_offset, int import_y_offset, int import_z_offset)
 {
 	selection.clear();
 	actionQueue->clear();
 
-	Map imported_map;
-	bool loaded = imported_map.open(nstr(filename.GetFullPath()));
+	g_gui.CreateLoadBar("Importing minimap...");
+	IOMinimap importer(this, MinimapExportFormat::Otmm, MinimapExportMode::AllFloors, true);
+	const bool loaded = importer.loadOtmm(filename, Position(import_x_offset, import_y_offset, import_z_offset));
+	g_gui.DestroyLoadBar();
 
 	if(!loaded) {
-		g_gui.PopupDialog("Error", "Error loading map!\n" + imported_map.getError(), wxOK | wxICON_INFORMATION);
+		g_gui.PopupDialog("Error", "Error importing minimap!\n" + wxstr(importer.getError()), wxOK | wxICON_INFORMATION);
+		return false;
+	}
+
+	// The map grows to take in what was imported
+	const BaseMap::TileBounds bounds = map.getBounds();
+	if(!bounds.empty()) {
+		map.setWidth(std::max<int>(map.getWidth(), bounds.max_x));
+		map.setHeight(std::max<int>(map.getHeight(), bounds.max_y));
+	}
+	if(importer.getImportedTiles() > 0) {
+		map.doChange();
+	}
+
+	wxString message = wxString::Format("Minimap imported, %zu tiles were created.", importer.getImportedTiles());
+	if(importer.getSkippedBlocks() > 0) {
+		message << wxString::Format(" %zu damaged blocks were skipped.", importer.getSkippedBlocks());
+	}
+	g_gui.PopupDialog("Success", message, wxOK);
+
+	g_gui.RefreshPalettes();
+	g_gui.FitViewToMap();
+	return true;
+}
+
+bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offset, int import_z_offset, ImportType house_import_type, ImportType spawn_import_type, const MapArea& area)
+{
+	selection.clear();
+	actionQueue->clear();
+
+	// Only the header, towns, waypoints and houses of the imported map are read into memory,
+	// its tiles are streamed from the file into this map one group of tile areas at a time
+	Map imported_map;
+	IOMapOTBM loader(imported_map.getVersion());
+	if(!loader.beginImport(imported_map, filename)) {
+		g_gui.PopupDialog("Error", "Error loading map!\n" + loader.getError(), wxOK | wxICON_INFORMATION);
 		return false;
 	}
-	g_gui.ListDialog("Warning", imported_map.getWarnings());
 
 	Position offset(import_x_offset, import_y_offset, import_z_offset);
 
@@ -465,6 +607,7 @@ bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offs
 
 	std::map<uint32_t, uint32_t> town_id_map;
 	std::map<uint32_t, uint32_t> house_id_map;
+	std::vector<uint32_t> added_houses;
 
 	if(house_import_type != IMPORT_DONT) {
 		for(TownMap::iterator tit = imported_map.towns.begin(); tit != imported_map.towns.end();) {
@@ -598,6 +741,7 @@ bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offs
 			Position newexit = oldexit + offset;
 			if(newexit.isValid()) imported_house->setExit(&map, newexit);
 			map.houses.addHouse(imported_house);
+			added_houses.push_back(imported_house->id);
 
 #ifdef __VISUALC__ // C++0x compliance to some degree :)
 			hit = imported_map.houses.erase(hit);
@@ -618,154 +762,167 @@ bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offs
 		}
 	}
 
-	std::map<Position, Spawn*> spawn_map;
-	if(spawn_import_type != IMPORT_DONT) {
-		for(SpawnPositionList::iterator siter = imported_map.spawns.begin(); siter != imported_map.spawns.end();) {
-			Position old_spawn_pos = *siter;
-			Position new_spawn_pos = *siter + offset;
-			switch(spawn_import_type) {
-				case IMPORT_SMART_MERGE:
-				case IMPORT_INSERT:
-				case IMPORT_MERGE: {
-					Tile* imported_tile = imported_map.getTile(old_spawn_pos);
-					if(imported_tile) {
-						ASSERT(imported_tile->spawn);
-						spawn_map[new_spawn_pos] = imported_tile->spawn;
-
-						SpawnPositionList::iterator next = siter;
-						bool cont = true;
-						Position next_spawn;
-
-						++next;
-						if(next == imported_map.spawns.end())
-							cont = false;
-						else
-							next_spawn = *next;
-						imported_map.spawns.erase(siter);
-						if(cont)
-							siter = imported_map.spawns.find(next_spawn);
-						else
-							siter = imported_map.spawns.end();
-					}
-					break;
-				}
-				case IMPORT_DONT: {
-					++siter;
-					break;
-				}
-			}
-		}
-	}
-
 	// Plain merge of waypoints, very simple! :)
 	for(WaypointMap::iterator iter = imported_map.waypoints.begin(); iter != imported_map.waypoints.end(); ++iter) {
-		iter->second->pos += offset;
-	}
-
-	map.waypoints.waypoints.insert(imported_map.waypoints.begin(), imported_map.waypoints.end());
-	imported_map.waypoints.waypoints.clear();
-
-
-	uint64_t tiles_merged = 0;
-	uint64_t tiles_to_import = imported_map.tilecount;
-	for(MapIterator mit = imported_map.begin(); mit != imported_map.end(); ++mit) {
-		if(tiles_merged % 8092 == 0) {
-			g_gui.SetLoadDone(int(100.0 * tiles_merged / tiles_to_import));
-		}
-		++tiles_merged;
-
-		Tile* import_tile = (*mit)->get();
-		Position new_pos = import_tile->getPosition() + offset;
-		if(!new_pos.isValid()) {
-			++discarded_tiles;
+		Waypoint* waypoint = iter->second;
+		if(!area.contains(waypoint->pos) || map.waypoints.getWaypoint(waypoint->name)) {
+			delete waypoint;
 			continue;
 		}
-
-		if(!resizemap && (new_pos.x > map.getWidth() || new_pos.y > map.getHeight())) {
-			if(resize_asked) {
+		waypoint->pos += offset;
+		map.waypoints.addWaypoint(waypoint);
+	}
+	imported_map.waypoints.releaseWaypoints();
+
+	std::vector<IOMapOTBM::ImportedTile> placed;
+	PositionVector positions;
+	bool loaded = loader.importTiles(area, [&](std::vector<IOMapOTBM::ImportedTile>& tiles) {
+		placed.clear();
+		positions.clear();
+		for(IOMapOTBM::ImportedTile& imported : tiles) {
+			Position new_pos = imported.position + offset;
+			if(!new_pos.isValid()) {
 				++discarded_tiles;
+				delete imported.tile;
 				continue;
-			} else {
-				resize_asked = true;
-				int ret = g_gui.PopupDialog("Collision", "The imported tiles are outside the current map scope. Do you want to resize the map? (Else additional tiles will be removed)", wxYES | wxNO);
+			}
 
-				if(ret == wxID_YES) {
-					// ...
-					resizemap = true;
-				} else {
+			if(!resizemap && (new_pos.x > map.getWidth() || new_pos.y > map.getHeight())) {
+				if(!resize_asked) {
+					resize_asked = true;
+					int ret = g_gui.PopupDialog("Collision", "The imported tiles are outside the current map scope. Do you want to resize the map? (Else additional tiles will be removed)", wxYES | wxNO);
+					resizemap = (ret == wxID_YES);
+				}
+				if(!resizemap) {
 					++discarded_tiles;
+					delete imported.tile;
 					continue;
 				}
 			}
-		}
 
-		if(new_pos.x > newsize_x) {
-			newsize_x = new_pos.x;
-		}
-		if(new_pos.y > newsize_y) {
-			newsize_y = new_pos.y;
-		}
+			if(new_pos.x > newsize_x) {
+				newsize_x = new_pos.x;
+			}
+			if(new_pos.y > newsize_y) {
+				newsize_y = new_pos.y;
+			}
 
-		imported_map.setTile(import_tile->getPosition(), nullptr);
-		TileLocation* location = map.createTileL(new_pos);
+			placed.push_back({new_pos, imported.tile});
+			positions.push_back(new_pos);
+		}
 
+		// The tree is descended once per leaf of the batch instead of once per tile
+		std::vector<TileLocation*> locations = map.createTileLocations(positions);
+		for(size_t index = 0; index < placed.size(); ++index) {
+			const Position& new_pos = placed[index].position;
+			Tile* import_tile = placed[index].tile;
+			import_tile->setLocation(locations[index]);
 
-		// Check if we should update any houses
-		int new_houseid = house_id_map[import_tile->getHouseID()];
-		House* house = map.houses.getHouse(new_houseid);
-		if(import_tile->isHouseTile() && house_import_type != IMPORT_DONT && house) {
-			// We need to notify houses of the tile moving
-			house->removeTile(import_tile);
-			import_tile->setLocation(location);
-			house->addTile(import_tile);
-		} else {
-			import_tile->setLocation(location);
-		}
+			// Check if we should update any houses
+			if(import_tile->isHouseTile()) {
+				std::map<uint32_t, uint32_t>::const_iterator house_iter = house_id_map.find(import_tile->getHouseID());
+				House* house = nullptr;
+				if(house_import_type != IMPORT_DONT && house_iter != house_id_map.end()) {
+					house = map.houses.getHouse(house_iter->second);
+				}
+				if(house) {
+					house->addTile(import_tile);
+				} else {
+					map.houses.setOrphanedTiles(true);
+				}
+			}
 
-		if(offset != Position(0,0,0)) {
-			for(ItemVector::iterator iter = import_tile->items.begin(); iter != import_tile->items.end(); ++iter) {
-				Item* item = *iter;
-				if(Teleport* teleport = dynamic_cast<Teleport*>(item)) {
-					teleport->setDestination(teleport->getDestination() + offset);
+			if(offset != Position(0,0,0)) {
+				for(ItemVector::iterator iter = import_tile->items.begin(); iter != import_tile->items.end(); ++iter) {
+					Item* item = *iter;
+					if(Teleport* teleport = dynamic_cast<Teleport*>(item)) {
+						teleport->setDestination(teleport->getDestination() + offset);
+					}
 				}
 			}
-		}
 
-		Tile* old_tile = map.getTile(new_pos);
-		if(old_tile) {
-			map.removeSpawn(old_tile);
+			Tile* old_tile = map.getTile(new_pos);
+			if(old_tile) {
+				map.removeSpawn(old_tile);
+			}
+
+			map.setTile(new_pos, import_tile, true);
 		}
-		import_tile->spawn = nullptr;
+	});
 
-		map.setTile(new_pos, import_tile, true);
+	// Spawns are read once the tiles their creatures stand on are in place
+	if(loaded && spawn_import_type != IMPORT_DONT) {
+		loader.finishImport(map, offset, area);
 	}
 
-	for(std::map<Position, Spawn*>::iterator spawn_iter = spawn_map.begin(); spawn_iter != spawn_map.end(); ++spawn_iter) {
-		Position pos = spawn_iter->first;
-		TileLocation* location = map.createTileL(pos);
-		Tile* tile = location->get();
-		if(!tile) {
-			tile = map.allocator(location);
-			map.setTile(pos, tile);
-		} else if(tile->spawn) {
-			map.removeSpawnInternal(tile);
-			delete tile->spawn;
+	// Houses added for a part of the imported map might not have any tiles in it
+	if(!area.isWholeMap()) {
+		for(uint32_t house_id : added_houses) {
+			House* house = map.houses.getHouse(house_id);
+			if(house && house->getTiles().empty()) {
+				map.houses.removeHouse(house);
+			}
 		}
-		tile->spawn = spawn_iter->second;
-
-		map.addSpawn(tile);
 	}
 
 	g_gui.DestroyLoadBar();
 
 	map.setWidth(newsize_x);
 	map.setHeight(newsize_y);
-	g_gui.PopupDialog("Success", "Map imported successfully, " + i2ws(discarded_tiles) + " tiles were discarded as invalid.", wxOK);
+	if(!loaded) {
+		g_gui.PopupDialog("Error", "Error loading map!\n" + loader.getError(), wxOK | wxICON_INFORMATION);
+	} else {
+		g_gui.ListDialog("Warning", loader.getWarnings());
+		g_gui.PopupDialog("Success", "Map imported successfully, " + i2ws(discarded_tiles) + " tiles were discarded as invalid.", wxOK);
+	}
 
 	g_gui.RefreshPalettes();
 	g_gui.FitViewToMap();
 
-	return true;
+	return loaded;
+}
+
+namespace
+{
+	// Runs func(index) for every index in [0, count) on the thread pool, in chunks of consecutive indices
+	template <typename Func>
+	void parallelChunks(size_t count, Func&& func)
+	{
+		ThreadPool& pool = ThreadPool::getInstance();
+		const size_t chunk_count = std::max<size_t>(std::min(count / 256, pool.getWorkerCount() * 8), 1);
+		pool.parallelFor(chunk_count, [&](size_t chunk) {
+			const size_t end = count * (chunk + 1) / chunk_count;
+			for(size_t index = count * chunk / chunk_count; index < end; ++index) {
+				func(index);
+			}
+		});
+	}
+
+	// Copies and borderizes the tiles on the thread pool, the copies aren't on the map so this only reads it
+	std::vector<Tile*> borderizedCopies(Map& map, const std::vector<const Tile*>& tiles, bool borderize)
+	{
+		RME_TRACE_ZONE("brush", "borderizedCopies");
+		// Borders look at the neighbours, the pool can't read them back in if they are paged out
+		if(borderize) {
+			for(const Tile* tile : tiles) {
+				map.pageInArea(tile->getX() - 1, tile->getY() - 1, tile->getX() + 1, tile->getY() + 1);
+			}
+		}
+		std::vector<Tile*> copies(tiles.size());
+		parallelChunks(tiles.size(), [&](size_t index) {
+			copies[index] = tiles[index]->deepCopy(map);
+			if(borderize) {
+				copies[index]->borderize(&map);
+			}
+		});
+		return copies;
+	}
+
+	void uniqueTiles(std::vector<const Tile*>& tiles)
+	{
+		std::sort(tiles.begin(), tiles.end());
+		tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+	}
 }
 
 void Editor::borderizeSelection()
@@ -775,10 +932,11 @@ void Editor::borderizeSelection()
 		return;
 	}
 
+	const std::vector<const Tile*> tiles(selection.begin(), selection.end());
+	std::vector<Tile*> new_tiles = borderizedCopies(map, tiles, true);
+
 	Action* action = actionQueue->createAction(ACTION_BORDERIZE);
-	for(const Tile* tile : selection) {
-		Tile* new_tile = tile->deepCopy(map);
-		new_tile->borderize(&map);
+	for(Tile* new_tile : new_tiles) {
 		new_tile->select();
 		action->addChange(new Change(new_tile));
 	}
@@ -792,24 +950,48 @@ void Editor::borderizeMap(bool showdialog)
 		g_gui.CreateLoadBar("Borderizing map...");
 	}
 
-	uint64_t tiles_done = 0;
-	for(TileLocation* tileLocation : map) {
-		if(showdialog && tiles_done % 4096 == 0) {
-			g_gui.SetLoadDone(static_cast<int32_t>(tiles_done / double(map.tilecount) * 100.0));
+	map.borderize([showdialog](int percent) {
+		if(showdialog) {
+			g_gui.SetLoadDone(percent);
 		}
-
-		Tile* tile = tileLocation->get();
-		ASSERT(tile);
-
-		tile->borderize(&map);
-		++tiles_done;
-	}
+	});
 
 	if(showdialog) {
 		g_gui.DestroyLoadBar();
 	}
 }
 
+namespace
+{
+	// Draws a new ground of its ground brush on the tile, rolled from its position and the seed,
+	// the action and unique ids of the old ground go to the new one
+	bool randomizeGround(Tile* tile, uint32_t seed, bool rerandomizable_only)
+	{
+		GroundBrush* brush = tile->getGroundBrush();
+		if(!brush || (rerandomizable_only && !brush->isReRandomizable())) {
+			return false;
+		}
+
+		const Position& position = tile->getPosition();
+		const uint16_t id = brush->getGroundItem(position_random(position.x, position.y, position.z, seed, 1, brush->getTotalChance()));
+		if(id == 0) {
+			return false;
+		}
+
+		uint16_t action_id = 0, unique_id = 0;
+		if(tile->ground) {
+			action_id = tile->ground->getActionID();
+			unique_id = tile->ground->getUniqueID();
+		}
+		tile->addItem(Item::Create(id));
+		if(tile->ground) {
+			tile->ground->setActionID(action_id);
+			tile->ground->setUniqueID(unique_id);
+		}
+		return true;
+	}
+}
+
 void Editor::randomizeSelection()
 {
 	if(selection.empty()) {
@@ -817,21 +999,23 @@ void Editor::randomizeSelection()
 		return;
 	}
 
-	Action* action = actionQueue->createAction(ACTION_RANDOMIZE);
-	for(const Tile* tile : selection) {
-		Tile* new_tile = tile->deepCopy(map);
-		GroundBrush* brush = new_tile->getGroundBrush();
-		if(brush && brush->isReRandomizable()) {
-			brush->draw(&map, new_tile, nullptr);
-
-			Item* old_ground = tile->ground;
-			Item* new_ground = new_tile->ground;
-			if(old_ground && new_ground) {
-				new_ground->setActionID(old_ground->getActionID());
-				new_ground->setUniqueID(old_ground->getUniqueID());
-			}
-
+	// The copies are randomized on the thread pool, the action is built in selection order
+	const std::vector<const Tile*> tiles(selection.begin(), selection.end());
+	const uint32_t seed = mt_randi();
+	std::vector<Tile*> new_tiles(tiles.size());
+	parallelChunks(tiles.size(), [&](size_t index) {
+		Tile* new_tile = tiles[index]->deepCopy(map);
+		if(randomizeGround(new_tile, seed, true)) {
 			new_tile->select();
+			new_tiles[index] = new_tile;
+		} else {
+			delete new_tile;
+		}
+	});
+
+	Action* action = actionQueue->createAction(ACTION_RANDOMIZE);
+	for(Tile* new_tile : new_tiles) {
+		if(new_tile) {
 			action->addChange(new Change(new_tile));
 		}
 	}
@@ -839,44 +1023,36 @@ void Editor::randomizeSelection()
 	updateActions();
 }
 
-void Editor::randomizeMap(bool showdialog)
+void Editor::randomizeMap(bool showdialog, uint32_t seed)
 {
 	if(showdialog) {
 		g_gui.CreateLoadBar("Randomizing map...");
 	}
 
-	uint64_t tiles_done = 0;
-	for(TileLocation* tileLocation : map) {
-		if(showdialog && tiles_done % 4096 == 0) {
-			g_gui.SetLoadDone(static_cast<int32_t>(tiles_done / double(map.tilecount) * 100.0));
-		}
-
-		Tile* tile = tileLocation->get();
-		ASSERT(tile);
-
-		GroundBrush* groundBrush = tile->getGroundBrush();
-		if(groundBrush) {
-			Item* oldGround = tile->ground;
-
-			uint16_t actionId, uniqueId;
-			if(oldGround) {
-				actionId = oldGround->getActionID();
-				uniqueId = oldGround->getUniqueID();
-			} else {
-				actionId = 0;
-				uniqueId = 0;
+	// Every tile rolls from its own position, the result doesn't depend on the threads
+	parallel_foreach_LeafOnMap(map, [seed](QTreeNode* leaf, int, int) {
+		bool changed = false;
+		for(int z = rme::MapMinLayer; z <= rme::MapMaxLayer; ++z) {
+			Floor* floor = leaf->getFloor(z);
+			if(!floor) {
+				continue;
 			}
-			groundBrush->draw(&map, tile, nullptr);
 
-			Item* newGround = tile->ground;
-			if(newGround) {
-				newGround->setActionID(actionId);
-				newGround->setUniqueID(uniqueId);
+			for(TileLocation& location : floor->locs) {
+				Tile* tile = location.get();
+				if(tile && randomizeGround(tile, seed, false)) {
+					tile->update();
+					changed = true;
+				}
 			}
-			tile->update();
 		}
-		++tiles_done;
-	}
+		return changed;
+	}, [showdialog](int percent) {
+		if(showdialog) {
+			g_gui.SetLoadDone(percent);
+		}
+	});
+	map.discardItemIdIndex();
 
 	if(showdialog) {
 		g_gui.DestroyLoadBar();
@@ -891,45 +1067,40 @@ void Editor::clearInvalidHouseTiles(bool showdialog)
 
 	Houses& houses = map.houses;
 
-	HouseMap::iterator iter = houses.begin();
-	while(iter != houses.end()) {
-		House* h = iter->second;
-		if(map.towns.getTown(h->townid) == nullptr) {
-#ifdef __VISUALC__ // C++0x compliance to some degree :)
-			iter = houses.erase(iter);
-#else // Bulky, slow way
-			HouseMap::iterator tmp_iter = iter;
-			++tmp_iter;
-			uint32_t next_key = 0;
-			if(tmp_iter != houses.end()) {
-				next_key = tmp_iter->first;
-			}
-			houses.erase(iter);
-			if(next_key != 0) {
-				iter = houses.find(next_key);
-			} else {
-				iter = houses.end();
-			}
-#endif
-		} else {
-			++iter;
+	// The houses know their tiles, removing one clears them
+	std::vector<House*> invalid;
+	for(const auto& houseEntry : houses) {
+		if(map.towns.getTown(houseEntry.second->townid) == nullptr) {
+			invalid.push_back(houseEntry.second);
 		}
 	}
+	for(House* house : invalid) {
+		houses.removeHouse(house);
+	}
 
-	uint64_t tiles_done = 0;
-	for(MapIterator map_iter = map.begin(); map_iter != map.end(); ++map_iter) {
-		if(showdialog && tiles_done % 4096 == 0) {
-			g_gui.SetLoadDone(int(tiles_done / double(map.tilecount) * 100.0));
+	// Only tiles of houses that don't exist need the whole map to be looked at
+	if(!houses.hasOrphanedTiles()) {
+		if(showdialog) {
+			g_gui.DestroyLoadBar();
 		}
+		return;
+	}
 
-		Tile* tile = (*map_iter)->get();
-		ASSERT(tile);
-		if(tile->isHouseTile()) {
-			if(houses.getHouse(tile->getHouseID()) == nullptr) {
-				tile->setHouse(nullptr);
-			}
+	const Houses& existing = houses;
+	bool cancelled = false;
+	parallel_pass_TileOnMap(map, [&existing](Tile* tile) {
+		if(!tile->isHouseTile() || existing.getHouse(tile->getHouseID()) != nullptr) {
+			return false;
 		}
-		++tiles_done;
+		tile->setHouse(nullptr);
+		return true;
+	}, [showdialog, &cancelled](int percent) {
+		cancelled = showdialog && !g_gui.SetLoadDone(std::min(percent, 99));
+		return !cancelled;
+	});
+	// Some tiles may not have been looked at
+	if(!cancelled) {
+		houses.setOrphanedTiles(false);
 	}
 
 	if(showdialog) {
@@ -943,17 +1114,14 @@ void Editor::clearModifiedTileState(bool showdialog)
 		g_gui.CreateLoadBar("Clearing modified state from all tiles...");
 	}
 
-	uint64_t tiles_done = 0;
-	for(MapIterator map_iter = map.begin(); map_iter != map.end(); ++map_iter) {
-		if(showdialog && tiles_done % 4096 == 0) {
-			g_gui.SetLoadDone(int(tiles_done / double(map.tilecount) * 100.0));
-		}
-
-		Tile* tile = (*map_iter)->get();
-		ASSERT(tile);
+	// Every tile changes, the map is marked as a whole instead of leaf by leaf
+	parallel_pass_TileOnMap(map, [](Tile* tile) {
 		tile->unmodify();
-		++tiles_done;
-	}
+		return false;
+	}, [showdialog](int percent) {
+		return !showdialog || g_gui.SetLoadDone(std::min(percent, 99));
+	});
+	map.markAllTilesChanged();
 
 	if(showdialog) {
 		g_gui.DestroyLoadBar();
@@ -966,17 +1134,18 @@ void Editor::moveSelection(const Position& offset)
 		return;
 	}
 
-	bool borderize = false;
 	int drag_threshold = g_settings.getInteger(Config::BORDERIZE_DRAG_THRESHOLD);
 	bool create_borders = g_settings.getInteger(Config::USE_AUTOMAGIC)
 		&& g_settings.getInteger(Config::BORDERIZE_DRAG);
 
-	TileSet storage;
-	BatchAction* batch_action = actionQueue->createBatch(ACTION_MOVE);
-	Action* action = actionQueue->createAction(batch_action);
+	const std::vector<Tile*> selected(selection.begin(), selection.end());
+	std::vector<Tile*> new_tiles(selected.size());
+	std::vector<Tile*> storage(selected.size());
+	std::atomic<bool> borderize(false);
 
-	// Update the tiles with the new positions
-	for(Tile* tile : selection) {
+	// Split the tiles into what stays and what moves, every tile on its own so this runs on the pool
+	parallelChunks(selected.size(), [&](size_t index) {
+		Tile* tile = selected[index];
 		Tile* new_tile = tile->deepCopy(map);
 		Tile* storage_tile = map.allocator(tile->getLocation());
 
@@ -1005,7 +1174,13 @@ void Editor::moveSelection(const Position& offset)
 			borderize = true;
 		}
 
-		storage.insert(storage_tile);
+		new_tiles[index] = new_tile;
+		storage[index] = storage_tile;
+	});
+
+	BatchAction* batch_action = actionQueue->createBatch(ACTION_MOVE);
+	Action* action = actionQueue->createAction(batch_action);
+	for(Tile* new_tile : new_tiles) {
 		action->addChange(new Change(new_tile));
 	}
 	batch_action->addAndCommitAction(action);
@@ -1013,33 +1188,27 @@ void Editor::moveSelection(const Position& offset)
 	// Remove old borders (and create some new?)
 	if(create_borders && selection.size() < static_cast<size_t>(drag_threshold)) {
 		action = actionQueue->createAction(batch_action);
-		TileList borderize_tiles;
+		std::vector<const Tile*> borderize_tiles;
 		// Go through all modified (selected) tiles (might be slow)
 		for(const Tile* tile : storage) {
 			const Position& pos = tile->getPosition();
 			// Go through all neighbours
-			Tile* t;
-			t = map.getTile(pos.x  , pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x-1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x  , pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x+1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x-1, pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x+1, pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x-1, pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x  , pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-			t = map.getTile(pos.x+1, pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); }
-		}
-
-		// Remove duplicates
-		borderize_tiles.sort();
-		borderize_tiles.unique();
+			for(int y = -1; y <= 1; ++y) {
+				for(int x = -1; x <= 1; ++x) {
+					const Tile* t = map.getTile(pos.x + x, pos.y + y, pos.z);
+					if(t && !t->isSelected()) {
+						borderize_tiles.push_back(t);
+					}
+				}
+			}
+		}
+		uniqueTiles(borderize_tiles);
 
 		// Create borders
-		for(const Tile* tile : borderize_tiles) {
-			Tile* new_tile = tile->deepCopy(map);
-			if(borderize) {
-				new_tile->borderize(&map);
-			}
+		std::vector<Tile*> copies = borderizedCopies(map, borderize_tiles, borderize);
+		for(size_t index = 0; index < copies.size(); ++index) {
+			const Tile* tile = borderize_tiles[index];
+			Tile* new_tile = copies[index];
 			new_tile->wallize(&map);
 			new_tile->tableize(&map);
 			new_tile->carpetize(&map);
@@ -1052,21 +1221,32 @@ void Editor::moveSelection(const Position& offset)
 	}
 
 	// New action for adding the destination tiles
-	action = actionQueue->createAction(batch_action);
+	std::vector<Tile*> moved;
+	PositionVector destinations;
+	moved.reserve(storage.size());
+	destinations.reserve(storage.size());
 	for(Tile* tile : storage) {
-		const Position& old_pos = tile->getPosition();
-		Position new_pos = old_pos - offset;
-		if(new_pos.z < rme::MapMinLayer && new_pos.z > rme::MapMaxLayer) {
+		Position new_pos = tile->getPosition() - offset;
+		if(new_pos.z < rme::MapMinLayer || new_pos.z > rme::MapMaxLayer) {
 			delete tile;
 			continue;
 		}
+		moved.push_back(tile);
+		destinations.push_back(new_pos);
+	}
 
-		TileLocation* location = map.createTileL(new_pos);
+	// Every destination is a different tile, so the merges can run side by side
+	const std::vector<TileLocation*> locations = map.createTileLocations(destinations);
+	const bool merge_move = g_settings.getInteger(Config::MERGE_MOVE);
+	std::vector<Tile*> dest_tiles(moved.size());
+	parallelChunks(moved.size(), [&](size_t index) {
+		Tile* tile = moved[index];
+		TileLocation* location = locations[index];
 		Tile* old_dest_tile = location->get();
-		Tile* new_dest_tile = nullptr;
 
-		if(!tile->ground || g_settings.getInteger(Config::MERGE_MOVE)) {
+		if(!tile->ground || merge_move) {
 			// Move items
+			Tile* new_dest_tile;
 			if(old_dest_tile) {
 				new_dest_tile = old_dest_tile->deepCopy(map);
 			} else {
@@ -1074,60 +1254,63 @@ void Editor::moveSelection(const Position& offset)
 			}
 			new_dest_tile->merge(tile);
 			delete tile;
+			dest_tiles[index] = new_dest_tile;
 		} else {
 			// Replace tile instead of just merge
 			tile->setLocation(location);
-			new_dest_tile = tile;
+			dest_tiles[index] = tile;
 		}
+	});
+
+	action = actionQueue->createAction(batch_action);
+	for(Tile* new_dest_tile : dest_tiles) {
 		action->addChange(new Change(new_dest_tile));
 	}
 	batch_action->addAndCommitAction(action);
 
 	if(create_borders && selection.size() < static_cast<size_t>(drag_threshold)) {
 		action = actionQueue->createAction(batch_action);
-		TileList borderize_tiles;
+		std::vector<const Tile*> borderize_tiles;
 		// Go through all modified (selected) tiles (might be slow)
 		for(Tile* tile : selection) {
 			bool add_me = false; // If this tile is touched
 			const Position& pos = tile->getPosition();
 			// Go through all neighbours
-			Tile* t;
-			t = map.getTile(pos.x-1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x-1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x  , pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x+1, pos.y-1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x-1, pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x+1, pos.y  , pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x-1, pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x  , pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
-			t = map.getTile(pos.x+1, pos.y+1, pos.z); if(t && !t->isSelected()) { borderize_tiles.push_back(t); add_me = true; }
+			for(int y = -1; y <= 1; ++y) {
+				for(int x = -1; x <= 1; ++x) {
+					if(x == 0 && y == 0) {
+						continue;
+					}
+					const Tile* t = map.getTile(pos.x + x, pos.y + y, pos.z);
+					if(t && !t->isSelected()) {
+						borderize_tiles.push_back(t);
+						add_me = true;
+					}
+				}
+			}
 			if(add_me) {
 				borderize_tiles.push_back(tile);
 			}
 		}
 
-		// Remove duplicates
-		borderize_tiles.sort();
-		borderize_tiles.unique();
+		// Only tiles with a ground brush get new borders
+		borderize_tiles.erase(std::remove_if(borderize_tiles.begin(), borderize_tiles.end(), [](const Tile* tile) {
+			return !tile->ground || !tile->ground->getGroundBrush();
+		}), borderize_tiles.end());
+		uniqueTiles(borderize_tiles);
 
 		// Create borders
-		for(const Tile* tile : borderize_tiles) {
-			if(!tile || !tile->ground) {
-				continue;
-			}
-			if(tile->ground->getGroundBrush()) {
-				Tile* new_tile = tile->deepCopy(map);
-				if(borderize) {
-					new_tile->borderize(&map);
-				}
-				new_tile->wallize(&map);
-				new_tile->tableize(&map);
-				new_tile->carpetize(&map);
-				if(tile->ground->isSelected()) {
-					new_tile->selectGround();
-				}
-				action->addChange(new Change(new_tile));
+		std::vector<Tile*> copies = borderizedCopies(map, borderize_tiles, borderize);
+		for(size_t index = 0; index < copies.size(); ++index) {
+			const Tile* tile = borderize_tiles[index];
+			Tile* new_tile = copies[index];
+			new_tile->wallize(&map);
+			new_tile->tableize(&map);
+			new_tile->carpetize(&map);
+			if(tile->ground->isSelected()) {
+				new_tile->selectGround();
 			}
+			action->addChange(new Change(new_tile));
 		}
 		batch_action->addAndCommitAction(action);
 	}
@@ -1150,10 +1333,9 @@ void Editor::destroySelection()
 		BatchAction* batch = actionQueue->createBatch(ACTION_DELETE_TILES);
 		Action* action = actionQueue->createAction(batch);
 
-		for(TileSet::iterator it = selection.begin(); it != selection.end(); ++it) {
+		for(Tile* tile : selection) {
 			tile_count++;
 
-			Tile* tile = *it;
 			Tile* newtile = tile->deepCopy(map);
 
 			ItemVector tile_selection = newtile->popSelectedItems();
@@ -1265,14 +1447,19 @@ void removeDuplicateWalls(Tile* buffer, Tile* tile)
 
 void Editor::drawInternal(Position offset, bool alt, bool dodraw)
 {
+	RME_TRACE_ZONE("brush", "Editor::draw");
 	if(!CanEdit()) {
 		return;
 	}
 
+	// A stroke copies every tile it touches for the undo history
+	MapAllocator::Scope allocation_scope;
+
 	Brush* brush = g_gui.GetCurrentBrush();
 	if(!brush) {
 		return;
 	}
+	g_session_recorder.recordDraw(*this, offset, alt, dodraw);
 
 	if(brush->isDoodad()) {
 		BatchAction* batch = actionQueue->createBatch(ACTION_DRAW);
@@ -1437,14 +1624,18 @@ void Editor::drawInternal(Position offset, bool alt, bool dodraw)
 
 void Editor::drawInternal(const PositionVector& tilestodraw, bool alt, bool dodraw)
 {
+	RME_TRACE_ZONE("brush", "Editor::draw");
 	if(!CanEdit()) {
 		return;
 	}
 
+	MapAllocator::Scope allocation_scope;
+
 	Brush* brush = g_gui.GetCurrentBrush();
 	if(!brush) {
 		return;
 	}
+	g_session_recorder.recordDraw(*this, tilestodraw, nullptr, alt, dodraw);
 
 #ifdef __DEBUG__
 	if(brush->isGround() || brush->isWall()) {
@@ -1508,18 +1699,153 @@ void Editor::drawInternal(const PositionVector& tilestodraw, bool alt, bool dodr
 
 void Editor::drawInternal(const PositionVector& tilestodraw, PositionVector& tilestoborder, bool alt, bool dodraw)
 {
+	RME_TRACE_ZONE("brush", "Editor::draw");
 	if(!CanEdit()) {
 		return;
 	}
 
+	MapAllocator::Scope allocation_scope;
+
 	Brush* brush = g_gui.GetCurrentBrush();
 	if(!brush) {
 		return;
 	}
+	g_session_recorder.recordDraw(*this, tilestodraw, &tilestoborder, alt, dodraw);
+
+	if(brush->isGround()) {
+		// The drawn tiles and the ring around them get their final state in one
+		// pass, ground brush borders only depend on the grounds around a tile, so
+		// the ring is bordered against the drawn copies before anything reaches
+		// the map. Each tile is copied once and the stroke is a single action.
+		BatchAction* batch = actionQueue->createBatch(dodraw ? ACTION_DRAW : ACTION_ERASE);
+		Action* action = actionQueue->createAction(batch);
+		const bool automagic = g_settings.getInteger(Config::USE_AUTOMAGIC);
+
+		std::pair<bool, GroundBrush*> param;
+		if(replace_brush) {
+			param.first = false;
+			param.second = replace_brush;
+		} else {
+			param.first = true;
+			param.second = nullptr;
+		}
+
+		// The drawn copies, indexed over the bounding box of the stroke and its ring
+		Position min_pos(rme::MapMaxWidth, rme::MapMaxHeight, rme::MapMaxLayer);
+		Position max_pos(0, 0, rme::MapMinLayer);
+		for(const PositionVector* positions : { &tilestodraw, &tilestoborder }) {
+			for(const Position& pos : *positions) {
+				min_pos.x = std::min(min_pos.x, pos.x);
+				min_pos.y = std::min(min_pos.y, pos.y);
+				min_pos.z = std::min(min_pos.z, pos.z);
+				max_pos.x = std::max(max_pos.x, pos.x);
+				max_pos.y = std::max(max_pos.y, pos.y);
+				max_pos.z = std::max(max_pos.z, pos.z);
+			}
+		}
+		const int width = std::max(max_pos.x - min_pos.x + 1, 0);
+		const int height = std::max(max_pos.y - min_pos.y + 1, 0);
+		const int depth = std::max(max_pos.z - min_pos.z + 1, 0);
+		std::vector<Tile*> drawn(static_cast<size_t>(width) * height * depth, nullptr);
+		const auto drawnAt = [&](int x, int y, int z) -> Tile** {
+			if(x < min_pos.x || y < min_pos.y || z < min_pos.z || x > max_pos.x || y > max_pos.y || z > max_pos.z) {
+				return nullptr;
+			}
+			return &drawn[(static_cast<size_t>(z - min_pos.z) * height + (y - min_pos.y)) * width + (x - min_pos.x)];
+		};
+
+		PositionVector toborder;
+		if(automagic) {
+			toborder = tilestoborder;
+		}
+
+		for(const Position& pos : tilestodraw) {
+			Tile** slot = drawnAt(pos.x, pos.y, pos.z);
+			if(*slot) {
+				continue;
+			}
+
+			TileLocation* location = map.createTileL(pos);
+			Tile* tile = location->get();
+			Tile* new_tile;
+			if(tile) {
+				new_tile = tile->deepCopy(map);
+				if(automagic) {
+					new_tile->cleanBorders();
+				}
+			} else if(dodraw) {
+				new_tile = map.allocator(location);
+			} else {
+				continue;
+			}
+
+			if(!dodraw) {
+				brush->undraw(&map, new_tile);
+				if(automagic) {
+					toborder.push_back(pos);
+				}
+			} else if(alt) {
+				brush->draw(&map, new_tile, &param);
+			} else {
+				brush->draw(&map, new_tile, nullptr);
+			}
+			*slot = new_tile;
+			action->addChange(newd Change(new_tile));
+		}
+
+		std::sort(toborder.begin(), toborder.end());
+		toborder.erase(std::unique(toborder.begin(), toborder.end()), toborder.end());
+
+		const auto groundBrushAt = [&](int x, int y, int z) -> GroundBrush* {
+			if(x < 0 || y < 0) {
+				return nullptr;
+			}
+			Tile** slot = drawnAt(x, y, z);
+			Tile* tile = slot && *slot ? *slot : map.getTile(x, y, z);
+			return tile ? tile->getGroundBrush() : nullptr;
+		};
+
+		{
+			RME_TRACE_ZONE("brush", "GroundBrush::doBorders");
+			for(const Position& pos : toborder) {
+				Tile** slot = drawnAt(pos.x, pos.y, pos.z);
+				Tile* new_tile = *slot;
+				bool existed = true;
+				if(!new_tile) {
+					TileLocation* location = map.createTileL(pos);
+					Tile* tile = location->get();
+					existed = tile != nullptr;
+					new_tile = existed ? tile->deepCopy(map) : map.allocator(location);
+				}
 
-	if(brush->isGround() || brush->isEraser()) {
-		ActionIdentifier identifier = (dodraw && !brush->isEraser()) ? ACTION_DRAW : ACTION_ERASE;
-		BatchAction* batch = actionQueue->createBatch(identifier);
+				GroundBrush* const neighbours[8] = {
+					groundBrushAt(pos.x - 1, pos.y - 1, pos.z),
+					groundBrushAt(pos.x,     pos.y - 1, pos.z),
+					groundBrushAt(pos.x + 1, pos.y - 1, pos.z),
+					groundBrushAt(pos.x - 1, pos.y,     pos.z),
+					groundBrushAt(pos.x + 1, pos.y,     pos.z),
+					groundBrushAt(pos.x - 1, pos.y + 1, pos.z),
+					groundBrushAt(pos.x,     pos.y + 1, pos.z),
+					groundBrushAt(pos.x + 1, pos.y + 1, pos.z),
+				};
+				GroundBrush::doBorders(new_tile, neighbours);
+
+				if(*slot) {
+					continue;
+				}
+				if(existed || new_tile->size() > 0) {
+					action->addChange(newd Change(new_tile));
+				} else {
+					delete new_tile;
+				}
+			}
+		}
+
+		// Commit changes to map
+		batch->addAndCommitAction(action);
+		addBatch(batch, 2);
+	} else if(brush->isEraser()) {
+		BatchAction* batch = actionQueue->createBatch(ACTION_ERASE);
 		Action* action = actionQueue->createAction(batch);
 
 		for(PositionVector::const_iterator it = tilestodraw.begin(); it != tilestodraw.end(); ++it) {
@@ -1530,40 +1856,16 @@ void Editor::drawInternal(const PositionVector& tilestodraw, PositionVector& til
 				if(g_settings.getInteger(Config::USE_AUTOMAGIC)) {
 					new_tile->cleanBorders();
 				}
-				if(dodraw)
-					if(brush->isGround() && alt) {
-						std::pair<bool, GroundBrush*> param;
-						if(replace_brush) {
-							param.first = false;
-							param.second = replace_brush;
-						} else {
-							param.first = true;
-							param.second = nullptr;
-						}
-						g_gui.GetCurrentBrush()->draw(&map, new_tile, &param);
-					} else {
-						g_gui.GetCurrentBrush()->draw(&map, new_tile, nullptr);
-					}
-				else {
+				if(dodraw) {
+					g_gui.GetCurrentBrush()->draw(&map, new_tile, nullptr);
+				} else {
 					g_gui.GetCurrentBrush()->undraw(&map, new_tile);
 					tilestoborder.push_back(*it);
 				}
 				action->addChange(newd Change(new_tile));
 			} else if(dodraw) {
 				Tile* new_tile = map.allocator(location);
-				if(brush->isGround() && alt) {
-					std::pair<bool, GroundBrush*> param;
-					if(replace_brush) {
-						param.first = false;
-						param.second = replace_brush;
-					} else {
-						param.first = true;
-						param.second = nullptr;
-					}
-					g_gui.GetCurrentBrush()->draw(&map, new_tile, &param);
-				} else {
-					g_gui.GetCurrentBrush()->draw(&map, new_tile, nullptr);
-				}
+				g_gui.GetCurrentBrush()->draw(&map, new_tile, nullptr);
 				action->addChange(newd Change(new_tile));
 			}
 		}
@@ -1572,7 +1874,9 @@ void Editor::drawInternal(const PositionVector& tilestodraw, PositionVector& til
 		batch->addAndCommitAction(action);
 
 		if(g_settings.getInteger(Config::USE_AUTOMAGIC)) {
-			// Do borders!
+			// Do borders, the erased tiles were added to the ring so it can hold each tile twice
+			std::sort(tilestoborder.begin(), tilestoborder.end());
+			tilestoborder.erase(std::unique(tilestoborder.begin(), tilestoborder.end()), tilestoborder.end());
 			action = actionQueue->createAction(batch);
 			for(PositionVector::const_iterator it = tilestoborder.begin(); it != tilestoborder.end(); ++it) {
 				TileLocation* location = map.createTileL(*it);
@@ -1889,3 +2193,10 @@ void Editor::SendNodeRequests()
 	}
 }
 
+void Editor::SetNodeViewport(int start_x, int start_y, int end_x, int end_y, int floor)
+{
+	if(live_client) {
+		live_client->setViewport(start_x, start_y, end_x, end_y, floor);
+	}
+}
+
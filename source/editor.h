@@ -25,18 +25,22 @@
 
 #include "action.h"
 #include "selection.h"
+#include "minimap_cache.h"
+
+#include <chrono>
 
 class BaseMap;
 class CopyBuffer;
 class LiveClient;
 class LiveServer;
 class LiveSocket;
+class MapAutosave;
 
 class Editor
 {
 public:
 	Editor(CopyBuffer& copybuffer, LiveClient* client);
-	Editor(CopyBuffer& copybuffer, const FileName& fn);
+	Editor(CopyBuffer& copybuffer, const FileName& fn, const MapArea& area = MapArea());
 	Editor(CopyBuffer& copybuffer);
 	~Editor();
 
@@ -44,6 +48,8 @@ protected:
 	// Live Server
 	LiveServer* live_server;
 	LiveClient* live_client;
+	// Local maps only, the changes of live clients are kept by the server
+	MapAutosave* autosave;
 
 public:
 	// Public members
@@ -69,12 +75,22 @@ public: // Functions
 	// Client side
 	void QueryNode(int ndx, int ndy, bool underground);
 	void SendNodeRequests();
+	void SetNodeViewport(int start_x, int start_y, int end_x, int end_y, int floor);
 
 	bool hasChanges() const;
 	void clearChanges();
 
 	// Map handling
 	void saveMap(FileName filename, bool showdialog); // "" means default filename
+	// Writes the map file alone to filename, the map keeps its own file. for_server writes it in
+	// the server profile of IOMapOTBM, with the tile index only along with_index.
+	bool exportMap(const FileName& filename, bool for_server = false, bool with_index = false);
+
+	// The map of the current tab is marked active on every idle event, which wakes it if it
+	// hibernates. hibernateIfIdle lets a map that has been in the background for as long as the
+	// settings say hibernate, see Map::hibernate.
+	void markActive();
+	bool hibernateIfIdle();
 
 	Map& getMap() noexcept { return map; }
 	const Map& getMap() const noexcept { return map; }
@@ -82,8 +98,9 @@ public: // Functions
 	uint16_t getMapHeight() const noexcept { return map.height; }
 
 	wxString getLoaderError() const { return map.getError(); }
-	bool importMap(FileName filename, int import_x_offset, int import_y_offset, int import_z_offset, ImportType house_import_type, ImportType spawn_import_type);
-	bool importMiniMap(FileName filename, int import, int import_x_offset, int import_y_offset, int import_z_offset);
+	bool importMap(FileName filename, int import_x_offset, int import_y_offset, int import_z_offset, ImportType house_import_type, ImportType spawn_import_type, const MapArea& area);
+	// Creates the tiles seen on a client minimap (.otmm) that the map doesn't have, see IOMinimap::loadOtmm
+	bool importMiniMap(FileName filename, int import_x_offset, int import_y_offset, int import_z_offset);
 
 	ActionQueue* getHistoryActions() const noexcept { return actionQueue; }
 	Action* createAction(ActionIdentifier type);
@@ -103,6 +120,9 @@ public: // Functions
 	Selection& getSelection() noexcept { return selection; }
 	const Selection& getSelection() const noexcept { return selection; }
 	bool hasSelection() const noexcept { return selection.size() != 0; }
+
+	// The minimap colours of the map, shared by everything that draws them
+	MinimapCache& getMinimapCache() noexcept { return minimap_cache; }
 	// Some simple actions that work on the map (these will work through the undo queue)
 	// Moves the selected area by the offset
 	void moveSelection(const Position& offset);
@@ -117,7 +137,8 @@ public: // Functions
 	// action queue is flushed when these functions are called
 	// showdialog is whether a progress bar should be shown
 	void borderizeMap(bool showdialog);
-	void randomizeMap(bool showdialog);
+	// Every tile draws from its position and the seed, the same seed gives the same map
+	void randomizeMap(bool showdialog, uint32_t seed);
 	void clearInvalidHouseTiles(bool showdialog);
 	void clearModifiedTileState(bool showdialog);
 
@@ -141,7 +162,9 @@ protected:
 private:
 	Map map;
 	Selection selection;
+	MinimapCache minimap_cache;
 	ActionQueue* actionQueue;
+	std::chrono::steady_clock::time_point last_active = std::chrono::steady_clock::now();
 };
 
 inline void Editor::draw(const Position& offset, bool alt) { drawInternal(offset, alt, true); }
@@ -124,6 +124,10 @@ void MapTabbook::OnNotebookPageChanged(wxAuiNotebookEvent& evt)
 	if(!newMapTab) {
 		g_gui.RefreshPalettes(nullptr);
 	} else if(!oldMapTab || !oldMapTab->HasSameReference(newMapTab)) {
+		// The maps may be of different versions
+		g_gui.SwitchToMapVersion(*newMapTab->GetMap());
+		// Once its version is loaded, the items are decoded through it
+		newMapTab->GetEditor()->markActive();
 		g_gui.RefreshPalettes(newMapTab->GetMap());
 		g_gui.UpdateMenus();
 	}
@@ -22,6 +22,33 @@
 #include <stdio.h>
 #include <assert.h>
 
+#ifdef _WIN32
+#	include <wx/msw/wrapwin.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+bool fileSeek(FILE* file, int64_t offset, int origin)
+{
+#ifdef _WIN32
+	return _fseeki64(file, offset, origin) == 0;
+#else
+	return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+}
+
+int64_t fileTell(FILE* file)
+{
+#ifdef _WIN32
+	return _ftelli64(file);
+#else
+	return ftello(file);
+#endif
+}
+
 uint8_t NodeFileWriteHandle::NODE_START = ::NODE_START;
 uint8_t NodeFileWriteHandle::NODE_END = ::NODE_END;
 uint8_t NodeFileWriteHandle::ESCAPE_CHAR = ::ESCAPE_CHAR;
@@ -29,7 +56,7 @@ uint8_t NodeFileWriteHandle::ESCAPE_CHAR = ::ESCAPE_CHAR;
 bool FileHandle::seek(size_t offset, int origin)
 {
 	if(file) {
-		return fseek(file, static_cast<long>(offset), origin) == 0;
+		return fileSeek(file, static_cast<int64_t>(offset), origin);
 	}
 	return false;
 }
@@ -37,7 +64,8 @@ bool FileHandle::seek(size_t offset, int origin)
 size_t FileHandle::tell()
 {
 	if(file) {
-		return ftell(file);
+		int64_t position = fileTell(file);
+		return position < 0 ? 0 : static_cast<size_t>(position);
 	}
 	return 0;
 }
@@ -84,9 +112,9 @@ FileReadHandle::FileReadHandle(const std::string& name) : file_size(0)
 	if(!file || ferror(file)) {
 		error_code = FILE_COULD_NOT_OPEN;
 	} else {
-		fseek(file, 0, SEEK_END);
-		file_size = ftell(file);
-		fseek(file, 0, SEEK_SET);
+		fileSeek(file, 0, SEEK_END);
+		file_size = static_cast<size_t>(fileTell(file));
+		fileSeek(file, 0, SEEK_SET);
 	}
 }
 
@@ -142,11 +170,66 @@ bool FileReadHandle::getLongString(std::string& str)
 	return getRAW(str, sz);
 }
 
+//=============================================================================
+// Memory read handle
+
+MemoryReadHandle::MemoryReadHandle(const std::string& name) :
+	error_code(FILE_NO_ERROR),
+	position(0)
+{
+	FileReadHandle file(name);
+	if(!file.isOk()) {
+		error_code = file.error_code != FILE_NO_ERROR ? file.error_code : FILE_COULD_NOT_OPEN;
+		return;
+	}
+	data.resize(file.size());
+	if(!data.empty() && !file.getRAW(data.data(), data.size())) {
+		data.clear();
+		error_code = FILE_READ_ERROR;
+	}
+}
+
+bool MemoryReadHandle::getRAW(uint8_t* ptr, size_t sz)
+{
+	if(sz > data.size() - position) {
+		position = data.size();
+		error_code = FILE_PREMATURE_END;
+		return false;
+	}
+	memcpy(ptr, data.data() + position, sz);
+	position += sz;
+	return true;
+}
+
+bool MemoryReadHandle::getString(std::string& str)
+{
+	uint16_t sz;
+	if(!getU16(sz) || sz > data.size() - position) {
+		position = data.size();
+		error_code = FILE_PREMATURE_END;
+		return false;
+	}
+	str.assign(reinterpret_cast<const char*>(data.data()) + position, sz);
+	position += sz;
+	return true;
+}
+
+std::string MemoryReadHandle::getErrorMessage() const
+{
+	switch(error_code) {
+		case FILE_COULD_NOT_OPEN: return "Could not open file";
+		case FILE_READ_ERROR: return "Failed to read from file";
+		case FILE_PREMATURE_END: return "File end encountered unexpectedly";
+		default: return "No error";
+	}
+}
+
 //=============================================================================
 // Node file read handle
 
 NodeFileReadHandle::NodeFileReadHandle() :
 	last_was_start(false),
+	stable_cache(false),
 	cache(nullptr),
 	cache_size(32768),
 	cache_length(0),
@@ -184,11 +267,111 @@ void NodeFileReadHandle::freeNode(BinaryNode* node)
 	}
 }
 
+// Offset of the first node marker or escape at or after offset, length if there is none.
+// Eight bytes are tested at a time: a byte is one of them when its complement is below 3.
+static size_t findNodeMarker(const uint8_t* data, size_t offset, size_t length)
+{
+	constexpr uint64_t ones = 0x0101010101010101ULL;
+	constexpr uint64_t highs = 0x8080808080808080ULL;
+	while(offset + 8 <= length) {
+		uint64_t word;
+		memcpy(&word, data + offset, sizeof(word));
+		const uint64_t inverted = ~word;
+		if(((inverted - ones * 3) & ~inverted & highs) != 0) {
+			break;
+		}
+		offset += 8;
+	}
+	while(offset < length && data[offset] < ESCAPE_CHAR) {
+		++offset;
+	}
+	return offset;
+}
+
+bool NodeFileReadHandle::buildNodeIndex()
+{
+	node_index.clear();
+	if(!stable_cache || cache_length > MaxIndexedSize || local_read_index >= cache_length || cache[local_read_index] != NODE_START) {
+		return false;
+	}
+
+	// The nodes that are open, and the last child seen of each
+	std::vector<uint32_t> open;
+	std::vector<uint32_t> last_child;
+	size_t offset = local_read_index;
+	while(true) {
+		offset = findNodeMarker(cache, offset, cache_length);
+		if(offset >= cache_length) {
+			node_index.clear();
+			return false;
+		}
+
+		const uint8_t op = cache[offset];
+		if(op == ESCAPE_CHAR) {
+			node_index[open.back()].escaped = true;
+			offset += 2;
+			continue;
+		}
+
+		if(op == NODE_START) {
+			const uint32_t index = static_cast<uint32_t>(node_index.size());
+			if(!open.empty()) {
+				if(last_child.back() != 0) {
+					node_index[last_child.back()].next = index;
+				}
+				last_child.back() = index;
+			}
+			node_index.push_back(NodeSpan { static_cast<uint32_t>(offset + 1), 0, 0, false });
+			open.push_back(index);
+			last_child.push_back(0);
+			++offset;
+			continue;
+		}
+
+		node_index[open.back()].close = static_cast<uint32_t>(offset);
+		open.pop_back();
+		last_child.pop_back();
+		if(open.empty()) {
+			// Anything after the root is not read
+			return true;
+		}
+
+		// Siblings follow each other directly, anything else is left to the reader to report
+		++offset;
+		if(offset >= cache_length || (cache[offset] != NODE_START && cache[offset] != NODE_END)) {
+			node_index.clear();
+			return false;
+		}
+	}
+}
+
+bool NodeFileReadHandle::skipNodes(int depth)
+{
+	ASSERT(stable_cache);
+	while(depth > 0) {
+		local_read_index = findNodeMarker(cache, local_read_index, cache_length);
+		if(local_read_index >= cache_length) {
+			return false;
+		}
+
+		const uint8_t op = cache[local_read_index];
+		if(op == ESCAPE_CHAR) {
+			local_read_index += 2;
+			continue;
+		}
+		depth += op == NODE_START ? 1 : -1;
+		++local_read_index;
+	}
+	local_read_index = std::min(local_read_index, cache_length);
+	return true;
+}
+
 //=============================================================================
 // Memory based node file read handle
 
 MemoryNodeFileReadHandle::MemoryNodeFileReadHandle(const uint8_t* data, size_t size)
 {
+	stable_cache = true;
 	assign(data, size);
 }
 
@@ -196,6 +379,7 @@ void MemoryNodeFileReadHandle::assign(const uint8_t* data, size_t size)
 {
 	freeNode(root_node);
 	root_node = nullptr;
+	node_index.clear();
 	// Highly volatile, but we know we're not gonna modify
 	cache = const_cast<uint8_t*>(data);
 	cache_size = cache_length = size;
@@ -221,6 +405,7 @@ BinaryNode* MemoryNodeFileReadHandle::getRootNode()
 {
 	assert(root_node == nullptr); // You should never do this twice
 
+	buildNodeIndex();
 	local_read_index++; // Skip first NODE_START
 	last_was_start = true;
 	root_node = getNode(nullptr);
@@ -267,9 +452,9 @@ DiskNodeFileReadHandle::DiskNodeFileReadHandle(const std::string& name, const st
 			}
 		}
 
-		fseek(file, 0, SEEK_END);
-		file_size = ftell(file);
-		fseek(file, 4, SEEK_SET);
+		fileSeek(file, 0, SEEK_END);
+		file_size = static_cast<size_t>(fileTell(file));
+		fileSeek(file, 4, SEEK_SET);
 	}
 }
 
@@ -315,14 +500,161 @@ BinaryNode* DiskNodeFileReadHandle::getRootNode()
 	}
 }
 
+//=============================================================================
+// Memory mapped node file read handle
+
+MappedNodeFileReadHandle::MappedNodeFileReadHandle(const std::string& name, const std::vector<std::string>& acceptable_identifiers) :
+	mapping(nullptr),
+	file_size(0)
+#ifdef _WIN32
+	, file_handle(INVALID_HANDLE_VALUE),
+	mapping_handle(nullptr)
+#endif
+{
+	stable_cache = true;
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileW(string2wstring(name).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(handle == INVALID_HANDLE_VALUE) {
+		error_code = FILE_COULD_NOT_OPEN;
+		return;
+	}
+	file_handle = handle;
+
+	LARGE_INTEGER length;
+	if(!GetFileSizeEx(handle, &length) || length.QuadPart < 4) {
+		error_code = FILE_SYNTAX_ERROR;
+		close();
+		return;
+	}
+	file_size = static_cast<size_t>(length.QuadPart);
+
+	mapping_handle = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mapping_handle) {
+		mapping = static_cast<uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	int fd = open(name.c_str(), O_RDONLY);
+	if(fd < 0) {
+		error_code = FILE_COULD_NOT_OPEN;
+		return;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < 4) {
+		::close(fd);
+		error_code = FILE_SYNTAX_ERROR;
+		return;
+	}
+	file_size = static_cast<size_t>(st.st_size);
+
+	void* ptr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive
+	::close(fd);
+	if(ptr != MAP_FAILED) {
+		mapping = static_cast<uint8_t*>(ptr);
+		madvise(ptr, file_size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if(!mapping) {
+		error_code = FILE_COULD_NOT_OPEN;
+		close();
+		return;
+	}
+
+	// 0x00 00 00 00 is accepted as a wildcard version
+	const char* ver = reinterpret_cast<const char*>(mapping);
+	if(ver[0] != 0 || ver[1] != 0 || ver[2] != 0 || ver[3] != 0) {
+		bool accepted = false;
+		for(const std::string& identifier : acceptable_identifiers) {
+			if(memcmp(ver, identifier.c_str(), 4) == 0) {
+				accepted = true;
+				break;
+			}
+		}
+
+		if(!accepted) {
+			close();
+			error_code = FILE_SYNTAX_ERROR;
+			return;
+		}
+	}
+
+	cache = mapping;
+	cache_size = cache_length = file_size;
+	local_read_index = 4;
+}
+
+MappedNodeFileReadHandle::~MappedNodeFileReadHandle()
+{
+	close();
+}
+
+void MappedNodeFileReadHandle::close()
+{
+	freeNode(root_node);
+	root_node = nullptr;
+
+	if(mapping) {
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+#else
+		munmap(mapping, file_size);
+#endif
+		mapping = nullptr;
+	}
+#ifdef _WIN32
+	if(mapping_handle) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+	if(file_handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(file_handle);
+		file_handle = INVALID_HANDLE_VALUE;
+	}
+#endif
+
+	cache = nullptr;
+	cache_size = cache_length = 0;
+	local_read_index = 0;
+	file_size = 0;
+}
+
+bool MappedNodeFileReadHandle::renewCache()
+{
+	// Everything is already in memory
+	return false;
+}
+
+BinaryNode* MappedNodeFileReadHandle::getRootNode()
+{
+	assert(root_node == nullptr); // You should never do this twice
+	if(local_read_index >= cache_length || cache[local_read_index] != NODE_START) {
+		error_code = FILE_SYNTAX_ERROR;
+		return nullptr;
+	}
+
+	buildNodeIndex();
+	++local_read_index;
+	last_was_start = true;
+	root_node = getNode(nullptr);
+	root_node->load();
+	return root_node;
+}
+
 //=============================================================================
 // Binary file node
 
 BinaryNode::BinaryNode(NodeFileReadHandle* file, BinaryNode* parent) :
+	payload(nullptr),
+	payload_size(0),
 	read_offset(0),
 	file(file),
 	parent(parent),
-	child(nullptr)
+	child(nullptr),
+	index(0),
+	children_read(false)
 {
 	////
 }
@@ -337,6 +669,17 @@ BinaryNode* BinaryNode::getChild()
 	ASSERT(file);
 	ASSERT(child == nullptr);
 
+	if(file->hasNodeIndex()) {
+		if(children_read || !file->hasIndexedChildren(index)) {
+			return nullptr;
+		}
+		children_read = true;
+		child = file->getNode(this);
+		child->index = index + 1;
+		child->load();
+		return child;
+	}
+
 	if(file->last_was_start) {
 		child = file->getNode(this);
 		child->load();
@@ -347,22 +690,22 @@ BinaryNode* BinaryNode::getChild()
 
 bool BinaryNode::getRAW(uint8_t* ptr, size_t sz)
 {
-	if(read_offset + sz > data.size()) {
-		read_offset = data.size();
+	if(read_offset + sz > payload_size) {
+		read_offset = payload_size;
 		return false;
 	}
-	memcpy(ptr, data.data() + read_offset, sz);
+	memcpy(ptr, payload + read_offset, sz);
 	read_offset += sz;
 	return true;
 }
 
 bool BinaryNode::getRAW(std::string& str, size_t sz)
 {
-	if(read_offset + sz > data.size()) {
-		read_offset = data.size();
+	if(read_offset + sz > payload_size) {
+		read_offset = payload_size;
 		return false;
 	}
-	str.assign(data.data() + read_offset, sz);
+	str.assign(reinterpret_cast<const char*>(payload) + read_offset, sz);
 	read_offset += sz;
 	return true;
 }
@@ -393,6 +736,43 @@ BinaryNode* BinaryNode::advance()
 	if(file->error_code != FILE_NO_ERROR)
 		return nullptr;
 
+	if(file->hasNodeIndex()) {
+		file->freeNode(child);
+		child = nullptr;
+
+		const uint32_t next = file->node_index[index].next;
+		if(next != 0) {
+			index = next;
+			read_offset = 0;
+			load();
+			return this;
+		}
+		file->local_read_index = file->node_index[index].close + 1;
+		// The root belongs to the file
+		if(parent) {
+			parent->child = nullptr;
+			file->freeNode(this);
+		}
+		return nullptr;
+	}
+
+	if(file->stable_cache) {
+		// Skip what is left of our children without making nodes for them. Every node
+		// down the chain of children is open, the deepest one unless its end was read
+		int depth = 1;
+		for(BinaryNode* node = child; node; node = node->child) {
+			++depth;
+		}
+		depth += file->last_was_start ? 1 : -1;
+		file->freeNode(child);
+		child = nullptr;
+		if(!file->skipNodes(depth)) {
+			file->error_code = FILE_PREMATURE_END;
+			return nullptr;
+		}
+		file->last_was_start = false;
+	}
+
 	if(child == nullptr) {
 		getChild();
 	}
@@ -445,6 +825,93 @@ BinaryNode* BinaryNode::advance()
 	}
 }
 
+bool BinaryNode::extractChildren(std::vector<uint8_t>& buffer)
+{
+	ASSERT(file);
+	ASSERT(child == nullptr);
+
+	// Dummy root node, the type byte is never looked at
+	buffer.clear();
+	buffer.push_back(NODE_START);
+	buffer.push_back(0);
+
+	if(file->hasNodeIndex()) {
+		const NodeFileReadHandle::NodeSpan& span = file->node_index[index];
+		if(!children_read && file->hasIndexedChildren(index)) {
+			// From the start of the first child up to our end marker
+			const uint8_t* begin = file->cache + file->node_index[index + 1].begin - 1;
+			const uint8_t* end = file->cache + span.close + 1;
+			buffer.insert(buffer.end(), begin, end);
+		} else {
+			buffer.push_back(NODE_END);
+		}
+		children_read = true;
+		file->local_read_index = span.close + 1;
+		file->last_was_start = false;
+		return true;
+	}
+
+	if(!file->last_was_start) {
+		// No children, just terminate the root
+		buffer.push_back(NODE_END);
+		return true;
+	}
+
+	// The start of the first child has already been consumed by load()
+	buffer.push_back(NODE_START);
+
+	if(file->stable_cache) {
+		// Through the end of the first child and then our own
+		const size_t begin = file->local_read_index;
+		if(!file->skipNodes(2)) {
+			file->error_code = FILE_PREMATURE_END;
+			return false;
+		}
+		buffer.insert(buffer.end(), file->cache + begin, file->cache + file->local_read_index);
+		file->last_was_start = false;
+		return true;
+	}
+
+	uint8_t*& cache = file->cache;
+	size_t& cache_length = file->cache_length;
+	size_t& local_read_index = file->local_read_index;
+
+	int depth = 1;
+	while(true) {
+		if(local_read_index >= cache_length) {
+			if(!file->renewCache()) {
+				file->error_code = FILE_PREMATURE_END;
+				return false;
+			}
+		}
+
+		uint8_t op = cache[local_read_index];
+		++local_read_index;
+		buffer.push_back(op);
+
+		if(op == ESCAPE_CHAR) {
+			if(local_read_index >= cache_length) {
+				if(!file->renewCache()) {
+					file->error_code = FILE_PREMATURE_END;
+					return false;
+				}
+			}
+			buffer.push_back(cache[local_read_index]);
+			++local_read_index;
+		} else if(op == NODE_START) {
+			++depth;
+		} else if(op == NODE_END) {
+			// Going below zero means this was the end of ourselves
+			if(--depth < 0) {
+				break;
+			}
+		}
+	}
+
+	file->last_was_start = false;
+	return true;
+}
+
 void BinaryNode::load()
 {
 	ASSERT(file);
@@ -452,12 +919,74 @@ void BinaryNode::load()
 	uint8_t*& cache = file->cache;
 	size_t& cache_length = file->cache_length;
 	size_t& local_read_index = file->local_read_index;
-	while(true) {
+
+	data.clear();
+	children_read = false;
+	if(file->hasNodeIndex()) {
+		// The payload ends where the first child starts, or at our end marker
+		const NodeFileReadHandle::NodeSpan& span = file->node_index[index];
+		const bool has_children = file->hasIndexedChildren(index);
+		const size_t end = has_children ? file->node_index[index + 1].begin - 1 : span.close;
+		file->last_was_start = has_children;
+		local_read_index = end + 1;
+		if(span.escaped) {
+			unescape(span.begin, end);
+			payload = reinterpret_cast<const uint8_t*>(data.data());
+			payload_size = data.size();
+		} else {
+			payload = cache + span.begin;
+			payload_size = end - span.begin;
+		}
+		return;
+	}
+
+	if(file->stable_cache) {
+		// Look for the end of the node, if we don't hit an escape on the way
+		// the node can use the cache as is.
+		const size_t begin = local_read_index;
+		const size_t end = findNodeMarker(cache, begin, cache_length);
+		if(end == cache_length) {
+			file->error_code = FILE_PREMATURE_END;
+			payload = cache + begin;
+			payload_size = end - begin;
+			local_read_index = cache_length;
+			return;
+		}
+
+		if(cache[end] != ESCAPE_CHAR) {
+			file->last_was_start = (cache[end] == NODE_START);
+			payload = cache + begin;
+			payload_size = end - begin;
+			local_read_index = end + 1;
+			return;
+		}
+
+		// Escaped data, unescape up to the next marker
+		size_t marker = end;
+		while(marker < cache_length && cache[marker] == ESCAPE_CHAR) {
+			marker = findNodeMarker(cache, marker + 2, cache_length);
+		}
+		if(marker >= cache_length) {
+			file->error_code = FILE_PREMATURE_END;
+			unescape(begin, cache_length);
+			local_read_index = cache_length;
+		} else {
+			file->last_was_start = (cache[marker] == NODE_START);
+			unescape(begin, marker);
+			local_read_index = marker + 1;
+		}
+		payload = reinterpret_cast<const uint8_t*>(data.data());
+		payload_size = data.size();
+		return;
+	}
+
+	bool done = false;
+	while(!done) {
 		if(local_read_index >= cache_length) {
 			if(!file->renewCache()) {
 				// Failed to renew, exit
 				file->error_code = FILE_PREMATURE_END;
-				return;
+				break;
 			}
 		}
 
@@ -467,12 +996,14 @@ void BinaryNode::load()
 		switch(op) {
 			case NODE_START: {
 				file->last_was_start = true;
-				return;
+				done = true;
+				continue;
 			}
 
 			case NODE_END: {
 				file->last_was_start = false;
-				return;
+				done = true;
+				continue;
 			}
 
 			case ESCAPE_CHAR: {
@@ -480,7 +1011,8 @@ void BinaryNode::load()
 					if(!file->renewCache()) {
 						// Failed to renew, exit
 						file->error_code = FILE_PREMATURE_END;
-						return;
+						done = true;
+						continue;
 					}
 				}
 
@@ -492,9 +1024,27 @@ void BinaryNode::load()
 			default:
 				break;
 		}
-		//std::cout << "Appending..." << std::endl;
 		data.append(1, op);
 	}
+
+	payload = reinterpret_cast<const uint8_t*>(data.data());
+	payload_size = data.size();
+}
+
+void BinaryNode::unescape(size_t begin, size_t end)
+{
+	const uint8_t* cache = file->cache;
+	data.clear();
+	data.reserve(end - begin);
+	while(begin < end) {
+		const size_t escape = findNodeMarker(cache, begin, end);
+		data.append(reinterpret_cast<const char*>(cache) + begin, escape - begin);
+		if(escape + 1 >= end) {
+			break;
+		}
+		data.push_back(static_cast<char>(cache[escape + 1]));
+		begin = escape + 2;
+	}
 }
 
 //=============================================================================
@@ -569,7 +1119,10 @@ void FileWriteHandle::flush()
 //=============================================================================
 // Disk based node file write handle
 
-DiskNodeFileWriteHandle::DiskNodeFileWriteHandle(const std::string& name, const std::string& identifier)
+DiskNodeFileWriteHandle::DiskNodeFileWriteHandle(const std::string& name, const std::string& identifier, bool async) :
+	async(async),
+	write_failed(false),
+	stopping(false)
 {
 #if defined __VISUALC__ && defined _UNICODE
 	file = _wfopen(string2wstring(name).c_str(), L"wb");
@@ -586,6 +1139,12 @@ DiskNodeFileWriteHandle::DiskNodeFileWriteHandle(const std::string& name, const
 	}
 
 	fwrite(identifier.c_str(), 1, 4, file);
+	flushed = 4;
+	if(async) {
+		// Larger buffers, there is no point in waking the writer for every 32kb
+		cache_size = 0x100000;
+		startWriter();
+	}
 	if(!cache) {
 		cache = (uint8_t*)malloc(cache_size+1);
 	}
@@ -600,26 +1159,106 @@ DiskNodeFileWriteHandle::~DiskNodeFileWriteHandle()
 void DiskNodeFileWriteHandle::close()
 {
 	if(file) {
+		flushPending();
 		renewCache();
+		stopWriter();
 		fclose(file);
 		file = nullptr;
-		error_code = FILE_NO_ERROR;
+		if(write_failed) {
+			error_code = FILE_WRITE_ERROR;
+		}
 	}
 }
 
 void DiskNodeFileWriteHandle::renewCache()
 {
-	if(cache) {
+	if(!cache) {
+		cache = (uint8_t*)malloc(cache_size+1);
+		local_write_index = 0;
+		return;
+	}
+
+	flushed += local_write_index;
+	if(!writer.joinable()) {
 		fwrite(cache, local_write_index, 1, file);
 		if(ferror(file) != 0) {
 			error_code = FILE_WRITE_ERROR;
 		}
-	} else {
-		cache = (uint8_t*)malloc(cache_size+1);
+		local_write_index = 0;
+		return;
 	}
+
+	if(write_failed) {
+		error_code = FILE_WRITE_ERROR;
+	}
+
+	uint8_t* next = nullptr;
+	{
+		// Keep a bounded amount of data in flight
+		std::unique_lock<std::mutex> lock(writer_mutex);
+		writer_signal.wait(lock, [this]() { return pending.size() < 8; });
+		pending.push_back({cache, local_write_index});
+		if(!spare.empty()) {
+			next = spare.back();
+			spare.pop_back();
+		}
+	}
+	writer_signal.notify_all();
+
+	cache = next ? next : (uint8_t*)malloc(cache_size+1);
 	local_write_index = 0;
 }
 
+void DiskNodeFileWriteHandle::startWriter()
+{
+	stopping = false;
+	writer = std::thread([this]() { writerLoop(); });
+}
+
+void DiskNodeFileWriteHandle::stopWriter()
+{
+	if(!writer.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		stopping = true;
+	}
+	writer_signal.notify_all();
+	writer.join();
+
+	for(uint8_t* buffer : spare) {
+		free(buffer);
+	}
+	spare.clear();
+}
+
+void DiskNodeFileWriteHandle::writerLoop()
+{
+	while(true) {
+		Buffer buffer;
+		{
+			std::unique_lock<std::mutex> lock(writer_mutex);
+			writer_signal.wait(lock, [this]() { return stopping || !pending.empty(); });
+			if(pending.empty()) {
+				// Stopping and everything has been written
+				return;
+			}
+			buffer = pending.front();
+			pending.pop_front();
+		}
+		writer_signal.notify_all();
+
+		if(buffer.size > 0 && fwrite(buffer.data, buffer.size, 1, file) != 1) {
+			write_failed = true;
+		}
+
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		spare.push_back(buffer.data);
+	}
+}
+
 //=============================================================================
 // Memory based node file write handle
 
@@ -640,21 +1279,25 @@ void MemoryNodeFileWriteHandle::reset()
 {
 	memset(cache, 0xAA, cache_size);
 	local_write_index = 0;
+	pending.clear();
 }
 
 void MemoryNodeFileWriteHandle::close()
 {
 	free(cache);
 	cache = nullptr;
+	pending.clear();
 }
 
 uint8_t* MemoryNodeFileWriteHandle::getMemory()
 {
+	flushPending();
 	return cache;
 }
 
 size_t MemoryNodeFileWriteHandle::getSize()
 {
+	flushPending();
 	return local_write_index;
 }
 
@@ -677,7 +1320,8 @@ void MemoryNodeFileWriteHandle::renewCache()
 NodeFileWriteHandle::NodeFileWriteHandle() :
 	cache(nullptr),
 	cache_size(0x7FFF),
-	local_write_index(0)
+	local_write_index(0),
+	flushed(0)
 {
 	////
 }
@@ -689,6 +1333,7 @@ NodeFileWriteHandle::~NodeFileWriteHandle()
 
 bool NodeFileWriteHandle::addNode(uint8_t nodetype)
 {
+	flushPending();
 	cache[local_write_index++] = NODE_START;
 	if(local_write_index >= cache_size) {
 		renewCache();
@@ -704,6 +1349,7 @@ bool NodeFileWriteHandle::addNode(uint8_t nodetype)
 
 bool NodeFileWriteHandle::endNode()
 {
+	flushPending();
 	cache[local_write_index++] = NODE_END;
 	if(local_write_index >= cache_size) {
 		renewCache();
@@ -771,3 +1417,48 @@ bool NodeFileWriteHandle::addRAW(const uint8_t* ptr, size_t sz)
 	writeBytes(ptr, sz);
 	return error_code == FILE_NO_ERROR;
 }
+
+bool NodeFileWriteHandle::addEncoded(const uint8_t* ptr, size_t sz)
+{
+	flushPending();
+	writeEncoded(ptr, sz);
+	return error_code == FILE_NO_ERROR;
+}
+
+void NodeFileWriteHandle::flushPending()
+{
+	if(!pending.empty()) {
+		writeEscaped(pending.data(), pending.size());
+		pending.clear();
+	}
+}
+
+void NodeFileWriteHandle::writeEscaped(const uint8_t* ptr, size_t sz)
+{
+	size_t offset = 0;
+	while(offset < sz) {
+		const size_t special = findNodeMarker(ptr, offset, sz);
+		writeEncoded(ptr + offset, special - offset);
+		if(special == sz) {
+			break;
+		}
+
+		const uint8_t escaped[2] = { ESCAPE_CHAR, ptr[special] };
+		writeEncoded(escaped, sizeof(escaped));
+		offset = special + 1;
+	}
+}
+
+void NodeFileWriteHandle::writeEncoded(const uint8_t* ptr, size_t sz)
+{
+	while(sz > 0) {
+		size_t count = std::min(sz, cache_size - local_write_index);
+		memcpy(cache + local_write_index, ptr, count);
+		local_write_index += count;
+		ptr += count;
+		sz -= count;
+		if(local_write_index >= cache_size) {
+			renewCache();
+		}
+	}
+}
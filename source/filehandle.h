@@ -22,7 +22,14 @@
 
 #include <stdexcept>
 #include <string>
+#include <cstring>
 #include <stack>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <stdio.h>
 
 #ifndef FORCEINLINE
@@ -33,6 +40,10 @@
 #   endif
 #endif
 
+// fseek/ftell with 64-bit offsets, long is only 32 bits on Windows.
+bool fileSeek(FILE* file, int64_t offset, int origin);
+int64_t fileTell(FILE* file);
+
 enum FileHandleError {
 	FILE_NO_ERROR,
 	FILE_COULD_NOT_OPEN,
@@ -86,6 +97,7 @@ public:
 	FORCEINLINE bool getU16(uint16_t& u16) { return getType(u16); }
 	FORCEINLINE bool getU32(uint32_t& u32) { return getType(u32); }
 	FORCEINLINE bool get32(int32_t& i32) { return getType(i32); }
+	FORCEINLINE bool getU64(uint64_t& u64) { return getType(u64); }
 	bool getRAW(uint8_t* ptr, size_t sz);
 	bool getRAW(std::string& str, size_t sz);
 	bool getString(std::string& str);
@@ -104,6 +116,62 @@ protected:
 	}
 };
 
+// A whole file read into memory at once, decoded with the getters of FileReadHandle
+// without a call into stdio per value. Reads are checked against the size, one going
+// past the end fails, leaves its value untouched and sets FILE_PREMATURE_END.
+class MemoryReadHandle
+{
+public:
+	explicit MemoryReadHandle(const std::string& name);
+
+	MemoryReadHandle(const MemoryReadHandle&) = delete;
+	MemoryReadHandle& operator=(const MemoryReadHandle&) = delete;
+
+	FORCEINLINE bool getU8(uint8_t& u8) { return getType(u8); }
+	FORCEINLINE bool getByte(uint8_t& u8) { return getType(u8); }
+	FORCEINLINE bool getSByte(int8_t& i8) { return getType(i8); }
+	FORCEINLINE bool getU16(uint16_t& u16) { return getType(u16); }
+	FORCEINLINE bool getU32(uint32_t& u32) { return getType(u32); }
+	FORCEINLINE bool get32(int32_t& i32) { return getType(i32); }
+	FORCEINLINE bool getU64(uint64_t& u64) { return getType(u64); }
+	bool getRAW(uint8_t* ptr, size_t sz);
+	bool getString(std::string& str);
+	FORCEINLINE bool skip(size_t sz) {
+		if(sz > data.size() - position) {
+			position = data.size();
+			error_code = FILE_PREMATURE_END;
+			return false;
+		}
+		position += sz;
+		return true;
+	}
+
+	size_t size() const noexcept { return data.size(); }
+	size_t tell() const noexcept { return position; }
+	// The whole file, for parts that are handed on without being copied
+	const uint8_t* getData() const noexcept { return data.data(); }
+	bool isOk() const noexcept { return error_code == FILE_NO_ERROR; }
+	std::string getErrorMessage() const;
+
+	FileHandleError error_code;
+
+protected:
+	template<class T>
+	bool getType(T& ref) {
+		if(sizeof(ref) > data.size() - position) {
+			position = data.size();
+			error_code = FILE_PREMATURE_END;
+			return false;
+		}
+		memcpy(&ref, data.data() + position, sizeof(ref));
+		position += sizeof(ref);
+		return true;
+	}
+
+	std::vector<uint8_t> data;
+	size_t position;
+};
+
 class NodeFileReadHandle;
 class DiskNodeFileReadHandle;
 class MemoryNodeFileReadHandle;
@@ -120,8 +188,8 @@ public:
 	FORCEINLINE bool getU32(uint32_t& u32) { return getType(u32); }
 	FORCEINLINE bool getU64(uint64_t& u64) { return getType(u64); }
 	FORCEINLINE bool skip(size_t sz) {
-		if(read_offset + sz > data.size()) {
-			read_offset = data.size();
+		if(read_offset + sz > payload_size) {
+			read_offset = payload_size;
 			return false;
 		}
 		read_offset += sz;
@@ -135,28 +203,42 @@ public:
 	BinaryNode* getChild();
 	// Returns this on success, nullptr on failure
 	BinaryNode* advance();
+	// Copies the (still escaped) child nodes into a standalone buffer and skips past
+	// them in the file. The buffer holds a root node with the children attached, and
+	// can be read back through a MemoryNodeFileReadHandle, on any thread.
+	bool extractChildren(std::vector<uint8_t>& buffer);
 protected:
 	template<class T>
 	bool getType(T& ref) {
-		if(read_offset + sizeof(ref) > data.size()) {
-			read_offset = data.size();
+		if(read_offset + sizeof(ref) > payload_size) {
+			read_offset = payload_size;
 			return false;
 		}
-		ref = *(T*)(data.data()+read_offset);
+		memcpy(&ref, payload + read_offset, sizeof(ref));
 
 		read_offset += sizeof(ref);
 		return true;
 	}
 
 	void load();
+	// Copies the payload bytes between begin and end of the cache into data, without the escapes
+	void unescape(size_t begin, size_t end);
+	// Points straight into the file cache when the node holds no escaped bytes
+	// and the cache is stable, otherwise into the unescaped copy in data.
+	const uint8_t* payload;
+	size_t payload_size;
 	std::string data;
 	size_t read_offset;
 	NodeFileReadHandle* file;
 	BinaryNode* parent;
 	BinaryNode* child;
+	// Position in the node index of the file, when it has one
+	uint32_t index;
+	bool children_read;
 
 	friend class DiskNodeFileReadHandle;
 	friend class MemoryNodeFileReadHandle;
+	friend class MappedNodeFileReadHandle;
 };
 
 class NodeFileReadHandle : public FileHandle
@@ -175,7 +257,31 @@ protected:
 	// Returns false when end-of-file is reached
 	virtual bool renewCache() = 0;
 
+	// Where a node lies in a stable cache, found by buildNodeIndex with one scan over
+	// the file. Nodes are listed in file order, so the first child follows its parent.
+	struct NodeSpan {
+		uint32_t begin; // First payload byte, the node type
+		uint32_t close; // The end marker of the node
+		uint32_t next; // The next sibling, 0 for none
+		bool escaped;
+	};
+	// Larger files, such as big maps, are read by scanning instead, an index costs
+	// about three times the file. Their tile areas are indexed once extracted.
+	static constexpr size_t MaxIndexedSize = 16 << 20;
+	// Called before the root node is read, keeps the index empty if the nodes are malformed
+	bool buildNodeIndex();
+	bool hasNodeIndex() const noexcept { return !node_index.empty(); }
+	bool hasIndexedChildren(uint32_t index) const noexcept {
+		return index + 1 < node_index.size() && node_index[index + 1].begin < node_index[index].close;
+	}
+	// Moves past the end markers of depth open nodes in a stable cache
+	bool skipNodes(int depth);
+	std::vector<NodeSpan> node_index;
+
 	bool last_was_start;
+	// The whole file is in the cache and it doesn't move while reading,
+	// nodes can reference it directly instead of copying their data.
+	bool stable_cache;
 	uint8_t* cache;
 	size_t cache_size;
 	size_t cache_length;
@@ -198,7 +304,7 @@ public:
 	virtual BinaryNode* getRootNode();
 
 	virtual size_t size() { return file_size; }
-	virtual size_t tell() {if(file) return ftell(file); return 0; }
+	virtual size_t tell() {if(file) return static_cast<size_t>(fileTell(file)); return 0; }
 protected:
 	virtual bool renewCache();
 
@@ -226,6 +332,32 @@ protected:
 	uint8_t* index;
 };
 
+// Maps the whole file into memory, nodes without escaped bytes are never copied.
+class MappedNodeFileReadHandle : public NodeFileReadHandle
+{
+public:
+	MappedNodeFileReadHandle(const std::string& name, const std::vector<std::string>& acceptable_identifiers);
+	virtual ~MappedNodeFileReadHandle();
+
+	virtual void close();
+	virtual BinaryNode* getRootNode();
+
+	virtual bool isOpen() { return mapping != nullptr; }
+	virtual bool isOk() { return isOpen() && error_code == FILE_NO_ERROR; }
+
+	virtual size_t size() { return file_size; }
+	virtual size_t tell() { return local_read_index; }
+protected:
+	virtual bool renewCache();
+
+	uint8_t* mapping;
+	size_t file_size;
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#endif
+};
+
 class FileWriteHandle : public FileHandle
 {
 public:
@@ -272,6 +404,14 @@ public:
 	bool addRAW(std::string& str);
 	bool addRAW(const uint8_t* ptr, size_t sz);
 	bool addRAW(const char* c) { return addRAW(reinterpret_cast<const uint8_t*>(c), strlen(c)); }
+	// Appends data that is already node encoded (escaped), eg. the contents of a MemoryNodeFileWriteHandle
+	bool addEncoded(const uint8_t* ptr, size_t sz);
+
+	// Position of the next byte written, counted from the start of the output
+	size_t getOffset() {
+		flushPending();
+		return flushed + local_write_index;
+	}
 
 protected:
 	virtual void renewCache() = 0;
@@ -283,37 +423,51 @@ protected:
 	uint8_t* cache;
 	size_t cache_size;
 	size_t local_write_index;
+	size_t flushed;
+
+	// The payload written since the last node marker, it is escaped into the cache in one
+	// pass once a marker, encoded data or the end of the output follows
+	std::vector<uint8_t> pending;
 
 	FORCEINLINE void writeBytes(const uint8_t* ptr, size_t sz) {
-		if(sz) {
-			do {
-				if(*ptr == NODE_START || *ptr == NODE_END || *ptr == ESCAPE_CHAR) {
-					cache[local_write_index++] = ESCAPE_CHAR;
-					if(local_write_index >= cache_size) {
-						renewCache();
-					}
-				}
-				cache[local_write_index++] = *ptr;
-				if(local_write_index >= cache_size) {
-					renewCache();
-				}
-				++ptr;
-				--sz;
-			} while(sz != 0);
-		}
+		pending.insert(pending.end(), ptr, ptr + sz);
 	}
+	void flushPending();
+	// Runs of bytes that need no escape are copied into the cache at once
+	void writeEscaped(const uint8_t* ptr, size_t sz);
+	void writeEncoded(const uint8_t* ptr, size_t sz);
 };
 
 class DiskNodeFileWriteHandle : public NodeFileWriteHandle
 {
 public:
-	DiskNodeFileWriteHandle(const std::string& name, const std::string& identifier);
+	// In async mode full buffers are handed over to a background thread that writes
+	// them to disk, so serializing doesn't have to wait for the disk.
+	DiskNodeFileWriteHandle(const std::string& name, const std::string& identifier, bool async = false);
 	virtual ~DiskNodeFileWriteHandle();
 
 	virtual void close();
 
 protected:
 	virtual void renewCache();
+
+	void startWriter();
+	void stopWriter();
+	void writerLoop();
+
+	struct Buffer {
+		uint8_t* data;
+		size_t size;
+	};
+
+	bool async;
+	std::thread writer;
+	std::mutex writer_mutex;
+	std::condition_variable writer_signal;
+	std::deque<Buffer> pending;
+	std::vector<uint8_t*> spare;
+	std::atomic<bool> write_failed;
+	bool stopping;
 };
 
 class MemoryNodeFileWriteHandle : public NodeFileWriteHandle
@@ -327,6 +481,8 @@ public:
 
 	uint8_t* getMemory();
 	size_t getSize();
+	// Bytes allocated for the buffer, it grows as needed and is kept between resets
+	size_t getCapacity() const noexcept { return cache ? cache_size : 0; }
 
 protected:
 	virtual void renewCache();
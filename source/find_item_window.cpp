@@ -281,147 +281,70 @@ void FindItemDialog::RefreshContentsInternal()
 	ok_button->Enable(false);
 
 	SearchMode selection = (SearchMode)options_radio_box->GetSelection();
-	bool found_search_results = false;
+	const ItemSearchIndex& index = g_items.getSearchIndex();
+	const uint32_t pickupables = only_pickupables ? ItemSearchIndex::mask(ITEM_SEARCH_PICKUPABLE) : 0;
+	std::vector<uint16_t> found;
 
 	if(selection == SearchMode::ServerIDs) {
-		uint16_t serverID = (uint16_t)server_id_spin->GetValue();
-		for(int id = g_items.getMinID(); id <= g_items.getMaxID(); ++id) {
-			const ItemType& item = g_items.getItemType(id);
-			if(item.id != serverID)
-				continue;
-
-			RAWBrush* raw_brush = item.raw_brush;
-			if(!raw_brush)
-				continue;
-
-			if(only_pickupables && !item.pickupable)
-				continue;
-
-			found_search_results = true;
-			items_list->AddBrush(raw_brush);
-		}
+		found = index.findByServerId((uint16_t)server_id_spin->GetValue(), pickupables);
 	}
 	else if(selection == SearchMode::ClientIDs) {
-		uint16_t clientID = static_cast<uint16_t>(client_id_spin->GetValue());
-		for(int id = g_items.getMinID(); id <= g_items.getMaxID(); ++id) {
-			const ItemType& item = g_items.getItemType(id);
-			if(item.id == 0 || item.clientID != clientID)
-				continue;
-
-			RAWBrush* raw_brush = item.raw_brush;
-			if(!raw_brush)
-				continue;
-
-			if(only_pickupables && !item.pickupable)
-				continue;
-
-			found_search_results = true;
-			items_list->AddBrush(raw_brush);
-		}
+		found = index.findByClientId(static_cast<uint16_t>(client_id_spin->GetValue()), pickupables);
 	}
 	else if(selection == SearchMode::Names) {
-		std::string search_string = as_lower_str(nstr(name_text_input->GetValue()));
-		if(search_string.size() >= 2) {
-			for(int id = g_items.getMinID(); id <= g_items.getMaxID(); ++id) {
-				const ItemType& item = g_items.getItemType(id);
-				if(item.id == 0)
-					continue;
-
-				RAWBrush* raw_brush = item.raw_brush;
-				if(!raw_brush)
-					continue;
-
-				if(only_pickupables && !item.pickupable)
-					continue;
-
-				if(as_lower_str(raw_brush->getName()).find(search_string) == std::string::npos)
-					continue;
-
-				found_search_results = true;
-				items_list->AddBrush(raw_brush);
-			}
-		}
+		found = index.findByName(as_lower_str(nstr(name_text_input->GetValue())), pickupables);
 	}
 	else if(selection == SearchMode::Types) {
-		for(int id = g_items.getMinID(); id <= g_items.getMaxID(); ++id) {
-			const ItemType& item = g_items.getItemType(id);
-			if(item.id == 0)
-				continue;
-
-			RAWBrush* raw_brush = item.raw_brush;
-			if(!raw_brush)
-				continue;
-
-			if(only_pickupables && !item.pickupable)
-				continue;
-
-			SearchItemType selection = (SearchItemType)types_radio_box->GetSelection();
-			if((selection == SearchItemType::Depot && !item.isDepot()) ||
-				(selection == SearchItemType::Mailbox && !item.isMailbox()) ||
-				(selection == SearchItemType::TrashHolder && !item.isTrashHolder()) ||
-				(selection == SearchItemType::Container && !item.isContainer()) ||
-				(selection == SearchItemType::Door && !item.isDoor()) ||
-				(selection == SearchItemType::MagicField && !item.isMagicField()) ||
-				(selection == SearchItemType::Teleport && !item.isTeleport()) ||
-				(selection == SearchItemType::Bed && !item.isBed()) ||
-				(selection == SearchItemType::Key && !item.isKey())) {
-				continue;
-			}
-
-			found_search_results = true;
-			items_list->AddBrush(raw_brush);
+		static const ItemSearchFlag types[] = {
+			ITEM_SEARCH_DEPOT,
+			ITEM_SEARCH_MAILBOX,
+			ITEM_SEARCH_TRASH_HOLDER,
+			ITEM_SEARCH_CONTAINER,
+			ITEM_SEARCH_DOOR,
+			ITEM_SEARCH_MAGIC_FIELD,
+			ITEM_SEARCH_TELEPORT,
+			ITEM_SEARCH_BED,
+			ITEM_SEARCH_KEY,
+		};
+		const int type = types_radio_box->GetSelection();
+		if(type >= 0 && type < int(sizeof(types) / sizeof(types[0]))) {
+			found = index.findByFlags(ItemSearchIndex::mask(types[type]) | pickupables);
 		}
 	}
 	else if(selection == SearchMode::Properties) {
-		bool has_selected = (unpassable->GetValue() ||
-			unmovable->GetValue() ||
-			block_missiles->GetValue() ||
-			block_pathfinder->GetValue() ||
-			readable->GetValue() ||
-			writeable->GetValue() ||
-			pickupable->GetValue() ||
-			stackable->GetValue() ||
-			rotatable->GetValue() ||
-			hangable->GetValue() ||
-			hook_east->GetValue() ||
-			hook_south->GetValue() ||
-			has_elevation->GetValue() ||
-			ignore_look->GetValue() ||
-			floor_change->GetValue());
-
-		if(has_selected) {
-			for(int id = g_items.getMinID(); id <= g_items.getMaxID(); ++id) {
-				const ItemType& item = g_items.getItemType(id);
-				if(item.id == 0)
-					continue;
-
-				RAWBrush* raw_brush = item.raw_brush;
-				if(!raw_brush)
-					continue;
-
-				if((unpassable->GetValue() && !item.unpassable) ||
-					(unmovable->GetValue() && item.moveable) ||
-					(block_missiles->GetValue() && !item.blockMissiles) ||
-					(block_pathfinder->GetValue() && !item.blockPathfinder) ||
-					(readable->GetValue() && !item.canReadText) ||
-					(writeable->GetValue() && !item.canWriteText) ||
-					(pickupable->GetValue() && !item.pickupable) ||
-					(stackable->GetValue() && !item.stackable) ||
-					(rotatable->GetValue() && !item.rotable) ||
-					(hangable->GetValue() && !item.isHangable) ||
-					(hook_east->GetValue() && !item.hookEast) ||
-					(hook_south->GetValue() && !item.hookSouth) ||
-					(has_elevation->GetValue() && !item.hasElevation) ||
-					(ignore_look->GetValue() && !item.ignoreLook) ||
-					(floor_change->GetValue() && !item.isFloorChange())) {
-					continue;
-				}
-
-				found_search_results = true;
-				items_list->AddBrush(raw_brush);
+		const std::pair<wxCheckBox*, ItemSearchFlag> properties[] = {
+			{ unpassable, ITEM_SEARCH_UNPASSABLE },
+			{ unmovable, ITEM_SEARCH_UNMOVABLE },
+			{ block_missiles, ITEM_SEARCH_BLOCK_MISSILES },
+			{ block_pathfinder, ITEM_SEARCH_BLOCK_PATHFINDER },
+			{ readable, ITEM_SEARCH_READABLE },
+			{ writeable, ITEM_SEARCH_WRITEABLE },
+			{ pickupable, ITEM_SEARCH_PICKUPABLE },
+			{ stackable, ITEM_SEARCH_STACKABLE },
+			{ rotatable, ITEM_SEARCH_ROTATABLE },
+			{ hangable, ITEM_SEARCH_HANGABLE },
+			{ hook_east, ITEM_SEARCH_HOOK_EAST },
+			{ hook_south, ITEM_SEARCH_HOOK_SOUTH },
+			{ has_elevation, ITEM_SEARCH_HAS_ELEVATION },
+			{ ignore_look, ITEM_SEARCH_IGNORE_LOOK },
+			{ floor_change, ITEM_SEARCH_FLOOR_CHANGE },
+		};
+		uint32_t flags = 0;
+		for(const auto& [checkbox, flag] : properties) {
+			if(checkbox->GetValue()) {
+				flags |= ItemSearchIndex::mask(flag);
 			}
 		}
+
+		if(flags != 0) {
+			found = index.findByFlags(flags);
+		}
+	}
+
+	for(uint16_t id : found) {
+		items_list->AddBrush(g_items.getRAWBrush(id));
 	}
+	const bool found_search_results = !found.empty();
 
 	if(found_search_results) {
 		items_list->SetSelection(0);
@@ -449,7 +372,8 @@ void FindItemDialog::OnClientIdChange(wxCommandEvent& WXUNUSED(event))
 
 void FindItemDialog::OnText(wxCommandEvent& WXUNUSED(event))
 {
-	input_timer.Start(800, true);
+	// Searching the index is cheap, only the typing is waited for
+	input_timer.Start(200, true);
 }
 
 void FindItemDialog::OnTypeChange(wxCommandEvent& WXUNUSED(event))
@@ -0,0 +1,127 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "flood_fill.h"
+#include "basemap.h"
+
+FloodFill::FloodFill(BaseMap& map, int z, Match match) :
+	map(map),
+	z(z),
+	match(std::move(match)),
+	start_x(0), start_y(0),
+	end_x(rme::MapMaxWidth - 1), end_y(rme::MapMaxHeight - 1)
+{
+	////
+}
+
+void FloodFill::setBounds(int start_x, int start_y, int end_x, int end_y)
+{
+	this->start_x = std::max(start_x, 0);
+	this->start_y = std::max(start_y, 0);
+	this->end_x = std::min(end_x, rme::MapMaxWidth - 1);
+	this->end_y = std::min(end_y, rme::MapMaxHeight - 1);
+}
+
+FloodFill::Leaf& FloodFill::getLeaf(int x, int y)
+{
+	const uint32_t key = (uint32_t(x >> 2) << 16) | uint32_t(y >> 2);
+	if(key == last_key) {
+		return *last_leaf;
+	}
+
+	// Elements of the map stay where they are, so the pointer outlives later inserts
+	auto it = leaves.find(key);
+	if(it == leaves.end()) {
+		it = leaves.emplace(key, Leaf()).first;
+		QTreeNode* node = map.getLeaf(x, y);
+		if(node) {
+			it->second.floor = node->getFloor(z);
+		}
+	}
+	last_key = key;
+	last_leaf = &it->second;
+	return it->second;
+}
+
+bool FloodFill::canFill(int x, int y)
+{
+	if(x < start_x || x > end_x || y < start_y || y > end_y) {
+		return false;
+	}
+
+	Leaf& leaf = getLeaf(x, y);
+	const int index = (x & 3) * 4 + (y & 3);
+	if(leaf.visited & (1 << index)) {
+		return false;
+	}
+	return match(leaf.floor ? leaf.floor->locs[index].get() : nullptr);
+}
+
+bool FloodFill::run(int x, int y, PositionVector& positions, ThreadPool::TaskGroup* group)
+{
+	if(group) {
+		group->setProgressTotal(int64_t(end_x - start_x + 1) * (end_y - start_y + 1));
+	}
+
+	// Each seed is filled out to a whole span of its row, then the rows above and
+	// below get a seed for every run of squares along that span that can be filled
+	std::vector<std::pair<int, int>> seeds;
+	seeds.emplace_back(x, y);
+	while(!seeds.empty()) {
+		const int seed_x = seeds.back().first;
+		const int seed_y = seeds.back().second;
+		seeds.pop_back();
+		if(!canFill(seed_x, seed_y)) {
+			continue;
+		}
+
+		if(group && group->isCancelled()) {
+			return false;
+		}
+
+		int left = seed_x;
+		while(canFill(left - 1, seed_y)) {
+			--left;
+		}
+		int right = seed_x;
+		while(canFill(right + 1, seed_y)) {
+			++right;
+		}
+
+		for(int span_x = left; span_x <= right; ++span_x) {
+			getLeaf(span_x, seed_y).visited |= 1 << ((span_x & 3) * 4 + (seed_y & 3));
+			positions.emplace_back(span_x, seed_y, z);
+		}
+		if(group) {
+			group->addProgress(right - left + 1);
+		}
+
+		for(int row : { seed_y - 1, seed_y + 1 }) {
+			bool in_run = false;
+			for(int span_x = left; span_x <= right; ++span_x) {
+				const bool fill = canFill(span_x, row);
+				if(fill && !in_run) {
+					seeds.emplace_back(span_x, row);
+				}
+				in_run = fill;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_FLOOD_FILL_H_
+#define RME_FLOOD_FILL_H_
+
+#include "position.h"
+#include "thread_pool.h"
+
+#include <functional>
+#include <unordered_map>
+
+class BaseMap;
+class Floor;
+class Tile;
+
+// Finds the connected area of a floor whose tiles pass a test, a row at a time.
+// Tiles are read straight from the floors of the leaves and the visited tiles are
+// kept as a mask per leaf, so only the parts of the map that are reached cost memory.
+class FloodFill
+{
+public:
+	// Gets nullptr for the squares without a tile
+	using Match = std::function<bool(const Tile* tile)>;
+
+	FloodFill(BaseMap& map, int z, Match match);
+
+	// The fill never leaves this box (inclusive), it is the whole map by default
+	void setBounds(int start_x, int start_y, int end_x, int end_y);
+
+	// Appends the positions of the area around x, y to positions, row by row.
+	// The progress of the group goes up to the size of the bounds, the fill stops
+	// and returns false once the group is cancelled
+	bool run(int x, int y, PositionVector& positions, ThreadPool::TaskGroup* group = nullptr);
+
+private:
+	struct Leaf {
+		Floor* floor = nullptr;
+		uint16_t visited = 0;
+	};
+
+	Leaf& getLeaf(int x, int y);
+	// In bounds, not visited yet and passing the test
+	bool canFill(int x, int y);
+
+	BaseMap& map;
+	int z;
+	Match match;
+	int start_x, start_y, end_x, end_y;
+
+	std::unordered_map<uint32_t, Leaf> leaves;
+	// Rows are walked along, so the leaf of the last square is usually the next one's
+	uint32_t last_key = 0xFFFFFFFF;
+	Leaf* last_leaf = nullptr;
+};
+
+#endif
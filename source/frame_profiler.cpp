@@ -0,0 +1,183 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "frame_profiler.h"
+
+#include <fstream>
+
+FrameProfiler g_profiler;
+
+FrameProfiler::FrameProfiler() :
+	enabled(false),
+	in_frame(false),
+	section_depth(),
+	history(HistorySize),
+	recorded(0)
+{
+}
+
+void FrameProfiler::setEnabled(bool enabled)
+{
+	if(this->enabled == enabled) {
+		return;
+	}
+	this->enabled = enabled;
+	in_frame = false;
+	current = Frame();
+	std::fill(std::begin(section_depth), std::end(section_depth), 0);
+}
+
+void FrameProfiler::beginFrame()
+{
+	if(!enabled) {
+		return;
+	}
+	in_frame = true;
+	current = Frame();
+	std::fill(std::begin(section_depth), std::end(section_depth), 0);
+	frame_start = Clock::now();
+}
+
+void FrameProfiler::endFrame()
+{
+	if(!enabled || !in_frame) {
+		return;
+	}
+	in_frame = false;
+	current.frame_ms = std::chrono::duration<double, std::milli>(Clock::now() - frame_start).count();
+	history[recorded % HistorySize] = current;
+	++recorded;
+}
+
+void FrameProfiler::beginSection(Section section)
+{
+	if(section_depth[section]++ == 0) {
+		section_start[section] = Clock::now();
+	}
+}
+
+void FrameProfiler::endSection(Section section)
+{
+	if(section_depth[section] == 0 || --section_depth[section] != 0) {
+		return;
+	}
+	current.section_ms[section] += std::chrono::duration<double, std::milli>(Clock::now() - section_start[section]).count();
+}
+
+FrameProfiler::Frame FrameProfiler::getAverage() const
+{
+	Frame average;
+	const size_t frames = std::min(getFrameCount(), AverageFrames);
+	if(frames == 0) {
+		return average;
+	}
+
+	double counters[COUNTER_COUNT] = {};
+	for(size_t age = 0; age < frames; ++age) {
+		const Frame& frame = getFrame(age);
+		average.frame_ms += frame.frame_ms;
+		for(int i = 0; i < SECTION_COUNT; ++i) {
+			average.section_ms[i] += frame.section_ms[i];
+		}
+		for(int i = 0; i < COUNTER_COUNT; ++i) {
+			counters[i] += frame.counters[i];
+		}
+	}
+
+	average.frame_ms /= frames;
+	for(int i = 0; i < SECTION_COUNT; ++i) {
+		average.section_ms[i] /= frames;
+	}
+	for(int i = 0; i < COUNTER_COUNT; ++i) {
+		average.counters[i] = uint32_t(counters[i] / frames + 0.5);
+	}
+	return average;
+}
+
+std::vector<std::string> FrameProfiler::getSummary() const
+{
+	std::vector<std::string> lines;
+	const Frame average = getAverage();
+
+	char line[128];
+	snprintf(line, sizeof(line), "frame: %.2f ms (%.0f fps)", average.frame_ms, average.frame_ms > 0.0 ? 1000.0 / average.frame_ms : 0.0);
+	lines.emplace_back(line);
+	for(int i = 0; i < SECTION_COUNT; ++i) {
+		snprintf(line, sizeof(line), "%s: %.2f ms", getSectionName(Section(i)), average.section_ms[i]);
+		lines.emplace_back(line);
+	}
+	for(int i = 0; i < COUNTER_COUNT; ++i) {
+		snprintf(line, sizeof(line), "%s: %u", getCounterName(Counter(i)), average.counters[i]);
+		lines.emplace_back(line);
+	}
+	return lines;
+}
+
+bool FrameProfiler::dumpCSV(const FileName& filename) const
+{
+	std::ofstream file(nstr(filename.GetFullPath()).c_str(), std::ios::trunc | std::ios::out);
+	if(!file.is_open()) {
+		return false;
+	}
+
+	file << "frame,frame_ms";
+	for(int i = 0; i < SECTION_COUNT; ++i) {
+		file << ',' << getSectionName(Section(i)) << "_ms";
+	}
+	for(int i = 0; i < COUNTER_COUNT; ++i) {
+		file << ',' << getCounterName(Counter(i));
+	}
+	file << '\n';
+
+	const size_t frames = getFrameCount();
+	for(size_t age = frames; age-- > 0;) {
+		const Frame& frame = getFrame(age);
+		file << (recorded - 1 - age) << ',' << frame.frame_ms;
+		for(int i = 0; i < SECTION_COUNT; ++i) {
+			file << ',' << frame.section_ms[i];
+		}
+		for(int i = 0; i < COUNTER_COUNT; ++i) {
+			file << ',' << frame.counters[i];
+		}
+		file << '\n';
+	}
+	return file.good();
+}
+
+const char* FrameProfiler::getSectionName(Section section)
+{
+	switch(section) {
+		case SECTION_DRAW_MAP: return "draw_map";
+		case SECTION_DRAW_TILE: return "draw_tile";
+		case SECTION_TOOLTIPS: return "tooltips";
+		case SECTION_LIGHTS: return "lights";
+		case SECTION_TEXTURE_UPLOAD: return "texture_upload";
+		default: return "";
+	}
+}
+
+const char* FrameProfiler::getCounterName(Counter counter)
+{
+	switch(counter) {
+		case COUNTER_DRAW_CALLS: return "draw_calls";
+		case COUNTER_TEXTURE_BINDS: return "texture_binds";
+		case COUNTER_SPRITES_LOADED: return "sprites_loaded";
+		default: return "";
+	}
+}
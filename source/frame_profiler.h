@@ -0,0 +1,127 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_FRAME_PROFILER_H_
+#define RME_FRAME_PROFILER_H_
+
+#include <chrono>
+
+// Times the sections of a map frame and counts what the frame did, keeping the
+// last HistorySize frames for the on-canvas overlay and for CSV dumps. Nothing is
+// timed or counted while it is disabled; it is only used by the render thread.
+class FrameProfiler
+{
+public:
+	enum Section {
+		SECTION_DRAW_MAP,
+		SECTION_DRAW_TILE,
+		SECTION_TOOLTIPS,
+		SECTION_LIGHTS,
+		SECTION_TEXTURE_UPLOAD,
+		SECTION_COUNT
+	};
+
+	enum Counter {
+		COUNTER_DRAW_CALLS,
+		COUNTER_TEXTURE_BINDS,
+		COUNTER_SPRITES_LOADED,
+		COUNTER_COUNT
+	};
+
+	static constexpr size_t HistorySize = 1024;
+	static constexpr size_t AverageFrames = 60; // Shown in the overlay
+
+	struct Frame {
+		double frame_ms = 0.0;
+		double section_ms[SECTION_COUNT] = {};
+		uint32_t counters[COUNTER_COUNT] = {};
+	};
+
+	FrameProfiler();
+
+	bool isEnabled() const noexcept { return enabled; }
+	void setEnabled(bool enabled);
+
+	void beginFrame();
+	void endFrame();
+
+	// Nested scopes of the same section are timed once, by the outermost one
+	void beginSection(Section section);
+	void endSection(Section section);
+	void count(Counter counter, uint32_t amount = 1) {
+		if(enabled) {
+			current.counters[counter] += amount;
+		}
+	}
+
+	// The mean of the last AverageFrames frames
+	Frame getAverage() const;
+	size_t getFrameCount() const noexcept { return std::min(recorded, HistorySize); }
+
+	// The averages as lines of text, for the overlay
+	std::vector<std::string> getSummary() const;
+
+	// One line per frame kept, oldest first
+	bool dumpCSV(const FileName& filename) const;
+
+	static const char* getSectionName(Section section);
+	static const char* getCounterName(Counter counter);
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	const Frame& getFrame(size_t age) const { return history[(recorded - 1 - age) % HistorySize]; }
+
+	bool enabled;
+	bool in_frame;
+	Frame current;
+	Clock::time_point frame_start;
+	Clock::time_point section_start[SECTION_COUNT];
+	int section_depth[SECTION_COUNT];
+	std::vector<Frame> history;
+	size_t recorded;
+};
+
+extern FrameProfiler g_profiler;
+
+// Times the enclosing block as a section of the current frame
+class ProfileScope
+{
+public:
+	explicit ProfileScope(FrameProfiler::Section section) :
+		section(section), active(g_profiler.isEnabled())
+	{
+		if(active) {
+			g_profiler.beginSection(section);
+		}
+	}
+	~ProfileScope()
+	{
+		if(active) {
+			g_profiler.endSection(section);
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	FrameProfiler::Section section;
+	bool active;
+};
+
+#endif
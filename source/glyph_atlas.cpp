@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+#include "glyph_atlas.h"
+#include "sprite_batch.h"
+
+#include <wx/dcmemory.h>
+
+namespace {
+	int nextPowerOfTwo(int value)
+	{
+		int result = 1;
+		while(result < value) {
+			result <<= 1;
+		}
+		return result;
+	}
+}
+
+GlyphAtlas::GlyphAtlas() :
+	texture(0),
+	failed(false),
+	cell_height(0),
+	ascent(0)
+{
+	////
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+	clear();
+}
+
+bool GlyphAtlas::load()
+{
+	if(texture != 0) {
+		return true;
+	}
+	if(failed) {
+		return false;
+	}
+
+	const wxFont font(wxFontInfo(wxSize(0, FontPixels)).Family(wxFONTFAMILY_SWISS));
+	wxBitmap measure(1, 1, 24);
+	wxMemoryDC dc(measure);
+	dc.SetFont(font);
+
+	int cell_width = 0;
+	for(int i = 0; i < GlyphCount; ++i) {
+		wxCoord width = 0, height = 0, descent = 0;
+		dc.GetTextExtent(wxString(char(FirstGlyph + i)), &width, &height, &descent);
+		glyphs[i].width = width;
+		glyphs[i].advance = width;
+		cell_width = std::max<int>(cell_width, width);
+		cell_height = std::max<int>(cell_height, height);
+		ascent = std::max<int>(ascent, height - descent);
+	}
+	// A pixel between the cells, so linear filtering doesn't pick up the neighbours
+	cell_width += 2;
+	cell_height += 2;
+
+	const int rows = (GlyphCount + GlyphsPerRow - 1) / GlyphsPerRow;
+	const int width = nextPowerOfTwo(GlyphsPerRow * cell_width);
+	const int height = nextPowerOfTwo(rows * cell_height);
+	if(cell_width <= 2 || width > 1024 || height > 1024) {
+		failed = true;
+		return false;
+	}
+
+	// White on black, the brightness of a pixel becomes its alpha
+	wxBitmap bitmap(width, height, 24);
+	dc.SelectObject(bitmap);
+	dc.SetBackground(*wxBLACK_BRUSH);
+	dc.Clear();
+	dc.SetFont(font);
+	dc.SetTextForeground(*wxWHITE);
+	dc.SetBackgroundMode(wxTRANSPARENT);
+	for(int i = 0; i < GlyphCount; ++i) {
+		const int x = (i % GlyphsPerRow) * cell_width + 1;
+		const int y = (i / GlyphsPerRow) * cell_height + 1;
+		dc.DrawText(wxString(char(FirstGlyph + i)), x, y);
+
+		Glyph& glyph = glyphs[i];
+		glyph.u0 = float(x) / width;
+		glyph.v0 = float(y) / height;
+		glyph.u1 = float(x + glyph.width) / width;
+		glyph.v1 = float(y + cell_height - 2) / height;
+	}
+	dc.SelectObject(wxNullBitmap);
+
+	const wxImage image = bitmap.ConvertToImage();
+	const uint8_t* rgb = image.GetData();
+	if(!rgb) {
+		failed = true;
+		return false;
+	}
+
+	std::vector<uint8_t> rgba(size_t(width) * height * 4);
+	for(size_t i = 0, pixels = size_t(width) * height; i < pixels; ++i) {
+		rgba[i * 4] = 0xFF;
+		rgba[i * 4 + 1] = 0xFF;
+		rgba[i * 4 + 2] = 0xFF;
+		rgba[i * 4 + 3] = std::max({ rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2] });
+	}
+
+	glGenTextures(1, &texture);
+	if(texture == 0) {
+		failed = true;
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	return true;
+}
+
+void GlyphAtlas::clear()
+{
+	if(texture != 0) {
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+}
+
+const GlyphAtlas::Glyph& GlyphAtlas::getGlyph(char c) const noexcept
+{
+	if(c < FirstGlyph || c > LastGlyph) {
+		c = ' ';
+	}
+	return glyphs[c - FirstGlyph];
+}
+
+int GlyphAtlas::getWidth(const std::string& text) const noexcept
+{
+	int width = 0;
+	for(char c : text) {
+		width += getAdvance(c);
+	}
+	return width;
+}
+
+void GlyphAtlas::add(SpriteBatch& batch, float x, float y, char c, float scale,
+	uint8_t r, uint8_t g, uint8_t b, uint8_t a) const
+{
+	if(texture == 0 || c == ' ') {
+		return;
+	}
+
+	const Glyph& glyph = getGlyph(c);
+	batch.add(texture, x, y - ascent * scale, glyph.width * scale, (cell_height - 2) * scale,
+		r, g, b, a, glyph.u0, glyph.v0, glyph.u1, glyph.v1);
+}
+
+float GlyphAtlas::add(SpriteBatch& batch, float x, float y, const std::string& text, float scale,
+	uint8_t r, uint8_t g, uint8_t b, uint8_t a) const
+{
+	for(char c : text) {
+		add(batch, x, y, c, scale, r, g, b, a);
+		x += getAdvance(c) * scale;
+	}
+	return x;
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_GLYPH_ATLAS_H_
+#define RME_GLYPH_ATLAS_H_
+
+class SpriteBatch;
+
+// The printable ASCII characters of a small sans serif font, rasterized once
+// into a single texture. Text is drawn as one quad per character through a
+// sprite batch, so a screen full of labels takes a few draw calls.
+class GlyphAtlas
+{
+public:
+	struct Glyph {
+		float u0 = 0.f, v0 = 0.f, u1 = 0.f, v1 = 0.f;
+		int width = 0;
+		int advance = 0;
+	};
+
+	GlyphAtlas();
+	~GlyphAtlas();
+
+	GlyphAtlas(const GlyphAtlas&) = delete;
+	GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+	// Rasterizes the glyphs the first time it's called, the GL context of the
+	// canvas must be current
+	bool load();
+	void clear();
+
+	// Characters outside the atlas are drawn as a space
+	const Glyph& getGlyph(char c) const noexcept;
+	int getAdvance(char c) const noexcept { return getGlyph(c).advance; }
+	int getWidth(const std::string& text) const noexcept;
+
+	// Adds the quad of a character with its baseline at x, y, scale is the
+	// size of a pixel of the glyph in view units
+	void add(SpriteBatch& batch, float x, float y, char c, float scale,
+		uint8_t r, uint8_t g, uint8_t b, uint8_t a) const;
+	// Adds a line of text, returns where the next character would go
+	float add(SpriteBatch& batch, float x, float y, const std::string& text, float scale,
+		uint8_t r, uint8_t g, uint8_t b, uint8_t a) const;
+
+	static constexpr int FontPixels = 12;
+	static constexpr int LineHeight = 14;
+
+private:
+	static constexpr char FirstGlyph = ' ';
+	static constexpr char LastGlyph = '~';
+	static constexpr int GlyphCount = LastGlyph - FirstGlyph + 1;
+	static constexpr int GlyphsPerRow = 16;
+
+	GLuint texture;
+	bool failed;
+	int cell_height;
+	int ascent;
+	Glyph glyphs[GlyphCount];
+};
+
+#endif
@@ -24,13 +24,18 @@
 #include "settings.h"
 #include "gui.h"
 #include "otml.h"
+#include "frame_profiler.h"
+#include "thread_pool.h"
 
 #include <wx/mstream.h>
 #include <wx/stopwatch.h>
 #include <wx/dir.h>
 #include <wx/rawbmp.h>
 #include "pngfiles.h"
+#include "tracing.h"
 #include <toml++/toml.hpp>
+#include <unordered_set>
+#include <array>
 
 // All 133 template colors
 static uint32_t TemplateOutfitLookupTable[] = {
@@ -62,6 +67,7 @@ static uint32_t TemplateOutfitLookupTable[] = {
 GraphicManager::GraphicManager() :
 	client_version(nullptr),
 	unloaded(true),
+	sprite_handle(nullptr),
 	dat_format(DAT_FORMAT_UNKNOWN),
 	otfi_found(false),
 	is_extended(false),
@@ -69,7 +75,15 @@ GraphicManager::GraphicManager() :
 	has_frame_durations(false),
 	has_frame_groups(false),
 	loaded_textures(0),
-	lastclean(0)
+	lru_head(nullptr),
+	lru_tail(nullptr),
+	texture_revision(0),
+	pending_decodes(0),
+	decode_generation(0),
+	decode_async(true),
+	placeholder_texture(0),
+	grid_texture(0),
+	elapsed_time(0)
 {
 	animation_timer = newd wxStopWatch();
 	animation_timer->Start();
@@ -77,18 +91,77 @@ GraphicManager::GraphicManager() :
 
 GraphicManager::~GraphicManager()
 {
-	for(SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
-		delete iter->second;
+	clearTemplateImages();
+	for(Sprite* sprite : sprite_space) {
+		delete sprite;
 	}
-
-	for(ImageMap::iterator iter = image_space.begin(); iter != image_space.end(); ++iter) {
-		delete iter->second;
+	for(Sprite* sprite : editor_space) {
+		delete sprite;
+	}
+	for(GameSprite::Image* image : image_space) {
+		delete image;
 	}
 
 	sprite_space.clear();
+	editor_space.clear();
 	image_space.clear();
 
+	delete sprite_handle;
 	delete animation_timer;
+
+	if(grid_texture != 0) {
+		glDeleteTextures(1, &grid_texture);
+	}
+}
+
+ShaderRenderer* GraphicManager::getShaderRenderer()
+{
+	if(g_settings.getInteger(Config::RENDER_BACKEND) != RENDER_BACKEND_SHADERS || !shader_renderer.load()) {
+		return nullptr;
+	}
+	return &shader_renderer;
+}
+
+ShaderLightRenderer* GraphicManager::getLightRenderer()
+{
+	if(g_settings.getInteger(Config::RENDER_BACKEND) != RENDER_BACKEND_SHADERS || !light_renderer.load()) {
+		return nullptr;
+	}
+	return &light_renderer;
+}
+
+GLuint GraphicManager::getGridTexture()
+{
+	if(grid_texture != 0) {
+		return grid_texture;
+	}
+
+	glGenTextures(1, &grid_texture);
+	if(grid_texture == 0) {
+		return 0;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, grid_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	std::vector<uint8_t> pixels;
+	int level = 0;
+	for(int size = GridTextureSize; size >= 1; size /= 2, ++level) {
+		pixels.assign(size_t(size) * size * 4, 0);
+		for(int i = 0; i < size; ++i) {
+			const size_t top = size_t(i) * 4;
+			const size_t left = size_t(i) * size * 4;
+			for(int channel = 0; channel < 4; ++channel) {
+				pixels[top + channel] = 0xFF;
+				pixels[left + channel] = 0xFF;
+			}
+		}
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	}
+	return grid_texture;
 }
 
 bool GraphicManager::hasTransparency() const
@@ -109,46 +182,97 @@ GLuint GraphicManager::getFreeTextureID()
 
 void GraphicManager::clear()
 {
-	SpriteMap new_sprite_space;
-	for(SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
-		if(iter->first >= 0) { // Don't clean internal sprites
-			delete iter->second;
-		} else {
-			new_sprite_space.insert(std::make_pair(iter->first, iter->second));
-		}
+	// The internal sprites in editor_space are kept
+	clearTemplateImages();
+	for(Sprite* sprite : sprite_space) {
+		delete sprite;
 	}
-
-	for(ImageMap::iterator iter = image_space.begin(); iter != image_space.end(); ++iter) {
-		delete iter->second;
+	for(GameSprite::Image* image : image_space) {
+		delete image;
 	}
 
-	sprite_space.swap(new_sprite_space);
+	sprite_space.clear();
 	image_space.clear();
 	cleanup_list.clear();
+	atlas.clear();
+	++decode_generation;
+	clearOutfitPreviews();
 
 	item_count = 0;
 	creature_count = 0;
 	loaded_textures = 0;
-	lastclean = time(nullptr);
 	spritefile = "";
+	delete sprite_handle;
+	sprite_handle = nullptr;
+	sprite_indexes.clear();
+	// After the images, their dumps point into it
+	std::vector<uint8_t>().swap(sprite_data);
 
 	unloaded = true;
 }
 
+void GraphicManager::swapVersion(GraphicManager& other)
+{
+	// Textures, templates, bitmaps and pending decodes stay with this manager, none of them
+	// is taken along
+	for(GameSprite::Image* image : image_space) {
+		if(!image) {
+			continue;
+		}
+		if(image->isGLLoaded) {
+			image->unloadGLTexture(0);
+		}
+		unlinkImage(image);
+		static_cast<GameSprite::NormalImage*>(image)->decoding = false;
+	}
+	clearTemplateImages();
+	cleanSoftwareSprites();
+	cleanup_list.clear();
+	atlas.clear();
+	++decode_generation;
+	clearOutfitPreviews();
+
+	std::swap(client_version, other.client_version);
+	signatureDatas.swap(other.signatureDatas);
+	std::swap(datSignature, other.datSignature);
+	std::swap(unloaded, other.unloaded);
+	spritefile.swap(other.spritefile);
+	std::swap(sprite_handle, other.sprite_handle);
+	sprite_indexes.swap(other.sprite_indexes);
+	sprite_data.swap(other.sprite_data);
+	sprite_space.swap(other.sprite_space);
+	image_space.swap(other.image_space);
+	std::swap(dat_format, other.dat_format);
+	std::swap(item_count, other.item_count);
+	std::swap(creature_count, other.creature_count);
+	std::swap(otfi_found, other.otfi_found);
+	std::swap(is_extended, other.is_extended);
+	std::swap(has_transparency, other.has_transparency);
+	std::swap(has_frame_durations, other.has_frame_durations);
+	std::swap(has_frame_groups, other.has_frame_groups);
+	std::swap(metadata_file, other.metadata_file);
+	std::swap(sprites_file, other.sprites_file);
+}
+
 void GraphicManager::cleanSoftwareSprites()
 {
-	for(SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
-		if(iter->first >= 0) { // Don't clean internal sprites
-			iter->second->unloadDC();
+	// Don't clean internal sprites
+	for(Sprite* sprite : sprite_space) {
+		if(sprite) {
+			sprite->unloadDC();
 		}
 	}
 }
 
 Sprite* GraphicManager::getSprite(int id)
 {
-	SpriteMap::iterator it = sprite_space.find(id);
-	if(it != sprite_space.end()) {
-		return it->second;
+	if(id >= 0) {
+		return size_t(id) < sprite_space.size() ? sprite_space[id] : nullptr;
+	}
+
+	const size_t index = size_t(id - EDITOR_SPRITE_SELECTION_MARKER);
+	if(id >= EDITOR_SPRITE_SELECTION_MARKER && index < editor_space.size()) {
+		return editor_space[index];
 	}
 	return nullptr;
 }
@@ -159,9 +283,9 @@ GameSprite* GraphicManager::getCreatureSprite(int id)
 		return nullptr;
 	}
 
-	SpriteMap::iterator it = sprite_space.find(id+item_count);
-	if(it != sprite_space.end()) {
-		return static_cast<GameSprite*>(it->second);
+	const size_t index = size_t(id) + item_count;
+	if(index < sprite_space.size()) {
+		return static_cast<GameSprite*>(sprite_space[index]);
 	}
 	return nullptr;
 }
@@ -171,15 +295,34 @@ GameSprite* GraphicManager::getEditorSprite(int id)
 	if(id >= 0) {
 		return nullptr;
 	}
+	return dynamic_cast<GameSprite*>(getSprite(id));
+}
 
-	SpriteMap::iterator it = sprite_space.find(id);
-	if(it != sprite_space.end()) {
-		return dynamic_cast<GameSprite*>(it->second);
+Sprite*& GraphicManager::getSpriteSlot(int id)
+{
+	SpriteList& list = id >= 0 ? sprite_space : editor_space;
+	const size_t index = id >= 0 ? size_t(id) : size_t(id - EDITOR_SPRITE_SELECTION_MARKER);
+	ASSERT(id >= EDITOR_SPRITE_SELECTION_MARKER);
+	if(index >= list.size()) {
+		list.resize(index + 1, nullptr);
 	}
-	return nullptr;
+	return list[index];
+}
+
+GameSprite::Image*& GraphicManager::getImageSlot(uint32_t id)
+{
+	if(id >= image_space.size()) {
+		image_space.resize(id + 1, nullptr);
+	}
+	return image_space[id];
+}
+
+template<size_t N>
+inline EmbeddedPNG embeddedPNGFile(const unsigned char (&data)[N])
+{
+	return { data, N };
 }
 
-#define loadPNGFile(name) _wxGetBitmapFromMemory(name, sizeof(name))
 inline wxBitmap* _wxGetBitmapFromMemory(const unsigned char* data, int length)
 {
 	wxMemoryInputStream is(data, length);
@@ -190,166 +333,166 @@ inline wxBitmap* _wxGetBitmapFromMemory(const unsigned char* data, int length)
 
 bool GraphicManager::loadEditorSprites()
 {
-	// Unused graphics MIGHT be loaded here, but it's a neglectable loss
-	sprite_space[EDITOR_SPRITE_SELECTION_MARKER] =
+	// The embedded PNGs are only decoded once they are drawn for the first time
+	getSpriteSlot(EDITOR_SPRITE_SELECTION_MARKER) =
 		newd EditorSprite(
 			newd wxBitmap(selection_marker_xpm16x16),
 			newd wxBitmap(selection_marker_xpm32x32)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_1x1] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_1x1) =
 		newd EditorSprite(
-			loadPNGFile(circular_1_small_png),
-			loadPNGFile(circular_1_png)
+			embeddedPNGFile(circular_1_small_png),
+			embeddedPNGFile(circular_1_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_3x3] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_3x3) =
 		newd EditorSprite(
-			loadPNGFile(circular_2_small_png),
-			loadPNGFile(circular_2_png)
+			embeddedPNGFile(circular_2_small_png),
+			embeddedPNGFile(circular_2_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_5x5] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_5x5) =
 		newd EditorSprite(
-			loadPNGFile(circular_3_small_png),
-			loadPNGFile(circular_3_png)
+			embeddedPNGFile(circular_3_small_png),
+			embeddedPNGFile(circular_3_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_7x7] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_7x7) =
 		newd EditorSprite(
-			loadPNGFile(circular_4_small_png),
-			loadPNGFile(circular_4_png)
+			embeddedPNGFile(circular_4_small_png),
+			embeddedPNGFile(circular_4_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_9x9] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_9x9) =
 		newd EditorSprite(
-			loadPNGFile(circular_5_small_png),
-			loadPNGFile(circular_5_png)
+			embeddedPNGFile(circular_5_small_png),
+			embeddedPNGFile(circular_5_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_15x15] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_15x15) =
 		newd EditorSprite(
-			loadPNGFile(circular_6_small_png),
-			loadPNGFile(circular_6_png)
+			embeddedPNGFile(circular_6_small_png),
+			embeddedPNGFile(circular_6_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_19x19] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_CD_19x19) =
 		newd EditorSprite(
-			loadPNGFile(circular_7_small_png),
-			loadPNGFile(circular_7_png)
+			embeddedPNGFile(circular_7_small_png),
+			embeddedPNGFile(circular_7_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_1x1] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_1x1) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_1_small_png),
-			loadPNGFile(rectangular_1_png)
+			embeddedPNGFile(rectangular_1_small_png),
+			embeddedPNGFile(rectangular_1_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_3x3] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_3x3) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_2_small_png),
-			loadPNGFile(rectangular_2_png)
+			embeddedPNGFile(rectangular_2_small_png),
+			embeddedPNGFile(rectangular_2_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_5x5] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_5x5) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_3_small_png),
-			loadPNGFile(rectangular_3_png)
+			embeddedPNGFile(rectangular_3_small_png),
+			embeddedPNGFile(rectangular_3_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_7x7] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_7x7) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_4_small_png),
-			loadPNGFile(rectangular_4_png)
+			embeddedPNGFile(rectangular_4_small_png),
+			embeddedPNGFile(rectangular_4_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_9x9] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_9x9) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_5_small_png),
-			loadPNGFile(rectangular_5_png)
+			embeddedPNGFile(rectangular_5_small_png),
+			embeddedPNGFile(rectangular_5_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_15x15] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_15x15) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_6_small_png),
-			loadPNGFile(rectangular_6_png)
+			embeddedPNGFile(rectangular_6_small_png),
+			embeddedPNGFile(rectangular_6_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_19x19] =
+	getSpriteSlot(EDITOR_SPRITE_BRUSH_SD_19x19) =
 		newd EditorSprite(
-			loadPNGFile(rectangular_7_small_png),
-			loadPNGFile(rectangular_7_png)
+			embeddedPNGFile(rectangular_7_small_png),
+			embeddedPNGFile(rectangular_7_png)
 		);
 
-	sprite_space[EDITOR_SPRITE_OPTIONAL_BORDER_TOOL] =
+	getSpriteSlot(EDITOR_SPRITE_OPTIONAL_BORDER_TOOL) =
 		newd EditorSprite(
-			loadPNGFile(optional_border_small_png),
-			loadPNGFile(optional_border_png)
+			embeddedPNGFile(optional_border_small_png),
+			embeddedPNGFile(optional_border_png)
 		);
-	sprite_space[EDITOR_SPRITE_ERASER] =
+	getSpriteSlot(EDITOR_SPRITE_ERASER) =
 		newd EditorSprite(
-			loadPNGFile(eraser_small_png),
-			loadPNGFile(eraser_png)
+			embeddedPNGFile(eraser_small_png),
+			embeddedPNGFile(eraser_png)
 		);
-	sprite_space[EDITOR_SPRITE_PZ_TOOL] =
+	getSpriteSlot(EDITOR_SPRITE_PZ_TOOL) =
 		newd EditorSprite(
-			loadPNGFile(protection_zone_small_png),
-			loadPNGFile(protection_zone_png)
+			embeddedPNGFile(protection_zone_small_png),
+			embeddedPNGFile(protection_zone_png)
 		);
-	sprite_space[EDITOR_SPRITE_PVPZ_TOOL] =
+	getSpriteSlot(EDITOR_SPRITE_PVPZ_TOOL) =
 		newd EditorSprite(
-			loadPNGFile(pvp_zone_small_png),
-			loadPNGFile(pvp_zone_png)
+			embeddedPNGFile(pvp_zone_small_png),
+			embeddedPNGFile(pvp_zone_png)
 		);
-	sprite_space[EDITOR_SPRITE_ZONE_TOOL] =
+	getSpriteSlot(EDITOR_SPRITE_ZONE_TOOL) =
 		newd EditorSprite(
-			loadPNGFile(zone_brush_small_png),
-			loadPNGFile(zone_brush_zone_png)
+			embeddedPNGFile(zone_brush_small_png),
+			embeddedPNGFile(zone_brush_zone_png)
 		);
-	sprite_space[EDITOR_SPRITE_NOLOG_TOOL] =
+	getSpriteSlot(EDITOR_SPRITE_NOLOG_TOOL) =
 		newd EditorSprite(
-			loadPNGFile(no_logout_small_png),
-			loadPNGFile(no_logout_png)
+			embeddedPNGFile(no_logout_small_png),
+			embeddedPNGFile(no_logout_png)
 		);
-	sprite_space[EDITOR_SPRITE_NOPVP_TOOL] =
+	getSpriteSlot(EDITOR_SPRITE_NOPVP_TOOL) =
 		newd EditorSprite(
-			loadPNGFile(no_pvp_small_png),
-			loadPNGFile(no_pvp_png)
+			embeddedPNGFile(no_pvp_small_png),
+			embeddedPNGFile(no_pvp_png)
 		);
 
-	sprite_space[EDITOR_SPRITE_DOOR_NORMAL] =
+	getSpriteSlot(EDITOR_SPRITE_DOOR_NORMAL) =
 		newd EditorSprite(
-			loadPNGFile(door_normal_small_png),
-			loadPNGFile(door_normal_png)
+			embeddedPNGFile(door_normal_small_png),
+			embeddedPNGFile(door_normal_png)
 		);
-	sprite_space[EDITOR_SPRITE_DOOR_LOCKED] =
+	getSpriteSlot(EDITOR_SPRITE_DOOR_LOCKED) =
 		newd EditorSprite(
-			loadPNGFile(door_locked_small_png),
-			loadPNGFile(door_locked_png)
+			embeddedPNGFile(door_locked_small_png),
+			embeddedPNGFile(door_locked_png)
 		);
-	sprite_space[EDITOR_SPRITE_DOOR_MAGIC] =
+	getSpriteSlot(EDITOR_SPRITE_DOOR_MAGIC) =
 		newd EditorSprite(
-			loadPNGFile(door_magic_small_png),
-			loadPNGFile(door_magic_png)
+			embeddedPNGFile(door_magic_small_png),
+			embeddedPNGFile(door_magic_png)
 		);
-	sprite_space[EDITOR_SPRITE_DOOR_QUEST] =
+	getSpriteSlot(EDITOR_SPRITE_DOOR_QUEST) =
 		newd EditorSprite(
-			loadPNGFile(door_quest_small_png),
-			loadPNGFile(door_quest_png)
+			embeddedPNGFile(door_quest_small_png),
+			embeddedPNGFile(door_quest_png)
 		);
-	sprite_space[EDITOR_SPRITE_WINDOW_NORMAL] =
+	getSpriteSlot(EDITOR_SPRITE_WINDOW_NORMAL) =
 		newd EditorSprite(
-			loadPNGFile(window_normal_small_png),
-			loadPNGFile(window_normal_png)
+			embeddedPNGFile(window_normal_small_png),
+			embeddedPNGFile(window_normal_png)
 		);
-	sprite_space[EDITOR_SPRITE_WINDOW_HATCH] =
+	getSpriteSlot(EDITOR_SPRITE_WINDOW_HATCH) =
 		newd EditorSprite(
-			loadPNGFile(window_hatch_small_png),
-			loadPNGFile(window_hatch_png)
+			embeddedPNGFile(window_hatch_small_png),
+			embeddedPNGFile(window_hatch_png)
 		);
 
-	sprite_space[EDITOR_SPRITE_SELECTION_GEM] =
+	getSpriteSlot(EDITOR_SPRITE_SELECTION_GEM) =
 		newd EditorSprite(
-			loadPNGFile(gem_edit_png),
-			nullptr
+			embeddedPNGFile(gem_edit_png),
+			nullptr, 0
 		);
-	sprite_space[EDITOR_SPRITE_DRAWING_GEM] =
+	getSpriteSlot(EDITOR_SPRITE_DRAWING_GEM) =
 		newd EditorSprite(
-			loadPNGFile(gem_move_png),
-			nullptr
+			embeddedPNGFile(gem_move_png),
+			nullptr, 0
 		);
 
-	sprite_space[EDITOR_SPRITE_SPAWNS] = GameSprite::createFromBitmap(ART_SPAWNS);
-	sprite_space[EDITOR_SPRITE_HOUSE_EXIT] = GameSprite::createFromBitmap(ART_HOUSE_EXIT);
-	sprite_space[EDITOR_SPRITE_PICKUPABLE_ITEM] = GameSprite::createFromBitmap(ART_PICKUPABLE);
-	sprite_space[EDITOR_SPRITE_MOVEABLE_ITEM] = GameSprite::createFromBitmap(ART_MOVEABLE);
-	sprite_space[EDITOR_SPRITE_PICKUPABLE_MOVEABLE_ITEM] = GameSprite::createFromBitmap(ART_PICKUPABLE_MOVEABLE);
+	getSpriteSlot(EDITOR_SPRITE_SPAWNS) = GameSprite::createFromBitmap(ART_SPAWNS);
+	getSpriteSlot(EDITOR_SPRITE_HOUSE_EXIT) = GameSprite::createFromBitmap(ART_HOUSE_EXIT);
+	getSpriteSlot(EDITOR_SPRITE_PICKUPABLE_ITEM) = GameSprite::createFromBitmap(ART_PICKUPABLE);
+	getSpriteSlot(EDITOR_SPRITE_MOVEABLE_ITEM) = GameSprite::createFromBitmap(ART_MOVEABLE);
+	getSpriteSlot(EDITOR_SPRITE_PICKUPABLE_MOVEABLE_ITEM) = GameSprite::createFromBitmap(ART_PICKUPABLE_MOVEABLE);
 
 	return true;
 }
@@ -395,8 +538,15 @@ bool GraphicManager::loadOTFI(const FileName& filename, wxString& error, wxArray
 
 bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& error, wxArrayString& warnings, bool datOnlyLoad)
 {
-	// items.otb has most of the info we need. This only loads the GameSprite metadata
-	FileReadHandle file(nstr(datafile.GetFullPath()));
+	RME_TRACE_ZONE("load", "GraphicManager::loadSpriteMetadata");
+	if(loadMetadataCache(datafile, datOnlyLoad)) {
+		return true;
+	}
+	const size_t warning_count = warnings.size();
+
+	// items.otb has most of the info we need. This only loads the GameSprite metadata.
+	// The dat is read whole and decoded from memory, it is thousands of small values
+	MemoryReadHandle file(nstr(datafile.GetFullPath()));
 
 	if(!file.isOk()) {
 		error += "Failed to open " + datafile.GetFullPath() + " for reading\nThe error reported was:" + wxstr(file.getErrorMessage());
@@ -434,7 +584,7 @@ bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& erro
 	// loop through all ItemDatabase until we reach the end of file
 	while(id <= maxID) {
 		GameSprite* sType = newd GameSprite();
-		sprite_space[id] = sType;
+		getSpriteSlot(id) = sType;
 		sType->id = id;
 
 		ItemType* iType = nullptr;
@@ -524,21 +674,26 @@ bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& erro
 					sprite_id = u16;
 				}
 
-				if(image_space[sprite_id] == nullptr) {
+				GameSprite::Image*& image = getImageSlot(sprite_id);
+				if(image == nullptr) {
 					GameSprite::NormalImage* img = newd GameSprite::NormalImage();
 					img->id = sprite_id;
-					image_space[sprite_id] = img;
+					image = img;
 				}
-				sType->spriteList.push_back(static_cast<GameSprite::NormalImage*>(image_space[sprite_id]));
+				sType->spriteList.push_back(static_cast<GameSprite::NormalImage*>(image));
 			}
 		}
 		++id;
 	}
 
+	// Warnings are only seen when the dat is read, so it is read again until they are fixed
+	if(warnings.size() == warning_count) {
+		saveMetadataCache(datafile, datOnlyLoad);
+	}
 	return true;
 }
 
-bool GraphicManager::loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings, bool datOnlyLoad, ItemType* iType)
+bool GraphicManager::loadSpriteMetadataFlags(MemoryReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings, bool datOnlyLoad, ItemType* iType)
 {
 	uint8_t prev_flag = 0;
 	uint8_t flag = DatFlagLast;
@@ -709,12 +864,16 @@ bool GraphicManager::loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* s
 			case DatFlagTranslucent:
 			case DatFlagLyingCorpse:
 			case DatFlagAnimateAlways:
-			case DatFlagFullGround:
 			case DatFlagLook:
 			case DatFlagWrappable:
 			case DatFlagUnwrappable:
 			case DatFlagTopEffect:
 				break;
+			case DatFlagFullGround:
+				if(iType) {
+					iType->fullGround = true;
+				}
+				break;
 			case DatFlagFloorChange:
 				// verify as idk how to do floorChangeDown etc.
 				//item->floorChange = item->floorChangeDown || item->floorChangeNorth || item->floorChangeEast || item->floorChangeSouth || item->floorChangeWest;
@@ -817,8 +976,369 @@ bool GraphicManager::loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* s
 	return true;
 }
 
+namespace
+{
+	constexpr uint32_t MetadataCacheMagic = 0x43454D52; // "RMEC"
+	constexpr uint32_t MetadataCacheVersion = 1;
+
+	// The dat-derived ItemType flags, for datOnlyLoad
+	enum MetadataItemFlags : uint32_t {
+		ITEM_ALWAYS_ON_BOTTOM = 1 << 0,
+		ITEM_STACKABLE = 1 << 1,
+		ITEM_UNPASSABLE = 1 << 2,
+		ITEM_MOVEABLE = 1 << 3,
+		ITEM_BLOCK_MISSILES = 1 << 4,
+		ITEM_BLOCK_PATHFINDER = 1 << 5,
+		ITEM_PICKUPABLE = 1 << 6,
+		ITEM_HANGABLE = 1 << 7,
+		ITEM_HOOK_SOUTH = 1 << 8,
+		ITEM_HOOK_EAST = 1 << 9,
+		ITEM_ROTABLE = 1 << 10,
+		ITEM_FULL_GROUND = 1 << 11,
+		ITEM_FLOOR_CHANGE = 1 << 12,
+		ITEM_READABLE = 1 << 13,
+		ITEM_WRITEABLE = 1 << 14,
+		ITEM_ELEVATION = 1 << 15,
+	};
+
+	class MetadataCacheWriter
+	{
+	public:
+		template <typename T>
+		void add(T value) {
+			const size_t offset = data.size();
+			data.resize(offset + sizeof(T));
+			memcpy(&data[offset], &value, sizeof(T));
+		}
+		void addString(const std::string& str) {
+			add(uint32_t(str.size()));
+			data.insert(data.end(), str.begin(), str.end());
+		}
+
+		std::vector<uint8_t> data;
+	};
+
+	// Never reads past the end, once a read fails every later one does too
+	class MetadataCacheReader
+	{
+	public:
+		MetadataCacheReader(const uint8_t* data, size_t size) : position(data), end(data + size), ok(true) {}
+
+		template <typename T>
+		T get() {
+			T value = T();
+			if(!ok || size_t(end - position) < sizeof(T)) {
+				ok = false;
+				return value;
+			}
+			memcpy(&value, position, sizeof(T));
+			position += sizeof(T);
+			return value;
+		}
+		std::string getString() {
+			const uint32_t size = get<uint32_t>();
+			if(!ok || size_t(end - position) < size) {
+				ok = false;
+				return std::string();
+			}
+			std::string str(reinterpret_cast<const char*>(position), size);
+			position += size;
+			return str;
+		}
+
+		bool isOk() const noexcept { return ok; }
+		bool atEnd() const noexcept { return position == end; }
+
+	private:
+		const uint8_t* position;
+		const uint8_t* end;
+		bool ok;
+	};
+
+	// Changes whenever the dat file or what it was read with does
+	void addMetadataCacheKey(MetadataCacheWriter& writer, const FileName& datafile, bool datOnlyLoad, uint32_t flags)
+	{
+		writer.add(MetadataCacheMagic);
+		writer.add(MetadataCacheVersion);
+		writer.addString(nstr(datafile.GetFullPath()));
+		writer.add(uint64_t(datafile.GetSize().GetValue()));
+		writer.add(int64_t(datafile.GetModificationTime().GetValue().GetValue()));
+		writer.add(uint8_t(datOnlyLoad));
+		writer.add(flags);
+	}
+
+	// The options the dat is read with, those not given by the otfi follow from the dat itself
+	uint32_t getMetadataCacheOptions(bool otfi_found, bool is_extended, bool has_frame_durations, bool has_frame_groups)
+	{
+		if(!otfi_found) {
+			return 0;
+		}
+		return 1 | uint32_t(is_extended) << 1 | uint32_t(has_frame_durations) << 2 | uint32_t(has_frame_groups) << 3;
+	}
+
+	FileName getMetadataCacheFile(const ClientVersion* version)
+	{
+		FileName file = version->getLocalDataPath();
+		file.SetFullName("metadata.cache");
+		return file;
+	}
+}
+
+bool GraphicManager::loadMetadataCache(const FileName& datafile, bool datOnlyLoad)
+{
+	if(!g_settings.getInteger(Config::USE_STARTUP_CACHE)) {
+		return false;
+	}
+
+	// Read in one go, then built from memory
+	std::vector<uint8_t> data;
+	{
+		FileReadHandle file(nstr(getMetadataCacheFile(client_version).GetFullPath()));
+		if(!file.isOk() || file.size() == 0) {
+			return false;
+		}
+		data.resize(file.size());
+		if(!file.getRAW(data.data(), data.size())) {
+			return false;
+		}
+	}
+
+	MetadataCacheWriter key;
+	addMetadataCacheKey(key, datafile, datOnlyLoad, getMetadataCacheOptions(otfi_found, is_extended, has_frame_durations, has_frame_groups));
+	if(data.size() < key.data.size() || memcmp(data.data(), key.data.data(), key.data.size()) != 0) {
+		return false;
+	}
+
+	MetadataCacheReader header(data.data() + key.data.size(), data.size() - key.data.size());
+	const uint32_t signature = header.get<uint32_t>();
+	const uint16_t items = header.get<uint16_t>();
+	const uint16_t creatures = header.get<uint16_t>();
+	const uint8_t formats = header.get<uint8_t>();
+	if(!header.isOk() || client_version->getDatFormatForSignature(signature) == DAT_FORMAT_UNKNOWN) {
+		return false;
+	}
+
+	// Walked once to check it is whole, a second time to build the sprites
+	GameSprite scratch;
+	for(int pass = 0; pass < 2; ++pass) {
+		const bool build = pass == 1;
+		MetadataCacheReader reader = header;
+		for(uint32_t id = 100; id <= uint32_t(items) + creatures; ++id) {
+			GameSprite* sType = build ? newd GameSprite() : &scratch;
+			if(build) {
+				getSpriteSlot(id) = sType;
+			}
+			sType->id = id;
+
+			sType->width = reader.get<uint8_t>();
+			sType->height = reader.get<uint8_t>();
+			sType->layers = reader.get<uint8_t>();
+			sType->pattern_x = reader.get<uint8_t>();
+			sType->pattern_y = reader.get<uint8_t>();
+			sType->pattern_z = reader.get<uint8_t>();
+			sType->frames = reader.get<uint8_t>();
+			sType->numsprites = reader.get<uint32_t>();
+			sType->ground_speed = reader.get<uint16_t>();
+			sType->draw_height = reader.get<uint16_t>();
+			sType->draw_offset.x = reader.get<int32_t>();
+			sType->draw_offset.y = reader.get<int32_t>();
+			sType->minimap_color = reader.get<uint16_t>();
+			sType->has_light = reader.get<uint8_t>() != 0;
+			sType->light.intensity = reader.get<uint8_t>();
+			sType->light.color = reader.get<uint8_t>();
+
+			if(reader.get<uint8_t>() != 0) {
+				const int frame_count = reader.get<int32_t>();
+				const int start_frame = reader.get<int32_t>();
+				const int loop_count = reader.get<int32_t>();
+				const bool async = reader.get<uint8_t>() != 0;
+				if(!reader.isOk() || frame_count <= 0 || frame_count > 255 || start_frame < -1 || start_frame >= frame_count) {
+					return false;
+				}
+
+				std::vector<FrameDuration> durations;
+				for(int i = 0; i < frame_count; ++i) {
+					const int min = reader.get<int32_t>();
+					const int max = reader.get<int32_t>();
+					if(min > max) {
+						return false;
+					}
+					durations.emplace_back(min, max);
+				}
+
+				if(build) {
+					sType->animator = newd Animator(frame_count, start_frame, loop_count, async);
+					for(int i = 0; i < frame_count; ++i) {
+						*sType->animator->durations[i] = durations[i];
+					}
+					sType->animator->reset();
+				}
+			}
+
+			const uint32_t sprite_count = reader.get<uint32_t>();
+			if(!reader.isOk()) {
+				return false;
+			}
+			if(build) {
+				sType->spriteList.reserve(sprite_count);
+			}
+			for(uint32_t i = 0; i < sprite_count && reader.isOk(); ++i) {
+				const uint32_t sprite_id = reader.get<uint32_t>();
+				if(!build) {
+					continue;
+				}
+
+				GameSprite::Image*& image = getImageSlot(sprite_id);
+				if(image == nullptr) {
+					GameSprite::NormalImage* img = newd GameSprite::NormalImage();
+					img->id = sprite_id;
+					image = img;
+				}
+				sType->spriteList.push_back(static_cast<GameSprite::NormalImage*>(image));
+			}
+
+			if(datOnlyLoad && id < uint32_t(items) + 1) {
+				const uint8_t group = reader.get<uint8_t>();
+				const uint8_t type = reader.get<uint8_t>();
+				const int32_t top_order = reader.get<int32_t>();
+				const uint32_t flags = reader.get<uint32_t>();
+				if(build) {
+					ItemType* iType = new ItemType();
+					iType->id = id;
+					iType->clientID = id;
+					iType->sprite = sType;
+					iType->group = ItemGroup_t(group);
+					iType->type = ItemTypes_t(type);
+					iType->alwaysOnTopOrder = top_order;
+					iType->alwaysOnBottom = (flags & ITEM_ALWAYS_ON_BOTTOM) != 0;
+					iType->stackable = (flags & ITEM_STACKABLE) != 0;
+					iType->unpassable = (flags & ITEM_UNPASSABLE) != 0;
+					iType->moveable = (flags & ITEM_MOVEABLE) != 0;
+					iType->blockMissiles = (flags & ITEM_BLOCK_MISSILES) != 0;
+					iType->blockPathfinder = (flags & ITEM_BLOCK_PATHFINDER) != 0;
+					iType->pickupable = (flags & ITEM_PICKUPABLE) != 0;
+					iType->isHangable = (flags & ITEM_HANGABLE) != 0;
+					iType->hookSouth = (flags & ITEM_HOOK_SOUTH) != 0;
+					iType->hookEast = (flags & ITEM_HOOK_EAST) != 0;
+					iType->rotable = (flags & ITEM_ROTABLE) != 0;
+					iType->fullGround = (flags & ITEM_FULL_GROUND) != 0;
+					iType->floorChange = (flags & ITEM_FLOOR_CHANGE) != 0;
+					iType->canReadText = (flags & ITEM_READABLE) != 0;
+					iType->canWriteText = (flags & ITEM_WRITEABLE) != 0;
+					iType->hasElevation = (flags & ITEM_ELEVATION) != 0;
+					g_items.getItemMap().set(iType->id, iType);
+				}
+			}
+
+			if(!reader.isOk()) {
+				return false;
+			}
+		}
+		if(!reader.atEnd()) {
+			return false;
+		}
+	}
+
+	datSignature = signature;
+	item_count = items;
+	creature_count = creatures;
+	dat_format = client_version->getDatFormatForSignature(signature);
+	is_extended = (formats & 1) != 0;
+	has_frame_durations = (formats & 2) != 0;
+	has_frame_groups = (formats & 4) != 0;
+	g_items.setMaxID(item_count + 1);
+	return true;
+}
+
+void GraphicManager::saveMetadataCache(const FileName& datafile, bool datOnlyLoad)
+{
+	if(!g_settings.getInteger(Config::USE_STARTUP_CACHE)) {
+		return;
+	}
+
+	MetadataCacheWriter writer;
+	addMetadataCacheKey(writer, datafile, datOnlyLoad, getMetadataCacheOptions(otfi_found, is_extended, has_frame_durations, has_frame_groups));
+	writer.add(datSignature);
+	writer.add(item_count);
+	writer.add(creature_count);
+	writer.add(uint8_t(uint8_t(is_extended) | uint8_t(has_frame_durations) << 1 | uint8_t(has_frame_groups) << 2));
+
+	for(uint32_t id = 100; id <= uint32_t(item_count) + creature_count; ++id) {
+		GameSprite* sType = id < sprite_space.size() ? dynamic_cast<GameSprite*>(sprite_space[id]) : nullptr;
+		if(!sType) {
+			return;
+		}
+
+		writer.add(sType->width);
+		writer.add(sType->height);
+		writer.add(sType->layers);
+		writer.add(sType->pattern_x);
+		writer.add(sType->pattern_y);
+		writer.add(sType->pattern_z);
+		writer.add(sType->frames);
+		writer.add(sType->numsprites);
+		writer.add(sType->ground_speed);
+		writer.add(sType->draw_height);
+		writer.add(int32_t(sType->draw_offset.x));
+		writer.add(int32_t(sType->draw_offset.y));
+		writer.add(sType->minimap_color);
+		writer.add(uint8_t(sType->has_light));
+		writer.add(sType->light.intensity);
+		writer.add(sType->light.color);
+
+		const Animator* animator = sType->animator;
+		writer.add(uint8_t(animator != nullptr));
+		if(animator) {
+			writer.add(int32_t(animator->frame_count));
+			writer.add(int32_t(animator->start_frame));
+			writer.add(int32_t(animator->loop_count));
+			writer.add(uint8_t(animator->async));
+			for(const FrameDuration* duration : animator->durations) {
+				writer.add(int32_t(duration->min));
+				writer.add(int32_t(duration->max));
+			}
+		}
+
+		writer.add(uint32_t(sType->spriteList.size()));
+		for(const GameSprite::NormalImage* image : sType->spriteList) {
+			writer.add(image->id);
+		}
+
+		if(datOnlyLoad && id < uint32_t(item_count) + 1) {
+			const ItemType& iType = g_items.getItemType(id);
+			uint32_t flags = 0;
+			flags |= iType.alwaysOnBottom ? ITEM_ALWAYS_ON_BOTTOM : 0;
+			flags |= iType.stackable ? ITEM_STACKABLE : 0;
+			flags |= iType.unpassable ? ITEM_UNPASSABLE : 0;
+			flags |= iType.moveable ? ITEM_MOVEABLE : 0;
+			flags |= iType.blockMissiles ? ITEM_BLOCK_MISSILES : 0;
+			flags |= iType.blockPathfinder ? ITEM_BLOCK_PATHFINDER : 0;
+			flags |= iType.pickupable ? ITEM_PICKUPABLE : 0;
+			flags |= iType.isHangable ? ITEM_HANGABLE : 0;
+			flags |= iType.hookSouth ? ITEM_HOOK_SOUTH : 0;
+			flags |= iType.hookEast ? ITEM_HOOK_EAST : 0;
+			flags |= iType.rotable ? ITEM_ROTABLE : 0;
+			flags |= iType.fullGround ? ITEM_FULL_GROUND : 0;
+			flags |= iType.floorChange ? ITEM_FLOOR_CHANGE : 0;
+			flags |= iType.canReadText ? ITEM_READABLE : 0;
+			flags |= iType.canWriteText ? ITEM_WRITEABLE : 0;
+			flags |= iType.hasElevation ? ITEM_ELEVATION : 0;
+			writer.add(uint8_t(iType.group));
+			writer.add(uint8_t(iType.type));
+			writer.add(int32_t(iType.alwaysOnTopOrder));
+			writer.add(flags);
+		}
+	}
+
+	FileWriteHandle file(nstr(getMetadataCacheFile(client_version).GetFullPath()));
+	if(file.isOk()) {
+		file.addRAW(writer.data.data(), writer.data.size());
+	}
+}
+
 bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, wxArrayString& warnings)
 {
+	RME_TRACE_ZONE("load", "GraphicManager::loadSpriteData");
 	FileReadHandle fh(nstr(datafile.GetFullPath()));
 
 	if(!fh.isOk()) {
@@ -846,48 +1366,66 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 		total_pics = u16;
 	}
 
-	if(!g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
+	sprite_indexes.clear();
+	sprite_indexes.reserve(total_pics);
+	for(uint32_t i = 0; i < total_pics; ++i) {
+		uint32_t index;
+		safe_get(U32, index);
+		sprite_indexes.push_back(index);
+	}
+
+	if(!g_settings.getSnapshot()->use_memcached_sprites) {
+		// Keep the file open, sprites are read from it whenever they are needed
+		delete sprite_handle;
+		sprite_handle = newd FileReadHandle(nstr(datafile.GetFullPath()));
+		if(!sprite_handle->isOk()) {
+			error = "Failed to open file for reading";
+			return false;
+		}
 		spritefile = nstr(datafile.GetFullPath());
 		unloaded = false;
 		return true;
 	}
 
-	std::vector<uint32_t> sprite_indexes;
-	for(uint32_t i = 0; i < total_pics; ++i) {
-		uint32_t index;
-		safe_get(U32, index);
-		sprite_indexes.push_back(index);
+	// The whole file in one read, the dumps point into it instead of being read and
+	// allocated one at a time
+	const size_t file_size = fh.size();
+	sprite_data.resize(file_size);
+	fh.seek(0);
+	if(!fh.getRAW(sprite_data.data(), file_size)) {
+		error = wxstr(fh.getErrorMessage());
+		return false;
 	}
 
-	// Now read individual sprites
+	const uint8_t* data = sprite_data.data();
 	int id = 1;
 	for(std::vector<uint32_t>::iterator sprite_iter = sprite_indexes.begin(); sprite_iter != sprite_indexes.end(); ++sprite_iter, ++id) {
-		uint32_t index = *sprite_iter + 3;
-		fh.seek(index);
-		uint16_t size;
-		safe_get(U16, size);
-
-		ImageMap::iterator it = image_space.find(id);
-		if(it != image_space.end()) {
-			GameSprite::NormalImage* spr = dynamic_cast<GameSprite::NormalImage*>(it->second);
+		// Past the colour key
+		const size_t index = size_t(*sprite_iter) + 3;
+		if(index + 2 > file_size) {
+			error = "items.spr: Sprite offset beyond the end of the file";
+			return false;
+		}
+		const uint16_t size = data[index] | data[index + 1] << 8;
+		if(index + 2 + size > file_size) {
+			error = "items.spr: Sprite data beyond the end of the file";
+			return false;
+		}
+
+		if(size_t(id) < image_space.size()) {
+			GameSprite::NormalImage* spr = dynamic_cast<GameSprite::NormalImage*>(image_space[id]);
 			if(spr && size > 0) {
 				if(spr->size > 0) {
 					wxString ss;
 					ss << "items.spr: Duplicate GameSprite id " << id;
 					warnings.push_back(ss);
-					fh.skip(size);
 				} else {
 					spr->id = id;
 					spr->size = size;
-					spr->dump = newd uint8_t[size];
-					if(!fh.getRAW(spr->dump, size)) {
-						error = wxstr(fh.getErrorMessage()); \
-						return false;
-					}
+					spr->dump = sprite_data.data() + index + 2;
+					spr->shared_dump = true;
 				}
 			}
-		} else {
-			fh.skip(size);
 		}
 	}
 #undef safe_get
@@ -897,7 +1435,7 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 
 bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite_id)
 {
-	if(g_settings.getInteger(Config::USE_MEMCACHED_SPRITES))
+	if(g_settings.getSnapshot()->use_memcached_sprites)
 		return false;
 
 	if(sprite_id == 0) {
@@ -907,17 +1445,21 @@ bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite
 		return true;
 	}
 
-	FileReadHandle fh(spritefile);
-	if(!fh.isOk())
+	if(!sprite_handle || static_cast<uint32_t>(sprite_id) > sprite_indexes.size())
 		return false;
-	unloaded = false;
 
-	if(!fh.seek((is_extended ? 4 : 2) + sprite_id * sizeof(uint32_t)))
-		return false;
+	FileReadHandle& fh = *sprite_handle;
+	if(!fh.isOk()) {
+		// Don't let a failed read break every sprite after it
+		delete sprite_handle;
+		sprite_handle = newd FileReadHandle(spritefile);
+		if(!sprite_handle->isOk())
+			return false;
+		return loadSpriteDump(target, size, sprite_id);
+	}
+	unloaded = false;
 
-	uint32_t to_seek = 0;
-	if(fh.getU32(to_seek)) {
-		fh.seek(to_seek+3);
+	if(fh.seek(sprite_indexes[sprite_id - 1] + 3)) {
 		uint16_t sprite_size;
 		if(fh.getU16(sprite_size)) {
 			target = newd uint8_t[sprite_size];
@@ -932,44 +1474,312 @@ bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite
 	return false;
 }
 
+void GraphicManager::prefetchSprites(const std::vector<GameSprite*>& sprites)
+{
+	if(!sprite_handle || g_settings.getSnapshot()->use_memcached_sprites)
+		return;
+
+	std::vector<GameSprite::NormalImage*> images;
+	for(GameSprite* sprite : sprites) {
+		for(GameSprite::NormalImage* image : sprite->spriteList) {
+			if(image && !image->dump && !image->isGLLoaded && image->id != 0 && image->id <= sprite_indexes.size()) {
+				images.push_back(image);
+			}
+		}
+	}
+	if(images.empty())
+		return;
+
+	// Read them front to back, so the file is only walked once
+	std::sort(images.begin(), images.end(), [this](const GameSprite::NormalImage* a, const GameSprite::NormalImage* b) {
+		return sprite_indexes[a->id - 1] < sprite_indexes[b->id - 1];
+	});
+
+	for(GameSprite::NormalImage* image : images) {
+		// The same image can be shared by several sprites
+		if(image->dump)
+			continue;
+		if(loadSpriteDump(image->dump, image->size, image->id)) {
+			image->visit();
+		}
+	}
+}
+
 void GraphicManager::addSpriteToCleanup(GameSprite* spr)
 {
 	cleanup_list.push_back(spr);
 	// Clean if needed
-	if(cleanup_list.size() > std::max<uint32_t>(100, g_settings.getInteger(Config::SOFTWARE_CLEAN_THRESHOLD))) {
-		for(int i = 0; i < g_settings.getInteger(Config::SOFTWARE_CLEAN_SIZE) && static_cast<uint32_t>(i) < cleanup_list.size(); ++i) {
+	const std::shared_ptr<const SettingsSnapshot> settings = g_settings.getSnapshot();
+	if(cleanup_list.size() > std::max<uint32_t>(100, settings->software_clean_threshold)) {
+		for(uint32_t i = 0; i < settings->software_clean_size && i < cleanup_list.size(); ++i) {
 			cleanup_list.front()->unloadDC();
 			cleanup_list.pop_front();
 		}
 	}
 }
 
-void GraphicManager::garbageCollection()
+GraphicManager::MemoryUsage GraphicManager::getMemoryUsage() const
 {
-	if(g_settings.getInteger(Config::TEXTURE_MANAGEMENT)) {
-		int t = time(nullptr);
-		if(loaded_textures > g_settings.getInteger(Config::TEXTURE_CLEAN_THRESHOLD) &&
-			t - lastclean > g_settings.getInteger(Config::TEXTURE_CLEAN_PULSE)) {
-			ImageMap::iterator iit = image_space.begin();
-			while(iit != image_space.end()) {
-				iit->second->clean(t);
-				++iit;
-			}
-			SpriteMap::iterator sit = sprite_space.begin();
-			while(sit != sprite_space.end()) {
-				GameSprite* gs = dynamic_cast<GameSprite*>(sit->second);
-				if(gs) gs->clean(t);
-				++sit;
+	MemoryUsage usage;
+	usage.atlas_sprites = atlas.getUsedCells();
+	usage.atlas_pages = atlas.getPageCount();
+	usage.atlas_bytes = usage.atlas_pages * TextureAtlas::PageSize * TextureAtlas::PageSize * 4;
+	usage.textures = std::max<int>(loaded_textures - int(usage.atlas_sprites), 0);
+	usage.texture_bytes = usage.textures * rme::SpritePixelsSize * 4;
+
+	for(const GameSprite::Image* entry : image_space) {
+		const GameSprite::NormalImage* image = dynamic_cast<const GameSprite::NormalImage*>(entry);
+		if(image && image->dump) {
+			++usage.sprite_dumps;
+			usage.sprite_dump_bytes += image->size;
+		}
+	}
+
+	// A sprite is listed again whenever its bitmaps are remade
+	std::unordered_set<const GameSprite*> counted;
+	for(const GameSprite* sprite : cleanup_list) {
+		const size_t bytes = sprite->getDCMemsize();
+		if(bytes > 0 && counted.insert(sprite).second) {
+			++usage.software_sprites;
+			usage.software_bytes += bytes;
+		}
+	}
+	return usage;
+}
+
+void GraphicManager::touchImage(GameSprite::Image* image)
+{
+	if(image == lru_tail) {
+		return;
+	}
+	unlinkImage(image);
+
+	image->lru_prev = lru_tail;
+	image->lru_next = nullptr;
+	image->in_lru = true;
+	if(lru_tail) {
+		lru_tail->lru_next = image;
+	} else {
+		lru_head = image;
+	}
+	lru_tail = image;
+}
+
+void GraphicManager::unlinkImage(GameSprite::Image* image)
+{
+	if(!image->in_lru) {
+		return;
+	}
+
+	if(image->lru_prev) {
+		image->lru_prev->lru_next = image->lru_next;
+	} else {
+		lru_head = image->lru_next;
+	}
+	if(image->lru_next) {
+		image->lru_next->lru_prev = image->lru_prev;
+	} else {
+		lru_tail = image->lru_prev;
+	}
+	image->lru_prev = nullptr;
+	image->lru_next = nullptr;
+	image->in_lru = false;
+}
+
+size_t GraphicManager::TemplateKeyHash::operator()(const TemplateKey& key) const noexcept
+{
+	size_t hash = std::hash<const void*>()(key.parent);
+	hash ^= std::hash<uint64_t>()(uint64_t(uint32_t(key.sprite_index)) << 32 | key.colors) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+GameSprite::TemplateImage* GraphicManager::getTemplateImage(GameSprite* parent, int sprite_index, const Outfit& outfit)
+{
+	const TemplateKey key { parent, sprite_index, outfit.getColorHash() };
+	auto it = template_space.find(key);
+	if(it != template_space.end()) {
+		template_lru.splice(template_lru.end(), template_lru, it->second.lru_entry);
+		return it->second.image;
+	}
+
+	GameSprite::TemplateImage* img = newd GameSprite::TemplateImage(parent, sprite_index, outfit);
+	template_space.emplace(key, TemplateEntry { img, template_lru.insert(template_lru.end(), key) });
+	return img;
+}
+
+void GraphicManager::clearTemplateImages()
+{
+	for(auto& entry : template_space) {
+		delete entry.second.image;
+	}
+	template_lru.clear();
+	template_space.clear();
+}
+
+void GraphicManager::garbageCollection(const void* view)
+{
+	// A view that draws again starts a new round, the others may still be showing what
+	// they drew in the last one
+	if(std::find(collection_round.begin(), collection_round.end(), view) == collection_round.end()) {
+		collection_round.push_back(view);
+		return;
+	}
+	collection_round.clear();
+	collection_round.push_back(view);
+
+	// Templates are dropped after the round, their textures may have been drawn in it
+	while(template_lru.size() > MaxTemplateImages) {
+		auto it = template_space.find(template_lru.front());
+		delete it->second.image;
+		template_space.erase(it);
+		template_lru.pop_front();
+	}
+
+	const std::shared_ptr<const SettingsSnapshot> settings = g_settings.getSnapshot();
+	if(settings->texture_management && loaded_textures > settings->texture_clean_threshold) {
+		// Dumps are kept for 5 seconds, textures for the longevity setting
+		const int t = time(nullptr);
+		const int longevity = std::max(settings->texture_longevity, 5);
+
+		// The images are ordered by their last visit, so the walk from the cold end stops
+		// at the first one that is too recent, and a frame never cleans more than a few
+		int budget = CleanImagesPerFrame;
+		while(lru_head && budget-- > 0) {
+			GameSprite::Image* image = lru_head;
+			if(t - image->lastaccess <= longevity) {
+				break;
 			}
-			lastclean = t;
+			image->clean(t);
+			unlinkImage(image);
+		}
+	}
+	atlas.nextFrame();
+}
+
+bool GraphicManager::isDecodeAsync() const
+{
+	return decode_async && g_settings.getSnapshot()->sprite_uploads_per_frame > 0;
+}
+
+bool GraphicManager::requestDecode(GameSprite::NormalImage* image)
+{
+	if(image->decoding) {
+		return true;
+	}
+
+	if(!image->dump && !loadSpriteDump(image->dump, image->size, image->id)) {
+		return false;
+	}
+
+	// The dump may be cleaned while the worker runs, it gets a copy
+	std::vector<uint8_t> dump(image->dump, image->dump + image->size);
+	const uint32_t id = image->id;
+	const uint32_t generation = decode_generation;
+	const bool use_alpha = hasTransparency();
+	image->decoding = true;
+	++pending_decodes;
+
+	ThreadPool::getInstance().async([this, dump = std::move(dump), id, generation, use_alpha]() {
+		DecodedSprite sprite { id, generation, std::unique_ptr<uint8_t[]>(newd uint8_t[rme::SpritePixelsSize * 4]) };
+		GameSprite::NormalImage::decodeRGBA(dump.data(), uint16_t(dump.size()), use_alpha, sprite.rgba.get());
+
+		bool first;
+		{
+			std::lock_guard<std::mutex> lock(decoded_mutex);
+			first = decoded_sprites.empty();
+			decoded_sprites.push_back(std::move(sprite));
+		}
+		// Whatever it was drawn in shows the placeholder until it is drawn again
+		if(first) {
+			wxTheApp->CallAfter([]() { g_gui.RefreshView(); });
 		}
+	});
+	return true;
+}
+
+TextureRegion GraphicManager::getPlaceholderRegion()
+{
+	if(placeholder_texture == 0) {
+		std::vector<uint8_t> rgba(rme::SpritePixelsSize * 4);
+		for(size_t i = 0; i < rgba.size(); i += 4) {
+			rgba[i + 0] = 0x80;
+			rgba[i + 1] = 0x80;
+			rgba[i + 2] = 0x80;
+			rgba[i + 3] = 0x30;
+		}
+
+		placeholder_texture = getFreeTextureID();
+		glBindTexture(GL_TEXTURE_2D, placeholder_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rme::SpritePixels, rme::SpritePixels, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
 	}
+
+	TextureRegion region;
+	region.texture = placeholder_texture;
+	return region;
+}
+
+bool GraphicManager::uploadDecodedSprites()
+{
+	if(pending_decodes == 0) {
+		return false;
+	}
+
+	const size_t budget = std::max(g_settings.getSnapshot()->sprite_uploads_per_frame, 1);
+	std::vector<DecodedSprite> ready;
+	bool more;
+	{
+		std::lock_guard<std::mutex> lock(decoded_mutex);
+		const size_t count = std::min(budget, decoded_sprites.size());
+		ready.reserve(count);
+		for(size_t i = 0; i < count; ++i) {
+			ready.push_back(std::move(decoded_sprites.front()));
+			decoded_sprites.pop_front();
+		}
+		more = !decoded_sprites.empty();
+	}
+
+	bool uploaded = false;
+	for(DecodedSprite& sprite : ready) {
+		--pending_decodes;
+		if(sprite.generation != decode_generation) {
+			continue;
+		}
+
+		if(sprite.id >= image_space.size() || !image_space[sprite.id]) {
+			continue;
+		}
+
+		GameSprite::NormalImage* image = static_cast<GameSprite::NormalImage*>(image_space[sprite.id]);
+		image->decoding = false;
+		if(!image->isGLLoaded) {
+			image->uploadRGBA(sprite.rgba.get());
+			uploaded = true;
+		}
+	}
+
+	// Drawings recorded with the placeholder have to be made again
+	if(uploaded) {
+		texture_revision += 1;
+	}
+	return more;
 }
 
 EditorSprite::EditorSprite(wxBitmap* b16x16, wxBitmap* b32x32)
 {
 	bm[SPRITE_SIZE_16x16] = b16x16;
 	bm[SPRITE_SIZE_32x32] = b32x32;
+	png[SPRITE_SIZE_16x16] = { nullptr, 0 };
+	png[SPRITE_SIZE_32x32] = { nullptr, 0 };
+}
+
+EditorSprite::EditorSprite(EmbeddedPNG png16x16, EmbeddedPNG png32x32)
+{
+	bm[SPRITE_SIZE_16x16] = nullptr;
+	bm[SPRITE_SIZE_32x32] = nullptr;
+	png[SPRITE_SIZE_16x16] = png16x16;
+	png[SPRITE_SIZE_32x32] = png32x32;
 }
 
 EditorSprite::~EditorSprite()
@@ -977,9 +1787,21 @@ EditorSprite::~EditorSprite()
 	unloadDC();
 }
 
+wxBitmap* EditorSprite::getBitmap(SpriteSize sz)
+{
+	if(!bm[sz] && png[sz].data) {
+		bm[sz] = _wxGetBitmapFromMemory(png[sz].data, static_cast<int>(png[sz].size));
+		if(!bm[sz]) {
+			// Broken data, don't try to decode it on every draw
+			png[sz].data = nullptr;
+		}
+	}
+	return bm[sz];
+}
+
 void EditorSprite::DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int width, int height)
 {
-	wxBitmap* sp = bm[sz];
+	wxBitmap* sp = getBitmap(sz);
 	if(sp)
 		dc->DrawBitmap(*sp, start_x, start_y, true);
 }
@@ -1011,23 +1833,22 @@ GameSprite::GameSprite() :
 	dc[SPRITE_SIZE_32x32] = nullptr;
 }
 
-GameSprite::~GameSprite()
+size_t GameSprite::getDCMemsize() const
 {
-	unloadDC();
-	for(std::list<TemplateImage*>::iterator iter = instanced_templates.begin(); iter != instanced_templates.end(); ++iter) {
-		delete *iter;
+	size_t mem = 0;
+	for(const wxMemoryDC* context : dc) {
+		if(context) {
+			const wxBitmap& bitmap = context->GetSelectedBitmap();
+			mem += size_t(bitmap.GetWidth()) * bitmap.GetHeight() * 4;
+		}
 	}
-
-	delete animator;
+	return mem;
 }
 
-void GameSprite::clean(int time) {
-	for(std::list<TemplateImage*>::iterator iter = instanced_templates.begin();
-			iter != instanced_templates.end();
-			++iter)
-	{
-		(*iter)->clean(time);
-	}
+GameSprite::~GameSprite()
+{
+	unloadDC();
+	delete animator;
 }
 
 void GameSprite::unloadDC()
@@ -1049,7 +1870,7 @@ int GameSprite::getIndex(int width, int height, int layer, int pattern_x, int pa
 		this->width + width;
 }
 
-GLuint GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame)
+TextureRegion GameSprite::getTextureRegion(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame)
 {
 	uint32_t v;
 	if(_count >= 0 && height <= 1 && width <= 1) {
@@ -1064,32 +1885,15 @@ GLuint GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pa
 			v %= numsprites;
 		}
 	}
-	return spriteList[v]->getHardwareID();
+	return spriteList[v]->getTextureRegion();
 }
 
 GameSprite::TemplateImage* GameSprite::getTemplateImage(int sprite_index, const Outfit& outfit)
 {
-	if(instanced_templates.empty()) {
-		TemplateImage* img = newd TemplateImage(this, sprite_index, outfit);
-		instanced_templates.push_back(img);
-		return img;
-	}
-	// While this is linear lookup, it is very rare for the list to contain more than 4-8 entries, so it's faster than a hashmap anyways.
-	for(std::list<TemplateImage*>::iterator iter = instanced_templates.begin(); iter != instanced_templates.end(); ++iter) {
-		TemplateImage* img = *iter;
-		if(img->sprite_index == sprite_index) {
-			uint32_t lookHash = img->lookHead << 24 | img->lookBody << 16 | img->lookLegs << 8 | img->lookFeet;
-			if(outfit.getColorHash() == lookHash) {
-				return img;
-			}
-		}
-	}
-	TemplateImage* img = newd TemplateImage(this, sprite_index, outfit);
-	instanced_templates.push_back(img);
-	return img;
+	return g_gui.gfx.getTemplateImage(this, sprite_index, outfit);
 }
 
-GLuint GameSprite::getHardwareID(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame)
+TextureRegion GameSprite::getTextureRegion(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame)
 {
 	uint32_t v = getIndex(_x, _y, 0, _dir, _addon, _pattern_z, _frame);
 	if(v >= numsprites) {
@@ -1101,9 +1905,9 @@ GLuint GameSprite::getHardwareID(int _x, int _y, int _dir, int _addon, int _patt
 	}
 	if(layers > 1) { // Template
 		TemplateImage* img = getTemplateImage(v, _outfit);
-		return img->getHardwareID();
+		return img->getTextureRegion();
 	}
-	return spriteList[v]->getHardwareID();
+	return spriteList[v]->getTextureRegion();
 }
 
 wxMemoryDC* GameSprite::getDC(SpriteSize size)
@@ -1148,52 +1952,6 @@ wxMemoryDC* GameSprite::getDC(SpriteSize size)
 	return dc[size];
 }
 
-wxMemoryDC* GameSprite::getDC(const Outfit& outfit)
-{
-	ASSERT(width >= 1 && height >= 1);
-
-	if(dc[SPRITE_SIZE_32x32]) {
-		return dc[SPRITE_SIZE_32x32];
-	}
-
-	const int image_size = std::max<int>(width, height) * rme::SpritePixels;
-	wxImage image(image_size, image_size);
-	image.Clear(g_settings.getInteger(Config::ICON_BACKGROUND));
-
-	const int direction = static_cast<int>(SOUTH) % pattern_x;
-
-	for(uint8_t w = 0; w < width; w++) {
-		for(uint8_t h = 0; h < height; h++) {
-			const int index = getIndex(w, h, 0, direction, 0, 0, 0);
-			uint8_t* data = nullptr;
-			if(layers == 1) {
-				data = spriteList[index]->getRGBData();
-			} else {
-				auto img = getTemplateImage(index, outfit);
-				data = img->getRGBData();
-			}
-			if(data) {
-				wxImage img(rme::SpritePixels, rme::SpritePixels, data);
-				img.SetMaskColour(0xFF, 0x00, 0xFF);
-				image.Paste(img, (width - w - 1) * rme::SpritePixels, (height - h - 1) * rme::SpritePixels);
-				img.Destroy();
-			}
-		}
-	}
-
-	// resizing to 32x32
-	if (image.GetWidth() > rme::SpritePixels || image.GetHeight() > rme::SpritePixels) {
-		image.Rescale(32, 32);
-	}
-
-	wxBitmap bitmap(image);
-	dc[SPRITE_SIZE_32x32] = new wxMemoryDC(bitmap);
-	image.Destroy();
-
-	g_gui.gfx.addSpriteToCleanup(this);
-	return dc[SPRITE_SIZE_32x32];
-}
-
 void GameSprite::DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int width, int height)
 {
 	if(width == -1)  width = sz == SPRITE_SIZE_32x32 ? 32 : 16;
@@ -1209,28 +1967,36 @@ void GameSprite::DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int w
 	}
 }
 
-void GameSprite::DrawTo(wxDC* context, const wxRect& rect, const Outfit& outfit)
+void GameSprite::DrawTo(wxDC* context, const wxRect& rect, const Outfit& outfit, const wxWindow* owner)
 {
-	wxDC* source = getDC(outfit);
-	if(source) {
-		context->Blit(rect.x, rect.y, rect.width, rect.height, source, 0, 0, wxCOPY, true);
+	const wxBitmap* preview = g_gui.gfx.getOutfitPreview(this, outfit, owner);
+	if(preview) {
+		context->DrawBitmap(*preview, rect.x, rect.y, true);
 	} else {
-		const wxBrush& brush = context->GetBrush();
-		context->SetBrush(*wxRED_BRUSH);
-		context->DrawRectangle(rect);
+		const int shade = g_settings.getInteger(Config::ICON_BACKGROUND);
+		const wxBrush brush = context->GetBrush();
+		const wxPen pen = context->GetPen();
+		context->SetBrush(wxBrush(wxColour(shade, shade, shade)));
+		context->SetPen(*wxTRANSPARENT_PEN);
+		context->DrawRectangle(rect.x, rect.y, rme::SpritePixels, rme::SpritePixels);
 		context->SetBrush(brush);
+		context->SetPen(pen);
 	}
 }
 
 GameSprite::Image::Image() :
 	isGLLoaded(false),
-	lastaccess(0)
+	lastaccess(0),
+	lru_prev(nullptr),
+	lru_next(nullptr),
+	in_lru(false)
 {
 	////
 }
 
 GameSprite::Image::~Image()
 {
+	g_gui.gfx.unlinkImage(this);
 	unloadGLTexture(0);
 }
 
@@ -1243,8 +2009,17 @@ void GameSprite::Image::createGLTexture(GLuint textureId)
 		return;
 	}
 
+	uploadGLTexture(textureId, rgba);
+	delete[] rgba;
+}
+
+void GameSprite::Image::uploadGLTexture(GLuint textureId, const uint8_t* rgba)
+{
+	ProfileScope scope(FrameProfiler::SECTION_TEXTURE_UPLOAD);
+
 	isGLLoaded = true;
 	g_gui.gfx.loaded_textures += 1;
+	g_profiler.count(FrameProfiler::COUNTER_SPRITES_LOADED);
 
 	glBindTexture(GL_TEXTURE_2D, textureId);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
@@ -1252,25 +2027,32 @@ void GameSprite::Image::createGLTexture(GLuint textureId)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rme::SpritePixels, rme::SpritePixels, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
-
-	delete[] rgba;
 }
 
 void GameSprite::Image::unloadGLTexture(GLuint textureId)
 {
 	isGLLoaded = false;
 	g_gui.gfx.loaded_textures -= 1;
+	g_gui.gfx.texture_revision += 1;
 	glDeleteTextures(1, &textureId);
 }
 
+TextureRegion GameSprite::Image::getTextureRegion()
+{
+	TextureRegion region;
+	region.texture = getHardwareID();
+	return region;
+}
+
 void GameSprite::Image::visit()
 {
 	lastaccess = time(nullptr);
+	g_gui.gfx.touchImage(this);
 }
 
 void GameSprite::Image::clean(int time)
 {
-	if(isGLLoaded && time - lastaccess > g_settings.getInteger(Config::TEXTURE_LONGEVITY)) {
+	if(isGLLoaded && time - lastaccess > g_settings.getSnapshot()->texture_longevity) {
 		unloadGLTexture(0);
 	}
 }
@@ -1278,20 +2060,30 @@ void GameSprite::Image::clean(int time)
 GameSprite::NormalImage::NormalImage() :
 	id(0),
 	size(0),
-	dump(nullptr)
+	dump(nullptr),
+	shared_dump(false),
+	atlas_slot(0),
+	atlas_generation(0),
+	in_atlas(false),
+	decoding(false)
 {
 	////
 }
 
 GameSprite::NormalImage::~NormalImage()
 {
-	delete[] dump;
+	if(in_atlas) {
+		g_gui.gfx.atlas.release(atlas_slot, atlas_generation);
+	}
+	if(!shared_dump) {
+		delete[] dump;
+	}
 }
 
 void GameSprite::NormalImage::clean(int time)
 {
 	Image::clean(time);
-	if(time - lastaccess > 5 && !g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) { // We keep dumps around for 5 seconds.
+	if(time - lastaccess > 5 && !shared_dump && !g_settings.getSnapshot()->use_memcached_sprites) { // We keep dumps around for 5 seconds.
 		delete[] dump;
 		dump = nullptr;
 	}
@@ -1300,7 +2092,7 @@ void GameSprite::NormalImage::clean(int time)
 uint8_t* GameSprite::NormalImage::getRGBData()
 {
 	if(!dump) {
-		if(g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
+		if(g_settings.getSnapshot()->use_memcached_sprites) {
 			return nullptr;
 		}
 
@@ -1350,7 +2142,7 @@ uint8_t* GameSprite::NormalImage::getRGBData()
 uint8_t* GameSprite::NormalImage::getRGBAData()
 {
 	if(!dump) {
-		if(g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
+		if(g_settings.getSnapshot()->use_memcached_sprites) {
 			return nullptr;
 		}
 
@@ -1359,48 +2151,53 @@ uint8_t* GameSprite::NormalImage::getRGBAData()
 		}
 	}
 
-	const int pixels_data_size = rme::SpritePixelsSize * 4;
-	uint8_t* data = newd uint8_t[pixels_data_size];
-	bool use_alpha = g_gui.gfx.hasTransparency();
-	uint8_t bpp = use_alpha ? 4 : 3;
-	int write = 0;
+	uint8_t* data = newd uint8_t[rme::SpritePixelsSize * 4];
+	decodeRGBA(dump, size, g_gui.gfx.hasTransparency(), data);
+	return data;
+}
+
+void GameSprite::NormalImage::decodeRGBA(const uint8_t* dump, uint16_t size, bool use_alpha, uint8_t* data)
+{
+	const int pixels = rme::SpritePixelsSize;
+	const int bpp = use_alpha ? 4 : 3;
+	int write = 0; // In pixels
 	int read = 0;
 
-	// decompress pixels
-	while(read < size && write < pixels_data_size) {
-		int transparent = dump[read] | dump[read + 1] << 8;
-		if(use_alpha && transparent >= rme::SpritePixelsSize) // Corrupted sprite?
+	// The dump is runs of transparent pixels followed by runs of coloured ones,
+	// transparent runs are cleared and coloured RGBA runs copied as a whole
+	while(read + 4 <= size && write < pixels) {
+		const int transparent = dump[read] | dump[read + 1] << 8;
+		if(use_alpha && transparent >= pixels) // Corrupted sprite?
 			break;
 		read += 2;
-		for(int i = 0; i < transparent && write < pixels_data_size; i++) {
-			data[write + 0] = 0x00; // red
-			data[write + 1] = 0x00; // green
-			data[write + 2] = 0x00; // blue
-			data[write + 3] = 0x00; // alpha
-			write += 4;
-		}
+
+		const int cleared = std::min(transparent, pixels - write);
+		memset(data + write * 4, 0, cleared * 4);
+		write += cleared;
 
 		int colored = dump[read] | dump[read + 1] << 8;
 		read += 2;
-		for(int i = 0; i < colored && write < pixels_data_size; i++) {
-			data[write + 0] = dump[read + 0]; // red
-			data[write + 1] = dump[read + 1]; // green
-			data[write + 2] = dump[read + 2]; // blue
-			data[write + 3] = use_alpha ? dump[read + 3] : 0xFF; // alpha
-			write += 4;
-			read += bpp;
+		colored = std::min({ colored, pixels - write, (size - read) / bpp });
+		if(use_alpha) {
+			memcpy(data + write * 4, dump + read, colored * 4);
+		} else {
+			uint8_t* out = data + write * 4;
+			const uint8_t* in = dump + read;
+			for(int i = 0; i < colored; ++i, out += 4, in += 3) {
+				out[0] = in[0]; // red
+				out[1] = in[1]; // green
+				out[2] = in[2]; // blue
+				out[3] = 0xFF; // alpha
+			}
 		}
+		write += colored;
+		read += colored * bpp;
 	}
 
 	// fill remaining pixels
-	while(write < pixels_data_size) {
-		data[write + 0] = 0x00; // red
-		data[write + 1] = 0x00; // green
-		data[write + 2] = 0x00; // blue
-		data[write + 3] = 0x00; // alpha
-		write += 4;
+	if(write < pixels) {
+		memset(data + write * 4, 0, (pixels - write) * 4);
 	}
-	return data;
 }
 
 GLuint GameSprite::NormalImage::getHardwareID()
@@ -1412,13 +2209,73 @@ GLuint GameSprite::NormalImage::getHardwareID()
 	return id;
 }
 
+TextureRegion GameSprite::NormalImage::getTextureRegion()
+{
+	if(isGLLoaded && in_atlas && !g_gui.gfx.atlas.touch(atlas_slot, atlas_generation)) {
+		// The cell was given to another sprite
+		unloadGLTexture(0);
+	}
+	if(!isGLLoaded) {
+		if(g_gui.gfx.isDecodeAsync()) {
+			if(!g_gui.gfx.requestDecode(this)) {
+				return TextureRegion();
+			}
+			visit();
+			return g_gui.gfx.getPlaceholderRegion();
+		}
+		createGLTexture(0);
+		if(!isGLLoaded) {
+			return TextureRegion();
+		}
+	}
+	visit();
+
+	if(in_atlas) {
+		return g_gui.gfx.atlas.getRegion(atlas_slot);
+	}
+	TextureRegion region;
+	region.texture = id;
+	return region;
+}
+
 void GameSprite::NormalImage::createGLTexture(GLuint textureId)
 {
-	Image::createGLTexture(id);
+	ASSERT(!isGLLoaded);
+
+	uint8_t* rgba = getRGBAData();
+	if(!rgba) {
+		return;
+	}
+
+	uploadRGBA(rgba);
+	delete[] rgba;
+}
+
+void GameSprite::NormalImage::uploadRGBA(const uint8_t* rgba)
+{
+	ProfileScope scope(FrameProfiler::SECTION_TEXTURE_UPLOAD);
+
+	in_atlas = g_gui.gfx.atlas.insert(rgba, atlas_slot, atlas_generation);
+	if(in_atlas) {
+		isGLLoaded = true;
+		g_gui.gfx.loaded_textures += 1;
+		g_profiler.count(FrameProfiler::COUNTER_SPRITES_LOADED);
+		return;
+	}
+
+	// No room for another page, use a texture of its own
+	uploadGLTexture(id, rgba);
 }
 
 void GameSprite::NormalImage::unloadGLTexture(GLuint textureId)
 {
+	if(in_atlas) {
+		g_gui.gfx.atlas.release(atlas_slot, atlas_generation);
+		in_atlas = false;
+		isGLLoaded = false;
+		g_gui.gfx.loaded_textures -= 1;
+		return;
+	}
 	Image::unloadGLTexture(id);
 }
 
@@ -1502,15 +2359,31 @@ GameSprite::TemplateImage::~TemplateImage()
 	////
 }
 
-void GameSprite::TemplateImage::colorizePixel(uint8_t color, uint8_t& red, uint8_t& green, uint8_t& blue)
+// Multiplies every pixel of data by the outfit color the template mask picks for it.
+// Each mask pixel selects a row of channel factors, so the loop runs without branches.
+static void colorizeTemplate(uint8_t* data, int channels, const uint8_t* mask, const uint8_t (&looks)[4])
 {
-	// Thanks! Khaos, or was it mips? Hmmm... =)
-	uint8_t ro = (TemplateOutfitLookupTable[color] & 0xFF0000) >> 16; // rgb outfit
-	uint8_t go = (TemplateOutfitLookupTable[color] & 0xFF00) >> 8;
-	uint8_t bo = (TemplateOutfitLookupTable[color] & 0xFF);
-	red = (uint8_t)(red * (ro / 255.f));
-	green = (uint8_t)(green * (go / 255.f));
-	blue = (uint8_t)(blue * (bo / 255.f));
+	static constexpr size_t LookupTableSize = sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]);
+	// Indexed by red << 2 | green << 1 | blue of the mask: yellow => head, red => body,
+	// green => legs, blue => feet, anything else keeps its color
+	static constexpr uint8_t MaskParts[8] = { 0, 4, 3, 0, 2, 0, 1, 0 };
+
+	uint16_t factors[5][3] = { { 255, 255, 255 } };
+	for(int part = 0; part < 4; ++part) {
+		const uint32_t color = TemplateOutfitLookupTable[looks[part] < LookupTableSize ? looks[part] : 0];
+		factors[part + 1][0] = (color >> 16) & 0xFF;
+		factors[part + 1][1] = (color >> 8) & 0xFF;
+		factors[part + 1][2] = color & 0xFF;
+	}
+
+	for(int i = 0; i < rme::SpritePixelsSize; ++i) {
+		const uint8_t* m = mask + i * 3;
+		const uint16_t* factor = factors[MaskParts[(m[0] != 0) << 2 | (m[1] != 0) << 1 | (m[2] != 0)]];
+		uint8_t* pixel = data + i * channels;
+		pixel[0] = uint8_t(pixel[0] * factor[0] / 255);
+		pixel[1] = uint8_t(pixel[1] * factor[1] / 255);
+		pixel[2] = uint8_t(pixel[2] * factor[2] / 255);
+	}
 }
 
 uint8_t* GameSprite::TemplateImage::getRGBData()
@@ -1527,40 +2400,8 @@ uint8_t* GameSprite::TemplateImage::getRGBData()
 		return nullptr;
 	}
 
-	if(lookHead > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookHead = 0;
-	}
-	if(lookBody > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookBody = 0;
-	}
-	if(lookLegs > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookLegs = 0;
-	}
-	if(lookFeet > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookFeet = 0;
-	}
-
-	for(int y = 0; y < rme::SpritePixels; ++y) {
-		for(int x = 0; x < rme::SpritePixels; ++x) {
-			uint8_t& red   = rgbdata[y*rme::SpritePixels*3 + x*3 + 0];
-			uint8_t& green = rgbdata[y*rme::SpritePixels*3 + x*3 + 1];
-			uint8_t& blue  = rgbdata[y*rme::SpritePixels*3 + x*3 + 2];
-
-			uint8_t& tred   = template_rgbdata[y*rme::SpritePixels*3 + x*3 + 0];
-			uint8_t& tgreen = template_rgbdata[y*rme::SpritePixels*3 + x*3 + 1];
-			uint8_t& tblue  = template_rgbdata[y*rme::SpritePixels*3 + x*3 + 2];
-
-			if(tred && tgreen && !tblue) { // yellow => head
-				colorizePixel(lookHead, red, green, blue);
-			} else if(tred && !tgreen && !tblue) { // red => body
-				colorizePixel(lookBody, red, green, blue);
-			} else if(!tred && tgreen && !tblue) { // green => legs
-				colorizePixel(lookLegs, red, green, blue);
-			} else if(!tred && !tgreen && tblue) { // blue => feet
-				colorizePixel(lookFeet, red, green, blue);
-			}
-		}
-	}
+	const uint8_t looks[4] = { lookHead, lookBody, lookLegs, lookFeet };
+	colorizeTemplate(rgbdata, 3, template_rgbdata, looks);
 	delete[] template_rgbdata;
 	return rgbdata;
 }
@@ -1579,42 +2420,154 @@ uint8_t* GameSprite::TemplateImage::getRGBAData()
 		return nullptr;
 	}
 
-	if(lookHead > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookHead = 0;
+	const uint8_t looks[4] = { lookHead, lookBody, lookLegs, lookFeet };
+	colorizeTemplate(rgbadata, 4, template_rgbdata, looks);
+	delete[] template_rgbdata;
+	return rgbadata;
+}
+
+const wxBitmap* GraphicManager::getOutfitPreview(GameSprite* sprite, const Outfit& outfit, const wxWindow* owner)
+{
+	const uint8_t background = uint8_t(g_settings.getInteger(Config::ICON_BACKGROUND));
+	const uint64_t key = uint64_t(uint16_t(outfit.lookType)) << 40 | uint64_t(background) << 32 | outfit.getColorHash();
+
+	auto found = outfit_preview_index.find(key);
+	if(found != outfit_preview_index.end()) {
+		outfit_previews.splice(outfit_previews.begin(), outfit_previews, found->second);
+		return &found->second->bitmap;
 	}
-	if(lookBody > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookBody = 0;
+
+	auto pending = pending_previews.find(key);
+	if(pending != pending_previews.end()) {
+		std::vector<wxWeakRef<wxWindow>>& owners = pending->second;
+		if(owner && std::none_of(owners.begin(), owners.end(), [owner](const wxWeakRef<wxWindow>& window) { return window.get() == owner; })) {
+			owners.emplace_back(const_cast<wxWindow*>(owner));
+		}
+		return nullptr;
 	}
-	if(lookLegs > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookLegs = 0;
+
+	// The dumps are read here, the sprite file is not shared with the workers
+	std::vector<OutfitPreviewPiece> pieces;
+	const int direction = static_cast<int>(SOUTH) % std::max<int>(sprite->pattern_x, 1);
+	const size_t mask_offset = size_t(sprite->width) * sprite->height;
+	auto copyDump = [this](GameSprite::NormalImage* image, std::vector<uint8_t>& dump) {
+		if(!image->dump && !loadSpriteDump(image->dump, image->size, image->id)) {
+			return false;
+		}
+		dump.assign(image->dump, image->dump + image->size);
+		return true;
+	};
+	for(uint8_t w = 0; w < sprite->width; ++w) {
+		for(uint8_t h = 0; h < sprite->height; ++h) {
+			const size_t index = sprite->getIndex(w, h, 0, direction, 0, 0, 0);
+			if(index >= sprite->spriteList.size()) {
+				continue;
+			}
+
+			OutfitPreviewPiece piece;
+			piece.x = (sprite->width - w - 1) * rme::SpritePixels;
+			piece.y = (sprite->height - h - 1) * rme::SpritePixels;
+			if(!copyDump(sprite->spriteList[index], piece.dump)) {
+				continue;
+			}
+			if(sprite->layers > 1 && (index + mask_offset >= sprite->spriteList.size() || !copyDump(sprite->spriteList[index + mask_offset], piece.mask))) {
+				continue;
+			}
+			pieces.push_back(std::move(piece));
+		}
 	}
-	if(lookFeet > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookFeet = 0;
+
+	std::vector<wxWeakRef<wxWindow>>& owners = pending_previews[key];
+	if(owner) {
+		owners.emplace_back(const_cast<wxWindow*>(owner));
 	}
 
-	for(int y = 0; y < rme::SpritePixels; ++y) {
-		for(int x = 0; x < rme::SpritePixels; ++x) {
-			uint8_t& red   = rgbadata[y*rme::SpritePixels*4 + x*4 + 0];
-			uint8_t& green = rgbadata[y*rme::SpritePixels*4 + x*4 + 1];
-			uint8_t& blue  = rgbadata[y*rme::SpritePixels*4 + x*4 + 2];
+	const int image_size = std::max<int>(sprite->width, sprite->height) * rme::SpritePixels;
+	const bool use_alpha = hasTransparency();
+	const uint32_t generation = decode_generation;
+	ThreadPool::getInstance().async([this, pieces = std::move(pieces), image_size, background, use_alpha, generation, key,
+			looks = std::array<uint8_t, 4> { uint8_t(outfit.lookHead), uint8_t(outfit.lookBody), uint8_t(outfit.lookLegs), uint8_t(outfit.lookFeet) }]() {
+		const uint8_t parts[4] = { looks[0], looks[1], looks[2], looks[3] };
+		std::vector<uint8_t> rgb = composeOutfitPreview(pieces, image_size, background, use_alpha, parts);
+		wxTheApp->CallAfter([this, key, generation, rgb = std::move(rgb)]() {
+			finishOutfitPreview(key, generation, rgb);
+		});
+	});
+	return nullptr;
+}
 
-			uint8_t& tred   = template_rgbdata[y*rme::SpritePixels*3 + x*3 + 0];
-			uint8_t& tgreen = template_rgbdata[y*rme::SpritePixels*3 + x*3 + 1];
-			uint8_t& tblue  = template_rgbdata[y*rme::SpritePixels*3 + x*3 + 2];
+std::vector<uint8_t> GraphicManager::composeOutfitPreview(const std::vector<OutfitPreviewPiece>& pieces, int image_size, uint8_t background, bool use_alpha, const uint8_t (&looks)[4])
+{
+	wxImage image(image_size, image_size, false);
+	uint8_t* data = image.GetData();
+	memset(data, background, size_t(image_size) * image_size * 3);
 
-			if(tred && tgreen && !tblue) { // yellow => head
-				colorizePixel(lookHead, red, green, blue);
-			} else if(tred && !tgreen && !tblue) { // red => body
-				colorizePixel(lookBody, red, green, blue);
-			} else if(!tred && tgreen && !tblue) { // green => legs
-				colorizePixel(lookLegs, red, green, blue);
-			} else if(!tred && !tgreen && tblue) { // blue => feet
-				colorizePixel(lookFeet, red, green, blue);
+	std::vector<uint8_t> rgba(rme::SpritePixelsSize * 4);
+	std::vector<uint8_t> mask_rgba(rme::SpritePixelsSize * 4);
+	std::vector<uint8_t> mask(rme::SpritePixelsSize * 3);
+	for(const OutfitPreviewPiece& piece : pieces) {
+		GameSprite::NormalImage::decodeRGBA(piece.dump.data(), uint16_t(piece.dump.size()), use_alpha, rgba.data());
+		if(!piece.mask.empty()) {
+			GameSprite::NormalImage::decodeRGBA(piece.mask.data(), uint16_t(piece.mask.size()), use_alpha, mask_rgba.data());
+			for(int i = 0; i < rme::SpritePixelsSize; ++i) {
+				memcpy(&mask[i * 3], &mask_rgba[i * 4], 3);
+			}
+			colorizeTemplate(rgba.data(), 4, mask.data(), looks);
+		}
+
+		// Pasted over the background where the sprite isn't transparent
+		for(int y = 0; y < rme::SpritePixels; ++y) {
+			const uint8_t* in = &rgba[y * rme::SpritePixels * 4];
+			uint8_t* out = data + (size_t(piece.y + y) * image_size + piece.x) * 3;
+			for(int x = 0; x < rme::SpritePixels; ++x, in += 4, out += 3) {
+				if(in[3] != 0) {
+					out[0] = in[0];
+					out[1] = in[1];
+					out[2] = in[2];
+				}
 			}
 		}
 	}
-	delete[] template_rgbdata;
-	return rgbadata;
+
+	if(image_size > rme::SpritePixels) {
+		image.Rescale(rme::SpritePixels, rme::SpritePixels);
+	}
+	// The image stays on this thread, its data isn't reference counted atomically
+	return std::vector<uint8_t>(image.GetData(), image.GetData() + rme::SpritePixelsSize * 3);
+}
+
+void GraphicManager::finishOutfitPreview(uint64_t key, uint32_t generation, const std::vector<uint8_t>& rgb)
+{
+	// Composed from the sprites of a version that has been unloaded since
+	if(generation != decode_generation) {
+		return;
+	}
+
+	wxImage image(rme::SpritePixels, rme::SpritePixels, false);
+	memcpy(image.GetData(), rgb.data(), rgb.size());
+	outfit_previews.push_front(OutfitPreview { key, wxBitmap(image) });
+	outfit_preview_index[key] = outfit_previews.begin();
+	while(outfit_previews.size() > MaxOutfitPreviews) {
+		outfit_preview_index.erase(outfit_previews.back().key);
+		outfit_previews.pop_back();
+	}
+
+	auto pending = pending_previews.find(key);
+	if(pending != pending_previews.end()) {
+		for(wxWindow* window : pending->second) {
+			if(window) {
+				window->Refresh();
+			}
+		}
+		pending_previews.erase(pending);
+	}
+}
+
+void GraphicManager::clearOutfitPreviews()
+{
+	outfit_previews.clear();
+	outfit_preview_index.clear();
+	pending_previews.clear();
 }
 
 GLuint GameSprite::TemplateImage::getHardwareID()
@@ -1667,11 +2620,11 @@ Animator::Animator(int frame_count, int start_frame, int loop_count, bool async)
 	start_frame(start_frame),
 	loop_count(loop_count),
 	async(async),
+	current_phase(0),
 	current_frame(0),
 	current_loop(0),
 	current_duration(0),
 	total_duration(0),
-	direction(ANIMATION_FORWARD),
 	last_time(0),
 	is_complete(false)
 {
@@ -1707,32 +2660,31 @@ FrameDuration* Animator::getFrameDuration(int frame)
 
 int Animator::getFrame()
 {
-	long time = g_gui.gfx.getElapsedTime();
-	if(time != last_time && !is_complete) {
-		long elapsed = time - last_time;
-		if(elapsed >= current_duration) {
-			int frame = 0;
-			if(loop_count < 0)
-				frame = getPingPongFrame();
-			else
-				frame = getLoopFrame();
+	const long time = g_gui.gfx.getElapsedTime();
+	if(time == last_time || is_complete)
+		return current_frame;
 
-			if(current_frame != frame) {
-				int duration = getDuration(frame) - (elapsed - current_duration);
-				if(duration < 0 && !async) {
-					calculateSynchronous();
-				} else {
-					current_frame = frame;
-					current_duration = std::max<int>(0, duration);
-				}
-			} else {
-				is_complete = true;
-			}
-		} else {
-			current_duration -= elapsed;
-		}
+	const long elapsed = time - last_time;
+	last_time = time;
+	if(elapsed < current_duration) {
+		current_duration -= elapsed;
+		return current_frame;
+	}
 
-		last_time = time;
+	const int phase = loop_count < 0 ? getPingPongPhase() : getLoopPhase();
+	const int frame = phases[phase];
+	if(current_frame == frame) {
+		is_complete = true;
+		return current_frame;
+	}
+
+	const int duration = getDuration(frame) - (elapsed - current_duration);
+	if(duration < 0 && !async) {
+		calculateSynchronous();
+	} else {
+		current_phase = phase;
+		current_frame = frame;
+		current_duration = std::max<int>(0, duration);
 	}
 	return current_frame;
 }
@@ -1754,6 +2706,7 @@ void Animator::setFrame(int frame)
 		else
 			current_frame = getStartFrame();
 
+		current_phase = current_frame;
 		is_complete = false;
 		last_time = g_gui.gfx.getElapsedTime();
 		current_duration = getDuration(current_frame);
@@ -1765,12 +2718,21 @@ void Animator::setFrame(int frame)
 
 void Animator::reset()
 {
-	total_duration = 0;
+	phases.clear();
+	for(int i = 0; i < frame_count; i++)
+		phases.push_back(i);
+	if(loop_count < 0) {
+		for(int i = frame_count - 2; i > 0; i--)
+			phases.push_back(i);
+	}
+
+	frame_starts.assign(1, 0);
 	for(int i = 0; i < frame_count; i++)
-		total_duration += durations[i]->max;
+		frame_starts.push_back(frame_starts.back() + durations[i]->max);
+	total_duration = frame_starts.back();
 
 	is_complete = false;
-	direction = ANIMATION_FORWARD;
+	current_phase = current_frame;
 	current_loop = 0;
 	async = false;
 	setFrame(-1);
@@ -1782,20 +2744,14 @@ int Animator::getDuration(int frame) const
 	return durations[frame]->getDuration();
 }
 
-int Animator::getPingPongFrame()
+int Animator::getPingPongPhase() const
 {
-	int count = direction == ANIMATION_FORWARD ? 1 : -1;
-	int next_frame = current_frame + count;
-	if(next_frame < 0 || next_frame >= frame_count) {
-		direction = direction == ANIMATION_FORWARD ? ANIMATION_BACKWARD : ANIMATION_FORWARD;
-		count *= -1;
-	}
-	return current_frame + count;
+	return (current_phase + 1) % int(phases.size());
 }
 
-int Animator::getLoopFrame()
+int Animator::getLoopPhase()
 {
-	int next_phase = current_frame + 1;
+	int next_phase = current_phase + 1;
 	if(next_phase < frame_count)
 		return next_phase;
 
@@ -1806,24 +2762,19 @@ int Animator::getLoopFrame()
 		current_loop++;
 		return 0;
 	}
-	return current_frame;
+	return current_phase;
 }
 
 void Animator::calculateSynchronous()
 {
-	long time = g_gui.gfx.getElapsedTime();
+	const long time = g_gui.gfx.getElapsedTime();
 	if(time > 0 && total_duration > 0) {
-		long elapsed = time % total_duration;
-		int total_time = 0;
-		for(int i = 0; i < frame_count; i++) {
-			int duration = getDuration(i);
-			if(elapsed >= total_time && elapsed < total_time + duration) {
-				current_frame = i;
-				current_duration = duration - (elapsed - total_time);
-				break;
-			}
-			total_time += duration;
-		}
+		const long elapsed = time % total_duration;
+		// The last frame starting at or before elapsed, frames of no duration are passed over
+		const int frame = int(std::upper_bound(frame_starts.begin(), frame_starts.end(), elapsed) - frame_starts.begin()) - 1;
+		current_phase = frame;
+		current_frame = frame;
+		current_duration = frame_starts[frame + 1] - elapsed;
 		last_time = time;
 	}
 }
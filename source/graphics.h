@@ -21,10 +21,16 @@
 #include "outfit.h"
 #include "common.h"
 #include <deque>
+#include <mutex>
+#include <atomic>
 
 #include "client_version.h"
+#include "glyph_atlas.h"
+#include "shader_renderer.h"
+#include "texture_atlas.h"
 
 #include <wx/artprov.h>
+#include <wx/weakref.h>
 
 enum SpriteSize {
 	SPRITE_SIZE_16x16,
@@ -33,11 +39,6 @@ enum SpriteSize {
 	SPRITE_SIZE_COUNT
 };
 
-enum AnimationDirection {
-	ANIMATION_FORWARD = 0,
-	ANIMATION_BACKWARD = 1
-};
-
 enum ItemAnimationDuration {
 	ITEM_FRAME_DURATION = 500
 };
@@ -45,6 +46,7 @@ enum ItemAnimationDuration {
 class MapCanvas;
 class GraphicManager;
 class FileReadHandle;
+class MemoryReadHandle;
 class Animator;
 
 struct SpriteLight {
@@ -64,17 +66,28 @@ private:
 	Sprite(const Sprite&);
 };
 
+// A PNG file compiled into the editor
+struct EmbeddedPNG {
+	const unsigned char* data;
+	size_t size;
+};
+
 class EditorSprite : public Sprite
 {
 public:
 	EditorSprite(wxBitmap* b16x16, wxBitmap* b32x32);
+	// Keeps the embedded PNG data and decodes each size the first time it is drawn
+	EditorSprite(EmbeddedPNG png16x16, EmbeddedPNG png32x32);
 	virtual ~EditorSprite();
 
 	virtual void DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int width = -1, int height = -1);
 	virtual void unloadDC();
 
 protected:
+	wxBitmap* getBitmap(SpriteSize sz);
+
 	wxBitmap* bm[SPRITE_SIZE_COUNT];
+	EmbeddedPNG png[SPRITE_SIZE_COUNT];
 };
 
 class GameSprite : public Sprite
@@ -84,14 +97,16 @@ public:
 	virtual ~GameSprite();
 
 	int getIndex(int width, int height, int layer, int pattern_x, int pattern_y, int pattern_z, int frame) const;
-	GLuint getHardwareID(int _x, int _y, int _layer, int _subtype, int _pattern_x, int _pattern_y, int _pattern_z, int _frame);
-	GLuint getHardwareID(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame); // CreatureDatabase
+	TextureRegion getTextureRegion(int _x, int _y, int _layer, int _subtype, int _pattern_x, int _pattern_y, int _pattern_z, int _frame);
+	TextureRegion getTextureRegion(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame); // CreatureDatabase
 	virtual void DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int width = -1, int height = -1);
-	void DrawTo(wxDC* context, const wxRect& rect, const Outfit& outfit);
+	// The outfit facing south, composed in the background the first time. Until then its
+	// square is left blank and owner is refreshed once the preview is ready.
+	void DrawTo(wxDC* context, const wxRect& rect, const Outfit& outfit, const wxWindow* owner);
 
 	virtual void unloadDC();
-
-	void clean(int time);
+	// Bytes held by the software bitmaps made for the palettes, 0 once unloaded
+	size_t getDCMemsize() const;
 
 	uint16_t getDrawHeight() const noexcept { return draw_height; }
 	const wxPoint& getDrawOffset() const noexcept { return draw_offset; }
@@ -108,7 +123,6 @@ protected:
 	class TemplateImage;
 
 	wxMemoryDC* getDC(SpriteSize size);
-	wxMemoryDC* getDC(const Outfit& outfit);
 	TemplateImage* getTemplateImage(int sprite_index, const Outfit& outfit);
 
 	class Image {
@@ -119,16 +133,28 @@ protected:
 		bool isGLLoaded;
 		int lastaccess;
 
+		// Marks the image as just used, moving it to the recent end of the cleanup list
 		void visit();
 		virtual void clean(int time);
 
 		virtual GLuint getHardwareID() = 0;
+		// The whole texture of getHardwareID, unless the image lives in the atlas
+		virtual TextureRegion getTextureRegion();
 		virtual uint8_t* getRGBData() = 0;
 		virtual uint8_t* getRGBAData() = 0;
 
 	protected:
 		virtual void createGLTexture(GLuint textureId);
 		virtual void unloadGLTexture(GLuint textureId);
+		// Gives the texture the decoded pixels, rme::SpritePixelsSize RGBA
+		void uploadGLTexture(GLuint textureId, const uint8_t* rgba);
+
+		// Neighbours in the cleanup list of GraphicManager, ordered by lastaccess
+		Image* lru_prev;
+		Image* lru_next;
+		bool in_lru;
+
+		friend class GraphicManager;
 	};
 
 	class NormalImage : public Image {
@@ -142,21 +168,42 @@ protected:
 		// This contains the pixel data
 		uint16_t size;
 		uint8_t* dump;
+		// The dump points into the sprite file held by GraphicManager and isn't freed here
+		bool shared_dump;
+
+		// Cell in the sprite atlas, valid as long as the generation matches
+		uint32_t atlas_slot;
+		uint32_t atlas_generation;
+		bool in_atlas;
+		// Handed to the thread pool to be decoded (GraphicManager::requestDecode)
+		bool decoding;
 
 		virtual void clean(int time);
 
 		virtual GLuint getHardwareID();
+		virtual TextureRegion getTextureRegion();
 		virtual uint8_t* getRGBData();
 		virtual uint8_t* getRGBAData();
 
+		// Decompresses the pixels of a sprite dump into data, rme::SpritePixelsSize RGBA,
+		// only touches its arguments so it can run on any thread
+		static void decodeRGBA(const uint8_t* dump, uint16_t size, bool use_alpha, uint8_t* data);
+
 	protected:
 		virtual void createGLTexture(GLuint textureId = 0);
 		virtual void unloadGLTexture(GLuint textureId = 0);
+		// Into the atlas when there is room, a texture of its own otherwise
+		void uploadRGBA(const uint8_t* rgba);
+
+		friend class GraphicManager;
 	};
 
 	class EditorImage : public NormalImage {
 	public:
 		EditorImage(const wxArtID& bitmapId);
+
+		// Editor sprites keep their own textures
+		TextureRegion getTextureRegion() override { return Image::getTextureRegion(); }
 	protected:
 		void createGLTexture(GLuint textureId) override;
 		void unloadGLTexture(GLuint textureId) override;
@@ -181,8 +228,6 @@ protected:
 		uint8_t lookLegs;
 		uint8_t lookFeet;
 	protected:
-		void colorizePixel(uint8_t color, uint8_t &r, uint8_t &b, uint8_t &g);
-
 		virtual void createGLTexture(GLuint ignored = 0);
 		virtual void unloadGLTexture(GLuint ignored = 0);
 	};
@@ -212,7 +257,6 @@ public:
 	SpriteLight light;
 
 	std::vector<NormalImage*> spriteList;
-	std::list<TemplateImage*> instanced_templates; // Templates that use this sprite
 
 	friend class GraphicManager;
 };
@@ -259,8 +303,9 @@ public:
 
 private:
 	int getDuration(int frame) const;
-	int getPingPongFrame();
-	int getLoopFrame();
+	// Index into phases of the frame shown after the current one
+	int getPingPongPhase() const;
+	int getLoopPhase();
 	void calculateSynchronous();
 
 	int frame_count;
@@ -268,13 +313,20 @@ private:
 	int loop_count;
 	bool async;
 	std::vector<FrameDuration*> durations;
+	// Frames in the order they are shown, a ping pong animation runs forward and
+	// back again; the first frame_count phases are the frames themselves
+	std::vector<int> phases;
+	// When every frame starts within total_duration, for synchronous animations
+	std::vector<int> frame_starts;
+	int current_phase;
 	int current_frame;
 	int current_loop;
 	int current_duration;
 	int total_duration;
-	AnimationDirection direction;
 	long last_time;
 	bool is_complete;
+
+	friend class GraphicManager;
 };
 
 struct SignatureData
@@ -293,12 +345,19 @@ public:
 
 	void clear();
 	void cleanSoftwareSprites();
+	// Exchanges the loaded client version with the one held by other, a manager nothing is
+	// drawn with. The textures of the current one are released first, they are made again
+	// once its sprites are drawn.
+	void swapVersion(GraphicManager& other);
 
 	Sprite* getSprite(int id);
 	GameSprite* getCreatureSprite(int id);
 	GameSprite* getEditorSprite(int id);
 
-	long getElapsedTime() const { return (animation_timer->TimeInMicro() / 1000).ToLong(); }
+	// The animation clock, sampled by updateElapsedTime once per frame so all
+	// animators drawn in it show the same moment without reading the clock
+	long getElapsedTime() const noexcept { return elapsed_time; }
+	void updateElapsedTime() { elapsed_time = (animation_timer->TimeInMicro() / 1000).ToLong(); }
 
 	uint16_t getItemSpriteMinID() const noexcept { return 100; }
 	uint16_t getItemSpriteMaxID() const noexcept { return item_count; }
@@ -315,20 +374,82 @@ public:
 
 	// datOnlyLoad - we load items.dat, meaning we will be ignoring .otb, and so we want full info from dat.
 	bool loadSpriteMetadata(const FileName& datafile, wxString& error, wxArrayString& warnings, bool datOnlyLoad);
-	bool loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings, bool datOnlyLoad, ItemType* iType);
+	bool loadSpriteMetadataFlags(MemoryReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings, bool datOnlyLoad, ItemType* iType);
+	// Snapshot of what loadSpriteMetadata built, kept next to the local data of the client
+	// version and only used while the dat file and the options it was read with are unchanged
+	bool loadMetadataCache(const FileName& datafile, bool datOnlyLoad);
+	void saveMetadataCache(const FileName& datafile, bool datOnlyLoad);
 
 	bool loadSpriteData(const FileName& datafile, wxString& error, wxArrayString& warnings);
-
-	// Cleans old & unused textures according to config settings
-	void garbageCollection();
+	// Reads the pixel data of all given sprites that are not loaded yet, in file order
+	void prefetchSprites(const std::vector<GameSprite*>& sprites);
+
+	// Cleans old & unused textures according to config settings, at most CleanImagesPerFrame per call.
+	// Every map view calls it after drawing; the views share the context and the textures, so
+	// the cleaning runs once per round in which each view drew at most once, and nothing
+	// another view drew in the same round is evicted.
+	void garbageCollection(const void* view);
+	static constexpr int CleanImagesPerFrame = 64;
 	void addSpriteToCleanup(GameSprite* spr);
 
+	// Sprites that are drawn before their pixels were decoded are decoded on the thread pool
+	// and drawn as a placeholder meanwhile. The render thread uploads what was decoded at the
+	// start of a frame, at most Config::SPRITE_UPLOADS_PER_FRAME at a time. With a budget of 0,
+	// or while async decoding is off (screenshots), sprites are decoded when they are drawn.
+	bool isDecodeAsync() const;
+	void setDecodeAsync(bool async) noexcept { decode_async = async; }
+	// False if the pixels of the sprite can't be read
+	bool requestDecode(GameSprite::NormalImage* image);
+	TextureRegion getPlaceholderRegion();
+	// Needs the GL context, returns true when decoded sprites were left for the next frame
+	bool uploadDecodedSprites();
+
+	// 32x32 previews of outfits for the lists of creatures. They are composed on the thread
+	// pool, nullptr is returned until one is ready and owner is refreshed then. The most
+	// recently drawn MaxOutfitPreviews are kept.
+	const wxBitmap* getOutfitPreview(GameSprite* sprite, const Outfit& outfit, const wxWindow* owner);
+
 	wxFileName getMetadataFileName() const { return metadata_file; }
 	wxFileName getSpritesFileName() const { return sprites_file; }
 
 	bool hasTransparency() const;
 	bool isUnloaded() const;
 
+	struct MemoryUsage {
+		// Game sprites in the atlas, and the atlas pages holding them
+		size_t atlas_sprites = 0;
+		size_t atlas_pages = 0;
+		size_t atlas_bytes = 0;
+		// Outfit templates, editor sprites and whatever didn't fit in the atlas
+		size_t textures = 0;
+		size_t texture_bytes = 0;
+		// Compressed pixels read from the sprite file
+		size_t sprite_dumps = 0;
+		size_t sprite_dump_bytes = 0;
+		// Bitmaps waiting in the cleanup list, at most Config::SOFTWARE_CLEAN_THRESHOLD
+		size_t software_sprites = 0;
+		size_t software_bytes = 0;
+	};
+	// Estimates, the driver may keep more for mipmaps and alignment
+	MemoryUsage getMemoryUsage() const;
+
+	// Changes whenever a texture that was handed out may no longer hold the same sprite
+	uint32_t getTextureRevision() const noexcept { return texture_revision + atlas.getRevision(); }
+
+	// The renderer of Config::RENDER_BACKEND, nullptr for the fixed function
+	// pipeline or when the driver can't run the shaders
+	ShaderRenderer* getShaderRenderer();
+	// The light map on the GPU, along with the shader backend only
+	ShaderLightRenderer* getLightRenderer();
+
+	// Interface font of the map views
+	GlyphAtlas& getGlyphAtlas() noexcept { return glyph_atlas; }
+	// A line along the top and left edge of a tile, repeated over the view to draw the grid
+	// with one quad. Every mipmap level has a line one texel wide, so it stays one pixel wide
+	// at any zoom.
+	GLuint getGridTexture();
+	static constexpr int GridTextureSize = rme::TileSize * 8;
+
 	ClientVersion *client_version;
 
 	// Basically, signatures is used for predicting protocol version (unless somebody has custom signature...)
@@ -350,12 +471,24 @@ private:;
 	bool unloaded;
 	// This is used if memcaching is NOT on
 	std::string spritefile;
+	FileReadHandle* sprite_handle;
+	// File offset of every sprite, indexed by sprite id - 1
+	std::vector<uint32_t> sprite_indexes;
+	// This is used if memcaching is on, the whole sprite file
+	std::vector<uint8_t> sprite_data;
 	bool loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite_id);
 
-	typedef std::map<int, Sprite*> SpriteMap;
-	SpriteMap sprite_space;
-	typedef std::map<int, GameSprite::Image*> ImageMap;
-	ImageMap image_space;
+	// Sprite and image ids are dense, so they index vectors instead of maps.
+	// Game sprites by id, editor sprites (negative ids) by their offset from the first one
+	typedef std::vector<Sprite*> SpriteList;
+	SpriteList sprite_space;
+	SpriteList editor_space;
+	// Sprite images by sprite id, nullptr where no sprite uses it
+	typedef std::vector<GameSprite::Image*> ImageList;
+	ImageList image_space;
+	// The slots grow to hold the id
+	Sprite*& getSpriteSlot(int id);
+	GameSprite::Image*& getImageSlot(uint32_t id);
 	std::deque<GameSprite*> cleanup_list;
 
 	DatFormat dat_format;
@@ -370,10 +503,87 @@ private:;
 	wxFileName sprites_file;
 
 	int loaded_textures;
-	int lastclean;
+	// Images that have been visited, least recently visited first
+	GameSprite::Image* lru_head;
+	GameSprite::Image* lru_tail;
+	void touchImage(GameSprite::Image* image);
+	void unlinkImage(GameSprite::Image* image);
+	uint32_t texture_revision;
+
+	// Outfit templates of all sprites, by sprite, sprite index and outfit colors
+	struct TemplateKey {
+		const GameSprite* parent;
+		int sprite_index;
+		uint32_t colors;
+
+		bool operator==(const TemplateKey& other) const noexcept {
+			return parent == other.parent && sprite_index == other.sprite_index && colors == other.colors;
+		}
+	};
+	struct TemplateKeyHash {
+		size_t operator()(const TemplateKey& key) const noexcept;
+	};
+	// Least recently drawn first, trimmed to MaxTemplateImages by garbageCollection
+	std::list<TemplateKey> template_lru;
+	struct TemplateEntry {
+		GameSprite::TemplateImage* image;
+		std::list<TemplateKey>::iterator lru_entry;
+	};
+	std::unordered_map<TemplateKey, TemplateEntry, TemplateKeyHash> template_space;
+	static constexpr size_t MaxTemplateImages = 2048;
+	GameSprite::TemplateImage* getTemplateImage(GameSprite* parent, int sprite_index, const Outfit& outfit);
+	void clearTemplateImages();
+
+	struct DecodedSprite {
+		uint32_t id;
+		uint32_t generation;
+		std::unique_ptr<uint8_t[]> rgba;
+	};
+
+	// The squares of an outfit, copied for the thread pool
+	struct OutfitPreviewPiece {
+		int x, y;
+		std::vector<uint8_t> dump;
+		std::vector<uint8_t> mask; // The colour template of the square, empty without one
+	};
+	struct OutfitPreview {
+		uint64_t key;
+		wxBitmap bitmap;
+	};
+	// RGB pixels of the preview, on any thread
+	static std::vector<uint8_t> composeOutfitPreview(const std::vector<OutfitPreviewPiece>& pieces, int image_size, uint8_t background, bool use_alpha, const uint8_t (&looks)[4]);
+	void finishOutfitPreview(uint64_t key, uint32_t generation, const std::vector<uint8_t>& rgb);
+	void clearOutfitPreviews();
+	// Most recently drawn first
+	std::list<OutfitPreview> outfit_previews;
+	std::unordered_map<uint64_t, std::list<OutfitPreview>::iterator> outfit_preview_index;
+	// Windows to refresh once the preview being composed is ready
+	std::unordered_map<uint64_t, std::vector<wxWeakRef<wxWindow>>> pending_previews;
+	static constexpr size_t MaxOutfitPreviews = 1024;
+
+	std::mutex decoded_mutex;
+	std::deque<DecodedSprite> decoded_sprites;
+	// Requested and not yet uploaded
+	std::atomic<uint32_t> pending_decodes;
+	// Changes whenever the sprites are unloaded, older decodes are dropped
+	uint32_t decode_generation;
+	bool decode_async;
+	GLuint placeholder_texture;
+
+	// Game sprites are packed in here, outfit templates and editor sprites use their own textures
+	TextureAtlas atlas;
+	ShaderRenderer shader_renderer;
+	ShaderLightRenderer light_renderer;
+	GlyphAtlas glyph_atlas;
+	GLuint grid_texture;
+
+	// The views that drew since the textures were last cleaned
+	std::vector<const void*> collection_round;
 
 	wxStopWatch* animation_timer;
+	long elapsed_time;
 
+	friend class GameSprite;
 	friend class GameSprite::Image;
 	friend class GameSprite::NormalImage;
 	friend class GameSprite::EditorImage;
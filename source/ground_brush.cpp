@@ -470,6 +470,7 @@ bool GroundBrush::load(pugi::xml_node node, wxArrayString& warnings)
 				}
 			}
 			borders.push_back(borderBlock);
+			buildBorderLookup();
 		} else if(childName == "friend") {
 			const std::string& name = childNode.attribute("name").as_string();
 			if(!name.empty()) {
@@ -517,6 +518,7 @@ bool GroundBrush::load(pugi::xml_node node, wxArrayString& warnings)
 				delete bb;
 			}
 			borders.clear();
+			buildBorderLookup();
 		} else if(childName == "clear_friends") {
 			friends.clear();
 			hate_friends = false;
@@ -555,93 +557,72 @@ void GroundBrush::draw(BaseMap* map, Tile* tile, void* parameter)
 			return;
 		}
 	}
-	int chance = random(1, total_chance);
-	uint16_t id = 0;
+	tile->addItem(Item::Create(getGroundItem(random(1, total_chance))));
+}
+
+uint16_t GroundBrush::getGroundItem(int chance) const
+{
+	if(border_items.empty()) {
+		return 0;
+	}
+
 	for(std::vector<ItemChanceBlock>::const_iterator it = border_items.begin(); it != border_items.end(); ++it) {
 		if(chance < it->chance) {
-			id = it->id;
-			break;
+			return it->id;
 		}
 	}
-	if(id == 0) {
-		id = border_items.front().id;
-	}
+	return border_items.front().id;
+}
+
+void GroundBrush::buildBorderLookup()
+{
+	inner_lookup = BorderLookup();
+	outer_lookup = BorderLookup();
+	for(const BorderBlock* bb : borders) {
+		BorderLookup& lookup = bb->outer ? outer_lookup : inner_lookup;
+		if(bb->to == 0xFFFFFFFF) {
+			if(!lookup.all) {
+				lookup.all = bb;
+			}
+			continue;
+		}
 
-	tile->addItem(Item::Create(id));
+		if(bb->to == 0 && !lookup.zilch) {
+			lookup.zilch = bb;
+		}
+		// A scan would stop at an earlier block to all before reaching this one
+		if(!lookup.all) {
+			lookup.to.emplace(bb->to, bb);
+		}
+	}
 }
 
 const GroundBrush::BorderBlock* GroundBrush::getBrushTo(GroundBrush* first, GroundBrush* second) {
-	//printf("Border from %s to %s : ", first->getName().c_str(), second->getName().c_str());
 	if(first) {
 		if(second) {
 			if(first->getZ() < second->getZ() && second->hasOuterBorder()) {
 				if(first->hasInnerBorder()) {
-					for(std::vector<BorderBlock*>::iterator it = first->borders.begin(); it != first->borders.end(); ++it) {
-						BorderBlock* bb = *it;
-						if(bb->outer) {
-							continue;
-						} else if(bb->to == second->getID() || bb->to == 0xFFFFFFFF) {
-							//printf("%d\n", bb->autoborder);
-							return bb;
-						}
-					}
-				}
-				for(std::vector<BorderBlock*>::iterator it = second->borders.begin(); it != second->borders.end(); ++it) {
-					BorderBlock* bb = *it;
-					if(!bb->outer) {
-						continue;
-					} else if(bb->to == first->getID()) {
-						//printf("%d\n", bb->autoborder);
-						return bb;
-					} else if(bb->to == 0xFFFFFFFF) {
-						//printf("%d\n", bb->autoborder);
+					if(const BorderBlock* bb = first->inner_lookup.find(second->getID())) {
 						return bb;
 					}
 				}
+				return second->outer_lookup.find(first->getID());
 			} else if(first->hasInnerBorder()) {
-				for(std::vector<BorderBlock*>::iterator it = first->borders.begin(); it != first->borders.end(); ++it) {
-					BorderBlock* bb = *it;
-					if(bb->outer) {
-						continue;
-					} else if(bb->to == second->getID()) {
-						//printf("%d\n", bb->autoborder);
-						return bb;
-					} else if(bb->to == 0xFFFFFFFF) {
-						//printf("%d\n", bb->autoborder);
-						return bb;
-					}
-				}
+				return first->inner_lookup.find(second->getID());
 			}
 		} else if(first->hasInnerZilchBorder()) {
-			for(std::vector<BorderBlock*>::iterator it = first->borders.begin(); it != first->borders.end(); ++it) {
-				BorderBlock* bb = *it;
-				if(bb->outer) {
-					continue;
-				} else if(bb->to == 0) {
-					//printf("%d\n", bb->autoborder);
-					return bb;
-				}
-			}
+			return first->inner_lookup.zilch;
 		}
 	} else if(second && second->hasOuterZilchBorder()) {
-		for(std::vector<BorderBlock*>::iterator it = second->borders.begin(); it != second->borders.end(); ++it) {
-			BorderBlock* bb = *it;
-			if(!bb->outer) {
-				continue;
-			} else if(bb->to == 0) {
-				//printf("%d\n", bb->autoborder);
-				return bb;
-			}
-		}
+		return second->outer_lookup.zilch;
 	}
-	//printf("None\n");
 	return nullptr;
 }
 
 void GroundBrush::doBorders(BaseMap* map, Tile* tile)
 {
-	static const auto extractGroundBrushFromTile = [](BaseMap* map, uint32_t x, uint32_t y, uint32_t z) -> GroundBrush* {
-		Tile* tile = map->getTile(x, y, z);
+	static const auto extractGroundBrushFromTile = [](const TileNeighbourhood& around, int dx, int dy) -> GroundBrush* {
+		Tile* tile = around.getTile(dx, dy);
 		if(tile) {
 			return tile->getGroundBrush();
 		}
@@ -650,6 +631,25 @@ void GroundBrush::doBorders(BaseMap* map, Tile* tile)
 
 	ASSERT(tile);
 
+	const TileNeighbourhood around(*map, tile->getPosition());
+	GroundBrush* const neighbours[8] = {
+		extractGroundBrushFromTile(around, -1, -1),
+		extractGroundBrushFromTile(around,  0, -1),
+		extractGroundBrushFromTile(around,  1, -1),
+		extractGroundBrushFromTile(around, -1,  0),
+		extractGroundBrushFromTile(around,  1,  0),
+		extractGroundBrushFromTile(around, -1,  1),
+		extractGroundBrushFromTile(around,  0,  1),
+		extractGroundBrushFromTile(around,  1,  1),
+	};
+
+	doBorders(tile, neighbours);
+}
+
+void GroundBrush::doBorders(Tile* tile, GroundBrush* const neighbourBrushes[8])
+{
+	ASSERT(tile);
+
 	GroundBrush* borderBrush;
 	if(tile->ground) {
 		borderBrush = tile->ground->getGroundBrush();
@@ -657,55 +657,14 @@ void GroundBrush::doBorders(BaseMap* map, Tile* tile)
 		borderBrush = nullptr;
 	}
 
-	const Position& position = tile->getPosition();
-
-	uint32_t x = position.x;
-	uint32_t y = position.y;
-	uint32_t z = position.z;
-
 	// Pair of visited / what border type
 	std::pair<bool, GroundBrush*> neighbours[8];
-	if(x == 0) {
-		if(y == 0) {
-			neighbours[0] = { false, nullptr };
-			neighbours[1] = { false, nullptr };
-			neighbours[2] = { false, nullptr };
-			neighbours[3] = { false, nullptr };
-			neighbours[4] = { false, extractGroundBrushFromTile(map, x + 1, y,     z) };
-			neighbours[5] = { false, nullptr };
-			neighbours[6] = { false, extractGroundBrushFromTile(map, x,     y + 1, z) };
-			neighbours[7] = { false, extractGroundBrushFromTile(map, x + 1, y + 1, z) };
-		} else {
-			neighbours[0] = { false, nullptr };
-			neighbours[1] = { false, extractGroundBrushFromTile(map, x,     y - 1, z) };
-			neighbours[2] = { false, extractGroundBrushFromTile(map, x + 1, y - 1, z) };
-			neighbours[3] = { false, nullptr };
-			neighbours[4] = { false, extractGroundBrushFromTile(map, x + 1, y,     z) };
-			neighbours[5] = { false, nullptr };
-			neighbours[6] = { false, extractGroundBrushFromTile(map, x,     y + 1, z) };
-			neighbours[7] = { false, extractGroundBrushFromTile(map, x + 1, y + 1, z) };
-		}
-	} else if(y == 0) {
-		neighbours[0] = { false, nullptr };
-		neighbours[1] = { false, nullptr };
-		neighbours[2] = { false, nullptr };
-		neighbours[3] = { false, extractGroundBrushFromTile(map, x - 1, y,     z) };
-		neighbours[4] = { false, extractGroundBrushFromTile(map, x + 1, y,     z) };
-		neighbours[5] = { false, extractGroundBrushFromTile(map, x - 1, y + 1, z) };
-		neighbours[6] = { false, extractGroundBrushFromTile(map, x,     y + 1, z) };
-		neighbours[7] = { false, extractGroundBrushFromTile(map, x + 1, y + 1, z) };
-	} else {
-		neighbours[0] = { false, extractGroundBrushFromTile(map, x - 1, y - 1, z) };
-		neighbours[1] = { false, extractGroundBrushFromTile(map, x,     y - 1, z) };
-		neighbours[2] = { false, extractGroundBrushFromTile(map, x + 1, y - 1, z) };
-		neighbours[3] = { false, extractGroundBrushFromTile(map, x - 1, y,     z) };
-		neighbours[4] = { false, extractGroundBrushFromTile(map, x + 1, y,     z) };
-		neighbours[5] = { false, extractGroundBrushFromTile(map, x - 1, y + 1, z) };
-		neighbours[6] = { false, extractGroundBrushFromTile(map, x,     y + 1, z) };
-		neighbours[7] = { false, extractGroundBrushFromTile(map, x + 1, y + 1, z) };
+	for(int32_t i = 0; i < 8; ++i) {
+		neighbours[i] = { false, neighbourBrushes[i] };
 	}
 
-	static std::vector<const BorderBlock*> specificList;
+	// Map wide borderize runs on several threads at once
+	static thread_local std::vector<const BorderBlock*> specificList;
 	specificList.clear();
 
 	std::vector<BorderCluster> borderList;
@@ -20,6 +20,8 @@
 
 #include "brush.h"
 
+#include <unordered_map>
+
 //=============================================================================
 
 class GroundBrush : public TerrainBrush
@@ -41,11 +43,16 @@ public:
 	virtual void draw(BaseMap* map, Tile* tile, void* parameter);
 	virtual void undraw(BaseMap* map, Tile* tile);
 	static void doBorders(BaseMap* map, Tile* tile);
+	// The same with the ground brushes of the 8 neighbours already looked up, NW, N, NE, W, E, SW, S, SE
+	static void doBorders(Tile* tile, GroundBrush* const neighbours[8]);
 	static const BorderBlock* getBrushTo(GroundBrush* first, GroundBrush* second);
 
 	virtual int32_t getZ() const { return z_order; }
 	bool useSoloOptionalBorder() const { return use_only_optional; }
 	bool isReRandomizable() const { return randomize; }
+	int getTotalChance() const noexcept { return total_chance; }
+	// The ground item for a roll between 1 and the total chance, 0 if there's none
+	uint16_t getGroundItem(int chance) const;
 
 	bool hasOuterZilchBorder() const { return has_zilch_outer_border || optional_border; }
 	bool hasInnerZilchBorder() const { return has_zilch_inner_border; }
@@ -97,7 +104,24 @@ protected: // Members
 		}
 	};
 
+	// Answers getBrushTo for one side of the borders without scanning them.
+	// Rebuilt by load whenever the border blocks change, read-only afterwards.
+	struct BorderLookup {
+		std::unordered_map<uint32_t, const BorderBlock*> to; // first block to that brush, unless a block to all precedes it
+		const BorderBlock* all = nullptr; // first block to all brushes
+		const BorderBlock* zilch = nullptr; // first block to no brush
+
+		const BorderBlock* find(uint32_t id) const {
+			auto it = to.find(id);
+			return it != to.end() ? it->second : all;
+		}
+	};
+
+	void buildBorderLookup();
+
 	std::vector<BorderBlock*> borders;
+	BorderLookup inner_lookup;
+	BorderLookup outer_lookup;
 	std::vector<ItemChanceBlock> border_items;
 	int total_chance;
 
@@ -26,8 +26,11 @@
 #include "editor.h"
 #include "brush.h"
 #include "map.h"
+#include "map_autosave.h"
 #include "sprites.h"
 #include "materials.h"
+#include "items.h"
+#include "creatures.h"
 #include "doodad_brush.h"
 #include "spawn_brush.h"
 
@@ -44,6 +47,8 @@
 #include "live_client.h"
 #include "live_tab.h"
 #include "live_server.h"
+#include "thread_pool.h"
+#include "tracing.h"
 
 #include <wx/filefn.h>
 
@@ -57,6 +62,81 @@ const wxEventType EVT_UPDATE_ACTIONS = wxNewEventType();
 // Global GUI instance
 GUI g_gui;
 
+namespace
+{
+	// Loaders run on the thread pool, each starting as soon as those it comes after are done,
+	// one that comes after a failed loader doesn't run. Errors are kept per loader, warnings
+	// are handed back in the order the loaders were added, so the result doesn't depend on
+	// which one finished first.
+	class LoadStage
+	{
+	public:
+		using Load = std::function<bool(wxString& error, wxArrayString& warnings)>;
+
+		size_t add(Load load, std::initializer_list<size_t> after = {}) {
+			const size_t index = tasks.size();
+			tasks.push_back(std::make_unique<Task>());
+			Task& task = *tasks.back();
+			task.load = std::move(load);
+			task.waiting = after.size();
+			for(size_t before : after) {
+				tasks[before]->next.push_back(index);
+			}
+			return index;
+		}
+
+		// With the open load bar showing how many are done
+		void run(wxArrayString& warnings) {
+			group.setProgressTotal(tasks.size());
+			for(size_t index = 0; index < tasks.size(); ++index) {
+				if(tasks[index]->waiting == 0) {
+					start(index);
+				}
+			}
+			ThreadPool::getInstance().waitWithLoadBar(group);
+
+			for(const std::unique_ptr<Task>& task : tasks) {
+				for(const wxString& warning : task->warnings) {
+					warnings.push_back(warning);
+				}
+			}
+		}
+
+		bool isOk(size_t index) const { return tasks[index]->ok; }
+		const wxString& getError(size_t index) const { return tasks[index]->error; }
+
+	private:
+		struct Task {
+			Load load;
+			std::vector<size_t> next;
+			std::atomic<size_t> waiting { 0 };
+			std::atomic<bool> blocked { false };
+			bool ok = false;
+			wxString error;
+			wxArrayString warnings;
+		};
+
+		void start(size_t index) {
+			ThreadPool::getInstance().submit(group, [this, index]() {
+				Task& task = *tasks[index];
+				task.ok = !task.blocked && task.load(task.error, task.warnings);
+				group.addProgress(1);
+				for(size_t next : task.next) {
+					if(!task.ok) {
+						tasks[next]->blocked = true;
+					}
+					if(--tasks[next]->waiting == 0) {
+						start(next);
+					}
+				}
+			});
+		}
+
+		std::vector<std::unique_ptr<Task>> tasks;
+		ThreadPool::TaskGroup group;
+	};
+}
+
 // GUI class implementation
 GUI::GUI() :
 	aui_manager(nullptr),
@@ -86,6 +166,7 @@ GUI::GUI() :
 	mode(SELECTION_MODE),
 	pasting(false),
 	hotkeys_enabled(true),
+	headless(false),
 
 	current_brush(nullptr),
 	previous_brush(nullptr),
@@ -262,23 +343,37 @@ void GUI::discoverDataDirectory(const wxString& existentFile)
 
 bool GUI::LoadVersion(ClientVersionID version, wxString& error, wxArrayString& warnings, bool force)
 {
+	RME_TRACE_ZONE("load", "GUI::LoadVersion");
 	if(ClientVersion::get(version) == nullptr) {
 		error = "Unsupported client version! (8)";
 		return false;
 	}
 
 	if(version != loaded_version || force) {
-		if(getLoadedVersion() != nullptr)
+		if(getLoadedVersion() != nullptr && !headless)
 			// There is another version loaded right now, save window layout
 			g_gui.SavePerspective();
 
 		// Disable all rendering so the data is not accessed while reloading
 		UnnamedRenderingLock();
-		DestroyPalettes();
-		DestroyMinimap();
+		if(!headless) {
+			DestroyPalettes();
+			DestroyMinimap();
+		}
 
-		// Destroy the previous version
-		UnloadVersion();
+		// Keep the previous version around for the maps still open with it
+		if(!force && KeepsVersionsResident())
+			StashVersion();
+		else
+			UnloadVersion();
+
+		if(IsVersionResident(version)) {
+			RestoreVersion(version);
+			if(!headless)
+				g_gui.LoadPerspective();
+			TrimResidentVersions();
+			return true;
+		}
 
 		loaded_version = version;
 		if(!getLoadedVersion()->hasValidPaths()) {
@@ -290,16 +385,188 @@ bool GUI::LoadVersion(ClientVersionID version, wxString& error, wxArrayString& w
 		}
 
 		bool ret = LoadDataFiles(error, warnings);
-		if(ret)
+		if(ret && !headless)
 			g_gui.LoadPerspective();
 		else
 			loaded_version = CLIENT_VERSION_NONE;
 
+		TrimResidentVersions();
 		return ret;
 	}
 	return true;
 }
 
+bool GUI::SwitchToMapVersion(const Map& map)
+{
+	const ClientVersionID version = map.getVersion().client;
+	if(version == loaded_version)
+		return true;
+
+	wxString error;
+	wxArrayString warnings;
+	if(!LoadVersion(version, error, warnings)) {
+		PopupDialog("Error", error, wxOK);
+		return false;
+	}
+	ListDialog("Warnings", warnings);
+	return true;
+}
+
+// A version moved out of the globals, the data structures are swapped in and
+// out so nothing pointing into them moves
+struct GUI::ResidentVersion
+{
+	ClientVersionID version = CLIENT_VERSION_NONE;
+	size_t bytes = 0;
+
+	ItemDatabase items;
+	CreatureDatabase creatures;
+	Brushes brushes;
+	Materials materials;
+	GraphicManager gfx;
+
+	HouseBrush* house_brush = nullptr;
+	HouseExitBrush* house_exit_brush = nullptr;
+	WaypointBrush* waypoint_brush = nullptr;
+	OptionalBorderBrush* optional_brush = nullptr;
+	EraserBrush* eraser = nullptr;
+	SpawnBrush* spawn_brush = nullptr;
+	DoorBrush* normal_door_brush = nullptr;
+	DoorBrush* locked_door_brush = nullptr;
+	DoorBrush* magic_door_brush = nullptr;
+	DoorBrush* quest_door_brush = nullptr;
+	DoorBrush* hatch_door_brush = nullptr;
+	DoorBrush* window_door_brush = nullptr;
+	FlagBrush* pz_brush = nullptr;
+	FlagBrush* rook_brush = nullptr;
+	FlagBrush* nolog_brush = nullptr;
+	FlagBrush* pvp_brush = nullptr;
+	FlagBrush* zone_brush = nullptr;
+};
+
+bool GUI::KeepsVersionsResident() const
+{
+	return !headless && g_settings.getInteger(Config::RESIDENT_VERSIONS_MEMORY) > 0;
+}
+
+bool GUI::IsVersionResident(ClientVersionID version) const
+{
+	for(const auto& resident : resident_versions) {
+		if(resident->version == version)
+			return true;
+	}
+	return false;
+}
+
+void GUI::SwapVersionData(ResidentVersion& resident)
+{
+	// A frame being written reads the tables that go away here
+	MapAutosave::waitForWrites();
+
+	g_items.swap(resident.items);
+	g_creatures.swap(resident.creatures);
+	g_brushes.swap(resident.brushes);
+	g_materials.swap(resident.materials);
+	gfx.swapVersion(resident.gfx);
+
+	std::swap(house_brush, resident.house_brush);
+	std::swap(house_exit_brush, resident.house_exit_brush);
+	std::swap(waypoint_brush, resident.waypoint_brush);
+	std::swap(optional_brush, resident.optional_brush);
+	std::swap(eraser, resident.eraser);
+	std::swap(spawn_brush, resident.spawn_brush);
+	std::swap(normal_door_brush, resident.normal_door_brush);
+	std::swap(locked_door_brush, resident.locked_door_brush);
+	std::swap(magic_door_brush, resident.magic_door_brush);
+	std::swap(quest_door_brush, resident.quest_door_brush);
+	std::swap(hatch_door_brush, resident.hatch_door_brush);
+	std::swap(window_door_brush, resident.window_door_brush);
+	std::swap(pz_brush, resident.pz_brush);
+	std::swap(rook_brush, resident.rook_brush);
+	std::swap(nolog_brush, resident.nolog_brush);
+	std::swap(pvp_brush, resident.pvp_brush);
+	std::swap(zone_brush, resident.zone_brush);
+	std::swap(loaded_version, resident.version);
+}
+
+void GUI::StashVersion()
+{
+	UnnamedRenderingLock();
+	current_brush = nullptr;
+	previous_brush = nullptr;
+	if(loaded_version == CLIENT_VERSION_NONE)
+		return;
+
+	auto resident = std::make_unique<ResidentVersion>();
+	SwapVersionData(*resident);
+
+	// Textures are rebuilt when it comes back, what stays are the sprite dumps
+	// and the item and brush data
+	resident->bytes = resident->gfx.getMemoryUsage().sprite_dump_bytes +
+		resident->items.getMaxID() * sizeof(ItemType);
+	resident_versions.push_back(std::move(resident));
+}
+
+void GUI::RestoreVersion(ClientVersionID version)
+{
+	auto it = std::find_if(resident_versions.begin(), resident_versions.end(),
+		[version](const auto& resident) { return resident->version == version; });
+	if(it == resident_versions.end())
+		return;
+
+	// Nothing is loaded at this point, the entry is left empty
+	SwapVersionData(**it);
+	resident_versions.erase(it);
+	current_brush = nullptr;
+	previous_brush = nullptr;
+}
+
+void GUI::ReleaseResidentVersion(ResidentVersion& resident)
+{
+	resident.materials.clear();
+	resident.brushes.clear();
+	resident.items.clear();
+	resident.gfx.clear();
+
+	FileName cdb = ClientVersion::get(resident.version)->getLocalDataPath();
+	cdb.SetFullName("creatures.xml");
+	resident.creatures.saveToXML(cdb);
+	resident.creatures.clear();
+}
+
+void GUI::TrimResidentVersions()
+{
+	std::set<ClientVersionID> open;
+	for(int index = 0; tabbook && index < tabbook->GetTabCount(); ++index) {
+		if(MapTab* tab = dynamic_cast<MapTab*>(tabbook->GetTab(index)))
+			open.insert(tab->GetMap()->getVersion().client);
+	}
+
+	const size_t budget = size_t(std::max(g_settings.getInteger(Config::RESIDENT_VERSIONS_MEMORY), 0)) * 1024 * 1024;
+	size_t total = 0;
+	for(const auto& resident : resident_versions)
+		total += resident->bytes;
+
+	for(auto it = resident_versions.begin(); it != resident_versions.end() && total > budget;) {
+		// The maps open with it would have nothing to draw with
+		if(open.count((*it)->version) != 0) {
+			++it;
+			continue;
+		}
+		total -= (*it)->bytes;
+		ReleaseResidentVersion(**it);
+		it = resident_versions.erase(it);
+	}
+}
+
+void GUI::UnloadResidentVersions()
+{
+	UnnamedRenderingLock();
+	for(const auto& resident : resident_versions)
+		ReleaseResidentVersion(*resident);
+	resident_versions.clear();
+}
+
 void GUI::EnableHotkeys()
 {
 	hotkeys_enabled = true;
@@ -336,6 +603,7 @@ void GUI::CycleTab(bool forward)
 
 bool GUI::LoadDataFiles(wxString& error, wxArrayString& warnings)
 {
+	RME_TRACE_ZONE("load", "GUI::LoadDataFiles");
 	FileName data_path = getLoadedVersion()->getDataPath();
 	FileName client_path = getLoadedVersion()->getClientPath();
 	FileName extension_path = GetExtensionsDirectory();
@@ -381,40 +649,31 @@ bool GUI::LoadDataFiles(wxString& error, wxArrayString& warnings)
 		return false;
 	} */
 
-	// We need to load spr file before dat/otb because itemtype is assigned GameSprite.
-	g_gui.SetLoadDone(20, "Loading sprites file...");
-	wxFileName sprites_path = g_gui.gfx.getSpritesFileName();
-	if(!g_gui.gfx.loadSpriteData(sprites_path.GetFullPath(), error, warnings)) {
-		error = "Couldn't load sprites: " + error;
-		g_gui.DestroyLoadBar();
-		UnloadVersion();
-		return false;
-	}
-
 	// to-do Make maybe a checkbox - just copy over spr signatures checkbox.
 	// And split this below into 2 checks: if items.dat exists + if checkbox is enabled.
 	// Current behavior: if items.otb is not in the folder, it loads all from `.dat` (usually Tibia.dat), path specified in preferences/client version/
 	bool datOnlyLoad = !wxFileExists(wxString(data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + "items.otb"));
 
-	g_gui.SetLoadDone(5, "Loading metadata file...");
+	wxFileName sprites_path = g_gui.gfx.getSpritesFileName();
 	wxFileName metadata_path = g_gui.gfx.getMetadataFileName();
-	if(!g_gui.gfx.loadSpriteMetadata(metadata_path, error, warnings, datOnlyLoad)) {
-		error = "Couldn't load metadata: " + error;
-		g_gui.DestroyLoadBar();
-		UnloadVersion();
-		return false;
-	}
-
-	if(!datOnlyLoad) {
-		g_gui.SetLoadDone(10, "Loading items.otb file...");
-		if(!g_items.loadFromOtb(wxString(data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + "items.otb"), error, warnings)) {
-			error = "Couldn't load items.otb: " + error;
-			g_gui.DestroyLoadBar();
-			UnloadVersion();
-			return false;
+	wxString dataDir = data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR);
+	FileName user_creatures_path = getLoadedVersion()->getLocalDataPath();
+	user_creatures_path.SetFullName("creatures.xml");
+
+	// The client files are read in parallel once the metadata is: it tells whether the sprite file
+	// is extended, and makes the game sprites the items and creatures point to
+	LoadStage stage;
+	const size_t metadata = stage.add([&](wxString& error, wxArrayString& warnings) {
+		return g_gui.gfx.loadSpriteMetadata(metadata_path, error, warnings, datOnlyLoad);
+	});
+	const size_t sprites = stage.add([&](wxString& error, wxArrayString& warnings) {
+		return g_gui.gfx.loadSpriteData(sprites_path.GetFullPath(), error, warnings);
+	}, { metadata });
+	const size_t items_otb = stage.add([&](wxString& error, wxArrayString& warnings) {
+		if(!datOnlyLoad) {
+			//warnings.push_back(wxString::Format("Major,Minor,BuildNumber: %d %d %d", g_items.MajorVersion, g_items.MinorVersion, g_items.BuildNumber));
+			return g_items.loadFromOtb(dataDir + "items.otb", error, warnings);
 		}
-		//warnings.push_back(wxString::Format("Major,Minor,BuildNumber: %d %d %d", g_items.MajorVersion, g_items.MinorVersion, g_items.BuildNumber));
-	} else {
 		// to-do do MajorVersion. Maybe lets just do own MajorVersion rather than lying that its some 1,2,3... lets do 4 (or 10 or w/e) and say its items.dat forever.
 		// or use those 32 bits for something else.
 		const auto& signatureData = g_gui.gfx.getSignatureData();
@@ -422,28 +681,58 @@ bool GUI::LoadDataFiles(wxString& error, wxArrayString& warnings)
 		g_items.MinorVersion = signatureData.minorVersion;
 		g_items.BuildNumber = 1; // to-do - information what is this, idk, what is that. But its in [10.98 items.otb]'s with value 1.
 		//warnings.push_back(wxString::Format("Detected Protocol: %d %d %d", signatureData.protocolVersion, signatureData.majorVersion, signatureData.minorVersion));
+		return true;
+	}, { metadata });
+	const size_t items_data = stage.add([&](wxString& error, wxArrayString& warnings) {
+		return g_items.loadItems(dataDir, error, warnings);
+	}, { items_otb });
+	const size_t creatures = stage.add([&](wxString& error, wxArrayString& warnings) {
+		return g_creatures.loadFromXML(dataDir + "creatures.xml", true, error, warnings);
+	}, { metadata });
+	stage.add([&](wxString& error, wxArrayString& warnings) {
+		wxString nerr;
+		wxArrayString nwarn;
+		g_creatures.loadFromXML(user_creatures_path, false, nerr, nwarn);
+		return true;
+	}, { creatures });
+
+	g_gui.SetLoadScale(0, 50);
+	g_gui.SetLoadDone(0, "Loading client data...");
+	stage.run(warnings);
+	g_gui.SetLoadScale(0, 100);
+
+	if(!stage.isOk(sprites)) {
+		error = "Couldn't load sprites: " + stage.getError(sprites);
+		g_gui.DestroyLoadBar();
+		UnloadVersion();
+		return false;
 	}
 
-	g_gui.SetLoadDone(30, "Loading items data...");
-	wxString dataDir = data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR);
-	if(!g_items.loadItems(dataDir, error, warnings)) {
-		warnings.push_back("Couldn't load items: " + error);
+	if(!stage.isOk(metadata)) {
+		error = "Couldn't load metadata: " + stage.getError(metadata);
+		g_gui.DestroyLoadBar();
+		UnloadVersion();
+		return false;
 	}
 
-	g_gui.SetLoadDone(45, "Loading creatures.xml ...");
-	if(!g_creatures.loadFromXML(wxString(data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + "creatures.xml"), true, error, warnings)) {
-		warnings.push_back("Couldn't load creatures.xml: " + error);
+	if(!stage.isOk(items_otb)) {
+		error = "Couldn't load items.otb: " + stage.getError(items_otb);
+		g_gui.DestroyLoadBar();
+		UnloadVersion();
+		return false;
 	}
 
-	g_gui.SetLoadDone(45, "Loading user creatures.xml ...");
-	{
-		FileName cdb = getLoadedVersion()->getLocalDataPath();
-		cdb.SetFullName("creatures.xml");
-		wxString nerr;
-		wxArrayString nwarn;
-		g_creatures.loadFromXML(cdb, false, nerr, nwarn);
+	if(!stage.isOk(items_data)) {
+		warnings.push_back("Couldn't load items: " + stage.getError(items_data));
+	}
+
+	if(!stage.isOk(creatures)) {
+		warnings.push_back("Couldn't load creatures.xml: " + stage.getError(creatures));
 	}
 
+	// The item predicates read the hot data, the brushes query them while loading
+	g_items.updateHotData();
+
 	g_gui.SetLoadDone(50, "Loading materials.xml ...");
 	if(!g_materials.loadMaterials(wxString(data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + "materials.xml"), error, warnings)) {
 		warnings.push_back("Couldn't load materials.xml: " + error);
@@ -457,11 +746,54 @@ bool GUI::LoadDataFiles(wxString& error, wxArrayString& warnings)
 	g_gui.SetLoadDone(70, "Finishing...");
 	g_brushes.init();
 	g_materials.createOtherTileset();
+	g_items.updateHotData();
 
 	g_gui.DestroyLoadBar();
 	return true;
 }
 
+bool GUI::ReloadMaterials(wxString& error, wxArrayString& warnings)
+{
+	RME_TRACE_ZONE("load", "GUI::ReloadMaterials");
+	if(!IsVersionLoaded()) {
+		error = "No client version is loaded.";
+		return false;
+	}
+
+	if(!headless)
+		g_gui.SavePerspective();
+
+	// The palettes and the brushes in use point into what is about to be freed
+	UnnamedRenderingLock();
+	if(!headless)
+		DestroyPalettes();
+	current_brush = nullptr;
+	previous_brush = nullptr;
+
+	// The brushes reference each other across the files, so they are all parsed again
+	g_materials.clear();
+	g_brushes.clear();
+	g_items.clearBrushes();
+	g_creatures.clearBrushes();
+	g_items.updateHotData();
+
+	FileName data_path = getLoadedVersion()->getDataPath();
+	if(!g_materials.loadMaterials(wxString(data_path.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + "materials.xml"), error, warnings)) {
+		warnings.push_back("Couldn't load materials.xml: " + error);
+	}
+	g_materials.loadExtensions(GetExtensionsDirectory(), error, warnings);
+
+	g_brushes.init();
+	g_materials.createOtherTileset();
+	g_items.updateHotData();
+
+	if(!headless) {
+		g_gui.LoadPerspective();
+		RefreshView();
+	}
+	return true;
+}
+
 void GUI::UnloadVersion()
 {
 	UnnamedRenderingLock();
@@ -504,6 +836,9 @@ void GUI::SaveCurrentMap(FileName filename, bool showdialog)
 		Editor* editor = mapTab->GetEditor();
 		if(editor) {
 			editor->saveMap(filename, showdialog);
+			const IOTelemetry& telemetry = editor->getMap().getIOTelemetry();
+			if(!telemetry.empty())
+				SetStatusText(telemetry.getSummary("Saved"));
 
 			const std::string& filename = editor->getMap().getFilename();
 			const Position& position = mapTab->GetScreenCenterPosition();
@@ -627,9 +962,10 @@ void GUI::SaveMapAs()
 	}
 }
 
-bool GUI::LoadMap(const FileName& fileName)
+bool GUI::LoadMap(const FileName& fileName, const MapArea& area)
 {
     FinishWelcomeDialog();
+	map_preloader.finish(fileName);
 
 	if(GetCurrentEditor() && !GetCurrentMap().hasChanged() && !GetCurrentMap().hasFile())
 		g_gui.CloseCurrentEditor();
@@ -637,7 +973,7 @@ bool GUI::LoadMap(const FileName& fileName)
 	Editor* editor;
 	try
 	{
-		editor = newd Editor(copybuffer, fileName);
+		editor = newd Editor(copybuffer, fileName, area);
 	}
 	catch(std::runtime_error& e)
 	{
@@ -657,6 +993,7 @@ bool GUI::LoadMap(const FileName& fileName)
 
 	FitViewToMap(mapTab);
 	root->UpdateMenubar();
+	SetStatusText(mapTab->GetMap()->getIOTelemetry().getSummary("Loaded"));
 
 	std::string path = g_settings.getString(Config::RECENT_EDITED_MAP_PATH);
 	if(!path.empty()) {
@@ -774,6 +1111,11 @@ bool GUI::CloseLiveEditors(LiveSocket* sock)
 
 bool GUI::CloseAllEditors()
 {
+	if(headless) {
+		// Batch mode editors aren't in tabs
+		return true;
+	}
+
 	for(int i = 0; i < tabbook->GetTabCount(); ++i) {
 		auto *mapTab = dynamic_cast<MapTab*>(tabbook->GetTab(i));
 		if(mapTab) {
@@ -1204,6 +1546,10 @@ bool GUI::IsMinimapVisible() const
 
 void GUI::RefreshView()
 {
+	if(headless) {
+		return;
+	}
+
 	EditorTab* editorTab = GetCurrentTab();
 	if(!editorTab) {
 		return;
@@ -1235,6 +1581,10 @@ void GUI::CreateLoadBar(wxString message, bool canCancel /* = false */ )
 	progressTo = 100;
 	currentProgress = -1;
 
+	if(headless) {
+		return;
+	}
+
 	progressBar = newd wxGenericProgressDialog("Loading", progressText + " (0%)", 100, root,
 		wxPD_APP_MODAL | wxPD_SMOOTH | (canCancel ? wxPD_CAN_ABORT : 0)
 	);
@@ -1260,7 +1610,7 @@ bool GUI::SetLoadDone(int32_t done, const wxString& newMessage)
 	if(done == 100) {
 		DestroyLoadBar();
 		return true;
-	} else if(done == currentProgress) {
+	} else if(done == currentProgress || headless) {
 		return true;
 	}
 
@@ -1271,12 +1621,12 @@ bool GUI::SetLoadDone(int32_t done, const wxString& newMessage)
 	int32_t newProgress = progressFrom + static_cast<int32_t>((done / 100.f) * (progressTo - progressFrom));
 	newProgress = std::max<int32_t>(0, std::min<int32_t>(100, newProgress));
 
-	bool skip = false;
+	// Update returns false once the cancel button was hit
+	bool keep_going = true;
 	if(progressBar) {
-		progressBar->Update(
+		keep_going = progressBar->Update(
 			newProgress,
-			wxString::Format("%s (%d%%)", progressText, newProgress),
-			&skip
+			wxString::Format("%s (%d%%)", progressText, newProgress)
 		);
 		currentProgress = newProgress;
 	}
@@ -1291,7 +1641,7 @@ bool GUI::SetLoadDone(int32_t done, const wxString& newMessage)
 		}
 	}
 
-	return skip;
+	return keep_going;
 }
 
 void GUI::DestroyLoadBar()
@@ -1318,6 +1668,9 @@ void GUI::ShowWelcomeDialog(const wxBitmap &icon) {
     welcomeDialog->Bind(WELCOME_DIALOG_ACTION, &GUI::OnWelcomeDialogAction, this);
     welcomeDialog->Show();
     UpdateMenubar();
+    if(g_settings.getInteger(Config::PRELOAD_RECENT_MAP) && !recent_files.empty()) {
+        map_preloader.start(FileName(recent_files.front()));
+    }
 }
 
 void GUI::FinishWelcomeDialog() {
@@ -1335,6 +1688,7 @@ bool GUI::IsWelcomeDialogShown() {
 
 void GUI::OnWelcomeDialogClosed(wxCloseEvent &event)
 {
+    map_preloader.cancel();
     welcomeDialog->Destroy();
     root->Close();
 }
@@ -1342,6 +1696,7 @@ void GUI::OnWelcomeDialogClosed(wxCloseEvent &event)
 void GUI::OnWelcomeDialogAction(wxCommandEvent &event)
 {
     if(event.GetId() == wxID_NEW) {
+        map_preloader.cancel();
         NewMap();
     } else if(event.GetId() == wxID_OPEN) {
         LoadMap(FileName(event.GetString()));
@@ -1399,6 +1754,7 @@ void GUI::PreparePaste()
 {
 	Editor* editor = GetCurrentEditor();
 	if(editor) {
+		copybuffer.fetchClipboard();
 		SetSelectionMode();
 		Selection& selection = editor->getSelection();
 		selection.start();
@@ -1411,7 +1767,7 @@ void GUI::PreparePaste()
 
 void GUI::StartPasting()
 {
-	if(GetCurrentEditor()) {
+	if(GetCurrentEditor() && copybuffer.canPaste()) {
 		pasting = true;
 		secondary_map = &copybuffer.getBufferMap();
 	}
@@ -1491,6 +1847,9 @@ void GUI::ChangeFloor(int new_floor)
 
 void GUI::SetStatusText(wxString text)
 {
+	if(headless) {
+		return;
+	}
 	g_gui.root->SetStatusText(text, 0);
 }
 
@@ -1536,6 +1895,10 @@ void GUI::SetTitle(wxString title)
 
 void GUI::UpdateTitle()
 {
+	if(headless) {
+		return;
+	}
+
 	if(tabbook->GetTabCount() > 0) {
 		SetTitle(tabbook->GetCurrentTab()->GetTitle());
 		for(int idx = 0; idx < tabbook->GetTabCount(); ++idx) {
@@ -1549,12 +1912,18 @@ void GUI::UpdateTitle()
 
 void GUI::UpdateMenus()
 {
+	if(headless) {
+		return;
+	}
 	wxCommandEvent evt(EVT_UPDATE_MENUS);
 	g_gui.root->AddPendingEvent(evt);
 }
 
 void GUI::UpdateActions()
 {
+	if(headless) {
+		return;
+	}
 	wxCommandEvent evt(EVT_UPDATE_ACTIONS);
 	g_gui.root->AddPendingEvent(evt);
 }
@@ -1598,6 +1967,12 @@ void GUI::SetDrawingMode()
 	if(mode == DRAWING_MODE)
 		return;
 
+	if(headless) {
+		// Batch mode editors aren't in tabs, the session replay draws on its own
+		mode = DRAWING_MODE;
+		return;
+	}
+
 	std::set<MapTab*> al;
 	for(int idx = 0; idx < tabbook->GetTabCount(); ++idx) {
 		EditorTab* editorTab = tabbook->GetTab(idx);
@@ -1640,6 +2015,10 @@ void GUI::SetBrushSize(int nz)
 {
 	SetBrushSizeInternal(nz);
 
+	if(headless) {
+		return;
+	}
+
 	for(auto &palette : palettes) {
 		palette->OnUpdateBrushSize(brush_shape, brush_size);
 	}
@@ -1667,6 +2046,10 @@ void GUI::SetBrushShape(BrushShape bs)
 	}
 	brush_shape = bs;
 
+	if(headless) {
+		return;
+	}
+
 	for(auto &palette : palettes) {
 		palette->OnUpdateBrushSize(brush_shape, brush_size);
 	}
@@ -1872,7 +2255,6 @@ void GUI::FillDoodadPreviewBuffer()
 	if(brush->isEmpty(GetBrushVariation()))
 		return;
 
-	int object_count = 0;
 	int area;
 	if(GetBrushShape() == BRUSHSHAPE_SQUARE) {
 		area = 2*GetBrushSize();
@@ -1891,98 +2273,7 @@ void GUI::FillDoodadPreviewBuffer()
 	Position center_pos(0x8000, 0x8000, 0x8);
 
 	if(brush_size > 0 && !brush->oneSizeFitsAll()) {
-		while(object_count < final_object_count) {
-			int retries = 0;
-			bool exit = false;
-
-			// Try to place objects 5 times
-			while(retries < 5 && !exit) {
-
-				int pos_retries = 0;
-				int xpos = 0, ypos = 0;
-				bool found_pos = false;
-				if(GetBrushShape() == BRUSHSHAPE_CIRCLE) {
-					while(pos_retries < 5 && !found_pos) {
-						xpos = random(-brush_size, brush_size);
-						ypos = random(-brush_size, brush_size);
-						float distance = sqrt(float(xpos*xpos) + float(ypos*ypos));
-						if(distance < g_gui.GetBrushSize() + 0.005) {
-							found_pos = true;
-						} else {
-							++pos_retries;
-						}
-					}
-				} else {
-					found_pos = true;
-					xpos = random(-brush_size, brush_size);
-					ypos = random(-brush_size, brush_size);
-				}
-
-				if(!found_pos) {
-					++retries;
-					continue;
-				}
-
-				// Decide whether the zone should have a composite or several single objects.
-				bool fail = false;
-				if(random(brush->getTotalChance(GetBrushVariation())) <= brush->getCompositeChance(GetBrushVariation())) {
-					// Composite
-					const CompositeTileList& composites = brush->getComposite(GetBrushVariation());
-
-					// Figure out if the placement is valid
-					for(const auto &composite : composites) {
-						Position pos = center_pos + composite.first + Position(xpos, ypos, 0);
-						if(Tile* tile = doodad_buffer_map->getTile(pos)) {
-							if(!tile->empty()) {
-								fail = true;
-								break;
-							}
-						}
-					}
-					if(fail) {
-						++retries;
-						break;
-					}
-
-					// Transfer items to the stack
-					for(const auto &composite : composites) {
-						Position pos = center_pos + composite.first + Position(xpos, ypos, 0);
-						const ItemVector& items = composite.second;
-						Tile* tile = doodad_buffer_map->getTile(pos);
-
-						if(!tile)
-							tile = doodad_buffer_map->allocator(doodad_buffer_map->createTileL(pos));
-
-						for(auto item : items) {
-							tile->addItem(item->deepCopy());
-						}
-						doodad_buffer_map->setTile(tile->getPosition(), tile);
-					}
-					exit = true;
-				} else if(brush->hasSingleObjects(GetBrushVariation())) {
-					Position pos = center_pos + Position(xpos, ypos, 0);
-					Tile* tile = doodad_buffer_map->getTile(pos);
-					if(tile) {
-						if(!tile->empty()) {
-							fail = true;
-							break;
-						}
-					} else {
-						tile = doodad_buffer_map->allocator(doodad_buffer_map->createTileL(pos));
-					}
-					int variation = GetBrushVariation();
-					brush->draw(doodad_buffer_map, tile, &variation);
-					//std::cout << "\tpos: " << tile->getPosition() << std::endl;
-					doodad_buffer_map->setTile(tile->getPosition(), tile);
-					exit = true;
-				}
-				if(fail) {
-					++retries;
-					break;
-				}
-			}
-			++object_count;
-		}
+		brush->spray(doodad_buffer_map, center_pos, GetBrushVariation(), brush_size, GetBrushShape() == BRUSHSHAPE_CIRCLE, final_object_count);
 	} else {
 		if(brush->hasCompositeObjects(GetBrushVariation()) &&
 				random(brush->getTotalChance(GetBrushVariation())) <= brush->getCompositeChance(GetBrushVariation())) {
@@ -2017,6 +2308,11 @@ long GUI::PopupDialog(wxWindow* parent, wxString title, wxString text, long styl
 	if(text.empty())
 		return wxID_ANY;
 
+	if(headless) {
+		std::cerr << title << ": " << text << std::endl;
+		return (style & wxOK) ? wxID_OK : wxID_NO;
+	}
+
 	wxMessageDialog dlg(parent, text, title, style);
 	return dlg.ShowModal();
 }
@@ -2031,6 +2327,13 @@ void GUI::ListDialog(wxWindow* parent, wxString title, const wxArrayString& para
 	if(param_items.empty())
 		return;
 
+	if(headless) {
+		for(const wxString& item : param_items) {
+			std::cerr << title << ": " << item << std::endl;
+		}
+		return;
+	}
+
 	wxArrayString list_items(param_items);
 
 	// Create the window
@@ -29,6 +29,8 @@
 #include "map_tab.h"
 #include "palette_window.h"
 #include "client_version.h"
+#include "iomap.h"
+#include "map_preloader.h"
 
 class BaseMap;
 class Map;
@@ -161,6 +163,7 @@ public:
 	 * Destroys (hides) the current loading bar.
 	 */
 	void DestroyLoadBar();
+	bool IsLoadBarShown() const { return progressBar != nullptr; }
 
 	void UpdateMenubar();
 
@@ -280,11 +283,27 @@ public:
 	// Load/unload a client version (takes care of dialogs aswell)
 	void UnloadVersion();
 	bool LoadVersion(ClientVersionID ver, wxString& error, wxArrayString& warnings, bool force = false);
+	// Parses materials.xml and the extensions of the loaded version again, the sprites, items and
+	// creatures are kept as they are
+	bool ReloadMaterials(wxString& error, wxArrayString& warnings);
 	// The current version loaded (returns CLIENT_VERSION_NONE if no version is loaded)
 	const ClientVersion& GetCurrentVersion() const;
 	ClientVersionID GetCurrentVersionID() const;
 	// If any version is loaded at all
 	bool IsVersionLoaded() const { return loaded_version != CLIENT_VERSION_NONE; }
+	// Switches to the version of the map, a version kept resident comes back
+	// without reading any files
+	bool SwitchToMapVersion(const Map& map);
+	// Versions stay in memory when another one is loaded, so maps of several
+	// versions can be open at once (Config::RESIDENT_VERSIONS_MEMORY)
+	bool KeepsVersionsResident() const;
+	bool IsVersionResident(ClientVersionID version) const;
+	// Frees every version kept in memory, the loaded one isn't touched
+	void UnloadResidentVersions();
+
+	// Without windows (batch mode), load bars do nothing and dialogs are written to stderr
+	void SetHeadless(bool value) noexcept { headless = value; }
+	bool IsHeadless() const noexcept { return headless; }
 
 	// Centers current view on position
 	void SetScreenCenterPosition(const Position& position, bool showIndicator = true);
@@ -332,7 +351,7 @@ public:
 	void OpenMap();
 	void SaveMap();
 	void SaveMapAs();
-	bool LoadMap(const FileName& fileName);
+	bool LoadMap(const FileName& fileName, const MapArea& area = MapArea());
 
 protected:
 	bool LoadDataFiles(wxString& error, wxArrayString& warnings);
@@ -340,6 +359,15 @@ protected:
 		return loaded_version == CLIENT_VERSION_NONE ? nullptr : ClientVersion::get(loaded_version);
 	}
 
+	struct ResidentVersion;
+	void SwapVersionData(ResidentVersion& resident);
+	void StashVersion();
+	void RestoreVersion(ClientVersionID version);
+	void ReleaseResidentVersion(ResidentVersion& resident);
+	// Drops the least recently used versions without an open map until the
+	// rest fits in the budget
+	void TrimResidentVersions();
+
 	//=========================================================================
 	// Palette Interface
 public:
@@ -379,6 +407,7 @@ public:
 	MainFrame* root; // The main frame
 	WelcomeDialog* welcomeDialog;
 	CopyBuffer copybuffer;
+	MapPreloader map_preloader;
 
 	MinimapWindow* minimap;
 	DCButton* gem; // The small gem in the lower-right corner
@@ -423,11 +452,14 @@ protected:
 	wxGLContext* OGLContext;
 
 	ClientVersionID loaded_version;
+	// Versions loaded before, least recently used first
+	std::list<std::unique_ptr<ResidentVersion>> resident_versions;
 	EditorMode mode;
 	bool pasting;
 
 	Hotkey hotkeys[10];
 	bool hotkeys_enabled;
+	bool headless;
 
 	//=========================================================================
 	// Internal brush data
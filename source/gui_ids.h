@@ -93,7 +93,12 @@ enum EditorActionID {
 
 	EXTENSIONS_OPEN_FOLDER_BUTTON,
 
+	MEMORY_REPORT_REFRESH_BUTTON,
+	MEMORY_REPORT_EXPORT_BUTTON,
+	MEMORY_REPORT_COMPACT_BUTTON,
+
 	MAP_WINDOW_FILE_BUTTON,
+	IMPORT_MAP_AREA_CHECKBOX,
 
 	PALETTE_ITEM_CHOICEBOOK,
 	PALETTE_CHOICEBOOK,
@@ -155,6 +160,8 @@ enum EditorActionID {
 	ITEM_PROPERTIES_REMOVE_ATTRIBUTE,
 
 	LIVE_CHAT_TEXTBOX,
+	LIVE_METRICS_TIMER,
+	LIVE_METRICS_EXPORT,
 
 	ABOUT_RUN_TETRIS,
 	ABOUT_RUN_SNAKE,
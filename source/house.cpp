@@ -24,7 +24,8 @@
 
 Houses::Houses(Map& map) :
 	map(map),
-	max_house_id(0)
+	max_house_id(0),
+	orphaned_tiles(false)
 {
 	////
 }
@@ -50,13 +51,20 @@ void Houses::addHouse(House* new_house)
 	if(new_house->id > max_house_id)
 		max_house_id = new_house->id;
 	houses[new_house->id] = new_house;
+	if(new_house->id < DenseIds) {
+		if(new_house->id >= by_id.size())
+			by_id.resize(new_house->id + 1, nullptr);
+		by_id[new_house->id] = new_house;
+	}
 }
 
 void Houses::removeHouse(House* house_to_remove)
 {
 	HouseMap::iterator it = houses.find(house_to_remove->id);
-	if(it != houses.end())
+	if(it != houses.end()) {
+		unindex(it->first);
 		houses.erase(it);
+	}
 
 	house_to_remove->clean();
 	delete house_to_remove;
@@ -64,6 +72,9 @@ void Houses::removeHouse(House* house_to_remove)
 
 House* Houses::getHouse(uint32_t houseid)
 {
+	if(houseid < DenseIds)
+		return houseid < by_id.size() ? by_id[houseid] : nullptr;
+
 	HouseMap::iterator it = houses.find(houseid);
 	if(it != houses.end()) {
 		return it->second;
@@ -73,6 +84,9 @@ House* Houses::getHouse(uint32_t houseid)
 
 const House* Houses::getHouse(uint32_t houseid) const
 {
+	if(houseid < DenseIds)
+		return houseid < by_id.size() ? by_id[houseid] : nullptr;
+
 	HouseMap::const_iterator it = houses.find(houseid);
 	if(it != houses.end())
 		return it->second;
@@ -86,28 +100,35 @@ House::House(Map& map) :
 	townid(0),
 	guildhall(false),
 	map(&map),
-	exit(0,0,0)
+	exit(0,0,0),
+	bounds_stale(false)
 {
 	////
 }
 
 void House::clean()
 {
-	for(PositionList::const_iterator pos_iter = tiles.begin(); pos_iter != tiles.end(); ++pos_iter) {
+	for(HouseTileList::const_iterator pos_iter = tiles.begin(); pos_iter != tiles.end(); ++pos_iter) {
 		Tile* tile = map->getTile(*pos_iter);
-		if(tile)
+		if(tile) {
 			tile->setHouse(nullptr);
+			map->markAreaDirty(pos_iter->x, pos_iter->y);
+			map->markTileChanged(pos_iter->x, pos_iter->y);
+		}
 	}
 
 	Tile* tile = map->getTile(exit);
 	if(tile)
 		tile->removeHouseExit(this);
+
+	tiles.clear();
+	bounds_stale = false;
 }
 
 size_t House::size() const
 {
 	size_t count = 0;
-	for(PositionList::const_iterator pos_iter = tiles.begin(); pos_iter != tiles.end(); ++pos_iter) {
+	for(HouseTileList::const_iterator pos_iter = tiles.begin(); pos_iter != tiles.end(); ++pos_iter) {
 		Tile* tile = map->getTile(*pos_iter);
 		if(tile && !tile->isBlocking())
 			++count;
@@ -120,24 +141,72 @@ void House::addTile(Tile* tile)
 	ASSERT(tile);
 	tile->setHouse(this);
 	tiles.push_back(tile->getPosition());
+	extendBounds(tiles.back());
+}
+
+void House::addTiles(const std::vector<Tile*>& house_tiles)
+{
+	if(tiles.capacity() < tiles.size() + house_tiles.size())
+		tiles.reserve(std::max(tiles.capacity() * 2, tiles.size() + house_tiles.size()));
+	for(Tile* tile : house_tiles) {
+		ASSERT(tile);
+		tile->setHouse(this);
+		tiles.push_back(tile->getPosition());
+		extendBounds(tiles.back());
+	}
 }
 
 void House::removeTile(Tile* tile)
 {
 	ASSERT(tile);
-	for(PositionList::iterator tile_iter = tiles.begin(); tile_iter != tiles.end(); ++tile_iter) {
+	for(HouseTileList::iterator tile_iter = tiles.begin(); tile_iter != tiles.end(); ++tile_iter) {
 		if(*tile_iter == tile->getPosition()) {
+			const Position pos = *tile_iter;
 			tiles.erase(tile_iter);
 			tile->setHouse(nullptr);
+			if(pos.x == bounds_start.x || pos.y == bounds_start.y || pos.z == bounds_start.z ||
+				pos.x == bounds_end.x || pos.y == bounds_end.y || pos.z == bounds_end.z) {
+				bounds_stale = true;
+			}
 			return;
 		}
 	}
 }
 
+void House::extendBounds(const Position& pos)
+{
+	if(tiles.size() == 1) {
+		bounds_start = pos;
+		bounds_end = pos;
+		bounds_stale = false;
+	} else if(!bounds_stale) {
+		bounds_start = Position(std::min(bounds_start.x, pos.x), std::min(bounds_start.y, pos.y), std::min(bounds_start.z, pos.z));
+		bounds_end = Position(std::max(bounds_end.x, pos.x), std::max(bounds_end.y, pos.y), std::max(bounds_end.z, pos.z));
+	}
+}
+
+bool House::getBounds(Position& start, Position& end) const
+{
+	if(tiles.empty())
+		return false;
+
+	if(bounds_stale) {
+		bounds_start = bounds_end = tiles.front();
+		for(const Position& pos : tiles) {
+			bounds_start = Position(std::min(bounds_start.x, pos.x), std::min(bounds_start.y, pos.y), std::min(bounds_start.z, pos.z));
+			bounds_end = Position(std::max(bounds_end.x, pos.x), std::max(bounds_end.y, pos.y), std::max(bounds_end.z, pos.z));
+		}
+		bounds_stale = false;
+	}
+	start = bounds_start;
+	end = bounds_end;
+	return true;
+}
+
 uint8_t House::getEmptyDoorID() const
 {
 	std::set<uint8_t> taken;
-	for(PositionList::const_iterator tile_iter = tiles.begin(); tile_iter != tiles.end(); ++tile_iter) {
+	for(HouseTileList::const_iterator tile_iter = tiles.begin(); tile_iter != tiles.end(); ++tile_iter) {
 		if(const Tile* tile = map->getTile(*tile_iter)) {
 			for(ItemVector::const_iterator item_iter = tile->items.begin(); item_iter != tile->items.end(); ++item_iter) {
 				if(Door* door = dynamic_cast<Door*>(*item_iter))
@@ -158,7 +227,7 @@ uint8_t House::getEmptyDoorID() const
 
 Position House::getDoorPositionByID(uint8_t id) const
 {
-	for(PositionList::const_iterator tile_iter = tiles.begin(); tile_iter != tiles.end(); ++tile_iter) {
+	for(HouseTileList::const_iterator tile_iter = tiles.begin(); tile_iter != tiles.end(); ++tile_iter) {
 		if(const Tile* tile = map->getTile(*tile_iter)) {
 			for(ItemVector::const_iterator item_iter = tile->items.begin(); item_iter != tile->items.end(); ++item_iter) {
 				if(Door* door = dynamic_cast<Door*>(*item_iter)) {
@@ -26,6 +26,8 @@ class Door;
 
 class Houses;
 
+typedef std::vector<Position> HouseTileList;
+
 class House
 {
 public:
@@ -33,10 +35,18 @@ public:
 
 	void clean();
 	void addTile(Tile* tile);
+	// The tiles of a house are read in runs, the list grows once per run
+	void addTiles(const std::vector<Tile*>& house_tiles);
 	void removeTile(Tile* tile);
+	// The tiles that aren't blocking, which is what the house file gives as its size
 	size_t size() const;
 	std::string getDescription();
 
+	// Kept as tiles are added and removed, so neither needs a look at the map
+	size_t getTileCount() const noexcept { return tiles.size(); }
+	// The box around the tiles on every floor, false without tiles
+	bool getBounds(Position& start, Position& end) const;
+
 	uint32_t id;
 	int rent;
 	//HouseDoorList doorList;
@@ -50,13 +60,20 @@ public:
 	uint8_t getEmptyDoorID() const;
 	Position getDoorPositionByID(uint8_t id) const;
 
-	const PositionList& getTiles() const { return tiles; }
+	const HouseTileList& getTiles() const { return tiles; }
 
 protected:
+	void extendBounds(const Position& pos);
+
 	Map* map;
-	PositionList tiles;
+	HouseTileList tiles;
 	Position exit;
 
+	// Only made again from the tiles once one on its edge is removed
+	mutable Position bounds_start;
+	mutable Position bounds_end;
+	mutable bool bounds_stale;
+
 	friend class Houses;
 };
 
@@ -74,9 +91,9 @@ public:
 	HouseMap::const_iterator begin() const { return houses.begin(); }
 	HouseMap::const_iterator end() const { return houses.end(); }
 #ifdef __VISUALC__ // C++0x compliance to some degree :)
-	HouseMap::iterator erase(HouseMap::iterator iter) { return houses.erase(iter); }
+	HouseMap::iterator erase(HouseMap::iterator iter) { unindex(iter->first); orphaned_tiles = true; return houses.erase(iter); }
 #else
-	void erase(HouseMap::iterator iter) { houses.erase(iter); }
+	void erase(HouseMap::iterator iter) { unindex(iter->first); orphaned_tiles = true; houses.erase(iter); }
 #endif
 	HouseMap::iterator find(uint32_t val) { return houses.find(val); }
 
@@ -85,10 +102,24 @@ public:
 	House* getHouse(uint32_t houseid);
 	const House* getHouse(uint32_t houseid) const;
 	uint32_t getEmptyID();
+
+	// Whether the map might have tiles with the id of a house that doesn't exist, as when a house is
+	// erased without cleaning its tiles or a tile of an unknown house is put on the map
+	bool hasOrphanedTiles() const noexcept { return orphaned_tiles; }
+	void setOrphanedTiles(bool value) noexcept { orphaned_tiles = value; }
 protected:
+	void unindex(uint32_t houseid) {
+		if(houseid < by_id.size())
+			by_id[houseid] = nullptr;
+	}
+
 	Map& map;
 	uint32_t max_house_id;
+	bool orphaned_tiles;
 	HouseMap houses;
+	// The houses by id for the ids below DenseIds, every house tile loaded looks its house up
+	static const uint32_t DenseIds = 0x10000;
+	std::vector<House*> by_id;
 };
 
 #endif
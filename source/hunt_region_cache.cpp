@@ -0,0 +1,260 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Hunt Region Cache Implementation
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+#include "hunt_region_cache.h"
+
+#include "creature.h"
+#include "map.h"
+#include "tile.h"
+
+#include "ext/pugixml.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+	uint64_t parseHash(const char *text) {
+		return std::strtoull(text, nullptr, 16);
+	}
+
+	std::string formatHash(uint64_t hash) {
+		char buffer[17];
+		std::snprintf(buffer, sizeof(buffer), "%016llx",
+					  static_cast<unsigned long long>(hash));
+		return buffer;
+	}
+}
+
+HuntRegion HuntRegion::fromArea(const Position &start, const Position &end) {
+	HuntRegion region;
+	const int lastZ = std::min(std::max(start.z, end.z), rme::MapMaxLayer);
+	for (int z = std::max(std::min(start.z, end.z), 0); z <= lastZ; ++z) {
+		Box box;
+		box.startX = std::min(start.x, end.x);
+		box.startY = std::min(start.y, end.y);
+		box.endX = std::max(start.x, end.x);
+		box.endY = std::max(start.y, end.y);
+		box.z = z;
+		region.boxes.push_back(box);
+	}
+	return region;
+}
+
+HuntRegion HuntRegion::fromPositions(std::vector<Position> positions) {
+	// Packed keys sort by floor, row and column, so a run of tiles is a run
+	// of consecutive keys
+	std::vector<PositionKey> keys;
+	keys.reserve(positions.size());
+	for (const Position &position : positions) {
+		keys.push_back(packPosition(position));
+	}
+	positions.clear();
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	HuntRegion region;
+	// Boxes ending on the row above and on this row, by starting column
+	std::vector<size_t> above, row;
+	int rowY = -1, rowZ = -1;
+	size_t next = 0;
+	for (size_t index = 0; index < keys.size();) {
+		size_t last = index;
+		while (last + 1 < keys.size() && keys[last + 1] == keys[last] + 1) {
+			++last;
+		}
+		const Position start = unpackPosition(keys[index]);
+		const int endX = unpackPosition(keys[last]).x;
+		index = last + 1;
+
+		if (start.y != rowY || start.z != rowZ) {
+			if (start.z == rowZ && start.y == rowY + 1) {
+				above.swap(row);
+			} else {
+				above.clear();
+			}
+			row.clear();
+			next = 0;
+			rowY = start.y;
+			rowZ = start.z;
+		}
+
+		// A run spanning the same columns as one on the row above grows it
+		while (next < above.size() &&
+			   region.boxes[above[next]].startX < start.x) {
+			++next;
+		}
+		Box *grown = next < above.size() ? &region.boxes[above[next]] : nullptr;
+		if (grown && grown->startX == start.x && grown->endX == endX) {
+			grown->endY = start.y;
+			row.push_back(above[next]);
+			++next;
+			continue;
+		}
+
+		Box box;
+		box.startX = start.x;
+		box.startY = start.y;
+		box.endX = endX;
+		box.endY = start.y;
+		box.z = start.z;
+		row.push_back(region.boxes.size());
+		region.boxes.push_back(box);
+	}
+	return region;
+}
+
+uint64_t HuntRegion::hash() const {
+	uint64_t hash = HuntRegionCache::hashBytes(nullptr, 0);
+	for (const Box &box : boxes) {
+		const int32_t values[] = {box.startX, box.startY, box.endX, box.endY,
+								  box.z};
+		hash = HuntRegionCache::hashBytes(values, sizeof(values), hash);
+	}
+	return hash;
+}
+
+uint64_t HuntRegionCache::hashBytes(const void *data, size_t size,
+									uint64_t seed) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for (size_t index = 0; index < size; ++index) {
+		seed = (seed ^ bytes[index]) * 0x100000001B3ull;
+	}
+	return seed;
+}
+
+void HuntRegionCache::forEachCreature(
+	const Map &map, const HuntRegion &region,
+	const std::function<void(const Position &, const Creature &)> &visit) {
+	for (const HuntRegion::Box &box : region.boxes) {
+		for (const Position &position : map.spawns.getCreaturesInArea(
+				 box.startX, box.startY, box.endX, box.endY, box.z)) {
+			const Tile *tile = map.getTile(position);
+			if (tile && tile->creature) {
+				visit(position, *tile->creature);
+			}
+		}
+	}
+}
+
+uint64_t HuntRegionCache::spawnVersion(const Map &map,
+									   const HuntRegion &region) {
+	uint64_t version = hashBytes(nullptr, 0);
+	forEachCreature(map, region,
+					[&](const Position &position, const Creature &creature) {
+						const PositionKey key = packPosition(position);
+						const int32_t spawnTime = creature.getSpawnTime();
+						const std::string name = creature.getName();
+						version = hashBytes(&key, sizeof(key), version);
+						version =
+							hashBytes(&spawnTime, sizeof(spawnTime), version);
+						version = hashBytes(name.data(), name.size(), version);
+					});
+	return version;
+}
+
+void HuntRegionCache::store(HuntCacheEntry entry) {
+	entry.geometryHash = entry.region.hash();
+	for (HuntCacheEntry &existing : entries) {
+		if (existing.name == entry.name) {
+			existing = std::move(entry);
+			return;
+		}
+	}
+	entries.push_back(std::move(entry));
+}
+
+bool HuntRegionCache::remove(const std::string &name) {
+	auto it = std::find_if(
+		entries.begin(), entries.end(),
+		[&name](const HuntCacheEntry &entry) { return entry.name == name; });
+	if (it == entries.end()) {
+		return false;
+	}
+	entries.erase(it);
+	return true;
+}
+
+bool HuntRegionCache::load(const std::string &path) {
+	entries.clear();
+
+	pugi::xml_document doc;
+	if (!doc.load_file(path.c_str())) {
+		return false;
+	}
+
+	pugi::xml_node root = doc.child("hunt_regions");
+	if (!root) {
+		return false;
+	}
+
+	for (pugi::xml_node node : root.children("region")) {
+		HuntCacheEntry entry;
+		entry.name = node.attribute("name").as_string();
+		for (pugi::xml_node boxNode : node.children("box")) {
+			HuntRegion::Box box;
+			box.startX = boxNode.attribute("startx").as_int();
+			box.startY = boxNode.attribute("starty").as_int();
+			box.endX = boxNode.attribute("endx").as_int();
+			box.endY = boxNode.attribute("endy").as_int();
+			box.z = boxNode.attribute("z").as_int();
+			entry.region.boxes.push_back(box);
+		}
+
+		// A region changed by hand doesn't match its key anymore, nothing
+		// cached for it can be trusted
+		entry.geometryHash = parseHash(node.attribute("geometry").as_string());
+		if (entry.name.empty() || entry.region.empty() ||
+			entry.region.hash() != entry.geometryHash) {
+			continue;
+		}
+
+		entry.spawnVersion = parseHash(node.attribute("spawns").as_string());
+		entry.settingsHash = parseHash(node.attribute("settings").as_string());
+		entry.metrics.expPerHour = node.attribute("exp_per_hour").as_double();
+		entry.metrics.goldPerHour =
+			node.attribute("gold_per_hour").as_double();
+		entry.metrics.killsPerHour =
+			node.attribute("kills_per_hour").as_double();
+		entry.metrics.monsters = node.attribute("monsters").as_uint();
+		entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+bool HuntRegionCache::save(const std::string &path) const {
+	pugi::xml_document doc;
+
+	pugi::xml_node decl = doc.prepend_child(pugi::node_declaration);
+	decl.append_attribute("version") = "1.0";
+	decl.append_attribute("encoding") = "UTF-8";
+
+	pugi::xml_node root = doc.append_child("hunt_regions");
+	for (const HuntCacheEntry &entry : entries) {
+		pugi::xml_node node = root.append_child("region");
+		node.append_attribute("name") = entry.name.c_str();
+		node.append_attribute("geometry") =
+			formatHash(entry.geometryHash).c_str();
+		node.append_attribute("spawns") =
+			formatHash(entry.spawnVersion).c_str();
+		node.append_attribute("settings") =
+			formatHash(entry.settingsHash).c_str();
+		node.append_attribute("exp_per_hour") = entry.metrics.expPerHour;
+		node.append_attribute("gold_per_hour") = entry.metrics.goldPerHour;
+		node.append_attribute("kills_per_hour") = entry.metrics.killsPerHour;
+		node.append_attribute("monsters") = entry.metrics.monsters;
+
+		for (const HuntRegion::Box &box : entry.region.boxes) {
+			pugi::xml_node boxNode = node.append_child("box");
+			boxNode.append_attribute("startx") = box.startX;
+			boxNode.append_attribute("starty") = box.startY;
+			boxNode.append_attribute("endx") = box.endX;
+			boxNode.append_attribute("endy") = box.endY;
+			boxNode.append_attribute("z") = box.z;
+		}
+	}
+	return doc.save_file(path.c_str());
+}
@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Hunt Region Cache - Metrics of named hunting spots, kept per map
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_HUNT_REGION_CACHE_H_
+#define RME_HUNT_REGION_CACHE_H_
+
+#include "position.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Creature;
+class Map;
+
+// The tiles of a hunting spot as boxes on single floors. Selections become a
+// box per run of tiles, runs repeating on the next row are merged, so the
+// same tiles always give the same boxes whatever tool picked them.
+struct HuntRegion {
+	struct Box {
+		int startX = 0, startY = 0;
+		int endX = 0, endY = 0; // Inclusive
+		int z = 0;
+	};
+	std::vector<Box> boxes;
+
+	static HuntRegion fromArea(const Position &start, const Position &end);
+	static HuntRegion fromPositions(std::vector<Position> positions);
+
+	bool empty() const { return boxes.empty(); }
+	uint64_t hash() const;
+};
+
+// What the comparison ranks the spots by
+struct HuntMetrics {
+	double expPerHour = 0.0;
+	double goldPerHour = 0.0;
+	double killsPerHour = 0.0;
+	uint32_t monsters = 0;
+};
+
+struct HuntCacheEntry {
+	std::string name;
+	HuntRegion region;
+	// The metrics are current as long as the three keys match
+	uint64_t geometryHash = 0;
+	uint64_t spawnVersion = 0;
+	uint64_t settingsHash = 0;
+	HuntMetrics metrics;
+};
+
+// The computed metrics of every named region of a map, saved next to its
+// analyses. An entry goes stale when the creatures within its region or the
+// rates and kill settings change, edits elsewhere on the map don't touch it.
+class HuntRegionCache {
+  public:
+	bool load(const std::string &path);
+	bool save(const std::string &path) const;
+	void clear() { entries.clear(); }
+
+	// Replaces the entry of the same name, the geometry key is worked out here
+	void store(HuntCacheEntry entry);
+	bool remove(const std::string &name);
+	const std::vector<HuntCacheEntry> &getEntries() const { return entries; }
+	std::vector<HuntCacheEntry> &getEntries() { return entries; }
+
+	// Visits the creatures within the region through the creature index of
+	// the map, the tiles outside of it aren't looked at
+	static void forEachCreature(
+		const Map &map, const HuntRegion &region,
+		const std::function<void(const Position &, const Creature &)> &visit);
+	// Fingerprint of the creatures within the region, their positions, names
+	// and spawn times
+	static uint64_t spawnVersion(const Map &map, const HuntRegion &region);
+
+	// FNV-1a, stable between runs so the keys can be saved
+	static uint64_t hashBytes(const void *data, size_t size,
+							  uint64_t seed = 0xCBF29CE484222325ull);
+
+  private:
+	std::vector<HuntCacheEntry> entries;
+};
+
+#endif // RME_HUNT_REGION_CACHE_H_
@@ -0,0 +1,236 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Hunt Simulation Implementation
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+#include "hunt_simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	// Hunts of a task and of a round, results are reported once per round
+	const uint64_t HuntsPerTask = 64;
+	const uint64_t HuntsPerRound = 1024;
+
+	uint32_t mix(uint32_t value) {
+		value = (value ^ (value >> 16)) * 0x7FEB352Du;
+		value = (value ^ (value >> 15)) * 0x846CA68Bu;
+		return value ^ (value >> 16);
+	}
+
+	// Streams of random numbers, 0 is the kill times of a monster and the
+	// others its loot items
+	uint64_t streamId(uint64_t hunt, size_t monster, size_t stream) {
+		return (hunt << 32) | (uint64_t(monster & 0xFFFF) << 16) |
+			   uint64_t(stream & 0xFFFF);
+	}
+
+	double percentile(const std::vector<double> &sorted, double fraction) {
+		if (sorted.empty()) {
+			return 0.0;
+		}
+		const size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+		return sorted[index];
+	}
+}
+
+void HuntSimulation::fillUniform(float *out, size_t count, uint64_t stream) {
+	// Counter based, every number only depends on the stream and its index,
+	// so the loop has no dependency from one lane to the next and vectorizes
+	const uint32_t key = mix(uint32_t(stream) ^ mix(uint32_t(stream >> 32)));
+	for (size_t index = 0; index < count; ++index) {
+		const uint32_t value = mix(key + uint32_t(index) * 0x9E3779B9u);
+		out[index] = float(value >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+void HuntSimulation::simulate(const HuntSimulationInput &input, uint64_t hunt,
+							  Accumulator &accumulator,
+							  std::vector<float> &randoms,
+							  std::vector<float> &killTimes,
+							  std::vector<float> &firstDrop) {
+	const float never = std::numeric_limits<float>::infinity();
+	firstDrop.assign(input.slotCount, never);
+
+	double gold = 0.0;
+	double experience = 0.0;
+	for (size_t monsterIndex = 0; monsterIndex < input.monsters.size();
+		 ++monsterIndex) {
+		const HuntSimulationInput::Monster &monster =
+			input.monsters[monsterIndex];
+		if (monster.killsPerHour <= 0.0) {
+			continue;
+		}
+
+		// Every interval is at least half the mean, which bounds the kills
+		const double interval = 60.0 / monster.killsPerHour;
+		const size_t maxKills =
+			static_cast<size_t>(2.0 * input.minutes / interval) + 2;
+		randoms.resize(maxKills);
+		fillUniform(randoms.data(), maxKills, streamId(hunt, monsterIndex, 0));
+
+		killTimes.clear();
+		double time = randoms[0] * interval;
+		for (size_t index = 1; time <= input.minutes && index < maxKills;
+			 ++index) {
+			killTimes.push_back(static_cast<float>(time));
+			time += interval * (0.5 + randoms[index]);
+		}
+
+		const size_t kills = killTimes.size();
+		experience += kills * monster.experience;
+		if (kills == 0) {
+			continue;
+		}
+
+		for (size_t lootIndex = 0; lootIndex < monster.loot.size();
+			 ++lootIndex) {
+			const HuntSimulationInput::Loot &loot = monster.loot[lootIndex];
+			if (loot.chance <= 0.0 || loot.slot >= input.slotCount) {
+				continue;
+			}
+
+			fillUniform(randoms.data(), kills,
+						streamId(hunt, monsterIndex, lootIndex + 1));
+
+			// A roll under the chance is a drop, and scaled back up it is
+			// uniform again, which gives the count without another number
+			const float chance = static_cast<float>(loot.chance);
+			const float scale = static_cast<float>(loot.countmax / loot.chance);
+			const uint32_t extraMax = loot.countmax > 0 ? loot.countmax - 1 : 0;
+			uint64_t amount = 0;
+			for (size_t kill = 0; kill < kills; ++kill) {
+				const float roll = randoms[kill];
+				const uint32_t extra =
+					std::min(extraMax, static_cast<uint32_t>(roll * scale));
+				amount += roll < chance ? 1 + extra : 0;
+			}
+			if (amount == 0) {
+				continue;
+			}
+
+			gold += static_cast<double>(amount) * loot.coinValue;
+			for (size_t kill = 0; kill < kills; ++kill) {
+				if (randoms[kill] < chance) {
+					firstDrop[loot.slot] =
+						std::min(firstDrop[loot.slot], killTimes[kill]);
+					break;
+				}
+			}
+		}
+	}
+
+	accumulator.gold.push_back(gold);
+	accumulator.exp.push_back(experience);
+	for (size_t slot = 0; slot < input.slotCount; ++slot) {
+		if (firstDrop[slot] == never) {
+			continue;
+		}
+		const int bin = std::min(
+			TimeBins - 1,
+			static_cast<int>(firstDrop[slot] / input.minutes * TimeBins));
+		++accumulator.firstDrops[slot * TimeBins + std::max(bin, 0)];
+	}
+}
+
+HuntSimulationResult
+HuntSimulation::summarize(const HuntSimulationInput &input,
+						  const Accumulator &total) {
+	HuntSimulationResult result;
+	result.hunts = total.gold.size();
+	result.minutes = input.minutes;
+
+	std::vector<double> sorted = total.gold;
+	std::sort(sorted.begin(), sorted.end());
+	result.goldP10 = percentile(sorted, 0.1);
+	result.goldP50 = percentile(sorted, 0.5);
+	result.goldP90 = percentile(sorted, 0.9);
+
+	sorted = total.exp;
+	std::sort(sorted.begin(), sorted.end());
+	result.expP10 = percentile(sorted, 0.1);
+	result.expP50 = percentile(sorted, 0.5);
+	result.expP90 = percentile(sorted, 0.9);
+
+	const double never = std::numeric_limits<double>::infinity();
+	const double hunts = static_cast<double>(std::max<uint64_t>(result.hunts, 1));
+	result.slots.resize(input.slotCount);
+	for (size_t slot = 0; slot < input.slotCount; ++slot) {
+		HuntSimulationResult::Slot &stats = result.slots[slot];
+		stats.firstDropP50 = never;
+		stats.firstDropP90 = never;
+
+		const uint32_t *bins = &total.firstDrops[slot * TimeBins];
+		uint64_t dropped = 0;
+		for (int bin = 0; bin < TimeBins; ++bin) {
+			dropped += bins[bin];
+			stats.histogram[bin * HuntSimulationResult::HistogramBins /
+							TimeBins] += bins[bin];
+
+			const double time = (bin + 1) * input.minutes / TimeBins;
+			if (stats.firstDropP50 == never && dropped >= 0.5 * hunts) {
+				stats.firstDropP50 = time;
+			}
+			if (stats.firstDropP90 == never && dropped >= 0.9 * hunts) {
+				stats.firstDropP90 = time;
+			}
+		}
+		stats.dropShare = dropped / hunts;
+	}
+	return result;
+}
+
+void HuntSimulation::run(const HuntSimulationInput &input, uint64_t maxHunts,
+						 ThreadPool::TaskGroup &group, const Report &report) {
+	ThreadPool &pool = ThreadPool::getInstance();
+	group.setProgressTotal(static_cast<int64_t>(maxHunts));
+
+	Accumulator total;
+	total.firstDrops.assign(input.slotCount * TimeBins, 0);
+
+	uint64_t done = 0;
+	while (done < maxHunts && !group.isCancelled()) {
+		const uint64_t round = std::min(HuntsPerRound, maxHunts - done);
+		const size_t tasks =
+			static_cast<size_t>((round + HuntsPerTask - 1) / HuntsPerTask);
+
+		// Every task fills its own accumulator, they are merged in order
+		std::vector<Accumulator> parts(tasks);
+		pool.parallelFor(tasks, [&](size_t task) {
+			if (group.isCancelled()) {
+				return;
+			}
+
+			Accumulator &part = parts[task];
+			part.firstDrops.assign(input.slotCount * TimeBins, 0);
+			std::vector<float> randoms, killTimes, firstDrop;
+			const uint64_t first = done + task * HuntsPerTask;
+			const uint64_t last = std::min(first + HuntsPerTask, done + round);
+			for (uint64_t hunt = first; hunt < last; ++hunt) {
+				simulate(input, hunt, part, randoms, killTimes, firstDrop);
+			}
+		});
+		if (group.isCancelled()) {
+			return;
+		}
+
+		for (const Accumulator &part : parts) {
+			total.gold.insert(total.gold.end(), part.gold.begin(),
+							  part.gold.end());
+			total.exp.insert(total.exp.end(), part.exp.begin(), part.exp.end());
+			for (size_t index = 0; index < total.firstDrops.size(); ++index) {
+				total.firstDrops[index] += part.firstDrops[index];
+			}
+		}
+		done += round;
+		group.addProgress(static_cast<int64_t>(round));
+
+		HuntSimulationResult result = summarize(input, total);
+		result.finished = done >= maxHunts;
+		report(result);
+	}
+}
@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Hunt Simulation - Monte Carlo runs of the hunts of the hunting calculator
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_HUNT_SIMULATION_H_
+#define RME_HUNT_SIMULATION_H_
+
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// What a hunt is made of, with the multipliers of the server already applied
+struct HuntSimulationInput {
+	struct Loot {
+		uint32_t slot = 0;		// Index of the aggregated loot entry
+		double chance = 0.0;	// Per kill, 0 to 1
+		uint32_t countmax = 1;
+		uint64_t coinValue = 0; // Gold per item, 0 if it isn't a coin
+	};
+
+	struct Monster {
+		double killsPerHour = 0.0;
+		double experience = 0.0; // Per kill
+		std::vector<Loot> loot;
+	};
+
+	std::vector<Monster> monsters;
+	size_t slotCount = 0;
+	double minutes = 60.0;
+};
+
+// The hunts simulated so far, percentiles are taken over the hunts
+struct HuntSimulationResult {
+	static const int HistogramBins = 10;
+
+	struct Slot {
+		// Share of the hunts that got at least one
+		double dropShare = 0.0;
+		// Minutes into the hunt by which half and 90% of the hunts had the
+		// first one, infinity if fewer hunts than that got it at all
+		double firstDropP50 = 0.0;
+		double firstDropP90 = 0.0;
+		// Hunts by the time of their first drop, over the duration of the hunt
+		uint32_t histogram[HistogramBins] = {};
+	};
+
+	uint64_t hunts = 0;
+	bool finished = false;
+	double minutes = 0.0;
+	double goldP10 = 0.0, goldP50 = 0.0, goldP90 = 0.0;
+	double expP10 = 0.0, expP50 = 0.0, expP90 = 0.0;
+	std::vector<Slot> slots;
+};
+
+// Simulates hunts in rounds on the thread pool. Each kill comes a respawn
+// interval after the last, jittered by up to half of it either way, and rolls
+// every item of the loot table. The random numbers of a hunt only depend on
+// its index, so the result doesn't change with the number of threads.
+class HuntSimulation {
+  public:
+	using Report = std::function<void(const HuntSimulationResult &)>;
+
+	// Runs until maxHunts were simulated or the group is cancelled, report
+	// gets the running result after every round, on the calling thread
+	static void run(const HuntSimulationInput &input, uint64_t maxHunts,
+					ThreadPool::TaskGroup &group, const Report &report);
+
+  private:
+	// Fine bins of the first drop times, the percentiles are read from them
+	static const int TimeBins = 200;
+
+	struct Accumulator {
+		std::vector<double> gold;
+		std::vector<double> exp;
+		// TimeBins per slot, hunts without a drop aren't counted
+		std::vector<uint32_t> firstDrops;
+	};
+
+	static void simulate(const HuntSimulationInput &input, uint64_t hunt,
+						 Accumulator &accumulator,
+						 std::vector<float> &randoms,
+						 std::vector<float> &killTimes,
+						 std::vector<float> &firstDrop);
+	static void fillUniform(float *out, size_t count, uint64_t stream);
+	static HuntSimulationResult summarize(const HuntSimulationInput &input,
+										  const Accumulator &total);
+};
+
+#endif // RME_HUNT_SIMULATION_H_
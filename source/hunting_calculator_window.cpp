@@ -17,15 +17,19 @@
 #include "ext/pugixml.hpp"
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iomanip>
+#include <limits>
+#include <mutex>
+#include <numeric>
 #include <regex>
 #include <sstream>
 #include <wx/dir.h>
 #include <wx/filename.h>
+#include <wx/listctrl.h>
 #include <wx/statline.h>
-#include <wx/textfile.h>
 #include <wx/tokenzr.h>
 
 // Coin IDs and values
@@ -79,6 +83,37 @@ static uint16_t LookupItemIdByName(const std::string &name) {
 	return 0;
 }
 
+// ============================================================================
+// Parsed monster files, shared by every calculator window
+// A file is parsed again only once its modification time changes
+// ============================================================================
+struct MonsterFileEntry {
+	int64_t modified = 0;
+	bool loaded = false;
+	HuntingMonsterData data;
+};
+
+static std::mutex s_monsterFileCacheMutex;
+static std::unordered_map<std::string, MonsterFileEntry> s_monsterFileCache;
+
+static int64_t GetFileModified(const std::string &filepath) {
+	wxDateTime modified = wxFileName(filepath).GetModificationTime();
+	return modified.IsValid() ? modified.GetValue().GetValue() : 0;
+}
+
+// Parsed config.lua rates, by the same rule, only read from the UI thread
+struct ConfigFileEntry {
+	int64_t modified = 0;
+	ServerConfig config;
+};
+
+static std::unordered_map<std::string, ConfigFileEntry> s_configFileCache;
+
+static std::string ToLower(std::string text) {
+	std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+	return text;
+}
+
 // ============================================================================
 // MonsterListBox Implementation
 // ============================================================================
@@ -121,7 +156,7 @@ void MonsterListBox::OnDrawItem(wxDC &dc, const wxRect &rect, size_t n) const {
 				g_gui.gfx.getCreatureSprite(monster.outfit.lookType);
 			if (sprite) {
 				wxRect spriteRect(rect.GetX() + 2, rect.GetY() + 2, 32, 32);
-				sprite->DrawTo(&dc, spriteRect, monster.outfit);
+				sprite->DrawTo(&dc, spriteRect, monster.outfit, this);
 			}
 		} catch (...) {
 			// If sprite loading fails, just skip drawing the sprite
@@ -296,6 +331,42 @@ void LootListBox::OnShowExpectedTime(wxCommandEvent &event) {
 	message +=
 		wxString::Format("95%% chance: %s\n", m_calculator->FormatTime(time95));
 
+	const HuntSimulationResult &simulation = m_calculator->GetSimulation();
+	if (static_cast<size_t>(m_rightClickedItem) < simulation.slots.size()) {
+		const HuntSimulationResult::Slot &slot =
+			simulation.slots[m_rightClickedItem];
+		auto formatSimulated = [this](double minutes) {
+			return std::isinf(minutes)
+					   ? std::string("not within the hunt")
+					   : m_calculator->FormatTime(minutes);
+		};
+
+		message += wxString::Format("\n--- %llu Simulated Hunts ---\n",
+									static_cast<unsigned long long>(
+										simulation.hunts));
+		message += wxString::Format("Dropped in: %.1f%% of the hunts\n",
+									slot.dropShare * 100.0);
+		message += wxString::Format("Half of the hunts had it by: %s\n",
+									formatSimulated(slot.firstDropP50));
+		message += wxString::Format("90%% of the hunts had it by: %s\n",
+									formatSimulated(slot.firstDropP90));
+
+		// First drops over the duration of the hunt
+		const double binMinutes =
+			simulation.minutes / HuntSimulationResult::HistogramBins;
+		const double hunts =
+			static_cast<double>(std::max<uint64_t>(simulation.hunts, 1));
+		for (int bin = 0; bin < HuntSimulationResult::HistogramBins; ++bin) {
+			const double share = slot.histogram[bin] / hunts;
+			message += wxString::Format(
+				"%s - %s: %s %.1f%%\n",
+				m_calculator->FormatTime(bin * binMinutes),
+				m_calculator->FormatTime((bin + 1) * binMinutes),
+				std::string(static_cast<size_t>(share * 40.0 + 0.5), '#'),
+				share * 100.0);
+		}
+	}
+
 	wxMessageBox(message, "Expected Time to Drop: " + item.name,
 				 wxOK | wxICON_INFORMATION);
 }
@@ -319,14 +390,18 @@ EVT_CHECKBOX(ID_HUNTING_CALC_APPLY_MULTIPLIERS,
 			 HuntingCalculatorWindow::OnApplyMultipliersChanged)
 EVT_CHECKBOX(ID_HUNTING_CALC_USE_DPS_MODE,
 			 HuntingCalculatorWindow::OnKillModeChanged)
+EVT_TIMER(ID_HUNTING_CALC_PROGRESS_TIMER,
+		  HuntingCalculatorWindow::OnProgressTimer)
+EVT_BUTTON(ID_HUNTING_CALC_COMPARE_REGIONS,
+		   HuntingCalculatorWindow::OnCompareRegions)
 END_EVENT_TABLE()
 
 HuntingCalculatorWindow::HuntingCalculatorWindow(wxWindow *parent,
 												 Editor &editor)
 	: wxDialog(parent, wxID_ANY, "Hunting Calculator", wxDefaultPosition,
 			   wxSize(950, 750), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
-	  m_editor(editor), m_cacheValid(false), m_cachedCurrentFloor(7),
-	  m_cachedTileCount(0) {
+	  m_editor(editor), m_cacheValid(false), m_cachedTileCount(0),
+	  m_progressTimer(this, ID_HUNTING_CALC_PROGRESS_TIMER) {
 	SetBackgroundColour(wxColour(37, 37, 38));
 
 	try {
@@ -341,10 +416,21 @@ HuntingCalculatorWindow::HuntingCalculatorWindow(wxWindow *parent,
 		// If LoadMapConfig fails, continue with defaults
 	}
 
+	try {
+		LoadRegionCache();
+	} catch (...) {
+		// Without the cache every region is evaluated again
+	}
+
 	Centre();
 }
 
 HuntingCalculatorWindow::~HuntingCalculatorWindow() {
+	// The analysis and the simulation post to this window, they have to be
+	// gone first
+	CancelAnalysis();
+	CancelSimulation();
+
 	// Clean up cached data to free memory
 	InvalidateCache();
 	m_monstersInArea.clear();
@@ -612,6 +698,11 @@ void HuntingCalculatorWindow::CreateControls() {
 
 	mainSizer->Add(resultBox, 0, wxEXPAND | wxALL, 5);
 
+	// Spread of the simulated hunts around the expected values above
+	m_simulationLabel = newd wxStaticText(this, wxID_ANY, "");
+	m_simulationLabel->SetForegroundColour(wxColour(180, 180, 180));
+	mainSizer->Add(m_simulationLabel, 0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
 	// ========================================================================
 	// Monster and Loot Lists (side by side) with headers
 	// ========================================================================
@@ -699,6 +790,11 @@ void HuntingCalculatorWindow::CreateControls() {
 	m_savedAnalysesList->SetMinSize(wxSize(150, -1));
 	saveBox->Add(m_savedAnalysesList, 0, wxALIGN_CENTER_VERTICAL | wxALL, 5);
 
+	m_compareButton =
+		newd wxButton(this, ID_HUNTING_CALC_COMPARE_REGIONS, "Compare...");
+	m_compareButton->SetMinSize(wxSize(100, 28));
+	saveBox->Add(m_compareButton, 0, wxALIGN_CENTER_VERTICAL | wxALL, 5);
+
 	// Populate saved analyses list
 	RefreshSavedAnalysesList();
 
@@ -748,226 +844,408 @@ void HuntingCalculatorWindow::SetUseSelection(bool useSelection) {
 		m_selectionInfoBox->ShowItems(useSelection);
 	}
 
-	// If using selection, cache the tiles and update info
+	// If using selection, cache the monsters and update info
 	if (useSelection) {
-		// Safely get current floor
-		try {
-			m_cachedCurrentFloor = g_gui.GetCurrentFloor();
-		} catch (...) {
-			m_cachedCurrentFloor = 7; // Default to ground floor
-		}
+		CacheSelectionMonsters();
+		UpdateSelectionInfo();
+	}
 
-		m_cacheValid = false;
+	Layout();
+	Refresh();
+}
 
-		// Cache selection tiles now (with error handling inside)
-		CacheSelectionTiles();
+// ============================================================================
+// Background Analysis
+// ============================================================================
 
-		// Update selection info label
-		if (m_selectionInfoLabel) {
-			wxString info = wxString::Format(
-				"Floor %d  |  %zu tiles  |  %zu monsters", m_cachedCurrentFloor,
-				m_cachedTileCount, m_cachedMonsters.size());
-			m_selectionInfoLabel->SetLabel(info);
+// Monsters counted by lower case name
+struct HuntingCalculatorWindow::AreaMonsters {
+	std::map<std::string, int> counts;
+	std::map<std::string, std::string> names;
+	std::map<std::string, Outfit> outfits;
+
+	void add(const std::string &name, const Outfit &outfit) {
+		std::string lowerName = ToLower(name);
+		counts[lowerName]++;
+		names[lowerName] = name;
+		if (outfit.lookType > 0) {
+			outfits[lowerName] = outfit;
 		}
 	}
+};
 
-	Layout();
-	Refresh();
-}
+// Everything the analysis needs from the dialog, copied before it starts
+struct HuntingCalculatorWindow::AnalysisRequest {
+	bool useSelection = false;
 
-void HuntingCalculatorWindow::LoadMonstersFromArea() {
-	m_monstersInArea.clear();
+	// Selection mode, the monsters were cached when it was made
+	std::vector<CachedMonsterData> cachedMonsters;
+
+	// Coordinate mode
+	int startX = 0, startY = 0, startZ = 0;
+	int endX = 0, endY = 0, endZ = 0;
+
+	bool loadDatabase = false;
+	std::string monsterDirectory;
+};
+
+struct HuntingCalculatorWindow::AnalysisResult {
+	unsigned generation = 0;
+	bool useSelection = false;
+	AreaMonsters area;
+
+	// Set when the monster files were loaded
+	bool databaseLoaded = false;
+	std::string monsterDirectory;
+	std::unordered_map<std::string, HuntingMonsterData> database;
+};
 
-	std::map<std::string, int> monsterCounts;
-	std::map<std::string, std::string> monsterOriginalNames;
-	std::map<std::string, Outfit> monsterOutfits;
+void HuntingCalculatorWindow::StartAnalysis() {
+	CancelAnalysis();
+
+	AnalysisRequest request;
+	request.useSelection = m_useSelection;
 
 	if (m_useSelection) {
-		// Use cached monsters if available
-		if (m_cacheValid && !m_cachedMonsters.empty()) {
-			// Process cached monsters
-			for (const auto &cachedMonster : m_cachedMonsters) {
-				std::string lowerName = cachedMonster.creatureName;
-				std::transform(lowerName.begin(), lowerName.end(),
-							   lowerName.begin(), ::tolower);
-
-				monsterCounts[lowerName]++;
-				monsterOriginalNames[lowerName] = cachedMonster.creatureName;
-
-				if (cachedMonster.outfit.lookType > 0) {
-					monsterOutfits[lowerName] = cachedMonster.outfit;
-				}
-			}
-		} else {
-			// No cache - try to get from current selection
-			if (!m_editor.hasSelection()) {
-				wxMessageBox(
-					"No selection found.\nPlease make a selection with the "
-					"lasso tool first.",
-					"No Selection", wxOK | wxICON_INFORMATION);
-				return;
-			}
+		if (!m_cacheValid) {
+			wxMessageBox("No selection found.\nPlease make a selection with "
+						 "the lasso tool first.",
+						 "No Selection", wxOK | wxICON_INFORMATION);
+			return;
+		}
+		request.cachedMonsters = m_cachedMonsters;
 
-			const Selection &selection = m_editor.getSelection();
-			if (selection.empty()) {
-				wxMessageBox("Selection is empty.", "No Selection",
-							 wxOK | wxICON_INFORMATION);
-				return;
-			}
+		std::vector<Position> positions;
+		positions.reserve(m_editor.getSelection().size());
+		for (const Tile *tile : m_editor.getSelection()) {
+			positions.push_back(tile->getPosition());
+		}
+		m_analysisRegion = HuntRegion::fromPositions(std::move(positions));
+	} else {
+		request.startX = m_startX->GetValue();
+		request.startY = m_startY->GetValue();
+		request.startZ = m_startZ->GetValue();
+		request.endX = m_endX->GetValue();
+		request.endY = m_endY->GetValue();
+		request.endZ = m_endZ->GetValue();
 
-			// Use the cached floor (which was detected from the selection in
-			// CacheSelectionTiles)
-			int currentFloor = m_cachedCurrentFloor;
+		// Ensure proper order
+		if (request.startX > request.endX)
+			std::swap(request.startX, request.endX);
+		if (request.startY > request.endY)
+			std::swap(request.startY, request.endY);
+		if (request.startZ > request.endZ)
+			std::swap(request.startZ, request.endZ);
+
+		m_analysisRegion = HuntRegion::fromArea(
+			Position(request.startX, request.startY, request.startZ),
+			Position(request.endX, request.endY, request.endZ));
+
+		// The scan runs on the pool, which can't read paged out areas back
+		m_editor.getMap().pageInArea(request.startX, request.startY,
+									 request.endX, request.endY);
+	}
+
+	// The monster database is only loaded once per directory
+	request.loadDatabase =
+		m_monsterDatabase.empty() && !m_monsterDirectory.empty();
+	request.monsterDirectory = m_monsterDirectory;
+	if (request.loadDatabase) {
+		// Built here, the loot parsers only read it
+		BuildItemNameCache();
+	}
 
-			// Copy tiles to local vector first to avoid issues with selection
-			// modification
-			std::vector<Tile *> tilesToProcess;
-			try {
-				const TileSet &tiles = selection.getTiles();
-				tilesToProcess.reserve(tiles.size());
-				for (Tile *tile : tiles) {
-					if (tile != nullptr && tile->location != nullptr) {
-						tilesToProcess.push_back(tile);
-					}
-				}
-			} catch (...) {
-				wxMessageBox("Error accessing selection tiles.", "Error",
-							 wxOK | wxICON_ERROR);
-				return;
-			}
+	ShowProgress("Analyzing area...", 100);
+	m_progressTimer.Start(100);
 
-			// If cache is not valid, detect floor from tiles
-			if (!m_cacheValid && !tilesToProcess.empty()) {
-				std::map<int, int> floorCounts;
-				for (Tile *tile : tilesToProcess) {
-					if (tile != nullptr && tile->location != nullptr) {
-						try {
-							int tileZ = tile->getZ();
-							floorCounts[tileZ]++;
-						} catch (...) {
-							continue;
-						}
-					}
-				}
+	m_analysis = std::make_unique<ThreadPool::TaskGroup>();
+	ThreadPool::TaskGroup &group = *m_analysis;
+	const unsigned generation = m_analysisGeneration;
+	if (m_editor.IsLive()) {
+		// Live peers change the map from the event loop, so the tiles are
+		// only safe to read right here
+		RunAnalysis(request, group, generation);
+		return;
+	}
+	ThreadPool::getInstance().submit(group,
+									 [this, request, &group, generation]() {
+										 RunAnalysis(request, group,
+													 generation);
+									 });
+}
 
-				// Find the floor with the most tiles
-				int maxCount = 0;
-				for (const auto &pair : floorCounts) {
-					if (pair.second > maxCount) {
-						maxCount = pair.second;
-						currentFloor = pair.first;
-					}
-				}
-				m_cachedCurrentFloor = currentFloor;
-			}
+void HuntingCalculatorWindow::CancelAnalysis() {
+	if (m_analysis) {
+		m_analysis->cancel();
+		try {
+			ThreadPool::getInstance().wait(*m_analysis);
+		} catch (const std::exception &e) {
+			// Cancelled anyway, the window may be going away
+			wxLogError("The hunt analysis failed: %s", e.what());
+		}
+		m_analysis.reset();
+	}
+	// Drops whatever the cancelled analysis already posted
+	++m_analysisGeneration;
+	m_progressTimer.Stop();
+}
 
-			// Iterate over copied tiles
-			for (Tile *tile : tilesToProcess) {
-				if (tile == nullptr || tile->location == nullptr)
-					continue;
+void HuntingCalculatorWindow::StartSimulation(
+	const HuntSimulationInput &input) {
+	CancelSimulation();
+	m_simulationResult = HuntSimulationResult();
+	if (m_simulationLabel) {
+		m_simulationLabel->SetLabel(input.monsters.empty()
+										? ""
+										: "Simulating hunts...");
+	}
+	if (input.monsters.empty()) {
+		return;
+	}
 
-				int tileZ = 0;
-				try {
-					tileZ = tile->getZ();
-				} catch (...) {
-					continue;
+	m_simulation = std::make_unique<ThreadPool::TaskGroup>();
+	ThreadPool::TaskGroup &group = *m_simulation;
+	const unsigned generation = m_simulationGeneration;
+	ThreadPool::getInstance().submit(group, [this, input, &group,
+											 generation]() {
+		// The rounds are quick, the window is only updated every now and then
+		auto lastPost = std::chrono::steady_clock::time_point();
+		HuntSimulation::run(
+			input, SIMULATED_HUNTS, group,
+			[&](const HuntSimulationResult &result) {
+				auto now = std::chrono::steady_clock::now();
+				if (!result.finished &&
+					now - lastPost < std::chrono::milliseconds(250)) {
+					return;
 				}
+				lastPost = now;
+				auto posted = std::make_shared<HuntSimulationResult>(result);
+				CallAfter([this, generation, posted]() {
+					if (generation == m_simulationGeneration) {
+						ApplySimulation(*posted);
+					}
+				});
+			});
+	});
+}
 
-				if (tileZ != currentFloor)
-					continue;
+void HuntingCalculatorWindow::CancelSimulation() {
+	if (m_simulation) {
+		m_simulation->cancel();
+		try {
+			ThreadPool::getInstance().wait(*m_simulation);
+		} catch (const std::exception &e) {
+			// Cancelled anyway, the window may be going away
+			wxLogError("The hunt simulation failed: %s", e.what());
+		}
+		m_simulation.reset();
+	}
+	// Drops whatever the cancelled simulation already posted
+	++m_simulationGeneration;
+}
 
-				Creature *creature = tile->creature;
-				if (creature != nullptr && !creature->isNpc()) {
-					try {
-						std::string name = creature->getName();
-						std::string lowerName = name;
-						std::transform(lowerName.begin(), lowerName.end(),
-									   lowerName.begin(), ::tolower);
-
-						monsterCounts[lowerName]++;
-						monsterOriginalNames[lowerName] = name;
-
-						const Outfit &outfit = creature->getLookType();
-						if (outfit.lookType > 0) {
-							monsterOutfits[lowerName] = outfit;
-						}
-					} catch (...) {
-						continue;
-					}
+void HuntingCalculatorWindow::ApplySimulation(
+	const HuntSimulationResult &result) {
+	m_simulationResult = result;
+	if (!m_simulationLabel) {
+		return;
+	}
+
+	m_simulationLabel->SetLabel(wxString::Format(
+		"%s hunts simulated%s  |  Gold P10/P50/P90: %s / %s / %s  |  "
+		"Exp P10/P50/P90: %s / %s / %s",
+		FormatNumber(static_cast<double>(result.hunts)),
+		result.finished ? "" : "...",
+		FormatGold(static_cast<uint64_t>(result.goldP10)),
+		FormatGold(static_cast<uint64_t>(result.goldP50)),
+		FormatGold(static_cast<uint64_t>(result.goldP90)),
+		FormatNumber(result.expP10), FormatNumber(result.expP50),
+		FormatNumber(result.expP90)));
+}
+
+void HuntingCalculatorWindow::RunAnalysis(const AnalysisRequest &request,
+										  ThreadPool::TaskGroup &group,
+										  unsigned generation) {
+	auto result = std::make_shared<AnalysisResult>();
+	result->generation = generation;
+	result->useSelection = request.useSelection;
+	AreaMonsters &area = result->area;
+
+	// Partial counts are shown every now and then while scanning. The results
+	// are posted to this window rather than the app, wxWidgets drops its
+	// pending calls once the window is destroyed
+	auto lastPost = std::chrono::steady_clock::now();
+	auto postPartial = [&]() {
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastPost < std::chrono::milliseconds(250)) {
+			return;
+		}
+		lastPost = now;
+		auto partial = std::make_shared<AreaMonsters>(area);
+		CallAfter([this, generation, partial]() {
+			if (generation == m_analysisGeneration) {
+				ShowMonsters(*partial);
+			}
+		});
+	};
+
+	int64_t scanTotal = 0;
+	if (request.useSelection) {
+		for (const CachedMonsterData &monster : request.cachedMonsters) {
+			area.add(monster.creatureName, monster.outfit);
+		}
+	} else {
+		// The creature index of the map gives the occupied tiles of every
+		// floor of the area, empty ground isn't looked at
+		const Map &map = m_editor.getMap();
+		const std::vector<Position> positions = map.spawns.getCreaturesInArea(
+			Position(request.startX, request.startY, request.startZ),
+			Position(request.endX, request.endY, request.endZ));
+		scanTotal = static_cast<int64_t>(positions.size());
+		group.setProgressTotal(scanTotal);
+
+		for (size_t index = 0; index < positions.size(); ++index) {
+			const Tile *tile = map.getTile(positions[index]);
+			if (tile && tile->creature && !tile->creature->isNpc()) {
+				area.add(tile->creature->getName(),
+						 tile->creature->getLookType());
+			}
+			if ((index & 4095) == 4095) {
+				if (group.isCancelled()) {
+					return;
 				}
+				group.addProgress(4096);
+				postPartial();
 			}
 		}
-
-		if (monsterCounts.empty()) {
-			wxMessageBox("No monsters found on floor " +
-							 std::to_string(m_cachedCurrentFloor) + ".",
-						 "No Monsters", wxOK | wxICON_INFORMATION);
+		if (group.isCancelled()) {
 			return;
 		}
-	} else {
-		// Use coordinate-based area scan
-		Map &map = m_editor.getMap();
-
-		int startX = m_startX->GetValue();
-		int startY = m_startY->GetValue();
-		int startZ = m_startZ->GetValue();
-		int endX = m_endX->GetValue();
-		int endY = m_endY->GetValue();
-		int endZ = m_endZ->GetValue();
+		group.addProgress(positions.size() & 4095);
+	}
 
-		// Ensure proper order
-		if (startX > endX)
-			std::swap(startX, endX);
-		if (startY > endY)
-			std::swap(startY, endY);
-		if (startZ > endZ)
-			std::swap(startZ, endZ);
-
-		// Scan the area for creatures (no progress bar to avoid wxYield issues)
-		for (int z = startZ; z <= endZ; ++z) {
-			for (int y = startY; y <= endY; ++y) {
-				for (int x = startX; x <= endX; ++x) {
-					Tile *tile = map.getTile(x, y, z);
-					if (tile && tile->creature && !tile->creature->isNpc()) {
-						std::string name = tile->creature->getName();
-						std::string lowerName = name;
-						std::transform(lowerName.begin(), lowerName.end(),
-									   lowerName.begin(), ::tolower);
-						monsterCounts[lowerName]++;
-						monsterOriginalNames[lowerName] = name;
-
-						const Outfit &outfit = tile->creature->getLookType();
-						if (outfit.lookType > 0) {
-							monsterOutfits[lowerName] = outfit;
-						}
-					}
-				}
+	// Do this AFTER we know we have monsters to avoid unnecessary loading
+	if (request.loadDatabase && !area.counts.empty()) {
+		CallAfter([this, generation]() {
+			if (generation == m_analysisGeneration && m_progressLabel) {
+				m_progressLabel->SetLabel("Loading monster files...");
 			}
+		});
+		result->database =
+			LoadMonsterDatabase(request.monsterDirectory, group, scanTotal);
+		result->databaseLoaded = true;
+		result->monsterDirectory = request.monsterDirectory;
+	}
+
+	if (group.isCancelled()) {
+		return;
+	}
+	CallAfter([this, result]() { ApplyAnalysis(*result); });
+}
+
+void HuntingCalculatorWindow::ApplyAnalysis(const AnalysisResult &result) {
+	if (result.generation != m_analysisGeneration) {
+		return;
+	}
+
+	// The task group is released by the next analysis, the task that posted
+	// this may not have returned yet
+	m_progressTimer.Stop();
+	HideProgress();
+
+	// The directory may have been changed while the files were loading
+	if (result.databaseLoaded &&
+		result.monsterDirectory == m_monsterDirectory) {
+		m_monsterDatabase = result.database;
+	}
+
+	if (result.area.counts.empty()) {
+		if (result.useSelection) {
+			wxMessageBox("No monsters found in the selection.", "No Monsters",
+						 wxOK | wxICON_INFORMATION);
 		}
+		return;
 	}
+	ShowMonsters(result.area);
+}
+
+std::vector<HuntingMonsterData>
+HuntingCalculatorWindow::BuildMonsters(const AreaMonsters &area) const {
+	std::vector<HuntingMonsterData> monsters;
 
 	// Convert to monster data
-	for (const auto &pair : monsterCounts) {
+	for (const auto &pair : area.counts) {
 		HuntingMonsterData data;
-		data.name = monsterOriginalNames[pair.first];
+		data.name = area.names.at(pair.first);
 		data.count = pair.second;
 
-		auto outfitIt = monsterOutfits.find(pair.first);
-		if (outfitIt != monsterOutfits.end()) {
+		auto outfitIt = area.outfits.find(pair.first);
+		if (outfitIt != area.outfits.end()) {
 			data.outfit = outfitIt->second;
 		}
 
-		m_monstersInArea.push_back(data);
+		// Match monsters with database info
+		auto it = m_monsterDatabase.find(pair.first);
+		if (it != m_monsterDatabase.end()) {
+			data.experience = it->second.experience;
+			data.health = it->second.health;
+			data.loot = it->second.loot;
+			if (data.outfit.lookType == 0) {
+				data.outfit = it->second.outfit;
+			}
+		}
+
+		monsters.push_back(data);
 	}
 
 	// Sort by count descending
-	std::sort(m_monstersInArea.begin(), m_monstersInArea.end(),
+	std::sort(monsters.begin(), monsters.end(),
 			  [](const HuntingMonsterData &a, const HuntingMonsterData &b) {
 				  return a.count > b.count;
 			  });
+	return monsters;
+}
+
+void HuntingCalculatorWindow::ShowMonsters(const AreaMonsters &area) {
+	m_monstersInArea = BuildMonsters(area);
+	ShowResults();
+}
+
+void HuntingCalculatorWindow::UpdateSelectionInfo() {
+	if (!m_selectionInfoLabel) {
+		return;
+	}
+
+	if (!m_cacheValid) {
+		m_selectionInfoLabel->SetLabel("No selection");
+		return;
+	}
+
+	const wxString floors =
+		m_cachedMinFloor == m_cachedMaxFloor
+			? wxString::Format("Floor %d", m_cachedMinFloor)
+			: wxString::Format("Floors %d-%d", m_cachedMinFloor,
+							   m_cachedMaxFloor);
+	m_selectionInfoLabel->SetLabel(
+		wxString::Format("%s  |  %zu tiles  |  %zu monsters", floors,
+						 m_cachedTileCount, m_cachedMonsters.size()));
+}
+
+void HuntingCalculatorWindow::OnProgressTimer(wxTimerEvent &event) {
+	if (m_analysis) {
+		UpdateProgress(m_analysis->getProgress());
+	}
 }
 
 bool HuntingCalculatorWindow::LoadConfigLua(const std::string &filepath) {
+	const int64_t modified = GetFileModified(filepath);
+	auto cached = s_configFileCache.find(filepath);
+	if (modified != 0 && cached != s_configFileCache.end() &&
+		cached->second.modified == modified) {
+		m_serverConfig = cached->second.config;
+		return true;
+	}
+
 	std::ifstream file(filepath);
 	if (!file.is_open()) {
 		return false;
@@ -977,7 +1255,8 @@ bool HuntingCalculatorWindow::LoadConfigLua(const std::string &filepath) {
 						std::istreambuf_iterator<char>());
 	file.close();
 
-	// Parse rates from config.lua
+	// Parse rates from config.lua, the ones it leaves out stay at 1
+	m_serverConfig = ServerConfig();
 	std::regex rateExpRegex(R"(rateExp\s*=\s*(\d+(?:\.\d+)?))");
 	std::regex rateLootRegex(R"(rateLoot\s*=\s*(\d+(?:\.\d+)?))");
 	std::regex rateSpawnRegex(R"(rateSpawn\s*=\s*(\d+(?:\.\d+)?))");
@@ -1007,6 +1286,7 @@ bool HuntingCalculatorWindow::LoadConfigLua(const std::string &filepath) {
 	}
 
 	m_serverConfig.loaded = true;
+	s_configFileCache[filepath] = {modified, m_serverConfig};
 	return true;
 }
 
@@ -1025,26 +1305,80 @@ void HuntingCalculatorWindow::UpdateMultiplierLabels() {
 	}
 }
 
-void HuntingCalculatorWindow::LoadMonsterDatabase() {
-	m_monsterDatabase.clear();
+std::unordered_map<std::string, HuntingMonsterData>
+HuntingCalculatorWindow::LoadMonsterDatabase(
+	const std::string &monsterDirectory, ThreadPool::TaskGroup &group,
+	int64_t progressBase) {
+	std::unordered_map<std::string, HuntingMonsterData> database;
+	if (monsterDirectory.empty()) {
+		return database;
+	}
+
+	// Load from main directory and subdirectories, a 'lua' subdirectory is
+	// one of them
+	std::vector<std::string> files;
+	CollectMonsterFiles(monsterDirectory, files);
+	group.setProgressTotal(progressBase + static_cast<int64_t>(files.size()));
+
+	// Only the files that changed since they were last parsed are parsed
+	// again, they are independent so they are parsed side by side
+	std::vector<MonsterFileEntry> entries(files.size());
+	ThreadPool &pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(
+		std::min(files.size() / 16, pool.getWorkerCount() * 8), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t end = files.size() * (chunk + 1) / chunk_count;
+		for (size_t index = files.size() * chunk / chunk_count; index < end;
+			 ++index) {
+			if (group.isCancelled()) {
+				return;
+			}
 
-	if (m_monsterDirectory.empty()) {
-		return;
-	}
+			const std::string &filepath = files[index];
+			MonsterFileEntry &entry = entries[index];
+			entry.modified = GetFileModified(filepath);
+			{
+				std::lock_guard<std::mutex> lock(s_monsterFileCacheMutex);
+				auto it = s_monsterFileCache.find(filepath);
+				if (it != s_monsterFileCache.end() &&
+					it->second.modified == entry.modified) {
+					entry = it->second;
+					group.addProgress(1);
+					continue;
+				}
+			}
 
-	// Load from main directory and subdirectories
-	LoadMonstersFromDirectory(m_monsterDirectory);
+			try {
+				if (wxFileName(filepath).GetExt().Lower() == "xml") {
+					entry.loaded = LoadMonsterFromXML(filepath, entry.data);
+				} else {
+					entry.loaded = LoadMonsterFromLua(filepath, entry.data);
+				}
+			} catch (...) {
+				// Skip files that fail to load
+				entry.loaded = false;
+				entry.data = HuntingMonsterData();
+			}
 
-	// Also check for 'lua' subdirectory
-	wxString luaDir =
-		m_monsterDirectory + wxFileName::GetPathSeparator() + "lua";
-	if (wxDir::Exists(luaDir)) {
-		LoadMonstersFromDirectory(luaDir.ToStdString());
+			{
+				std::lock_guard<std::mutex> lock(s_monsterFileCacheMutex);
+				s_monsterFileCache[filepath] = entry;
+			}
+			group.addProgress(1);
+		}
+	});
+
+	// In file order, so a later file of the same monster still wins
+	for (MonsterFileEntry &entry : entries) {
+		if (entry.loaded && !entry.data.name.empty()) {
+			database[ToLower(entry.data.name)] = std::move(entry.data);
+		}
 	}
+	return database;
 }
 
-void HuntingCalculatorWindow::LoadMonstersFromDirectory(
-	const std::string &dirPath) {
+void HuntingCalculatorWindow::CollectMonsterFiles(
+	const std::string &dirPath, std::vector<std::string> &files, int depth) {
 	if (dirPath.empty()) {
 		return;
 	}
@@ -1056,64 +1390,39 @@ void HuntingCalculatorWindow::LoadMonstersFromDirectory(
 
 	wxString filename;
 
-	// Load XML files
+	// XML files
 	bool cont = dir.GetFirst(&filename, "*.xml", wxDIR_FILES);
 	while (cont) {
 		// Skip monsters.xml index file
 		if (filename.Lower() != "monsters.xml") {
-			wxString fullPath =
-				dirPath + wxFileName::GetPathSeparator() + filename;
-			try {
-				HuntingMonsterData data;
-				if (LoadMonsterFromXML(fullPath.ToStdString(), data) &&
-					!data.name.empty()) {
-					std::string key = data.name;
-					std::transform(key.begin(), key.end(), key.begin(),
-								   ::tolower);
-					m_monsterDatabase[key] = data;
-				}
-			} catch (...) {
-				// Skip files that fail to load
-			}
+			files.push_back(
+				(dirPath + wxFileName::GetPathSeparator() + filename)
+					.ToStdString());
 		}
 		cont = dir.GetNext(&filename);
 	}
 
-	// Load Lua files
+	// Lua files
 	cont = dir.GetFirst(&filename, "*.lua", wxDIR_FILES);
 	while (cont) {
 		// Skip files starting with # (examples/templates)
 		if (!filename.StartsWith("#")) {
-			wxString fullPath =
-				dirPath + wxFileName::GetPathSeparator() + filename;
-			try {
-				HuntingMonsterData data;
-				if (LoadMonsterFromLua(fullPath.ToStdString(), data) &&
-					!data.name.empty()) {
-					std::string key = data.name;
-					std::transform(key.begin(), key.end(), key.begin(),
-								   ::tolower);
-					m_monsterDatabase[key] = data;
-				}
-			} catch (...) {
-				// Skip files that fail to load
-			}
+			files.push_back(
+				(dirPath + wxFileName::GetPathSeparator() + filename)
+					.ToStdString());
 		}
 		cont = dir.GetNext(&filename);
 	}
 
-	// Recursively load from subdirectories (limit depth to avoid infinite
+	// Recursively collect from subdirectories (limit depth to avoid infinite
 	// loops)
-	static int recursionDepth = 0;
-	if (recursionDepth < 5) { // Max 5 levels deep
+	if (depth < 5) { // Max 5 levels deep
 		cont = dir.GetFirst(&filename, wxEmptyString, wxDIR_DIRS);
 		while (cont) {
 			if (filename != "." && filename != "..") {
 				wxString subDir =
 					dirPath + wxFileName::GetPathSeparator() + filename;
-				recursionDepth++;
-				LoadMonstersFromDirectory(subDir.ToStdString());
-				recursionDepth--;
+				CollectMonsterFiles(subDir.ToStdString(), files, depth + 1);
 			}
 			cont = dir.GetNext(&filename);
 		}
@@ -1211,30 +1520,31 @@ void HuntingCalculatorWindow::ParseLootXML(
 
 bool HuntingCalculatorWindow::LoadMonsterFromLua(const std::string &filepath,
 												 HuntingMonsterData &data) {
-	wxTextFile file;
-	if (!file.Open(filepath)) {
+	std::ifstream file(filepath, std::ios::binary);
+	if (!file.is_open()) {
 		return false;
 	}
 
-	std::string content;
-	for (wxString line = file.GetFirstLine(); !file.Eof();
-		 line = file.GetNextLine()) {
-		content += line.ToStdString() + "\n";
-	}
-	file.Close();
+	std::string content((std::istreambuf_iterator<char>(file)),
+						std::istreambuf_iterator<char>());
+	file.close();
 
-	// Parse Lua monster file using regex
-	std::regex nameRegex(R"((?:monster\.)?name\s*=\s*[\"']([^\"']+)[\"'])");
-	std::regex expRegex(R"((?:monster\.)?experience\s*=\s*(\d+))");
-	std::regex healthRegex(R"((?:monster\.)?(?:health|maxHealth)\s*=\s*(\d+))");
-	std::regex lookTypeRegex(R"(lookType\s*=\s*(\d+))");
-	std::regex lookHeadRegex(R"(lookHead\s*=\s*(\d+))");
-	std::regex lookBodyRegex(R"(lookBody\s*=\s*(\d+))");
-	std::regex lookLegsRegex(R"(lookLegs\s*=\s*(\d+))");
-	std::regex lookFeetRegex(R"(lookFeet\s*=\s*(\d+))");
-	std::regex lookAddonsRegex(R"(lookAddons\s*=\s*(\d+))");
-	std::regex armorRegex(R"(armor\s*=\s*(\d+))");
-	std::regex defenseRegex(R"(defense\s*=\s*(\d+))");
+	// Parse Lua monster file using regex, compiled once and shared by the
+	// threads loading the files
+	static const std::regex nameRegex(
+		R"((?:monster\.)?name\s*=\s*[\"']([^\"']+)[\"'])");
+	static const std::regex expRegex(
+		R"((?:monster\.)?experience\s*=\s*(\d+))");
+	static const std::regex healthRegex(
+		R"((?:monster\.)?(?:health|maxHealth)\s*=\s*(\d+))");
+	static const std::regex lookTypeRegex(R"(lookType\s*=\s*(\d+))");
+	static const std::regex lookHeadRegex(R"(lookHead\s*=\s*(\d+))");
+	static const std::regex lookBodyRegex(R"(lookBody\s*=\s*(\d+))");
+	static const std::regex lookLegsRegex(R"(lookLegs\s*=\s*(\d+))");
+	static const std::regex lookFeetRegex(R"(lookFeet\s*=\s*(\d+))");
+	static const std::regex lookAddonsRegex(R"(lookAddons\s*=\s*(\d+))");
+	static const std::regex armorRegex(R"(armor\s*=\s*(\d+))");
+	static const std::regex defenseRegex(R"(defense\s*=\s*(\d+))");
 
 	std::smatch match;
 
@@ -1292,7 +1602,8 @@ void HuntingCalculatorWindow::ParseLootLua(
 	const std::string &content,
 	std::vector<HuntingMonsterData::LootItem> &lootList) {
 	// Find the loot table
-	std::regex lootTableRegex(R"((?:monster\.)?loot\s*=\s*\{)");
+	static const std::regex lootTableRegex(
+		R"((?:monster\.)?loot\s*=\s*\{)");
 	std::smatch lootMatch;
 
 	if (!std::regex_search(content, lootMatch, lootTableRegex)) {
@@ -1303,10 +1614,11 @@ void HuntingCalculatorWindow::ParseLootLua(
 	std::string lootSection = content.substr(lootStart);
 
 	// Patterns
-	std::regex lootStringRegex(R"(\{\s*id\s*=\s*[\"']([^\"']+)[\"'])");
-	std::regex lootNumericRegex(R"(\{\s*id\s*=\s*(\d+)\s*,)");
-	std::regex chanceRegex(R"(chance\s*=\s*(\d+))");
-	std::regex maxCountRegex(R"(maxCount\s*=\s*(\d+))");
+	static const std::regex lootStringRegex(
+		R"(\{\s*id\s*=\s*[\"']([^\"']+)[\"'])");
+	static const std::regex lootNumericRegex(R"(\{\s*id\s*=\s*(\d+)\s*,)");
+	static const std::regex chanceRegex(R"(chance\s*=\s*(\d+))");
+	static const std::regex maxCountRegex(R"(maxCount\s*=\s*(\d+))");
 
 	// Find all loot blocks
 	size_t pos = 0;
@@ -1374,39 +1686,77 @@ void HuntingCalculatorWindow::ParseLootLua(
 	}
 }
 
+HuntSettings HuntingCalculatorWindow::GetHuntSettings() const {
+	HuntSettings settings;
+	settings.durationMinutes = m_huntingDuration->GetValue();
+	settings.useDPS = m_useDPSMode->IsChecked();
+	settings.timePerKill = CalculateTimePerKill();
+	settings.playerDPS = m_playerDPS->GetValue();
+	if (m_applyMultipliers->IsChecked() && m_serverConfig.loaded) {
+		settings.expMult = m_serverConfig.rateExp;
+		settings.lootMult = m_serverConfig.rateLoot;
+		settings.spawnMult = m_serverConfig.rateSpawn;
+	}
+	settings.monsterDirectory = m_monsterDirectory;
+	return settings;
+}
+
+uint64_t HuntSettings::hash() const {
+	const double values[] = {durationMinutes, timePerKill, playerDPS,
+							 expMult, lootMult, spawnMult};
+	uint64_t hash = HuntRegionCache::hashBytes(values, sizeof(values));
+	const uint8_t mode = useDPS ? 1 : 0;
+	hash = HuntRegionCache::hashBytes(&mode, sizeof(mode), hash);
+	return HuntRegionCache::hashBytes(monsterDirectory.data(),
+									  monsterDirectory.size(), hash);
+}
+
+HuntMetrics HuntingCalculatorWindow::HuntTotals::metrics() const {
+	HuntMetrics metrics;
+	metrics.expPerHour = expPerHour;
+	metrics.goldPerHour = static_cast<double>(goldPerHour);
+	metrics.killsPerHour = killsPerHour;
+	metrics.monsters = monsters;
+	return metrics;
+}
+
 void HuntingCalculatorWindow::CalculateResults() {
-	double huntingDurationMinutes = m_huntingDuration->GetValue();
+	const HuntSettings settings = GetHuntSettings();
+	HuntSimulationInput simulation;
+	m_totals =
+		EvaluateHunt(m_monstersInArea, settings, m_aggregatedLoot, simulation);
+	m_totalsSettingsHash = settings.hash();
+	StartSimulation(simulation);
+}
+
+HuntingCalculatorWindow::HuntTotals HuntingCalculatorWindow::EvaluateHunt(
+	std::vector<HuntingMonsterData> &monsters, const HuntSettings &settings,
+	std::vector<AggregatedLoot> &aggregatedLoot,
+	HuntSimulationInput &simulation) {
+	double huntingDurationMinutes = settings.durationMinutes;
 	double huntingDurationHours =
 		huntingDurationMinutes / 60.0; // Convert to hours for calculations
-	double timePerKill = CalculateTimePerKill();
-
-	// Get multipliers
-	double expMult = 1.0;
-	double lootMult = 1.0;
-	double spawnMult = 1.0;
-
-	if (m_applyMultipliers->IsChecked() && m_serverConfig.loaded) {
-		expMult = m_serverConfig.rateExp;
-		lootMult = m_serverConfig.rateLoot;
-		spawnMult = m_serverConfig.rateSpawn;
-	}
+	double timePerKill = settings.timePerKill;
+	double expMult = settings.expMult;
+	double lootMult = settings.lootMult;
 
 	// Respawn formula: only uses spawn rate from config.lua
 	// Protect against division by zero
-	double respawnMultiplier = (spawnMult > 0.0) ? spawnMult : 1.0;
+	double respawnMultiplier =
+		(settings.spawnMult > 0.0) ? settings.spawnMult : 1.0;
 
-	m_totalExpPerHour = 0;
-	m_totalExp = 0;
-	m_totalKills = 0;
-	m_totalGoldPerHour = 0;
-	m_aggregatedLoot.clear();
+	HuntTotals totals;
+	aggregatedLoot.clear();
 
-	std::map<uint32_t, AggregatedLoot>
-		lootMapById; // Use ID as key to avoid duplicates
-	std::map<std::string, AggregatedLoot>
-		lootMapByName; // Fallback for items without ID
+	// The entries of aggregatedLoot by item id, or by lower case name for
+	// items without one, they are also the loot slots of the simulation
+	std::vector<int32_t> slotById(std::numeric_limits<uint16_t>::max() + 1,
+								  -1);
+	std::unordered_map<std::string, int32_t> slotByName;
+	simulation = HuntSimulationInput();
+	simulation.minutes = huntingDurationMinutes;
 
-	for (auto &monster : m_monstersInArea) {
+	for (auto &monster : monsters) {
 		// Calculate respawn time (protect against division by zero)
 		monster.respawnTime = DEFAULT_RESPAWN_TIME / respawnMultiplier;
 		if (monster.respawnTime <= 0.0)
@@ -1414,8 +1764,8 @@ void HuntingCalculatorWindow::CalculateResults() {
 
 		// In DPS mode, calculate time per kill based on monster health
 		double effectiveTimePerKill = timePerKill;
-		if (m_useDPSMode->IsChecked() && monster.health > 0) {
-			double playerDPS = m_playerDPS->GetValue();
+		if (settings.useDPS && monster.health > 0) {
+			double playerDPS = settings.playerDPS;
 			if (playerDPS > 0.0) {
 				effectiveTimePerKill =
 					static_cast<double>(monster.health) / playerDPS;
@@ -1434,13 +1784,19 @@ void HuntingCalculatorWindow::CalculateResults() {
 		// Experience per hour (with multiplier)
 		monster.expPerHour =
 			monster.killsPerHour * monster.experience * expMult;
-		m_totalExpPerHour += monster.expPerHour;
+		totals.expPerHour += monster.expPerHour;
+		totals.killsPerHour += monster.killsPerHour;
+		totals.monsters += static_cast<uint32_t>(monster.count);
 
 		// Total kills and exp
 		int totalKillsForMonster =
 			static_cast<int>(monster.killsPerHour * huntingDurationHours);
-		m_totalKills += totalKillsForMonster;
-		m_totalExp += totalKillsForMonster * monster.experience * expMult;
+		totals.kills += totalKillsForMonster;
+		totals.exp += totalKillsForMonster * monster.experience * expMult;
+
+		HuntSimulationInput::Monster simulated;
+		simulated.killsPerHour = monster.killsPerHour;
+		simulated.experience = monster.experience * expMult;
 
 		// Calculate loot (with multiplier)
 		for (const auto &lootItem : monster.loot) {
@@ -1450,80 +1806,85 @@ void HuntingCalculatorWindow::CalculateResults() {
 			double expectedCount =
 				totalKillsForMonster * dropRate * lootItem.countmax;
 
-			// Calculate gold value for coins
-			uint64_t coinValue = GetCoinValue(lootItem.id);
-			if (coinValue > 0) {
-				// This is a coin - calculate gold per hour
-				double coinsPerHour =
-					monster.killsPerHour * dropRate * lootItem.countmax;
-				m_totalGoldPerHour +=
-					static_cast<uint64_t>(coinsPerHour * coinValue);
-			}
-
 			// Use ID as key if available, otherwise use name
+			uint64_t coinValue = GetCoinValue(lootItem.id);
+			int32_t *slot = nullptr;
 			if (lootItem.id > 0) {
-				if (lootMapById.find(lootItem.id) == lootMapById.end()) {
-					AggregatedLoot agg;
-					agg.name = lootItem.name;
-					agg.id = lootItem.id;
-					agg.expectedCount = expectedCount;
-					agg.dropRate = dropRate * 100.0;
-					lootMapById[lootItem.id] = agg;
-				} else {
-					lootMapById[lootItem.id].expectedCount += expectedCount;
-				}
+				slot = &slotById[lootItem.id];
 			} else if (!lootItem.name.empty()) {
-				std::string lowerName = lootItem.name;
-				std::transform(lowerName.begin(), lowerName.end(),
-							   lowerName.begin(), ::tolower);
+				std::string lowerName = ToLower(lootItem.name);
 
 				// Check if this is a coin by name
 				if (lowerName == "gold coin") {
-					double coinsPerHour =
-						monster.killsPerHour * dropRate * lootItem.countmax;
-					m_totalGoldPerHour +=
-						static_cast<uint64_t>(coinsPerHour * GOLD_COIN_VALUE);
+					coinValue = GOLD_COIN_VALUE;
 				} else if (lowerName == "platinum coin") {
-					double coinsPerHour =
-						monster.killsPerHour * dropRate * lootItem.countmax;
-					m_totalGoldPerHour += static_cast<uint64_t>(
-						coinsPerHour * PLATINUM_COIN_VALUE);
+					coinValue = PLATINUM_COIN_VALUE;
 				} else if (lowerName == "crystal coin") {
-					double coinsPerHour =
-						monster.killsPerHour * dropRate * lootItem.countmax;
-					m_totalGoldPerHour += static_cast<uint64_t>(
-						coinsPerHour * CRYSTAL_COIN_VALUE);
+					coinValue = CRYSTAL_COIN_VALUE;
 				}
+				slot = &slotByName.emplace(lowerName, -1).first->second;
+			} else {
+				continue;
+			}
 
-				if (lootMapByName.find(lowerName) == lootMapByName.end()) {
-					AggregatedLoot agg;
-					agg.name = lootItem.name;
-					agg.id = 0;
-					agg.expectedCount = expectedCount;
-					agg.dropRate = dropRate * 100.0;
-					lootMapByName[lowerName] = agg;
-				} else {
-					lootMapByName[lowerName].expectedCount += expectedCount;
-				}
+			if (coinValue > 0) {
+				// This is a coin - calculate gold per hour
+				double coinsPerHour =
+					monster.killsPerHour * dropRate * lootItem.countmax;
+				totals.goldPerHour +=
+					static_cast<uint64_t>(coinsPerHour * coinValue);
 			}
+
+			if (*slot < 0) {
+				*slot = static_cast<int32_t>(aggregatedLoot.size());
+				AggregatedLoot agg;
+				agg.name = lootItem.name;
+				agg.id = lootItem.id;
+				agg.expectedCount = expectedCount;
+				agg.dropRate = dropRate * 100.0;
+				aggregatedLoot.push_back(agg);
+			} else {
+				aggregatedLoot[*slot].expectedCount += expectedCount;
+			}
+
+			HuntSimulationInput::Loot loot;
+			loot.slot = static_cast<uint32_t>(*slot);
+			loot.chance = dropRate;
+			loot.countmax = std::max<uint32_t>(lootItem.countmax, 1);
+			loot.coinValue = coinValue;
+			simulated.loot.push_back(loot);
 		}
+		simulation.monsters.push_back(std::move(simulated));
 	}
 
-	// Convert loot maps to vector and sort
-	for (const auto &pair : lootMapById) {
-		m_aggregatedLoot.push_back(pair.second);
-	}
-	for (const auto &pair : lootMapByName) {
-		m_aggregatedLoot.push_back(pair.second);
+	// Sort the loot, the slots of the simulation follow it
+	std::vector<size_t> order(aggregatedLoot.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(),
+			  [&aggregatedLoot](size_t a, size_t b) {
+				  return aggregatedLoot[a].expectedCount >
+						 aggregatedLoot[b].expectedCount;
+			  });
+
+	std::vector<AggregatedLoot> sorted;
+	sorted.reserve(order.size());
+	std::vector<uint32_t> sortedSlot(order.size());
+	for (size_t index = 0; index < order.size(); ++index) {
+		sortedSlot[order[index]] = static_cast<uint32_t>(index);
+		sorted.push_back(std::move(aggregatedLoot[order[index]]));
 	}
+	aggregatedLoot = std::move(sorted);
 
-	std::sort(m_aggregatedLoot.begin(), m_aggregatedLoot.end(),
-			  [](const AggregatedLoot &a, const AggregatedLoot &b) {
-				  return a.expectedCount > b.expectedCount;
-			  });
+	for (HuntSimulationInput::Monster &monster : simulation.monsters) {
+		for (HuntSimulationInput::Loot &loot : monster.loot) {
+			loot.slot = sortedSlot[loot.slot];
+		}
+	}
+	simulation.slotCount = aggregatedLoot.size();
+	return totals;
 }
 
-double HuntingCalculatorWindow::CalculateTimePerKill() {
+double HuntingCalculatorWindow::CalculateTimePerKill() const {
 	if (m_useDPSMode->IsChecked()) {
 		// In DPS mode, we calculate per-monster, return a default
 		return 10.0;
@@ -1711,51 +2072,35 @@ void HuntingCalculatorWindow::OnCalculate(wxCommandEvent &event) {
 		return;
 	}
 
-	// Load monsters from the specified area (simple and direct)
-	LoadMonstersFromArea();
-
-	if (m_monstersInArea.empty()) {
-		return; // Message already shown in LoadMonstersFromArea
-	}
-
-	// Load monster database only if directory is set and database is empty
-	// Do this AFTER we know we have monsters to avoid unnecessary loading
-	if (m_monsterDatabase.empty() && !m_monsterDirectory.empty()) {
-		LoadMonsterDatabase();
-	}
-
-	// Match monsters with database info
-	for (auto &monster : m_monstersInArea) {
-		std::string lowerName = monster.name;
-		std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(),
-					   ::tolower);
+	// Counts the monsters of the area and loads the monster database in the
+	// background, the results show up as they come in
+	StartAnalysis();
+}
 
-		auto it = m_monsterDatabase.find(lowerName);
-		if (it != m_monsterDatabase.end()) {
-			monster.experience = it->second.experience;
-			monster.health = it->second.health;
-			monster.loot = it->second.loot;
-			if (monster.outfit.lookType == 0) {
-				monster.outfit = it->second.outfit;
-			}
-		}
+void HuntingCalculatorWindow::ShowResults() {
+	if (!m_expPerHourLabel || !m_totalExpLabel || !m_totalKillsLabel ||
+		!m_goldPerHourLabel || !m_monsterList || !m_lootList) {
+		return;
 	}
 
 	// Calculate results
 	CalculateResults();
 
 	// Update UI
-	m_expPerHourLabel->SetLabel("Exp/Hour: " + FormatNumber(m_totalExpPerHour));
-	m_totalExpLabel->SetLabel("Total Exp: " + FormatNumber(m_totalExp));
-	m_totalKillsLabel->SetLabel("Kills: " + FormatNumber(m_totalKills));
+	m_expPerHourLabel->SetLabel("Exp/Hour: " +
+								FormatNumber(m_totals.expPerHour));
+	m_totalExpLabel->SetLabel("Total Exp: " + FormatNumber(m_totals.exp));
+	m_totalKillsLabel->SetLabel("Kills: " + FormatNumber(m_totals.kills));
 	m_goldPerHourLabel->SetLabel("Gold/Hour: " +
-								 FormatGold(m_totalGoldPerHour));
+								 FormatGold(m_totals.goldPerHour));
 
 	UpdateMonsterList();
 	UpdateLootList();
 }
 
 void HuntingCalculatorWindow::OnClose(wxCommandEvent &event) {
+	CancelAnalysis();
+	CancelSimulation();
 	EndModal(wxID_CANCEL);
 }
 
@@ -1782,17 +2127,7 @@ void HuntingCalculatorWindow::OnConfigFileChanged(wxFileDirPickerEvent &event) {
 void HuntingCalculatorWindow::OnApplyMultipliersChanged(wxCommandEvent &event) {
 	// Recalculate if we have data
 	if (!m_monstersInArea.empty()) {
-		CalculateResults();
-
-		m_expPerHourLabel->SetLabel("Exp/Hour: " +
-									FormatNumber(m_totalExpPerHour));
-		m_totalExpLabel->SetLabel("Total Exp: " + FormatNumber(m_totalExp));
-		m_totalKillsLabel->SetLabel("Kills: " + FormatNumber(m_totalKills));
-		m_goldPerHourLabel->SetLabel("Gold/Hour: " +
-									 FormatGold(m_totalGoldPerHour));
-
-		UpdateMonsterList();
-		UpdateLootList();
+		ShowResults();
 	}
 }
 
@@ -1801,17 +2136,7 @@ void HuntingCalculatorWindow::OnKillModeChanged(wxCommandEvent &event) {
 
 	// Recalculate if we have data
 	if (!m_monstersInArea.empty()) {
-		CalculateResults();
-
-		m_expPerHourLabel->SetLabel("Exp/Hour: " +
-									FormatNumber(m_totalExpPerHour));
-		m_totalExpLabel->SetLabel("Total Exp: " + FormatNumber(m_totalExp));
-		m_totalKillsLabel->SetLabel("Kills: " + FormatNumber(m_totalKills));
-		m_goldPerHourLabel->SetLabel("Gold/Hour: " +
-									 FormatGold(m_totalGoldPerHour));
-
-		UpdateMonsterList();
-		UpdateLootList();
+		ShowResults();
 	}
 }
 
@@ -2033,11 +2358,11 @@ void HuntingCalculatorWindow::SaveAnalysis(const std::string &name) {
 	toml << "[summary]\n";
 	toml << "name = \"" << name << "\"\n";
 	toml << "total_exp_per_hour = " << std::fixed << std::setprecision(0)
-		 << m_totalExpPerHour << "\n";
-	toml << "total_exp = " << std::fixed << std::setprecision(0) << m_totalExp
+		 << m_totals.expPerHour << "\n";
+	toml << "total_exp = " << std::fixed << std::setprecision(0) << m_totals.exp
 		 << "\n";
-	toml << "total_kills = " << m_totalKills << "\n";
-	toml << "gold_per_hour = " << m_totalGoldPerHour << "\n";
+	toml << "total_kills = " << m_totals.kills << "\n";
+	toml << "gold_per_hour = " << m_totals.goldPerHour << "\n";
 	toml << "hunting_duration_minutes = " << m_huntingDuration->GetValue()
 		 << "\n";
 
@@ -2094,6 +2419,7 @@ void HuntingCalculatorWindow::SaveAnalysis(const std::string &name) {
 	if (file.is_open()) {
 		file << toml.str();
 		file.close();
+		StoreRegion(name);
 		wxMessageBox("Analysis saved to:\n" + filepath, "Success",
 					 wxOK | wxICON_INFORMATION);
 		RefreshSavedAnalysesList();
@@ -2173,128 +2499,263 @@ void HuntingCalculatorWindow::OnLoadAnalysis(wxCommandEvent &event) {
 }
 
 // ============================================================================
-// Cache Management
+// Region Comparison
 // ============================================================================
 
-void HuntingCalculatorWindow::CacheSelectionTiles() {
-	m_cachedMonsters.clear();
-	m_cacheValid = false;
-	m_cachedTileCount = 0;
+std::string HuntingCalculatorWindow::GetRegionCachePath() {
+	// Next to the saved analyses, the folder is made when one is saved
+	wxString mapPath = wxString(m_editor.getMap().getFilename());
+	if (mapPath.IsEmpty()) {
+		return "";
+	}
 
-	// Safety check - make sure editor has a valid selection
-	if (!m_editor.hasSelection()) {
-		return;
+	wxFileName fn(mapPath);
+	fn.AppendDir("hunting_analyzer");
+	fn.SetFullName("regions.xml");
+	return fn.GetFullPath().ToStdString();
+}
+
+void HuntingCalculatorWindow::LoadRegionCache() {
+	m_regionCache.clear();
+	const std::string path = GetRegionCachePath();
+	if (!path.empty() && wxFileExists(path)) {
+		m_regionCache.load(path);
 	}
+}
 
-	const Selection &selection = m_editor.getSelection();
-	if (selection.empty()) {
+void HuntingCalculatorWindow::StoreRegion(const std::string &name) {
+	const std::string path = GetRegionCachePath();
+	if (path.empty() || m_analysisRegion.empty()) {
 		return;
 	}
 
-	// Get tiles safely - create a copy of the tile pointers
-	std::vector<Tile *> tilesToProcess;
-
-	try {
-		const TileSet &selectedTiles = selection.getTiles();
-		tilesToProcess.reserve(selectedTiles.size());
-
-		for (Tile *tile : selectedTiles) {
-			// Skip null tiles
-			if (tile == nullptr) {
-				continue;
-			}
+	HuntCacheEntry entry;
+	entry.name = name;
+	entry.region = m_analysisRegion;
+	entry.spawnVersion =
+		HuntRegionCache::spawnVersion(m_editor.getMap(), m_analysisRegion);
+	entry.settingsHash = m_totalsSettingsHash;
+	entry.metrics = m_totals.metrics();
+	m_regionCache.store(std::move(entry));
+	m_regionCache.save(path);
+}
 
-			// Skip tiles with null location (critical safety check)
-			if (tile->location == nullptr) {
-				continue;
-			}
+std::vector<bool> HuntingCalculatorWindow::RefreshRegionCache() {
+	const HuntSettings settings = GetHuntSettings();
+	const uint64_t settingsHash = settings.hash();
+	const Map &map = m_editor.getMap();
+
+	std::vector<bool> current;
+	bool changed = false;
+	bool databaseTried = false;
+	for (HuntCacheEntry &entry : m_regionCache.getEntries()) {
+		const uint64_t spawnVersion =
+			HuntRegionCache::spawnVersion(map, entry.region);
+		if (entry.spawnVersion == spawnVersion &&
+			entry.settingsHash == settingsHash) {
+			current.push_back(true);
+			continue;
+		}
 
-			tilesToProcess.push_back(tile);
+		// A stale region is evaluated again like the calculator does, which
+		// needs the monster files, they are loaded once for all of them
+		if (m_monsterDatabase.empty() && !databaseTried &&
+			!m_monsterDirectory.empty()) {
+			databaseTried = true;
+			BuildItemNameCache();
+			ThreadPool::TaskGroup group;
+			m_monsterDatabase =
+				LoadMonsterDatabase(m_monsterDirectory, group, 0);
+		}
+		if (m_monsterDatabase.empty()) {
+			current.push_back(false);
+			continue;
 		}
-	} catch (...) {
-		// If anything goes wrong during tile collection, abort safely
-		return;
-	}
 
-	if (tilesToProcess.empty()) {
-		return;
-	}
+		AreaMonsters area;
+		HuntRegionCache::forEachCreature(
+			map, entry.region,
+			[&area](const Position &, const Creature &creature) {
+				if (!creature.isNpc()) {
+					area.add(creature.getName(), creature.getLookType());
+				}
+			});
+		std::vector<HuntingMonsterData> monsters = BuildMonsters(area);
+		std::vector<AggregatedLoot> loot;
+		HuntSimulationInput simulation;
+		entry.metrics =
+			EvaluateHunt(monsters, settings, loot, simulation).metrics();
+		entry.spawnVersion = spawnVersion;
+		entry.settingsHash = settingsHash;
+		current.push_back(true);
+		changed = true;
+	}
+
+	const std::string path = GetRegionCachePath();
+	if (changed && !path.empty()) {
+		m_regionCache.save(path);
+	}
+	return current;
+}
 
-	// Detect the floor from the selected tiles (use the most common floor)
-	// This fixes the issue where lasso selection only worked on floor 7
-	std::map<int, int> floorCounts;
-	for (Tile *tile : tilesToProcess) {
-		if (tile != nullptr && tile->location != nullptr) {
-			try {
-				int tileZ = tile->getZ();
-				floorCounts[tileZ]++;
-			} catch (...) {
-				continue;
+void HuntingCalculatorWindow::ShowComparison(
+	const std::vector<bool> &current) {
+	wxDialog dialog(this, wxID_ANY, "Compare Hunting Spots", wxDefaultPosition,
+					wxSize(780, 480), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
+	wxBoxSizer *sizer = newd wxBoxSizer(wxVERTICAL);
+
+	wxListCtrl *list =
+		newd wxListCtrl(&dialog, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+						wxLC_REPORT | wxLC_SINGLE_SEL);
+	list->AppendColumn("#", wxLIST_FORMAT_RIGHT, 40);
+	list->AppendColumn("Region", wxLIST_FORMAT_LEFT, 200);
+	list->AppendColumn("Exp/Hour", wxLIST_FORMAT_RIGHT, 110);
+	list->AppendColumn("Gold/Hour", wxLIST_FORMAT_RIGHT, 110);
+	list->AppendColumn("Kills/Hour", wxLIST_FORMAT_RIGHT, 90);
+	list->AppendColumn("Monsters", wxLIST_FORMAT_RIGHT, 80);
+	list->AppendColumn("Status", wxLIST_FORMAT_LEFT, 120);
+	sizer->Add(list, 1, wxEXPAND | wxALL, 10);
+
+	wxBoxSizer *buttonSizer = newd wxBoxSizer(wxHORIZONTAL);
+	wxButton *removeButton = newd wxButton(&dialog, wxID_DELETE, "Remove");
+	buttonSizer->Add(removeButton, 0, wxALL, 5);
+	buttonSizer->AddStretchSpacer();
+	buttonSizer->Add(newd wxButton(&dialog, wxID_OK, "Close"), 0, wxALL, 5);
+	sizer->Add(buttonSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 5);
+
+	// Ranked by the clicked column, best first
+	std::vector<bool> status = current;
+	std::vector<size_t> order;
+	int sortColumn = 2;
+	auto fill = [&]() {
+		const std::vector<HuntCacheEntry> &entries =
+			m_regionCache.getEntries();
+		order.resize(entries.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			const HuntMetrics &left = entries[a].metrics;
+			const HuntMetrics &right = entries[b].metrics;
+			switch (sortColumn) {
+			case 1:
+				return entries[a].name < entries[b].name;
+			case 3:
+				return left.goldPerHour > right.goldPerHour;
+			case 4:
+				return left.killsPerHour > right.killsPerHour;
+			case 5:
+				return left.monsters > right.monsters;
+			default:
+				return left.expPerHour > right.expPerHour;
 			}
+		});
+
+		list->DeleteAllItems();
+		for (size_t rank = 0; rank < order.size(); ++rank) {
+			const HuntCacheEntry &entry = entries[order[rank]];
+			const long row = list->InsertItem(
+				static_cast<long>(rank), wxString::Format("%zu", rank + 1));
+			list->SetItem(row, 1, wxString::FromUTF8(entry.name));
+			list->SetItem(row, 2, FormatNumber(entry.metrics.expPerHour));
+			list->SetItem(row, 3,
+						  FormatGold(static_cast<uint64_t>(
+							  entry.metrics.goldPerHour)));
+			list->SetItem(row, 4, FormatNumber(entry.metrics.killsPerHour));
+			list->SetItem(row, 5,
+						  wxString::Format("%u", entry.metrics.monsters));
+			list->SetItem(row, 6, status[order[rank]]
+									  ? "Current"
+									  : "Stale, no monster files");
+		}
+	};
+	fill();
+
+	list->Bind(wxEVT_LIST_COL_CLICK, [&](wxListEvent &event) {
+		if (event.GetColumn() > 0) {
+			sortColumn = event.GetColumn();
+			fill();
+		}
+	});
+	removeButton->Bind(wxEVT_BUTTON, [&](wxCommandEvent &) {
+		const long row =
+			list->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+		if (row < 0) {
+			return;
 		}
-	}
 
-	// Find the floor with the most tiles (this is the floor the user selected
-	// on)
-	int detectedFloor = m_cachedCurrentFloor; // Default to cached floor
-	int maxCount = 0;
-	for (const auto &pair : floorCounts) {
-		if (pair.second > maxCount) {
-			maxCount = pair.second;
-			detectedFloor = pair.first;
+		const size_t index = order[row];
+		m_regionCache.remove(m_regionCache.getEntries()[index].name);
+		status.erase(status.begin() + index);
+		const std::string path = GetRegionCachePath();
+		if (!path.empty()) {
+			m_regionCache.save(path);
 		}
+		fill();
+	});
+
+	dialog.SetSizer(sizer);
+	dialog.ShowModal();
+}
+
+void HuntingCalculatorWindow::OnCompareRegions(wxCommandEvent &event) {
+	if (m_regionCache.getEntries().empty()) {
+		wxMessageBox("No regions to compare yet.\nEvery saved analysis is "
+					 "added to the comparison.",
+					 "Compare Hunting Spots", wxOK | wxICON_INFORMATION);
+		return;
 	}
 
-	// Update cached floor to the detected floor
-	m_cachedCurrentFloor = detectedFloor;
+	// The monster files may be loaded for the stale regions, nothing else
+	// may be reading the item names meanwhile
+	CancelAnalysis();
+	HideProgress();
 
-	// Reserve space for monsters (estimate ~5% of tiles have monsters)
-	m_cachedMonsters.reserve(tilesToProcess.size() / 20 + 10);
+	std::vector<bool> current;
+	{
+		wxBusyCursor busy;
+		current = RefreshRegionCache();
+	}
+	ShowComparison(current);
+}
 
-	// Process tiles - only cache monsters on the detected floor
-	size_t tilesOnFloor = 0;
+// ============================================================================
+// Cache Management
+// ============================================================================
 
-	for (Tile *tile : tilesToProcess) {
-		// Double-check tile validity (defensive programming)
-		if (tile == nullptr || tile->location == nullptr) {
-			continue;
-		}
+void HuntingCalculatorWindow::CacheSelectionMonsters() {
+	m_cachedMonsters.clear();
+	m_cacheValid = false;
+	m_cachedTileCount = 0;
 
-		// Safely get tile Z coordinate
-		int tileZ = 0;
-		try {
-			tileZ = tile->getZ();
-		} catch (...) {
-			continue;
-		}
+	// Safety check - make sure editor has a valid selection
+	if (!m_editor.hasSelection()) {
+		return;
+	}
 
-		// Only process tiles on the detected floor
-		if (tileZ != detectedFloor) {
+	// Only the creatures within the bounds of the selection are looked at,
+	// through the creature index of the map, and kept if their tile is
+	// selected. Every floor of the selection counts, so multi-floor hunts
+	// come out whole.
+	const Selection &selection = m_editor.getSelection();
+	const Position minPosition = selection.minPosition();
+	const Position maxPosition = selection.maxPosition();
+	const Map &map = m_editor.getMap();
+	for (const Position &position :
+		 map.spawns.getCreaturesInArea(minPosition, maxPosition)) {
+		if (!selection.contains(position)) {
 			continue;
 		}
-
-		++tilesOnFloor;
-
-		// Check if tile has a creature (not NPC)
-		Creature *creature = tile->creature;
-		if (creature != nullptr && !creature->isNpc()) {
-			try {
-				CachedMonsterData data;
-				data.creatureName = creature->getName();
-				data.outfit = creature->getLookType();
-				m_cachedMonsters.push_back(data);
-			} catch (...) {
-				// Skip this creature if we can't get its data
-				continue;
-			}
+		const Tile *tile = map.getTile(position);
+		if (tile && tile->creature && !tile->creature->isNpc()) {
+			CachedMonsterData data;
+			data.creatureName = tile->creature->getName();
+			data.outfit = tile->creature->getLookType();
+			m_cachedMonsters.push_back(std::move(data));
 		}
 	}
 
-	// Store tile count for display
-	m_cachedTileCount = tilesOnFloor;
-
-	// Shrink to fit to release unused reserved memory
-	m_cachedMonsters.shrink_to_fit();
+	m_cachedMinFloor = minPosition.z;
+	m_cachedMaxFloor = maxPosition.z;
+	m_cachedTileCount = selection.size();
 	m_cacheValid = true;
 }
 
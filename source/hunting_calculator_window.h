@@ -8,19 +8,25 @@
 #define RME_HUNTING_CALCULATOR_WINDOW_H_
 
 #include "ext/pugixml.hpp"
+#include "hunt_region_cache.h"
+#include "hunt_simulation.h"
 #include "outfit.h"
+#include "thread_pool.h"
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <wx/filepicker.h>
 #include <wx/gauge.h>
 #include <wx/spinctrl.h>
+#include <wx/timer.h>
 #include <wx/vlbox.h>
 #include <wx/wx.h>
 
 // Forward declarations
 class Editor;
+class Tile;
 class HuntingCalculatorWindow;
 
 // Monster data structure for hunting calculations
@@ -66,6 +72,21 @@ struct ServerConfig {
 	bool loaded = false;
 };
 
+// Everything the calculation depends on besides the monsters
+struct HuntSettings {
+	double durationMinutes = 60.0;
+	bool useDPS = false;
+	double timePerKill = 10.0;
+	double playerDPS = 1000.0;
+	double expMult = 1.0;
+	double lootMult = 1.0;
+	double spawnMult = 1.0;
+	std::string monsterDirectory;
+
+	// Key of the cached region metrics, stable between runs
+	uint64_t hash() const;
+};
+
 // Custom list box for monsters with sprites
 class MonsterListBox : public wxVListBox {
   public:
@@ -113,14 +134,15 @@ class HuntingCalculatorWindow : public wxDialog {
 	// Set selection mode (true = use selected tiles, false = use coordinates)
 	void SetUseSelection(bool useSelection);
 
-	// Load monsters from the selected area
-	void LoadMonstersFromArea();
-
 	// Public helper functions (needed by LootListBox)
 	std::string FormatTime(double minutes);
 	double CalculateExpectedTimeForItem(const AggregatedLoot &item) const;
 	double CalculateTimeForProbability(const AggregatedLoot &item,
 									   double probability) const;
+	// The simulated hunts so far, its slots follow the loot list
+	const HuntSimulationResult &GetSimulation() const {
+		return m_simulationResult;
+	}
 
   private:
 	// Event handlers
@@ -132,27 +154,57 @@ class HuntingCalculatorWindow : public wxDialog {
 	void OnSaveAnalysis(wxCommandEvent &event);
 	void OnLoadAnalysis(wxCommandEvent &event);
 	void OnKillModeChanged(wxCommandEvent &event);
+	void OnCompareRegions(wxCommandEvent &event);
+	void OnProgressTimer(wxTimerEvent &event);
 
 	// Helper functions
 	void CreateControls();
-	void LoadMonsterDatabase();
-	void LoadMonstersFromDirectory(const std::string &dirPath);
-	bool LoadMonsterFromXML(const std::string &filepath,
-							HuntingMonsterData &data);
-	void ParseLootXML(pugi::xml_node lootNode,
-					  std::vector<HuntingMonsterData::LootItem> &lootList);
-	bool LoadMonsterFromLua(const std::string &filepath,
-							HuntingMonsterData &data);
-	void ParseLootLua(const std::string &content,
-					  std::vector<HuntingMonsterData::LootItem> &lootList);
+	// The monster file helpers only read their arguments and g_items, so they
+	// run on the thread pool
+	static std::unordered_map<std::string, HuntingMonsterData>
+	LoadMonsterDatabase(const std::string &monsterDirectory,
+						ThreadPool::TaskGroup &group, int64_t progressBase);
+	static void CollectMonsterFiles(const std::string &dirPath,
+									std::vector<std::string> &files,
+									int depth = 0);
+	static bool LoadMonsterFromXML(const std::string &filepath,
+								   HuntingMonsterData &data);
+	static void
+	ParseLootXML(pugi::xml_node lootNode,
+				 std::vector<HuntingMonsterData::LootItem> &lootList);
+	static bool LoadMonsterFromLua(const std::string &filepath,
+								   HuntingMonsterData &data);
+	static void
+	ParseLootLua(const std::string &content,
+				 std::vector<HuntingMonsterData::LootItem> &lootList);
 	bool LoadConfigLua(const std::string &filepath);
+
+	// Totals of an evaluated hunt, per hour unless noted
+	struct HuntTotals {
+		double expPerHour = 0;
+		double exp = 0; // Over the whole duration
+		int kills = 0;	// Over the whole duration
+		uint64_t goldPerHour = 0;
+		double killsPerHour = 0;
+		uint32_t monsters = 0;
+
+		HuntMetrics metrics() const;
+	};
+	// Fills in the rates of the monsters and the loot they drop, only reads
+	// its arguments so cached regions are evaluated the same way
+	static HuntTotals EvaluateHunt(std::vector<HuntingMonsterData> &monsters,
+								   const HuntSettings &settings,
+								   std::vector<AggregatedLoot> &aggregatedLoot,
+								   HuntSimulationInput &simulation);
+	HuntSettings GetHuntSettings() const;
 	void CalculateResults();
+	void ShowResults();
 	void UpdateMonsterList();
 	void UpdateLootList();
 	void UpdateMultiplierLabels();
 	void UpdateKillModeUI();
-	double CalculateTimePerKill();
-	uint64_t GetCoinValue(uint16_t itemId);
+	double CalculateTimePerKill() const;
+	static uint64_t GetCoinValue(uint16_t itemId);
 	std::string FormatNumber(double value);
 	std::string FormatGold(uint64_t gold);
 
@@ -171,11 +223,40 @@ class HuntingCalculatorWindow : public wxDialog {
 	std::string GetAnalysisFolder();
 	void RefreshSavedAnalysesList();
 
+	// Metrics of the named regions, for ranking them against each other
+	std::string GetRegionCachePath();
+	void LoadRegionCache();
+	void StoreRegion(const std::string &name);
+	// Evaluates the stale regions again, whether each one is current after
+	std::vector<bool> RefreshRegionCache();
+	void ShowComparison(const std::vector<bool> &current);
+
 	// Cache management
-	void CacheSelectionTiles();
+	void CacheSelectionMonsters();
 	void InvalidateCache();
 	bool IsCacheValid() const { return m_cacheValid; }
 
+	// Background analysis, the area scan and the monster files run on the
+	// thread pool and their results are posted back to the dialog
+	struct AreaMonsters;
+	struct AnalysisRequest;
+	struct AnalysisResult;
+	void StartAnalysis();
+	void CancelAnalysis();
+	void RunAnalysis(const AnalysisRequest &request,
+					 ThreadPool::TaskGroup &group, unsigned generation);
+	void ApplyAnalysis(const AnalysisResult &result);
+	std::vector<HuntingMonsterData>
+	BuildMonsters(const AreaMonsters &area) const;
+	void ShowMonsters(const AreaMonsters &area);
+	void UpdateSelectionInfo();
+
+	// Monte Carlo runs of the calculated hunt, refined in the background
+	// until SIMULATED_HUNTS were simulated
+	void StartSimulation(const HuntSimulationInput &input);
+	void CancelSimulation();
+	void ApplySimulation(const HuntSimulationResult &result);
+
 	// Progress bar helpers
 	void ShowProgress(const wxString &message, int total);
 	void UpdateProgress(int current);
@@ -211,6 +292,7 @@ class HuntingCalculatorWindow : public wxDialog {
 	wxStaticText *m_totalExpLabel = nullptr;
 	wxStaticText *m_totalKillsLabel = nullptr;
 	wxStaticText *m_goldPerHourLabel = nullptr;
+	wxStaticText *m_simulationLabel = nullptr;
 
 	// Lists with sprites
 	MonsterListBox *m_monsterList = nullptr;
@@ -220,6 +302,7 @@ class HuntingCalculatorWindow : public wxDialog {
 	wxButton *m_calculateButton = nullptr;
 	wxButton *m_closeButton = nullptr;
 	wxButton *m_saveAnalysisButton = nullptr;
+	wxButton *m_compareButton = nullptr;
 
 	// Analysis save controls
 	wxTextCtrl *m_analysisName = nullptr;
@@ -234,6 +317,10 @@ class HuntingCalculatorWindow : public wxDialog {
 	std::vector<HuntingMonsterData> m_monstersInArea;
 	std::vector<AggregatedLoot> m_aggregatedLoot;
 
+	// Tiles of the last analysis and the cached metrics of the named ones
+	HuntRegion m_analysisRegion;
+	HuntRegionCache m_regionCache;
+
 	// Area coordinates
 	int m_areaStartX = 0, m_areaStartY = 0, m_areaStartZ = 0;
 	int m_areaEndX = 0, m_areaEndY = 0, m_areaEndZ = 0;
@@ -257,21 +344,31 @@ class HuntingCalculatorWindow : public wxDialog {
 	std::vector<CachedMonsterData>
 		m_cachedMonsters; // Only monsters, not all tiles
 	bool m_cacheValid = false;
-	int m_cachedCurrentFloor = 7; // Floor when selection was made
+	int m_cachedMinFloor = 7;	  // Floors the selection spans
+	int m_cachedMaxFloor = 7;
 	size_t m_cachedTileCount = 0; // Number of tiles in selection
 
+	// Running analysis, results of older ones are dropped by generation
+	std::unique_ptr<ThreadPool::TaskGroup> m_analysis;
+	unsigned m_analysisGeneration = 0;
+	wxTimer m_progressTimer;
+
+	// Running simulation, results of older ones are dropped by generation
+	std::unique_ptr<ThreadPool::TaskGroup> m_simulation;
+	unsigned m_simulationGeneration = 0;
+	HuntSimulationResult m_simulationResult;
+
 	// Progress tracking
 	wxGauge *m_progressBar = nullptr;
 	wxStaticText *m_progressLabel = nullptr;
 
-	// Calculation results
-	double m_totalExpPerHour = 0;
-	double m_totalExp = 0;
-	int m_totalKills = 0;
-	uint64_t m_totalGoldPerHour = 0;
+	// Calculation results and the settings they were worked out with
+	HuntTotals m_totals;
+	uint64_t m_totalsSettingsHash = 0;
 
 	// Constants
 	static const int DEFAULT_RESPAWN_TIME = 600; // 10 minutes in seconds
+	static const uint64_t SIMULATED_HUNTS = 20000;
 
 	DECLARE_EVENT_TABLE()
 };
@@ -299,7 +396,9 @@ enum HuntingCalculatorIDs {
 	ID_HUNTING_CALC_ANALYSIS_NAME,
 	ID_HUNTING_CALC_USE_DPS_MODE,
 	ID_HUNTING_CALC_PLAYER_DPS,
-	ID_HUNTING_CALC_LOOT_EXPECTED_TIME
+	ID_HUNTING_CALC_LOOT_EXPECTED_TIME,
+	ID_HUNTING_CALC_PROGRESS_TIMER,
+	ID_HUNTING_CALC_COMPARE_REGIONS
 };
 
 #endif // RME_HUNTING_CALCULATOR_WINDOW_H_
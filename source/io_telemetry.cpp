@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "io_telemetry.h"
+
+namespace {
+	double perSecond(uint64_t amount, double ms) {
+		return ms > 0.0 ? amount * 1000.0 / ms : 0.0;
+	}
+
+	wxString formatRate(double rate) {
+		if(rate >= 1e6) {
+			return wxString::Format("%.1fM", rate / 1e6);
+		} else if(rate >= 1e3) {
+			return wxString::Format("%.1fk", rate / 1e3);
+		}
+		return wxString::Format("%.0f", rate);
+	}
+}
+
+void IOTelemetry::clear()
+{
+	for(Counters& counters : phases) {
+		counters = Counters();
+	}
+}
+
+bool IOTelemetry::empty() const
+{
+	for(const Counters& counters : phases) {
+		if(counters.ms > 0.0 || counters.bytes > 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+IOTelemetry::Counters IOTelemetry::getTotal() const
+{
+	Counters total;
+	for(const Counters& counters : phases) {
+		total.ms += counters.ms;
+		total.tiles += counters.tiles;
+		total.items += counters.items;
+		total.bytes += counters.bytes;
+	}
+	return total;
+}
+
+const char* IOTelemetry::getPhaseName(Phase phase)
+{
+	switch(phase) {
+		case HEADER: return "header";
+		case TILE_AREAS: return "tile_areas";
+		case TOWNS: return "towns";
+		case WAYPOINTS: return "waypoints";
+		case SPAWNS: return "spawns";
+		case HOUSES: return "houses";
+		case ZONES: return "zones";
+		default: return "";
+	}
+}
+
+wxString IOTelemetry::getSummary(const wxString& operation) const
+{
+	const Counters total = getTotal();
+	// The tiles are all in one phase, the others would only dilute their rate
+	const Counters& tiles = phases[TILE_AREAS];
+	return wxString::Format("%s in %.2f s, %s tiles/s, %s items/s, %s/s",
+		operation, total.ms / 1000.0,
+		formatRate(perSecond(tiles.tiles, tiles.ms)),
+		formatRate(perSecond(tiles.items, tiles.ms)),
+		wxFileName::GetHumanReadableSize(wxULongLong(uint64_t(perSecond(total.bytes, total.ms)))));
+}
+
+wxString IOTelemetry::getReport() const
+{
+	wxString report;
+	for(int index = 0; index < PHASE_COUNT; ++index) {
+		const Counters& counters = phases[index];
+		if(counters.ms <= 0.0 && counters.bytes == 0) {
+			continue;
+		}
+
+		report << wxString::Format("%-10s %9.1f ms", getPhaseName(Phase(index)), counters.ms);
+		if(counters.tiles > 0) {
+			report << ", " << formatRate(perSecond(counters.tiles, counters.ms)) << " tiles/s";
+		}
+		if(counters.items > 0) {
+			report << ", " << formatRate(perSecond(counters.items, counters.ms)) << " items/s";
+		}
+		if(counters.bytes > 0) {
+			report << ", " << wxFileName::GetHumanReadableSize(wxULongLong(counters.bytes))
+				<< " at " << wxFileName::GetHumanReadableSize(wxULongLong(uint64_t(perSecond(counters.bytes, counters.ms)))) << "/s";
+		}
+		report << "\n";
+	}
+	return report;
+}
+
+void IOTelemetry::log(const wxString& operation) const
+{
+	wxLogVerbose("%s", getSummary(operation));
+	for(const wxString& line : wxSplit(getReport(), '\n')) {
+		if(!line.empty()) {
+			wxLogVerbose("  %s", line);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_IO_TELEMETRY_H_
+#define RME_IO_TELEMETRY_H_
+
+#include <chrono>
+#include <string>
+
+// Where the time of a map load or save went, per part of the OTBM file and the files next to it
+class IOTelemetry
+{
+public:
+	enum Phase {
+		HEADER,
+		TILE_AREAS,
+		TOWNS,
+		WAYPOINTS,
+		SPAWNS,
+		HOUSES,
+		ZONES,
+		PHASE_COUNT
+	};
+
+	struct Counters {
+		double ms = 0.0;
+		uint64_t tiles = 0;
+		uint64_t items = 0;
+		uint64_t bytes = 0;
+	};
+
+	// Adds the time until it goes out of scope to a phase, the phase may change meanwhile.
+	// Scopes must not be nested, the time would be counted twice.
+	class Scope
+	{
+	public:
+		Scope(IOTelemetry& telemetry, Phase phase) : telemetry(telemetry), phase(phase), start(Clock::now()), running(true) {}
+		~Scope() { stop(); }
+
+		void setPhase(Phase newPhase) noexcept { phase = newPhase; }
+		// Adds the time so far, nothing is counted afterwards
+		void stop() {
+			if(running) {
+				telemetry[phase].ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				running = false;
+			}
+		}
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		IOTelemetry& telemetry;
+		Phase phase;
+		Clock::time_point start;
+		bool running;
+	};
+
+	Counters& operator[](Phase phase) noexcept { return phases[phase]; }
+	const Counters& operator[](Phase phase) const noexcept { return phases[phase]; }
+
+	void clear();
+	bool empty() const;
+	Counters getTotal() const;
+
+	static const char* getPhaseName(Phase phase);
+
+	// "Loaded in 1.2 s, 3.1M tiles/s, 85 MB/s", operation being "Loaded" or "Saved"
+	wxString getSummary(const wxString& operation) const;
+	// A line per phase that took any time, with its rates
+	wxString getReport() const;
+	// Writes the report to the verbose log
+	void log(const wxString& operation) const;
+
+private:
+	Counters phases[PHASE_COUNT];
+};
+
+#endif
@@ -19,6 +19,8 @@
 #define RME_MAP_IO_H_
 
 #include "client_version.h"
+#include "io_telemetry.h"
+#include "position.h"
 
 enum ImportType
 {
@@ -28,6 +30,29 @@ enum ImportType
 	IMPORT_INSERT,
 };
 
+// A box of a map, inclusive, as the part of a map to import or to load
+struct MapArea
+{
+	Position start = Position(0, 0, rme::MapMinLayer);
+	Position end = Position(rme::MapMaxWidth, rme::MapMaxHeight, rme::MapMaxLayer);
+
+	bool contains(const Position& pos) const {
+		return pos.x >= start.x && pos.x <= end.x && pos.y >= start.y && pos.y <= end.y && pos.z >= start.z && pos.z <= end.z;
+	}
+	// The 256x256 tile area on floor z, x and y being its first tile
+	bool intersectsTileArea(int x, int y, int z) const {
+		return x <= end.x && x + 0xFF >= start.x && y <= end.y && y + 0xFF >= start.y && z >= start.z && z <= end.z;
+	}
+	// The tile area holding pos, which a partial load reads as a whole
+	bool intersectsTileAreaOf(const Position& pos) const {
+		return intersectsTileArea(pos.x & 0xFF00, pos.y & 0xFF00, pos.z);
+	}
+	bool isWholeMap() const {
+		return start.x <= 0 && start.y <= 0 && start.z <= rme::MapMinLayer &&
+			end.x >= rme::MapMaxWidth && end.y >= rme::MapMaxHeight && end.z >= rme::MapMaxLayer;
+	}
+};
+
 class Map;
 
 class IOMap
@@ -35,6 +60,8 @@ class IOMap
 protected:
 	wxArrayString warnings;
 	wxString errorstr;
+	// Of the last load or save
+	IOTelemetry telemetry;
 
 	bool queryUser(const wxString& title, const wxString& format);
 	void warning(const wxString format, ...);
@@ -50,6 +77,7 @@ public:
 
 	wxArrayString& getWarnings() { return warnings; }
 	wxString& getError() { return errorstr; }
+	const IOTelemetry& getTelemetry() const noexcept { return telemetry; }
 
 	virtual bool loadMap(Map& map, const FileName& identifier) = 0;
 	virtual bool saveMap(Map& map, const FileName& identifier) = 0;
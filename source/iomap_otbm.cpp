@@ -24,8 +24,14 @@
 #include <wx/datstrm.h>
 #include <wx/dir.h>
 
+#include <deque>
+#include <future>
+#include <zlib.h>
+
 #include "settings.h"
 #include "gui.h" // Loadbar
+#include "thread_pool.h"
+#include "tracing.h"
 
 #include "creatures.h"
 #include "creature.h"
@@ -41,8 +47,6 @@ typedef uint8_t attribute_t;
 typedef uint32_t flags_t;
 
 
-std::map<uint16_t, std::vector<Position>> zoneMap;
-
 // H4X
 void reform(Map* map, Tile* tile, Item* item)
 {
@@ -64,6 +68,11 @@ void reform(Map* map, Tile* tile, Item* item)
 	*/
 }
 
+static uint64_t getFileSize(const wxString& path)
+{
+	return wxFileName::FileExists(path) ? wxFileName::GetSize(path).GetValue() : 0;
+}
+
 // ============================================================================
 // Item
 
@@ -75,29 +84,34 @@ std::string removeOTBMExtension(const std::string& filename) {
 	return filename;
 }
 
-toml::table serializeZoneToToml(uint16_t zoneId, const std::vector<Position>& positions) {
-	std::ostringstream tomlStream;
-	tomlStream << "[[zone]]\n";
-	tomlStream << "id = " << zoneId << "\n";
-	tomlStream << "positions = [";
+std::string serializeZoneToToml(uint16_t zoneId, const std::vector<Position>& positions) {
+	// Written out directly, there's no need to build a toml::table of every position first
+	std::string toml;
+	toml.reserve(64 + positions.size() * 32);
+	toml += "[[zone]]\nid = " + std::to_string(zoneId) + "\npositions = [";
 	for (size_t i = 0; i < positions.size(); ++i) {
 		const auto& pos = positions[i];
-		tomlStream << "{x = " << pos.x << ", y = " << pos.y << ", z = " << pos.z << "}";
+		toml += "{x = " + std::to_string(pos.x) + ", y = " + std::to_string(pos.y) + ", z = " + std::to_string(pos.z) + "}";
 		if (i < positions.size() - 1) {
-			tomlStream << ", ";
+			toml += ", ";
 		}
 	}
-	tomlStream << "]\n\n";
-	std::string tomlString = tomlStream.str();
-	try {
-		return toml::parse(tomlString);
-	}
-	catch (const toml::parse_error& err) {
-		throw std::runtime_error("Failed to parse generated TOML: " + std::string(err.what()));
-	}
+	toml += "]\n\n";
+	return toml;
 }
 
-void IOMapOTBM::saveZonesToToml(const std::map<uint16_t, std::vector<Position>>& zoneMap, const wxFileName& dir, Map& map) {
+void IOMapOTBM::saveZonesToToml(const FileName& dir, Map& map) {
+	std::map<uint16_t, std::vector<Position>> zoneMap;
+	for (const OTBM_ZoneLeaf& leaf : saved_zones) {
+		for (const auto& [zoneId, mask] : leaf.zones) {
+			for (int index = 0; index < 16; ++index) {
+				if (mask & (1 << index)) {
+					zoneMap[zoneId].emplace_back(leaf.x + (index >> 2), leaf.y + (index & 3), leaf.z);
+				}
+			}
+		}
+	}
+
 	auto mapName = removeOTBMExtension(map.getName());
 	auto folderPath = dir.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME) + mapName + "-zones";
 
@@ -128,15 +142,13 @@ void IOMapOTBM::saveZonesToToml(const std::map<uint16_t, std::vector<Position>>&
 	}
 
 	for (const auto& [zoneId, positions] : zoneMap) {
-		auto zoneTable = serializeZoneToToml(zoneId, positions);
 		auto filepath = folderPath + wxString::Format("/%u.toml", zoneId);
-		std::stringstream ss;
-		ss << zoneTable;
 		auto file = wxFile(filepath, wxFile::write);
 		if (file.IsOpened()) {
-			auto zoneData = ss.str();
+			auto zoneData = serializeZoneToToml(zoneId, positions);
 			file.Write(zoneData.c_str(), zoneData.length());
 			file.Close();
+			telemetry[IOTelemetry::ZONES].bytes += zoneData.length();
 		}
 		else {
 			wxLogError("Failed to open file for writing: %s", filepath);
@@ -391,6 +403,11 @@ void Item::serializeItemCompact_OTBM(const IOMap& maphandle, NodeFileWriteHandle
 	*/
 }
 
+bool Item::isCompact() const
+{
+	return plain && !isComplex() && !g_items.getHotData(id).has(ITEM_HOT_SUBTYPE | ITEM_HOT_CHARGED);
+}
+
 bool Item::serializeItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHandle& file) const
 {
 	file.addNode(OTBM_ITEM);
@@ -401,7 +418,46 @@ bool Item::serializeItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f
 			file.addU8(getSubtype());
 		}
 	}
-	serializeItemAttributes_OTBM(maphandle, file);
+	if(plain) {
+		Item::serializeItemAttributes_OTBM(maphandle, file);
+	} else {
+		serializeItemAttributes_OTBM(maphandle, file);
+	}
+	file.endNode();
+	return true;
+}
+
+bool Item::serializePlainItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHandle& file) const
+{
+	ASSERT(plain);
+	if(isComplex()) {
+		return Item::serializeItemNode_OTBM(maphandle, file);
+	}
+
+	// The subtype is only kept by the types flagged for it, so it can be written as is
+	const ItemHotData& hot = g_items.getHotData(id);
+	uint8_t layout[8];
+	size_t size = 0;
+	layout[size++] = static_cast<uint8_t>(id);
+	layout[size++] = static_cast<uint8_t>(id >> 8);
+	if(maphandle.version.otbm == MAP_OTBM_1) {
+		if(hot.has(ITEM_HOT_SUBTYPE)) {
+			layout[size++] = static_cast<uint8_t>(subtype);
+		}
+	} else {
+		if(hot.has(ITEM_HOT_SUBTYPE)) {
+			layout[size++] = OTBM_ATTR_COUNT;
+			layout[size++] = static_cast<uint8_t>(subtype);
+		}
+		if(maphandle.version.otbm < MAP_OTBM_4 && g_items.MinorVersion >= CLIENT_VERSION_820 && hot.has(ITEM_HOT_CHARGED)) {
+			layout[size++] = OTBM_ATTR_CHARGES;
+			layout[size++] = static_cast<uint8_t>(subtype);
+			layout[size++] = static_cast<uint8_t>(subtype >> 8);
+		}
+	}
+
+	file.addNode(OTBM_ITEM);
+	file.addRAW(layout, size);
 	file.endNode();
 	return true;
 }
@@ -537,7 +593,7 @@ bool Container::serializeItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHand
 
 	serializeItemAttributes_OTBM(maphandle, file);
 	for(Item* item : contents) {
-		item->serializeItemNode_OTBM(maphandle, file);
+		item->writeItemNode_OTBM(maphandle, file);
 	}
 
 	file.endNode();
@@ -565,8 +621,182 @@ bool Container::serializeItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHand
 	|--- OTBM_ITEM_DEF (not implemented)
 */
 
+// Compressed maps (.otbz) hold the nodes of a plain map, without the identifier, in zlib frames
+// of whole tile areas. The index in front of them gives where every frame goes, so they are
+// compressed and decompressed in parallel.
+static const char* compressed_map_identifier = "OTBZ";
+static const uint32_t compressed_map_version = 1;
+static const size_t compressed_map_header_size = 28;
+static const size_t compressed_map_frame_entry_size = 16;
+// Tile areas are grouped into frames of at least this much, a frame never exceeds the limit
+static const size_t compressed_map_frame_target = 4 << 20;
+static const size_t compressed_map_frame_limit = 64 << 20;
+
+struct CompressedMapFrame
+{
+	uint64_t offset; // In the nodes
+	uint32_t size;
+	std::vector<uint8_t> data;
+};
+
+struct CompressedMapHeader
+{
+	uint32_t otbm_version;
+	uint32_t items_minor;
+	uint64_t size; // Of the nodes
+	uint32_t frames;
+};
+
+static bool readCompressedMapHeader(FileReadHandle& f, CompressedMapHeader& header)
+{
+	std::string magic;
+	uint32_t format_version;
+	if(f.size() < compressed_map_header_size || !f.getRAW(magic, 4) || magic != compressed_map_identifier)
+		return false;
+
+	f.getU32(format_version);
+	f.getU32(header.otbm_version);
+	f.getU32(header.items_minor);
+	f.getU64(header.size);
+	return f.getU32(header.frames) && format_version == compressed_map_version;
+}
+
+static bool isCompressedMap(const std::string& name)
+{
+	FileReadHandle f(name);
+	std::string magic;
+	return f.isOk() && f.size() >= 4 && f.getRAW(magic, 4) && magic == compressed_map_identifier;
+}
+
+static FileHandleError readCompressedMap(const std::string& name, std::vector<uint8_t>& nodes)
+{
+	FileReadHandle f(name);
+	if(!f.isOk())
+		return FILE_COULD_NOT_OPEN;
+
+	CompressedMapHeader header;
+	if(!readCompressedMapHeader(f, header))
+		return FILE_INVALID_IDENTIFIER;
+	if(f.size() < compressed_map_header_size + size_t(header.frames) * compressed_map_frame_entry_size)
+		return FILE_PREMATURE_END;
+
+	std::vector<CompressedMapFrame> frames(header.frames);
+	uint64_t expected = 0;
+	for(CompressedMapFrame& frame : frames) {
+		uint32_t compressed_size;
+		f.getU64(frame.offset);
+		f.getU32(frame.size);
+		if(!f.getU32(compressed_size) || frame.offset != expected || frame.size > compressed_map_frame_limit)
+			return FILE_SYNTAX_ERROR;
+		frame.data.resize(compressed_size);
+		expected += frame.size;
+	}
+	if(expected != header.size)
+		return FILE_SYNTAX_ERROR;
+	for(CompressedMapFrame& frame : frames) {
+		if(!f.getRAW(frame.data.data(), frame.data.size()))
+			return FILE_PREMATURE_END;
+	}
+
+	nodes.resize(header.size);
+	std::atomic<bool> valid(true);
+	ThreadPool::getInstance().parallelFor(frames.size(), [&](size_t i) {
+		CompressedMapFrame& frame = frames[i];
+		uLongf length = frame.size;
+		if(uncompress(nodes.data() + frame.offset, &length, frame.data.data(), frame.data.size()) != Z_OK || length != frame.size) {
+			valid = false;
+		}
+		frame.data = std::vector<uint8_t>();
+	});
+	return valid ? FILE_NO_ERROR : FILE_SYNTAX_ERROR;
+}
+
+// Frames are cut at the tile areas in areas, their offsets being relative to nodes
+static bool writeCompressedMap(const std::string& name, const MapVersion& version, const uint8_t* nodes, size_t size, const std::vector<OTBM_TileIndexEntry>& areas)
+{
+	std::vector<CompressedMapFrame> frames;
+	uint64_t start = 0;
+	auto cut = [&](uint64_t end) {
+		while(end - start > compressed_map_frame_limit) {
+			frames.push_back(CompressedMapFrame { start, uint32_t(compressed_map_frame_limit), {} });
+			start += compressed_map_frame_limit;
+		}
+		frames.push_back(CompressedMapFrame { start, uint32_t(end - start), {} });
+		start = end;
+	};
+	for(const OTBM_TileIndexEntry& entry : areas) {
+		if(entry.offset < size && entry.offset >= start + compressed_map_frame_target) {
+			cut(entry.offset);
+		}
+	}
+	if(start < size || frames.empty()) {
+		cut(size);
+	}
+
+	std::atomic<bool> valid(true);
+	ThreadPool::getInstance().parallelFor(frames.size(), [&](size_t i) {
+		CompressedMapFrame& frame = frames[i];
+		uLongf length = compressBound(frame.size);
+		frame.data.resize(length);
+		if(compress2(frame.data.data(), &length, nodes + frame.offset, frame.size, Z_DEFAULT_COMPRESSION) != Z_OK) {
+			valid = false;
+		}
+		frame.data.resize(length);
+	});
+	if(!valid)
+		return false;
+
+	FileWriteHandle f(name);
+	if(!f.isOk())
+		return false;
+
+	f.addRAW(compressed_map_identifier);
+	f.addU32(compressed_map_version);
+	f.addU32(version.otbm);
+	f.addU32(g_items.MinorVersion);
+	f.addU64(size);
+	f.addU32(uint32_t(frames.size()));
+	for(const CompressedMapFrame& frame : frames) {
+		f.addU64(frame.offset);
+		f.addU32(frame.size);
+		f.addU32(uint32_t(frame.data.size()));
+	}
+	for(const CompressedMapFrame& frame : frames) {
+		f.addRAW(frame.data.data(), frame.data.size());
+	}
+	return f.isOk();
+}
+
+// Reads a compressed map into memory as a whole
+class CompressedNodeFileReadHandle : public MemoryNodeFileReadHandle
+{
+public:
+	explicit CompressedNodeFileReadHandle(const std::string& name) : MemoryNodeFileReadHandle(nullptr, 0) {
+		error_code = readCompressedMap(name, nodes);
+		if(error_code == FILE_NO_ERROR) {
+			assign(nodes.data(), nodes.size());
+		}
+	}
+
+	virtual bool isOk() { return error_code == FILE_NO_ERROR; }
+
+protected:
+	std::vector<uint8_t> nodes;
+};
+
 bool IOMapOTBM::getVersionInfo(const FileName& filename, MapVersion& out_ver)
 {
+	// The container repeats the versions of the root node, there is no need to decompress it
+	if(isCompressedMap(nstr(filename.GetFullPath()))) {
+		FileReadHandle f(nstr(filename.GetFullPath()));
+		CompressedMapHeader header;
+		if(!readCompressedMapHeader(f, header))
+			return false;
+		out_ver.otbm = MapVersionID(header.otbm_version);
+		out_ver.client = ClientVersionID(header.items_minor);
+		return true;
+	}
+
 	// Just open a disk-based read handle
 	DiskNodeFileReadHandle f(nstr(filename.GetFullPath()), StringVector(1, "OTBM"));
 	if(!f.isOk())
@@ -601,43 +831,326 @@ bool IOMapOTBM::getVersionInfo(NodeFileReadHandle* f,  MapVersion& out_ver)
 	return true;
 }
 
+static std::unique_ptr<NodeFileReadHandle> openMapFile(const FileName& filename)
+{
+	if(isCompressedMap(nstr(filename.GetFullPath()))) {
+		return std::unique_ptr<NodeFileReadHandle>(newd CompressedNodeFileReadHandle(nstr(filename.GetFullPath())));
+	}
+
+	// Map the file if we can, fall back on buffered reads otherwise
+	std::unique_ptr<NodeFileReadHandle> f(newd MappedNodeFileReadHandle(nstr(filename.GetFullPath()), StringVector(1, "OTBM")));
+	if(f->error_code == FILE_COULD_NOT_OPEN) {
+		f.reset(newd DiskNodeFileReadHandle(nstr(filename.GetFullPath()), StringVector(1, "OTBM")));
+	}
+	return f;
+}
+
 bool IOMapOTBM::loadMap(Map& map, const FileName& filename)
 {
-	DiskNodeFileReadHandle f(nstr(filename.GetFullPath()), StringVector(1, "OTBM"));
-	if(!f.isOk()) {
-		error(("Couldn't open file for reading\nThe error reported was: " + wxstr(f.getErrorMessage())).wc_str());
+	RME_TRACE_ZONE("io", "IOMapOTBM::loadMap");
+	telemetry.clear();
+	if(!map.partial && g_settings.getBoolean(Config::SESSION_SNAPSHOTS) && loadSession(map, filename)) {
+		session_loaded = true;
+		return true;
+	}
+
+	std::unique_ptr<NodeFileReadHandle> f = openMapFile(filename);
+	if(!f->isOk()) {
+		error(("Couldn't open file for reading\nThe error reported was: " + wxstr(f->getErrorMessage())).wc_str());
 		return false;
 	}
 
-	if(!loadMap(map, f))
+	// A snapshot that turned out to be stale doesn't count
+	telemetry.clear();
+	if(!(map.partial ? loadMapArea(map, *f, filename) : loadMap(map, *f)))
 		return false;
 
+	// The tiles match the file now, unless some of them couldn't be loaded
+	if(warnings.empty())
+		map.clearDirtyAreas();
+
 	// Read auxilliary files
-	if(!loadHouses(map, filename)) {
-		warning("Failed to load houses.");
-		map.housefile = nstr(filename.GetName()) + "-house.xml";
+	{
+		// A partial map has the houses without tiles in its area too
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::HOUSES);
+		if(!loadHouses(map, filename, map.partial != nullptr)) {
+			warning("Failed to load houses.");
+			map.housefile = nstr(filename.GetName()) + "-house.xml";
+		}
+	}
+	// Every area of a paged map is read once it is looked at
+	if(map.isPaged()) {
+		for(const auto& [area, nodes] : map.partial->index) {
+			map.setAreaPagedOut(area, true);
+		}
 	}
-	if(!loadSpawns(map, filename)) {
-		warning("Failed to load spawns.");
-		map.spawnfile = nstr(filename.GetName()) + "-spawn.xml";
+	{
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::SPAWNS);
+		if(!loadSpawns(map, filename)) {
+			warning("Failed to load spawns.");
+			map.spawnfile = nstr(filename.GetName()) + "-spawn.xml";
+		}
 	}
 
-	auto mapName = nstr(filename.GetName());
+	// Maps saved before the zone file existed only have the TOML folder
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::ZONES);
+	if(!loadZones(map, filename)) {
+		if(map.isPaged()) {
+			return true;
+		}
+		auto mapName = nstr(filename.GetName());
 
-	auto zoneDir = filename.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME) + mapName + "-zones";
+		auto zoneDir = filename.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME) + mapName + "-zones";
 
-	auto zoneMap = loadZonesFromToml(zoneDir);
-	applyZonesToTiles(zoneMap, map);
+		auto zoneMap = loadZonesFromToml(zoneDir);
+		applyZonesToTiles(zoneMap, map);
+	} else {
+		telemetry[IOTelemetry::ZONES].bytes += getFileSize(filename.GetFullPath() + ".zones");
+	}
 
 	return true;
 }
 
-bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
+// Tiles of one OTBM_TILE_AREA, decoded without touching the map so it can be done on any thread
+struct TileAreaBatch
+{
+	struct Entry {
+		Position position;
+		Tile* tile;
+	};
+	std::vector<Entry> tiles;
+	wxArrayString warnings;
+};
+
+// A group of raw tile areas handed to a worker thread
+struct TileAreaJob
+{
+	struct Area {
+		Position base;
+		std::vector<uint8_t> data;
+	};
+	std::vector<Area> areas;
+	size_t bytes = 0;
+};
+
+static void decodeTileArea(const IOMap& maphandle, const Position& base, BinaryNode* firstTileNode, TileAreaBatch& batch)
+{
+	for(BinaryNode* tileNode = firstTileNode; tileNode != nullptr; tileNode = tileNode->advance()) {
+		uint8_t tile_type;
+		if(!tileNode->getByte(tile_type)) {
+			batch.warnings.push_back("Invalid tile type");
+			continue;
+		}
+		if(tile_type != OTBM_TILE && tile_type != OTBM_HOUSETILE) {
+			batch.warnings.push_back("Unknown type of tile node");
+			continue;
+		}
+
+		uint8_t x_offset, y_offset;
+		if(!tileNode->getU8(x_offset) || !tileNode->getU8(y_offset)) {
+			batch.warnings.push_back("Could not read position of tile");
+			continue;
+		}
+		const Position pos(base.x + x_offset, base.y + y_offset, base.z);
+
+		uint32_t house_id = 0;
+		if(tile_type == OTBM_HOUSETILE) {
+			if(!tileNode->getU32(house_id)) {
+				batch.warnings.push_back("House tile without house data, discarding tile");
+				continue;
+			}
+			if(!house_id) {
+				batch.warnings.push_back(wxString::Format("Invalid house id from tile %d:%d:%d", pos.x, pos.y, pos.z));
+			}
+		}
+
+		// The location is assigned when the tile is merged into the map
+		Tile* tile = newd Tile(pos.x, pos.y, pos.z);
+		tile->house_id = house_id;
+
+		uint8_t attribute;
+		while(tileNode->getU8(attribute)) {
+			switch(attribute) {
+				case OTBM_ATTR_TILE_FLAGS: {
+					uint32_t flags = 0;
+					if(!tileNode->getU32(flags)) {
+						batch.warnings.push_back(wxString::Format("Invalid tile flags of tile on %d:%d:%d", pos.x, pos.y, pos.z));
+					}
+
+					tile->setMapFlags(flags);
+					break;
+				}
+				case OTBM_ATTR_ITEM: {
+					Item* item = Item::Create_OTBM(maphandle, tileNode);
+					if(item == nullptr)
+					{
+						batch.warnings.push_back(wxString::Format("Invalid item at tile %d:%d:%d", pos.x, pos.y, pos.z));
+					}
+					tile->addItem(item);
+					break;
+				}
+				default: {
+					batch.warnings.push_back(wxString::Format("Unknown tile attribute at %d:%d:%d", pos.x, pos.y, pos.z));
+					break;
+				}
+			}
+		}
+
+		for(BinaryNode* itemNode = tileNode->getChild(); itemNode != nullptr; itemNode = itemNode->advance()) {
+			uint8_t item_type;
+			if(!itemNode->getByte(item_type)) {
+				batch.warnings.push_back(wxString::Format("Unknown item type %d:%d:%d", pos.x, pos.y, pos.z));
+				continue;
+			}
+			if(item_type == OTBM_ITEM) {
+				Item* item = Item::Create_OTBM(maphandle, itemNode);
+				if(item) {
+					if(!item->unserializeItemNode_OTBM(maphandle, itemNode)) {
+						batch.warnings.push_back(wxString::Format("Couldn't unserialize item attributes at %d:%d:%d", pos.x, pos.y, pos.z));
+					}
+					tile->addItem(item);
+				}
+			} else {
+				batch.warnings.push_back("Unknown type of tile child node");
+			}
+		}
+
+		tile->update();
+		batch.tiles.push_back({pos, tile});
+	}
+}
+
+static TileAreaBatch decodeTileAreaJob(const IOMap& maphandle, TileAreaJob job)
+{
+	TileAreaBatch batch;
+	for(TileAreaJob::Area& area : job.areas) {
+		MemoryNodeFileReadHandle handle(area.data.data(), area.data.size());
+		BinaryNode* root = handle.getRootNode();
+		decodeTileArea(maphandle, area.base, root->getChild(), batch);
+		if(handle.error_code != FILE_NO_ERROR) {
+			batch.warnings.push_back(wxstr(handle.getErrorMessage()));
+		}
+		std::vector<uint8_t>().swap(area.data);
+	}
+	return batch;
+}
+
+// Must run on the thread that owns the map
+static void mergeTileArea(Map& map, wxArrayString& warnings, IOTelemetry::Counters& counters, TileAreaBatch&& batch)
+{
+	// The tiles of a house mostly come one after another, they are handed over a run at a time
+	House* house = nullptr;
+	std::vector<Tile*> house_tiles;
+	for(TileAreaBatch::Entry& entry : batch.tiles) {
+		const Position& pos = entry.position;
+		Tile* tile = entry.tile;
+		if(map.getTile(pos)) {
+			batch.warnings.push_back(wxString::Format("Duplicate tile at %d:%d:%d, discarding duplicate", pos.x, pos.y, pos.z));
+			delete tile;
+			continue;
+		}
+
+		tile->setLocation(map.createTileL(pos));
+		if(tile->house_id) {
+			if(!house || house->id != tile->house_id) {
+				if(house) {
+					house->addTiles(house_tiles);
+					house_tiles.clear();
+				}
+				house = map.houses.getHouse(tile->house_id);
+				if(!house) {
+					house = newd House(map);
+					house->id = tile->house_id;
+					map.houses.addHouse(house);
+				}
+			}
+			house_tiles.push_back(tile);
+		}
+
+		map.setTile(pos.x, pos.y, pos.z, tile);
+		++counters.tiles;
+		counters.items += tile->size();
+	}
+	if(house) {
+		house->addTiles(house_tiles);
+	}
+
+	for(const wxString& message : batch.warnings) {
+		warnings.push_back(message);
+	}
+}
+
+// Decodes tile areas on the worker threads when there are any, merge gets the batches in file order
+class TileAreaDecoder
+{
+public:
+	using Merge = std::function<void(TileAreaBatch&& batch)>;
+
+	TileAreaDecoder(const IOMap& maphandle, Merge merge) :
+		maphandle(maphandle),
+		merge(std::move(merge)),
+		threadcount(std::max(g_settings.getInteger(Config::WORKER_THREADS), 1)) {}
+
+	// Takes the children of an OTBM_TILE_AREA node, false if the file ends within them
+	bool decode(BinaryNode* areaNode, const Position& base) {
+		if(threadcount <= 1) {
+			TileAreaBatch batch;
+			decodeTileArea(maphandle, base, areaNode->getChild(), batch);
+			merge(std::move(batch));
+			return true;
+		}
+
+		// Hand the raw area over to a worker thread, merge the oldest finished job
+		// once enough are in flight so memory usage stays bounded.
+		TileAreaJob::Area area;
+		area.base = base;
+		if(!areaNode->extractChildren(area.data)) {
+			return false;
+		}
+		job.bytes += area.data.size();
+		job.areas.push_back(std::move(area));
+
+		if(job.areas.size() >= 64 || job.bytes >= 4 * 1024 * 1024) {
+			dispatch();
+			if(pending.size() >= size_t(threadcount)) {
+				merge(pending.front().get());
+				pending.pop_front();
+			}
+		}
+		return true;
+	}
+
+	// Flushes what's left of the parallel decoding
+	void finish() {
+		dispatch();
+		while(!pending.empty()) {
+			merge(pending.front().get());
+			pending.pop_front();
+		}
+	}
+
+private:
+	void dispatch() {
+		if(!job.areas.empty()) {
+			const IOMap& self = maphandle;
+			pending.push_back(ThreadPool::getInstance().async([&self, job = std::move(job)]() mutable { return decodeTileAreaJob(self, std::move(job)); }));
+			job = TileAreaJob();
+		}
+	}
+
+	const IOMap& maphandle;
+	Merge merge;
+	const int threadcount;
+	std::deque<std::future<TileAreaBatch>> pending;
+	TileAreaJob job;
+};
+
+BinaryNode* IOMapOTBM::loadMapHeader(Map& map, NodeFileReadHandle& f)
 {
 	BinaryNode* root = f.getRootNode();
 	if(!root) {
 		error("Could not read root node.");
-		return false;
+		return nullptr;
 	}
 	root->skip(1); // Skip the type byte
 
@@ -646,7 +1159,7 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 	uint32_t u32;
 
 	if(!root->getU32(u32))
-		return false;
+		return nullptr;
 
 	version.otbm = (MapVersionID) u32;
 
@@ -659,16 +1172,16 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 			warning("Unsupported or damaged map version");
 		} else {
 			error("Unsupported OTBM version, could not load map");
-			return false;
+			return nullptr;
 		}
 	}
 
 	if(!root->getU16(u16))
-		return false;
+		return nullptr;
 
 	map.width = u16;
 	if(!root->getU16(u16))
-		return false;
+		return nullptr;
 
 	map.height = u16;
 
@@ -680,7 +1193,7 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 			warning("Map was saved with different .otb than the version of current one. Caution - Might be unsupported or damaged map version");
 		} else {
 			error("Outdated items.otb, could not load map");
-			return false;
+			return nullptr;
 		}
 	}
 
@@ -692,7 +1205,7 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 	BinaryNode* mapHeaderNode = root->getChild();
 	if(mapHeaderNode == nullptr || !mapHeaderNode->getByte(u8) || u8 != OTBM_MAP_DATA) {
 		error("Could not get root child node. Cannot recover from fatal error!");
-		return false;
+		return nullptr;
 	}
 
 	uint8_t attribute;
@@ -723,10 +1236,149 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 			}
 		}
 	}
+	return mapHeaderNode;
+}
+
+void IOMapOTBM::loadTowns(Map& map, BinaryNode* node)
+{
+	for(BinaryNode* townNode = node->getChild(); townNode != nullptr; townNode = townNode->advance()) {
+		Town* town = nullptr;
+		uint8_t town_type;
+		if(!townNode->getByte(town_type)) {
+			warning("Invalid town type (1)");
+			continue;
+		}
+		if(town_type != OTBM_TOWN) {
+			warning("Invalid town type (2)");
+			continue;
+		}
+		uint32_t town_id;
+		if(!townNode->getU32(town_id)) {
+			warning("Invalid town id");
+			continue;
+		}
+
+		town = map.towns.getTown(town_id);
+		if(town) {
+			warning("Duplicate town id %d, discarding duplicate", town_id);
+			continue;
+		} else {
+			town = newd Town(town_id);
+			if(!map.towns.addTown(town)) {
+				delete town;
+				continue;
+			}
+		}
+		std::string town_name;
+		if(!townNode->getString(town_name)) {
+			warning("Invalid town name");
+			continue;
+		}
+		town->setName(town_name);
+		Position pos;
+		uint16_t x;
+		uint16_t y;
+		uint8_t z;
+		if(!townNode->getU16(x) || !townNode->getU16(y) || !townNode->getU8(z)) {
+			warning("Invalid town temple position");
+			continue;
+		}
+		pos.x = x;
+		pos.y = y;
+		pos.z = z;
+		town->setTemplePosition(pos);
+	}
+}
+
+void IOMapOTBM::loadWaypoints(Map& map, BinaryNode* node)
+{
+	for(BinaryNode* waypointNode = node->getChild(); waypointNode != nullptr; waypointNode = waypointNode->advance()) {
+		uint8_t waypoint_type;
+		if(!waypointNode->getByte(waypoint_type)) {
+			warning("Invalid waypoint type (1)");
+			continue;
+		}
+		if(waypoint_type != OTBM_WAYPOINT) {
+			warning("Invalid waypoint type (2)");
+			continue;
+		}
+
+		Waypoint wp;
+
+		if(!waypointNode->getString(wp.name)) {
+			warning("Invalid waypoint name");
+			continue;
+		}
+		uint16_t x;
+		uint16_t y;
+		uint8_t z;
+		if(!waypointNode->getU16(x) || !waypointNode->getU16(y) || !waypointNode->getU8(z)) {
+			warning("Invalid waypoint position");
+			continue;
+		}
+		wp.pos.x = x;
+		wp.pos.y = y;
+		wp.pos.z = z;
+
+		map.waypoints.addWaypoint(newd Waypoint(wp));
+	}
+}
+
+bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
+{
+	IOTelemetry::Scope header(telemetry, IOTelemetry::HEADER);
+	BinaryNode* mapHeaderNode = loadMapHeader(map, f);
+	if(!mapHeaderNode)
+		return false;
+
+	telemetry[IOTelemetry::HEADER].bytes += f.tell();
+	header.stop();
+	return loadMapNodes(map, f, mapHeaderNode);
+}
+
+bool IOMapOTBM::loadMapArea(Map& map, NodeFileReadHandle& f, const FileName& filename)
+{
+	IOTelemetry::Scope header(telemetry, IOTelemetry::HEADER);
+	BinaryNode* mapHeaderNode = loadMapHeader(map, f);
+	if(!mapHeaderNode)
+		return false;
+
+	telemetry[IOTelemetry::HEADER].bytes += f.tell();
+	header.stop();
+
+	// The tile index lets us seek to the areas, without one for this very file they are scanned for
+	const bool indexed = loadTileIndex(filename, filename) && loadIndexedMapNodes(map);
+	if(indexed && map.partial->paged) {
+		map.partial->source = filename;
+		map.partial->index = std::move(previous_areas);
+	}
+	previous_file.reset();
+	previous_areas.clear();
+	if(indexed)
+		return true;
+
+	// Paging needs the index, the map is loaded whole instead
+	if(map.partial->paged) {
+		map.partial.reset();
+	}
+	return loadMapNodes(map, f, mapHeaderNode);
+}
 
+bool IOMapOTBM::loadMapNodes(Map& map, NodeFileReadHandle& f, BinaryNode* mapHeaderNode)
+{
+	RME_TRACE_ZONE("io", "IOMapOTBM::loadMapNodes");
 	int nodes_loaded = 0;
 
+	// A partial map only reads the tile areas in its area, advancing skips over the others
+	const MapArea area = map.partial ? map.partial->area : MapArea();
+	TileAreaDecoder decoder(*this, [&](TileAreaBatch&& batch) {
+		mergeTileArea(map, warnings, telemetry[IOTelemetry::TILE_AREAS], std::move(batch));
+	});
+
+	const size_t nodes_offset = f.tell();
 	for(BinaryNode* mapNode = mapHeaderNode->getChild(); mapNode != nullptr; mapNode = mapNode->advance()) {
+		// Towns and waypoints switch the phase, the rest counts as tile areas
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
 		++nodes_loaded;
 		if(nodes_loaded % 15 == 0) {
 			g_gui.SetLoadDone(static_cast<int32_t>(100.0 * f.tell() / f.size()));
@@ -744,193 +1396,289 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 				warning("Invalid map node, no base coordinate");
 				continue;
 			}
+			if(!area.intersectsTileArea(base_x, base_y, base_z)) {
+				continue;
+			}
 
-			for(BinaryNode* tileNode = mapNode->getChild(); tileNode != nullptr; tileNode = tileNode->advance()) {
-				Tile* tile = nullptr;
-				uint8_t tile_type;
-				if(!tileNode->getByte(tile_type)) {
-					warning("Invalid tile type");
-					continue;
-				}
-				if(tile_type == OTBM_TILE || tile_type == OTBM_HOUSETILE) {
-					//printf("Start\n");
-					uint8_t x_offset, y_offset;
-					if(!tileNode->getU8(x_offset) || !tileNode->getU8(y_offset)) {
-						warning("Could not read position of tile");
-						continue;
-					}
-					const Position pos(base_x + x_offset, base_y + y_offset, base_z);
+			if(!decoder.decode(mapNode, Position(base_x, base_y, base_z))) {
+				warning("Invalid map node, premature end of tile area");
+				break;
+			}
+		} else if(node_type == OTBM_TOWNS) {
+			scope.setPhase(IOTelemetry::TOWNS);
+			const size_t offset = f.tell();
+			loadTowns(map, mapNode);
+			telemetry[IOTelemetry::TOWNS].bytes += f.tell() - offset;
+		} else if(node_type == OTBM_WAYPOINTS) {
+			scope.setPhase(IOTelemetry::WAYPOINTS);
+			const size_t offset = f.tell();
+			loadWaypoints(map, mapNode);
+			telemetry[IOTelemetry::WAYPOINTS].bytes += f.tell() - offset;
+		}
+	}
 
-					if(map.getTile(pos)) {
-						warning("Duplicate tile at %d:%d:%d, discarding duplicate", pos.x, pos.y, pos.z);
-						continue;
-					}
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+	decoder.finish();
+	telemetry[IOTelemetry::TILE_AREAS].bytes += f.tell() - nodes_offset - telemetry[IOTelemetry::TOWNS].bytes - telemetry[IOTelemetry::WAYPOINTS].bytes;
 
-					tile = map.allocator(map.createTileL(pos));
-					House* house = nullptr;
-					if(tile_type == OTBM_HOUSETILE) {
-						uint32_t house_id;
-						if(!tileNode->getU32(house_id)) {
-							warning("House tile without house data, discarding tile");
-							continue;
-						}
-						if(house_id) {
-							house = map.houses.getHouse(house_id);
-							if(!house) {
-								house = newd House(map);
-								house->id = house_id;
-								map.houses.addHouse(house);
-							}
-						} else {
-							warning("Invalid house id from tile %d:%d:%d", pos.x, pos.y, pos.z);
-						}
-					}
-
-					uint8_t attribute;
-					while(tileNode->getU8(attribute)) {
-						switch(attribute) {
-							case OTBM_ATTR_TILE_FLAGS: {
-								uint32_t flags = 0;
-								if(!tileNode->getU32(flags)) {
-									warning("Invalid tile flags of tile on %d:%d:%d", pos.x, pos.y, pos.z);
-								}
+	if(!f.isOk())
+		warning(wxstr(f.getErrorMessage()).wc_str());
+	return true;
+}
 
-								tile->setMapFlags(flags);
-								break;
-							}
-							case OTBM_ATTR_ITEM: {
-								Item* item = Item::Create_OTBM(*this, tileNode);
-								if(item == nullptr)
-								{
-									warning("Invalid item at tile %d:%d:%d", pos.x, pos.y, pos.z);
-								}
-								tile->addItem(item);
-								break;
-							}
-							default: {
-								warning("Unknown tile attribute at %d:%d:%d", pos.x, pos.y, pos.z);
-								break;
-							}
-						}
-					}
+// Wraps encoded sibling nodes into a dummy root, the way extractChildren does, so a
+// MemoryNodeFileReadHandle can read them. The root is left open when closed is false.
+static void wrapNodes(std::vector<uint8_t>& buffer, size_t length, bool closed)
+{
+	buffer.assign(length + 2, 0);
+	buffer[0] = NODE_START;
+	if(closed) {
+		buffer.push_back(NODE_END);
+	}
+}
 
-					for(BinaryNode* itemNode = tileNode->getChild(); itemNode != nullptr; itemNode = itemNode->advance()) {
-						Item* item = nullptr;
-						uint8_t item_type;
-						if(!itemNode->getByte(item_type)) {
-							warning("Unknown item type %d:%d:%d", pos.x, pos.y, pos.z);
-							continue;
-						}
-						if(item_type == OTBM_ITEM) {
-							item = Item::Create_OTBM(*this, itemNode);
-							if(item) {
-								if(!item->unserializeItemNode_OTBM(*this, itemNode)) {
-									warning("Couldn't unserialize item attributes at %d:%d:%d", pos.x, pos.y, pos.z);
-								}
-								//reform(&map, tile, item);
-								tile->addItem(item);
-							}
-						} else {
-							warning("Unknown type of tile child node");
-						}
-					}
+bool IOMapOTBM::loadIndexedMapNodes(Map& map)
+{
+	const MapArea& area = map.partial->area;
+	FileReadHandle& file = *previous_file;
+
+	// The towns and waypoints follow the last tile area
+	size_t footer_offset = 0;
+	for(const auto& [key, nodes] : previous_areas) {
+		for(const OTBM_TileIndexEntry& entry : nodes) {
+			footer_offset = std::max<size_t>(footer_offset, entry.offset + entry.length);
+		}
+	}
+	if(footer_offset == 0 || footer_offset >= file.size())
+		return false;
 
-					tile->update();
-					if(house)
-						house->addTile(tile);
+	std::vector<uint8_t> buffer;
+	{
+		// What's left after them closes the map data and the root, the dummy root ends at the first of it
+		wrapNodes(buffer, file.size() - footer_offset, false);
+		if(!file.seek(footer_offset) || !file.getRAW(buffer.data() + 2, buffer.size() - 2))
+			return false;
 
-					map.setTile(pos.x, pos.y, pos.z, tile);
-				} else {
-					warning("Unknown type of tile node");
-				}
+		MemoryNodeFileReadHandle handle(buffer.data(), buffer.size());
+		BinaryNode* root = handle.getRootNode();
+		for(BinaryNode* mapNode = root ? root->getChild() : nullptr; mapNode != nullptr; mapNode = mapNode->advance()) {
+			uint8_t node_type;
+			if(!mapNode->getByte(node_type)) {
+				continue;
 			}
-		} else if(node_type == OTBM_TOWNS) {
-			for(BinaryNode* townNode = mapNode->getChild(); townNode != nullptr; townNode = townNode->advance()) {
-				Town* town = nullptr;
-				uint8_t town_type;
-				if(!townNode->getByte(town_type)) {
-					warning("Invalid town type (1)");
-					continue;
-				}
-				if(town_type != OTBM_TOWN) {
-					warning("Invalid town type (2)");
-					continue;
-				}
-				uint32_t town_id;
-				if(!townNode->getU32(town_id)) {
-					warning("Invalid town id");
-					continue;
-				}
-
-				town = map.towns.getTown(town_id);
-				if(town) {
-					warning("Duplicate town id %d, discarding duplicate", town_id);
-					continue;
-				} else {
-					town = newd Town(town_id);
-					if(!map.towns.addTown(town)) {
-						delete town;
-						continue;
-					}
-				}
-				std::string town_name;
-				if(!townNode->getString(town_name)) {
-					warning("Invalid town name");
-					continue;
-				}
-				town->setName(town_name);
-				Position pos;
-				uint16_t x;
-				uint16_t y;
-				uint8_t z;
-				if(!townNode->getU16(x) || !townNode->getU16(y) || !townNode->getU8(z)) {
-					warning("Invalid town temple position");
-					continue;
-				}
-				pos.x = x;
-				pos.y = y;
-				pos.z = z;
-				town->setTemplePosition(pos);
+			if(node_type == OTBM_TOWNS) {
+				IOTelemetry::Scope scope(telemetry, IOTelemetry::TOWNS);
+				loadTowns(map, mapNode);
+			} else if(node_type == OTBM_WAYPOINTS) {
+				IOTelemetry::Scope scope(telemetry, IOTelemetry::WAYPOINTS);
+				loadWaypoints(map, mapNode);
 			}
+		}
+	}
+
+	// A paged map reads them once they are needed
+	if(map.partial->paged)
+		return true;
+
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+	IOTelemetry::Counters& counters = telemetry[IOTelemetry::TILE_AREAS];
+	TileAreaDecoder decoder(*this, [&](TileAreaBatch&& batch) {
+		mergeTileArea(map, warnings, counters, std::move(batch));
+	});
+	size_t areas_read = 0;
+	for(const auto& [key, nodes] : previous_areas) {
+		g_gui.SetLoadDone(static_cast<int32_t>(100.0 * ++areas_read / previous_areas.size()));
+		decodeIndexedTileAreas(file, nodes, area, decoder, counters);
+	}
+	decoder.finish();
+	return true;
+}
+
+void IOMapOTBM::decodeIndexedTileAreas(FileReadHandle& file, const std::vector<OTBM_TileIndexEntry>& nodes, const MapArea& area, TileAreaDecoder& decoder, IOTelemetry::Counters& counters)
+{
+	std::vector<uint8_t> buffer;
+	// The nodes that don't overlap are never read
+	for(const OTBM_TileIndexEntry& entry : nodes) {
+		if(!area.intersectsTileArea(entry.x, entry.y, entry.z)) {
+			continue;
+		}
+
+		wrapNodes(buffer, entry.length, true);
+		if(!file.seek(entry.offset) || !file.getRAW(buffer.data() + 2, entry.length)) {
+			warning("Could not read the tile area at %d:%d:%d", entry.x, entry.y, entry.z);
+			continue;
+		}
+		counters.bytes += entry.length;
+
+		MemoryNodeFileReadHandle handle(buffer.data(), buffer.size());
+		BinaryNode* root = handle.getRootNode();
+		BinaryNode* areaNode = root ? root->getChild() : nullptr;
+		uint8_t node_type;
+		uint16_t base_x, base_y;
+		uint8_t base_z;
+		if(!areaNode || !areaNode->getByte(node_type) || node_type != OTBM_TILE_AREA ||
+			!areaNode->getU16(base_x) || !areaNode->getU16(base_y) || !areaNode->getU8(base_z) ||
+			base_x != entry.x || base_y != entry.y || base_z != entry.z) {
+			warning("The tile index doesn't match the tile area at %d:%d:%d", entry.x, entry.y, entry.z);
+			continue;
+		}
+		if(!decoder.decode(areaNode, Position(base_x, base_y, base_z))) {
+			warning("Invalid map node, premature end of tile area");
+		}
+	}
+}
+
+// Hands the tiles of a batch that are inside area to sink, the others are dropped
+static void importTileArea(const MapArea& area, const IOMapOTBM::ImportSink& sink, wxArrayString& warnings, IOTelemetry::Counters& counters, TileAreaBatch&& batch)
+{
+	std::vector<IOMapOTBM::ImportedTile> tiles;
+	tiles.reserve(batch.tiles.size());
+	for(TileAreaBatch::Entry& entry : batch.tiles) {
+		if(!area.contains(entry.position)) {
+			delete entry.tile;
+			continue;
+		}
+		++counters.tiles;
+		counters.items += entry.tile->size();
+		tiles.push_back({entry.position, entry.tile});
+	}
+
+	if(!tiles.empty()) {
+		sink(tiles);
+	}
+
+	for(const wxString& message : batch.warnings) {
+		warnings.push_back(message);
+	}
+}
+
+bool IOMapOTBM::beginImport(Map& map, const FileName& identifier)
+{
+	std::unique_ptr<NodeFileReadHandle> f = openMapFile(identifier);
+	if(!f->isOk()) {
+		error(("Couldn't open file for reading\nThe error reported was: " + wxstr(f->getErrorMessage())).wc_str());
+		return false;
+	}
+
+	telemetry.clear();
+	BinaryNode* mapHeaderNode = loadMapHeader(map, *f);
+	if(!mapHeaderNode)
+		return false;
+
+	// Only the towns and waypoints are read, advancing skips over the tile areas without decoding them
+	for(BinaryNode* mapNode = mapHeaderNode->getChild(); mapNode != nullptr; mapNode = mapNode->advance()) {
+		uint8_t node_type;
+		if(!mapNode->getByte(node_type)) {
+			warning("Invalid map node");
+			continue;
+		}
+		if(node_type == OTBM_TOWNS) {
+			IOTelemetry::Scope scope(telemetry, IOTelemetry::TOWNS);
+			loadTowns(map, mapNode);
 		} else if(node_type == OTBM_WAYPOINTS) {
-			for(BinaryNode* waypointNode = mapNode->getChild(); waypointNode != nullptr; waypointNode = waypointNode->advance()) {
-				uint8_t waypoint_type;
-				if(!waypointNode->getByte(waypoint_type)) {
-					warning("Invalid waypoint type (1)");
-					continue;
-				}
-				if(waypoint_type != OTBM_WAYPOINT) {
-					warning("Invalid waypoint type (2)");
-					continue;
-				}
+			IOTelemetry::Scope scope(telemetry, IOTelemetry::WAYPOINTS);
+			loadWaypoints(map, mapNode);
+		}
+	}
 
-				Waypoint wp;
+	if(!f->isOk())
+		warning(wxstr(f->getErrorMessage()).wc_str());
 
-				if(!waypointNode->getString(wp.name)) {
-					warning("Invalid waypoint name");
-					continue;
-				}
-				uint16_t x;
-				uint16_t y;
-				uint8_t z;
-				if(!waypointNode->getU16(x) || !waypointNode->getU16(y) || !waypointNode->getU8(z)) {
-					warning("Invalid waypoint position");
-					continue;
-				}
-				wp.pos.x = x;
-				wp.pos.y = y;
-				wp.pos.z = z;
+	// The houses have no tiles yet, so they are made from the house file
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::HOUSES);
+	if(!loadHouses(map, identifier, true)) {
+		warning("Failed to load houses.");
+	}
 
-				map.waypoints.addWaypoint(newd Waypoint(wp));
-			}
+	import_source = identifier;
+	import_spawnfile = map.spawnfile;
+	return true;
+}
+
+bool IOMapOTBM::importTiles(const MapArea& area, const ImportSink& sink)
+{
+	std::unique_ptr<NodeFileReadHandle> f = openMapFile(import_source);
+	if(!f->isOk()) {
+		error(("Couldn't open file for reading\nThe error reported was: " + wxstr(f->getErrorMessage())).wc_str());
+		return false;
+	}
+
+	// The header was read by beginImport already
+	BinaryNode* root = f->getRootNode();
+	BinaryNode* mapHeaderNode = root ? root->getChild() : nullptr;
+	if(!mapHeaderNode) {
+		error("Could not read root node.");
+		return false;
+	}
+
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+	IOTelemetry::Counters& counters = telemetry[IOTelemetry::TILE_AREAS];
+	TileAreaDecoder decoder(*this, [&](TileAreaBatch&& batch) {
+		importTileArea(area, sink, warnings, counters, std::move(batch));
+	});
+
+	// The index of the file lets us seek to the areas instead of scanning for them
+	if(!area.isWholeMap() && loadTileIndex(import_source, import_source)) {
+		for(const auto& [key, nodes] : previous_areas) {
+			decodeIndexedTileAreas(*previous_file, nodes, area, decoder, counters);
 		}
+		decoder.finish();
+		previous_file.reset();
+		previous_areas.clear();
+		return true;
 	}
 
-	if(!f.isOk())
-		warning(wxstr(f.getErrorMessage()).wc_str());
+	int nodes_loaded = 0;
+	for(BinaryNode* mapNode = mapHeaderNode->getChild(); mapNode != nullptr; mapNode = mapNode->advance()) {
+		++nodes_loaded;
+		if(nodes_loaded % 15 == 0) {
+			g_gui.SetLoadDone(static_cast<int32_t>(100.0 * f->tell() / f->size()));
+		}
+
+		uint8_t node_type;
+		if(!mapNode->getByte(node_type) || node_type != OTBM_TILE_AREA) {
+			continue;
+		}
+
+		uint16_t base_x, base_y;
+		uint8_t base_z;
+		if(!mapNode->getU16(base_x) || !mapNode->getU16(base_y) || !mapNode->getU8(base_z)) {
+			warning("Invalid map node, no base coordinate");
+			continue;
+		}
+		if(!area.intersectsTileArea(base_x, base_y, base_z)) {
+			continue;
+		}
+
+		if(!decoder.decode(mapNode, Position(base_x, base_y, base_z))) {
+			warning("Invalid map node, premature end of tile area");
+			break;
+		}
+	}
+	decoder.finish();
+	counters.bytes += f->tell();
+
+	if(!f->isOk())
+		warning(wxstr(f->getErrorMessage()).wc_str());
 	return true;
 }
 
+bool IOMapOTBM::finishImport(Map& target, const Position& offset, const MapArea& area)
+{
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::SPAWNS);
+	FileName filename(import_source.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME) + wxstr(import_spawnfile));
+	if(!filename.FileExists())
+		return false;
+
+	pugi::xml_document doc;
+	pugi::xml_parse_result result = doc.load_file(nstr(filename.GetFullPath()).c_str(), pugi::parse_minimal | pugi::parse_escapes);
+	if(!result) {
+		return false;
+	}
+	telemetry[IOTelemetry::SPAWNS].bytes += getFileSize(filename.GetFullPath());
+	return loadSpawns(target, doc, offset, &area);
+}
+
 bool IOMapOTBM::loadSpawns(Map& map, const FileName& dir)
 {
 	std::string fn = (const char*)(dir.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME).mb_str(wxConvUTF8));
@@ -940,15 +1688,101 @@ bool IOMapOTBM::loadSpawns(Map& map, const FileName& dir)
 	if(!filename.FileExists())
 		return false;
 
+	// Parsed in the buffer pugixml reads the file into, the spawn file only has elements and attributes
 	pugi::xml_document doc;
-	pugi::xml_parse_result result = doc.load_file(fn.c_str());
+	pugi::xml_parse_result result = doc.load_file(fn.c_str(), pugi::parse_minimal | pugi::parse_escapes);
 	if(!result) {
 		return false;
 	}
+	telemetry[IOTelemetry::SPAWNS].bytes += getFileSize(filename.GetFullPath());
 	return loadSpawns(map, doc);
 }
 
-bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
+// Whether a spawn and all of its creatures are on the tile areas a partial map loaded
+static bool isSpawnLoaded(const Map& map, pugi::xml_node spawnNode, const Position& center)
+{
+	if(!map.isAreaLoaded(center))
+		return false;
+
+	for(pugi::xml_node creatureNode = spawnNode.first_child(); creatureNode; creatureNode = creatureNode.next_sibling()) {
+		const Position pos(center.x + creatureNode.attribute("x").as_int(), center.y + creatureNode.attribute("y").as_int(), center.z);
+		if(!map.isAreaLoaded(pos))
+			return false;
+	}
+	return true;
+}
+
+// Case insensitively, without making a lowered copy of every node name
+static bool hasName(pugi::xml_node node, const char* name)
+{
+	const char* other = node.name();
+	for(; *name && *other; ++name, ++other) {
+		if(std::tolower(static_cast<unsigned char>(*name)) != std::tolower(static_cast<unsigned char>(*other)))
+			return false;
+	}
+	return *name == *other;
+}
+
+// A spawn node as read from the document, the nodes are read on the worker threads and then
+// placed on the map in file order
+struct SpawnRecord
+{
+	struct Creature {
+		// Within the document, which outlives the record
+		const char* name;
+		bool npc;
+		// A creature without them ends the spawn
+		bool has_position;
+		int32_t x, y;
+		int32_t spawntime;
+		int32_t direction;
+	};
+
+	pugi::xml_node node;
+	bool is_spawn = false;
+	Position center;
+	int32_t radius = 0;
+	std::vector<Creature> creatures;
+};
+
+static void readSpawnNode(pugi::xml_node spawnNode, SpawnRecord& record)
+{
+	record.node = spawnNode;
+	record.is_spawn = hasName(spawnNode, "spawn");
+	if(!record.is_spawn)
+		return;
+
+	record.center.x = spawnNode.attribute("centerx").as_int();
+	record.center.y = spawnNode.attribute("centery").as_int();
+	record.center.z = spawnNode.attribute("centerz").as_int();
+	record.radius = spawnNode.attribute("radius").as_int();
+
+	for(pugi::xml_node creatureNode = spawnNode.first_child(); creatureNode; creatureNode = creatureNode.next_sibling()) {
+		const bool npc = hasName(creatureNode, "npc");
+		if(!npc && !hasName(creatureNode, "monster")) {
+			continue;
+		}
+
+		SpawnRecord::Creature creature;
+		creature.name = creatureNode.attribute("name").as_string();
+		creature.npc = npc;
+		pugi::xml_attribute xAttribute = creatureNode.attribute("x");
+		pugi::xml_attribute yAttribute = creatureNode.attribute("y");
+		creature.has_position = xAttribute && yAttribute;
+		creature.x = xAttribute.as_int();
+		creature.y = yAttribute.as_int();
+		creature.spawntime = creatureNode.attribute("spawntime").as_int();
+		creature.direction = creatureNode.attribute("direction").as_int(-1);
+		record.creatures.push_back(creature);
+
+		// The rest of the spawn is discarded along with it
+		if(*creature.name == '\0' || !creature.has_position) {
+			break;
+		}
+	}
+}
+
+bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc, const Position& offset, const MapArea* area)
 {
 	pugi::xml_node node = doc.child("spawns");
 	if(!node) {
@@ -956,22 +1790,51 @@ bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
 		return false;
 	}
 
+	std::vector<SpawnRecord> records;
 	for(pugi::xml_node spawnNode = node.first_child(); spawnNode; spawnNode = spawnNode.next_sibling()) {
-		if(as_lower_str(spawnNode.name()) != "spawn") {
-			continue;
+		records.emplace_back().node = spawnNode;
+	}
+
+	// Reading the document doesn't change it, only placing the spawns has to be done in order
+	const size_t chunk_count = std::max<size_t>(std::min(records.size() / 256, ThreadPool::getInstance().getWorkerCount() * 8), 1);
+	ThreadPool::getInstance().parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t end = records.size() * (chunk + 1) / chunk_count;
+		for(size_t index = records.size() * chunk / chunk_count; index < end; ++index) {
+			readSpawnNode(records[index].node, records[index]);
 		}
+	});
 
-		Position spawnPosition;
-		spawnPosition.x = spawnNode.attribute("centerx").as_int();
-		spawnPosition.y = spawnNode.attribute("centery").as_int();
-		spawnPosition.z = spawnNode.attribute("centerz").as_int();
+	const int32_t default_spawntime = g_settings.getInteger(Config::DEFAULT_SPAWNTIME);
+	const int32_t max_radius = g_settings.getInteger(Config::MAX_SPAWN_RADIUS);
+	for(const SpawnRecord& record : records) {
+		if(!record.is_spawn) {
+			continue;
+		}
 
+		Position spawnPosition = record.center;
 		if(spawnPosition.x == 0 || spawnPosition.y == 0) {
 			warning("Bad position data on one spawn, discarding...");
 			continue;
 		}
 
-		int32_t radius = spawnNode.attribute("radius").as_int();
+		// A partial map keeps the spawns it can't place whole as they are, to save them back
+		if(!area && map.partial && !isSpawnLoaded(map, record.node, spawnPosition)) {
+			map.partial->spawns.append_copy(record.node);
+			continue;
+		}
+
+		// An import only takes the spawns inside its area, moved along with the tiles
+		if(area) {
+			if(!area->contains(spawnPosition)) {
+				continue;
+			}
+			spawnPosition += offset;
+			if(!spawnPosition.isValid()) {
+				continue;
+			}
+		}
+
+		int32_t radius = record.radius;
 		if(radius < 1) {
 			warning("Couldn't read radius of spawn.. discarding spawn...");
 			continue;
@@ -979,8 +1842,14 @@ bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
 
 		Tile* tile = map.getTile(spawnPosition);
 		if(tile && tile->spawn) {
-			warning("Duplicate spawn on position %d:%d:%d\n", tile->getX(), tile->getY(), tile->getZ());
-			continue;
+			if(!area) {
+				warning("Duplicate spawn on position %d:%d:%d\n", tile->getX(), tile->getY(), tile->getZ());
+				continue;
+			}
+			// Imported spawns replace the ones already there
+			map.removeSpawnInternal(tile);
+			delete tile->spawn;
+			tile->spawn = nullptr;
 		}
 
 		Spawn* spawn = newd Spawn(radius);
@@ -992,14 +1861,8 @@ bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
 		tile->spawn = spawn;
 		map.addSpawn(tile);
 
-		for(pugi::xml_node creatureNode = spawnNode.first_child(); creatureNode; creatureNode = creatureNode.next_sibling()) {
-			const std::string& creatureNodeName = as_lower_str(creatureNode.name());
-			if(creatureNodeName != "monster" && creatureNodeName != "npc") {
-				continue;
-			}
-
-			bool isNpc = creatureNodeName == "npc";
-			const std::string& name = creatureNode.attribute("name").as_string();
+		for(const SpawnRecord::Creature& creatureRecord : record.creatures) {
+			const std::string& name = creatureRecord.name;
 			if(name.empty()) {
 				wxString err;
 				err << "Bad creature position data, discarding creature at spawn " << spawnPosition.x << ":" << spawnPosition.y << ":" << spawnPosition.z << " due missing name.";
@@ -1007,34 +1870,33 @@ bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
 				break;
 			}
 
-			int32_t spawntime = creatureNode.attribute("spawntime").as_int();
+			int32_t spawntime = creatureRecord.spawntime;
 			if(spawntime == 0) {
-				spawntime = g_settings.getInteger(Config::DEFAULT_SPAWNTIME);
+				spawntime = default_spawntime;
 			}
 
 			Direction direction = NORTH;
-			int dir = creatureNode.attribute("direction").as_int(-1);
-			if(dir >= DIRECTION_FIRST && dir <= DIRECTION_LAST) {
-				direction = (Direction)dir;
+			if(creatureRecord.direction >= DIRECTION_FIRST && creatureRecord.direction <= DIRECTION_LAST) {
+				direction = (Direction)creatureRecord.direction;
 			}
 
 			Position creaturePosition(spawnPosition);
-
-			pugi::xml_attribute xAttribute = creatureNode.attribute("x");
-			pugi::xml_attribute yAttribute = creatureNode.attribute("y");
-			if(!xAttribute || !yAttribute) {
+			if(!creatureRecord.has_position) {
 				wxString err;
 				err << "Bad creature position data, discarding creature \"" << name << "\" at spawn " << creaturePosition.x << ":" << creaturePosition.y << ":" << creaturePosition.z << " due to invalid position.";
 				warnings.Add(err);
 				break;
 			}
 
-			creaturePosition.x += xAttribute.as_int();
-			creaturePosition.y += yAttribute.as_int();
+			creaturePosition.x += creatureRecord.x;
+			creaturePosition.y += creatureRecord.y;
+			if(area && !area->contains(creaturePosition - offset)) {
+				continue;
+			}
 
 			radius = std::max<int32_t>(radius, std::abs(creaturePosition.x - spawnPosition.x));
 			radius = std::max<int32_t>(radius, std::abs(creaturePosition.y - spawnPosition.y));
-			radius = std::min<int32_t>(radius, g_settings.getInteger(Config::MAX_SPAWN_RADIUS));
+			radius = std::min<int32_t>(radius, max_radius);
 
 			Tile* creatureTile;
 			if(creaturePosition == spawnPosition) {
@@ -1059,13 +1921,15 @@ bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
 
 			CreatureType* type = g_creatures[name];
 			if(!type) {
-				type = g_creatures.addMissingCreatureType(name, isNpc);
+				type = g_creatures.addMissingCreatureType(name, creatureRecord.npc);
 			}
 
 			Creature* creature = newd Creature(type);
 			creature->setDirection(direction);
 			creature->setSpawnTime(spawntime);
 			creatureTile->creature = creature;
+			// Put on a tile already in the map, past updateItemIndex
+			map.spawns.addCreature(creaturePosition);
 
 			if(creatureTile->getLocation()->getSpawnCount() == 0) {
 				// No spawn, create a newd one
@@ -1078,8 +1942,79 @@ bool IOMapOTBM::loadSpawns(Map& map, pugi::xml_document& doc)
 	}
 	return true;
 }
+}
+
+bool IOMapOTBM::loadPagedArea(Map& map, uint32_t area)
+{
+	OTBM_PartialMap& partial = *map.partial;
+	auto nodes = partial.index.find(area);
+	if(nodes == partial.index.end())
+		return true;
+
+	FileReadHandle file(nstr(partial.source.GetFullPath()));
+	if(!file.isOk()) {
+		error("Couldn't open %s to read the tiles back in", (const char*)partial.source.GetFullPath().mb_str(wxConvUTF8));
+		return false;
+	}
+
+	IOTelemetry::Counters counters;
+	TileAreaDecoder decoder(*this, [&](TileAreaBatch&& batch) {
+		// The house file size counts these tiles, the house only has the ones in memory
+		for(const TileAreaBatch::Entry& entry : batch.tiles) {
+			if(entry.tile->house_id) {
+				--partial.unloaded_house_sizes[entry.tile->house_id];
+			}
+		}
+		mergeTileArea(map, warnings, counters, std::move(batch));
+	});
+	decodeIndexedTileAreas(file, nodes->second, MapArea(), decoder, counters);
+	decoder.finish();
+
+	// Somewhat less than what the tiles actually take, the items they hold vary a lot. Only the tiles
+	// are freed again when the area is paged out, its floors and leaves stay
+	const size_t bytes = counters.tiles * sizeof(Tile) + counters.items * sizeof(Item);
+	partial.resident[area] = bytes;
+	partial.resident_bytes += bytes;
+
+	// The spawns that are whole now
+	pugi::xml_document doc;
+	pugi::xml_node spawns = doc.append_child("spawns");
+	for(pugi::xml_node spawnNode = partial.spawns.first_child(); spawnNode;) {
+		pugi::xml_node next = spawnNode.next_sibling();
+		const Position center(spawnNode.attribute("centerx").as_int(), spawnNode.attribute("centery").as_int(), spawnNode.attribute("centerz").as_int());
+		if(isSpawnLoaded(map, spawnNode, center)) {
+			spawns.append_copy(spawnNode);
+			partial.spawns.remove_child(spawnNode);
+		}
+		spawnNode = next;
+	}
+	if(spawns.first_child()) {
+		loadSpawns(map, doc);
+	}
+
+	auto zones = std::stable_partition(partial.zones.begin(), partial.zones.end(), [area](const OTBM_ZoneLeaf& leaf) {
+		return Map::getAreaIndex(leaf.x, leaf.y) != area;
+	});
+	for(auto it = zones; it != partial.zones.end(); ++it) {
+		QTreeNode* leaf = map.getLeaf(it->x, it->y);
+		Floor* floor = leaf && it->z <= rme::MapMaxLayer ? leaf->getFloor(it->z) : nullptr;
+		if(!floor)
+			continue;
+
+		for(const auto& [zone_id, mask] : it->zones) {
+			for(int index = 0; index < 16; ++index) {
+				Tile* tile = (mask & (1 << index)) ? floor->locs[index].get() : nullptr;
+				if(tile) {
+					tile->addZoneId(zone_id);
+				}
+			}
+		}
+	}
+	partial.zones.erase(zones, partial.zones.end());
+	return true;
+}
 
-bool IOMapOTBM::loadHouses(Map& map, const FileName& dir)
+bool IOMapOTBM::loadHouses(Map& map, const FileName& dir, bool create)
 {
 	std::string fn = (const char*)(dir.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME).mb_str(wxConvUTF8));
 	fn += map.housefile;
@@ -1088,14 +2023,15 @@ bool IOMapOTBM::loadHouses(Map& map, const FileName& dir)
 		return false;
 
 	pugi::xml_document doc;
-	pugi::xml_parse_result result = doc.load_file(fn.c_str());
+	pugi::xml_parse_result result = doc.load_file(fn.c_str(), pugi::parse_minimal | pugi::parse_escapes);
 	if(!result) {
 		return false;
 	}
-	return loadHouses(map, doc);
+	telemetry[IOTelemetry::HOUSES].bytes += getFileSize(filename.GetFullPath());
+	return loadHouses(map, doc, create);
 }
 
-bool IOMapOTBM::loadHouses(Map& map, pugi::xml_document& doc)
+bool IOMapOTBM::loadHouses(Map& map, pugi::xml_document& doc, bool create)
 {
 	pugi::xml_node node = doc.child("houses");
 	if(!node) {
@@ -1105,7 +2041,7 @@ bool IOMapOTBM::loadHouses(Map& map, pugi::xml_document& doc)
 
 	pugi::xml_attribute attribute;
 	for(pugi::xml_node houseNode = node.first_child(); houseNode; houseNode = houseNode.next_sibling()) {
-		if(as_lower_str(houseNode.name()) != "house") {
+		if(!hasName(houseNode, "house")) {
 			continue;
 		}
 
@@ -1113,7 +2049,12 @@ bool IOMapOTBM::loadHouses(Map& map, pugi::xml_document& doc)
 		if((attribute = houseNode.attribute("houseid"))) {
 			house = map.houses.getHouse(attribute.as_uint());
 			if(!house) {
-				break;
+				if(!create) {
+					break;
+				}
+				house = newd House(map);
+				house->id = attribute.as_uint();
+				map.houses.addHouse(house);
 			}
 		}
 
@@ -1140,6 +2081,10 @@ bool IOMapOTBM::loadHouses(Map& map, pugi::xml_document& doc)
 			house->guildhall = attribute.as_bool();
 		}
 
+		if(map.partial) {
+			map.partial->unloaded_house_sizes[house->id] = houseNode.attribute("size").as_int() - int32_t(house->size());
+		}
+
 		if((attribute = houseNode.attribute("townid"))) {
 			house->townid = attribute.as_uint();
 		} else {
@@ -1152,6 +2097,8 @@ bool IOMapOTBM::loadHouses(Map& map, pugi::xml_document& doc)
 
 bool IOMapOTBM::saveMap(Map& map, const FileName& identifier)
 {
+	RME_TRACE_ZONE("io", "IOMapOTBM::saveMap");
+	telemetry.clear();
 #if OTGZ_SUPPORT > 0
 	if(identifier.GetExt() == "otgz") {
 		// Create the archive
@@ -1189,10 +2136,8 @@ bool IOMapOTBM::saveMap(Map& map, const FileName& identifier)
 
 		g_gui.SetLoadDone(0, "Saving houses...");
 
-		pugi::xml_document houseDoc;
-		if(saveHouses(map, houseDoc)) {
+		if(saveHouses(map, streamData)) {
 			// Write the data
-			houseDoc.save(streamData, "", pugi::format_raw, pugi::encoding_utf8);
 			std::string xmlData = streamData.str();
 
 			// Write to the arhive
@@ -1239,210 +2184,1135 @@ bool IOMapOTBM::saveMap(Map& map, const FileName& identifier)
 		archive_write_free(a);
 
 		g_gui.DestroyLoadBar();
+		map.clearDirtyAreas();
 		return true;
 	}
 #endif
 
-	DiskNodeFileWriteHandle f(
-		nstr(identifier.GetFullPath()),
-		(g_settings.getInteger(Config::SAVE_WITH_OTB_MAGIC_NUMBER) ? "OTBM" : std::string(4, '\0'))
-		);
-
-	if(!f.isOk()) {
-		error("Can not open file %s for writing", (const char*)identifier.GetFullPath().mb_str(wxConvUTF8));
+	// Paged out areas are read through the tile index, which only plain maps have
+	const bool compressed = isCompressedMapName(identifier);
+	if(compressed && map.isPaged()) {
+		error("Maps that are read an area at a time can only be saved as plain OTBM");
 		return false;
 	}
-
-	if(!saveMap(map, f))
+	if(!saveMapFile(map, identifier, compressed))
 		return false;
 
+	map.clearDirtyAreas();
+
+	// The areas paged out are in the new file now, and at other offsets
+	if(map.isPaged()) {
+		map.partial->source = identifier;
+		map.partial->index.clear();
+		for(const OTBM_TileIndexEntry& entry : saved_areas) {
+			map.partial->index[entry.getArea()].push_back(entry);
+		}
+	}
+
 	g_gui.SetLoadDone(99, "Saving spawns...");
-	saveSpawns(map, identifier);
+	{
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::SPAWNS);
+		saveSpawns(map, identifier);
+	}
 
 	g_gui.SetLoadDone(99, "Saving houses...");
-	saveHouses(map, identifier);
+	{
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::HOUSES);
+		saveHouses(map, identifier);
+	}
 
-	saveZonesToToml(zoneMap, identifier, map);
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::ZONES);
+	if(map.partial) {
+		saved_zones.insert(saved_zones.end(), map.partial->zones.begin(), map.partial->zones.end());
+	}
+	if(saveZones(identifier)) {
+		telemetry[IOTelemetry::ZONES].bytes += getFileSize(identifier.GetFullPath() + ".zones");
+	} else {
+		warning("Failed to write the zones.");
+	}
+	if(g_settings.getInteger(Config::SAVE_ZONES_AS_TOML)) {
+		saveZonesToToml(identifier, map);
+	}
 
 	return true;
 }
 
-bool IOMapOTBM::saveMap(Map& map, NodeFileWriteHandle& f)
+bool IOMapOTBM::exportMap(Map& map, const FileName& identifier)
 {
-	/* STOP!
-	 * Before you even think about modifying this, please reconsider.
-	 * while adding stuff to the binary format may be "cool", you'll
-	 * inevitably make it incompatible with any future releases of
-	 * the map editor, meaning you cannot reuse your map. Before you
-	 * try to modify this, PLEASE consider using an external file
-	 * like spawns.xml or houses.xml, as that will be MUCH easier
-	 * to port to newer versions of the editor than a custom binary
-	 * format.
-	 */
+	telemetry.clear();
+	return saveMapFile(map, identifier, isCompressedMapName(identifier));
+}
 
-	const IOMapOTBM& self = *this;
+bool IOMapOTBM::isCompressedMapName(const FileName& identifier)
+{
+	return identifier.GetExt().Lower() == "otbz";
+}
 
-	FileName tmpName;
-	MapVersion mapVersion = map.getVersion();
+bool IOMapOTBM::saveMapFile(Map& map, const FileName& identifier, bool compressed)
+{
+	// The index of the previous save is only valid for the file it was written with. A partial
+	// map splices in the areas it didn't load instead, see spliceTileAreas. The server profile
+	// orders the areas differently, so it writes all of them again.
+	if(!map.partial) {
+		if(!server_profile) {
+			loadTileIndex(identifier, incremental_source);
+		}
+	} else if(!partial_source.FileExists() || partial_source.SameAs(identifier)) {
+		error("The map was only partly loaded from %s, it has to be there to save the rest", (const char*)partial_source.GetFullPath().mb_str(wxConvUTF8));
+		return false;
+	}
+	wxRemoveFile(identifier.GetFullPath() + ".idx");
+
+	if(compressed) {
+		// The offsets of the tile areas are those of the nodes, so no tile index is written
+		MemoryNodeFileWriteHandle f;
+		bool saved = saveMap(map, f);
+		previous_file.reset();
+		previous_areas.clear();
+		if(!saved)
+			return false;
 
-	f.addNode(0);
-	{
-		f.addU32(mapVersion.otbm); // Version
+		g_gui.SetLoadDone(99, "Compressing...");
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+		if(!writeCompressedMap(nstr(identifier.GetFullPath()), version, f.getMemory(), f.getSize(), saved_areas)) {
+			error("Failed to write %s", (const char*)identifier.GetFullPath().mb_str(wxConvUTF8));
+			return false;
+		}
+		return true;
+	}
 
-		f.addU16(map.width);
-		f.addU16(map.height);
+	DiskNodeFileWriteHandle f(
+		nstr(identifier.GetFullPath()),
+		(g_settings.getInteger(Config::SAVE_WITH_OTB_MAGIC_NUMBER) ? "OTBM" : std::string(4, '\0')),
+		true
+		);
 
-		f.addU32(g_items.MajorVersion);
-		f.addU32(g_items.MinorVersion);
+	if(!f.isOk()) {
+		error("Can not open file %s for writing", (const char*)identifier.GetFullPath().mb_str(wxConvUTF8));
+		return false;
+	}
 
-		f.addNode(OTBM_MAP_DATA);
-		{
-			f.addByte(OTBM_ATTR_DESCRIPTION);
-			// Neither SimOne's nor OpenTibia cares for additional description tags
-			f.addString("Saved with Remere's Map Editor " + __RME_VERSION__);
+	bool saved = saveMap(map, f);
+	previous_file.reset();
+	previous_areas.clear();
+	if(!saved)
+		return false;
 
-			f.addU8(OTBM_ATTR_DESCRIPTION);
-			f.addString(map.description);
+	// Wait for the background writer to finish
+	{
+		IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+		f.close();
+	}
+	if(f.error_code != FILE_NO_ERROR) {
+		error("Failed to write %s", (const char*)identifier.GetFullPath().mb_str(wxConvUTF8));
+		return false;
+	}
 
-			tmpName.Assign(wxstr(map.spawnfile));
-			f.addU8(OTBM_ATTR_EXT_SPAWN_FILE);
-			f.addString(nstr(tmpName.GetFullName()));
+	if((!server_profile || server_index) && !saveTileIndex(identifier, &map)) {
+		warning("Failed to write the tile index, the next save will write the whole map.");
+	}
+	return true;
+}
 
-			tmpName.Assign(wxstr(map.housefile));
-			f.addU8(OTBM_ATTR_EXT_HOUSE_FILE);
-			f.addString(nstr(tmpName.GetFullName()));
+static const char* tile_index_identifier = "OIDX";
+static const uint32_t tile_index_version = 3;
+// Identifier, index version, file size and time, OTBM and client version, items version and the area count
+static const size_t tile_index_header_size = 44;
+static const size_t tile_index_summary_size = 17;
+static const size_t tile_index_entry_size = 21;
+static const int tile_index_thumbnail_size = 64;
+
+// The summary follows the header: whether there is one, the tile count, the bounds and the
+// size and minimap colours of the thumbnail
+static void writeMapSummary(FileWriteHandle& f, const Map* map)
+{
+	BaseMap::TileBounds bounds;
+	if(map) {
+		bounds = map->getBounds();
+	}
+	if(bounds.empty()) {
+		f.addU8(map ? 1 : 0);
+		f.addU64(map ? map->getTileCount() : 0);
+		for(int i = 0; i < 6; ++i) {
+			f.addU16(0);
+		}
+		return;
+	}
 
-			// Start writing tiles
-			uint32_t tiles_saved = 0;
-			bool first = true;
+	// The ground floor looks most like the map, the others only if it has nothing
+	int z = rme::MapGroundLayer;
+	if(map->getFloorBounds(z).empty()) {
+		z = 0;
+		while(map->getFloorBounds(z).empty()) {
+			++z;
+		}
+	}
+	const BaseMap::TileBounds& floor = map->getFloorBounds(z);
+
+	const int tiles_x = floor.max_x - floor.min_x + 1;
+	const int tiles_y = floor.max_y - floor.min_y + 1;
+	const int longest = std::max(tiles_x, tiles_y);
+	const int width = std::max(1, tiles_x * std::min(longest, tile_index_thumbnail_size) / longest);
+	const int height = std::max(1, tiles_y * std::min(longest, tile_index_thumbnail_size) / longest);
+
+	// A tile from the middle of the square each pixel stands for
+	std::vector<uint8_t> thumbnail(width * height, 0);
+	for(int py = 0; py < height; ++py) {
+		const int y = floor.min_y + (2 * py + 1) * tiles_y / (2 * height);
+		for(int px = 0; px < width; ++px) {
+			const int x = floor.min_x + (2 * px + 1) * tiles_x / (2 * width);
+			if(const Tile* tile = map->getTile(x, y, z)) {
+				thumbnail[py * width + px] = tile->getMiniMapColor();
+			}
+		}
+	}
 
-			int local_x = -1, local_y = -1, local_z = -1;
+	f.addU8(1);
+	f.addU64(map->getTileCount());
+	f.addU16(uint16_t(bounds.min_x));
+	f.addU16(uint16_t(bounds.min_y));
+	f.addU16(uint16_t(bounds.max_x));
+	f.addU16(uint16_t(bounds.max_y));
+	f.addU16(uint16_t(width));
+	f.addU16(uint16_t(height));
+	f.addRAW(thumbnail.data(), thumbnail.size());
+}
 
-			MapIterator map_iterator = map.begin();
-			while(map_iterator != map.end()) {
-				// Update progressbar
-				++tiles_saved;
-				if(tiles_saved % 8192 == 0)
-					g_gui.SetLoadDone(int(tiles_saved / double(map.getTileCount()) * 100.0));
+// Reads the summary into probe, or skips it if there is none. False if it doesn't fit the file.
+static bool readMapSummary(FileReadHandle& f, OTBM_MapProbe* probe)
+{
+	uint8_t known;
+	uint64_t tile_count;
+	uint16_t min_x, min_y, max_x, max_y, width, height;
+	f.getU8(known);
+	f.getU64(tile_count);
+	f.getU16(min_x);
+	f.getU16(min_y);
+	f.getU16(max_x);
+	f.getU16(max_y);
+	f.getU16(width);
+	if(!f.getU16(height) || width > tile_index_thumbnail_size || height > tile_index_thumbnail_size)
+		return false;
+	if(f.size() < tile_index_header_size + tile_index_summary_size + size_t(width) * height)
+		return false;
 
-				// Get tile
-				Tile* save_tile = (*map_iterator)->get();
+	if(!probe)
+		return f.seek(size_t(width) * height, SEEK_CUR);
+
+	probe->has_summary = known != 0;
+	probe->tile_count = tile_count;
+	probe->min_x = min_x;
+	probe->min_y = min_y;
+	probe->max_x = max_x;
+	probe->max_y = max_y;
+	probe->thumbnail_width = width;
+	probe->thumbnail_height = height;
+	probe->thumbnail.resize(size_t(width) * height);
+	return probe->thumbnail.empty() || f.getRAW(probe->thumbnail.data(), probe->thumbnail.size());
+}
 
-				// Is it an empty tile that we can skip? (Leftovers...)
-				if(!save_tile || save_tile->size() == 0) {
-					++map_iterator;
-					continue;
-				}
+bool IOMapOTBM::probeMap(const FileName& identifier, OTBM_MapProbe& probe)
+{
+	probe = OTBM_MapProbe();
+	if(!identifier.FileExists() || !getVersionInfo(identifier, probe.version))
+		return false;
+	probe.file_size = identifier.GetSize().GetValue();
 
-				const Position& pos = save_tile->getPosition();
+	// Compressed maps keep their index inside the container, without a summary
+	FileReadHandle f(nstr(identifier.GetFullPath()) + ".idx");
+	if(isCompressedMapName(identifier) || !f.isOk() || f.size() < tile_index_header_size + tile_index_summary_size)
+		return true;
 
-				// Decide if newd node should be created
-				if(pos.x < local_x || pos.x >= local_x + 256 || pos.y < local_y || pos.y >= local_y + 256 || pos.z != local_z) {
-					// End last node
-					if(!first) {
-						f.endNode();
-					}
-					first = false;
+	std::string magic;
+	uint32_t index_version;
+	uint64_t file_size, file_time;
+	f.getRAW(magic, 4);
+	f.getU32(index_version);
+	f.getU64(file_size);
+	if(!f.getU64(file_time) || magic != tile_index_identifier || index_version != tile_index_version)
+		return true;
+	// Saved by something else since
+	if(file_size != probe.file_size || file_time != uint64_t(identifier.GetModificationTime().GetTicks()))
+		return true;
+
+	f.seek(tile_index_header_size);
+	if(!readMapSummary(f, &probe)) {
+		probe.has_summary = false;
+		probe.thumbnail.clear();
+	}
+	return true;
+}
+
+bool IOMapOTBM::loadTileIndex(const FileName& identifier, const FileName& source)
+{
+	previous_file.reset();
+	previous_areas.clear();
+	if(!source.IsOk() || !source.FileExists())
+		return false;
+
+	FileReadHandle f(nstr(identifier.GetFullPath()) + ".idx");
+	if(!f.isOk() || f.size() < tile_index_header_size + tile_index_summary_size)
+		return false;
+
+	std::string magic;
+	uint32_t index_version, otbm_version, client_version, items_major, items_minor, count;
+	uint64_t file_size, file_time;
+
+	f.getRAW(magic, 4);
+	f.getU32(index_version);
+	f.getU64(file_size);
+	f.getU64(file_time);
+	f.getU32(otbm_version);
+	f.getU32(client_version);
+	f.getU32(items_major);
+	f.getU32(items_minor);
+	if(!f.getU32(count) || magic != tile_index_identifier || index_version != tile_index_version)
+		return false;
+	if(!readMapSummary(f, nullptr))
+		return false;
+	if(f.size() != f.tell() + size_t(count) * tile_index_entry_size)
+		return false;
+
+	// It has to describe the very file we copy from, serialized the same way we would
+	if(file_size != source.GetSize().GetValue() || file_time != uint64_t(source.GetModificationTime().GetTicks()))
+		return false;
+	if(otbm_version != uint32_t(version.otbm) || client_version != uint32_t(version.client) ||
+		items_major != g_items.MajorVersion || items_minor != g_items.MinorVersion)
+		return false;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		OTBM_TileIndexEntry entry;
+		f.getU16(entry.x);
+		f.getU16(entry.y);
+		f.getU8(entry.z);
+		f.getU64(entry.offset);
+		if(!f.getU64(entry.length) || entry.offset + entry.length > file_size) {
+			previous_areas.clear();
+			return false;
+		}
+		previous_areas[entry.getArea()].push_back(entry);
+	}
+
+	previous_file.reset(newd FileReadHandle(nstr(source.GetFullPath())));
+	if(!previous_file->isOk()) {
+		previous_file.reset();
+		previous_areas.clear();
+		return false;
+	}
+	return true;
+}
+
+bool IOMapOTBM::saveTileIndex(const FileName& identifier, const Map* map)
+{
+	FileName written(identifier.GetFullPath());
+	FileWriteHandle f(nstr(identifier.GetFullPath()) + ".idx");
+	if(!f.isOk())
+		return false;
+
+	f.addRAW(tile_index_identifier);
+	f.addU32(tile_index_version);
+	f.addU64(written.GetSize().GetValue());
+	f.addU64(uint64_t(written.GetModificationTime().GetTicks()));
+	f.addU32(version.otbm);
+	f.addU32(version.client);
+	f.addU32(g_items.MajorVersion);
+	f.addU32(g_items.MinorVersion);
+	f.addU32(uint32_t(saved_areas.size()));
+	ASSERT(f.tell() == tile_index_header_size);
+	writeMapSummary(f, map);
+	for(const OTBM_TileIndexEntry& entry : saved_areas) {
+		f.addU16(entry.x);
+		f.addU16(entry.y);
+		f.addU8(entry.z);
+		f.addU64(entry.offset);
+		f.addU64(entry.length);
+	}
+	if(!f.isOk())
+		return false;
+	f.close();
+
+#ifdef __DEBUG__
+	// Read back the way loadTileIndex does, an index it refuses makes every save write the whole map
+	FileReadHandle check(nstr(identifier.GetFullPath()) + ".idx");
+	uint32_t count = 0;
+	check.seek(tile_index_header_size - 4);
+	check.getU32(count);
+	ASSERT(count == saved_areas.size() && readMapSummary(check, nullptr));
+	ASSERT(check.size() == check.tell() + size_t(count) * tile_index_entry_size);
+	for(const OTBM_TileIndexEntry& entry : saved_areas) {
+		OTBM_TileIndexEntry read;
+		check.getU16(read.x);
+		check.getU16(read.y);
+		check.getU8(read.z);
+		check.getU64(read.offset);
+		check.getU64(read.length);
+		ASSERT(read.x == entry.x && read.y == entry.y && read.z == entry.z && read.offset == entry.offset && read.length == entry.length);
+	}
+#endif
+	return true;
+}
 
-					// Start newd node
-					f.addNode(OTBM_TILE_AREA);
-					f.addU16(local_x = pos.x & 0xFF00);
-					f.addU16(local_y = pos.y & 0xFF00);
-					f.addU8( local_z = pos.z);
+static const char* zone_file_identifier = "OZON";
+static const uint32_t zone_file_version = 1;
+
+bool IOMapOTBM::loadZones(Map& map, const FileName& identifier)
+{
+	FileReadHandle f(nstr(identifier.GetFullPath()) + ".zones");
+	if(!f.isOk())
+		return false;
+
+	std::string magic;
+	uint32_t file_version, count;
+	f.getRAW(magic, 4);
+	f.getU32(file_version);
+	if(!f.getU32(count) || magic != zone_file_identifier || file_version != zone_file_version)
+		return false;
+
+	// Read a leaf at a time straight into its floor
+	for(uint32_t i = 0; i < count; ++i) {
+		uint16_t x, y, zone_count;
+		uint8_t z;
+		f.getU16(x);
+		f.getU16(y);
+		f.getU8(z);
+		if(!f.getU16(zone_count)) {
+			warning("The zone file is truncated.");
+			return true;
+		}
+
+		// The leaves a partial map didn't load are kept to be saved back
+		OTBM_ZoneLeaf* unloaded = nullptr;
+		if(map.partial && !map.isAreaLoaded(Position(x, y, z))) {
+			map.partial->zones.push_back({x, y, z, {}});
+			unloaded = &map.partial->zones.back();
+		}
+
+		QTreeNode* leaf = unloaded ? nullptr : map.getLeaf(x, y);
+		Floor* floor = leaf && z <= rme::MapMaxLayer ? leaf->getFloor(z) : nullptr;
+		for(uint16_t zone = 0; zone < zone_count; ++zone) {
+			uint16_t zone_id, mask;
+			f.getU16(zone_id);
+			if(!f.getU16(mask)) {
+				warning("The zone file is truncated.");
+				return true;
+			}
+			if(unloaded) {
+				unloaded->zones.emplace_back(zone_id, mask);
+			}
+			if(!floor)
+				continue;
+
+			for(int index = 0; index < 16; ++index) {
+				Tile* tile = (mask & (1 << index)) ? floor->locs[index].get() : nullptr;
+				if(tile) {
+					tile->addZoneId(zone_id);
 				}
-				f.addNode(save_tile->isHouseTile()? OTBM_HOUSETILE : OTBM_TILE);
+			}
+		}
+	}
+	return true;
+}
+
+bool IOMapOTBM::saveZones(const FileName& identifier)
+{
+	FileWriteHandle f(nstr(identifier.GetFullPath()) + ".zones");
+	if(!f.isOk())
+		return false;
 
-				f.addU8(save_tile->getX() & 0xFF);
-				f.addU8(save_tile->getY() & 0xFF);
+	f.addRAW(zone_file_identifier);
+	f.addU32(zone_file_version);
+	f.addU32(uint32_t(saved_zones.size()));
+	for(const OTBM_ZoneLeaf& leaf : saved_zones) {
+		f.addU16(leaf.x);
+		f.addU16(leaf.y);
+		f.addU8(leaf.z);
+		f.addU16(uint16_t(leaf.zones.size()));
+		for(const auto& [zone_id, mask] : leaf.zones) {
+			f.addU16(zone_id);
+			f.addU16(mask);
+		}
+	}
+	return f.isOk();
+}
 
-				if(save_tile->isHouseTile()) {
-					f.addU32(save_tile->getHouseID());
+void IOMapOTBM::collectZones(const Tile* tile)
+{
+	const Position& pos = tile->getPosition();
+	const uint16_t x = uint16_t(pos.x & ~3);
+	const uint16_t y = uint16_t(pos.y & ~3);
+	if(saved_zones.empty() || saved_zones.back().x != x || saved_zones.back().y != y || saved_zones.back().z != pos.z) {
+		saved_zones.push_back({x, y, uint8_t(pos.z), {}});
+	}
+
+	auto& zones = saved_zones.back().zones;
+	const uint16_t bit = uint16_t(1 << ((pos.x & 3) * 4 + (pos.y & 3)));
+	for(uint16_t zone_id : tile->getZoneIds()) {
+		auto it = std::find_if(zones.begin(), zones.end(), [zone_id](const std::pair<uint16_t, uint16_t>& zone) {
+			return zone.first == zone_id;
+		});
+		if(it != zones.end()) {
+			it->second |= bit;
+		} else {
+			zones.emplace_back(zone_id, bit);
+		}
+	}
+}
+
+// Collects where each OTBM_TILE_AREA node is in the output
+class TileAreaIndex
+{
+public:
+	TileAreaIndex() : open(false) {}
+
+	// A node starts at offset, the previous one ended there
+	void begin(uint16_t x, uint16_t y, uint8_t z, size_t offset) {
+		finish(offset);
+		current = {x, y, z, offset, 0};
+		open = true;
+	}
+	void finish(size_t offset) {
+		if(open) {
+			current.length = offset - current.offset;
+			entries.push_back(current);
+			open = false;
+		}
+	}
+	// The nodes of a chunk appended at base, their offsets being relative to it
+	void append(const std::vector<OTBM_TileIndexEntry>& chunk, size_t base) {
+		finish(base);
+		for(OTBM_TileIndexEntry entry : chunk) {
+			entry.offset += base;
+			entries.push_back(entry);
+		}
+	}
+
+	std::vector<OTBM_TileIndexEntry> entries;
+
+private:
+	OTBM_TileIndexEntry current;
+	bool open;
+};
+
+// Writes tiles, grouped into OTBM_TILE_AREA nodes. For a server the items are inlined wherever
+// they can be and the zone flag, which only the editor reads, is left out.
+class TileAreaWriter
+{
+public:
+	TileAreaWriter(const IOMap& maphandle, NodeFileWriteHandle& f, TileAreaIndex& index, bool server = false) :
+		maphandle(maphandle), f(f), index(index), server(server), first(true), local_x(-1), local_y(-1), local_z(-1) {}
+
+	void write(const Tile* save_tile);
+	// Only closes the last node if one has actually been created
+	void finish() {
+		if(!first) {
+			f.endNode();
+			first = true;
+		}
+	}
+
+private:
+	const IOMap& maphandle;
+	NodeFileWriteHandle& f;
+	TileAreaIndex& index;
+	bool server;
+	bool first;
+	int local_x, local_y, local_z;
+};
+
+// The map flags of a tile as a server reads them
+static uint16_t getServerMapFlags(const Tile* tile)
+{
+	return tile->getMapFlags() & ~TILESTATE_ZONE_BRUSH;
+}
+
+void TileAreaWriter::write(const Tile* save_tile)
+{
+	const Position& pos = save_tile->getPosition();
+
+	// Decide if newd node should be created
+	if(pos.x < local_x || pos.x >= local_x + 256 || pos.y < local_y || pos.y >= local_y + 256 || pos.z != local_z) {
+		// End last node
+		if(!first) {
+			f.endNode();
+		}
+		first = false;
+
+		// Start newd node
+		local_x = pos.x & 0xFF00;
+		local_y = pos.y & 0xFF00;
+		local_z = pos.z;
+		index.begin(local_x, local_y, local_z, f.getOffset());
+		f.addNode(OTBM_TILE_AREA);
+		f.addU16(local_x);
+		f.addU16(local_y);
+		f.addU8(local_z);
+	}
+	f.addNode(save_tile->isHouseTile()? OTBM_HOUSETILE : OTBM_TILE);
+
+	f.addU8(save_tile->getX() & 0xFF);
+	f.addU8(save_tile->getY() & 0xFF);
+
+	if(save_tile->isHouseTile()) {
+		f.addU32(save_tile->getHouseID());
+	}
+
+	const uint16_t flags = server ? getServerMapFlags(save_tile) : save_tile->getMapFlags();
+	if(flags) {
+		f.addByte(OTBM_ATTR_TILE_FLAGS);
+		f.addU32(flags);
+	}
+
+	if(save_tile->ground) {
+		Item* ground = save_tile->ground;
+		if(ground->isMetaItem()) {
+			// Do nothing, we don't save metaitems...
+		} else if(ground->hasBorderEquivalent()) {
+			bool found = false;
+			for(Item* item : save_tile->items) {
+				if(item->getGroundEquivalent() == ground->getID()) {
+					// Do nothing
+					// Found equivalent
+					found = true;
+					break;
 				}
+			}
 
-				if(save_tile->getMapFlags()) {
-					f.addByte(OTBM_ATTR_TILE_FLAGS);
-					f.addU32(save_tile->getMapFlags());
-					if (save_tile->getMapFlags() & TILESTATE_ZONE_BRUSH)
-					{
-						for (const auto& zoneId : save_tile->getZoneIds())
-						{
-							zoneMap[zoneId].push_back(save_tile->getPosition());
-						}
-					}
+			if(!found) {
+				ground->writeItemNode_OTBM(maphandle, f);
+			}
+		} else if(ground->isComplex()) {
+			ground->writeItemNode_OTBM(maphandle, f);
+		} else {
+			f.addByte(OTBM_ATTR_ITEM);
+			ground->serializeItemCompact_OTBM(maphandle, f);
+		}
+	}
+
+	// The attributes of a tile are read before its child nodes, so only the items below the
+	// first one that needs a node can be inlined without changing their order
+	auto it = save_tile->items.begin();
+	if(server) {
+		for(; it != save_tile->items.end() && ((*it)->isMetaItem() || (*it)->isCompact()); ++it) {
+			if(!(*it)->isMetaItem()) {
+				f.addByte(OTBM_ATTR_ITEM);
+				(*it)->serializeItemCompact_OTBM(maphandle, f);
+			}
+		}
+	}
+	for(; it != save_tile->items.end(); ++it) {
+		if(!(*it)->isMetaItem()) {
+			(*it)->writeItemNode_OTBM(maphandle, f);
+		}
+	}
+
+	f.endNode();
+}
+
+// A piece of the tile section, the index offsets are relative to the start of the chunk
+struct TileSegment
+{
+	std::unique_ptr<MemoryNodeFileWriteHandle> chunk;
+	TileAreaIndex index;
+};
+
+static TileSegment serializeTileJob(const IOMap& maphandle, std::vector<Tile*> tiles, bool server = false)
+{
+	TileSegment segment;
+	segment.chunk.reset(newd MemoryNodeFileWriteHandle());
+	TileAreaWriter writer(maphandle, *segment.chunk, segment.index, server);
+	for(const Tile* tile : tiles) {
+		writer.write(tile);
+	}
+	writer.finish();
+	segment.index.finish(segment.chunk->getSize());
+	return segment;
+}
+
+// Whether the nodes of an area can be copied in one piece
+static bool isContiguous(const std::vector<OTBM_TileIndexEntry>& nodes)
+{
+	for(size_t i = 1; i < nodes.size(); ++i) {
+		if(nodes[i].offset != nodes[i - 1].offset + nodes[i - 1].length)
+			return false;
+	}
+	return !nodes.empty();
+}
+
+// Reads the nodes of an unchanged area from the previous file, the bytes are already encoded
+static TileSegment copyTileArea(const IOMap& maphandle, FileReadHandle& previous, const std::vector<OTBM_TileIndexEntry>& nodes, std::vector<Tile*> tiles)
+{
+	const uint64_t start = nodes.front().offset;
+	std::vector<uint8_t> buffer(nodes.back().offset + nodes.back().length - start);
+	if(!previous.seek(start) || !previous.getRAW(buffer.data(), buffer.size())) {
+		return serializeTileJob(maphandle, std::move(tiles));
+	}
+
+	TileSegment segment;
+	segment.chunk.reset(newd MemoryNodeFileWriteHandle());
+	segment.chunk->addEncoded(buffer.data(), buffer.size());
+	for(OTBM_TileIndexEntry entry : nodes) {
+		entry.offset -= start;
+		segment.index.entries.push_back(entry);
+	}
+	return segment;
+}
+
+// Copies the tile areas of source that a partial map didn't load, they are still encoded as they were read
+static bool spliceTileAreas(const FileName& source, const Map& map, NodeFileWriteHandle& f, TileAreaIndex& index)
+{
+	std::unique_ptr<NodeFileReadHandle> file = openMapFile(source);
+	if(!file->isOk())
+		return false;
+
+	BinaryNode* root = file->getRootNode();
+	BinaryNode* mapHeaderNode = root ? root->getChild() : nullptr;
+	if(!mapHeaderNode)
+		return false;
+
+	std::vector<uint8_t> buffer;
+	for(BinaryNode* mapNode = mapHeaderNode->getChild(); mapNode != nullptr; mapNode = mapNode->advance()) {
+		uint8_t node_type;
+		uint16_t base_x, base_y;
+		uint8_t base_z;
+		if(!mapNode->getByte(node_type) || node_type != OTBM_TILE_AREA) {
+			continue;
+		}
+		if(!mapNode->getU16(base_x) || !mapNode->getU16(base_y) || !mapNode->getU8(base_z)) {
+			return false;
+		}
+		if(map.isAreaLoaded(Position(base_x, base_y, base_z))) {
+			continue;
+		}
+
+		if(!mapNode->extractChildren(buffer))
+			return false;
+
+		index.begin(base_x, base_y, base_z, f.getOffset());
+		f.addNode(OTBM_TILE_AREA);
+		f.addU16(base_x);
+		f.addU16(base_y);
+		f.addU8(base_z);
+		// Without the dummy root extractChildren puts around them
+		f.addEncoded(buffer.data() + 2, buffer.size() - 3);
+		f.endNode();
+	}
+	return file->isOk();
+}
+
+bool IOMapOTBM::saveMap(Map& map, NodeFileWriteHandle& f)
+{
+	RME_TRACE_ZONE("io", "IOMapOTBM::saveMap(NodeFileWriteHandle)");
+	/* STOP!
+	 * Before you even think about modifying this, please reconsider.
+	 * while adding stuff to the binary format may be "cool", you'll
+	 * inevitably make it incompatible with any future releases of
+	 * the map editor, meaning you cannot reuse your map. Before you
+	 * try to modify this, PLEASE consider using an external file
+	 * like spawns.xml or houses.xml, as that will be MUCH easier
+	 * to port to newer versions of the editor than a custom binary
+	 * format.
+	 */
+
+	const IOMapOTBM& self = *this;
+
+	saveMapHeader(map, f);
+	if(server_profile) {
+		if(!saveServerTileAreas(map, f))
+			return false;
+		saveMapFooter(map, f);
+		return true;
+	}
+
+	// Start writing tiles
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+	IOTelemetry::Counters& counters = telemetry[IOTelemetry::TILE_AREAS];
+	const size_t tiles_offset = f.getOffset();
+	uint32_t tiles_saved = 0;
+	const int threadcount = std::max(g_settings.getInteger(Config::WORKER_THREADS), 1);
+
+	// Tiles are serialized in jobs on worker threads, and the finished chunks are
+	// appended in map order. Every job opens its own tile areas.
+	std::deque<std::future<TileSegment>> pending;
+	std::vector<Tile*> job;
+	job.reserve(4096);
+
+	// Serial saves write straight into the file
+	TileAreaIndex index;
+	TileAreaWriter serial_writer(self, f, index);
+
+	// 256x256 areas that didn't change since the previous save are copied from it
+	uint32_t current_area = UINT32_MAX;
+	const std::vector<OTBM_TileIndexEntry>* reused = nullptr;
+	std::vector<Tile*> reused_tiles;
+
+	auto append = [&](TileSegment segment) {
+		index.append(segment.index.entries, f.getOffset());
+		f.addEncoded(segment.chunk->getMemory(), segment.chunk->getSize());
+	};
+	auto drain = [&](size_t keep) {
+		while(pending.size() > keep) {
+			append(pending.front().get());
+			pending.pop_front();
+		}
+	};
+	auto dispatch = [&]() {
+		if(!job.empty()) {
+			pending.push_back(ThreadPool::getInstance().async([&self, job = std::move(job)]() mutable { return serializeTileJob(self, std::move(job)); }));
+			job = std::vector<Tile*>();
+			job.reserve(4096);
+		}
+	};
+	auto reuse = [&]() {
+		if(threadcount <= 1) {
+			serial_writer.finish();
+			append(copyTileArea(self, *previous_file, *reused, std::move(reused_tiles)));
+		} else {
+			// Deferred, so the copy runs on this thread once it's the chunk's turn
+			dispatch();
+			pending.push_back(std::async(std::launch::deferred, copyTileArea, std::cref(self), std::ref(*previous_file), *reused, std::move(reused_tiles)));
+			drain(size_t(threadcount - 1));
+		}
+		reused_tiles = std::vector<Tile*>();
+		reused = nullptr;
+	};
+
+	saved_zones.clear();
+	uint64_t discarded_tiles = 0;
+	MapIterator map_iterator = map.begin();
+	while(map_iterator != map.end()) {
+		// Update progressbar
+		++tiles_saved;
+		if(tiles_saved % 8192 == 0)
+			g_gui.SetLoadDone(int(tiles_saved / double(map.getTileCount()) * 100.0));
+
+		// Get tile
+		Tile* save_tile = (*map_iterator)->get();
+		++map_iterator;
+
+		// Is it an empty tile that we can skip? (Leftovers...)
+		if(!save_tile || save_tile->size() == 0) {
+			continue;
+		}
+
+		// The tile areas a partial map didn't load are taken from its file
+		if(map.partial && !map.isAreaLoaded(save_tile->getPosition())) {
+			++discarded_tiles;
+			continue;
+		}
+
+		if(save_tile->getMapFlags() & TILESTATE_ZONE_BRUSH) {
+			collectZones(save_tile);
+		}
+		++counters.tiles;
+		counters.items += save_tile->size();
+
+		const uint32_t area = BaseMap::getAreaIndex(save_tile->getX(), save_tile->getY());
+		if(area != current_area) {
+			if(reused) {
+				reuse();
+			}
+			current_area = area;
+			if(previous_file && !map.isAreaDirty(save_tile->getX(), save_tile->getY())) {
+				auto previous = previous_areas.find(area);
+				if(previous != previous_areas.end() && isContiguous(previous->second)) {
+					reused = &previous->second;
 				}
+			}
+		}
+
+		if(reused) {
+			// Kept in case the previous file can't be read after all
+			reused_tiles.push_back(save_tile);
+			continue;
+		}
+
+		if(threadcount <= 1) {
+			serial_writer.write(save_tile);
+			continue;
+		}
+
+		job.push_back(save_tile);
+		if(job.size() >= 4096) {
+			dispatch();
+			drain(size_t(threadcount - 1));
+		}
+	}
+
+	if(reused) {
+		reuse();
+	}
+	dispatch();
+	drain(0);
+
+	// Only close the last node if one has actually been created
+	serial_writer.finish();
+	if(map.partial) {
+		if(!spliceTileAreas(partial_source, map, f, index)) {
+			error("Could not copy the tiles that weren't loaded from %s", (const char*)partial_source.GetFullPath().mb_str(wxConvUTF8));
+			return false;
+		}
+		if(discarded_tiles > 0) {
+			warning("%llu tiles outside of the loaded area were not saved.", (unsigned long long)discarded_tiles);
+		}
+	}
+	index.finish(f.getOffset());
+	saved_areas = std::move(index.entries);
+	counters.bytes += f.getOffset() - tiles_offset;
+	scope.stop();
+
+	saveMapFooter(map, f);
+	return true;
+}
+
+bool IOMapOTBM::saveServerTileAreas(Map& map, NodeFileWriteHandle& f)
+{
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::TILE_AREAS);
+	IOTelemetry::Counters& counters = telemetry[IOTelemetry::TILE_AREAS];
+	const size_t tiles_offset = f.getOffset();
+
+	// Sorted by area, floor and row, so every area and floor is one node however the tiles
+	// are spread over the leaves of the map
+	std::vector<std::pair<uint64_t, Tile*>> tiles;
+	tiles.reserve(map.getTileCount());
+	uint64_t discarded_tiles = 0;
+	uint32_t tiles_visited = 0;
+	for(MapIterator map_iterator = map.begin(); map_iterator != map.end(); ++map_iterator) {
+		++tiles_visited;
+		if(tiles_visited % 8192 == 0)
+			g_gui.SetLoadDone(int(tiles_visited / double(map.getTileCount()) * 50.0));
+
+		Tile* save_tile = (*map_iterator)->get();
+		if(!save_tile || save_tile->size() == 0) {
+			continue;
+		}
+		if(map.partial && !map.isAreaLoaded(save_tile->getPosition())) {
+			++discarded_tiles;
+			continue;
+		}
+
+		// Tiles holding nothing the server reads
+		bool empty = !save_tile->isHouseTile() && getServerMapFlags(save_tile) == 0 && (!save_tile->ground || save_tile->ground->isMetaItem());
+		for(const Item* item : save_tile->items) {
+			empty = empty && item->isMetaItem();
+		}
+		if(empty) {
+			continue;
+		}
+
+		const uint64_t x = save_tile->getX(), y = save_tile->getY(), z = save_tile->getZ();
+		tiles.emplace_back(((y >> 8) << 36) | ((x >> 8) << 28) | (z << 16) | ((y & 0xFF) << 8) | (x & 0xFF), save_tile);
+		++counters.tiles;
+		counters.items += save_tile->size();
+	}
+	std::sort(tiles.begin(), tiles.end());
+
+	// The nodes are serialized in parallel a window at a time, and appended in order
+	std::vector<size_t> nodes;
+	for(size_t i = 0; i < tiles.size(); ++i) {
+		if(i == 0 || (tiles[i].first >> 16) != (tiles[i - 1].first >> 16)) {
+			nodes.push_back(i);
+		}
+	}
+	nodes.push_back(tiles.size());
+
+	TileAreaIndex index;
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t node_count = nodes.size() - 1;
+	const size_t window = std::max<size_t>(pool.getWorkerCount() * 4, 1);
+	std::vector<TileSegment> segments(window);
+	for(size_t first = 0; first < node_count; first += window) {
+		const size_t count = std::min(window, node_count - first);
+		pool.parallelFor(count, [&](size_t i) {
+			std::vector<Tile*> job;
+			job.reserve(nodes[first + i + 1] - nodes[first + i]);
+			for(size_t tile = nodes[first + i]; tile < nodes[first + i + 1]; ++tile) {
+				job.push_back(tiles[tile].second);
+			}
+			segments[i] = serializeTileJob(*this, std::move(job), true);
+		});
+		for(size_t i = 0; i < count; ++i) {
+			index.append(segments[i].index.entries, f.getOffset());
+			f.addEncoded(segments[i].chunk->getMemory(), segments[i].chunk->getSize());
+			segments[i] = TileSegment();
+		}
+		g_gui.SetLoadDone(50 + int((first + count) / double(node_count) * 49.0));
+	}
+
+	// The areas a partial map didn't load follow as they were
+	if(map.partial) {
+		if(!spliceTileAreas(partial_source, map, f, index)) {
+			error("Could not copy the tiles that weren't loaded from %s", (const char*)partial_source.GetFullPath().mb_str(wxConvUTF8));
+			return false;
+		}
+		if(discarded_tiles > 0) {
+			warning("%llu tiles outside of the loaded area were not saved.", (unsigned long long)discarded_tiles);
+		}
+	}
+	index.finish(f.getOffset());
+	saved_areas = std::move(index.entries);
+	counters.bytes += f.getOffset() - tiles_offset;
+	return true;
+}
+
+void IOMapOTBM::saveMapHeader(Map& map, NodeFileWriteHandle& f)
+{
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::HEADER);
+	const size_t offset = f.getOffset();
+	FileName tmpName;
+	MapVersion mapVersion = map.getVersion();
+
+	f.addNode(0);
+	f.addU32(mapVersion.otbm); // Version
+
+	f.addU16(map.width);
+	f.addU16(map.height);
+
+	f.addU32(g_items.MajorVersion);
+	f.addU32(g_items.MinorVersion);
+
+	f.addNode(OTBM_MAP_DATA);
+	f.addByte(OTBM_ATTR_DESCRIPTION);
+	// Neither SimOne's nor OpenTibia cares for additional description tags
+	f.addString("Saved with Remere's Map Editor " + __RME_VERSION__);
+
+	f.addU8(OTBM_ATTR_DESCRIPTION);
+	f.addString(map.description);
+
+	tmpName.Assign(wxstr(map.spawnfile));
+	f.addU8(OTBM_ATTR_EXT_SPAWN_FILE);
+	f.addString(nstr(tmpName.GetFullName()));
+
+	tmpName.Assign(wxstr(map.housefile));
+	f.addU8(OTBM_ATTR_EXT_HOUSE_FILE);
+	f.addString(nstr(tmpName.GetFullName()));
+	telemetry[IOTelemetry::HEADER].bytes += f.getOffset() - offset;
+}
+
+void IOMapOTBM::saveMapFooter(Map& map, NodeFileWriteHandle& f)
+{
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::TOWNS);
+	size_t offset = f.getOffset();
+	f.addNode(OTBM_TOWNS);
+	for(const auto& townEntry : map.towns) {
+		Town* town = townEntry.second;
+		const Position& townPosition = town->getTemplePosition();
+		f.addNode(OTBM_TOWN);
+			f.addU32(town->getID());
+			f.addString(town->getName());
+			f.addU16(townPosition.x);
+			f.addU16(townPosition.y);
+			f.addU8(townPosition.z);
+		f.endNode();
+	}
+	f.endNode();
+	telemetry[IOTelemetry::TOWNS].bytes += f.getOffset() - offset;
+	scope.stop();
+
+	if(version.otbm >= MAP_OTBM_3) {
+		IOTelemetry::Scope waypoints(telemetry, IOTelemetry::WAYPOINTS);
+		offset = f.getOffset();
+		f.addNode(OTBM_WAYPOINTS);
+		for(const auto& waypointEntry : map.waypoints) {
+			Waypoint* waypoint = waypointEntry.second;
+			f.addNode(OTBM_WAYPOINT);
+				f.addString(waypoint->name);
+				f.addU16(waypoint->pos.x);
+				f.addU16(waypoint->pos.y);
+				f.addU8(waypoint->pos.z);
+			f.endNode();
+		}
+		f.endNode();
+		telemetry[IOTelemetry::WAYPOINTS].bytes += f.getOffset() - offset;
+	}
+
+	// Closes the map data and root nodes opened by the header
+	f.endNode();
+	f.endNode();
+}
+
+bool IOMapOTBM::beginStream(Map& map, const FileName& identifier)
+{
+	stream.reset(newd DiskNodeFileWriteHandle(
+		nstr(identifier.GetFullPath()),
+		(g_settings.getInteger(Config::SAVE_WITH_OTB_MAGIC_NUMBER) ? "OTBM" : std::string(4, '\0')),
+		true
+		));
+	if(!stream->isOk()) {
+		error("Can not open file %s for writing", (const char*)identifier.GetFullPath().mb_str(wxConvUTF8));
+		stream.reset();
+		return false;
+	}
+
+	// The file written won't match an index of a previous one
+	wxRemoveFile(identifier.GetFullPath() + ".idx");
+
+	saved_zones.clear();
+	saved_areas.clear();
+	stream_spawns.reset();
+	pugi::xml_node decl = stream_spawns.prepend_child(pugi::node_declaration);
+	decl.append_attribute("version") = "1.0";
+	stream_spawns.append_child("spawns");
 
-				if(save_tile->ground) {
-					Item* ground = save_tile->ground;
-					if(ground->isMetaItem()) {
-						// Do nothing, we don't save metaitems...
-					} else if(ground->hasBorderEquivalent()) {
-						bool found = false;
-						for(Item* item : save_tile->items) {
-							if(item->getGroundEquivalent() == ground->getID()) {
-								// Do nothing
-								// Found equivalent
-								found = true;
-								break;
-							}
-						}
+	saveMapHeader(map, *stream);
+	return true;
+}
 
-						if(!found) {
-							ground->serializeItemNode_OTBM(self, f);
-						}
-					} else if(ground->isComplex()) {
-						ground->serializeItemNode_OTBM(self, f);
-					} else {
-						f.addByte(OTBM_ATTR_ITEM);
-						ground->serializeItemCompact_OTBM(self, f);
-					}
-				}
+void IOMapOTBM::streamPart(Map& part)
+{
+	ASSERT(stream);
+
+	// Serialized on this thread, the writer already takes the disk off it
+	std::vector<Tile*> tiles;
+	tiles.reserve(part.getTileCount());
+	for(MapIterator it = part.begin(); it != part.end(); ++it) {
+		Tile* tile = (*it)->get();
+		if(!tile || tile->size() == 0) {
+			continue;
+		}
+		if(tile->getMapFlags() & TILESTATE_ZONE_BRUSH) {
+			collectZones(tile);
+		}
+		tiles.push_back(tile);
+	}
 
-				for(Item* item : save_tile->items) {
-					if(!item->isMetaItem()) {
-						item->serializeItemNode_OTBM(self, f);
-					}
-				}
+	TileSegment segment = serializeTileJob(*this, std::move(tiles));
+	for(OTBM_TileIndexEntry entry : segment.index.entries) {
+		entry.offset += stream->getOffset();
+		saved_areas.push_back(entry);
+	}
+	stream->addEncoded(segment.chunk->getMemory(), segment.chunk->getSize());
 
-				f.endNode();
-				++map_iterator;
-			}
+	addSpawns(part, stream_spawns.child("spawns"));
+}
 
-			// Only close the last node if one has actually been created
-			if(!first) {
-				f.endNode();
-			}
+bool IOMapOTBM::finishStream(Map& map, const FileName& identifier)
+{
+	ASSERT(stream);
+
+	saveMapFooter(map, *stream);
+	stream->close();
+	const bool written = stream->error_code == FILE_NO_ERROR;
+	stream.reset();
+	if(!written) {
+		error("Failed to write %s", (const char*)identifier.GetFullPath().mb_str(wxConvUTF8));
+		return false;
+	}
 
-			f.addNode(OTBM_TOWNS);
-			for(const auto& townEntry : map.towns) {
-				Town* town = townEntry.second;
-				const Position& townPosition = town->getTemplePosition();
-				f.addNode(OTBM_TOWN);
-					f.addU32(town->getID());
-					f.addString(town->getName());
-					f.addU16(townPosition.x);
-					f.addU16(townPosition.y);
-					f.addU8(townPosition.z);
-				f.endNode();
-			}
-			f.endNode();
+	wxString filepath = identifier.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME);
+	if(!stream_spawns.save_file((filepath + wxstr(map.spawnfile)).wc_str(), "\t", pugi::format_default, pugi::encoding_utf8)) {
+		warning("Failed to write the spawns.");
+	}
+	stream_spawns.reset();
 
-			if(version.otbm >= MAP_OTBM_3) {
-				f.addNode(OTBM_WAYPOINTS);
-				for(const auto& waypointEntry : map.waypoints) {
-					Waypoint* waypoint = waypointEntry.second;
-					f.addNode(OTBM_WAYPOINT);
-						f.addString(waypoint->name);
-						f.addU16(waypoint->pos.x);
-						f.addU16(waypoint->pos.y);
-						f.addU8(waypoint->pos.z);
-					f.endNode();
-				}
-				f.endNode();
-			}
-		}
-		f.endNode();
+	if(!saveHouses(map, identifier)) {
+		warning("Failed to write the houses.");
+	}
+	if(!saveZones(identifier)) {
+		warning("Failed to write the zones.");
+	}
+	if(!saveTileIndex(identifier, nullptr)) {
+		warning("Failed to write the tile index.");
 	}
-	f.endNode();
 	return true;
 }
 
@@ -1453,8 +3323,9 @@ bool IOMapOTBM::saveSpawns(Map& map, const FileName& dir)
 
 	// Create the XML file
 	pugi::xml_document doc;
-	if(saveSpawns(map, doc)) {
-		return doc.save_file(filepath.wc_str(), "\t", pugi::format_default, pugi::encoding_utf8);
+	if(saveSpawns(map, doc) && doc.save_file(filepath.wc_str(), "\t", pugi::format_default, pugi::encoding_utf8)) {
+		telemetry[IOTelemetry::SPAWNS].bytes += getFileSize(filepath);
+		return true;
 	}
 	return false;
 }
@@ -1468,10 +3339,21 @@ bool IOMapOTBM::saveSpawns(Map& map, pugi::xml_document& doc)
 
 	decl.append_attribute("version") = "1.0";
 
+	pugi::xml_node spawnNodes = doc.append_child("spawns");
+	addSpawns(map, spawnNodes);
+	if(map.partial) {
+		for(pugi::xml_node spawnNode = map.partial->spawns.first_child(); spawnNode; spawnNode = spawnNode.next_sibling()) {
+			spawnNodes.append_copy(spawnNode);
+		}
+	}
+	return true;
+}
+
+void IOMapOTBM::addSpawns(Map& map, pugi::xml_node spawnNodes)
+{
 	CreatureList creatureList;
 
-	pugi::xml_node spawnNodes = doc.append_child("spawns");
-	for(const auto& spawnPosition : map.spawns) {
+	for(const Position& spawnPosition : map.spawns.getSpawnPositions()) {
 		Tile *tile = map.getTile(spawnPosition);
 		if(tile == nullptr)
 			continue;
@@ -1488,27 +3370,25 @@ bool IOMapOTBM::saveSpawns(Map& map, pugi::xml_document& doc)
 		int32_t radius = spawn->getSize();
 		spawnNode.append_attribute("radius") = radius;
 
-		for(int32_t y = -radius; y <= radius; ++y) {
-			for(int32_t x = -radius; x <= radius; ++x) {
-				Tile* creature_tile = map.getTile(spawnPosition + Position(x, y, 0));
-				if(creature_tile) {
-					Creature* creature = creature_tile->creature;
-					if(creature && !creature->isSaved()) {
-						pugi::xml_node creatureNode = spawnNode.append_child(creature->isNpc() ? "npc" : "monster");
-
-						creatureNode.append_attribute("name") = creature->getName().c_str();
-						creatureNode.append_attribute("x") = x;
-						creatureNode.append_attribute("y") = y;
-						creatureNode.append_attribute("z") = spawnPosition.z;
-						creatureNode.append_attribute("spawntime") = creature->getSpawnTime();
-						creatureNode.append_attribute("direction") = creature->getDirection();
-
-
-						// Mark as saved
-						creature->save();
-						creatureList.push_back(creature);
-					}
-				}
+		// A creature belongs to the first spawn covering it that gets here
+		const std::vector<Position> creatures = map.spawns.getCreaturesInArea(
+			spawnPosition.x - radius, spawnPosition.y - radius, spawnPosition.x + radius, spawnPosition.y + radius, spawnPosition.z);
+		for(const Position& position : creatures) {
+			Tile* creature_tile = map.getTile(position);
+			Creature* creature = creature_tile ? creature_tile->creature : nullptr;
+			if(creature && !creature->isSaved()) {
+				pugi::xml_node creatureNode = spawnNode.append_child(creature->isNpc() ? "npc" : "monster");
+
+				creatureNode.append_attribute("name") = creature->getName().c_str();
+				creatureNode.append_attribute("x") = position.x - spawnPosition.x;
+				creatureNode.append_attribute("y") = position.y - spawnPosition.y;
+				creatureNode.append_attribute("z") = spawnPosition.z;
+				creatureNode.append_attribute("spawntime") = creature->getSpawnTime();
+				creatureNode.append_attribute("direction") = creature->getDirection();
+
+				// Mark as saved
+				creature->save();
+				creatureList.push_back(creature);
 			}
 		}
 	}
@@ -1516,7 +3396,6 @@ bool IOMapOTBM::saveSpawns(Map& map, pugi::xml_document& doc)
 	for(Creature* creature : creatureList) {
 		creature->reset();
 	}
-	return true;
 }
 
 bool IOMapOTBM::saveHouses(Map& map, const FileName& dir)
@@ -1524,43 +3403,686 @@ bool IOMapOTBM::saveHouses(Map& map, const FileName& dir)
 	wxString filepath = dir.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME);
 	filepath += wxString(map.housefile.c_str(), wxConvUTF8);
 
-	// Create the XML file
-	pugi::xml_document doc;
-	if(saveHouses(map, doc)) {
-		return doc.save_file(filepath.wc_str(), "\t", pugi::format_default, pugi::encoding_utf8);
+	// Written as it goes, a document of every house isn't needed
+	std::ofstream file(nstr(filepath).c_str(), std::ios::trunc | std::ios::out | std::ios::binary);
+	if(!file.is_open()) {
+		return false;
+	}
+	if(saveHouses(map, file) && file.flush()) {
+		file.close();
+		telemetry[IOTelemetry::HOUSES].bytes += getFileSize(filepath);
+		return true;
 	}
 	return false;
 }
 
-bool IOMapOTBM::saveHouses(Map& map, pugi::xml_document& doc)
+// An attribute as pugixml writes it, with the value escaped
+static void writeXmlAttribute(std::ostream& stream, const char* name, const std::string& value)
 {
-	pugi::xml_node decl = doc.prepend_child(pugi::node_declaration);
-	if(!decl) {
-		return false;
+	stream << ' ' << name << "=\"";
+	for(char c : value) {
+		switch(c) {
+			case '&': stream << "&amp;"; break;
+			case '<': stream << "&lt;"; break;
+			case '>': stream << "&gt;"; break;
+			case '"': stream << "&quot;"; break;
+			case '\r': stream << "&#13;"; break;
+			case '\n': stream << "&#10;"; break;
+			case '\t': stream << "&#9;"; break;
+			default: stream << c; break;
+		}
 	}
+	stream << '"';
+}
 
-	decl.append_attribute("version") = "1.0";
+template <typename T>
+static void writeXmlAttribute(std::ostream& stream, const char* name, T value)
+{
+	stream << ' ' << name << "=\"" << value << '"';
+}
 
-	pugi::xml_node houseNodes = doc.append_child("houses");
+bool IOMapOTBM::saveHouses(Map& map, std::ostream& stream)
+{
+	std::vector<const House*> houses;
+	houses.reserve(map.houses.count());
 	for(const auto& houseEntry : map.houses) {
-		const House* house = houseEntry.second;
-		pugi::xml_node houseNode = houseNodes.append_child("house");
+		houses.push_back(houseEntry.second);
+	}
+
+	// The size looks at every tile of the house, the houses are counted on the worker threads
+	std::vector<int32_t> sizes(houses.size());
+	const size_t chunk_count = std::max<size_t>(std::min(houses.size() / 64, ThreadPool::getInstance().getWorkerCount() * 8), 1);
+	ThreadPool::getInstance().parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t end = houses.size() * (chunk + 1) / chunk_count;
+		for(size_t index = houses.size() * chunk / chunk_count; index < end; ++index) {
+			sizes[index] = static_cast<int32_t>(houses[index]->size());
+		}
+	});
 
-		houseNode.append_attribute("name") = house->name.c_str();
-		houseNode.append_attribute("houseid") = house->id;
+	stream << "<?xml version=\"1.0\"?>\n<houses>\n";
+	for(size_t index = 0; index < houses.size(); ++index) {
+		const House* house = houses[index];
+		stream << "\t<house";
+		writeXmlAttribute(stream, "name", house->name);
+		writeXmlAttribute(stream, "houseid", house->id);
 
 		const Position& exitPosition = house->getExit();
-		houseNode.append_attribute("entryx") = exitPosition.x;
-		houseNode.append_attribute("entryy") = exitPosition.y;
-		houseNode.append_attribute("entryz") = exitPosition.z;
+		writeXmlAttribute(stream, "entryx", exitPosition.x);
+		writeXmlAttribute(stream, "entryy", exitPosition.y);
+		writeXmlAttribute(stream, "entryz", exitPosition.z);
 
-		houseNode.append_attribute("rent") = house->rent;
+		writeXmlAttribute(stream, "rent", house->rent);
 		if(house->guildhall) {
-			houseNode.append_attribute("guildhall") = true;
+			writeXmlAttribute(stream, "guildhall", "true");
+		}
+
+		writeXmlAttribute(stream, "townid", house->townid);
+
+		// The tiles a partial map didn't load still count
+		int32_t size = sizes[index];
+		if(map.partial) {
+			auto unloaded = map.partial->unloaded_house_sizes.find(house->id);
+			if(unloaded != map.partial->unloaded_house_sizes.end()) {
+				size += unloaded->second;
+			}
+		}
+		writeXmlAttribute(stream, "size", size);
+		stream << " />\n";
+	}
+	stream << "</houses>\n";
+	return stream.good();
+}
+
+//=============================================================================
+// Session snapshots
+
+static const char* session_identifier = "RMES";
+static const uint32_t session_version = 1;
+// Identifier, version, the three source files, the map and item versions
+static const size_t session_header_size = 4 + 4 + 3 * 16 + 4 * 4;
+
+namespace
+{
+	// The size and modification time of a file a snapshot was made from, zero while there is none
+	struct SessionSource
+	{
+		uint64_t size = 0;
+		int64_t modified = 0;
+
+		bool operator==(const SessionSource& other) const noexcept = default;
+	};
+
+	SessionSource getSessionSource(const FileName& file)
+	{
+		SessionSource source;
+		if(file.FileExists()) {
+			source.size = file.GetSize().GetValue();
+			source.modified = file.GetModificationTime().GetValue().GetValue();
+		}
+		return source;
+	}
+
+	template <typename T>
+	void appendSession(std::vector<uint8_t>& out, T value)
+	{
+		const size_t at = out.size();
+		out.resize(at + sizeof(T));
+		memcpy(&out[at], &value, sizeof(T));
+	}
+
+	void appendSession(std::vector<uint8_t>& out, const std::string& value)
+	{
+		appendSession<uint32_t>(out, value.size());
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	void appendSession(std::vector<uint8_t>& out, const Position& position)
+	{
+		appendSession<uint16_t>(out, position.x);
+		appendSession<uint16_t>(out, position.y);
+		appendSession<uint8_t>(out, position.z);
+	}
+
+	void appendSession(std::vector<uint8_t>& out, const SessionSource& source)
+	{
+		appendSession<uint64_t>(out, source.size);
+		appendSession<int64_t>(out, source.modified);
+	}
+
+	// Reads the tables of a snapshot in memory, every read is checked against its end
+	class SessionReader
+	{
+	public:
+		SessionReader(const uint8_t* data, size_t size) : in(data), end(data + size) {}
+
+		template <typename T>
+		bool take(T& value) {
+			if(static_cast<size_t>(end - in) < sizeof(T)) {
+				return false;
+			}
+			memcpy(&value, in, sizeof(T));
+			in += sizeof(T);
+			return true;
+		}
+		bool take(std::string& value) {
+			uint32_t size;
+			if(!take(size) || static_cast<size_t>(end - in) < size) {
+				return false;
+			}
+			value.assign(reinterpret_cast<const char*>(in), size);
+			in += size;
+			return true;
+		}
+		bool take(Position& position) {
+			uint16_t x, y;
+			uint8_t z;
+			if(!take(x) || !take(y) || !take(z)) {
+				return false;
+			}
+			position = Position(x, y, z);
+			return true;
+		}
+		bool take(SessionSource& source) {
+			return take(source.size) && take(source.modified);
+		}
+
+	private:
+		const uint8_t* in;
+		const uint8_t* end;
+	};
+
+	struct SessionHouse
+	{
+		uint32_t id;
+		std::string name;
+		uint32_t townid;
+		int32_t rent;
+		uint8_t guildhall;
+		Position exit;
+	};
+
+	struct SessionCreature
+	{
+		Position position;
+		std::string name;
+		uint8_t npc;
+		int32_t spawntime;
+		uint8_t direction;
+	};
+
+	// Everything but the tiles, read in full before any of it goes into the map
+	struct SessionTables
+	{
+		uint16_t width, height;
+		std::string description;
+		std::string spawnfile;
+		std::string housefile;
+		std::vector<Town> towns;
+		std::vector<Waypoint> waypoints;
+		std::vector<SessionHouse> houses;
+		std::vector<std::pair<Position, int32_t>> spawns;
+		std::vector<SessionCreature> creatures;
+		std::vector<OTBM_ZoneLeaf> zones;
+		std::vector<OTBM_TileIndexEntry> areas;
+	};
+
+	bool readSessionTables(SessionReader& reader, SessionTables& tables)
+	{
+		uint32_t count;
+		if(!reader.take(tables.width) || !reader.take(tables.height) || !reader.take(tables.description) ||
+			!reader.take(tables.spawnfile) || !reader.take(tables.housefile)) {
+			return false;
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		for(uint32_t index = 0; index < count; ++index) {
+			uint32_t id;
+			std::string name;
+			Position temple;
+			if(!reader.take(id) || !reader.take(name) || !reader.take(temple)) {
+				return false;
+			}
+			Town& town = tables.towns.emplace_back(id);
+			town.setName(name);
+			town.setTemplePosition(temple);
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		tables.waypoints.resize(count);
+		for(Waypoint& waypoint : tables.waypoints) {
+			if(!reader.take(waypoint.name) || !reader.take(waypoint.pos)) {
+				return false;
+			}
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		tables.houses.resize(count);
+		for(SessionHouse& house : tables.houses) {
+			if(!reader.take(house.id) || !reader.take(house.name) || !reader.take(house.townid) ||
+				!reader.take(house.rent) || !reader.take(house.guildhall) || !reader.take(house.exit)) {
+				return false;
+			}
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		tables.spawns.resize(count);
+		for(auto& [position, radius] : tables.spawns) {
+			if(!reader.take(position) || !reader.take(radius)) {
+				return false;
+			}
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		tables.creatures.resize(count);
+		for(SessionCreature& creature : tables.creatures) {
+			if(!reader.take(creature.position) || !reader.take(creature.name) || !reader.take(creature.npc) ||
+				!reader.take(creature.spawntime) || !reader.take(creature.direction)) {
+				return false;
+			}
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		tables.zones.resize(count);
+		for(OTBM_ZoneLeaf& leaf : tables.zones) {
+			uint16_t zone_count;
+			if(!reader.take(leaf.x) || !reader.take(leaf.y) || !reader.take(leaf.z) || !reader.take(zone_count)) {
+				return false;
+			}
+			leaf.zones.resize(zone_count);
+			for(auto& [zone_id, mask] : leaf.zones) {
+				if(!reader.take(zone_id) || !reader.take(mask)) {
+					return false;
+				}
+			}
+		}
+
+		if(!reader.take(count)) {
+			return false;
+		}
+		tables.areas.resize(count);
+		for(OTBM_TileIndexEntry& entry : tables.areas) {
+			if(!reader.take(entry.x) || !reader.take(entry.y) || !reader.take(entry.z) ||
+				!reader.take(entry.offset) || !reader.take(entry.length)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+// Decodes the tile areas [first, last) of a snapshot, straight from where it was read to
+static TileAreaBatch decodeSessionAreas(const IOMap& maphandle, const uint8_t* data, const std::vector<OTBM_TileIndexEntry>& areas, size_t first, size_t last)
+{
+	TileAreaBatch batch;
+	for(size_t index = first; index < last; ++index) {
+		const OTBM_TileIndexEntry& entry = areas[index];
+		MemoryNodeFileReadHandle handle(data + entry.offset, entry.length);
+		BinaryNode* root = handle.getRootNode();
+		BinaryNode* areaNode = root ? root->getChild() : nullptr;
+		uint8_t node_type;
+		uint16_t base_x, base_y;
+		uint8_t base_z;
+		if(!areaNode || !areaNode->getByte(node_type) || node_type != OTBM_TILE_AREA ||
+			!areaNode->getU16(base_x) || !areaNode->getU16(base_y) || !areaNode->getU8(base_z)) {
+			batch.warnings.push_back(wxString::Format("Invalid tile area at %d:%d:%d in the session snapshot", entry.x, entry.y, entry.z));
+			continue;
+		}
+		decodeTileArea(maphandle, Position(base_x, base_y, base_z), areaNode->getChild(), batch);
+	}
+	return batch;
+}
+
+bool IOMapOTBM::saveSession(Map& map, const FileName& identifier)
+{
+	const std::string path = nstr(identifier.GetFullPath()) + ".session";
+	const std::string temporary = path + ".tmp";
+	const wxString directory = identifier.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME);
+
+	std::vector<uint8_t> header;
+	header.insert(header.end(), session_identifier, session_identifier + 4);
+	appendSession<uint32_t>(header, session_version);
+	appendSession(header, getSessionSource(identifier));
+	appendSession(header, getSessionSource(FileName(directory + wxstr(map.housefile))));
+	appendSession(header, getSessionSource(FileName(directory + wxstr(map.spawnfile))));
+	appendSession<uint32_t>(header, map.mapVersion.otbm);
+	appendSession<uint32_t>(header, map.mapVersion.client);
+	appendSession<uint32_t>(header, g_items.MajorVersion);
+	appendSession<uint32_t>(header, g_items.MinorVersion);
+	ASSERT(header.size() == session_header_size);
+
+	{
+		FileWriteHandle f(temporary);
+		if(!f.isOk()) {
+			error("Can not open file %s for writing", path.c_str());
+			return false;
+		}
+		f.addRAW(header.data(), header.size());
+		uint64_t offset = header.size();
+
+		// Every tile area gets a dummy root of its own, so it can be decoded where it lies
+		const IOMapOTBM& self = *this;
+		std::vector<OTBM_TileIndexEntry> areas;
+		auto append = [&](TileSegment segment) {
+			const uint8_t* memory = segment.chunk->getMemory();
+			for(OTBM_TileIndexEntry entry : segment.index.entries) {
+				const uint8_t root[2] = { NODE_START, 0 };
+				f.addRAW(root, sizeof(root));
+				f.addRAW(memory + entry.offset, entry.length);
+				f.addU8(NODE_END);
+				entry.offset = offset;
+				entry.length += sizeof(root) + 1;
+				offset += entry.length;
+				areas.push_back(entry);
+			}
+		};
+
+		const size_t threadcount = std::max(g_settings.getInteger(Config::WORKER_THREADS), 1);
+		std::deque<std::future<TileSegment>> pending;
+		std::vector<Tile*> job;
+		auto dispatch = [&]() {
+			if(!job.empty()) {
+				pending.push_back(ThreadPool::getInstance().async([&self, job = std::move(job)]() mutable { return serializeTileJob(self, std::move(job)); }));
+				job = std::vector<Tile*>();
+			}
+			while(pending.size() >= threadcount) {
+				append(pending.front().get());
+				pending.pop_front();
+			}
+		};
+
+		std::vector<const Tile*> spawns;
+		std::vector<const Tile*> creatures;
+		saved_zones.clear();
+		for(MapIterator it = map.begin(); it != map.end(); ++it) {
+			Tile* tile = (*it)->get();
+			if(!tile || tile->size() == 0) {
+				continue;
+			}
+			if(tile->spawn) {
+				spawns.push_back(tile);
+			}
+			if(tile->creature) {
+				creatures.push_back(tile);
+			}
+			if(tile->getMapFlags() & TILESTATE_ZONE_BRUSH) {
+				collectZones(tile);
+			}
+
+			job.push_back(tile);
+			if(job.size() >= 4096) {
+				dispatch();
+			}
+		}
+		dispatch();
+		while(!pending.empty()) {
+			append(pending.front().get());
+			pending.pop_front();
+		}
+
+		std::vector<uint8_t> tables;
+		appendSession<uint16_t>(tables, map.width);
+		appendSession<uint16_t>(tables, map.height);
+		appendSession(tables, map.description);
+		appendSession(tables, map.spawnfile);
+		appendSession(tables, map.housefile);
+
+		appendSession<uint32_t>(tables, map.towns.count());
+		for(const auto& townEntry : map.towns) {
+			const Town* town = townEntry.second;
+			appendSession<uint32_t>(tables, town->getID());
+			appendSession(tables, town->getName());
+			appendSession(tables, town->getTemplePosition());
+		}
+
+		appendSession<uint32_t>(tables, map.waypoints.waypoints.size());
+		for(const auto& waypointEntry : map.waypoints) {
+			appendSession(tables, waypointEntry.second->name);
+			appendSession(tables, waypointEntry.second->pos);
+		}
+
+		appendSession<uint32_t>(tables, map.houses.count());
+		for(const auto& houseEntry : map.houses) {
+			const House* house = houseEntry.second;
+			appendSession<uint32_t>(tables, house->id);
+			appendSession(tables, house->name);
+			appendSession<uint32_t>(tables, house->townid);
+			appendSession<int32_t>(tables, house->rent);
+			appendSession<uint8_t>(tables, house->guildhall);
+			appendSession(tables, house->getExit());
+		}
+
+		appendSession<uint32_t>(tables, spawns.size());
+		for(const Tile* tile : spawns) {
+			appendSession(tables, tile->getPosition());
+			appendSession<int32_t>(tables, tile->spawn->getSize());
+		}
+
+		appendSession<uint32_t>(tables, creatures.size());
+		for(const Tile* tile : creatures) {
+			appendSession(tables, tile->getPosition());
+			appendSession(tables, tile->creature->getName());
+			appendSession<uint8_t>(tables, tile->creature->isNpc());
+			appendSession<int32_t>(tables, tile->creature->getSpawnTime());
+			appendSession<uint8_t>(tables, tile->creature->getDirection());
+		}
+
+		appendSession<uint32_t>(tables, saved_zones.size());
+		for(const OTBM_ZoneLeaf& leaf : saved_zones) {
+			appendSession<uint16_t>(tables, leaf.x);
+			appendSession<uint16_t>(tables, leaf.y);
+			appendSession<uint8_t>(tables, leaf.z);
+			appendSession<uint16_t>(tables, leaf.zones.size());
+			for(const auto& [zone_id, mask] : leaf.zones) {
+				appendSession<uint16_t>(tables, zone_id);
+				appendSession<uint16_t>(tables, mask);
+			}
+		}
+
+		appendSession<uint32_t>(tables, areas.size());
+		for(const OTBM_TileIndexEntry& entry : areas) {
+			appendSession<uint16_t>(tables, entry.x);
+			appendSession<uint16_t>(tables, entry.y);
+			appendSession<uint8_t>(tables, entry.z);
+			appendSession<uint64_t>(tables, entry.offset);
+			appendSession<uint64_t>(tables, entry.length);
+		}
+
+		// The tables are found through the last eight bytes
+		f.addRAW(tables.data(), tables.size());
+		f.addU64(offset);
+		if(!f.isOk()) {
+			f.close();
+			std::remove(temporary.c_str());
+			error("Could not write the session snapshot %s", path.c_str());
+			return false;
+		}
+	}
+	return wxRenameFile(wxstr(temporary), wxstr(path), true);
+}
+
+bool IOMapOTBM::loadSession(Map& map, const FileName& identifier)
+{
+	FileReadHandle f(nstr(identifier.GetFullPath()) + ".session");
+	if(!f.isOk() || f.size() < session_header_size + sizeof(uint64_t)) {
+		return false;
+	}
+
+	// The header alone tells whether the snapshot is still what the map file holds
+	std::vector<uint8_t> data(f.size());
+	if(!f.getRAW(data.data(), session_header_size)) {
+		return false;
+	}
+
+	SessionReader header(data.data(), session_header_size);
+	std::string magic(4, '\0');
+	uint32_t file_version, otbm, client, items_major, items_minor;
+	SessionSource map_source, house_source, spawn_source;
+	header.take(magic[0]);
+	header.take(magic[1]);
+	header.take(magic[2]);
+	header.take(magic[3]);
+	header.take(file_version);
+	header.take(map_source);
+	header.take(house_source);
+	header.take(spawn_source);
+	header.take(otbm);
+	header.take(client);
+	header.take(items_major);
+	if(!header.take(items_minor) || magic != session_identifier || file_version != session_version ||
+		!(map_source == getSessionSource(identifier)) || items_major != g_items.MajorVersion || items_minor != g_items.MinorVersion) {
+		return false;
+	}
+
+	IOTelemetry::Scope scope(telemetry, IOTelemetry::HEADER);
+	if(!f.getRAW(data.data() + session_header_size, data.size() - session_header_size)) {
+		return false;
+	}
+	telemetry[IOTelemetry::HEADER].bytes += data.size();
+
+	uint64_t tables_offset;
+	memcpy(&tables_offset, data.data() + data.size() - sizeof(tables_offset), sizeof(tables_offset));
+	if(tables_offset < session_header_size || tables_offset > data.size() - sizeof(tables_offset)) {
+		return false;
+	}
+
+	SessionTables tables;
+	SessionReader reader(data.data() + tables_offset, data.size() - sizeof(tables_offset) - tables_offset);
+	if(!readSessionTables(reader, tables)) {
+		return false;
+	}
+	for(const OTBM_TileIndexEntry& entry : tables.areas) {
+		if(entry.offset < session_header_size || entry.length > tables_offset || entry.offset > tables_offset - entry.length) {
+			return false;
+		}
+	}
+
+	// The house and spawn files can be changed by hand
+	const wxString directory = identifier.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME);
+	if(!(house_source == getSessionSource(FileName(directory + wxstr(tables.housefile)))) ||
+		!(spawn_source == getSessionSource(FileName(directory + wxstr(tables.spawnfile))))) {
+		return false;
+	}
+
+	version.otbm = static_cast<MapVersionID>(otbm);
+	version.client = static_cast<ClientVersionID>(client);
+	map.width = tables.width;
+	map.height = tables.height;
+	map.description = tables.description;
+	map.spawnfile = tables.spawnfile;
+	map.housefile = tables.housefile;
+	scope.setPhase(IOTelemetry::TOWNS);
+	for(const Town& town : tables.towns) {
+		Town* copy = newd Town(town);
+		if(!map.towns.addTown(copy)) {
+			delete copy;
+		}
+	}
+
+	// Groups of about 4MB of areas are decoded on the worker threads, and merged in file order
+	scope.setPhase(IOTelemetry::TILE_AREAS);
+	IOTelemetry::Counters& counters = telemetry[IOTelemetry::TILE_AREAS];
+	const IOMapOTBM& self = *this;
+	const uint8_t* memory = data.data();
+	std::deque<std::future<TileAreaBatch>> pending;
+	for(size_t first = 0; first < tables.areas.size();) {
+		size_t last = first;
+		uint64_t bytes = 0;
+		while(last < tables.areas.size() && (last == first || bytes < 4 * 1024 * 1024)) {
+			bytes += tables.areas[last++].length;
+		}
+		counters.bytes += bytes;
+		pending.push_back(ThreadPool::getInstance().async([&self, memory, &tables, first, last]() {
+			return decodeSessionAreas(self, memory, tables.areas, first, last);
+		}));
+		first = last;
+	}
+	const size_t jobs = pending.size();
+	while(!pending.empty()) {
+		mergeTileArea(map, warnings, counters, pending.front().get());
+		pending.pop_front();
+		g_gui.SetLoadDone(static_cast<int32_t>(100.0 * (jobs - pending.size()) / jobs));
+	}
+
+	scope.setPhase(IOTelemetry::WAYPOINTS);
+	for(const Waypoint& waypoint : tables.waypoints) {
+		map.waypoints.addWaypoint(newd Waypoint(waypoint));
+	}
+
+	scope.setPhase(IOTelemetry::HOUSES);
+	for(const SessionHouse& record : tables.houses) {
+		House* house = map.houses.getHouse(record.id);
+		if(!house) {
+			house = newd House(map);
+			house->id = record.id;
+			map.houses.addHouse(house);
+		}
+		house->name = record.name;
+		house->townid = record.townid;
+		house->rent = record.rent;
+		house->guildhall = record.guildhall != 0;
+		if(record.exit.x != 0 && record.exit.y != 0 && record.exit.z != 0) {
+			house->setExit(record.exit);
+		}
+	}
+
+	scope.setPhase(IOTelemetry::SPAWNS);
+	for(const auto& [position, radius] : tables.spawns) {
+		Tile* tile = map.getTile(position);
+		if(!tile) {
+			tile = map.allocator(map.createTileL(position));
+			map.setTile(position, tile);
+		}
+		if(!tile->spawn) {
+			tile->spawn = newd Spawn(radius);
+			map.addSpawn(tile);
+		}
+	}
+	for(const SessionCreature& record : tables.creatures) {
+		Tile* tile = map.getTile(record.position);
+		if(!tile || tile->creature) {
+			continue;
+		}
+
+		CreatureType* type = g_creatures[record.name];
+		if(!type) {
+			type = g_creatures.addMissingCreatureType(record.name, record.npc != 0);
 		}
+		Creature* creature = newd Creature(type);
+		creature->setDirection(static_cast<Direction>(record.direction));
+		creature->setSpawnTime(record.spawntime);
+		tile->creature = creature;
+		map.spawns.addCreature(record.position);
+	}
 
-		houseNode.append_attribute("townid") = house->townid;
-		houseNode.append_attribute("size") = static_cast<int32_t>(house->size());
+	scope.setPhase(IOTelemetry::ZONES);
+	for(const OTBM_ZoneLeaf& record : tables.zones) {
+		QTreeNode* leaf = map.getLeaf(record.x, record.y);
+		Floor* floor = leaf && record.z <= rme::MapMaxLayer ? leaf->getFloor(record.z) : nullptr;
+		if(!floor) {
+			continue;
+		}
+		for(const auto& [zone_id, mask] : record.zones) {
+			for(int index = 0; index < 16; ++index) {
+				Tile* tile = (mask & (1 << index)) ? floor->locs[index].get() : nullptr;
+				if(tile) {
+					tile->addZoneId(zone_id);
+				}
+			}
+		}
 	}
+
+	map.clearDirtyAreas();
 	return true;
 }
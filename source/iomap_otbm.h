@@ -20,6 +20,8 @@
 
 #include <toml++/toml.hpp>
 
+#include <functional>
+
 #include "iomap.h"
 
 // Pragma pack is VERY important since otherwise it won't be able to load the structs correctly
@@ -118,33 +120,193 @@ struct OTBM_HouseTile_coords
 
 #pragma pack()
 
+// Location of one OTBM_TILE_AREA node in a saved map, the tile index (.otbm.idx) stores one per node.
+// The editor writes the nodes of a 256x256 area next to each other, floor by floor.
+struct OTBM_TileIndexEntry
+{
+	uint16_t x, y; // The base of the node
+	uint8_t z;
+	uint64_t offset;
+	uint64_t length;
+
+	// As BaseMap::getAreaIndex
+	uint32_t getArea() const noexcept { return (y & 0xFF00) | (x >> 8); }
+};
+
+// The zones of one leaf floor in the zone file (.otbm.zones)
+struct OTBM_ZoneLeaf
+{
+	uint16_t x;
+	uint16_t y;
+	uint8_t z;
+	std::vector<std::pair<uint16_t, uint16_t>> zones; // id, tile mask
+};
+
+// What is left out when only an area of a map is opened, so saving can write it back. The tiles
+// stay in the OTBM and are spliced in from it, the rest outside the area is kept here as it was read.
+struct OTBM_PartialMap
+{
+	MapArea area;
+	// Spawns with a creature outside the loaded tile areas, as whole <spawn> nodes
+	pugi::xml_document spawns;
+	std::vector<OTBM_ZoneLeaf> zones;
+	// The size the house file gives a house, less that of its loaded tiles
+	std::map<uint32_t, int32_t> unloaded_house_sizes;
+
+	// A paged map covers the whole map, its areas are read from source through the index when needed
+	bool paged = false;
+	FileName source;
+	std::map<uint32_t, std::vector<OTBM_TileIndexEntry>> index;
+	// The estimated memory of the areas read so far that are still in memory
+	std::map<uint32_t, size_t> resident;
+	size_t resident_bytes = 0;
+};
+
+// What can be told about a map file without loading it, see IOMapOTBM::probeMap
+struct OTBM_MapProbe
+{
+	MapVersion version;
+	uint64_t file_size = 0;
+	// The rest is kept in the tile index by the last save of the editor, it isn't known
+	// for maps saved elsewhere, compressed or changed since
+	bool has_summary = false;
+	uint64_t tile_count = 0;
+	uint16_t min_x = 0, min_y = 0, max_x = 0, max_y = 0; // Of every floor together
+	// Minimap colours of the ground floor, row by row, scaled down to fit 64x64
+	uint16_t thumbnail_width = 0, thumbnail_height = 0;
+	std::vector<uint8_t> thumbnail;
+};
+
+class TileAreaDecoder;
+
 class IOMapOTBM : public IOMap
 {
 public:
 	IOMapOTBM(MapVersion ver) { version = ver; }
 	~IOMapOTBM() {}
 
-	void saveZonesToToml(const std::map<uint16_t, std::vector<Position>>& zoneMap, const wxFileName& dir, Map& map);
-
 	static bool getVersionInfo(const FileName& identifier, MapVersion& out_ver);
+	// Reads the versions and the summary in the tile index, without touching the tiles. Doesn't
+	// use any global state, so it can run on any thread.
+	static bool probeMap(const FileName& identifier, OTBM_MapProbe& probe);
 
 	virtual bool loadMap(Map& map, const FileName& identifier);
 	virtual bool saveMap(Map& map, const FileName& identifier);
+	// Writes only the map file, plain or compressed by the extension, without the spawns,
+	// houses and zones and without marking the map as saved
+	bool exportMap(Map& map, const FileName& identifier);
+	// Maps named .otbz are saved compressed, reading tells them apart by their identifier
+	static bool isCompressedMapName(const FileName& identifier);
+	// Makes the saves write the map for a server to load rather than for the editor, still as
+	// standard OTBM: one tile area node per 256x256 area and floor, the areas and the tiles within
+	// them in rows, the items inlined in their tile wherever they have nothing but an id, and without
+	// the meta items and zone flags. The tile index is only written along with_index.
+	void setServerProfile(bool enable, bool with_index = false) { server_profile = enable; server_index = with_index; }
+
+	// The file the map was last loaded from or saved to, areas that haven't been changed
+	// since are copied from it instead of being serialized again.
+	void setIncrementalSource(const FileName& previous) { incremental_source = previous; }
+	// The file a partial map was loaded from or last saved to, the tiles it didn't load are copied from it
+	void setPartialSource(const FileName& source) { partial_source = source; }
+
+	// Writes a map that is built one part at a time, so it never has to be in memory as a whole.
+	// map gives the header, towns, houses and waypoints, every part adds its tiles and spawns and can
+	// be freed afterwards. Parts must not overlap.
+	bool beginStream(Map& map, const FileName& identifier);
+	void streamPart(Map& part);
+	bool finishStream(Map& map, const FileName& identifier);
+
+	// Reads a map to be merged into another one without loading it as a whole. beginImport reads
+	// the header, towns, waypoints and houses into map, leaving its tiles empty. importTiles then
+	// decodes the tile areas overlapping area a group at a time and hands the tiles inside it to
+	// sink, which takes them over, the other areas are skipped without being decoded. finishImport
+	// adds the spawns inside area to target, moved by offset, once the tiles are in place.
+	struct ImportedTile
+	{
+		Position position;
+		Tile* tile; // Without a location yet
+	};
+	using ImportSink = std::function<void(std::vector<ImportedTile>& tiles)>;
+	bool beginImport(Map& map, const FileName& identifier);
+	bool importTiles(const MapArea& area, const ImportSink& sink);
+	bool finishImport(Map& target, const Position& offset, const MapArea& area);
+
+	// Reads a paged out area of a paged map back in, with the spawns and zones that are on it
+	bool loadPagedArea(Map& map, uint32_t area);
+
+	// A session snapshot (.otbm.session) holds a whole map as it was loaded or saved in one file:
+	// the tile areas as they are encoded in the OTBM, each readable where it lies, and binary tables
+	// for the towns, waypoints, houses, spawns and zones. Loading reads it in one go and decodes the
+	// areas in parallel without parsing the map, house, spawn and zone files. loadSession leaves the
+	// map alone and returns false unless the files it was made from are unchanged.
+	bool saveSession(Map& map, const FileName& identifier);
+	bool loadSession(Map& map, const FileName& identifier);
+	// Whether the last loadMap was served by the session snapshot
+	bool isSessionLoaded() const noexcept { return session_loaded; }
 
 protected:
 	static bool getVersionInfo(NodeFileReadHandle* f,  MapVersion& out_ver);
 
 	virtual bool loadMap(Map& map, NodeFileReadHandle& handle);
+	// Returns the map data node, its children being the tile areas, towns and waypoints
+	BinaryNode* loadMapHeader(Map& map, NodeFileReadHandle& handle);
+	bool loadMapNodes(Map& map, NodeFileReadHandle& handle, BinaryNode* mapHeaderNode);
+	// Partial maps only read the tile areas overlapping their area
+	bool loadMapArea(Map& map, NodeFileReadHandle& handle, const FileName& identifier);
+	// Seeks to the tile areas through the index in previous_areas, false if it can't be used
+	bool loadIndexedMapNodes(Map& map);
+	// Reads the nodes of previous_areas that overlap area, for the loads that can seek
+	void decodeIndexedTileAreas(FileReadHandle& file, const std::vector<OTBM_TileIndexEntry>& nodes, const MapArea& area, TileAreaDecoder& decoder, IOTelemetry::Counters& counters);
+	void loadTowns(Map& map, BinaryNode* node);
+	void loadWaypoints(Map& map, BinaryNode* node);
 	bool loadSpawns(Map& map, const FileName& dir);
-	bool loadSpawns(Map& map, pugi::xml_document& doc);
-	bool loadHouses(Map& map, const FileName& dir);
-	bool loadHouses(Map& map, pugi::xml_document& doc);
+	// With an area the spawns are imported, see finishImport
+	bool loadSpawns(Map& map, pugi::xml_document& doc, const Position& offset = Position(), const MapArea* area = nullptr);
+	// create makes the houses that have no tiles on the map yet instead of stopping at them
+	bool loadHouses(Map& map, const FileName& dir, bool create = false);
+	bool loadHouses(Map& map, pugi::xml_document& doc, bool create = false);
 
 	virtual bool saveMap(Map& map, NodeFileWriteHandle& handle);
+	// The tile areas of the server profile
+	bool saveServerTileAreas(Map& map, NodeFileWriteHandle& handle);
+	bool saveMapFile(Map& map, const FileName& identifier, bool compressed);
+	// Opens the root and map data nodes, the footer writes the towns and waypoints and closes them
+	void saveMapHeader(Map& map, NodeFileWriteHandle& handle);
+	void saveMapFooter(Map& map, NodeFileWriteHandle& handle);
 	bool saveSpawns(Map& map, const FileName& dir);
 	bool saveSpawns(Map& map, pugi::xml_document& doc);
+	void addSpawns(Map& map, pugi::xml_node spawnNodes);
 	bool saveHouses(Map& map, const FileName& dir);
-	bool saveHouses(Map& map, pugi::xml_document& doc);
+	bool saveHouses(Map& map, std::ostream& stream);
+	// Reads identifier.idx, which has to describe source
+	bool loadTileIndex(const FileName& identifier, const FileName& source);
+	// The summary of map is written with it, streamed maps pass none
+	bool saveTileIndex(const FileName& identifier, const Map* map);
+	// Zones are kept next to the map (.otbm.zones), a tile mask per zone for every leaf floor.
+	// The <map>-zones folder of TOML files is read when there is none, and written as an export.
+	bool loadZones(Map& map, const FileName& identifier);
+	bool saveZones(const FileName& identifier);
+	void saveZonesToToml(const FileName& dir, Map& map);
+	void collectZones(const Tile* tile);
+
+	FileName incremental_source;
+	FileName partial_source;
+	std::unique_ptr<FileReadHandle> previous_file;
+	// The nodes of every area in previous_file, in file order
+	std::map<uint32_t, std::vector<OTBM_TileIndexEntry>> previous_areas;
+	std::vector<OTBM_TileIndexEntry> saved_areas;
+
+	// The zones of the tiles written by the last save, in map order
+	std::vector<OTBM_ZoneLeaf> saved_zones;
+
+	std::unique_ptr<DiskNodeFileWriteHandle> stream;
+	pugi::xml_document stream_spawns;
+
+	FileName import_source;
+	std::string import_spawnfile;
+	bool session_loaded = false;
+	bool server_profile = false;
+	bool server_index = false;
 	//void saveZonesToToml(const toml::table& zonesToml, const wxFileName& dir);
 };
 
@@ -88,31 +88,55 @@ bool IOMinimap::saveOtmm(const wxFileName& file)
 		writer.addU16(start);
 		writer.seek(start);
 
-		unsigned long blockSize = MMBLOCK_SIZE * MMBLOCK_SIZE * sizeof(MinimapTile);
-		std::vector<uint8_t> buffer(compressBound(blockSize));
-		constexpr int COMPRESS_LEVEL = 3;
-
 		readBlocks();
 
+		struct OtmmBlock {
+			uint32_t index;
+			uint8_t z;
+			const MinimapBlock* block;
+			std::vector<uint8_t> data;
+		};
+
+		std::vector<OtmmBlock> blocks;
 		for(uint8_t z = 0; z <= rme::MapMaxLayer; ++z) {
-			for(auto& it : m_blocks[z]) {
-				int index = it.first;
-				auto& block = it.second;
-
-				// write index pos
-				uint16_t x = static_cast<uint16_t>((index % (65536 / MMBLOCK_SIZE)) * MMBLOCK_SIZE);
-				uint16_t y = static_cast<uint16_t>((index / (65536 / MMBLOCK_SIZE)) * MMBLOCK_SIZE);
-				writer.addU16(x);
-				writer.addU16(y);
-				writer.addU8(z);
-
-				unsigned long len = blockSize;
-				int ret = compress2(buffer.data(), &len, (uint8_t*)&block.getTiles(), blockSize, COMPRESS_LEVEL);
+			for(const auto& it : m_blocks[z]) {
+				blocks.push_back(OtmmBlock { it.first, z, &it.second, {} });
+			}
+		}
+
+		// Blocks are compressed on the pool, and written one after another in the same order
+		const unsigned long blockSize = MMBLOCK_SIZE * MMBLOCK_SIZE * sizeof(MinimapTile);
+		constexpr int COMPRESS_LEVEL = 3;
+
+		ThreadPool& pool = ThreadPool::getInstance();
+		const size_t chunk_count = std::max<size_t>(std::min(blocks.size() / 16, pool.getWorkerCount() * 8), 1);
+		pool.parallelFor(chunk_count, [&](size_t chunk) {
+			const size_t end = blocks.size() * (chunk + 1) / chunk_count;
+			for(size_t i = blocks.size() * chunk / chunk_count; i < end; ++i) {
+				OtmmBlock& block = blocks[i];
+				unsigned long len = compressBound(blockSize);
+				block.data.resize(len);
+				int ret = compress2(block.data.data(), &len, (const uint8_t*)&block.block->getTiles(), blockSize, COMPRESS_LEVEL);
 				assert(ret == Z_OK);
-				writer.addU16(len);
-				writer.addRAW(buffer.data(), len);
+				block.data.resize(len);
 			}
-			m_blocks[z].clear();
+		});
+
+		for(const OtmmBlock& block : blocks) {
+			// write index pos
+			uint16_t x = static_cast<uint16_t>((block.index % (65536 / MMBLOCK_SIZE)) * MMBLOCK_SIZE);
+			uint16_t y = static_cast<uint16_t>((block.index / (65536 / MMBLOCK_SIZE)) * MMBLOCK_SIZE);
+			writer.addU16(x);
+			writer.addU16(y);
+			writer.addU8(block.z);
+
+			writer.addU16(block.data.size());
+			writer.addRAW(block.data.data(), block.data.size());
+		}
+
+		blocks.clear();
+		for(auto& floor : m_blocks) {
+			floor.clear();
 		}
 
 		// end of file is an invalid pos
@@ -130,6 +154,153 @@ bool IOMinimap::saveOtmm(const wxFileName& file)
 	return true;
 }
 
+bool IOMinimap::loadOtmm(const wxFileName& file, const Position& offset)
+{
+	m_importedTiles = 0;
+	m_skippedBlocks = 0;
+
+	MemoryReadHandle reader(file.GetFullPath().ToStdString());
+	if(!reader.isOk()) {
+		m_error = "failed to read OTMM minimap: " + reader.getErrorMessage();
+		return false;
+	}
+
+	uint32_t signature, flags;
+	uint16_t start, version;
+	reader.getU32(signature);
+	reader.getU16(start);
+	reader.getU16(version);
+	if(!reader.getU32(flags) || signature != OTMM_SIGNATURE || version != OTMM_VERSION || start < reader.tell()) {
+		m_error = "not an OTMM minimap";
+		return false;
+	}
+	reader.skip(start - reader.tell());
+
+	struct OtmmBlock {
+		uint16_t x;
+		uint16_t y;
+		uint8_t z;
+		uint16_t size;
+		size_t offset;
+	};
+
+	// The blocks stay where they are in the file, only their headers are read up front
+	std::vector<OtmmBlock> blocks;
+	while(true) {
+		OtmmBlock block;
+		reader.getU16(block.x);
+		reader.getU16(block.y);
+		if(!reader.getU8(block.z) || (block.x == 65535 && block.y == 65535 && block.z == 255)) {
+			break;
+		}
+		reader.getU16(block.size);
+		block.offset = reader.tell();
+		if(!reader.skip(block.size)) {
+			break;
+		}
+		if(block.z <= rme::MapMaxLayer && block.x % MMBLOCK_SIZE == 0 && block.y % MMBLOCK_SIZE == 0) {
+			blocks.push_back(block);
+		}
+	}
+	if(!reader.isOk()) {
+		m_error = "the OTMM minimap is truncated";
+		return false;
+	}
+
+	// A ground of every colour, and something blocking for the squares that can't be walked on
+	uint16_t walkable[256] = {};
+	uint16_t blocking[256] = {};
+	for(int id = 0; id <= g_items.getMaxID(); ++id) {
+		const ItemType& type = g_items.getItemType(id);
+		const uint8_t color = type.minimap_color;
+		if(type.id == 0 || color == 0) {
+			continue;
+		}
+		if(type.isGroundTile() && !type.unpassable && !walkable[color]) {
+			walkable[color] = type.id;
+		} else if(type.unpassable && (type.isGroundTile() || type.isWall) && !blocking[color]) {
+			blocking[color] = type.id;
+		}
+	}
+	for(int color = 0; color < 256; ++color) {
+		if(!walkable[color]) {
+			walkable[color] = blocking[color];
+		} else if(!blocking[color]) {
+			blocking[color] = walkable[color];
+		}
+	}
+
+	struct ImportedSquare {
+		Position position;
+		uint16_t id;
+	};
+
+	constexpr unsigned long blockSize = MMBLOCK_SIZE * MMBLOCK_SIZE * sizeof(MinimapTile);
+	auto& map = m_editor->getMap();
+	const uint8_t* data = reader.getData();
+
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t group_size = std::max<size_t>(pool.getWorkerCount() * 16, 1);
+	std::vector<std::vector<ImportedSquare>> decoded(std::min(group_size, blocks.size()));
+	std::atomic<size_t> skipped(0);
+	PositionVector positions;
+	for(size_t first = 0; first < blocks.size(); first += group_size) {
+		const size_t count = std::min(group_size, blocks.size() - first);
+		pool.parallelFor(count, [&](size_t i) {
+			const OtmmBlock& block = blocks[first + i];
+			std::vector<ImportedSquare>& squares = decoded[i];
+			squares.clear();
+
+			std::array<MinimapTile, MMBLOCK_SIZE * MMBLOCK_SIZE> tiles;
+			unsigned long len = blockSize;
+			if(uncompress(reinterpret_cast<uint8_t*>(tiles.data()), &len, data + block.offset, block.size) != Z_OK || len != blockSize) {
+				++skipped;
+				return;
+			}
+
+			for(size_t index = 0; index < tiles.size(); ++index) {
+				const MinimapTile& tile = tiles[index];
+				if(!(tile.flags & MinimapTileWasSeen) || tile.color == INVALID_MINIMAP_COLOR) {
+					continue;
+				}
+				const uint16_t id = (tile.flags & MinimapTileNotWalkable) ? blocking[tile.color] : walkable[tile.color];
+				const Position position(block.x + int(index % MMBLOCK_SIZE) + offset.x, block.y + int(index / MMBLOCK_SIZE) + offset.y, block.z + offset.z);
+				if(id && position.isValid()) {
+					squares.push_back(ImportedSquare { position, id });
+				}
+			}
+		});
+
+		// The tree is descended once per leaf of a block, the tiles that are there already are kept
+		for(size_t i = 0; i < count; ++i) {
+			const std::vector<ImportedSquare>& squares = decoded[i];
+			positions.clear();
+			for(const ImportedSquare& square : squares) {
+				positions.push_back(square.position);
+			}
+
+			std::vector<TileLocation*> locations = map.createTileLocations(positions);
+			for(size_t index = 0; index < squares.size(); ++index) {
+				if(locations[index]->get()) {
+					continue;
+				}
+				Tile* tile = map.allocator(locations[index]);
+				tile->addItem(Item::Create(squares[index].id));
+				tile->update();
+				map.setTile(squares[index].position, tile);
+				++m_importedTiles;
+			}
+		}
+
+		if(m_updateLoadbar) {
+			g_gui.SetLoadDone(static_cast<int32_t>((first + count) * 100 / blocks.size()));
+		}
+	}
+
+	m_skippedBlocks = skipped;
+	return true;
+}
+
 bool IOMinimap::saveImage(const std::string& directory, const std::string& name)
 {
 	try
@@ -163,91 +334,78 @@ bool IOMinimap::exportMinimap(const std::string& directory)
 		return true;
 	}
 
-	wxRect bounds[rme::MapLayers];
 	int min_z = m_floor == -1 ? 0 : m_floor;
 	int max_z = m_floor == -1 ? rme::MapMaxLayer : m_floor;
 
-	for (size_t z = min_z; z <= max_z; z++) {
-		auto& rect = bounds[z];
-		rect.x = rme::MapMaxWidth + 1;
-		rect.y = rme::MapMaxHeight + 1;
-		rect.width = 0;
-		rect.height = 0;
-	}
-
-	for(auto it = map.begin(); it != map.end(); ++it) {
-		auto tile = (*it)->get();
-		if(!tile || (!tile->ground && tile->items.empty())) {
-			continue;
-		}
-
-		const auto& position = tile->getPosition();
-		auto& rect = bounds[position.z];
-		if(position.x < rect.x) {
-			rect.x = position.x;
-		}
-		if(position.y < rect.y) {
-			rect.y = position.y;
-		}
-		if (position.x > rect.width) {
-			rect.width = position.x;
-		}
-		if (position.y > rect.height) {
-			rect.height = position.y;
-		}
-	}
-
 	constexpr int image_size = 1024;
 	constexpr int pixels_size = image_size * image_size * rme::PixelFormatRGB;
-	uint8_t* pixels = new uint8_t[pixels_size];
-	auto image = new wxImage(image_size, image_size, pixels, true);
 
-	for(size_t z = min_z; z <= max_z; z++) {
-		auto& rect = bounds[z];
-		if(rect.IsEmpty()) {
+	struct ImageArea {
+		int x;
+		int y;
+		int z;
+	};
+
+	std::vector<ImageArea> images;
+	for(int z = min_z; z <= max_z; z++) {
+		// The map keeps the area its tiles span, an image is made wherever it overlaps it
+		const auto& bounds = map.getFloorBounds(z);
+		if(bounds.empty()) {
 			continue;
 		}
 
 		for (int h = 0; h < rme::MapMaxHeight; h += image_size) {
 			for (int w = 0; w < rme::MapMaxWidth; w += image_size) {
-				if (w < rect.x || w > rect.width || h < rect.y || h > rect.height) {
+				if (w + image_size <= bounds.min_x || w > bounds.max_x || h + image_size <= bounds.min_y || h > bounds.max_y) {
 					continue;
 				}
+				images.push_back(ImageArea { w, h, z });
+			}
+		}
+	}
 
-				bool empty = true;
-				memset(pixels, 0, pixels_size);
+	// Every image is filled from the leaves it covers and encoded on its own task,
+	// the map is only read meanwhile
+	const wxString extension = m_format == MinimapExportFormat::Png ? "png" : "bmp";
+	const wxBitmapType type = m_format == MinimapExportFormat::Png ? wxBITMAP_TYPE_PNG : wxBITMAP_TYPE_BMP;
+	std::atomic<size_t> images_done(0);
+	ThreadPool::getInstance().parallelFor(images.size(), [&](size_t i) {
+		const ImageArea& area = images[i];
+		std::vector<uint8_t> pixels(pixels_size, 0);
+		bool empty = true;
 
-				int index = 0;
-				for (int y = 0; y < image_size; y++) {
-					for (int x = 0; x < image_size; x++) {
-						auto tile = map.getTile(w + x, h + y, z);
-						if(!tile || (!tile->ground && tile->items.empty())) {
-							index += rme::PixelFormatRGB;
-							continue;
-						}
-						uint8_t color = tile->getMiniMapColor();
-						pixels[index  ] = (uint8_t)(static_cast<int>(color / 36) % 6 * 51); // red
-						pixels[index+1] = (uint8_t)(static_cast<int>(color / 6) % 6 * 51);  // green
-						pixels[index+2] = (uint8_t)(color % 6 * 51);                        // blue
-						index += rme::PixelFormatRGB;
-						empty = false;
-					}
+		map.visitFloors(area.x, area.y, area.x + image_size - 1, area.y + image_size - 1, area.z, area.z, [&](Floor* floor, int nd_x, int nd_y, int) {
+			for(int index = 0; index < 16; ++index) {
+				auto tile = floor->locs[index].get();
+				if(!tile || (!tile->ground && tile->items.empty())) {
+					continue;
 				}
 
-				if (!empty) {
-					image->SetData(pixels, true);
-					wxString extension = m_format == MinimapExportFormat::Png ? "png" : "bmp";
-					wxBitmapType type = m_format == MinimapExportFormat::Png ? wxBITMAP_TYPE_PNG : wxBITMAP_TYPE_BMP; 
-					wxFileName file = wxString::Format("%d-%d-%d.%s", h, w, z, extension);
-					file.Normalize(wxPATH_NORM_ALL, directory);
-					image->SaveFile(file.GetFullPath(), type);
-				}
+				const int x = nd_x + (index >> 2) - area.x;
+				const int y = nd_y + (index & 3) - area.y;
+				uint8_t color = tile->getMiniMapColor();
+				uint8_t* pixel = &pixels[(y * image_size + x) * rme::PixelFormatRGB];
+				pixel[0] = (uint8_t)(static_cast<int>(color / 36) % 6 * 51); // red
+				pixel[1] = (uint8_t)(static_cast<int>(color / 6) % 6 * 51);  // green
+				pixel[2] = (uint8_t)(color % 6 * 51);                        // blue
+				empty = false;
 			}
+		});
+
+		if (!empty) {
+			wxImage image(image_size, image_size, pixels.data(), true);
+			wxFileName file = wxString::Format("%d-%d-%d.%s", area.y, area.x, area.z, extension);
+			file.Normalize(wxPATH_NORM_ALL, directory);
+			image.SaveFile(file.GetFullPath(), type);
 		}
-	}
+		++images_done;
+	}, [&]() {
+		if(m_updateLoadbar) {
+			g_gui.SetLoadDone(int(images_done * 100 / std::max<size_t>(images.size(), 1)));
+		}
+		return true;
+	});
 
-	image->Destroy();
-	delete[] pixels;
 	return true;
 }
 
@@ -259,9 +417,8 @@ bool IOMinimap::exportSelection(const std::string& directory, const std::string&
 	int max_x = 0, max_y = 0, max_z = 0;
 
 	const auto& selection = m_editor->getSelection();
-	const auto& tiles = selection.getTiles();
 
-	for(auto tile : tiles) {
+	for(auto tile : selection) {
 		if(!tile || (!tile->ground && tile->items.empty())) {
 			continue;
 		}
@@ -356,51 +513,110 @@ void IOMinimap::readBlocks()
 
 	auto& map = m_editor->getMap();
 
-	int tiles_iterated = 0;
-	for(auto it = map.begin(); it != map.end(); ++it) {
-		auto tile = (*it)->get();
+	int min_z = rme::MapMinLayer, max_z = rme::MapMaxLayer;
+	if (m_mode != MinimapExportMode::SelectedArea && m_floor != -1) {
+		min_z = max_z = m_floor;
+	}
 
-		if (m_updateLoadbar) {
-			++tiles_iterated;
-			if (tiles_iterated % 8192 == 0) {
-				g_gui.SetLoadDone(int(tiles_iterated / double(map.size()) * 90.0));
-			}
+	// A leaf is 4x4 tiles, it always lies in a single block, and the leaves of a block are
+	// visited one after another
+	static_assert(MMBLOCK_SIZE % 4 == 0, "minimap blocks have to hold whole leaves");
+
+	struct Leaf {
+		QTreeNode* node;
+		int x;
+		int y;
+	};
+
+	struct BlockLeaves {
+		uint32_t index;
+		size_t begin;
+		size_t end;
+		MinimapBlock* blocks[rme::MapLayers];
+		bool used[rme::MapLayers];
+	};
+
+	// The blocks are created up front, so that the tasks below only write into their own
+	std::vector<Leaf> leaves;
+	std::vector<BlockLeaves> jobs;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int nd_x, int nd_y) {
+		const uint32_t index = getBlockIndex(Position(nd_x, nd_y, 0));
+		if(jobs.empty() || jobs.back().index != index) {
+			jobs.push_back(BlockLeaves { index, leaves.size(), leaves.size(), {}, {} });
 		}
 
-		if(!tile || (!tile->ground && tile->items.empty())) {
-			continue;
+		BlockLeaves& job = jobs.back();
+		for(int z = min_z; z <= max_z; ++z) {
+			if(!job.blocks[z] && leaf->getFloor(z)) {
+				job.blocks[z] = &m_blocks[z][index];
+			}
 		}
+		leaves.push_back(Leaf { leaf, nd_x, nd_y });
+		job.end = leaves.size();
+	});
+
+	std::atomic<long long> tiles_iterated(0);
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(std::min(jobs.size() / 16, pool.getWorkerCount() * 8), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		long long visited = 0;
+		const size_t end = jobs.size() * (chunk + 1) / chunk_count;
+		for(size_t i = jobs.size() * chunk / chunk_count; i < end; ++i) {
+			BlockLeaves& job = jobs[i];
+			for(size_t l = job.begin; l < job.end; ++l) {
+				const Leaf& leaf = leaves[l];
+				for(int z = min_z; z <= max_z; ++z) {
+					Floor* floor = leaf.node->getFloor(z);
+					if(!floor) {
+						continue;
+					}
 
-		const auto& position = tile->getPosition();
+					for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1) {
+						const int index = std::countr_zero(mask);
+						auto tile = floor->locs[index].get();
 
-		if (m_mode == MinimapExportMode::SelectedArea) {
-			if (!tile->isSelected()) {
-				continue;
+						++visited;
+						if(!tile->ground && tile->items.empty()) {
+							continue;
+						}
+
+						if (m_mode == MinimapExportMode::SelectedArea && !tile->isSelected()) {
+							continue;
+						}
+
+						MinimapTile minimapTile;
+						minimapTile.color = tile->getMiniMapColor();
+						minimapTile.flags |= MinimapTileWasSeen;
+						if (tile->isBlocking()) {
+							minimapTile.flags |= MinimapTileNotWalkable;
+						}
+						//if (!tile->isPathable()) {
+							//minimapTile.flags |= MinimapTileNotPathable;
+						//}
+						minimapTile.speed = std::min<int>((int)std::ceil(tile->getGroundSpeed() / 10.f), 0xFF);
+
+						const int x = leaf.x + (index >> 2);
+						const int y = leaf.y + (index & 3);
+						job.blocks[z]->updateTile(x % MMBLOCK_SIZE, y % MMBLOCK_SIZE, minimapTile);
+						job.used[z] = true;
+					}
+				}
 			}
-		} else if (m_floor != -1 && position.z != m_floor) {
-			continue;
 		}
-
-		MinimapTile minimapTile;
-		minimapTile.color = tile->getMiniMapColor();
-		minimapTile.flags |= MinimapTileWasSeen;
-		if (tile->isBlocking()) {
-			minimapTile.flags |= MinimapTileNotWalkable;
+		tiles_iterated += visited;
+	}, [&]() {
+		if (m_updateLoadbar) {
+			g_gui.SetLoadDone(int(tiles_iterated / double(std::max<uint64_t>(map.size(), 1)) * 90.0));
 		}
-		//if (!tile->isPathable()) {
-			//minimapTile.flags |= MinimapTileNotPathable;
-		//}
-		minimapTile.speed = std::min<int>((int)std::ceil(tile->getGroundSpeed() / 10.f), 0xFF);
+		return true;
+	});
 
-		auto& blocks = m_blocks[position.z];
-		uint32_t index = getBlockIndex(position);
-		if (blocks.find(index) == blocks.end()) {
-			blocks.insert({ index, MinimapBlock() });
+	// Blocks whose tiles were all empty or unselected are not exported
+	for(const BlockLeaves& job : jobs) {
+		for(int z = min_z; z <= max_z; ++z) {
+			if(job.blocks[z] && !job.used[z]) {
+				m_blocks[z].erase(job.index);
+			}
 		}
-
-		auto& block = blocks.at(index);
-		int offset_x = position.x - (position.x % MMBLOCK_SIZE);
-		int offset_y = position.y - (position.y % MMBLOCK_SIZE);
-		block.updateTile(position.x - offset_x, position.y - offset_y, minimapTile);
 	}
 }
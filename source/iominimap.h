@@ -72,8 +72,15 @@ public:
 	IOMinimap(Editor* editor, MinimapExportFormat format, MinimapExportMode mode, bool updateLoadbar);
 
 	bool saveMinimap(const std::string& directory, const std::string& name, int floor = -1);
+	// Gives every seen square of an OTMM that has no tile yet a ground of the same minimap
+	// colour, moved by offset. The blocks are decompressed on the pool a group at a time and
+	// their tiles created leaf by leaf on this thread.
+	bool loadOtmm(const wxFileName& file, const Position& offset);
 
 	const std::string& getError() const noexcept { return m_error; }
+	size_t getImportedTiles() const noexcept { return m_importedTiles; }
+	// Blocks that couldn't be decompressed
+	size_t getSkippedBlocks() const noexcept { return m_skippedBlocks; }
 
 private:
 	bool saveOtmm(const wxFileName& file);
@@ -92,6 +99,8 @@ private:
 	int m_floor = -1;
 	std::unordered_map<uint32_t, MinimapBlock> m_blocks[rme::MapLayers];
 	std::string m_error;
+	size_t m_importedTiles = 0;
+	size_t m_skippedBlocks = 0;
 };
 
 #endif
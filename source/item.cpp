@@ -24,6 +24,7 @@
 #include "complexitem.h"
 #include "iomap.h"
 #include "item.h"
+#include "map_allocator.h"
 
 #include "ground_brush.h"
 #include "carpet_brush.h"
@@ -65,6 +66,7 @@ Item::Item(unsigned short _type, unsigned short _count) :
 	id(_type),
 	subtype(1),
 	selected(false),
+	plain(true),
 	frame(0)
 {
 	if(hasSubtype()) {
@@ -77,6 +79,26 @@ Item::~Item()
 	////
 }
 
+#if RME_POOLED_MAP_ALLOCATOR > 0
+// Containers, doors, depots etc. inherit these, only the plain item fits a slot
+void* Item::operator new(size_t size)
+{
+	if(size == sizeof(Item)) {
+		return MapAllocator::itemPool().allocate();
+	}
+	return ::operator new(size);
+}
+
+void Item::operator delete(void* ptr, size_t size)
+{
+	if(size == sizeof(Item)) {
+		MapAllocator::itemPool().deallocate(ptr);
+	} else {
+		::operator delete(ptr);
+	}
+}
+#endif
+
 Item* Item::deepCopy() const
 {
 	Item* copy = Create(id, subtype);
@@ -144,8 +166,7 @@ Item* transformItem(Item* old_item, uint16_t new_id, Tile* parent)
 
 uint32_t Item::memsize() const
 {
-	uint32_t mem = sizeof(*this);
-	return mem;
+	return uint32_t(sizeof(*this) + getAttributeMemsize());
 }
 
 void Item::setID(uint16_t new_id)
@@ -270,22 +291,22 @@ double Item::getWeight() const
 
 void Item::setUniqueID(unsigned short n)
 {
-	setAttribute("uid", n);
+	setAttribute(ItemAttributeKeys::UNIQUE_ID, n);
 }
 
 void Item::setActionID(unsigned short n)
 {
-	setAttribute("aid", n);
+	setAttribute(ItemAttributeKeys::ACTION_ID, n);
 }
 
 void Item::setText(const std::string& str)
 {
-	setAttribute("text", str);
+	setAttribute(ItemAttributeKeys::TEXT, str);
 }
 
 void Item::setDescription(const std::string& str)
 {
-	setAttribute("desc", str);
+	setAttribute(ItemAttributeKeys::DESCRIPTION, str);
 }
 
 double Item::getWeight()
@@ -309,11 +330,7 @@ bool Item::canHoldDescription() const
 
 uint8_t Item::getMiniMapColor() const
 {
-	GameSprite* sprite = g_items.getItemType(id).sprite;
-	if(sprite) {
-		return sprite->getMiniMapColor();
-	}
-	return 0;
+	return g_items.getHotData(id).minimap_color;
 }
 
 GroundBrush* Item::getGroundBrush() const
@@ -415,7 +432,7 @@ void Item::animate()
 	if(!sprite || !sprite->animator)
 		return;
 
-	frame = sprite->animator->getFrame();
+	frame = static_cast<uint16_t>(sprite->animator->getFrame());
 }
 
 // ============================================================================
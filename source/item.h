@@ -22,6 +22,8 @@
 #include "iomap_otbm.h"
 //#include "iomap_otmm.h"
 #include "item_attributes.h"
+#include "map_region.h"
+#include "small_vector.h"
 
 enum ITEMPROPERTY {
 	BLOCKSOLID,
@@ -113,8 +115,14 @@ public:
 
 	// Will return a node containing this item
 	virtual bool serializeItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const;
+	// The same, plain items are written without going through the virtual serializers
+	bool writeItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const {
+		return plain ? serializePlainItemNode_OTBM(maphandle, f) : serializeItemNode_OTBM(maphandle, f);
+	}
 	// Will write this item to the stream supplied in the argument
-	virtual void serializeItemCompact_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const;
+	void serializeItemCompact_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const;
+	// Whether the compact form, the id alone, holds all of the item
+	bool isCompact() const;
 	virtual void serializeItemAttributes_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const;
 
 	// OTMM map interface
@@ -137,6 +145,8 @@ public:
 	static uint16_t LiquidName2ID(std::string id);
 
 	const ItemType& getItemType() const noexcept { return g_items.getItemType(id); }
+	// The properties tested in the tile and draw loops, one load for all of them
+	const ItemHotData& getHotData() const noexcept { return g_items.getHotData(id); }
 
 	// IDs
 	uint16_t getID() const { return id; }
@@ -168,7 +178,7 @@ public:
 	TableBrush* getTableBrush() const;
 	CarpetBrush* getCarpetBrush() const;
 	Brush* getDoodadBrush() const { return getItemType().doodad_brush; } // This is not necessarily a doodad brush
-	RAWBrush* getRAWBrush() const { return getItemType().raw_brush; }
+	RAWBrush* getRAWBrush() const { return g_items.getRAWBrush(id); }
 	uint16_t getGroundEquivalent() const { return getItemType().ground_equivalent; }
 	uint16_t hasBorderEquivalent() const { return getItemType().has_equivalent; }
 	uint32_t getBorderGroup() const { return getItemType().border_group; }
@@ -184,34 +194,34 @@ public:
 
 	// Item types
 	bool hasProperty(enum ITEMPROPERTY prop) const;
-	bool isBlocking() const { return getItemType().unpassable; }
-	bool isStackable() const { return getItemType().stackable; }
+	bool isBlocking() const { return getHotData().has(ITEM_HOT_UNPASSABLE); }
+	bool isStackable() const { return getHotData().has(ITEM_HOT_STACKABLE); }
 	bool isClientCharged() const { return getItemType().isClientCharged(); }
 	bool isExtraCharged() const { return getItemType().isExtraCharged(); }
-	bool isCharged() const { return isClientCharged() || isExtraCharged(); }
-	bool isFluidContainer() const { return (getItemType().isFluidContainer()); }
-	bool isAlwaysOnBottom() const { return getItemType().alwaysOnBottom; }
-	int  getTopOrder() const { return getItemType().alwaysOnTopOrder; }
-	bool isGroundTile() const { return getItemType().isGroundTile(); }
-	bool isSplash() const { return getItemType().isSplash(); }
+	bool isCharged() const { return getHotData().has(ITEM_HOT_CHARGED); }
+	bool isFluidContainer() const { return getHotData().group == ITEM_GROUP_FLUID; }
+	bool isAlwaysOnBottom() const { return getHotData().has(ITEM_HOT_ALWAYS_ON_BOTTOM); }
+	int  getTopOrder() const { return getHotData().top_order; }
+	bool isGroundTile() const { return getHotData().group == ITEM_GROUP_GROUND; }
+	bool isSplash() const { return getHotData().group == ITEM_GROUP_SPLASH; }
 	bool isMagicField() const { return getItemType().isMagicField(); }
-	bool isNotMoveable() const { return !getItemType().moveable; }
-	bool isMoveable() const { return getItemType().moveable; }
-	bool isPickupable() const { return getItemType().pickupable; }
+	bool isNotMoveable() const { return !getHotData().has(ITEM_HOT_MOVEABLE); }
+	bool isMoveable() const { return getHotData().has(ITEM_HOT_MOVEABLE); }
+	bool isPickupable() const { return getHotData().has(ITEM_HOT_PICKUPABLE); }
 	//bool isWeapon() const { return (getItemType().weaponType != WEAPON_NONE && g_items[id].weaponType != WEAPON_AMMO); }
 	//bool isUseable() const { return getItemType().useable; }
-	bool isHangable() const { return getItemType().isHangable; }
+	bool isHangable() const { return getHotData().has(ITEM_HOT_HANGABLE); }
 	bool isRoteable() const { return getItemType().rotable && getItemType().rotateTo; }
 	bool hasCharges() const { return getItemType().charges != 0; }
-	bool isBorder() const { return getItemType().isBorder; }
-	bool isOptionalBorder() const { return getItemType().isOptionalBorder; }
+	bool isBorder() const { return getHotData().has(ITEM_HOT_BORDER); }
+	bool isOptionalBorder() const { return getHotData().has(ITEM_HOT_OPTIONAL_BORDER); }
 	bool isWall() const { return getItemType().isWall; }
 	bool isDoor() const { return getItemType().isDoor(); }
 	bool isOpen() const { return getItemType().isOpen; }
 	bool isBrushDoor() const { return getItemType().isBrushDoor; }
-	bool isTable() const { return getItemType().isTable; }
-	bool isCarpet() const { return getItemType().isCarpet; }
-	bool isMetaItem() const { return getItemType().isMetaItem(); }
+	bool isTable() const { return getHotData().has(ITEM_HOT_TABLE); }
+	bool isCarpet() const { return getHotData().has(ITEM_HOT_CARPET); }
+	bool isMetaItem() const { return getHotData().has(ITEM_HOT_META_ITEM); }
 
 	// Wall alignment (vertical, horizontal, pole, corner)
 	BorderType getWallAlignment() const;
@@ -229,7 +239,7 @@ public:
 	void toggleSelection() {selected =! selected; }
 
 	// Item properties!
-	virtual bool isComplex() const { return attributes && attributes->size(); } // If this item requires full save (not compact)
+	bool isComplex() const { return attributes && attributes->size(); } // If this item requires full save (not compact)
 
 	// Weight
 	bool hasWeight() { return isPickupable(); }
@@ -256,6 +266,9 @@ public:
 	void animate();
 	int getFrame() const { return frame; }
 
+	// Plain items come from a slab pool, the bigger complex items from the heap
+	DECLARE_POOLED_ALLOCATION()
+
 	void doRotate() {
 		if(isRoteable()) {
 			setID(getItemType().rotateTo);
@@ -263,11 +276,19 @@ public:
 	}
 
 protected:
+	// Without attributes the node only depends on the flags of the type, it is put
+	// together in one buffer and written at once
+	bool serializePlainItemNode_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const;
+
 	uint16_t id;  // the same id as in ItemType
 	// Subtype is either fluid type, count, subtype or charges
 	uint16_t subtype;
 	bool selected;
-	int frame;
+	// Cleared by the subclasses that save attributes of their own, lets the
+	// serializers write the item from the layout of its type without virtual calls
+	bool plain;
+	// 16 bits keep a plain item at three words with the vtable and attributes
+	uint16_t frame;
 
 private:
 	Item& operator=(const Item& i);// Can't copy
@@ -275,7 +296,7 @@ private:
 	Item& operator==(const Item& i);// Can't compare
 };
 
-typedef std::vector<Item*> ItemVector;
+typedef SmallVector<Item*, 4> ItemVector;
 typedef std::list<Item*> ItemList;
 
 Item* transformItem(Item* old_item, uint16_t new_id, Tile* parent = nullptr);
@@ -288,28 +309,28 @@ inline int Item::getCount() const {
 }
 
 inline uint16_t Item::getUniqueID() const {
-	const int32_t* a = getIntegerAttribute("uid");
+	const int32_t* a = getIntegerAttribute(ItemAttributeKeys::UNIQUE_ID);
 	if(a)
 		return *a;
 	return 0;
 }
 
 inline uint16_t Item::getActionID() const {
-	const int32_t* a = getIntegerAttribute("aid");
+	const int32_t* a = getIntegerAttribute(ItemAttributeKeys::ACTION_ID);
 	if(a)
 		return *a;
 	return 0;
 }
 
 inline std::string Item::getText() const {
-	const std::string* a = getStringAttribute("text");
+	const std::string* a = getStringAttribute(ItemAttributeKeys::TEXT);
 	if(a)
 		return *a;
 	return "";
 }
 
 inline std::string Item::getDescription() const {
-	const std::string* a = getStringAttribute("desc");
+	const std::string* a = getStringAttribute(ItemAttributeKeys::DESCRIPTION);
 	if(a)
 		return *a;
 	return "";
@@ -20,13 +20,84 @@
 #include "item_attributes.h"
 #include "filehandle.h"
 
+#include <deque>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace
+{
+	struct AttributeKeyTable
+	{
+		AttributeKeyTable() {
+			// In the order of ItemAttributeKeys
+			for(const char* name : { "aid", "uid", "text", "desc", "charges", "keyid" }) {
+				keys.emplace(name, static_cast<ItemAttributeKey>(names.size()));
+				names.emplace_back(name);
+			}
+		}
+
+		std::shared_mutex mutex;
+		std::unordered_map<std::string, ItemAttributeKey> keys;
+		std::deque<std::string> names; // Doesn't move the names as it grows
+	};
+
+	// Never destroyed, items may be torn down after static destruction has started
+	AttributeKeyTable& keyTable()
+	{
+		static AttributeKeyTable* table = newd AttributeKeyTable();
+		return *table;
+	}
+
+	bool keyLess(const ItemAttributeMap::value_type& entry, ItemAttributeKey key)
+	{
+		return entry.first < key;
+	}
+}
+
+ItemAttributeKey ItemAttributeKeys::intern(const std::string& name)
+{
+	AttributeKeyTable& table = keyTable();
+	{
+		std::shared_lock<std::shared_mutex> lock(table.mutex);
+		auto it = table.keys.find(name);
+		if(it != table.keys.end())
+			return it->second;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(table.mutex);
+	auto result = table.keys.emplace(name, static_cast<ItemAttributeKey>(table.names.size()));
+	if(result.second)
+		table.names.push_back(name);
+	return result.first->second;
+}
+
+bool ItemAttributeKeys::find(const std::string& name, ItemAttributeKey& key)
+{
+	AttributeKeyTable& table = keyTable();
+	std::shared_lock<std::shared_mutex> lock(table.mutex);
+	auto it = table.keys.find(name);
+	if(it == table.keys.end())
+		return false;
+	key = it->second;
+	return true;
+}
+
+const std::string& ItemAttributeKeys::name(ItemAttributeKey key)
+{
+	AttributeKeyTable& table = keyTable();
+	std::shared_lock<std::shared_mutex> lock(table.mutex);
+	ASSERT(key < table.names.size());
+	return table.names[key];
+}
+
 ItemAttributes::ItemAttributes() :
 	attributes(nullptr)
 {
 	////
 }
 
-ItemAttributes::ItemAttributes(const ItemAttributes& o)
+ItemAttributes::ItemAttributes(const ItemAttributes& o) :
+	attributes(nullptr)
 {
 	if(o.attributes)
 		attributes = newd ItemAttributeMap(*o.attributes);
@@ -57,89 +128,163 @@ ItemAttributeMap ItemAttributes::getAttributes() const
 	return ItemAttributeMap();
 }
 
-void ItemAttributes::setAttribute(const std::string& key, const ItemAttribute& value)
+size_t ItemAttributes::getAttributeMemsize() const
+{
+	if(!attributes)
+		return 0;
+
+	size_t mem = sizeof(ItemAttributeMap) + attributes->capacity() * sizeof(ItemAttributeMap::value_type);
+	for(const auto& attribute : *attributes) {
+		const std::string* str = attribute.second.getString();
+		// Short strings are kept inside the string itself
+		if(str && str->capacity() >= sizeof(std::string))
+			mem += str->capacity() + 1;
+	}
+	return mem;
+}
+
+const ItemAttribute* ItemAttributes::findAttribute(ItemAttributeKey key) const
+{
+	if(!attributes)
+		return nullptr;
+
+	ItemAttributeMap::const_iterator iter = std::lower_bound(attributes->begin(), attributes->end(), key, keyLess);
+	if(iter != attributes->end() && iter->first == key)
+		return &iter->second;
+	return nullptr;
+}
+
+ItemAttribute& ItemAttributes::attributeFor(ItemAttributeKey key)
 {
 	createAttributes();
-	(*attributes)[key] = value;
+
+	ItemAttributeMap::iterator iter = std::lower_bound(attributes->begin(), attributes->end(), key, keyLess);
+	if(iter == attributes->end() || iter->first != key)
+		iter = attributes->insert(iter, ItemAttributeMap::value_type(key, ItemAttribute()));
+	return iter->second;
+}
+
+void ItemAttributes::setAttribute(ItemAttributeKey key, const ItemAttribute& value)
+{
+	attributeFor(key) = value;
+}
+
+void ItemAttributes::setAttribute(ItemAttributeKey key, const std::string& value)
+{
+	attributeFor(key).set(value);
+}
+
+void ItemAttributes::setAttribute(ItemAttributeKey key, int32_t value)
+{
+	attributeFor(key).set(value);
+}
+
+void ItemAttributes::setAttribute(ItemAttributeKey key, double value)
+{
+	attributeFor(key).set(value);
+}
+
+void ItemAttributes::setAttribute(ItemAttributeKey key, bool value)
+{
+	attributeFor(key).set(value);
+}
+
+void ItemAttributes::setAttribute(const std::string& key, const ItemAttribute& value)
+{
+	setAttribute(ItemAttributeKeys::intern(key), value);
 }
 
 void ItemAttributes::setAttribute(const std::string& key, const std::string& value)
 {
-	createAttributes();
-	(*attributes)[key].set(value);
+	setAttribute(ItemAttributeKeys::intern(key), value);
 }
 
 void ItemAttributes::setAttribute(const std::string& key, int32_t value)
 {
-	createAttributes();
-	(*attributes)[key].set(value);
+	setAttribute(ItemAttributeKeys::intern(key), value);
 }
 
 void ItemAttributes::setAttribute(const std::string& key, double value)
 {
-	createAttributes();
-	(*attributes)[key].set(value);
+	setAttribute(ItemAttributeKeys::intern(key), value);
 }
 
 void ItemAttributes::setAttribute(const std::string& key, bool value)
 {
-	createAttributes();
-	(*attributes)[key].set(value);
+	setAttribute(ItemAttributeKeys::intern(key), value);
 }
 
-void ItemAttributes::eraseAttribute(const std::string& key)
+void ItemAttributes::eraseAttribute(ItemAttributeKey key)
 {
 	if(!attributes)
 		return;
 
-	ItemAttributeMap::iterator iter = attributes->find(key);
-
-	if(iter != attributes->end())
+	ItemAttributeMap::iterator iter = std::lower_bound(attributes->begin(), attributes->end(), key, keyLess);
+	if(iter != attributes->end() && iter->first == key)
 		attributes->erase(iter);
 }
 
-const std::string* ItemAttributes::getStringAttribute(const std::string& key) const
+void ItemAttributes::eraseAttribute(const std::string& name)
 {
-	if(!attributes)
-		return nullptr;
+	ItemAttributeKey key;
+	if(ItemAttributeKeys::find(name, key))
+		eraseAttribute(key);
+}
 
-	ItemAttributeMap::iterator iter = attributes->find(key);
-	if(iter != attributes->end())
-		return iter->second.getString();
-	return nullptr;
+const std::string* ItemAttributes::getStringAttribute(ItemAttributeKey key) const
+{
+	const ItemAttribute* attribute = findAttribute(key);
+	return attribute ? attribute->getString() : nullptr;
 }
 
-const int32_t* ItemAttributes::getIntegerAttribute(const std::string& key) const
+const int32_t* ItemAttributes::getIntegerAttribute(ItemAttributeKey key) const
 {
-	if(!attributes)
-		return nullptr;
+	const ItemAttribute* attribute = findAttribute(key);
+	return attribute ? attribute->getInteger() : nullptr;
+}
 
-	ItemAttributeMap::iterator iter = attributes->find(key);
-	if(iter != attributes->end())
-		return iter->second.getInteger();
-	return nullptr;
+const double* ItemAttributes::getFloatAttribute(ItemAttributeKey key) const
+{
+	const ItemAttribute* attribute = findAttribute(key);
+	return attribute ? attribute->getFloat() : nullptr;
 }
 
-const double* ItemAttributes::getFloatAttribute(const std::string& key) const
+const bool* ItemAttributes::getBooleanAttribute(ItemAttributeKey key) const
 {
-	if(!attributes)
+	const ItemAttribute* attribute = findAttribute(key);
+	return attribute ? attribute->getBoolean() : nullptr;
+}
+
+const std::string* ItemAttributes::getStringAttribute(const std::string& name) const
+{
+	ItemAttributeKey key;
+	if(!ItemAttributeKeys::find(name, key))
 		return nullptr;
+	return getStringAttribute(key);
+}
 
-	ItemAttributeMap::iterator iter = attributes->find(key);
-	if(iter != attributes->end())
-		return iter->second.getFloat();
-	return nullptr;
+const int32_t* ItemAttributes::getIntegerAttribute(const std::string& name) const
+{
+	ItemAttributeKey key;
+	if(!ItemAttributeKeys::find(name, key))
+		return nullptr;
+	return getIntegerAttribute(key);
 }
 
-const bool* ItemAttributes::getBooleanAttribute(const std::string& key) const
+const double* ItemAttributes::getFloatAttribute(const std::string& name) const
 {
-	if(!attributes)
+	ItemAttributeKey key;
+	if(!ItemAttributeKeys::find(name, key))
 		return nullptr;
+	return getFloatAttribute(key);
+}
 
-	ItemAttributeMap::iterator iter = attributes->find(key);
-	if(iter != attributes->end())
-		return iter->second.getBoolean();
-	return nullptr;
+const bool* ItemAttributes::getBooleanAttribute(const std::string& name) const
+{
+	ItemAttributeKey key;
+	if(!ItemAttributeKeys::find(name, key))
+		return nullptr;
+	return getBooleanAttribute(key);
 }
 
 bool ItemAttributes::hasStringAttribute(const std::string& key) const
@@ -305,7 +450,7 @@ bool ItemAttributes::unserializeAttributeMap(const IOMap& maphandle, BinaryNode*
 				return false;
 			if(!attrib.unserialize(maphandle, stream))
 				return false;
-			(*attributes)[key] = attrib;
+			setAttribute(ItemAttributeKeys::intern(key), attrib);
 		}
 	}
 	return true;
@@ -319,7 +464,7 @@ void ItemAttributes::serializeAttributeMap(const IOMap& maphandle, NodeFileWrite
 	ItemAttributeMap::const_iterator attribute = attributes->begin();
 	int i = 0;
 	while(attribute != attributes->end() && i <= 0xFFFF) {
-		const std::string& key = attribute->first;
+		const std::string& key = ItemAttributeKeys::name(attribute->first);
 		if(key.size() > 0xFFFF)
 			f.addString(key.substr(0, 65535));
 		else
@@ -19,7 +19,7 @@
 #define RME_ITEM_ATTRIBUTES_H_
 
 #include <string>
-#include <map>
+#include <vector>
 
 #include "filehandle.h"
 
@@ -69,7 +69,31 @@ private:
 	char data[sizeof(std::string) > sizeof(double) ? sizeof(std::string) : sizeof(double)];
 };
 
-typedef std::map<std::string, ItemAttribute> ItemAttributeMap;
+typedef uint32_t ItemAttributeKey;
+
+// Attribute names are interned once, items store and compare the key instead
+class ItemAttributeKeys
+{
+public:
+	// Registered up front, so the item accessors need no lookup
+	enum : ItemAttributeKey {
+		ACTION_ID,
+		UNIQUE_ID,
+		TEXT,
+		DESCRIPTION,
+		CHARGES,
+		KEY_ID,
+	};
+
+	// Returns the key of the name, registering it on first use. Map loading calls this from several threads.
+	static ItemAttributeKey intern(const std::string& name);
+	// Looks the name up without registering it, false if no item ever used it
+	static bool find(const std::string& name, ItemAttributeKey& key);
+	static const std::string& name(ItemAttributeKey key);
+};
+
+// Sorted by key, an item rarely carries more than a handful of attributes
+typedef std::vector<std::pair<ItemAttributeKey, ItemAttribute> > ItemAttributeMap;
 
 class ItemAttributes
 {
@@ -88,12 +112,21 @@ public:
 	void setAttribute(const std::string& key, int32_t value);
 	void setAttribute(const std::string& key, double value);
 	void setAttribute(const std::string& key, bool set);
+	void setAttribute(ItemAttributeKey key, const ItemAttribute& attr);
+	void setAttribute(ItemAttributeKey key, const std::string& value);
+	void setAttribute(ItemAttributeKey key, int32_t value);
+	void setAttribute(ItemAttributeKey key, double value);
+	void setAttribute(ItemAttributeKey key, bool set);
 
 	// returns nullptr if the attribute is not set
 	const std::string* getStringAttribute(const std::string& key) const;
 	const int32_t* getIntegerAttribute(const std::string& key) const;
 	const double* getFloatAttribute(const std::string& key) const;
 	const bool* getBooleanAttribute(const std::string& key) const;
+	const std::string* getStringAttribute(ItemAttributeKey key) const;
+	const int32_t* getIntegerAttribute(ItemAttributeKey key) const;
+	const double* getFloatAttribute(ItemAttributeKey key) const;
+	const bool* getBooleanAttribute(ItemAttributeKey key) const;
 
 	// Returns true if the attribute (of that type) exists
 	bool hasStringAttribute(const std::string& key) const;
@@ -102,14 +135,21 @@ public:
 	bool hasBooleanAttribute(const std::string& key) const;
 
 	void eraseAttribute(const std::string& key);
+	void eraseAttribute(ItemAttributeKey key);
 
 	void clearAllAttributes();
 	ItemAttributeMap getAttributes() const;
 
+	size_t getAttributeCount() const noexcept { return attributes ? attributes->size() : 0; }
+	// Heap bytes of the attribute map, including the text of string attributes
+	size_t getAttributeMemsize() const;
+
 protected:
 	ItemAttributeMap* attributes;
 
 	void createAttributes();
+	const ItemAttribute* findAttribute(ItemAttributeKey key) const;
+	ItemAttribute& attributeFor(ItemAttributeKey key);
 };
 
 #endif
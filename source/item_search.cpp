@@ -0,0 +1,209 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "item_search.h"
+#include "items.h"
+#include "raw_brush.h"
+
+void ItemSearchIndex::clear()
+{
+	searchable.clear();
+	for(Bitset& bits : flag_bits) {
+		bits.clear();
+	}
+	names.clear();
+	grams.clear();
+	client_ids.clear();
+}
+
+uint32_t ItemSearchIndex::gram(const char* text, size_t length) noexcept
+{
+	uint32_t key = uint32_t(length) << 24;
+	for(size_t i = 0; i < length; ++i) {
+		key |= uint32_t(uint8_t(text[i])) << (16 - 8 * i);
+	}
+	return key;
+}
+
+void ItemSearchIndex::build(const ItemDatabase& items)
+{
+	clear();
+
+	const size_t count = size_t(items.getMaxID()) + 1;
+	const size_t words = (count + 63) / 64;
+	searchable.assign(words, 0);
+	for(Bitset& bits : flag_bits) {
+		bits.assign(words, 0);
+	}
+	names.resize(count);
+
+	for(uint32_t id = items.getMinID(); id < count; ++id) {
+		const ItemType& type = items.getItemType(id);
+		if(type.id == 0 || !type.hasRAWBrush()) {
+			continue;
+		}
+
+		const uint64_t bit = uint64_t(1) << (id & 63);
+		searchable[id >> 6] |= bit;
+		const bool flags[ITEM_SEARCH_FLAG_COUNT] = {
+			type.unpassable,
+			!type.moveable,
+			type.blockMissiles,
+			type.blockPathfinder,
+			type.canReadText,
+			type.canWriteText,
+			type.pickupable,
+			type.stackable,
+			type.rotable,
+			type.isHangable,
+			type.hookEast,
+			type.hookSouth,
+			type.hasElevation,
+			type.ignoreLook,
+			type.isFloorChange(),
+			type.isDepot(),
+			type.isMailbox(),
+			type.isTrashHolder(),
+			type.isContainer(),
+			type.isDoor(),
+			type.isMagicField(),
+			type.isTeleport(),
+			type.isBed(),
+			type.isKey(),
+		};
+		for(int flag = 0; flag < ITEM_SEARCH_FLAG_COUNT; ++flag) {
+			if(flags[flag]) {
+				flag_bits[flag][id >> 6] |= bit;
+			}
+		}
+
+		client_ids[type.clientID].push_back(uint16_t(id));
+
+		// The ids come in order, so every posting list stays sorted
+		std::string& name = names[id];
+		name = as_lower_str(RAWBrush::getName(type));
+		for(size_t length = 2; length <= 3; ++length) {
+			for(size_t offset = 0; offset + length <= name.size(); ++offset) {
+				std::vector<uint16_t>& postings = grams[gram(name.data() + offset, length)];
+				if(postings.empty() || postings.back() != id) {
+					postings.push_back(uint16_t(id));
+				}
+			}
+		}
+	}
+}
+
+ItemSearchIndex::Bitset ItemSearchIndex::matching(uint32_t flags) const
+{
+	Bitset bits = searchable;
+	for(int flag = 0; flag < ITEM_SEARCH_FLAG_COUNT; ++flag) {
+		if(flags & mask(ItemSearchFlag(flag))) {
+			for(size_t word = 0; word < bits.size(); ++word) {
+				bits[word] &= flag_bits[flag][word];
+			}
+		}
+	}
+	return bits;
+}
+
+std::vector<uint16_t> ItemSearchIndex::findByFlags(uint32_t flags) const
+{
+	std::vector<uint16_t> found;
+	const Bitset bits = matching(flags);
+	for(size_t word = 0; word < bits.size(); ++word) {
+		for(uint64_t value = bits[word]; value != 0; value &= value - 1) {
+			int bit = 0;
+			while(((value >> bit) & 1) == 0) {
+				++bit;
+			}
+			found.push_back(uint16_t(word * 64 + bit));
+		}
+	}
+	return found;
+}
+
+std::vector<uint16_t> ItemSearchIndex::findByName(const std::string& text, uint32_t flags) const
+{
+	std::vector<uint16_t> found;
+	if(text.size() < 2 || searchable.empty()) {
+		return found;
+	}
+
+	// Every three letters of the text, or the two of a text that short
+	const size_t length = std::min<size_t>(text.size(), 3);
+	std::vector<const std::vector<uint16_t>*> lists;
+	for(size_t offset = 0; offset + length <= text.size(); ++offset) {
+		auto it = grams.find(gram(text.data() + offset, length));
+		if(it == grams.end()) {
+			return found;
+		}
+		lists.push_back(&it->second);
+	}
+	std::sort(lists.begin(), lists.end(), [](const std::vector<uint16_t>* a, const std::vector<uint16_t>* b) {
+		return a->size() < b->size();
+	});
+
+	// From the shortest list, what all of them have and the flags allow
+	const Bitset bits = matching(flags);
+	std::vector<size_t> positions(lists.size(), 0);
+	for(uint16_t id : *lists.front()) {
+		if(!test(bits, id)) {
+			continue;
+		}
+
+		bool in_all = true;
+		for(size_t list = 1; list < lists.size() && in_all; ++list) {
+			const std::vector<uint16_t>& postings = *lists[list];
+			size_t& position = positions[list];
+			position = std::lower_bound(postings.begin() + position, postings.end(), id) - postings.begin();
+			in_all = position < postings.size() && postings[position] == id;
+		}
+		// The substrings being there doesn't mean they are in the right order
+		if(in_all && names[id].find(text) != std::string::npos) {
+			found.push_back(id);
+		}
+	}
+	return found;
+}
+
+std::vector<uint16_t> ItemSearchIndex::findByServerId(uint16_t id, uint32_t flags) const
+{
+	std::vector<uint16_t> found;
+	if(size_t(id >> 6) < searchable.size() && test(matching(flags), id)) {
+		found.push_back(id);
+	}
+	return found;
+}
+
+std::vector<uint16_t> ItemSearchIndex::findByClientId(uint16_t id, uint32_t flags) const
+{
+	std::vector<uint16_t> found;
+	auto it = client_ids.find(id);
+	if(it == client_ids.end()) {
+		return found;
+	}
+
+	const Bitset bits = matching(flags);
+	for(uint16_t item_id : it->second) {
+		if(test(bits, item_id)) {
+			found.push_back(item_id);
+		}
+	}
+	return found;
+}
@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_ITEM_SEARCH_H_
+#define RME_ITEM_SEARCH_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ItemDatabase;
+
+enum ItemSearchFlag {
+	ITEM_SEARCH_UNPASSABLE,
+	ITEM_SEARCH_UNMOVABLE,
+	ITEM_SEARCH_BLOCK_MISSILES,
+	ITEM_SEARCH_BLOCK_PATHFINDER,
+	ITEM_SEARCH_READABLE,
+	ITEM_SEARCH_WRITEABLE,
+	ITEM_SEARCH_PICKUPABLE,
+	ITEM_SEARCH_STACKABLE,
+	ITEM_SEARCH_ROTATABLE,
+	ITEM_SEARCH_HANGABLE,
+	ITEM_SEARCH_HOOK_EAST,
+	ITEM_SEARCH_HOOK_SOUTH,
+	ITEM_SEARCH_HAS_ELEVATION,
+	ITEM_SEARCH_IGNORE_LOOK,
+	ITEM_SEARCH_FLOOR_CHANGE,
+	ITEM_SEARCH_DEPOT,
+	ITEM_SEARCH_MAILBOX,
+	ITEM_SEARCH_TRASH_HOLDER,
+	ITEM_SEARCH_CONTAINER,
+	ITEM_SEARCH_DOOR,
+	ITEM_SEARCH_MAGIC_FIELD,
+	ITEM_SEARCH_TELEPORT,
+	ITEM_SEARCH_BED,
+	ITEM_SEARCH_KEY,
+
+	ITEM_SEARCH_FLAG_COUNT
+};
+
+// What the find item dialog searches, made once the items and their RAW brushes are loaded.
+// Only items with a RAW brush are in it. Names are found through the posting lists of their
+// two and three letter substrings, flags through a bitset per flag, results come in id order.
+class ItemSearchIndex
+{
+public:
+	void build(const ItemDatabase& items);
+	void clear();
+
+	static uint32_t mask(ItemSearchFlag flag) noexcept { return 1u << flag; }
+
+	// The items with every flag of the mask
+	std::vector<uint16_t> findByFlags(uint32_t flags) const;
+	// The items whose brush name holds text, lower case and two letters at least
+	std::vector<uint16_t> findByName(const std::string& text, uint32_t flags = 0) const;
+	std::vector<uint16_t> findByServerId(uint16_t id, uint32_t flags = 0) const;
+	std::vector<uint16_t> findByClientId(uint16_t id, uint32_t flags = 0) const;
+
+private:
+	typedef std::vector<uint64_t> Bitset;
+
+	static uint32_t gram(const char* text, size_t length) noexcept;
+	// The searchable items with every flag of the mask
+	Bitset matching(uint32_t flags) const;
+	static bool test(const Bitset& bits, uint16_t id) noexcept {
+		return (bits[id >> 6] >> (id & 63)) & 1;
+	}
+
+	Bitset searchable;
+	Bitset flag_bits[ITEM_SEARCH_FLAG_COUNT];
+	// The lower case brush names, by id
+	std::vector<std::string> names;
+	std::unordered_map<uint32_t, std::vector<uint16_t>> grams;
+	std::unordered_map<uint16_t, std::vector<uint16_t>> client_ids;
+};
+
+#endif
@@ -19,12 +19,17 @@
 #include <wx/dir.h>
 
 #include "materials.h"
+#include "raw_brush.h"
 #include "gui.h"
 #include <string.h> // memcpy
 #include <toml++/toml.hpp>
+#include <string_view>
+#include <unordered_map>
 
 #include "items.h"
 #include "item.h"
+#include "thread_pool.h"
+#include "tracing.h"
 
 ItemDatabase g_items;
 
@@ -88,6 +93,7 @@ ItemType::ItemType() :
 	blockMissiles(false),
 	blockPathfinder(false),
 	hasElevation(false),
+	fullGround(false),
 	alwaysOnTopOrder(0),
 	rotateTo(0),
 	border_alignment(BORDER_NONE)
@@ -134,6 +140,94 @@ void ItemDatabase::clear()
 		delete items[i];
 		items.set(i, nullptr);
 	}
+	hot_data.clear();
+	search_index.clear();
+}
+
+void ItemDatabase::swap(ItemDatabase& other)
+{
+	std::swap(MajorVersion, other.MajorVersion);
+	std::swap(MinorVersion, other.MinorVersion);
+	std::swap(BuildNumber, other.BuildNumber);
+	items.swap(other.items);
+	hot_data.swap(other.hot_data);
+	std::swap(search_index, other.search_index);
+	std::swap(item_count, other.item_count);
+	std::swap(effect_count, other.effect_count);
+	std::swap(monster_count, other.monster_count);
+	std::swap(distance_count, other.distance_count);
+	std::swap(minClientID, other.minClientID);
+	std::swap(maxClientID, other.maxClientID);
+	std::swap(maxItemId, other.maxItemId);
+}
+
+void ItemDatabase::clearBrushes()
+{
+	for(uint32_t id = getMinID(); id <= maxItemId; ++id) {
+		ItemType* type = items[id];
+		if(!type)
+			continue;
+
+		type->brush = nullptr;
+		type->doodad_brush = nullptr;
+		type->raw_brush = nullptr;
+		type->has_raw = false;
+		type->in_other_tileset = false;
+		type->ground_equivalent = 0;
+		type->border_group = 0;
+		type->has_equivalent = false;
+		type->wall_hate_me = false;
+		type->isBorder = false;
+		type->isOptionalBorder = false;
+		type->isWall = false;
+		type->isBrushDoor = false;
+		type->isOpen = false;
+		type->isTable = false;
+		type->isCarpet = false;
+		type->border_alignment = BORDER_NONE;
+	}
+}
+
+void ItemDatabase::updateHotData()
+{
+	RME_TRACE_ZONE("load", "ItemDatabase::updateHotData");
+	hot_data.assign(maxItemId + 1, ItemHotData());
+	for(uint32_t id = getMinID(); id <= maxItemId; ++id) {
+		const ItemType* type = items[id];
+		if(!type) {
+			continue;
+		}
+
+		ItemHotData& data = hot_data[id];
+		data.sprite = type->sprite;
+		data.group = type->group;
+		data.top_order = static_cast<uint8_t>(type->alwaysOnTopOrder);
+		if(type->sprite) {
+			data.ground_speed = type->sprite->ground_speed;
+			data.minimap_color = static_cast<uint8_t>(type->sprite->getMiniMapColor());
+			if(type->sprite->animator) data.flags |= ITEM_HOT_ANIMATED;
+			if(type->sprite->hasLight()) data.flags |= ITEM_HOT_LIGHT;
+		}
+
+		if(type->unpassable) data.flags |= ITEM_HOT_UNPASSABLE;
+		if(type->pickupable) data.flags |= ITEM_HOT_PICKUPABLE;
+		if(type->moveable) data.flags |= ITEM_HOT_MOVEABLE;
+		if(type->stackable) data.flags |= ITEM_HOT_STACKABLE;
+		if(type->alwaysOnBottom) data.flags |= ITEM_HOT_ALWAYS_ON_BOTTOM;
+		if(type->isHangable) data.flags |= ITEM_HOT_HANGABLE;
+		if(type->hookSouth) data.flags |= ITEM_HOT_HOOK_SOUTH;
+		if(type->hookEast) data.flags |= ITEM_HOT_HOOK_EAST;
+		if(type->fullGround) data.flags |= ITEM_HOT_FULL_GROUND;
+		if(type->isBorder) data.flags |= ITEM_HOT_BORDER;
+		if(type->isOptionalBorder) data.flags |= ITEM_HOT_OPTIONAL_BORDER;
+		if(type->isTable) data.flags |= ITEM_HOT_TABLE;
+		if(type->isCarpet) data.flags |= ITEM_HOT_CARPET;
+		if(type->isContainer()) data.flags |= ITEM_HOT_CONTAINER;
+		if(type->isMetaItem()) data.flags |= ITEM_HOT_META_ITEM;
+		if(type->stackable || type->isSplash() || type->isFluidContainer()) data.flags |= ITEM_HOT_SUBTYPE;
+		if(type->isClientCharged() || type->isExtraCharged()) data.flags |= ITEM_HOT_CHARGED;
+	}
+	search_index.build(*this);
 }
 
 bool ItemDatabase::loadFromOtbVer1(BinaryNode* itemNode, wxString& error, wxArrayString& warnings)
@@ -713,19 +807,24 @@ bool ItemDatabase::loadFromOtbVer3(BinaryNode* itemNode, wxString& error, wxArra
 
 bool ItemDatabase::loadFromOtb(const FileName& datafile, wxString& error, wxArrayString& warnings)
 {
+	RME_TRACE_ZONE("load", "ItemDatabase::loadFromOtb");
 	std::string filename = nstr((datafile.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + datafile.GetFullName()));
-	DiskNodeFileReadHandle f(filename, StringVector(1, "OTBI"));
+	// Map the file if we can, fall back on buffered reads otherwise
+	std::unique_ptr<NodeFileReadHandle> f(newd MappedNodeFileReadHandle(filename, StringVector(1, "OTBI")));
+	if(f->error_code == FILE_COULD_NOT_OPEN) {
+		f.reset(newd DiskNodeFileReadHandle(filename, StringVector(1, "OTBI")));
+	}
 
-	if(!f.isOk()) {
-		error = "Couldn't open file \"" + wxstr(filename) + "\":" + wxstr(f.getErrorMessage());
+	if(!f->isOk()) {
+		error = "Couldn't open file \"" + wxstr(filename) + "\":" + wxstr(f->getErrorMessage());
 		return false;
 	}
 
-	BinaryNode* root = f.getRootNode();
+	BinaryNode* root = f->getRootNode();
 
 #define safe_get(node, func, ...) do {\
 		if(!node->get##func(__VA_ARGS__)) {\
-			error = wxstr(f.getErrorMessage()); \
+			error = wxstr(f->getErrorMessage()); \
 			return false; \
 		} \
 	} while(false)
@@ -751,7 +850,7 @@ bool ItemDatabase::loadFromOtb(const FileName& datafile, wxString& error, wxArra
 		csd.resize(128);
 
 		if(!root->getRAW((uint8_t*)csd.data(), 128)) { // CSDVersion ??
-			error = wxstr(f.getErrorMessage());
+			error = wxstr(f->getErrorMessage());
 			return false;
 		}
 	} else {
@@ -968,57 +1067,124 @@ bool ItemDatabase::loadFromGameXml(const FileName& identifier, wxString& error,
 	return true;
 }
 
-bool ItemDatabase::loadFromGameToml(const wxString& filename, wxString& error, wxArrayString& warnings)
+namespace
 {
-	try {
-		auto table = toml::parse_file(filename.ToStdString());
-		auto itemsArray = table["items"].as_array();
-		if (!itemsArray) {
-			error = "No 'items' array found in " + filename;
-			return false;
+	using TomlAttributeHandler = void (*)(ItemType* item, const toml::node& node);
+
+	void setTomlType(ItemType* item, const toml::node& node)
+	{
+		static const std::unordered_map<std::string_view, ItemTypes_t> types = {
+			{ "depot", ITEM_TYPE_DEPOT },
+			{ "mailbox", ITEM_TYPE_MAILBOX },
+			{ "trashholder", ITEM_TYPE_TRASHHOLDER },
+			{ "container", ITEM_TYPE_CONTAINER },
+			{ "door", ITEM_TYPE_DOOR },
+			{ "magicfield", ITEM_TYPE_MAGICFIELD },
+			{ "teleport", ITEM_TYPE_TELEPORT },
+			{ "bed", ITEM_TYPE_BED },
+			{ "key", ITEM_TYPE_KEY },
+		};
+		if (auto value = node.value<std::string_view>()) {
+			auto it = types.find(*value);
+			if (it != types.end()) {
+				item->type = it->second;
+				if (it->second == ITEM_TYPE_MAGICFIELD) {
+					item->group = ITEM_GROUP_MAGICFIELD;
+				}
+			}
 		}
+	}
 
-		for (const auto& itemNode : *itemsArray) {
-			auto* itemTable = itemNode.as_table();
-			if (!itemTable) {
-				warnings.push_back("Invalid item entry in " + filename);
-				continue;
+	void setTomlFloorChange(ItemType* item, const toml::node& node)
+	{
+		static const std::unordered_map<std::string_view, bool ItemType::*> directions = {
+			{ "down", &ItemType::floorChangeDown },
+			{ "north", &ItemType::floorChangeNorth },
+			{ "south", &ItemType::floorChangeSouth },
+			{ "west", &ItemType::floorChangeWest },
+			{ "east", &ItemType::floorChangeEast },
+		};
+		if (auto value = node.value<std::string_view>()) {
+			auto it = directions.find(*value);
+			if (it != directions.end()) {
+				item->*(it->second) = true;
+				item->floorChange = true;
 			}
+		}
+	}
 
-			auto idNode = (*itemTable)["id"];
-			if (!idNode || !idNode.is_integer()) {
-				warnings.push_back("Item missing 'id' or 'id' is not an integer in " + filename);
-				continue;
-			}
-			auto idValue = idNode.value<uint16_t>();
-			if (!idValue) {
-				warnings.push_back("Invalid 'id' value in " + filename);
-				continue;
+	// Handlers run in this order whatever the order of the keys in the file, some of them
+	// overwrite what an earlier one set
+	const std::pair<std::string_view, TomlAttributeHandler> TomlAttributeHandlers[] = {
+		{ "type", setTomlType },
+		{ "description", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<std::string>()) item->description = *value;
+		} },
+		{ "weight", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<int>()) item->weight = *value / 100.f;
+		} },
+		{ "armor", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<int>()) item->armor = *value;
+		} },
+		{ "defense", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<int>()) item->defense = *value;
+		} },
+		{ "rotateTo", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<uint16_t>()) item->rotateTo = *value;
+		} },
+		{ "containerSize", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<uint16_t>()) item->volume = *value;
+		} },
+		{ "readable", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<bool>()) item->canReadText = *value;
+		} },
+		{ "writeable", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<bool>()) item->canWriteText = item->canReadText = *value;
+		} },
+		{ "decayTo", [](ItemType* item, const toml::node&) {
+			item->decays = true;
+		} },
+		{ "maxtextlen", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<uint16_t>()) {
+				item->maxTextLen = *value;
+				item->canReadText = *value > 0;
 			}
-			uint16_t id = *idValue;
-			if (!isValidID(id)) {
-				warnings.push_back("Invalid item id: " + wxString::Format("%d", id) + " in " + filename);
-				continue;
-			}
-
-			ItemType* item = items[id];
-
-			if (auto nameNode = (*itemTable)["name"]) {
-				if (auto name = nameNode.value<std::string>()) {
-					item->name = *name;
-				}
+		} },
+		{ "allowDistRead", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<bool>()) item->allowDistRead = *value;
+		} },
+		{ "charges", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<uint32_t>()) {
+				item->charges = *value;
+				item->extra_chargeable = true;
 			}
-
-			if (auto articleNode = (*itemTable)["article"]) {
-				if (auto article = articleNode.value<std::string>()) {
-					item->article = *article;
-				}
+		} },
+		{ "floorchange", setTomlFloorChange },
+		{ "blockprojectile", [](ItemType* item, const toml::node& node) {
+			if (auto value = node.value<bool>()) item->blockMissiles = *value;
+		} },
+	};
+	constexpr size_t TomlAttributeCount = std::size(TomlAttributeHandlers);
+
+	size_t findTomlAttribute(std::string_view key)
+	{
+		static const std::unordered_map<std::string_view, size_t> indices = [] {
+			std::unordered_map<std::string_view, size_t> indices;
+			for (size_t i = 0; i < TomlAttributeCount; ++i) {
+				indices.emplace(TomlAttributeHandlers[i].first, i);
 			}
+			return indices;
+		}();
+		auto it = indices.find(key);
+		return it != indices.end() ? it->second : TomlAttributeCount;
+	}
+}
 
-			setItemAttributes(item, itemTable);
-		}
-
-		return true;
+bool ItemDatabase::loadFromGameToml(const wxString& filename, wxString& error, wxArrayString& warnings)
+{
+	try {
+		auto table = toml::parse_file(filename.ToStdString());
+		return applyGameToml(table, filename, error, warnings);
 	}
 	catch (const toml::parse_error& e) {
 		error = "Error parsing TOML file " + filename + ": " + e.what();
@@ -1026,96 +1192,76 @@ bool ItemDatabase::loadFromGameToml(const wxString& filename, wxString& error, w
 	}
 }
 
-void ItemDatabase::setItemAttributes(ItemType* item, const toml::table* attrs)
+bool ItemDatabase::applyGameToml(const toml::table& table, const wxString& filename, wxString& error, wxArrayString& warnings)
 {
-	if (!attrs) return;
+	auto itemsArray = table["items"].as_array();
+	if (!itemsArray) {
+		error = "No 'items' array found in " + filename;
+		return false;
+	}
 
-	if (auto type = attrs->get("type")) {
-		if (auto typeValue = type->value<std::string>()) {
-			std::string val = *typeValue;
-			if (val == "depot") item->type = ITEM_TYPE_DEPOT;
-			else if (val == "mailbox") item->type = ITEM_TYPE_MAILBOX;
-			else if (val == "trashholder") item->type = ITEM_TYPE_TRASHHOLDER;
-			else if (val == "container") item->type = ITEM_TYPE_CONTAINER;
-			else if (val == "door") item->type = ITEM_TYPE_DOOR;
-			else if (val == "magicfield") { item->group = ITEM_GROUP_MAGICFIELD; item->type = ITEM_TYPE_MAGICFIELD; }
-			else if (val == "teleport") item->type = ITEM_TYPE_TELEPORT;
-			else if (val == "bed") item->type = ITEM_TYPE_BED;
-			else if (val == "key") item->type = ITEM_TYPE_KEY;
+	for (const auto& itemNode : *itemsArray) {
+		auto* itemTable = itemNode.as_table();
+		if (!itemTable) {
+			warnings.push_back("Invalid item entry in " + filename);
+			continue;
 		}
-	}
-	if (auto description = attrs->get("description")) {
-		if (auto desc = description->value<std::string>()) item->description = *desc;
-	}
-	if (auto weight = attrs->get("weight")) {
-		if (auto w = weight->value<int>()) item->weight = *w / 100.f;
-	}
-	if (auto armor = attrs->get("armor")) {
-		if (auto a = armor->value<int>()) item->armor = *a;
-	}
-	if (auto defense = attrs->get("defense")) {
-		if (auto d = defense->value<int>()) item->defense = *d;
-	}
-	if (auto rotateTo = attrs->get("rotateTo")) {
-		if (auto r = rotateTo->value<uint16_t>()) item->rotateTo = *r;
-	}
-	if (auto containerSize = attrs->get("containerSize")) {
-		if (auto cs = containerSize->value<uint16_t>()) item->volume = *cs;
-	}
-	if (auto readable = attrs->get("readable")) {
-		if (auto r = readable->value<bool>()) item->canReadText = *r;
-	}
-	if (auto writeable = attrs->get("writeable")) {
-		if (auto w = writeable->value<bool>()) item->canWriteText = item->canReadText = *w;
-	}
-	if (attrs->contains("decayTo")) {
-		item->decays = true;
-	}
-	if (auto maxTextLen = attrs->get("maxtextlen")) {
-		if (auto mtl = maxTextLen->value<uint16_t>()) {
-			item->maxTextLen = *mtl;
-			item->canReadText = *mtl > 0;
+
+		auto idNode = (*itemTable)["id"];
+		if (!idNode || !idNode.is_integer()) {
+			warnings.push_back("Item missing 'id' or 'id' is not an integer in " + filename);
+			continue;
 		}
-	}
-	if (auto allowDistRead = attrs->get("allowDistRead")) {
-		if (auto adr = allowDistRead->value<bool>()) item->allowDistRead = *adr;
-	}
-	if (auto charges = attrs->get("charges")) {
-		if (auto c = charges->value<uint32_t>()) {
-			item->charges = *c;
-			item->extra_chargeable = true;
+		auto idValue = idNode.value<uint16_t>();
+		if (!idValue) {
+			warnings.push_back("Invalid 'id' value in " + filename);
+			continue;
 		}
-	}
-	if (auto floorchange = attrs->get("floorchange")) {
-		if (auto fc = floorchange->value<std::string>()) {
-			std::string value = *fc;
-			if (value == "down") {
-				item->floorChangeDown = true;
-				item->floorChange = true;
-			}
-			else if (value == "north") {
-				item->floorChangeNorth = true;
-				item->floorChange = true;
-			}
-			else if (value == "south") {
-				item->floorChangeSouth = true;
-				item->floorChange = true;
-			}
-			else if (value == "west") {
-				item->floorChangeWest = true;
-				item->floorChange = true;
+		uint16_t id = *idValue;
+		if (!isValidID(id)) {
+			warnings.push_back("Invalid item id: " + wxString::Format("%d", id) + " in " + filename);
+			continue;
+		}
+
+		ItemType* item = items[id];
+
+		if (auto nameNode = (*itemTable)["name"]) {
+			if (auto name = nameNode.value<std::string>()) {
+				item->name = *name;
 			}
-			else if (value == "east") {
-				item->floorChangeEast = true;
-				item->floorChange = true;
+		}
+
+		if (auto articleNode = (*itemTable)["article"]) {
+			if (auto article = articleNode.value<std::string>()) {
+				item->article = *article;
 			}
 		}
+
+		setItemAttributes(item, itemTable);
 	}
-	if (auto blockprojectile = attrs->get("blockprojectile")) {
-		if (auto bp = blockprojectile->value<bool>()) item->blockMissiles = *bp;
-	}
+	return true;
 }
 
+void ItemDatabase::setItemAttributes(ItemType* item, const toml::table* attrs)
+{
+	if (!attrs) return;
+
+	// One pass over the keys of the item, each known one is looked up once and its handler run
+	// after in the order of the table
+	const toml::node* found[TomlAttributeCount] = {};
+	for (const auto& [key, node] : *attrs) {
+		const size_t index = findTomlAttribute(key.str());
+		if (index < TomlAttributeCount) {
+			found[index] = &node;
+		}
+	}
+
+	for (size_t i = 0; i < TomlAttributeCount; ++i) {
+		if (found[i]) {
+			TomlAttributeHandlers[i].second(item, *found[i]);
+		}
+	}
+}
 
 bool ItemDatabase::loadFromGameTomlDir(const wxString& dirPath, wxString& error, wxArrayString& warnings)
 {
@@ -1125,20 +1271,53 @@ bool ItemDatabase::loadFromGameTomlDir(const wxString& dirPath, wxString& error,
 		return false;
 	}
 
+	wxArrayString filenames;
 	wxString filename;
-	bool found = false;
 	for (bool cont = dir.GetFirst(&filename, "*.toml", wxDIR_FILES); cont; cont = dir.GetNext(&filename)) {
-		found = true;
-		wxString fullPath = dirPath + wxFileName::GetPathSeparator() + filename;
-		if (!loadFromGameToml(fullPath, error, warnings)) {
+		filenames.push_back(dirPath + wxFileName::GetPathSeparator() + filename);
+	}
+	if (filenames.empty()) {
+		return false;
+	}
+	// Later files override earlier ones, so they are applied by name rather than in whatever
+	// order the directory lists them
+	filenames.Sort();
+
+	// The files are parsed side by side, the parser doesn't touch the database
+	struct ParsedFile {
+		std::string path;
+		toml::table table;
+		std::string error;
+	};
+	std::vector<ParsedFile> parsed(filenames.size());
+	for (size_t i = 0; i < filenames.size(); ++i) {
+		parsed[i].path = filenames[i].ToStdString();
+	}
+	ThreadPool::getInstance().parallelFor(parsed.size(), [&](size_t i) {
+		ParsedFile& file = parsed[i];
+		try {
+			file.table = toml::parse_file(file.path);
+		}
+		catch (const toml::parse_error& e) {
+			file.error = e.what();
+		}
+	});
+
+	for (size_t i = 0; i < parsed.size(); ++i) {
+		if (!parsed[i].error.empty()) {
+			error = "Error parsing TOML file " + filenames[i] + ": " + wxString(parsed[i].error);
+			return false;
+		}
+		if (!applyGameToml(parsed[i].table, filenames[i], error, warnings)) {
 			return false;
 		}
 	}
-	return found;
+	return true;
 }
 
 bool ItemDatabase::loadItems(const wxString& dataDir, wxString& error, wxArrayString& warnings)
 {
+	RME_TRACE_ZONE("load", "ItemDatabase::loadItems");
 	wxString tomlDir = dataDir + "items";
 	if (loadFromGameTomlDir(tomlDir, error, warnings)) {
 		return true;
@@ -1182,6 +1361,21 @@ ItemType* ItemDatabase::getRawItemType(uint16_t id)
 	return items[id];
 }
 
+RAWBrush* ItemDatabase::getRAWBrush(uint16_t id)
+{
+	ItemType* type = getRawItemType(id);
+	if(!type)
+		return nullptr;
+
+	if(!type->raw_brush && type->in_other_tileset) {
+		type->raw_brush = newd RAWBrush(id);
+		type->raw_brush->flagAsVisible();
+		type->has_raw = true;
+		g_brushes.addBrush(type->raw_brush);
+	}
+	return type->raw_brush;
+}
+
 bool ItemDatabase::isValidID(uint16_t id) const
 {
 	if(id == 0 || id > maxItemId)
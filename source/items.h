@@ -22,6 +22,7 @@
 #include "con_vector.h"
 #include "ext/pugixml.hpp"
 #include "filehandle.h"
+#include "item_search.h"
 #include <toml++/toml.hpp>
 #include <wx/arrstr.h>
 #include <wx/filename.h>
@@ -269,6 +270,8 @@ class ItemType {
 
 	bool isStackable() const noexcept { return stackable; }
 	bool isMetaItem() const noexcept { return is_metaitem; }
+	// Whether it has a RAW brush, made or not yet
+	bool hasRAWBrush() const noexcept { return raw_brush || in_other_tileset; }
 
 	bool isFloorChange() const noexcept;
 
@@ -285,6 +288,8 @@ class ItemType {
 	// using the same brushes ("others" category consists of items with this
 	// flag set to false)
 	bool has_raw;
+	// In the RAW category of the "Others" tileset, the RAW brush of these is
+	// only made once something asks for it
 	bool in_other_tileset;
 
 	uint16_t ground_equivalent;
@@ -356,18 +361,69 @@ class ItemType {
 	bool blockMissiles;
 	bool blockPathfinder;
 	bool hasElevation;
+	bool fullGround; // The sprite covers the whole square, nothing below it shows
 
 	int alwaysOnTopOrder;
 	uint16_t rotateTo;
 	BorderType border_alignment;
 };
 
+enum ItemHotFlags_t : uint32_t {
+	ITEM_HOT_UNPASSABLE = 1 << 0,
+	ITEM_HOT_PICKUPABLE = 1 << 1,
+	ITEM_HOT_MOVEABLE = 1 << 2,
+	ITEM_HOT_STACKABLE = 1 << 3,
+	ITEM_HOT_ALWAYS_ON_BOTTOM = 1 << 4,
+	ITEM_HOT_HANGABLE = 1 << 5,
+	ITEM_HOT_HOOK_SOUTH = 1 << 6,
+	ITEM_HOT_HOOK_EAST = 1 << 7,
+	ITEM_HOT_FULL_GROUND = 1 << 8,
+	ITEM_HOT_BORDER = 1 << 9,
+	ITEM_HOT_OPTIONAL_BORDER = 1 << 10,
+	ITEM_HOT_TABLE = 1 << 11,
+	ITEM_HOT_CARPET = 1 << 12,
+	ITEM_HOT_CONTAINER = 1 << 13,
+	ITEM_HOT_META_ITEM = 1 << 14,
+	ITEM_HOT_ANIMATED = 1 << 15,
+	ITEM_HOT_LIGHT = 1 << 16,
+	// Stackables, splashes and fluid containers, their subtype is saved as a count
+	ITEM_HOT_SUBTYPE = 1 << 17,
+	ITEM_HOT_CHARGED = 1 << 18,
+};
+
+// Copy of the ItemType fields read in the draw and tile update loops,
+// 16 bytes each so that four of them share a cache line
+struct ItemHotData {
+	GameSprite *sprite = nullptr;
+	uint32_t flags : 24 = 0;
+	uint32_t top_order : 8 = 0;
+	uint16_t ground_speed = 0;
+	uint8_t minimap_color = 0;
+	uint8_t group = ITEM_GROUP_NONE;
+
+	bool has(uint32_t flag) const noexcept { return (flags & flag) != 0; }
+	// Several properties in one test, e.g. hasAll<ITEM_HOT_PICKUPABLE |
+	// ITEM_HOT_STACKABLE>()
+	template <uint32_t Mask> bool hasAll() const noexcept {
+		static_assert(Mask < (1u << 24), "not an ItemHotFlags_t mask");
+		return (flags & Mask) == Mask;
+	}
+	template <uint32_t Mask> bool hasAny() const noexcept {
+		static_assert(Mask < (1u << 24), "not an ItemHotFlags_t mask");
+		return (flags & Mask) != 0;
+	}
+};
+static_assert(sizeof(ItemHotData) <= 16, "ItemHotData has to stay small");
+
 class ItemDatabase {
   public:
 	ItemDatabase();
 	~ItemDatabase();
 
 	void clear();
+	// Exchanges everything loaded with other, the item types keep their
+	// addresses
+	void swap(ItemDatabase &other);
 
 	void setMaxID(uint16_t id) { maxItemId = id; }
 
@@ -375,6 +431,22 @@ class ItemDatabase {
 	uint16_t getMaxID() const noexcept { return maxItemId; }
 	const ItemType &getItemType(uint16_t id) const;
 	ItemType *getRawItemType(uint16_t id);
+	// Makes the RAW brush of an item in the "Others" tileset the first time
+	// it's asked for, nullptr for the items without one. Main thread only.
+	RAWBrush *getRAWBrush(uint16_t id);
+	const ItemHotData &getHotData(uint16_t id) const noexcept {
+		return id < hot_data.size() ? hot_data[id] : hot_dummy;
+	}
+
+	// Has to be called again whenever the fields in ItemHotData change
+	// in the item types, the brushes set some of them while loading, so it
+	// runs once after the items are read and again after the brushes.
+	// The search index is made again along with it.
+	void updateHotData();
+	const ItemSearchIndex &getSearchIndex() const noexcept { return search_index; }
+	// Forgets what the brushes set in the item types, before the brushes are
+	// loaded again without the items
+	void clearBrushes();
 
 	bool isValidID(uint16_t id) const;
 
@@ -411,10 +483,15 @@ class ItemDatabase {
 	bool loadFromOtbVer3(BinaryNode *itemNode, wxString &error,
 						 wxArrayString &warnings);
 
+	bool applyGameToml(const toml::table &table, const wxString &filename,
+					   wxString &error, wxArrayString &warnings);
 	void setItemAttributes(ItemType *item, const toml::table *attrs);
 
   protected:
 	ItemMap items;
+	std::vector<ItemHotData> hot_data;
+	ItemHotData hot_dummy;
+	ItemSearchIndex search_index;
 
 	// Count of GameSprite types
 	uint16_t item_count;
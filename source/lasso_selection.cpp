@@ -19,6 +19,7 @@
 #include "main.h"
 #include <algorithm>
 #include <cmath>
+#include <map>
 
 LassoSelection::LassoSelection()
 	: m_active(false), m_closed(false),
@@ -146,20 +147,69 @@ double LassoSelection::perpendicularDistance(const LassoPoint &point,
 std::vector<Position> LassoSelection::getTilesInPolygon(int floor) const {
 	std::vector<Position> tiles;
 
+	const std::vector<LassoSpan> spans = getSpansInPolygon();
+	size_t count = 0;
+	for (const LassoSpan &span : spans) {
+		count += span.x1 - span.x0 + 1;
+	}
+
+	tiles.reserve(count);
+	for (const LassoSpan &span : spans) {
+		for (int x = span.x0; x <= span.x1; ++x) {
+			tiles.emplace_back(x, span.y, floor);
+		}
+	}
+	return tiles;
+}
+
+std::vector<LassoSpan> LassoSelection::getSpansInPolygon() const {
+	std::vector<LassoSpan> spans;
+
 	if (!m_closed || m_path.size() < 3) {
-		return tiles;
+		return spans;
 	}
 
-	// OPTIMIZATION: Pre-reserve memory based on bounding box area estimate
 	if (m_boundingBox.isValid()) {
-		int estimatedTiles =
-			(m_boundingBox.width() + 1) * (m_boundingBox.height() + 1);
-		// Estimate ~50% fill ratio for most polygon shapes
-		tiles.reserve(estimatedTiles / 2);
+		spans.reserve(m_boundingBox.height() + 1);
 	}
 
-	scanlineFillAET(floor, tiles);
-	return tiles;
+	scanlineFillAET(spans);
+	return spans;
+}
+
+std::vector<LassoLeaf> LassoSelection::getLeavesInPolygon() const {
+	std::vector<LassoLeaf> leaves;
+
+	const std::vector<LassoSpan> spans = getSpansInPolygon();
+	std::map<int, uint16_t> band;
+	size_t first = 0;
+	while (first < spans.size()) {
+		// The spans are in row order, the rows of a band are next to each
+		// other
+		const int band_y = spans[first].y & ~3;
+		size_t last = first;
+		for (; last < spans.size() && (spans[last].y & ~3) == band_y; ++last) {
+			const LassoSpan &span = spans[last];
+			const int x0 = std::max(span.x0, 0);
+			for (int leaf_x = x0 & ~3; leaf_x <= span.x1; leaf_x += 4) {
+				const int from = std::max(x0, leaf_x) - leaf_x;
+				const int to = std::min(span.x1, leaf_x + 3) - leaf_x;
+				uint16_t &mask = band[leaf_x];
+				for (int lx = from; lx <= to; ++lx) {
+					mask |= 1 << (lx * 4 + (span.y & 3));
+				}
+			}
+		}
+
+		if (band_y >= 0) {
+			for (const auto &leaf : band) {
+				leaves.emplace_back(leaf.first, band_y, leaf.second);
+			}
+		}
+		band.clear();
+		first = last;
+	}
+	return leaves;
 }
 
 void LassoSelection::buildEdgeTable(
@@ -207,8 +257,7 @@ void LassoSelection::buildEdgeTable(
 	}
 }
 
-void LassoSelection::scanlineFillAET(int floor,
-									 std::vector<Position> &tiles) const {
+void LassoSelection::scanlineFillAET(std::vector<LassoSpan> &spans) const {
 	// Use simplified path for the polygon
 	const std::vector<LassoPoint> &poly =
 		m_simplifiedPath.empty() ? m_path : m_simplifiedPath;
@@ -263,8 +312,8 @@ void LassoSelection::scanlineFillAET(int floor,
 			int xStart = static_cast<int>(std::ceil(activeEdges[i].x));
 			int xEnd = static_cast<int>(std::floor(activeEdges[i + 1].x));
 
-			for (int x = xStart; x <= xEnd; ++x) {
-				tiles.emplace_back(x, y, floor);
+			if (xStart <= xEnd) {
+				spans.emplace_back(y, xStart, xEnd);
 			}
 		}
 
@@ -102,6 +102,25 @@ struct LassoEdge {
 		: yMax(yMax), x(x), invSlope(invSlope) {}
 };
 
+// Run of tiles of one row inside the polygon, x0 to x1 inclusive
+struct LassoSpan {
+	int y;
+	int x0;
+	int x1;
+
+	LassoSpan(int y, int x0, int x1) : y(y), x0(x0), x1(x1) {}
+};
+
+// Tiles of one map leaf inside the polygon, x/y is the first tile of the leaf
+// and the bits of the mask follow the tiles of a Floor, (x & 3) * 4 + (y & 3)
+struct LassoLeaf {
+	int x;
+	int y;
+	uint16_t mask;
+
+	LassoLeaf(int x, int y, uint16_t mask) : x(x), y(y), mask(mask) {}
+};
+
 // Lasso selection mode
 enum class LassoMode {
 	Replace, // Replace current selection
@@ -131,6 +150,11 @@ class LassoSelection {
 
 	// Get tiles inside the lasso polygon
 	std::vector<Position> getTilesInPolygon(int floor) const;
+	// The same tiles as runs of each row, top to bottom
+	std::vector<LassoSpan> getSpansInPolygon() const;
+	// The same tiles grouped by leaf, a band of 4 rows at a time from left to
+	// right, so large areas cost a mask per leaf instead of a Position per tile
+	std::vector<LassoLeaf> getLeavesInPolygon() const;
 
 	// Configuration
 	void setMinPointDistance(double dist) { m_minPointDistance = dist; }
@@ -146,7 +170,7 @@ class LassoSelection {
 								 const LassoPoint &lineEnd) const;
 
 	// Optimized scanline fill using Active Edge Table (AET)
-	void scanlineFillAET(int floor, std::vector<Position> &tiles) const;
+	void scanlineFillAET(std::vector<LassoSpan> &spans) const;
 
 	// Build edge table for AET algorithm
 	void buildEdgeTable(std::vector<std::vector<LassoEdge>> &edgeTable,
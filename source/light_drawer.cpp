@@ -17,6 +17,13 @@
 
 #include "main.h"
 #include "light_drawer.h"
+#include "frame_profiler.h"
+#include "gui.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RME_LIGHT_SSE2
+#include <emmintrin.h>
+#endif
 
 LightDrawer::LightDrawer()
 {
@@ -24,6 +31,11 @@ LightDrawer::LightDrawer()
 	buffer.resize(static_cast<size_t>(rme::ClientMapWidth * rme::ClientMapHeight * rme::PixelFormatRGBA));
 	global_color = wxColor(50, 50, 50, 255);
 
+	for (size_t i = 0; i < color_table.size(); ++i) {
+		const wxColor color = colorFromEightBit(static_cast<int>(i));
+		color_table[i] = LightColor{ static_cast<float>(color.Red()), static_cast<float>(color.Green()), static_cast<float>(color.Blue()) };
+	}
+
 	createGLTexture();
 }
 
@@ -36,36 +48,19 @@ LightDrawer::~LightDrawer()
 
 void LightDrawer::draw(int map_x, int map_y, int scroll_x, int scroll_y)
 {
-	constexpr int half_tile_size = rme::TileSize / 2;
-
-	for (int x = 0; x < rme::ClientMapWidth; ++x) {
-		for (int y = 0; y < rme::ClientMapHeight; ++y) {
-			int mx = (map_x + x);
-			int my = (map_y + y);
-			int px = (mx * rme::TileSize + half_tile_size);
-			int py = (my * rme::TileSize + half_tile_size);
-			int index = (y * rme::ClientMapWidth + x);
-			int color_index = index * rme::PixelFormatRGBA;
-
-			buffer[color_index]	 = global_color.Red();
-			buffer[color_index + 1] = global_color.Green();
-			buffer[color_index + 2] = global_color.Blue();
-			buffer[color_index + 3] = global_color.Alpha();
-
-			for (auto& light : lights) {
-				float intensity = calculateIntensity(mx, my, light);
-				if (intensity == 0.f) {
-					continue;
-				}
-				wxColor light_color = colorFromEightBit(light.color);
-				uint8_t red = static_cast<uint8_t>(light_color.Red() * intensity);
-				uint8_t green = static_cast<uint8_t>(light_color.Green() * intensity);
-				uint8_t blue = static_cast<uint8_t>(light_color.Blue() * intensity);
-				buffer[color_index]	 = std::max(buffer[color_index], red);
-				buffer[color_index + 1] = std::max(buffer[color_index + 1], green);
-				buffer[color_index + 2] = std::max(buffer[color_index + 2], blue);
-			}
-		}
+	ProfileScope scope(FrameProfiler::SECTION_LIGHTS);
+
+	if (drawShaded(map_x, map_y, scroll_x, scroll_y)) {
+		return;
+	}
+
+	const uint8_t global[rme::PixelFormatRGBA] = { global_color.Red(), global_color.Green(), global_color.Blue(), global_color.Alpha() };
+	for (size_t i = 0; i < buffer.size(); i += rme::PixelFormatRGBA) {
+		memcpy(&buffer[i], global, rme::PixelFormatRGBA);
+	}
+
+	for (const auto& light : lights) {
+		drawLight(map_x, map_y, light);
 	}
 
 	const int draw_x = map_x * rme::TileSize - scroll_x;
@@ -73,6 +68,8 @@ void LightDrawer::draw(int map_x, int map_y, int scroll_x, int scroll_y)
 	constexpr int draw_width = rme::ClientMapWidth * rme::TileSize;
 	constexpr int draw_height = rme::ClientMapHeight * rme::TileSize;
 
+	g_profiler.count(FrameProfiler::COUNTER_TEXTURE_BINDS);
+	g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS);
 	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -94,6 +91,108 @@ void LightDrawer::draw(int map_x, int map_y, int scroll_x, int scroll_y)
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
+bool LightDrawer::drawShaded(int map_x, int map_y, int scroll_x, int scroll_y)
+{
+	ShaderLightRenderer* renderer = g_gui.gfx.getLightRenderer();
+	if (!renderer) {
+		return false;
+	}
+
+	// A quad over the reach of every light, centered on its square
+	constexpr float half_tile = rme::TileSize / 2.f;
+	vertices.clear();
+	vertices.reserve(lights.size() * 4);
+	for (const auto& light : lights) {
+		if (light.intensity == 0) {
+			continue;
+		}
+		const LightColor& color = color_table[light.color];
+		const float center_x = light.map_x * rme::TileSize - scroll_x + half_tile;
+		const float center_y = light.map_y * rme::TileSize - scroll_y + half_tile;
+		const float reach = light.intensity * static_cast<float>(rme::TileSize);
+		const float reach_x[4] = { -reach, reach, reach, -reach };
+		const float reach_y[4] = { -reach, -reach, reach, reach };
+		for (int corner = 0; corner < 4; ++corner) {
+			vertices.push_back(ShaderLightRenderer::Vertex {
+				center_x + reach_x[corner], center_y + reach_y[corner],
+				center_x, center_y,
+				static_cast<float>(light.intensity),
+				static_cast<uint8_t>(color.red), static_cast<uint8_t>(color.green), static_cast<uint8_t>(color.blue), 255
+			});
+		}
+	}
+
+	const float draw_x = static_cast<float>(map_x * rme::TileSize - scroll_x);
+	const float draw_y = static_cast<float>(map_y * rme::TileSize - scroll_y);
+	constexpr float draw_width = rme::ClientMapWidth * rme::TileSize;
+	constexpr float draw_height = rme::ClientMapHeight * rme::TileSize;
+	return renderer->draw(vertices, global_color, draw_x, draw_y, draw_width, draw_height, static_cast<float>(rme::TileSize));
+}
+
+void LightDrawer::drawLight(int map_x, int map_y, const Light& light)
+{
+	// A light never reaches further than its intensity
+	const int start_x = std::max(0, light.map_x - light.intensity - map_x);
+	const int end_x = std::min(rme::ClientMapWidth - 1, light.map_x + light.intensity - map_x);
+	const int start_y = std::max(0, light.map_y - light.intensity - map_y);
+	const int end_y = std::min(rme::ClientMapHeight - 1, light.map_y + light.intensity - map_y);
+	if (start_x > end_x || start_y > end_y) {
+		return;
+	}
+
+	const LightColor& color = color_table[light.color];
+
+#ifdef RME_LIGHT_SSE2
+	const __m128 light_intensity = _mm_set1_ps(light.intensity);
+	const __m128 max_distance = _mm_set1_ps(rme::MaxLightIntensity);
+	const __m128 min_intensity = _mm_set1_ps(0.01f);
+	const __m128 scale = _mm_set1_ps(0.2f);
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 red = _mm_set1_ps(color.red);
+	const __m128 green = _mm_set1_ps(color.green);
+	const __m128 blue = _mm_set1_ps(color.blue);
+	const __m128 steps = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+#endif
+
+	for (int y = start_y; y <= end_y; ++y) {
+		const int dy = map_y + y - light.map_y;
+		uint8_t* row = &buffer[y * rme::ClientMapWidth * rme::PixelFormatRGBA];
+		int x = start_x;
+
+#ifdef RME_LIGHT_SSE2
+		// Four cells at a time, the same math as calculateIntensity
+		const __m128 dy2 = _mm_set1_ps(static_cast<float>(dy * dy));
+		for (; x + 3 <= end_x; x += 4) {
+			const __m128 dx = _mm_add_ps(_mm_set1_ps(static_cast<float>(map_x + x - light.map_x)), steps);
+			const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2));
+			__m128 intensity = _mm_mul_ps(_mm_sub_ps(light_intensity, distance), scale);
+			const __m128 lit = _mm_and_ps(_mm_cmple_ps(distance, max_distance), _mm_cmpge_ps(intensity, min_intensity));
+			intensity = _mm_and_ps(_mm_min_ps(intensity, one), lit);
+
+			const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(red, intensity));
+			const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(green, intensity));
+			const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(blue, intensity));
+			// RGB in the low bytes of each pixel, alpha stays as it is
+			const __m128i pixels = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(b, 16)));
+
+			__m128i* target = reinterpret_cast<__m128i*>(row + x * rme::PixelFormatRGBA);
+			_mm_storeu_si128(target, _mm_max_epu8(_mm_loadu_si128(target), pixels));
+		}
+#endif
+
+		for (; x <= end_x; ++x) {
+			float intensity = calculateIntensity(map_x + x, map_y + y, light);
+			if (intensity == 0.f) {
+				continue;
+			}
+			uint8_t* pixel = row + x * rme::PixelFormatRGBA;
+			pixel[0] = std::max(pixel[0], static_cast<uint8_t>(color.red * intensity));
+			pixel[1] = std::max(pixel[1], static_cast<uint8_t>(color.green * intensity));
+			pixel[2] = std::max(pixel[2], static_cast<uint8_t>(color.blue * intensity));
+		}
+	}
+}
+
 void LightDrawer::setGlobalLightColor(uint8_t color)
 {
 	global_color = colorFromEightBit(color);
@@ -21,6 +21,8 @@
 #include "graphics.h"
 #include "position.h"
 
+#include <array>
+
 class LightDrawer
 {
 	struct Light {
@@ -30,6 +32,12 @@ class LightDrawer
 		uint8_t intensity = 0;
 	};
 
+	struct LightColor {
+		float red = 0.f;
+		float green = 0.f;
+		float blue = 0.f;
+	};
+
 public:
 	LightDrawer();
 	virtual ~LightDrawer();
@@ -41,9 +49,15 @@ public:
 	void clear() noexcept;
 
 private:
+	// The light map through the light shaders, false if they can't be used
+	bool drawShaded(int map_x, int map_y, int scroll_x, int scroll_y);
+
 	void createGLTexture();
 	void unloadGLTexture();
 
+	// Brightens the cells in reach of the light, map_x / map_y is the top left cell of the buffer
+	void drawLight(int map_x, int map_y, const Light& light);
+
 	inline float calculateIntensity(int map_x, int map_y, const Light& light) {
 		int dx = map_x - light.map_x;
 		int dy = map_y - light.map_y;
@@ -61,7 +75,10 @@ private:
 	GLuint texture;
 	std::vector<Light> lights;
 	std::vector<uint8_t> buffer;
+	std::vector<ShaderLightRenderer::Vertex> vertices;
 	wxColor global_color;
+	// colorFromEightBit for every light color
+	std::array<LightColor, 256> color_table;
 };
 
 #endif
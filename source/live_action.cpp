@@ -61,6 +61,7 @@ void NetworkedBatchAction::addAndCommitAction(Action* action)
 	// Add it!
 	action->commit(type != ACTION_SELECT? &dirty_list : nullptr);
 	batch.push_back(action);
+	memory_size += sizeof(Action*) + action->memsize();
 	timestamp = time(nullptr);
 
 	// Broadcast changes!
@@ -75,7 +76,7 @@ void NetworkedBatchAction::commit()
 	for(ActionVector::iterator it = batch.begin(); it != batch.end(); ++it) {
 		NetworkedAction* action = static_cast<NetworkedAction*>(*it);
 		if(!action->isCommited()) {
-			action->commit(type != ACTION_SELECT? &dirty_list : nullptr);
+			commitAction(action, type != ACTION_SELECT? &dirty_list : nullptr);
 			if(action->owner != 0)
 				dirty_list.owner = action->owner;
 		}
@@ -90,7 +91,7 @@ void NetworkedBatchAction::undo()
 	DirtyList dirty_list;
 
 	for(ActionVector::reverse_iterator it = batch.rbegin(); it != batch.rend(); ++it) {
-		(*it)->undo(type != ACTION_SELECT? &dirty_list : nullptr);
+		undoAction(*it, type != ACTION_SELECT? &dirty_list : nullptr);
 	}
 	// Broadcast changes!
 	queue.broadcast(dirty_list);
@@ -21,12 +21,30 @@
 #include "live_tab.h"
 #include "live_action.h"
 #include "editor.h"
+#include "tracing.h"
 
 #include <wx/event.h>
 
+// Packets parsed per event loop pass, so a burst of nodes does not stall the UI
+static constexpr size_t LiveReceiveBatchSize = 16;
+// Nodes asked for at once, the rest waits until some have arrived
+static constexpr size_t LiveMaxNodeRequests = 96;
+// How many nodes beyond the edge of the view are requested in the scroll direction
+static constexpr int LivePrefetchNodes = 2;
+// Tries to resume the session before giving up on a dropped connection
+static constexpr int LiveReconnectAttempts = 3;
+// Identifies the node cache files, the version is bumped when their layout changes
+static constexpr uint32_t LiveNodeCacheMagic = 0x4C454D52; // "RMEL"
+static constexpr uint32_t LiveNodeCacheVersion = 1;
+// Calls of checkIntegrity, once a second from the live tab, between the hashes sent to the server
+static constexpr int LiveIntegrityInterval = 30;
+
 LiveClient::LiveClient() : LiveSocket(),
-	readMessage(), queryNodeList(), currentOperation(),
-	resolver(nullptr), socket(nullptr), editor(nullptr), stopped(false)
+	readMessage(), queryNodeList(), requestedNodes(),
+	viewStartX(0), viewStartY(0), viewEndX(-1), viewEndY(-1), viewFloor(rme::MapGroundLayer), scrollX(0), scrollY(0),
+	sentStartX(-1), sentStartY(-1), sentEndX(-1), sentEndY(-1), sentFloor(-1),
+	currentOperation(), journalSession(0), journalSequence(0), resyncPending(false), integrityTicks(0), address(), port(0), reconnectAttempts(0),
+	resolver(nullptr), socket(nullptr), strand(nullptr), editor(nullptr), stopped(false)
 {
 	//
 }
@@ -53,6 +71,13 @@ bool LiveClient::connect(const std::string& address, uint16_t port)
 		socket = std::make_shared<asio::ip::tcp::socket>(service);
 	}
 
+	if(!strand) {
+		strand = std::make_shared<asio::strand<asio::io_context::executor_type>>(connection.make_strand());
+	}
+
+	this->address = address;
+	this->port = port;
+
 	asio::ip::tcp::resolver::query query(address, std::to_string(port));
 	resolver->async_resolve(query, [this](const std::error_code& error, asio::ip::tcp::resolver::iterator endpoint_iterator) -> void
 	{
@@ -131,6 +156,10 @@ void LiveClient::tryConnect(asio::ip::tcp::resolver::iterator endpoint_iterator)
 
 void LiveClient::close()
 {
+	if(!stopped) {
+		saveNodeCache();
+	}
+
 	if(resolver) {
 		resolver->cancel();
 	}
@@ -153,7 +182,9 @@ bool LiveClient::handleError(const std::error_code& error)
 	if(error == asio::error::eof || error == asio::error::connection_reset) {
 		wxTheApp->CallAfter([this]() {
 			log->Message(wxString() + getHostName() + ": disconnected.");
-			close();
+			if(!reconnect()) {
+				close();
+			}
 		});
 		return true;
 	} else if(error == asio::error::connection_aborted) {
@@ -163,6 +194,28 @@ bool LiveClient::handleError(const std::error_code& error)
 	return false;
 }
 
+bool LiveClient::reconnect()
+{
+	if(stopped || !editor || !testFlags(features, LIVE_FEATURE_JOURNAL) || reconnectAttempts >= LiveReconnectAttempts) {
+		return false;
+	}
+	++reconnectAttempts;
+	log->Message("Resuming the session (attempt " + std::to_string(reconnectAttempts) + ")...");
+
+	// The answers to these went down with the connection, they are queried again when drawn
+	for(uint32_t nd : requestedNodes) {
+		QTreeNode* node = editor->getMap().getLeaf((nd >> 18) * 4, ((nd >> 4) & 0x3FFF) * 4);
+		if(node) {
+			node->setRequested(nd & 1, false);
+		}
+	}
+	requestedNodes.clear();
+
+	// async_connect opens the socket again
+	socket->close();
+	return connect(address, port);
+}
+
 std::string LiveClient::getHostName() const
 {
 	if(!socket) {
@@ -174,9 +227,10 @@ std::string LiveClient::getHostName() const
 void LiveClient::receiveHeader()
 {
 	readMessage.position = 0;
+	readMessage.inflated = false;
 	asio::async_read(*socket,
 		asio::buffer(readMessage.buffer, 4),
-		[this](const std::error_code& error, size_t bytesReceived) -> void {
+		asio::bind_executor(*strand, [this](const std::error_code& error, size_t bytesReceived) -> void {
 			if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
@@ -186,7 +240,7 @@ void LiveClient::receiveHeader()
 			} else {
 				receive(readMessage.read<uint32_t>());
 			}
-		}
+		})
 	);
 }
 
@@ -195,7 +249,7 @@ void LiveClient::receive(uint32_t packetSize)
 	readMessage.buffer.resize(readMessage.position + packetSize);
 	asio::async_read(*socket,
 		asio::buffer(&readMessage.buffer[readMessage.position], packetSize),
-		[this](const std::error_code& error, size_t bytesReceived) -> void {
+		asio::bind_executor(*strand, [this](const std::error_code& error, size_t bytesReceived) -> void {
 			if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
@@ -203,25 +257,70 @@ void LiveClient::receive(uint32_t packetSize)
 			} else if(bytesReceived < readMessage.buffer.size() - 4) {
 				logMessage(wxString() + getHostName() + ": Could not receive packet[size: " + std::to_string(bytesReceived) + "], disconnecting client.");
 			} else {
-				wxTheApp->CallAfter([this]() {
-					parsePacket(std::move(readMessage));
-					receiveHeader();
-				});
+				RME_TRACE_ZONE("live", "LiveClient::receive");
+				const size_t wireSize = readMessage.buffer.size();
+				inflateMessage(readMessage);
+				countReceived(readMessage, wireSize);
+				queueMessage();
 			}
-		}
+		})
 	);
 }
 
+void LiveClient::queueMessage()
+{
+	if(!queueReceived(readMessage)) {
+		return;
+	}
+
+	if(!drainPending.exchange(true)) {
+		wxTheApp->CallAfter([this]() {
+			drainMessages();
+		});
+	}
+	receiveHeader();
+}
+
+void LiveClient::drainMessages()
+{
+	RME_TRACE_ZONE("live", "LiveClient::drainMessages");
+	drainPending = false;
+	for(size_t count = 0; count < LiveReceiveBatchSize; ++count) {
+		NetworkMessage* message = receivedMessages.front();
+		if(!message) {
+			break;
+		}
+
+		parsePacket(*message);
+		popReceived();
+	}
+
+	if(!receivedMessages.empty() && !drainPending.exchange(true)) {
+		wxTheApp->CallAfter([this]() {
+			drainMessages();
+		});
+	}
+
+	if(takeStalledRead()) {
+		asio::post(*strand, [this]() {
+			queueMessage();
+		});
+	}
+}
+
 void LiveClient::send(NetworkMessage& message)
 {
-	memcpy(&message.buffer[0], &message.size, 4);
+	RME_TRACE_ZONE("live", "LiveClient::send");
+	const uint8_t type = message.buffer[4];
+	auto buffer = encodeMessage(std::move(message), testFlags(features, LIVE_FEATURE_COMPRESSION));
+	traffic.sent(type, buffer->size());
 	asio::async_write(*socket,
-		asio::buffer(message.buffer, message.size + 4),
-		[this](const std::error_code& error, size_t bytesTransferred) -> void {
+		asio::buffer(*buffer),
+		asio::bind_executor(*strand, [this, buffer](const std::error_code& error, size_t bytesTransferred) -> void {
 			if(error) {
 				logMessage(wxString() + getHostName() + ": " + error.message());
 			}
-		}
+		})
 	);
 }
 
@@ -275,30 +374,70 @@ void LiveClient::sendHello()
 	message.write<uint32_t>(g_gui.GetCurrentVersionID());
 	message.write<std::string>(nstr(name));
 	message.write<std::string>(nstr(password));
+	message.write<uint32_t>(LIVE_FEATURES_SUPPORTED);
 
 	send(message);
 }
 
 void LiveClient::sendNodeRequests()
 {
-	if(queryNodeList.empty()) {
+	if(queryNodeList.empty() || requestedNodes.size() >= LiveMaxNodeRequests) {
 		return;
 	}
 
+	const int startX = (viewStartX >> 2) - LivePrefetchNodes;
+	const int startY = (viewStartY >> 2) - LivePrefetchNodes;
+	const int endX = (viewEndX >> 2) + LivePrefetchNodes;
+	const int endY = (viewEndY >> 2) + LivePrefetchNodes;
+	const int centerX = (startX + endX) / 2;
+	const int centerY = (startY + endY) / 2;
+	const bool underground = viewFloor > rme::MapGroundLayer;
+
+	// Nodes scrolled out of view are forgotten, they are queried again once drawn
+	std::vector<std::pair<int64_t, uint32_t>> nodes;
+	for(auto it = queryNodeList.begin(); it != queryNodeList.end();) {
+		const uint32_t nd = *it;
+		const int ndx = nd >> 18;
+		const int ndy = (nd >> 4) & 0x3FFF;
+		if(ndx < startX || ndx > endX || ndy < startY || ndy > endY) {
+			QTreeNode* node = editor->getMap().getLeaf(ndx * 4, ndy * 4);
+			if(node) {
+				node->setRequested(nd & 1, false);
+			}
+			it = queryNodeList.erase(it);
+			continue;
+		}
+
+		// The floors being looked at go first, then the nodes nearest the centre of the view
+		const int64_t distance = static_cast<int64_t>(ndx - centerX) * (ndx - centerX) + static_cast<int64_t>(ndy - centerY) * (ndy - centerY);
+		nodes.emplace_back(((nd & 1) == underground ? 0 : (static_cast<int64_t>(1) << 40)) + distance, nd);
+		++it;
+	}
+
+	if(nodes.empty()) {
+		return;
+	}
+
+	const size_t count = std::min(nodes.size(), LiveMaxNodeRequests - requestedNodes.size());
+	std::partial_sort(nodes.begin(), nodes.begin() + count, nodes.end());
+
 	NetworkMessage message;
 	message.write<uint8_t>(PACKET_REQUEST_NODES);
 
-	message.write<uint32_t>(queryNodeList.size());
-	for(uint32_t node : queryNodeList) {
-		message.write<uint32_t>(node);
+	message.write<uint32_t>(count);
+	for(size_t i = 0; i < count; ++i) {
+		const uint32_t nd = nodes[i].second;
+		message.write<uint32_t>(nd);
+		requestedNodes.insert(nd);
+		queryNodeList.erase(nd);
 	}
 
 	send(message);
-	queryNodeList.clear();
 }
 
 void LiveClient::sendChanges(DirtyList& dirtyList)
 {
+	RME_TRACE_ZONE("live", "LiveClient::sendChanges");
 	ChangeList& changeList = dirtyList.GetChanges();
 	if(changeList.empty()) {
 		return;
@@ -308,7 +447,7 @@ void LiveClient::sendChanges(DirtyList& dirtyList)
 	for(Change* change : changeList) {
 		switch (change->getType()) {
 			case CHANGE_TILE: {
-				const Position& position = static_cast<Tile*>(change->getData())->getPosition();
+				const Position& position = change->getPosition();
 				sendTile(mapWriter, editor->getMap().getTile(position), &position);
 				break;
 			}
@@ -321,9 +460,217 @@ void LiveClient::sendChanges(DirtyList& dirtyList)
 	NetworkMessage message;
 	message.write<uint8_t>(PACKET_CHANGE_LIST);
 
-	std::string data(reinterpret_cast<const char*>(mapWriter.getMemory()), mapWriter.getSize());
-	message.write<std::string>(data);
+	message.write<std::string_view>(std::string_view(reinterpret_cast<const char*>(mapWriter.getMemory()), mapWriter.getSize()));
+
+	send(message);
+}
+
+void LiveClient::sendChangesSince()
+{
+	if(!testFlags(features, LIVE_FEATURE_JOURNAL)) {
+		return;
+	}
+
+	std::vector<uint32_t> nodes;
+	editor->getMap().visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&nodes](QTreeNode* leaf, int x, int y) {
+		const uint32_t nd = ((x >> 2) << 18) | ((y >> 2) << 4);
+		for(bool underground : { false, true }) {
+			if(leaf->isVisible(underground)) {
+				nodes.push_back(nd | (underground ? 1 : 0));
+			}
+		}
+	});
+
+	resyncPending = true;
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_REQUEST_CHANGES_SINCE);
+	message.write<uint32_t>(journalSession);
+	message.write<uint64_t>(journalSequence);
+	message.writeArray(nodes);
+	send(message);
+}
+
+wxString LiveClient::getNodeCachePath() const
+{
+	std::string host = address + "_" + std::to_string(port);
+	for(char& c : host) {
+		if(!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-') {
+			c = '_';
+		}
+	}
+
+	FileName path = g_gui.GetLocalDirectory();
+	path.AppendDir("live_cache");
+	path.Mkdir(0755, wxPATH_MKDIR_FULL);
+	path.SetFullName(wxstr(host) + ".cache");
+	return path.GetFullPath();
+}
+
+bool LiveClient::loadNodeCache(uint32_t session)
+{
+	FileReadHandle file(nstr(getNodeCachePath()));
+	if(!file.isOk()) {
+		return false;
+	}
+
+	uint32_t magic, version, cacheSession, count;
+	uint64_t sequence;
+	if(!file.getU32(magic) || magic != LiveNodeCacheMagic || !file.getU32(version) || version != LiveNodeCacheVersion) {
+		return false;
+	}
+
+	// The host was restarted since, its sequence numbers start over
+	if(!file.getU32(cacheSession) || cacheSession != session || !file.getU64(sequence) || !file.getU32(count)) {
+		return false;
+	}
+
+	Map& map = editor->getMap();
+	Action* action = editor->createAction(ACTION_REMOTE);
+	uint32_t loaded = 0;
+	for(; loaded < count; ++loaded) {
+		uint32_t size;
+		if(!file.getU32(size)) {
+			break;
+		}
+
+		NetworkMessage message;
+		message.buffer.resize(4 + size);
+		if(!file.getRAW(&message.buffer[4], size)) {
+			break;
+		}
+		message.size = size;
+
+		if(size < 5 || message.read<uint8_t>() != PACKET_NODE) {
+			break;
+		}
+
+		const uint32_t ind = message.read<uint32_t>();
+		const int32_t ndx = ind >> 18;
+		const int32_t ndy = (ind >> 4) & 0x3FFF;
+		map.createLeaf(ndx * 4, ndy * 4);
+		receiveNode(message, *editor, action, ndx, ndy, ind & 1);
+	}
+	editor->addAction(action);
+
+	journalSession = session;
+	journalSequence = sequence;
+
+	log->Message("Loaded " + std::to_string(loaded) + " cached nodes.");
+	return true;
+}
+
+void LiveClient::saveNodeCache()
+{
+	// Only a complete state is worth keeping, a half applied resync would be taken for up to date
+	if(!editor || !testFlags(features, LIVE_FEATURE_JOURNAL) || journalSession == 0 || resyncPending) {
+		return;
+	}
+
+	std::vector<std::pair<QTreeNode*, uint32_t>> nodes;
+	editor->getMap().visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&nodes](QTreeNode* leaf, int x, int y) {
+		const uint32_t nd = ((x >> 2) << 18) | ((y >> 2) << 4);
+		for(bool underground : { false, true }) {
+			if(leaf->isVisible(underground)) {
+				nodes.emplace_back(leaf, nd | (underground ? 1 : 0));
+			}
+		}
+	});
+
+	FileWriteHandle file(nstr(getNodeCachePath()));
+	if(!file.isOk()) {
+		return;
+	}
+
+	// Everything held is up to date as of journalSequence, so one version covers all nodes
+	file.addU32(LiveNodeCacheMagic);
+	file.addU32(LiveNodeCacheVersion);
+	file.addU32(journalSession);
+	file.addU64(journalSequence);
+	file.addU32(nodes.size());
+	for(const auto& entry : nodes) {
+		const uint32_t nd = entry.second;
+
+		NetworkMessage message;
+		writeNode(message, entry.first, nd >> 18, (nd >> 4) & 0x3FFF, (nd & 1) ? 0xFF00 : 0x00FF);
+		file.addU32(message.size);
+		file.addRAW(&message.buffer[4], message.size);
+	}
+}
+
+void LiveClient::sendViewport(bool force)
+{
+	if(!testFlags(features, LIVE_FEATURE_INTEREST) || viewEndX < viewStartX) {
+		return;
+	}
+
+	if(!force && (viewStartX >> 2) == sentStartX && (viewStartY >> 2) == sentStartY &&
+		(viewEndX >> 2) == sentEndX && (viewEndY >> 2) == sentEndY && viewFloor == sentFloor) {
+		return;
+	}
+	sentStartX = viewStartX >> 2;
+	sentStartY = viewStartY >> 2;
+	sentEndX = viewEndX >> 2;
+	sentEndY = viewEndY >> 2;
+	sentFloor = viewFloor;
 
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_CLIENT_VIEWPORT);
+	message.write<uint16_t>(std::max(viewStartX, 0));
+	message.write<uint16_t>(std::max(viewStartY, 0));
+	message.write<uint16_t>(std::max(viewEndX, 0));
+	message.write<uint16_t>(std::max(viewEndY, 0));
+	message.write<uint8_t>(viewFloor);
+	send(message);
+}
+
+void LiveClient::sendPing()
+{
+	if(stopped || !editor || !testFlags(features, LIVE_FEATURE_PING)) {
+		return;
+	}
+
+	NetworkMessage message;
+	writePing(message, PACKET_CLIENT_PING);
+	send(message);
+}
+
+void LiveClient::checkIntegrity()
+{
+	if(stopped || !editor || !testFlags(features, LIVE_FEATURE_INTEGRITY) || !testFlags(features, LIVE_FEATURE_JOURNAL)) {
+		return;
+	}
+
+	// The nodes we hold are behind until the answer to sendChangesSince is complete
+	if(++integrityTicks < LiveIntegrityInterval || journalSession == 0 || resyncPending) {
+		return;
+	}
+	integrityTicks = 0;
+
+	// Only the leaves changed since the last check are hashed again
+	Map& map = editor->getMap();
+	std::vector<std::pair<uint32_t, uint64_t>> hashes;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int x, int y) {
+		const uint32_t nd = ((x >> 2) << 18) | ((y >> 2) << 4);
+		for(bool underground : { false, true }) {
+			if(leaf->isVisible(underground)) {
+				hashes.emplace_back(nd | (underground ? 1 : 0), hashNode(map, leaf, x >> 2, y >> 2, underground));
+			}
+		}
+	});
+	if(hashes.empty()) {
+		return;
+	}
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_CLIENT_NODE_HASHES);
+	message.write<uint32_t>(journalSession);
+	message.write<uint64_t>(journalSequence);
+	message.write<uint32_t>(hashes.size());
+	for(const auto& hash : hashes) {
+		message.write<uint32_t>(hash.first);
+		message.write<uint64_t>(hash.second);
+	}
 	send(message);
 }
 
@@ -351,7 +698,65 @@ void LiveClient::queryNode(int32_t ndx, int32_t ndy, bool underground)
 	queryNodeList.insert(nd);
 }
 
-void LiveClient::parsePacket(NetworkMessage message)
+void LiveClient::setViewport(int startX, int startY, int endX, int endY, int floor)
+{
+	const int moveX = (startX + endX) - (viewStartX + viewEndX);
+	const int moveY = (startY + endY) - (viewStartY + viewEndY);
+	const bool hadView = viewEndX >= viewStartX;
+
+	viewStartX = startX;
+	viewStartY = startY;
+	viewEndX = endX;
+	viewEndY = endY;
+	viewFloor = floor;
+	sendViewport();
+
+	if(!hadView || (moveX == 0 && moveY == 0)) {
+		return;
+	}
+	scrollX = (moveX > 0) - (moveX < 0);
+	scrollY = (moveY > 0) - (moveY < 0);
+
+	// The band of nodes the view is heading into
+	const bool underground = floor > rme::MapGroundLayer;
+	int bandStartX = startX >> 2, bandEndX = endX >> 2;
+	int bandStartY = startY >> 2, bandEndY = endY >> 2;
+	if(scrollX > 0) {
+		bandStartX = bandEndX + 1;
+		bandEndX += LivePrefetchNodes;
+	} else if(scrollX < 0) {
+		bandEndX = bandStartX - 1;
+		bandStartX -= LivePrefetchNodes;
+	}
+
+	if(scrollY > 0) {
+		bandStartY = bandEndY + 1;
+		bandEndY += LivePrefetchNodes;
+	} else if(scrollY < 0) {
+		bandEndY = bandStartY - 1;
+		bandStartY -= LivePrefetchNodes;
+	}
+
+	Map& map = editor->getMap();
+	bandEndX = std::min(bandEndX, map.getWidth() >> 2);
+	bandEndY = std::min(bandEndY, map.getHeight() >> 2);
+	for(int ndx = std::max(bandStartX, 0); ndx <= bandEndX; ++ndx) {
+		for(int ndy = std::max(bandStartY, 0); ndy <= bandEndY; ++ndy) {
+			QTreeNode* node = map.getLeaf(ndx * 4, ndy * 4);
+			if(!node) {
+				node = map.createLeaf(ndx * 4, ndy * 4);
+				node->setVisible(false, false);
+			}
+
+			if(!node->isVisible(underground) && !node->isRequested(underground)) {
+				queryNode(ndx * 4, ndy * 4, underground);
+				node->setRequested(underground, true);
+			}
+		}
+	}
+}
+
+void LiveClient::parsePacket(NetworkMessage& message)
 {
 	uint8_t packetType;
 	while(message.position < message.buffer.size()) {
@@ -375,6 +780,24 @@ void LiveClient::parsePacket(NetworkMessage message)
 			case PACKET_NODE:
 				parseNode(message);
 				break;
+			case PACKET_NODE_CHANGES:
+				parseNodeChanges(message);
+				break;
+			case PACKET_JOURNAL_SEQUENCE:
+				parseJournalSequence(message);
+				break;
+			case PACKET_CHANGES_SINCE_DONE:
+				parseChangesSinceDone(message);
+				break;
+			case PACKET_NODES_EXPIRED:
+				parseNodesExpired(message);
+				break;
+			case PACKET_SERVER_PING:
+				parsePing(message);
+				break;
+			case PACKET_SERVER_PONG:
+				readPong(message);
+				break;
 			case PACKET_CURSOR_UPDATE:
 				parseCursorUpdate(message);
 				break;
@@ -384,6 +807,16 @@ void LiveClient::parsePacket(NetworkMessage message)
 			case PACKET_UPDATE_OPERATION:
 				parseUpdateOperation(message);
 				break;
+			case PACKET_COMPRESSED: {
+				NetworkMessage decompressed;
+				if(!decompressMessage(message, decompressed)) {
+					log->Message("Invalid compressed packet receieved!");
+					close();
+					return;
+				}
+				parsePacket(decompressed);
+				break;
+			}
 			default: {
 				log->Message("Unknown packet receieved!");
 				close();
@@ -395,15 +828,43 @@ void LiveClient::parsePacket(NetworkMessage message)
 
 void LiveClient::parseHello(NetworkMessage& message)
 {
-	ASSERT(editor == nullptr);
+	// Back after a reconnect, the map we have only needs what changed meanwhile
+	if(editor) {
+		message.read<std::string>();
+		message.read<uint16_t>();
+		message.read<uint16_t>();
+		features = message.read<uint32_t>() & LIVE_FEATURES_SUPPORTED;
+		if(testFlags(features, LIVE_FEATURE_JOURNAL)) {
+			message.read<uint32_t>();
+		}
+
+		reconnectAttempts = 0;
+		log->Message("Session resumed.");
+		sendViewport(true);
+		sendChangesSince();
+		return;
+	}
+
 	editor = newd Editor(g_gui.copybuffer, this);
 
 	Map& map = editor->getMap();
 	map.setName("Live Map - " + message.read<std::string>());
 	map.setWidth(message.read<uint16_t>());
 	map.setHeight(message.read<uint16_t>());
+	features = message.read<uint32_t>() & LIVE_FEATURES_SUPPORTED;
 
 	createEditorWindow();
+	sendViewport(true);
+
+	// Even without a cache the answer tells us where the journal stands
+	if(testFlags(features, LIVE_FEATURE_JOURNAL)) {
+		const uint32_t session = message.read<uint32_t>();
+		if(!loadNodeCache(session)) {
+			journalSession = session;
+			journalSequence = 0;
+		}
+		sendChangesSince();
+	}
 }
 
 void LiveClient::parseKick(NetworkMessage& message)
@@ -452,6 +913,7 @@ void LiveClient::parseNode(NetworkMessage& message)
 	int32_t ndx = ind >> 18;
 	int32_t ndy = (ind >> 4) & 0x3FFF;
 	bool underground = ind & 1;
+	requestedNodes.erase(ind);
 
 	Action* action = editor->createAction(ACTION_REMOTE);
 	receiveNode(message, *editor, action, ndx, ndy, underground);
@@ -461,6 +923,64 @@ void LiveClient::parseNode(NetworkMessage& message)
 	g_gui.UpdateMinimap();
 }
 
+void LiveClient::parseNodeChanges(NetworkMessage& message)
+{
+	uint32_t ind = message.read<uint32_t>();
+
+	int32_t ndx = ind >> 18;
+	int32_t ndy = (ind >> 4) & 0x3FFF;
+
+	Action* action = editor->createAction(ACTION_REMOTE);
+	receiveNodeChanges(message, *editor, action, ndx, ndy);
+	editor->addAction(action);
+
+	g_gui.RefreshView();
+	g_gui.UpdateMinimap();
+}
+
+void LiveClient::parseJournalSequence(NetworkMessage& message)
+{
+	const uint32_t session = message.read<uint32_t>();
+	const uint64_t sequence = message.read<uint64_t>();
+	if(resyncPending) {
+		return;
+	}
+
+	if(session != journalSession || sequence > journalSequence) {
+		journalSession = session;
+		journalSequence = sequence;
+	}
+}
+
+void LiveClient::parseChangesSinceDone(NetworkMessage& message)
+{
+	journalSession = message.read<uint32_t>();
+	journalSequence = message.read<uint64_t>();
+	resyncPending = false;
+}
+
+void LiveClient::parseNodesExpired(NetworkMessage& message)
+{
+	// Drawing them again queries them from the server
+	Map& map = editor->getMap();
+	std::vector<uint32_t> nodes;
+	message.readArray(nodes);
+	for(uint32_t ind : nodes) {
+		QTreeNode* node = map.getLeaf((ind >> 18) * 4, ((ind >> 4) & 0x3FFF) * 4);
+		if(node) {
+			node->setVisible(ind & 1, false);
+		}
+	}
+}
+
+void LiveClient::parsePing(NetworkMessage& message)
+{
+	NetworkMessage outMessage;
+	outMessage.write<uint8_t>(PACKET_CLIENT_PONG);
+	outMessage.write<uint64_t>(message.read<uint64_t>());
+	send(outMessage);
+}
+
 void LiveClient::parseCursorUpdate(NetworkMessage& message)
 {
 	LiveCursor cursor = readCursor(message);
@@ -22,6 +22,7 @@
 #include "net_connection.h"
 
 #include <set>
+#include <unordered_set>
 
 class DirtyList;
 class MapTab;
@@ -38,6 +39,8 @@ class LiveClient : public LiveSocket
 
 		void close();
 		bool handleError(const std::error_code& error);
+		// Connects again after the server dropped us, keeping the map that has been received
+		bool reconnect();
 
 		//
 		std::string getHostName() const;
@@ -50,6 +53,11 @@ class LiveClient : public LiveSocket
 		//
 		void updateCursor(const Position& position);
 
+		size_t getPendingNodes() override { return requestedNodes.size() + queryNodeList.size(); }
+		void sendPing() override;
+		// Every so often sends the hashes of the nodes we hold, the server resends those it has otherwise
+		void checkIntegrity() override;
+
 		LiveLogTab* createLogWindow(wxWindow* parent);
 		MapTab* createEditorWindow();
 
@@ -59,12 +67,28 @@ class LiveClient : public LiveSocket
 		void sendChanges(DirtyList& dirtyList);
 		void sendChat(const wxString& chatMessage);
 		void sendReady();
+		// Asks the server for the changes to the nodes we hold that we have not seen
+		void sendChangesSince();
+		// Tells the server where we look, only when it moved to other nodes or floors
+		void sendViewport(bool force = false);
+
+		// Nodes of the session kept on disk between joins, so only the stale ones are fetched again
+		wxString getNodeCachePath() const;
+		bool loadNodeCache(uint32_t session);
+		void saveNodeCache();
 
 		// Flags a node as queried and stores it, need to call SendNodeRequest to send it to server
 		void queryNode(int32_t ndx, int32_t ndy, bool underground);
+		// The area on screen, queried nodes nearest its centre are requested first and the ones
+		// that left it are dropped. Nodes ahead of the scroll direction are queried in advance.
+		void setViewport(int startX, int startY, int endX, int endY, int floor);
 
 	protected:
-		void parsePacket(NetworkMessage message);
+		// queueMessage runs on the strand, drainMessages on the UI thread
+		void queueMessage();
+		void drainMessages();
+
+		void parsePacket(NetworkMessage& message);
 
 		// parse packets
 		void parseHello(NetworkMessage& message);
@@ -73,6 +97,11 @@ class LiveClient : public LiveSocket
 		void parseChangeClientVersion(NetworkMessage& message);
 		void parseServerTalk(NetworkMessage& message);
 		void parseNode(NetworkMessage& message);
+		void parseNodeChanges(NetworkMessage& message);
+		void parseJournalSequence(NetworkMessage& message);
+		void parseChangesSinceDone(NetworkMessage& message);
+		void parseNodesExpired(NetworkMessage& message);
+		void parsePing(NetworkMessage& message);
 		void parseCursorUpdate(NetworkMessage& message);
 		void parseStartOperation(NetworkMessage& message);
 		void parseUpdateOperation(NetworkMessage& message);
@@ -81,10 +110,29 @@ class LiveClient : public LiveSocket
 		NetworkMessage readMessage;
 
 		std::set<uint32_t> queryNodeList;
+		// Requested from the server and not received yet
+		std::unordered_set<uint32_t> requestedNodes;
+
+		int viewStartX, viewStartY, viewEndX, viewEndY, viewFloor;
+		int scrollX, scrollY;
+		// The viewport last sent, in nodes
+		int sentStartX, sentStartY, sentEndX, sentEndY, sentFloor;
 		wxString currentOperation;
 
+		// The last change of the server we have everything of
+		uint32_t journalSession;
+		uint64_t journalSequence;
+		// Until the answer is complete the nodes we hold are older than the sequences broadcast meanwhile
+		bool resyncPending;
+		int integrityTicks;
+
+		std::string address;
+		uint16_t port;
+		int reconnectAttempts;
+
 		std::shared_ptr<asio::ip::tcp::resolver> resolver;
 		std::shared_ptr<asio::ip::tcp::socket> socket;
+		std::shared_ptr<asio::strand<asio::io_context::executor_type>> strand;
 
 		Editor* editor;
 
@@ -26,12 +26,22 @@ enum LivePacketType
 
 	PACKET_REQUEST_NODES = 0x20,
 	PACKET_CHANGE_LIST = 0x21,
+	// The nodes the client still holds, the server resends those changed since the sequence
+	PACKET_REQUEST_CHANGES_SINCE = 0x22,
 	PACKET_ADD_HOUSE = 0x23,
 	PACKET_EDIT_HOUSE = 0x24,
 	PACKET_REMOVE_HOUSE = 0x25,
 
 	PACKET_CLIENT_TALK = 0x30,
 	PACKET_CLIENT_UPDATE_CURSOR = 0x31,
+	// The area the client looks at, the server only keeps it up to date around there
+	PACKET_CLIENT_VIEWPORT = 0x32,
+	// A timestamp of the sender, echoed back to it to measure the round trip
+	PACKET_CLIENT_PING = 0x33,
+	PACKET_CLIENT_PONG = 0x34,
+	// Content hashes of the nodes the client holds as of its journal sequence, the server resends
+	// the ones that differ from its own
+	PACKET_CLIENT_NODE_HASHES = 0x35,
 
 	PACKET_HELLO_FROM_SERVER = 0x80,
 	PACKET_KICK = 0x81,
@@ -44,6 +54,40 @@ enum LivePacketType
 	PACKET_START_OPERATION = 0x92,
 	PACKET_UPDATE_OPERATION = 0x93,
 	PACKET_CHAT_MESSAGE = 0x94,
+	PACKET_NODE_CHANGES = 0x95,
+	// Sent after the nodes of a committed change, the client has caught up to the sequence
+	PACKET_JOURNAL_SEQUENCE = 0x96,
+	// Ends the answer to PACKET_REQUEST_CHANGES_SINCE, the nodes before it bring the client to the sequence
+	PACKET_CHANGES_SINCE_DONE = 0x97,
+	// Nodes that left the area of the client, it does not get their changes anymore
+	PACKET_NODES_EXPIRED = 0x98,
+	PACKET_SERVER_PING = 0x99,
+	PACKET_SERVER_PONG = 0x9A,
+
+	// Either side, holds another packet compressed with zlib
+	PACKET_COMPRESSED = 0xA0,
+};
+
+// Sent by the client in its hello, the server answers with the ones both support
+enum LiveFeatureFlags
+{
+	LIVE_FEATURE_COMPRESSION = 1 << 0,
+	// Changes are sent as the changed tiles of a node instead of the whole node
+	LIVE_FEATURE_NODE_CHANGES = 1 << 1,
+
+	// The server numbers its changes, a client that lost the connection resumes from the last one it saw
+	LIVE_FEATURE_JOURNAL = 1 << 2,
+
+	// Nodes and cursors are only sent to the clients looking at them
+	LIVE_FEATURE_INTEREST = 1 << 3,
+
+	// Both sides ping each other to show the latency in the live tab
+	LIVE_FEATURE_PING = 1 << 4,
+
+	// The client checks the nodes it holds against the server every so often, needs the journal
+	LIVE_FEATURE_INTEGRITY = 1 << 5,
+
+	LIVE_FEATURES_SUPPORTED = LIVE_FEATURE_COMPRESSION | LIVE_FEATURE_NODE_CHANGES | LIVE_FEATURE_JOURNAL | LIVE_FEATURE_INTEREST | LIVE_FEATURE_PING | LIVE_FEATURE_INTEGRITY,
 };
 
 #endif
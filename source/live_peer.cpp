@@ -23,9 +23,37 @@
 #include "live_action.h"
 
 #include "editor.h"
+#include "tracing.h"
+
+namespace {
+	// Small packets are gathered up to this size into a single write
+	constexpr size_t LiveSendBatchSize = 64 * 1024;
+
+	// Past this much waiting for the socket, node changes go out as full nodes, which replace what
+	// is queued for the node instead of adding to it
+	constexpr size_t LiveSendBacklogSize = 4 * 1024 * 1024;
+	// A peer with this much waiting doesn't keep up at all and is disconnected
+	constexpr size_t LiveSendQueueLimit = 32 * 1024 * 1024;
+
+	// Packets parsed per event loop pass, so a burst does not stall the UI
+	constexpr size_t LiveReceiveBatchSize = 16;
+
+	// Tiles around the viewport of a client it is kept up to date on, more than it prefetches
+	constexpr int LiveInterestMargin = 16;
+	// Close to the ground floor both halves of a node are of interest, so a short trip
+	// above or below does not expire everything
+	constexpr int LiveInterestFloors = 1;
+
+	// Nodes and node changes share a key, a full node makes both obsolete
+	uint64_t outboundKey(LiveOutboundKind kind, uint32_t key)
+	{
+		const uint64_t group = kind == LIVE_OUTBOUND_CURSOR ? 2 : 1;
+		return (group << 32) | key;
+	}
+}
 
 LivePeer::LivePeer(LiveServer* server, asio::ip::tcp::socket socket) : LiveSocket(),
-	readMessage(), server(server), socket(std::move(socket)), color(), id(0), clientId(0), connected(false)
+	readMessage(), server(server), socket(std::move(socket)), strand(NetworkConnection::getInstance().make_strand()), color(), interest(), hasInterest(false), visibleNodes(), cursorsInside(), id(0), clientId(0), requestedFeatures(0), connected(false), sendQueue(), sending(), queuedKeys(), queuedBytes(0), writing(false), overflowed(false)
 {
 	ASSERT(server != nullptr);
 }
@@ -46,7 +74,9 @@ bool LivePeer::handleError(const std::error_code& error)
 {
 	if(error == asio::error::eof || error == asio::error::connection_reset) {
 		logMessage(wxString() + getHostName() + ": disconnected.");
-		close();
+		wxTheApp->CallAfter([this]() {
+			close();
+		});
 		return true;
 	} else if(error == asio::error::connection_aborted) {
 		logMessage(name + " have left the server.");
@@ -63,9 +93,10 @@ std::string LivePeer::getHostName() const
 void LivePeer::receiveHeader()
 {
 	readMessage.position = 0;
+	readMessage.inflated = false;
 	asio::async_read(socket,
 		asio::buffer(readMessage.buffer, 4),
-		[this](const std::error_code& error, size_t bytesReceived) -> void {
+		asio::bind_executor(strand, [this](const std::error_code& error, size_t bytesReceived) -> void {
 			if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
@@ -75,7 +106,7 @@ void LivePeer::receiveHeader()
 			} else {
 				receive(readMessage.read<uint32_t>());
 			}
-		}
+		})
 	);
 }
 
@@ -84,7 +115,7 @@ void LivePeer::receive(uint32_t packetSize)
 	readMessage.buffer.resize(readMessage.position + packetSize);
 	asio::async_read(socket,
 		asio::buffer(&readMessage.buffer[readMessage.position], packetSize),
-		[this](const std::error_code& error, size_t bytesReceived) -> void {
+		asio::bind_executor(strand, [this](const std::error_code& error, size_t bytesReceived) -> void {
 			if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
@@ -92,33 +123,283 @@ void LivePeer::receive(uint32_t packetSize)
 			} else if(bytesReceived < readMessage.buffer.size() - 4) {
 				logMessage(wxString() + getHostName() + ": Could not receive packet[size: " + std::to_string(bytesReceived) + "], disconnecting client.");
 			} else {
-				wxTheApp->CallAfter([this]() {
-					if(connected) {
-						parseEditorPacket(std::move(readMessage));
-					} else {
-						parseLoginPacket(std::move(readMessage));
-					}
-					receiveHeader();
-				});
+				RME_TRACE_ZONE("live", "LivePeer::receive");
+				const size_t wireSize = readMessage.buffer.size();
+				inflateMessage(readMessage);
+				countReceived(readMessage, wireSize);
+				queueMessage();
 			}
-		}
+		})
 	);
 }
 
+void LivePeer::queueMessage()
+{
+	if(!queueReceived(readMessage)) {
+		return;
+	}
+
+	if(!drainPending.exchange(true)) {
+		wxTheApp->CallAfter([this]() {
+			drainMessages();
+		});
+	}
+	receiveHeader();
+}
+
+void LivePeer::drainMessages()
+{
+	RME_TRACE_ZONE("live", "LivePeer::drainMessages");
+	drainPending = false;
+	for(size_t count = 0; count < LiveReceiveBatchSize; ++count) {
+		NetworkMessage* message = receivedMessages.front();
+		if(!message) {
+			break;
+		}
+
+		if(connected) {
+			parseEditorPacket(*message);
+		} else {
+			parseLoginPacket(*message);
+		}
+		popReceived();
+	}
+
+	if(!receivedMessages.empty() && !drainPending.exchange(true)) {
+		wxTheApp->CallAfter([this]() {
+			drainMessages();
+		});
+	}
+
+	if(takeStalledRead()) {
+		asio::post(strand, [this]() {
+			queueMessage();
+		});
+	}
+}
+
 void LivePeer::send(NetworkMessage& message)
 {
-	memcpy(&message.buffer[0], &message.size, 4);
+	RME_TRACE_ZONE("live", "LivePeer::send");
+	const uint8_t type = message.buffer[4];
+	sendEncoded(encodeMessage(std::move(message), testFlags(features, LIVE_FEATURE_COMPRESSION)), LIVE_OUTBOUND_PACKET, 0, 0, type);
+}
+
+size_t LivePeer::getPendingNodes()
+{
+	std::lock_guard<std::mutex> lock(sendMutex);
+	size_t nodes = 0;
+	for(const LiveOutboundPacket& packet : sendQueue) {
+		if(packet.kind == LIVE_OUTBOUND_NODE) {
+			++nodes;
+		}
+	}
+	return nodes;
+}
+
+void LivePeer::sendPing()
+{
+	if(!connected || !testFlags(features, LIVE_FEATURE_PING)) {
+		return;
+	}
+
+	NetworkMessage message;
+	writePing(message, PACKET_SERVER_PING);
+	send(message);
+}
+
+bool LivePeer::isBacklogged()
+{
+	std::lock_guard<std::mutex> lock(sendMutex);
+	return queuedBytes > LiveSendBacklogSize;
+}
+
+LiveSocket::BufferUsage LivePeer::getBufferUsage()
+{
+	BufferUsage usage = LiveSocket::getBufferUsage();
+	std::lock_guard<std::mutex> lock(sendMutex);
+	usage.messages += sendQueue.size() + sending.size();
+	usage.bytes += queuedBytes;
+	for(const auto& buffer : sending) {
+		usage.bytes += buffer->size();
+	}
+	return usage;
+}
+
+bool LivePeer::isInterested(int32_t ndx, int32_t ndy, bool underground) const
+{
+	if(!hasInterest) {
+		return true;
+	}
+
+	const bool viewingUnderground = interest.floor > rme::MapGroundLayer;
+	if(underground != viewingUnderground && std::abs(interest.floor - rme::MapGroundLayer) > LiveInterestFloors) {
+		return false;
+	}
+
+	const int x = ndx * 4;
+	const int y = ndy * 4;
+	return x + 3 >= interest.startX && x <= interest.endX && y + 3 >= interest.startY && y <= interest.endY;
+}
+
+bool LivePeer::isInterested(const Position& position) const
+{
+	return isInterested(position.x >> 2, position.y >> 2, position.z > rme::MapGroundLayer);
+}
+
+void LivePeer::setNodeVisible(QTreeNode* node, uint32_t key)
+{
+	node->setVisible(clientId, key & 1, true);
+	visibleNodes.insert(key);
+}
+
+void LivePeer::sendExpired(const std::vector<uint32_t>& expired)
+{
+	if(expired.empty()) {
+		return;
+	}
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_NODES_EXPIRED);
+	message.writeArray(expired);
+	send(message);
+}
+
+bool LivePeer::wantsCursor(const LiveCursor& cursor)
+{
+	if(!hasInterest) {
+		return true;
+	}
+
+	if(isInterested(cursor.pos)) {
+		cursorsInside.insert(cursor.id);
+		return true;
+	}
+	return cursorsInside.erase(cursor.id) != 0;
+}
+
+void LivePeer::sendEncoded(const std::shared_ptr<std::vector<uint8_t>>& buffer, LiveOutboundKind kind, uint32_t key, uint32_t floors, uint8_t type)
+{
+	if(type == 0) {
+		switch(kind) {
+			case LIVE_OUTBOUND_NODE: type = PACKET_NODE; break;
+			case LIVE_OUTBOUND_NODE_CHANGES: type = PACKET_NODE_CHANGES; break;
+			case LIVE_OUTBOUND_CURSOR: type = PACKET_CURSOR_UPDATE; break;
+			default: type = (*buffer)[4]; break;
+		}
+	}
+	traffic.sent(type, buffer->size());
+
+	std::lock_guard<std::mutex> lock(sendMutex);
+	if(overflowed) {
+		return;
+	}
+	if(kind == LIVE_OUTBOUND_NODE || kind == LIVE_OUTBOUND_CURSOR) {
+		removeQueued(kind, key, floors);
+	}
+
+	if(kind != LIVE_OUTBOUND_PACKET) {
+		++queuedKeys[outboundKey(kind, key)];
+	}
+	sendQueue.push_back({ buffer, kind, key, floors });
+	queuedBytes += buffer->size();
+
+	if(queuedBytes > LiveSendQueueLimit) {
+		logMessage(wxString() + getHostName() + ": fell too far behind, disconnecting client.");
+		overflowed = true;
+		sendQueue.clear();
+		queuedKeys.clear();
+		queuedBytes = 0;
+		// Not while the server goes through its peers
+		wxTheApp->CallAfter([this]() {
+			close();
+		});
+		return;
+	}
+
+	// The write is started on the strand of the socket, not on the thread that queued it
+	if(!writing) {
+		asio::post(strand, [this]() {
+			std::lock_guard<std::mutex> lock(sendMutex);
+			flushSendQueue();
+		});
+	}
+}
+
+void LivePeer::removeQueued(LiveOutboundKind kind, uint32_t key, uint32_t floors)
+{
+	auto it = queuedKeys.find(outboundKey(kind, key));
+	if(it == queuedKeys.end()) {
+		return;
+	}
+
+	// The socket fell behind, the packets still waiting for this node or cursor are out of date. A node
+	// only carries its changed floors, the packets with a floor it doesn't carry are still needed.
+	const bool cursor = kind == LIVE_OUTBOUND_CURSOR;
+	for(auto packet = sendQueue.begin(); packet != sendQueue.end();) {
+		if(packet->kind != LIVE_OUTBOUND_PACKET && (packet->kind == LIVE_OUTBOUND_CURSOR) == cursor && packet->key == key && (cursor || (packet->floors & ~floors) == 0)) {
+			queuedBytes -= packet->buffer->size();
+			packet = sendQueue.erase(packet);
+			if(--it->second == 0) {
+				queuedKeys.erase(it);
+				break;
+			}
+		} else {
+			++packet;
+		}
+	}
+}
+
+void LivePeer::flushSendQueue()
+{
+	RME_TRACE_ZONE("live", "LivePeer::flushSendQueue");
+	if(writing || sendQueue.empty()) {
+		return;
+	}
+
+	std::vector<asio::const_buffer> buffers;
+	size_t batchSize = 0;
+	while(!sendQueue.empty()) {
+		LiveOutboundPacket& packet = sendQueue.front();
+		const size_t packetSize = packet.buffer->size();
+		if(!sending.empty() && batchSize + packetSize > LiveSendBatchSize) {
+			break;
+		}
+
+		if(packet.kind != LIVE_OUTBOUND_PACKET) {
+			auto it = queuedKeys.find(outboundKey(packet.kind, packet.key));
+			if(it != queuedKeys.end() && --it->second == 0) {
+				queuedKeys.erase(it);
+			}
+		}
+
+		buffers.emplace_back(asio::buffer(*packet.buffer));
+		sending.push_back(std::move(packet.buffer));
+		batchSize += packetSize;
+		queuedBytes -= packetSize;
+		sendQueue.pop_front();
+	}
+
+	writing = true;
 	asio::async_write(socket,
-		asio::buffer(message.buffer, message.size + 4),
-		[this](const std::error_code& error, size_t bytesTransferred) -> void {
+		buffers,
+		asio::bind_executor(strand, [this](const std::error_code& error, size_t bytesTransferred) -> void {
+			std::lock_guard<std::mutex> lock(sendMutex);
+			writing = false;
+			sending.clear();
 			if(error) {
 				logMessage(wxString() + getHostName() + ": " + error.message());
+				sendQueue.clear();
+				queuedKeys.clear();
+				queuedBytes = 0;
+				return;
 			}
-		}
+			flushSendQueue();
+		})
 	);
 }
 
-void LivePeer::parseLoginPacket(NetworkMessage message)
+void LivePeer::parseLoginPacket(NetworkMessage& message)
 {
 	uint8_t packetType;
 	while(message.position < message.buffer.size()) {
@@ -139,7 +420,7 @@ void LivePeer::parseLoginPacket(NetworkMessage message)
 	}
 }
 
-void LivePeer::parseEditorPacket(NetworkMessage message)
+void LivePeer::parseEditorPacket(NetworkMessage& message)
 {
 	uint8_t packetType;
 	while(message.position < message.buffer.size()) {
@@ -148,6 +429,9 @@ void LivePeer::parseEditorPacket(NetworkMessage message)
 			case PACKET_REQUEST_NODES:
 				parseNodeRequest(message);
 				break;
+			case PACKET_REQUEST_CHANGES_SINCE:
+				parseChangesSince(message);
+				break;
 			case PACKET_CHANGE_LIST:
 				parseReceiveChanges(message);
 				break;
@@ -166,6 +450,28 @@ void LivePeer::parseEditorPacket(NetworkMessage message)
 			case PACKET_CLIENT_TALK:
 				parseChatMessage(message);
 				break;
+			case PACKET_CLIENT_VIEWPORT:
+				parseViewport(message);
+				break;
+			case PACKET_CLIENT_PING:
+				parsePing(message);
+				break;
+			case PACKET_CLIENT_PONG:
+				readPong(message);
+				break;
+			case PACKET_CLIENT_NODE_HASHES:
+				parseNodeHashes(message);
+				break;
+			case PACKET_COMPRESSED: {
+				NetworkMessage decompressed;
+				if(!decompressMessage(message, decompressed)) {
+					log->Message("Invalid compressed packet receieved, connection severed.");
+					close();
+					return;
+				}
+				parseEditorPacket(decompressed);
+				break;
+			}
 			default: {
 				log->Message("Invalid editor packet receieved, connection severed.");
 				close();
@@ -207,6 +513,7 @@ void LivePeer::parseHello(NetworkMessage& message)
 	uint32_t clientVersion = message.read<uint32_t>();
 	std::string nickname = message.read<std::string>();
 	std::string password = message.read<std::string>();
+	uint32_t clientFeatures = message.read<uint32_t>();
 
 	if(server->getPassword() != wxString(password.c_str(), wxConvUTF8)) {
 		log->Message("Client tried to connect, but used the wrong password, connection refused.");
@@ -217,6 +524,9 @@ void LivePeer::parseHello(NetworkMessage& message)
 	name = wxString(nickname.c_str(), wxConvUTF8);
 	log->Message(name + " (" + getHostName() + ") connected.");
 
+	// Used once the client has been told in PACKET_HELLO_FROM_SERVER
+	requestedFeatures = clientFeatures & LIVE_FEATURES_SUPPORTED;
+
 	NetworkMessage outMessage;
 	if(static_cast<ClientVersionID>(clientVersion) != g_gui.GetCurrentVersionID()) {
 		outMessage.write<uint8_t>(PACKET_CHANGE_CLIENT_VERSION);
@@ -258,16 +568,23 @@ void LivePeer::parseReady(NetworkMessage& message)
 	outMessage.write<std::string>(map.getName());
 	outMessage.write<uint16_t>(map.getWidth());
 	outMessage.write<uint16_t>(map.getHeight());
+	outMessage.write<uint32_t>(requestedFeatures);
+
+	// The client learns where the journal stands from its first PACKET_REQUEST_CHANGES_SINCE
+	if(testFlags(requestedFeatures, LIVE_FEATURE_JOURNAL)) {
+		outMessage.write<uint32_t>(server->getJournalSession());
+	}
 
 	send(outMessage);
+	features = requestedFeatures;
 }
 
 void LivePeer::parseNodeRequest(NetworkMessage& message)
 {
 	Map& map = server->getEditor()->getMap();
-	for(uint32_t nodes = message.read<uint32_t>(); nodes != 0; --nodes) {
-		uint32_t ind = message.read<uint32_t>();
-
+	std::vector<uint32_t> nodes;
+	message.readArray(nodes);
+	for(uint32_t ind : nodes) {
 		int32_t ndx = ind >> 18;
 		int32_t ndy = (ind >> 4) & 0x3FFF;
 		bool underground = ind & 1;
@@ -275,17 +592,107 @@ void LivePeer::parseNodeRequest(NetworkMessage& message)
 		QTreeNode* node = map.createLeaf(ndx * 4, ndy * 4);
 		if(node) {
 			sendNode(clientId, node, ndx, ndy, underground ? 0xFF00 : 0x00FF);
+			visibleNodes.insert(ind);
 		}
 	}
 }
 
+void LivePeer::parseChangesSince(NetworkMessage& message)
+{
+	const uint32_t session = message.read<uint32_t>();
+	const uint64_t sequence = message.read<uint64_t>();
+
+	// Without the journal covering the gap every node the client holds may be out of date
+	const bool known = session == server->getJournalSession() &&
+		sequence >= server->getJournalHorizon() && sequence <= server->getJournalSequence();
+
+	Map& map = server->getEditor()->getMap();
+	std::vector<uint32_t> expired;
+	uint32_t resent = 0;
+	std::vector<uint32_t> nodes;
+	message.readArray(nodes);
+	for(uint32_t ind : nodes) {
+		int32_t ndx = ind >> 18;
+		int32_t ndy = (ind >> 4) & 0x3FFF;
+		bool underground = ind & 1;
+
+		// Held from an earlier visit to somewhere the client is not looking now
+		if(!isInterested(ndx, ndy, underground)) {
+			expired.push_back(ind);
+			continue;
+		}
+
+		QTreeNode* node = map.createLeaf(ndx * 4, ndy * 4);
+		if(!node) {
+			continue;
+		}
+
+		if(!known || server->getNodeVersion(ind) > sequence) {
+			sendNode(clientId, node, ndx, ndy, underground ? 0xFF00 : 0x00FF);
+			++resent;
+		}
+		setNodeVisible(node, ind);
+	}
+
+	sendExpired(expired);
+
+	NetworkMessage outMessage;
+	outMessage.write<uint8_t>(PACKET_CHANGES_SINCE_DONE);
+	outMessage.write<uint32_t>(server->getJournalSession());
+	outMessage.write<uint64_t>(server->getJournalSequence());
+	send(outMessage);
+
+	if(!nodes.empty()) {
+		log->Message(name + " resumed the session, " + std::to_string(resent) + " of " + std::to_string(nodes.size()) + " nodes were resent.");
+	}
+}
+
+void LivePeer::parseNodeHashes(NetworkMessage& message)
+{
+	const uint32_t session = message.read<uint32_t>();
+	const uint64_t sequence = message.read<uint64_t>();
+	const uint32_t count = message.read<uint32_t>();
+
+	// A client behind the horizon resumes through PACKET_REQUEST_CHANGES_SINCE, nothing to compare with
+	const bool known = session == server->getJournalSession() &&
+		sequence >= server->getJournalHorizon() && sequence <= server->getJournalSequence();
+
+	Map& map = server->getEditor()->getMap();
+	uint32_t resent = 0;
+	for(uint32_t i = 0; i < count; ++i) {
+		const uint32_t ind = message.read<uint32_t>();
+		const uint64_t hash = message.read<uint64_t>();
+		int32_t ndx = ind >> 18;
+		int32_t ndy = (ind >> 4) & 0x3FFF;
+		bool underground = ind & 1;
+
+		// Nodes changed after the sequence are still on their way to the client
+		if(!known || !isInterested(ndx, ndy, underground) || server->getNodeVersion(ind) > sequence) {
+			continue;
+		}
+
+		QTreeNode* node = map.createLeaf(ndx * 4, ndy * 4);
+		if(node && server->hashNode(map, node, ndx, ndy, underground) != hash) {
+			sendNode(clientId, node, ndx, ndy, underground ? 0xFF00 : 0x00FF);
+			++resent;
+		}
+	}
+
+	if(resent != 0) {
+		log->Message(name + " held " + std::to_string(resent) + " of " + std::to_string(count) + " nodes differing from the map, they were resent.");
+	}
+}
+
 void LivePeer::parseReceiveChanges(NetworkMessage& message)
 {
 	Editor& editor = *server->getEditor();
 
 	// -1 on address since we skip the first START_NODE when sending
-	const std::string& data = message.read<std::string>();
-	mapReader.assign(reinterpret_cast<const uint8_t*>(data.c_str() - 1), data.size());
+	const std::string_view data = message.read<std::string_view>();
+	if(data.empty()) {
+		return;
+	}
+	mapReader.assign(reinterpret_cast<const uint8_t*>(data.data() - 1), data.size());
 
 	BinaryNode* rootNode = mapReader.getRootNode();
 	BinaryNode* tileNode = rootNode->getChild();
@@ -338,3 +745,61 @@ void LivePeer::parseChatMessage(NetworkMessage& message)
 	const std::string& chatMessage = message.read<std::string>();
 	server->broadcastChat(name, wxstr(chatMessage));
 }
+
+void LivePeer::parseViewport(NetworkMessage& message)
+{
+	const int startX = message.read<uint16_t>();
+	const int startY = message.read<uint16_t>();
+	const int endX = message.read<uint16_t>();
+	const int endY = message.read<uint16_t>();
+	const int floor = message.read<uint8_t>();
+
+	interest.startX = startX - LiveInterestMargin;
+	interest.startY = startY - LiveInterestMargin;
+	interest.endX = endX + LiveInterestMargin;
+	interest.endY = endY + LiveInterestMargin;
+	interest.floor = floor;
+	hasInterest = true;
+
+	// The client forgets the nodes it is told about and asks for them again when it comes back
+	Map& map = server->getEditor()->getMap();
+	std::vector<uint32_t> expired;
+	for(auto it = visibleNodes.begin(); it != visibleNodes.end();) {
+		const uint32_t ind = *it;
+		const int32_t ndx = ind >> 18;
+		const int32_t ndy = (ind >> 4) & 0x3FFF;
+		if(isInterested(ndx, ndy, ind & 1)) {
+			++it;
+			continue;
+		}
+
+		QTreeNode* node = map.getLeaf(ndx * 4, ndy * 4);
+		if(node) {
+			node->setVisible(clientId, ind & 1, false);
+		}
+		expired.push_back(ind);
+		it = visibleNodes.erase(it);
+	}
+
+	sendExpired(expired);
+
+	// Cursors that were out of the area were not sent, their place is told now
+	for(const LiveCursor& cursor : server->getCursorList()) {
+		if(cursor.id != clientId && !cursorsInside.count(cursor.id) && isInterested(cursor.pos)) {
+			cursorsInside.insert(cursor.id);
+
+			NetworkMessage cursorMessage;
+			cursorMessage.write<uint8_t>(PACKET_CURSOR_UPDATE);
+			writeCursor(cursorMessage, cursor);
+			send(cursorMessage);
+		}
+	}
+}
+
+void LivePeer::parsePing(NetworkMessage& message)
+{
+	NetworkMessage outMessage;
+	outMessage.write<uint8_t>(PACKET_SERVER_PONG);
+	outMessage.write<uint64_t>(message.read<uint64_t>());
+	send(outMessage);
+}
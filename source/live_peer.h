@@ -21,6 +21,34 @@
 #include "live_socket.h"
 #include "net_connection.h"
 
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+
+// What a queued packet is, so a newer one can replace it before it is written
+enum LiveOutboundKind : uint8_t
+{
+	LIVE_OUTBOUND_PACKET,
+	LIVE_OUTBOUND_NODE,
+	LIVE_OUTBOUND_NODE_CHANGES,
+	LIVE_OUTBOUND_CURSOR,
+};
+
+// The tiles a client looks at plus a margin, and the floor it is on
+struct LiveInterest
+{
+	int startX, startY, endX, endY;
+	int floor;
+};
+
+struct LiveOutboundPacket
+{
+	std::shared_ptr<std::vector<uint8_t>> buffer;
+	LiveOutboundKind kind;
+	uint32_t key;
+	uint32_t floors; // Those a node packet carries
+};
+
 class LiveServer;
 class LivePeer : public LiveSocket
 {
@@ -44,13 +72,38 @@ class LivePeer : public LiveSocket
 		void receiveHeader();
 		void receive(uint32_t packetSize);
 		void send(NetworkMessage& message);
+		// Queues bytes already encoded for the peer, so a broadcast can share them between peers.
+		// A full node replaces the queued packets of the same node that carry none of the floors it
+		// doesn't, and a cursor the queued one of the same id. type is the packet counted in the
+		// traffic, taken from the kind or the buffer if not given.
+		void sendEncoded(const std::shared_ptr<std::vector<uint8_t>>& buffer, LiveOutboundKind kind = LIVE_OUTBOUND_PACKET, uint32_t key = 0, uint32_t floors = 0, uint8_t type = 0);
 
 		//
 		void updateCursor(const Position& position) {}
 
+		// Includes the packets waiting for the socket
+		BufferUsage getBufferUsage() override;
+		// Nodes still waiting in the send queue
+		size_t getPendingNodes() override;
+		// The socket fell behind, node changes should be sent as full nodes that replace the queued ones
+		bool isBacklogged();
+		void sendPing() override;
+
+		// Without a viewport from the client everything is of interest
+		bool isInterested(int32_t ndx, int32_t ndy, bool underground) const;
+		bool isInterested(const Position& position) const;
+		// The client holds the node and gets its changes until it leaves the area
+		void setNodeVisible(QTreeNode* node, uint32_t key);
+		// Also true once for a cursor that has just left the area, so it is not left behind on the client
+		bool wantsCursor(const LiveCursor& cursor);
+
 	protected:
-		void parseLoginPacket(NetworkMessage message);
-		void parseEditorPacket(NetworkMessage message);
+		// queueMessage runs on the strand, drainMessages on the UI thread
+		void queueMessage();
+		void drainMessages();
+
+		void parseLoginPacket(NetworkMessage& message);
+		void parseEditorPacket(NetworkMessage& message);
 
 		// login packets
 		void parseHello(NetworkMessage& message);
@@ -58,23 +111,50 @@ class LivePeer : public LiveSocket
 
 		// editor packets
 		void parseNodeRequest(NetworkMessage& message);
+		void parseChangesSince(NetworkMessage& message);
+		void parseNodeHashes(NetworkMessage& message);
 		void parseReceiveChanges(NetworkMessage& message);
 		void parseAddHouse(NetworkMessage& message);
 		void parseEditHouse(NetworkMessage& message);
 		void parseRemoveHouse(NetworkMessage& message);
 		void parseCursorUpdate(NetworkMessage& message);
 		void parseChatMessage(NetworkMessage& message);
+		void parseViewport(NetworkMessage& message);
+		void parsePing(NetworkMessage& message);
+
+		void sendExpired(const std::vector<uint32_t>& expired);
+
+		// Writes as many queued packets as fit a batch in one go, sendMutex must be held
+		void flushSendQueue();
+		void removeQueued(LiveOutboundKind kind, uint32_t key, uint32_t floors);
 
 		//
 		NetworkMessage readMessage;
 
+		// Only one write is in flight, everything sent meanwhile waits here
+		std::mutex sendMutex;
+		std::deque<LiveOutboundPacket> sendQueue;
+		std::vector<std::shared_ptr<std::vector<uint8_t>>> sending;
+		std::unordered_map<uint64_t, uint32_t> queuedKeys;
+		size_t queuedBytes;
+		bool writing;
+		// Over the queue limit, nothing is queued anymore until the peer is closed
+		bool overflowed;
+
 		LiveServer* server;
 		asio::ip::tcp::socket socket;
+		asio::strand<asio::io_context::executor_type> strand;
 
 		wxColor color;
 
+		LiveInterest interest;
+		bool hasInterest;
+		std::unordered_set<uint32_t> visibleNodes;
+		std::unordered_set<uint32_t> cursorsInside;
+
 		uint32_t id;
 		uint32_t clientId;
+		uint32_t requestedFeatures;
 
 		bool connected;
 
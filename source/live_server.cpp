@@ -23,12 +23,23 @@
 #include "live_action.h"
 
 #include "editor.h"
+#include "tracing.h"
+
+#include <random>
+
+// Node changes remembered for clients that come back after losing the connection
+static constexpr size_t LiveJournalSize = 64 * 1024;
 
 LiveServer::LiveServer(Editor& editor) : LiveSocket(),
 	clients(), acceptor(nullptr), socket(nullptr), editor(&editor),
+	journal(), nodeVersions(), journalHead(0), journalSequence(0), journalHorizon(0), journalSession(0),
 	clientIds(0), port(0), stopped(false)
 {
-	//
+	// Tells a client of an earlier session apart, its sequence numbers mean nothing here
+	std::random_device device;
+	while(journalSession == 0) {
+		journalSession = device();
+	}
 }
 
 LiveServer::~LiveServer()
@@ -107,9 +118,12 @@ void LiveServer::acceptClient()
 		} else {
 			LivePeer* peer = new LivePeer(this, std::move(*socket));
 			peer->log = log;
-			peer->receiveHeader();
 
-			clients.insert(std::make_pair(id++, peer));
+			// The client list belongs to the UI thread, broadcasts walk it from there
+			wxTheApp->CallAfter([this, peer]() {
+				clients.insert(std::make_pair(id++, peer));
+				peer->receiveHeader();
+			});
 		}
 		acceptClient();
 	});
@@ -151,6 +165,24 @@ void LiveServer::updateClientList() const
 	log->UpdateClientList(clients);
 }
 
+LiveSocket::BufferUsage LiveServer::getBufferUsage()
+{
+	BufferUsage usage = LiveSocket::getBufferUsage();
+	for(const auto& client : clients) {
+		const BufferUsage peer = client.second->getBufferUsage();
+		usage.messages += peer.messages;
+		usage.bytes += peer.bytes;
+	}
+	return usage;
+}
+
+void LiveServer::sendPing()
+{
+	for(auto& clientEntry : clients) {
+		clientEntry.second->sendPing();
+	}
+}
+
 uint16_t LiveServer::getPort() const
 {
 	return port;
@@ -186,22 +218,86 @@ std::string LiveServer::getHostName() const
 	return "localhost";
 }
 
+uint64_t LiveServer::getNodeVersion(uint32_t key) const
+{
+	auto it = nodeVersions.find(key);
+	return it != nodeVersions.end() ? it->second : 0;
+}
+
+void LiveServer::writeJournalSequence(NetworkMessage& message) const
+{
+	message.write<uint8_t>(PACKET_JOURNAL_SEQUENCE);
+	message.write<uint32_t>(journalSession);
+	message.write<uint64_t>(journalSequence);
+}
+
+void LiveServer::recordJournal(uint32_t key)
+{
+	if(journal.size() < LiveJournalSize) {
+		journal.push_back({ journalSequence, key });
+	} else {
+		// The oldest entry is dropped, its node is only still known if it changed again since
+		LiveJournalEntry& entry = journal[journalHead];
+		auto it = nodeVersions.find(entry.key);
+		if(it != nodeVersions.end() && it->second == entry.sequence) {
+			nodeVersions.erase(it);
+		}
+		journalHorizon = entry.sequence;
+		entry = { journalSequence, key };
+		journalHead = (journalHead + 1) % LiveJournalSize;
+	}
+	nodeVersions[key] = journalSequence;
+}
+
 void LiveServer::broadcastNodes(DirtyList& dirtyList)
 {
+	RME_TRACE_ZONE("live", "LiveServer::broadcastNodes");
 	if(dirtyList.Empty()) {
 		return;
 	}
 
+	++journalSequence;
 	for(const auto& ind : dirtyList.GetPosList()) {
 		int32_t ndx = ind.pos >> 18;
 		int32_t ndy = (ind.pos >> 4) & 0x3FFF;
 		uint32_t floors = ind.floors;
 
+		const uint32_t nodeKey = (ndx << 18) | (ndy << 4);
+		if(floors & 0x00FF) {
+			recordJournal(nodeKey);
+		}
+		if(floors & 0xFF00) {
+			recordJournal(nodeKey | 1);
+		}
+
 		QTreeNode* node = editor->getMap().getLeaf(ndx * 4, ndy * 4);
 		if(!node) {
 			continue;
 		}
 
+		// Every peer gets the same bytes for a node, so each variant is serialized only once
+		std::shared_ptr<std::vector<uint8_t>> buffers[2][4];
+		bool unchanged[2] = { false, false };
+
+		const auto getBuffer = [&](bool underground, bool changesOnly, bool compressed) -> std::shared_ptr<std::vector<uint8_t>> {
+			auto& buffer = buffers[underground][(changesOnly ? 2 : 0) + (compressed ? 1 : 0)];
+			if(!buffer) {
+				const uint32_t floorMask = floors & (underground ? 0xFF00 : 0x00FF);
+
+				NetworkMessage message;
+				if(changesOnly) {
+					if(!writeNodeChanges(message, node, ndx, ndy, floorMask, dirtyList)) {
+						unchanged[underground] = true;
+						return nullptr;
+					}
+				} else {
+					writeNode(message, node, ndx, ndy, floorMask);
+				}
+				buffer = encodeMessage(message, compressed);
+			}
+			return buffer;
+		};
+
 		for(auto& clientEntry : clients) {
 			LivePeer* peer = clientEntry.second;
 
@@ -210,14 +306,52 @@ void LiveServer::broadcastNodes(DirtyList& dirtyList)
 				continue;
 			}
 
-			if(node->isVisible(clientId, true)) {
-				peer->sendNode(clientId, node, ndx, ndy, floors & 0xFF00);
+			// The peer already has the node, it only needs to hear about the tiles that changed. Unless
+			// it fell behind, then the full node replaces what is still queued for it
+			const uint32_t peerFeatures = peer->getFeatures();
+			const bool changesOnly = testFlags(peerFeatures, LIVE_FEATURE_NODE_CHANGES) && !peer->isBacklogged();
+			const bool compressed = testFlags(peerFeatures, LIVE_FEATURE_COMPRESSION);
+			for(bool underground : { true, false }) {
+				if(!node->isVisible(clientId, underground)) {
+					continue;
+				}
+
+				if(changesOnly && unchanged[underground]) {
+					continue;
+				}
+
+				auto buffer = getBuffer(underground, changesOnly, compressed);
+				if(!buffer) {
+					continue;
+				}
+
+				const uint32_t key = nodeKey | (underground ? 1 : 0);
+				if(!changesOnly) {
+					peer->setNodeVisible(node, key);
+				}
+				peer->sendEncoded(buffer, changesOnly ? LIVE_OUTBOUND_NODE_CHANGES : LIVE_OUTBOUND_NODE, key, floors & (underground ? 0xFF00 : 0x00FF));
 			}
+		}
+	}
 
-			if(node->isVisible(clientId, false)) {
-				peer->sendNode(clientId, node, ndx, ndy, floors & 0x00FF);
-			}
+	// Behind the nodes, so a client that has seen the sequence has everything before it
+	NetworkMessage message;
+	writeJournalSequence(message);
+
+	std::shared_ptr<std::vector<uint8_t>> buffers[2];
+	for(auto& clientEntry : clients) {
+		LivePeer* peer = clientEntry.second;
+		const uint32_t peerFeatures = peer->getFeatures();
+		if(!testFlags(peerFeatures, LIVE_FEATURE_JOURNAL)) {
+			continue;
 		}
+
+		const bool compressed = testFlags(peerFeatures, LIVE_FEATURE_COMPRESSION);
+		auto& buffer = buffers[compressed];
+		if(!buffer) {
+			buffer = encodeMessage(message, compressed);
+		}
+		peer->sendEncoded(buffer);
 	}
 }
 
@@ -235,11 +369,32 @@ void LiveServer::broadcastCursor(const LiveCursor& cursor)
 	message.write<uint8_t>(PACKET_CURSOR_UPDATE);
 	writeCursor(message, cursor);
 
+	// An older position of the cursor still waiting for a slow peer is dropped for this one
+	std::shared_ptr<std::vector<uint8_t>> buffers[2];
+	for(auto& clientEntry : clients) {
+		LivePeer* peer = clientEntry.second;
+		if(peer->getClientId() != cursor.id && peer->wantsCursor(cursor)) {
+			const bool compressed = testFlags(peer->getFeatures(), LIVE_FEATURE_COMPRESSION);
+			auto& buffer = buffers[compressed];
+			if(!buffer) {
+				buffer = encodeMessage(message, compressed);
+			}
+			peer->sendEncoded(buffer, LIVE_OUTBOUND_CURSOR, cursor.id);
+		}
+	}
+}
+
+void LiveServer::broadcastPacket(const NetworkMessage& message)
+{
+	std::shared_ptr<std::vector<uint8_t>> buffers[2];
 	for(auto& clientEntry : clients) {
 		LivePeer* peer = clientEntry.second;
-		if(peer->getClientId() != cursor.id) {
-			peer->send(message);
+		const bool compressed = testFlags(peer->getFeatures(), LIVE_FEATURE_COMPRESSION);
+		auto& buffer = buffers[compressed];
+		if(!buffer) {
+			buffer = encodeMessage(message, compressed);
 		}
+		peer->sendEncoded(buffer);
 	}
 }
 
@@ -254,9 +409,7 @@ void LiveServer::broadcastChat(const wxString& speaker, const wxString& chatMess
 	message.write<std::string>(nstr(speaker));
 	message.write<std::string>(nstr(chatMessage));
 
-	for(auto& clientEntry : clients) {
-		clientEntry.second->send(message);
-	}
+	broadcastPacket(message);
 
 	log->Chat(name, chatMessage);
 }
@@ -271,9 +424,7 @@ void LiveServer::startOperation(const wxString& operationMessage)
 	message.write<uint8_t>(PACKET_START_OPERATION);
 	message.write<std::string>(nstr(operationMessage));
 
-	for(auto& clientEntry : clients) {
-		clientEntry.second->send(message);
-	}
+	broadcastPacket(message);
 }
 
 void LiveServer::updateOperation(int32_t percent)
@@ -286,9 +437,7 @@ void LiveServer::updateOperation(int32_t percent)
 	message.write<uint8_t>(PACKET_UPDATE_OPERATION);
 	message.write<uint32_t>(percent);
 
-	for(auto& clientEntry : clients) {
-		clientEntry.second->send(message);
-	}
+	broadcastPacket(message);
 }
 
 LiveLogTab* LiveServer::createLogWindow(wxWindow* parent)
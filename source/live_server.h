@@ -26,6 +26,13 @@ class LivePeer;
 class LiveLogTab;
 class QTreeNode;
 
+// A node half (key as in PACKET_NODE) changed by the committed change numbered sequence
+struct LiveJournalEntry
+{
+	uint64_t sequence;
+	uint32_t key;
+};
+
 class LiveServer : public LiveSocket
 {
 	public:
@@ -48,6 +55,12 @@ class LiveServer : public LiveSocket
 		void updateCursor(const Position& position);
 		void updateClientList() const;
 
+		// Summed over the peers
+		BufferUsage getBufferUsage() override;
+		void sendPing() override;
+
+		const std::unordered_map<uint32_t, LivePeer*>& getClients() const { return clients; }
+
 		//
 		LiveLogTab* createLogWindow(wxWindow* parent);
 
@@ -70,7 +83,20 @@ class LiveServer : public LiveSocket
 		void startOperation(const wxString& operationMessage);
 		void updateOperation(int32_t percent);
 
+		// The journal of the session, every broadcast of nodes is one sequence number.
+		// Changes after the horizon are all known, a client behind it gets everything it holds again.
+		uint32_t getJournalSession() const { return journalSession; }
+		uint64_t getJournalSequence() const { return journalSequence; }
+		uint64_t getJournalHorizon() const { return journalHorizon; }
+		// The last sequence that changed the node, 0 if it has not changed since the horizon
+		uint64_t getNodeVersion(uint32_t key) const;
+		void writeJournalSequence(NetworkMessage& message) const;
+
 	protected:
+		void recordJournal(uint32_t key);
+		// Encodes the message once per compression setting and queues it for every peer
+		void broadcastPacket(const NetworkMessage& message);
+
 		std::unordered_map<uint32_t, LivePeer*> clients;
 
 		std::shared_ptr<asio::ip::tcp::acceptor> acceptor;
@@ -78,6 +104,14 @@ class LiveServer : public LiveSocket
 
 		Editor* editor;
 
+		// Ring buffer of the latest changes, nodeVersions indexes the entries still in it
+		std::vector<LiveJournalEntry> journal;
+		std::unordered_map<uint32_t, uint64_t> nodeVersions;
+		size_t journalHead;
+		uint64_t journalSequence;
+		uint64_t journalHorizon;
+		uint32_t journalSession;
+
 		uint32_t clientIds;
 		uint16_t port;
 
@@ -21,10 +21,22 @@
 #include "iomap_otbm.h"
 #include "live_tab.h"
 #include "editor.h"
+#include "action.h"
+
+#include <zlib.h>
+#include <chrono>
+
+// Smaller packets aren't worth the time
+static constexpr size_t LiveCompressionThreshold = 512;
+// The size a peer claims for a compressed message is checked before anything is allocated: no
+// message gets anywhere near this, and deflate never shrinks anything more than about 1032:1
+static constexpr uint32_t LiveMaxInflatedSize = 64 * 1024 * 1024;
+static constexpr uint64_t LiveMaxInflateRatio = 1032;
 
 LiveSocket::LiveSocket() :
 	cursors(), mapReader(nullptr, 0), mapWriter(),
-	mapVersion(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE)), log(nullptr),
+	mapVersion(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE)), nodeHashes(MapHashCache::HASH_LIVE), features(0),
+	receivedMessages(), receivedBytes(0), drainPending(false), readStalled(false), traffic(), roundTrip(-1), log(nullptr),
 	name("User"), password("")
 {
 	//
@@ -141,6 +153,12 @@ void LiveSocket::sendNode(uint32_t clientId, QTreeNode* node, int32_t ndx, int32
 
 	// Send message
 	NetworkMessage message;
+	writeNode(message, node, ndx, ndy, floorMask);
+	send(message);
+}
+
+void LiveSocket::writeNode(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask)
+{
 	message.write<uint8_t>(PACKET_NODE);
 	message.write<uint32_t>((ndx << 18) | (ndy << 4) | ((floorMask & 0xFF00) ? 1 : 0));
 
@@ -164,11 +182,58 @@ void LiveSocket::sendNode(uint32_t clientId, QTreeNode* node, int32_t ndx, int32
 			}
 		}
 	}
+}
 
-	send(message);
+void LiveSocket::receiveNodeChanges(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy)
+{
+	QTreeNode* node = editor.getMap().getLeaf(ndx * 4, ndy * 4);
+	if(!node) {
+		log->Message("Warning: Received changes for unknown tile (" + std::to_string(ndx * 4) + "/" + std::to_string(ndy * 4) + ")");
+		message.position = message.buffer.size();
+		return;
+	}
+
+	uint16_t floorBits = message.read<uint16_t>();
+	for(uint_fast8_t z = 0; z < 16; ++z) {
+		if(testFlags(floorBits, static_cast<uint64_t>(1) << z)) {
+			uint16_t tileMask = message.read<uint16_t>();
+			receiveFloor(message, editor, action, ndx, ndy, z, node, node->getFloor(z), tileMask);
+		}
+	}
+}
+
+bool LiveSocket::writeNodeChanges(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask, const DirtyList& dirtyList)
+{
+	const uint32_t pos = (ndx << 18) | (ndy << 4);
+
+	message.write<uint8_t>(PACKET_NODE_CHANGES);
+	message.write<uint32_t>(pos | ((floorMask & 0xFF00) ? 1 : 0));
+
+	uint16_t sendMask = 0;
+	for(uint32_t z = 0; z < 16; ++z) {
+		uint32_t bit = 1 << z;
+		if(testFlags(floorMask, bit) && dirtyList.GetTileMask(pos, z) != 0) {
+			sendMask |= bit;
+		}
+	}
+
+	message.write<uint16_t>(sendMask);
+	if(sendMask == 0) {
+		return false;
+	}
+
+	Floor** floors = node->getFloors();
+	for(uint32_t z = 0; z < 16; ++z) {
+		if(testFlags(sendMask, static_cast<uint64_t>(1) << z)) {
+			uint16_t tileMask = dirtyList.GetTileMask(pos, z);
+			message.write<uint16_t>(tileMask);
+			sendFloor(message, floors[z], tileMask);
+		}
+	}
+	return true;
 }
 
-void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, int32_t z, QTreeNode* node, Floor* floor)
+void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, int32_t z, QTreeNode* node, Floor* floor, uint16_t tileMask)
 {
 	Map& map = editor.getMap();
 
@@ -176,15 +241,21 @@ void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* a
 	if(tileBits == 0) {
 		for(uint_fast8_t x = 0; x < 4; ++x) {
 			for(uint_fast8_t y = 0; y < 4; ++y) {
-				action->addChange(new Change(map.allocator(node->createTile(ndx * 4 + x, ndy * 4 + y, z))));
+				if(testFlags(tileMask, static_cast<uint64_t>(1) << ((x * 4) + y))) {
+					action->addChange(new Change(map.allocator(node->createTile(ndx * 4 + x, ndy * 4 + y, z))));
+				}
 			}
 		}
 		return;
 	}
 
-	// -1 on address since we skip the first START_NODE when sending
-	const std::string& data = message.read<std::string>();
-	mapReader.assign(reinterpret_cast<const uint8_t*>(data.c_str() - 1), data.size());
+	// -1 on address since we skip the first START_NODE when sending, the byte before
+	// the data is still within the message
+	const std::string_view data = message.read<std::string_view>();
+	if(data.empty()) {
+		return;
+	}
+	mapReader.assign(reinterpret_cast<const uint8_t*>(data.data() - 1), data.size());
 
 	BinaryNode* rootNode = mapReader.getRootNode();
 	BinaryNode* tileNode = rootNode->getChild();
@@ -196,9 +267,12 @@ void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* a
 			position.y = (ndy * 4) + y;
 
 			if(testFlags(tileBits, static_cast<uint64_t>(1) << ((x * 4) + y))) {
-				receiveTile(tileNode, editor, action, &position);
-				tileNode->advance();
-			} else {
+				// Fewer tiles than the bits say, the node is freed once advanced past the last one
+				if(tileNode) {
+					receiveTile(tileNode, editor, action, &position);
+					tileNode = tileNode->advance();
+				}
+			} else if(testFlags(tileMask, static_cast<uint64_t>(1) << ((x * 4) + y))) {
 				action->addChange(new Change(map.allocator(node->createTile(position.x, position.y, z))));
 			}
 		}
@@ -206,12 +280,20 @@ void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* a
 	mapReader.close();
 }
 
-void LiveSocket::sendFloor(NetworkMessage& message, Floor* floor)
+uint64_t LiveSocket::hashNode(Map& map, QTreeNode* node, int32_t ndx, int32_t ndy, bool underground)
+{
+	return nodeHashes.getLeafHash(map, node, ndx * 4, ndy * 4, underground ? 0xFF00 : 0x00FF);
+}
+
+void LiveSocket::sendFloor(NetworkMessage& message, Floor* floor, uint16_t tileMask)
 {
 	uint16_t tileBits = 0;
 	for(uint_fast8_t x = 0; x < 4; ++x) {
 		for(uint_fast8_t y = 0; y < 4; ++y) {
 			uint_fast8_t index = (x * 4) + y;
+			if(!floor || !testFlags(tileMask, static_cast<uint64_t>(1) << index)) {
+				continue;
+			}
 
 			Tile* tile = floor->locs[index].get();
 			if(tile && tile->size() > 0) {
@@ -280,7 +362,7 @@ void LiveSocket::sendTile(MemoryNodeFileWriteHandle& writer, Tile* tile, const P
 	Item* ground = tile->ground;
 	if(ground) {
 		if(ground->isComplex()) {
-			ground->serializeItemNode_OTBM(mapVersion, writer);
+			ground->writeItemNode_OTBM(mapVersion, writer);
 		} else {
 			writer.addByte(OTBM_ATTR_ITEM);
 			ground->serializeItemCompact_OTBM(mapVersion, writer);
@@ -288,7 +370,7 @@ void LiveSocket::sendTile(MemoryNodeFileWriteHandle& writer, Tile* tile, const P
 	}
 
 	for(Item* item : tile->items) {
-		item->serializeItemNode_OTBM(mapVersion, writer);
+		item->writeItemNode_OTBM(mapVersion, writer);
 	}
 
 	writer.endNode();
@@ -314,6 +396,9 @@ Tile* LiveSocket::readTile(BinaryNode* node, Editor& editor, const Position* pos
 		uint16_t x; node->getU16(x); pos.x = x;
 		uint16_t y; node->getU16(y); pos.y = y;
 		uint8_t z; node->getU8(z); pos.z = z;
+		if(pos.z > rme::MapMaxLayer) {
+			return nullptr;
+		}
 	}
 
 	Tile* tile = map.allocator(
@@ -405,13 +490,17 @@ Tile* LiveSocket::readTile(BinaryNode* node, Editor& editor, const Position* pos
 
 LiveCursor LiveSocket::readCursor(NetworkMessage& message)
 {
-	LiveCursor cursor;
-	cursor.id = message.read<uint32_t>();
+	// Identifier, colour and position
+	LiveCursor cursor {};
+	if(!message.require(4 + 4 + 5)) {
+		return cursor;
+	}
+	cursor.id = message.take<uint32_t>();
 
-	uint8_t r = message.read<uint8_t>();
-	uint8_t g = message.read<uint8_t>();
-	uint8_t b = message.read<uint8_t>();
-	uint8_t a = message.read<uint8_t>();
+	uint8_t r = message.take<uint8_t>();
+	uint8_t g = message.take<uint8_t>();
+	uint8_t b = message.take<uint8_t>();
+	uint8_t a = message.take<uint8_t>();
 	cursor.color = wxColor(r, g, b, a);
 
 	cursor.pos = message.read<Position>();
@@ -427,3 +516,230 @@ void LiveSocket::writeCursor(NetworkMessage& message, const LiveCursor& cursor)
 	message.write<uint8_t>(cursor.color.Alpha());
 	message.write<Position>(cursor.pos);
 }
+
+std::shared_ptr<std::vector<uint8_t>> LiveSocket::encodeMessage(const NetworkMessage& message, bool compress) const
+{
+	if(compress) {
+		NetworkMessage compressed;
+		if(compressMessage(message, compressed)) {
+			return encodeMessage(std::move(compressed), false);
+		}
+	}
+
+	// The write finishes on the network thread, the buffer has to outlive the message
+	NetworkBufferPool& pool = NetworkBufferPool::getInstance();
+	std::vector<uint8_t> buffer = pool.acquire(message.size + 4);
+	buffer.assign(message.buffer.begin(), message.buffer.begin() + message.size + 4);
+	const uint32_t size = static_cast<uint32_t>(message.size);
+	memcpy(buffer.data(), &size, 4);
+	return pool.share(std::move(buffer));
+}
+
+std::shared_ptr<std::vector<uint8_t>> LiveSocket::encodeMessage(NetworkMessage&& message, bool compress) const
+{
+	if(compress) {
+		NetworkMessage compressed;
+		if(compressMessage(message, compressed)) {
+			message.clear();
+			return encodeMessage(std::move(compressed), false);
+		}
+	}
+
+	// The size goes into the four bytes kept free in front
+	std::vector<uint8_t> buffer = std::move(message.buffer);
+	const uint32_t size = static_cast<uint32_t>(message.size);
+	message.buffer.clear();
+	message.position = 4;
+	message.size = 0;
+
+	buffer.resize(size + 4);
+	memcpy(buffer.data(), &size, 4);
+	return NetworkBufferPool::getInstance().share(std::move(buffer));
+}
+
+bool LiveSocket::compressMessage(const NetworkMessage& message, NetworkMessage& compressed) const
+{
+	if(message.size < LiveCompressionThreshold) {
+		return false;
+	}
+
+	compressed.write<uint8_t>(PACKET_COMPRESSED);
+	compressed.write<uint32_t>(static_cast<uint32_t>(message.size));
+	const size_t lengthPosition = compressed.position;
+	compressed.write<uint32_t>(0);
+
+	uLongf length = compressBound(message.size);
+	compressed.buffer.resize(compressed.position + length);
+	if(compress2(&compressed.buffer[compressed.position], &length, &message.buffer[4], message.size, Z_BEST_SPEED) != Z_OK) {
+		return false;
+	}
+
+	// Incompressible data goes as it is
+	if(compressed.size + length >= message.size) {
+		return false;
+	}
+
+	const uint32_t length32 = static_cast<uint32_t>(length);
+	memcpy(&compressed.buffer[lengthPosition], &length32, 4);
+	compressed.size += length;
+	compressed.position += length;
+	return true;
+}
+
+bool LiveSocket::decompressMessage(NetworkMessage& message, NetworkMessage& decompressed) const
+{
+	// Nested compressed packets would inflate and recurse without end
+	if(message.inflated || message.position + 8 > message.buffer.size()) {
+		return false;
+	}
+
+	const uint32_t size = message.read<uint32_t>();
+	const uint32_t length = message.read<uint32_t>();
+	if(message.position + length > message.buffer.size()) {
+		return false;
+	}
+	if(size > LiveMaxInflatedSize || size > length * LiveMaxInflateRatio) {
+		return false;
+	}
+
+	decompressed.buffer.resize(4 + size);
+	decompressed.position = 4;
+	decompressed.size = size;
+	decompressed.inflated = true;
+
+	uLongf decompressedLength = size;
+	const int result = uncompress(&decompressed.buffer[4], &decompressedLength, &message.buffer[message.position], length);
+	message.position += length;
+	return result == Z_OK && decompressedLength == size;
+}
+
+void LiveSocket::inflateMessage(NetworkMessage& message) const
+{
+	const size_t start = message.position;
+	if(start >= message.buffer.size() || message.buffer[start] != PACKET_COMPRESSED) {
+		return;
+	}
+
+	++message.position;
+	NetworkMessage decompressed;
+	if(!decompressMessage(message, decompressed) || message.position != message.buffer.size()) {
+		message.position = start;
+		return;
+	}
+	message = std::move(decompressed);
+}
+
+bool LiveSocket::queueReceived(NetworkMessage& message)
+{
+	NetworkMessage* slot = receivedMessages.acquire();
+	if(!slot) {
+		readStalled = true;
+		// The UI thread may have emptied the queue meanwhile, whoever clears the flag goes on
+		slot = receivedMessages.acquire();
+		if(!slot || !readStalled.exchange(false)) {
+			return false;
+		}
+	}
+
+	std::swap(*slot, message);
+	receivedBytes += slot->buffer.size();
+	receivedMessages.publish();
+	return true;
+}
+
+void LiveSocket::popReceived()
+{
+	NetworkMessage* message = receivedMessages.front();
+	if(message) {
+		receivedBytes -= message->buffer.size();
+		receivedMessages.pop();
+	}
+}
+
+LiveSocket::BufferUsage LiveSocket::getBufferUsage()
+{
+	BufferUsage usage;
+	usage.messages = receivedMessages.size();
+	usage.bytes = receivedBytes + mapWriter.getCapacity();
+	return usage;
+}
+
+void LiveSocket::countReceived(const NetworkMessage& message, size_t bytes)
+{
+	if(message.buffer.size() > message.position) {
+		traffic.received(message.buffer[message.position], bytes);
+	}
+}
+
+void LiveSocket::writePing(NetworkMessage& message, uint8_t type) const
+{
+	message.write<uint8_t>(type);
+	message.write<uint64_t>(getTimestamp());
+}
+
+void LiveSocket::readPong(NetworkMessage& message)
+{
+	const uint64_t timestamp = message.read<uint64_t>();
+	roundTrip = static_cast<int64_t>(getTimestamp() - timestamp);
+}
+
+uint64_t LiveSocket::getTimestamp()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* LiveSocket::getPacketName(uint8_t type)
+{
+	switch(type) {
+		case PACKET_HELLO_FROM_CLIENT: return "hello from client";
+		case PACKET_READY_CLIENT: return "ready client";
+		case PACKET_REQUEST_NODES: return "request nodes";
+		case PACKET_CHANGE_LIST: return "change list";
+		case PACKET_REQUEST_CHANGES_SINCE: return "request changes since";
+		case PACKET_ADD_HOUSE: return "add house";
+		case PACKET_EDIT_HOUSE: return "edit house";
+		case PACKET_REMOVE_HOUSE: return "remove house";
+		case PACKET_CLIENT_TALK: return "client talk";
+		case PACKET_CLIENT_UPDATE_CURSOR: return "client cursor";
+		case PACKET_CLIENT_VIEWPORT: return "client viewport";
+		case PACKET_CLIENT_PING: return "client ping";
+		case PACKET_CLIENT_PONG: return "client pong";
+		case PACKET_CLIENT_NODE_HASHES: return "client node hashes";
+		case PACKET_HELLO_FROM_SERVER: return "hello from server";
+		case PACKET_KICK: return "kick";
+		case PACKET_ACCEPTED_CLIENT: return "accepted client";
+		case PACKET_CHANGE_CLIENT_VERSION: return "change client version";
+		case PACKET_SERVER_TALK: return "server talk";
+		case PACKET_NODE: return "node";
+		case PACKET_CURSOR_UPDATE: return "cursor";
+		case PACKET_START_OPERATION: return "start operation";
+		case PACKET_UPDATE_OPERATION: return "update operation";
+		case PACKET_CHAT_MESSAGE: return "chat message";
+		case PACKET_NODE_CHANGES: return "node changes";
+		case PACKET_JOURNAL_SEQUENCE: return "journal sequence";
+		case PACKET_CHANGES_SINCE_DONE: return "changes since done";
+		case PACKET_NODES_EXPIRED: return "nodes expired";
+		case PACKET_SERVER_PING: return "server ping";
+		case PACKET_SERVER_PONG: return "server pong";
+		case PACKET_COMPRESSED: return "compressed";
+		default: return "unknown";
+	}
+}
+
+uint64_t LiveTrafficStats::getBytesIn() const
+{
+	uint64_t total = 0;
+	for(const auto& bytes : bytesIn) {
+		total += bytes.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+uint64_t LiveTrafficStats::getBytesOut() const
+{
+	uint64_t total = 0;
+	for(const auto& bytes : bytesOut) {
+		total += bytes.load(std::memory_order_relaxed);
+	}
+	return total;
+}
@@ -23,12 +23,17 @@
 #include "live_packets.h"
 #include "filehandle.h"
 #include "iomap.h"
+#include "map_hash.h"
+#include "spsc_queue.h"
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <unordered_map>
 
 class LiveLogTab;
 class Action;
+class DirtyList;
 
 struct LiveCursor
 {
@@ -37,6 +42,28 @@ struct LiveCursor
 	Position pos;
 };
 
+// Traffic of a connection by packet type, a compressed packet counts under the type it holds.
+// Counted on the network threads for received packets and on the UI thread for sent ones.
+struct LiveTrafficStats
+{
+	std::array<std::atomic<uint64_t>, 256> bytesIn {};
+	std::array<std::atomic<uint64_t>, 256> bytesOut {};
+	std::array<std::atomic<uint32_t>, 256> packetsIn {};
+	std::array<std::atomic<uint32_t>, 256> packetsOut {};
+
+	void received(uint8_t type, size_t bytes) {
+		bytesIn[type].fetch_add(bytes, std::memory_order_relaxed);
+		packetsIn[type].fetch_add(1, std::memory_order_relaxed);
+	}
+	void sent(uint8_t type, size_t bytes) {
+		bytesOut[type].fetch_add(bytes, std::memory_order_relaxed);
+		packetsOut[type].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint64_t getBytesIn() const;
+	uint64_t getBytesOut() const;
+};
+
 class LiveSocket
 {
 	public:
@@ -62,18 +89,49 @@ class LiveSocket
 		//
 		virtual void receiveHeader() = 0;
 		virtual void receive(uint32_t packetSize) = 0;
+		// Takes the buffer of the message, it is left empty
 		virtual void send(NetworkMessage& message) = 0;
 
 		//
 		virtual void updateCursor(const Position& position) = 0;
 
+		uint32_t getFeatures() const { return features; }
+
+		struct BufferUsage {
+			size_t messages = 0;
+			size_t bytes = 0;
+		};
+		// Messages waiting to be handled or written and the buffers they are built in, UI thread only
+		virtual BufferUsage getBufferUsage();
+
+		const LiveTrafficStats& getTraffic() const { return traffic; }
+		// Microseconds of the last ping answered, -1 before the first one
+		int64_t getRoundTrip() const { return roundTrip; }
+		// Nodes asked for and not received yet
+		virtual size_t getPendingNodes() { return 0; }
+		// Pings the other side if it takes part, called from the live tab every so often
+		virtual void sendPing() {}
+		// Called from the live tab along with sendPing, the client compares its nodes with the server
+		virtual void checkIntegrity() {}
+		// Of the floors of a node half as PACKET_NODE sends them, hashed again only where it changed
+		uint64_t hashNode(Map& map, QTreeNode* node, int32_t ndx, int32_t ndy, bool underground);
+
+		static const char* getPacketName(uint8_t type);
+
 	protected:
 		// receive / send methods
 		void receiveNode(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, bool underground);
 		void sendNode(uint32_t clientId, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask);
+		void writeNode(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask);
+
+		// Only the tiles of the node the dirty list has marked, the other side already has the rest.
+		// Returns false if none of them is on the floors of the mask.
+		void receiveNodeChanges(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy);
+		bool writeNodeChanges(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask, const DirtyList& dirtyList);
 
-		void receiveFloor(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, int32_t z, QTreeNode* node, Floor* floor);
-		void sendFloor(NetworkMessage& message, Floor* floor);
+		// tileMask selects the tiles of the floor that are sent, the others are left as they are
+		void receiveFloor(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, int32_t z, QTreeNode* node, Floor* floor, uint16_t tileMask = 0xFFFF);
+		void sendFloor(NetworkMessage& message, Floor* floor, uint16_t tileMask = 0xFFFF);
 
 		void receiveTile(BinaryNode* node, Editor& editor, Action* action, const Position* position);
 		void sendTile(MemoryNodeFileWriteHandle& writer, Tile* tile, const Position* position);
@@ -84,12 +142,52 @@ class LiveSocket
 		LiveCursor readCursor(NetworkMessage& message);
 		void writeCursor(NetworkMessage& message, const LiveCursor& cursor);
 
+		// The bytes to write to the socket for a message, with its size in front
+		std::shared_ptr<std::vector<uint8_t>> encodeMessage(const NetworkMessage& message, bool compress) const;
+		// Same, but the buffer of the message is handed over instead of copied
+		std::shared_ptr<std::vector<uint8_t>> encodeMessage(NetworkMessage&& message, bool compress) const;
+		bool compressMessage(const NetworkMessage& message, NetworkMessage& compressed) const;
+		// Reads a PACKET_COMPRESSED body, the packets it holds are put into decompressed. Refused
+		// within a message that was inflated already.
+		bool decompressMessage(NetworkMessage& message, NetworkMessage& decompressed) const;
+		// Run on the network thread, so a compressed message reaches the UI thread already inflated.
+		// A message that fails to inflate is left as it is for the parser to reject.
+		void inflateMessage(NetworkMessage& message) const;
+
+		// Network side, on the strand of the socket: hands message to the UI thread and leaves a
+		// recycled buffer in it. False if the queue is full, reading then waits for takeStalledRead.
+		bool queueReceived(NetworkMessage& message);
+		// UI side, once the message at the front of receivedMessages has been handled
+		void popReceived();
+		// UI side, after draining: true if a read was held back and has to be queued again
+		bool takeStalledRead() { return readStalled.exchange(false); }
+
+		// Counts a message just read from the socket under the packet it starts with
+		void countReceived(const NetworkMessage& message, size_t bytes);
+		void writePing(NetworkMessage& message, uint8_t type) const;
+		// The other side has echoed our ping
+		void readPong(NetworkMessage& message);
+		static uint64_t getTimestamp();
+
 		//
 		std::unordered_map<uint32_t, LiveCursor> cursors;
 
 		MemoryNodeFileReadHandle mapReader;
 		MemoryNodeFileWriteHandle mapWriter;
 		VirtualIOMap mapVersion;
+		MapHashCache nodeHashes;
+
+		// LiveFeatureFlags agreed on in the handshake
+		uint32_t features;
+
+		// Received messages on their way to the UI thread, drained a batch per event loop pass
+		SpscQueue<NetworkMessage, 64> receivedMessages;
+		std::atomic<size_t> receivedBytes;
+		std::atomic<bool> drainPending;
+		std::atomic<bool> readStalled;
+
+		LiveTrafficStats traffic;
+		int64_t roundTrip;
 
 		LiveLogTab* log;
 
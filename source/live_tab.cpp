@@ -41,13 +41,29 @@ IMPLEMENT_CLASS(myGrid, wxGrid)
 
 BEGIN_EVENT_TABLE(LiveLogTab, wxPanel)
 	EVT_TEXT(LIVE_CHAT_TEXTBOX, LiveLogTab::OnChat)
+	EVT_TIMER(LIVE_METRICS_TIMER, LiveLogTab::OnMetricsTimer)
+	EVT_BUTTON(LIVE_METRICS_EXPORT, LiveLogTab::OnExportMetrics)
 END_EVENT_TABLE()
 
+namespace {
+	// How often the metrics are refreshed and the other side pinged
+	constexpr int LiveMetricsInterval = 1000;
+
+	wxString formatBytes(uint64_t bytes)
+	{
+		if(bytes >= 1024 * 1024) {
+			return wxString::Format("%.1f MB", bytes / (1024.0 * 1024.0));
+		}
+		return wxString::Format("%.1f KB", bytes / 1024.0);
+	}
+}
+
 LiveLogTab::LiveLogTab(MapTabbook* aui, LiveSocket* server) :
 	EditorTab(),
 	wxPanel(aui),
 	aui(aui),
-	socket(server)
+	socket(server),
+	metrics_timer(this, LIVE_METRICS_TIMER)
 {
 	wxSizer* topsizer = newd wxBoxSizer(wxVERTICAL);
 
@@ -94,8 +110,11 @@ LiveLogTab::LiveLogTab(MapTabbook* aui, LiveSocket* server) :
 	left_pane->SetSizerAndFit(left_sizer);
 
 	// Setup right panel
-	user_list = newd myGrid(splitter, wxID_ANY, wxDefaultPosition, wxSize(280, 100));
-	user_list->CreateGrid(5, 3);
+	wxPanel* right_pane = newd wxPanel(splitter);
+	wxSizer* right_sizer = newd wxBoxSizer(wxVERTICAL);
+
+	user_list = newd myGrid(right_pane, wxID_ANY, wxDefaultPosition, wxSize(520, 100));
+	user_list->CreateGrid(5, 7);
 	user_list->DisableDragRowSize();
 	user_list->DisableDragColSize();
 	user_list->SetSelectionMode(wxGrid::wxGridSelectRows);
@@ -106,7 +125,21 @@ LiveLogTab::LiveLogTab(MapTabbook* aui, LiveSocket* server) :
 	user_list->SetColLabelValue(1, "#");
 	user_list->SetColSize(1, 36);
 	user_list->SetColLabelValue(2, "Name");
-	user_list->SetColSize(2, 200);
+	user_list->SetColSize(2, 160);
+	user_list->SetColLabelValue(3, "Ping");
+	user_list->SetColSize(3, 60);
+	user_list->SetColLabelValue(4, "Queue");
+	user_list->SetColSize(4, 80);
+	user_list->SetColLabelValue(5, "In");
+	user_list->SetColSize(5, 70);
+	user_list->SetColLabelValue(6, "Out");
+	user_list->SetColSize(6, 70);
+	user_list->EnableEditing(false);
+	user_list->GetGridWindow()->SetToolTip("Queue: nodes waiting / messages and bytes waiting for the socket");
+	right_sizer->Add(user_list, 1, wxEXPAND);
+
+	right_sizer->Add(newd wxButton(right_pane, LIVE_METRICS_EXPORT, "Export Metrics..."), 0, wxEXPAND);
+	right_pane->SetSizerAndFit(right_sizer);
 
 	//user_list->GetGridWindow()->
 
@@ -115,16 +148,17 @@ LiveLogTab::LiveLogTab(MapTabbook* aui, LiveSocket* server) :
 
 	wxSizer* split_sizer = newd wxBoxSizer(wxHORIZONTAL);
 	split_sizer->Add(left_pane, wxSizerFlags(1).Expand());
-	split_sizer->Add(user_list, wxSizerFlags(0).Expand());
+	split_sizer->Add(right_pane, wxSizerFlags(0).Expand());
 	splitter->SetSizerAndFit(split_sizer);
 	//splitter->SplitVertically(left_pane, user_list, max(this->GetSize().GetWidth() - 200, 0));
 
 	aui->AddTab(this, true);
+	metrics_timer.Start(LiveMetricsInterval);
 }
 
 LiveLogTab::~LiveLogTab()
 {
-
+	metrics_timer.Stop();
 }
 
 bool LiveLogTab::IsCurrent() const
@@ -153,6 +187,7 @@ wxString LiveLogTab::GetTitle() const
 void LiveLogTab::Disconnect()
 {
 	socket->log = nullptr;
+	metrics_timer.Stop();
 	input->SetWindowStyle(input->GetWindowStyle() | wxTE_READONLY);
 	socket = nullptr;
 	Refresh();
@@ -241,3 +276,97 @@ void LiveLogTab::UpdateClientList(const std::unordered_map<uint32_t, LivePeer*>&
 		++i;
 	}
 }
+
+std::vector<std::pair<wxString, LiveSocket*>> LiveLogTab::GetMetricSockets() const
+{
+	std::vector<std::pair<wxString, LiveSocket*>> sockets;
+	if(!socket) {
+		return sockets;
+	}
+
+	if(dynamic_cast<LiveServer*>(socket)) {
+		for(const auto& clientEntry : clients) {
+			sockets.emplace_back(clientEntry.second->getName(), clientEntry.second);
+		}
+	} else {
+		sockets.emplace_back(socket->getHostName(), socket);
+	}
+	return sockets;
+}
+
+void LiveLogTab::UpdateMetrics()
+{
+	const auto sockets = GetMetricSockets();
+	if(user_list->GetNumberRows() < static_cast<int>(sockets.size())) {
+		user_list->AppendRows(sockets.size() - user_list->GetNumberRows());
+	}
+
+	int32_t row = 0;
+	for(const auto& entry : sockets) {
+		LiveSocket* metricSocket = entry.second;
+		const int64_t roundTrip = metricSocket->getRoundTrip();
+		const LiveSocket::BufferUsage usage = metricSocket->getBufferUsage();
+		const LiveTrafficStats& traffic = metricSocket->getTraffic();
+
+		if(!dynamic_cast<LivePeer*>(metricSocket)) {
+			user_list->SetCellValue(row, 2, entry.first);
+		}
+		user_list->SetCellValue(row, 3, roundTrip < 0 ? wxString("-") : wxString::Format("%lld ms", static_cast<long long>(roundTrip / 1000)));
+		user_list->SetCellValue(row, 4, wxString::Format("%zu / %zu", metricSocket->getPendingNodes(), usage.messages) + " / " + formatBytes(usage.bytes));
+		user_list->SetCellValue(row, 5, formatBytes(traffic.getBytesIn()));
+		user_list->SetCellValue(row, 6, formatBytes(traffic.getBytesOut()));
+		++row;
+	}
+}
+
+void LiveLogTab::OnMetricsTimer(wxTimerEvent& evt)
+{
+	if(!socket) {
+		return;
+	}
+
+	UpdateMetrics();
+	socket->sendPing();
+	socket->checkIntegrity();
+}
+
+void LiveLogTab::OnExportMetrics(wxCommandEvent& evt)
+{
+	const auto sockets = GetMetricSockets();
+	if(sockets.empty()) {
+		return;
+	}
+
+	wxFileDialog dialog(this, "Export live metrics...", "", "", "CSV files (*.csv)|*.csv", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() != wxID_OK) {
+		return;
+	}
+
+	wxFile file(dialog.GetPath(), wxFile::write);
+	if(!file.IsOpened()) {
+		return;
+	}
+
+	file.Write("connection,packet,packets in,bytes in,packets out,bytes out\n");
+	for(const auto& entry : sockets) {
+		LiveSocket* metricSocket = entry.second;
+		const LiveTrafficStats& traffic = metricSocket->getTraffic();
+		for(int type = 0; type < 256; ++type) {
+			const uint32_t packetsIn = traffic.packetsIn[type];
+			const uint32_t packetsOut = traffic.packetsOut[type];
+			if(packetsIn == 0 && packetsOut == 0) {
+				continue;
+			}
+
+			file.Write(wxString::Format("%s,%s,%u,%llu,%u,%llu\n", entry.first, LiveSocket::getPacketName(type),
+				packetsIn, static_cast<unsigned long long>(traffic.bytesIn[type]),
+				packetsOut, static_cast<unsigned long long>(traffic.bytesOut[type])));
+		}
+
+		const LiveSocket::BufferUsage usage = metricSocket->getBufferUsage();
+		file.Write(wxString::Format("%s,round trip us,%lld,,,\n", entry.first, static_cast<long long>(metricSocket->getRoundTrip())));
+		file.Write(wxString::Format("%s,pending nodes,%zu,,,\n", entry.first, metricSocket->getPendingNodes()));
+		file.Write(wxString::Format("%s,send backlog,%zu,%zu,,\n", entry.first, usage.messages, usage.bytes));
+	}
+	file.Close();
+}
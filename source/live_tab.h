@@ -57,12 +57,21 @@ public:
 	void OnResizeChat(wxSizeEvent& evt);
 	void OnResizeClientList(wxSizeEvent& evt);
 
+	// Refreshes the latency, queue and traffic columns, and pings for the next time
+	void OnMetricsTimer(wxTimerEvent& evt);
+	void OnExportMetrics(wxCommandEvent& evt);
+
 protected:
 	MapTabbook* aui;
 	LiveSocket* socket;
 	wxGrid* log;
 	wxTextCtrl* input;
 	wxGrid* user_list;
+	wxTimer metrics_timer;
+
+	void UpdateMetrics();
+	// The connections shown in the user list, in row order
+	std::vector<std::pair<wxString, LiveSocket*>> GetMetricSockets() const;
 
 	std::unordered_map<uint32_t, LivePeer*> clients;
 
@@ -27,6 +27,13 @@
 #include "extension_window.h"
 #include "find_item_window.h"
 #include "duplicated_items_window.h"
+#include "frame_profiler.h"
+#include "tracing.h"
+#include "memory_report_window.h"
+#include "session_recorder.h"
+#include "map_generator.h"
+#include "map_reachability.h"
+#include "map_search.h"
 #include "settings.h"
 
 #include "gui.h"
@@ -39,6 +46,8 @@
 #include "live_client.h"
 #include "live_server.h"
 
+#include <unordered_set>
+
 BEGIN_EVENT_TABLE(MainMenuBar, wxEvtHandler)
 END_EVENT_TABLE()
 
@@ -52,6 +61,7 @@ MainMenuBar::MainMenuBar(MainFrame *frame) : frame(frame)
 
 	MAKE_ACTION(NEW, wxITEM_NORMAL, OnNew);
 	MAKE_ACTION(OPEN, wxITEM_NORMAL, OnOpen);
+	MAKE_ACTION(OPEN_AREA, wxITEM_NORMAL, OnOpenArea);
 	MAKE_ACTION(SAVE, wxITEM_NORMAL, OnSave);
 	MAKE_ACTION(SAVE_AS, wxITEM_NORMAL, OnSaveAs);
 	MAKE_ACTION(GENERATE_MAP, wxITEM_NORMAL, OnGenerateMap);
@@ -61,8 +71,11 @@ MainMenuBar::MainMenuBar(MainFrame *frame) : frame(frame)
 	MAKE_ACTION(IMPORT_MONSTERS, wxITEM_NORMAL, OnImportMonsterData);
 	MAKE_ACTION(IMPORT_MINIMAP, wxITEM_NORMAL, OnImportMinimap);
 	MAKE_ACTION(EXPORT_MINIMAP, wxITEM_NORMAL, OnExportMinimap);
+	MAKE_ACTION(EXPORT_MAP, wxITEM_NORMAL, OnExportMap);
+	MAKE_ACTION(EXPORT_SERVER_MAP, wxITEM_NORMAL, OnExportServerMap);
 
 	MAKE_ACTION(RELOAD_DATA, wxITEM_NORMAL, OnReloadDataFiles);
+	MAKE_ACTION(RELOAD_MATERIALS, wxITEM_NORMAL, OnReloadMaterials);
 	//MAKE_ACTION(RECENT_FILES, wxITEM_NORMAL, OnRecent);
 	MAKE_ACTION(PREFERENCES, wxITEM_NORMAL, OnPreferences);
 	MAKE_ACTION(EXIT, wxITEM_NORMAL, OnQuit);
@@ -158,11 +171,17 @@ MainMenuBar::MainMenuBar(MainFrame *frame) : frame(frame)
 	MAKE_ACTION(SHOW_WALL_HOOKS, wxITEM_CHECK, OnChangeViewSettings);
 	MAKE_ACTION(SHOW_PICKUPABLES, wxITEM_CHECK, OnChangeViewSettings);
 	MAKE_ACTION(SHOW_MOVEABLES, wxITEM_CHECK, OnChangeViewSettings);
+	MAKE_ACTION(SHOW_FRAME_PROFILER, wxITEM_CHECK, OnChangeViewSettings);
+	MAKE_ACTION(DUMP_FRAME_PROFILE, wxITEM_NORMAL, OnDumpFrameProfile);
+	MAKE_ACTION(RECORD_SESSION, wxITEM_CHECK, OnRecordSession);
+	MAKE_ACTION(RECORD_TRACE, wxITEM_CHECK, OnRecordTrace);
+	MAKE_ACTION(SHOW_MEMORY_REPORT, wxITEM_NORMAL, OnShowMemoryReport);
 
 	MAKE_ACTION(WIN_MINIMAP, wxITEM_NORMAL, OnMinimapWindow);
 	MAKE_ACTION(WIN_ACTIONS_HISTORY, wxITEM_NORMAL, OnActionsHistoryWindow);
 	MAKE_ACTION(NEW_PALETTE, wxITEM_NORMAL, OnNewPalette);
 	MAKE_ACTION(TAKE_SCREENSHOT, wxITEM_NORMAL, OnTakeScreenshot);
+	MAKE_ACTION(RENDER_SELECTION, wxITEM_NORMAL, OnRenderSelection);
 
 	MAKE_ACTION(LIVE_START, wxITEM_NORMAL, OnStartLive);
 	MAKE_ACTION(LIVE_JOIN, wxITEM_NORMAL, OnJoinLive);
@@ -238,19 +257,35 @@ MainMenuBar::~MainMenuBar()
 
 namespace OnMapRemoveItems
 {
-	struct RemoveItemCondition
+	// The conditions of the removal passes, as parallel_remove_ItemOnMap calls them
+	struct ItemIdCondition
 	{
-		RemoveItemCondition(uint16_t itemId) :
-			itemId(itemId) { }
-
 		uint16_t itemId;
 
-		bool operator()(Map& map, Item* item, int64_t removed, int64_t done) {
-			if(done % 0x8000 == 0)
-				g_gui.SetLoadDone((uint32_t)(100 * done / map.getTileCount()));
+		bool operator()(const Tile*, const Item* item) const {
 			return item->getID() == itemId && !item->isComplex();
 		}
 	};
+
+	// Whether an item is a corpse is a bit of the tileset membership of its type
+	struct CorpseCondition
+	{
+		CorpseCondition() :
+			corpses(g_materials.getTilesetHandle("Corpses")) { }
+
+		Materials::TilesetHandle corpses;
+
+		bool operator()(const Tile*, const Item* item) const {
+			return g_materials.isInTileset(item->getID(), corpses) && !item->isComplex();
+		}
+	};
+
+	struct HouseItemCondition
+	{
+		bool operator()(const Tile* tile, const Item* item) const {
+			return tile->isHouseTile() && item->isMoveable();
+		}
+	};
 }
 
 void MainMenuBar::EnableItem(MenuBar::ActionID id, bool enable)
@@ -330,8 +365,10 @@ void MainMenuBar::Update()
 
 	EnableItem(IMPORT_MAP, is_local);
 	EnableItem(IMPORT_MONSTERS, is_local);
-	EnableItem(IMPORT_MINIMAP, false);
+	EnableItem(IMPORT_MINIMAP, is_local);
 	EnableItem(EXPORT_MINIMAP, is_local);
+	EnableItem(EXPORT_MAP, is_host);
+	EnableItem(EXPORT_SERVER_MAP, is_host);
 
 	EnableItem(FIND_ITEM, is_host);
 	EnableItem(REPLACE_ITEMS, is_local);
@@ -403,6 +440,14 @@ void MainMenuBar::Update()
 
 	EnableItem(DEBUG_VIEW_DAT, loaded);
 
+	EnableItem(RECORD_SESSION, is_local || g_session_recorder.isRecording());
+	CheckItem(RECORD_SESSION, g_session_recorder.isRecording());
+#if RME_TRACING > 0
+	CheckItem(RECORD_TRACE, Tracer::isRecording());
+#else
+	CheckItem(RECORD_TRACE, false);
+#endif
+
 	UpdateFloorMenu();
 	UpdateIndicatorsMenu();
 }
@@ -464,6 +509,7 @@ void MainMenuBar::LoadValues()
 	CheckItem(SHOW_WALL_HOOKS, g_settings.getBoolean(Config::SHOW_WALL_HOOKS));
 	CheckItem(SHOW_PICKUPABLES, g_settings.getBoolean(Config::SHOW_PICKUPABLES));
 	CheckItem(SHOW_MOVEABLES, g_settings.getBoolean(Config::SHOW_MOVEABLES));
+	CheckItem(SHOW_FRAME_PROFILER, g_settings.getBoolean(Config::SHOW_FRAME_PROFILER));
 }
 
 void MainMenuBar::LoadRecentFiles()
@@ -719,24 +765,50 @@ void MainMenuBar::OnNew(wxCommandEvent& WXUNUSED(event))
 
 void MainMenuBar::OnGenerateMap(wxCommandEvent& WXUNUSED(event))
 {
-	/*
-	if(!DoQuerySave()) return;
+	const long size = wxGetNumberFromUser("Width and height of the map, in tiles.", "Size:", "Generate Map", 1024, 256, 8192, frame);
+	if(size < 0) {
+		return;
+	}
+	const long seed = wxGetNumberFromUser("The same seed always gives the same map.", "Seed:", "Generate Map", 0, 0, 1000000000, frame);
+	if(seed < 0) {
+		return;
+	}
 
-	std::ostringstream os;
-	os << "Untitled-" << untitled_counter << ".otbm";
-	++untitled_counter;
+	if(!g_gui.NewMap()) {
+		return;
+	}
+	Editor* editor = g_gui.GetCurrentEditor();
+	if(!editor) {
+		return;
+	}
 
-	editor.generateMap(wxstr(os.str()));
+	MapGenerator::Options options;
+	options.width = int(size);
+	options.height = int(size);
+	options.seed = uint32_t(seed);
 
-	g_gui.SetStatusText("Generated newd map");
+	Map& map = editor->getMap();
+	MapGenerator generator(map, options);
+	bool generated;
+	{
+		ScopedLoadingBar loadingBar("Generating map...", true);
+		generated = generator.generateMap([](int percent) {
+			return g_gui.SetLoadDone(percent);
+		});
+	}
+	map.doChange();
+
+	if(!generated) {
+		g_gui.PopupDialog("Error", wxstr(generator.getError()), wxOK);
+	} else {
+		g_gui.SetStatusText(wxString::Format("Generated %llu tiles with %llu items.", (unsigned long long)generator.getTileCount(), (unsigned long long)generator.getItemCount()));
+	}
 
 	g_gui.UpdateTitle();
 	g_gui.RefreshPalettes();
 	g_gui.UpdateMinimap();
 	g_gui.FitViewToMap();
-	UpdateMenubar();
-	Refresh();
-	*/
+	Update();
 }
 
 void MainMenuBar::OnOpenRecent(wxCommandEvent& event)
@@ -750,6 +822,14 @@ void MainMenuBar::OnOpen(wxCommandEvent& WXUNUSED(event))
 	g_gui.OpenMap();
 }
 
+void MainMenuBar::OnOpenArea(wxCommandEvent& WXUNUSED(event))
+{
+	OpenMapAreaWindow dialog(frame);
+	if(dialog.ShowModal() != 0) {
+		g_gui.LoadMap(dialog.GetFile(), dialog.GetArea());
+	}
+}
+
 void MainMenuBar::OnClose(wxCommandEvent& WXUNUSED(event))
 {
 	frame->DoQuerySave(true); // It closes the editor too
@@ -810,9 +890,14 @@ void MainMenuBar::OnImportMonsterData(wxCommandEvent& WXUNUSED(event))
 
 void MainMenuBar::OnImportMinimap(wxCommandEvent& WXUNUSED(event))
 {
-	ASSERT(g_gui.IsEditorOpen());
-	//wxDialog* importmap = newd ImportMapWindow();
-	//importmap->ShowModal();
+	Editor* editor = g_gui.GetCurrentEditor();
+	ASSERT(editor);
+
+	wxFileDialog dialog(frame, "Import minimap", "", "", "OTMM minimap (*.otmm)|*.otmm", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+	if(dialog.ShowModal() == wxID_OK) {
+		editor->importMiniMap(FileName(dialog.GetPath()), 0, 0, 0);
+		Update();
+	}
 }
 
 void MainMenuBar::OnExportMinimap(wxCommandEvent& WXUNUSED(event))
@@ -825,6 +910,32 @@ void MainMenuBar::OnExportMinimap(wxCommandEvent& WXUNUSED(event))
 	dialog.ShowModal();
 }
 
+void MainMenuBar::OnExportMap(wxCommandEvent& WXUNUSED(event))
+{
+	if(!g_gui.IsEditorOpen()) {
+		return;
+	}
+
+	// For servers that can't read compressed maps
+	wxFileDialog dialog(frame, "Export Plain OTBM...", "", "", MAP_EXPORT_FILE_WILDCARD, wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() == wxID_OK) {
+		g_gui.GetCurrentEditor()->exportMap(dialog.GetPath());
+	}
+}
+
+void MainMenuBar::OnExportServerMap(wxCommandEvent& WXUNUSED(event))
+{
+	if(!g_gui.IsEditorOpen()) {
+		return;
+	}
+
+	wxFileDialog dialog(frame, "Export for Server...", "", "", MAP_EXPORT_FILE_WILDCARD, wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() == wxID_OK) {
+		const int index = g_gui.PopupDialog("Tile index", "Write the tile index (.otbm.idx) along with the map?\nServers that seek to the tile areas can use it, others ignore it.", wxYES | wxNO);
+		g_gui.GetCurrentEditor()->exportMap(dialog.GetPath(), true, index == wxID_YES);
+	}
+}
+
 void MainMenuBar::OnDebugViewDat(wxCommandEvent& WXUNUSED(event))
 {
 	wxDialog dlg(frame, wxID_ANY, "Debug .dat file", wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
@@ -841,6 +952,17 @@ void MainMenuBar::OnReloadDataFiles(wxCommandEvent& WXUNUSED(event))
 	g_gui.ListDialog("Warnings", warnings);
 }
 
+void MainMenuBar::OnReloadMaterials(wxCommandEvent& WXUNUSED(event))
+{
+	wxString error;
+	wxArrayString warnings;
+	if(!g_gui.ReloadMaterials(error, warnings)) {
+		g_gui.PopupDialog("Error", error, wxOK);
+		return;
+	}
+	g_gui.ListDialog("Warnings", warnings);
+}
+
 void MainMenuBar::OnListExtensions(wxCommandEvent& WXUNUSED(event))
 {
 	ExtensionsDialog exts(frame);
@@ -881,18 +1003,31 @@ namespace OnSearchForItem
 
 		bool limitReached() const { return result.size() >= (size_t)maxCount; }
 
-		void operator()(Map& map, Tile* tile, Item* item, long long done)
+		void operator()(const Map& map, Tile* tile, Item* item)
 		{
 			if(result.size() >= (size_t)maxCount)
 				return;
 
-			if(done % 0x8000 == 0)
-				g_gui.SetLoadDone((unsigned int)(100 * done / map.getTileCount()));
-
 			if(item->getID() == itemId)
 				result.push_back(std::make_pair(tile, item));
 		}
 	};
+
+	// Every chunk of the map is searched on its own, their results are merged in map order
+	void search(Finder& finder, bool selectedTiles)
+	{
+		auto chunks = parallel_foreach_ItemWithId(g_gui.GetCurrentMap(), finder.itemId, finder, selectedTiles, [](int percent) {
+			g_gui.SetLoadDone(percent);
+		});
+
+		for(const Finder& chunk : chunks) {
+			for(const auto& found : chunk.result) {
+				if(finder.limitReached())
+					return;
+				finder.result.push_back(found);
+			}
+		}
+	}
 }
 
 void MainMenuBar::OnSearchForItem(wxCommandEvent& WXUNUSED(event))
@@ -906,7 +1041,7 @@ void MainMenuBar::OnSearchForItem(wxCommandEvent& WXUNUSED(event))
 		OnSearchForItem::Finder finder(dialog.getResultID(), (uint32_t)g_settings.getInteger(Config::REPLACE_SIZE));
 		g_gui.CreateLoadBar("Searching map...");
 
-		foreach_ItemOnMap(g_gui.GetCurrentMap(), finder, false);
+		OnSearchForItem::search(finder, false);
 		std::vector< std::pair<Tile*, Item*> >& result = finder.result;
 
 		g_gui.DestroyLoadBar();
@@ -922,7 +1057,7 @@ void MainMenuBar::OnSearchForItem(wxCommandEvent& WXUNUSED(event))
 		for(std::vector<std::pair<Tile*, Item*> >::const_iterator iter = result.begin(); iter != result.end(); ++iter) {
 			Tile* tile = iter->first;
 			Item* item = iter->second;
-			window->AddPosition(wxstr(item->getName()), tile->getPosition());
+			window->AddItem(item->getID(), tile->getPosition());
 		}
 
 		g_settings.setInteger(Config::FIND_ITEM_MODE, (int)dialog.getSearchMode());
@@ -942,101 +1077,6 @@ void MainMenuBar::OnReplaceItems(wxCommandEvent& WXUNUSED(event))
 	}
 }
 
-namespace OnSearchForStuff
-{
-	struct Searcher
-	{
-		Searcher() :
-			search_zones(false),
-			search_unique(false),
-			search_action(false),
-			search_container(false),
-			search_writeable(false) {}
-
-		bool search_zones;
-		bool search_unique;
-		bool search_action;
-		bool search_container;
-		bool search_writeable;
-		std::vector<std::pair<Tile*, Item*> > found;
-
-		void operator()(Map& map, Tile* tile, Item* item, long long done)
-		{
-			if(done % 0x8000 == 0) {
-				g_gui.SetLoadDone((unsigned int)(100 * done / map.getTileCount()));
-			}
-			Container* container;
-			if ((search_zones && item->isGroundTile() && !tile->getZoneIds().empty()) ||
-				(search_unique && item->getUniqueID() > 0) ||
-				(search_action && item->getActionID() > 0) ||
-				(search_container && ((container = dynamic_cast<Container*>(item)) && container->getItemCount())) ||
-				(search_writeable && item->getText().length() > 0)) {
-				found.push_back(std::make_pair(tile, item));
-			}
-		}
-
-		wxString desc(Tile* tile, Item* item)
-		{
-			wxString label;
-			if (search_zones)
-			{
-				label << "Zone ID: ";
-				size_t zones = tile->getZoneIds().size();
-				for (const auto& zoneId : tile->getZoneIds())
-				{
-					label << zoneId;
-					if (--zones > 0)
-						label << "/";
-				}
-			}
-			else
-			{
-				if (item->getUniqueID() > 0)
-					label << "UID: " << item->getUniqueID() << " ";
-
-				if (item->getActionID() > 0)
-					label << "AID: " << item->getActionID() << " ";
-
-				label << wxstr(item->getName());
-
-				if (dynamic_cast<Container*>(item))
-					label << " (Container) ";
-
-				if (item->getText().length() > 0)
-					label << " (Text: " << wxstr(item->getText()) << ") ";
-			}
-
-			return label;
-		}
-
-		void sort()
-		{
-			if(search_unique || search_action)
-				std::sort(found.begin(), found.end(), Searcher::compare);
-			else if (search_zones)
-				std::sort(found.begin(), found.end(), Searcher::compareZones);
-		}
-
-		static bool compare(const std::pair<Tile*, Item*>& pair1, const std::pair<Tile*, Item*>& pair2)
-		{
-			const Item* item1 = pair1.second;
-			const Item* item2 = pair2.second;
-
-			if(item1->getActionID() != 0 || item2->getActionID() != 0)
-				return item1->getActionID() < item2->getActionID();
-			else if(item1->getUniqueID() != 0 || item2->getUniqueID() != 0)
-				return item1->getUniqueID() < item2->getUniqueID();
-
-			return false;
-		}
-
-		static bool compareZones(const std::pair<Tile*, Item*>& pair1, const std::pair<Tile*, Item*>& pair2)
-		{
-			return pair1.first->getZoneId() < pair2.first->getZoneId();
-		}
-	};
-}
-
 void MainMenuBar::OnSearchForStuffOnMap(wxCommandEvent& WXUNUSED(event))
 {
 	SearchItems(true, true, true, true, false);
@@ -1113,7 +1153,7 @@ void MainMenuBar::OnSearchForItemOnSelection(wxCommandEvent& WXUNUSED(event))
 		OnSearchForItem::Finder finder(dialog.getResultID(), (uint32_t)g_settings.getInteger(Config::REPLACE_SIZE));
 		g_gui.CreateLoadBar("Searching on selected area...");
 
-		foreach_ItemOnMap(g_gui.GetCurrentMap(), finder, true);
+		OnSearchForItem::search(finder, true);
 		std::vector<std::pair<Tile*, Item*> >& result = finder.result;
 
 		g_gui.DestroyLoadBar();
@@ -1129,7 +1169,7 @@ void MainMenuBar::OnSearchForItemOnSelection(wxCommandEvent& WXUNUSED(event))
 		for(std::vector<std::pair<Tile*, Item*> >::const_iterator iter = result.begin(); iter != result.end(); ++iter) {
 			Tile* tile = iter->first;
 			Item* item = iter->second;
-			window->AddPosition(wxstr(item->getName()), tile->getPosition());
+			window->AddItem(item->getID(), tile->getPosition());
 		}
 
 		g_settings.setInteger(Config::FIND_ITEM_MODE, (int)dialog.getSearchMode());
@@ -1164,8 +1204,9 @@ void MainMenuBar::OnRemoveItemOnSelection(wxCommandEvent& WXUNUSED(event))
 	if(dialog.ShowModal() == wxID_OK) {
 		g_gui.GetCurrentEditor()->clearActions();
 		g_gui.CreateLoadBar("Searching item on selection to remove...");
-		OnMapRemoveItems::RemoveItemCondition condition(dialog.getResultID());
-		int64_t count = RemoveItemOnMap(g_gui.GetCurrentMap(), condition, true);
+		int64_t count = parallel_remove_ItemOnMap(g_gui.GetCurrentMap(), OnMapRemoveItems::ItemIdCondition { dialog.getResultID() }, true, false, [](int percent) {
+			g_gui.SetLoadDone(percent);
+		});
 		g_gui.DestroyLoadBar();
 
 		wxString msg;
@@ -1251,7 +1292,7 @@ void MainMenuBar::OnRandomizeMap(wxCommandEvent& WXUNUSED(event))
 
 	int ret = g_gui.PopupDialog("Randomize Map", "Are you sure you want to randomize the entire map (this action cannot be undone)?", wxYES | wxNO);
 	if(ret == wxID_YES)
-		g_gui.GetCurrentEditor()->randomizeMap(true);
+		g_gui.GetCurrentEditor()->randomizeMap(true, mt_randi());
 
 	g_gui.RefreshView();
 }
@@ -1322,10 +1363,11 @@ void MainMenuBar::OnMapRemoveItems(wxCommandEvent& WXUNUSED(event))
 		g_gui.GetCurrentEditor()->getSelection().clear();
 		g_gui.GetCurrentEditor()->clearActions();
 
-		OnMapRemoveItems::RemoveItemCondition condition(itemid);
 		g_gui.CreateLoadBar("Searching map for items to remove...");
 
-		int64_t count = RemoveItemOnMap(g_gui.GetCurrentMap(), condition, false);
+		int64_t count = parallel_remove_ItemOnMap(g_gui.GetCurrentMap(), OnMapRemoveItems::ItemIdCondition { itemid }, false, false, [](int percent) {
+			g_gui.SetLoadDone(percent);
+		});
 
 		g_gui.DestroyLoadBar();
 
@@ -1339,95 +1381,42 @@ void MainMenuBar::OnMapRemoveItems(wxCommandEvent& WXUNUSED(event))
 	dialog.Destroy();
 }
 
-namespace OnMapRemoveCorpses
-{
-	struct condition
-	{
-		condition() {}
-
-		bool operator()(Map& map, Item* item, long long removed, long long done){
-			if(done % 0x800 == 0)
-				g_gui.SetLoadDone((unsigned int)(100 * done / map.getTileCount()));
-
-			return g_materials.isInTileset(item, "Corpses") & !item->isComplex();
-		}
-	};
-}
-
 void MainMenuBar::OnMapRemoveCorpses(wxCommandEvent& WXUNUSED(event))
 {
 	if(!g_gui.IsEditorOpen())
 		return;
 
-	int ok = g_gui.PopupDialog("Remove Corpses", "Do you want to remove all corpses from the map?", wxYES | wxNO);
+	Map& map = g_gui.GetCurrentMap();
+	const OnMapRemoveItems::CorpseCondition condition;
+	const int64_t found = parallel_remove_ItemOnMap(map, condition, false, true);
+	if(found == 0) {
+		g_gui.PopupDialog("Remove Corpses", "There are no corpses on the map.", wxOK);
+		return;
+	}
+
+	wxString question;
+	question << "Do you want to remove all " << found << " corpses from the map?";
+	int ok = g_gui.PopupDialog("Remove Corpses", question, wxYES | wxNO);
 
 	if(ok == wxID_YES) {
 		g_gui.GetCurrentEditor()->getSelection().clear();
 		g_gui.GetCurrentEditor()->clearActions();
 
-		OnMapRemoveCorpses::condition func;
 		g_gui.CreateLoadBar("Searching map for items to remove...");
 
-		int64_t count = RemoveItemOnMap(g_gui.GetCurrentMap(), func, false);
+		int64_t count = parallel_remove_ItemOnMap(map, condition, false, false, [](int percent) {
+			g_gui.SetLoadDone(percent);
+		});
 
 		g_gui.DestroyLoadBar();
 
 		wxString msg;
 		msg << count << " items deleted.";
 		g_gui.PopupDialog("Search completed", msg, wxOK);
-		g_gui.GetCurrentMap().doChange();
+		map.doChange();
 	}
 }
 
-namespace OnMapRemoveUnreachable
-{
-	struct condition
-	{
-		condition() {}
-
-		bool isReachable(Tile* tile)
-		{
-			if(tile == nullptr)
-				return false;
-			if(!tile->isBlocking())
-				return true;
-			return false;
-		}
-
-		bool operator()(Map& map, Tile* tile, long long removed, long long done, long long total)
-		{
-			if(done % 0x1000 == 0)
-				g_gui.SetLoadDone((unsigned int)(100 * done / total));
-
-			const Position& pos = tile->getPosition();
-			int sx = std::max(pos.x - 10, 0);
-			int ex = std::min(pos.x + 10, 65535);
-			int sy = std::max(pos.y - 8,  0);
-			int ey = std::min(pos.y + 8,  65535);
-			int sz, ez;
-
-			if(pos.z < 8) {
-				sz = 0;
-				ez = 9;
-			} else {
-				// underground
-				sz = std::max(pos.z - 2, rme::MapGroundLayer);
-				ez = std::min(pos.z + 2, rme::MapMaxLayer);
-			}
-
-			for(int z = sz; z <= ez; ++z) {
-				for(int y = sy; y <= ey; ++y) {
-					for(int x = sx; x <= ex; ++x) {
-						if(isReachable(map.getTile(x, y, z)))
-							return false;
-					}
-				}
-			}
-			return true;
-		}
-	};
-}
-
 void MainMenuBar::OnMapRemoveUnreachable(wxCommandEvent& WXUNUSED(event))
 {
 	if(!g_gui.IsEditorOpen())
@@ -1439,10 +1428,35 @@ void MainMenuBar::OnMapRemoveUnreachable(wxCommandEvent& WXUNUSED(event))
 		g_gui.GetCurrentEditor()->getSelection().clear();
 		g_gui.GetCurrentEditor()->clearActions();
 
-		OnMapRemoveUnreachable::condition func;
 		g_gui.CreateLoadBar("Searching map for tiles to remove...");
 
-		long long removed = remove_if_TileOnMap(g_gui.GetCurrentMap(), func);
+		Map& map = g_gui.GetCurrentMap();
+		MapReachability reachability;
+		reachability.compute(map, [](int percent) {
+			g_gui.SetLoadDone(percent / 2);
+		});
+
+		struct Unreachable {
+			const MapReachability* reachability;
+			std::vector<Position> positions;
+
+			void operator()(const Map&, Tile* tile) {
+				const Position position = tile->getPosition();
+				if(!reachability->isReachable(position))
+					positions.push_back(position);
+			}
+		};
+		auto chunks = parallel_foreach_TileOnMap(map, Unreachable { &reachability, {} }, false, [](int percent) {
+			g_gui.SetLoadDone(50 + percent / 2);
+		});
+
+		long long removed = 0;
+		for(const Unreachable& chunk : chunks) {
+			for(const Position& position : chunk.positions) {
+				map.setTile(position, nullptr, true);
+				++removed;
+			}
+		}
 
 		g_gui.DestroyLoadBar();
 
@@ -1451,7 +1465,7 @@ void MainMenuBar::OnMapRemoveUnreachable(wxCommandEvent& WXUNUSED(event))
 
 		g_gui.PopupDialog("Search completed", msg, wxOK);
 
-		g_gui.GetCurrentMap().doChange();
+		map.doChange();
 	}
 }
 
@@ -1469,25 +1483,39 @@ void MainMenuBar::OnMapRemoveEmptySpawns(wxCommandEvent& WXUNUSED(event))
 		g_gui.CreateLoadBar("Searching map for empty spawns to remove...");
 
 		Map& map = g_gui.GetCurrentMap();
-		CreatureVector creatures;
-		TileVector toDeleteSpawns;
-		for(const auto& spawnPosition : map.spawns) {
-			Tile* tile = map.getTile(spawnPosition);
+		const std::vector<Position> spawnPositions = map.spawns.getSpawnPositions();
+
+		// The creatures within each spawn are looked up in parallel through the creature index
+		std::vector<std::vector<Position>> spawnCreatures(spawnPositions.size());
+		ThreadPool::getInstance().parallelFor(spawnPositions.size(), [&](size_t index) {
+			const Position& spawnPosition = spawnPositions[index];
+			const Tile* tile = map.getTile(spawnPosition);
 			if(!tile || !tile->spawn) {
-				continue;
+				return;
 			}
 
 			const int32_t radius = tile->spawn->getSize();
+			for(const Position& position : map.spawns.getCreaturesInArea(spawnPosition.x - radius, spawnPosition.y - radius, spawnPosition.x + radius, spawnPosition.y + radius, spawnPosition.z)) {
+				const Tile* creature_tile = map.getTile(position);
+				if(creature_tile && creature_tile->creature) {
+					spawnCreatures[index].push_back(position);
+				}
+			}
+		});
+
+		// A creature only keeps the first spawn covering it alive, as the spawns come
+		std::unordered_set<PositionKey> claimed;
+		TileVector toDeleteSpawns;
+		for(size_t index = 0; index < spawnPositions.size(); ++index) {
+			Tile* tile = map.getTile(spawnPositions[index]);
+			if(!tile || !tile->spawn) {
+				continue;
+			}
 
 			bool empty = true;
-			for(int32_t y = -radius; y <= radius; ++y) {
-				for(int32_t x = -radius; x <= radius; ++x) {
-					Tile* creature_tile = map.getTile(spawnPosition + Position(x, y, 0));
-					if(creature_tile && creature_tile->creature && !creature_tile->creature->isSaved()) {
-						creature_tile->creature->save();
-						creatures.push_back(creature_tile->creature);
-						empty = false;
-					}
+			for(const Position& position : spawnCreatures[index]) {
+				if(claimed.insert(packPosition(position)).second) {
+					empty = false;
 				}
 			}
 
@@ -1496,10 +1524,6 @@ void MainMenuBar::OnMapRemoveEmptySpawns(wxCommandEvent& WXUNUSED(event))
 			}
 		}
 
-		for(Creature* creature : creatures) {
-			creature->reset();
-		}
-
 		BatchAction* batch = editor->createBatch(ACTION_DELETE_TILES);
 		Action* action = editor->createAction(batch);
 
@@ -1575,15 +1599,28 @@ void MainMenuBar::OnMapCleanHouseItems(wxCommandEvent& WXUNUSED(event))
 	if(!editor)
 		return;
 
-	int ret = g_gui.PopupDialog(
-		"Clear Moveable House Items",
-		"Are you sure you want to remove all items inside houses that can be moved (this action cannot be undone)?",
-		wxYES | wxNO
-	);
+	Map& map = editor->getMap();
+	const OnMapRemoveItems::HouseItemCondition condition;
+	const int64_t found = parallel_remove_ItemOnMap(map, condition, false, true);
+	if(found == 0) {
+		g_gui.PopupDialog("Clear Moveable House Items", "There are no moveable items inside houses.", wxOK);
+		return;
+	}
+
+	wxString question;
+	question << "Are you sure you want to remove all " << found << " items inside houses that can be moved (this action cannot be undone)?";
+	int ret = g_gui.PopupDialog("Clear Moveable House Items", question, wxYES | wxNO);
 
 	if(ret == wxID_YES) {
-		// Editor will do the work
-		//editor->removeHouseItems(true);
+		editor->getSelection().clear();
+		editor->clearActions();
+
+		g_gui.CreateLoadBar("Removing moveable house items...");
+		parallel_remove_ItemOnMap(map, condition, false, false, [](int percent) {
+			g_gui.SetLoadDone(percent);
+		});
+		g_gui.DestroyLoadBar();
+		map.doChange();
 	}
 
 	g_gui.RefreshView();
@@ -1648,67 +1685,22 @@ void MainMenuBar::OnMapStatistics(wxCommandEvent& WXUNUSED(event))
 	double sqm_per_house = 0.0;
 	double sqm_per_town = 0.0;
 
-	for(MapIterator mit = map->begin(); mit != map->end(); ++mit) {
-		Tile* tile = (*mit)->get();
-		if(load_counter % 8192 == 0) {
-			g_gui.SetLoadDone((unsigned int)(int64_t(load_counter) * 95ll / int64_t(map->getTileCount())));
-		}
-
-		if(tile->empty())
-			continue;
-
-		tile_count += 1;
-
-		bool is_detailed = false;
-#define ANALYZE_ITEM(_item) {\
-	item_count += 1; \
-	if(!(_item)->isGroundTile() && !(_item)->isBorder()) { \
-		is_detailed = true; \
-		const ItemType& it = g_items.getItemType((_item)->getID()); \
-		if(it.moveable) { \
-			loose_item_count += 1; \
-		} \
-		if(it.isDepot()) { \
-			depot_count += 1; \
-		} \
-		if((_item)->getActionID() > 0) { \
-			action_item_count += 1; \
-		} \
-		if((_item)->getUniqueID() > 0) { \
-			unique_item_count += 1; \
-		} \
-		if(Container* c = dynamic_cast<Container*>((_item))) { \
-			if(c->getVector().size()) { \
-				container_count += 1; \
-			} \
-		} \
-	} \
-}
-		if(tile->ground) {
-			ANALYZE_ITEM(tile->ground);
-		}
-
-		for(Item* item : tile->items) {
-			ANALYZE_ITEM(item);
-		}
-#undef ANALYZE_ITEM
-
-		if(tile->spawn)
-			spawn_count += 1;
-
-		if(tile->creature)
-			creature_count += 1;
-
-		if(tile->isBlocking())
-			blocking_tile_count += 1;
-		else
-			walkable_tile_count += 1;
-
-		if(is_detailed)
-			detailed_tile_count += 1;
-
-		load_counter += 1;
-	}
+	// Only the leaves changed since the last time are counted again
+	const TileStatistics statistics = map->getStatisticsCache().collect(*map, [](int percent) {
+		g_gui.SetLoadDone((unsigned int)(percent * 95 / 100));
+	});
+	tile_count = statistics.tile_count;
+	detailed_tile_count = statistics.detailed_tile_count;
+	blocking_tile_count = statistics.blocking_tile_count;
+	walkable_tile_count = statistics.walkable_tile_count;
+	spawn_count = statistics.spawn_count;
+	creature_count = statistics.creature_count;
+	item_count = statistics.item_count;
+	loose_item_count = statistics.loose_item_count;
+	depot_count = statistics.depot_count;
+	action_item_count = statistics.action_item_count;
+	unique_item_count = statistics.unique_item_count;
+	container_count = statistics.container_count;
 
 	creatures_per_spawn = (spawn_count != 0 ? double(creature_count) / double(spawn_count) : -1.0);
 	percent_pathable = 100.0*(tile_count != 0 ? double(walkable_tile_count) / double(tile_count) : -1.0);
@@ -1722,12 +1714,13 @@ void MainMenuBar::OnMapStatistics(wxCommandEvent& WXUNUSED(event))
 		if(load_counter % 64)
 			g_gui.SetLoadDone((unsigned int)(95ll + int64_t(load_counter) * 5ll / int64_t(house_count)));
 
-		if(house->size() > largest_house_size) {
+		const size_t house_size = house->size();
+		if(house_size > largest_house_size) {
 			largest_house = house;
-			largest_house_size = house->size();
+			largest_house_size = house_size;
 		}
-		total_house_sqm += house->size();
-		town_sqm_count[house->townid] += house->size();
+		total_house_sqm += house_size;
+		town_sqm_count[house->townid] += house_size;
 	}
 
 	houses_per_town = (town_count != 0?  double(house_count) /     double(town_count)  : -1.0);
@@ -1903,6 +1896,90 @@ void MainMenuBar::OnTakeScreenshot(wxCommandEvent& WXUNUSED(event))
 
 }
 
+void MainMenuBar::OnRenderSelection(wxCommandEvent& WXUNUSED(event))
+{
+	if(!g_gui.IsEditorOpen())
+		return;
+
+	wxString path = wxstr(g_settings.getString(Config::SCREENSHOT_DIRECTORY));
+	if(path.size() > 0 && (path.Last() == '/' || path.Last() == '\\'))
+		path = path + "/";
+
+	g_gui.GetCurrentMapTab()->GetView()->GetCanvas()->RenderSelection(path);
+}
+
+void MainMenuBar::OnDumpFrameProfile(wxCommandEvent& WXUNUSED(event))
+{
+	if(g_profiler.getFrameCount() == 0) {
+		g_gui.PopupDialog("Notice", "No frames have been profiled yet, enable View > Show Frame Profiler first.", wxOK);
+		return;
+	}
+
+	wxFileDialog dialog(frame, "Save frame profile...", "", "frame_profile.csv", "CSV files (*.csv)|*.csv", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() != wxID_OK)
+		return;
+
+	if(!g_profiler.dumpCSV(FileName(dialog.GetPath()))) {
+		g_gui.PopupDialog("Error", "Could not write " + dialog.GetPath(), wxOK);
+	}
+}
+
+void MainMenuBar::OnRecordSession(wxCommandEvent& WXUNUSED(event))
+{
+	if(g_session_recorder.isRecording()) {
+		g_session_recorder.stop();
+		g_gui.SetStatusText("Session recording stopped.");
+		Update();
+		return;
+	}
+
+	Editor* editor = g_gui.GetCurrentEditor();
+	if(!editor) {
+		Update();
+		return;
+	}
+
+	wxFileDialog dialog(frame, "Record session to...", "", "session.jsonl", "Recorded sessions (*.jsonl)|*.jsonl", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() == wxID_OK) {
+		if(g_session_recorder.start(*editor, FileName(dialog.GetPath()))) {
+			g_gui.SetStatusText("Recording the session, replay it with rme --batch replay <map> <session>.");
+		} else {
+			g_gui.PopupDialog("Error", "Could not write " + dialog.GetPath(), wxOK);
+		}
+	}
+	Update();
+}
+
+void MainMenuBar::OnRecordTrace(wxCommandEvent& WXUNUSED(event))
+{
+#if RME_TRACING > 0
+	if(Tracer::isRecording()) {
+		if(Tracer::getInstance().stop()) {
+			g_gui.SetStatusText("Trace written, open it in chrome://tracing or ui.perfetto.dev.");
+		} else {
+			g_gui.PopupDialog("Error", "Could not write the trace.", wxOK);
+		}
+		Update();
+		return;
+	}
+
+	wxFileDialog dialog(frame, "Record trace to...", "", "trace.json", "Chrome traces (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() == wxID_OK) {
+		Tracer::getInstance().start(nstr(dialog.GetPath()));
+		g_gui.SetStatusText("Recording a trace, choose Record Trace again to write it.");
+	}
+#else
+	g_gui.PopupDialog("Notice", "This build has no tracing, it has to be built with RME_TRACING set.", wxOK);
+#endif
+	Update();
+}
+
+void MainMenuBar::OnShowMemoryReport(wxCommandEvent& WXUNUSED(event))
+{
+	MemoryReportDialog dialog(frame);
+	dialog.ShowModal();
+}
+
 void MainMenuBar::OnZoomIn(wxCommandEvent& event)
 {
 	double zoom = g_gui.GetCurrentZoom();
@@ -1955,6 +2032,7 @@ void MainMenuBar::OnChangeViewSettings(wxCommandEvent& event)
 	g_settings.setInteger(Config::SHOW_WALL_HOOKS, IsItemChecked(MenuBar::SHOW_WALL_HOOKS));
 	g_settings.setInteger(Config::SHOW_PICKUPABLES, IsItemChecked(MenuBar::SHOW_PICKUPABLES));
 	g_settings.setInteger(Config::SHOW_MOVEABLES, IsItemChecked(MenuBar::SHOW_MOVEABLES));
+	g_settings.setInteger(Config::SHOW_FRAME_PROFILER, IsItemChecked(MenuBar::SHOW_FRAME_PROFILER));
 
 	g_gui.RefreshView();
 	g_gui.root->GetAuiToolBar()->UpdateIndicators();
@@ -2187,28 +2265,46 @@ void MainMenuBar::SearchItems(bool unique, bool action, bool container, bool wri
 	if(!g_gui.IsEditorOpen())
 		return;
 
+	uint32_t query = 0;
+	if(unique)
+		query |= SEARCH_UNIQUE;
+	if(action)
+		query |= SEARCH_ACTION;
+	if(container)
+		query |= SEARCH_CONTAINER;
+	if(writable)
+		query |= SEARCH_WRITEABLE;
+	if(zones)
+		query |= SEARCH_ZONES;
+	MapSearch search(query);
+
 	if(onSelection)
-		g_gui.CreateLoadBar("Searching on selected area...");
+		g_gui.CreateLoadBar("Searching on selected area...", true);
 	else
-		g_gui.CreateLoadBar("Searching on map...");
+		g_gui.CreateLoadBar("Searching on map...", true);
 
-	OnSearchForStuff::Searcher searcher;
-	searcher.search_zones = zones;
-	searcher.search_unique = unique;
-	searcher.search_action = action;
-	searcher.search_container = container;
-	searcher.search_writeable = writable;
+	// Results show up as the search goes, and are put in order once it's done
+	SearchResultWindow* result = g_gui.ShowSearchWindow();
+	result->Clear();
 
-	foreach_ItemOnMap(g_gui.GetCurrentMap(), searcher, onSelection);
-	searcher.sort();
-	std::vector<std::pair<Tile*, Item*> >& found = searcher.found;
+	std::vector<MapSearchResult> found;
+	const bool finished = search.run(g_gui.GetCurrentMap(), onSelection, [&](const std::vector<MapSearchResult>& results) {
+		for(const MapSearchResult& entry : results) {
+			result->AddPosition(MapSearch::describe(entry), entry.tile->getPosition());
+		}
+		found.insert(found.end(), results.begin(), results.end());
+	}, [](int percent) {
+		return g_gui.SetLoadDone(std::min(percent, 99));
+	});
 
 	g_gui.DestroyLoadBar();
 
-	SearchResultWindow* result = g_gui.ShowSearchWindow();
-	result->Clear();
-	for(std::vector<std::pair<Tile*, Item*> >::iterator iter = found.begin(); iter != found.end(); ++iter) {
-		result->AddPosition(searcher.desc(iter->first, iter->second), iter->first->getPosition());
+	if(finished && search.sorts()) {
+		search.sort(found);
+		result->Clear();
+		for(const MapSearchResult& entry : found) {
+			result->AddPosition(MapSearch::describe(entry), entry.tile->getPosition());
+		}
 	}
 }
 
@@ -28,6 +28,7 @@ namespace MenuBar
 	enum ActionID {
 		NEW,
 		OPEN,
+		OPEN_AREA,
 		SAVE,
 		SAVE_AS,
 		GENERATE_MAP,
@@ -36,7 +37,10 @@ namespace MenuBar
 		IMPORT_MONSTERS,
 		IMPORT_MINIMAP,
 		EXPORT_MINIMAP,
+		EXPORT_MAP,
+		EXPORT_SERVER_MAP,
 		RELOAD_DATA,
+		RELOAD_MATERIALS,
 		RECENT_FILES,
 		PREFERENCES,
 		EXIT,
@@ -123,10 +127,16 @@ namespace MenuBar
 		SHOW_WALL_HOOKS,
 		SHOW_PICKUPABLES,
 		SHOW_MOVEABLES,
+		SHOW_FRAME_PROFILER,
+		DUMP_FRAME_PROFILE,
+		RECORD_SESSION,
+		RECORD_TRACE,
+		SHOW_MEMORY_REPORT,
 		WIN_MINIMAP,
 		WIN_ACTIONS_HISTORY,
 		NEW_PALETTE,
 		TAKE_SCREENSHOT,
+		RENDER_SELECTION,
 		LIVE_START,
 		LIVE_JOIN,
 		LIVE_CLOSE,
@@ -190,6 +200,7 @@ public:
 	// File Menu
 	void OnNew(wxCommandEvent& event);
 	void OnOpen(wxCommandEvent& event);
+	void OnOpenArea(wxCommandEvent& event);
 	void OnGenerateMap(wxCommandEvent& event);
 	void OnOpenRecent(wxCommandEvent& event);
 	void OnSave(wxCommandEvent& event);
@@ -204,7 +215,10 @@ public:
 	void OnImportMonsterData(wxCommandEvent& event);
 	void OnImportMinimap(wxCommandEvent& event);
 	void OnExportMinimap(wxCommandEvent& event);
+	void OnExportMap(wxCommandEvent& event);
+	void OnExportServerMap(wxCommandEvent& event);
 	void OnReloadDataFiles(wxCommandEvent& event);
+	void OnReloadMaterials(wxCommandEvent& event);
 
 	// Edit Menu
 	void OnUndo(wxCommandEvent& event);
@@ -278,6 +292,11 @@ public:
 	void OnActionsHistoryWindow(wxCommandEvent& event);
 	void OnNewPalette(wxCommandEvent& event);
 	void OnTakeScreenshot(wxCommandEvent& event);
+	void OnRenderSelection(wxCommandEvent& event);
+	void OnDumpFrameProfile(wxCommandEvent& event);
+	void OnRecordSession(wxCommandEvent& event);
+	void OnRecordTrace(wxCommandEvent& event);
+	void OnShowMemoryReport(wxCommandEvent& event);
 	void OnSelectTerrainPalette(wxCommandEvent& event);
 	void OnSelectDoodadPalette(wxCommandEvent& event);
 	void OnSelectItemPalette(wxCommandEvent& event);
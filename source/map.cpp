@@ -20,8 +20,14 @@
 #include "gui.h" // loadbar
 
 #include "map.h"
+#include "conversion_table.h"
+#include "iomap_otbm.h"
+#include "ground_brush.h"
+#include "tracing.h"
 
+#include <bit>
 #include <sstream>
+#include <limits>
 
 Map::Map() : BaseMap(),
 	width(512),
@@ -29,7 +35,10 @@ Map::Map() : BaseMap(),
 	houses(*this),
 	has_changed(false),
 	unnamed(false),
-	waypoints(*this)
+	waypoints(*this),
+	duplicateUniqueIds(0),
+	indexItemIds(g_settings.getBoolean(Config::INDEX_ITEM_IDS)),
+	itemBlocksStale(false)
 {
 	// Earliest version possible
 	// Caller is responsible for converting us to proper version
@@ -42,12 +51,21 @@ Map::~Map()
 	////
 }
 
-bool Map::open(const std::string file)
+bool Map::open(const std::string file, const MapArea& area)
 {
 	if(file == filename)
 		return true; // Do not reopen ourselves!
 
 	tilecount = 0;
+	partial.reset();
+	if(!area.isWholeMap()) {
+		partial.reset(newd OTBM_PartialMap);
+		partial->area = area;
+	} else if(g_settings.getInteger(Config::PAGED_MAP_MEMORY) > 0) {
+		// Only works out with an index for the file, the loader opens it whole otherwise
+		partial.reset(newd OTBM_PartialMap);
+		partial->paged = true;
+	}
 
 	IOMapOTBM maploader(getVersion());
 
@@ -56,17 +74,29 @@ bool Map::open(const std::string file)
 	mapVersion = maploader.version;
 
 	warnings = maploader.getWarnings();
+	telemetry = maploader.getTelemetry();
 
 	if(!success) {
 		error = maploader.getError();
 		return false;
 	}
 
+	for(uint16_t uid : getDuplicateUniqueIds()) {
+		warnings.push_back(wxString::Format("Unique ID %d is used by %d items.", uid, getUniqueIdCount(uid)));
+	}
+
 	has_changed = false;
 
 	wxFileName fn = wxstr(file);
 	filename = fn.GetFullPath().mb_str(wxConvUTF8);
 	name = fn.GetFullName().mb_str(wxConvUTF8);
+	telemetry.log("Loaded " + fn.GetFullName() + (maploader.isSessionLoaded() ? " from its session snapshot" : ""));
+
+	// Made once from the OTBM, the next time the map opens from it. A load with warnings
+	// is left to show them again.
+	if(!partial && g_settings.getBoolean(Config::SESSION_SNAPSHOTS) && !maploader.isSessionLoaded() && warnings.empty()) {
+		maploader.saveSession(*this, fn);
+	}
 
 	// convert(getReplacementMapClassic(), true);
 
@@ -143,126 +173,126 @@ bool Map::convert(MapVersion to, bool showdialog)
 	return true;
 }
 
-bool Map::convert(const ConversionMap& rm, bool showdialog)
+// Only touches the tile itself, so tiles can be converted on any thread
+static void convertTile(const ConversionTable& table, Tile* tile)
 {
-	if(showdialog)
-		g_gui.CreateLoadBar("Converting map ...");
-
-	uint64_t tiles_done = 0;
-	std::vector<uint16_t> id_list;
-
-	//std::ofstream conversions("converted_items.txt");
-
-	for(MapIterator miter = begin(); miter != end(); ++miter) {
-		Tile* tile = (*miter)->get();
-		ASSERT(tile);
-
-		if(tile->size() == 0)
-			continue;
-
-		// id_list try MTM conversion
-		id_list.clear();
-
+	// id_list try MTM conversion
+	const ConversionMap::MTM::value_type* cfmtm = nullptr;
+	if(table.hasMany()) {
+		SmallVector<uint16_t, 16> id_list;
 		if(tile->ground)
 			id_list.push_back(tile->ground->getID());
-		for(ItemVector::const_iterator item_iter = tile->items.begin(); item_iter != tile->items.end(); ++item_iter)
-			if((*item_iter)->isBorder())
-				id_list.push_back((*item_iter)->getID());
+		for(const Item* item : tile->items)
+			if(item->isBorder())
+				id_list.push_back(item->getID());
 
 		std::sort(id_list.begin(), id_list.end());
+		cfmtm = table.findMany(id_list.data(), id_list.size());
+	}
 
-		ConversionMap::MTM::const_iterator cfmtm = rm.mtm.end();
-
-		while(id_list.size()) {
-			cfmtm = rm.mtm.find(id_list);
-			if(cfmtm != rm.mtm.end())
-				break;
-			id_list.pop_back();
-		}
+	// Keep track of how many items have been inserted at the bottom
+	size_t inserted_items = 0;
 
-		// Keep track of how many items have been inserted at the bottom
-		size_t inserted_items = 0;
+	if(cfmtm) {
+		// Keys are sorted
+		const std::vector<uint16_t>& v = cfmtm->first;
 
-		if(cfmtm != rm.mtm.end()) {
-			const std::vector<uint16_t>& v = cfmtm->first;
+		if(tile->ground && std::binary_search(v.begin(), v.end(), tile->ground->getID())) {
+			delete tile->ground;
+			tile->ground = nullptr;
+		}
 
-			if(tile->ground && std::find(v.begin(), v.end(), tile->ground->getID()) != v.end()) {
-				delete tile->ground;
-				tile->ground = nullptr;
+		for(ItemVector::iterator item_iter = tile->items.begin(); item_iter != tile->items.end(); ) {
+			if(std::binary_search(v.begin(), v.end(), (*item_iter)->getID())) {
+				delete *item_iter;
+				item_iter = tile->items.erase(item_iter);
 			}
+			else
+				++item_iter;
+		}
 
-			for(ItemVector::iterator item_iter = tile->items.begin(); item_iter != tile->items.end(); ) {
-				if(std::find(v.begin(), v.end(), (*item_iter)->getID()) != v.end()) {
-					delete *item_iter;
-					item_iter = tile->items.erase(item_iter);
-				}
-				else
-					++item_iter;
-			}
+		for(uint16_t id : cfmtm->second) {
+			Item* item = Item::Create(id);
+			if(!item)
+				continue;
 
-			const std::vector<uint16_t>& new_items = cfmtm->second;
-			for(std::vector<uint16_t>::const_iterator iit = new_items.begin(); iit != new_items.end(); ++iit) {
-				Item* item = Item::Create(*iit);
-				if(item->isGroundTile())
-					tile->ground = item;
-				else {
-					tile->items.insert(tile->items.begin(), item);
-					++inserted_items;
-				}
+			if(item->isGroundTile())
+				tile->ground = item;
+			else {
+				tile->items.insert(tile->items.begin(), item);
+				++inserted_items;
 			}
 		}
+	}
 
-		if(tile->ground) {
-			ConversionMap::STM::const_iterator cfstm = rm.stm.find(tile->ground->getID());
-			if(cfstm != rm.stm.end()) {
-				uint16_t aid = tile->ground->getActionID();
-				uint16_t uid = tile->ground->getUniqueID();
-				delete tile->ground;
-				tile->ground = nullptr;
-
-				const std::vector<uint16_t>& v = cfstm->second;
-				//conversions << "Converted " << tile->getX() << ":" << tile->getY() << ":" << tile->getZ() << " " << id << " -> ";
-				for(std::vector<uint16_t>::const_iterator iit = v.begin(); iit != v.end(); ++iit) {
-					Item* item = Item::Create(*iit);
-					//conversions << *iit << " ";
-					if(item->isGroundTile()) {
-						item->setActionID(aid);
-						item->setUniqueID(uid);
-						tile->addItem(item);
-					} else {
-						tile->items.insert(tile->items.begin(), item);
-						++inserted_items;
-					}
+	if(tile->ground) {
+		const std::vector<uint16_t>* v = table.findSingle(tile->ground->getID());
+		if(v) {
+			uint16_t aid = tile->ground->getActionID();
+			uint16_t uid = tile->ground->getUniqueID();
+			delete tile->ground;
+			tile->ground = nullptr;
+
+			for(uint16_t id : *v) {
+				Item* item = Item::Create(id);
+				if(!item)
+					continue;
+
+				if(item->isGroundTile()) {
+					item->setActionID(aid);
+					item->setUniqueID(uid);
+					tile->addItem(item);
+				} else {
+					tile->items.insert(tile->items.begin(), item);
+					++inserted_items;
 				}
-				//conversions << std::endl;
 			}
 		}
+	}
 
-		for(ItemVector::iterator replace_item_iter = tile->items.begin() + inserted_items; replace_item_iter != tile->items.end(); ) {
-			uint16_t id = (*replace_item_iter)->getID();
-			ConversionMap::STM::const_iterator cf = rm.stm.find(id);
-			if(cf != rm.stm.end()) {
-				//uint16_t aid = (*replace_item_iter)->getActionID();
-				//uint16_t uid = (*replace_item_iter)->getUniqueID();
-				delete *replace_item_iter;
+	for(ItemVector::iterator replace_item_iter = tile->items.begin() + inserted_items; replace_item_iter != tile->items.end(); ) {
+		const std::vector<uint16_t>* v = table.findSingle((*replace_item_iter)->getID());
+		if(v) {
+			delete *replace_item_iter;
 
-				replace_item_iter = tile->items.erase(replace_item_iter);
-				const std::vector<uint16_t>& v = cf->second;
-				for(std::vector<uint16_t>::const_iterator iit = v.begin(); iit != v.end(); ++iit) {
-					replace_item_iter = tile->items.insert(replace_item_iter, Item::Create(*iit));
-					//conversions << "Converted " << tile->getX() << ":" << tile->getY() << ":" << tile->getZ() << " " << id << " -> " << *iit << std::endl;
+			replace_item_iter = tile->items.erase(replace_item_iter);
+			for(uint16_t id : *v) {
+				Item* item = Item::Create(id);
+				if(item) {
+					replace_item_iter = tile->items.insert(replace_item_iter, item);
 					++replace_item_iter;
 				}
 			}
-			else
-				++replace_item_iter;
 		}
+		else
+			++replace_item_iter;
+	}
+}
+
+bool Map::convert(const ConversionMap& rm, bool showdialog)
+{
+	if(showdialog)
+		g_gui.CreateLoadBar("Converting map ...");
+
+	const ConversionTable table(rm);
 
-		++tiles_done;
-		if(showdialog && tiles_done % 0x10000 == 0) {
-			g_gui.SetLoadDone(int(tiles_done / double(getTileCount()) * 100.0));
+	// Tiles are converted in place
+	markAllAreasDirty();
+	markAllTilesChanged();
+	discardItemIdIndex();
+
+	// Every tile is converted on its own, the leaves are split between the worker threads
+	struct Converter {
+		const ConversionTable* table;
+		void operator()(const Map&, Tile* tile) {
+			if(tile->size() != 0)
+				convertTile(*table, tile);
 		}
-	}
+	};
+	parallel_foreach_TileOnMap(*this, Converter { &table }, false, [showdialog](int percent) {
+		if(showdialog)
+			g_gui.SetLoadDone(percent);
+	});
 
 	if(showdialog)
 		g_gui.DestroyLoadBar();
@@ -270,34 +300,211 @@ bool Map::convert(const ConversionMap& rm, bool showdialog)
 	return true;
 }
 
-void Map::cleanInvalidTiles(bool showdialog)
+bool Map::isAreaLoaded(const Position& pos) const
 {
-	if(showdialog)
-		g_gui.CreateLoadBar("Removing invalid tiles...");
+	if(isAreaPagedOut(pos.x, pos.y))
+		return false;
+	return !partial || partial->area.intersectsTileAreaOf(pos);
+}
+
+bool Map::isPaged() const noexcept
+{
+	return partial && partial->paged;
+}
+
+void Map::loadPagedArea(uint32_t area)
+{
+	// The tasks that read tiles never get to change the map, not even those the UI thread helps with
+	if(!wxThread::IsMain() || ThreadPool::isRunningTask())
+		return;
+
+	setAreaPagedOut(area, false);
+	if(hibernation && hibernation->has(area)) {
+		std::vector<MapHibernation::Entry> tiles;
+		if(!hibernation->decodeArea(area, tiles)) {
+			warnings.push_back(wxString::Format("Could not wake all tiles of the area at %d:%d", int(area & 0xFF) << 8, int(area & 0xFF00)));
+		}
+		hibernation->remove(area);
+		placeHibernatedTiles(area, tiles);
+		if(hibernation->empty()) {
+			hibernation.reset();
+		}
+		return;
+	}
 
-	uint64_t tiles_done = 0;
+	IOMapOTBM loader(getVersion());
+	if(!loader.loadPagedArea(*this, area)) {
+		warnings.push_back(loader.getError());
+	}
+	for(const wxString& warning : loader.getWarnings()) {
+		warnings.push_back(warning);
+	}
+	// The tiles are what the file has
+	clearAreaDirty(area);
+}
 
-	for(MapIterator miter = begin(); miter != end(); ++miter) {
-		Tile* tile = (*miter)->get();
-		ASSERT(tile);
+bool Map::canPageOut(int x, int y)
+{
+	bool pinned = false;
+	visitFloors(x, y, x + 0xFF, y + 0xFF, rme::MapMinLayer, rme::MapMaxLayer, [&](Floor* floor, int, int, int) {
+		for(TileLocation& location : floor->locs) {
+			const Tile* tile = location.get();
+			if(location.getSpawnCount() != 0 || location.getWaypointCount() != 0 || location.getHouseExits()) {
+				pinned = true;
+			} else if(tile && (tile->isHouseTile() || tile->spawn || tile->creature || tile->isSelected() || (tile->getMapFlags() & TILESTATE_ZONE_BRUSH))) {
+				pinned = true;
+			}
+		}
+	});
+	return !pinned;
+}
+
+void Map::trimPagedAreas(const std::vector<Position>& views)
+{
+	const size_t budget = size_t(g_settings.getInteger(Config::PAGED_MAP_MEMORY)) * 1024 * 1024;
+	if(!isPaged() || budget == 0 || partial->resident_bytes <= budget)
+		return;
+
+	// In areas, from the nearest view
+	std::vector<std::pair<int, uint32_t>> candidates;
+	for(const auto& [area, bytes] : partial->resident) {
+		const int area_x = int(area & 0xFF);
+		const int area_y = int(area >> 8);
+		int distance = std::numeric_limits<int>::max();
+		for(const Position& view : views) {
+			distance = std::min(distance, std::max(std::abs(area_x - (view.x >> 8)), std::abs(area_y - (view.y >> 8))));
+		}
+		// What is on screen is within the areas around a view
+		if(distance > 1 && !isAreaDirty(area_x << 8, area_y << 8)) {
+			candidates.emplace_back(distance, area);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), std::greater<>());
 
-		if(tile->size() == 0)
+	// A bit below the budget, so it isn't trimmed again right away
+	const size_t target = budget - budget / 8;
+	for(const auto& [distance, area] : candidates) {
+		if(partial->resident_bytes <= target)
+			break;
+
+		const int x = int(area & 0xFF) << 8;
+		const int y = int(area & 0xFF00);
+		if(!canPageOut(x, y))
+			continue;
+
+		releaseArea(x, y);
+		setAreaPagedOut(area, true);
+		partial->resident_bytes -= partial->resident[area];
+		partial->resident.erase(area);
+	}
+}
+
+size_t Map::hibernate()
+{
+	// Paged maps have the tiles they drop in their file already
+	if(hibernation || partial || areAllAreasDirty())
+		return 0;
+
+	RME_TRACE_ZONE("map", "Map::hibernate");
+	// The leaves of an area follow each other in the tree
+	std::vector<uint32_t> areas;
+	visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode*, int x, int y) {
+		const uint32_t area = getAreaIndex(x, y);
+		if((areas.empty() || areas.back() != area) && !isAreaDirty(x, y)) {
+			areas.push_back(area);
+		}
+	});
+
+	std::vector<MapHibernation::Area> encoded(areas.size());
+	std::vector<std::vector<Position>> taken(areas.size());
+	ThreadPool::getInstance().parallelFor(areas.size(), [&](size_t i) {
+		MapHibernation::encodeArea(*this, areas[i], encoded[i], taken[i]);
+	});
+
+	// Through setTile, so the tile count and the item indexes follow. The slabs the tiles
+	// leave empty are handed back to the system.
+	hibernation = std::make_unique<MapHibernation>();
+	size_t tiles = 0;
+	MapAllocator::beginCompaction();
+	for(size_t i = 0; i < areas.size(); ++i) {
+		if(taken[i].empty())
 			continue;
 
+		for(const Position& position : taken[i]) {
+			setTile(position, nullptr, true);
+		}
+		tiles += taken[i].size();
+		clearAreaDirty(areas[i]);
+		setAreaPagedOut(areas[i], true);
+		hibernation->add(areas[i], std::move(encoded[i]));
+	}
+	MapAllocator::endCompaction();
+
+	if(hibernation->empty()) {
+		hibernation.reset();
+	}
+	return tiles;
+}
+
+void Map::wake()
+{
+	if(!hibernation)
+		return;
+
+	RME_TRACE_ZONE("map", "Map::wake");
+	const std::vector<uint32_t> areas = hibernation->getAreas();
+	std::vector<std::vector<MapHibernation::Entry>> decoded(areas.size());
+	std::vector<char> failed(areas.size(), 0);
+	ThreadPool::getInstance().parallelFor(areas.size(), [&](size_t i) {
+		failed[i] = !hibernation->decodeArea(areas[i], decoded[i]);
+	});
+
+	for(size_t i = 0; i < areas.size(); ++i) {
+		if(failed[i]) {
+			warnings.push_back(wxString::Format("Could not wake all tiles of the area at %d:%d", int(areas[i] & 0xFF) << 8, int(areas[i] & 0xFF00)));
+		}
+		setAreaPagedOut(areas[i], false);
+		placeHibernatedTiles(areas[i], decoded[i]);
+	}
+	hibernation.reset();
+}
+
+size_t Map::getHibernatedBytes() const noexcept
+{
+	return hibernation ? hibernation->getBytes() : 0;
+}
+
+void Map::placeHibernatedTiles(uint32_t area, std::vector<MapHibernation::Entry>& tiles)
+{
+	for(MapHibernation::Entry& entry : tiles) {
+		entry.tile->setLocation(createTileL(entry.position));
+		setTile(entry.position, entry.tile);
+	}
+	// The tiles are what they were
+	clearAreaDirty(area);
+}
+
+void Map::cleanInvalidTiles(bool showdialog)
+{
+	if(showdialog)
+		g_gui.CreateLoadBar("Removing invalid tiles...");
+
+	parallel_pass_TileOnMap(*this, [](Tile* tile) {
+		bool removed = false;
 		for(ItemVector::iterator item_iter = tile->items.begin(); item_iter != tile->items.end();) {
 			if(g_items.isValidID((*item_iter)->getID()))
 				++item_iter;
 			else {
 				delete *item_iter;
 				item_iter = tile->items.erase(item_iter);
+				removed = true;
 			}
 		}
-
-		++tiles_done;
-		if(showdialog && tiles_done % 0x10000 == 0) {
-			g_gui.SetLoadDone(int(tiles_done / double(getTileCount()) * 100.0));
-		}
-	}
+		return removed;
+	}, [showdialog](int percent) {
+		// 100 would close the load bar
+		return !showdialog || g_gui.SetLoadDone(std::min(percent, 99));
+	});
 
 	if(showdialog)
 		g_gui.DestroyLoadBar();
@@ -367,6 +574,7 @@ bool Map::addSpawn(Tile* tile)
 			for(int x = start_x; x <= end_x; ++x) {
 				TileLocation* ctile_loc = createTileL(x, y, z);
 				ctile_loc->increaseSpawnCount();
+				markTileChanged(x, y);
 			}
 		}
 		spawns.addSpawn(tile);
@@ -389,8 +597,10 @@ void Map::removeSpawnInternal(Tile* tile)
 	for(int y = start_y; y <= end_y; ++y) {
 		for(int x = start_x; x <= end_x; ++x) {
 			TileLocation* ctile_loc = getTileL(x, y, z);
-			if(ctile_loc != nullptr && ctile_loc->getSpawnCount() > 0)
+			if(ctile_loc != nullptr && ctile_loc->getSpawnCount() > 0) {
 				ctile_loc->decreaseSpawnCount();
+				markTileChanged(x, y);
+			}
 		}
 	}
 }
@@ -412,49 +622,12 @@ SpawnList Map::getSpawnList(const Tile* tile) const
 	if(!location || location->getSpawnCount() == 0)
 		return list;
 
-	uint32_t found = 0;
-	if(tile->spawn) {
-		++found;
-		list.push_back(tile->spawn);
-	}
-
-	// Scans the border tiles in an expanding square around the original spawn
-	const Position& position = tile->getPosition();
-	int start_x = position.x - 1;
-	int end_x = position.x + 1;
-	int start_y = position.y - 1;
-	int end_y = position.y + 1;
-
-	while(found != location->getSpawnCount()) {
-		for(int x = start_x; x <= end_x; ++x) {
-			const Tile* start_tile = getTile(x, start_y, position.z);
-			if(start_tile && start_tile->spawn) {
-				list.push_back(start_tile->spawn);
-				++found;
-			}
-			const Tile* end_tile = getTile(x, end_y, position.z);
-			if(end_tile && end_tile->spawn) {
-				list.push_back(end_tile->spawn);
-				++found;
-			}
-		}
-
-		for(int y = start_y + 1; y < end_y; ++y) {
-			const Tile* start_tile = getTile(start_x, y, position.z);
-			if(start_tile && start_tile->spawn) {
-				list.push_back(start_tile->spawn);
-				++found;
-			}
-			const Tile* end_tile = getTile(end_x, y, position.z);
-			if(end_tile && end_tile->spawn) {
-				list.push_back(end_tile->spawn);
-				++found;
-			}
+	// Nearest first, so the tile's own spawn leads
+	for(const Position& center : spawns.getSpawnsCovering(tile->getPosition())) {
+		const Tile* spawn_tile = getTile(center);
+		if(spawn_tile && spawn_tile->spawn) {
+			list.push_back(spawn_tile->spawn);
 		}
-		--start_x;
-		--start_y;
-		++end_x;
-		++end_y;
 	}
 	return list;
 }
@@ -471,214 +644,446 @@ SpawnList Map::getSpawnList(int x, int y, int z) const
 	return getSpawnList(tile);
 }
 
-bool Map::exportMinimap(FileName filename, int floor /*= rme::MapGroundLayer*/, bool displaydialog)
+void Map::borderize(const std::function<void(int)>& progress)
 {
-	uint8_t* pic = nullptr;
-
-	try
-	{
-		int min_x = 0x10000, min_y = 0x10000;
-		int max_x = 0x00000, max_y = 0x00000;
-
-		if(size() == 0)
-			return true;
-
-		uint32_t minimap_colors[256];
-		for(int i = 0; i < 256; ++i)
-			minimap_colors[i] = colorFromEightBit(i).GetRGB();
+	RME_TRACE_ZONE("brush", "Map::borderize");
+	// Borders only depend on the grounds around a tile, which borderizing
+	// never changes, so the neighbours are looked up once per leaf and floor
+	parallel_foreach_LeafOnMap(*this, [this](QTreeNode* leaf, int leaf_x, int leaf_y) {
+		bool changed = false;
+		QTreeNode* around[3][3];
+		for(int dx = 0; dx < 3; ++dx) {
+			for(int dy = 0; dy < 3; ++dy) {
+				int x = leaf_x + (dx - 1) * 4;
+				int y = leaf_y + (dy - 1) * 4;
+				if(dx == 1 && dy == 1) {
+					around[dx][dy] = leaf;
+				} else if(x < 0 || y < 0 || x > rme::MapMaxWidth || y > rme::MapMaxHeight) {
+					around[dx][dy] = nullptr;
+				} else {
+					around[dx][dy] = getLeaf(x, y);
+				}
+			}
+		}
 
-		for(MapIterator mit = begin(); mit != end(); ++mit) {
-			if((*mit)->get() == nullptr || (*mit)->empty())
+		for(int z = rme::MapMinLayer; z <= rme::MapMaxLayer; ++z) {
+			Floor* floor = leaf->getFloor(z);
+			if(!floor) {
 				continue;
+			}
 
-			Position pos = (*mit)->getPosition();
-
-			if(pos.x < min_x)
-				min_x = pos.x;
-
-			if(pos.y < min_y)
-				min_y = pos.y;
-
-			if(pos.x > max_x)
-				max_x = pos.x;
+			// The leaf and the ring of tiles around it, [1][1] is the first tile of the leaf
+			GroundBrush* brushes[6][6];
+			for(int gx = 0; gx < 6; ++gx) {
+				for(int gy = 0; gy < 6; ++gy) {
+					int x = leaf_x + gx - 1;
+					int y = leaf_y + gy - 1;
+					QTreeNode* node = around[(gx + 3) / 4][(gy + 3) / 4];
+					Floor* other = node ? node->getFloor(z) : nullptr;
+					Tile* tile = other ? other->locs[(x & 3) * 4 + (y & 3)].get() : nullptr;
+					brushes[gx][gy] = tile ? tile->getGroundBrush() : nullptr;
+				}
+			}
 
-			if(pos.y > max_y)
-				max_y = pos.y;
+			for(int tx = 0; tx < 4; ++tx) {
+				for(int ty = 0; ty < 4; ++ty) {
+					Tile* tile = floor->locs[tx * 4 + ty].get();
+					if(!tile) {
+						continue;
+					}
 
+					GroundBrush* const neighbours[8] = {
+						brushes[tx][ty],     brushes[tx + 1][ty],     brushes[tx + 2][ty],
+						brushes[tx][ty + 1],                          brushes[tx + 2][ty + 1],
+						brushes[tx][ty + 2], brushes[tx + 1][ty + 2], brushes[tx + 2][ty + 2],
+					};
+					GroundBrush::doBorders(tile, neighbours);
+					// The borders are made again, whether they came out the same isn't known
+					changed = true;
+				}
+			}
 		}
+		return changed;
+	}, progress);
+	discardItemIdIndex();
+}
 
-		int minimap_width = max_x - min_x+1;
-		int minimap_height = max_y - min_y+1;
-
-		pic = newd uint8_t[minimap_width*minimap_height]; // 1 byte per pixel
+bool Map::exportMinimap(FileName filename, int floor /*= rme::MapGroundLayer*/, bool displaydialog)
+{
+	if(size() == 0)
+		return true;
 
-		memset(pic, 0, minimap_width*minimap_height);
+	// The bounds of all floors, so the images of different floors line up
+	const TileBounds bounds = getBounds();
+	if(bounds.empty())
+		return true;
 
-		int tiles_iterated = 0;
-		for(MapIterator mit = begin(); mit != end(); ++mit) {
-			Tile* tile = (*mit)->get();
-			++tiles_iterated;
-			if(tiles_iterated % 8192 == 0 && displaydialog)
-				g_gui.SetLoadDone(int(tiles_iterated / double(tilecount) * 90.0));
+	const int minimap_width = bounds.max_x - bounds.min_x + 1;
+	const int minimap_height = bounds.max_y - bounds.min_y + 1;
+	// Bitmap rows are padded to a multiple of four bytes
+	const int row_size = (minimap_width + 3) & ~3;
 
-			if(tile->empty() || tile->getZ() != floor)
-				continue;
+	uint32_t minimap_colors[256];
+	for(int i = 0; i < 256; ++i)
+		minimap_colors[i] = colorFromEightBit(i).GetRGB();
 
-			//std::cout << "Pixel : " << (tile->getY() - min_y) * width + (tile->getX() - min_x) << std::endl;
-			uint32_t pixelpos = (tile->getY() - min_y) * minimap_width + (tile->getX() - min_x);
-			uint8_t& pixel = pic[pixelpos];
+	// Create a file for writing
+	FileWriteHandle fh(nstr(filename.GetFullPath()));
 
-			for(ItemVector::const_reverse_iterator item_iter = tile->items.rbegin(); item_iter != tile->items.rend(); ++item_iter) {
-				if((*item_iter)->getMiniMapColor()) {
-					pixel = (*item_iter)->getMiniMapColor();
-					break;
+	if(!fh.isOpen()) {
+		return false;
+	}
+	// Store the magic number
+	fh.addRAW("BM");
+
+	// Store the file size
+	uint32_t file_size =
+				14 // header
+				+40 // image data header
+				+256*4 // color palette
+				+uint32_t(row_size) * minimap_height; // pixels
+	fh.addU32(file_size);
+
+	// Two values reserved, must always be 0.
+	fh.addU16(0);
+	fh.addU16(0);
+
+	// Bitmapdata offset
+	fh.addU32(14 + 40 + 256*4);
+
+	// Header size
+	fh.addU32(40);
+
+	// Header width/height
+	fh.addU32(minimap_width);
+	fh.addU32(minimap_height);
+
+	// Color planes
+	fh.addU16(1);
+
+	// bits per pixel, OT map format is 8
+	fh.addU16(8);
+
+	// compression type, 0 is no compression
+	fh.addU32(0);
+
+	// image size, 0 is valid if we use no compression
+	fh.addU32(0);
+
+	// horizontal/vertical resolution in pixels / meter
+	fh.addU32(4000);
+	fh.addU32(4000);
+
+	// Number of colors
+	fh.addU32(256);
+	// Important colors, 0 is all
+	fh.addU32(0);
+
+	// Write the color palette
+	for(int i = 0; i < 256; ++i)
+		fh.addU32(minimap_colors[i]);
+
+	// Bands of rows are filled from the leaves side by side and written as soon as a round of them
+	// is done, so only a few bands are held whatever the size of the map. Bitmap rows are saved in
+	// reverse order, so the bands start at the bottom and each is filled bottom row first.
+	const int band_height = 64;
+	const int band_count = (minimap_height + band_height - 1) / band_height;
+	ThreadPool& pool = ThreadPool::getInstance();
+	const int round_size = int(std::max<size_t>(pool.getWorkerCount(), 1) * 2);
+	std::vector<std::vector<uint8_t>> bands(round_size);
+
+	for(int done = 0; done < band_count;) {
+		const int round = std::min(round_size, band_count - done);
+		pool.parallelFor(round, [&](size_t i) {
+			const int end_y = bounds.max_y - (done + int(i)) * band_height;
+			const int start_y = std::max(end_y - band_height + 1, bounds.min_y);
+			std::vector<uint8_t>& pixels = bands[i];
+			pixels.assign(size_t(row_size) * (end_y - start_y + 1), 0);
+
+			visitFloors(bounds.min_x, start_y, bounds.max_x, end_y, floor, floor, [&](Floor* tiles, int nd_x, int nd_y, int) {
+				for(int index = 0; index < 16; ++index) {
+					const int x = nd_x + (index >> 2);
+					const int y = nd_y + (index & 3);
+					if(x < bounds.min_x || x > bounds.max_x || y < start_y || y > end_y)
+						continue;
+
+					const Tile* tile = tiles->locs[index].get();
+					if(!tile || tile->empty())
+						continue;
+
+					if(uint8_t color = tile->getMiniMapColor()) {
+						pixels[size_t(end_y - y) * row_size + (x - bounds.min_x)] = color;
+					}
 				}
-			}
-			if(pixel == 0)
-				// check ground too
-				if(tile->hasGround())
-					pixel = tile->ground->getMiniMapColor();
-		}
-
-		// Create a file for writing
-		FileWriteHandle fh(nstr(filename.GetFullPath()));
+			});
+		});
 
-		if(!fh.isOpen()) {
-			delete[] pic;
-			return false;
+		for(int i = 0; i < round; ++i) {
+			fh.addRAW(bands[i].data(), bands[i].size());
+		}
+		done += round;
+		if(displaydialog) {
+			g_gui.SetLoadDone(int(done / double(band_count) * 100.0));
 		}
-		// Store the magic number
-		fh.addRAW("BM");
+	}
 
-		// Store the file size
-		// We need to predict how large it will be
-		uint32_t file_size =
-					14 // header
-					+40 // image data header
-					+256*4 // color palette
-					+((minimap_width + 3) / 4 * 4) * height; // pixels
-		fh.addU32(file_size);
+	fh.close();
+	return true;
+}
 
-		// Two values reserved, must always be 0.
-		fh.addU16(0);
-		fh.addU16(0);
+namespace
+{
+	void addPosition(std::unordered_map<uint16_t, std::vector<Position>>& index, uint16_t id, const Position& position)
+	{
+		index[id].push_back(position);
+	}
 
-		// Bitmapdata offset
-		fh.addU32(14 + 40 + 256*4);
+	void removePosition(std::unordered_map<uint16_t, std::vector<Position>>& index, uint16_t id, const Position& position)
+	{
+		auto it = index.find(id);
+		if(it == index.end()) {
+			return;
+		}
 
-		// Header size
-		fh.addU32(40);
+		std::vector<Position>& positions = it->second;
+		auto found = std::find(positions.begin(), positions.end(), position);
+		if(found != positions.end()) {
+			*found = positions.back();
+			positions.pop_back();
+		}
+		if(positions.empty()) {
+			index.erase(it);
+		}
+	}
 
-		// Header width/height
-		fh.addU32(minimap_width);
-		fh.addU32(minimap_height);
+	std::vector<Position> collectTiles(const std::unordered_map<uint16_t, std::vector<Position>>& index)
+	{
+		std::vector<Position> tiles;
+		for(const auto& entry : index) {
+			tiles.insert(tiles.end(), entry.second.begin(), entry.second.end());
+		}
+		std::sort(tiles.begin(), tiles.end());
+		tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+		return tiles;
+	}
+}
 
-		// Color planes
-		fh.addU16(1);
+void Map::updateItemIndex(Tile* old_tile, Tile* new_tile)
+{
+	if(old_tile && old_tile->creature)
+		spawns.removeCreature(old_tile->getPosition());
+	if(new_tile && new_tile->creature)
+		spawns.addCreature(new_tile->getPosition());
+
+	if(indexItemIds && !itemBlocksStale) {
+		if(old_tile)
+			countItemIds(old_tile, false);
+		if(new_tile)
+			countItemIds(new_tile, true);
+	}
 
-		// bits per pixel, OT map format is 8
-		fh.addU16(8);
+	if(old_tile && (old_tile->hasUniqueItem() || old_tile->hasActionItem())) {
+		const Position& position = old_tile->getPosition();
+		foreach_ItemOnTile(old_tile, [&](const Item* item) {
+			if(uint16_t uid = item->getUniqueID()) {
+				removeUniqueId(uid);
+				removePosition(uniqueIdPositions, uid, position);
+			}
+			if(uint16_t aid = item->getActionID()) {
+				removePosition(actionIdPositions, aid, position);
+			}
+		});
+	}
 
-		// compression type, 0 is no compression
-		fh.addU32(0);
+	if(new_tile && (new_tile->hasUniqueItem() || new_tile->hasActionItem())) {
+		const Position& position = new_tile->getPosition();
+		foreach_ItemOnTile(new_tile, [&](const Item* item) {
+			if(uint16_t uid = item->getUniqueID()) {
+				addUniqueId(uid);
+				addPosition(uniqueIdPositions, uid, position);
+			}
+			if(uint16_t aid = item->getActionID()) {
+				addPosition(actionIdPositions, aid, position);
+			}
+		});
+	}
+}
 
-		// image size, 0 is valid if we use no compression
-		fh.addU32(0);
+const std::vector<Position>& Map::getActionIdPositions(uint16_t aid) const
+{
+	static const std::vector<Position> none;
+	auto it = actionIdPositions.find(aid);
+	return it != actionIdPositions.end() ? it->second : none;
+}
 
-		// horizontal/vertical resolution in pixels / meter
-		fh.addU32(4000);
-		fh.addU32(4000);
+const std::vector<Position>& Map::getUniqueIdPositions(uint16_t uid) const
+{
+	static const std::vector<Position> none;
+	auto it = uniqueIdPositions.find(uid);
+	return it != uniqueIdPositions.end() ? it->second : none;
+}
 
-		// Number of colors
-		fh.addU32(256);
-		// Important colors, 0 is all
-		fh.addU32(0);
+std::vector<Position> Map::getActionIdTiles() const
+{
+	return collectTiles(actionIdPositions);
+}
 
-		// Write the color palette
-		for(int i = 0; i < 256; ++i)
-			fh.addU32(minimap_colors[i]);
+std::vector<Position> Map::getUniqueIdTiles() const
+{
+	return collectTiles(uniqueIdPositions);
+}
 
-		// Bitmap width must be divisible by four, calculate how much padding we need
-		int padding = ((minimap_width & 3) != 0? 4-(minimap_width & 3) : 0);
-		// Bitmap rows are saved in reverse order
-		for(int y = minimap_height-1; y >= 0; --y) {
-			fh.addRAW(pic + y*minimap_width, minimap_width);
-			for(int i = 0; i < padding; ++i) {
-				fh.addU8(0);
-			}
-			if(y % 100 == 0 && displaydialog) {
-				g_gui.SetLoadDone(90 + int((minimap_height-y) / double(minimap_height) * 10.0));
-			}
+void Map::countItemIds(Tile* tile, bool add)
+{
+	const uint32_t block = (uint32_t(tile->getX() / ItemBlockSize) << 16) | uint32_t(tile->getY() / ItemBlockSize);
+	foreach_ItemOnTile(tile, [&](const Item* item) {
+		if(add) {
+			++itemBlocks[item->getID()][block];
+			return;
 		}
 
-		delete[] pic;
-		//fclose(file);
-		fh.close();
-	}
-	catch(...)
-	{
-		delete[] pic;
-	}
+		auto blocks = itemBlocks.find(item->getID());
+		if(blocks == itemBlocks.end())
+			return;
 
-	return true;
+		auto count = blocks->second.find(block);
+		if(count != blocks->second.end() && --count->second == 0) {
+			blocks->second.erase(count);
+			if(blocks->second.empty())
+				itemBlocks.erase(blocks);
+		}
+	});
 }
 
-void Map::updateUniqueIds(Tile* old_tile, Tile* new_tile)
+bool Map::getItemIdLeaves(uint16_t id, std::vector<QTreeNode*>& leaves)
 {
-	if(old_tile && old_tile->hasUniqueItem()) {
-		if(old_tile->ground) {
-			uint16_t uid = old_tile->ground->getUniqueID();
-			if(uid != 0)
-				removeUniqueId(uid);
-		}
-		for(const Item* item : old_tile->items) {
-			if(item) {
-				uint16_t uid = item->getUniqueID();
-				if(uid != 0) {
-					removeUniqueId(uid);
-				}
-			}
+	if(!indexItemIds)
+		return false;
+
+	if(itemBlocksStale) {
+		itemBlocks.clear();
+		for(MapIterator it = begin(); it != end(); ++it) {
+			countItemIds((*it)->get(), true);
 		}
+		itemBlocksStale = false;
 	}
 
-	if(new_tile && new_tile->hasUniqueItem()) {
-		if(new_tile->ground) {
-			uint16_t uid = new_tile->ground->getUniqueID();
-			if(uid != 0)
-				addUniqueId(uid);
-		}
-		for(const Item* item : new_tile->items) {
-			if(item) {
-				uint16_t uid = item->getUniqueID();
-				if(uid != 0) {
-					addUniqueId(uid);
-				}
-			}
-		}
+	auto found = itemBlocks.find(id);
+	if(found == itemBlocks.end())
+		return true;
+
+	std::vector<uint32_t> blocks;
+	blocks.reserve(found->second.size());
+	for(const auto& entry : found->second) {
+		blocks.push_back(entry.first);
+	}
+	std::sort(blocks.begin(), blocks.end());
+
+	for(uint32_t block : blocks) {
+		const int x = int(block >> 16) * ItemBlockSize;
+		const int y = int(block & 0xFFFF) * ItemBlockSize;
+		visitLeaves(x, y, x + ItemBlockSize - 1, y + ItemBlockSize - 1, [&leaves](QTreeNode* leaf, int, int) {
+			leaves.push_back(leaf);
+		});
 	}
+	return true;
 }
 
 void Map::addUniqueId(uint16_t uid)
 {
-	auto it = std::find(uniqueIds.begin(), uniqueIds.end(), uid);
-	if (it == uniqueIds.end()) {
-		uniqueIds.push_back(uid);
+	if(uniqueIdCounts.empty()) {
+		uniqueIdCounts.resize(rme::MaxUniqueId + 1, 0);
+	}
+
+	if(++uniqueIdCounts[uid] == 2) {
+		++duplicateUniqueIds;
 	}
 }
 
 void Map::removeUniqueId(uint16_t uid)
 {
-	auto it = std::find(uniqueIds.begin(), uniqueIds.end(), uid);
-	if (it != uniqueIds.end()) {
-		uniqueIds.erase(it);
+	if(uniqueIdCounts.empty() || uniqueIdCounts[uid] == 0) {
+		return;
+	}
+
+	if(uniqueIdCounts[uid]-- == 2) {
+		--duplicateUniqueIds;
 	}
 }
 
 bool Map::hasUniqueId(uint16_t uid) const
 {
-	if (uid < rme::MinUniqueId || uniqueIds.empty())
+	if(uid < rme::MinUniqueId)
 		return false;
+	return getUniqueIdCount(uid) != 0;
+}
+
+uint32_t Map::getUniqueIdCount(uint16_t uid) const
+{
+	if(uniqueIdCounts.empty())
+		return 0;
+	return uniqueIdCounts[uid];
+}
+
+std::vector<uint16_t> Map::getDuplicateUniqueIds() const
+{
+	std::vector<uint16_t> duplicates;
+	if(duplicateUniqueIds == 0)
+		return duplicates;
+
+	duplicates.reserve(duplicateUniqueIds);
+	for(size_t uid = rme::MinUniqueId; uid < uniqueIdCounts.size(); ++uid) {
+		if(uniqueIdCounts[uid] > 1) {
+			duplicates.push_back(static_cast<uint16_t>(uid));
+		}
+	}
+	return duplicates;
+}
 
-	auto it = std::find(uniqueIds.begin(), uniqueIds.end(), uid);
-	return it != uniqueIds.end();
+std::vector<size_t> splitLeavesByItems(const std::vector<QTreeNode*>& leaves)
+{
+	// Weighing the leaves walks the containers as well, so it runs on the pool too
+	std::vector<uint64_t> weights(leaves.size());
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(std::min(leaves.size() / 64, pool.getWorkerCount() * 8), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t begin = leaves.size() * chunk / chunk_count;
+		const size_t end = leaves.size() * (chunk + 1) / chunk_count;
+		for(size_t i = begin; i < end; ++i) {
+			uint64_t weight = 0;
+			for(Floor* floor : std::span(leaves[i]->getFloors(), rme::MapLayers)) {
+				if(!floor)
+					continue;
+
+				for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1) {
+					Tile* tile = floor->locs[std::countr_zero(mask)].get();
+					weight += 1;
+					if(tile->hasContainers()) {
+						foreach_ItemOnTile(tile, [&weight](Item*) {
+							++weight;
+						});
+					}
+				}
+			}
+			weights[i] = weight;
+		}
+	});
+
+	uint64_t total = 0;
+	for(uint64_t weight : weights)
+		total += weight;
+	const uint64_t target = std::max<uint64_t>(total / chunk_count, 1);
+
+	std::vector<size_t> bounds(1, 0);
+	uint64_t run = 0;
+	for(size_t i = 0; i < leaves.size(); ++i) {
+		// A leaf heavier than what is left of the run starts a new one
+		if(run != 0 && run + weights[i] > target) {
+			bounds.push_back(i);
+			run = 0;
+		}
+		run += weights[i];
+	}
+	bounds.push_back(leaves.size());
+	return bounds;
 }
@@ -24,8 +24,18 @@
 #include "house.h"
 #include "spawn.h"
 #include "complexitem.h"
+
+#include <unordered_map>
 #include "waypoints.h"
 #include "templates.h"
+#include "thread_pool.h"
+#include "iomap.h"
+#include "map_statistics.h"
+#include "map_hibernation.h"
+
+#include <span>
+
+struct OTBM_PartialMap;
 
 class Map : public BaseMap
 {
@@ -36,6 +46,9 @@ public:
 
 	// Operations on the entire map
 	void cleanInvalidTiles(bool showdialog = false);
+	// Puts the borders of every ground of the map, leaf by leaf on the shared ThreadPool.
+	// progress(percent) is called on the calling thread.
+	void borderize(const std::function<void(int)>& progress = nullptr);
 	// Save a bmp image of the minimap
 	bool exportMinimap(FileName filename, int floor = rme::MapGroundLayer, bool showdialog = false);
 	//
@@ -57,6 +70,10 @@ public:
 	const wxArrayString& getWarnings() const noexcept { return warnings; }
 	bool hasError() const { return !error.empty(); }
 	const wxString& getError() const noexcept { return error; }
+	// Timings of the last load or save
+	const IOTelemetry& getIOTelemetry() const noexcept { return telemetry; }
+	// The counts of the statistics dialog, kept per leaf between two looks
+	MapStatisticsCache& getStatisticsCache() noexcept { return statisticsCache; }
 
 	// Mess with spawns
 	bool addSpawn(Tile* spawn);
@@ -92,16 +109,53 @@ public:
 	void flagAsNamed() noexcept { unnamed = false; }
 
 	bool hasUniqueId(uint16_t uid) const;
+	// Unique ids carried by more than one item on the map, in ascending order
+	std::vector<uint16_t> getDuplicateUniqueIds() const;
+	uint32_t getUniqueIdCount(uint16_t uid) const;
+
+	// Tiles holding an item with the id, a tile with several such items is listed once per item
+	const std::vector<Position>& getActionIdPositions(uint16_t aid) const;
+	const std::vector<Position>& getUniqueIdPositions(uint16_t uid) const;
+	// Every tile holding an item with an action id / unique id, sorted and listed once
+	std::vector<Position> getActionIdTiles() const;
+	std::vector<Position> getUniqueIdTiles() const;
+
+	// Collects, in map order, the leaves that may hold an item with the server id; the others hold
+	// none. Returns false when the map keeps no index of item ids and every leaf has to be searched.
+	bool getItemIdLeaves(uint16_t id, std::vector<QTreeNode*>& leaves);
+
+	// If only an area of the map file was loaded, saving takes the rest from the file
+	bool isPartial() const noexcept { return partial != nullptr; }
+	// Whether the tiles of the 256x256 area holding pos are in memory
+	bool isAreaLoaded(const Position& pos) const;
+
+	// A paged map reads its areas from its file as they are needed. Once the areas read take more than
+	// the memory budget, the unmodified ones farthest from the views are dropped again.
+	bool isPaged() const noexcept;
+	void trimPagedAreas(const std::vector<Position>& views);
+
+	// A map that is open but not worked on can hibernate: the tiles of the areas unchanged since it
+	// was saved are kept compressed in memory instead, see MapHibernation. The leaves holding what is
+	// pointed at from elsewhere stay, and so do the locations, which the history points at. Looking
+	// up a tile of a hibernating area wakes it, waking the whole map decodes the areas on the thread
+	// pool. Returns how many tiles were taken. Not to be called while other threads use the map.
+	size_t hibernate();
+	void wake();
+	bool isHibernating() const noexcept { return hibernation != nullptr; }
+	// What the hibernating tiles take compressed
+	size_t getHibernatedBytes() const noexcept;
 
 protected:
-	// Loads a map
-	bool open(const std::string identifier);
+	// Loads a map, or only the tile areas of it that intersect area
+	bool open(const std::string identifier, const MapArea& area = MapArea());
 
 protected:
 	void removeSpawnInternal(Tile* tile);
 
 	wxArrayString warnings;
 	wxString error;
+	IOTelemetry telemetry;
+	MapStatisticsCache statisticsCache;
 
 	std::string name; // The map name, NOT the same as filename
 	std::string filename; // the maps filename
@@ -121,13 +175,28 @@ public:
 	Spawns spawns;
 
 protected:
-	void updateUniqueIds(Tile* old_tile, Tile* new_tile) override;
+	void loadPagedArea(uint32_t area) override;
+	// Puts the tiles of a hibernating area back, the area must not be paged out anymore
+	void placeHibernatedTiles(uint32_t area, std::vector<MapHibernation::Entry>& tiles);
+	// Houses, spawns, waypoints, zones and selections aren't paged, their areas stay in memory
+	bool canPageOut(int x, int y);
+
+	void updateItemIndex(Tile* old_tile, Tile* new_tile) override;
 	void addUniqueId(uint16_t uid);
 	void removeUniqueId(uint16_t uid);
+	void countItemIds(Tile* tile, bool add);
+	// Called after tiles were changed in place rather than through setTile/swapTile, as the
+	// item id index could not follow; it is rebuilt the next time it is queried
+	void discardItemIdIndex() noexcept { itemBlocksStale = true; }
 
 	bool has_changed; // If the map has changed
 	bool unnamed; // If the map has yet to receive a name
 
+	// What a partial load didn't keep of the map file, nullptr if the whole map was loaded
+	std::unique_ptr<OTBM_PartialMap> partial;
+	// The tiles taken off a hibernating map, nullptr while it is awake
+	std::unique_ptr<MapHibernation> hibernation;
+
 	friend class IOMapOTBM;
 	friend class IOMapOTMM;
 	friend class Editor;
@@ -136,12 +205,64 @@ public:
 	Waypoints waypoints;
 
 private:
-	std::vector<uint16_t> uniqueIds;
+	// How many items on the map carry each unique id, indexed by the id. Allocated on first use.
+	std::vector<uint32_t> uniqueIdCounts;
+	size_t duplicateUniqueIds; // Ids with a count above one
+
+	typedef std::unordered_map<uint16_t, std::vector<Position>> IdPositionIndex;
+	IdPositionIndex actionIdPositions;
+	IdPositionIndex uniqueIdPositions;
+
+	// How many items with each server id (containers' contents included) lie in each column of
+	// ItemBlockSize x ItemBlockSize tiles, all floors together, keyed by the id and then the block.
+	// A block, rather than a leaf or a tile, keeps the index small next to the map it describes.
+	static constexpr int ItemBlockSize = 64;
+	typedef std::unordered_map<uint16_t, std::unordered_map<uint32_t, uint32_t>> ItemBlockIndex;
+	ItemBlockIndex itemBlocks;
+	bool indexItemIds; // Config::INDEX_ITEM_IDS when the map was created
+	bool itemBlocksStale;
 };
 
+// Calls func(item) for the ground and the items of the tile, the contents of a container coming
+// right after it, in the order foreach_ItemOnMap visits them
+template <typename Func>
+inline void foreach_ItemOnTile(Tile* tile, Func&& func)
+{
+	if(tile->ground) {
+		func(tile->ground);
+	}
+
+	if(!tile->hasContainers()) {
+		for(Item* item : tile->items) {
+			func(item);
+		}
+		return;
+	}
+
+	std::queue<Container*> containers;
+	for(Item* item : tile->items) {
+		func(item);
+		if(Container* container = dynamic_cast<Container*>(item)) {
+			containers.push(container);
+		}
+
+		while(!containers.empty()) {
+			for(Item* content : containers.front()->getVector()) {
+				func(content);
+				if(Container* container = dynamic_cast<Container*>(content)) {
+					containers.push(container);
+				}
+			}
+			containers.pop();
+		}
+	}
+}
+
 template <typename ForeachType>
 inline void foreach_ItemOnMap(Map& map, ForeachType& foreach, bool selectedTiles)
 {
+	if(!selectedTiles)
+		map.pageInAll();
 	MapIterator tileiter = map.begin();
 	MapIterator end = map.end();
 	long long done = 0;
@@ -154,33 +275,9 @@ inline void foreach_ItemOnMap(Map& map, ForeachType& foreach, bool selectedTiles
 			continue;
 		}
 
-		if(tile->ground) {
-			foreach(map, tile, tile->ground, done);
-		}
-
-		std::queue<Container*> containers;
-		for(ItemVector::iterator itemiter = tile->items.begin(); itemiter != tile->items.end(); ++itemiter) {
-			Item* item = *itemiter;
-			Container* container = dynamic_cast<Container*>(item);
+		foreach_ItemOnTile(tile, [&](Item* item) {
 			foreach(map, tile, item, done);
-			if(container) {
-				containers.push(container);
-
-				do {
-					container = containers.front();
-					ItemVector& v = container->getVector();
-					for(ItemVector::iterator containeriter = v.begin(); containeriter != v.end(); ++containeriter) {
-						Item* i = *containeriter;
-						Container* c = dynamic_cast<Container*>(i);
-						foreach(map, tile, i, done);
-						if(c) {
-							containers.push(c);
-						}
-					}
-					containers.pop();
-				} while(containers.size());
-			}
-		}
+		});
 		++tileiter;
 	}
 }
@@ -188,6 +285,7 @@ inline void foreach_ItemOnMap(Map& map, ForeachType& foreach, bool selectedTiles
 template <typename ForeachType>
 inline void foreach_TileOnMap(Map& map, ForeachType& foreach)
 {
+	map.pageInAll();
 	MapIterator tileiter = map.begin();
 	MapIterator end = map.end();
 	long long done = 0;
@@ -196,9 +294,250 @@ inline void foreach_TileOnMap(Map& map, ForeachType& foreach)
 		foreach(map, (*tileiter++)->get(), ++done);
 }
 
+// Cuts leaves into runs of about equal work for a parallel pass over their items, as many as the
+// passes by count use: a leaf weighs the tiles it holds, and the items inside the containers on
+// them as well. A leaf of depots can weigh more than a whole run, it then runs on its own. Run i
+// is [bounds[i], bounds[i + 1]) of the returned bounds.
+std::vector<size_t> splitLeavesByItems(const std::vector<QTreeNode*>& leaves);
+
+// Parallel, read-only variants of the above. The leaves of the map are cut into chunks that run on the
+// shared ThreadPool, and every chunk works on its own copy of foreach, so no state is shared between
+// threads. The copies are returned in map order for the caller to merge (the reduction step).
+// The contract: foreach only reads the map and writes its own members. It must not change tiles or
+// items, and must not call into the GUI; progress(percent) is called on the calling thread instead.
+// The leaves are cut by count, or as bounds says when given, see splitLeavesByItems. Like the serial
+// ones, the passes over the whole map first read back what a paged map keeps in its file only.
+template <typename ForeachType>
+inline std::vector<ForeachType> parallel_foreach_TileOnLeaves(Map& map, const std::vector<QTreeNode*>& leaves, const ForeachType& foreach, bool selectedTiles = false, const std::function<void(int)>& progress = nullptr, std::vector<size_t> bounds = {})
+{
+	ThreadPool& pool = ThreadPool::getInstance();
+	if(bounds.empty()) {
+		const size_t chunk_count = std::max<size_t>(std::min(leaves.size() / 64, pool.getWorkerCount() * 8), 1);
+		for(size_t chunk = 0; chunk <= chunk_count; ++chunk)
+			bounds.push_back(leaves.size() * chunk / chunk_count);
+	}
+	const size_t chunk_count = bounds.size() - 1;
+	std::vector<ForeachType> chunks(chunk_count, foreach);
+
+	std::atomic<long long> done(0);
+	const long long total = std::max<long long>(leaves.size(), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const Map& const_map = map;
+		const size_t begin = bounds[chunk];
+		const size_t end = bounds[chunk + 1];
+		for(size_t i = begin; i < end; ++i) {
+			for(Floor* floor : std::span(leaves[i]->getFloors(), rme::MapLayers)) {
+				if(!floor)
+					continue;
+
+				for(TileLocation& location : floor->locs) {
+					Tile* tile = location.get();
+					if(!tile || (selectedTiles && !tile->isSelected()))
+						continue;
+
+					chunks[chunk](const_map, tile);
+				}
+			}
+		}
+		done += end - begin;
+	}, [&]() {
+		if(progress)
+			progress(int(100 * done / total));
+		return true;
+	});
+	return chunks;
+}
+
+template <typename ForeachType>
+inline std::vector<ForeachType> parallel_foreach_TileOnMap(Map& map, const ForeachType& foreach, bool selectedTiles = false, const std::function<void(int)>& progress = nullptr)
+{
+	if(!selectedTiles)
+		map.pageInAll();
+	std::vector<QTreeNode*> leaves;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&leaves](QTreeNode* leaf, int, int) {
+		leaves.push_back(leaf);
+	});
+	return parallel_foreach_TileOnLeaves(map, leaves, foreach, selectedTiles, progress);
+}
+
+template <typename ForeachType>
+struct ItemOnTileVisitor
+{
+	ForeachType foreach;
+
+	void operator()(const Map& map, Tile* tile)
+	{
+		foreach_ItemOnTile(tile, [&](Item* item) {
+			foreach(map, tile, item);
+		});
+	}
+
+	static std::vector<ForeachType> unwrap(std::vector<ItemOnTileVisitor>& visitors)
+	{
+		std::vector<ForeachType> chunks;
+		chunks.reserve(visitors.size());
+		for(ItemOnTileVisitor& visitor : visitors) {
+			chunks.push_back(std::move(visitor.foreach));
+		}
+		return chunks;
+	}
+};
+
+template <typename ForeachType>
+inline std::vector<ForeachType> parallel_foreach_ItemOnMap(Map& map, const ForeachType& foreach, bool selectedTiles, const std::function<void(int)>& progress = nullptr)
+{
+	if(!selectedTiles)
+		map.pageInAll();
+	std::vector<QTreeNode*> leaves;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&leaves](QTreeNode* leaf, int, int) {
+		leaves.push_back(leaf);
+	});
+
+	typedef ItemOnTileVisitor<ForeachType> Visitor;
+	std::vector<Visitor> visitors = parallel_foreach_TileOnLeaves(map, leaves, Visitor { foreach }, selectedTiles, progress, splitLeavesByItems(leaves));
+	return Visitor::unwrap(visitors);
+}
+
+// As parallel_foreach_ItemOnMap, for a foreach that only looks for items with the server id: only the
+// leaves that hold such an item are visited when the map indexes item ids, or else the leaves whose
+// summary may hold it. foreach still sees every item of those tiles, and must check the id itself.
+template <typename ForeachType>
+inline std::vector<ForeachType> parallel_foreach_ItemWithId(Map& map, uint16_t itemid, const ForeachType& foreach, bool selectedTiles, const std::function<void(int)>& progress = nullptr)
+{
+	if(!selectedTiles)
+		map.pageInAll();
+	std::vector<QTreeNode*> leaves;
+	if(!map.getItemIdLeaves(itemid, leaves)) {
+		TileSummary filter;
+		filter.floors = 0xFFFF;
+		filter.items = TileSummary::itemBit(itemid);
+		map.visitLeavesMatching(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, filter, [&leaves](QTreeNode* leaf, int, int) {
+			leaves.push_back(leaf);
+		});
+	}
+
+	typedef ItemOnTileVisitor<ForeachType> Visitor;
+	std::vector<Visitor> visitors = parallel_foreach_TileOnLeaves(map, leaves, Visitor { foreach }, selectedTiles, progress, splitLeavesByItems(leaves));
+	return Visitor::unwrap(visitors);
+}
+
+// Calls func(leaf, x, y) for every leaf of the map on the shared ThreadPool, x/y being its first tile.
+// The leaves are split into the four colours of a 2x2 checkerboard and one colour runs at a time, so
+// no two leaves that run together touch each other: func may change the tiles of its own leaf while
+// it reads their neighbours in the leaves around it. func returns whether it changed the leaf, the
+// changed leaves are marked dirty and changed on the calling thread afterwards, as parallel_pass_TileOnMap
+// does. progress(percent) is called on the calling thread.
+template <typename Func>
+inline void parallel_foreach_LeafOnMap(Map& map, Func&& func, const std::function<void(int)>& progress = nullptr)
+{
+	struct Leaf {
+		QTreeNode* node;
+		int x;
+		int y;
+	};
+
+	// Borders reach into the neighbouring areas, all of them have to be there
+	map.pageInAll();
+	std::vector<Leaf> colours[4];
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&colours](QTreeNode* leaf, int x, int y) {
+		colours[((x >> 2) & 1) | (((y >> 2) & 1) << 1)].push_back({ leaf, x, y });
+	});
+
+	ThreadPool& pool = ThreadPool::getInstance();
+	std::atomic<size_t> done(0);
+	const size_t total = std::max<size_t>(colours[0].size() + colours[1].size() + colours[2].size() + colours[3].size(), 1);
+	for(const std::vector<Leaf>& leaves : colours) {
+		const size_t chunk_count = std::max<size_t>(std::min(leaves.size() / 16, pool.getWorkerCount() * 8), 1);
+		std::vector<uint8_t> changed(leaves.size(), 0);
+		pool.parallelFor(chunk_count, [&](size_t chunk) {
+			const size_t begin = leaves.size() * chunk / chunk_count;
+			const size_t end = leaves.size() * (chunk + 1) / chunk_count;
+			for(size_t i = begin; i < end; ++i) {
+				changed[i] = func(leaves[i].node, leaves[i].x, leaves[i].y) ? 1 : 0;
+			}
+			done += end - begin;
+		}, [&]() {
+			if(progress)
+				progress(int(100 * done / total));
+			return true;
+		});
+
+		// The dirty areas and the revisions are shared by the whole map
+		for(size_t i = 0; i < leaves.size(); ++i) {
+			if(changed[i]) {
+				map.markAreaDirty(leaves[i].x, leaves[i].y);
+				map.markTileChanged(leaves[i].x, leaves[i].y);
+			}
+		}
+	}
+}
+
+// Changes the tiles of the map in place on the shared ThreadPool, for passes over the whole map.
+// Every chunk of leaves works on its own copy of pass, called as pass(tile) for each tile: it may change
+// that tile and its items and returns whether it did, what it gathers (counts, undo data) goes in its
+// own members. It must not touch other tiles, the map or the GUI. The leaves holding a changed tile are
+// marked dirty and changed on the calling thread afterwards, and the copies are returned in map order
+// for the caller to merge. progress(percent) is called on the calling thread, once it returns false the
+// chunks that haven't started yet are skipped.
+template <typename PassType>
+inline std::vector<PassType> parallel_pass_TileOnMap(Map& map, const PassType& pass, const std::function<bool(int)>& progress = nullptr)
+{
+	struct Leaf {
+		QTreeNode* node;
+		int x;
+		int y;
+	};
+
+	map.pageInAll();
+	std::vector<Leaf> leaves;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&leaves](QTreeNode* leaf, int x, int y) {
+		leaves.push_back({ leaf, x, y });
+	});
+
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(std::min(leaves.size() / 64, pool.getWorkerCount() * 8), 1);
+	std::vector<PassType> chunks(chunk_count, pass);
+	std::vector<std::vector<const Leaf*>> changed(chunk_count);
+
+	std::atomic<size_t> done(0);
+	const size_t total = std::max<size_t>(leaves.size(), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t begin = leaves.size() * chunk / chunk_count;
+		const size_t end = leaves.size() * (chunk + 1) / chunk_count;
+		for(size_t i = begin; i < end; ++i) {
+			bool leaf_changed = false;
+			for(Floor* floor : std::span(leaves[i].node->getFloors(), rme::MapLayers)) {
+				if(!floor)
+					continue;
+
+				for(TileLocation& location : floor->locs) {
+					Tile* tile = location.get();
+					if(tile && chunks[chunk](tile))
+						leaf_changed = true;
+				}
+			}
+			if(leaf_changed)
+				changed[chunk].push_back(&leaves[i]);
+		}
+		done += end - begin;
+	}, [&]() {
+		return !progress || progress(int(100 * done / total));
+	});
+
+	// The dirty areas and the revisions are shared by the whole map
+	for(const std::vector<const Leaf*>& list : changed) {
+		for(const Leaf* leaf : list) {
+			map.markAreaDirty(leaf->x, leaf->y);
+			map.markTileChanged(leaf->x, leaf->y);
+		}
+	}
+	return chunks;
+}
+
 template <typename RemoveIfType>
 inline long long remove_if_TileOnMap(Map& map, RemoveIfType& remove_if)
 {
+	map.pageInAll();
 	MapIterator tileiter = map.begin();
 	MapIterator end = map.end();
 	long long done = 0;
@@ -218,41 +557,64 @@ inline long long remove_if_TileOnMap(Map& map, RemoveIfType& remove_if)
 	return removed;
 }
 
-template <typename RemoveIfType>
-inline int64_t RemoveItemOnMap(Map& map, RemoveIfType& condition, bool selectedOnly) {
-	int64_t done = 0;
-	int64_t removed = 0;
+// Removes the ground and the items of the tiles of the map (or the selected ones) condition(tile, item)
+// holds for, in place and without undo. The candidates are gathered leaf by leaf on the shared ThreadPool,
+// condition is shared by the threads and must only read. The tiles holding any are then changed on the
+// calling thread in one go. With dryRun nothing is removed, the items that would be are only counted.
+// Conditions can be combined into one pass by or-ing them. progress(percent) is called on the calling thread.
+template <typename ConditionType>
+inline int64_t parallel_remove_ItemOnMap(Map& map, const ConditionType& condition, bool selectedOnly, bool dryRun = false, const std::function<void(int)>& progress = nullptr)
+{
+	struct Collector {
+		const ConditionType* condition;
+		std::vector<Tile*> tiles;
+		int64_t count = 0;
+
+		void operator()(const Map&, Tile* tile) {
+			int64_t found = 0;
+			if(tile->ground && (*condition)(tile, tile->ground))
+				++found;
+			for(const Item* item : tile->items) {
+				if((*condition)(tile, item))
+					++found;
+			}
+			if(found != 0) {
+				tiles.push_back(tile);
+				count += found;
+			}
+		}
+	};
 
-	MapIterator it = map.begin();
-	MapIterator end = map.end();
+	std::vector<Collector> chunks = parallel_foreach_TileOnMap(map, Collector { &condition }, selectedOnly, progress);
 
-	while(it != end) {
-		++done;
-		Tile* tile = (*it)->get();
-		if(selectedOnly && !tile->isSelected()) {
-			++it;
-			continue;
-		}
+	int64_t removed = 0;
+	for(const Collector& chunk : chunks) {
+		removed += chunk.count;
+	}
+	if(dryRun)
+		return removed;
 
-		if(tile->ground) {
-			if(condition(map, tile->ground, removed, done)) {
+	for(const Collector& chunk : chunks) {
+		for(Tile* tile : chunk.tiles) {
+			if(tile->ground && condition(tile, tile->ground)) {
 				delete tile->ground;
 				tile->ground = nullptr;
-				++removed;
 			}
-		}
 
-		for(auto iit = tile->items.begin(); iit != tile->items.end();) {
-			Item* item = *iit;
-			if(condition(map, item, removed, done)) {
-				iit = tile->items.erase(iit);
-				delete item;
-				++removed;
+			for(auto it = tile->items.begin(); it != tile->items.end();) {
+				if(condition(tile, *it)) {
+					delete *it;
+					it = tile->items.erase(it);
+				} else {
+					++it;
+				}
 			}
-			else
-				++iit;
+			tile->update();
+
+			// The tile is changed in place, not through an action
+			map.markAreaDirty(tile->getX(), tile->getY());
+			map.markTileChanged(tile->getX(), tile->getY());
 		}
-		++it;
 	}
 	return removed;
 }
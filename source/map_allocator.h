@@ -21,8 +21,247 @@
 #include "tile.h"
 #include "map_region.h"
 
+#include <algorithm>
+#include <mutex>
+
 class BaseMap;
 
+// Fixed size object pool used for the map structure.
+// Objects are carved out of large slabs instead of being allocated one by one,
+// so loading a huge map doesn't do tens of millions of heap allocations.
+// Freed slots are recycled through an intrusive free list, and the slabs are
+// handed back to the system once every object in the pool has been freed.
+template<size_t ObjectSize, size_t SlabCount>
+class SlabPool
+{
+public:
+	SlabPool() : free_list(nullptr), aside(nullptr), live(0), compacting(false) {}
+	~SlabPool() { release(false); }
+
+	SlabPool(const SlabPool&) = delete;
+	SlabPool& operator=(const SlabPool&) = delete;
+
+	// While a scope is open on a thread, the objects that thread allocates and frees go
+	// through a cache of its own, filled and handed back many slots at a time. Copying
+	// or dropping an undo action of thousands of tiles and items then takes the lock a
+	// few times instead of once per object. Cached slots count as live until the
+	// outermost scope closes. There is one pool of each type, the cache is per type.
+	class Scope
+	{
+	public:
+		explicit Scope(SlabPool& pool) : pool(pool) { ++cache().depth; }
+		~Scope() {
+			if(--cache().depth == 0)
+				pool.flush();
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		SlabPool& pool;
+	};
+
+	void* allocate() {
+		Cache& local = cache();
+		if(local.depth > 0) {
+			if(!local.head)
+				refill(local);
+			Slot* slot = local.head;
+			local.head = slot->next;
+			if(!local.head)
+				local.tail = nullptr;
+			--local.count;
+			return slot;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!free_list)
+			grow();
+
+		Slot* slot = free_list;
+		free_list = slot->next;
+		++live;
+		return slot;
+	}
+
+	void deallocate(void* ptr) {
+		if(!ptr) return;
+
+		Slot* slot = static_cast<Slot*>(ptr);
+		Cache& local = cache();
+		if(local.depth > 0) {
+			slot->next = local.head;
+			local.head = slot;
+			if(!local.tail)
+				local.tail = slot;
+			++local.count;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(compacting) {
+			slot->next = aside;
+			aside = slot;
+			--live;
+			return;
+		}
+		slot->next = free_list;
+		free_list = slot;
+		if(--live == 0) {
+			// Keep one slab around, so temporary objects don't trash the heap
+			release(true);
+		}
+	}
+
+	// While compacting, freed slots are set aside instead of being handed out again, so the
+	// objects allocated meanwhile fill slabs of their own in the order they are made
+	void beginCompaction() {
+		std::lock_guard<std::mutex> lock(mutex);
+		aside = free_list;
+		free_list = nullptr;
+		compacting = true;
+	}
+
+	// Hands the slabs without a live object left back to the system, the free slots of the
+	// others are given out again lowest address first. Returns the bytes released.
+	size_t endCompaction() {
+		std::lock_guard<std::mutex> lock(mutex);
+		compacting = false;
+
+		std::vector<Slot*> free_slots;
+		for(Slot* slot = free_list; slot; slot = slot->next)
+			free_slots.push_back(slot);
+		for(Slot* slot = aside; slot; slot = slot->next)
+			free_slots.push_back(slot);
+		aside = nullptr;
+
+		const size_t reserved = slabs.size();
+		if(live == 0) {
+			release(true);
+			return (reserved - slabs.size()) * SlabCount * sizeof(Slot);
+		}
+
+		std::sort(free_slots.begin(), free_slots.end(), std::less<Slot*>());
+		std::sort(slabs.begin(), slabs.end(), std::less<Slot*>());
+
+		// The free slots of a slab are a run of the sorted list
+		std::vector<Slot*> kept;
+		kept.reserve(slabs.size());
+		std::vector<Slot*>::iterator slot = free_slots.begin();
+		std::vector<Slot*>::iterator kept_end = free_slots.begin();
+		for(Slot* slab : slabs) {
+			std::vector<Slot*>::iterator first = slot;
+			while(slot != free_slots.end() && std::less<Slot*>()(*slot, slab + SlabCount))
+				++slot;
+			if(size_t(slot - first) == SlabCount) {
+				::operator delete(slab);
+				continue;
+			}
+			kept.push_back(slab);
+			kept_end = std::copy(first, slot, kept_end);
+		}
+		slabs.swap(kept);
+
+		free_list = nullptr;
+		for(std::vector<Slot*>::iterator it = kept_end; it != free_slots.begin();) {
+			--it;
+			(*it)->next = free_list;
+			free_list = *it;
+		}
+		return (reserved - slabs.size()) * SlabCount * sizeof(Slot);
+	}
+
+	size_t liveCount() const noexcept { return live; }
+	size_t reservedBytes() const noexcept { return slabs.size() * SlabCount * sizeof(Slot); }
+
+private:
+	union Slot {
+		Slot* next;
+		alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) uint8_t storage[ObjectSize];
+	};
+
+	struct Cache {
+		Slot* head = nullptr;
+		Slot* tail = nullptr;
+		size_t count = 0;
+		int depth = 0;
+	};
+	static Cache& cache() {
+		static thread_local Cache local;
+		return local;
+	}
+
+	static constexpr size_t RefillCount = 256;
+
+	void refill(Cache& local) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for(size_t i = 0; i < RefillCount; ++i) {
+			if(!free_list)
+				grow();
+			Slot* slot = free_list;
+			free_list = slot->next;
+			slot->next = local.head;
+			local.head = slot;
+			if(!local.tail)
+				local.tail = slot;
+		}
+		local.count += RefillCount;
+		live += RefillCount;
+	}
+
+	void flush() {
+		Cache& local = cache();
+		if(!local.head)
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		live -= local.count;
+		if(compacting) {
+			local.tail->next = aside;
+			aside = local.head;
+			local = Cache();
+			return;
+		}
+		local.tail->next = free_list;
+		free_list = local.head;
+		local = Cache();
+		if(live == 0)
+			release(true);
+	}
+
+	void grow() {
+		Slot* slab = static_cast<Slot*>(::operator new(SlabCount * sizeof(Slot)));
+		slabs.push_back(slab);
+		link(slab);
+	}
+
+	void link(Slot* slab) {
+		for(size_t i = 0; i < SlabCount; ++i) {
+			slab[i].next = free_list;
+			free_list = &slab[i];
+		}
+	}
+
+	void release(bool keep_one) {
+		free_list = nullptr;
+		size_t keep = (keep_one && !slabs.empty()) ? 1 : 0;
+		for(size_t i = keep; i < slabs.size(); ++i)
+			::operator delete(slabs[i]);
+		slabs.resize(keep);
+		if(keep)
+			link(slabs.front());
+	}
+
+	std::mutex mutex;
+	std::vector<Slot*> slabs;
+	Slot* free_list;
+	// Slots freed while compacting
+	Slot* aside;
+	size_t live;
+	bool compacting;
+};
+
 class MapAllocator
 {
 
@@ -30,6 +269,46 @@ public:
 	MapAllocator() {}
 	~MapAllocator() {}
 
+#if RME_POOLED_MAP_ALLOCATOR > 0
+	typedef SlabPool<sizeof(Tile), 4096> TilePool;
+	typedef SlabPool<sizeof(Floor), 256> FloorPool;
+	typedef SlabPool<sizeof(QTreeNode), 1024> NodePool;
+	typedef SlabPool<sizeof(Item), 8192> ItemPool;
+
+	// The pools are shared by all maps, since tiles are freely moved between
+	// maps (copybuffer, undo actions etc.). Tile, Floor, QTreeNode and plain
+	// Item route their operator new/delete through these.
+	static TilePool& tilePool();
+	static FloorPool& floorPool();
+	static NodePool& nodePool();
+	static ItemPool& itemPool();
+
+	// Opened around work that copies or frees many tiles and items at once, see SlabPool::Scope
+	class Scope
+	{
+	public:
+		Scope() : tiles(tilePool()), items(itemPool()) {}
+
+	private:
+		TilePool::Scope tiles;
+		ItemPool::Scope items;
+	};
+
+	// Around BaseMap::compact, see SlabPool::beginCompaction
+	static void beginCompaction() {
+		tilePool().beginCompaction();
+		itemPool().beginCompaction();
+	}
+	static size_t endCompaction() {
+		return tilePool().endCompaction() + itemPool().endCompaction();
+	}
+#else
+	class Scope {};
+
+	static void beginCompaction() {}
+	static size_t endCompaction() { return 0; }
+#endif
+
 	// shorthands for tiles
 	Tile* operator()(TileLocation* location) {
 		return allocateTile(location);
@@ -43,7 +322,7 @@ public:
 	Tile* allocateTile(TileLocation* location) {
 		return newd Tile(*location);
 	}
-	void freeTile(Tile* t) {
+	static void freeTile(Tile* t) {
 		delete t;
 	}
 
@@ -51,7 +330,7 @@ public:
 	Floor* allocateFloor(int x, int y, int z) {
 		return newd Floor(x, y, z);
 	}
-	void freeFloor(Floor* f) {
+	static void freeFloor(Floor* f) {
 		delete f;
 	}
 
@@ -59,7 +338,7 @@ public:
 	QTreeNode* allocateNode(BaseMap& map) {
 		return newd QTreeNode(map);
 	}
-	void freeNode(QTreeNode* qt) {
+	static void freeNode(QTreeNode* qt) {
 		delete qt;
 	}
 };
@@ -0,0 +1,519 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <wx/dir.h>
+#include <wx/process.h>
+#include <wx/stopwatch.h>
+
+#include "map_autosave.h"
+#include "editor.h"
+#include "gui.h"
+#include "house.h"
+#include "iomap_otbm.h"
+#include "settings.h"
+
+namespace
+{
+	wxString getRecoveryRoot()
+	{
+		FileName root;
+		root.AssignDir(GUI::GetLocalDataDirectory());
+		root.AppendDir("recovery");
+		return root.GetPath();
+	}
+
+	wxString getFrameName(int frame)
+	{
+		return wxString::Format("frame-%d", frame);
+	}
+
+	// Leaves are written as their first tile divided by four, which fits in 16 bits per axis
+	uint32_t getLeafKey(int x, int y) noexcept
+	{
+		return (uint32_t(x >> 2) << 16) | uint32_t(y >> 2);
+	}
+
+	// The frames being written by every editor, they use the item types of the loaded version
+	std::mutex writes_mutex;
+	std::condition_variable writes_done;
+	int writes_in_flight = 0;
+
+	struct WriteInFlight
+	{
+		WriteInFlight() {
+			std::lock_guard<std::mutex> lock(writes_mutex);
+			++writes_in_flight;
+		}
+		~WriteInFlight() {
+			std::lock_guard<std::mutex> lock(writes_mutex);
+			if(--writes_in_flight == 0) {
+				writes_done.notify_all();
+			}
+		}
+	};
+}
+
+void MapAutosave::waitForWrites()
+{
+	std::unique_lock<std::mutex> lock(writes_mutex);
+	writes_done.wait(lock, []() { return writes_in_flight == 0; });
+}
+
+MapAutosave::MapAutosave(Editor& editor) :
+	editor(editor),
+	savedRevision(editor.getMap().getRevision()),
+	nextFrame(1),
+	writeFailed(false),
+	snapshotting(false),
+	consolidating(false),
+	snapshotRevision(0),
+	snapshotIndex(0)
+{
+	static int counter = 0;
+	directory = getRecoveryRoot() + wxFileName::GetPathSeparator() + wxString::Format("%lu-%d", wxGetProcessId(), ++counter);
+	restart();
+}
+
+MapAutosave::~MapAutosave()
+{
+	// Closing the editor is a clean exit, whatever wasn't saved was meant to be dropped
+	Stop();
+	if(pending) {
+		pending->written.wait();
+	}
+	if(wxDirExists(directory)) {
+		wxFileName::Rmdir(directory, wxPATH_RMDIR_RECURSIVE);
+	}
+}
+
+void MapAutosave::restart()
+{
+	// Checked again every minute while it is disabled, so turning it on takes effect
+	const int interval = g_settings.getInteger(Config::AUTOSAVE_INTERVAL);
+	StartOnce((interval > 0 ? interval : 1) * 60000);
+}
+
+void MapAutosave::reset()
+{
+	snapshotting = false;
+	snapshotLeaves.clear();
+	part.reset();
+	partLeaves.clear();
+	if(pending) {
+		pending->written.wait();
+		pending.reset();
+	}
+
+	frames.clear();
+	writeFailed = false;
+	savedRevision = editor.getMap().getRevision();
+	if(wxDirExists(directory)) {
+		wxFileName::Rmdir(directory, wxPATH_RMDIR_RECURSIVE);
+	}
+	restart();
+}
+
+void MapAutosave::Notify()
+{
+	if(pending) {
+		if(poll()) {
+			restart();
+		} else {
+			StartOnce(PollDelay);
+		}
+		return;
+	}
+
+	// Items are written through the data of their client version, which may
+	// not be the loaded one while another map is shown
+	if(editor.getMap().getVersion().client != g_gui.GetCurrentVersionID()) {
+		if(snapshotting)
+			StartOnce(SnapshotDelay);
+		else
+			restart();
+		return;
+	}
+
+	if(!snapshotting) {
+		const Map& map = editor.getMap();
+		if(g_settings.getInteger(Config::AUTOSAVE_INTERVAL) <= 0 || !map.hasChanged() || (map.getRevision() == savedRevision && !writeFailed)) {
+			restart();
+			return;
+		}
+		beginSnapshot();
+	}
+
+	if(continueSnapshot()) {
+		writeFrame();
+		StartOnce(PollDelay);
+	} else {
+		StartOnce(SnapshotDelay);
+	}
+}
+
+bool MapAutosave::poll()
+{
+	if(pending->written.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		return false;
+	}
+
+	std::unique_ptr<PendingFrame> frame = std::move(pending);
+	if(!frame->written.get()) {
+		removeFrame(frame->number);
+		writeFailed = true;
+		return true;
+	}
+
+	// The frames a consolidated one replaces are only deleted once the manifest doesn't name them
+	std::vector<int> replaced;
+	if(frame->consolidated) {
+		replaced.swap(frames);
+	}
+	frames.push_back(frame->number);
+	writeFailed = !writeManifest();
+	if(writeFailed) {
+		return true;
+	}
+
+	for(int number : replaced) {
+		removeFrame(number);
+	}
+	savedRevision = frame->revision;
+	return true;
+}
+
+void MapAutosave::beginSnapshot()
+{
+	Map& map = editor.getMap();
+	consolidating = writeFailed || frames.size() >= MaxFrames;
+	const uint32_t since = consolidating ? 0 : savedRevision;
+
+	snapshotRevision = map.getRevision();
+	snapshotLeaves.clear();
+	snapshotIndex = 0;
+
+	// Only the areas changed since the map was saved can hold changed leaves
+	auto collect = [this, since](QTreeNode* leaf, int x, int y) {
+		if(leaf->getRevision() > since) {
+			snapshotLeaves.emplace_back(x, y);
+		}
+	};
+	if(map.areAllAreasDirty()) {
+		map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, collect);
+	} else {
+		for(int y = 0; y < rme::MapMaxHeight; y += 0x100) {
+			for(int x = 0; x < rme::MapMaxWidth; x += 0x100) {
+				if(map.isAreaDirty(x, y) && !map.isAreaPagedOut(x, y)) {
+					map.visitLeaves(x, y, x + 0xFF, y + 0xFF, collect);
+				}
+			}
+		}
+	}
+
+	part.reset(newd Map());
+	part->convert(map.getVersion());
+	part->setWidth(map.getWidth());
+	part->setHeight(map.getHeight());
+	partLeaves.clear();
+	snapshotting = true;
+}
+
+bool MapAutosave::continueSnapshot()
+{
+	Map& map = editor.getMap();
+	wxStopWatch watch;
+	while(snapshotIndex < snapshotLeaves.size()) {
+		if(watch.Time() >= SnapshotBudget) {
+			return false;
+		}
+
+		// The leaves are looked up again, they may have gone since they were collected
+		const auto [x, y] = snapshotLeaves[snapshotIndex++];
+		partLeaves.push_back(getLeafKey(x, y));
+		QTreeNode* leaf = map.getLeaf(x, y);
+		if(!leaf) {
+			continue;
+		}
+
+		for(int z = rme::MapMinLayer; z <= rme::MapMaxLayer; ++z) {
+			Floor* floor = leaf->getFloor(z);
+			if(!floor) {
+				continue;
+			}
+			for(TileLocation& location : floor->locs) {
+				const Tile* tile = location.get();
+				if(!tile) {
+					continue;
+				}
+
+				const Position& position = tile->getPosition();
+				Tile* copy = tile->deepCopy(*part);
+				copy->setLocation(part->createTileL(position));
+				part->setTile(position, copy);
+				if(copy->spawn) {
+					part->addSpawn(copy);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void MapAutosave::writeFrame()
+{
+	snapshotting = false;
+	snapshotLeaves.clear();
+	wxFileName::Mkdir(directory, 0755, wxPATH_MKDIR_FULL);
+
+	const int number = nextFrame++;
+	const wxString name = getFrameName(number);
+	part->setSpawnFilename(nstr(name + "-spawn.xml"));
+	part->setHouseFilename(nstr(name + "-house.xml"));
+
+	const std::string map_path = nstr(directory + wxFileName::GetPathSeparator() + name + ".otbm");
+	const std::string leaves_path = nstr(directory + wxFileName::GetPathSeparator() + name + ".leaves");
+
+	pending.reset(newd PendingFrame());
+	pending->number = number;
+	pending->consolidated = consolidating;
+	pending->revision = snapshotRevision;
+	// A thread of its own, the write blocks on the disk and the pool is for computing
+	auto in_flight = std::make_shared<WriteInFlight>();
+	pending->written = std::async(std::launch::async, [part = std::move(part), leaves = std::move(partLeaves), map_path, leaves_path, in_flight]() mutable {
+		// Counted until the lambda returns, whichever way
+		const std::shared_ptr<WriteInFlight> writing = std::move(in_flight);
+		std::ofstream file(leaves_path, std::ios::binary | std::ios::trunc);
+		const uint32_t count = leaves.size();
+		file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		file.write(reinterpret_cast<const char*>(leaves.data()), leaves.size() * sizeof(uint32_t));
+		file.close();
+		if(!file) {
+			return false;
+		}
+
+		const FileName identifier(wxstr(map_path));
+		IOMapOTBM writer(part->getVersion());
+		if(!writer.beginStream(*part, identifier)) {
+			return false;
+		}
+		writer.streamPart(*part);
+		const bool written = writer.finishStream(*part, identifier);
+
+		// Freed here rather than on the UI thread
+		part.reset();
+		return written;
+	});
+	partLeaves.clear();
+}
+
+bool MapAutosave::writeManifest()
+{
+	const Map& map = editor.getMap();
+	const wxString path = directory + wxFileName::GetPathSeparator() + "manifest.txt";
+	const wxString temporary = path + ".tmp";
+	{
+		std::ofstream file(nstr(temporary), std::ios::trunc);
+		file << "map " << map.getFilename() << std::endl;
+		file << "size " << map.getWidth() << " " << map.getHeight() << std::endl;
+		for(int number : frames) {
+			file << "frame " << number << std::endl;
+		}
+		if(!file) {
+			return false;
+		}
+	}
+	return wxRenameFile(temporary, path, true);
+}
+
+void MapAutosave::removeFrame(int number)
+{
+	const wxString name = getFrameName(number);
+	wxArrayString files;
+	wxDir::GetAllFiles(directory, &files, name + ".*", wxDIR_FILES);
+	wxDir::GetAllFiles(directory, &files, name + "-*", wxDIR_FILES);
+	for(const wxString& file : files) {
+		wxRemoveFile(file);
+	}
+}
+
+bool MapAutosave::applyFrame(Map& map, const wxString& directory, int frame)
+{
+	const wxString name = getFrameName(frame);
+
+	std::vector<uint32_t> leaves;
+	{
+		std::ifstream file(nstr(directory + wxFileName::GetPathSeparator() + name + ".leaves"), std::ios::binary);
+		uint32_t count = 0;
+		file.read(reinterpret_cast<char*>(&count), sizeof(count));
+		leaves.resize(count);
+		file.read(reinterpret_cast<char*>(leaves.data()), leaves.size() * sizeof(uint32_t));
+		if(!file) {
+			return false;
+		}
+	}
+
+	// A frame holds its leaves whole, the tiles that were removed from them are simply missing
+	for(uint32_t key : leaves) {
+		const int leaf_x = (key >> 16) << 2;
+		const int leaf_y = (key & 0xFFFF) << 2;
+		for(int z = rme::MapMinLayer; z <= rme::MapMaxLayer; ++z) {
+			for(int y = leaf_y; y < leaf_y + 4; ++y) {
+				for(int x = leaf_x; x < leaf_x + 4; ++x) {
+					Tile* tile = map.getTile(x, y, z);
+					if(tile) {
+						map.removeSpawn(tile);
+						map.setTile(x, y, z, nullptr, true);
+					}
+				}
+			}
+		}
+	}
+
+	Map frame_map;
+	IOMapOTBM loader(frame_map.getVersion());
+	const FileName identifier(directory + wxFileName::GetPathSeparator() + name + ".otbm");
+	if(!loader.beginImport(frame_map, identifier)) {
+		return false;
+	}
+
+	const MapArea area;
+	PositionVector positions;
+	const bool loaded = loader.importTiles(area, [&](std::vector<IOMapOTBM::ImportedTile>& tiles) {
+		positions.clear();
+		for(const IOMapOTBM::ImportedTile& imported : tiles) {
+			positions.push_back(imported.position);
+		}
+
+		std::vector<TileLocation*> locations = map.createTileLocations(positions);
+		for(size_t index = 0; index < tiles.size(); ++index) {
+			Tile* tile = tiles[index].tile;
+			tile->setLocation(locations[index]);
+			if(tile->isHouseTile()) {
+				House* house = map.houses.getHouse(tile->getHouseID());
+				if(house) {
+					house->addTile(tile);
+				} else {
+					map.houses.setOrphanedTiles(true);
+				}
+			}
+			map.setTile(tiles[index].position, tile, true);
+		}
+	});
+	return loaded && loader.finishImport(map, Position(0, 0, 0), area);
+}
+
+bool MapAutosave::Recover()
+{
+	const wxString root = getRecoveryRoot();
+	if(!wxDirExists(root)) {
+		return false;
+	}
+
+	wxArrayString directories;
+	{
+		wxDir dir(root);
+		wxString name;
+		for(bool found = dir.GetFirst(&name, wxEmptyString, wxDIR_DIRS); found; found = dir.GetNext(&name)) {
+			directories.push_back(name);
+		}
+	}
+
+	bool recovered = false;
+	for(const wxString& name : directories) {
+		const wxString directory = root + wxFileName::GetPathSeparator() + name;
+
+		// The autosaves of editors that are still running aren't theirs to take
+		unsigned long pid = 0;
+		if(name.BeforeFirst('-').ToULong(&pid) && pid != wxGetProcessId() && wxProcess::Exists(pid)) {
+			continue;
+		}
+
+		std::string source;
+		int width = 0, height = 0;
+		std::vector<int> frames;
+		{
+			std::ifstream file(nstr(directory + wxFileName::GetPathSeparator() + "manifest.txt"));
+			std::string line;
+			while(std::getline(file, line)) {
+				std::istringstream stream(line);
+				std::string key;
+				stream >> key;
+				if(key == "map") {
+					source = line.size() > 4 ? line.substr(4) : std::string();
+				} else if(key == "size") {
+					stream >> width >> height;
+				} else if(key == "frame") {
+					int number = 0;
+					if(stream >> number) {
+						frames.push_back(number);
+					}
+				}
+			}
+		}
+
+		if(frames.empty()) {
+			wxFileName::Rmdir(directory, wxPATH_RMDIR_RECURSIVE);
+			continue;
+		}
+
+		const wxString map_name = source.empty() ? wxString("an unsaved map") : wxstr(source);
+		const long ret = g_gui.PopupDialog(
+			"Recover Map",
+			"The editor was closed while there were unsaved changes to " + map_name + ".\n\n"
+			"Do you want to recover them from the last autosave? (the map will be opened immediately)",
+			wxYES | wxNO);
+		if(ret != wxID_YES) {
+			wxFileName::Rmdir(directory, wxPATH_RMDIR_RECURSIVE);
+			continue;
+		}
+
+		// Kept for another try when the map can't be opened now
+		const bool opened = source.empty() ? g_gui.NewMap() : g_gui.LoadMap(FileName(wxstr(source)));
+		if(!opened) {
+			continue;
+		}
+
+		Editor* editor = g_gui.GetCurrentEditor();
+		Map& map = editor->getMap();
+		if(source.empty() && width > 0 && height > 0) {
+			map.setWidth(width);
+			map.setHeight(height);
+		}
+
+		g_gui.CreateLoadBar("Recovering map...");
+		bool applied = true;
+		for(size_t index = 0; index < frames.size() && applied; ++index) {
+			applied = applyFrame(map, directory, frames[index]);
+			g_gui.SetLoadDone(int((index + 1) * 100 / frames.size()));
+		}
+		g_gui.DestroyLoadBar();
+
+		if(!applied) {
+			g_gui.PopupDialog("Error", "Some of the autosaved changes could not be read, the map is missing them.", wxOK);
+		}
+		map.doChange();
+		g_gui.RefreshView();
+		wxFileName::Rmdir(directory, wxPATH_RMDIR_RECURSIVE);
+		recovered = true;
+	}
+	return recovered;
+}
@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_AUTOSAVE_H_
+#define RME_MAP_AUTOSAVE_H_
+
+#include <future>
+
+class Editor;
+class Map;
+
+// Writes the leaves of a map that changed since it was last saved to a recovery directory every
+// few minutes, so the work isn't lost if the editor goes down. Every autosave is a frame: a small
+// OTBM map holding copies of the leaves changed since the previous frame, and the list of those
+// leaves, some of which may be empty. The copies are made on the UI thread a few milliseconds at a
+// time, writing them happens on a thread of its own. Once MaxFrames are written the next frame takes
+// every leaf changed since the map was saved, and the older ones are deleted.
+//
+// A manifest names the map file the frames apply to. At startup Recover offers the recovery
+// directories of editors that didn't close cleanly, which loads the map and applies the frames
+// in order.
+class MapAutosave : public wxTimer
+{
+public:
+	explicit MapAutosave(Editor& editor);
+	~MapAutosave();
+
+	MapAutosave(const MapAutosave&) = delete;
+	MapAutosave& operator=(const MapAutosave&) = delete;
+
+	void Notify() override;
+
+	// The map was saved, the frames written so far aren't needed anymore
+	void reset();
+
+	// Blocks until no editor is writing a frame anymore, before the item types are swapped out
+	static void waitForWrites();
+
+	// Offers to recover the maps that had unsaved changes when the editor went down,
+	// true if any was opened
+	static bool Recover();
+
+private:
+	static constexpr int MaxFrames = 8;
+	static constexpr int SnapshotBudget = 8; // Milliseconds of copying per tick
+	static constexpr int SnapshotDelay = 50; // Between the ticks of a snapshot
+	static constexpr int PollDelay = 500; // While a frame is being written
+
+	struct PendingFrame
+	{
+		int number;
+		bool consolidated;
+		uint32_t revision;
+		std::future<bool> written;
+	};
+
+	void restart();
+	// Picks up the frame being written, false while it isn't done yet
+	bool poll();
+	void beginSnapshot();
+	// Copies leaves until the budget runs out, false if there are some left
+	bool continueSnapshot();
+	void writeFrame();
+	bool writeManifest();
+	void removeFrame(int number);
+
+	static bool applyFrame(Map& map, const wxString& directory, int frame);
+
+	Editor& editor;
+	wxString directory;
+
+	// Leaves whose revision is past this have been changed since the last frame
+	uint32_t savedRevision;
+	int nextFrame;
+	std::vector<int> frames;
+	// Makes the next frame a consolidated one, so nothing is missing after a failed write
+	bool writeFailed;
+
+	// The snapshot being made, the leaves left to copy are given by their first tile
+	bool snapshotting;
+	bool consolidating;
+	uint32_t snapshotRevision;
+	std::vector<std::pair<int, int>> snapshotLeaves;
+	size_t snapshotIndex;
+	std::unique_ptr<Map> part;
+	std::vector<uint32_t> partLeaves;
+
+	std::unique_ptr<PendingFrame> pending;
+};
+
+#endif
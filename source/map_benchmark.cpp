@@ -0,0 +1,286 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "map_benchmark.h"
+#include "action.h"
+#include "editor.h"
+#include "ground_brush.h"
+#include "iomap_otbm.h"
+#include "iominimap.h"
+#include "live_socket.h"
+
+#include <chrono>
+#include <random>
+
+namespace {
+	// Cases that aren't worth measuring on a whole large map take this many
+	constexpr size_t SampleSize = 100000;
+
+	// The node encoding of the live protocol without a connection
+	class BenchmarkSocket : public LiveSocket
+	{
+	public:
+		void receiveHeader() override { }
+		void receive(uint32_t) override { }
+		void send(NetworkMessage&) override { }
+		void updateCursor(const Position&) override { }
+
+		void encode(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy) {
+			writeNode(message, node, ndx, ndy, 0xFFFF);
+		}
+
+		void decode(NetworkMessage& message, Editor& editor, Action* action) {
+			message.read<uint8_t>();
+			const uint32_t position = message.read<uint32_t>();
+			receiveNode(message, editor, action, position >> 18, (position >> 4) & 0x3FFF, (position & 1) != 0);
+		}
+	};
+
+	uint64_t getFileSize(const wxFileName& file) {
+		return file.FileExists() ? file.GetSize().GetValue() : 0;
+	}
+}
+
+MapBenchmark::MapBenchmark(Editor& editor, const std::string& directory, int repeat) :
+	editor(editor),
+	directory(directory),
+	repeat(std::max(repeat, 1))
+{
+	////
+}
+
+template <typename Func>
+MapBenchmark::Result MapBenchmark::measure(const std::string& name, const std::string& unit, Func&& func)
+{
+	using Clock = std::chrono::steady_clock;
+
+	Result result { name, 0.0, 0.0, unit };
+	for(int run = 0; run < repeat; ++run) {
+		const Clock::time_point start = Clock::now();
+		const double amount = func();
+		const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		if(run == 0 || ms < result.ms) {
+			result.ms = ms;
+			result.rate = ms > 0.0 ? amount * 1000.0 / ms : 0.0;
+		}
+	}
+	return result;
+}
+
+bool MapBenchmark::run(const Report& report)
+{
+	if(!wxFileName::Mkdir(wxstr(directory), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+		return false;
+	}
+
+	bool ok = saveLoad(report);
+	lookups(report);
+	traversal(report);
+	borders(report);
+	actions(report);
+	liveNodes(report);
+	ok = minimap(report) && ok;
+
+	wxFileName::Rmdir(wxstr(directory), wxPATH_RMDIR_RECURSIVE);
+	return ok;
+}
+
+bool MapBenchmark::saveLoad(const Report& report)
+{
+	Map& map = editor.getMap();
+	const wxFileName file(wxstr(directory), "benchmark.otbm");
+
+	bool ok = true;
+	report(measure("save", "MB/s", [&]() {
+		IOMapOTBM io(map.getVersion());
+		ok = io.saveMap(map, file) && ok;
+		return getFileSize(file) / 1048576.0;
+	}));
+	if(!ok) {
+		return false;
+	}
+
+	report(measure("load", "MB/s", [&]() {
+		Map loaded;
+		IOMapOTBM io(map.getVersion());
+		ok = io.loadMap(loaded, file) && ok;
+		return getFileSize(file) / 1048576.0;
+	}));
+	return ok;
+}
+
+void MapBenchmark::lookups(const Report& report)
+{
+	Map& map = editor.getMap();
+	const int width = std::max(map.getWidth(), 1);
+	const int height = std::max(map.getHeight(), 1);
+
+	// Row by row over the ground floor, as far as it goes within the sample size
+	const size_t count = std::min<size_t>(size_t(width) * height, SampleSize * 100);
+	size_t found = 0;
+	report(measure("get_tile_sequential", "lookups/s", [&]() {
+		size_t index = 0;
+		for(int y = 0; y < height && index < count; ++y) {
+			for(int x = 0; x < width && index < count; ++x, ++index) {
+				found += map.getTile(x, y, rme::MapGroundLayer) != nullptr;
+			}
+		}
+		return double(count);
+	}));
+
+	report(measure("get_tile_random", "lookups/s", [&]() {
+		std::mt19937 random(0x524D45);
+		std::uniform_int_distribution<int> random_x(0, width - 1);
+		std::uniform_int_distribution<int> random_y(0, height - 1);
+		for(size_t index = 0; index < count; ++index) {
+			found += map.getTile(random_x(random), random_y(random), rme::MapGroundLayer) != nullptr;
+		}
+		return double(count);
+	}));
+
+	// Keeps the lookups from being optimized away
+	if(found == size_t(-1)) {
+		std::cerr << found << std::endl;
+	}
+}
+
+void MapBenchmark::traversal(const Report& report)
+{
+	Map& map = editor.getMap();
+	report(measure("map_iterator", "tiles/s", [&]() {
+		size_t count = 0;
+		for(MapIterator it = map.begin(); it != map.end(); ++it) {
+			count += (*it)->get() != nullptr;
+		}
+		return double(count);
+	}));
+}
+
+void MapBenchmark::borders(const Report& report)
+{
+	Map& map = editor.getMap();
+	std::vector<Tile*> tiles;
+	for(MapIterator it = map.begin(); it != map.end() && tiles.size() < SampleSize; ++it) {
+		Tile* tile = (*it)->get();
+		if(tile && tile->getGroundBrush()) {
+			tiles.push_back(tile);
+		}
+	}
+
+	// On copies, so the map is left as it was
+	report(measure("ground_borders", "tiles/s", [&]() {
+		for(Tile* tile : tiles) {
+			Tile* copy = tile->deepCopy(map);
+			GroundBrush::doBorders(&map, copy);
+			delete copy;
+		}
+		return double(tiles.size());
+	}));
+}
+
+void MapBenchmark::actions(const Report& report)
+{
+	Map& map = editor.getMap();
+	std::vector<Tile*> tiles;
+	for(MapIterator it = map.begin(); it != map.end() && tiles.size() < SampleSize; ++it) {
+		Tile* tile = (*it)->get();
+		if(tile) {
+			tiles.push_back(tile);
+		}
+	}
+
+	// Every change replaces a tile with a copy of itself and undo puts the original
+	// back, the copies are made outside of the timings
+	using Clock = std::chrono::steady_clock;
+	double commit_ms = 0.0, undo_ms = 0.0;
+	for(int run = 0; run < repeat; ++run) {
+		Action* action = editor.createAction(ACTION_DRAW);
+		for(const Tile* tile : tiles) {
+			action->addChange(newd Change(tile->deepCopy(map)));
+		}
+
+		Clock::time_point start = Clock::now();
+		action->commit(nullptr);
+		const double commit_run = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		start = Clock::now();
+		action->undo(nullptr);
+		const double undo_run = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		delete action;
+
+		commit_ms = (run == 0 ? commit_run : std::min(commit_ms, commit_run));
+		undo_ms = (run == 0 ? undo_run : std::min(undo_ms, undo_run));
+	}
+
+	report(Result { "action_commit", commit_ms, commit_ms > 0.0 ? tiles.size() * 1000.0 / commit_ms : 0.0, "changes/s" });
+	report(Result { "action_undo", undo_ms, undo_ms > 0.0 ? tiles.size() * 1000.0 / undo_ms : 0.0, "changes/s" });
+}
+
+void MapBenchmark::liveNodes(const Report& report)
+{
+	Map& map = editor.getMap();
+	std::vector<std::pair<QTreeNode*, Position>> leaves;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int x, int y) {
+		if(leaves.size() < SampleSize / 16) {
+			leaves.emplace_back(leaf, Position(x, y, 0));
+		}
+	});
+
+	BenchmarkSocket socket;
+	std::vector<NetworkMessage> messages(leaves.size());
+	std::vector<size_t> sizes(leaves.size());
+	report(measure("live_node_encode", "MB/s", [&]() {
+		size_t bytes = 0;
+		for(size_t index = 0; index < leaves.size(); ++index) {
+			NetworkMessage& message = messages[index];
+			message.clear();
+			socket.encode(message, leaves[index].first, leaves[index].second.x >> 2, leaves[index].second.y >> 2);
+			// After the size the socket puts in front
+			sizes[index] = message.position - 4;
+			bytes += sizes[index];
+		}
+		return bytes / 1048576.0;
+	}));
+
+	// Decoding makes the changes a peer would get, they are never committed
+	report(measure("live_node_decode", "MB/s", [&]() {
+		size_t bytes = 0;
+		Action* action = editor.createAction(ACTION_REMOTE);
+		for(size_t index = 0; index < messages.size(); ++index) {
+			NetworkMessage& message = messages[index];
+			message.position = 4;
+			socket.decode(message, editor, action);
+			bytes += sizes[index];
+		}
+		delete action;
+		return bytes / 1048576.0;
+	}));
+}
+
+bool MapBenchmark::minimap(const Report& report)
+{
+	Map& map = editor.getMap();
+	bool ok = true;
+	report(measure("minimap_otmm", "tiles/s", [&]() {
+		IOMinimap io(&editor, MinimapExportFormat::Otmm, MinimapExportMode::AllFloors, false);
+		ok = io.saveMinimap(directory, "benchmark") && ok;
+		return double(map.getTileCount());
+	}));
+	return ok;
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_BENCHMARK_H_
+#define RME_MAP_BENCHMARK_H_
+
+#include <functional>
+#include <string>
+
+class Editor;
+
+// Times the operations that decide how the editor scales on the map of an editor.
+// Every case runs a number of times and the fastest run is kept, random cases use a
+// fixed seed, so two builds measured on the same map can be compared.
+class MapBenchmark
+{
+public:
+	struct Result {
+		std::string name;
+		double ms; // The fastest run
+		double rate; // Units per second in that run
+		std::string unit;
+	};
+	using Report = std::function<void(const Result& result)>;
+
+	MapBenchmark(Editor& editor, const std::string& directory, int repeat);
+
+	// Reports every case once it is done, false if the files couldn't be written
+	bool run(const Report& report);
+
+private:
+	// Runs func repeat times, func returns the amount of units of its run
+	template <typename Func>
+	Result measure(const std::string& name, const std::string& unit, Func&& func);
+
+	bool saveLoad(const Report& report);
+	void lookups(const Report& report);
+	void traversal(const Report& report);
+	void borders(const Report& report);
+	void actions(const Report& report);
+	void liveNodes(const Report& report);
+	bool minimap(const Report& report);
+
+	Editor& editor;
+	// Scratch space for the files written, removed afterwards
+	std::string directory;
+	int repeat;
+};
+
+#endif
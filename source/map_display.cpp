@@ -17,22 +17,29 @@
 
 #include "main.h"
 
+#include <future>
 #include <sstream>
 #include <time.h>
+#include <wx/display.h>
 #include <wx/wfstream.h>
 
 #include "application.h"
 #include "browse_tile_window.h"
 #include "brush.h"
+#include "brush_footprint.h"
 #include "editor.h"
+#include "flood_fill.h"
 #include "gui.h"
 #include "live_server.h"
 #include "map.h"
 #include "map_display.h"
+#include "frame_profiler.h"
 #include "map_drawer.h"
 #include "old_properties_window.h"
 #include "palette_window.h"
+#include "png_writer.h"
 #include "properties_window.h"
+#include "session_recorder.h"
 #include "sprites.h"
 #include "tile.h"
 
@@ -104,7 +111,6 @@ EVT_MENU(MAP_POPUP_MENU_BROWSE_TILE, MapCanvas::OnBrowseTile)
 EVT_MENU(MAP_POPUP_MENU_HUNTING_CALCULATOR, MapCanvas::OnHuntingCalculator)
 END_EVENT_TABLE()
 
-bool MapCanvas::processed[] = {0};
 
 MapCanvas::MapCanvas(MapWindow *parent, Editor &editor, int *attriblist)
 	: wxGLCanvas(parent, wxID_ANY, nullptr, wxDefaultPosition, wxDefaultSize,
@@ -127,6 +133,7 @@ MapCanvas::MapCanvas(MapWindow *parent, Editor &editor, int *attriblist)
 	  last_mmb_click_x(-1), last_mmb_click_y(-1) {
 	popup_menu = newd MapPopupMenu(editor);
 	animation_timer = newd AnimationTimer(this);
+	frame_timer = newd FrameTimer(this);
 	// IMPORTANT: Create m_lasso BEFORE drawer, as drawer may access m_lasso
 	// during its operations
 	m_lasso = new LassoSelection();
@@ -138,18 +145,37 @@ MapCanvas::MapCanvas(MapWindow *parent, Editor &editor, int *attriblist)
 MapCanvas::~MapCanvas() {
 	delete popup_menu;
 	delete animation_timer;
+	delete frame_timer;
 	delete drawer;
 	delete m_lasso;
 	free(screenshot_buffer);
 }
 
 void MapCanvas::Refresh() {
-	if (refresh_watch.Time() >
-		g_settings.getInteger(Config::HARD_REFRESH_RATE)) {
-		refresh_watch.Start();
-		wxGLCanvas::Update();
+	if (frame_pending)
+		return;
+
+	// Too soon after the last frame, everything until the timer fires ends up
+	// in the same frame
+	const long elapsed = frame_watch.Time();
+	if (elapsed < frame_interval) {
+		frame_timer->StartOnce(int(frame_interval - elapsed));
+		return;
 	}
+
+	frame_pending = true;
 	wxGLCanvas::Refresh();
+	// Paint events wait for the input events, a flood of mouse moves would
+	// hold them back for good
+	if (elapsed > g_settings.getSnapshot()->hard_refresh_rate)
+		wxGLCanvas::Update();
+}
+
+void MapCanvas::OnFrameDue() {
+	if (!frame_pending) {
+		frame_pending = true;
+		wxGLCanvas::Refresh();
+	}
 }
 
 void MapCanvas::SetZoom(double value) {
@@ -183,52 +209,57 @@ void MapCanvas::GetViewBox(int *view_scroll_x, int *view_scroll_y,
 void MapCanvas::OnPaint(wxPaintEvent &event) {
 	SetCurrent(*g_gui.GetGLContext(this));
 
-	if (g_gui.IsRenderingEnabled()) {
+	const std::shared_ptr<const SettingsSnapshot> settings =
+		g_settings.getSnapshot();
+	g_profiler.setEnabled(settings->show_frame_profiler);
+	g_profiler.beginFrame();
+
+	frame_watch.Start();
+	frame_pending = false;
+	const int display = wxDisplay::GetFromWindow(this);
+	if (display != frame_display) {
+		frame_display = display;
+		const int refresh =
+			wxDisplay(display != wxNOT_FOUND ? display : 0).GetCurrentMode().refresh;
+		frame_interval = refresh > 0 ? std::max(1000 / refresh, 1) : 16;
+	}
+
+	bool more_sprites = false;
+	bool reduced = false;
+
+	// Maps of a version kept resident aren't drawn until it's loaded again
+	if (g_gui.IsRenderingEnabled() &&
+		editor.getMap().getVersion().client == g_gui.GetCurrentVersionID()) {
 		DrawingOptions &options = drawer->getOptions();
 		if (screenshot_buffer) {
 			options.SetIngame();
 		} else {
-			options.transparent_floors =
-				g_settings.getBoolean(Config::TRANSPARENT_FLOORS);
-			options.transparent_items =
-				g_settings.getBoolean(Config::TRANSPARENT_ITEMS);
-			options.show_ingame_box =
-				g_settings.getBoolean(Config::SHOW_INGAME_BOX);
-			options.show_lights = g_settings.getBoolean(Config::SHOW_LIGHTS);
-			options.show_grid = g_settings.getInteger(Config::SHOW_GRID);
-			options.ingame = !g_settings.getBoolean(Config::SHOW_EXTRA);
-			options.show_all_floors =
-				g_settings.getBoolean(Config::SHOW_ALL_FLOORS);
-			options.show_creatures =
-				g_settings.getBoolean(Config::SHOW_CREATURES);
-			options.show_spawns = g_settings.getBoolean(Config::SHOW_SPAWNS);
-			options.show_houses = g_settings.getBoolean(Config::SHOW_HOUSES);
-			options.show_shade = g_settings.getBoolean(Config::SHOW_SHADE);
-			options.show_special_tiles =
-				g_settings.getBoolean(Config::SHOW_SPECIAL_TILES);
-			options.show_zone_areas =
-				g_settings.getBoolean(Config::SHOW_ZONE_AREAS);
-			options.show_items = g_settings.getBoolean(Config::SHOW_ITEMS);
-			options.highlight_items =
-				g_settings.getBoolean(Config::HIGHLIGHT_ITEMS);
-			options.show_blocking =
-				g_settings.getBoolean(Config::SHOW_BLOCKING);
-			options.show_tooltips =
-				g_settings.getBoolean(Config::SHOW_TOOLTIPS);
-			options.show_as_minimap =
-				g_settings.getBoolean(Config::SHOW_AS_MINIMAP);
-			options.show_only_colors =
-				g_settings.getBoolean(Config::SHOW_ONLY_TILEFLAGS);
-			options.show_only_modified =
-				g_settings.getBoolean(Config::SHOW_ONLY_MODIFIED_TILES);
-			options.show_preview = g_settings.getBoolean(Config::SHOW_PREVIEW);
-			options.show_hooks = g_settings.getBoolean(Config::SHOW_WALL_HOOKS);
-			options.show_pickupables =
-				g_settings.getBoolean(Config::SHOW_PICKUPABLES);
-			options.show_moveables =
-				g_settings.getBoolean(Config::SHOW_MOVEABLES);
-			options.hide_items_when_zoomed =
-				g_settings.getBoolean(Config::HIDE_ITEMS_WHEN_ZOOMED);
+			options.transparent_floors = settings->transparent_floors;
+			options.transparent_items = settings->transparent_items;
+			options.show_ingame_box = settings->show_ingame_box;
+			options.show_lights = settings->show_lights;
+			options.show_grid = settings->show_grid;
+			options.ingame = !settings->show_extra;
+			options.show_all_floors = settings->show_all_floors;
+			options.show_creatures = settings->show_creatures;
+			options.show_spawns = settings->show_spawns;
+			options.show_houses = settings->show_houses;
+			options.show_shade = settings->show_shade;
+			options.show_special_tiles = settings->show_special_tiles;
+			options.show_zone_areas = settings->show_zone_areas;
+			options.show_items = settings->show_items;
+			options.highlight_items = settings->highlight_items;
+			options.show_blocking = settings->show_blocking;
+			options.show_tooltips = settings->show_tooltips;
+			options.show_as_minimap = settings->show_as_minimap;
+			options.show_only_colors = settings->show_only_tileflags;
+			options.show_only_modified = settings->show_only_modified_tiles;
+			options.show_preview = settings->show_preview;
+			options.show_hooks = settings->show_wall_hooks;
+			options.show_pickupables = settings->show_pickupables;
+			options.show_moveables = settings->show_moveables;
+			options.hide_items_when_zoomed = settings->hide_items_when_zoomed;
+			options.show_profiler = g_profiler.isEnabled();
 		}
 
 		options.dragging = boundbox_selection;
@@ -238,10 +269,47 @@ void MapCanvas::OnPaint(wxPaintEvent &event) {
 		else
 			animation_timer->Stop();
 
+		// Screenshots can't wait for sprites decoded in the background
+		g_gui.gfx.setDecodeAsync(!screenshot_buffer);
+		if (g_gui.gfx.uploadDecodedSprites())
+			more_sprites = true;
+
+		int scroll_x, scroll_y, width, height;
+		GetViewBox(&scroll_x, &scroll_y, &width, &height);
+		if (scroll_x != last_view_x || scroll_y != last_view_y ||
+			floor != last_view_floor || zoom != last_view_zoom) {
+			last_view_x = scroll_x;
+			last_view_y = scroll_y;
+			last_view_floor = floor;
+			last_view_zoom = zoom;
+			view_watch.Start();
+		}
+
+		reduced = !screenshot_buffer && view_watch.Time() < RefineDelay &&
+				  full_frame_ms > frame_interval;
+		if (reduced) {
+			options.show_lights = false;
+			options.show_tooltips = false;
+		}
+
+		if (g_session_recorder.isRecording(editor) && !screenshot_buffer) {
+			g_session_recorder.recordCamera(editor, scroll_x, scroll_y, width,
+											height, floor, zoom);
+		}
+
 		drawer->SetupVars();
 		drawer->SetupGL();
 		drawer->Draw();
 
+		// Drawing only, swapping the buffers waits for the display
+		if (reduced) {
+			frame_timer->StartOnce(RefineDelay);
+		} else {
+			const double ms = frame_watch.Time();
+			full_frame_ms =
+				full_frame_ms == 0.0 ? ms : full_frame_ms * 0.8 + ms * 0.2;
+		}
+
 		if (screenshot_buffer)
 			drawer->TakeScreenshot(screenshot_buffer);
 
@@ -249,13 +317,19 @@ void MapCanvas::OnPaint(wxPaintEvent &event) {
 	}
 
 	// Clean unused textures
-	g_gui.gfx.garbageCollection();
+	g_gui.gfx.garbageCollection(this);
+
+	g_profiler.endFrame();
 
 	// Swap buffer
 	SwapBuffers();
 
 	// Send newd node requests
 	editor.SendNodeRequests();
+
+	// The upload budget left some for later frames
+	if (more_sprites)
+		wxTheApp->CallAfter([]() { g_gui.RefreshView(); });
 }
 
 void MapCanvas::ShowPositionIndicator(const Position &position) {
@@ -267,6 +341,11 @@ void MapCanvas::ShowPositionIndicator(const Position &position) {
 	}
 }
 
+bool MapCanvas::IsAnimationDue() const {
+	return drawer && (drawer->GetPositionIndicatorTime() != 0 ||
+					  drawer->HasAnimationAdvanced());
+}
+
 void MapCanvas::TakeScreenshot(wxFileName path, wxString format) {
 	int screensize_x, screensize_y;
 	GetViewBox(&view_scroll_x, &view_scroll_y, &screensize_x, &screensize_y);
@@ -347,6 +426,105 @@ void MapCanvas::TakeScreenshot(wxFileName path, wxString format) {
 	screenshot_buffer = nullptr;
 }
 
+void MapCanvas::RenderSelection(wxFileName path) {
+	const Selection &selection = editor.getSelection();
+	if (selection.empty()) {
+		g_gui.SetStatusText("No tiles selected. Can't render.");
+		return;
+	}
+
+	const Position min_position = selection.minPosition();
+	const Position max_position = selection.maxPosition();
+	const int64_t image_width =
+		int64_t(max_position.x - min_position.x + 1) * rme::TileSize;
+	const int64_t image_height =
+		int64_t(max_position.y - min_position.y + 1) * rme::TileSize;
+
+	int view_x, view_y, view_width, view_height;
+	GetViewBox(&view_x, &view_y, &view_width, &view_height);
+	if (view_width <= 0 || view_height <= 0 || image_width > 0x7FFFFFFF ||
+		image_height > 0x7FFFFFFF)
+		return;
+
+	path.SetName(wxString::Format("render_%d-%d-%d", min_position.x,
+								  min_position.y, floor));
+	path.SetExt("png");
+	path.Mkdir(0755, wxPATH_MKDIR_FULL);
+
+	PngWriter writer(nstr(path.GetFullPath()));
+	if (!writer.begin(uint32_t(image_width), uint32_t(image_height))) {
+		g_gui.PopupDialog("File error",
+						  "Couldn't open file " + path.GetFullPath() +
+							  " for writing.",
+						  wxOK);
+		return;
+	}
+
+	// A strip of views is drawn while the one before it is compressed and
+	// written. That blocks on the disk, so it gets its own thread rather than
+	// tying up a pool worker.
+	const size_t stride = size_t(image_width) * 3;
+	std::vector<uint8_t> strips[2];
+	strips[0].resize(stride * view_height);
+	strips[1].resize(stride * view_height);
+	std::future<bool> encoded;
+
+	// Floors above the ground are drawn shifted by the floor adjustment
+	const int adjustment = floor <= rme::MapGroundLayer
+							   ? rme::TileSize * (rme::MapGroundLayer - floor)
+							   : 0;
+
+	SetCurrent(*g_gui.GetGLContext(this));
+	DrawingOptions &options = drawer->getOptions();
+	const DrawingOptions saved_options = options;
+	options.SetIngame();
+	g_gui.gfx.setDecodeAsync(false);
+
+	g_gui.CreateLoadBar("Rendering selection...");
+	bool ok = true;
+	int strip = 0;
+	for (int64_t y = 0; y < image_height && ok; y += view_height) {
+		const int rows = int(std::min<int64_t>(view_height, image_height - y));
+		uint8_t *pixels = strips[strip].data();
+		for (int64_t x = 0; x < image_width; x += view_width) {
+			const int columns =
+				int(std::min<int64_t>(view_width, image_width - x));
+			drawer->SetupView(
+				int(min_position.x * rme::TileSize + x) - adjustment,
+				int(min_position.y * rme::TileSize + y) - adjustment);
+			drawer->SetupGL();
+			drawer->Draw();
+			drawer->ReadPixels(pixels + x * 3, columns, rows, stride);
+			drawer->Release();
+		}
+
+		if (encoded.valid())
+			ok = encoded.get();
+		encoded = std::async(std::launch::async, [&writer, pixels, rows,
+												  stride]() {
+			return writer.addRows(pixels, rows, stride);
+		});
+		strip ^= 1;
+
+		if (!g_gui.SetLoadDone(int(100 * (y + rows) / image_height)))
+			ok = false;
+	}
+	if (encoded.valid() && !encoded.get())
+		ok = false;
+	g_gui.DestroyLoadBar();
+
+	options = saved_options;
+	g_gui.gfx.setDecodeAsync(true);
+	Refresh();
+
+	if (ok && writer.finish())
+		g_gui.SetStatusText("Rendered selection and saved as " +
+							path.GetFullName());
+	else
+		g_gui.PopupDialog("File error", "Couldn't render the selection.",
+						  wxOK);
+}
+
 void MapCanvas::ScreenToMap(int screen_x, int screen_y, int *map_x,
 							int *map_y) {
 	int start_x, start_y;
@@ -584,24 +762,8 @@ void MapCanvas::OnMouseMove(wxMouseEvent &event) {
 				}
 			} else { // No borders
 				PositionVector tilestodraw;
-
-				for (int y = -g_gui.GetBrushSize(); y <= g_gui.GetBrushSize();
-					 y++) {
-					for (int x = -g_gui.GetBrushSize();
-						 x <= g_gui.GetBrushSize(); x++) {
-						if (g_gui.GetBrushShape() == BRUSHSHAPE_SQUARE) {
-							tilestodraw.push_back(Position(
-								mouse_map_x + x, mouse_map_y + y, floor));
-						} else if (g_gui.GetBrushShape() == BRUSHSHAPE_CIRCLE) {
-							double distance =
-								sqrt(double(x * x) + double(y * y));
-							if (distance < g_gui.GetBrushSize() + 0.005) {
-								tilestodraw.push_back(Position(
-									mouse_map_x + x, mouse_map_y + y, floor));
-							}
-						}
-					}
-				}
+				getTilesToDraw(mouse_map_x, mouse_map_y, floor, &tilestodraw,
+							   nullptr);
 				if (event.ControlDown()) {
 					editor.undraw(tilestodraw, event.AltDown());
 				} else {
@@ -1063,20 +1225,13 @@ void MapCanvas::OnMouseActionRelease(wxMouseEvent &event) {
 				m_lasso->closePath();
 
 				if (m_lasso->isClosed()) {
-					// Get all tiles inside the lasso polygon
-					std::vector<Position> tilesInLasso =
-						m_lasso->getTilesInPolygon(floor);
+					// Get all leaves inside the lasso polygon
+					std::vector<LassoLeaf> leavesInLasso =
+						m_lasso->getLeavesInPolygon();
 
-					if (!tilesInLasso.empty()) {
+					if (!leavesInLasso.empty()) {
 						selection.start(); // Start a selection session
-
-						for (const Position &pos : tilesInLasso) {
-							Tile *tile = editor.getMap().getTile(pos);
-							if (tile) {
-								selection.add(tile);
-							}
-						}
-
+						selection.add(leavesInLasso, floor);
 						selection.finish(); // Finish the selection session
 						selection.updateSelectionCount();
 					}
@@ -1192,45 +1347,36 @@ void MapCanvas::OnMouseActionRelease(wxMouseEvent &event) {
 						// No point in threading for such a small set.
 						threadcount = 1;
 					}
-					// Subdivide the selection area
-					// We know it's a square, just split it into several areas
-					int width = end_x - start_x;
-					if (width < threadcount) {
-						threadcount = std::min(1, width);
-					}
-					// Let's divide!
-					int remainder = width;
-					int cleared = 0;
-					std::vector<SelectionThread *> threads;
-					if (width == 0) {
-						threads.push_back(newd SelectionThread(
-							editor, Position(start_x, start_y, start_z),
-							Position(start_x, end_y, end_z)));
-					} else {
-						for (int i = 0; i < threadcount; ++i) {
-							int chunksize = width / threadcount;
-							// The last threads takes all the remainder
-							if (i == threadcount - 1) {
-								chunksize = remainder;
-							}
-							threads.push_back(newd SelectionThread(
-								editor,
-								Position(start_x + cleared, start_y, start_z),
-								Position(start_x + cleared + chunksize, end_y,
-										 end_z)));
-							cleared += chunksize;
-							remainder -= chunksize;
-						}
+					// Subdivide the selection area into columns of whole leaves,
+					// so no two tasks walk the same leaf
+					int first_column = start_x >> 2;
+					int columns = (end_x >> 2) - first_column + 1;
+					threadcount = std::max(std::min(threadcount, columns), 1);
+
+					std::vector<SelectionTask *> tasks;
+					int column = first_column;
+					for (int i = 0; i < threadcount; ++i) {
+						// The first tasks take the remainder, one column each
+						int chunksize = columns / threadcount +
+										(i < columns % threadcount ? 1 : 0);
+						int chunk_start_x = std::max(start_x, column * 4);
+						int chunk_end_x =
+							std::min(end_x, (column + chunksize) * 4 - 1);
+						tasks.push_back(newd SelectionTask(
+							editor, Position(chunk_start_x, start_y, start_z),
+							Position(chunk_end_x, end_y, end_z)));
+						column += chunksize;
 					}
-					ASSERT(cleared == width);
-					ASSERT(remainder == 0);
+					ASSERT(column == first_column + columns);
 
 					selection.start(); // Start a selection session
-					for (SelectionThread *thread : threads) {
-						thread->Execute();
+					ThreadPool::TaskGroup group;
+					for (SelectionTask *task : tasks) {
+						task->Execute(group);
 					}
-					for (SelectionThread *thread : threads) {
-						selection.join(thread);
+					ThreadPool::getInstance().wait(group);
+					for (SelectionTask *task : tasks) {
+						selection.join(task);
 					}
 					selection.finish(); // Finish the selection session
 					selection.updateSelectionCount();
@@ -2833,94 +2979,69 @@ void MapCanvas::getTilesToDraw(int mouse_map_x, int mouse_map_y, int floor,
 			}
 		}
 
-		std::fill(std::begin(processed), std::end(processed), false);
-		floodFill(&editor.getMap(), position, BLOCK_SIZE / 2, BLOCK_SIZE / 2,
-				  oldBrush, tilestodraw);
+		floodFill(position, oldBrush, tilestodraw);
 
 	} else {
-		for (int y = -g_gui.GetBrushSize() - 1; y <= g_gui.GetBrushSize() + 1;
-			 y++) {
-			for (int x = -g_gui.GetBrushSize() - 1;
-				 x <= g_gui.GetBrushSize() + 1; x++) {
-				if (g_gui.GetBrushShape() == BRUSHSHAPE_SQUARE) {
-					if (x >= -g_gui.GetBrushSize() &&
-						x <= g_gui.GetBrushSize() &&
-						y >= -g_gui.GetBrushSize() &&
-						y <= g_gui.GetBrushSize()) {
-						if (tilestodraw)
-							tilestodraw->push_back(Position(
-								mouse_map_x + x, mouse_map_y + y, floor));
-					}
-					if (std::abs(x) - g_gui.GetBrushSize() < 2 &&
-						std::abs(y) - g_gui.GetBrushSize() < 2) {
-						if (tilestoborder)
-							tilestoborder->push_back(Position(
-								mouse_map_x + x, mouse_map_y + y, floor));
-					}
-				} else if (g_gui.GetBrushShape() == BRUSHSHAPE_CIRCLE) {
-					double distance = sqrt(double(x * x) + double(y * y));
-					if (distance < g_gui.GetBrushSize() + 0.005) {
-						if (tilestodraw)
-							tilestodraw->push_back(Position(
-								mouse_map_x + x, mouse_map_y + y, floor));
-					}
-					if (std::abs(distance - g_gui.GetBrushSize()) < 1.5) {
-						if (tilestoborder)
-							tilestoborder->push_back(Position(
-								mouse_map_x + x, mouse_map_y + y, floor));
-					}
-				}
+		const BrushFootprint &footprint =
+			BrushFootprint::get(g_gui.GetBrushShape(), g_gui.GetBrushSize());
+		const Position cursor(mouse_map_x, mouse_map_y, floor);
+		if (tilestodraw) {
+			tilestodraw->reserve(tilestodraw->size() +
+								 footprint.getTiles().size());
+			for (const Position &offset : footprint.getTiles()) {
+				tilestodraw->push_back(cursor + offset);
+			}
+		}
+		if (tilestoborder) {
+			tilestoborder->reserve(tilestoborder->size() +
+								   footprint.getBorder().size());
+			for (const Position &offset : footprint.getBorder()) {
+				tilestoborder->push_back(cursor + offset);
 			}
 		}
 	}
 }
 
-bool MapCanvas::floodFill(Map *map, const Position &center, int x, int y,
-						  GroundBrush *brush, PositionVector *positions) {
-	if (x < 0 || y < 0 || x > BLOCK_SIZE || y > BLOCK_SIZE) {
-		return false;
-	}
-
-	processed[getFillIndex(x, y)] = true;
-
-	int px = (center.x + x) - (BLOCK_SIZE / 2);
-	int py = (center.y + y) - (BLOCK_SIZE / 2);
-	if (px <= 0 || py <= 0 || px >= map->getWidth() || py >= map->getHeight()) {
-		return false;
-	}
-
-	Tile *tile = map->getTile(px, py, center.z);
-	if ((tile && tile->ground && !brush) || (!tile && brush)) {
-		return false;
-	}
-
-	if (tile && brush) {
-		GroundBrush *groundBrush = tile->getGroundBrush();
-		if (!groundBrush || groundBrush->getID() != brush->getID()) {
-			return false;
+void MapCanvas::floodFill(const Position &position, GroundBrush *brush,
+						  PositionVector *positions) {
+	Map &map = editor.getMap();
+	FloodFill fill(map, position.z, [brush](const Tile *tile) {
+		if (!brush) {
+			return !tile || !tile->ground;
 		}
+		GroundBrush *groundBrush = tile ? tile->getGroundBrush() : nullptr;
+		return groundBrush && groundBrush->getID() == brush->getID();
+	});
+
+	// The edges of the map are never filled
+	const int radius = std::max(g_settings.getInteger(Config::FILL_RADIUS), 1);
+	fill.setBounds(std::max(position.x - radius, 1),
+				   std::max(position.y - radius, 1),
+				   std::min(position.x + radius, map.getWidth() - 1),
+				   std::min(position.y + radius, map.getHeight() - 1));
+
+	// Filled on the pool, the load bar only shows up once it takes a while
+	ThreadPool &pool = ThreadPool::getInstance();
+	ThreadPool::TaskGroup group;
+	pool.submit(group, [&]() {
+		fill.run(position.x, position.y, *positions, &group);
+	});
+
+	bool loadBar = false;
+	pool.wait(group, [&]() {
+		if (!loadBar) {
+			g_gui.CreateLoadBar("Filling...", true);
+			loadBar = true;
+		}
+		return g_gui.SetLoadDone(std::min(group.getProgress(), 99));
+	});
+	if (loadBar) {
+		g_gui.DestroyLoadBar();
 	}
 
-	positions->push_back(Position(px, py, center.z));
-
-	bool deny = false;
-	if (!processed[getFillIndex(x - 1, y)]) {
-		deny = floodFill(map, center, x - 1, y, brush, positions);
-	}
-
-	if (!deny && !processed[getFillIndex(x, y - 1)]) {
-		deny = floodFill(map, center, x, y - 1, brush, positions);
-	}
-
-	if (!deny && !processed[getFillIndex(x + 1, y)]) {
-		deny = floodFill(map, center, x + 1, y, brush, positions);
-	}
-
-	if (!deny && !processed[getFillIndex(x, y + 1)]) {
-		deny = floodFill(map, center, x, y + 1, brush, positions);
+	if (group.isCancelled()) {
+		positions->clear();
 	}
-
-	return deny;
 }
 
 // ============================================================================
@@ -2932,7 +3053,8 @@ AnimationTimer::AnimationTimer(MapCanvas *canvas)
 	  };
 
 void AnimationTimer::Notify() {
-	if (map_canvas->GetZoom() <= 2.0)
+	// Nothing is drawn again until an animation in view changes its frame
+	if (map_canvas->GetZoom() <= 2.0 && map_canvas->IsAnimationDue())
 		map_canvas->Refresh();
 };
 
@@ -2949,3 +3071,9 @@ void AnimationTimer::Stop() {
 		wxTimer::Stop();
 	}
 };
+
+FrameTimer::FrameTimer(MapCanvas *canvas) : wxTimer(), map_canvas(canvas) {
+	////
+}
+
+void FrameTimer::Notify() { map_canvas->OnFrameDue(); }
@@ -28,6 +28,7 @@ class Creature;
 class MapWindow;
 class MapPopupMenu;
 class AnimationTimer;
+class FrameTimer;
 class MapDrawer;
 class HuntingCalculatorWindow;
 class LassoSelection;
@@ -95,7 +96,12 @@ class MapCanvas : public wxGLCanvas {
 	void OnProperties(wxCommandEvent &event);
 	void OnHuntingCalculator(wxCommandEvent &event);
 
+	// Invalidations between two frames are coalesced into one, drawn at most
+	// once per refresh of the display
 	void Refresh();
+	// The frame Refresh held back is due, or the view stopped moving and the
+	// last frame left something out
+	void OnFrameDue();
 
 	void ScreenToMap(int screen_x, int screen_y, int *map_x, int *map_y);
 	void MouseToMap(int *map_x, int *map_y) {
@@ -122,24 +128,23 @@ class MapCanvas : public wxGLCanvas {
 	Position GetCursorPosition() const;
 
 	void ShowPositionIndicator(const Position &position);
+	// Whether an animation in view, or the position indicator, changed since
+	// the last frame
+	bool IsAnimationDue() const;
 	void TakeScreenshot(wxFileName path, wxString format);
+	// Renders the bounds of the selection on the current floor at 1:1 into a
+	// PNG, one view at a time, so the image can be far larger than the screen
+	void RenderSelection(wxFileName path);
 
   protected:
 	void getTilesToDraw(int mouse_map_x, int mouse_map_y, int floor,
 						PositionVector *tilestodraw,
 						PositionVector *tilestoborder, bool fill = false);
-	bool floodFill(Map *map, const Position &center, int x, int y,
-				   GroundBrush *brush, PositionVector *positions);
+	// The ground of brush connected to position, within FILL_RADIUS of it
+	void floodFill(const Position &position, GroundBrush *brush,
+				   PositionVector *positions);
 
   private:
-	enum { BLOCK_SIZE = 64 };
-
-	inline int getFillIndex(int x, int y) const noexcept {
-		return ((y % BLOCK_SIZE) * BLOCK_SIZE) + (x % BLOCK_SIZE);
-	}
-
-	static bool processed[BLOCK_SIZE * BLOCK_SIZE];
-
 	Editor &editor;
 	MapDrawer *drawer =
 		nullptr; // Initialize to nullptr to prevent crash on first use
@@ -187,7 +192,24 @@ class MapCanvas : public wxGLCanvas {
 
 	uint32_t current_house_id = 0;
 
-	wxStopWatch refresh_watch;
+	// Frame pacing, frame_watch runs from the start of the last frame
+	FrameTimer *frame_timer = nullptr;
+	wxStopWatch frame_watch;
+	int frame_display = -2;
+	long frame_interval = 16;
+	bool frame_pending = false;
+
+	// While the view moves and the frames with everything in them take longer
+	// than the display interval, lights and tooltips are left out until it
+	// stops for RefineDelay ms. full_frame_ms is the running average of the
+	// full frames.
+	static constexpr int RefineDelay = 150;
+	double full_frame_ms = 0.0;
+	wxStopWatch view_watch;
+	int last_view_x = 0;
+	int last_view_y = 0;
+	int last_view_floor = -1;
+	double last_view_zoom = 0.0;
 	MapPopupMenu *popup_menu =
 		nullptr; // Initialize to nullptr to prevent crash on first use
 	AnimationTimer *animation_timer =
@@ -223,4 +245,14 @@ class AnimationTimer : public wxTimer {
 	bool started;
 };
 
+class FrameTimer : public wxTimer {
+  public:
+	FrameTimer(MapCanvas *canvas);
+
+	void Notify();
+
+  private:
+	MapCanvas *map_canvas;
+};
+
 #endif
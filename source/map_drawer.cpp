@@ -17,14 +17,10 @@
 
 #include "main.h"
 
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-#else
-#include <GL/glut.h>
-#endif
-
+#include "brush_footprint.h"
 #include "copybuffer.h"
 #include "editor.h"
+#include "frame_profiler.h"
 #include "graphics.h"
 #include "gui.h"
 #include "live_socket.h"
@@ -115,6 +111,7 @@ void DrawingOptions::SetDefault() {
 	show_pickupables = false;
 	show_moveables = false;
 	hide_items_when_zoomed = true;
+	show_profiler = false;
 }
 
 void DrawingOptions::SetIngame() {
@@ -146,6 +143,7 @@ void DrawingOptions::SetIngame() {
 	show_pickupables = false;
 	show_moveables = false;
 	hide_items_when_zoomed = false;
+	show_profiler = false;
 }
 
 bool DrawingOptions::isOnlyColors() const noexcept {
@@ -167,11 +165,21 @@ bool DrawingOptions::isDrawLight() const noexcept {
 }
 
 MapDrawer::MapDrawer(MapCanvas *canvas)
-	: canvas(canvas), editor(canvas->editor) {
+	: canvas(canvas), editor(canvas->editor), batching(false),
+	  prefetch_start_x(-1), prefetch_start_y(-1), prefetch_start_z(-1),
+	  prefetch_end_x(-1), prefetch_end_y(-1), node_cache_id(1), draw_count(0),
+	  nodes_drawn(0), node_caching(false), node_replayed(false),
+	  selection_deferred(false), selection_shading(false),
+	  overview(false), cover_x(0), cover_y(0), cover_width(0),
+	  cover_height(0), culling(false),
+	  glyph_atlas(g_gui.gfx.getGlyphAtlas()) {
 	light_drawer = std::make_shared<LightDrawer>();
 }
 
-MapDrawer::~MapDrawer() { Release(); }
+MapDrawer::~MapDrawer() {
+	Release();
+	ClearOverviewPages();
+}
 
 void MapDrawer::SetupVars() {
 	canvas->MouseToMap(&mouse_map_x, &mouse_map_y);
@@ -182,8 +190,35 @@ void MapDrawer::SetupVars() {
 	dragging_draw = canvas->dragging_draw;
 
 	zoom = static_cast<float>(canvas->GetZoom());
-	tile_size = int(rme::TileSize / zoom); // after zoom
 	floor = canvas->GetFloor();
+	SetupRange();
+
+	// Live clients only know the leaves they asked for, which drawing requests
+	const int overview_zoom = g_settings.getSnapshot()->overview_zoom;
+	overview =
+		overview_zoom > 0 && zoom >= overview_zoom && !editor.IsLiveClient();
+}
+
+void MapDrawer::SetupView(int scroll_x, int scroll_y) {
+	SetupVars();
+	view_scroll_x = scroll_x;
+	view_scroll_y = scroll_y;
+	dragging = false;
+	dragging_draw = false;
+	zoom = 1.f;
+	overview = false;
+	SetupRange();
+
+	// Floors above the ground are drawn shifted up and left, the tiles
+	// shifted into the view have to be drawn as well
+	if (floor <= rme::MapGroundLayer) {
+		end_x += rme::MapGroundLayer - floor;
+		end_y += rme::MapGroundLayer - floor;
+	}
+}
+
+void MapDrawer::SetupRange() {
+	tile_size = int(rme::TileSize / zoom); // after zoom
 
 	if (options.show_all_floors) {
 		if (floor < 8)
@@ -210,6 +245,7 @@ void MapDrawer::SetupVars() {
 
 void MapDrawer::SetupGL() {
 	glViewport(0, 0, screensize_x, screensize_y);
+	sprite_batch.setRenderer(g_gui.gfx.getShaderRenderer());
 
 	// Enable 2D mode
 	int vPort[4];
@@ -245,10 +281,17 @@ void MapDrawer::Release() {
 }
 
 void MapDrawer::Draw() {
+	g_gui.gfx.updateElapsedTime();
+	drawn_animations.clear();
 	DrawBackground();
-	DrawMap();
-	DrawDraggingShadow();
-	DrawHigherFloors();
+	if (overview) {
+		DrawOverview();
+	} else {
+		PrefetchSprites();
+		DrawMap();
+		DrawDraggingShadow();
+		DrawHigherFloors();
+	}
 	if (options.dragging)
 		DrawSelectionBox();
 	DrawLassoSelection();
@@ -258,8 +301,37 @@ void MapDrawer::Draw() {
 		DrawGrid();
 	if (options.show_ingame_box)
 		DrawIngameBox();
-	if (options.isTooltips())
+	if (options.isTooltips()) {
+		ProfileScope scope(FrameProfiler::SECTION_TOOLTIPS);
 		DrawTooltips();
+	}
+	if (options.show_profiler)
+		DrawProfiler();
+}
+
+void MapDrawer::DrawProfiler() {
+	const std::vector<std::string> lines = g_profiler.getSummary();
+	if (!glyph_atlas.load())
+		return;
+
+	int width = 0;
+	for (const std::string &line : lines)
+		width = std::max(width, glyph_atlas.getWidth(line));
+
+	// The view is scaled by the zoom, the text isn't
+	const float x = 8.0f * zoom;
+	const float y = 8.0f * zoom;
+	const float box_width = (width + 12.0f) * zoom;
+	const float box_height = (lines.size() * 14.0f + 8.0f) * zoom;
+
+	sprite_batch.add(0, x, y, box_width, box_height, 0, 0, 0, 160);
+	float line_y = y + 16.0f * zoom;
+	for (const std::string &line : lines) {
+		glyph_atlas.add(sprite_batch, x + 6.0f * zoom, line_y, line, zoom, 255,
+						255, 255, 255);
+		line_y += 14.0f * zoom;
+	}
+	FlushBatch();
 }
 
 void MapDrawer::DrawBackground() {
@@ -304,7 +376,69 @@ void MapDrawer::DrawShade(int map_z) {
 	}
 }
 
+void MapDrawer::PrefetchSprites() {
+	if (g_settings.getSnapshot()->use_memcached_sprites)
+		return;
+
+	if (start_x == prefetch_start_x && start_y == prefetch_start_y &&
+		start_z == prefetch_start_z && end_x == prefetch_end_x &&
+		end_y == prefetch_end_y)
+		return;
+
+	prefetch_start_x = start_x;
+	prefetch_start_y = start_y;
+	prefetch_start_z = start_z;
+	prefetch_end_x = end_x;
+	prefetch_end_y = end_y;
+
+	// Read everything the view needs in one go, instead of sprite by sprite
+	// while drawing
+	prefetch_sprites.clear();
+	for (int map_z = start_z; map_z >= end_z; map_z--) {
+		for (int nd_map_x = start_x & ~3; nd_map_x <= (end_x & ~3) + 4;
+			 nd_map_x += 4) {
+			for (int nd_map_y = start_y & ~3; nd_map_y <= (end_y & ~3) + 4;
+				 nd_map_y += 4) {
+				QTreeNode *nd = editor.getMap().getLeaf(nd_map_x, nd_map_y);
+				if (!nd)
+					continue;
+
+				for (int map_x = 0; map_x < 4; ++map_x) {
+					for (int map_y = 0; map_y < 4; ++map_y) {
+						TileLocation *location =
+							nd->getTile(map_x, map_y, map_z);
+						const Tile *tile = location ? location->get() : nullptr;
+						if (!tile)
+							continue;
+
+						if (tile->ground) {
+							GameSprite *sprite =
+								g_items.getHotData(tile->ground->getID())
+									.sprite;
+							if (sprite)
+								prefetch_sprites.push_back(sprite);
+						}
+						for (const Item *item : tile->items) {
+							GameSprite *sprite =
+								g_items.getHotData(item->getID()).sprite;
+							if (sprite)
+								prefetch_sprites.push_back(sprite);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::sort(prefetch_sprites.begin(), prefetch_sprites.end());
+	prefetch_sprites.erase(
+		std::unique(prefetch_sprites.begin(), prefetch_sprites.end()),
+		prefetch_sprites.end());
+	g_gui.gfx.prefetchSprites(prefetch_sprites);
+}
+
 void MapDrawer::DrawMap() {
+	ProfileScope scope(FrameProfiler::SECTION_DRAW_MAP);
 	int center_x = start_x + int(screensize_x * zoom / 64);
 	int center_y = start_y + int(screensize_y * zoom / 64);
 	int offset_y = 2;
@@ -314,6 +448,9 @@ void MapDrawer::DrawMap() {
 	int box_end_map_y = center_y + rme::ClientMapHeight + offset_y;
 
 	bool live_client = editor.IsLiveClient();
+	if (live_client) {
+		editor.SetNodeViewport(start_x, start_y, end_x, end_y, floor);
+	}
 
 	Brush *brush = g_gui.GetCurrentBrush();
 
@@ -329,6 +466,9 @@ void MapDrawer::DrawMap() {
 	bool only_colors = options.isOnlyColors();
 	bool tile_indicators = options.isTileIndicators();
 
+	BeginNodeCache();
+	BuildCover();
+
 	for (int map_z = start_z; map_z >= superend_z; map_z--) {
 		if (options.show_shade) {
 			DrawShade(map_z);
@@ -338,12 +478,13 @@ void MapDrawer::DrawMap() {
 			if (!only_colors)
 				glEnable(GL_TEXTURE_2D);
 
+			BeginBatch();
+
 			int nd_start_x = start_x & ~3;
 			int nd_start_y = start_y & ~3;
 			int nd_end_x = (end_x & ~3) + 4;
 			int nd_end_y = (end_y & ~3) + 4;
 
-			zoneTiles.clear();
 			for (int nd_map_x = nd_start_x; nd_map_x <= nd_end_x;
 				 nd_map_x += 4) {
 				for (int nd_map_y = nd_start_y; nd_map_y <= nd_end_y;
@@ -358,13 +499,19 @@ void MapDrawer::DrawMap() {
 
 					if (!live_client ||
 						nd->isVisible(map_z > rme::MapGroundLayer)) {
-						for (int map_x = 0; map_x < 4; ++map_x) {
-							for (int map_y = 0; map_y < 4; ++map_y) {
-								TileLocation *location =
-									nd->getTile(map_x, map_y, map_z);
-								DrawTile(location);
-								if (location && options.isDrawLight()) {
-									auto &position = location->getPosition();
+						if (!culling ||
+							!IsCovered(nd_map_x, nd_map_y, map_z)) {
+							DrawNode(nd, nd_map_x, nd_map_y, map_z);
+							ShadeNode(nd, nd_map_x, nd_map_y, map_z);
+						}
+						if (options.isDrawLight()) {
+							for (int map_x = 0; map_x < 4; ++map_x) {
+								for (int map_y = 0; map_y < 4; ++map_y) {
+									TileLocation *location =
+										nd->getTile(map_x, map_y, map_z);
+									if (!location)
+										continue;
+									const Position position = location->getPosition();
 									if (position.x >= box_start_map_x &&
 										position.x <= box_end_map_x &&
 										position.y >= box_start_map_y &&
@@ -394,55 +541,31 @@ void MapDrawer::DrawMap() {
 						int cx = (nd_map_x)*rme::TileSize - view_scroll_x -
 								 getFloorAdjustment(floor);
 
-						glColor4ub(255, 0, 255, 128);
-						glBegin(GL_QUADS);
-						glVertex2f(cx, cy + rme::TileSize * 4);
-						glVertex2f(cx + rme::TileSize * 4,
-								   cy + rme::TileSize * 4);
-						glVertex2f(cx + rme::TileSize * 4, cy);
-						glVertex2f(cx, cy);
-						glEnd();
+						sprite_batch.add(0, cx, cy, rme::TileSize * 4,
+										 rme::TileSize * 4, 255, 0, 255, 128);
 					}
 				}
 			}
 
-			for (auto &itZonePos : zoneTiles) {
-				ZoneFinder finder(itZonePos.second);
-				auto zones = finder.findZones();
-
-				for (const auto &itZone : zones) {
-					const FinderPosition center =
-						finder.findClosestToCenter(itZone);
-
-					QTreeNode *nd = editor.getMap().getLeaf(center.x, center.y);
-					TileLocation *location =
-						nd->getTile(center.x, center.y, center.z);
-
-					const Tile *tile = location->get();
+			// Everything of this floor in as few calls as possible
+			FlushBatch();
 
-					std::ostringstream tooltip;
-					tooltip << "zone id: ";
-					size_t zones = tile->getZoneIds().size();
-					for (const auto &zoneId : tile->getZoneIds()) {
-						tooltip << zoneId;
-						if (--zones > 0)
-							tooltip << "/";
-					}
-
-					int offset;
-					if (map_z <= rme::MapGroundLayer) {
-						offset = (rme::MapGroundLayer - map_z) * rme::TileSize;
-					} else {
-						offset = rme::TileSize * (floor - map_z);
-					}
+			if (options.isTooltips() && map_z == floor) {
+				int offset;
+				if (map_z <= rme::MapGroundLayer) {
+					offset = (rme::MapGroundLayer - map_z) * rme::TileSize;
+				} else {
+					offset = rme::TileSize * (floor - map_z);
+				}
 
+				for (const ZoneLabel &label :
+					 GetZoneLabels(nd_start_x, nd_start_y, nd_end_x + 3,
+								   nd_end_y + 3, map_z)) {
 					int draw_x =
-						((tile->getX() * rme::TileSize) - view_scroll_x) -
-						offset;
+						((label.x * rme::TileSize) - view_scroll_x) - offset;
 					int draw_y =
-						((tile->getY() * rme::TileSize) - view_scroll_y) -
-						offset;
-					MakeTooltip(draw_x, draw_y + 8, tooltip.str());
+						((label.y * rme::TileSize) - view_scroll_y) - offset;
+					MakeTooltip(draw_x, draw_y + 8, label.text);
 				}
 			}
 
@@ -461,10 +584,405 @@ void MapDrawer::DrawMap() {
 		++end_y;
 	}
 
+	EndNodeCache();
+
 	if (!only_colors)
 		glEnable(GL_TEXTURE_2D);
 }
 
+uint16_t MapDrawer::GetOpaqueMask(QTreeNode *node, int map_x, int map_y,
+								  int map_z) {
+	const uint64_t key = (uint64_t(uint32_t(map_x)) << 32) |
+						 (uint64_t(uint32_t(map_y)) << 8) | uint64_t(map_z);
+	OpaqueCache &cache = opaque_cache[key];
+	const uint32_t tiles_revision = editor.getMap().getTilesRevision();
+	if (cache.revision == node->getRevision() &&
+		cache.tiles_revision == tiles_revision)
+		return cache.mask;
+
+	uint16_t mask = 0;
+	if (Floor *map_floor = node->getFloor(map_z)) {
+		for (int index = 0; index < 16; ++index) {
+			const Tile *tile = map_floor->locs[index].get();
+			if (tile && tile->ground &&
+				g_items.getHotData(tile->ground->getID())
+					.has(ITEM_HOT_FULL_GROUND))
+				mask |= 1 << index;
+		}
+	}
+
+	cache.revision = node->getRevision();
+	cache.tiles_revision = tiles_revision;
+	cache.mask = mask;
+	return mask;
+}
+
+void MapDrawer::BuildCover() {
+	// Colours are drawn as squares that may be see-through, and tiles that
+	// aren't drawn don't hide anything
+	culling = start_z != end_z && !options.isOnlyColors() &&
+			  !options.show_only_modified;
+	if (!culling)
+		return;
+
+	if (opaque_cache.size() > node_cache.size() * 2 + 4096)
+		opaque_cache.clear();
+
+	// Every floor below the top one is drawn with one more tile around it, and
+	// shifted by at most a square per floor
+	const int reach = start_z - end_z + rme::MapGroundLayer + 4;
+	cover_x = (start_x & ~3) - reach;
+	cover_y = (start_y & ~3) - reach;
+	cover_width = (end_x & ~3) + 4 + reach - cover_x + 1;
+	cover_height = (end_y & ~3) + 4 + reach - cover_y + 1;
+	cover.assign(size_t(cover_width) * cover_height, 0xFF);
+
+	// Going down from the top floor, the first opaque ground of a square wins
+	for (int map_z = end_z; map_z < start_z; ++map_z) {
+		const int grow = start_z - map_z;
+		const int offset = GetSquareOffset(map_z);
+		for (int nd_map_x = (start_x - grow) & ~3;
+			 nd_map_x <= ((end_x + grow) & ~3) + 4; nd_map_x += 4) {
+			for (int nd_map_y = (start_y - grow) & ~3;
+				 nd_map_y <= ((end_y + grow) & ~3) + 4; nd_map_y += 4) {
+				QTreeNode *nd = editor.getMap().getLeaf(nd_map_x, nd_map_y);
+				if (!nd)
+					continue;
+
+				const uint16_t mask =
+					GetOpaqueMask(nd, nd_map_x, nd_map_y, map_z);
+				for (int index = 0; mask != 0 && index < 16; ++index) {
+					if (!(mask & (1 << index)))
+						continue;
+
+					const int x = nd_map_x + (index >> 2) - offset - cover_x;
+					const int y = nd_map_y + (index & 3) - offset - cover_y;
+					if (x < 0 || y < 0 || x >= cover_width || y >= cover_height)
+						continue;
+
+					uint8_t &square = cover[size_t(y) * cover_width + x];
+					if (square == 0xFF)
+						square = uint8_t(map_z);
+				}
+			}
+		}
+	}
+}
+
+bool MapDrawer::IsCovered(int map_x, int map_y, int map_z) const {
+	const int offset = GetSquareOffset(map_z);
+	const int left = map_x - offset - 1 - cover_x;
+	const int top = map_y - offset - 1 - cover_y;
+	if (left < 0 || top < 0 || left + 5 > cover_width ||
+		top + 5 > cover_height)
+		return false;
+
+	for (int y = top; y < top + 5; ++y) {
+		const uint8_t *row = &cover[size_t(y) * cover_width];
+		for (int x = left; x < left + 5; ++x) {
+			if (row[x] >= map_z)
+				return false;
+		}
+	}
+	return true;
+}
+
+void MapDrawer::DrawOverview() {
+	++draw_count;
+
+	const int adjustment = getFloorAdjustment(floor);
+	const int page_start_x = std::max(start_x, 0) / OverviewPageSize;
+	const int page_start_y = std::max(start_y, 0) / OverviewPageSize;
+	const int page_end_x =
+		std::min(end_x, rme::MapMaxWidth) / OverviewPageSize;
+	const int page_end_y =
+		std::min(end_y, rme::MapMaxHeight) / OverviewPageSize;
+	const float size = float(OverviewPageSize * rme::TileSize);
+
+	glEnable(GL_TEXTURE_2D);
+	glColor4ub(255, 255, 255, 255);
+	size_t pages_drawn = 0;
+	for (int page_x = page_start_x; page_x <= page_end_x; ++page_x) {
+		for (int page_y = page_start_y; page_y <= page_end_y; ++page_y) {
+			const int map_x = page_x * OverviewPageSize;
+			const int map_y = page_y * OverviewPageSize;
+			const GLuint texture = GetOverviewPage(map_x, map_y, floor);
+			if (texture == 0)
+				continue;
+
+			++pages_drawn;
+			const float x =
+				float(map_x * rme::TileSize - view_scroll_x - adjustment);
+			const float y =
+				float(map_y * rme::TileSize - view_scroll_y - adjustment);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glBegin(GL_QUADS);
+			glTexCoord2f(0.f, 0.f);
+			glVertex2f(x, y);
+			glTexCoord2f(1.f, 0.f);
+			glVertex2f(x + size, y);
+			glTexCoord2f(1.f, 1.f);
+			glVertex2f(x + size, y + size);
+			glTexCoord2f(0.f, 1.f);
+			glVertex2f(x, y + size);
+			glEnd();
+		}
+	}
+
+	// Forget the pages that are no longer in view
+	if (overview_pages.size() > pages_drawn * 2 + 64) {
+		for (auto it = overview_pages.begin(); it != overview_pages.end();) {
+			if (it->second.used != draw_count) {
+				glDeleteTextures(1, &it->second.texture);
+				it = overview_pages.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	glDisable(GL_TEXTURE_2D);
+	DrawPositionIndicator(floor);
+	glEnable(GL_TEXTURE_2D);
+}
+
+GLuint MapDrawer::GetOverviewPage(int map_x, int map_y, int map_z) {
+	const uint32_t key = (uint32_t(map_x / OverviewPageSize) << 12) |
+						 (uint32_t(map_y / OverviewPageSize) << 4) |
+						 uint32_t(map_z);
+	OverviewPage &page = overview_pages[key];
+	page.used = draw_count;
+
+	const bool created = page.texture == 0;
+	if (created) {
+		glGenTextures(1, &page.texture);
+		if (page.texture == 0)
+			return 0;
+
+		glBindTexture(GL_TEXTURE_2D, page.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		// GL_CLAMP_TO_EDGE
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, OverviewPageSize,
+					 OverviewPageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	static const std::array<uint32_t, 256> palette = [] {
+		std::array<uint32_t, 256> colors;
+		colors[0] = 0; // Nothing there, the background shows through
+		for (int i = 1; i < 256; ++i) {
+			wxColor color = colorFromEightBit(i);
+			const uint8_t rgba[4] = {color.Red(), color.Green(), color.Blue(),
+									 255};
+			memcpy(&colors[i], rgba, sizeof(rgba));
+		}
+		return colors;
+	}();
+
+	// Only the blocks whose colours changed since are uploaded again
+	MinimapCache &cache = editor.getMinimapCache();
+	const int block_size = MinimapCache::BlockSize;
+	uint32_t pixels[block_size * block_size];
+	for (int block = 0; block < OverviewPageBlocks * OverviewPageBlocks;
+		 ++block) {
+		const int x = (block % OverviewPageBlocks) * block_size;
+		const int y = (block / OverviewPageBlocks) * block_size;
+		uint32_t version;
+		const uint8_t *colors =
+			cache.getBlock(map_x + x, map_y + y, map_z, 0, &version);
+		if (!created && page.versions[block] == version)
+			continue;
+
+		page.versions[block] = version;
+		for (int i = 0; i < block_size * block_size; ++i)
+			pixels[i] = palette[colors[i]];
+
+		glBindTexture(GL_TEXTURE_2D, page.texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, block_size, block_size,
+						GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	}
+	return page.texture;
+}
+
+void MapDrawer::ClearOverviewPages() {
+	for (auto &entry : overview_pages) {
+		if (entry.second.texture != 0)
+			glDeleteTextures(1, &entry.second.texture);
+	}
+	overview_pages.clear();
+}
+
+void MapDrawer::BeginNodeCache() {
+	// Tooltips and zones are gathered while the tiles are drawn, they can't be
+	// replayed
+	node_caching = !options.isTooltips();
+	node_replayed = false;
+	nodes_drawn = 0;
+	++draw_count;
+
+	NodeCacheState state;
+	state.options = options;
+	state.zoom = zoom;
+	state.floor = floor;
+	state.house_id = current_house_id;
+	state.tiles_revision = editor.getMap().getTilesRevision();
+	state.texture_revision = g_gui.gfx.getTextureRevision();
+	if (!(state == node_cache_state)) {
+		node_cache_state = state;
+		++node_cache_id;
+	}
+}
+
+void MapDrawer::EndNodeCache() {
+	// A texture that was replayed may have been handed to another sprite while
+	// drawing, draw once more with what the sprites look like now
+	if (node_replayed &&
+		g_gui.gfx.getTextureRevision() != node_cache_state.texture_revision)
+		canvas->Refresh();
+
+	// Forget the leaves that are no longer in view
+	if (node_cache.size() > nodes_drawn * 2 + 1024) {
+		for (auto it = node_cache.begin(); it != node_cache.end();) {
+			if (it->second.used != draw_count)
+				it = node_cache.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+void MapDrawer::DrawNode(QTreeNode *node, int map_x, int map_y, int map_z) {
+	if (!node_caching) {
+		for (int x = 0; x < 4; ++x) {
+			for (int y = 0; y < 4; ++y)
+				DrawTile(node->getTile(x, y, map_z));
+		}
+		return;
+	}
+
+	const uint64_t key = (uint64_t(uint32_t(map_x)) << 32) |
+						 (uint64_t(uint32_t(map_y)) << 8) | uint64_t(map_z);
+	NodeCache &cache = node_cache[key];
+	cache.used = draw_count;
+	++nodes_drawn;
+
+	// Selecting marks the tiles as modified, which shows once only those are
+	// drawn
+	const uint32_t revision = options.show_only_modified
+								  ? node->getRevision()
+								  : node->getDrawRevision();
+	if (cache.state == node_cache_id && cache.revision == revision) {
+		sprite_batch.replay(cache.recording,
+							float(cache.scroll_x - view_scroll_x),
+							float(cache.scroll_y - view_scroll_y));
+		node_replayed = true;
+		return;
+	}
+
+	// Animated items get a new frame every time they are drawn
+	const bool animate = options.show_preview && zoom <= 2.0;
+	auto animated = [](const Item *item) {
+		return g_items.getHotData(item->getID()).has(ITEM_HOT_ANIMATED);
+	};
+	bool cacheable = true;
+
+	const size_t mark = sprite_batch.mark();
+	selection_deferred = true;
+	for (int x = 0; x < 4; ++x) {
+		for (int y = 0; y < 4; ++y) {
+			TileLocation *location = node->getTile(x, y, map_z);
+			DrawTile(location);
+
+			const Tile *tile = location ? location->get() : nullptr;
+			if (!animate || !cacheable || !tile)
+				continue;
+			if (tile->ground && animated(tile->ground))
+				cacheable = false;
+			for (const Item *item : tile->items) {
+				if (animated(item))
+					cacheable = false;
+			}
+		}
+	}
+	selection_deferred = false;
+
+	if (cacheable) {
+		sprite_batch.record(mark, cache.recording);
+		cache.state = node_cache_id;
+		cache.revision = revision;
+		cache.scroll_x = view_scroll_x;
+		cache.scroll_y = view_scroll_y;
+	} else {
+		cache.recording.clear();
+		cache.state = 0;
+	}
+}
+
+void MapDrawer::ShadeNode(QTreeNode *node, int map_x, int map_y, int map_z) {
+	if (!node_caching || options.ingame || options.isOnlyColors())
+		return;
+
+	const uint16_t mask =
+		editor.getSelection().getLeafMask(map_x, map_y, map_z);
+	if (mask == 0)
+		return;
+
+	selection_shading = true;
+	for (int x = 0; x < 4; ++x) {
+		for (int y = 0; y < 4; ++y) {
+			if (mask & (1 << (x * 4 + y)))
+				ShadeTile(node->getTile(x, y, map_z));
+		}
+	}
+	selection_shading = false;
+}
+
+void MapDrawer::ShadeTile(TileLocation *location) {
+	Tile *tile = location ? location->get() : nullptr;
+	if (!tile || (options.show_only_modified && !tile->isModified()))
+		return;
+
+	// The items are gone over as DrawTile does, the ones that aren't selected
+	// only raise the items above them
+	int draw_x, draw_y;
+	getDrawPosition(location->getPosition(), draw_x, draw_y);
+	if (tile->ground)
+		BlitItem(draw_x, draw_y, tile, tile->ground);
+
+	if (options.hide_items_when_zoomed && zoom > 10.f)
+		return;
+
+	for (const Item *item : tile->items)
+		BlitItem(draw_x, draw_y, tile, item);
+
+	if (options.show_creatures && tile->creature &&
+		tile->creature->isSelected())
+		BlitCreature(draw_x, draw_y, tile->creature->getLookType(),
+					 tile->creature->getDirection(), 0, 0, 0, 128);
+}
+
+void MapDrawer::AnimateItem(Item *item) {
+	if (!g_items.getHotData(item->getID()).has(ITEM_HOT_ANIMATED))
+		return;
+
+	item->animate();
+	drawn_animations[item->getID()] = item->getFrame();
+}
+
+bool MapDrawer::HasAnimationAdvanced() const {
+	g_gui.gfx.updateElapsedTime();
+	for (const auto &entry : drawn_animations) {
+		// Items of a type share the animator of its sprite
+		const GameSprite *sprite = g_items.getItemType(entry.first).sprite;
+		if (sprite && sprite->animator &&
+			sprite->animator->getFrame() != entry.second)
+			return true;
+	}
+	return false;
+}
+
 void MapDrawer::DrawSecondaryMap(int map_z) {
 	if (options.ingame)
 		return;
@@ -485,100 +1003,156 @@ void MapDrawer::DrawSecondaryMap(int map_z) {
 		}
 	}
 
+	const int pos_z = normal_pos.z + map_z - to_pos.z;
+	if (pos_z < 0 || pos_z >= rme::MapLayers)
+		return;
+
+	SecondaryCache &cache = secondary_cache;
+	if (cache.map_id != secondary_map->getInstanceId() ||
+		cache.normal_pos != normal_pos) {
+		cache.map_id = secondary_map->getInstanceId();
+		cache.normal_pos = normal_pos;
+		cache.leaves.clear();
+	}
+
+	// The tile of the buffer at x, y is drawn at x, y of the map moved by delta
+	const int delta_x = normal_pos.x - to_pos.x;
+	const int delta_y = normal_pos.y - to_pos.y;
+	const int origin_x = view_scroll_x + delta_x * rme::TileSize;
+	const int origin_y = view_scroll_y + delta_y * rme::TileSize;
+
 	glEnable(GL_TEXTURE_2D);
+	BeginBatch();
+
+	size_t leaves_drawn = 0;
+	secondary_map->visitLeaves(
+		start_x + delta_x, start_y + delta_y, end_x + delta_x,
+		end_y + delta_y, [&](QTreeNode *leaf, int leaf_x, int leaf_y) {
+			const uint64_t key = (uint64_t(uint32_t(leaf_x)) << 32) |
+								 (uint64_t(uint32_t(leaf_y)) << 8) |
+								 uint64_t(pos_z);
+			NodeCache &entry = cache.leaves[key];
+			entry.used = draw_count;
+			++leaves_drawn;
+
+			if (entry.state == node_cache_id &&
+				entry.revision == leaf->getRevision()) {
+				sprite_batch.replay(entry.recording,
+									float(entry.scroll_x - origin_x),
+									float(entry.scroll_y - origin_y));
+				node_replayed = true;
+				return;
+			}
 
-	for (int map_x = start_x; map_x <= end_x; map_x++) {
-		for (int map_y = start_y; map_y <= end_y; map_y++) {
-			Position final_pos(map_x, map_y, map_z);
-			Position pos = normal_pos + final_pos - to_pos;
-			if (pos.z < 0 || pos.z >= rme::MapLayers) {
-				continue;
+			const size_t mark = sprite_batch.mark();
+			for (int x = 0; x < 4; ++x) {
+				for (int y = 0; y < 4; ++y) {
+					TileLocation *location = leaf->getTile(x, y, pos_z);
+					const Tile *tile = location ? location->get() : nullptr;
+					if (!tile)
+						continue;
+
+					int draw_x, draw_y;
+					getDrawPosition(Position(leaf_x + x - delta_x,
+											 leaf_y + y - delta_y, map_z),
+									draw_x, draw_y);
+					DrawSecondaryTile(tile, draw_x, draw_y);
+				}
 			}
 
-			Tile *tile = secondary_map->getTile(pos);
-			if (!tile)
-				continue;
+			sprite_batch.record(mark, entry.recording);
+			entry.state = node_cache_id;
+			entry.revision = leaf->getRevision();
+			entry.scroll_x = origin_x;
+			entry.scroll_y = origin_y;
+		});
 
-			int draw_x, draw_y;
-			getDrawPosition(final_pos, draw_x, draw_y);
-
-			// Draw ground
-			uint8_t r = 160, g = 160, b = 160;
-			if (tile->ground) {
-				if (options.show_blocking && tile->isBlocking()) {
-					g = g / 3 * 2;
-					b = b / 3 * 2;
-				}
-				if (options.show_houses && tile->isHouseTile()) {
-					if (tile->getHouseID() == current_house_id) {
-						r /= 2;
-					} else {
-						r /= 2;
-						g /= 2;
-					}
-				} else if (options.show_special_tiles && tile->isPZ()) {
-					r /= 2;
-					b /= 2;
-				}
-				if (options.show_special_tiles &&
-					tile->getMapFlags() & TILESTATE_PVPZONE) {
-					r = r / 3 * 2;
-					b = r / 3 * 2;
-				}
-				if (options.show_special_tiles &&
-					tile->getMapFlags() & TILESTATE_NOLOGOUT) {
-					b /= 2;
-				}
-				if (options.show_special_tiles &&
-					tile->getMapFlags() & TILESTATE_NOPVP) {
-					g /= 2;
-				}
+	FlushBatch();
+	glDisable(GL_TEXTURE_2D);
 
-				if (options.show_zone_areas &&
-					tile->getMapFlags() & TILESTATE_ZONE_BRUSH) {
-					size_t zones = tile->getZoneIds().size();
-					uint16_t r16 = 0, g16 = 0, b16 = 0;
-					for (const auto &zoneId : tile->getZoneIds()) {
-						const uint16_t colorIndex = zoneId % colors.size();
-						const Color colour = colors.at(colorIndex);
-
-						r16 += std::get<0>(colour);
-						g16 += std::get<1>(colour);
-						b16 += std::get<2>(colour);
-					}
+	// Forget the leaves that are no longer in view
+	if (cache.leaves.size() > leaves_drawn * 2 + 1024) {
+		for (auto it = cache.leaves.begin(); it != cache.leaves.end();) {
+			if (it->second.used != draw_count)
+				it = cache.leaves.erase(it);
+			else
+				++it;
+		}
+	}
+}
 
-					r = r16 / zones;
-					g = g16 / zones;
-					b = b16 / zones;
-				}
+void MapDrawer::DrawSecondaryTile(const Tile *tile, int draw_x, int draw_y) {
+	// Draw ground
+	uint8_t r = 160, g = 160, b = 160;
+	if (tile->ground) {
+		if (options.show_blocking && tile->isBlocking()) {
+			g = g / 3 * 2;
+			b = b / 3 * 2;
+		}
+		if (options.show_houses && tile->isHouseTile()) {
+			if (tile->getHouseID() == current_house_id) {
+				r /= 2;
+			} else {
+				r /= 2;
+				g /= 2;
+			}
+		} else if (options.show_special_tiles && tile->isPZ()) {
+			r /= 2;
+			b /= 2;
+		}
+		if (options.show_special_tiles &&
+			tile->getMapFlags() & TILESTATE_PVPZONE) {
+			r = r / 3 * 2;
+			b = r / 3 * 2;
+		}
+		if (options.show_special_tiles &&
+			tile->getMapFlags() & TILESTATE_NOLOGOUT) {
+			b /= 2;
+		}
+		if (options.show_special_tiles &&
+			tile->getMapFlags() & TILESTATE_NOPVP) {
+			g /= 2;
+		}
 
-				BlitItem(draw_x, draw_y, tile, tile->ground, true, r, g, b,
-						 160);
+		if (options.show_zone_areas &&
+			tile->getMapFlags() & TILESTATE_ZONE_BRUSH) {
+			size_t zones = tile->getZoneIds().size();
+			uint16_t r16 = 0, g16 = 0, b16 = 0;
+			for (const auto &zoneId : tile->getZoneIds()) {
+				const uint16_t colorIndex = zoneId % colors.size();
+				const Color colour = colors.at(colorIndex);
+
+				r16 += std::get<0>(colour);
+				g16 += std::get<1>(colour);
+				b16 += std::get<2>(colour);
 			}
 
-			bool hidden = options.hide_items_when_zoomed && zoom > 10.f;
+			r = r16 / zones;
+			g = g16 / zones;
+			b = b16 / zones;
+		}
 
-			// Draw items
-			if (!hidden && !tile->items.empty()) {
-				for (const Item *item : tile->items) {
-					if (item->isBorder()) {
-						BlitItem(draw_x, draw_y, tile, item, true, 160, r, g,
-								 b);
-					} else {
-						BlitItem(draw_x, draw_y, tile, item, true, 160, 160,
-								 160, 160);
-					}
-				}
-			}
+		BlitItem(draw_x, draw_y, tile, tile->ground, true, r, g, b, 160);
+	}
 
-			// Draw creature
-			if (!hidden && options.show_creatures && tile->creature) {
-				BlitCreature(draw_x, draw_y, tile->creature);
+	bool hidden = options.hide_items_when_zoomed && zoom > 10.f;
+
+	// Draw items
+	if (!hidden && !tile->items.empty()) {
+		for (const Item *item : tile->items) {
+			if (item->isBorder()) {
+				BlitItem(draw_x, draw_y, tile, item, true, 160, r, g, b);
+			} else {
+				BlitItem(draw_x, draw_y, tile, item, true, 160, 160, 160,
+						 160);
 			}
 		}
 	}
 
-	glDisable(GL_TEXTURE_2D);
+	// Draw creature
+	if (!hidden && options.show_creatures && tile->creature) {
+		BlitCreature(draw_x, draw_y, tile->creature);
+	}
 }
 
 void MapDrawer::DrawIngameBox() {
@@ -652,24 +1226,21 @@ void MapDrawer::DrawIngameBox() {
 }
 
 void MapDrawer::DrawGrid() {
-	glDisable(GL_TEXTURE_2D);
-	glColor4ub(255, 255, 255, 128);
-	glBegin(GL_LINES);
-
-	for (int y = start_y; y < end_y; ++y) {
-		int py = y * rme::TileSize - view_scroll_y;
-		glVertex2f(start_x * rme::TileSize - view_scroll_x, py);
-		glVertex2f(end_x * rme::TileSize - view_scroll_x, py);
-	}
+	const GLuint grid_texture = g_gui.gfx.getGridTexture();
+	if (grid_texture == 0)
+		return;
 
-	for (int x = start_x; x < end_x; ++x) {
-		int px = x * rme::TileSize - view_scroll_x;
-		glVertex2f(px, start_y * rme::TileSize - view_scroll_y);
-		glVertex2f(px, end_y * rme::TileSize - view_scroll_y);
-	}
+	const float x = start_x * rme::TileSize - view_scroll_x;
+	const float y = start_y * rme::TileSize - view_scroll_y;
+	const int width = end_x - start_x;
+	const int height = end_y - start_y;
+	if (width <= 0 || height <= 0)
+		return;
 
-	glEnd();
-	glEnable(GL_TEXTURE_2D);
+	sprite_batch.add(grid_texture, x, y, width * rme::TileSize,
+					 height * rme::TileSize, 255, 255, 255, 128, 0.f, 0.f,
+					 float(width), float(height));
+	FlushBatch();
 }
 
 void MapDrawer::DrawDraggingShadow() {
@@ -677,6 +1248,7 @@ void MapDrawer::DrawDraggingShadow() {
 		return;
 
 	glEnable(GL_TEXTURE_2D);
+	BeginBatch();
 
 	for (Tile *tile : editor.getSelection()) {
 		int move_z = canvas->drag_start_z - floor;
@@ -723,6 +1295,7 @@ void MapDrawer::DrawDraggingShadow() {
 		}
 	}
 
+	FlushBatch();
 	glDisable(GL_TEXTURE_2D);
 }
 
@@ -731,37 +1304,106 @@ void MapDrawer::DrawHigherFloors() {
 		return;
 
 	glEnable(GL_TEXTURE_2D);
+	BeginBatch();
+
+	// A leaf at a time, so the floor above is replayed from the node cache
+	// like the floors of DrawMap
+	const int map_z = floor - 1;
+	for (int nd_map_x = start_x & ~3; nd_map_x <= end_x; nd_map_x += 4) {
+		for (int nd_map_y = start_y & ~3; nd_map_y <= end_y; nd_map_y += 4) {
+			QTreeNode *nd = editor.getMap().getLeaf(nd_map_x, nd_map_y);
+			if (nd)
+				DrawHigherNode(nd, nd_map_x, nd_map_y, map_z);
+		}
+	}
 
-	int map_z = floor - 1;
-	for (int map_x = start_x; map_x <= end_x; map_x++) {
-		for (int map_y = start_y; map_y <= end_y; map_y++) {
-			Tile *tile = editor.getMap().getTile(map_x, map_y, map_z);
-			if (!tile)
-				continue;
+	FlushBatch();
+	glDisable(GL_TEXTURE_2D);
+}
 
-			int draw_x, draw_y;
-			getDrawPosition(tile->getPosition(), draw_x, draw_y);
+void MapDrawer::DrawHigherNode(QTreeNode *node, int map_x, int map_y,
+							   int map_z) {
+	if (!node_caching) {
+		for (int x = 0; x < 4; ++x) {
+			for (int y = 0; y < 4; ++y)
+				DrawHigherTile(node->getTile(x, y, map_z));
+		}
+		return;
+	}
 
-			if (tile->ground) {
-				if (tile->isPZ()) {
-					BlitItem(draw_x, draw_y, tile, tile->ground, false, 128,
-							 255, 128, 96);
-				} else {
-					BlitItem(draw_x, draw_y, tile, tile->ground, false, 255,
-							 255, 255, 96);
-				}
-			}
+	// The floor is drawn see-through here, apart from how DrawMap draws it
+	const uint64_t key = (uint64_t(uint32_t(map_x)) << 32) |
+						 (uint64_t(uint32_t(map_y)) << 8) | uint64_t(map_z) |
+						 HigherFloorKey;
+	NodeCache &cache = node_cache[key];
+	cache.used = draw_count;
+	++nodes_drawn;
 
-			bool hidden = options.hide_items_when_zoomed && zoom > 10.f;
-			if (!hidden && !tile->items.empty()) {
-				for (const Item *item : tile->items)
-					BlitItem(draw_x, draw_y, tile, item, false, 255, 255, 255,
-							 96);
+	if (cache.state == node_cache_id && cache.revision == node->getRevision()) {
+		sprite_batch.replay(cache.recording,
+							float(cache.scroll_x - view_scroll_x),
+							float(cache.scroll_y - view_scroll_y));
+		node_replayed = true;
+		return;
+	}
+
+	const bool animate = options.show_preview && zoom <= 2.0;
+	bool cacheable = true;
+
+	const size_t mark = sprite_batch.mark();
+	for (int x = 0; x < 4; ++x) {
+		for (int y = 0; y < 4; ++y) {
+			TileLocation *location = node->getTile(x, y, map_z);
+			DrawHigherTile(location);
+
+			const Tile *tile = location ? location->get() : nullptr;
+			if (!animate || !cacheable || !tile)
+				continue;
+			if (tile->ground && g_items.getHotData(tile->ground->getID())
+									.has(ITEM_HOT_ANIMATED))
+				cacheable = false;
+			for (const Item *item : tile->items) {
+				if (g_items.getHotData(item->getID()).has(ITEM_HOT_ANIMATED))
+					cacheable = false;
 			}
 		}
 	}
 
-	glDisable(GL_TEXTURE_2D);
+	if (cacheable) {
+		sprite_batch.record(mark, cache.recording);
+		cache.state = node_cache_id;
+		cache.revision = node->getRevision();
+		cache.scroll_x = view_scroll_x;
+		cache.scroll_y = view_scroll_y;
+	} else {
+		cache.recording.clear();
+		cache.state = 0;
+	}
+}
+
+void MapDrawer::DrawHigherTile(TileLocation *location) {
+	const Tile *tile = location ? location->get() : nullptr;
+	if (!tile)
+		return;
+
+	int draw_x, draw_y;
+	getDrawPosition(tile->getPosition(), draw_x, draw_y);
+
+	if (tile->ground) {
+		if (tile->isPZ()) {
+			BlitItem(draw_x, draw_y, tile, tile->ground, false, 128, 255, 128,
+					 96);
+		} else {
+			BlitItem(draw_x, draw_y, tile, tile->ground, false, 255, 255, 255,
+					 96);
+		}
+	}
+
+	bool hidden = options.hide_items_when_zoomed && zoom > 10.f;
+	if (!hidden && !tile->items.empty()) {
+		for (const Item *item : tile->items)
+			BlitItem(draw_x, draw_y, tile, item, false, 255, 255, 255, 96);
+	}
 }
 
 void MapDrawer::DrawSelectionBox() {
@@ -1255,90 +1897,33 @@ void MapDrawer::DrawBrush() {
 				glDisable(GL_TEXTURE_2D);
 			}
 
-			for (int y = -g_gui.GetBrushSize() - 1;
-				 y <= g_gui.GetBrushSize() + 1; y++) {
-				int cy = (mouse_map_y + y) * rme::TileSize - view_scroll_y -
-						 adjustment;
-				for (int x = -g_gui.GetBrushSize() - 1;
-					 x <= g_gui.GetBrushSize() + 1; x++) {
-					int cx = (mouse_map_x + x) * rme::TileSize - view_scroll_x -
-							 adjustment;
-					if (g_gui.GetBrushShape() == BRUSHSHAPE_SQUARE) {
-						if (x >= -g_gui.GetBrushSize() &&
-							x <= g_gui.GetBrushSize() &&
-							y >= -g_gui.GetBrushSize() &&
-							y <= g_gui.GetBrushSize()) {
-							if (brush->isRaw()) {
-								BlitSpriteType(cx, cy,
-											   raw_brush->getItemType()->sprite,
-											   160, 160, 160, 160);
-							} else {
-								if (brush->isWaypoint()) {
-									uint8_t r, g, b;
-									getColor(brush,
-											 Position(mouse_map_x + x,
-													  mouse_map_y + y, floor),
-											 r, g, b);
-									DrawBrushIndicator(cx, cy, brush, r, g, b);
-								} else {
-									if (brush->isHouseExit() ||
-										brush->isOptionalBorder())
-										glColorCheck(brush,
-													 Position(mouse_map_x + x,
-															  mouse_map_y + y,
-															  floor));
-									else
-										glColor(brushColor);
-
-									glBegin(GL_QUADS);
-									glVertex2f(cx, cy + rme::TileSize);
-									glVertex2f(cx + rme::TileSize,
-											   cy + rme::TileSize);
-									glVertex2f(cx + rme::TileSize, cy);
-									glVertex2f(cx, cy);
-									glEnd();
-								}
-							}
-						}
-					} else if (g_gui.GetBrushShape() == BRUSHSHAPE_CIRCLE) {
-						double distance = sqrt(double(x * x) + double(y * y));
-						if (distance < g_gui.GetBrushSize() + 0.005) {
-							if (brush->isRaw()) {
-								BlitSpriteType(cx, cy,
-											   raw_brush->getItemType()->sprite,
-											   160, 160, 160, 160);
-							} else {
-								if (brush->isWaypoint()) {
-									uint8_t r, g, b;
-									getColor(brush,
-											 Position(mouse_map_x + x,
-													  mouse_map_y + y, floor),
-											 r, g, b);
-									DrawBrushIndicator(cx, cy, brush, r, g, b);
-								} else {
-									if (brush->isHouseExit() ||
-										brush->isOptionalBorder())
-										glColorCheck(brush,
-													 Position(mouse_map_x + x,
-															  mouse_map_y + y,
-															  floor));
-									else
-										glColor(brushColor);
-
-									glBegin(GL_QUADS);
-									glVertex2f(cx, cy + rme::TileSize);
-									glVertex2f(cx + rme::TileSize,
-											   cy + rme::TileSize);
-									glVertex2f(cx + rme::TileSize, cy);
-									glVertex2f(cx, cy);
-									glEnd();
-								}
-							}
-						}
-					}
+			// Every tile of the brush in a single call
+			const wxColor brush_color = getBrushColor(brushColor);
+			BeginBatch();
+
+			const BrushFootprint &footprint =
+				BrushFootprint::get(g_gui.GetBrushShape(), g_gui.GetBrushSize());
+			const Position cursor(mouse_map_x, mouse_map_y, floor);
+			for (const Position &offset : footprint.getTiles()) {
+				const Position position = cursor + offset;
+				int cx = position.x * rme::TileSize - view_scroll_x - adjustment;
+				int cy = position.y * rme::TileSize - view_scroll_y - adjustment;
+				if (brush->isRaw()) {
+					BlitSpriteType(cx, cy, raw_brush->getItemType()->sprite, 160,
+								   160, 160, 160);
+				} else if (brush->isWaypoint()) {
+					uint8_t r, g, b;
+					getColor(brush, position, r, g, b);
+					DrawBrushIndicator(cx, cy, brush, r, g, b);
+				} else if (brush->isHouseExit() || brush->isOptionalBorder()) {
+					glBlitSquare(cx, cy, getCheckColor(brush, position));
+				} else {
+					glBlitSquare(cx, cy, brush_color);
 				}
 			}
 
+			FlushBatch();
+
 			if (brush->isRaw()) { // Textured brush
 				glDisable(GL_TEXTURE_2D);
 			} else {
@@ -1352,14 +1937,23 @@ void MapDrawer::BlitItem(int &draw_x, int &draw_y, const Tile *tile,
 						 const Item *item, bool ephemeral, int red, int green,
 						 int blue, int alpha) {
 	const ItemType &type = g_items.getItemType(item->getID());
+	const bool selected = !options.ingame && !ephemeral && item->isSelected();
+	// Shading the selection, the other items are only gone over for the
+	// height they add
+	const bool skipped = selection_shading && !selected;
 	if (type.id == 0) {
+		if (skipped)
+			return;
 		glDisable(GL_TEXTURE_2D);
 		glBlitSquare(draw_x, draw_y, *wxRED);
 		glEnable(GL_TEXTURE_2D);
 		return;
 	}
 
-	if (!options.ingame && !ephemeral && item->isSelected()) {
+	if (selected && selection_shading) {
+		red = green = blue = 0;
+		alpha /= 2;
+	} else if (selected && !selection_deferred) {
 		red /= 2;
 		blue /= 2;
 		green /= 2;
@@ -1367,11 +1961,15 @@ void MapDrawer::BlitItem(int &draw_x, int &draw_y, const Tile *tile,
 
 	// Ugly hacks. :)
 	if (type.id == 459 && !options.ingame) {
+		if (skipped)
+			return;
 		glDisable(GL_TEXTURE_2D);
 		glBlitSquare(draw_x, draw_y, red, green, 0, alpha / 3 * 2);
 		glEnable(GL_TEXTURE_2D);
 		return;
 	} else if (type.id == 460 && !options.ingame) {
+		if (skipped)
+			return;
 		glDisable(GL_TEXTURE_2D);
 		glBlitSquare(draw_x, draw_y, red, 0, 0, alpha / 3 * 2);
 		glEnable(GL_TEXTURE_2D);
@@ -1444,21 +2042,25 @@ void MapDrawer::BlitItem(int &draw_x, int &draw_y, const Tile *tile,
 		alpha /= 2;
 	}
 
+	if (skipped)
+		return;
+
 	int frame = item->getFrame();
 	for (int cx = 0; cx != sprite->width; cx++) {
 		for (int cy = 0; cy != sprite->height; cy++) {
 			for (int cf = 0; cf != sprite->layers; cf++) {
-				int texnum =
-					sprite->getHardwareID(cx, cy, cf, subtype, pattern_x,
-										  pattern_y, pattern_z, frame);
+				const TextureRegion region =
+					sprite->getTextureRegion(cx, cy, cf, subtype, pattern_x,
+											 pattern_y, pattern_z, frame);
 				glBlitTexture(screenx - cx * rme::TileSize,
-							  screeny - cy * rme::TileSize, texnum, red, green,
+							  screeny - cy * rme::TileSize, region, red, green,
 							  blue, alpha);
 			}
 		}
 	}
 
-	if (options.show_hooks && (type.hookSouth || type.hookEast))
+	if (!selection_shading && options.show_hooks &&
+		(type.hookSouth || type.hookEast))
 		DrawHookIndicator(draw_x, draw_y, type);
 }
 
@@ -1549,11 +2151,11 @@ void MapDrawer::BlitItem(int &draw_x, int &draw_y, const Position &pos,
 	for (int cx = 0; cx != sprite->width; ++cx) {
 		for (int cy = 0; cy != sprite->height; ++cy) {
 			for (int cf = 0; cf != sprite->layers; ++cf) {
-				int texnum =
-					sprite->getHardwareID(cx, cy, cf, subtype, pattern_x,
-										  pattern_y, pattern_z, frame);
+				const TextureRegion region =
+					sprite->getTextureRegion(cx, cy, cf, subtype, pattern_x,
+											 pattern_y, pattern_z, frame);
 				glBlitTexture(screenx - cx * rme::TileSize,
-							  screeny - cy * rme::TileSize, texnum, red, green,
+							  screeny - cy * rme::TileSize, region, red, green,
 							  blue, alpha);
 			}
 		}
@@ -1580,10 +2182,10 @@ void MapDrawer::BlitSpriteType(int screenx, int screeny, uint32_t spriteid,
 	for (int cx = 0; cx != sprite->width; ++cx) {
 		for (int cy = 0; cy != sprite->height; ++cy) {
 			for (int cf = 0; cf != sprite->layers; ++cf) {
-				int texnum =
-					sprite->getHardwareID(cx, cy, cf, -1, 0, 0, 0, frame);
+				const TextureRegion region =
+					sprite->getTextureRegion(cx, cy, cf, -1, 0, 0, 0, frame);
 				glBlitTexture(screenx - cx * rme::TileSize,
-							  screeny - cy * rme::TileSize, texnum, red, green,
+							  screeny - cy * rme::TileSize, region, red, green,
 							  blue, alpha);
 			}
 		}
@@ -1602,10 +2204,10 @@ void MapDrawer::BlitSpriteType(int screenx, int screeny, GameSprite *sprite,
 	for (int cx = 0; cx != sprite->width; ++cx) {
 		for (int cy = 0; cy != sprite->height; ++cy) {
 			for (int cf = 0; cf != sprite->layers; ++cf) {
-				int texnum =
-					sprite->getHardwareID(cx, cy, cf, -1, 0, 0, 0, frame);
+				const TextureRegion region =
+					sprite->getTextureRegion(cx, cy, cf, -1, 0, 0, 0, frame);
 				glBlitTexture(screenx - cx * rme::TileSize,
-							  screeny - cy * rme::TileSize, texnum, red, green,
+							  screeny - cy * rme::TileSize, region, red, green,
 							  blue, alpha);
 			}
 		}
@@ -1631,10 +2233,10 @@ void MapDrawer::BlitCreature(int screenx, int screeny, const Outfit &outfit,
 					g_gui.gfx.getCreatureSprite(outfit.lookMount)) {
 				for (int cx = 0; cx != mountSpr->width; ++cx) {
 					for (int cy = 0; cy != mountSpr->height; ++cy) {
-						int texnum = mountSpr->getHardwareID(cx, cy, 0, 0,
-															 (int)dir, 0, 0, 0);
+						const TextureRegion region = mountSpr->getTextureRegion(
+							cx, cy, 0, 0, (int)dir, 0, 0, 0);
 						glBlitTexture(screenx - cx * rme::TileSize,
-									  screeny - cy * rme::TileSize, texnum, red,
+									  screeny - cy * rme::TileSize, region, red,
 									  green, blue, alpha);
 					}
 				}
@@ -1653,10 +2255,10 @@ void MapDrawer::BlitCreature(int screenx, int screeny, const Outfit &outfit,
 
 			for (int cx = 0; cx != sprite->width; ++cx) {
 				for (int cy = 0; cy != sprite->height; ++cy) {
-					int texnum = sprite->getHardwareID(
+					const TextureRegion region = sprite->getTextureRegion(
 						cx, cy, (int)dir, pattern_y, pattern_z, outfit, frame);
 					glBlitTexture(screenx - cx * rme::TileSize,
-								  screeny - cy * rme::TileSize, texnum, red,
+								  screeny - cy * rme::TileSize, region, red,
 								  green, blue, alpha);
 				}
 			}
@@ -1666,7 +2268,7 @@ void MapDrawer::BlitCreature(int screenx, int screeny, const Outfit &outfit,
 
 void MapDrawer::BlitCreature(int screenx, int screeny, const Creature *creature,
 							 int red, int green, int blue, int alpha) {
-	if (!options.ingame && creature->isSelected()) {
+	if (!options.ingame && !selection_deferred && creature->isSelected()) {
 		red /= 2;
 		green /= 2;
 		blue /= 2;
@@ -1694,18 +2296,8 @@ void MapDrawer::WriteTooltip(Tile *tile, const Item *item,
 	if (stream.tellp() > 0)
 		stream << "\n";
 
-	if (!zoneIds.empty()) {
-		for (auto &zoneId : zoneIds) {
-			auto itZone = zoneTiles.find(zoneId);
-			if (itZone == zoneTiles.end())
-				zoneTiles.emplace(
-					zoneId, std::vector<FinderPosition>({FinderPosition(
-								tile->getX(), tile->getY(), tile->getZ())}));
-			else
-				itZone->second.push_back(
-					FinderPosition(tile->getX(), tile->getY(), tile->getZ()));
-		}
-	} else
+	// Zones get one label per area instead, see GetZoneLabels
+	if (zoneIds.empty())
 		stream << "id: " << id << "\n";
 
 	if (action > 0)
@@ -1724,6 +2316,7 @@ void MapDrawer::WriteTooltip(const Waypoint *waypoint,
 }
 
 void MapDrawer::DrawTile(TileLocation *location) {
+	ProfileScope scope(FrameProfiler::SECTION_DRAW_TILE);
 	if (!location)
 		return;
 
@@ -1736,6 +2329,9 @@ void MapDrawer::DrawTile(TileLocation *location) {
 
 	const Position &position = location->getPosition();
 	bool show_tooltips = options.isTooltips();
+	// Only tiles with ids, texts or zones write anything into the tooltip
+	bool item_tooltips = show_tooltips && position.z == floor &&
+						 (tile->hasTooltip() || tile->hasZones());
 
 	if (show_tooltips && location->getWaypointCount() > 0) {
 		Waypoint *waypoint =
@@ -1806,7 +2402,7 @@ void MapDrawer::DrawTile(TileLocation *location) {
 				g /= 2;
 			}
 
-			if (options.show_zone_areas and not tile->getZoneIds().empty()) {
+			if (options.show_zone_areas and tile->hasZones()) {
 				size_t zones = tile->getZoneIds().size();
 				uint16_t r16 = 0, g16 = 0, b16 = 0;
 				for (const auto zoneId : tile->getZoneIds()) {
@@ -1835,12 +2431,12 @@ void MapDrawer::DrawTile(TileLocation *location) {
 			glEnable(GL_TEXTURE_2D);
 		} else {
 			if (options.show_preview && zoom <= 2.0)
-				tile->ground->animate();
+				AnimateItem(tile->ground);
 
 			BlitItem(draw_x, draw_y, tile, tile->ground, false, r, g, b);
 		}
 
-		if (show_tooltips && position.z == floor)
+		if (item_tooltips)
 			WriteTooltip(tile, tile->ground, tooltip);
 	}
 
@@ -1849,11 +2445,11 @@ void MapDrawer::DrawTile(TileLocation *location) {
 
 	if (!hidden && !tile->items.empty()) {
 		for (Item *item : tile->items) {
-			if (show_tooltips && position.z == floor)
+			if (item_tooltips)
 				WriteTooltip(tile, item, tooltip);
 
 			if (options.show_preview && zoom <= 2.0)
-				item->animate();
+				AnimateItem(item);
 
 			if (item->isBorder()) {
 				BlitItem(draw_x, draw_y, tile, item, false, r, g, b);
@@ -1878,56 +2474,67 @@ void MapDrawer::DrawTile(TileLocation *location) {
 
 void MapDrawer::DrawBrushIndicator(int x, int y, Brush *brush, uint8_t r,
 								   uint8_t g, uint8_t b) {
-	x += (rme::TileSize / 2);
-	y += (rme::TileSize / 2);
-
-	// 7----0----1
-	// |         |
-	// 6--5  3--2
-	//     \/
-	//     4
-	static int vertexes[9][2] = {
-		{-15, -20}, // 0
-		{15, -20},	// 1
-		{15, -5},	// 2
-		{5, -5},	// 3
-		{0, 0},		// 4
-		{-5, -5},	// 5
-		{-15, -5},	// 6
-		{-15, -20}, // 7
-		{-15, -20}, // 0
-	};
-
-	// circle
-	glBegin(GL_TRIANGLE_FAN);
-	glColor4ub(0x00, 0x00, 0x00, 0x50);
-	glVertex2i(x, y);
-	for (int i = 0; i <= 30; i++) {
-		float angle = i * 2.0f * rme::PI / 30;
-		glVertex2f(cos(angle) * (rme::TileSize / 2) + x,
-				   sin(angle) * (rme::TileSize / 2) + y);
-	}
-	glEnd();
-
-	// background
-	glColor4ub(r, g, b, 0xB4);
-	glBegin(GL_POLYGON);
-	for (int i = 0; i < 8; ++i)
-		glVertex2i(vertexes[i][0] + x, vertexes[i][1] + y);
-	glEnd();
+	// Drawn through the batch, every tile of the brush goes out in one call
+	const float fx = x + (rme::TileSize / 2);
+	const float fy = y + (rme::TileSize / 2);
+
+	// circle, as a fan of quads
+	constexpr int segments = 30;
+	float rim[segments + 1][2];
+	for (int i = 0; i <= segments; i++) {
+		float angle = i * 2.0f * rme::PI / segments;
+		rim[i][0] = cos(angle) * (rme::TileSize / 2) + fx;
+		rim[i][1] = sin(angle) * (rme::TileSize / 2) + fy;
+	}
+	for (int i = 0; i < segments; i += 2) {
+		const float corners[8] = {fx,			 fy,
+								  rim[i][0],	 rim[i][1],
+								  rim[i + 1][0], rim[i + 1][1],
+								  rim[i + 2][0], rim[i + 2][1]};
+		sprite_batch.addQuad(corners, 0x00, 0x00, 0x00, 0x50);
+	}
+
+	// background, a box with an arrow pointing at the centre of the tile
+	const float arrow[8] = {fx - 5, fy - 5, fx + 5, fy - 5, fx, fy, fx, fy};
+	sprite_batch.add(0, fx - 15, fy - 20, 30, 15, r, g, b, 0xB4);
+	sprite_batch.addQuad(arrow, r, g, b, 0xB4);
 
 	// borders
-	glColor4ub(0x00, 0x00, 0x00, 0xB4);
-	glLineWidth(1.0);
-	glBegin(GL_LINES);
-	for (int i = 0; i < 8; ++i) {
-		glVertex2i(vertexes[i][0] + x, vertexes[i][1] + y);
-		glVertex2i(vertexes[i + 1][0] + x, vertexes[i + 1][1] + y);
-	}
-	glEnd();
+	const float right_edge[8] = {fx + 5, fy - 5, fx + 6, fy - 5,
+								 fx + 1, fy,	 fx,	 fy};
+	const float left_edge[8] = {fx - 5, fy - 5, fx - 4, fy - 5,
+								fx + 1, fy,		fx,		fy};
+	sprite_batch.add(0, fx - 15, fy - 20, 31, 1, 0x00, 0x00, 0x00, 0xB4);
+	sprite_batch.add(0, fx + 15, fy - 19, 1, 15, 0x00, 0x00, 0x00, 0xB4);
+	sprite_batch.add(0, fx - 15, fy - 19, 1, 15, 0x00, 0x00, 0x00, 0xB4);
+	sprite_batch.add(0, fx + 5, fy - 5, 10, 1, 0x00, 0x00, 0x00, 0xB4);
+	sprite_batch.add(0, fx - 14, fy - 5, 10, 1, 0x00, 0x00, 0x00, 0xB4);
+	sprite_batch.addQuad(right_edge, 0x00, 0x00, 0x00, 0xB4);
+	sprite_batch.addQuad(left_edge, 0x00, 0x00, 0x00, 0xB4);
 }
 
 void MapDrawer::DrawHookIndicator(int x, int y, const ItemType &type) {
+	if (batching) {
+		if (type.hookSouth) {
+			x -= 10;
+			y += 10;
+			const float corners[8] = {float(x),		 float(y),
+									  float(x + 10), float(y),
+									  float(x + 20), float(y + 10),
+									  float(x + 10), float(y + 10)};
+			sprite_batch.addQuad(corners, 0, 0, 255, 200);
+		} else if (type.hookEast) {
+			x += 10;
+			y -= 10;
+			const float corners[8] = {float(x),		 float(y),
+									  float(x + 10), float(y + 10),
+									  float(x + 10), float(y + 20),
+									  float(x),		 float(y + 10)};
+			sprite_batch.addQuad(corners, 0, 0, 255, 200);
+		}
+		return;
+	}
+
 	glDisable(GL_TEXTURE_2D);
 	glColor4ub(uint8_t(0), uint8_t(0), uint8_t(255), uint8_t(200));
 	glBegin(GL_QUADS);
@@ -2008,8 +2615,9 @@ void MapDrawer::DrawIndicator(int x, int y, int indicator, uint8_t r, uint8_t g,
 	if (sprite == nullptr)
 		return;
 
-	int textureId = sprite->getHardwareID(0, 0, 0, -1, 0, 0, 0, 0);
-	glBlitTexture(x, y, textureId, r, g, b, a, true);
+	const TextureRegion region =
+		sprite->getTextureRegion(0, 0, 0, -1, 0, 0, 0, 0);
+	glBlitTexture(x, y, region, r, g, b, a, true);
 }
 
 void MapDrawer::DrawPositionIndicator(int z) {
@@ -2038,41 +2646,21 @@ void MapDrawer::DrawPositionIndicator(int z) {
 }
 
 void MapDrawer::DrawTooltips() {
-	if (!options.show_tooltips || tooltips.empty())
+	if (!options.show_tooltips || tooltips.empty()) {
+		tooltip_layouts.clear();
 		return;
+	}
 
-	glDisable(GL_TEXTURE_2D);
+	// The glyphs are measured even when they aren't drawn, for the layouts
+	const bool draw_text = glyph_atlas.load() && zoom <= 1.0;
 
 	for (MapTooltip *tooltip : tooltips) {
-		const char *text = tooltip->text.c_str();
-		float line_width = 0.0f;
-		float width = 2.0f;
-		float height = 14.0f;
-		int char_count = 0;
-		int line_char_count = 0;
-
-		for (const char *c = text; *c != '\0'; c++) {
-			if (*c == '\n' ||
-				(line_char_count >= MapTooltip::MAX_CHARS_PER_LINE &&
-				 *c == ' ')) {
-				height += 14.0f;
-				line_width = 0.0f;
-				line_char_count = 0;
-			} else {
-				line_width += glutBitmapWidth(GLUT_BITMAP_HELVETICA_12, *c);
-			}
-			width = std::max<float>(width, line_width);
-			char_count++;
-			line_char_count++;
-
-			if (tooltip->ellipsis && char_count > (MapTooltip::MAX_CHARS + 3))
-				break;
-		}
+		const TooltipLayout &layout = GetTooltipLayout(*tooltip);
 
 		float scale = zoom < 1.0f ? zoom : 1.0f;
 
-		width = (width + 8.0f) * scale;
-		height = (height + 4.0f) * scale;
+		float width = (layout.width + 8.0f) * scale;
+		float height = (layout.height + 4.0f) * scale;
 
 		float x = tooltip->x + (rme::TileSize / 2.0f);
 		float y = tooltip->y + ((rme::TileSize / 2.0f) * scale);
@@ -2083,71 +2671,220 @@ void MapDrawer::DrawTooltips() {
 		float starty = y - (height + space);
 		float endy = y - space;
 
-		// 7----0----1
-		// |         |
-		// 6--5  3--2
-		//     \/
-		//     4
-		float vertexes[9][2] = {
-			{x, starty},	   // 0
-			{endx, starty},	   // 1
-			{endx, endy},	   // 2
-			{x + space, endy}, // 3
-			{x, y},			   // 4
-			{x - space, endy}, // 5
-			{startx, endy},	   // 6
-			{startx, starty},  // 7
-			{x, starty},	   // 0
-		};
+		// A box with an arrow pointing at the tile, over the same shape in
+		// black one screen pixel larger as its border
+		const float border = zoom;
+		const float outline[8] = {x - space - border * 2.0f, endy,
+								  x + space + border * 2.0f, endy,
+								  x, y + border * 1.5f,
+								  x, y + border * 1.5f};
+		sprite_batch.add(0, startx - border, starty - border,
+						 width + border * 2.0f, height + border * 2.0f, 0, 0,
+						 0, 255);
+		sprite_batch.addQuad(outline, 0, 0, 0, 255);
 
 		// background
-		glColor4ub(tooltip->r, tooltip->g, tooltip->b, 255);
-		glBegin(GL_POLYGON);
-		for (int i = 0; i < 8; ++i)
-			glVertex2f(vertexes[i][0], vertexes[i][1]);
-		glEnd();
-
-		// borders
-		glColor4ub(0, 0, 0, 255);
-		glLineWidth(1.0);
-		glBegin(GL_LINES);
-		for (int i = 0; i < 8; ++i) {
-			glVertex2f(vertexes[i][0], vertexes[i][1]);
-			glVertex2f(vertexes[i + 1][0], vertexes[i + 1][1]);
-		}
-		glEnd();
+		const float arrow[8] = {x - space, endy - border, x + space,
+								endy - border, x, y, x, y};
+		sprite_batch.add(0, startx, starty, width, height, tooltip->r,
+						 tooltip->g, tooltip->b, 255);
+		sprite_batch.addQuad(arrow, tooltip->r, tooltip->g, tooltip->b, 255);
 
 		// text
-		if (zoom <= 1.0) {
+		if (draw_text) {
 			startx += (3.0f * scale);
 			starty += (14.0f * scale);
-			glColor4ub(0, 0, 0, 255);
-			glRasterPos2f(startx, starty);
-			char_count = 0;
+			for (const TooltipLayout::Character &character :
+				 layout.characters) {
+				glyph_atlas.add(sprite_batch, startx + character.x * scale,
+								starty + character.line * 14.0f * scale,
+								character.c, scale, 0, 0, 0, 255);
+			}
+		}
+	}
+	FlushBatch();
+
+	// Layouts of texts that are no longer shown
+	for (auto it = tooltip_layouts.begin(); it != tooltip_layouts.end();) {
+		if (it->second.used != draw_count)
+			it = tooltip_layouts.erase(it);
+		else
+			++it;
+	}
+}
+
+const MapDrawer::TooltipLayout &
+MapDrawer::GetTooltipLayout(const MapTooltip &tooltip) {
+	TooltipLayout &layout = tooltip_layouts[tooltip.text];
+	layout.used = draw_count;
+	if (layout.height != 0)
+		return layout;
+
+	// Lines break on newlines and on the first space past the line length,
+	// texts that are too long end with dots
+	int line = 0;
+	int line_width = 0;
+	int char_count = 0;
+	int line_char_count = 0;
+	layout.width = 2;
+	for (char c : tooltip.text) {
+		char_count++;
+		line_char_count++;
+		if (c == '\n' ||
+			(line_char_count > MapTooltip::MAX_CHARS_PER_LINE && c == ' ')) {
+			line++;
+			line_width = 0;
 			line_char_count = 0;
-			for (const char *c = text; *c != '\0'; c++) {
-				if (*c == '\n' ||
-					(line_char_count >= MapTooltip::MAX_CHARS_PER_LINE &&
-					 *c == ' ')) {
-					starty += (14.0f * scale);
-					glRasterPos2f(startx, starty);
-					line_char_count = 0;
+			continue;
+		}
+
+		if (tooltip.ellipsis && char_count >= MapTooltip::MAX_CHARS)
+			c = '.';
+		else if (iscntrl(static_cast<unsigned char>(c)))
+			continue;
+
+		layout.characters.push_back(TooltipLayout::Character{
+			int16_t(line_width), int16_t(line), c});
+		line_width += glyph_atlas.getAdvance(c);
+		layout.width = std::max(layout.width, line_width);
+
+		if (tooltip.ellipsis && char_count >= MapTooltip::MAX_CHARS + 2)
+			break;
+	}
+	layout.height = (line + 1) * GlyphAtlas::LineHeight;
+	return layout;
+}
+
+const std::vector<MapDrawer::ZoneLabel> &
+MapDrawer::GetZoneLabels(int start_x, int start_y, int end_x, int end_y,
+						 int z) {
+	Map &map = editor.getMap();
+	ZoneLabelCache &cache = zone_labels;
+	if (cache.revision == map.getRevision() && cache.z == z &&
+		cache.start_x == start_x && cache.start_y == start_y &&
+		cache.end_x == end_x && cache.end_y == end_y)
+		return cache.labels;
+
+	cache.revision = map.getRevision();
+	cache.z = z;
+	cache.start_x = start_x;
+	cache.start_y = start_y;
+	cache.end_x = end_x;
+	cache.end_y = end_y;
+	cache.labels.clear();
+
+	// The squares of the view that are in each zone, the same tiles that write
+	// a tooltip
+	const int width = end_x - start_x + 1;
+	const int height = end_y - start_y + 1;
+	std::unordered_map<uint16_t, std::vector<int>> zones;
+	map.visitFloors(
+		start_x, start_y, end_x, end_y, z, z,
+		[&](Floor *nd_floor, int nd_x, int nd_y, int) {
+			for (int index = 0; index < 16; ++index) {
+				const int x = nd_x + (index >> 2);
+				const int y = nd_y + (index & 3);
+				if (x < start_x || x > end_x || y < start_y || y > end_y)
+					continue;
+
+				const Tile *tile = nd_floor->locs[index].get();
+				if (!tile || !tile->hasZones())
+					continue;
+
+				bool has_item = tile->ground && tile->ground->getID() >= 100;
+				for (const Item *item : tile->items) {
+					has_item = has_item || item->getID() >= 100;
 				}
-				char_count++;
-				line_char_count++;
-
-				if (tooltip->ellipsis && char_count >= MapTooltip::MAX_CHARS) {
-					glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, '.');
-					if (char_count >= (MapTooltip::MAX_CHARS + 2))
-						break;
-				} else if (!iscntrl(*c)) {
-					glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+				if (!has_item)
+					continue;
+
+				for (uint16_t zoneId : tile->getZoneIds()) {
+					zones[zoneId].push_back((y - start_y) * width +
+											(x - start_x));
 				}
 			}
+		});
+
+	// Connected squares of a zone are found with a flood fill over the view,
+	// marks are numbered so the grid is only cleared once
+	std::vector<uint32_t> marks(size_t(width) * height, 0);
+	std::vector<int> pending;
+	std::vector<int> component;
+	uint32_t mark = 0;
+	for (const auto &zone : zones) {
+		const uint32_t member = ++mark;
+		const uint32_t visited = ++mark;
+		for (int square : zone.second) {
+			marks[square] = member;
 		}
-	}
 
-	glEnable(GL_TEXTURE_2D);
+		for (int first : zone.second) {
+			if (marks[first] != member)
+				continue;
+
+			component.clear();
+			marks[first] = visited;
+			pending.push_back(first);
+			while (!pending.empty()) {
+				const int square = pending.back();
+				pending.pop_back();
+				component.push_back(square);
+
+				const int x = square % width;
+				const int y = square / width;
+				const int neighbours[4][2] = {
+					{x + 1, y}, {x - 1, y}, {x, y + 1}, {x, y - 1}};
+				for (const auto &neighbour : neighbours) {
+					if (neighbour[0] < 0 || neighbour[0] >= width ||
+						neighbour[1] < 0 || neighbour[1] >= height)
+						continue;
+					const int next = neighbour[1] * width + neighbour[0];
+					if (marks[next] == member) {
+						marks[next] = visited;
+						pending.push_back(next);
+					}
+				}
+			}
+
+			// The label goes on the square closest to the centre of the area
+			int64_t sum_x = 0, sum_y = 0;
+			for (int square : component) {
+				sum_x += square % width;
+				sum_y += square / width;
+			}
+			const int center_x = int(sum_x / int64_t(component.size()));
+			const int center_y = int(sum_y / int64_t(component.size()));
+
+			int closest = component.front();
+			int closest_distance = std::numeric_limits<int>::max();
+			for (int square : component) {
+				const int dx = square % width - center_x;
+				const int dy = square / width - center_y;
+				const int distance = dx * dx + dy * dy;
+				if (distance < closest_distance) {
+					closest_distance = distance;
+					closest = square;
+				}
+			}
+
+			ZoneLabel label;
+			label.x = start_x + closest % width;
+			label.y = start_y + closest / width;
+
+			const Tile *tile = map.getTile(label.x, label.y, z);
+			std::ostringstream text;
+			text << "zone id: ";
+			size_t count = tile->getZoneIds().size();
+			for (const auto &zoneId : tile->getZoneIds()) {
+				text << zoneId;
+				if (--count > 0)
+					text << "/";
+			}
+			label.text = text.str();
+			cache.labels.push_back(std::move(label));
+		}
+	}
+	return cache.labels;
 }
 
 void MapDrawer::MakeTooltip(int screenx, int screeny, const std::string &text,
@@ -2166,7 +2903,7 @@ void MapDrawer::AddLight(TileLocation *location) {
 	}
 
 	auto tile = location->get();
-	if (!tile) {
+	if (!tile || !tile->hasLight()) {
 		return;
 	}
 
@@ -2217,17 +2954,51 @@ void MapDrawer::TakeScreenshot(uint8_t *screenshot_buffer) {
 					 (GLubyte *)(screenshot_buffer) + 3 * screensize_x * i);
 }
 
+void MapDrawer::ReadPixels(uint8_t *buffer, int width, int height,
+						   size_t stride) {
+	glFinish();
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	// The framebuffer starts at the bottom row
+	for (int i = 0; i < height; ++i)
+		glReadPixels(0, screensize_y - 1 - i, width, 1, GL_RGB,
+					 GL_UNSIGNED_BYTE, (GLubyte *)(buffer + stride * i));
+}
+
 void MapDrawer::ShowPositionIndicator(const Position &position) {
 	pos_indicator = position;
 	pos_indicator_timer.Start();
 }
 
-void MapDrawer::glBlitTexture(int x, int y, int textureId, int red, int green,
-							  int blue, int alpha, bool adjustZoom) {
-	if (textureId <= 0)
+void MapDrawer::glBlitTexture(int x, int y, const TextureRegion &region,
+							  int red, int green, int blue, int alpha,
+							  bool adjustZoom) {
+	if (region.texture == 0)
 		return;
 
-	glBindTexture(GL_TEXTURE_2D, textureId);
+	if (batching) {
+		float size = rme::TileSize;
+		if (adjustZoom) {
+			if (zoom < 1.0f) {
+				float offset = 10 / (10 * zoom);
+				size = std::max<float>(16, rme::TileSize * zoom);
+				x += offset;
+				y += offset;
+			} else if (zoom > 1.f) {
+				float offset = (10 * zoom);
+				size = rme::TileSize + offset;
+				x -= offset;
+				y -= offset;
+			}
+		}
+		sprite_batch.add(region.texture, x, y, size, size, red, green, blue,
+						 alpha, region.u0, region.v0, region.u1, region.v1);
+		return;
+	}
+
+	g_profiler.count(FrameProfiler::COUNTER_TEXTURE_BINDS);
+	g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS);
+	glBindTexture(GL_TEXTURE_2D, region.texture);
 	glColor4ub(uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
 	glBegin(GL_QUADS);
 
@@ -2244,22 +3015,22 @@ void MapDrawer::glBlitTexture(int x, int y, int textureId, int red, int green,
 			x -= offset;
 			y -= offset;
 		}
-		glTexCoord2f(0.f, 0.f);
+		glTexCoord2f(region.u0, region.v0);
 		glVertex2f(x, y);
-		glTexCoord2f(1.f, 0.f);
+		glTexCoord2f(region.u1, region.v0);
 		glVertex2f(x + size, y);
-		glTexCoord2f(1.f, 1.f);
+		glTexCoord2f(region.u1, region.v1);
 		glVertex2f(x + size, y + size);
-		glTexCoord2f(0.f, 1.f);
+		glTexCoord2f(region.u0, region.v1);
 		glVertex2f(x, y + size);
 	} else {
-		glTexCoord2f(0.f, 0.f);
+		glTexCoord2f(region.u0, region.v0);
 		glVertex2f(x, y);
-		glTexCoord2f(1.f, 0.f);
+		glTexCoord2f(region.u1, region.v0);
 		glVertex2f(x + rme::TileSize, y);
-		glTexCoord2f(1.f, 1.f);
+		glTexCoord2f(region.u1, region.v1);
 		glVertex2f(x + rme::TileSize, y + rme::TileSize);
-		glTexCoord2f(0.f, 1.f);
+		glTexCoord2f(region.u0, region.v1);
 		glVertex2f(x, y + rme::TileSize);
 	}
 
@@ -2268,6 +3039,13 @@ void MapDrawer::glBlitTexture(int x, int y, int textureId, int red, int green,
 
 void MapDrawer::glBlitSquare(int x, int y, int red, int green, int blue,
 							 int alpha) {
+	if (batching) {
+		sprite_batch.add(0, x, y, rme::TileSize, rme::TileSize, red, green,
+						 blue, alpha);
+		return;
+	}
+
+	g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS);
 	glColor4ub(uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
 	glBegin(GL_QUADS);
 	glVertex2f(x, y);
@@ -2278,6 +3056,13 @@ void MapDrawer::glBlitSquare(int x, int y, int red, int green, int blue,
 }
 
 void MapDrawer::glBlitSquare(int x, int y, const wxColor &color) {
+	if (batching) {
+		sprite_batch.add(0, x, y, rme::TileSize, rme::TileSize, color.Red(),
+						 color.Green(), color.Blue(), color.Alpha());
+		return;
+	}
+
+	g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS);
 	glColor4ub(color.Red(), color.Green(), color.Blue(), color.Alpha());
 	glBegin(GL_QUADS);
 	glVertex2f(x, y);
@@ -2287,54 +3072,59 @@ void MapDrawer::glBlitSquare(int x, int y, const wxColor &color) {
 	glEnd();
 }
 
+void MapDrawer::FlushBatch() {
+	sprite_batch.flush();
+	batching = false;
+}
+
 void MapDrawer::glColor(const wxColor &color) {
 	glColor4ub(color.Red(), color.Green(), color.Blue(), color.Alpha());
 }
 
 void MapDrawer::glColor(MapDrawer::BrushColor color) {
+	glColor(getBrushColor(color));
+}
+
+void MapDrawer::glColorCheck(Brush *brush, const Position &pos) {
+	glColor(getCheckColor(brush, pos));
+}
+
+wxColor MapDrawer::getBrushColor(MapDrawer::BrushColor color) const {
+	const std::shared_ptr<const SettingsSnapshot> settings =
+		g_settings.getSnapshot();
 	switch (color) {
-	case COLOR_BRUSH:
-		glColor4ub(g_settings.getInteger(Config::CURSOR_RED),
-				   g_settings.getInteger(Config::CURSOR_GREEN),
-				   g_settings.getInteger(Config::CURSOR_BLUE),
-				   g_settings.getInteger(Config::CURSOR_ALPHA));
-		break;
+	case COLOR_BRUSH: {
+		const uint8_t *rgba = settings->cursor_color;
+		return wxColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+	}
 
 	case COLOR_FLAG_BRUSH:
-	case COLOR_HOUSE_BRUSH:
-		glColor4ub(g_settings.getInteger(Config::CURSOR_ALT_RED),
-				   g_settings.getInteger(Config::CURSOR_ALT_GREEN),
-				   g_settings.getInteger(Config::CURSOR_ALT_BLUE),
-				   g_settings.getInteger(Config::CURSOR_ALT_ALPHA));
-		break;
+	case COLOR_HOUSE_BRUSH: {
+		const uint8_t *rgba = settings->cursor_alt_color;
+		return wxColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+	}
 
 	case COLOR_SPAWN_BRUSH:
-		glColor4ub(166, 0, 0, 128);
-		break;
+		return wxColor(166, 0, 0, 128);
 
 	case COLOR_ERASER:
-		glColor4ub(166, 0, 0, 128);
-		break;
+		return wxColor(166, 0, 0, 128);
 
 	case COLOR_VALID:
-		glColor4ub(0, 166, 0, 128);
-		break;
+		return wxColor(0, 166, 0, 128);
 
 	case COLOR_INVALID:
-		glColor4ub(166, 0, 0, 128);
-		break;
+		return wxColor(166, 0, 0, 128);
 
 	default:
-		glColor4ub(255, 255, 255, 128);
-		break;
+		return wxColor(255, 255, 255, 128);
 	}
 }
 
-void MapDrawer::glColorCheck(Brush *brush, const Position &pos) {
+wxColor MapDrawer::getCheckColor(Brush *brush, const Position &pos) {
 	if (brush->canDraw(&editor.getMap(), pos))
-		glColor(COLOR_VALID);
-	else
-		glColor(COLOR_INVALID);
+		return getBrushColor(COLOR_VALID);
+	return getBrushColor(COLOR_INVALID);
 }
 
 void MapDrawer::drawRect(int x, int y, int w, int h, const wxColor &color,
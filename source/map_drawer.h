@@ -21,7 +21,10 @@
 #include <iostream>
 #include <memory>
 #include <unordered_map>
-#include <unordered_set>
+
+#include "glyph_atlas.h"
+#include "minimap_cache.h"
+#include "sprite_batch.h"
 
 class GameSprite;
 class LassoSelection;
@@ -61,6 +64,8 @@ class DrawingOptions {
 	bool isTooltips() const noexcept;
 	bool isDrawLight() const noexcept;
 
+	bool operator==(const DrawingOptions &other) const = default;
+
 	bool transparent_floors;
 	bool transparent_items;
 	bool show_ingame_box;
@@ -89,110 +94,19 @@ class DrawingOptions {
 	bool show_pickupables;
 	bool show_moveables;
 	bool hide_items_when_zoomed;
+	bool show_profiler;
 };
 
 class MapCanvas;
 class LightDrawer;
 
-struct FinderPosition {
-	FinderPosition() {}
-	FinderPosition(int _x, int _y, int _z) : x(_x), y(_y), z(_z) {}
-	int x, y, z;
-
-	bool operator==(const FinderPosition &other) const {
-		return x == other.x && y == other.y && z == other.z;
-	}
-
-	double distance(const FinderPosition &b) const {
-		return std::sqrt(std::pow(x - b.x, 2) + std::pow(y - b.y, 2));
-	}
-
-	struct Hash {
-		size_t operator()(const FinderPosition &p) const {
-			return p.x ^ p.y ^ p.z;
-		}
-	};
-};
-
-class ZoneFinder {
-  private:
-	std::unordered_set<FinderPosition, FinderPosition::Hash> positions;
-	std::vector<std::vector<FinderPosition>> zones;
-	std::unordered_set<FinderPosition, FinderPosition::Hash> visited;
-
-	bool isValid(const FinderPosition &pos) {
-		return positions.find(pos) != positions.end() &&
-			   visited.find(pos) == visited.end();
-	}
-
-	void dfs(const FinderPosition &pos, std::vector<FinderPosition> &zone) {
-		if (visited.find(pos) != visited.end()) {
-			return;
-		}
-
-		visited.insert(pos);
-		zone.push_back(pos);
-
-		std::vector<FinderPosition> neighbors = {{pos.x + 1, pos.y, pos.z},
-												 {pos.x - 1, pos.y, pos.z},
-												 {pos.x, pos.y + 1, pos.z},
-												 {pos.x, pos.y - 1, pos.z}};
-
-		for (const auto &next : neighbors) {
-			if (isValid(next)) {
-				dfs(next, zone);
-			}
-		}
-	}
-
-  public:
-	ZoneFinder(const std::vector<FinderPosition> &inputPositions)
-		: positions(inputPositions.begin(), inputPositions.end()) {}
-
-	std::vector<std::vector<FinderPosition>> findZones() {
-		for (const auto &pos : positions) {
-			if (visited.find(pos) == visited.end()) {
-				std::vector<FinderPosition> zone;
-				dfs(pos, zone);
-				zones.push_back(zone);
-			}
-		}
-
-		return zones;
-	}
-
-	FinderPosition
-	findClosestToCenter(const std::vector<FinderPosition> &zone) {
-		FinderPosition centroid = {0, 0, 0};
-		for (const auto &pos : zone) {
-			centroid.x += pos.x;
-			centroid.y += pos.y;
-			centroid.z += pos.z;
-		}
-
-		centroid.x /= zone.size();
-		centroid.y /= zone.size();
-		centroid.z /= zone.size();
-
-		double minDistance = std::numeric_limits<double>::max();
-		FinderPosition closestPosition;
-		for (const auto &pos : zone) {
-			const double dist = pos.distance(centroid);
-			if (dist < minDistance) {
-				minDistance = dist;
-				closestPosition = pos;
-			}
-		}
-
-		return closestPosition;
-	}
-};
-
 class MapDrawer {
 	MapCanvas *canvas;
 	Editor &editor;
 	DrawingOptions options;
 	std::shared_ptr<LightDrawer> light_drawer;
+	SpriteBatch sprite_batch;
+	bool batching;
 
 	float zoom;
 
@@ -206,14 +120,129 @@ class MapDrawer {
 	int tile_size;
 	int floor;
 
+	// The view the sprites were last prefetched for
+	int prefetch_start_x, prefetch_start_y, prefetch_start_z;
+	int prefetch_end_x, prefetch_end_y;
+	std::vector<GameSprite *> prefetch_sprites;
+
+	// Everything the drawing of a leaf depends on besides its tiles
+	struct NodeCacheState {
+		DrawingOptions options;
+		float zoom = 0.f;
+		int floor = -1;
+		uint32_t house_id = 0;
+		uint32_t tiles_revision = 0;
+		uint32_t texture_revision = 0;
+
+		bool operator==(const NodeCacheState &other) const = default;
+	};
+
+	// The quads the tiles of a leaf were drawn with on one floor
+	struct NodeCache {
+		SpriteBatch::Recording recording;
+		uint32_t revision = 0;
+		uint32_t state = 0;
+		uint32_t used = 0;
+		int scroll_x = 0;
+		int scroll_y = 0;
+	};
+
+	std::unordered_map<uint64_t, NodeCache> node_cache;
+	// Marks the leaves of the see-through floor of DrawHigherFloors in the keys
+	// of the node cache
+	static constexpr uint64_t HigherFloorKey = 0x80;
+
+	// The same for the leaves of the secondary map, the copy buffer or the
+	// doodad preview. It follows the cursor, so the quads are recorded relative
+	// to where the first tile of the buffer would be drawn and replayed moved.
+	struct SecondaryCache {
+		uint32_t map_id = 0;
+		Position normal_pos;
+		std::unordered_map<uint64_t, NodeCache> leaves;
+	};
+	SecondaryCache secondary_cache;
+	NodeCacheState node_cache_state;
+	uint32_t node_cache_id;
+	uint32_t draw_count;
+	size_t nodes_drawn;
+	bool node_caching;
+	bool node_replayed;
+	// Set while DrawNode draws tiles to be recorded, the selection isn't
+	// tinted then; set while ShadeNode goes over the same tiles, only the
+	// selected items are drawn then, in black
+	bool selection_deferred;
+	bool selection_shading;
+
+	// From Config::OVERVIEW_ZOOM on, the floor is drawn from the minimap colours
+	// of the editor, one texture for every page of OverviewPageSize tiles
+	static constexpr int OverviewPageSize = 256;
+	static constexpr int OverviewPageBlocks =
+		OverviewPageSize / MinimapCache::BlockSize;
+	struct OverviewPage {
+		GLuint texture = 0;
+		uint32_t versions[OverviewPageBlocks * OverviewPageBlocks] = {};
+		uint32_t used = 0;
+	};
+
+	std::unordered_map<uint32_t, OverviewPage> overview_pages;
+	bool overview;
+
+	// Which tiles of a leaf have a ground covering their whole square, on one
+	// floor, kept until the leaf changes
+	struct OpaqueCache {
+		uint32_t revision = 0;
+		uint32_t tiles_revision = 0;
+		uint16_t mask = 0;
+	};
+
+	// When several floors are drawn, the topmost floor with an opaque ground on
+	// each square of the view, 0xFF for none; the leaves below it are skipped
+	std::unordered_map<uint64_t, OpaqueCache> opaque_cache;
+	std::vector<uint8_t> cover;
+	int cover_x, cover_y, cover_width, cover_height;
+	bool culling;
+
   protected:
-	std::unordered_map<uint16_t, std::vector<FinderPosition>> zoneTiles;
+	// A label for every group of connected tiles with the same zone id in
+	// view, found again only once the view or the map changes
+	struct ZoneLabel {
+		int x = 0, y = 0;
+		std::string text;
+	};
+	struct ZoneLabelCache {
+		uint32_t revision = 0;
+		int z = -1;
+		int start_x = 0, start_y = 0, end_x = -1, end_y = -1;
+		std::vector<ZoneLabel> labels;
+	};
+	ZoneLabelCache zone_labels;
 	std::vector<MapTooltip *> tooltips;
 	std::ostringstream tooltip;
 
+	// Where the characters of a tooltip go, in pixels from the baseline of its
+	// first line. Tiles showing the same text share a layout, one that isn't
+	// shown in a frame is dropped.
+	struct TooltipLayout {
+		struct Character {
+			int16_t x;
+			int16_t line;
+			char c;
+		};
+		std::vector<Character> characters;
+		int width = 0;
+		int height = 0;
+		uint32_t used = 0;
+	};
+	std::unordered_map<std::string, TooltipLayout> tooltip_layouts;
+	// Shared by every view, like the sprite textures
+	GlyphAtlas &glyph_atlas;
+
 	wxStopWatch pos_indicator_timer;
 	Position pos_indicator;
 
+	// The frame every animated item type in view was last drawn with
+	std::unordered_map<uint16_t, int> drawn_animations;
+
   public:
 	MapDrawer(MapCanvas *canvas);
 	~MapDrawer();
@@ -222,13 +251,18 @@ class MapDrawer {
 	bool dragging_draw;
 
 	void SetupVars();
+	// Sets up drawing the map at 1:1 from the scroll position instead of what
+	// the canvas shows, everything else stays as the canvas has it
+	void SetupView(int scroll_x, int scroll_y);
 	void SetupGL();
 	void Release();
 
 	void Draw();
 	void DrawBackground();
 	void DrawShade(int mapz);
+	void PrefetchSprites();
 	void DrawMap();
+	void DrawOverview();
 	void DrawSecondaryMap(int mapz);
 	void DrawDraggingShadow();
 	void DrawHigherFloors();
@@ -239,8 +273,13 @@ class MapDrawer {
 	void DrawIngameBox();
 	void DrawGrid();
 	void DrawTooltips();
+	// The frame profiler averages, over the top left corner of the view
+	void DrawProfiler();
 
 	void TakeScreenshot(uint8_t *screenshot_buffer);
+	// Reads the top left width x height pixels drawn, as RGB rows stride bytes
+	// apart
+	void ReadPixels(uint8_t *buffer, int width, int height, size_t stride);
 
 	void ShowPositionIndicator(const Position &position);
 	long GetPositionIndicatorTime() const {
@@ -251,6 +290,10 @@ class MapDrawer {
 		return 0;
 	}
 
+	// Whether an animated item drawn in the last frame would be drawn with
+	// another frame now, the static leaves are replayed from the node cache
+	bool HasAnimationAdvanced() const;
+
 	DrawingOptions &getOptions() noexcept { return options; }
 
   protected:
@@ -273,6 +316,36 @@ class MapDrawer {
 					  Direction dir, int red = 255, int green = 255,
 					  int blue = 255, int alpha = 255);
 	void DrawTile(TileLocation *tile);
+	// Moves an item to the current frame of its animation and remembers it
+	void AnimateItem(Item *item);
+	// Draws the tiles of a leaf on one floor, or what they were drawn as before
+	// if nothing changed since
+	void DrawNode(QTreeNode *node, int map_x, int map_y, int map_z);
+	// Darkens the selected items of a leaf over what DrawNode drew, the
+	// recorded leaves leave the selection out
+	void ShadeNode(QTreeNode *node, int map_x, int map_y, int map_z);
+	void ShadeTile(TileLocation *location);
+	void DrawSecondaryTile(const Tile *tile, int draw_x, int draw_y);
+	// The same for the floor above the current one, drawn see-through
+	void DrawHigherNode(QTreeNode *node, int map_x, int map_y, int map_z);
+	void DrawHigherTile(TileLocation *location);
+	// The tiles and floors in view, from the scroll position, zoom and floor
+	void SetupRange();
+	uint16_t GetOpaqueMask(QTreeNode *node, int map_x, int map_y, int map_z);
+	void BuildCover();
+	// Whether the floors above hide the leaf at map_x, map_y on map_z, along
+	// with the squares up and left of it that its larger sprites reach into
+	bool IsCovered(int map_x, int map_y, int map_z) const;
+	int GetSquareOffset(int map_z) const noexcept {
+		return map_z <= rme::MapGroundLayer ? rme::MapGroundLayer - map_z
+											: floor - map_z;
+	}
+	// The texture of the overview page starting at map_x, map_y, brought up to
+	// date with the blocks of the minimap cache that changed
+	GLuint GetOverviewPage(int map_x, int map_y, int map_z);
+	void ClearOverviewPages();
+	void BeginNodeCache();
+	void EndNodeCache();
 	void DrawBrushIndicator(int x, int y, Brush *brush, uint8_t r, uint8_t g,
 							uint8_t b);
 	void DrawHookIndicator(int x, int y, const ItemType &type);
@@ -282,8 +355,11 @@ class MapDrawer {
 	void DrawPositionIndicator(int z);
 	void WriteTooltip(Tile *tile, const Item *item, std::ostringstream &stream);
 	void WriteTooltip(const Waypoint *item, std::ostringstream &stream);
+	const std::vector<ZoneLabel> &GetZoneLabels(int start_x, int start_y,
+												int end_x, int end_y, int z);
 	void MakeTooltip(int screenx, int screeny, const std::string &text,
 					 uint8_t r = 255, uint8_t g = 255, uint8_t b = 255);
+	const TooltipLayout &GetTooltipLayout(const MapTooltip &tooltip);
 	void AddLight(TileLocation *location);
 
 	enum BrushColor {
@@ -299,17 +375,23 @@ class MapDrawer {
 
 	void getColor(Brush *brush, const Position &position, uint8_t &r,
 				  uint8_t &g, uint8_t &b);
-	void glBlitTexture(int x, int y, int textureId, int red, int green,
-					   int blue, int alpha, bool adjustZoom = false);
+	void glBlitTexture(int x, int y, const TextureRegion &region, int red,
+					   int green, int blue, int alpha, bool adjustZoom = false);
 	void glBlitSquare(int x, int y, int red, int green, int blue, int alpha);
 	void glBlitSquare(int x, int y, const wxColor &color);
 	void glColor(const wxColor &color);
 	void glColor(BrushColor color);
 	void glColorCheck(Brush *brush, const Position &pos);
+	wxColor getBrushColor(BrushColor color) const;
+	wxColor getCheckColor(Brush *brush, const Position &pos);
 	void drawRect(int x, int y, int w, int h, const wxColor &color,
 				  int width = 1);
 	void drawFilledRect(int x, int y, int w, int h, const wxColor &color);
 
+	// Sprites and squares blitted in between are collected and drawn by FlushBatch
+	void BeginBatch() noexcept { batching = true; }
+	void FlushBatch();
+
   private:
 	void getDrawPosition(const Position &position, int &x, int &y);
 };
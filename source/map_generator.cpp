@@ -0,0 +1,681 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "map_generator.h"
+#include "brush.h"
+#include "complexitem.h"
+#include "creature.h"
+#include "creatures.h"
+#include "ground_brush.h"
+#include "gui.h"
+#include "iomap_otbm.h"
+#include "map.h"
+#include "thread_pool.h"
+#include "wall_brush.h"
+
+namespace {
+	constexpr int AreaSize = 256;
+	// Houses and spawns get a cell of their own, so they can be placed without looking at the others
+	constexpr int HouseCell = 32;
+	constexpr int SpawnCell = 32;
+	constexpr int ZoneCell = 64;
+
+	enum : uint32_t {
+		SaltHouse = 1,
+		SaltContainer,
+		SaltSpawn,
+		SaltZone,
+		SaltCreature = 16,
+		SaltNoise = 256,
+	};
+
+	GroundBrush* findGround(std::initializer_list<const char*> names)
+	{
+		for(const char* name : names) {
+			Brush* brush = g_brushes.getBrush(name);
+			if(brush && brush->isGround()) {
+				return brush->asGround();
+			}
+		}
+		return nullptr;
+	}
+
+	WallBrush* findWall(std::initializer_list<const char*> names)
+	{
+		for(const char* name : names) {
+			Brush* brush = g_brushes.getBrush(name);
+			if(brush && brush->isWall()) {
+				return brush->asWall();
+			}
+		}
+		return nullptr;
+	}
+}
+
+MapGenerator::MapGenerator(Map& map, const Options& options) :
+	map(map),
+	options(options),
+	sea(nullptr),
+	sand(nullptr),
+	grass(nullptr),
+	mountain(nullptr),
+	cave(nullptr),
+	floor(nullptr),
+	wall(nullptr),
+	tile_count(0),
+	item_count(0),
+	spawn_count(0)
+{
+	this->options.floors = std::max(1, std::min(options.floors, rme::MapLayers));
+}
+
+bool MapGenerator::findContent()
+{
+	grass = findGround({ "grass" });
+	if(!grass) {
+		// Any ground will do for a version without the usual materials
+		for(const auto& entry : g_brushes.getMap()) {
+			if(entry.second->isGround()) {
+				grass = entry.second->asGround();
+				break;
+			}
+		}
+	}
+	if(!grass) {
+		error = "The client version has no ground brushes to generate a map with.";
+		return false;
+	}
+
+	sea = findGround({ "sea", "clear water" });
+	sand = findGround({ "sand", "earth" });
+	mountain = findGround({ "mountain" });
+	cave = findGround({ "cave", "earth" });
+	floor = findGround({ "wooden floor", "cobblestone" });
+	wall = findWall({ "stone wall", "brick wall", "wooden wall" });
+	sea = sea ? sea : grass;
+	sand = sand ? sand : grass;
+	mountain = mountain ? mountain : grass;
+	cave = cave ? cave : grass;
+	floor = floor ? floor : grass;
+
+	// A few of each are enough for the distributions to look like a real map
+	for(int id = 100; id <= g_items.getMaxID(); ++id) {
+		const ItemType& type = g_items.getItemType(id);
+		if(type.id == 0 || !type.pickupable) {
+			continue;
+		}
+		if(type.isContainer() && type.getVolume() >= 4) {
+			if(containers.size() < 8) {
+				containers.push_back(id);
+			}
+		} else if(!type.isContainer() && !type.isFluidContainer() && loot.size() < 32) {
+			loot.push_back(id);
+		}
+	}
+
+	for(auto it = g_creatures.begin(); it != g_creatures.end() && monsters.size() < 16; ++it) {
+		if(!it->second->isNpc) {
+			monsters.push_back(it->second);
+		}
+	}
+	return true;
+}
+
+std::vector<int> MapGenerator::prepare(const std::string& name)
+{
+	map.setWidth(options.width);
+	map.setHeight(options.height);
+	options.width = map.getWidth();
+	options.height = map.getHeight();
+
+	if(!name.empty()) {
+		map.setSpawnFilename(name + "-spawn.xml");
+		map.setHouseFilename(name + "-house.xml");
+	}
+	map.setMapDescription("Generated with seed " + std::to_string(options.seed) + ".");
+
+	Town* town = newd Town(1);
+	town->setName("Generated");
+	town->setTemplePosition(Position(options.width / 2, options.height / 2, rme::MapGroundLayer));
+	map.towns.addTown(town);
+
+	// The ground floor goes first, the houses are created there before their storeys
+	std::vector<int> floors;
+	floors.push_back(rme::MapGroundLayer);
+	if(options.floors > 1) {
+		floors.push_back(rme::MapGroundLayer - 1);
+	}
+	for(int z = rme::MapGroundLayer + 1; z < rme::MapLayers && int(floors.size()) < options.floors; ++z) {
+		floors.push_back(z);
+	}
+	for(int z = rme::MapGroundLayer - 2; z >= 0 && int(floors.size()) < options.floors; --z) {
+		floors.push_back(z);
+	}
+	return floors;
+}
+
+bool MapGenerator::generate(const FileName& filename)
+{
+	if(!findContent()) {
+		return false;
+	}
+
+	const std::vector<int> floors = prepare(nstr(filename.GetName()));
+
+	IOMapOTBM io(map.getVersion());
+	if(!io.beginStream(map, filename)) {
+		error = nstr(io.getError());
+		return false;
+	}
+
+	const int areas_x = (options.width + AreaSize - 1) / AreaSize;
+	const int areas_y = (options.height + AreaSize - 1) / AreaSize;
+	const int total = areas_x * areas_y;
+	for(int area_y = 0; area_y < areas_y; ++area_y) {
+		for(int area_x = 0; area_x < areas_x; ++area_x) {
+			// Every area is made in a map of its own, which is freed once it is written
+			Map part;
+			for(int z : floors) {
+				generateFloor(part, area_x * AreaSize, area_y * AreaSize, z);
+			}
+
+			for(MapIterator it = part.begin(); it != part.end(); ++it) {
+				const Tile* tile = (*it)->get();
+				if(tile && tile->size() > 0) {
+					++tile_count;
+					item_count += tile->size();
+				}
+			}
+			io.streamPart(part);
+
+			const int done = area_y * areas_x + area_x + 1;
+			if(!g_gui.SetLoadDone(int(done * 100ll / total))) {
+				// Finished anyway, so what was written so far is still a valid map
+				io.finishStream(map, filename);
+				error = "The generation was cancelled, the map only has the areas generated so far.";
+				return false;
+			}
+		}
+	}
+
+	if(!io.finishStream(map, filename)) {
+		error = nstr(io.getError());
+		return false;
+	}
+	return true;
+}
+
+void MapGenerator::generateFloor(Map& part, int area_x, int area_y, int z)
+{
+	const int end_x = std::min(area_x + AreaSize, options.width);
+	const int end_y = std::min(area_y + AreaSize, options.height);
+
+	// The tiles around the area are drawn too, so the borders along its edges see their neighbours
+	const int margin_start_x = std::max(area_x - 1, 0);
+	const int margin_start_y = std::max(area_y - 1, 0);
+	const int margin_end_x = std::min(end_x, options.width - 1);
+	const int margin_end_y = std::min(end_y, options.height - 1);
+	for(int y = margin_start_y; y <= margin_end_y; ++y) {
+		for(int x = margin_start_x; x <= margin_end_x; ++x) {
+			GroundBrush* brush = getGround(x, y, z);
+			if(!brush) {
+				continue;
+			}
+			Tile* tile = part.allocator(part.createTileL(x, y, z));
+			drawGround(tile, brush);
+			part.setTile(tile);
+		}
+	}
+
+	for(int y = area_y; y < end_y; ++y) {
+		for(int x = area_x; x < end_x; ++x) {
+			Tile* tile = part.getTile(x, y, z);
+			if(tile && tile->hasGround()) {
+				tile->borderize(&part);
+			}
+		}
+	}
+
+	placeObjects(part, area_x, area_y, end_x, end_y, z);
+
+	// The margin belongs to the neighbouring areas, which write it themselves
+	auto removeMargin = [&](int x, int y) {
+		if(x >= 0 && y >= 0 && x < options.width && y < options.height) {
+			delete part.swapTile(x, y, z, nullptr);
+		}
+	};
+	for(int x = area_x - 1; x <= end_x; ++x) {
+		removeMargin(x, area_y - 1);
+		removeMargin(x, end_y);
+	}
+	for(int y = area_y; y < end_y; ++y) {
+		removeMargin(area_x - 1, y);
+		removeMargin(end_x, y);
+	}
+}
+
+bool MapGenerator::generateMap(const std::function<bool(int)>& progress)
+{
+	if(!findContent()) {
+		return false;
+	}
+
+	const std::vector<int> floors = prepare(std::string());
+	const int areas_x = (options.width + AreaSize - 1) / AreaSize;
+	const int areas_y = (options.height + AreaSize - 1) / AreaSize;
+
+	// The grounds take most of the time, they go first on every floor so the borders can be put
+	// on the whole map at once, then the houses, spawns and zones go on top area by area
+	const int total = int(floors.size()) * areas_y * 2;
+	int done = 0;
+	auto step = [&]() {
+		++done;
+		return !progress || progress(std::min(done * 100 / total, 99));
+	};
+
+	for(int z : floors) {
+		for(int area_y = 0; area_y < areas_y; ++area_y) {
+			placeTerrain(area_y, z);
+			if(!step()) {
+				error = "The generation was cancelled.";
+				return false;
+			}
+		}
+	}
+
+	map.borderize();
+
+	for(int z : floors) {
+		for(int area_y = 0; area_y < areas_y; ++area_y) {
+			for(int area_x = 0; area_x < areas_x; ++area_x) {
+				const int end_x = std::min((area_x + 1) * AreaSize, options.width);
+				const int end_y = std::min((area_y + 1) * AreaSize, options.height);
+				placeObjects(map, area_x * AreaSize, area_y * AreaSize, end_x, end_y, z);
+			}
+			if(!step()) {
+				error = "The generation was cancelled.";
+				return false;
+			}
+		}
+	}
+
+	for(MapIterator it = map.begin(); it != map.end(); ++it) {
+		const Tile* tile = (*it)->get();
+		if(tile && tile->size() > 0) {
+			++tile_count;
+			item_count += tile->size();
+		}
+	}
+	return true;
+}
+
+void MapGenerator::placeTerrain(int area_y, int z)
+{
+	ThreadPool& pool = ThreadPool::getInstance();
+	const int areas_x = (options.width + AreaSize - 1) / AreaSize;
+	const int start_y = area_y * AreaSize;
+	const int end_y = std::min(start_y + AreaSize, options.height);
+
+	// The terrain is worked out for every area in parallel, only creating the locations changes
+	// the tree, which happens on this thread
+	std::vector<PositionVector> positions(areas_x);
+	std::vector<std::vector<GroundBrush*>> brushes(areas_x);
+	pool.parallelFor(areas_x, [&](size_t area_x) {
+		const int start_x = int(area_x) * AreaSize;
+		const int end_x = std::min(start_x + AreaSize, options.width);
+		for(int y = start_y; y < end_y; ++y) {
+			for(int x = start_x; x < end_x; ++x) {
+				if(GroundBrush* brush = getGround(x, y, z)) {
+					positions[area_x].push_back(Position(x, y, z));
+					brushes[area_x].push_back(brush);
+				}
+			}
+		}
+	});
+
+	std::vector<std::vector<TileLocation*>> locations(areas_x);
+	for(int area_x = 0; area_x < areas_x; ++area_x) {
+		locations[area_x] = map.createTileLocations(positions[area_x]);
+	}
+
+	std::vector<std::vector<Tile*>> tiles(areas_x);
+	pool.parallelFor(areas_x, [&](size_t area_x) {
+		tiles[area_x].reserve(locations[area_x].size());
+		for(size_t index = 0; index < locations[area_x].size(); ++index) {
+			Tile* tile = map.allocator(locations[area_x][index]);
+			drawGround(tile, brushes[area_x][index]);
+			tiles[area_x].push_back(tile);
+		}
+	});
+
+	for(const std::vector<Tile*>& area : tiles) {
+		for(Tile* tile : area) {
+			map.setTile(tile);
+		}
+	}
+}
+
+void MapGenerator::placeObjects(Map& part, int area_x, int area_y, int end_x, int end_y, int z)
+{
+	const int cell_end_x = (end_x - 1) / HouseCell;
+	const int cell_end_y = (end_y - 1) / HouseCell;
+	for(int cell_y = area_y / HouseCell; cell_y <= cell_end_y; ++cell_y) {
+		for(int cell_x = area_x / HouseCell; cell_x <= cell_end_x; ++cell_x) {
+			placeHouse(part, cell_x, cell_y, z);
+		}
+	}
+
+	if(z >= rme::MapGroundLayer) {
+		for(int cell_y = area_y / SpawnCell; cell_y <= (end_y - 1) / SpawnCell; ++cell_y) {
+			for(int cell_x = area_x / SpawnCell; cell_x <= (end_x - 1) / SpawnCell; ++cell_x) {
+				placeSpawn(part, cell_x, cell_y, z);
+			}
+		}
+	}
+
+	if(z == rme::MapGroundLayer) {
+		for(int cell_y = area_y / ZoneCell; cell_y <= (end_y - 1) / ZoneCell; ++cell_y) {
+			for(int cell_x = area_x / ZoneCell; cell_x <= (end_x - 1) / ZoneCell; ++cell_x) {
+				placeZone(part, cell_x, cell_y, z);
+			}
+		}
+	}
+}
+
+void MapGenerator::placeHouse(Map& part, int cell_x, int cell_y, int z)
+{
+	Rect rect;
+	if(!getHouse(cell_x, cell_y, z, rect)) {
+		return;
+	}
+
+	const uint32_t id = getHouseId(cell_x, cell_y);
+	House* house = map.houses.getHouse(id);
+	if(!house) {
+		house = newd House(map);
+		house->id = id;
+		house->name = "Generated house " + std::to_string(id);
+		house->townid = 1;
+		map.houses.addHouse(house);
+	}
+
+	// Walled in, with a gap in the middle of the front on the ground floor
+	const int door_x = rect.x + rect.width / 2;
+	const int door_y = rect.y + rect.height - 1;
+	std::vector<Tile*> walls;
+	for(int y = rect.y; y < rect.y + rect.height; ++y) {
+		for(int x = rect.x; x < rect.x + rect.width; ++x) {
+			Tile* tile = part.getTile(x, y, z);
+			if(!tile) {
+				continue;
+			}
+
+			const bool edge = x == rect.x || y == rect.y || x == rect.x + rect.width - 1 || y == door_y;
+			const bool door = z == rme::MapGroundLayer && x == door_x && y == door_y;
+			if(edge && !door) {
+				if(wall) {
+					wall->draw(&part, tile, nullptr);
+					walls.push_back(tile);
+				}
+			} else {
+				house->addTile(tile);
+				tile->setPZ(true);
+			}
+		}
+	}
+	for(Tile* tile : walls) {
+		tile->wallize(&part);
+	}
+
+	if(z == rme::MapGroundLayer) {
+		house->setExit(&part, Position(door_x, door_y + 1, z));
+	}
+	house->rent = int(house->size()) * 50;
+
+	placeContainer(part.getTile(rect.x + 1, rect.y + 1, z), hash(cell_x, cell_y, z, SaltContainer));
+}
+
+void MapGenerator::placeContainer(Tile* tile, uint32_t random)
+{
+	if(!tile || containers.empty()) {
+		return;
+	}
+
+	auto create = [&](uint32_t index) -> Container* {
+		Item* item = Item::Create(containers[index % containers.size()]);
+		Container* container = item ? item->getContainer() : nullptr;
+		if(!container) {
+			delete item;
+		}
+		return container;
+	};
+	auto fill = [&](Container* container, int count, uint32_t seed) {
+		for(int index = 0; index < count && !loot.empty(); ++index) {
+			Item* item = Item::Create(loot[(seed >> (index * 4)) % loot.size()]);
+			if(item) {
+				container->getVector().push_back(item);
+				++item_count;
+			}
+		}
+	};
+
+	// A box with some loot and a bag holding some more
+	Container* container = create(random);
+	if(!container) {
+		return;
+	}
+	fill(container, 1 + (random >> 4) % 4, random >> 8);
+
+	Container* inner = create(random >> 12);
+	if(inner) {
+		fill(inner, 1 + (random >> 16) % 3, random >> 18);
+		container->getVector().push_back(inner);
+		++item_count;
+	}
+	tile->addItem(container);
+}
+
+void MapGenerator::placeSpawn(Map& part, int cell_x, int cell_y, int z)
+{
+	const uint32_t random = hash(cell_x, cell_y, z, SaltSpawn);
+	if(monsters.empty() || random % 3 != 0) {
+		return;
+	}
+
+	auto isOpen = [&](const Tile* tile) {
+		if(!tile || tile->isHouseTile() || tile->getWall()) {
+			return false;
+		}
+		const GroundBrush* brush = tile->getGroundBrush();
+		return brush == grass || brush == sand || brush == cave;
+	};
+
+	// The radius stays within the cell
+	const int radius = 2 + (random >> 4) % 3;
+	const Position center(cell_x * SpawnCell + 8 + (random >> 8) % 16, cell_y * SpawnCell + 8 + (random >> 12) % 16, z);
+	Tile* tile = part.getTile(center);
+	if(!isOpen(tile)) {
+		return;
+	}
+
+	tile->spawn = newd Spawn(radius);
+	part.addSpawn(tile);
+	++spawn_count;
+
+	const int count = 1 + (random >> 16) % 3;
+	const int side = radius * 2 + 1;
+	for(int index = 0; index < count; ++index) {
+		const uint32_t place = hash(cell_x, cell_y, z, SaltCreature + index);
+		Tile* creature_tile = part.getTile(center.x - radius + int(place % side), center.y - radius + int((place >> 8) % side), z);
+		if(!isOpen(creature_tile) || creature_tile->creature) {
+			continue;
+		}
+
+		Creature* creature = newd Creature(monsters[(place >> 16) % monsters.size()]);
+		creature->setSpawnTime(60);
+		creature_tile->creature = creature;
+		part.spawns.addCreature(creature_tile->getPosition());
+	}
+}
+
+void MapGenerator::placeZone(Map& part, int cell_x, int cell_y, int z)
+{
+	const uint32_t random = hash(cell_x, cell_y, z, SaltZone);
+	if(random % 8 != 0) {
+		return;
+	}
+
+	const uint16_t zone = 1 + (random >> 4) % 32;
+	const int start_x = cell_x * ZoneCell + 8 + (random >> 8) % 40;
+	const int start_y = cell_y * ZoneCell + 8 + (random >> 16) % 40;
+	for(int y = start_y; y < start_y + 16; ++y) {
+		for(int x = start_x; x < start_x + 16; ++x) {
+			Tile* tile = part.getTile(x, y, z);
+			if(tile && tile->hasGround()) {
+				tile->setMapFlags(TILESTATE_ZONE_BRUSH);
+				tile->addZoneId(zone);
+			}
+		}
+	}
+}
+
+void MapGenerator::drawGround(Tile* tile, GroundBrush* brush) const
+{
+	// Rolled from the position instead of the shared random generator, the grounds are drawn by
+	// several threads and the same seed gives the same map
+	const Position position = tile->getPosition();
+	const uint16_t id = brush->getGroundItem(position_random(position.x, position.y, position.z, options.seed, 1, brush->getTotalChance()));
+	if(id != 0) {
+		tile->addItem(Item::Create(id));
+	}
+}
+
+GroundBrush* MapGenerator::getGround(int x, int y, int z) const
+{
+	Rect rect;
+	if(z <= rme::MapGroundLayer && getHouse(x / HouseCell, y / HouseCell, z, rect) && rect.contains(x, y)) {
+		return floor;
+	}
+	return getTerrain(x, y, z);
+}
+
+GroundBrush* MapGenerator::getTerrain(int x, int y, int z) const
+{
+	if(x < 0 || y < 0 || x >= options.width || y >= options.height) {
+		return nullptr;
+	}
+
+	if(z == rme::MapGroundLayer) {
+		const double height = noise(x, y, z);
+		if(height < 0.36) {
+			return sea;
+		} else if(height < 0.41) {
+			return sand;
+		} else if(height < 0.66) {
+			return grass;
+		}
+		return mountain;
+	} else if(z > rme::MapGroundLayer) {
+		// Tunnels through the rock
+		return noise(x, y, z) < 0.5 ? nullptr : cave;
+	}
+	// Above the ground there are only the house storeys
+	return nullptr;
+}
+
+bool MapGenerator::getHouse(int cell_x, int cell_y, int z, Rect& rect) const
+{
+	if(z > rme::MapGroundLayer) {
+		return false;
+	}
+
+	const uint32_t random = hash(cell_x, cell_y, 0, SaltHouse);
+	if(random % 4 != 0) {
+		return false;
+	}
+
+	const int storeys = 1 + (random >> 24) % 3;
+	if(rme::MapGroundLayer - z >= storeys) {
+		return false;
+	}
+
+	// Kept off the edges of the cell, the exit is in front of it
+	rect.width = 5 + (random >> 4) % 5;
+	rect.height = 5 + (random >> 8) % 5;
+	rect.x = cell_x * HouseCell + 3 + (random >> 12) % (HouseCell - 6 - rect.width);
+	rect.y = cell_y * HouseCell + 3 + (random >> 18) % (HouseCell - 6 - rect.height);
+	if(rect.x + rect.width >= options.width - 1 || rect.y + rect.height >= options.height - 1) {
+		return false;
+	}
+
+	// Only on open land
+	const int corners[5][2] = {
+		{ rect.x, rect.y }, { rect.x + rect.width - 1, rect.y },
+		{ rect.x, rect.y + rect.height }, { rect.x + rect.width - 1, rect.y + rect.height },
+		{ rect.x + rect.width / 2, rect.y + rect.height / 2 }
+	};
+	for(const auto& corner : corners) {
+		if(getTerrain(corner[0], corner[1], rme::MapGroundLayer) != grass) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t MapGenerator::getHouseId(int cell_x, int cell_y) const
+{
+	return uint32_t(cell_y) * ((options.width + HouseCell - 1) / HouseCell) + uint32_t(cell_x) + 1;
+}
+
+uint32_t MapGenerator::hash(int x, int y, int z, uint32_t salt) const
+{
+	uint32_t value = options.seed ^ (salt * 0x9E3779B9u);
+	value ^= uint32_t(x) * 0x85EBCA6Bu;
+	value = (value ^ (value >> 13)) * 0xC2B2AE35u;
+	value ^= uint32_t(y) * 0x27D4EB2Fu;
+	value = (value ^ (value >> 15)) * 0x165667B1u;
+	value ^= uint32_t(z) * 0x9E3779B1u;
+	value = (value ^ (value >> 16)) * 0x85EBCA6Bu;
+	return value ^ (value >> 13);
+}
+
+double MapGenerator::noise(int x, int y, int z) const
+{
+	// Two octaves of value noise, the large one shapes the land and the small one its coasts
+	double value = 0.0;
+	double weight = 0.0;
+	double amplitude = 1.0;
+	for(int scale : { 64, 16 }) {
+		const int cell_x = x / scale;
+		const int cell_y = y / scale;
+		auto smooth = [](double t) { return t * t * (3.0 - 2.0 * t); };
+		const double fx = smooth(double(x % scale) / scale);
+		const double fy = smooth(double(y % scale) / scale);
+		auto corner = [&](int dx, int dy) {
+			return (hash(cell_x + dx, cell_y + dy, z, SaltNoise + scale) & 0xFFFF) / 65535.0;
+		};
+
+		const double top = corner(0, 0) + (corner(1, 0) - corner(0, 0)) * fx;
+		const double bottom = corner(0, 1) + (corner(1, 1) - corner(0, 1)) * fx;
+		value += (top + (bottom - top) * fy) * amplitude;
+		weight += amplitude;
+		amplitude *= 0.35;
+	}
+	return value / weight;
+}
@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_GENERATOR_H_
+#define RME_MAP_GENERATOR_H_
+
+#include <functional>
+
+class Map;
+class Tile;
+class GroundBrush;
+class WallBrush;
+class CreatureType;
+
+// Makes large maps for prototyping and scale testing out of the brushes of the loaded client
+// version. Terrain, borders, houses with walls, containers, spawns and zones are derived from
+// the seed alone, so the same options always give the same map. The map is either streamed
+// to OTBM one 256x256 area at a time, with only the houses kept in memory for the whole map,
+// or built in memory, with the grounds placed and borderized in parallel.
+class MapGenerator
+{
+public:
+	struct Options {
+		int width = 2048;
+		int height = 2048;
+		// The ground floor first, then the caves below it and the house storeys above it
+		int floors = 3;
+		uint32_t seed = 0;
+	};
+
+	MapGenerator(Map& map, const Options& options);
+
+	// Streams the map to the file, map only gets the header, towns and houses, its tiles
+	// aren't touched
+	bool generate(const FileName& filename);
+	// Generates the map into map, which should be empty. progress(percent) is called on the
+	// calling thread, the generation stops once it returns false.
+	bool generateMap(const std::function<bool(int)>& progress = nullptr);
+
+	const std::string& getError() const noexcept { return error; }
+	uint64_t getTileCount() const noexcept { return tile_count; }
+	uint64_t getItemCount() const noexcept { return item_count; }
+	uint64_t getSpawnCount() const noexcept { return spawn_count; }
+
+private:
+	struct Rect {
+		int x, y, width, height;
+		bool contains(int px, int py) const {
+			return px >= x && px < x + width && py >= y && py < y + height;
+		}
+	};
+
+	// Brushes, item types and creatures picked from the loaded data, false if there's no ground brush
+	bool findContent();
+
+	// The header, the town and the floors to generate, in order
+	std::vector<int> prepare(const std::string& name);
+	void generateFloor(Map& part, int area_x, int area_y, int z);
+	// The grounds of a row of areas of the map, put in parallel
+	void placeTerrain(int area_y, int z);
+	void placeObjects(Map& part, int area_x, int area_y, int end_x, int end_y, int z);
+	void drawGround(Tile* tile, GroundBrush* brush) const;
+	void placeHouse(Map& part, int cell_x, int cell_y, int z);
+	void placeContainer(Tile* tile, uint32_t random);
+	void placeSpawn(Map& part, int cell_x, int cell_y, int z);
+	void placeZone(Map& part, int cell_x, int cell_y, int z);
+
+	GroundBrush* getGround(int x, int y, int z) const;
+	GroundBrush* getTerrain(int x, int y, int z) const;
+	// The house of a cell, false if the cell has none on floor z
+	bool getHouse(int cell_x, int cell_y, int z, Rect& rect) const;
+	uint32_t getHouseId(int cell_x, int cell_y) const;
+
+	uint32_t hash(int x, int y, int z, uint32_t salt) const;
+	// Smooth value noise from 0 to 1
+	double noise(int x, int y, int z) const;
+
+	Map& map;
+	Options options;
+	std::string error;
+
+	GroundBrush* sea;
+	GroundBrush* sand;
+	GroundBrush* grass;
+	GroundBrush* mountain;
+	GroundBrush* cave;
+	GroundBrush* floor;
+	WallBrush* wall;
+	std::vector<uint16_t> containers;
+	std::vector<uint16_t> loot;
+	std::vector<CreatureType*> monsters;
+
+	uint64_t tile_count;
+	uint64_t item_count;
+	uint64_t spawn_count;
+};
+
+#endif
@@ -0,0 +1,289 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "map_hash.h"
+#include "basemap.h"
+#include "creature.h"
+#include "hunt_region_cache.h"
+#include "iomap.h"
+#include "spawn.h"
+#include "thread_pool.h"
+
+#include <bit>
+
+namespace {
+	// The items are hashed as the live protocol and the undo history write them
+	const VirtualIOMap hash_version(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE));
+
+	uint64_t mix(uint64_t value)
+	{
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	// The hash of a part at its place within the whole, these are summed so the order the parts
+	// are visited in doesn't matter and a part holding nothing adds nothing
+	uint64_t place(uint64_t hash, uint64_t where)
+	{
+		return hash == 0 ? 0 : mix(hash ^ mix(where + 1));
+	}
+
+	uint32_t getLeafKey(int x, int y)
+	{
+		return (uint32_t(y >> 2) << 14) | uint32_t(x >> 2);
+	}
+
+	template <typename T>
+	uint64_t hashValue(const T& value, uint64_t hash)
+	{
+		return HuntRegionCache::hashBytes(&value, sizeof(T), hash);
+	}
+}
+
+MapHashCache::MapHashCache(Content content) :
+	content(content),
+	root(0),
+	tiles_revision(0)
+{
+	////
+}
+
+void MapHashCache::clear()
+{
+	leaves.clear();
+	areas.clear();
+	root = 0;
+	tiles_revision = 0;
+}
+
+uint64_t MapHashCache::hashTile(const Tile* tile, Content content)
+{
+	if(!tile) {
+		return 0;
+	}
+
+	// A live client gets the tiles with anything on them, one holding nothing but a creature
+	// arrives as an empty tile
+	const bool holds_items = tile->ground || !tile->items.empty();
+	if(content == HASH_LIVE ? !holds_items : tile->empty() && tile->getMapFlags() == 0 && !tile->isHouseTile()) {
+		return 0;
+	}
+
+	thread_local MemoryNodeFileWriteHandle writer;
+	writer.reset();
+	if(tile->ground) {
+		tile->ground->writeItemNode_OTBM(hash_version, writer);
+	}
+	for(const Item* item : tile->items) {
+		item->writeItemNode_OTBM(hash_version, writer);
+	}
+	uint64_t hash = HuntRegionCache::hashBytes(writer.getMemory(), writer.getSize());
+
+	const uint16_t flags = tile->getMapFlags();
+	hash = hashValue(flags, hash);
+	if(flags & TILESTATE_ZONE_BRUSH) {
+		const std::vector<uint16_t>& zones = tile->getZoneIds();
+		hash = HuntRegionCache::hashBytes(zones.data(), zones.size() * sizeof(uint16_t), hash);
+	}
+
+	// The client drops houses it doesn't know, the rest isn't sent at all
+	if(content == HASH_LIVE) {
+		return hash;
+	}
+
+	hash = hashValue(tile->getHouseID(), hash);
+	if(tile->spawn) {
+		hash = hashValue(tile->spawn->getSize(), hash);
+	}
+	if(tile->creature) {
+		const std::string name = tile->creature->getName();
+		hash = HuntRegionCache::hashBytes(name.data(), name.size(), hash);
+		hash = hashValue(tile->creature->getDirection(), hash);
+		hash = hashValue(tile->creature->getSpawnTime(), hash);
+	}
+	return hash;
+}
+
+void MapHashCache::hashLeaf(QTreeNode* leaf, Entry& entry) const
+{
+	Floor** floors = leaf->getFloors();
+	for(int z = 0; z < rme::MapLayers; ++z) {
+		entry.floors[z] = 0;
+		if(!floors[z]) {
+			continue;
+		}
+		for(uint32_t mask = floors[z]->getOccupied(); mask != 0; mask &= mask - 1) {
+			const int index = std::countr_zero(mask);
+			entry.floors[z] += place(hashTile(floors[z]->locs[index].get(), content), index);
+		}
+	}
+}
+
+uint64_t MapHashCache::hashFloors(const Entry& entry, uint16_t floorMask)
+{
+	uint64_t hash = 0;
+	for(uint32_t mask = floorMask; mask != 0; mask &= mask - 1) {
+		const int z = std::countr_zero(mask);
+		hash += place(entry.floors[z], z);
+	}
+	return hash;
+}
+
+void MapHashCache::update(BaseMap& map)
+{
+	if(map.getTilesRevision() != tiles_revision) {
+		leaves.clear();
+		tiles_revision = map.getTilesRevision();
+	}
+
+	// As MapStatisticsCache, the leaves kept at the same revision are taken as they are
+	map.pageInAll();
+	std::unordered_map<QTreeNode*, Entry> current;
+	current.reserve(leaves.size());
+	std::vector<std::pair<QTreeNode*, Entry*>> changed;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int x, int y) {
+		Entry& entry = current[leaf];
+		auto it = leaves.find(leaf);
+		if(it != leaves.end() && it->second.revision == leaf->getRevision()) {
+			entry = it->second;
+		} else {
+			entry.revision = leaf->getRevision();
+			entry.x = x;
+			entry.y = y;
+			changed.emplace_back(leaf, &entry);
+		}
+	});
+	leaves.swap(current);
+
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(std::min(changed.size() / 64, pool.getWorkerCount() * 8), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t begin = changed.size() * chunk / chunk_count;
+		const size_t end = changed.size() * (chunk + 1) / chunk_count;
+		for(size_t i = begin; i < end; ++i) {
+			hashLeaf(changed[i].first, *changed[i].second);
+		}
+	});
+
+	// Summing up the leaves is cheap next to hashing them, it's done over again every time
+	areas.clear();
+	root = 0;
+	for(const auto& leaf : leaves) {
+		const Entry& entry = leaf.second;
+		const uint64_t hash = hashFloors(entry, 0xFFFF);
+		if(hash == 0) {
+			continue;
+		}
+		const uint32_t key = getLeafKey(entry.x, entry.y);
+		Area& area = areas[BaseMap::getAreaIndex(entry.x, entry.y)];
+		area.hash += place(hash, key);
+		area.leaves.emplace(key, &entry);
+	}
+	for(const auto& area : areas) {
+		root += place(area.second.hash, area.first);
+	}
+}
+
+uint64_t MapHashCache::getLeafHash(BaseMap& map, QTreeNode* leaf, int x, int y, uint16_t floorMask)
+{
+	if(map.getTilesRevision() != tiles_revision) {
+		clear();
+		tiles_revision = map.getTilesRevision();
+	}
+
+	auto it = leaves.find(leaf);
+	if(it == leaves.end() || it->second.revision != leaf->getRevision()) {
+		Entry& entry = leaves[leaf];
+		entry.revision = leaf->getRevision();
+		entry.x = x;
+		entry.y = y;
+		hashLeaf(leaf, entry);
+		return hashFloors(entry, floorMask);
+	}
+	return hashFloors(it->second, floorMask);
+}
+
+PositionVector MapHashCache::compare(const MapHashCache& first, BaseMap& first_map, const MapHashCache& second, BaseMap& second_map)
+{
+	PositionVector positions;
+	if(first.root == second.root) {
+		return positions;
+	}
+
+	const Entry empty;
+	auto compareLeaves = [&](const Entry* first_leaf, const Entry* second_leaf) {
+		const Entry& leaf = first_leaf ? *first_leaf : *second_leaf;
+		for(int z = 0; z < rme::MapLayers; ++z) {
+			if((first_leaf ? first_leaf : &empty)->floors[z] == (second_leaf ? second_leaf : &empty)->floors[z]) {
+				continue;
+			}
+			for(int index = 0; index < 16; ++index) {
+				const int x = leaf.x + index / 4;
+				const int y = leaf.y + index % 4;
+				if(hashTile(first_map.getTile(x, y, z), first.content) != hashTile(second_map.getTile(x, y, z), second.content)) {
+					positions.emplace_back(x, y, z);
+				}
+			}
+		}
+	};
+
+	// Both sides are ordered by position, walked together like a merge
+	auto compareAreas = [&](const Area* first_area, const Area* second_area) {
+		static const std::map<uint32_t, const Entry*> none;
+		const auto& first_leaves = first_area ? first_area->leaves : none;
+		const auto& second_leaves = second_area ? second_area->leaves : none;
+		auto a = first_leaves.begin();
+		auto b = second_leaves.begin();
+		while(a != first_leaves.end() || b != second_leaves.end()) {
+			if(b == second_leaves.end() || (a != first_leaves.end() && a->first < b->first)) {
+				compareLeaves(a->second, nullptr);
+				++a;
+			} else if(a == first_leaves.end() || b->first < a->first) {
+				compareLeaves(nullptr, b->second);
+				++b;
+			} else {
+				if(hashFloors(*a->second, 0xFFFF) != hashFloors(*b->second, 0xFFFF)) {
+					compareLeaves(a->second, b->second);
+				}
+				++a;
+				++b;
+			}
+		}
+	};
+
+	auto a = first.areas.begin();
+	auto b = second.areas.begin();
+	while(a != first.areas.end() || b != second.areas.end()) {
+		if(b == second.areas.end() || (a != first.areas.end() && a->first < b->first)) {
+			compareAreas(&a->second, nullptr);
+			++a;
+		} else if(a == first.areas.end() || b->first < a->first) {
+			compareAreas(nullptr, &b->second);
+			++b;
+		} else {
+			if(a->second.hash != b->second.hash) {
+				compareAreas(&a->second, &b->second);
+			}
+			++a;
+			++b;
+		}
+	}
+	return positions;
+}
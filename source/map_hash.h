@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_HASH_H_
+#define RME_MAP_HASH_H_
+
+#include "const.h"
+#include "position.h"
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+class BaseMap;
+class QTreeNode;
+class Tile;
+
+// Content hashes of a map, kept per floor of every leaf along with the leaf revision they were
+// taken at, so only the leaves changed since are hashed again. The floors add up to the hash of
+// their area of 256x256 tiles and the areas to the hash of the map, each mixed with where it is,
+// so two maps holding the same tiles have the same hashes whatever order they were loaded in and
+// a difference can be found by going down only the areas, leaves and floors that don't match.
+// Tiles changed in place have to be marked as for MapStatisticsCache.
+class MapHashCache
+{
+public:
+	enum Content {
+		// Everything saved with the map
+		HASH_ALL,
+		// What a live session sends of a tile: its flags and items, on tiles holding any item
+		HASH_LIVE,
+	};
+
+	explicit MapHashCache(Content content = HASH_ALL);
+
+	// Brings the hashes up to the map, the changed leaves are hashed on the shared ThreadPool
+	void update(BaseMap& map);
+	void clear();
+
+	// Of the map as of the last update, 0 when it holds nothing
+	uint64_t getRoot() const noexcept { return root; }
+
+	// Of the floors of the leaf in the mask, bit z for floor z. The leaf is hashed again first if
+	// it changed since, the rest of the map isn't looked at.
+	uint64_t getLeafHash(BaseMap& map, QTreeNode* leaf, int x, int y, uint16_t floorMask);
+
+	// The positions of the tiles differing between the maps both caches were last updated for
+	static PositionVector compare(const MapHashCache& first, BaseMap& first_map, const MapHashCache& second, BaseMap& second_map);
+
+	static uint64_t hashTile(const Tile* tile, Content content);
+
+private:
+	struct Entry {
+		uint32_t revision = 0;
+		int x = 0, y = 0;
+		uint64_t floors[rme::MapLayers] = {};
+	};
+	struct Area {
+		uint64_t hash = 0;
+		// By the position of their corner
+		std::map<uint32_t, const Entry*> leaves;
+	};
+
+	void hashLeaf(QTreeNode* leaf, Entry& entry) const;
+	static uint64_t hashFloors(const Entry& entry, uint16_t floorMask);
+
+	Content content;
+	std::unordered_map<QTreeNode*, Entry> leaves;
+	std::map<uint32_t, Area> areas;
+	uint64_t root;
+	uint32_t tiles_revision;
+};
+
+#endif
@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "map_hibernation.h"
+#include "basemap.h"
+#include "iomap_otbm.h"
+#include "item.h"
+#include "tile.h"
+
+#include <bit>
+#include <zlib.h>
+
+namespace {
+	// The tiles never leave memory, any version that keeps every attribute will do
+	const VirtualIOMap hibernation_version(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE));
+
+	enum TileFlags : uint8_t {
+		TILE_HAS_GROUND = 1 << 0,
+		TILE_MODIFIED = 1 << 1,
+	};
+
+	// The selection, houses, spawns, waypoints and zones hold the tiles or their locations
+	bool isPinned(TileLocation& location)
+	{
+		if(location.getSpawnCount() != 0 || location.getWaypointCount() != 0 || location.getHouseExits()) {
+			return true;
+		}
+		const Tile* tile = location.get();
+		return tile && (tile->isHouseTile() || tile->spawn || tile->creature || tile->isSelected() || (tile->getMapFlags() & TILESTATE_ZONE_BRUSH));
+	}
+}
+
+bool MapHibernation::encodeArea(BaseMap& map, uint32_t area, Area& out, std::vector<Position>& positions)
+{
+	const int area_x = int(area & 0xFF) << 8;
+	const int area_y = int(area & 0xFF00);
+
+	MemoryNodeFileWriteHandle writer;
+	writer.addNode(0);
+	map.visitLeaves(area_x, area_y, area_x + 0xFF, area_y + 0xFF, [&](QTreeNode* leaf, int, int) {
+		Floor** floors = leaf->getFloors();
+		for(int z = 0; z < rme::MapLayers; ++z) {
+			if(!floors[z]) {
+				continue;
+			}
+			for(TileLocation& location : floors[z]->locs) {
+				if(isPinned(location)) {
+					return;
+				}
+			}
+		}
+
+		for(int z = 0; z < rme::MapLayers; ++z) {
+			if(!floors[z]) {
+				continue;
+			}
+			for(uint32_t mask = floors[z]->getOccupied(); mask != 0; mask &= mask - 1) {
+				const Tile* tile = floors[z]->locs[std::countr_zero(mask)].get();
+				const Position& position = tile->getPosition();
+				writer.addNode(OTBM_TILE);
+				writer.addU8(position.x & 0xFF);
+				writer.addU8(position.y & 0xFF);
+				writer.addU8(position.z);
+				writer.addU16(tile->getMapFlags());
+				writer.addU8((tile->ground ? TILE_HAS_GROUND : 0) | (tile->isModified() ? TILE_MODIFIED : 0));
+				if(tile->ground) {
+					tile->ground->writeItemNode_OTBM(hibernation_version, writer);
+				}
+				for(const Item* item : tile->items) {
+					item->writeItemNode_OTBM(hibernation_version, writer);
+				}
+				writer.endNode();
+				positions.push_back(position);
+			}
+		}
+	});
+	writer.endNode();
+	if(positions.empty()) {
+		return false;
+	}
+
+	uLongf length = compressBound(writer.getSize());
+	out.data.resize(length);
+	if(compress2(out.data.data(), &length, writer.getMemory(), writer.getSize(), Z_BEST_SPEED) != Z_OK) {
+		positions.clear();
+		return false;
+	}
+	out.data.resize(length);
+	out.data.shrink_to_fit();
+	out.size = uint32_t(writer.getSize());
+	return true;
+}
+
+bool MapHibernation::decodeArea(uint32_t area, std::vector<Entry>& tiles) const
+{
+	auto it = areas.find(area);
+	if(it == areas.end()) {
+		return false;
+	}
+
+	std::vector<uint8_t> data(it->second.size);
+	uLongf length = data.size();
+	if(uncompress(data.data(), &length, it->second.data.data(), it->second.data.size()) != Z_OK || length != data.size()) {
+		return false;
+	}
+
+	const int area_x = int(area & 0xFF) << 8;
+	const int area_y = int(area & 0xFF00);
+	MemoryNodeFileReadHandle handle(data.data(), data.size());
+	BinaryNode* root = handle.getRootNode();
+	for(BinaryNode* tileNode = root ? root->getChild() : nullptr; tileNode != nullptr; tileNode = tileNode->advance()) {
+		uint8_t type, x, y, z, flags;
+		uint16_t mapflags;
+		if(!tileNode->getByte(type) || !tileNode->getU8(x) || !tileNode->getU8(y) || !tileNode->getU8(z) || !tileNode->getU16(mapflags) || !tileNode->getU8(flags)) {
+			return false;
+		}
+
+		// The location is assigned when the tile is put back on the map
+		const Position position(area_x + x, area_y + y, z);
+		Tile* tile = newd Tile(position.x, position.y, position.z);
+		tile->setMapFlags(mapflags);
+		bool ground = (flags & TILE_HAS_GROUND) != 0;
+		for(BinaryNode* itemNode = tileNode->getChild(); itemNode != nullptr; itemNode = itemNode->advance()) {
+			uint8_t item_type;
+			Item* item = nullptr;
+			if(itemNode->getByte(item_type) && item_type == OTBM_ITEM) {
+				item = Item::Create_OTBM(hibernation_version, itemNode);
+			}
+			if(item) {
+				item->unserializeItemNode_OTBM(hibernation_version, itemNode);
+				if(ground) {
+					tile->ground = item;
+				} else {
+					tile->items.push_back(item);
+				}
+			}
+			ground = false;
+		}
+		tile->update();
+		if(flags & TILE_MODIFIED) {
+			tile->modify();
+		}
+		tiles.push_back({ position, tile });
+	}
+	return true;
+}
+
+void MapHibernation::add(uint32_t area, Area&& data)
+{
+	bytes += data.data.size();
+	areas[area] = std::move(data);
+}
+
+void MapHibernation::remove(uint32_t area)
+{
+	auto it = areas.find(area);
+	if(it != areas.end()) {
+		bytes -= it->second.data.size();
+		areas.erase(it);
+	}
+}
+
+std::vector<uint32_t> MapHibernation::getAreas() const
+{
+	std::vector<uint32_t> indexes;
+	indexes.reserve(areas.size());
+	for(const auto& area : areas) {
+		indexes.push_back(area.first);
+	}
+	return indexes;
+}
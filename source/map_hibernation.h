@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_HIBERNATION_H_
+#define RME_MAP_HIBERNATION_H_
+
+#include "position.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class BaseMap;
+class Tile;
+
+// The tiles a hibernating map took off itself, see Map::hibernate. Every 256x256 area is a zlib
+// stream of OTBM nodes, a node per tile with its items as children in the order they lie, written
+// as the undo history writes them so nothing the editor keeps on an item is lost. The leaves of an
+// area holding anything that is pointed at from elsewhere are left on the map.
+class MapHibernation
+{
+public:
+	struct Area {
+		std::vector<uint8_t> data;
+		uint32_t size = 0; // Uncompressed
+	};
+	struct Entry {
+		Position position;
+		Tile* tile; // Without a location yet
+	};
+
+	// Encodes the tiles of the area that can go, positions gets them. Only reads the map, so
+	// several areas can be encoded at once. False if there is nothing to take.
+	static bool encodeArea(BaseMap& map, uint32_t area, Area& out, std::vector<Position>& positions);
+	// Decodes the tiles of an area held, on any thread
+	bool decodeArea(uint32_t area, std::vector<Entry>& tiles) const;
+
+	void add(uint32_t area, Area&& data);
+	void remove(uint32_t area);
+	bool has(uint32_t area) const { return areas.find(area) != areas.end(); }
+	std::vector<uint32_t> getAreas() const;
+	bool empty() const noexcept { return areas.empty(); }
+
+	// Of the areas as compressed
+	size_t getBytes() const noexcept { return bytes; }
+
+private:
+	std::unordered_map<uint32_t, Area> areas;
+	size_t bytes = 0;
+};
+
+#endif
@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "map_preloader.h"
+#include "client_version.h"
+#include "gui.h"
+#include "iomap_otbm.h"
+
+#include <cstdio>
+
+MapPreloader::~MapPreloader()
+{
+	cancel();
+}
+
+void MapPreloader::start(const FileName& filename)
+{
+	cancel();
+
+	MapVersion version;
+	if(!filename.FileExists() || !IOMapOTBM::getVersionInfo(filename, version))
+		return;
+
+	// Everything opening the map reads besides the map itself, the ones that don't exist are skipped
+	std::vector<std::string> files;
+	const wxString path = filename.GetFullPath();
+	files.push_back(nstr(path));
+	for(const char* extension : { ".idx", ".session", ".zones" }) {
+		files.push_back(nstr(path) + extension);
+	}
+	const wxString base = filename.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR) + filename.GetName();
+	files.push_back(nstr(base + "-spawn.xml"));
+	files.push_back(nstr(base + "-house.xml"));
+
+	// Of the version, unless it is loaded already. Looking for the asset files may ask for
+	// their folder, that's left to the actual load.
+	ClientVersion* client = ClientVersion::get(version.client);
+	if(client && client != g_gui.getLoadedVersion() && client->hasValidPaths()) {
+		files.push_back(nstr(client->getMetadataPath().GetFullPath()));
+		files.push_back(nstr(client->getSpritesPath().GetFullPath()));
+		const wxString data = client->getDataPath().GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR);
+		for(const char* name : { "items.otb", "items.xml", "creatures.xml" }) {
+			files.push_back(nstr(data + name));
+		}
+	}
+
+	map = filename;
+	cancelled = false;
+	reader = std::thread([this, files = std::move(files)]() {
+		readFiles(files, cancelled);
+	});
+}
+
+void MapPreloader::cancel()
+{
+	// A read stops within a buffer
+	cancelled = true;
+	if(reader.joinable())
+		reader.join();
+	map = FileName();
+}
+
+void MapPreloader::finish(const FileName& opened)
+{
+	// Reading on doesn't slow down the load of the same files, it is ahead of it. The reader is
+	// stopped by the next start or cancel.
+	if(reader.joinable() && opened.SameAs(map)) {
+		map = FileName();
+		return;
+	}
+	cancel();
+}
+
+void MapPreloader::readFiles(const std::vector<std::string>& files, const std::atomic<bool>& cancelled)
+{
+	// Big enough to keep the disk busy, small enough to stop soon after a cancel
+	std::vector<char> buffer(4 * 1024 * 1024);
+	for(const std::string& file : files) {
+		FILE* handle = fopen(file.c_str(), "rb");
+		if(!handle)
+			continue;
+
+		while(!cancelled && fread(buffer.data(), 1, buffer.size(), handle) == buffer.size()) {
+			////
+		}
+		fclose(handle);
+		if(cancelled)
+			return;
+	}
+}
@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_PRELOADER_H_
+#define RME_MAP_PRELOADER_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reads the most recent map and the files of its client version while the welcome dialog
+// is up (Config::PRELOAD_RECENT_MAP), so they come from the disk cache once it is opened.
+// The client version and the map themselves are still loaded on the UI thread, both fill
+// the globals the rest of the editor reads from and report through the loading bar.
+class MapPreloader
+{
+public:
+	MapPreloader() = default;
+	~MapPreloader();
+
+	MapPreloader(const MapPreloader&) = delete;
+	MapPreloader& operator=(const MapPreloader&) = delete;
+
+	// Works out the files on this thread and reads them on a thread of its own, the reads
+	// block for long and would hold up a worker of the pool the load itself needs
+	void start(const FileName& map);
+	// Stops reading, unless the map to be opened is the one being read
+	void cancel();
+	void finish(const FileName& opened);
+
+private:
+	static void readFiles(const std::vector<std::string>& files, const std::atomic<bool>& cancelled);
+
+	std::thread reader;
+	std::atomic<bool> cancelled { false };
+	FileName map;
+};
+
+#endif
@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#include "main.h"
+
+#include "map_reachability.h"
+#include "map.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+	// Rows of a band, a band is worked on by one task
+	const int BandRows = 64;
+
+	// Bits shifted by offset columns, toward higher x for a positive offset
+	uint64_t shiftedWord(const uint64_t* row, size_t words, size_t word, int offset)
+	{
+		if(offset == 0)
+			return row[word];
+
+		if(offset > 0) {
+			uint64_t value = row[word] << offset;
+			if(word > 0)
+				value |= row[word - 1] >> (64 - offset);
+			return value;
+		}
+
+		uint64_t value = row[word] >> -offset;
+		if(word + 1 < words)
+			value |= row[word + 1] << (64 + offset);
+		return value;
+	}
+}
+
+void MapReachability::clear()
+{
+	origin_x = origin_y = 0;
+	width = height = 0;
+	words_per_row = 0;
+	for(Bitmap& floor : floors)
+		Bitmap().swap(floor);
+}
+
+bool MapReachability::isReachable(int x, int y, int z) const noexcept
+{
+	if(z < 0 || z > rme::MapMaxLayer)
+		return false;
+
+	x -= origin_x;
+	y -= origin_y;
+	const Bitmap& floor = floors[z];
+	if(floor.empty() || x < 0 || y < 0 || x >= width || y >= height)
+		return false;
+
+	return (floor[y * words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+void MapReachability::compute(Map& map, const std::function<void(int)>& progress)
+{
+	clear();
+
+	const BaseMap::TileBounds bounds = map.getBounds();
+	if(bounds.empty())
+		return;
+
+	// Aligned to whole words and leaves, with room for the view range around the tiles
+	origin_x = std::max(bounds.min_x - ViewRangeX, 0) & ~63;
+	origin_y = std::max(bounds.min_y - ViewRangeY, 0) & ~3;
+	width = std::min(bounds.max_x + ViewRangeX, rme::MapMaxWidth) - origin_x + 1;
+	height = std::min(bounds.max_y + ViewRangeY, rme::MapMaxHeight) - origin_y + 1;
+	words_per_row = (width + 63) / 64;
+
+	Bitmap walkable[rme::MapLayers];
+	markWalkable(map, walkable);
+	if(progress)
+		progress(30);
+
+	Bitmap near[rme::MapLayers];
+	ThreadPool::getInstance().parallelFor(rme::MapLayers, [&](size_t z) {
+		spread(walkable[z], near[z]);
+		Bitmap().swap(walkable[z]);
+	});
+	if(progress)
+		progress(80);
+
+	// The floors seen from each floor, above ground all of them show the same
+	auto merge = [&](Bitmap& into, int min_z, int max_z) {
+		for(int z = min_z; z <= max_z; ++z) {
+			if(near[z].empty())
+				continue;
+			if(into.empty()) {
+				into = near[z];
+				continue;
+			}
+			for(size_t word = 0; word < into.size(); ++word)
+				into[word] |= near[z][word];
+		}
+	};
+
+	ThreadPool::getInstance().parallelFor(rme::MapMaxLayer - rme::MapGroundLayer + 1, [&](size_t index) {
+		const int z = rme::MapGroundLayer + 1 + int(index);
+		if(z > rme::MapMaxLayer) {
+			merge(floors[0], 0, rme::MapGroundLayer + 2);
+			return;
+		}
+		merge(floors[z], std::max(z - 2, rme::MapGroundLayer), std::min(z + 2, rme::MapMaxLayer));
+	});
+	for(int z = 1; z <= rme::MapGroundLayer; ++z)
+		floors[z] = floors[0];
+
+	if(progress)
+		progress(100);
+}
+
+void MapReachability::markWalkable(Map& map, Bitmap* walkable)
+{
+	for(int z = 0; z <= rme::MapMaxLayer; ++z) {
+		if(!map.getFloorBounds(z).empty())
+			walkable[z].assign(words_per_row * height, 0);
+	}
+
+	// A band only writes its own rows, the leaves never straddle two bands
+	const size_t band_count = (height + BandRows - 1) / BandRows;
+	ThreadPool::getInstance().parallelFor(band_count, [&](size_t band) {
+		const int start_y = origin_y + int(band) * BandRows;
+		const int end_y = std::min(start_y + BandRows, origin_y + height) - 1;
+		map.visitFloors(origin_x, start_y, origin_x + width - 1, end_y, 0, rme::MapMaxLayer, [&](Floor* floor, int x, int y, int z) {
+			Bitmap& bitmap = walkable[z];
+			for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1) {
+				const int index = std::countr_zero(mask);
+				const Tile* tile = floor->locs[index].get();
+				if(tile->isBlocking())
+					continue;
+
+				const int tile_x = x + (index >> 2) - origin_x;
+				const int tile_y = y + (index & 3) - origin_y;
+				bitmap[tile_y * words_per_row + (tile_x >> 6)] |= uint64_t(1) << (tile_x & 63);
+			}
+		});
+	});
+}
+
+void MapReachability::spread(const Bitmap& walkable, Bitmap& near) const
+{
+	if(walkable.empty())
+		return;
+
+	// Row by row over the horizontal range
+	Bitmap rows(walkable.size(), 0);
+	for(int y = 0; y < height; ++y) {
+		const uint64_t* in = &walkable[y * words_per_row];
+		uint64_t* out = &rows[y * words_per_row];
+		for(size_t word = 0; word < words_per_row; ++word) {
+			uint64_t value = 0;
+			for(int offset = -ViewRangeX; offset <= ViewRangeX; ++offset)
+				value |= shiftedWord(in, words_per_row, word, offset);
+			out[word] = value;
+		}
+	}
+
+	// Then column by column over the vertical one
+	near.assign(walkable.size(), 0);
+	for(int y = 0; y < height; ++y) {
+		uint64_t* out = &near[y * words_per_row];
+		const int first = std::max(y - ViewRangeY, 0);
+		const int last = std::min(y + ViewRangeY, height - 1);
+		for(int row = first; row <= last; ++row) {
+			const uint64_t* in = &rows[row * words_per_row];
+			for(size_t word = 0; word < words_per_row; ++word)
+				out[word] |= in[word];
+		}
+	}
+}
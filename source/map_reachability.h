@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#ifndef RME_MAP_REACHABILITY_H_
+#define RME_MAP_REACHABILITY_H_
+
+#include "const.h"
+#include "position.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Map;
+
+// Which positions of a map a player can get to see: those with a walkable tile (a tile that isn't
+// blocking) within the view range around them, on the floors seen from there. Above ground that is
+// any of the floors 0 to 9, underground the two floors above and below.
+//
+// It's worked out once for the whole map as a bitmap per floor: the walkable tiles are marked, the
+// marks are spread over the view range row by row and then column by column, and the floors seen
+// from each other are merged, all on the shared ThreadPool. Asking about a position is then a lookup.
+class MapReachability
+{
+public:
+	static constexpr int ViewRangeX = 10;
+	static constexpr int ViewRangeY = 8;
+
+	// progress(percent) is called on the calling thread
+	void compute(Map& map, const std::function<void(int)>& progress = nullptr);
+	void clear();
+
+	bool isReachable(int x, int y, int z) const noexcept;
+	bool isReachable(const Position& position) const noexcept { return isReachable(position.x, position.y, position.z); }
+
+private:
+	using Bitmap = std::vector<uint64_t>; // words_per_row words per row, empty if nothing is set
+
+	void markWalkable(Map& map, Bitmap* walkable);
+	void spread(const Bitmap& walkable, Bitmap& near) const;
+
+	int origin_x = 0;
+	int origin_y = 0;
+	int width = 0;
+	int height = 0;
+	size_t words_per_row = 0;
+	Bitmap floors[rme::MapLayers];
+};
+
+#endif
@@ -21,15 +21,44 @@
 #include "basemap.h"
 #include "position.h"
 #include "tile.h"
+#include "item.h"
+#include "complexitem.h"
+
+//**************** Map Allocator **********************
+
+#if RME_POOLED_MAP_ALLOCATOR > 0
+// The pools are intentionally never destroyed, maps may be torn down
+// after static destruction has started.
+MapAllocator::TilePool& MapAllocator::tilePool()
+{
+	static TilePool* pool = newd TilePool();
+	return *pool;
+}
+
+MapAllocator::FloorPool& MapAllocator::floorPool()
+{
+	static FloorPool* pool = newd FloorPool();
+	return *pool;
+}
+
+MapAllocator::NodePool& MapAllocator::nodePool()
+{
+	static NodePool* pool = newd NodePool();
+	return *pool;
+}
+
+MapAllocator::ItemPool& MapAllocator::itemPool()
+{
+	static ItemPool* pool = newd ItemPool();
+	return *pool;
+}
+#endif
 
 //**************** Tile Location **********************
 
 TileLocation::TileLocation() :
 	tile(nullptr),
-	position(0, 0, 0),
-	spawn_count(0),
-	waypoint_count(0),
-	house_exits(nullptr)
+	floor(nullptr)
 {
 	////
 }
@@ -37,14 +66,17 @@ TileLocation::TileLocation() :
 TileLocation::~TileLocation()
 {
 	delete tile;
-	delete house_exits;
 }
 
 int TileLocation::size() const
 {
 	if(tile)
 		return tile->size();
-	return spawn_count + waypoint_count + (house_exits? 1 : 0);
+	const FloorExtras* extras = floor->getExtras();
+	if(!extras)
+		return 0;
+	const size_t index = getIndex();
+	return extras->spawn_count[index] + extras->waypoint_count[index] + (extras->house_exits[index]? 1 : 0);
 }
 
 bool TileLocation::empty() const
@@ -52,8 +84,29 @@ bool TileLocation::empty() const
 	return size() == 0;
 }
 
+void TileLocation::increaseSpawnCount()
+{
+	floor->createExtras().spawn_count[getIndex()]++;
+}
+
+void TileLocation::decreaseSpawnCount()
+{
+	floor->createExtras().spawn_count[getIndex()]--;
+}
+
+void TileLocation::increaseWaypointCount()
+{
+	floor->createExtras().waypoint_count[getIndex()]++;
+}
+
+void TileLocation::decreaseWaypointCount()
+{
+	floor->createExtras().waypoint_count[getIndex()]--;
+}
+
 HouseExitList* TileLocation::createHouseExits()
 {
+	HouseExitList*& house_exits = floor->createExtras().house_exits[getIndex()];
 	if(!house_exits)
 		house_exits = new HouseExitList();
 	return house_exits;
@@ -61,16 +114,86 @@ HouseExitList* TileLocation::createHouseExits()
 
 //**************** Floor **********************
 
-Floor::Floor(int sx, int sy, int z)
+FloorExtras::~FloorExtras()
+{
+	for(HouseExitList* house_exits : this->house_exits)
+		delete house_exits;
+}
+
+Floor::Floor(int sx, int sy, int z) :
+	x(sx & ~3),
+	y(sy & ~3),
+	z(z),
+	occupied(0)
+{
+	for(TileLocation& location : locs)
+		location.floor = this;
+}
+
+Floor::~Floor()
+{
+	////
+}
+
+FloorExtras& Floor::createExtras()
+{
+	if(!extras)
+		extras.reset(newd FloorExtras());
+	return *extras;
+}
+
+#if RME_POOLED_MAP_ALLOCATOR > 0
+void* Floor::operator new([[maybe_unused]] size_t size)
 {
-	sx = sx & ~3;
-	sy = sy & ~3;
+	ASSERT(size == sizeof(Floor));
+	return MapAllocator::floorPool().allocate();
+}
+
+void Floor::operator delete(void* ptr, size_t)
+{
+	MapAllocator::floorPool().deallocate(ptr);
+}
+#endif
+
+//**************** QTreeNode **********************
+
+//**************** TileSummary **********************
 
-	for(int i = 0; i < rme::MapLayers; ++i) {
-		locs[i].position.x = sx + (i >> 2);
-		locs[i].position.y = sy + (i & 3);
-		locs[i].position.z = z;
+TileSummary TileSummary::of(const Tile* tile, int z)
+{
+	TileSummary summary;
+	summary.floors = uint16_t(1u << z);
+	summary.map_flags = tile->getMapFlags();
+	if(tile->isHouseTile())
+		summary.kinds |= HOUSE;
+	if(tile->hasZones())
+		summary.kinds |= ZONE;
+	if(tile->hasUniqueItem())
+		summary.kinds |= UNIQUE;
+	if(tile->hasActionItem())
+		summary.kinds |= ACTION;
+	if(tile->hasContainers())
+		summary.kinds |= CONTAINER;
+
+	if(tile->ground)
+		summary.items |= itemBit(tile->ground->getID());
+	if(!tile->hasContainers()) {
+		for(const Item* item : tile->items)
+			summary.items |= itemBit(item->getID());
+		return summary;
 	}
+
+	std::vector<const Item*> pending(tile->items.begin(), tile->items.end());
+	while(!pending.empty()) {
+		const Item* item = pending.back();
+		pending.pop_back();
+		summary.items |= itemBit(item->getID());
+		if(const Container* container = dynamic_cast<const Container*>(item)) {
+			for(const Item* content : container->getVector())
+				pending.push_back(content);
+		}
+	}
+	return summary;
 }
 
 //**************** QTreeNode **********************
@@ -78,24 +201,53 @@ Floor::Floor(int sx, int sy, int z)
 QTreeNode::QTreeNode(BaseMap& map) :
 	map(map),
 	visible(0),
+	revision(map.nextRevision()),
+	draw_revision(revision),
 	isLeaf(false)
 {
 	// Doesn't matter if we're leaf or node
-	for(int i = 0; i < rme::MapLayers; ++i)
+	for(int i = 0; i < ChildCount; ++i)
 		child[i] = nullptr;
 }
 
 QTreeNode::~QTreeNode()
 {
+	// Not through the map, detached children are freed after it is gone
 	if(isLeaf) {
 		for(int i = 0; i < rme::MapLayers; ++i)
-			delete array[i];
+			MapAllocator::freeFloor(array[i]);
 	} else {
-		for(int i = 0; i < rme::MapLayers; ++i)
-			delete child[i];
+		for(int i = 0; i < ChildCount; ++i)
+			MapAllocator::freeNode(child[i]);
 	}
 }
 
+std::vector<QTreeNode*> QTreeNode::detachChildren()
+{
+	ASSERT(!isLeaf);
+	std::vector<QTreeNode*> children;
+	for(int i = 0; i < ChildCount; ++i) {
+		if(child[i]) {
+			children.push_back(child[i]);
+			child[i] = nullptr;
+		}
+	}
+	return children;
+}
+
+#if RME_POOLED_MAP_ALLOCATOR > 0
+void* QTreeNode::operator new([[maybe_unused]] size_t size)
+{
+	ASSERT(size == sizeof(QTreeNode));
+	return MapAllocator::nodePool().allocate();
+}
+
+void QTreeNode::operator delete(void* ptr, size_t)
+{
+	MapAllocator::nodePool().deallocate(ptr);
+}
+#endif
+
 QTreeNode* QTreeNode::getLeaf(int x, int y)
 {
 	QTreeNode* node = this;
@@ -132,11 +284,12 @@ QTreeNode* QTreeNode::getLeafForce(int x, int y)
 
 		} else {
 			if(level == 0) {
-				qt = newd QTreeNode(map);
+				qt = map.allocator.allocateNode(map);
 				qt->isLeaf = true;
+				map.registerLeaf(x, y, qt);
 				return qt;
 			} else {
-				qt = newd QTreeNode(map);
+				qt = map.allocator.allocateNode(map);
 			}
 		}
 		node = node->child[index];
@@ -149,11 +302,32 @@ QTreeNode* QTreeNode::getLeafForce(int x, int y)
 }
 
 
+const TileSummary& QTreeNode::rebuildSummary()
+{
+	summary = TileSummary();
+	if(isLeaf) {
+		for(int z = 0; z < rme::MapLayers; ++z) {
+			if(Floor* floor = array[z]) {
+				for(TileLocation& location : floor->locs) {
+					if(const Tile* tile = location.get())
+						summary.add(TileSummary::of(tile, z));
+				}
+			}
+		}
+	} else {
+		for(QTreeNode* node : child) {
+			if(node)
+				summary.add(node->rebuildSummary());
+		}
+	}
+	return summary;
+}
+
 Floor* QTreeNode::createFloor(int x, int y, int z)
 {
 	ASSERT(isLeaf);
 	if(!array[z])
-		array[z] = newd Floor(x, y, z);
+		array[z] = map.allocator.allocateFloor(x, y, z);
 	return array[z];
 }
 
@@ -174,20 +348,17 @@ bool QTreeNode::isRequested(bool underground)
 void QTreeNode::clearVisible(uint32_t u)
 {
 	if(isLeaf)
-		visible &= u;
+		visible &= u | (u << rme::MapLayers);
 	else
-		for(int i = 0; i < rme::MapLayers; ++i)
+		for(int i = 0; i < ChildCount; ++i)
 			if(child[i])
 				child[i]->clearVisible(u);
 }
 
 bool QTreeNode::isVisible(uint32_t client, bool underground)
 {
-	if(underground) {
-		return testFlags(visible >> rme::MapLayers, static_cast<uint64_t>(1) << client);
-	} else {
-		return testFlags(visible, static_cast<uint64_t>(1) << client);
-	}
+	// client is the id bit of the peer, the underground ones sit above the overground ones
+	return testFlags(visible, client << (underground ? rme::MapLayers : 0));
 }
 
 void QTreeNode::setVisible(bool underground, bool value)
@@ -201,7 +372,7 @@ void QTreeNode::setVisible(bool underground, bool value)
 		if(value)
 			visible |= 1;
 		else
-			visible &= 1;
+			visible &= ~1;
 	}
 }
 
@@ -216,9 +387,9 @@ void QTreeNode::setRequested(bool underground, bool r)
 void QTreeNode::setVisible(uint32_t client, bool underground, bool value)
 {
 	if(value)
-		visible |= (1 << client << (underground ? rme::MapLayers : 0));
+		visible |= client << (underground ? rme::MapLayers : 0);
 	else
-		visible &= ~(1 << client << (underground ? rme::MapLayers : 0));
+		visible &= ~(client << (underground ? rme::MapLayers : 0));
 }
 
 TileLocation* QTreeNode::getTile(int x, int y, int z)
@@ -248,11 +419,21 @@ Tile* QTreeNode::setTile(int x, int y, int z, Tile* newtile)
 	TileLocation* tmp = &f->locs[offset_x*4+offset_y];
 	Tile* oldtile = tmp->tile;
 	tmp->tile = newtile;
+	f->setOccupied(offset_x*4+offset_y, newtile != nullptr);
+	map.markAreaDirty(x, y);
+	revision = map.nextRevision();
+	if(!map.isSelectionSwaps())
+		draw_revision = revision;
 
-	if(newtile && !oldtile)
+	if(newtile)
+		map.addSummary(x, y, TileSummary::of(newtile, z));
+
+	if(newtile && !oldtile) {
 		++map.tilecount;
-	else if(oldtile && !newtile)
+		map.extendBounds(x, y, z);
+	} else if(oldtile && !newtile) {
 		--map.tilecount;
+	}
 
 	return oldtile;
 }
@@ -266,6 +447,10 @@ void QTreeNode::clearTile(int x, int y, int z)
 	int offset_y = y & 3;
 
 	TileLocation* tmp = &f->locs[offset_x*4+offset_y];
-	delete tmp->tile;
+	map.markAreaDirty(x, y);
+	revision = map.nextRevision();
+	draw_revision = revision;
+	map.allocator.freeTile(tmp->tile);
 	tmp->tile = map.allocator(tmp);
+	f->setOccupied(offset_x*4+offset_y, true);
 }
@@ -21,10 +21,33 @@
 #include "const.h"
 #include "position.h"
 
+#include <memory>
+#include <vector>
+
 class Tile;
 class Floor;
 class BaseMap;
 
+// Declares class specific operator new/delete that allocate from the MapAllocator pools
+#if RME_POOLED_MAP_ALLOCATOR > 0
+#	ifdef DEBUG_MEM
+#		define DECLARE_POOLED_ALLOCATION() \
+			static void* operator new(size_t size); \
+			static void operator delete(void* ptr, size_t size); \
+			static void* operator new(size_t size, const char*, int) { return operator new(size); } \
+			static void operator delete(void* ptr, const char*, int) { operator delete(ptr, 0); }
+#	else
+#		define DECLARE_POOLED_ALLOCATION() \
+			static void* operator new(size_t size); \
+			static void operator delete(void* ptr, size_t size);
+#	endif
+#else
+#	define DECLARE_POOLED_ALLOCATION()
+#endif
+
+// A slot of a floor. It only holds its tile and the floor it is on, its position
+// follows from where it is in the floor and the rest is kept by the floor for
+// the few slots that have any.
 class TileLocation
 {
 	TileLocation();
@@ -36,10 +59,7 @@ public:
 
 protected:
 	Tile* tile;
-	Position position;
-	size_t spawn_count;
-	size_t waypoint_count;
-	HouseExitList* house_exits; // Any house exits pointing here
+	Floor* floor;
 
 public:
 
@@ -51,36 +71,164 @@ public:
 	int size() const;
 	bool empty() const;
 
-	const Position& getPosition() const noexcept { return position; }
-	int getX() const noexcept { return position.x; }
-	int getY() const noexcept { return position.y; }
-	int getZ() const noexcept { return position.z; }
-
-	size_t getSpawnCount() const noexcept { return spawn_count; }
-	void increaseSpawnCount() noexcept { spawn_count++; }
-	void decreaseSpawnCount() noexcept { spawn_count--; }
-	size_t getWaypointCount() const noexcept { return waypoint_count; }
-	void increaseWaypointCount() noexcept { waypoint_count++; }
-	void decreaseWaypointCount() noexcept { waypoint_count--; }
+	Position getPosition() const noexcept;
+	int getX() const noexcept;
+	int getY() const noexcept;
+	int getZ() const noexcept;
+
+	size_t getSpawnCount() const noexcept;
+	void increaseSpawnCount();
+	void decreaseSpawnCount();
+	size_t getWaypointCount() const noexcept;
+	void increaseWaypointCount();
+	void decreaseWaypointCount();
 	HouseExitList* createHouseExits();
-	HouseExitList* getHouseExits() noexcept { return house_exits; }
+	HouseExitList* getHouseExits() noexcept;
+
+private:
+	size_t getIndex() const noexcept;
 
 	friend class Floor;
 	friend class QTreeNode;
+	friend class BaseMap;
 	friend class Waypoints;
 };
 
+// Spawn and waypoint counts and house exits of the slots of a floor, made
+// along with the first of them the floor gets
+struct FloorExtras
+{
+	~FloorExtras();
+
+	uint32_t spawn_count[rme::MapLayers] = {};
+	uint32_t waypoint_count[rme::MapLayers] = {};
+	HouseExitList* house_exits[rme::MapLayers] = {};
+};
+
 class Floor
 {
 public:
 	Floor(int x, int y, int z);
+	~Floor();
+
+	Floor(const Floor&) = delete;
+	Floor& operator=(const Floor&) = delete;
+
 	TileLocation locs[rme::MapLayers];
+
+	// The first tile of the floor
+	int getX() const noexcept { return x; }
+	int getY() const noexcept { return y; }
+	int getZ() const noexcept { return z; }
+
+	const FloorExtras* getExtras() const noexcept { return extras.get(); }
+	FloorExtras& createExtras();
+
+	// A bit per slot that holds a tile, scans skip the others
+	uint16_t getOccupied() const noexcept { return occupied; }
+	void setOccupied(size_t index, bool value) noexcept {
+		if(value)
+			occupied |= uint16_t(1u << index);
+		else
+			occupied &= uint16_t(~(1u << index));
+	}
+
+	DECLARE_POOLED_ALLOCATION()
+
+private:
+	int x, y, z;
+	uint16_t occupied;
+	std::unique_ptr<FloorExtras> extras;
+};
+
+inline size_t TileLocation::getIndex() const noexcept
+{
+	return size_t(this - floor->locs);
+}
+
+inline Position TileLocation::getPosition() const noexcept
+{
+	const size_t index = getIndex();
+	return Position(floor->getX() + int(index >> 2), floor->getY() + int(index & 3), floor->getZ());
+}
+
+inline int TileLocation::getX() const noexcept
+{
+	return floor->getX() + int(getIndex() >> 2);
+}
+
+inline int TileLocation::getY() const noexcept
+{
+	return floor->getY() + int(getIndex() & 3);
+}
+
+inline int TileLocation::getZ() const noexcept
+{
+	return floor->getZ();
+}
+
+inline size_t TileLocation::getSpawnCount() const noexcept
+{
+	const FloorExtras* extras = floor->getExtras();
+	return extras? extras->spawn_count[getIndex()] : 0;
+}
+
+inline size_t TileLocation::getWaypointCount() const noexcept
+{
+	const FloorExtras* extras = floor->getExtras();
+	return extras? extras->waypoint_count[getIndex()] : 0;
+}
+
+inline HouseExitList* TileLocation::getHouseExits() noexcept
+{
+	const FloorExtras* extras = floor->getExtras();
+	return extras? extras->house_exits[getIndex()] : nullptr;
+}
+
+// What the tiles below a node may hold. Bits are added as tiles are set and as leaves are marked
+// changed, and only dropped when the map makes its summaries again, so a summary can rule a
+// subtree out but never proves that it holds something.
+struct TileSummary
+{
+	enum Kind : uint16_t {
+		HOUSE = 1 << 0,
+		ZONE = 1 << 1,
+		UNIQUE = 1 << 2,
+		ACTION = 1 << 3,
+		CONTAINER = 1 << 4, // A container holding items
+	};
+
+	uint16_t floors = 0; // A bit per floor holding a tile
+	uint16_t map_flags = 0; // TILESTATE_ map flags of the tiles
+	uint16_t kinds = 0;
+	uint64_t items = 0; // Ids of the items and their contents, hashed to a bit each
+
+	static uint64_t itemBit(uint16_t id) noexcept { return uint64_t(1) << ((id * 0x9E3779B1u) >> 26); }
+	static TileSummary of(const Tile* tile, int z);
+
+	void add(const TileSummary& other) noexcept {
+		floors |= other.floors;
+		map_flags |= other.map_flags;
+		kinds |= other.kinds;
+		items |= other.items;
+	}
+	// Whether what this summarizes can hold a tile matching the filter: on one of its floors,
+	// with all of its flags and kinds and all of its item bits
+	bool mayMatch(const TileSummary& filter) const noexcept {
+		return (floors & filter.floors) != 0
+			&& (map_flags & filter.map_flags) == filter.map_flags
+			&& (kinds & filter.kinds) == filter.kinds
+			&& (items & filter.items) == filter.items;
+	}
 };
 
 // This is not a QuadTree, but a HexTree (16 child nodes to every node), so the name is abit misleading
 class QTreeNode
 {
 public:
+	// A node covers 4x4 children, each a quarter of its width and height
+	static constexpr int ChildCount = 16;
+
 	QTreeNode(BaseMap& map);
 	virtual ~QTreeNode();
 
@@ -89,6 +237,9 @@ public:
 
 	QTreeNode* getLeaf(int x, int y); // Might return nullptr
 	QTreeNode* getLeafForce(int x, int y); // Will never return nullptr, it will create the node if it's not there
+	// Takes the subtrees out of a node that isn't a leaf. They are freed with MapAllocator::freeNode
+	// and don't need the map anymore for that, so they may outlive it.
+	std::vector<QTreeNode*> detachChildren();
 
 	// Coordinates are NOT relative
 	TileLocation* createTile(int x, int y, int z);
@@ -114,19 +265,83 @@ public:
 	bool isVisible(bool underground);
 	bool isRequested(bool underground);
 
+	// Changes whenever a tile of this leaf is set or cleared
+	uint32_t getRevision() const noexcept { return revision; }
+	// The same, except for tiles swapped for copies that are only selected differently, how the
+	// leaf is drawn apart from its selection stays
+	uint32_t getDrawRevision() const noexcept { return draw_revision; }
+
+	const TileSummary& getSummary() const noexcept { return summary; }
+
+	// Calls func(leaf, x, y) for every leaf below this node that intersects the box (inclusive),
+	// x/y being the first tile of the leaf. node_x/node_y/size are the area this node covers,
+	// subtrees that don't exist or lie outside the box are skipped whole.
+	template <typename Func>
+	void visitLeaves(int node_x, int node_y, int size, int start_x, int start_y, int end_x, int end_y, Func& func) {
+		if(isLeaf) {
+			func(this, node_x, node_y);
+			return;
+		}
+
+		const int child_size = size / 4;
+		for(int i = 0; i < ChildCount; ++i) {
+			QTreeNode* node = child[i];
+			if(!node)
+				continue;
+
+			const int x = node_x + (i & 3) * child_size;
+			const int y = node_y + (i >> 2) * child_size;
+			if(x > end_x || y > end_y || x + child_size <= start_x || y + child_size <= start_y)
+				continue;
+
+			node->visitLeaves(x, y, child_size, start_x, start_y, end_x, end_y, func);
+		}
+	}
+
+	// As visitLeaves, subtrees whose summary can't match the filter are skipped as well
+	template <typename Func>
+	void visitLeavesMatching(int node_x, int node_y, int size, int start_x, int start_y, int end_x, int end_y, const TileSummary& filter, Func& func) {
+		if(!summary.mayMatch(filter))
+			return;
+		if(isLeaf) {
+			func(this, node_x, node_y);
+			return;
+		}
+
+		const int child_size = size / 4;
+		for(int i = 0; i < ChildCount; ++i) {
+			QTreeNode* node = child[i];
+			if(!node)
+				continue;
+
+			const int x = node_x + (i & 3) * child_size;
+			const int y = node_y + (i >> 2) * child_size;
+			if(x > end_x || y > end_y || x + child_size <= start_x || y + child_size <= start_y)
+				continue;
+
+			node->visitLeavesMatching(x, y, child_size, start_x, start_y, end_x, end_y, filter, func);
+		}
+	}
+
+	DECLARE_POOLED_ALLOCATION()
+
 protected:
+	// Made from the tiles of a leaf or the summaries of the children of a node
+	const TileSummary& rebuildSummary();
+
 	BaseMap& map;
 	uint32_t visible;
+	uint32_t revision;
+	uint32_t draw_revision;
+	TileSummary summary;
 
 	bool isLeaf;
 
 	union {
-		QTreeNode* child[rme::MapLayers];
+		QTreeNode* child[ChildCount];
 		Floor* array[rme::MapLayers];
-//#if 16 != rme::MapLayers
-//#    error "You need to rewrite the QuadTree in order to handle more or less than 16 floors"
-//#endif
 	};
+	static_assert(ChildCount == rme::MapLayers, "A leaf holds its floors where a node holds its children");
 
 	friend class BaseMap;
 	friend class MapIterator;
@@ -0,0 +1,225 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#include "main.h"
+
+#include "map_search.h"
+#include "map.h"
+#include "complexitem.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <span>
+
+uint32_t MapSearch::match(const Tile* tile, const Item* item) const
+{
+	uint32_t matched = 0;
+	if((query & SEARCH_UNIQUE) && item->getUniqueID() > 0)
+		matched |= SEARCH_UNIQUE;
+	if((query & SEARCH_ACTION) && item->getActionID() > 0)
+		matched |= SEARCH_ACTION;
+	if(query & SEARCH_CONTAINER) {
+		const Container* container = dynamic_cast<const Container*>(item);
+		if(container && container->getItemCount())
+			matched |= SEARCH_CONTAINER;
+	}
+	if((query & SEARCH_WRITEABLE) && item->getText().length() > 0)
+		matched |= SEARCH_WRITEABLE;
+	if((query & SEARCH_ZONES) && item->isGroundTile() && tile->hasZones())
+		matched |= SEARCH_ZONES;
+	return matched;
+}
+
+bool MapSearch::mayMatch(const Tile* tile) const
+{
+	// The ids inside containers count for the tile as well
+	return ((query & SEARCH_UNIQUE) && tile->hasUniqueItem())
+		|| ((query & SEARCH_ACTION) && tile->hasActionItem())
+		|| ((query & SEARCH_CONTAINER) && tile->hasContainers())
+		|| ((query & SEARCH_ZONES) && tile->hasZones());
+}
+
+bool MapSearch::run(Map& map, bool selection, const std::function<void(const std::vector<MapSearchResult>&)>& found, const std::function<bool(int)>& progress) const
+{
+	// A paged map keeps areas in its file only, those are searched as well
+	if(!selection)
+		map.pageInAll();
+
+	std::vector<MapSearchResult> results;
+	auto search = [&](Tile* tile) {
+		foreach_ItemOnTile(tile, [&](Item* item) {
+			if(uint32_t matched = match(tile, item))
+				results.push_back({ tile, item, matched });
+		});
+	};
+
+	if(!selection && (query & ~(SEARCH_UNIQUE | SEARCH_ACTION)) == 0) {
+		// The map keeps the tiles with action and unique ids indexed
+		std::vector<Position> tiles = (query & SEARCH_UNIQUE) ? map.getUniqueIdTiles() : std::vector<Position>();
+		if(query & SEARCH_ACTION) {
+			std::vector<Position> action_tiles = map.getActionIdTiles();
+			tiles.insert(tiles.end(), action_tiles.begin(), action_tiles.end());
+			std::sort(tiles.begin(), tiles.end());
+			tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+		}
+		for(const Position& position : tiles) {
+			if(Tile* tile = map.getTile(position))
+				search(tile);
+		}
+		found(results);
+		return true;
+	}
+
+	// Text can be anywhere, but ids, containers and zones only on the leaves whose summary says so
+	uint16_t kinds = 0;
+	if(query & SEARCH_UNIQUE)
+		kinds |= TileSummary::UNIQUE;
+	if(query & SEARCH_ACTION)
+		kinds |= TileSummary::ACTION;
+	if(query & SEARCH_CONTAINER)
+		kinds |= TileSummary::CONTAINER;
+	if(query & SEARCH_ZONES)
+		kinds |= TileSummary::ZONE;
+	const bool pruned = (query & SEARCH_WRITEABLE) == 0;
+
+	std::vector<QTreeNode*> leaves;
+	TileSummary filter;
+	filter.floors = 0xFFFF;
+	map.visitLeavesMatching(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, filter, [&](QTreeNode* leaf, int, int) {
+		if(!pruned || (leaf->getSummary().kinds & kinds) != 0)
+			leaves.push_back(leaf);
+	});
+
+	// The leaves holding depots get runs of their own
+	ThreadPool& pool = ThreadPool::getInstance();
+	const std::vector<size_t> bounds = splitLeavesByItems(leaves);
+	const size_t chunk_count = bounds.size() - 1;
+	std::vector<std::vector<MapSearchResult>> chunks(chunk_count);
+	std::unique_ptr<std::atomic<bool>[]> finished(new std::atomic<bool>[chunk_count]);
+	for(size_t chunk = 0; chunk < chunk_count; ++chunk)
+		finished[chunk] = false;
+
+	ThreadPool::TaskGroup group;
+	std::atomic<size_t> done(0);
+	for(size_t chunk = 0; chunk < chunk_count; ++chunk) {
+		pool.submit(group, [&, chunk]() {
+			const size_t begin = bounds[chunk];
+			const size_t end = bounds[chunk + 1];
+			std::vector<MapSearchResult>& chunk_results = chunks[chunk];
+			for(size_t i = begin; i < end && !group.isCancelled(); ++i) {
+				for(Floor* floor : std::span(leaves[i]->getFloors(), rme::MapLayers)) {
+					if(!floor)
+						continue;
+
+					for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1) {
+						Tile* tile = floor->locs[std::countr_zero(mask)].get();
+						if((selection && !tile->isSelected()) || (pruned && !mayMatch(tile)))
+							continue;
+
+						foreach_ItemOnTile(tile, [&](Item* item) {
+							if(uint32_t matched = match(tile, item))
+								chunk_results.push_back({ tile, item, matched });
+						});
+					}
+				}
+			}
+			done += end - begin;
+			finished[chunk] = true;
+		});
+	}
+
+	// The finished chunks are handed over in order as they come in, a chunk still running holds back
+	// the ones after it
+	size_t next = 0;
+	auto flush = [&]() {
+		while(next < chunk_count && finished[next]) {
+			if(!chunks[next].empty())
+				found(chunks[next]);
+			std::vector<MapSearchResult>().swap(chunks[next]);
+			++next;
+		}
+	};
+
+	const size_t total = std::max<size_t>(leaves.size(), 1);
+	pool.wait(group, [&]() {
+		flush();
+		return !progress || progress(int(100 * done / total));
+	});
+	if(group.isCancelled())
+		return false;
+
+	flush();
+	return true;
+}
+
+void MapSearch::sort(std::vector<MapSearchResult>& results) const
+{
+	if(query & (SEARCH_UNIQUE | SEARCH_ACTION)) {
+		std::stable_sort(results.begin(), results.end(), [](const MapSearchResult& first, const MapSearchResult& second) {
+			const Item* item1 = first.item;
+			const Item* item2 = second.item;
+			if(item1->getActionID() != 0 || item2->getActionID() != 0)
+				return item1->getActionID() < item2->getActionID();
+			else if(item1->getUniqueID() != 0 || item2->getUniqueID() != 0)
+				return item1->getUniqueID() < item2->getUniqueID();
+			return false;
+		});
+	} else if(query & SEARCH_ZONES) {
+		std::stable_sort(results.begin(), results.end(), [](const MapSearchResult& first, const MapSearchResult& second) {
+			return first.tile->getZoneId() < second.tile->getZoneId();
+		});
+	}
+}
+
+wxString MapSearch::describe(const MapSearchResult& result)
+{
+	wxString label;
+	const Item* item = result.item;
+	if(result.matched & ~SEARCH_ZONES) {
+		if(item->getUniqueID() > 0)
+			label << "UID: " << item->getUniqueID() << " ";
+
+		if(item->getActionID() > 0)
+			label << "AID: " << item->getActionID() << " ";
+
+		label << wxstr(item->getName());
+
+		if(dynamic_cast<const Container*>(item))
+			label << " (Container) ";
+
+		if(item->getText().length() > 0)
+			label << " (Text: " << wxstr(item->getText()) << ") ";
+	}
+
+	if(result.matched & SEARCH_ZONES) {
+		if(!label.empty())
+			label << " ";
+
+		label << "Zone ID: ";
+		const std::vector<uint16_t>& zones = result.tile->getZoneIds();
+		for(size_t i = 0; i < zones.size(); ++i) {
+			if(i > 0)
+				label << "/";
+			label << zones[i];
+		}
+	}
+	return label;
+}
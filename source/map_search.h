@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#ifndef RME_MAP_SEARCH_H_
+#define RME_MAP_SEARCH_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Item;
+class Map;
+class Tile;
+
+// What the "search for stuff" actions look for, any combination of them is searched in one pass
+enum MapSearchQuery : uint32_t {
+	SEARCH_UNIQUE = 1 << 0,
+	SEARCH_ACTION = 1 << 1,
+	SEARCH_CONTAINER = 1 << 2, // Only containers holding items
+	SEARCH_WRITEABLE = 1 << 3,
+	SEARCH_ZONES = 1 << 4, // Ground of the tiles with zones
+};
+
+struct MapSearchResult
+{
+	Tile* tile;
+	Item* item;
+	uint32_t matched; // The queries it matched
+};
+
+class MapSearch
+{
+public:
+	explicit MapSearch(uint32_t query) : query(query) {}
+
+	uint32_t getQuery() const noexcept { return query; }
+
+	// The queries of this search the item matches, 0 if none
+	uint32_t match(const Tile* tile, const Item* item) const;
+
+	// Searches the map (or the selected tiles) once for all of the queries, on the shared ThreadPool.
+	// found(results) is called on the calling thread as parts of the map are done, in map order, and so is
+	// progress(percent); the search is cancelled once progress returns false. Returns false if cancelled,
+	// the results found by then have already been passed on.
+	bool run(Map& map, bool selection, const std::function<void(const std::vector<MapSearchResult>&)>& found, const std::function<bool(int)>& progress = nullptr) const;
+
+	// Orders results by action id and unique id, or by zone when only zones were looked for
+	void sort(std::vector<MapSearchResult>& results) const;
+	// Whether sort changes the order results are found in
+	bool sorts() const noexcept { return (query & (SEARCH_UNIQUE | SEARCH_ACTION | SEARCH_ZONES)) != 0; }
+
+	static wxString describe(const MapSearchResult& result);
+
+private:
+	// Whether the tile can hold a match of any query but text, from its flags alone
+	bool mayMatch(const Tile* tile) const;
+
+	uint32_t query;
+};
+
+#endif
@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#include "main.h"
+
+#include "map_statistics.h"
+#include "map.h"
+#include "items.h"
+#include "complexitem.h"
+
+#include <atomic>
+
+void TileStatistics::add(const Tile* tile)
+{
+	if(tile->empty())
+		return;
+
+	tile_count += 1;
+
+	bool is_detailed = false;
+	auto analyze = [&](const Item* item) {
+		item_count += 1;
+		if(item->isGroundTile() || item->isBorder())
+			return;
+
+		is_detailed = true;
+		const ItemType& it = g_items.getItemType(item->getID());
+		if(it.moveable)
+			loose_item_count += 1;
+		if(it.isDepot())
+			depot_count += 1;
+		if(item->getActionID() > 0)
+			action_item_count += 1;
+		if(item->getUniqueID() > 0)
+			unique_item_count += 1;
+		if(tile->hasContainers()) {
+			const Container* container = dynamic_cast<const Container*>(item);
+			if(container && !container->getVector().empty())
+				container_count += 1;
+		}
+	};
+
+	if(tile->ground)
+		analyze(tile->ground);
+	for(const Item* item : tile->items)
+		analyze(item);
+
+	if(tile->spawn)
+		spawn_count += 1;
+	if(tile->creature)
+		creature_count += 1;
+
+	if(tile->isBlocking())
+		blocking_tile_count += 1;
+	else
+		walkable_tile_count += 1;
+
+	if(is_detailed)
+		detailed_tile_count += 1;
+}
+
+void TileStatistics::add(const TileStatistics& other)
+{
+	tile_count += other.tile_count;
+	detailed_tile_count += other.detailed_tile_count;
+	blocking_tile_count += other.blocking_tile_count;
+	walkable_tile_count += other.walkable_tile_count;
+	spawn_count += other.spawn_count;
+	creature_count += other.creature_count;
+	item_count += other.item_count;
+	loose_item_count += other.loose_item_count;
+	depot_count += other.depot_count;
+	action_item_count += other.action_item_count;
+	unique_item_count += other.unique_item_count;
+	container_count += other.container_count;
+}
+
+void MapStatisticsCache::clear()
+{
+	leaves.clear();
+	tiles_revision = 0;
+}
+
+TileStatistics MapStatisticsCache::collect(Map& map, const std::function<void(int)>& progress)
+{
+	if(map.getTilesRevision() != tiles_revision) {
+		leaves.clear();
+		tiles_revision = map.getTilesRevision();
+	}
+
+	// The leaves of the map now, the ones kept at the same revision are taken as they are. Leaves
+	// freed since are dropped, a leaf allocated at the address of a freed one has a new revision.
+	// What a paged map keeps in its file only is read back first.
+	map.pageInAll();
+	std::unordered_map<QTreeNode*, Entry> current;
+	current.reserve(leaves.size());
+	std::vector<std::pair<QTreeNode*, TileStatistics*>> changed;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&](QTreeNode* leaf, int, int) {
+		Entry& entry = current[leaf];
+		auto it = leaves.find(leaf);
+		if(it != leaves.end() && it->second.revision == leaf->getRevision()) {
+			entry = it->second;
+		} else {
+			entry.revision = leaf->getRevision();
+			changed.emplace_back(leaf, &entry.statistics);
+		}
+	});
+	leaves.swap(current);
+
+	// Every changed leaf is counted into its own entry, no state is shared between the tasks
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t chunk_count = std::max<size_t>(std::min(changed.size() / 64, pool.getWorkerCount() * 8), 1);
+	std::atomic<size_t> done(0);
+	const size_t total = std::max<size_t>(changed.size(), 1);
+	pool.parallelFor(chunk_count, [&](size_t chunk) {
+		const size_t begin = changed.size() * chunk / chunk_count;
+		const size_t end = changed.size() * (chunk + 1) / chunk_count;
+		for(size_t i = begin; i < end; ++i) {
+			TileStatistics& statistics = *changed[i].second;
+			for(Floor* floor : std::span(changed[i].first->getFloors(), rme::MapLayers)) {
+				if(!floor)
+					continue;
+				for(uint32_t mask = floor->getOccupied(); mask != 0; mask &= mask - 1)
+					statistics.add(floor->locs[std::countr_zero(mask)].get());
+			}
+		}
+		done += end - begin;
+	}, [&]() {
+		if(progress)
+			progress(int(100 * done / total));
+		return true;
+	});
+
+	TileStatistics statistics;
+	for(const auto& leaf : leaves)
+		statistics.add(leaf.second.statistics);
+	return statistics;
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#ifndef RME_MAP_STATISTICS_H_
+#define RME_MAP_STATISTICS_H_
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+class Map;
+class QTreeNode;
+class Tile;
+
+// Counts of the tiles, items and creatures of a map, for the statistics dialog
+struct TileStatistics
+{
+	uint64_t tile_count = 0;
+	uint64_t detailed_tile_count = 0;
+	uint64_t blocking_tile_count = 0;
+	uint64_t walkable_tile_count = 0;
+	uint64_t spawn_count = 0;
+	uint64_t creature_count = 0;
+	uint64_t item_count = 0;
+	uint64_t loose_item_count = 0;
+	uint64_t depot_count = 0;
+	uint64_t action_item_count = 0;
+	uint64_t unique_item_count = 0;
+	uint64_t container_count = 0; // Only containers holding items
+
+	void add(const Tile* tile);
+	void add(const TileStatistics& other);
+};
+
+// Keeps the counts of every leaf of a map along with the leaf revision they were taken at, so
+// asking again only counts the leaves that were changed since. Tiles changed in place follow the
+// contract of the drawing caches: they have to be marked through markTileChanged or
+// markAllTilesChanged, the latter drops everything kept.
+class MapStatisticsCache
+{
+public:
+	// The counts of the whole map, the changed leaves are counted on the shared ThreadPool.
+	// progress(percent) is called on the calling thread.
+	TileStatistics collect(Map& map, const std::function<void(int)>& progress = nullptr);
+	void clear();
+
+private:
+	struct Entry {
+		uint32_t revision = 0;
+		TileStatistics statistics;
+	};
+
+	std::unordered_map<QTreeNode*, Entry> leaves;
+	uint32_t tiles_revision = 0;
+};
+
+#endif
@@ -28,9 +28,20 @@
 #include "brush.h"
 #include "creature_brush.h"
 #include "raw_brush.h"
+#include "thread_pool.h"
+#include "tracing.h"
+
+#include <unordered_map>
 
 Materials g_materials;
 
+namespace {
+	time_t getFileTime(const wxString& path)
+	{
+		return wxFileExists(path) ? wxFileModificationTime(path) : -1;
+	}
+}
+
 Materials::Materials()
 {
 	////
@@ -53,6 +64,24 @@ void Materials::clear()
 
 	tilesets.clear();
 	extensions.clear();
+	tileset_handles.clear();
+	membership.clear();
+	membership_words = 0;
+	membership_ids = 0;
+	file_times.clear();
+	extensions_directory.Clear();
+}
+
+void Materials::swap(Materials& other)
+{
+	tilesets.swap(other.tilesets);
+	extensions.swap(other.extensions);
+	tileset_handles.swap(other.tileset_handles);
+	membership.swap(other.membership);
+	std::swap(membership_words, other.membership_words);
+	std::swap(membership_ids, other.membership_ids);
+	file_times.swap(other.file_times);
+	std::swap(extensions_directory, other.extensions_directory);
 }
 
 const MaterialsExtensionList& Materials::getExtensions()
@@ -71,11 +100,108 @@ MaterialsExtensionList Materials::getExtensionsByVersion(uint16_t version_id)
 	return ret_list;
 }
 
+void Materials::parseDocuments(std::vector<std::pair<FileName, FileName>> files)
+{
+	while(!files.empty()) {
+		std::vector<std::string> paths;
+		for(const auto& file : files) {
+			paths.push_back(std::string(file.first.GetFullPath().mb_str()));
+		}
+
+		std::vector<std::unique_ptr<ParsedDocument>> documents(files.size());
+		ThreadPool::getInstance().parallelFor(files.size(), [&](size_t index) {
+			documents[index] = std::make_unique<ParsedDocument>();
+			documents[index]->result = documents[index]->doc.load_file(paths[index].c_str());
+		});
+
+		// The includes of this round are parsed in the next one
+		std::vector<std::pair<FileName, FileName>> includes;
+		for(size_t index = 0; index < files.size(); ++index) {
+			const pugi::xml_node root = documents[index]->doc.document_element();
+			for(pugi::xml_node childNode = root.first_child(); childNode; childNode = childNode.next_sibling()) {
+				pugi::xml_attribute attribute;
+				if(as_lower_str(childNode.name()) != "include" || !(attribute = childNode.attribute("file"))) {
+					continue;
+				}
+
+				FileName includeName;
+				includeName.SetPath(files[index].second.GetPath());
+				includeName.SetFullName(wxString(attribute.as_string(), wxConvUTF8));
+				includes.emplace_back(includeName, includeName);
+			}
+			parsed_documents.emplace(paths[index], std::move(documents[index]));
+			file_times[paths[index]] = getFileTime(files[index].first.GetFullPath());
+		}
+
+		files.clear();
+		for(auto& include : includes) {
+			const std::string path(include.first.GetFullPath().mb_str());
+			if(parsed_documents.count(path) == 0 && std::find_if(files.begin(), files.end(), [&path](const auto& file) {
+				return std::string(file.first.GetFullPath().mb_str()) == path;
+			}) == files.end()) {
+				files.push_back(std::move(include));
+			}
+		}
+	}
+}
+
+const Materials::ParsedDocument& Materials::getDocument(const FileName& filename)
+{
+	const std::string path(filename.GetFullPath().mb_str());
+	std::unique_ptr<ParsedDocument>& document = parsed_documents[path];
+	if(!document) {
+		// Not seen by parseDocuments, read it here
+		document = std::make_unique<ParsedDocument>();
+		document->result = document->doc.load_file(path.c_str());
+		file_times[path] = getFileTime(filename.GetFullPath());
+	}
+	return *document;
+}
+
+std::vector<wxString> Materials::getChangedFiles() const
+{
+	std::vector<wxString> changed;
+	for(const auto& file : file_times) {
+		const wxString path(file.first);
+		if(getFileTime(path) != file.second) {
+			changed.push_back(path);
+		}
+	}
+
+	// Extensions dropped into the directory since
+	if(extensions_directory.GetPath().empty()) {
+		return changed;
+	}
+	wxDir ext_dir(extensions_directory.GetPath());
+	if(!ext_dir.IsOpened()) {
+		return changed;
+	}
+	wxString entry;
+	for(bool found = ext_dir.GetFirst(&entry, "*.xml", wxDIR_FILES); found; found = ext_dir.GetNext(&entry)) {
+		FileName fn;
+		fn.SetPath(extensions_directory.GetPath());
+		fn.SetFullName(entry);
+		if(file_times.count(std::string(fn.GetFullPath().mb_str())) == 0) {
+			changed.push_back(fn.GetFullPath());
+		}
+	}
+	return changed;
+}
+
 bool Materials::loadMaterials(const FileName& identifier, wxString& error, wxArrayString& warnings)
 {
-	pugi::xml_document doc;
-	pugi::xml_parse_result result = doc.load_file(identifier.GetFullPath().mb_str());
-	if(!result) {
+	RME_TRACE_ZONE("load", "Materials::loadMaterials");
+	parseDocuments({ { identifier, identifier } });
+	const bool loaded = loadMaterialsFile(identifier, error, warnings);
+	parsed_documents.clear();
+	return loaded;
+}
+
+bool Materials::loadMaterialsFile(const FileName& identifier, wxString& error, wxArrayString& warnings)
+{
+	const ParsedDocument& document = getDocument(identifier);
+	const pugi::xml_document& doc = document.doc;
+	if(!document.result) {
 		warnings.push_back("Could not open " + identifier.GetFullName() + " (file not found or syntax error)");
 		return false;
 	}
@@ -92,7 +218,9 @@ bool Materials::loadMaterials(const FileName& identifier, wxString& error, wxArr
 
 bool Materials::loadExtensions(FileName directoryName, wxString& error, wxArrayString& warnings)
 {
+	RME_TRACE_ZONE("load", "Materials::loadExtensions");
 	directoryName.Mkdir(0755, wxPATH_MKDIR_FULL); // Create if it doesn't exist
+	extensions_directory = directoryName;
 
 	wxDir ext_dir(directoryName.GetPath());
 	if(!ext_dir.IsOpened()) {
@@ -100,24 +228,30 @@ bool Materials::loadExtensions(FileName directoryName, wxString& error, wxArrayS
 		return false;
 	}
 
-	wxString filename;
-	if(!ext_dir.GetFirst(&filename)) {
+	wxString entry;
+	if(!ext_dir.GetFirst(&entry)) {
 		// No extensions found
 		return true;
 	}
 
-	StringVector clientVersions;
+	// Includes of extensions are looked up by the bare file name, as they always were
+	std::vector<std::pair<FileName, FileName>> files;
 	do {
 		FileName fn;
 		fn.SetPath(directoryName.GetPath());
-		fn.SetFullName(filename);
-		if(fn.GetExt() != "xml") {
-			continue;
+		fn.SetFullName(entry);
+		if(fn.GetExt() == "xml") {
+			files.emplace_back(fn, FileName(entry));
 		}
+	} while(ext_dir.GetNext(&entry));
+	parseDocuments(files);
 
-		pugi::xml_document doc;
-		pugi::xml_parse_result result = doc.load_file(fn.GetFullPath().mb_str());
-		if(!result) {
+	StringVector clientVersions;
+	for(const auto& file : files) {
+		const wxString filename = file.first.GetFullName();
+		const ParsedDocument& document = getDocument(file.first);
+		const pugi::xml_document& doc = document.doc;
+		if(!document.result) {
 			warnings.push_back("Could not open " + filename + " (file not found or syntax error)");
 			continue;
 		}
@@ -194,8 +328,9 @@ bool Materials::loadExtensions(FileName directoryName, wxString& error, wxArrayS
 		if(materialExtension->isForVersion(g_gui.GetCurrentVersionID())) {
 			unserializeMaterials(filename, extensionNode, error, warnings);
 		}
-	} while(ext_dir.GetNext(&filename));
+	}
 
+	parsed_documents.clear();
 	return true;
 }
 
@@ -215,7 +350,7 @@ bool Materials::unserializeMaterials(const FileName& filename, pugi::xml_node no
 			includeName.SetFullName(wxString(attribute.as_string(), wxConvUTF8));
 
 			wxString subError;
-			if(!loadMaterials(includeName, subError, warnings)) {
+			if(!loadMaterialsFile(includeName, subError, warnings)) {
 				warnings.push_back("Error while loading file \"" + includeName.GetFullName() + "\": " + subError);
 			}
 		} else if(childName == "metaitem") {
@@ -239,6 +374,7 @@ bool Materials::unserializeMaterials(const FileName& filename, pugi::xml_node no
 
 void Materials::createOtherTileset()
 {
+	RME_TRACE_ZONE("load", "Materials::createOtherTileset");
 	Tileset* others;
 	Tileset* npc_tileset;
 
@@ -265,22 +401,12 @@ void Materials::createOtherTileset()
 			continue;
 		}
 
-		if(!type->isMetaItem()) {
-			Brush* brush;
-			if(type->in_other_tileset) {
-				others->getCategory(TILESET_RAW)->brushlist.push_back(type->raw_brush);
-				continue;
-			} else if(!type->raw_brush) {
-				brush = type->raw_brush = newd RAWBrush(type->id);
-				type->has_raw = true;
-				g_brushes.addBrush(type->raw_brush);
-			} else if(!type->has_raw) {
-				brush = type->raw_brush;
-			} else
-				continue;
-
-			brush->flagAsVisible();
-			others->getCategory(TILESET_RAW)->brushlist.push_back(type->raw_brush);
+		// The RAW brushes of these are made by g_items once they're first asked for
+		if(!type->isMetaItem() && (type->in_other_tileset || !type->raw_brush || !type->has_raw)) {
+			if(type->raw_brush) {
+				type->raw_brush->flagAsVisible();
+			}
+			others->getCategory(TILESET_RAW)->lazy_items.push_back(type->id);
 			type->in_other_tileset = true;
 		}
 	}
@@ -305,6 +431,57 @@ void Materials::createOtherTileset()
 			}
 		}
 	}
+
+	// The last of the tilesets to be filled
+	updateTilesetMembership();
+}
+
+void Materials::updateTilesetMembership()
+{
+	tileset_handles.clear();
+	membership_words = (tilesets.size() + 63) / 64;
+	membership_ids = g_items.getMaxID() + 1;
+	membership.assign(membership_ids * membership_words, 0);
+
+	// The tilesets of every brush first, then the brushes of every item type
+	std::unordered_map<const Brush*, std::vector<uint64_t>> brush_tilesets;
+	TilesetHandle handle = 0;
+	for(const auto& entry : tilesets) {
+		tileset_handles[entry.first] = handle;
+		for(const TilesetCategory* category : entry.second->categories) {
+			for(const Brush* brush : category->brushlist) {
+				std::vector<uint64_t>& words = brush_tilesets[brush];
+				words.resize(membership_words);
+				words[handle / 64] |= uint64_t(1) << (handle % 64);
+			}
+			for(uint16_t id : category->lazy_items) {
+				if(id < membership_ids)
+					membership[id * membership_words + handle / 64] |= uint64_t(1) << (handle % 64);
+			}
+		}
+		++handle;
+	}
+
+	for(size_t id = 1; id < membership_ids; ++id) {
+		const ItemType& type = g_items.getItemType(static_cast<uint16_t>(id));
+		if(type.id == 0)
+			continue;
+
+		uint64_t* words = &membership[id * membership_words];
+		for(const Brush* brush : { type.brush, type.doodad_brush, static_cast<Brush*>(type.raw_brush) }) {
+			auto it = brush ? brush_tilesets.find(brush) : brush_tilesets.end();
+			if(it == brush_tilesets.end())
+				continue;
+			for(size_t word = 0; word < membership_words; ++word)
+				words[word] |= it->second[word];
+		}
+	}
+}
+
+Materials::TilesetHandle Materials::getTilesetHandle(const std::string& tileset) const
+{
+	auto it = tileset_handles.find(tileset);
+	return it != tileset_handles.end() ? it->second : NoTileset;
 }
 
 bool Materials::unserializeTileset(pugi::xml_node node, wxArrayString& warnings)
@@ -332,16 +509,12 @@ bool Materials::unserializeTileset(pugi::xml_node node, wxArrayString& warnings)
 	return true;
 }
 
-bool Materials::isInTileset(Item* item, std::string tilesetName) const
+bool Materials::isInTileset(Item* item, const std::string& tilesetName) const
 {
-	const ItemType& type = g_items.getItemType(item->getID());
-	return type.id != 0 && (
-		isInTileset(type.brush, tilesetName) ||
-		isInTileset(type.doodad_brush, tilesetName) ||
-		isInTileset(type.raw_brush, tilesetName));
+	return isInTileset(item->getID(), getTilesetHandle(tilesetName));
 }
 
-bool Materials::isInTileset(Brush* brush, std::string tilesetName) const
+bool Materials::isInTileset(Brush* brush, const std::string& tilesetName) const
 {
 	if(!brush)
 		return false;
@@ -26,6 +26,8 @@ public:
 	~Materials();
 
 	void clear();
+	// Exchanges the tilesets and extensions with other
+	void swap(Materials& other);
 
 	const MaterialsExtensionList& getExtensions();
 	MaterialsExtensionList getExtensionsByVersion(uint16_t version_id);
@@ -36,14 +38,52 @@ public:
 	bool loadExtensions(FileName identifier, wxString& error, wxArrayString& warnings);
 	void createOtherTileset();
 
-	bool isInTileset(Item* item, std::string tileset) const;
-	bool isInTileset(Brush* brush, std::string tileset) const;
+	// Tilesets looked up once by name, for testing many items against them
+	using TilesetHandle = int;
+	static constexpr TilesetHandle NoTileset = -1;
+	TilesetHandle getTilesetHandle(const std::string& tileset) const;
+	// Whether a brush of the item type is in the tileset, a bit of the table made by
+	// updateTilesetMembership
+	bool isInTileset(uint16_t id, TilesetHandle tileset) const noexcept {
+		return tileset >= 0 && id < membership_ids &&
+			((membership[id * membership_words + tileset / 64] >> (tileset % 64)) & 1);
+	}
+	bool isInTileset(Item* item, const std::string& tileset) const;
+	bool isInTileset(Brush* brush, const std::string& tileset) const;
+
+	// Works out the tilesets of every item type again, once the tilesets changed
+	void updateTilesetMembership();
+
+	// The files read by the loads since the last clear that were changed or removed since, and
+	// the files added to the extensions directory, by full path
+	std::vector<wxString> getChangedFiles() const;
 
 protected:
 	bool unserializeMaterials(const FileName& filename, pugi::xml_node node, wxString& error, wxArrayString& warnings);
 	bool unserializeTileset(pugi::xml_node node, wxArrayString& warnings);
 
+	// Files are parsed on the thread pool first, along with everything they include, then
+	// registered one by one in the order they would have been read in. Includes are found
+	// relative to the base given with each file.
+	struct ParsedDocument {
+		pugi::xml_document doc;
+		pugi::xml_parse_result result;
+	};
+	void parseDocuments(std::vector<std::pair<FileName, FileName>> files);
+	const ParsedDocument& getDocument(const FileName& filename);
+	bool loadMaterialsFile(const FileName& identifier, wxString& error, wxArrayString& warnings);
+
 	MaterialsExtensionList extensions;
+	// Bit per tileset of every item type, membership_words words per type
+	std::map<std::string, TilesetHandle> tileset_handles;
+	std::vector<uint64_t> membership;
+	size_t membership_words = 0;
+	size_t membership_ids = 0;
+	// By full path, only while loading
+	std::map<std::string, std::unique_ptr<ParsedDocument>> parsed_documents;
+	// Modification times of every file read, by full path, -1 for the ones that were missing
+	std::map<std::string, time_t> file_times;
+	FileName extensions_directory;
 
 private:
 	Materials(const Materials&);
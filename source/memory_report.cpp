@@ -0,0 +1,194 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "memory_report.h"
+#include "action.h"
+#include "complexitem.h"
+#include "copybuffer.h"
+#include "editor.h"
+#include "graphics.h"
+#include "gui.h"
+#include "live_socket.h"
+#include "map_allocator.h"
+#include "map_tab.h"
+
+namespace {
+	struct TileMemory {
+		uint64_t tiles = 0;
+		uint64_t tile_bytes = 0;
+		uint64_t items = 0;
+		uint64_t item_bytes = 0;
+		uint64_t attributes = 0;
+		uint64_t attribute_bytes = 0;
+
+		void operator()(const Map& map, Tile* tile) {
+			++tiles;
+			tile_bytes += sizeof(Tile) + tile->items.heapsize();
+			if(tile->ground) {
+				addItem(tile->ground);
+			}
+			for(const Item* item : tile->items) {
+				addItem(item);
+			}
+		}
+
+		void addItem(const Item* item) {
+			++items;
+			item_bytes += sizeof(Item);
+			attributes += item->getAttributeCount();
+			attribute_bytes += item->getAttributeMemsize();
+			if(const Container* container = dynamic_cast<const Container*>(item)) {
+				item_bytes += container->getVector().heapsize();
+				for(const Item* content : container->getVector()) {
+					addItem(content);
+				}
+			}
+		}
+
+		void merge(const TileMemory& other) {
+			tiles += other.tiles;
+			tile_bytes += other.tile_bytes;
+			items += other.items;
+			item_bytes += other.item_bytes;
+			attributes += other.attributes;
+			attribute_bytes += other.attribute_bytes;
+		}
+	};
+}
+
+void MemoryReport::collect()
+{
+	entries.clear();
+	pools.clear();
+
+	// Several tabs can show the same map
+	std::set<Editor*> editors;
+	for(int index = 0; index < g_gui.GetTabCount(); ++index) {
+		MapTab* tab = dynamic_cast<MapTab*>(g_gui.GetTab(index));
+		if(tab && editors.insert(tab->GetEditor()).second) {
+			addEditor(*tab->GetEditor());
+		}
+	}
+
+	add("copy_buffer", "Copy buffer", g_gui.copybuffer.GetTileCount(), g_gui.copybuffer.memsize());
+
+	const GraphicManager::MemoryUsage graphics = g_gui.gfx.getMemoryUsage();
+	add("sprite_atlas", "Sprite atlas pages", graphics.atlas_pages, graphics.atlas_bytes);
+	add("atlas_sprites", "Sprites in the atlas", graphics.atlas_sprites, 0);
+	add("textures", "Standalone textures", graphics.textures, graphics.texture_bytes);
+	add("sprite_dumps", "Sprite pixel data", graphics.sprite_dumps, graphics.sprite_dump_bytes);
+	add("software_sprites", "Software sprite cache", graphics.software_sprites, graphics.software_bytes);
+	add("zone_sets", "Zone sets", ZoneSets::count(), ZoneSets::memsize());
+
+#if RME_POOLED_MAP_ALLOCATOR > 0
+	const auto addPool = [this](const char* name, const char* label, size_t live, size_t reserved) {
+		pools.push_back({ name, label, live, reserved });
+	};
+	addPool("tile_pool", "Tile pool", MapAllocator::tilePool().liveCount(), MapAllocator::tilePool().reservedBytes());
+	addPool("floor_pool", "Floor pool", MapAllocator::floorPool().liveCount(), MapAllocator::floorPool().reservedBytes());
+	addPool("node_pool", "Node pool", MapAllocator::nodePool().liveCount(), MapAllocator::nodePool().reservedBytes());
+	addPool("item_pool", "Item pool", MapAllocator::itemPool().liveCount(), MapAllocator::itemPool().reservedBytes());
+#endif
+}
+
+void MemoryReport::addEditor(Editor& editor)
+{
+	Map& map = editor.getMap();
+
+	// What is in memory, the areas a paged map keeps in its file only aren't read back for it
+	std::vector<QTreeNode*> resident;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&resident](QTreeNode* leaf, int, int) {
+		resident.push_back(leaf);
+	});
+	TileMemory tiles;
+	for(const TileMemory& chunk : parallel_foreach_TileOnLeaves(map, resident, TileMemory())) {
+		tiles.merge(chunk);
+	}
+	add("tiles", "Tiles", tiles.tiles, tiles.tile_bytes);
+	add("items", "Items", tiles.items, tiles.item_bytes);
+	add("item_attributes", "Item attributes", tiles.attributes, tiles.attribute_bytes);
+
+	uint64_t leaves = 0, floors = 0;
+	map.visitLeaves(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, [&leaves](QTreeNode*, int, int) {
+		++leaves;
+	});
+	map.visitFloors(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, 0, rme::MapMaxLayer, [&floors](Floor*, int, int, int) {
+		++floors;
+	});
+	add("map_leaves", "Map leaves", leaves, leaves * sizeof(QTreeNode));
+	add("floors", "Floors", floors, floors * sizeof(Floor));
+
+	if(const ActionQueue* history = editor.getHistoryActions()) {
+		add("undo_history", "Undo history", history->size(), history->memsize());
+	}
+
+	if(editor.IsLive()) {
+		const LiveSocket::BufferUsage usage = editor.GetLive().getBufferUsage();
+		add("live_buffers", "Live session buffers", usage.messages, usage.bytes);
+	}
+}
+
+uint64_t MemoryReport::getTotalBytes() const
+{
+	uint64_t total = 0;
+	for(const Entry& entry : entries) {
+		total += entry.bytes;
+	}
+	return total;
+}
+
+void MemoryReport::add(const std::string& name, const std::string& label, uint64_t count, uint64_t bytes)
+{
+	for(Entry& entry : entries) {
+		if(entry.name == name) {
+			entry.count += count;
+			entry.bytes += bytes;
+			return;
+		}
+	}
+	entries.push_back({ name, label, count, bytes });
+}
+
+json MemoryReport::toJSON() const
+{
+	const auto toObject = [](const std::vector<Entry>& list) {
+		json object = json::object();
+		for(const Entry& entry : list) {
+			object[entry.name] = { { "count", entry.count }, { "bytes", entry.bytes } };
+		}
+		return object;
+	};
+
+	json report;
+	report["total_bytes"] = getTotalBytes();
+	report["entries"] = toObject(entries);
+	report["pools"] = toObject(pools);
+	return report;
+}
+
+bool MemoryReport::saveJSON(const FileName& filename) const
+{
+	std::ofstream file(nstr(filename.GetFullPath()).c_str(), std::ios::trunc | std::ios::out);
+	if(!file.is_open()) {
+		return false;
+	}
+
+	file << toJSON().dump(4) << '\n';
+	return file.good();
+}
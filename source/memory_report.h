@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MEMORY_REPORT_H_
+#define RME_MEMORY_REPORT_H_
+
+#include <string>
+#include <vector>
+
+class Editor;
+
+// What the editor holds in memory, per subsystem. The numbers come from walking the
+// live structures when the report is collected, nothing is counted while editing.
+class MemoryReport
+{
+public:
+	struct Entry {
+		std::string name; // Key in the JSON export
+		std::string label;
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	// The editors of all open maps, the copy buffer, the sprites and the map pools
+	void collect();
+	// Adds the map, history and live session of one editor
+	void addEditor(Editor& editor);
+
+	const std::vector<Entry>& getEntries() const noexcept { return entries; }
+	// Slabs of the map allocator, the objects in them are part of the entries already
+	const std::vector<Entry>& getPools() const noexcept { return pools; }
+	uint64_t getTotalBytes() const;
+
+	json toJSON() const;
+	bool saveJSON(const FileName& filename) const;
+
+private:
+	// Entries of the same name are summed up
+	void add(const std::string& name, const std::string& label, uint64_t count, uint64_t bytes);
+
+	std::vector<Entry> entries;
+	std::vector<Entry> pools;
+};
+
+#endif
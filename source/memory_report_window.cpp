@@ -0,0 +1,127 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "memory_report_window.h"
+
+#include "gui.h"
+#include "map.h"
+
+BEGIN_EVENT_TABLE(MemoryReportDialog, wxDialog)
+	EVT_BUTTON(wxID_OK, MemoryReportDialog::OnClickOK)
+	EVT_BUTTON(MEMORY_REPORT_REFRESH_BUTTON, MemoryReportDialog::OnClickRefresh)
+	EVT_BUTTON(MEMORY_REPORT_EXPORT_BUTTON, MemoryReportDialog::OnClickExport)
+	EVT_BUTTON(MEMORY_REPORT_COMPACT_BUTTON, MemoryReportDialog::OnClickCompact)
+END_EVENT_TABLE()
+
+MemoryReportDialog::MemoryReportDialog(wxWindow* parent) :
+	wxDialog(parent, wxID_ANY, "Memory Report", wxDefaultPosition, wxSize(500, 450), wxRESIZE_BORDER | wxCAPTION)
+{
+	wxBoxSizer* topSizer = newd wxBoxSizer(wxVERTICAL);
+
+	list = newd wxListCtrl(this, wxID_ANY, wxDefaultPosition, wxSize(460, 340), wxLC_REPORT | wxLC_SINGLE_SEL);
+	list->AppendColumn("Category", wxLIST_FORMAT_LEFT, 220);
+	list->AppendColumn("Count", wxLIST_FORMAT_RIGHT, 100);
+	list->AppendColumn("Size", wxLIST_FORMAT_RIGHT, 120);
+	topSizer->Add(list, wxSizerFlags(1).DoubleBorder().Expand());
+
+	total = newd wxStaticText(this, wxID_ANY, "");
+	topSizer->Add(total, wxSizerFlags(0).DoubleBorder(wxLEFT | wxRIGHT));
+
+	wxSizer* buttonSizer = newd wxBoxSizer(wxHORIZONTAL);
+	buttonSizer->Add(newd wxButton(this, wxID_OK, "OK"), wxSizerFlags(1).Center());
+	buttonSizer->Add(newd wxButton(this, MEMORY_REPORT_REFRESH_BUTTON, "Refresh"), wxSizerFlags(1).Center());
+	buttonSizer->Add(newd wxButton(this, MEMORY_REPORT_EXPORT_BUTTON, "Export JSON..."), wxSizerFlags(1).Center());
+	wxButton* compactButton = newd wxButton(this, MEMORY_REPORT_COMPACT_BUTTON, "Compact Map");
+	compactButton->SetToolTip("Moves the tiles and items of the current map together in the order of the map, and frees the memory left over");
+	compactButton->Enable(g_gui.IsEditorOpen());
+	buttonSizer->Add(compactButton, wxSizerFlags(1).Center());
+	topSizer->Add(buttonSizer, 0, wxCENTER | wxLEFT | wxRIGHT | wxBOTTOM, 20);
+
+	SetSizerAndFit(topSizer);
+	Centre(wxBOTH);
+
+	Collect();
+}
+
+MemoryReportDialog::~MemoryReportDialog()
+{
+	////
+}
+
+void MemoryReportDialog::Collect()
+{
+	wxBusyCursor busy;
+	report.collect();
+
+	list->DeleteAllItems();
+	for(const MemoryReport::Entry& entry : report.getEntries()) {
+		AddRow(entry);
+	}
+	// Reserved up front, the objects in them are counted above
+	for(const MemoryReport::Entry& entry : report.getPools()) {
+		AddRow(entry);
+	}
+
+	total->SetLabel("Total: " + wxFileName::GetHumanReadableSize(wxULongLong(report.getTotalBytes())));
+}
+
+void MemoryReportDialog::AddRow(const MemoryReport::Entry& entry)
+{
+	const long row = list->InsertItem(list->GetItemCount(), wxstr(entry.label));
+	list->SetItem(row, 1, wxString::Format("%llu", static_cast<unsigned long long>(entry.count)));
+	list->SetItem(row, 2, wxFileName::GetHumanReadableSize(wxULongLong(entry.bytes)));
+}
+
+void MemoryReportDialog::OnClickOK(wxCommandEvent& evt)
+{
+	EndModal(0);
+}
+
+void MemoryReportDialog::OnClickRefresh(wxCommandEvent& evt)
+{
+	Collect();
+}
+
+void MemoryReportDialog::OnClickCompact(wxCommandEvent& evt)
+{
+	if(!g_gui.IsEditorOpen())
+		return;
+
+	size_t released;
+	{
+		wxBusyCursor busy;
+		released = g_gui.GetCurrentMap().compact();
+	}
+	g_gui.RefreshView();
+
+	Collect();
+	total->SetLabel(total->GetLabel() + " (" + wxFileName::GetHumanReadableSize(wxULongLong(released)) + " released)");
+	Layout();
+}
+
+void MemoryReportDialog::OnClickExport(wxCommandEvent& evt)
+{
+	wxFileDialog dialog(this, "Export memory report...", "", "memory_report.json", "JSON files (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if(dialog.ShowModal() != wxID_OK)
+		return;
+
+	if(!report.saveJSON(FileName(dialog.GetPath()))) {
+		g_gui.PopupDialog(this, "Error", "Could not write " + dialog.GetPath(), wxOK);
+	}
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MEMORY_REPORT_WINDOW_H_
+#define RME_MEMORY_REPORT_WINDOW_H_
+
+#include "memory_report.h"
+
+#include <wx/listctrl.h>
+
+class MemoryReportDialog : public wxDialog
+{
+public:
+	MemoryReportDialog(wxWindow* parent);
+	virtual ~MemoryReportDialog();
+
+	void OnClickOK(wxCommandEvent& evt);
+	void OnClickRefresh(wxCommandEvent& evt);
+	void OnClickExport(wxCommandEvent& evt);
+	void OnClickCompact(wxCommandEvent& evt);
+
+	DECLARE_EVENT_TABLE();
+
+private:
+	void Collect();
+	void AddRow(const MemoryReport::Entry& entry);
+
+	MemoryReport report;
+	wxListCtrl* list;
+	wxStaticText* total;
+};
+
+#endif
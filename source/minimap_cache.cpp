@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "minimap_cache.h"
+#include "basemap.h"
+#include "tile.h"
+
+MinimapCache::MinimapCache(BaseMap& map) :
+	map(map),
+	tiles_revision(map.getTilesRevision())
+{
+}
+
+void MinimapCache::clear()
+{
+	blocks.clear();
+	tiles_revision = map.getTilesRevision();
+}
+
+const uint8_t* MinimapCache::getBlock(int x, int y, int z, int level, uint32_t* version)
+{
+	ASSERT(level >= 0 && level < MipLevels);
+	if(tiles_revision != map.getTilesRevision()) {
+		clear();
+	}
+
+	const int block_x = x / BlockSize;
+	const int block_y = y / BlockSize;
+	const uint32_t key = (uint32_t(block_x) << 14) | (uint32_t(block_y) << 4) | uint32_t(z);
+	Block& block = blocks[key];
+	if(block.checked != map.getRevision()) {
+		if(update(block, block_x * BlockSize, block_y * BlockSize, z)) {
+			block.version = map.getRevision();
+		}
+		block.checked = map.getRevision();
+	}
+	if(version) {
+		*version = block.version;
+	}
+	return block.colours + getOffset(level);
+}
+
+bool MinimapCache::update(Block& block, int block_x, int block_y, int z)
+{
+	bool seen[LeavesPerSide * LeavesPerSide] = {};
+	bool changed = false;
+	map.visitLeaves(block_x, block_y, block_x + BlockSize - 1, block_y + BlockSize - 1, [&](QTreeNode* leaf, int leaf_x, int leaf_y) {
+		const int x = leaf_x - block_x;
+		const int y = leaf_y - block_y;
+		const int index = (y / 4) * LeavesPerSide + x / 4;
+		seen[index] = true;
+		if(block.revisions[index] == leaf->getRevision()) {
+			return;
+		}
+
+		block.revisions[index] = leaf->getRevision();
+		readLeaf(block, leaf->getFloor(z), x, y);
+		changed = true;
+	});
+
+	// Leaves that were taken off the map since
+	for(int index = 0; index < LeavesPerSide * LeavesPerSide; ++index) {
+		if(!seen[index] && block.revisions[index] != 0) {
+			block.revisions[index] = 0;
+			readLeaf(block, nullptr, (index % LeavesPerSide) * 4, (index / LeavesPerSide) * 4);
+			changed = true;
+		}
+	}
+
+	if(changed) {
+		buildMips(block);
+	}
+	return changed;
+}
+
+void MinimapCache::readLeaf(Block& block, const Floor* floor, int x, int y)
+{
+	for(int index = 0; index < 16; ++index) {
+		const Tile* tile = floor ? floor->locs[index].get() : nullptr;
+		block.colours[(y + (index & 3)) * BlockSize + x + (index >> 2)] = tile ? tile->getMiniMapColor() : 0;
+	}
+}
+
+void MinimapCache::buildMips(Block& block)
+{
+	// Palette colours can't be blended, every pixel takes the first colour of the four below it
+	for(int level = 1; level < MipLevels; ++level) {
+		const uint8_t* source = block.colours + getOffset(level - 1);
+		uint8_t* target = block.colours + getOffset(level);
+		const int source_size = getSize(level - 1);
+		const int size = getSize(level);
+		for(int y = 0; y < size; ++y) {
+			for(int x = 0; x < size; ++x) {
+				const uint8_t* below = source + (y * 2) * source_size + x * 2;
+				uint8_t colour = below[0];
+				if(!colour) colour = below[1];
+				if(!colour) colour = below[source_size];
+				if(!colour) colour = below[source_size + 1];
+				target[y * size + x] = colour;
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MINIMAP_CACHE_H_
+#define RME_MINIMAP_CACHE_H_
+
+#include <unordered_map>
+
+class BaseMap;
+class Floor;
+
+// Keeps the minimap colour of every tile that has been asked for, in blocks of BlockSize x BlockSize
+// tiles per floor, along with copies halved in size for zoomed out views (mip levels). A block is
+// brought up to date when it is asked for: only the leaves whose revision changed are read again.
+class MinimapCache
+{
+public:
+	static constexpr int BlockSize = 64;
+	static constexpr int MipLevels = 7; // 64x64 down to 1x1
+
+	explicit MinimapCache(BaseMap& map);
+
+	// The colours of the block holding x, y on floor z at the level, row by row, getSize(level)
+	// per side. 0 is no colour. The pointer is valid until the cache is asked for another block.
+	// version, when given, receives a number that changes whenever the colours of the block do.
+	const uint8_t* getBlock(int x, int y, int z, int level = 0, uint32_t* version = nullptr);
+	static constexpr int getSize(int level) noexcept { return BlockSize >> level; }
+
+	void clear();
+
+private:
+	static constexpr int LeavesPerSide = BlockSize / 4;
+	static constexpr int ColourCount = (BlockSize * BlockSize * 4 - 1) / 3; // The sum of all levels
+
+	struct Block {
+		uint32_t checked; // The map revision the block was last checked at
+		uint32_t version; // The map revision its colours last changed at
+		uint32_t revisions[LeavesPerSide * LeavesPerSide]; // Of the leaves it was read from, 0 when absent
+		uint8_t colours[ColourCount];
+	};
+
+	bool update(Block& block, int block_x, int block_y, int z);
+	static void readLeaf(Block& block, const Floor* floor, int x, int y);
+	static void buildMips(Block& block);
+	static constexpr int getOffset(int level) noexcept { return (BlockSize * BlockSize - getSize(level) * getSize(level)) * 4 / 3; }
+
+	BaseMap& map;
+	uint32_t tiles_revision;
+	std::unordered_map<uint32_t, Block> blocks;
+};
+
+#endif
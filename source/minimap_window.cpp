@@ -27,6 +27,7 @@
 
 BEGIN_EVENT_TABLE(MinimapWindow, wxPanel)
 	EVT_LEFT_DOWN(MinimapWindow::OnMouseClick)
+	EVT_MOUSEWHEEL(MinimapWindow::OnMouseWheel)
 	EVT_SIZE(MinimapWindow::OnSize)
 	EVT_PAINT(MinimapWindow::OnPaint)
 	EVT_ERASE_BACKGROUND(MinimapWindow::OnEraseBackground)
@@ -37,18 +38,22 @@ END_EVENT_TABLE()
 
 MinimapWindow::MinimapWindow(wxWindow* parent) :
 	wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(205, 130)),
-	update_timer(this)
+	update_timer(this),
+	last_start_x(0),
+	last_start_y(0),
+	zoom(0)
 {
 	for(int i = 0; i < 256; ++i) {
-		pens[i] = new wxPen(colorFromEightBit(i));
+		wxColor color = colorFromEightBit(i);
+		palette[i][0] = color.Red();
+		palette[i][1] = color.Green();
+		palette[i][2] = color.Blue();
 	}
 }
 
 MinimapWindow::~MinimapWindow()
 {
-	for(int i = 0; i < 256; ++i) {
-		delete pens[i];
-	}
+	////
 }
 
 void MinimapWindow::OnSize(wxSizeEvent& event)
@@ -86,7 +91,12 @@ void MinimapWindow::OnPaint(wxPaintEvent& event)
 
 	int window_width = GetSize().GetWidth();
 	int window_height = GetSize().GetHeight();
-	//printf("W:%d\tH:%d\n", window_width, window_height);
+	if(window_width <= 0 || window_height <= 0) return;
+
+	// Everything below is in tiles, a pixel covers scale x scale of them
+	const int scale = 1 << zoom;
+	const int view_width = window_width * scale;
+	const int view_height = window_height * scale;
 	int center_x, center_y;
 
 	MapCanvas* canvas = g_gui.GetCurrentMapTab()->GetCanvas();
@@ -94,29 +104,30 @@ void MinimapWindow::OnPaint(wxPaintEvent& event)
 
 	int start_x, start_y;
 	int end_x, end_y;
-	start_x = center_x - window_width/2;
-	start_y = center_y - window_height/2;
+	start_x = center_x - view_width/2;
+	start_y = center_y - view_height/2;
 
-	end_x = center_x + window_width/2;
-	end_y = center_y + window_height/2;
+	end_x = center_x + view_width/2;
+	end_y = center_y + view_height/2;
 
 	if(start_x < 0) {
 		start_x = 0;
-		end_x = window_width;
+		end_x = view_width;
 	} else if(end_x > map.getWidth()) {
-		start_x = map.getWidth() - window_width;
+		start_x = map.getWidth() - view_width;
 		end_x = map.getWidth();
 	}
 	if(start_y < 0) {
 		start_y = 0;
-		end_y = window_height;
+		end_y = view_height;
 	} else if(end_y > map.getHeight()) {
-		start_y = map.getHeight() - window_height;
+		start_y = map.getHeight() - view_height;
 		end_y = map.getHeight();
 	}
 
-	start_x = std::max(start_x, 0);
-	start_y = std::max(start_y, 0);
+	// Pixels start on whole mip pixels
+	start_x = std::max(start_x, 0) & ~(scale - 1);
+	start_y = std::max(start_y, 0) & ~(scale - 1);
 	end_x = std::min(end_x, map.getWidth());
 	end_y = std::min(end_y, map.getHeight());
 
@@ -125,24 +136,37 @@ void MinimapWindow::OnPaint(wxPaintEvent& event)
 
 	int floor = g_gui.GetCurrentFloor();
 
-	//printf("Draw from %d:%d to %d:%d\n", start_x, start_y, end_x, end_y);
-	uint8_t last = 0;
 	if(g_gui.IsRenderingEnabled()) {
-		for(int y = start_y, window_y = 0; y <= end_y; ++y, ++window_y) {
-			for(int x = start_x, window_x = 0; x <= end_x; ++x, ++window_x) {
-				const Tile* tile = map.getTile(x, y, floor);
-				if(tile) {
-					uint8_t color = tile->getMiniMapColor();
-					if(color) {
-						if(last != color) {
-							pdc.SetPen(*pens[color]);
-							last = color;
-						}
-						pdc.DrawPoint(window_x, window_y);
+		// The colours come from the editor's cache, which only reads the leaves that changed since
+		MinimapCache& cache = editor.getMinimapCache();
+		const int block_size = MinimapCache::BlockSize;
+		const int size = MinimapCache::getSize(zoom);
+		wxImage image(window_width, window_height, true);
+		unsigned char* pixels = image.GetData();
+
+		for(int block_y = start_y / block_size * block_size; block_y <= end_y; block_y += block_size) {
+			for(int block_x = start_x / block_size * block_size; block_x <= end_x; block_x += block_size) {
+				const uint8_t* colours = cache.getBlock(block_x, block_y, floor, zoom);
+				for(int y = 0; y < size; ++y) {
+					const int py = (block_y - start_y) / scale + y;
+					if(py < 0 || py >= window_height)
+						continue;
+
+					for(int x = 0; x < size; ++x) {
+						const int px = (block_x - start_x) / scale + x;
+						const uint8_t color = colours[y * size + x];
+						if(px < 0 || px >= window_width || !color)
+							continue;
+
+						unsigned char* pixel = pixels + (py * window_width + px) * 3;
+						pixel[0] = palette[color][0];
+						pixel[1] = palette[color][1];
+						pixel[2] = palette[color][2];
 					}
 				}
 			}
 		}
+		pdc.DrawBitmap(wxBitmap(image), 0, 0);
 
 		if(g_settings.getInteger(Config::MINIMAP_VIEW_BOX)) {
 			pdc.SetPen(*wxWHITE_PEN);
@@ -168,13 +192,13 @@ void MinimapWindow::OnPaint(wxPaintEvent& event)
 			view_end_x = view_start_x + screensize_x / tile_size + 1;
 			view_end_y = view_start_y + screensize_y / tile_size + 1;
 
-			for(int x = view_start_x; x <= view_end_x; ++x) {
-				pdc.DrawPoint(x - start_x, view_start_y - start_y);
-				pdc.DrawPoint(x - start_x, view_end_y - start_y);
+			for(int x = view_start_x; x <= view_end_x; x += scale) {
+				pdc.DrawPoint((x - start_x) / scale, (view_start_y - start_y) / scale);
+				pdc.DrawPoint((x - start_x) / scale, (view_end_y - start_y) / scale);
 			}
-			for(int y = view_start_y; y < view_end_y; ++y) {
-				pdc.DrawPoint(view_start_x - start_x, y - start_y);
-				pdc.DrawPoint(view_end_x - start_x, y - start_y);
+			for(int y = view_start_y; y < view_end_y; y += scale) {
+				pdc.DrawPoint((view_start_x - start_x) / scale, (y - start_y) / scale);
+				pdc.DrawPoint((view_end_x - start_x) / scale, (y - start_y) / scale);
 			}
 		}
 	}
@@ -183,13 +207,23 @@ void MinimapWindow::OnPaint(wxPaintEvent& event)
 void MinimapWindow::OnMouseClick(wxMouseEvent& event)
 {
 	if(!g_gui.IsEditorOpen()) return;
-	int new_map_x = last_start_x + event.GetX();
-	int new_map_y = last_start_y + event.GetY();
+	int new_map_x = last_start_x + (event.GetX() << zoom);
+	int new_map_y = last_start_y + (event.GetY() << zoom);
 	g_gui.SetScreenCenterPosition(Position(new_map_x, new_map_y, g_gui.GetCurrentFloor()));
 	Refresh();
 	g_gui.RefreshView();
 }
 
+void MinimapWindow::OnMouseWheel(wxMouseEvent& event)
+{
+	// Up to 16 tiles a pixel, the cache keeps smaller blocks ready for each step
+	const int new_zoom = std::clamp(zoom - event.GetWheelRotation() / std::max(event.GetWheelDelta(), 1), 0, 4);
+	if(new_zoom != zoom) {
+		zoom = new_zoom;
+		Refresh();
+	}
+}
+
 void MinimapWindow::OnKey(wxKeyEvent& event)
 {
 	if(g_gui.GetCurrentTab() != nullptr) {
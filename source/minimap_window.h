@@ -26,6 +26,7 @@ public:
 	void OnPaint(wxPaintEvent&);
 	void OnEraseBackground(wxEraseEvent&) {}
 	void OnMouseClick(wxMouseEvent&);
+	void OnMouseWheel(wxMouseEvent&);
 	void OnSize(wxSizeEvent&);
 	void OnClose(wxCloseEvent&);
 
@@ -33,10 +34,11 @@ public:
 	void OnDelayedUpdate(wxTimerEvent& event);
 	void OnKey(wxKeyEvent& event);
 protected:
-	wxPen* pens[256];
+	uint8_t palette[256][3];
 	wxTimer	update_timer;
 	int last_start_x;
 	int last_start_y;
+	int zoom; // The mip level drawn, every pixel stands for 2^zoom x 2^zoom tiles
 
 	DECLARE_EVENT_TABLE()
 };
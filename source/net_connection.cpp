@@ -17,23 +17,113 @@
 
 #include "main.h"
 #include "net_connection.h"
+#include "settings.h"
+#include "tracing.h"
 
-NetworkMessage::NetworkMessage()
+namespace {
+	// Most packets fit, larger ones double from there
+	constexpr size_t NetworkMessageCapacity = 1024;
+
+	// Buffers kept for reuse, and the largest one worth keeping
+	constexpr size_t NetworkPoolSize = 256;
+	constexpr size_t NetworkPoolMaxCapacity = 4 * 1024 * 1024;
+}
+
+NetworkBufferPool& NetworkBufferPool::getInstance()
+{
+	static NetworkBufferPool pool;
+	return pool;
+}
+
+std::vector<uint8_t> NetworkBufferPool::acquire(size_t capacity)
+{
+	std::vector<uint8_t> buffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!buffers.empty()) {
+			buffer = std::move(buffers.back());
+			buffers.pop_back();
+		}
+	}
+	buffer.reserve(capacity);
+	return buffer;
+}
+
+void NetworkBufferPool::release(std::vector<uint8_t>&& buffer)
+{
+	if(buffer.capacity() == 0 || buffer.capacity() > NetworkPoolMaxCapacity) {
+		return;
+	}
+
+	buffer.clear();
+	std::lock_guard<std::mutex> lock(mutex);
+	if(buffers.size() < NetworkPoolSize) {
+		buffers.push_back(std::move(buffer));
+	}
+}
+
+std::shared_ptr<std::vector<uint8_t>> NetworkBufferPool::share(std::vector<uint8_t>&& buffer)
+{
+	return std::shared_ptr<std::vector<uint8_t>>(new std::vector<uint8_t>(std::move(buffer)), [this](std::vector<uint8_t>* shared) {
+		release(std::move(*shared));
+		delete shared;
+	});
+}
+
+NetworkMessage::NetworkMessage() :
+	buffer(NetworkBufferPool::getInstance().acquire(NetworkMessageCapacity))
 {
 	clear();
 }
 
+NetworkMessage::~NetworkMessage()
+{
+	NetworkBufferPool::getInstance().release(std::move(buffer));
+}
+
+NetworkMessage::NetworkMessage(NetworkMessage&& other) noexcept :
+	buffer(std::move(other.buffer)), position(other.position), size(other.size), inflated(other.inflated)
+{
+	// Left empty, a later write or clear() sizes it again
+	other.buffer.clear();
+	other.position = 4;
+	other.size = 0;
+	other.inflated = false;
+}
+
+NetworkMessage& NetworkMessage::operator=(NetworkMessage&& other) noexcept
+{
+	if(this != &other) {
+		NetworkBufferPool::getInstance().release(std::move(buffer));
+		buffer = std::move(other.buffer);
+		position = other.position;
+		size = other.size;
+		inflated = other.inflated;
+
+		other.buffer.clear();
+		other.position = 4;
+		other.size = 0;
+		other.inflated = false;
+	}
+	return *this;
+}
+
 void NetworkMessage::clear()
 {
 	buffer.resize(4);
 	position = 4;
 	size = 0;
+	inflated = false;
 }
 
 void NetworkMessage::expand(const size_t length)
 {
-	if(position + length >= buffer.size()) {
-		buffer.resize(position + length + 1);
+	const size_t required = position + length + 1;
+	if(required > buffer.size()) {
+		if(required > buffer.capacity()) {
+			buffer.reserve(std::max(required, buffer.capacity() * 2));
+		}
+		buffer.resize(required);
 	}
 	size += length;
 }
@@ -41,17 +131,33 @@ void NetworkMessage::expand(const size_t length)
 template<> std::string NetworkMessage::read<std::string>()
 {
 	const uint16_t length = read<uint16_t>();
+	if(!require(length)) {
+		return std::string();
+	}
 	char* strBuffer = reinterpret_cast<char*>(&buffer[position]);
 	position += length;
 	return std::string(strBuffer, length);
 }
 
+template<> std::string_view NetworkMessage::read<std::string_view>()
+{
+	const uint16_t length = read<uint16_t>();
+	if(!require(length)) {
+		return std::string_view();
+	}
+	const char* strBuffer = reinterpret_cast<const char*>(&buffer[position]);
+	position += length;
+	return std::string_view(strBuffer, length);
+}
+
 template<> Position NetworkMessage::read<Position>()
 {
 	Position position;
-	position.x = read<uint16_t>();
-	position.y = read<uint16_t>();
-	position.z = read<uint8_t>();
+	if(require(5)) {
+		position.x = take<uint16_t>();
+		position.y = take<uint16_t>();
+		position.z = take<uint8_t>();
+	}
 	return position;
 }
 
@@ -65,6 +171,16 @@ template<> void NetworkMessage::write<std::string>(const std::string& value)
 	position += length;
 }
 
+template<> void NetworkMessage::write<std::string_view>(const std::string_view& value)
+{
+	const size_t length = value.length();
+	write<uint16_t>(length);
+
+	expand(length);
+	memcpy(&buffer[position], value.data(), length);
+	position += length;
+}
+
 template<> void NetworkMessage::write<Position>(const Position& value)
 {
 	write<uint16_t>(value.x);
@@ -74,7 +190,7 @@ template<> void NetworkMessage::write<Position>(const Position& value)
 
 // NetworkConnection
 NetworkConnection::NetworkConnection() :
-	service(nullptr), thread(), stopped(false)
+	service(nullptr), work(), threads(), stopped(false)
 {
 	//
 }
@@ -92,7 +208,7 @@ NetworkConnection& NetworkConnection::getInstance()
 
 bool NetworkConnection::start()
 {
-	if(thread.joinable()) {
+	if(!threads.empty()) {
 		if(stopped) {
 			return false;
 		}
@@ -103,18 +219,27 @@ bool NetworkConnection::start()
 	if(!service) {
 		service = new asio::io_service;
 	}
+	work = std::make_unique<asio::executor_work_guard<asio::io_context::executor_type>>(service->get_executor());
 
-	thread = std::thread([this]() -> void {
-		asio::io_service& serviceRef = *service;
-		try {
+	// 0 picks one thread per core, a few are enough to keep up with many peers
+	int threadCount = g_settings.getInteger(Config::LIVE_IO_THREADS);
+	if(threadCount <= 0) {
+		threadCount = std::clamp<int>(std::thread::hardware_concurrency(), 1, 4);
+	}
+
+	for(int i = 0; i < threadCount; ++i) {
+		threads.emplace_back([this, i]() -> void {
+			RME_TRACE_THREAD("live network " + std::to_string(i));
+			asio::io_service& serviceRef = *service;
 			while(!stopped) {
-				serviceRef.run_one();
-				serviceRef.reset();
+				try {
+					serviceRef.run();
+				} catch (std::exception& e) {
+					std::cout << e.what() << std::endl;
+				}
 			}
-		} catch (std::exception& e) {
-			std::cout << e.what() << std::endl;
-		}
-	});
+		});
+	}
 	return true;
 }
 
@@ -124,9 +249,13 @@ void NetworkConnection::stop()
 		return;
 	}
 
-	service->stop();
 	stopped = true;
-	thread.join();
+	work.reset();
+	service->stop();
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
 
 	delete service;
 	service = nullptr;
@@ -136,3 +265,8 @@ asio::io_service& NetworkConnection::get_service()
 {
 	return *service;
 }
+
+asio::strand<asio::io_context::executor_type> NetworkConnection::make_strand()
+{
+	return asio::make_strand(service->get_executor());
+}
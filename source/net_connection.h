@@ -25,22 +25,88 @@
 #include <cstdint>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <algorithm>
+#include <cstring>
+
+// Byte buffers of network messages are recycled instead of freed, so a transfer of many nodes
+// reuses the capacity of the packets before it. Buffers are returned from the network threads.
+class NetworkBufferPool
+{
+	public:
+		static NetworkBufferPool& getInstance();
+
+		// An empty buffer with at least the capacity
+		std::vector<uint8_t> acquire(size_t capacity);
+		void release(std::vector<uint8_t>&& buffer);
+		// Hands the buffer over to the socket, it comes back once the last owner lets go of it
+		std::shared_ptr<std::vector<uint8_t>> share(std::vector<uint8_t>&& buffer);
+
+	private:
+		std::mutex mutex;
+		std::vector<std::vector<uint8_t>> buffers;
+};
 
+// Move only, the buffer goes back to NetworkBufferPool with the message
 struct NetworkMessage
 {
 	NetworkMessage();
+	~NetworkMessage();
+
+	NetworkMessage(const NetworkMessage&) = delete;
+	NetworkMessage& operator=(const NetworkMessage&) = delete;
+	NetworkMessage(NetworkMessage&& other) noexcept;
+	NetworkMessage& operator=(NetworkMessage&& other) noexcept;
 
 	void clear();
+	// Grows the buffer ahead of the writes, doubling it so a node is not reallocated per tile
 	void expand(const size_t length);
 
-	//
-	template<typename T> T read()
+	// Whether length more bytes can be read. If not the position moves to the end, so the
+	// packet loops stop on a message cut short instead of reading beyond it.
+	bool require(size_t length)
+	{
+		if(length > buffer.size() - std::min(position, buffer.size())) {
+			position = buffer.size();
+			return false;
+		}
+		return true;
+	}
+
+	// Reads without checking, for the values of a segment whose whole length was required
+	template<typename T> T take()
 	{
-		T& value = *reinterpret_cast<T*>(&buffer[position]);
+		T value;
+		memcpy(&value, &buffer[position], sizeof(T));
 		position += sizeof(T);
 		return value;
 	}
 
+	// Reading past the end of the buffer gives zeroes
+	template<typename T> T read()
+	{
+		return require(sizeof(T)) ? take<T>() : T {};
+	}
+
+	// A count of 32 bits followed by that many values, read with a single check. A count
+	// larger than what is left of the message reads nothing and ends the message.
+	template<typename T> bool readArray(std::vector<T>& values)
+	{
+		values.clear();
+		const uint32_t count = read<uint32_t>();
+		if(!require(static_cast<size_t>(count) * sizeof(T))) {
+			return false;
+		}
+		values.resize(count);
+		if(count != 0) {
+			memcpy(values.data(), &buffer[position], count * sizeof(T));
+			position += count * sizeof(T);
+		}
+		return true;
+	}
+
 	template<typename T> void write(const T& value)
 	{
 		expand(sizeof(T));
@@ -48,15 +114,30 @@ struct NetworkMessage
 		position += sizeof(T);
 	}
 
+	template<typename T> void writeArray(const std::vector<T>& values)
+	{
+		write<uint32_t>(static_cast<uint32_t>(values.size()));
+		if(!values.empty()) {
+			expand(values.size() * sizeof(T));
+			memcpy(&buffer[position], values.data(), values.size() * sizeof(T));
+			position += values.size() * sizeof(T);
+		}
+	}
+
 	//
 	std::vector<uint8_t> buffer;
 	size_t position;
 	size_t size;
+	// Inflated from a compressed packet, which may not hold another one
+	bool inflated;
 };
 
 template<> std::string NetworkMessage::read<std::string>();
+// Points into the buffer, only valid as long as the message is not written to or destroyed
+template<> std::string_view NetworkMessage::read<std::string_view>();
 template<> Position NetworkMessage::read<Position>();
 template<> void NetworkMessage::write<std::string>(const std::string& value);
+template<> void NetworkMessage::write<std::string_view>(const std::string_view& value);
 template<> void NetworkMessage::write<Position>(const Position& value);
 
 class NetworkConnection
@@ -74,11 +155,14 @@ class NetworkConnection
 		void stop();
 
 		asio::io_service& get_service();
+		// Handlers bound to the same strand never run at the same time, one per socket
+		asio::strand<asio::io_context::executor_type> make_strand();
 
 	private:
 		asio::io_service* service;
-		std::thread thread;
-		bool stopped;
+		std::unique_ptr<asio::executor_work_guard<asio::io_context::executor_type>> work;
+		std::vector<std::thread> threads;
+		std::atomic<bool> stopped;
 };
 
 #endif
@@ -330,7 +330,7 @@ Brush* BrushPanel::GetSelectedBrush() const
 	}
 
 	if(tileset && tileset->size() > 0) {
-		return tileset->brushlist[0];
+		return tileset->getBrush(0);
 	}
 	return nullptr;
 }
@@ -344,11 +344,9 @@ bool BrushPanel::SelectBrush(const Brush* whatbrush)
 		return brushbox->SelectBrush(whatbrush);
 	}
 
-	for(BrushVector::const_iterator iter = tileset->brushlist.begin(); iter != tileset->brushlist.end(); ++iter) {
-		if(*iter == whatbrush) {
-			LoadContents();
-			return brushbox->SelectBrush(whatbrush);
-		}
+	if(tileset->findBrush(whatbrush) != -1) {
+		LoadContents();
+		return brushbox->SelectBrush(whatbrush);
 	}
 	return false;
 }
@@ -377,57 +375,40 @@ void BrushPanel::OnClickListBoxRow(wxCommandEvent& event)
 	if(w)
 		g_gui.ActivatePalette(static_cast<PaletteWindow*>(w));
 
-	g_gui.SelectBrush(tileset->brushlist[n], tileset->getType());
+	g_gui.SelectBrush(tileset->getBrush(n), tileset->getType());
 }
 
 // ============================================================================
 // BrushIconBox
 
-BEGIN_EVENT_TABLE(BrushIconBox, wxScrolledWindow)
-	// Listbox style
-	EVT_TOGGLEBUTTON(wxID_ANY, BrushIconBox::OnClickBrushButton)
+BEGIN_EVENT_TABLE(BrushIconBox, wxVScrolledWindow)
+	EVT_PAINT(BrushIconBox::OnPaint)
+	EVT_LEFT_DOWN(BrushIconBox::OnMouseClick)
+	EVT_MOTION(BrushIconBox::OnMouseMove)
+	EVT_KEY_DOWN(BrushIconBox::OnKey)
 END_EVENT_TABLE()
 
 BrushIconBox::BrushIconBox(wxWindow *parent, const TilesetCategory *_tileset, RenderSize rsz) :
-	wxScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxVSCROLL),
+	wxVScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxVSCROLL),
 	BrushBoxInterface(_tileset),
-	icon_size(rsz)
+	icon_size(rsz),
+	selected(wxNOT_FOUND),
+	hovered(wxNOT_FOUND)
 {
 	ASSERT(tileset->getType() >= TILESET_UNKNOWN && tileset->getType() <= TILESET_HOUSE);
-	int width;
 	if(icon_size == RENDER_SIZE_32x32) {
-		width = std::max(g_settings.getInteger(Config::PALETTE_COL_COUNT) / 2 + 1, 1);
+		columns = std::max(g_settings.getInteger(Config::PALETTE_COL_COUNT) / 2 + 1, 1);
+		cell_size = 36;
 	} else {
-		width = std::max(g_settings.getInteger(Config::PALETTE_COL_COUNT) + 1, 1);
+		columns = std::max(g_settings.getInteger(Config::PALETTE_COL_COUNT) + 1, 1);
+		cell_size = 20;
 	}
 
-	// Create buttons
-	wxSizer* stacksizer = newd wxBoxSizer(wxVERTICAL);
-	wxSizer* rowsizer = nullptr;
-	int item_counter = 0;
-	for(BrushVector::const_iterator iter = tileset->brushlist.begin(); iter != tileset->brushlist.end(); ++iter) {
-		ASSERT(*iter);
-		++item_counter;
-
-		if(!rowsizer) {
-			rowsizer = newd wxBoxSizer(wxHORIZONTAL);
-		}
-
-		BrushButton* bb = newd BrushButton(this, *iter, rsz);
-		rowsizer->Add(bb);
-		brush_buttons.push_back(bb);
-
-		if(item_counter % width == 0) { // newd row
-			stacksizer->Add(rowsizer);
-			rowsizer = nullptr;
-		}
-	}
-	if(rowsizer) {
-		stacksizer->Add(rowsizer);
-	}
-
-	SetScrollbars(20,20, 8, item_counter/width, 0, 0);
-	SetSizer(stacksizer);
+	// Sprites are only drawn once their row scrolls into view, the bitmaps come from
+	// the sprite cache of the graphic manager which is bounded by the software clean settings
+	SetBackgroundStyle(wxBG_STYLE_PAINT);
+	SetRowCount((tileset->size() + columns - 1) / columns);
+	SetMinClientSize(wxSize(columns * cell_size, cell_size));
 }
 
 BrushIconBox::~BrushIconBox()
@@ -435,96 +416,158 @@ BrushIconBox::~BrushIconBox()
 	////
 }
 
+wxCoord BrushIconBox::OnGetRowHeight(size_t row) const
+{
+	return cell_size;
+}
+
 void BrushIconBox::SelectFirstBrush()
 {
 	if(tileset && tileset->size() > 0) {
-		DeselectAll();
-		brush_buttons[0]->SetValue(true);
+		SetSelection(0);
 		EnsureVisible((size_t)0);
 	}
 }
 
 Brush* BrushIconBox::GetSelectedBrush() const
 {
-	if(!tileset) {
+	if(!tileset || selected == wxNOT_FOUND) {
 		return nullptr;
 	}
+	return tileset->getBrush(selected);
+}
 
-	for(std::vector<BrushButton*>::const_iterator it = brush_buttons.begin(); it != brush_buttons.end(); ++it) {
-		if((*it)->GetValue()) {
-			return (*it)->brush;
-		}
+bool BrushIconBox::SelectBrush(const Brush* whatbrush)
+{
+	const int n = tileset->findBrush(whatbrush);
+	SetSelection(n);
+	if(n == -1) {
+		return false;
 	}
-	return nullptr;
+	EnsureVisible(n);
+	return true;
 }
 
-bool BrushIconBox::SelectBrush(const Brush* whatbrush)
+void BrushIconBox::SetSelection(int n)
 {
-	DeselectAll();
-	for(std::vector<BrushButton*>::iterator it = brush_buttons.begin(); it != brush_buttons.end(); ++it) {
-		if((*it)->brush == whatbrush) {
-			(*it)->SetValue(true);
-			EnsureVisible(*it);
-			return true;
-		}
+	if(n == selected) {
+		return;
+	}
+	RefreshBrush(selected);
+	selected = n;
+	RefreshBrush(selected);
+}
+
+void BrushIconBox::RefreshBrush(int n)
+{
+	if(n != wxNOT_FOUND) {
+		RefreshRow(n / columns);
 	}
-	return false;
 }
 
-void BrushIconBox::DeselectAll()
+void BrushIconBox::EnsureVisible(size_t n)
 {
-	for(std::vector<BrushButton*>::iterator it = brush_buttons.begin(); it != brush_buttons.end(); ++it) {
-		(*it)->SetValue(false);
+	const size_t row = n / columns;
+	if(!IsRowVisible(row)) {
+		//only scroll if the row isnt visible
+		ScrollToRow(row);
 	}
 }
 
-void BrushIconBox::EnsureVisible(BrushButton* btn)
+int BrushIconBox::HitTest(const wxPoint& point) const
 {
-	int windowSizeX, windowSizeY;
-	GetVirtualSize(&windowSizeX, &windowSizeY);
+	if(point.x < 0 || point.x >= columns * cell_size) {
+		return wxNOT_FOUND;
+	}
 
-	int scrollUnitX;
-	int scrollUnitY;
-	GetScrollPixelsPerUnit(&scrollUnitX, &scrollUnitY);
+	const int row = VirtualHitTest(point.y);
+	if(row == wxNOT_FOUND) {
+		return wxNOT_FOUND;
+	}
 
-	wxRect rect = btn->GetRect();
-	int y;
-	CalcUnscrolledPosition(0, rect.y, nullptr, &y);
+	const size_t n = size_t(row) * columns + point.x / cell_size;
+	return n < tileset->size() ? int(n) : wxNOT_FOUND;
+}
 
-	int maxScrollPos = windowSizeY / scrollUnitY;
-	int scrollPosY = std::min(maxScrollPos, (y / scrollUnitY));
+void BrushIconBox::OnPaint(wxPaintEvent& event)
+{
+	wxBufferedPaintDC pdc(this);
+	pdc.SetBackground(wxBrush(GetBackgroundColour()));
+	pdc.Clear();
 
-	int startScrollPosY;
-	GetViewStart(nullptr, &startScrollPosY);
+	if(g_gui.gfx.isUnloaded()) {
+		return;
+	}
+
+	const SpriteSize sprite_size = (icon_size == RENDER_SIZE_32x32 ? SPRITE_SIZE_32x32 : SPRITE_SIZE_16x16);
+	Sprite* marker = nullptr;
+	if(g_settings.getInteger(Config::USE_GUI_SELECTION_SHADOW)) {
+		marker = g_gui.gfx.getSprite(EDITOR_SPRITE_SELECTION_MARKER);
+	}
+
+	const size_t first = GetVisibleRowsBegin();
+	const size_t last = GetVisibleRowsEnd();
+	for(size_t row = first; row < last; ++row) {
+		const int y = int(row - first) * cell_size;
+		for(int column = 0; column < columns; ++column) {
+			const size_t n = row * columns + column;
+			if(n >= tileset->size()) {
+				break;
+			}
 
-	int clientSizeX, clientSizeY;
-	GetClientSize(&clientSizeX, &clientSizeY);
-	int endScrollPosY = startScrollPosY + clientSizeY / scrollUnitY;
+			const bool is_selected = (int(n) == selected);
+			const int x = column * cell_size;
+			DCButton::DrawFrame(pdc, wxRect(x, y, cell_size, cell_size), is_selected);
 
-	if(scrollPosY < startScrollPosY || scrollPosY > endScrollPosY){
-		//only scroll if the button isnt visible
-		Scroll(-1, scrollPosY);
+			Sprite* sprite = g_gui.gfx.getSprite(tileset->getBrush(n)->getLookID());
+			if(sprite) {
+				sprite->DrawTo(&pdc, sprite_size, x + 2, y + 2);
+			}
+			if(marker && is_selected) {
+				marker->DrawTo(&pdc, sprite_size, x + 2, y + 2);
+			}
+		}
 	}
 }
 
-void BrushIconBox::EnsureVisible(size_t n)
+void BrushIconBox::OnMouseClick(wxMouseEvent& event)
 {
-	EnsureVisible(brush_buttons[n]);
+	SetFocus();
+
+	const int n = HitTest(event.GetPosition());
+	if(n == wxNOT_FOUND) {
+		return;
+	}
+
+	SetSelection(n);
+
+	wxWindow* w = this;
+	while((w = w->GetParent()) && dynamic_cast<PaletteWindow*>(w) == nullptr);
+	if(w)
+		g_gui.ActivatePalette(static_cast<PaletteWindow*>(w));
+	g_gui.SelectBrush(tileset->getBrush(n), tileset->getType());
 }
 
-void BrushIconBox::OnClickBrushButton(wxCommandEvent& event)
+void BrushIconBox::OnMouseMove(wxMouseEvent& event)
 {
-	wxObject* obj = event.GetEventObject();
-	BrushButton* btn = dynamic_cast<BrushButton*>(obj);
-	if(btn) {
-		wxWindow* w = this;
-		while((w = w->GetParent()) && dynamic_cast<PaletteWindow*>(w) == nullptr);
-		if(w)
-			g_gui.ActivatePalette(static_cast<PaletteWindow*>(w));
-		g_gui.SelectBrush(btn->brush, tileset->getType());
+	const int n = HitTest(event.GetPosition());
+	if(n == hovered) {
+		return;
+	}
+
+	hovered = n;
+	if(n == wxNOT_FOUND) {
+		UnsetToolTip();
+	} else {
+		SetToolTip(wxstr(tileset->getBrush(n)->getName()));
 	}
 }
 
+void BrushIconBox::OnKey(wxKeyEvent& event)
+{
+	g_gui.AddPendingCanvasEvent(event);
+}
+
 // ============================================================================
 // BrushListBox
 
@@ -558,28 +601,27 @@ Brush* BrushListBox::GetSelectedBrush() const
 
 	int n = GetSelection();
 	if(n != wxNOT_FOUND) {
-		return tileset->brushlist[n];
+		return tileset->getBrush(n);
 	} else if(tileset->size() > 0) {
-		return tileset->brushlist[0];
+		return tileset->getBrush(0);
 	}
 	return nullptr;
 }
 
 bool BrushListBox::SelectBrush(const Brush* whatbrush)
 {
-	for(size_t n = 0; n < tileset->size(); ++n) {
-		if(tileset->brushlist[n] == whatbrush) {
-			SetSelection(n);
-			return true;
-		}
+	const int n = tileset->findBrush(whatbrush);
+	if(n == -1) {
+		return false;
 	}
-	return false;
+	SetSelection(n);
+	return true;
 }
 
 void BrushListBox::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const
 {
 	ASSERT(n < tileset->size());
-	Sprite* spr = g_gui.gfx.getSprite(tileset->brushlist[n]->getLookID());
+	Sprite* spr = g_gui.gfx.getSprite(tileset->getBrush(n)->getLookID());
 	if(spr) {
 		spr->DrawTo(&dc, SPRITE_SIZE_32x32, rect.GetX(), rect.GetY(), rect.GetWidth(), rect.GetHeight());
 	}
@@ -591,7 +633,7 @@ void BrushListBox::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const
 	} else {
 		dc.SetTextForeground(wxColor(0x00, 0x00, 0x00));
 	}
-	dc.DrawText(wxstr(tileset->brushlist[n]->getName()), rect.GetX() + 40, rect.GetY() + 6);
+	dc.DrawText(wxstr(tileset->getBrush(n)->getName()), rect.GetX() + 40, rect.GetY() + 6);
 }
 
 wxCoord BrushListBox::OnMeasureItem(size_t n) const
@@ -69,15 +69,16 @@ public:
 	DECLARE_EVENT_TABLE();
 };
 
-class BrushIconBox : public wxScrolledWindow, public BrushBoxInterface {
+// Shows the brushes as a grid of icons, only the rows in view are painted
+// so tilesets with thousands of brushes open as fast as small ones
+class BrushIconBox : public wxVScrolledWindow, public BrushBoxInterface {
 public:
 	BrushIconBox(wxWindow* parent, const TilesetCategory* _tileset, RenderSize rsz);
 	~BrushIconBox();
 
 	wxWindow* GetSelfWindow() { return this; }
 
-	// Scrolls the window to the position of the named brush button
-	void EnsureVisible(BrushButton* btn);
+	// Scrolls the window to the row of the brush at index n
 	void EnsureVisible(size_t n);
 
 	// Select the first brush
@@ -88,13 +89,23 @@ public:
 	bool SelectBrush(const Brush* brush);
 
 	// Event handling...
-	void OnClickBrushButton(wxCommandEvent& event);
+	void OnPaint(wxPaintEvent& event);
+	void OnMouseClick(wxMouseEvent& event);
+	void OnMouseMove(wxMouseEvent& event);
+	void OnKey(wxKeyEvent& event);
 protected:
-	// Used internally to deselect all buttons before selecting a newd one.
-	void DeselectAll();
+	virtual wxCoord OnGetRowHeight(size_t row) const;
+
+	// The index of the brush under a point of the window, wxNOT_FOUND if there is none
+	int HitTest(const wxPoint& point) const;
+	void RefreshBrush(int n);
+	void SetSelection(int n);
 protected:
-	std::vector<BrushButton*> brush_buttons;
 	RenderSize icon_size;
+	int columns;
+	int cell_size;
+	int selected;
+	int hovered;
 
 	DECLARE_EVENT_TABLE();
 };
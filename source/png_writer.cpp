@@ -0,0 +1,137 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "png_writer.h"
+
+PngWriter::PngWriter(const std::string& filename) :
+	file(filename),
+	stream(),
+	output_size(0),
+	width(0),
+	height(0),
+	rows_added(0),
+	started(false),
+	ok(true)
+{
+}
+
+PngWriter::~PngWriter()
+{
+	if(started) {
+		deflateEnd(&stream);
+	}
+}
+
+bool PngWriter::begin(uint32_t new_width, uint32_t new_height)
+{
+	if(started || new_width == 0 || new_height == 0 || !isOk()) {
+		return ok = false;
+	}
+
+	width = new_width;
+	height = new_height;
+	if(deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		return ok = false;
+	}
+	started = true;
+	row.resize(size_t(width) * 3 + 1);
+	output.resize(ChunkSize);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.addRAW(signature, sizeof(signature));
+
+	// Big endian width and height, 8 bits per channel, RGB, no interlacing
+	const uint8_t header[13] = {
+		uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+		uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+		8, 2, 0, 0, 0
+	};
+	return writeChunk("IHDR", header, sizeof(header));
+}
+
+bool PngWriter::addRows(const uint8_t* rgb, uint32_t rows, size_t stride)
+{
+	if(!started || rows_added + rows > height) {
+		return ok = false;
+	}
+
+	for(uint32_t y = 0; y < rows && ok; ++y) {
+		// Every row starts with its filter type, none
+		row[0] = 0;
+		memcpy(row.data() + 1, rgb + y * stride, row.size() - 1);
+		ok = compress(row.data(), row.size(), false);
+	}
+	rows_added += rows;
+	return isOk();
+}
+
+bool PngWriter::finish()
+{
+	if(!started || rows_added != height || !compress(nullptr, 0, true)) {
+		return ok = false;
+	}
+
+	writeChunk("IEND", nullptr, 0);
+	file.flush();
+	return isOk();
+}
+
+bool PngWriter::compress(const uint8_t* data, size_t size, bool last)
+{
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = static_cast<uInt>(size);
+
+	int ret;
+	do {
+		stream.next_out = output.data() + output_size;
+		stream.avail_out = static_cast<uInt>(output.size() - output_size);
+		ret = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH);
+		if(ret == Z_STREAM_ERROR) {
+			return false;
+		}
+
+		output_size = output.size() - stream.avail_out;
+		if(output_size == output.size() || (ret == Z_STREAM_END && output_size > 0)) {
+			if(!writeChunk("IDAT", output.data(), output_size)) {
+				return false;
+			}
+			output_size = 0;
+		}
+	} while(stream.avail_in > 0 || (last && ret != Z_STREAM_END));
+	return true;
+}
+
+bool PngWriter::writeChunk(const char* type, const uint8_t* data, size_t size)
+{
+	const uint8_t length[4] = { uint8_t(size >> 24), uint8_t(size >> 16), uint8_t(size >> 8), uint8_t(size) };
+	file.addRAW(length, sizeof(length));
+	file.addRAW(reinterpret_cast<const uint8_t*>(type), 4);
+	if(size > 0) {
+		file.addRAW(data, size);
+	}
+
+	// The checksum covers the type and the data
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+	if(size > 0) {
+		crc = crc32(crc, data, static_cast<uInt>(size));
+	}
+	const uint8_t checksum[4] = { uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc) };
+	file.addRAW(checksum, sizeof(checksum));
+	return file.isOk();
+}
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_PNG_WRITER_H_
+#define RME_PNG_WRITER_H_
+
+#include "filehandle.h"
+
+#include <zlib.h>
+
+// Writes an RGB image as PNG a few rows at a time, so the whole image never has to be in memory.
+// The rows are deflated as they come and written out in IDAT chunks of ChunkSize bytes.
+class PngWriter
+{
+public:
+	explicit PngWriter(const std::string& filename);
+	~PngWriter();
+
+	PngWriter(const PngWriter&) = delete;
+	PngWriter& operator=(const PngWriter&) = delete;
+
+	bool begin(uint32_t width, uint32_t height);
+	// Appends rows of width * 3 bytes each, stride bytes apart, top to bottom
+	bool addRows(const uint8_t* rgb, uint32_t rows, size_t stride);
+	// Fails if fewer rows than the height were added
+	bool finish();
+
+	bool isOk() { return ok && file.isOk(); }
+
+private:
+	static constexpr size_t ChunkSize = 256 * 1024;
+
+	bool compress(const uint8_t* data, size_t size, bool last);
+	bool writeChunk(const char* type, const uint8_t* data, size_t size);
+
+	FileWriteHandle file;
+	z_stream stream;
+	std::vector<uint8_t> row;
+	std::vector<uint8_t> output;
+	size_t output_size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rows_added;
+	bool started;
+	bool ok;
+};
+
+#endif
@@ -20,6 +20,7 @@
 
 #include "const.h"
 #include <cstdint>
+#include <functional>
 #include <istream>
 #include <list>
 #include <ostream>
@@ -127,4 +128,27 @@ inline Position abs(const Position &position) {
 typedef std::vector<Position> PositionVector;
 typedef std::list<Position> PositionList;
 
+// A position packed in a single integer, for the containers keyed by map
+// positions. The floor goes in the top bits, then the row and the column in 24
+// bits each, so keys sort like positions do. Only map positions are meant to
+// be packed, coordinates below zero don't survive the trip.
+typedef uint64_t PositionKey;
+
+inline PositionKey packPosition(const Position &position) noexcept {
+	return (uint64_t(position.z & 0xFF) << 48) |
+		   (uint64_t(position.y & 0xFFFFFF) << 24) |
+		   uint64_t(position.x & 0xFFFFFF);
+}
+
+inline Position unpackPosition(PositionKey key) noexcept {
+	return Position(int(key & 0xFFFFFF), int((key >> 24) & 0xFFFFFF),
+					int((key >> 48) & 0xFF));
+}
+
+template <> struct std::hash<Position> {
+	size_t operator()(const Position &position) const noexcept {
+		return std::hash<PositionKey>()(packPosition(position));
+	}
+};
+
 #endif
@@ -78,10 +78,30 @@ wxNotebookPage* PreferencesWindow::CreateGeneralPage()
 	show_welcome_dialog_chkbox->SetToolTip("Show welcome dialog when starting the editor.");
 	sizer->Add(show_welcome_dialog_chkbox, 0, wxLEFT | wxTOP, 5);
 
+	preload_recent_map_chkbox = newd wxCheckBox(general_page, wxID_ANY, "Preload the most recent map on startup");
+	preload_recent_map_chkbox->SetValue(g_settings.getInteger(Config::PRELOAD_RECENT_MAP) == 1);
+	preload_recent_map_chkbox->SetToolTip("While the welcome dialog is shown, reads the most recent map and the files of its client version ahead, so opening it doesn't wait on the disk. Stops when another map is picked.");
+	sizer->Add(preload_recent_map_chkbox, 0, wxLEFT | wxTOP, 5);
+
 	always_make_backup_chkbox = newd wxCheckBox(general_page, wxID_ANY, "Always make map backup");
 	always_make_backup_chkbox->SetValue(g_settings.getInteger(Config::ALWAYS_MAKE_BACKUP) == 1);
 	sizer->Add(always_make_backup_chkbox, 0, wxLEFT | wxTOP, 5);
 
+	incremental_save_chkbox = newd wxCheckBox(general_page, wxID_ANY, "Only save modified map areas");
+	incremental_save_chkbox->SetValue(g_settings.getInteger(Config::INCREMENTAL_SAVE) == 1);
+	incremental_save_chkbox->SetToolTip("Copies unchanged areas from the previous file when saving, this requires an index file (.otbm.idx) next to the map.");
+	sizer->Add(incremental_save_chkbox, 0, wxLEFT | wxTOP, 5);
+
+	session_snapshots_chkbox = newd wxCheckBox(general_page, wxID_ANY, "Keep session snapshots for faster reopening");
+	session_snapshots_chkbox->SetValue(g_settings.getInteger(Config::SESSION_SNAPSHOTS) == 1);
+	session_snapshots_chkbox->SetToolTip("Writes the whole map to a snapshot file (.otbm.session) when it is opened or saved, which opens much faster than the map file as long as the map, house and spawn files don't change.");
+	sizer->Add(session_snapshots_chkbox, 0, wxLEFT | wxTOP, 5);
+
+	reload_materials_chkbox = newd wxCheckBox(general_page, wxID_ANY, "Reload changed brush files");
+	reload_materials_chkbox->SetValue(g_settings.getInteger(Config::RELOAD_CHANGED_MATERIALS) == 1);
+	reload_materials_chkbox->SetToolTip("Parses the materials and extensions again when any of them changed on disk while the editor was in the background, without reloading the sprites and items.");
+	sizer->Add(reload_materials_chkbox, 0, wxLEFT | wxTOP, 5);
+
 	update_check_on_startup_chkbox = newd wxCheckBox(general_page, wxID_ANY, "Check for updates on startup");
 	update_check_on_startup_chkbox->SetValue(g_settings.getInteger(Config::USE_UPDATER) == 1);
 	sizer->Add(update_check_on_startup_chkbox, 0, wxLEFT | wxTOP, 5);
@@ -106,6 +126,26 @@ wxNotebookPage* PreferencesWindow::CreateGeneralPage()
 	grid_sizer->Add(undo_mem_size_spin, 0);
 	SetWindowToolTip(tmptext, undo_mem_size_spin, "The approximite limit for the memory usage of the undo queue.");
 
+	grid_sizer->Add(tmptext = newd wxStaticText(general_page, wxID_ANY, "Paged map memory (MB): "), 0);
+	paged_map_memory_spin = newd wxSpinCtrl(general_page, wxID_ANY, i2ws(g_settings.getInteger(Config::PAGED_MAP_MEMORY)), wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 0x100000);
+	grid_sizer->Add(paged_map_memory_spin, 0);
+	SetWindowToolTip(tmptext, paged_map_memory_spin, "Maps with an index file (.otbm.idx) are read an area at a time as they are viewed, and unmodified areas far from every view are dropped again above this much memory. 0 loads maps whole.");
+
+	grid_sizer->Add(tmptext = newd wxStaticText(general_page, wxID_ANY, "Resident versions memory (MB): "), 0);
+	resident_versions_memory_spin = newd wxSpinCtrl(general_page, wxID_ANY, i2ws(g_settings.getInteger(Config::RESIDENT_VERSIONS_MEMORY)), wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 0x100000);
+	grid_sizer->Add(resident_versions_memory_spin, 0);
+	SetWindowToolTip(tmptext, resident_versions_memory_spin, "Client versions stay in memory when another one is loaded, so maps of different versions can be open at once and switching between them is instant. Versions without an open map are dropped, oldest first, above this much memory. 0 closes all maps when the version changes.");
+
+	grid_sizer->Add(tmptext = newd wxStaticText(general_page, wxID_ANY, "Hibernate background maps (minutes): "), 0);
+	hibernate_maps_spin = newd wxSpinCtrl(general_page, wxID_ANY, i2ws(g_settings.getInteger(Config::HIBERNATE_INACTIVE_MAPS)), wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 1440);
+	grid_sizer->Add(hibernate_maps_spin, 0);
+	SetWindowToolTip(tmptext, hibernate_maps_spin, "Maps whose tab hasn't been shown for this long keep their unmodified areas compressed in memory, they are restored when their tab is shown again. The undo history and the selection are kept. 0 keeps every map as it is.");
+
+	grid_sizer->Add(tmptext = newd wxStaticText(general_page, wxID_ANY, "Autosave interval (minutes): "), 0);
+	autosave_interval_spin = newd wxSpinCtrl(general_page, wxID_ANY, i2ws(g_settings.getInteger(Config::AUTOSAVE_INTERVAL)), wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 240);
+	grid_sizer->Add(autosave_interval_spin, 0);
+	SetWindowToolTip(tmptext, autosave_interval_spin, "How often the unsaved changes of a map are written to a recovery file, which is offered at the next start if the editor goes down. 0 disables it.");
+
 	grid_sizer->Add(tmptext = newd wxStaticText(general_page, wxID_ANY, "Worker Threads: "), 0);
 	worker_threads_spin = newd wxSpinCtrl(general_page, wxID_ANY, i2ws(g_settings.getInteger(Config::WORKER_THREADS)), wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 64);
 	grid_sizer->Add(worker_threads_spin, 0);
@@ -291,6 +331,19 @@ wxNotebookPage* PreferencesWindow::CreateGraphicsPage()
 	subsizer->Add(screenshot_format_choice, 0);
 	SetWindowToolTip(screenshot_format_choice, tmp, "This will affect the screenshot format used by the editor.\nTo take a screenshot, press F11.");
 
+	// Renderer
+	render_backend_choice = newd wxChoice(graphics_page, wxID_ANY);
+	render_backend_choice->Append("Fixed function");
+	render_backend_choice->Append("Shaders");
+	if(g_settings.getInteger(Config::RENDER_BACKEND) == RENDER_BACKEND_SHADERS) {
+		render_backend_choice->SetSelection(1);
+	} else {
+		render_backend_choice->SetSelection(0);
+	}
+	subsizer->Add(tmp = newd wxStaticText(graphics_page, wxID_ANY, "Renderer: "), 0);
+	subsizer->Add(render_backend_choice, 0);
+	SetWindowToolTip(render_backend_choice, tmp, "How the map is drawn. Shaders need OpenGL 2.0 and are faster on most modern drivers, they also light the map per pixel. The editor falls back to the fixed function pipeline when they can't be used.");
+
 	sizer->Add(subsizer, 1, wxEXPAND | wxALL, 5);
 
 	// Advanced g_settings
@@ -585,11 +638,19 @@ void PreferencesWindow::Apply()
 	bool must_restart = false;
 	// General
 	g_settings.setInteger(Config::WELCOME_DIALOG, show_welcome_dialog_chkbox->GetValue());
+	g_settings.setInteger(Config::PRELOAD_RECENT_MAP, preload_recent_map_chkbox->GetValue());
 	g_settings.setInteger(Config::ALWAYS_MAKE_BACKUP, always_make_backup_chkbox->GetValue());
+	g_settings.setInteger(Config::INCREMENTAL_SAVE, incremental_save_chkbox->GetValue());
+	g_settings.setInteger(Config::SESSION_SNAPSHOTS, session_snapshots_chkbox->GetValue());
+	g_settings.setInteger(Config::RELOAD_CHANGED_MATERIALS, reload_materials_chkbox->GetValue());
 	g_settings.setInteger(Config::USE_UPDATER, update_check_on_startup_chkbox->GetValue());
 	g_settings.setInteger(Config::ONLY_ONE_INSTANCE, only_one_instance_chkbox->GetValue());
 	g_settings.setInteger(Config::UNDO_SIZE, undo_size_spin->GetValue());
 	g_settings.setInteger(Config::UNDO_MEM_SIZE, undo_mem_size_spin->GetValue());
+	g_settings.setInteger(Config::PAGED_MAP_MEMORY, paged_map_memory_spin->GetValue());
+	g_settings.setInteger(Config::RESIDENT_VERSIONS_MEMORY, resident_versions_memory_spin->GetValue());
+	g_settings.setInteger(Config::HIBERNATE_INACTIVE_MAPS, hibernate_maps_spin->GetValue());
+	g_settings.setInteger(Config::AUTOSAVE_INTERVAL, autosave_interval_spin->GetValue());
 	g_settings.setInteger(Config::WORKER_THREADS, worker_threads_spin->GetValue());
 	g_settings.setInteger(Config::REPLACE_SIZE, replace_size_spin->GetValue());
 	g_settings.setInteger(Config::COPY_POSITION_FORMAT, position_format->GetSelection());
@@ -656,6 +717,7 @@ void PreferencesWindow::Apply()
 		//g_settings.setInteger(Config::CURSOR_ALT_ALPHA, clr.Alpha());
 
 	g_settings.setInteger(Config::HIDE_ITEMS_WHEN_ZOOMED, hide_items_when_zoomed_chkbox->GetValue());
+	g_settings.setInteger(Config::RENDER_BACKEND, render_backend_choice->GetSelection() == 1 ? RENDER_BACKEND_SHADERS : RENDER_BACKEND_FIXED_FUNCTION);
 	/*
 	g_settings.setInteger(Config::TEXTURE_MANAGEMENT, texture_managment_chkbox->GetValue());
 	g_settings.setInteger(Config::TEXTURE_CLEAN_PULSE, clean_interval_spin->GetValue());
@@ -46,12 +46,20 @@ protected:
 
 	// General
 	wxCheckBox* always_make_backup_chkbox;
+	wxCheckBox* incremental_save_chkbox;
+	wxCheckBox* session_snapshots_chkbox;
+	wxCheckBox* reload_materials_chkbox;
 	wxCheckBox* create_on_startup_chkbox;
 	wxCheckBox* update_check_on_startup_chkbox;
 	wxCheckBox* only_one_instance_chkbox;
 	wxCheckBox* show_welcome_dialog_chkbox;
+	wxCheckBox* preload_recent_map_chkbox;
 	wxSpinCtrl* undo_size_spin;
 	wxSpinCtrl* undo_mem_size_spin;
+	wxSpinCtrl* paged_map_memory_spin;
+	wxSpinCtrl* resident_versions_memory_spin;
+	wxSpinCtrl* hibernate_maps_spin;
+	wxSpinCtrl* autosave_interval_spin;
 	wxSpinCtrl* worker_threads_spin;
 	wxSpinCtrl* replace_size_spin;
 	wxRadioBox* position_format;
@@ -74,6 +82,7 @@ protected:
 	wxCheckBox* use_memcached_chkbox;
 	wxDirPickerCtrl* screenshot_directory_picker;
 	wxChoice* screenshot_format_choice;
+	wxChoice* render_backend_choice;
 	wxCheckBox* hide_items_when_zoomed_chkbox;
 	wxColourPickerCtrl* cursor_color_pick;
 	wxColourPickerCtrl* cursor_alt_color_pick;
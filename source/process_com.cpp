@@ -22,6 +22,7 @@
 #include "gui.h"
 #include "process_com.h"
 
+#include <wx/stdpaths.h>
 
 //Server
 
@@ -35,6 +36,17 @@ RMEProcessServer::~RMEProcessServer()
 	////
 }
 
+wxString RMEProcessServer::GetServiceName()
+{
+#ifdef __WINDOWS__
+	return "rme_host";
+#else
+	FileName name(wxStandardPaths::Get().GetUserConfigDir() + "/.rme/rme_host.sock");
+	name.Mkdir(0755, wxPATH_MKDIR_FULL);
+	return name.GetFullPath();
+#endif
+}
+
 wxConnectionBase* RMEProcessServer::OnAcceptConnection(const wxString& topic)
 {
 	if(topic.Lower() == "rme_talk") {
@@ -79,7 +91,10 @@ RMEProcessConnection::~RMEProcessConnection()
 bool RMEProcessConnection::OnExec(const wxString& topic, const wxString& fileName)
 {
 	if(topic.Lower() == "rme_talk" && fileName != wxEmptyString) {
-		g_gui.LoadMap(FileName(fileName));
+		// Loaded once this is answered, the other process exits right away instead of waiting
+		// for the map
+		const FileName file(fileName);
+		wxTheApp->CallAfter([file]() { g_gui.LoadMap(file); });
 		return true;
 	}
 	return false;
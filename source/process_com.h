@@ -36,6 +36,10 @@ public:
 	RMEProcessServer();
 	~RMEProcessServer();
 
+	// DDE on Windows, elsewhere a socket in the user's configuration directory, so the
+	// instances of different users don't find each other
+	static wxString GetServiceName();
+
 	wxConnectionBase* OnAcceptConnection(const wxString& topic);
 };
 
@@ -161,7 +161,7 @@ wxWindow* PropertiesWindow::createAttributesPanel(wxWindow* parent)
 	attributesGrid->AppendRows(attrs.size());
 	int i = 0;
 	for(ItemAttributeMap::iterator aiter = attrs.begin(); aiter != attrs.end(); ++aiter, ++i)
-		SetGridValue(attributesGrid, i, aiter->first, aiter->second);
+		SetGridValue(attributesGrid, i, ItemAttributeKeys::name(aiter->first), aiter->second);
 
 	wxSizer* optSizer = newd wxBoxSizer(wxHORIZONTAL);
 	optSizer->Add(newd wxButton(panel, ITEM_PROPERTIES_ADD_ATTRIBUTE, "Add Attribute"), wxSizerFlags(0).Center());
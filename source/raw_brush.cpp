@@ -52,13 +52,17 @@ std::string RAWBrush::getName() const
 {
 	if(!itemtype)
 		return "RAWBrush";
+	return getName(*itemtype);
+}
 
-	if(itemtype->hookSouth)
-		return i2s(itemtype->id) + " - " + itemtype->name + " (Hook South)";
-	else if(itemtype->hookEast)
-		return i2s(itemtype->id) + " - " + itemtype->name + " (Hook East)";
+std::string RAWBrush::getName(const ItemType& type)
+{
+	if(type.hookSouth)
+		return i2s(type.id) + " - " + type.name + " (Hook South)";
+	else if(type.hookEast)
+		return i2s(type.id) + " - " + type.name + " (Hook East)";
 
-	return i2s(itemtype->id) + " - " + itemtype->name + itemtype->editorsuffix;
+	return i2s(type.id) + " - " + type.name + type.editorsuffix;
 }
 
 void RAWBrush::undraw(BaseMap* map, Tile* tile)
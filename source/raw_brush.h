@@ -39,6 +39,8 @@ public:
 	virtual bool canDrag() const { return true; }
 	virtual int getLookID() const;
 	virtual std::string getName() const;
+	// The name the brush of the type has, without making it
+	static std::string getName(const ItemType& type);
 	ItemType* getItemType() const { return itemtype; }
 	uint16_t getItemID() const;
 
@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "reclaimer.h"
+#include "map_allocator.h"
+#include "tracing.h"
+
+Reclaimer::Reclaimer() :
+	busy(false), stopping(false)
+{
+	thread = std::thread([this]() { work(); });
+}
+
+Reclaimer::~Reclaimer()
+{
+	// What is still queued goes before the pools it returns its slots to
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+
+	if(thread.joinable()) {
+		thread.join();
+	}
+}
+
+Reclaimer& Reclaimer::getInstance()
+{
+	static Reclaimer reclaimer;
+	return reclaimer;
+}
+
+void Reclaimer::submit(Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void Reclaimer::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	drained.wait(lock, [this]() { return tasks.empty() && !busy; });
+}
+
+void Reclaimer::work()
+{
+	RME_TRACE_THREAD("reclaimer");
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true) {
+		wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+		if(tasks.empty()) {
+			break;
+		}
+
+		Task task = std::move(tasks.front());
+		tasks.pop_front();
+		busy = true;
+		lock.unlock();
+		{
+			// The slots go back to the pools a few hundred at a time
+			MapAllocator::Scope allocation_scope;
+			RME_TRACE_ZONE("reclaimer", "Reclaimer task");
+			task();
+			task = nullptr;
+		}
+		lock.lock();
+		busy = false;
+		if(tasks.empty()) {
+			drained.notify_all();
+		}
+	}
+}
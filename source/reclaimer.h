@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_RECLAIMER_H_
+#define RME_RECLAIMER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Frees what is handed to it on a thread of its own, in the order it was handed
+// over. Closing a map or dropping the undo history frees millions of tiles and
+// items, which took seconds on the UI thread. Whatever is handed over must not
+// be reachable from anything else anymore, and its destructors must not touch
+// the GUI or the maps still open. A single thread, so the workers of the thread
+// pool stay free for what the user waits on.
+class Reclaimer
+{
+	public:
+		using Task = std::function<void()>;
+
+		~Reclaimer();
+
+		// Started the first time something is handed over
+		static Reclaimer& getInstance();
+
+		void submit(Task task);
+		// Takes over the object and deletes it on the thread
+		template <typename T>
+		void destroy(T* object) {
+			if(object) {
+				submit([object]() { delete object; });
+			}
+		}
+
+		// Blocks until everything handed over so far is freed
+		void wait();
+
+	private:
+		Reclaimer();
+		Reclaimer(const Reclaimer&) = delete;
+		Reclaimer& operator=(const Reclaimer&) = delete;
+
+		void work();
+
+		std::deque<Task> tasks;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable drained;
+		std::thread thread;
+		bool busy;
+		bool stopping;
+};
+
+#endif
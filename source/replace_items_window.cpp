@@ -23,6 +23,8 @@
 #include "artprovider.h"
 #include "items.h"
 
+#include <unordered_set>
+
 // ============================================================================
 // ReplaceItemsButton
 
@@ -159,6 +161,47 @@ wxCoord ReplaceItemsListBox::OnMeasureItem(size_t WXUNUSED(index)) const
 	return 40;
 }
 
+// ============================================================================
+// ReplacementFinder
+
+void ReplacementFinder::operator()(const Map& WXUNUSED(map), Tile* tile)
+{
+	const uint32_t first = static_cast<uint32_t>(hits.size());
+	uint32_t ordinal = 0;
+	foreach_ItemOnTile(tile, [&](Item* item) {
+		const uint16_t pair = (*pairs)[item->getID()];
+		if(pair != NoPair) {
+			hits.push_back({ ordinal, pair });
+		}
+		++ordinal;
+	});
+
+	const uint32_t count = static_cast<uint32_t>(hits.size()) - first;
+	if(count != 0) {
+		tiles.push_back({ tile, first, count });
+	}
+}
+
+void ReplacementFinder::merge(const ReplacementFinder& other, int32_t limit, std::vector<uint32_t>& counts)
+{
+	for(const TileHits& entry : other.tiles) {
+		const uint32_t first = static_cast<uint32_t>(hits.size());
+		for(uint32_t index = 0; index < entry.count; ++index) {
+			const Hit& hit = other.hits[entry.first + index];
+			if(limit > 0 && counts[hit.pair] >= uint32_t(limit))
+				continue;
+
+			hits.push_back(hit);
+			++counts[hit.pair];
+		}
+
+		const uint32_t count = static_cast<uint32_t>(hits.size()) - first;
+		if(count != 0) {
+			tiles.push_back({ entry.tile, first, count });
+		}
+	}
+}
+
 // ============================================================================
 // ReplaceItemsDialog
 
@@ -320,7 +363,7 @@ void ReplaceItemsDialog::OnExecuteButtonClicked(wxCommandEvent& WXUNUSED(event))
 	if(!g_gui.IsEditorOpen())
 		return;
 
-	const auto& items = list->GetItems();
+	const std::vector<ReplacingItem> items = list->GetItems();
 	if(items.empty())
 		return;
 
@@ -337,39 +380,78 @@ void ReplaceItemsDialog::OnExecuteButtonClicked(wxCommandEvent& WXUNUSED(event))
 		return;
 
 	Editor* editor = tab->GetEditor();
+	Map& map = editor->getMap();
 
-	int done = 0;
+	// Every pair goes in one table, so a single pass replaces all of them and every item is replaced
+	// at most once, by the pair of its own id
+	std::vector<uint16_t> pairs(UINT16_MAX + 1, ReplacementFinder::NoPair);
+	for(size_t index = 0; index < items.size(); ++index) {
+		pairs[items[index].replaceId] = static_cast<uint16_t>(index);
+	}
+
+	// Only the leaves that hold one of the items, from the item index of the map or else the summaries.
+	// A paged map reads back the areas it keeps in its file only first.
+	if(!selectionOnly)
+		map.pageInAll();
+	bool indexed = true;
+	uint64_t item_bits = 0;
+	std::unordered_set<QTreeNode*> candidates;
 	for(const ReplacingItem& info : items) {
-		ItemFinder finder(info.replaceId, (uint32_t)g_settings.getInteger(Config::REPLACE_SIZE));
-
-		// search on map
-		foreach_ItemOnMap(editor->getMap(), finder, selectionOnly);
-
-		uint32_t total = 0;
-		const auto& result = finder.result;
-
-		if(!result.empty()) {
-			BatchAction* batch = editor->createBatch(ACTION_REPLACE_ITEMS);
-			Action* action = editor->createAction(batch);
-			for(const auto& pair : result) {
-				Tile* new_tile = pair.first->deepCopy(editor->getMap());
-				int index = pair.first->getIndexOf(pair.second);
-				ASSERT(index != wxNOT_FOUND);
-				Item* item = new_tile->getItemAt(index);
-				ASSERT(item && item->getID() == pair.second->getID());
-				transformItem(item, info.withId, new_tile);
-				action->addChange(new Change(new_tile));
-				total++;
+		item_bits |= TileSummary::itemBit(info.replaceId);
+		std::vector<QTreeNode*> id_leaves;
+		if(indexed && map.getItemIdLeaves(info.replaceId, id_leaves)) {
+			candidates.insert(id_leaves.begin(), id_leaves.end());
+		} else {
+			indexed = false;
+		}
+	}
+
+	std::vector<QTreeNode*> leaves;
+	TileSummary filter;
+	filter.floors = 0xFFFF;
+	map.visitLeavesMatching(0, 0, rme::MapMaxWidth, rme::MapMaxHeight, filter, [&](QTreeNode* leaf, int, int) {
+		if(indexed ? candidates.count(leaf) != 0 : (leaf->getSummary().items & item_bits) != 0) {
+			leaves.push_back(leaf);
+		}
+	});
+
+	ReplacementFinder found(pairs);
+	std::vector<uint32_t> totals(items.size(), 0);
+	const int32_t limit = g_settings.getInteger(Config::REPLACE_SIZE);
+	for(const ReplacementFinder& chunk : parallel_foreach_TileOnLeaves(map, leaves, found, selectionOnly, [this](int percent) {
+		progress->SetValue(std::clamp<int>(percent, 0, 99));
+	})) {
+		found.merge(chunk, limit, totals);
+	}
+
+	if(!found.tiles.empty()) {
+		BatchAction* batch = editor->createBatch(ACTION_REPLACE_ITEMS);
+		Action* action = editor->createAction(batch);
+		std::vector<Item*> tile_items;
+		for(const ReplacementFinder::TileHits& entry : found.tiles) {
+			Tile* new_tile = entry.tile->deepCopy(map);
+			tile_items.clear();
+			foreach_ItemOnTile(new_tile, [&tile_items](Item* item) {
+				tile_items.push_back(item);
+			});
+
+			// Contents come after their container, so they are replaced before a container is copied
+			for(uint32_t index = entry.count; index-- > 0;) {
+				const ReplacementFinder::Hit& hit = found.hits[entry.first + index];
+				Item* item = tile_items[hit.ordinal];
+				ASSERT(item && item->getID() == items[hit.pair].replaceId);
+				transformItem(item, items[hit.pair].withId, new_tile);
 			}
-			batch->addAndCommitAction(action);
-			editor->addBatch(batch);
-			editor->updateActions();
+			action->addChange(new Change(new_tile));
 		}
+		batch->addAndCommitAction(action);
+		editor->addBatch(batch);
+		editor->updateActions();
+	}
 
-		done++;
-		const int value = static_cast<int>((done / items.size()) * 100);
-		progress->SetValue(std::clamp<int>(value, 0, 100));
-		list->MarkAsComplete(info, total);
+	progress->SetValue(100);
+	for(size_t index = 0; index < items.size(); ++index) {
+		list->MarkAsComplete(items[index], totals[index]);
 	}
 
 	tab->Refresh();
@@ -83,27 +83,40 @@ private:
 // ============================================================================
 // ReplaceItemsDialog
 
-struct ItemFinder
+// Finds the items of every pair of the list in one pass over the map. The hits are kept by tile, by
+// the order foreach_ItemOnTile visits the items in, so a copy of the tile can be changed at the same
+// places, contents of containers included.
+struct ReplacementFinder
 {
-	ItemFinder(uint16_t itemid, int32_t limit = -1) : itemid(itemid), limit(limit), exceeded(false) {}
+	// pairs[id] is the index of the pair replacing the item id, NoPair if it isn't replaced
+	static constexpr uint16_t NoPair = UINT16_MAX;
 
-	void operator()(Map& map, Tile* tile, Item* item, long long done) {
-		if(exceeded)
-			return;
+	struct Hit
+	{
+		uint32_t ordinal;
+		uint16_t pair;
+	};
 
-		if(item->getID() == itemid) {
-			result.push_back(std::make_pair(tile, item));
-			if(limit > 0 && result.size() >= size_t(limit))
-				exceeded = true;
-		}
-	}
+	struct TileHits
+	{
+		Tile* tile;
+		uint32_t first; // Into hits
+		uint32_t count;
+	};
+
+	ReplacementFinder(const std::vector<uint16_t>& pairs) : pairs(&pairs) {}
+
+	void operator()(const Map& map, Tile* tile);
+
+	// Takes over what another part of the map found, up to limit items of each pair (no limit if it
+	// isn't above 0), counts holds how many of each pair were taken so far
+	void merge(const ReplacementFinder& other, int32_t limit, std::vector<uint32_t>& counts);
 
-	std::vector<std::pair<Tile*, Item*>> result;
+	std::vector<TileHits> tiles;
+	std::vector<Hit> hits;
 
 private:
-	uint16_t itemid;
-	int32_t limit;
-	bool exceeded;
+	const std::vector<uint16_t>* pairs;
 };
 
 class ReplaceItemsDialog : public wxDialog
@@ -20,6 +20,7 @@
 #include "result_window.h"
 #include "gui.h"
 #include "position.h"
+#include "items.h"
 
 BEGIN_EVENT_TABLE(SearchResultWindow, wxPanel)
 	EVT_LISTBOX(wxID_ANY, SearchResultWindow::OnClickResult)
@@ -27,11 +28,34 @@ BEGIN_EVENT_TABLE(SearchResultWindow, wxPanel)
 	EVT_BUTTON(wxID_CLEAR, SearchResultWindow::OnClickClear)
 END_EVENT_TABLE()
 
+SearchResultList::SearchResultList(SearchResultWindow* parent) :
+	wxVListBox(parent, wxID_ANY, wxDefaultPosition, wxSize(200, 330), wxLB_SINGLE | wxLB_ALWAYS_SB),
+	window(parent)
+{
+	////
+}
+
+void SearchResultList::OnDrawItem(wxDC& dc, const wxRect& rect, size_t index) const
+{
+	if(IsSelected(index)) {
+		dc.SetTextForeground(wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHTTEXT));
+	} else {
+		dc.SetTextForeground(wxSystemSettings::GetColour(wxSYS_COLOUR_LISTBOXTEXT));
+	}
+	dc.DrawText(window->GetResultText(index), rect.GetX() + 2, rect.GetY() + 1);
+}
+
+wxCoord SearchResultList::OnMeasureItem(size_t WXUNUSED(index)) const
+{
+	return GetCharHeight() + 2;
+}
+
 SearchResultWindow::SearchResultWindow(wxWindow* parent) :
-	wxPanel(parent, wxID_ANY)
+	wxPanel(parent, wxID_ANY),
+	update_pending(false)
 {
 	wxSizer* sizer = newd wxBoxSizer(wxVERTICAL);
-	result_list = newd wxListBox(this, wxID_ANY, wxDefaultPosition, wxSize(200, 330), 0, nullptr, wxLB_SINGLE | wxLB_ALWAYS_SB);
+	result_list = newd SearchResultList(this);
 	sizer->Add(result_list, wxSizerFlags(1).Expand());
 
 	wxSizer* buttonsSizer = newd wxBoxSizer(wxHORIZONTAL);
@@ -43,27 +67,64 @@ SearchResultWindow::SearchResultWindow(wxWindow* parent) :
 
 SearchResultWindow::~SearchResultWindow()
 {
-	Clear();
+	////
 }
 
 void SearchResultWindow::Clear()
 {
-	for(uint32_t n = 0; n < result_list->GetCount(); ++n) {
-		delete reinterpret_cast<Position*>(result_list->GetClientData(n));
-	}
-	result_list->Clear();
+	std::vector<SearchResultEntry>().swap(results);
+	std::vector<wxString>().swap(descriptions);
+	result_list->SetItemCount(0);
+	result_list->Refresh();
 }
 
 void SearchResultWindow::AddPosition(wxString description, Position pos)
 {
-	result_list->Append(description << " (" << pos.x << "," << pos.y << "," << pos.z << ")", newd Position(pos));
+	results.push_back({ pos, 0, static_cast<uint32_t>(descriptions.size()) });
+	descriptions.push_back(std::move(description));
+	ScheduleUpdate();
+}
+
+void SearchResultWindow::AddItem(uint16_t id, Position pos)
+{
+	results.push_back({ pos, id, SearchResultEntry::NoDescription });
+	ScheduleUpdate();
+}
+
+wxString SearchResultWindow::GetResultText(size_t index) const
+{
+	if(index >= results.size())
+		return wxEmptyString;
+
+	const SearchResultEntry& entry = results[index];
+	wxString text;
+	if(entry.description != SearchResultEntry::NoDescription) {
+		text = descriptions[entry.description];
+	} else {
+		text = wxstr(g_items.getItemType(entry.item_id).name);
+	}
+	text << " (" << entry.position.x << "," << entry.position.y << "," << entry.position.z << ")";
+	return text;
+}
+
+void SearchResultWindow::ScheduleUpdate()
+{
+	if(update_pending)
+		return;
+
+	update_pending = true;
+	CallAfter([this]() {
+		update_pending = false;
+		result_list->SetItemCount(results.size());
+		result_list->Refresh();
+	});
 }
 
 void SearchResultWindow::OnClickResult(wxCommandEvent& event)
 {
-	Position* pos = reinterpret_cast<Position*>(event.GetClientData());
-	if(pos) {
-		g_gui.SetScreenCenterPosition(*pos);
+	const int index = event.GetInt();
+	if(index >= 0 && static_cast<size_t>(index) < results.size()) {
+		g_gui.SetScreenCenterPosition(results[index].position);
 	}
 }
 
@@ -77,12 +138,19 @@ void SearchResultWindow::OnClickExport(wxCommandEvent& WXUNUSED(event))
 
 			file.Write("Generated by Remere's Map Editor " + __RME_VERSION__);
 			file.Write("\n=============================================\n\n");
-			wxArrayString lines = result_list->GetStrings();
-			size_t count = lines.Count();
+
+			// The lines are put together from the results as they are written, in blocks
+			wxString block;
+			const size_t count = results.size();
 			for(size_t i = 0; i < count; ++i) {
-				file.Write(lines[i] + "\n");
-				g_gui.SetLoadScale((int32_t)i, (int32_t)count);
+				block << GetResultText(i) << "\n";
+				if(block.length() >= 0x10000) {
+					file.Write(block);
+					block.clear();
+					g_gui.SetLoadDone(static_cast<int32_t>(99 * i / count));
+				}
 			}
+			file.Write(block);
 			file.Close();
 
 			g_gui.DestroyLoadBar();
@@ -20,6 +20,33 @@
 
 #include "main.h"
 
+#include <vector>
+
+// A search result, kept compact so a search can list millions of them. The text is only put
+// together for the rows on screen.
+struct SearchResultEntry
+{
+	static constexpr uint32_t NoDescription = UINT32_MAX;
+
+	Position position;
+	uint16_t item_id; // Its name is the description if there is none
+	uint32_t description; // Index into the descriptions of the window, or NoDescription
+};
+
+class SearchResultWindow;
+
+class SearchResultList : public wxVListBox
+{
+public:
+	SearchResultList(SearchResultWindow* parent);
+
+	void OnDrawItem(wxDC& dc, const wxRect& rect, size_t index) const override;
+	wxCoord OnMeasureItem(size_t index) const override;
+
+private:
+	SearchResultWindow* window;
+};
+
 class SearchResultWindow : public wxPanel
 {
 public:
@@ -28,13 +55,24 @@ public:
 
 	void Clear();
 	void AddPosition(wxString description, Position pos);
+	// Listed under the name of the item
+	void AddItem(uint16_t id, Position pos);
+
+	size_t GetResultCount() const noexcept { return results.size(); }
+	wxString GetResultText(size_t index) const;
 
 	void OnClickResult(wxCommandEvent&);
 	void OnClickExport(wxCommandEvent&);
 	void OnClickClear(wxCommandEvent&);
 
 protected:
-	wxListBox* result_list;
+	// The list is told about new results once the current event is done, not once per result
+	void ScheduleUpdate();
+
+	SearchResultList* result_list;
+	std::vector<SearchResultEntry> results;
+	std::vector<wxString> descriptions;
+	bool update_pending;
 
 	DECLARE_EVENT_TABLE()
 };
@@ -46,12 +46,14 @@ class Action;
 
 class Brush;
 
+#include "small_vector.h"
+
 #include <unordered_set>
 
 typedef std::vector<uint32_t> HouseExitList;
 typedef std::vector<Tile*> TileVector;
 typedef std::unordered_set<Tile*> TileSet;
-typedef std::vector<Item*> ItemVector;
+typedef SmallVector<Item*, 4> ItemVector;
 typedef std::vector<Brush*> BrushVector;
 
 #endif
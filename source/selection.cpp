@@ -23,54 +23,126 @@
 #include "item.h"
 #include "editor.h"
 #include "gui.h"
+#include "lasso_selection.h"
+#include "session_recorder.h"
+#include "tracing.h"
 
 Selection::Selection(Editor& editor) :
 	editor(editor),
 	session(nullptr),
 	subsession(nullptr),
-	busy(false)
+	count(0),
+	busy(false),
+	last_key(0xFFFFFFFF),
+	last_leaf(nullptr),
+	bounds_valid(false)
 {
 	////
 }
 
 Selection::~Selection()
 {
-	tiles.clear();
-
 	delete subsession;
 	delete session;
 }
 
+Selection::iterator::iterator(LeafMap::const_iterator leaf, LeafMap::const_iterator end) :
+	leaf(leaf),
+	end(end),
+	index(0)
+{
+	settle();
+}
+
+Tile* Selection::iterator::operator*() const
+{
+	return leaf->second.floor->locs[index].get();
+}
+
+Selection::iterator& Selection::iterator::operator++()
+{
+	++index;
+	settle();
+	return *this;
+}
+
+void Selection::iterator::settle()
+{
+	for(; leaf != end; ++leaf, index = 0) {
+		const Leaf& current = leaf->second;
+		for(; index < 16; ++index) {
+			if((current.mask & (1 << index)) && current.floor->locs[index].get()) {
+				return;
+			}
+		}
+	}
+	index = 0;
+}
+
+bool Selection::contains(const Position& position) const
+{
+	auto it = leaves.find(getLeafKey(position.x, position.y, position.z));
+	return it != leaves.end() && (it->second.mask & (1 << ((position.x & 3) * 4 + (position.y & 3))));
+}
+
+uint16_t Selection::getLeafMask(int x, int y, int z) const
+{
+	auto it = leaves.find(getLeafKey(x, y, z));
+	return it != leaves.end() ? it->second.mask : 0;
+}
+
+void Selection::updateBounds() const
+{
+	min_position = Position(0x10000, 0x10000, 0x10);
+	max_position = Position();
+	for(const auto& entry : leaves) {
+		const uint32_t key = entry.first;
+		const uint16_t mask = entry.second.mask;
+		const int nd_x = int(key >> 18) << 2;
+		const int nd_y = int((key >> 4) & 0x3FFF) << 2;
+		const int z = int(key & 0xF);
+
+		// Columns are groups of 4 bits, rows the same bit of every group
+		int min_x = 4, max_x = -1, min_y = 4, max_y = -1;
+		for(int lx = 0; lx < 4; ++lx) {
+			const int column = (mask >> (lx * 4)) & 0xF;
+			if(column == 0)
+				continue;
+
+			min_x = std::min(min_x, lx);
+			max_x = std::max(max_x, lx);
+			for(int ly = 0; ly < 4; ++ly) {
+				if(column & (1 << ly)) {
+					min_y = std::min(min_y, ly);
+					max_y = std::max(max_y, ly);
+				}
+			}
+		}
+
+		min_position.x = std::min(min_position.x, nd_x + min_x);
+		min_position.y = std::min(min_position.y, nd_y + min_y);
+		min_position.z = std::min(min_position.z, z);
+		max_position.x = std::max(max_position.x, nd_x + max_x);
+		max_position.y = std::max(max_position.y, nd_y + max_y);
+		max_position.z = std::max(max_position.z, z);
+	}
+	bounds_valid = true;
+}
+
 Position Selection::minPosition() const
 {
-	Position min_pos(0x10000, 0x10000, 0x10);
-	for(const Tile* tile : tiles) {
-		if(!tile) continue;
-		const Position& tile_pos = tile->getPosition();
-		if(min_pos.x > tile_pos.x)
-			min_pos.x = tile_pos.x;
-		if(min_pos.y > tile_pos.y)
-			min_pos.y = tile_pos.y;
-		if(min_pos.z > tile_pos.z)
-			min_pos.z = tile_pos.z;
+	if(!bounds_valid) {
+		updateBounds();
 	}
-	return min_pos;
+	return min_position;
 }
 
 Position Selection::maxPosition() const
 {
-	Position max_pos;
-	for(const Tile* tile : tiles) {
-		if(!tile) continue;
-		const Position& tile_pos = tile->getPosition();
-		if(max_pos.x < tile_pos.x)
-			max_pos.x = tile_pos.x;
-		if(max_pos.y < tile_pos.y)
-			max_pos.y = tile_pos.y;
-		if(max_pos.z < tile_pos.z)
-			max_pos.z = tile_pos.z;
+	if(!bounds_valid) {
+		updateBounds();
 	}
-	return max_pos;
+	return max_position;
 }
 
 void Selection::add(const Tile* tile, Item* item)
@@ -86,7 +158,7 @@ void Selection::add(const Tile* tile, Item* item)
 	Tile* new_tile = tile->deepCopy(editor.getMap());
 	item->deselect();
 
-	if(g_settings.getInteger(Config::BORDER_IS_GROUND)) {
+	if(g_settings.getSnapshot()->border_is_ground) {
 		if(item->isBorder())
 			new_tile->selectGround();
 	}
@@ -137,7 +209,29 @@ void Selection::add(const Tile* tile)
 	subsession->addChange(newd Change(new_tile));
 }
 
-void Selection::remove(Tile* tile, Item* item)
+void Selection::add(const std::vector<LassoLeaf>& leaves, int z)
+{
+	ASSERT(subsession);
+
+	Map& map = editor.getMap();
+	for(const LassoLeaf& leaf : leaves) {
+		QTreeNode* node = map.getLeaf(leaf.x, leaf.y);
+		Floor* floor = node ? node->getFloor(z) : nullptr;
+		if(!floor)
+			continue;
+
+		for(int index = 0; index < 16; ++index) {
+			if(!(leaf.mask & (1 << index)))
+				continue;
+
+			Tile* tile = floor->locs[index].get();
+			if(tile) {
+				add(tile);
+			}
+		}
+	}
+}
+
 {
 	ASSERT(subsession);
 	ASSERT(tile);
@@ -147,7 +241,7 @@ void Selection::remove(Tile* tile, Item* item)
 	item->deselect();
 	Tile* new_tile = tile->deepCopy(editor.getMap());
 	if(selected) item->select();
-	if(item->isBorder() && g_settings.getInteger(Config::BORDER_IS_GROUND)) new_tile->deselectGround();
+	if(item->isBorder() && g_settings.getSnapshot()->border_is_ground) new_tile->deselectGround();
 
 	subsession->addChange(newd Change(new_tile));
 }
@@ -194,28 +288,98 @@ void Selection::addInternal(Tile* tile)
 {
 	ASSERT(tile);
 
-	tiles.insert(tile);
+	const Position& position = tile->getPosition();
+	const uint32_t key = getLeafKey(position.x, position.y, position.z);
+	if(key != last_key) {
+		auto it = leaves.find(key);
+		if(it == leaves.end()) {
+			QTreeNode* node = editor.getMap().getLeaf(position.x, position.y);
+			ASSERT(node);
+			it = leaves.emplace(key, Leaf { node->getFloor(position.z), 0 }).first;
+		}
+		last_key = key;
+		last_leaf = &it->second;
+	}
+
+	const uint16_t bit = 1 << ((position.x & 3) * 4 + (position.y & 3));
+	if(last_leaf->mask & bit) {
+		return;
+	}
+	last_leaf->mask |= bit;
+	++count;
+
+	if(bounds_valid) {
+		if(count == 1) {
+			min_position = max_position = position;
+		} else {
+			min_position.x = std::min(min_position.x, position.x);
+			min_position.y = std::min(min_position.y, position.y);
+			min_position.z = std::min(min_position.z, position.z);
+			max_position.x = std::max(max_position.x, position.x);
+			max_position.y = std::max(max_position.y, position.y);
+			max_position.z = std::max(max_position.z, position.z);
+		}
+	}
 }
 
 void Selection::removeInternal(Tile* tile)
 {
 	ASSERT(tile);
-	tiles.erase(tile);
+
+	// Tiles are swapped in before the tile they replace is removed, the square
+	// stays selected if the new tile is
+	const Position& position = tile->getPosition();
+	const Tile* current = editor.getMap().getTile(position);
+	if(current && current != tile && current->isSelected()) {
+		return;
+	}
+
+	const uint32_t key = getLeafKey(position.x, position.y, position.z);
+	auto it = leaves.find(key);
+	if(it == leaves.end()) {
+		return;
+	}
+
+	Leaf& leaf = it->second;
+	const uint16_t bit = 1 << ((position.x & 3) * 4 + (position.y & 3));
+	if(!(leaf.mask & bit)) {
+		return;
+	}
+	leaf.mask &= ~bit;
+	--count;
+
+	if(leaf.mask == 0) {
+		leaves.erase(it);
+		last_key = 0xFFFFFFFF;
+		last_leaf = nullptr;
+	}
+
+	// Only a tile on the edge can shrink the extent
+	if(bounds_valid && (count == 0 ||
+		position.x == min_position.x || position.y == min_position.y || position.z == min_position.z ||
+		position.x == max_position.x || position.y == max_position.y || position.z == max_position.z)) {
+		bounds_valid = false;
+	}
 }
 
 void Selection::clear()
 {
 	if(session) {
-		for(Tile* tile : tiles) {
+		for(Tile* tile : *this) {
 			Tile* new_tile = tile->deepCopy(editor.getMap());
 			new_tile->deselect();
 			subsession->addChange(newd Change(new_tile));
 		}
 	} else {
-		for(Tile* tile : tiles) {
+		for(Tile* tile : *this) {
 			tile->deselect();
+			editor.getMap().markTileChanged(tile->getX(), tile->getY());
 		}
-		tiles.clear();
+		leaves.clear();
+		count = 0;
+		last_key = 0xFFFFFFFF;
+		last_leaf = nullptr;
+		bounds_valid = false;
 	}
 }
 
@@ -263,6 +427,7 @@ void Selection::finish(SessionFlags flags)
 			batch->addAndCommitAction(subsession);
 			editor.addBatch(batch, 2);
 			editor.updateActions();
+			g_session_recorder.recordSelection(editor, *this);
 
 			session = nullptr;
 			subsession = nullptr;
@@ -284,19 +449,16 @@ void Selection::updateSelectionCount()
 	}
 }
 
-void Selection::join(SelectionThread* thread)
+void Selection::join(SelectionTask* task)
 {
-	thread->Wait();
-
 	ASSERT(session);
-	session->addAction(thread->result);
-	thread->selection.subsession = nullptr;
+	session->addAction(task->result);
+	task->selection.subsession = nullptr;
 
-	delete thread;
+	delete task;
 }
 
-SelectionThread::SelectionThread(Editor& editor, Position start, Position end) :
-	wxThread(wxTHREAD_JOINABLE),
+SelectionTask::SelectionTask(Editor& editor, Position start, Position end) :
 	editor(editor),
 	start(start),
 	end(end),
@@ -306,32 +468,52 @@ SelectionThread::SelectionThread(Editor& editor, Position start, Position end) :
 	////
 }
 
-void SelectionThread::Execute()
+void SelectionTask::Execute(ThreadPool::TaskGroup& group)
 {
-	Create();
-	Run();
+	ThreadPool::getInstance().submit(group, [this]() { Entry(); });
 }
 
-wxThread::ExitCode SelectionThread::Entry()
+void SelectionTask::Entry()
 {
+	RME_TRACE_ZONE("selection", "SelectionTask");
 	selection.start(Selection::SUBTHREAD);
-	bool compesated = g_settings.getInteger(Config::COMPENSATED_SELECT);
+	// Read through the snapshot, this runs on a worker thread
+	bool compesated = g_settings.getSnapshot()->compensated_select;
+
+	// Compensated selection moves the box one tile for every floor below the ground floor
+	int offsets[rme::MapLayers] = {};
+	int offset = 0;
 	for(int z = start.z; z >= end.z; --z) {
-		for(int x = start.x; x <= end.x; ++x) {
-			for(int y = start.y; y <= end.y; ++y) {
-				Tile* tile = editor.getMap().getTile(x, y, z);
+		offsets[z] = offset;
+		if(compesated && z <= rme::MapGroundLayer) {
+			++offset;
+		}
+	}
+	const int last_x = end.x + offsets[end.z];
+	const int last_y = end.y + offsets[end.z];
+
+	// Walk the leaves, the 16 tiles of a floor at once, and leaves that don't exist are skipped whole
+	editor.getMap().visitFloors(start.x, start.y, last_x, last_y, end.z, start.z, [&](Floor* floor, int nd_x, int nd_y, int z) {
+		const int min_x = start.x + offsets[z], max_x = end.x + offsets[z];
+		const int min_y = start.y + offsets[z], max_y = end.y + offsets[z];
+		for(int lx = 0; lx < 4; ++lx) {
+			const int x = nd_x + lx;
+			if(x < min_x || x > max_x)
+				continue;
+
+			for(int ly = 0; ly < 4; ++ly) {
+				const int y = nd_y + ly;
+				if(y < min_y || y > max_y)
+					continue;
+
+				Tile* tile = floor->locs[lx * 4 + ly].get();
 				if(!tile)
 					continue;
 
 				selection.add(tile);
 			}
 		}
-		if(compesated && z <= rme::MapGroundLayer) {
-			++start.x; ++start.y;
-			++end.x; ++end.y;
-		}
-	}
+	});
 	result = selection.subsession;
 	selection.finish(Selection::SUBTHREAD);
-	return nullptr;
 }
@@ -20,16 +20,57 @@
 
 #include "position.h"
 #include "action.h"
+#include "thread_pool.h"
+
+#include <iterator>
+#include <unordered_map>
 
 class Action;
 class Editor;
+class Floor;
 class BatchAction;
 
-class SelectionThread;
+class SelectionTask;
+
+struct LassoLeaf;
 
+// The selected tiles are kept as a mask per leaf floor, so adding, removing and
+// checking a tile is a bit of one mask, and the extent of the selection only has
+// to go over the leaves
 class Selection
 {
+	struct Leaf {
+		Floor* floor;
+		uint16_t mask;
+	};
+	using LeafMap = std::unordered_map<uint32_t, Leaf>;
+
 public:
+	// Visits the selected tiles a leaf at a time
+	class iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = Tile*;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Tile* const*;
+		using reference = Tile*;
+
+		iterator(LeafMap::const_iterator leaf, LeafMap::const_iterator end);
+
+		Tile* operator*() const;
+		iterator& operator++();
+		bool operator==(const iterator& other) const noexcept { return leaf == other.leaf && index == other.index; }
+		bool operator!=(const iterator& other) const noexcept { return !(*this == other); }
+
+	private:
+		// Moves on to the next selected tile, from index on
+		void settle();
+
+		LeafMap::const_iterator leaf, end;
+		int index;
+	};
+
 	Selection(Editor& editor);
 	~Selection();
 
@@ -39,6 +80,8 @@ public:
 	void add(const Tile* tile, Spawn* spawn);
 	void add(const Tile* tile, Creature* creature);
 	void add(const Tile* tile);
+	// The tiles of the lasso leaves on floor z, each leaf is looked up once
+	void add(const std::vector<LassoLeaf>& leaves, int z);
 	void remove(Tile* tile, Item* item);
 	void remove(Tile* tile, Spawn* spawn);
 	void remove(Tile* tile, Creature* creature);
@@ -73,37 +116,55 @@ public:
 	void commit();
 	void finish(SessionFlags flags = NONE);
 
-	// Joins the selection instance in this thread with this instance
-	// This deletes the thread
-	void join(SelectionThread* thread);
+	// Joins the selection instance of a finished task with this instance
+	// This deletes the task
+	void join(SelectionTask* task);
 
-	size_t size() const noexcept { return tiles.size(); }
-	bool empty() const noexcept { return tiles.empty(); }
+	size_t size() const noexcept { return count; }
+	bool empty() const noexcept { return count == 0; }
+	bool contains(const Position& position) const;
+	// The selected tiles of the leaf holding x, y on floor z, bit (x & 3) * 4 + (y & 3) per tile
+	uint16_t getLeafMask(int x, int y, int z) const;
 	void updateSelectionCount();
-	TileSet::iterator begin() noexcept { return tiles.begin(); }
-	TileSet::iterator end() noexcept { return tiles.end(); }
-	const TileSet& getTiles() const noexcept { return tiles; }
-	Tile* getSelectedTile() { ASSERT(size() == 1); return *tiles.begin(); }
+	iterator begin() const { return iterator(leaves.begin(), leaves.end()); }
+	iterator end() const { return iterator(leaves.end(), leaves.end()); }
+	Tile* getSelectedTile() { ASSERT(size() == 1); return *begin(); }
 
 private:
+	static uint32_t getLeafKey(int x, int y, int z) noexcept {
+		return (uint32_t(x >> 2) << 18) | (uint32_t(y >> 2) << 4) | uint32_t(z);
+	}
+	// Extent of the selection, worked out again after a tile on its edge was removed
+	void updateBounds() const;
+
 	Editor& editor;
 	BatchAction* session;
 	Action* subsession;
-	TileSet tiles;
+	LeafMap leaves;
+	size_t count;
 	bool busy;
 
-	friend class SelectionThread;
+	// The leaf of the tile last added or removed, tiles usually come a leaf at a time
+	uint32_t last_key;
+	Leaf* last_leaf;
+
+	mutable Position min_position;
+	mutable Position max_position;
+	mutable bool bounds_valid;
+
+	friend class SelectionTask;
 };
 
-class SelectionThread : public wxThread
+// Selects the tiles of an area on the shared thread pool, into a subsession of its own
+class SelectionTask
 {
 public:
-	SelectionThread(Editor& editor, Position start, Position end);
+	SelectionTask(Editor& editor, Position start, Position end);
 
-	void Execute(); // Calls "Create" and then "Run"
+	void Execute(ThreadPool::TaskGroup& group); // Queues it, wait on the group before joining
 
 protected:
-	virtual ExitCode Entry();
+	void Entry();
 	Editor& editor;
 	Position start, end;
 	Selection selection;
@@ -0,0 +1,369 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "session_recorder.h"
+#include "brush.h"
+#include "copybuffer.h"
+#include "editor.h"
+#include "gui.h"
+#include "mt_rand.h"
+#include "selection.h"
+
+#include <algorithm>
+#include <cmath>
+
+SessionRecorder g_session_recorder;
+
+namespace {
+	nlohmann::json toJSON(const Position& position)
+	{
+		return nlohmann::json::array({ position.x, position.y, position.z });
+	}
+
+	nlohmann::json toJSON(const PositionVector& positions)
+	{
+		nlohmann::json array = nlohmann::json::array();
+		for(const Position& position : positions) {
+			array.push_back(toJSON(position));
+		}
+		return array;
+	}
+
+	bool fromJSON(const nlohmann::json& value, Position& position)
+	{
+		if(!value.is_array() || value.size() != 3) {
+			return false;
+		}
+		position = Position(value[0].get<int>(), value[1].get<int>(), value[2].get<int>());
+		return true;
+	}
+
+	PositionVector fromJSON(const nlohmann::json& value)
+	{
+		PositionVector positions;
+		if(!value.is_array()) {
+			return positions;
+		}
+		positions.reserve(value.size());
+		for(const nlohmann::json& element : value) {
+			Position position;
+			if(fromJSON(element, position)) {
+				positions.push_back(position);
+			}
+		}
+		return positions;
+	}
+
+	double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		if(sorted.empty()) {
+			return 0.0;
+		}
+		return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+	}
+}
+
+SessionRecorder::SessionRecorder() :
+	recorded(nullptr),
+	last_brush(nullptr),
+	last_size(-1),
+	last_shape(-1),
+	last_variation(-1),
+	last_camera { 0, 0, 0, 0, -1 },
+	last_zoom(0.0)
+{
+	////
+}
+
+bool SessionRecorder::start(Editor& editor, const FileName& filename)
+{
+	stop();
+
+	file.open(nstr(filename.GetFullPath()).c_str(), std::ios::trunc | std::ios::out);
+	if(!file.is_open()) {
+		return false;
+	}
+
+	recorded = &editor;
+	started = Clock::now();
+	last_brush = nullptr;
+	last_camera[4] = -1;
+	return true;
+}
+
+void SessionRecorder::stop()
+{
+	if(file.is_open()) {
+		file.close();
+	}
+	recorded = nullptr;
+}
+
+void SessionRecorder::recordDraw(const Editor& editor, const Position& offset, bool alt, bool dodraw)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	recordBrush();
+	nlohmann::json operation = { { "op", "draw" }, { "erase", !dodraw }, { "alt", alt }, { "offset", toJSON(offset) } };
+	write(operation);
+}
+
+void SessionRecorder::recordDraw(const Editor& editor, const PositionVector& tiles, const PositionVector* border, bool alt, bool dodraw)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	recordBrush();
+	nlohmann::json operation = { { "op", "draw" }, { "erase", !dodraw }, { "alt", alt }, { "tiles", toJSON(tiles) } };
+	if(border) {
+		operation["border"] = toJSON(*border);
+	}
+	write(operation);
+}
+
+void SessionRecorder::recordSelection(const Editor& editor, const Selection& selection)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	nlohmann::json tiles = nlohmann::json::array();
+	for(const Tile* tile : selection) {
+		tiles.push_back(toJSON(tile->getPosition()));
+	}
+	nlohmann::json operation = { { "op", "select" }, { "tiles", std::move(tiles) } };
+	write(operation);
+}
+
+void SessionRecorder::recordCopy(const Editor& editor, int floor, bool cut)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	nlohmann::json operation = { { "op", cut ? "cut" : "copy" }, { "floor", floor } };
+	write(operation);
+}
+
+void SessionRecorder::recordPaste(const Editor& editor, const Position& position)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	nlohmann::json operation = { { "op", "paste" }, { "position", toJSON(position) } };
+	write(operation);
+}
+
+void SessionRecorder::recordUndo(const Editor& editor, int indexes, bool redo)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	nlohmann::json operation = { { "op", redo ? "redo" : "undo" }, { "count", indexes } };
+	write(operation);
+}
+
+void SessionRecorder::recordCamera(const Editor& editor, int scroll_x, int scroll_y, int width, int height, int floor, double zoom)
+{
+	if(!isRecording(editor)) {
+		return;
+	}
+
+	const int camera[5] = { scroll_x, scroll_y, width, height, floor };
+	if(std::equal(camera, camera + 5, last_camera) && zoom == last_zoom) {
+		return;
+	}
+	std::copy(camera, camera + 5, last_camera);
+	last_zoom = zoom;
+
+	nlohmann::json operation = {
+		{ "op", "camera" }, { "x", scroll_x }, { "y", scroll_y },
+		{ "width", width }, { "height", height }, { "floor", floor }, { "zoom", zoom }
+	};
+	write(operation);
+}
+
+void SessionRecorder::recordBrush()
+{
+	const Brush* brush = g_gui.GetCurrentBrush();
+	const int size = g_gui.GetBrushSize();
+	const int shape = g_gui.GetBrushShape();
+	const int variation = g_gui.GetBrushVariation();
+	if(!brush || (brush == last_brush && size == last_size && shape == last_shape && variation == last_variation)) {
+		return;
+	}
+
+	last_brush = brush;
+	last_size = size;
+	last_shape = shape;
+	last_variation = variation;
+
+	nlohmann::json operation = {
+		{ "op", "brush" }, { "name", brush->getName() }, { "size", size },
+		{ "shape", shape == BRUSHSHAPE_CIRCLE ? "circle" : "square" }, { "variation", variation }
+	};
+	write(operation);
+}
+
+void SessionRecorder::write(nlohmann::json& operation)
+{
+	// Whole microseconds, the rest is noise
+	const double ms = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+	operation["t"] = std::round(ms * 1000.0) / 1000.0;
+	file << operation.dump() << '\n';
+}
+
+SessionReplay::SessionReplay(Editor& editor) :
+	editor(editor),
+	skipped(0)
+{
+	////
+}
+
+bool SessionReplay::load(const std::string& path)
+{
+	std::ifstream file(path.c_str());
+	if(!file.is_open()) {
+		return false;
+	}
+
+	operations.clear();
+	std::string line;
+	while(std::getline(file, line)) {
+		nlohmann::json operation = nlohmann::json::parse(line, nullptr, false);
+		if(operation.is_object() && operation.contains("op") && operation["op"].is_string()) {
+			operations.push_back(std::move(operation));
+		}
+	}
+	return true;
+}
+
+void SessionReplay::run(const Report& report)
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Doodads and random grounds draw the same as long as the seed is the same
+	mt_seed(0);
+
+	timings.clear();
+	skipped = 0;
+	for(const nlohmann::json& operation : operations) {
+		const Clock::time_point start = Clock::now();
+		if(!play(operation)) {
+			++skipped;
+			continue;
+		}
+		const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		timings[operation["op"].get<std::string>()].push_back(ms);
+	}
+
+	for(auto& entry : timings) {
+		std::vector<double>& sorted = entry.second;
+		std::sort(sorted.begin(), sorted.end());
+
+		Result result;
+		result.operation = entry.first;
+		result.count = sorted.size();
+		for(double ms : sorted) {
+			result.total_ms += ms;
+		}
+		result.p50_ms = percentile(sorted, 0.5);
+		result.p90_ms = percentile(sorted, 0.9);
+		result.p99_ms = percentile(sorted, 0.99);
+		result.max_ms = sorted.back();
+		report(result);
+	}
+}
+
+bool SessionReplay::play(const nlohmann::json& operation)
+{
+	const std::string op = operation["op"].get<std::string>();
+	if(op == "brush") {
+		Brush* brush = g_brushes.getBrush(operation.value("name", ""));
+		if(!brush) {
+			return false;
+		}
+		g_gui.SelectBrushInternal(brush);
+		g_gui.SetBrushShape(operation.value("shape", "square") == "circle" ? BRUSHSHAPE_CIRCLE : BRUSHSHAPE_SQUARE);
+		g_gui.SetBrushSizeInternal(operation.value("size", 0));
+		g_gui.SetBrushVariation(operation.value("variation", 0));
+	} else if(op == "draw") {
+		const bool dodraw = !operation.value("erase", false);
+		const bool alt = operation.value("alt", false);
+		Position offset;
+		if(operation.contains("offset") && fromJSON(operation["offset"], offset)) {
+			if(dodraw) {
+				editor.draw(offset, alt);
+			} else {
+				editor.undraw(offset, alt);
+			}
+			return true;
+		}
+
+		const PositionVector tiles = fromJSON(operation["tiles"]);
+		if(tiles.empty()) {
+			return false;
+		}
+		if(operation.contains("border")) {
+			PositionVector border = fromJSON(operation["border"]);
+			if(dodraw) {
+				editor.draw(tiles, border, alt);
+			} else {
+				editor.undraw(tiles, border, alt);
+			}
+		} else if(dodraw) {
+			editor.draw(tiles, alt);
+		} else {
+			editor.undraw(tiles, alt);
+		}
+	} else if(op == "select") {
+		// Whole tiles, a selection of single items on a tile comes back as the tile
+		Selection& selection = editor.getSelection();
+		selection.start();
+		selection.clear();
+		for(const Position& position : fromJSON(operation["tiles"])) {
+			if(Tile* tile = editor.getMap().getTile(position)) {
+				selection.add(tile);
+			}
+		}
+		selection.finish();
+	} else if(op == "copy") {
+		g_gui.copybuffer.copy(editor, operation.value("floor", 0));
+	} else if(op == "cut") {
+		g_gui.copybuffer.cut(editor, operation.value("floor", 0));
+	} else if(op == "paste") {
+		Position position;
+		if(!fromJSON(operation["position"], position)) {
+			return false;
+		}
+		g_gui.copybuffer.paste(editor, position);
+	} else if(op == "undo") {
+		editor.undo(operation.value("count", 1));
+	} else if(op == "redo") {
+		editor.redo(operation.value("count", 1));
+	} else if(op != "camera") {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SESSION_RECORDER_H_
+#define RME_SESSION_RECORDER_H_
+
+#include "position.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class Brush;
+class Editor;
+class Selection;
+
+// Writes what is done to one map at the level of the editor, a line of JSON per
+// operation with the milliseconds since the recording started:
+//   {"alt": false, "erase": false, "op": "draw", "t": 1520.25, "tiles": [[x, y, z], ...]}
+// The brush a stroke was drawn with is written before it whenever it changed, the
+// view whenever it moved. A recording played back by SessionReplay does the same
+// edits again, so a slow session can be kept and timed as a benchmark.
+class SessionRecorder
+{
+public:
+	SessionRecorder();
+
+	bool start(Editor& editor, const FileName& filename);
+	void stop();
+	// Only the operations on the map the recording was started for are written
+	bool isRecording(const Editor& editor) const noexcept { return recorded == &editor; }
+	bool isRecording() const noexcept { return recorded != nullptr; }
+
+	void recordDraw(const Editor& editor, const Position& offset, bool alt, bool dodraw);
+	void recordDraw(const Editor& editor, const PositionVector& tiles, const PositionVector* border, bool alt, bool dodraw);
+	// The tiles with anything selected once a selection session is finished
+	void recordSelection(const Editor& editor, const Selection& selection);
+	void recordCopy(const Editor& editor, int floor, bool cut);
+	void recordPaste(const Editor& editor, const Position& position);
+	void recordUndo(const Editor& editor, int indexes, bool redo);
+	// Written only when the view differs from the last one written
+	void recordCamera(const Editor& editor, int scroll_x, int scroll_y, int width, int height, int floor, double zoom);
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	void recordBrush();
+	void write(nlohmann::json& operation);
+
+	const Editor* recorded;
+	std::ofstream file;
+	Clock::time_point started;
+
+	const Brush* last_brush;
+	int last_size;
+	int last_shape;
+	int last_variation;
+	int last_camera[5];
+	double last_zoom;
+};
+
+extern SessionRecorder g_session_recorder;
+
+// Plays a recording back against the map of an editor without any window, as fast
+// as it goes, and times every operation. The view can't be drawn without a GL
+// context, so the camera moves are counted but not timed.
+class SessionReplay
+{
+public:
+	struct Result {
+		std::string operation;
+		size_t count = 0;
+		double total_ms = 0.0;
+		double p50_ms = 0.0;
+		double p90_ms = 0.0;
+		double p99_ms = 0.0;
+		double max_ms = 0.0;
+	};
+	using Report = std::function<void(const Result& result)>;
+
+	explicit SessionReplay(Editor& editor);
+
+	// False if the file couldn't be read, lines that can't be parsed are skipped
+	bool load(const std::string& path);
+	// Reports the latencies of every kind of operation once all of them ran
+	void run(const Report& report);
+
+	size_t getOperationCount() const noexcept { return operations.size(); }
+	// Operations that couldn't be played back, a brush missing from the loaded version
+	size_t getSkippedCount() const noexcept { return skipped; }
+
+private:
+	// Returns false if the operation couldn't be played back
+	bool play(const nlohmann::json& operation);
+
+	Editor& editor;
+	std::vector<nlohmann::json> operations;
+	std::map<std::string, std::vector<double>> timings;
+	size_t skipped;
+};
+
+#endif
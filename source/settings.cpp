@@ -32,7 +32,7 @@
 
 Settings g_settings;
 
-Settings::Settings() : store(Config::LAST)
+Settings::Settings() : store(Config::LAST), batching(false)
 #ifdef __WINDOWS__
 			   , use_file_cfg(false)
 #endif
@@ -101,6 +101,9 @@ void Settings::setInteger(uint32_t key, int newval)
 		dv.type = TYPE_INT;
 		dv.intval = newval;
 	}
+	if(!batching) {
+		publish();
+	}
 }
 
 void Settings::setFloat(uint32_t key, float newval)
@@ -113,6 +116,9 @@ void Settings::setFloat(uint32_t key, float newval)
 		dv.type = TYPE_FLOAT;
 		dv.floatval = newval;
 	}
+	if(!batching) {
+		publish();
+	}
 }
 
 void Settings::setString(uint32_t key, std::string newval)
@@ -139,9 +145,69 @@ std::string Settings::DynamicValue::str()
 	}
 }
 
+void Settings::publish()
+{
+	using namespace Config;
+	auto next = std::make_shared<SettingsSnapshot>();
+
+	next->compensated_select = getBoolean(COMPENSATED_SELECT);
+	next->border_is_ground = getBoolean(BORDER_IS_GROUND);
+	next->group_actions = getBoolean(GROUP_ACTIONS);
+	next->undo_size = size_t(std::max(getInteger(UNDO_SIZE), 0));
+	next->undo_mem_size = size_t(std::max(getInteger(UNDO_MEM_SIZE), 0)) * 1024 * 1024;
+
+	next->use_memcached_sprites = getBoolean(USE_MEMCACHED_SPRITES);
+	next->software_clean_threshold = uint32_t(std::max(getInteger(SOFTWARE_CLEAN_THRESHOLD), 0));
+	next->software_clean_size = uint32_t(std::max(getInteger(SOFTWARE_CLEAN_SIZE), 0));
+	next->texture_management = getBoolean(TEXTURE_MANAGEMENT);
+	next->texture_clean_threshold = getInteger(TEXTURE_CLEAN_THRESHOLD);
+	next->texture_longevity = getInteger(TEXTURE_LONGEVITY);
+	next->sprite_uploads_per_frame = getInteger(SPRITE_UPLOADS_PER_FRAME);
+
+	next->hard_refresh_rate = getInteger(HARD_REFRESH_RATE);
+	next->overview_zoom = getInteger(OVERVIEW_ZOOM);
+	next->scroll_speed = getFloat(SCROLL_SPEED);
+	next->show_frame_profiler = getBoolean(SHOW_FRAME_PROFILER);
+	const Key cursor[] = { CURSOR_RED, CURSOR_GREEN, CURSOR_BLUE, CURSOR_ALPHA };
+	const Key cursor_alt[] = { CURSOR_ALT_RED, CURSOR_ALT_GREEN, CURSOR_ALT_BLUE, CURSOR_ALT_ALPHA };
+	for(int i = 0; i < 4; ++i) {
+		next->cursor_color[i] = uint8_t(getInteger(cursor[i]));
+		next->cursor_alt_color[i] = uint8_t(getInteger(cursor_alt[i]));
+	}
+
+	next->transparent_floors = getBoolean(TRANSPARENT_FLOORS);
+	next->transparent_items = getBoolean(TRANSPARENT_ITEMS);
+	next->show_ingame_box = getBoolean(SHOW_INGAME_BOX);
+	next->show_lights = getBoolean(SHOW_LIGHTS);
+	next->show_grid = getInteger(SHOW_GRID);
+	next->show_extra = getBoolean(SHOW_EXTRA);
+	next->show_all_floors = getBoolean(SHOW_ALL_FLOORS);
+	next->show_creatures = getBoolean(SHOW_CREATURES);
+	next->show_spawns = getBoolean(SHOW_SPAWNS);
+	next->show_houses = getBoolean(SHOW_HOUSES);
+	next->show_shade = getBoolean(SHOW_SHADE);
+	next->show_special_tiles = getBoolean(SHOW_SPECIAL_TILES);
+	next->show_zone_areas = getBoolean(SHOW_ZONE_AREAS);
+	next->show_items = getBoolean(SHOW_ITEMS);
+	next->highlight_items = getBoolean(HIGHLIGHT_ITEMS);
+	next->show_blocking = getBoolean(SHOW_BLOCKING);
+	next->show_tooltips = getBoolean(SHOW_TOOLTIPS);
+	next->show_as_minimap = getBoolean(SHOW_AS_MINIMAP);
+	next->show_only_tileflags = getBoolean(SHOW_ONLY_TILEFLAGS);
+	next->show_only_modified_tiles = getBoolean(SHOW_ONLY_MODIFIED_TILES);
+	next->show_preview = getBoolean(SHOW_PREVIEW);
+	next->show_wall_hooks = getBoolean(SHOW_WALL_HOOKS);
+	next->show_pickupables = getBoolean(SHOW_PICKUPABLES);
+	next->show_moveables = getBoolean(SHOW_MOVEABLES);
+	next->hide_items_when_zoomed = getBoolean(HIDE_ITEMS_WHEN_ZOOMED);
+
+	snapshot.store(std::move(next), std::memory_order_release);
+}
+
 void Settings::IO(IOMode mode)
 {
 	wxConfigBase* conf = (mode == DEFAULT? nullptr : dynamic_cast<wxConfigBase*>(wxConfig::Get()));
+	batching = true;
 
 	using namespace Config;
 #define section(s) if(conf) conf->SetPath("/" s)
@@ -215,6 +281,7 @@ void Settings::IO(IOMode mode)
 	Int(SHOW_WALL_HOOKS, 0);
 	Int(SHOW_PICKUPABLES, 0);
 	Int(SHOW_MOVEABLES, 0);
+	Int(SHOW_FRAME_PROFILER, 0);
 
 	section("Version");
 	Int(VERSION_ID, 0);
@@ -227,6 +294,8 @@ void Settings::IO(IOMode mode)
 	section("Editor");
 	String(RECENT_FILES, "");
 	Int(WORKER_THREADS, 1);
+	Int(INDEX_ITEM_IDS, 1);
+	Int(USE_STARTUP_CACHE, 1);
 	Int(MERGE_MOVE, 0);
 	Int(MERGE_PASTE, 0);
 	Int(UNDO_SIZE, 400);
@@ -245,11 +314,19 @@ void Settings::IO(IOMode mode)
 	Int(BORDERIZE_DRAG_THRESHOLD, 6000);
 	Int(BORDERIZE_PASTE_THRESHOLD, 10000);
 	Int(ALWAYS_MAKE_BACKUP, 0);
+	Int(INCREMENTAL_SAVE, 0);
+	Int(SESSION_SNAPSHOTS, 0);
+	Int(RELOAD_CHANGED_MATERIALS, 1);
+	Int(PAGED_MAP_MEMORY, 0);
+	Int(RESIDENT_VERSIONS_MEMORY, 1024);
+	Int(HIBERNATE_INACTIVE_MAPS, 0);
+	Int(AUTOSAVE_INTERVAL, 5);
 	Int(USE_AUTOMAGIC, 1);
 	Int(HOUSE_BRUSH_REMOVE_ITEMS, 0);
 	Int(AUTO_ASSIGN_DOORID, 1);
 	Int(ERASER_LEAVE_UNIQUE, 1);
 	Int(DOODAD_BRUSH_ERASE_LIKE, 0);
+	Int(FILL_RADIUS, 256);
 	Int(WARN_FOR_DUPLICATE_ID, 1);
 	Int(AUTO_CREATE_SPAWN, 1);
 	Int(DEFAULT_SPAWNTIME, 60);
@@ -261,6 +338,7 @@ void Settings::IO(IOMode mode)
 	Int(USE_OTBM_4_FOR_ALL_MAPS, 0);
 	Int(USE_OTGZ, 1);
 	Int(SAVE_WITH_OTB_MAGIC_NUMBER, 0);
+	Int(SAVE_ZONES_AS_TOML, 1);
 	Int(REPLACE_SIZE, 500);
 	Int(COPY_POSITION_FORMAT, 0);
 
@@ -268,6 +346,7 @@ void Settings::IO(IOMode mode)
 	Int(TEXTURE_MANAGEMENT, 1);
 	Int(TEXTURE_CLEAN_PULSE, 15);
 	Int(TEXTURE_LONGEVITY, 20);
+	Int(SPRITE_UPLOADS_PER_FRAME, 64);
 	Int(TEXTURE_CLEAN_THRESHOLD, 2500);
 	Int(SOFTWARE_CLEAN_THRESHOLD, 1800);
 	Int(SOFTWARE_CLEAN_SIZE, 500);
@@ -279,6 +358,8 @@ void Settings::IO(IOMode mode)
 	IntToSave(USE_MEMCACHED_SPRITES, 0);
 	Int(MINIMAP_UPDATE_DELAY, 333);
 	Int(MINIMAP_VIEW_BOX, 1);
+	Int(OVERVIEW_ZOOM, 16);
+	Int(RENDER_BACKEND, 0);
 	String(MINIMAP_EXPORT_DIR, "");
 
 	Int(CURSOR_RED, 0);
@@ -315,6 +396,7 @@ void Settings::IO(IOMode mode)
 	Int(WINDOW_WIDTH, 700);
 	Int(WINDOW_MAXIMIZED, 0);
 	Int(WELCOME_DIALOG, 1);
+	Int(PRELOAD_RECENT_MAP, 0);
 
 	section("Hotkeys");
 	String(NUMERICAL_HOTKEYS, "none:{}\nnone:{}\nnone:{}\nnone:{}\nnone:{}\nnone:{}\nnone:{}\nnone:{}\nnone:{}\nnone:{}\n");
@@ -337,12 +419,15 @@ void Settings::IO(IOMode mode)
 
 	Int(FIND_ITEM_MODE, 0);
 	Int(JUMP_TO_ITEM_MODE, 0);
+	Int(LIVE_IO_THREADS, 0);
 
 #undef section
 #undef Int
 #undef IntToSave
 #undef Float
 #undef String
+	batching = false;
+	publish();
 }
 
 void Settings::load()
@@ -20,6 +20,9 @@
 
 #include "main.h"
 
+#include <atomic>
+#include <memory>
+
 namespace Config {
 	enum Key {
 		NONE,
@@ -34,6 +37,7 @@ namespace Config {
 		TEXTURE_CLEAN_PULSE,
 		TEXTURE_CLEAN_THRESHOLD,
 		TEXTURE_LONGEVITY,
+		SPRITE_UPLOADS_PER_FRAME,
 		HARD_REFRESH_RATE,
 		USE_MEMCACHED_SPRITES,
 		USE_MEMCACHED_SPRITES_TO_SAVE,
@@ -60,6 +64,7 @@ namespace Config {
 		SHOW_WALL_HOOKS,
 		SHOW_PICKUPABLES,
 		SHOW_MOVEABLES,
+		SHOW_FRAME_PROFILER,
 		SHOW_AS_MINIMAP,
 		SHOW_ONLY_TILEFLAGS,
 		SHOW_ONLY_MODIFIED_TILES,
@@ -79,16 +84,25 @@ namespace Config {
 		BORDERIZE_PASTE_THRESHOLD,
 		ICON_BACKGROUND,
 		ALWAYS_MAKE_BACKUP,
+		INCREMENTAL_SAVE,
+		SESSION_SNAPSHOTS,
+		RELOAD_CHANGED_MATERIALS,
+		PAGED_MAP_MEMORY,
+		RESIDENT_VERSIONS_MEMORY,
+		HIBERNATE_INACTIVE_MAPS,
+		AUTOSAVE_INTERVAL,
 		USE_AUTOMAGIC,
 		HOUSE_BRUSH_REMOVE_ITEMS,
 		AUTO_ASSIGN_DOORID,
 		ERASER_LEAVE_UNIQUE,
 		DOODAD_BRUSH_ERASE_LIKE,
+		FILL_RADIUS,
 		WARN_FOR_DUPLICATE_ID,
 		USE_UPDATER,
 		USE_OTBM_4_FOR_ALL_MAPS,
 		USE_OTGZ,
 		SAVE_WITH_OTB_MAGIC_NUMBER,
+		SAVE_ZONES_AS_TOML,
 		REPLACE_SIZE,
 
 		USE_LARGE_CONTAINER_ICONS,
@@ -130,6 +144,8 @@ namespace Config {
 		LISTBOX_EATS_ALL_EVENTS,
 		RAW_LIKE_SIMONE,
 		WORKER_THREADS,
+		INDEX_ITEM_IDS,
+		USE_STARTUP_CACHE,
 		COPY_POSITION_FORMAT,
 
 		GOTO_WEBSITE_ON_BOOT,
@@ -142,6 +158,8 @@ namespace Config {
 		MINIMAP_LAYOUT,
 		MINIMAP_UPDATE_DELAY,
 		MINIMAP_VIEW_BOX,
+		OVERVIEW_ZOOM,
+		RENDER_BACKEND,
 		MINIMAP_EXPORT_DIR,
 		ACTIONS_HISTORY_VISIBLE,
 		ACTIONS_HISTORY_LAYOUT,
@@ -149,6 +167,7 @@ namespace Config {
 		WINDOW_WIDTH,
 		WINDOW_MAXIMIZED,
 		WELCOME_DIALOG,
+		PRELOAD_RECENT_MAP,
 
 		NUMERICAL_HOTKEYS,
 		RECENT_FILES,
@@ -158,6 +177,7 @@ namespace Config {
 
 		FIND_ITEM_MODE,
 		JUMP_TO_ITEM_MODE,
+		LIVE_IO_THREADS,
 
 		SHOW_TOOLBAR_STANDARD,
 		SHOW_TOOLBAR_BRUSHES,
@@ -176,6 +196,62 @@ namespace Config {
 
 class wxConfigBase;
 
+// The settings read on hot paths, already converted to their types. Settings rebuilds it
+// whenever a value changes and swaps it in whole, so a reader on any thread gets either the
+// old or the new values, never a mix of both.
+struct SettingsSnapshot {
+	// Editing
+	bool compensated_select = false;
+	bool border_is_ground = false;
+	bool group_actions = false;
+	size_t undo_size = 0;
+	size_t undo_mem_size = 0; // In bytes
+
+	// Sprites and textures
+	bool use_memcached_sprites = false;
+	uint32_t software_clean_threshold = 0;
+	uint32_t software_clean_size = 0;
+	bool texture_management = false;
+	int texture_clean_threshold = 0;
+	int texture_longevity = 0;
+	int sprite_uploads_per_frame = 0;
+
+	// Map view
+	int hard_refresh_rate = 0;
+	int overview_zoom = 0;
+	float scroll_speed = 0.0f;
+	bool show_frame_profiler = false;
+	uint8_t cursor_color[4] = {};
+	uint8_t cursor_alt_color[4] = {};
+
+	// Drawing options
+	bool transparent_floors = false;
+	bool transparent_items = false;
+	bool show_ingame_box = false;
+	bool show_lights = false;
+	int show_grid = 0;
+	bool show_extra = false;
+	bool show_all_floors = false;
+	bool show_creatures = false;
+	bool show_spawns = false;
+	bool show_houses = false;
+	bool show_shade = false;
+	bool show_special_tiles = false;
+	bool show_zone_areas = false;
+	bool show_items = false;
+	bool highlight_items = false;
+	bool show_blocking = false;
+	bool show_tooltips = false;
+	bool show_as_minimap = false;
+	bool show_only_tileflags = false;
+	bool show_only_modified_tiles = false;
+	bool show_preview = false;
+	bool show_wall_hooks = false;
+	bool show_pickupables = false;
+	bool show_moveables = false;
+	bool hide_items_when_zoomed = false;
+};
+
 class Settings {
 public:
 	Settings();
@@ -190,6 +266,12 @@ public:
 	void setFloat(uint32_t key, float newval);
 	void setString(uint32_t key, std::string newval);
 
+	// Safe to call from any thread. Keep the pointer for the whole operation rather than
+	// getting it again for every value, it stays valid after the settings change.
+	std::shared_ptr<const SettingsSnapshot> getSnapshot() const {
+		return snapshot.load(std::memory_order_acquire);
+	}
+
 	wxConfigBase& getConfigObject();
 	void setDefaults() { IO(DEFAULT); }
 	void load();
@@ -242,7 +324,12 @@ private:
 		SAVE,
 	};
 	void IO(IOMode mode);
+	void publish();
+
 	std::vector<DynamicValue> store;
+	std::atomic<std::shared_ptr<const SettingsSnapshot>> snapshot;
+	// Set while IO runs, the snapshot is published once it is done
+	bool batching;
 #ifdef __WINDOWS__
 	bool use_file_cfg;
 #endif
@@ -0,0 +1,751 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+#include "shader_renderer.h"
+#include "frame_profiler.h"
+
+#include <cstddef>
+
+#if defined __WINDOWS__
+#define RME_GL_CALL __stdcall
+#elif defined __APPLE__
+#include <dlfcn.h>
+#define RME_GL_CALL
+#else
+#include <GL/glx.h>
+#define RME_GL_CALL
+#endif
+
+namespace {
+	// Not all of the system headers go past OpenGL 1.1
+	constexpr GLenum ArrayBuffer = 0x8892; // GL_ARRAY_BUFFER
+	constexpr GLenum ElementArrayBuffer = 0x8893; // GL_ELEMENT_ARRAY_BUFFER
+	constexpr GLenum StreamDraw = 0x88E0; // GL_STREAM_DRAW
+	constexpr GLenum StaticDraw = 0x88E4; // GL_STATIC_DRAW
+	constexpr GLenum FragmentShader = 0x8B30; // GL_FRAGMENT_SHADER
+	constexpr GLenum VertexShader = 0x8B31; // GL_VERTEX_SHADER
+	constexpr GLenum CompileStatus = 0x8B81; // GL_COMPILE_STATUS
+	constexpr GLenum LinkStatus = 0x8B82; // GL_LINK_STATUS
+	constexpr GLenum Framebuffer = 0x8D40; // GL_FRAMEBUFFER
+	constexpr GLenum FramebufferBinding = 0x8CA6; // GL_FRAMEBUFFER_BINDING
+	constexpr GLenum FramebufferComplete = 0x8CD5; // GL_FRAMEBUFFER_COMPLETE
+	constexpr GLenum ColorAttachment0 = 0x8CE0; // GL_COLOR_ATTACHMENT0
+	constexpr GLenum FuncAdd = 0x8006; // GL_FUNC_ADD
+	constexpr GLenum BlendMax = 0x8008; // GL_MAX
+	constexpr GLenum ClampToEdge = 0x812F; // GL_CLAMP_TO_EDGE
+
+	enum Attribute : GLuint {
+		ATTRIBUTE_POSITION,
+		ATTRIBUTE_TEXCOORD,
+		ATTRIBUTE_COLOR,
+	};
+
+	struct Functions {
+		GLuint (RME_GL_CALL* CreateShader)(GLenum type);
+		void (RME_GL_CALL* ShaderSource)(GLuint shader, GLsizei count, const char* const* string, const GLint* length);
+		void (RME_GL_CALL* CompileShader)(GLuint shader);
+		void (RME_GL_CALL* GetShaderiv)(GLuint shader, GLenum name, GLint* params);
+		void (RME_GL_CALL* DeleteShader)(GLuint shader);
+		GLuint (RME_GL_CALL* CreateProgram)();
+		void (RME_GL_CALL* AttachShader)(GLuint program, GLuint shader);
+		void (RME_GL_CALL* BindAttribLocation)(GLuint program, GLuint index, const char* name);
+		void (RME_GL_CALL* LinkProgram)(GLuint program);
+		void (RME_GL_CALL* GetProgramiv)(GLuint program, GLenum name, GLint* params);
+		void (RME_GL_CALL* DeleteProgram)(GLuint program);
+		void (RME_GL_CALL* UseProgram)(GLuint program);
+		GLint (RME_GL_CALL* GetUniformLocation)(GLuint program, const char* name);
+		void (RME_GL_CALL* Uniform1i)(GLint location, GLint value);
+		void (RME_GL_CALL* UniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+		void (RME_GL_CALL* GenBuffers)(GLsizei n, GLuint* buffers);
+		void (RME_GL_CALL* DeleteBuffers)(GLsizei n, const GLuint* buffers);
+		void (RME_GL_CALL* BindBuffer)(GLenum target, GLuint buffer);
+		void (RME_GL_CALL* BufferData)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+		void (RME_GL_CALL* BufferSubData)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* data);
+		void (RME_GL_CALL* EnableVertexAttribArray)(GLuint index);
+		void (RME_GL_CALL* DisableVertexAttribArray)(GLuint index);
+		void (RME_GL_CALL* VertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+		// OpenGL 3.0, optional
+		void (RME_GL_CALL* GenVertexArrays)(GLsizei n, GLuint* arrays);
+		void (RME_GL_CALL* DeleteVertexArrays)(GLsizei n, const GLuint* arrays);
+		void (RME_GL_CALL* BindVertexArray)(GLuint array);
+		// Frame buffer objects and blend equations, for the light map only
+		void (RME_GL_CALL* Uniform1f)(GLint location, GLfloat value);
+		void (RME_GL_CALL* BlendEquation)(GLenum mode);
+		void (RME_GL_CALL* GenFramebuffers)(GLsizei n, GLuint* framebuffers);
+		void (RME_GL_CALL* DeleteFramebuffers)(GLsizei n, const GLuint* framebuffers);
+		void (RME_GL_CALL* BindFramebuffer)(GLenum target, GLuint framebuffer);
+		void (RME_GL_CALL* FramebufferTexture2D)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+		GLenum (RME_GL_CALL* CheckFramebufferStatus)(GLenum target);
+	};
+
+	Functions gl;
+
+	void* getProcAddress(const char* name)
+	{
+#if defined __WINDOWS__
+		void* address = reinterpret_cast<void*>(wglGetProcAddress(name));
+		// Some drivers hand out small numbers instead of nullptr for missing functions
+		const intptr_t value = reinterpret_cast<intptr_t>(address);
+		if(value >= -1 && value <= 3) {
+			return nullptr;
+		}
+		return address;
+#elif defined __APPLE__
+		return dlsym(RTLD_DEFAULT, name);
+#else
+		return reinterpret_cast<void*>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>(name)));
+#endif
+	}
+
+	template <typename T>
+	bool loadFunction(T& function, const char* name)
+	{
+		function = reinterpret_cast<T>(getProcAddress(name));
+		return function != nullptr;
+	}
+
+	bool loadFunctions()
+	{
+		bool loaded = true;
+		loaded &= loadFunction(gl.CreateShader, "glCreateShader");
+		loaded &= loadFunction(gl.ShaderSource, "glShaderSource");
+		loaded &= loadFunction(gl.CompileShader, "glCompileShader");
+		loaded &= loadFunction(gl.GetShaderiv, "glGetShaderiv");
+		loaded &= loadFunction(gl.DeleteShader, "glDeleteShader");
+		loaded &= loadFunction(gl.CreateProgram, "glCreateProgram");
+		loaded &= loadFunction(gl.AttachShader, "glAttachShader");
+		loaded &= loadFunction(gl.BindAttribLocation, "glBindAttribLocation");
+		loaded &= loadFunction(gl.LinkProgram, "glLinkProgram");
+		loaded &= loadFunction(gl.GetProgramiv, "glGetProgramiv");
+		loaded &= loadFunction(gl.DeleteProgram, "glDeleteProgram");
+		loaded &= loadFunction(gl.UseProgram, "glUseProgram");
+		loaded &= loadFunction(gl.GetUniformLocation, "glGetUniformLocation");
+		loaded &= loadFunction(gl.Uniform1i, "glUniform1i");
+		loaded &= loadFunction(gl.UniformMatrix4fv, "glUniformMatrix4fv");
+		loaded &= loadFunction(gl.GenBuffers, "glGenBuffers");
+		loaded &= loadFunction(gl.DeleteBuffers, "glDeleteBuffers");
+		loaded &= loadFunction(gl.BindBuffer, "glBindBuffer");
+		loaded &= loadFunction(gl.BufferData, "glBufferData");
+		loaded &= loadFunction(gl.BufferSubData, "glBufferSubData");
+		loaded &= loadFunction(gl.EnableVertexAttribArray, "glEnableVertexAttribArray");
+		loaded &= loadFunction(gl.DisableVertexAttribArray, "glDisableVertexAttribArray");
+		loaded &= loadFunction(gl.VertexAttribPointer, "glVertexAttribPointer");
+
+		if(!loadFunction(gl.GenVertexArrays, "glGenVertexArrays") ||
+			!loadFunction(gl.DeleteVertexArrays, "glDeleteVertexArrays") ||
+			!loadFunction(gl.BindVertexArray, "glBindVertexArray")) {
+			gl.GenVertexArrays = nullptr;
+			gl.DeleteVertexArrays = nullptr;
+			gl.BindVertexArray = nullptr;
+		}
+		return loaded;
+	}
+
+	// The framebuffer object extension has the same entry points with a suffix
+	template <typename T>
+	bool loadFramebufferFunction(T& function, const char* name)
+	{
+		return loadFunction(function, name) || loadFunction(function, (std::string(name) + "EXT").c_str());
+	}
+
+	bool loadLightFunctions()
+	{
+		bool loaded = loadFunctions();
+		loaded &= loadFunction(gl.Uniform1f, "glUniform1f");
+		loaded &= loadFunction(gl.BlendEquation, "glBlendEquation");
+		loaded &= loadFramebufferFunction(gl.GenFramebuffers, "glGenFramebuffers");
+		loaded &= loadFramebufferFunction(gl.DeleteFramebuffers, "glDeleteFramebuffers");
+		loaded &= loadFramebufferFunction(gl.BindFramebuffer, "glBindFramebuffer");
+		loaded &= loadFramebufferFunction(gl.FramebufferTexture2D, "glFramebufferTexture2D");
+		loaded &= loadFramebufferFunction(gl.CheckFramebufferStatus, "glCheckFramebufferStatus");
+		return loaded;
+	}
+
+	// What the fixed function pipeline would transform the vertices with
+	void currentTransform(GLfloat transform[16])
+	{
+		GLfloat projection[16];
+		GLfloat modelview[16];
+		glGetFloatv(GL_PROJECTION_MATRIX, projection);
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		for(int column = 0; column < 4; ++column) {
+			for(int row = 0; row < 4; ++row) {
+				GLfloat sum = 0.f;
+				for(int k = 0; k < 4; ++k) {
+					sum += projection[k * 4 + row] * modelview[column * 4 + k];
+				}
+				transform[column * 4 + row] = sum;
+			}
+		}
+	}
+
+	// GLSL 1.20 runs on every OpenGL 2.1 context, including the legacy one on macOS
+	const char* const VertexSource =
+		"#version 120\n"
+		"uniform mat4 transform;\n"
+		"attribute vec2 position;\n"
+		"attribute vec2 texcoord;\n"
+		"attribute vec4 color;\n"
+		"varying vec2 v_texcoord;\n"
+		"varying vec4 v_color;\n"
+		"void main() {\n"
+		"	v_texcoord = texcoord;\n"
+		"	v_color = color;\n"
+		"	gl_Position = transform * vec4(position, 0.0, 1.0);\n"
+		"}\n";
+
+	const char* const FragmentSource =
+		"#version 120\n"
+		"uniform sampler2D sprite;\n"
+		"uniform int textured;\n"
+		"varying vec2 v_texcoord;\n"
+		"varying vec4 v_color;\n"
+		"void main() {\n"
+		"	vec4 color = v_color;\n"
+		"	if(textured != 0) {\n"
+		"		color *= texture2D(sprite, v_texcoord);\n"
+		"	}\n"
+		"	gl_FragColor = color;\n"
+		"}\n";
+
+	enum LightAttribute : GLuint {
+		LIGHT_ATTRIBUTE_POSITION,
+		LIGHT_ATTRIBUTE_CENTER,
+		LIGHT_ATTRIBUTE_REACH,
+		LIGHT_ATTRIBUTE_COLOR,
+	};
+
+	// Same falloff as LightDrawer::calculateIntensity, at every pixel
+	const char* const LightVertexSource =
+		"#version 120\n"
+		"uniform mat4 transform;\n"
+		"uniform float tile_size;\n"
+		"attribute vec2 position;\n"
+		"attribute vec2 center;\n"
+		"attribute float reach;\n"
+		"attribute vec4 color;\n"
+		"varying vec2 v_offset;\n"
+		"varying float v_reach;\n"
+		"varying vec3 v_color;\n"
+		"void main() {\n"
+		"	v_offset = (position - center) / tile_size;\n"
+		"	v_reach = reach;\n"
+		"	v_color = color.rgb;\n"
+		"	gl_Position = transform * vec4(position, 0.0, 1.0);\n"
+		"}\n";
+
+	const char* const LightFragmentSource =
+		"#version 120\n"
+		"varying vec2 v_offset;\n"
+		"varying float v_reach;\n"
+		"varying vec3 v_color;\n"
+		"void main() {\n"
+		"	float intensity = min((v_reach - length(v_offset)) * 0.2, 1.0);\n"
+		"	if(intensity < 0.01) {\n"
+		"		discard;\n"
+		"	}\n"
+		"	gl_FragColor = vec4(v_color * intensity, 0.0);\n"
+		"}\n";
+
+	// The light map covers the viewport, so the clip coordinates are its
+	// texture coordinates
+	const char* const BlendVertexSource =
+		"#version 120\n"
+		"uniform mat4 transform;\n"
+		"attribute vec2 position;\n"
+		"varying vec2 v_texcoord;\n"
+		"void main() {\n"
+		"	gl_Position = transform * vec4(position, 0.0, 1.0);\n"
+		"	v_texcoord = gl_Position.xy * 0.5 + 0.5;\n"
+		"}\n";
+
+	const char* const BlendFragmentSource =
+		"#version 120\n"
+		"uniform sampler2D lights;\n"
+		"varying vec2 v_texcoord;\n"
+		"void main() {\n"
+		"	gl_FragColor = texture2D(lights, v_texcoord);\n"
+		"}\n";
+
+	GLuint compileShader(GLenum type, const char* source)
+	{
+		const GLuint shader = gl.CreateShader(type);
+		if(shader == 0) {
+			return 0;
+		}
+
+		gl.ShaderSource(shader, 1, &source, nullptr);
+		gl.CompileShader(shader);
+
+		GLint status = 0;
+		gl.GetShaderiv(shader, CompileStatus, &status);
+		if(status == 0) {
+			gl.DeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+
+	GLuint linkLightProgram(const char* vertex_source, const char* fragment_source)
+	{
+		const GLuint vertex_shader = compileShader(VertexShader, vertex_source);
+		const GLuint fragment_shader = compileShader(FragmentShader, fragment_source);
+		GLuint program = 0;
+		if(vertex_shader != 0 && fragment_shader != 0) {
+			program = gl.CreateProgram();
+		}
+
+		if(program != 0) {
+			gl.AttachShader(program, vertex_shader);
+			gl.AttachShader(program, fragment_shader);
+			gl.BindAttribLocation(program, LIGHT_ATTRIBUTE_POSITION, "position");
+			gl.BindAttribLocation(program, LIGHT_ATTRIBUTE_CENTER, "center");
+			gl.BindAttribLocation(program, LIGHT_ATTRIBUTE_REACH, "reach");
+			gl.BindAttribLocation(program, LIGHT_ATTRIBUTE_COLOR, "color");
+			gl.LinkProgram(program);
+
+			GLint status = 0;
+			gl.GetProgramiv(program, LinkStatus, &status);
+			if(status == 0) {
+				gl.DeleteProgram(program);
+				program = 0;
+			}
+		}
+
+		if(vertex_shader != 0) {
+			gl.DeleteShader(vertex_shader);
+		}
+		if(fragment_shader != 0) {
+			gl.DeleteShader(fragment_shader);
+		}
+		return program;
+	}
+}
+
+ShaderRenderer::ShaderRenderer() :
+	loaded(false),
+	failed(false),
+	textured(true),
+	program(0),
+	vertex_array(0),
+	vertex_buffer(0),
+	index_buffer(0),
+	index_quads(0),
+	vertex_capacity(0),
+	transform_location(-1),
+	sampler_location(-1),
+	textured_location(-1),
+	bound_textured(-1)
+{
+	////
+}
+
+ShaderRenderer::~ShaderRenderer()
+{
+	clear();
+}
+
+bool ShaderRenderer::load()
+{
+	if(loaded) {
+		return true;
+	}
+	if(failed || !loadFunctions()) {
+		failed = true;
+		return false;
+	}
+
+	const GLuint vertex_shader = compileShader(VertexShader, VertexSource);
+	const GLuint fragment_shader = compileShader(FragmentShader, FragmentSource);
+	if(vertex_shader != 0 && fragment_shader != 0) {
+		program = gl.CreateProgram();
+	}
+
+	if(program != 0) {
+		gl.AttachShader(program, vertex_shader);
+		gl.AttachShader(program, fragment_shader);
+		gl.BindAttribLocation(program, ATTRIBUTE_POSITION, "position");
+		gl.BindAttribLocation(program, ATTRIBUTE_TEXCOORD, "texcoord");
+		gl.BindAttribLocation(program, ATTRIBUTE_COLOR, "color");
+		gl.LinkProgram(program);
+
+		GLint status = 0;
+		gl.GetProgramiv(program, LinkStatus, &status);
+		if(status == 0) {
+			gl.DeleteProgram(program);
+			program = 0;
+		}
+	}
+
+	// The program keeps them alive while it's attached to them
+	if(vertex_shader != 0) {
+		gl.DeleteShader(vertex_shader);
+	}
+	if(fragment_shader != 0) {
+		gl.DeleteShader(fragment_shader);
+	}
+
+	if(program == 0) {
+		failed = true;
+		return false;
+	}
+
+	transform_location = gl.GetUniformLocation(program, "transform");
+	sampler_location = gl.GetUniformLocation(program, "sprite");
+	textured_location = gl.GetUniformLocation(program, "textured");
+
+	gl.GenBuffers(1, &vertex_buffer);
+	gl.GenBuffers(1, &index_buffer);
+
+	// The layout of the buffers is recorded once when vertex arrays are available
+	if(gl.GenVertexArrays) {
+		gl.GenVertexArrays(1, &vertex_array);
+		gl.BindVertexArray(vertex_array);
+		gl.BindBuffer(ArrayBuffer, vertex_buffer);
+		gl.BindBuffer(ElementArrayBuffer, index_buffer);
+		gl.EnableVertexAttribArray(ATTRIBUTE_POSITION);
+		gl.EnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+		gl.EnableVertexAttribArray(ATTRIBUTE_COLOR);
+		gl.VertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, VertexSize, reinterpret_cast<const void*>(0));
+		gl.VertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, VertexSize, reinterpret_cast<const void*>(2 * sizeof(float)));
+		gl.VertexAttribPointer(ATTRIBUTE_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, VertexSize, reinterpret_cast<const void*>(4 * sizeof(float)));
+		gl.BindVertexArray(0);
+		gl.BindBuffer(ArrayBuffer, 0);
+		gl.BindBuffer(ElementArrayBuffer, 0);
+	}
+
+	loaded = true;
+	return true;
+}
+
+void ShaderRenderer::clear()
+{
+	if(!loaded) {
+		return;
+	}
+
+	if(vertex_array != 0) {
+		gl.DeleteVertexArrays(1, &vertex_array);
+	}
+	gl.DeleteBuffers(1, &vertex_buffer);
+	gl.DeleteBuffers(1, &index_buffer);
+	gl.DeleteProgram(program);
+
+	program = 0;
+	vertex_array = 0;
+	vertex_buffer = 0;
+	index_buffer = 0;
+	index_quads = 0;
+	vertex_capacity = 0;
+	loaded = false;
+}
+
+bool ShaderRenderer::reserveIndices(size_t quads)
+{
+	if(quads <= index_quads) {
+		return true;
+	}
+	if(quads * 4 > std::numeric_limits<uint32_t>::max()) {
+		return false;
+	}
+
+	size_t capacity = std::max<size_t>(index_quads, 0x4000);
+	while(capacity < quads) {
+		capacity *= 2;
+	}
+
+	std::vector<uint32_t> indices(capacity * 6);
+	for(size_t quad = 0; quad < capacity; ++quad) {
+		const uint32_t first = static_cast<uint32_t>(quad * 4);
+		uint32_t* index = &indices[quad * 6];
+		index[0] = first;
+		index[1] = first + 1;
+		index[2] = first + 2;
+		index[3] = first;
+		index[4] = first + 2;
+		index[5] = first + 3;
+	}
+	gl.BufferData(ElementArrayBuffer, static_cast<ptrdiff_t>(indices.size() * sizeof(uint32_t)), indices.data(), StaticDraw);
+	index_quads = capacity;
+	return true;
+}
+
+void ShaderRenderer::begin(const void* vertices, size_t count, bool texturing)
+{
+	textured = texturing;
+	bound_textured = -1;
+
+	GLfloat transform[16];
+	currentTransform(transform);
+
+	gl.UseProgram(program);
+	gl.UniformMatrix4fv(transform_location, 1, GL_FALSE, transform);
+	gl.Uniform1i(sampler_location, 0);
+
+	if(vertex_array != 0) {
+		gl.BindVertexArray(vertex_array);
+	} else {
+		gl.BindBuffer(ArrayBuffer, vertex_buffer);
+		gl.BindBuffer(ElementArrayBuffer, index_buffer);
+		gl.EnableVertexAttribArray(ATTRIBUTE_POSITION);
+		gl.EnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+		gl.EnableVertexAttribArray(ATTRIBUTE_COLOR);
+		gl.VertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, VertexSize, reinterpret_cast<const void*>(0));
+		gl.VertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, VertexSize, reinterpret_cast<const void*>(2 * sizeof(float)));
+		gl.VertexAttribPointer(ATTRIBUTE_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, VertexSize, reinterpret_cast<const void*>(4 * sizeof(float)));
+	}
+	// The vertex array object doesn't hold the array buffer binding
+	gl.BindBuffer(ArrayBuffer, vertex_buffer);
+
+	// A new store every flush, so the driver doesn't wait for the last draw to finish with it
+	const ptrdiff_t bytes = static_cast<ptrdiff_t>(count * VertexSize);
+	vertex_capacity = std::max(vertex_capacity, count);
+	gl.BufferData(ArrayBuffer, static_cast<ptrdiff_t>(vertex_capacity * VertexSize), nullptr, StreamDraw);
+	gl.BufferSubData(ArrayBuffer, 0, bytes, vertices);
+
+	if(!reserveIndices(count / 4)) {
+		index_quads = 0;
+	}
+}
+
+void ShaderRenderer::draw(GLuint texture, GLint first, GLsizei count)
+{
+	if(static_cast<size_t>(first + count) / 4 > index_quads) {
+		return;
+	}
+
+	const GLint use_texture = (texture != 0 && textured) ? 1 : 0;
+	if(use_texture != bound_textured) {
+		gl.Uniform1i(textured_location, use_texture);
+		bound_textured = use_texture;
+	}
+	if(use_texture) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		g_profiler.count(FrameProfiler::COUNTER_TEXTURE_BINDS);
+	}
+
+	const size_t offset = static_cast<size_t>(first / 4) * 6 * sizeof(uint32_t);
+	glDrawElements(GL_TRIANGLES, (count / 4) * 6, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset));
+}
+
+void ShaderRenderer::end()
+{
+	if(vertex_array != 0) {
+		gl.BindVertexArray(0);
+	} else {
+		gl.DisableVertexAttribArray(ATTRIBUTE_POSITION);
+		gl.DisableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+		gl.DisableVertexAttribArray(ATTRIBUTE_COLOR);
+		gl.BindBuffer(ElementArrayBuffer, 0);
+	}
+	// The fixed function path draws from client memory, which needs no buffer bound
+	gl.BindBuffer(ArrayBuffer, 0);
+	gl.UseProgram(0);
+}
+
+ShaderLightRenderer::ShaderLightRenderer() :
+	loaded(false),
+	failed(false),
+	light_program(0),
+	blend_program(0),
+	vertex_buffer(0),
+	frame_buffer(0),
+	target(0),
+	target_width(0),
+	target_height(0),
+	light_transform_location(-1),
+	light_tile_size_location(-1),
+	blend_transform_location(-1),
+	blend_sampler_location(-1)
+{
+	////
+}
+
+ShaderLightRenderer::~ShaderLightRenderer()
+{
+	clear();
+}
+
+bool ShaderLightRenderer::load()
+{
+	if(loaded) {
+		return true;
+	}
+	if(failed || !loadLightFunctions()) {
+		failed = true;
+		return false;
+	}
+
+	light_program = linkLightProgram(LightVertexSource, LightFragmentSource);
+	blend_program = linkLightProgram(BlendVertexSource, BlendFragmentSource);
+	if(light_program == 0 || blend_program == 0) {
+		if(light_program != 0) {
+			gl.DeleteProgram(light_program);
+		}
+		if(blend_program != 0) {
+			gl.DeleteProgram(blend_program);
+		}
+		light_program = 0;
+		blend_program = 0;
+		failed = true;
+		return false;
+	}
+
+	light_transform_location = gl.GetUniformLocation(light_program, "transform");
+	light_tile_size_location = gl.GetUniformLocation(light_program, "tile_size");
+	blend_transform_location = gl.GetUniformLocation(blend_program, "transform");
+	blend_sampler_location = gl.GetUniformLocation(blend_program, "lights");
+
+	gl.GenBuffers(1, &vertex_buffer);
+	gl.GenFramebuffers(1, &frame_buffer);
+	glGenTextures(1, &target);
+
+	loaded = true;
+	return true;
+}
+
+void ShaderLightRenderer::clear()
+{
+	if(!loaded) {
+		return;
+	}
+
+	gl.DeleteBuffers(1, &vertex_buffer);
+	gl.DeleteFramebuffers(1, &frame_buffer);
+	glDeleteTextures(1, &target);
+	gl.DeleteProgram(light_program);
+	gl.DeleteProgram(blend_program);
+
+	light_program = 0;
+	blend_program = 0;
+	vertex_buffer = 0;
+	frame_buffer = 0;
+	target = 0;
+	target_width = 0;
+	target_height = 0;
+	loaded = false;
+}
+
+bool ShaderLightRenderer::reserveTarget(GLsizei width, GLsizei height)
+{
+	if(width == target_width && height == target_height) {
+		return true;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, target);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, ClampToEdge);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, ClampToEdge);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previous = 0;
+	glGetIntegerv(FramebufferBinding, &previous);
+	gl.BindFramebuffer(Framebuffer, frame_buffer);
+	gl.FramebufferTexture2D(Framebuffer, ColorAttachment0, GL_TEXTURE_2D, target, 0);
+	const bool complete = gl.CheckFramebufferStatus(Framebuffer) == FramebufferComplete;
+	gl.BindFramebuffer(Framebuffer, static_cast<GLuint>(previous));
+
+	if(!complete) {
+		// Won't get any better with another size
+		failed = true;
+		return false;
+	}
+
+	target_width = width;
+	target_height = height;
+	return true;
+}
+
+bool ShaderLightRenderer::draw(const std::vector<Vertex>& vertices, const wxColor& global, float x, float y, float width, float height, float tile_size)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if(failed || viewport[2] <= 0 || viewport[3] <= 0 || !reserveTarget(viewport[2], viewport[3])) {
+		return false;
+	}
+
+	// The lights first, then the box the light map is multiplied over
+	const Vertex box[4] = {
+		{ x, y, 0.f, 0.f, 0.f, 0, 0, 0, 0 },
+		{ x + width, y, 0.f, 0.f, 0.f, 0, 0, 0, 0 },
+		{ x + width, y + height, 0.f, 0.f, 0.f, 0, 0, 0, 0 },
+		{ x, y + height, 0.f, 0.f, 0.f, 0, 0, 0, 0 },
+	};
+	const GLsizei count = static_cast<GLsizei>(vertices.size());
+	gl.BindBuffer(ArrayBuffer, vertex_buffer);
+	gl.BufferData(ArrayBuffer, static_cast<ptrdiff_t>((vertices.size() + 4) * sizeof(Vertex)), nullptr, StreamDraw);
+	if(count > 0) {
+		gl.BufferSubData(ArrayBuffer, 0, static_cast<ptrdiff_t>(vertices.size() * sizeof(Vertex)), vertices.data());
+	}
+	gl.BufferSubData(ArrayBuffer, static_cast<ptrdiff_t>(vertices.size() * sizeof(Vertex)), sizeof(box), box);
+
+	gl.EnableVertexAttribArray(LIGHT_ATTRIBUTE_POSITION);
+	gl.EnableVertexAttribArray(LIGHT_ATTRIBUTE_CENTER);
+	gl.EnableVertexAttribArray(LIGHT_ATTRIBUTE_REACH);
+	gl.EnableVertexAttribArray(LIGHT_ATTRIBUTE_COLOR);
+	gl.VertexAttribPointer(LIGHT_ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, x)));
+	gl.VertexAttribPointer(LIGHT_ATTRIBUTE_CENTER, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, center_x)));
+	gl.VertexAttribPointer(LIGHT_ATTRIBUTE_REACH, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, reach)));
+	gl.VertexAttribPointer(LIGHT_ATTRIBUTE_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), reinterpret_cast<const void*>(offsetof(Vertex, red)));
+
+	GLfloat transform[16];
+	currentTransform(transform);
+
+	GLint previous_frame_buffer = 0;
+	glGetIntegerv(FramebufferBinding, &previous_frame_buffer);
+	GLfloat previous_clear[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, previous_clear);
+
+	gl.BindFramebuffer(Framebuffer, frame_buffer);
+	glClearColor(global.Red() / 255.f, global.Green() / 255.f, global.Blue() / 255.f, global.Alpha() / 255.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(previous_clear[0], previous_clear[1], previous_clear[2], previous_clear[3]);
+
+	if(count > 0) {
+		// Every pixel keeps the brightest light, the alpha of the global light stays
+		gl.UseProgram(light_program);
+		gl.UniformMatrix4fv(light_transform_location, 1, GL_FALSE, transform);
+		gl.Uniform1f(light_tile_size_location, tile_size);
+		gl.BlendEquation(BlendMax);
+		glDrawArrays(GL_QUADS, 0, count);
+		gl.BlendEquation(FuncAdd);
+		g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS);
+	}
+	gl.BindFramebuffer(Framebuffer, static_cast<GLuint>(previous_frame_buffer));
+
+	gl.UseProgram(blend_program);
+	gl.UniformMatrix4fv(blend_transform_location, 1, GL_FALSE, transform);
+	gl.Uniform1i(blend_sampler_location, 0);
+	glBindTexture(GL_TEXTURE_2D, target);
+	glBlendFunc(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_QUADS, count, 4);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	g_profiler.count(FrameProfiler::COUNTER_TEXTURE_BINDS);
+	g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS);
+
+	gl.DisableVertexAttribArray(LIGHT_ATTRIBUTE_POSITION);
+	gl.DisableVertexAttribArray(LIGHT_ATTRIBUTE_CENTER);
+	gl.DisableVertexAttribArray(LIGHT_ATTRIBUTE_REACH);
+	gl.DisableVertexAttribArray(LIGHT_ATTRIBUTE_COLOR);
+	gl.BindBuffer(ArrayBuffer, 0);
+	gl.UseProgram(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return true;
+}
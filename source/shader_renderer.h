@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SHADER_RENDERER_H_
+#define RME_SHADER_RENDERER_H_
+
+// Config::RENDER_BACKEND
+enum RenderBackend {
+	RENDER_BACKEND_FIXED_FUNCTION = 0,
+	RENDER_BACKEND_SHADERS = 1,
+};
+
+// Draws the quads of a sprite batch through a shader program, from a vertex
+// buffer streamed once per flush and a static index buffer splitting every quad
+// in two triangles. The GL 2.0 entry points are looked up at runtime the first
+// time it's loaded, without them the batch keeps its fixed function path.
+//
+// Matrices and blending still come from the fixed function state the map
+// drawer sets up, so both paths draw the same picture.
+class ShaderRenderer
+{
+public:
+	ShaderRenderer();
+	~ShaderRenderer();
+
+	ShaderRenderer(const ShaderRenderer&) = delete;
+	ShaderRenderer& operator=(const ShaderRenderer&) = delete;
+
+	// Compiles the program the first time, false if the driver can't run it.
+	// The shared GL context must be current.
+	bool load();
+	void clear();
+
+	// Vertices are two floats of position, two of texture coordinates and four
+	// bytes of colour, quads of four vertices in drawing order
+	static constexpr size_t VertexSize = 4 * sizeof(float) + 4;
+
+	// Uploads the vertices of a batch and binds the program, textured runs are
+	// drawn untextured if texturing is false
+	void begin(const void* vertices, size_t count, bool texturing);
+	// A texture of 0 draws the run untextured
+	void draw(GLuint texture, GLint first, GLsizei count);
+	void end();
+
+private:
+	bool reserveIndices(size_t quads);
+
+	bool loaded;
+	bool failed;
+	bool textured;
+
+	GLuint program;
+	GLuint vertex_array;
+	GLuint vertex_buffer;
+	GLuint index_buffer;
+	size_t index_quads;
+	size_t vertex_capacity;
+
+	GLint transform_location;
+	GLint sampler_location;
+	GLint textured_location;
+	GLint bound_textured;
+};
+
+// The light map of LightDrawer on the GPU. Every light is a quad drawn into a
+// frame buffer of the size of the view, cleared to the global light, and each
+// pixel keeps the brightest light reaching it, worked out from its own
+// distance to the light rather than per square. The frame buffer is then
+// multiplied over the map the same way as the light texture of the CPU path.
+// Needs frame buffer objects besides OpenGL 2.0.
+class ShaderLightRenderer
+{
+public:
+	ShaderLightRenderer();
+	~ShaderLightRenderer();
+
+	ShaderLightRenderer(const ShaderLightRenderer&) = delete;
+	ShaderLightRenderer& operator=(const ShaderLightRenderer&) = delete;
+
+	bool load();
+	void clear();
+
+	// Corners of the quad of a light, in the coordinates of the map drawer,
+	// four per light in drawing order
+	struct Vertex {
+		float x, y;
+		float center_x, center_y;
+		float reach; // Intensity of the light, in squares
+		uint8_t red, green, blue, alpha;
+	};
+
+	// Lights the box from x, y of width and height, distances are divided by
+	// tile_size to get squares. False if the driver can't, the light map has to
+	// be drawn another way then
+	bool draw(const std::vector<Vertex>& vertices, const wxColor& global, float x, float y, float width, float height, float tile_size);
+
+private:
+	bool reserveTarget(GLsizei width, GLsizei height);
+
+	bool loaded;
+	bool failed;
+
+	GLuint light_program;
+	GLuint blend_program;
+	GLuint vertex_buffer;
+	GLuint frame_buffer;
+	GLuint target;
+	GLsizei target_width;
+	GLsizei target_height;
+
+	GLint light_transform_location;
+	GLint light_tile_size_location;
+	GLint blend_transform_location;
+	GLint blend_sampler_location;
+};
+
+#endif
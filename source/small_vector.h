@@ -0,0 +1,224 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SMALL_VECTOR_H_
+#define RME_SMALL_VECTOR_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+// Vector of trivially copyable values that keeps up to InlineCapacity of them
+// inside the object and only allocates once it grows past that. Iterators are
+// plain pointers, invalidated like std::vector's, and moving the vector itself
+// also invalidates them while the values are inline.
+template <class T, size_t InlineCapacity>
+class SmallVector {
+	static_assert(std::is_trivially_copyable<T>::value, "SmallVector only holds trivially copyable values");
+	static_assert(InlineCapacity > 0, "SmallVector needs room for at least one inline value");
+public:
+	using value_type = T;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+	using reference = T&;
+	using const_reference = const T&;
+	using pointer = T*;
+	using const_pointer = const T*;
+	using iterator = T*;
+	using const_iterator = const T*;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	SmallVector() noexcept : count(0), capacity_(InlineCapacity) {}
+	SmallVector(const SmallVector& other) : SmallVector() {
+		assign(other.begin(), other.end());
+	}
+	SmallVector(SmallVector&& other) noexcept : SmallVector() {
+		steal(other);
+	}
+	~SmallVector() {
+		if(!isInline()) {
+			std::free(heap);
+		}
+	}
+
+	SmallVector& operator=(const SmallVector& other) {
+		if(this != &other) {
+			assign(other.begin(), other.end());
+		}
+		return *this;
+	}
+	SmallVector& operator=(SmallVector&& other) noexcept {
+		if(this != &other) {
+			if(!isInline()) {
+				std::free(heap);
+			}
+			count = 0;
+			capacity_ = InlineCapacity;
+			steal(other);
+		}
+		return *this;
+	}
+
+	template <class InputIt>
+	void assign(InputIt first, InputIt last) {
+		clear();
+		insert(end(), first, last);
+	}
+
+	iterator begin() noexcept { return data(); }
+	const_iterator begin() const noexcept { return data(); }
+	const_iterator cbegin() const noexcept { return data(); }
+	iterator end() noexcept { return data() + count; }
+	const_iterator end() const noexcept { return data() + count; }
+	const_iterator cend() const noexcept { return data() + count; }
+	reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+	const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+	reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+	const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+
+	bool empty() const noexcept { return count == 0; }
+	size_type size() const noexcept { return count; }
+	size_type capacity() const noexcept { return capacity_; }
+	// Bytes allocated outside of the object
+	size_type heapsize() const noexcept { return isInline() ? 0 : capacity_ * sizeof(T); }
+
+	T* data() noexcept { return isInline() ? local : heap; }
+	const T* data() const noexcept { return isInline() ? local : heap; }
+
+	reference operator[](size_type index) { return data()[index]; }
+	const_reference operator[](size_type index) const { return data()[index]; }
+	reference at(size_type index) {
+		if(index >= count) {
+			throw std::out_of_range("SmallVector::at");
+		}
+		return data()[index];
+	}
+	const_reference at(size_type index) const {
+		if(index >= count) {
+			throw std::out_of_range("SmallVector::at");
+		}
+		return data()[index];
+	}
+	reference front() { return data()[0]; }
+	const_reference front() const { return data()[0]; }
+	reference back() { return data()[count - 1]; }
+	const_reference back() const { return data()[count - 1]; }
+
+	void reserve(size_type wanted) {
+		if(wanted > capacity_) {
+			grow(wanted);
+		}
+	}
+
+	void clear() noexcept { count = 0; }
+
+	void push_back(const T& value) {
+		if(count == capacity_) {
+			// The value may live in this vector, so copy it before growing
+			T copy = value;
+			grow(count + 1);
+			data()[count++] = copy;
+			return;
+		}
+		data()[count++] = value;
+	}
+	void pop_back() { --count; }
+
+	iterator insert(const_iterator position, const T& value) {
+		const size_type index = position - begin();
+		T copy = value;
+		if(count == capacity_) {
+			grow(count + 1);
+		}
+		T* values = data();
+		std::memmove(values + index + 1, values + index, (count - index) * sizeof(T));
+		values[index] = copy;
+		++count;
+		return values + index;
+	}
+	template <class InputIt>
+	iterator insert(const_iterator position, InputIt first, InputIt last) {
+		const size_type index = position - begin();
+		const size_type added = std::distance(first, last);
+		if(count + added > capacity_) {
+			grow(count + added);
+		}
+		T* values = data();
+		std::memmove(values + index + added, values + index, (count - index) * sizeof(T));
+		std::copy(first, last, values + index);
+		count += static_cast<uint32_t>(added);
+		return values + index;
+	}
+
+	iterator erase(const_iterator position) {
+		return erase(position, position + 1);
+	}
+	iterator erase(const_iterator first, const_iterator last) {
+		T* values = data();
+		const size_type index = first - values;
+		const size_type removed = last - first;
+		std::memmove(values + index, values + index + removed, (count - index - removed) * sizeof(T));
+		count -= static_cast<uint32_t>(removed);
+		return values + index;
+	}
+
+private:
+	bool isInline() const noexcept { return capacity_ == InlineCapacity; }
+
+	void grow(size_type wanted) {
+		const size_type grown = std::max<size_type>(wanted, capacity_ * 2);
+		T* values = static_cast<T*>(std::malloc(grown * sizeof(T)));
+		if(!values) {
+			throw std::bad_alloc();
+		}
+		std::memcpy(values, data(), count * sizeof(T));
+		if(!isInline()) {
+			std::free(heap);
+		}
+		heap = values;
+		capacity_ = static_cast<uint32_t>(grown);
+	}
+
+	// Takes over the values of other, which is left empty and inline
+	void steal(SmallVector& other) noexcept {
+		if(other.isInline()) {
+			std::memcpy(local, other.local, other.count * sizeof(T));
+		} else {
+			heap = other.heap;
+			capacity_ = other.capacity_;
+		}
+		count = other.count;
+		other.count = 0;
+		other.capacity_ = InlineCapacity;
+	}
+
+	uint32_t count;
+	uint32_t capacity_;
+	union {
+		T local[InlineCapacity];
+		T* heap;
+	};
+};
+
+#endif
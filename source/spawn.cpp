@@ -38,24 +38,129 @@ void Spawns::addSpawn(Tile* tile)
 {
 	ASSERT(tile->spawn);
 
-	auto it = spawns.insert(tile->getPosition());
+	auto it = spawns.insert(packPosition(tile->getPosition()));
 	ASSERT(it.second);
+	if(it.second) {
+		const Position& pos = tile->getPosition();
+		const int radius = tile->spawn->getSize();
+		cells[cellKey(pos.x >> CELL_SHIFT, pos.y >> CELL_SHIFT, pos.z)].push_back({pos, radius});
+		max_radius = std::max(max_radius, radius);
+	}
 }
 
 void Spawns::removeSpawn(Tile* tile) {
 	ASSERT(tile->spawn);
-	spawns.erase(tile->getPosition());
-#if 0
-	SpawnPositionList::iterator iter = begin();
-	while(iter != end()) {
-		if(*iter == tile->getPosition()) {
-			spawns.erase(iter);
-			return;
+	if(spawns.erase(packPosition(tile->getPosition())) != 0) {
+		unindex(tile->getPosition());
+	}
+}
+
+std::vector<Position> Spawns::getSpawnPositions() const
+{
+	std::vector<PositionKey> keys(spawns.begin(), spawns.end());
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Position> positions;
+	positions.reserve(keys.size());
+	for(PositionKey key : keys) {
+		positions.push_back(unpackPosition(key));
+	}
+	return positions;
+}
+
+void Spawns::unindex(const Position& center)
+{
+	auto cell = cells.find(cellKey(center.x >> CELL_SHIFT, center.y >> CELL_SHIFT, center.z));
+	if(cell == cells.end()) {
+		return;
+	}
+
+	std::vector<IndexEntry>& entries = cell->second;
+	auto it = std::find_if(entries.begin(), entries.end(), [&center](const IndexEntry& entry) {
+		return entry.center == center;
+	});
+	if(it != entries.end()) {
+		*it = entries.back();
+		entries.pop_back();
+	}
+	if(entries.empty()) {
+		cells.erase(cell);
+	}
+	// The largest radius only shrinks once there are no spawns left
+	if(spawns.empty()) {
+		max_radius = 0;
+	}
+}
+
+std::vector<Position> Spawns::getSpawnsCovering(const Position& position) const
+{
+	std::vector<Position> found = getSpawnsInArea(position.x, position.y, position.x, position.y, position.z);
+	std::sort(found.begin(), found.end(), [&position](const Position& a, const Position& b) {
+		const int distance_a = std::max(std::abs(a.x - position.x), std::abs(a.y - position.y));
+		const int distance_b = std::max(std::abs(b.x - position.x), std::abs(b.y - position.y));
+		return distance_a < distance_b || (distance_a == distance_b && a < b);
+	});
+	return found;
+}
+
+std::vector<Position> Spawns::getSpawnsInArea(int start_x, int start_y, int end_x, int end_y, int z) const
+{
+	std::vector<Position> found;
+	if(cells.empty()) {
+		return found;
+	}
+
+	const int start_cell_x = std::max(start_x - max_radius, 0) >> CELL_SHIFT;
+	const int start_cell_y = std::max(start_y - max_radius, 0) >> CELL_SHIFT;
+	const int end_cell_x = std::max(end_x + max_radius, 0) >> CELL_SHIFT;
+	const int end_cell_y = std::max(end_y + max_radius, 0) >> CELL_SHIFT;
+	for(int cell_y = start_cell_y; cell_y <= end_cell_y; ++cell_y) {
+		for(int cell_x = start_cell_x; cell_x <= end_cell_x; ++cell_x) {
+			auto cell = cells.find(cellKey(cell_x, cell_y, z));
+			if(cell == cells.end()) {
+				continue;
+			}
+			for(const IndexEntry& entry : cell->second) {
+				const Position& center = entry.center;
+				if(center.x + entry.radius >= start_x && center.x - entry.radius <= end_x &&
+					center.y + entry.radius >= start_y && center.y - entry.radius <= end_y) {
+					found.push_back(center);
+				}
+			}
+		}
+	}
+	return found;
+}
+
+std::vector<Position> Spawns::getCreaturesInArea(int start_x, int start_y, int end_x, int end_y, int z) const
+{
+	std::vector<Position> found;
+	collectCreatures(start_x, start_y, end_x, end_y, z, found);
+	return found;
+}
+
+std::vector<Position> Spawns::getCreaturesInArea(const Position& start, const Position& end) const
+{
+	std::vector<Position> found;
+	for(int z = std::max(start.z, 0); z <= std::min(end.z, rme::MapMaxLayer); ++z) {
+		collectCreatures(start.x, start.y, end.x, end.y, z, found);
+	}
+	return found;
+}
+
+void Spawns::collectCreatures(int start_x, int start_y, int end_x, int end_y, int z, std::vector<Position>& found) const
+{
+	// Keys sort by floor, row and column, so every row is a range of the set
+	start_x = std::max(start_x, 0);
+	if(end_x < start_x) {
+		return;
+	}
+	for(int y = std::max(start_y, 0); y <= end_y && !creatures.empty(); ++y) {
+		const PositionKey last = packPosition(Position(end_x, y, z));
+		for(auto it = creatures.lower_bound(packPosition(Position(start_x, y, z))); it != creatures.end() && *it <= last; ++it) {
+			found.push_back(unpackPosition(*it));
 		}
-		++iter;
 	}
-	ASSERT(false);
-#endif
 }
 
 std::ostream& operator<<(std::ostream& os, const Spawn& spawn) {
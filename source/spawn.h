@@ -18,6 +18,9 @@
 #ifndef RME_SPAWN_H_
 #define RME_SPAWN_H_
 
+#include <unordered_map>
+#include <unordered_set>
+
 class Tile;
 
 class Spawn
@@ -46,24 +49,53 @@ protected:
 	bool selected;
 };
 
-typedef std::set<Position> SpawnPositionList;
 typedef std::list<Spawn*> SpawnList;
 
 class Spawns
 {
 public:
+	Spawns() : max_radius(0) {}
+
 	void addSpawn(Tile* tile);
 	void removeSpawn(Tile* tile);
 
-	SpawnPositionList::iterator begin() noexcept { return spawns.begin(); }
-	SpawnPositionList::const_iterator begin() const noexcept { return spawns.begin(); }
-	SpawnPositionList::iterator end() noexcept { return spawns.end(); }
-	SpawnPositionList::const_iterator end() const noexcept { return spawns.end(); }
-	void erase(SpawnPositionList::iterator iter) noexcept { spawns.erase(iter); }
-	SpawnPositionList::iterator find(Position& pos) { return spawns.find(pos); }
+	// Centres of every spawn, sorted like positions so saves come out the same
+	std::vector<Position> getSpawnPositions() const;
+
+	// Centres of the spawns whose radius covers the position, nearest first
+	std::vector<Position> getSpawnsCovering(const Position& position) const;
+	// Centres of the spawns whose radius overlaps the area on floor z
+	std::vector<Position> getSpawnsInArea(int start_x, int start_y, int end_x, int end_y, int z) const;
+
+	// The tiles of the map holding a creature, kept by the map as tiles come and go, so a spawn
+	// finds the creatures within its radius without looking at every tile of it
+	void addCreature(const Position& position) { creatures.insert(packPosition(position)); }
+	void removeCreature(const Position& position) { creatures.erase(packPosition(position)); }
+	size_t getCreatureCount() const noexcept { return creatures.size(); }
+	// Row by row, as they are within the area on floor z
+	std::vector<Position> getCreaturesInArea(int start_x, int start_y, int end_x, int end_y, int z) const;
+	// Floor by floor from start.z to end.z, for areas spanning several floors
+	std::vector<Position> getCreaturesInArea(const Position& start, const Position& end) const;
 
 private:
-	SpawnPositionList spawns;
+	// The spawns are also kept in a grid of cells keyed by their centre, a
+	// query looks at the cells within the largest radius around it
+	struct IndexEntry {
+		Position center;
+		int radius;
+	};
+	static const int CELL_SHIFT = 4;
+	static uint64_t cellKey(int cell_x, int cell_y, int z) noexcept {
+		return (uint64_t(uint32_t(cell_x)) << 24) | (uint64_t(uint32_t(cell_y)) << 4) | uint64_t(z & 0xF);
+	}
+	void unindex(const Position& center);
+	void collectCreatures(int start_x, int start_y, int end_x, int end_y, int z, std::vector<Position>& found) const;
+
+	std::unordered_set<PositionKey> spawns;
+	// Ordered, so every row of an area is a range of keys
+	std::set<PositionKey> creatures;
+	std::unordered_map<uint64_t, std::vector<IndexEntry>> cells;
+	int max_radius;
 };
 
 #endif
@@ -0,0 +1,150 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+#include "sprite_batch.h"
+#include "frame_profiler.h"
+#include "shader_renderer.h"
+
+SpriteBatch::SpriteBatch() :
+	renderer(nullptr)
+{
+	// A screen full of tiles at the lowest zoom, with a few items each
+	vertices.reserve(0x10000);
+	runs.reserve(0x400);
+}
+
+void SpriteBatch::add(GLuint texture, float x, float y, float width, float height,
+	uint8_t r, uint8_t g, uint8_t b, uint8_t a,
+	float u0, float v0, float u1, float v1)
+{
+	push(texture);
+	vertices.push_back(Vertex{ x, y, u0, v0, r, g, b, a });
+	vertices.push_back(Vertex{ x + width, y, u1, v0, r, g, b, a });
+	vertices.push_back(Vertex{ x + width, y + height, u1, v1, r, g, b, a });
+	vertices.push_back(Vertex{ x, y + height, u0, v1, r, g, b, a });
+}
+
+void SpriteBatch::addQuad(const float (&corners)[8], uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	push(0);
+	for (int i = 0; i < 8; i += 2) {
+		vertices.push_back(Vertex{ corners[i], corners[i + 1], 0.f, 0.f, r, g, b, a });
+	}
+}
+
+void SpriteBatch::push(GLuint texture)
+{
+	if (runs.empty() || runs.back().texture != texture) {
+		runs.push_back(Run{ texture, static_cast<GLint>(vertices.size()), 0 });
+	}
+	runs.back().count += 4;
+}
+
+void SpriteBatch::record(size_t from, Recording& recording) const
+{
+	recording.clear();
+	recording.vertices.assign(vertices.begin() + from, vertices.end());
+
+	for (const Run& run : runs) {
+		const size_t end = static_cast<size_t>(run.first + run.count);
+		if (end <= from) {
+			continue;
+		}
+		const size_t first = std::max(static_cast<size_t>(run.first), from);
+		recording.runs.push_back(Run{ run.texture, static_cast<GLint>(first - from), static_cast<GLsizei>(end - first) });
+	}
+}
+
+void SpriteBatch::replay(const Recording& recording, float offset_x, float offset_y)
+{
+	const GLint base = static_cast<GLint>(vertices.size());
+	for (const Run& run : recording.runs) {
+		if (!runs.empty() && runs.back().texture == run.texture && runs.back().first + runs.back().count == base + run.first) {
+			runs.back().count += run.count;
+		} else {
+			runs.push_back(Run{ run.texture, base + run.first, run.count });
+		}
+	}
+
+	for (Vertex vertex : recording.vertices) {
+		vertex.x += offset_x;
+		vertex.y += offset_y;
+		vertices.push_back(vertex);
+	}
+}
+
+void SpriteBatch::flush()
+{
+	if (vertices.empty()) {
+		return;
+	}
+
+	// Untextured runs switch texturing off, the caller's state is restored afterwards
+	const bool textured = glIsEnabled(GL_TEXTURE_2D) == GL_TRUE;
+
+	if (renderer) {
+		static_assert(sizeof(Vertex) == ShaderRenderer::VertexSize);
+		renderer->begin(vertices.data(), vertices.size(), textured);
+		for (const Run& run : runs) {
+			renderer->draw(run.texture, run.first, run.count);
+		}
+		renderer->end();
+		g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS, uint32_t(runs.size()));
+
+		vertices.clear();
+		runs.clear();
+		return;
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(Vertex), &vertices[0].x);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &vertices[0].u);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &vertices[0].r);
+
+	bool texture_enabled = textured;
+	for (const Run& run : runs) {
+		if (run.texture == 0) {
+			if (texture_enabled) {
+				glDisable(GL_TEXTURE_2D);
+				texture_enabled = false;
+			}
+		} else {
+			if (textured && !texture_enabled) {
+				glEnable(GL_TEXTURE_2D);
+				texture_enabled = true;
+			}
+			glBindTexture(GL_TEXTURE_2D, run.texture);
+			g_profiler.count(FrameProfiler::COUNTER_TEXTURE_BINDS);
+		}
+		glDrawArrays(GL_QUADS, run.first, run.count);
+	}
+	g_profiler.count(FrameProfiler::COUNTER_DRAW_CALLS, uint32_t(runs.size()));
+
+	if (texture_enabled != textured) {
+		glEnable(GL_TEXTURE_2D);
+	}
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	vertices.clear();
+	runs.clear();
+}
@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SPRITE_BATCH_H_
+#define RME_SPRITE_BATCH_H_
+
+#include "graphics.h"
+
+class ShaderRenderer;
+
+// Collects quads and draws them with a few vertex array calls instead of one
+// glBegin/glEnd pair each. Quads keep the order they were added in, consecutive
+// quads with the same texture are drawn with a single call.
+class SpriteBatch
+{
+	struct Vertex {
+		float x, y;
+		float u, v;
+		uint8_t r, g, b, a;
+	};
+
+	struct Run {
+		GLuint texture;
+		GLint first;
+		GLsizei count;
+	};
+
+public:
+	// Quads taken out of a batch, so they can be added again in later frames
+	class Recording
+	{
+	public:
+		bool empty() const noexcept { return vertices.empty(); }
+		void clear() noexcept { vertices.clear(); runs.clear(); }
+
+	private:
+		std::vector<Vertex> vertices;
+		std::vector<Run> runs;
+
+		friend class SpriteBatch;
+	};
+
+	SpriteBatch();
+
+	// A texture of 0 draws an untextured quad
+	void add(GLuint texture, float x, float y, float width, float height,
+		uint8_t r, uint8_t g, uint8_t b, uint8_t a,
+		float u0 = 0.f, float v0 = 0.f, float u1 = 1.f, float v1 = 1.f);
+	// Untextured quad with arbitrary corners, in drawing order
+	void addQuad(const float (&corners)[8], uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+	void flush();
+	bool empty() const noexcept { return vertices.empty(); }
+
+	// Flushes through the shader renderer instead of the fixed function
+	// pipeline, nullptr goes back to it
+	void setRenderer(ShaderRenderer* renderer) noexcept { this->renderer = renderer; }
+
+	// Position to record from, everything added after it ends up in the recording
+	size_t mark() const noexcept { return vertices.size(); }
+	void record(size_t from, Recording& recording) const;
+	// Adds the recorded quads again, moved by offset_x, offset_y
+	void replay(const Recording& recording, float offset_x, float offset_y);
+
+private:
+	void push(GLuint texture);
+
+	std::vector<Vertex> vertices;
+	std::vector<Run> runs;
+	ShaderRenderer* renderer;
+};
+
+#endif
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SPSC_QUEUE_H_
+#define RME_SPSC_QUEUE_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Fixed ring between one producer and one consumer thread, without locks.
+// The slots are never destroyed while the queue lives, so whatever a slot
+// owns (e.g. a message buffer) is handed back to the producer for reuse.
+template <class T, size_t Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+public:
+	SpscQueue() : slots(), head(0), tail(0) {}
+
+	// Producer: the slot to fill next, or nullptr if the consumer has not caught up
+	T* acquire() {
+		const size_t position = tail.load(std::memory_order_relaxed);
+		if(position - head.load(std::memory_order_acquire) == Capacity) {
+			return nullptr;
+		}
+		return &slots[position & (Capacity - 1)];
+	}
+	// Producer: hands the slot returned by acquire to the consumer
+	void publish() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: the oldest published slot, or nullptr if there is none
+	T* front() {
+		const size_t position = head.load(std::memory_order_relaxed);
+		if(position == tail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return &slots[position & (Capacity - 1)];
+	}
+	// Consumer: gives the slot returned by front back to the producer
+	void pop() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	// Only a hint when called from a thread that is neither the producer nor the consumer
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+private:
+	std::array<T, Capacity> slots;
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
+
+#endif
@@ -160,9 +160,9 @@ void TableBrush::draw(BaseMap* map, Tile* tile, void* parameter)
 }
 
 
-bool hasMatchingTableBrushAtTile(BaseMap* map, TableBrush* table_brush, uint32_t x, uint32_t y, uint32_t z)
+bool hasMatchingTableBrushAtTile(const TileNeighbourhood& around, TableBrush* table_brush, int dx, int dy)
 {
-	Tile* t = map->getTile(x, y, z);
+	Tile* t = around.getTile(dx, dy);
 	if(!t) return false;
 
 	ItemVector::const_iterator it = t->items.begin();
@@ -183,11 +183,7 @@ void TableBrush::doTables(BaseMap* map, Tile* tile)
 		return;
 	}
 
-	const Position& position = tile->getPosition();
-
-	int32_t x = position.x;
-	int32_t y = position.y;
-	int32_t z = position.z;
+	const TileNeighbourhood around(*map, tile->getPosition());
 
 	for(Item* item : tile->items) {
 		ASSERT(item);
@@ -198,45 +194,14 @@ void TableBrush::doTables(BaseMap* map, Tile* tile)
 		}
 
 		bool neighbours[8];
-		if(x == 0) {
-			if(y == 0) {
-				neighbours[0] = false;
-				neighbours[1] = false;
-				neighbours[2] = false;
-				neighbours[3] = false;
-				neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-				neighbours[5] = false;
-				neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x,     y + 1, z);
-				neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-			} else {
-				neighbours[0] = false;
-				neighbours[1] = hasMatchingTableBrushAtTile(map, table_brush, x,     y - 1, z);
-				neighbours[2] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y - 1, z);
-				neighbours[3] = false;
-				neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-				neighbours[5] = false;
-				neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x,     y + 1, z);
-				neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-			}
-		} else if(y == 0) {
-			neighbours[0] = false;
-			neighbours[1] = false;
-			neighbours[2] = false;
-			neighbours[3] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y, z);
-			neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-			neighbours[5] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y + 1, z);
-			neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x,     y + 1, z);
-			neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-		} else {
-			neighbours[0] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y - 1, z);
-			neighbours[1] = hasMatchingTableBrushAtTile(map, table_brush, x,     y - 1, z);
-			neighbours[2] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y - 1, z);
-			neighbours[3] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y, z);
-			neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-			neighbours[5] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y + 1, z);
-			neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x,     y + 1, z);
-			neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-		}
+		neighbours[0] = hasMatchingTableBrushAtTile(around, table_brush, -1, -1);
+		neighbours[1] = hasMatchingTableBrushAtTile(around, table_brush,  0, -1);
+		neighbours[2] = hasMatchingTableBrushAtTile(around, table_brush,  1, -1);
+		neighbours[3] = hasMatchingTableBrushAtTile(around, table_brush, -1,  0);
+		neighbours[4] = hasMatchingTableBrushAtTile(around, table_brush,  1,  0);
+		neighbours[5] = hasMatchingTableBrushAtTile(around, table_brush, -1,  1);
+		neighbours[6] = hasMatchingTableBrushAtTile(around, table_brush,  0,  1);
+		neighbours[7] = hasMatchingTableBrushAtTile(around, table_brush,  1,  1);
 
 		uint32_t tiledata = 0;
 		for(int32_t i = 0; i < 8; ++i) {
@@ -0,0 +1,251 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+#include "texture_atlas.h"
+#include "settings.h"
+
+TextureAtlas::TextureAtlas() :
+	buffer(CellSize * CellSize * 4),
+	used_cells(0),
+	frame(1),
+	revision(0)
+{
+	////
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	clear();
+}
+
+bool TextureAtlas::insert(const uint8_t* rgba, uint32_t& slot, uint32_t& generation)
+{
+	if(!allocate(slot)) {
+		return false;
+	}
+
+	// Copy the sprite into the middle of the cell and repeat its edges around it
+	constexpr int pixel = 4;
+	constexpr int row = CellSize * pixel;
+	for(int y = 0; y < CellSize; ++y) {
+		const int src_y = std::clamp(y - 1, 0, rme::SpritePixels - 1);
+		const uint8_t* src = rgba + src_y * rme::SpritePixels * pixel;
+		uint8_t* dst = &buffer[y * row];
+		memcpy(dst, src, pixel);
+		memcpy(dst + pixel, src, rme::SpritePixels * pixel);
+		memcpy(dst + (CellSize - 1) * pixel, src + (rme::SpritePixels - 1) * pixel, pixel);
+	}
+
+	const Page& page = pages[slot / CellsPerPage];
+	const uint32_t index = slot % CellsPerPage;
+	glBindTexture(GL_TEXTURE_2D, page.texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (index % CellsPerRow) * CellSize, (index / CellsPerRow) * CellSize,
+		CellSize, CellSize, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+
+	Cell& cell = cells[slot];
+	cell.used = true;
+	cell.frame = frame;
+	cell.lru = lru.insert(lru.end(), slot);
+	generation = cell.generation;
+	return true;
+}
+
+bool TextureAtlas::touch(uint32_t slot, uint32_t generation)
+{
+	if(slot >= cells.size()) {
+		return false;
+	}
+
+	Cell& cell = cells[slot];
+	if(!cell.used || cell.generation != generation) {
+		return false;
+	}
+
+	if(cell.frame != frame) {
+		cell.frame = frame;
+		lru.splice(lru.end(), lru, cell.lru);
+	}
+	return true;
+}
+
+void TextureAtlas::release(uint32_t slot, uint32_t generation)
+{
+	if(slot >= cells.size()) {
+		return;
+	}
+
+	Cell& cell = cells[slot];
+	if(!cell.used || cell.generation != generation) {
+		return;
+	}
+
+	cell.used = false;
+	++cell.generation;
+	++revision;
+	lru.erase(cell.lru);
+
+	Page& page = pages[slot / CellsPerPage];
+	page.free_cells.push_back(static_cast<uint16_t>(slot % CellsPerPage));
+	--page.used;
+	--used_cells;
+}
+
+TextureRegion TextureAtlas::getRegion(uint32_t slot) const
+{
+	const uint32_t index = slot % CellsPerPage;
+	const float x = static_cast<float>((index % CellsPerRow) * CellSize + 1);
+	const float y = static_cast<float>((index / CellsPerRow) * CellSize + 1);
+
+	TextureRegion region;
+	region.texture = pages[slot / CellsPerPage].texture;
+	region.u0 = x / PageSize;
+	region.v0 = y / PageSize;
+	region.u1 = (x + rme::SpritePixels) / PageSize;
+	region.v1 = (y + rme::SpritePixels) / PageSize;
+	return region;
+}
+
+void TextureAtlas::nextFrame()
+{
+	++frame;
+	for(size_t i = 0; i < pages.size(); ++i) {
+		if(pages[i].texture != 0 && pages[i].used == 0) {
+			destroyPage(i);
+		}
+	}
+}
+
+void TextureAtlas::clear()
+{
+	for(size_t i = 0; i < pages.size(); ++i) {
+		destroyPage(i);
+	}
+	pages.clear();
+	cells.clear();
+	lru.clear();
+	used_cells = 0;
+}
+
+size_t TextureAtlas::getPageCount() const noexcept
+{
+	size_t count = 0;
+	for(const Page& page : pages) {
+		count += page.texture != 0;
+	}
+	return count;
+}
+
+bool TextureAtlas::allocate(uint32_t& slot)
+{
+	// Fill the first pages first, so the last ones can run empty and be released
+	for(size_t i = 0; i < pages.size(); ++i) {
+		Page& page = pages[i];
+		if(page.texture != 0 && !page.free_cells.empty()) {
+			slot = static_cast<uint32_t>(i * CellsPerPage + page.free_cells.back());
+			page.free_cells.pop_back();
+			++page.used;
+			++used_cells;
+			return true;
+		}
+	}
+
+	// Reuse the least recently used cell, unless it is still needed for this frame
+	if(!lru.empty() && used_cells >= getMaxCells() && cells[lru.front()].frame != frame) {
+		const uint32_t victim = lru.front();
+		Cell& cell = cells[victim];
+		cell.used = false;
+		++cell.generation;
+		++revision;
+		lru.pop_front();
+		slot = victim;
+		return true;
+	}
+
+	size_t index = 0;
+	while(index < pages.size() && pages[index].texture != 0) {
+		++index;
+	}
+	if(!createPage(index)) {
+		return false;
+	}
+	return allocate(slot);
+}
+
+bool TextureAtlas::createPage(size_t index)
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	if(texture == 0) {
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, PageSize, PageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	if(index >= pages.size()) {
+		pages.resize(index + 1);
+		cells.resize(pages.size() * CellsPerPage);
+	}
+
+	Page& page = pages[index];
+	page.texture = texture;
+	page.used = 0;
+	page.free_cells.clear();
+	page.free_cells.reserve(CellsPerPage);
+	for(int i = CellsPerPage - 1; i >= 0; --i) {
+		page.free_cells.push_back(static_cast<uint16_t>(i));
+	}
+	return true;
+}
+
+void TextureAtlas::destroyPage(size_t index)
+{
+	Page& page = pages[index];
+	if(page.texture == 0) {
+		return;
+	}
+
+	// Whatever is still on the page is gone now
+	for(int i = 0; i < CellsPerPage; ++i) {
+		Cell& cell = cells[index * CellsPerPage + i];
+		if(cell.used) {
+			cell.used = false;
+			lru.erase(cell.lru);
+			--used_cells;
+		}
+		++cell.generation;
+	}
+
+	++revision;
+	glDeleteTextures(1, &page.texture);
+	page.texture = 0;
+	page.used = 0;
+	page.free_cells.clear();
+}
+
+size_t TextureAtlas::getMaxCells() const
+{
+	if(!g_settings.getInteger(Config::TEXTURE_MANAGEMENT)) {
+		return std::numeric_limits<size_t>::max();
+	}
+	return std::max<size_t>(g_settings.getInteger(Config::TEXTURE_CLEAN_THRESHOLD), CellsPerPage);
+}
@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_TEXTURE_ATLAS_H_
+#define RME_TEXTURE_ATLAS_H_
+
+#include <list>
+#include <vector>
+
+// Where the pixels of a sprite are on the GPU, a whole texture or a cell of an atlas page
+struct TextureRegion
+{
+	GLuint texture = 0;
+	float u0 = 0.f;
+	float v0 = 0.f;
+	float u1 = 1.f;
+	float v1 = 1.f;
+};
+
+// Packs 32x32 sprites into large texture pages, so the renderer can draw many
+// sprites without switching textures. Cells are handed out as (slot, generation)
+// pairs, a cell that has been evicted since no longer matches its generation.
+class TextureAtlas
+{
+public:
+	TextureAtlas();
+	~TextureAtlas();
+
+	// Uploads the RGBA pixels of a sprite, evicting the least recently used one if
+	// the atlas is already as large as allowed
+	bool insert(const uint8_t* rgba, uint32_t& slot, uint32_t& generation);
+	// Marks the cell as used this frame, returns false once it has been evicted
+	bool touch(uint32_t slot, uint32_t generation);
+	void release(uint32_t slot, uint32_t generation);
+	TextureRegion getRegion(uint32_t slot) const;
+
+	// Called after every frame, deletes pages that no longer hold any sprite
+	void nextFrame();
+	void clear();
+
+	size_t getUsedCells() const noexcept { return used_cells; }
+	// Pages with a texture, each PageSize * PageSize RGBA
+	size_t getPageCount() const noexcept;
+	// Changes whenever a cell is released or given to another sprite
+	uint32_t getRevision() const noexcept { return revision; }
+
+	static constexpr int PageSize = 2048;
+	// Every sprite has a 1px border of repeated edge pixels, so linear filtering doesn't bleed
+	static constexpr int CellSize = rme::SpritePixels + 2;
+	static constexpr int CellsPerRow = PageSize / CellSize;
+	static constexpr int CellsPerPage = CellsPerRow * CellsPerRow;
+
+private:
+	struct Cell {
+		uint32_t generation = 0;
+		uint32_t frame = 0;
+		bool used = false;
+		std::list<uint32_t>::iterator lru;
+	};
+
+	struct Page {
+		GLuint texture = 0;
+		uint32_t used = 0;
+		std::vector<uint16_t> free_cells;
+	};
+
+	bool allocate(uint32_t& slot);
+	bool createPage(size_t index);
+	void destroyPage(size_t index);
+	size_t getMaxCells() const;
+
+	std::vector<Page> pages;
+	std::vector<Cell> cells;
+	// Used cells, least recently used first
+	std::list<uint32_t> lru;
+	std::vector<uint8_t> buffer;
+	size_t used_cells;
+	uint32_t frame;
+	uint32_t revision;
+};
+
+#endif
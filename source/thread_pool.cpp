@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "thread_pool.h"
+#include "settings.h"
+#include "gui.h"
+#include "tracing.h"
+
+#include <chrono>
+
+namespace {
+	// The worker a thread is, none for threads outside the pool
+	constexpr size_t NoWorker = size_t(-1);
+	thread_local size_t current_worker = NoWorker;
+	// Tasks run by the thread right now, nested by waits within tasks
+	thread_local int running_tasks = 0;
+}
+
+int ThreadPool::TaskGroup::getProgress() const noexcept
+{
+	const int64_t total = progress_total;
+	if(total <= 0) {
+		return 0;
+	}
+	return static_cast<int>(std::min<int64_t>(progress_done * 100 / total, 100));
+}
+
+ThreadPool::ThreadPool(size_t count) :
+	workers(), detached(), queued(0), in_flight(0), next_worker(0), stopping(false)
+{
+	for(size_t i = 0; i < count; ++i) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+
+	for(size_t i = 0; i < count; ++i) {
+		workers[i]->thread = std::thread([this, i]() { work(i); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for(auto& worker : workers) {
+		if(worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
+}
+
+bool ThreadPool::isRunningTask() noexcept
+{
+	return running_tasks > 0;
+}
+
+ThreadPool& ThreadPool::getInstance()
+{
+	static ThreadPool pool(std::max(g_settings.getInteger(Config::WORKER_THREADS), 1));
+	return pool;
+}
+
+void ThreadPool::submit(TaskGroup& group, Task task)
+{
+	++group.pending;
+	++in_flight;
+
+	// Workers keep what they spawn for themselves, others are dealt out in turn
+	size_t index = current_worker;
+	if(index == NoWorker) {
+		index = next_worker++ % workers.size();
+	}
+
+	Worker& worker = *workers[index];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back({ &group, std::move(task) });
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		++queued;
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group, const std::function<bool()>& progress)
+{
+	auto last_progress = std::chrono::steady_clock::now();
+	while(!group.done()) {
+		if(progress) {
+			auto now = std::chrono::steady_clock::now();
+			if(now - last_progress >= std::chrono::milliseconds(100)) {
+				if(!progress()) {
+					group.cancel();
+				}
+				last_progress = now;
+			}
+		}
+
+		// Help out with the group instead of blocking, its tasks may be queued behind others
+		if(runOne(current_worker, &group)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(group.mutex);
+		group.finished.wait_for(lock, std::chrono::milliseconds(progress ? 50 : 10), [&group]() { return group.done(); });
+	}
+
+	// The last task may still be notifying, the group must outlive that
+	std::unique_lock<std::mutex> lock(group.mutex);
+	if(group.error) {
+		std::exception_ptr error = std::move(group.error);
+		group.error = nullptr;
+		lock.unlock();
+		std::rethrow_exception(error);
+	}
+}
+
+bool ThreadPool::waitWithLoadBar(TaskGroup& group)
+{
+	wait(group, [&group]() {
+		// 100 would close the load bar, the caller does that when it's finished
+		return g_gui.SetLoadDone(std::min(group.getProgress(), 99));
+	});
+	return !group.isCancelled();
+}
+
+void ThreadPool::work(size_t index)
+{
+	current_worker = index;
+	RME_TRACE_THREAD("worker " + std::to_string(index));
+	while(true) {
+		if(runOne(index)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake.wait(lock, [this]() { return stopping || queued > 0; });
+		if(stopping) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::runOne(size_t self, const TaskGroup* only)
+{
+	QueuedTask task;
+	bool found = false;
+	if(self != NoWorker) {
+		Worker& worker = *workers[self];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		for(auto it = worker.tasks.rbegin(); it != worker.tasks.rend(); ++it) {
+			if(!only || it->group == only) {
+				task = std::move(*it);
+				worker.tasks.erase(std::next(it).base());
+				found = true;
+				break;
+			}
+		}
+	}
+
+	const size_t count = workers.size();
+	const size_t start = (self == NoWorker ? 0 : self + 1);
+	for(size_t i = 0; !found && i < count; ++i) {
+		Worker& victim = *workers[(start + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		for(auto it = victim.tasks.begin(); it != victim.tasks.end(); ++it) {
+			if(!only || it->group == only) {
+				task = std::move(*it);
+				victim.tasks.erase(it);
+				found = true;
+				break;
+			}
+		}
+	}
+
+	if(!found) {
+		return false;
+	}
+
+	--queued;
+	run(task);
+	return true;
+}
+
+void ThreadPool::run(QueuedTask& queued_task)
+{
+	TaskGroup& group = *queued_task.group;
+	if(!group.isCancelled()) {
+		RME_TRACE_ZONE("pool", "ThreadPool task");
+		++running_tasks;
+		try {
+			queued_task.task();
+		} catch(...) {
+			// Whatever the other tasks make of the group is incomplete now
+			group.cancel();
+			std::lock_guard<std::mutex> lock(group.mutex);
+			if(!group.error) {
+				group.error = std::current_exception();
+			}
+		}
+		--running_tasks;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(group.mutex);
+		if(--group.pending == 0) {
+			group.finished.notify_all();
+		}
+	}
+	--in_flight;
+}
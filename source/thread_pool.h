@@ -0,0 +1,151 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_THREAD_POOL_H_
+#define RME_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by everything that wants to run in parallel, so the
+// features that run in parallel share the cores instead of each starting threads of its own.
+// Each worker has its own queue, it takes the newest task of its own queue and steals the
+// oldest one of another queue once its own is empty, so uneven tasks spread out by themselves.
+// Threads that block for long (file writers, sockets) don't belong here.
+class ThreadPool
+{
+	public:
+		using Task = std::function<void()>;
+
+		// Tasks that are waited on together. Once cancelled, the tasks of the group that
+		// haven't started are dropped, running ones can check isCancelled to stop early.
+		// Tasks report progress against a total, which wait can show in the load bar.
+		// A task that throws cancels its group, wait throws the exception again.
+		class TaskGroup
+		{
+			public:
+				TaskGroup() : pending(0), cancelled(false), progress_done(0), progress_total(0) {}
+				TaskGroup(const TaskGroup&) = delete;
+				TaskGroup& operator=(const TaskGroup&) = delete;
+
+				bool done() const noexcept { return pending == 0; }
+
+				void cancel() noexcept { cancelled = true; }
+				bool isCancelled() const noexcept { return cancelled; }
+
+				void setProgressTotal(int64_t total) noexcept { progress_total = total; }
+				void addProgress(int64_t amount) noexcept { progress_done += amount; }
+				// 0 to 100, of the total set
+				int getProgress() const noexcept;
+
+			private:
+				std::atomic<size_t> pending;
+				std::atomic<bool> cancelled;
+				std::atomic<int64_t> progress_done;
+				std::atomic<int64_t> progress_total;
+				std::mutex mutex;
+				std::condition_variable finished;
+				std::exception_ptr error; // The first a task threw
+
+				friend class ThreadPool;
+		};
+
+		~ThreadPool();
+
+		// Started the first time it is used, with WORKER_THREADS workers
+		static ThreadPool& getInstance();
+
+		size_t getWorkerCount() const noexcept { return workers.size(); }
+		// Whether the calling thread is running a task, a waiting thread runs those of its group
+		static bool isRunningTask() noexcept;
+		// Whether any task is queued or running, of any group
+		bool isBusy() const noexcept { return in_flight != 0; }
+
+		void submit(TaskGroup& group, Task task);
+		// Runs the queued tasks of the group on the calling thread until all of them are done,
+		// progress (if given) is called on this thread every now and then meanwhile,
+		// the group is cancelled once it returns false. Tasks of other groups are left to the
+		// workers, the calling thread may be the UI thread. Throws what a task of the group threw.
+		void wait(TaskGroup& group, const std::function<bool()>& progress = nullptr);
+		// wait, with the progress of the group shown in the open load bar (GUI::CreateLoadBar),
+		// cancelling the load bar cancels the group. Returns false if it was cancelled.
+		bool waitWithLoadBar(TaskGroup& group);
+
+		// Calls func(index) for every index in [0, count) on the pool and waits for them
+		template <typename Func>
+		void parallelFor(size_t count, Func&& func, const std::function<bool()>& progress = nullptr) {
+			TaskGroup group;
+			for(size_t index = 0; index < count; ++index) {
+				submit(group, [&func, index]() { func(index); });
+			}
+			wait(group, progress);
+		}
+
+		// Runs func on the pool, the result is picked up from the future
+		template <typename Func>
+		auto async(Func&& func) -> std::future<decltype(func())> {
+			using Result = decltype(func());
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+			std::future<Result> future = task->get_future();
+			submit(detached, [task]() { (*task)(); });
+			return future;
+		}
+
+	private:
+		ThreadPool(size_t count);
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		struct QueuedTask
+		{
+			TaskGroup* group;
+			Task task;
+		};
+
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<QueuedTask> tasks;
+			std::thread thread;
+		};
+
+		void work(size_t index);
+		// Runs one queued task, the own queue of worker self first, false if there was none.
+		// Only a task of the group only if given.
+		bool runOne(size_t self, const TaskGroup* only = nullptr);
+		void run(QueuedTask& queued);
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		// The tasks started with async, nobody waits on them as a group
+		TaskGroup detached;
+		std::mutex sleep_mutex;
+		std::condition_variable wake;
+		std::atomic<size_t> queued;
+		std::atomic<size_t> in_flight; // Submitted and not done yet
+		std::atomic<size_t> next_worker;
+		bool stopping;
+};
+
+#endif
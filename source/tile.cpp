@@ -28,6 +28,7 @@
 #include "wall_brush.h"
 #include "carpet_brush.h"
 #include "table_brush.h"
+#include "complexitem.h"
 
 Tile::Tile(int x, int y, int z) :
 	location(nullptr),
@@ -66,10 +67,24 @@ Tile::~Tile()
 	delete spawn;
 }
 
+#if RME_POOLED_MAP_ALLOCATOR > 0
+void* Tile::operator new([[maybe_unused]] size_t size)
+{
+	ASSERT(size == sizeof(Tile));
+	return MapAllocator::tilePool().allocate();
+}
+
+void Tile::operator delete(void* ptr, size_t)
+{
+	MapAllocator::tilePool().deallocate(ptr);
+}
+#endif
+
 Tile* Tile::deepCopy(BaseMap& map) const
 {
 	Tile* copy = map.allocator.allocateTile(location);
 	copy->flags = flags;
+	copy->minimapColor = minimapColor;
 	copy->house_id = house_id;
 	if (spawn) copy->spawn = spawn->deepCopy();
 	if (creature) copy->creature = creature->deepCopy();
@@ -93,7 +108,7 @@ uint32_t Tile::memsize() const
 		mem += item->memsize();
 	}
 
-	mem += sizeof(Item*) * items.capacity();
+	mem += items.heapsize();
 
 	return mem;
 }
@@ -228,7 +243,8 @@ void Tile::addItem(Item* item)
 {
 	if(!item) return;
 
-	if(item->isGroundTile()) {
+	const ItemHotData& data = item->getHotData();
+	if(data.group == ITEM_GROUP_GROUND) {
 		delete ground;
 		ground = item;
 		return;
@@ -243,16 +259,12 @@ void Tile::addItem(Item* item)
 		// At the very bottom!
 		it = items.begin();
 	} else {
-		if(item->isAlwaysOnBottom()) {
+		if(data.has(ITEM_HOT_ALWAYS_ON_BOTTOM)) {
 			it = items.begin();
-			while(true) {
-				if(it == items.end()) {
-					break;
-				} else if((*it)->isAlwaysOnBottom()) {
-					if(item->getTopOrder() < (*it)->getTopOrder()) {
-						break;
-					}
-				} else { // Always on top
+			while(it != items.end()) {
+				const ItemHotData& other = (*it)->getHotData();
+				// Always on top, or the first of a higher order
+				if(!other.has(ITEM_HOT_ALWAYS_ON_BOTTOM) || data.top_order < other.top_order) {
 					break;
 				}
 				++it;
@@ -372,9 +384,38 @@ uint8_t Tile::getMiniMapColor() const
 	return 0;
 }
 
+namespace
+{
+	bool hasText(const Item* item)
+	{
+		const std::string* text = item->getStringAttribute(ItemAttributeKeys::TEXT);
+		return text && !text->empty();
+	}
+
+	// Ids on items inside containers belong to the tile as well, the map indexes them
+	uint16_t containedIdFlags(const Container* container)
+	{
+		uint16_t flags = 0;
+		for(size_t index = 0; index < container->getItemCount(); ++index) {
+			const Item* item = container->getItem(index);
+			if(item->getUniqueID() != 0) {
+				flags |= TILESTATE_UNIQUE;
+			}
+			if(item->getActionID() != 0) {
+				flags |= TILESTATE_ACTION;
+			}
+			if(const Container* inner = dynamic_cast<const Container*>(item)) {
+				flags |= containedIdFlags(inner);
+			}
+		}
+		return flags;
+	}
+}
+
 void Tile::update()
 {
 	statflags &= TILESTATE_MODIFIED;
+	minimapColor = 0;
 
 	if(spawn && spawn->isSelected()) {
 		statflags |= TILESTATE_SELECTED;
@@ -387,14 +428,24 @@ void Tile::update()
 		if(ground->isSelected()) {
 			statflags |= TILESTATE_SELECTED;
 		}
-		if(ground->isBlocking()) {
+		const ItemHotData& data = g_items.getHotData(ground->getID());
+		if(data.has(ITEM_HOT_UNPASSABLE)) {
 			statflags |= TILESTATE_BLOCKING;
 		}
+		if(data.has(ITEM_HOT_LIGHT)) {
+			statflags |= TILESTATE_HAS_LIGHT;
+		}
+		if(hasText(ground)) {
+			statflags |= TILESTATE_HAS_TEXT;
+		}
 		if(ground->getUniqueID() != 0) {
 			statflags |= TILESTATE_UNIQUE;
 		}
-		if(ground->getMiniMapColor() != 0) {
-			minimapColor = ground->getMiniMapColor();
+		if(ground->getActionID() != 0) {
+			statflags |= TILESTATE_ACTION;
+		}
+		if(data.minimap_color != 0) {
+			minimapColor = data.minimap_color;
 		}
 	}
 
@@ -405,21 +456,38 @@ void Tile::update()
 		if(item->getUniqueID() != 0) {
 			statflags |= TILESTATE_UNIQUE;
 		}
-		if(item->getMiniMapColor() != 0) {
-			minimapColor = item->getMiniMapColor();
+		if(item->getActionID() != 0) {
+			statflags |= TILESTATE_ACTION;
 		}
 
-		const ItemType& type = g_items.getItemType(item->getID());
-		if(type.unpassable) {
+		const ItemHotData& data = g_items.getHotData(item->getID());
+		if(data.minimap_color != 0) {
+			minimapColor = data.minimap_color;
+		}
+		if(data.has(ITEM_HOT_CONTAINER)) {
+			if(const Container* container = dynamic_cast<const Container*>(item)) {
+				statflags |= containedIdFlags(container);
+				if(container->getItemCount() != 0) {
+					statflags |= TILESTATE_HAS_CONTAINER;
+				}
+			}
+		}
+		if(data.has(ITEM_HOT_UNPASSABLE)) {
 			statflags |= TILESTATE_BLOCKING;
 		}
-		if(type.isOptionalBorder) {
+		if(data.has(ITEM_HOT_LIGHT)) {
+			statflags |= TILESTATE_HAS_LIGHT;
+		}
+		if(hasText(item)) {
+			statflags |= TILESTATE_HAS_TEXT;
+		}
+		if(data.has(ITEM_HOT_OPTIONAL_BORDER)) {
 			statflags |= TILESTATE_OP_BORDER;
 		}
-		if(type.isTable) {
+		if(data.has(ITEM_HOT_TABLE)) {
 			statflags |= TILESTATE_HAS_TABLE;
 		}
-		if(type.isCarpet) {
+		if(data.has(ITEM_HOT_CARPET)) {
 			statflags |= TILESTATE_HAS_CARPET;
 		}
 	}
@@ -21,6 +21,7 @@
 #include "position.h"
 #include "item.h"
 #include "map_region.h"
+#include "zone_sets.h"
 #include <unordered_set>
 
 enum {
@@ -40,6 +41,10 @@ enum {
 	TILESTATE_HAS_TABLE = 0x0010,
 	TILESTATE_HAS_CARPET= 0x0020,
 	TILESTATE_MODIFIED  = 0x0040,
+	TILESTATE_ACTION    = 0x0080,
+	TILESTATE_HAS_LIGHT = 0x0100,
+	TILESTATE_HAS_TEXT  = 0x0200,
+	TILESTATE_HAS_CONTAINER = 0x0400, // A container holding items lies on the tile
 };
 
 enum : uint8_t {
@@ -64,6 +69,8 @@ public:
 
 	~Tile();
 
+	DECLARE_POOLED_ALLOCATION()
+
 	// Argument is a the map to allocate the tile from
 	Tile* deepCopy(BaseMap& map) const;
 
@@ -74,7 +81,7 @@ public:
 	const TileLocation* getLocation() const { return location; }
 
 	// Position of the tile
-	const Position& getPosition() const noexcept { return location->getPosition(); }
+	Position getPosition() const noexcept { return location->getPosition(); }
 	int getX() const noexcept { return location->getX(); }
 	int getY() const noexcept { return location->getY(); }
 	int getZ() const noexcept { return location->getZ(); }
@@ -124,14 +131,22 @@ public: //Functions
 
 	bool isSelected() const { return testFlags(statflags, TILESTATE_SELECTED); }
 	bool hasUniqueItem() const { return testFlags(statflags, TILESTATE_UNIQUE); }
+	bool hasActionItem() const { return testFlags(statflags, TILESTATE_ACTION); }
+	bool hasLight() const { return testFlags(statflags, TILESTATE_HAS_LIGHT); }
+	// Whether any item lies inside a container on the tile, the scans over items only descend then
+	bool hasContainers() const { return testFlags(statflags, TILESTATE_HAS_CONTAINER); }
+	// Any item with an unique id, action id or text, the zones are not included
+	bool hasTooltip() const { return testFlags(statflags, TILESTATE_UNIQUE | TILESTATE_ACTION | TILESTATE_HAS_TEXT); }
 
 	ItemVector popSelectedItems(bool ignoreTileSelected = false);
 	ItemVector getSelectedItems();
 	Item* getTopSelectedItem();
 
-	// Refresh internal flags (such as selected etc.)
+	// Refresh internal flags (such as selected etc.) and the minimap color,
+	// has to be called after every change to the items of the tile
 	void update();
 
+	// Cached by update(), only scans the items if it was never called
 	uint8_t getMiniMapColor() const;
 
 	bool hasItems() const noexcept { return ground || !items.empty(); }
@@ -197,13 +212,16 @@ public: //Functions
 	void setHouse(House* house);
 
 	// Mapflags (PZ, PVPZONE etc.)
+	// The zones are an interned set (see ZoneSets), sorted by id
 	void addZoneId(uint16_t _zoneId);
 	void removeZoneId(uint16_t _zoneId);
 	void clearZoneId();
-	void setZoneIds(Tile* tile);
 	void setZoneIds(const Tile* tile);
 	const std::vector<uint16_t>& getZoneIds() const;
 	uint16_t getZoneId() const;
+	bool hasZones() const noexcept { return zoneSet != ZoneSets::Empty; }
+	ZoneSets::Handle getZoneSet() const noexcept { return zoneSet; }
+	void setZoneSet(ZoneSets::Handle set) noexcept { zoneSet = set; }
 
 	void setMapFlags(uint16_t flags);
 	void unsetMapFlags(uint16_t flags);
@@ -223,7 +241,7 @@ protected:
 		uint32_t flags;
 	};
 
-	std::vector<uint16_t> zoneIds;
+	ZoneSets::Handle zoneSet = ZoneSets::Empty;
 
 private:
 	uint8_t minimapColor;
@@ -288,47 +306,35 @@ inline uint16_t Tile::getStatFlags() const noexcept {
 
 inline void Tile::addZoneId(uint16_t _zoneId)
 {
-	if (std::find(zoneIds.begin(), zoneIds.end(), _zoneId) == zoneIds.end()) {
-		zoneIds.push_back(_zoneId);
-	}
+	zoneSet = ZoneSets::add(zoneSet, _zoneId);
 }
 
 inline void Tile::clearZoneId()
 {
-	zoneIds.clear();
-}
-
-inline void Tile::setZoneIds(Tile* tile)
-{
-	zoneIds.clear();
-	zoneIds.assign(tile->getZoneIds().begin(), tile->getZoneIds().end());
+	zoneSet = ZoneSets::Empty;
 }
 
 inline void Tile::setZoneIds(const Tile* tile)
 {
-	zoneIds.clear();
-	zoneIds.assign(tile->getZoneIds().begin(), tile->getZoneIds().end());
+	zoneSet = tile->zoneSet;
 }
 
 inline void Tile::removeZoneId(uint16_t _zoneId)
 {
-	const auto& itZone = std::find(zoneIds.begin(), zoneIds.end(), _zoneId);
-	if (itZone != zoneIds.end()) {
-		zoneIds.erase(itZone);
-	}
+	zoneSet = ZoneSets::remove(zoneSet, _zoneId);
 }
 
 inline const std::vector<uint16_t>& Tile::getZoneIds() const
 {
-	return zoneIds;
+	return ZoneSets::get(zoneSet);
 }
 
 inline uint16_t Tile::getZoneId() const
 {
-	if (zoneIds.empty())
+	if (zoneSet == ZoneSets::Empty)
 		return 0;
 
-	return zoneIds.front();
+	return ZoneSets::get(zoneSet).front();
 }
 
 #endif
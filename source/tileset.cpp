@@ -41,6 +41,7 @@ void Tileset::clear()
 {
 	for(TilesetCategoryArray::iterator iter = categories.begin(); iter != categories.end(); ++iter) {
 		(*iter)->brushlist.clear();
+		(*iter)->lazy_items.clear();
 	}
 }
 
@@ -68,11 +69,33 @@ TilesetCategory* Tileset::getCategory(TilesetCategoryType type)
 
 bool TilesetCategory::containsBrush(Brush* brush) const
 {
-	for(std::vector<Brush*>::const_iterator iter = brushlist.begin(); iter != brushlist.end(); ++iter)
-		if(*iter == brush)
-			return true;
+	return findBrush(brush) != -1;
+}
 
-	return false;
+Brush* TilesetCategory::getBrush(size_t index) const
+{
+	if(index < brushlist.size())
+		return brushlist[index];
+	return g_items.getRAWBrush(lazy_items[index - brushlist.size()]);
+}
+
+int TilesetCategory::findBrush(const Brush* brush) const
+{
+	if(!brush)
+		return -1;
+
+	auto it = std::find(brushlist.begin(), brushlist.end(), brush);
+	if(it != brushlist.end())
+		return static_cast<int>(it - brushlist.begin());
+
+	// A RAW brush not made yet can't be asked for, so only its item has to be looked up
+	if(!brush->isRaw() || lazy_items.empty())
+		return -1;
+	const uint16_t id = const_cast<Brush*>(brush)->asRaw()->getItemID();
+	auto item = std::lower_bound(lazy_items.begin(), lazy_items.end(), id);
+	if(item == lazy_items.end() || *item != id)
+		return -1;
+	return static_cast<int>(brushlist.size() + (item - lazy_items.begin()));
 }
 
 const TilesetCategory* Tileset::getCategory(TilesetCategoryType type) const
@@ -170,16 +193,44 @@ bool TilesetCategory::isTrivial() const
 	return (type == TILESET_ITEM) || (type == TILESET_RAW);
 }
 
+std::vector<Brush*>::iterator TilesetCategory::findInsertPosition(const Brush* after, const std::string& afterName)
+{
+	if(afterName.empty()) {
+		return brushlist.end();
+	}
+
+	// Brushes are compared by id, names are only compared when the brush
+	// found under the name isn't in this category, several may share it
+	if(after) {
+		const uint32_t id = after->getID();
+		for(auto itt = brushlist.begin(); itt != brushlist.end(); ++itt) {
+			if((*itt)->getID() == id) {
+				return ++itt;
+			}
+		}
+	}
+	for(auto itt = brushlist.begin(); itt != brushlist.end(); ++itt) {
+		if((*itt)->getName() == afterName) {
+			return ++itt;
+		}
+	}
+	return brushlist.end();
+}
+
 void TilesetCategory::loadBrush(pugi::xml_node node, wxArrayString& warnings)
 {
 	pugi::xml_attribute attribute;
 
 	std::string brushName = node.attribute("after").as_string();
+	const Brush* afterBrush = nullptr;
 	if((attribute = node.attribute("afteritem"))) {
 		const ItemType& type = g_items.getItemType(attribute.as_ushort());
 		if(type.id != 0) {
+			afterBrush = type.raw_brush;
 			brushName = type.raw_brush ? type.raw_brush->getName() : std::string();
 		}
+	} else if(!brushName.empty()) {
+		afterBrush = tileset.brushes.getBrush(brushName);
 	}
 
 	const std::string& nodeName = as_lower_str(node.name());
@@ -190,15 +241,7 @@ void TilesetCategory::loadBrush(pugi::xml_node node, wxArrayString& warnings)
 
 		Brush* brush = tileset.brushes.getBrush(attribute.as_string());
 		if(brush) {
-			auto insertPosition = brushlist.end();
-			if(!brushName.empty()) {
-				for(auto itt = brushlist.begin(); itt != brushlist.end(); ++itt) {
-					if((*itt)->getName() == brushName) {
-						insertPosition = ++itt;
-						break;
-					}
-				}
-			}
+			auto insertPosition = findInsertPosition(afterBrush, brushName);
 			brush->flagAsVisible();
 			brushlist.insert(insertPosition, brush);
 		} else {
@@ -242,15 +285,7 @@ void TilesetCategory::loadBrush(pugi::xml_node node, wxArrayString& warnings)
 			tempBrushVector.push_back(brush);
 		}
 
-		auto insertPosition = brushlist.end();
-		if(!brushName.empty()) {
-			for(auto itt = brushlist.begin(); itt != brushlist.end(); ++itt) {
-				if((*itt)->getName() == brushName) {
-					insertPosition = ++itt;
-					break;
-				}
-			}
-		}
+		auto insertPosition = findInsertPosition(afterBrush, brushName);
 		brushlist.insert(insertPosition, tempBrushVector.begin(), tempBrushVector.end());
 	}
 }
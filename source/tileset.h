@@ -38,7 +38,11 @@ public:
 
 	bool isTrivial() const;
 	TilesetCategoryType getType() const { return type; }
-	size_t size() const { return brushlist.size(); }
+	size_t size() const { return brushlist.size() + lazy_items.size(); }
+	// The brushes of the list come first, then those of the lazy items, made here when first asked for
+	Brush* getBrush(size_t index) const;
+	// The index getBrush has the brush at, -1 if it isn't in the category
+	int findBrush(const Brush* brush) const;
 
 	void loadBrush(pugi::xml_node node, wxArrayString& warnings);
 	void clear();
@@ -49,9 +53,15 @@ protected:
 	TilesetCategoryType type;
 public:
 	std::vector<Brush*> brushlist;
+	// Items in ascending order whose RAW brushes are listed after the brushes,
+	// there are tens of thousands of these in the "Others" tileset
+	std::vector<uint16_t> lazy_items;
 	Tileset& tileset;
 
 private:
+	// Where brushes listed after another one go, the end if it isn't here
+	std::vector<Brush*>::iterator findInsertPosition(const Brush* after, const std::string& afterName);
+
 	TilesetCategory(const TilesetCategory&);
 	TilesetCategory operator=(const TilesetCategory&);
 };
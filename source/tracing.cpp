@@ -0,0 +1,123 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "tracing.h"
+
+#if RME_TRACING > 0
+
+#include <fstream>
+#include <iomanip>
+
+std::atomic<bool> Tracer::recording(false);
+
+Tracer::Tracer()
+{
+	////
+}
+
+Tracer& Tracer::getInstance()
+{
+	static Tracer instance;
+	return instance;
+}
+
+Tracer::Buffer& Tracer::getBuffer()
+{
+	// The buffers live as long as the tracer, a thread that ended leaves its events behind
+	thread_local Buffer* buffer = nullptr;
+	if(!buffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+		buffers.push_back(std::make_unique<Buffer>());
+		buffer = buffers.back().get();
+		buffer->id = static_cast<uint32_t>(buffers.size());
+	}
+	return *buffer;
+}
+
+void Tracer::setThreadName(const std::string& name)
+{
+	Buffer& buffer = getBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.name = name;
+}
+
+void Tracer::start(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const auto& buffer : buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+		buffer->events.clear();
+	}
+	this->path = path;
+	started = Clock::now();
+	recording = true;
+}
+
+void Tracer::record(const char* category, const char* name, Clock::time_point begin, Clock::time_point end)
+{
+	Buffer& buffer = getBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back({ category, name, begin, end });
+}
+
+bool Tracer::stop()
+{
+	recording = false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ofstream file(path.c_str(), std::ios::trunc | std::ios::out);
+	if(!file.is_open()) {
+		return false;
+	}
+
+	auto microseconds = [this](Clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(time - started).count();
+	};
+
+	// Complete events, and the names of the threads as metadata
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	bool first = true;
+	for(const auto& buffer : buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+		const std::string thread = buffer->name.empty() ? "thread " + std::to_string(buffer->id) : buffer->name;
+		file << (first ? "" : ",\n")
+			<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->id
+			<< ", \"args\": {\"name\": " << nlohmann::json(thread).dump() << "}}";
+		first = false;
+
+		for(const Event& event : buffer->events) {
+			// Zones that were already open when the recording started
+			if(event.begin < started) {
+				continue;
+			}
+			file << ",\n{\"name\": " << nlohmann::json(event.name).dump()
+				<< ", \"cat\": " << nlohmann::json(event.category).dump()
+				<< ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id
+				<< ", \"ts\": " << microseconds(event.begin)
+				<< ", \"dur\": " << microseconds(event.end) - microseconds(event.begin) << "}";
+		}
+		buffer->events.clear();
+		buffer->events.shrink_to_fit();
+	}
+	file << "\n]}\n";
+	return file.good();
+}
+
+#endif
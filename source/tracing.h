@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_TRACING_H_
+#define RME_TRACING_H_
+
+// Zones of time spent in the subsystems, on every thread, written out in the Chrome
+// trace format (chrome://tracing, ui.perfetto.dev) to be attached to performance reports:
+//   RME_TRACE_ZONE("io", "IOMapOTBM::loadMap");
+// times the rest of the enclosing block. The zones are only built in with RME_TRACING
+// set in definitions.h, otherwise they compile to nothing. Built in, a zone costs a
+// relaxed atomic load as long as no trace is being recorded.
+
+#if RME_TRACING > 0
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Tracer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static Tracer& getInstance();
+
+	// Drops anything recorded before, the trace is written to the file once stopped
+	void start(const std::string& path);
+	// False if the file couldn't be written
+	bool stop();
+	static bool isRecording() noexcept { return recording.load(std::memory_order_relaxed); }
+
+	// Names the calling thread in the traces
+	void setThreadName(const std::string& name);
+
+	// The category and name are kept as pointers, they have to be string literals
+	void record(const char* category, const char* name, Clock::time_point begin, Clock::time_point end);
+
+private:
+	Tracer();
+	Tracer(const Tracer&) = delete;
+	Tracer& operator=(const Tracer&) = delete;
+
+	struct Event {
+		const char* category;
+		const char* name;
+		Clock::time_point begin;
+		Clock::time_point end;
+	};
+
+	// Every thread appends to a buffer of its own, locked only against stop
+	struct Buffer {
+		std::mutex mutex;
+		std::vector<Event> events;
+		std::string name;
+		uint32_t id = 0;
+	};
+
+	Buffer& getBuffer();
+
+	static std::atomic<bool> recording;
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Buffer>> buffers;
+	std::string path;
+	Clock::time_point started;
+};
+
+// Records the enclosing block as a zone if a trace is being recorded when it starts
+class TraceScope
+{
+public:
+	TraceScope(const char* category, const char* name) :
+		category(category), name(name), active(Tracer::isRecording())
+	{
+		if(active) {
+			begin = Tracer::Clock::now();
+		}
+	}
+	~TraceScope()
+	{
+		if(active) {
+			Tracer::getInstance().record(category, name, begin, Tracer::Clock::now());
+		}
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* category;
+	const char* name;
+	bool active;
+	Tracer::Clock::time_point begin;
+};
+
+#define RME_TRACE_CONCAT_(a, b) a##b
+#define RME_TRACE_CONCAT(a, b) RME_TRACE_CONCAT_(a, b)
+#define RME_TRACE_ZONE(category, name) TraceScope RME_TRACE_CONCAT(trace_zone_, __LINE__)(category, name)
+#define RME_TRACE_THREAD(name) Tracer::getInstance().setThreadName(name)
+
+#else
+
+#define RME_TRACE_ZONE(category, name) ((void)0)
+#define RME_TRACE_THREAD(name) ((void)0)
+
+#endif
+
+#endif
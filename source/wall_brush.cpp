@@ -25,6 +25,7 @@ uint32_t WallBrush::full_border_types[16];
 uint32_t WallBrush::half_border_types[16];
 
 WallBrush::WallBrush() :
+	alignments(),
 	redirect_to(nullptr)
 {
 	////
@@ -339,9 +340,9 @@ void WallBrush::draw(BaseMap* map, Tile* tile, void* parameter)
 	tile->addWallItem(Item::Create(id));
 }
 
-bool hasMatchingWallBrushAtTile(BaseMap* map, WallBrush* wall_brush, uint32_t x, uint32_t y, uint32_t z)
+bool hasMatchingWallBrushAtTile(const TileNeighbourhood& around, WallBrush* wall_brush, int dx, int dy)
 {
-	Tile* t = map->getTile(x, y, z);
+	Tile* t = around.getTile(dx, dy);
 	if(!t) return false;
 
 	ItemVector::const_iterator it = t->items.begin();
@@ -360,14 +361,83 @@ bool hasMatchingWallBrushAtTile(BaseMap* map, WallBrush* wall_brush, uint32_t x,
 	return false;
 }
 
+void WallBrush::resolveAlignments()
+{
+	auto resolve = [this](::BorderType alignment) -> const WallNode* {
+		WallBrush* brush = this;
+		do {
+			const WallNode& node = brush->wall_items[int(alignment)];
+			if(!node.items.empty()) {
+				return &node;
+			}
+			brush = brush->redirect_to;
+		} while(brush && brush != this);
+		return nullptr;
+	};
+
+	for(uint32_t mask = 0; mask < 16; ++mask) {
+		WallAlignment& alignment = alignments[mask];
+		alignment.full = ::BorderType(full_border_types[mask]);
+		alignment.half = ::BorderType(half_border_types[mask]);
+		alignment.full_node = resolve(alignment.full);
+		alignment.half_node = resolve(alignment.half);
+	}
+}
+
+uint16_t WallBrush::pickWall(const WallNode& node)
+{
+	if(node.total_chance <= 0) {
+		return node.items.empty() ? 0 : node.items.front().id;
+	}
+
+	int chance = random(1, node.total_chance);
+	for(const WallType& type : node.items) {
+		if(chance <= type.chance) {
+			return type.id;
+		}
+	}
+	return 0;
+}
+
+void WallBrush::realignDecorations(ItemVector& items, ItemVector::iterator& it, ::BorderType alignment, bool wall_kept, ItemVector& items_to_add)
+{
+	while(it != items.end()) {
+		Item* wall_decoration = *it;
+		ASSERT(wall_decoration);
+		WallBrush* brush = wall_decoration->getWallBrush();
+		if(!brush || !brush->isWallDecoration()) {
+			// A replaced wall stays behind for cleanWalls, and so does the item after it
+			if(!wall_kept) {
+				++it;
+			}
+			return;
+		}
+
+		if(wall_kept && wall_decoration->getWallAlignment() == alignment) {
+			// Same, no need to change...
+			items_to_add.push_back(wall_decoration);
+			it = items.erase(it);
+			continue;
+		}
+
+		// Not the same alignment, create newd item with correct alignment
+		uint16_t id = pickWall(brush->wall_items[int(alignment)]);
+		if(id != 0) {
+			Item* new_wall = Item::Create(id);
+			if(wall_decoration->isSelected()) {
+				new_wall->select();
+			}
+			items_to_add.push_back(new_wall);
+		}
+		++it;
+	}
+}
+
 void WallBrush::doWalls(BaseMap* map, Tile* tile)
 {
 	ASSERT(tile);
 
-	// For quicker reference
-	unsigned int x = tile->getPosition().x;
-	unsigned int y = tile->getPosition().y;
-	unsigned int z = tile->getPosition().z;
+	const TileNeighbourhood around(*map, tile->getPosition());
 
 	// Advance the vector to the beginning of the walls
 	ItemVector::iterator it = tile->items.begin();
@@ -387,209 +457,63 @@ void WallBrush::doWalls(BaseMap* map, Tile* tile)
 			++it;
 			continue;
 		}
-		// or if it's a decoration brush.
-		if(wall_brush->isWallDecoration()) {
+		// or if it's a decoration brush, or one that's never changed.
+		if(wall_brush->isWallDecoration() || wall->getWallAlignment() == WALL_UNTOUCHABLE) {
 			items_to_add.push_back(wall);
 			it = tile->items.erase(it);
 			continue;
 		}
-		bool neighbours[4];
-
-		if(x == 0) {
-			if(y == 0) {
-				neighbours[0] = false;
-				neighbours[1] = false;
-				neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-				neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x,     y + 1, z);
-			} else {
-				neighbours[0] = hasMatchingWallBrushAtTile(map, wall_brush, x,     y - 1, z);
-				neighbours[1] = false;
-				neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-				neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x,     y + 1, z);
-			}
-		} else if(y == 0) {
-			neighbours[0] = false;
-			neighbours[1] = hasMatchingWallBrushAtTile(map, wall_brush, x - 1, y, z);
-			neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-			neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x,     y + 1, z);
-		} else {
-			neighbours[0] = hasMatchingWallBrushAtTile(map, wall_brush, x,     y - 1, z);
-			neighbours[1] = hasMatchingWallBrushAtTile(map, wall_brush, x - 1, y, z);
-			neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-			neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x,     y + 1, z);
-		}
 
 		uint32_t tiledata = 0;
-		for(int i = 0; i < 4; i++) {
-			if(neighbours[i]) {
-				// Same wall as this one, calculate what border
-				tiledata |= 1 << i;
-			}
+		if(hasMatchingWallBrushAtTile(around, wall_brush,  0, -1)) tiledata |= 1 << 0;
+		if(hasMatchingWallBrushAtTile(around, wall_brush, -1,  0)) tiledata |= 1 << 1;
+		if(hasMatchingWallBrushAtTile(around, wall_brush,  1,  0)) tiledata |= 1 << 2;
+		if(hasMatchingWallBrushAtTile(around, wall_brush,  0,  1)) tiledata |= 1 << 3;
+
+		// The full alignment if it's already there or the chain has walls for
+		// it, the half one otherwise
+		const WallAlignment& alignment = wall_brush->alignments[tiledata];
+		const ::BorderType current = wall->getWallAlignment();
+		::BorderType bt;
+		const WallNode* node = nullptr;
+		if(current == alignment.full) {
+			bt = alignment.full;
+		} else if(alignment.full_node) {
+			bt = alignment.full;
+			node = alignment.full_node;
+		} else if(current == alignment.half) {
+			bt = alignment.half;
+		} else if(alignment.half_node) {
+			bt = alignment.half;
+			node = alignment.half_node;
+		} else {
+			// Nothing fits, cleanWalls takes it away
+			++it;
+			continue;
 		}
 
-		bool exit = false;
-		for(int i = 0; i < 2; ++i) { // Repeat twice
-			if(exit) {
-				break;
-			}
-			::BorderType bt;
-			if(i == 0) {
-				bt = ::BorderType(full_border_types[tiledata]);
-			} else {
-				bt = ::BorderType(half_border_types[tiledata]);
-			}
+		if(!node) {
+			// Do nothing, the tile already has a wall like this
+			// However, wall decorations associated with this wall might need to change...
+			items_to_add.push_back(wall);
+			it = tile->items.erase(it);
+			realignDecorations(tile->items, it, bt, true, items_to_add);
+			continue;
+		}
 
-			if(wall->getWallAlignment() == WALL_UNTOUCHABLE) {
-				items_to_add.push_back(wall);
-				it = tile->items.erase(it);
-				exit = true;
-			} else if(wall->getWallAlignment() == bt) {
-				// Do nothing, the tile already has a wall like this
-				// However, wall decorations associated with this wall might need to change...
-				items_to_add.push_back(wall);
-				it = tile->items.erase(it);
-				exit = true;
-
-				while(it != tile->items.end()) {
-					// If we have a decoration ontop of us, we need to change it's alignment aswell!
-
-					Item* wall_decoration = *it;
-					ASSERT(wall_decoration);
-					WallBrush* brush = wall_decoration->getWallBrush();
-					if(brush && brush->isWallDecoration()) {
-						// We don't know if we have changed alignment
-						if(wall_decoration->getWallAlignment() == bt) {
-							// Same, no need to change...
-							items_to_add.push_back(wall_decoration);
-							it = tile->items.erase(it);
-							continue;
-						}
-						// Not the same alignment, create newd item with correct alignment
-						uint16_t id = 0;
-						WallNode& wn = brush->wall_items[int(bt)];
-						if(wn.total_chance <= 0) {
-							if(wn.items.size() == 0) {
-								++it;
-								continue;
-							} else {
-								id = wn.items.front().id;
-							}
-						} else {
-							int chance = random(1, wn.total_chance);
-							for(std::vector<WallType>::const_iterator witer = wn.items.begin();
-									witer != wn.items.end();
-									++witer)
-							{
-								if(chance <= witer->chance) {
-									id = witer->id;
-									break;
-								}
-							}
-						}
-						if(id != 0) {
-							Item* new_wall = Item::Create(id);
-							if(wall_decoration->isSelected()) {
-								new_wall->select();
-							}
-							items_to_add.push_back(new_wall);
-						}
-						++it;
-					} else {
-						break;
-					}
-				}
-			} else {
-				// Randomize a newd wall of the proper alignment
-				uint16_t id = 0;
-				WallBrush* try_brush = wall_brush;
-
-				while(true) {
-					if(try_brush == nullptr) break;
-					if(id != 0) break;
-
-					WallNode& wn = try_brush->wall_items[int(bt)];
-					if(wn.total_chance <= 0) {
-						if(wn.items.size() == 0) {
-							try_brush = try_brush->redirect_to;
-							if(try_brush == wall_brush) break; // To prevent infinite loop
-							continue;
-						} else {
-							id = wn.items.front().id;
-						}
-					} else {
-						int chance = random(1, wn.total_chance);
-						for(std::vector<WallType>::const_iterator node_iter = wn.items.begin();
-								node_iter != wn.items.end();
-								++node_iter) {
-							if(chance <= node_iter->chance) {
-								id = node_iter->id;
-								break;
-							}
-						}
-					}
-					// Propagate down the chain
-					try_brush = try_brush->redirect_to;
-					if(try_brush == wall_brush) break; // To prevent infinite loop
-				}
-				if(try_brush == nullptr && id == 0) {
-					if(i == 1) {
-						++it;
-					}
-					continue;
-				} else {
-					// If there is such an item, add it to the tile
-					Item* new_wall = Item::Create(id);
-					if(wall->isSelected()) {
-						new_wall->select();
-					}
-					items_to_add.push_back(new_wall);
-					exit = true;
-					++it;
-				}
+		// Randomize a newd wall of the proper alignment
+		uint16_t id = pickWall(*node);
+		++it;
+		if(id == 0) {
+			continue;
+		}
 
-				// Increment and check for end
-				while(it != tile->items.end()) {
-					// If we have a decoration ontop of us, we need to change it's alignment aswell!
-					Item* wall_decoration = *it;
-					WallBrush* brush = wall_decoration->getWallBrush();
-					if(brush && brush->isWallDecoration()) {
-						// We know we have changed alignment, so no need to check for it again.
-						uint16_t id = 0;
-						WallNode& wn = brush->wall_items[int(bt)];
-						if(wn.total_chance <= 0) {
-							if(wn.items.size() == 0) {
-								++it;
-								continue;
-							} else {
-								id = wn.items.front().id;
-							}
-						} else {
-							int chance = random(1, wn.total_chance);
-							for(std::vector<WallType>::const_iterator node_iter = wn.items.begin();
-									node_iter != wn.items.end();
-									++node_iter)
-							{
-								if(chance <= node_iter->chance) {
-									id = node_iter->id;
-									break;
-								}
-							}
-						}
-						if(id != 0) {
-							Item* new_wall = Item::Create(id);
-							if(wall_decoration->isSelected()) {
-								new_wall->select();
-							}
-							items_to_add.push_back(new_wall);
-						}
-						++it;
-					} else {
-						++it;
-						break;
-					}
-				}
-			}
+		Item* new_wall = Item::Create(id);
+		if(wall->isSelected()) {
+			new_wall->select();
 		}
+		items_to_add.push_back(new_wall);
+		realignDecorations(tile->items, it, bt, false, items_to_add);
 	}
 	tile->cleanWalls();
 	for(ItemVector::const_iterator it = items_to_add.begin(); it != items_to_add.end(); ++it) {
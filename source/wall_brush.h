@@ -45,6 +45,8 @@ public:
 	virtual void undraw(BaseMap* map, Tile* tile);
 	// Creates walls on the target tile (does not depend on brush in any way)
 	static void doWalls(BaseMap* map, Tile* tile);
+	// Works out the alignment table, the redirect links have to be loaded
+	void resolveAlignments();
 
 	// If the specified wall item is part of this wall
 	bool hasWall(Item* item);
@@ -70,8 +72,24 @@ protected:
 	WallNode wall_items[17];
 	std::vector<DoorType> door_items[17];
 
+	// What a wall turns into by the mask of matching neighbours (north, west,
+	// east, south). The nodes come from the first brush of the redirect chain
+	// with walls of that alignment, null if none has any.
+	struct WallAlignment {
+		::BorderType full;
+		::BorderType half;
+		const WallNode* full_node;
+		const WallNode* half_node;
+	};
+	WallAlignment alignments[16];
+
 	WallBrush* redirect_to;
 
+	// A random wall of the node, 0 if it has none
+	static uint16_t pickWall(const WallNode& node);
+	// Moves the decorations following a wall at it to the alignment
+	static void realignDecorations(ItemVector& items, ItemVector::iterator& it, ::BorderType alignment, bool wall_kept, ItemVector& items_to_add);
+
 	friend class DoorBrush;
 
 public:
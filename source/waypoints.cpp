@@ -35,6 +35,7 @@ void Waypoints::addWaypoint(Waypoint* wp)
 		if(!t)
 			map.setTile(wp->pos, t = map.allocator(map.createTileL(wp->pos)));
 		t->getLocation()->increaseWaypointCount();
+		positions.emplace(wp->pos, wp);
 	}
 	waypoints.insert(std::make_pair(as_lower_str(wp->name), wp));
 }
@@ -52,13 +53,10 @@ Waypoint* Waypoints::getWaypoint(const Position& position)
 {
 	if(!position.isValid())
 		return nullptr;
-	// TODO find waypoint by position hash.
-	for(WaypointMap::iterator it = waypoints.begin(); it != waypoints.end(); it++) {
-		Waypoint* waypoint = it->second;
-		if(waypoint && waypoint->pos == position)
-			return waypoint;
-	}
-	return nullptr;
+	auto iter = positions.find(position);
+	if(iter == positions.end())
+		return nullptr;
+	return iter->second;
 }
 
 void Waypoints::removeWaypoint(std::string name)
@@ -67,6 +65,32 @@ void Waypoints::removeWaypoint(std::string name)
 	WaypointMap::iterator iter = waypoints.find(name);
 	if(iter == waypoints.end())
 		return;
+	unindexWaypoint(iter->second);
 	delete iter->second;
 	waypoints.erase(iter);
 }
+
+void Waypoints::moveWaypoint(Waypoint* wp, const Position& position)
+{
+	unindexWaypoint(wp);
+	wp->pos = position;
+	if(position.isValid())
+		positions.emplace(position, wp);
+}
+
+void Waypoints::releaseWaypoints()
+{
+	waypoints.clear();
+	positions.clear();
+}
+
+void Waypoints::unindexWaypoint(Waypoint* wp)
+{
+	auto range = positions.equal_range(wp->pos);
+	for(auto it = range.first; it != range.second; ++it) {
+		if(it->second == wp) {
+			positions.erase(it);
+			return;
+		}
+	}
+}
@@ -20,6 +20,8 @@
 
 #include "position.h"
 
+#include <unordered_map>
+
 class Waypoint
 {
 public:
@@ -39,6 +41,12 @@ public:
 	Waypoint* getWaypoint(std::string name);
 	Waypoint* getWaypoint(const Position& position);
 	void removeWaypoint(std::string name);
+	// Moves a waypoint and keeps the position index up to date, the waypoint
+	// counts of the tiles are left to the caller
+	void moveWaypoint(Waypoint* wp, const Position& position);
+	// Forgets every waypoint without deleting them, once they have been handed
+	// over to another map
+	void releaseWaypoints();
 
 	WaypointMap waypoints;
 
@@ -48,7 +56,11 @@ public:
 	WaypointMap::const_iterator end() const { return waypoints.end(); }
 
 private:
+	void unindexWaypoint(Waypoint* wp);
+
 	Map& map;
+	// Waypoints by position, several may share a tile
+	std::unordered_multimap<Position, Waypoint*> positions;
 };
 
 #endif
@@ -19,6 +19,10 @@
 #include "welcome_dialog.h"
 #include "settings.h"
 #include "preferences.h"
+#include "iomap_otbm.h"
+#include "thread_pool.h"
+
+#include <wx/weakref.h>
 
 wxDEFINE_EVENT(WELCOME_DIALOG_ACTION, wxCommandEvent);
 
@@ -51,9 +55,7 @@ void WelcomeDialog::OnButtonClicked(const wxMouseEvent &event) {
         } else {
             wxCommandEvent action_event(WELCOME_DIALOG_ACTION);
             if(button->GetAction() == wxID_OPEN) {
-                wxString wildcard = g_settings.getInteger(Config::USE_OTGZ) != 0 ?
-                                    "(*.otbm;*.otgz)|*.otbm;*.otgz" :
-                                    "(*.otbm)|*.otbm|Compressed OpenTibia Binary Map (*.otgz)|*.otgz";
+                wxString wildcard = g_settings.getInteger(Config::USE_OTGZ) != 0 ? MAP_LOAD_FILE_WILDCARD_OTGZ : MAP_LOAD_FILE_WILDCARD;
                 wxFileDialog file_dialog(this, "Open map file", "", "", wildcard, wxFD_OPEN | wxFD_FILE_MUST_EXIST);
                 if(file_dialog.ShowModal() == wxID_OK) {
                     action_event.SetString(file_dialog.GetPath());
@@ -257,16 +259,79 @@ RecentItem::RecentItem(wxWindow *parent,
     m_file_path->SetToolTip(m_item_text);
     m_file_path->SetFont(GetFont().Smaller());
     m_file_path->SetForegroundColour(m_text_colour);
+    m_details = newd wxStaticText(this, wxID_ANY, "");
+    m_details->SetFont(GetFont().Smaller());
+    m_details->SetForegroundColour(m_text_colour);
+    m_thumbnail = newd wxStaticBitmap(this, wxID_ANY, wxNullBitmap);
+    m_thumbnail->Hide();
     wxBoxSizer *mainSizer = newd wxBoxSizer(wxHORIZONTAL);
     wxBoxSizer *sizer = newd wxBoxSizer(wxVERTICAL);
     sizer->Add(m_title);
     sizer->Add(m_file_path, 1, wxTOP, FROM_DIP(this, 2));
-    mainSizer->Add(sizer, 0, wxEXPAND | wxALL, FROM_DIP(this, 8));
+    sizer->Add(m_details, 0, wxTOP, FROM_DIP(this, 2));
+    mainSizer->Add(m_thumbnail, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, FROM_DIP(this, 8));
+    mainSizer->Add(sizer, 1, wxEXPAND | wxALL, FROM_DIP(this, 8));
     Bind(wxEVT_ENTER_WINDOW, &RecentItem::OnMouseEnter, this);
     Bind(wxEVT_LEAVE_WINDOW, &RecentItem::OnMouseLeave, this);
     m_title->Bind(wxEVT_LEFT_UP, &RecentItem::PropagateItemClicked, this);
     m_file_path->Bind(wxEVT_LEFT_UP, &RecentItem::PropagateItemClicked, this);
+    m_details->Bind(wxEVT_LEFT_UP, &RecentItem::PropagateItemClicked, this);
+    m_thumbnail->Bind(wxEVT_LEFT_UP, &RecentItem::PropagateItemClicked, this);
     SetSizerAndFit(mainSizer);
+    StartProbe();
+}
+
+void RecentItem::StartProbe() {
+    // Neither wxString nor wxWeakRef are safe to share between threads, the worker gets
+    // its own copy of the path and hands the reference back to the UI thread untouched
+    const std::string path = nstr(m_item_text);
+    auto item = std::make_shared<wxWeakRef<RecentItem>>(this);
+    ThreadPool::getInstance().async([item = std::move(item), path]() mutable {
+        auto probe = std::make_shared<OTBM_MapProbe>();
+        const bool probed = IOMapOTBM::probeMap(FileName(wxstr(path)), *probe);
+        wxTheApp->CallAfter([item = std::move(item), probe, probed]() {
+            if(probed && *item) {
+                (*item)->OnProbed(*probe);
+            }
+        });
+    });
+}
+
+void RecentItem::OnProbed(const OTBM_MapProbe& probe) {
+    wxString details = wxString::Format("OTBM %d", int(probe.version.otbm) + 1);
+    if(const ClientVersion* client = ClientVersion::get(probe.version.client)) {
+        details << ", " << wxstr(client->getName());
+    }
+    if(probe.has_summary) {
+        details << " - " << wxString::Format("%llu tiles", static_cast<unsigned long long>(probe.tile_count));
+        if(probe.tile_count > 0) {
+            details << wxString::Format(", %dx%d", probe.max_x - probe.min_x + 1, probe.max_y - probe.min_y + 1);
+        }
+    }
+    details << " - " << wxFileName::GetHumanReadableSize(wxULongLong(probe.file_size));
+    m_details->SetLabel(details);
+
+    if(!probe.thumbnail.empty()) {
+        const int width = probe.thumbnail_width;
+        const int height = probe.thumbnail_height;
+        wxImage image(width, height, false);
+        unsigned char* rgb = image.GetData();
+        for(size_t i = 0; i < probe.thumbnail.size(); ++i) {
+            const wxColor colour = colorFromEightBit(probe.thumbnail[i]);
+            rgb[i * 3] = colour.Red();
+            rgb[i * 3 + 1] = colour.Green();
+            rgb[i * 3 + 2] = colour.Blue();
+        }
+        // Kept square so the items line up, small maps are scaled up without smoothing
+        const int size = FROM_DIP(this, 40);
+        const int longest = std::max(width, height);
+        image.Rescale(std::max(1, width * size / longest), std::max(1, height * size / longest), wxIMAGE_QUALITY_NEAREST);
+        image.Resize(wxSize(size, size), wxPoint((size - image.GetWidth()) / 2, (size - image.GetHeight()) / 2), 0, 0, 0);
+        m_thumbnail->SetBitmap(wxBitmap(image));
+        m_thumbnail->Show();
+    }
+    Layout();
+    GetParent()->Layout();
 }
 
 void RecentItem::PropagateItemClicked(wxMouseEvent& event) {
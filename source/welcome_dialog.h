@@ -23,6 +23,7 @@
 wxDECLARE_EVENT(WELCOME_DIALOG_ACTION, wxCommandEvent);
 
 class WelcomeDialogPanel;
+struct OTBM_MapProbe;
 
 class WelcomeDialog : public wxDialog
 {
@@ -96,10 +97,17 @@ public:
     void PropagateItemClicked(wxMouseEvent& event);
     wxString GetText() { return m_item_text; };
 private:
+    // Reads the header and summary of the map on the thread pool, the item shows
+    // them once they are in if it is still open
+    void StartProbe();
+    void OnProbed(const OTBM_MapProbe& probe);
+
     wxColour m_text_colour;
     wxColour m_text_colour_hover;
+    wxStaticBitmap* m_thumbnail;
     wxStaticText* m_title;
     wxStaticText* m_file_path;
+    wxStaticText* m_details;
     wxString m_item_text;
 };
 
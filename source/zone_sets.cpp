@@ -0,0 +1,167 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "zone_sets.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+	// The sets are kept in chunks that never move, found through a fixed table, so that
+	// readers don't race with a thread adding a chunk
+	constexpr size_t ChunkBits = 12;
+	constexpr size_t ChunkSize = size_t(1) << ChunkBits;
+	constexpr size_t MaxChunks = 4096;
+
+	struct Table {
+		Table() : count(1) {
+			for(auto& chunk : chunks) {
+				chunk.store(nullptr, std::memory_order_relaxed);
+			}
+			// The empty set is there from the start
+			chunks[0].store(newd std::vector<uint16_t>[ChunkSize], std::memory_order_release);
+			handles.emplace(std::vector<uint16_t>(), ZoneSets::Empty);
+		}
+
+		std::mutex mutex;
+		std::atomic<std::vector<uint16_t>*> chunks[MaxChunks];
+		size_t count;
+		size_t bytes = 0;
+		std::map<std::vector<uint16_t>, ZoneSets::Handle> handles;
+		// Set, zone and whether it is removed, to the resulting set
+		std::unordered_map<uint64_t, ZoneSets::Handle> transitions;
+	};
+
+	// Never destroyed, tiles may be torn down after static destruction has started
+	Table& table()
+	{
+		static Table* table = newd Table();
+		return *table;
+	}
+
+	ZoneSets::Handle internLocked(Table& table, std::vector<uint16_t>&& zones)
+	{
+		auto it = table.handles.find(zones);
+		if(it != table.handles.end()) {
+			return it->second;
+		}
+
+		if(table.count == ChunkSize * MaxChunks) {
+			throw std::length_error("Too many different sets of zones.");
+		}
+		const ZoneSets::Handle handle = ZoneSets::Handle(table.count++);
+		std::vector<uint16_t>* chunk = table.chunks[handle >> ChunkBits].load(std::memory_order_relaxed);
+		if(!chunk) {
+			chunk = newd std::vector<uint16_t>[ChunkSize];
+			table.chunks[handle >> ChunkBits].store(chunk, std::memory_order_release);
+		}
+		// Twice, once in the chunk and once as the key
+		table.bytes += 2 * zones.capacity() * sizeof(uint16_t) + sizeof(std::vector<uint16_t>);
+		chunk[handle & (ChunkSize - 1)] = zones;
+		table.handles.emplace(std::move(zones), handle);
+		return handle;
+	}
+
+	ZoneSets::Handle transition(ZoneSets::Handle set, uint16_t zone, bool removed)
+	{
+		Table& table = ::table();
+		const uint64_t key = (uint64_t(set) << 17) | (uint64_t(zone) << 1) | (removed ? 1 : 0);
+
+		std::lock_guard<std::mutex> lock(table.mutex);
+		auto it = table.transitions.find(key);
+		if(it != table.transitions.end()) {
+			return it->second;
+		}
+
+		std::vector<uint16_t> zones = ZoneSets::get(set);
+		auto position = std::lower_bound(zones.begin(), zones.end(), zone);
+		if(removed) {
+			zones.erase(position);
+		} else {
+			zones.insert(position, zone);
+		}
+		const ZoneSets::Handle result = internLocked(table, std::move(zones));
+		table.transitions.emplace(key, result);
+		return result;
+	}
+}
+
+const std::vector<uint16_t>& ZoneSets::get(Handle set)
+{
+	const std::vector<uint16_t>* chunk = table().chunks[set >> ChunkBits].load(std::memory_order_acquire);
+	return chunk[set & (ChunkSize - 1)];
+}
+
+ZoneSets::Handle ZoneSets::intern(std::vector<uint16_t> zones)
+{
+	std::sort(zones.begin(), zones.end());
+	zones.erase(std::unique(zones.begin(), zones.end()), zones.end());
+	if(zones.empty()) {
+		return Empty;
+	}
+
+	Table& table = ::table();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	return internLocked(table, std::move(zones));
+}
+
+ZoneSets::Handle ZoneSets::add(Handle set, uint16_t zone)
+{
+	const std::vector<uint16_t>& zones = get(set);
+	if(std::binary_search(zones.begin(), zones.end(), zone)) {
+		return set;
+	}
+	return transition(set, zone, false);
+}
+
+ZoneSets::Handle ZoneSets::remove(Handle set, uint16_t zone)
+{
+	const std::vector<uint16_t>& zones = get(set);
+	if(!std::binary_search(zones.begin(), zones.end(), zone)) {
+		return set;
+	}
+	if(zones.size() == 1) {
+		return Empty;
+	}
+	return transition(set, zone, true);
+}
+
+size_t ZoneSets::count()
+{
+	Table& table = ::table();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	return table.count;
+}
+
+size_t ZoneSets::memsize()
+{
+	Table& table = ::table();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	size_t chunks = 0;
+	for(const auto& chunk : table.chunks) {
+		chunks += chunk.load(std::memory_order_relaxed) ? 1 : 0;
+	}
+	// The nodes of the lookup tables are estimated at a few pointers each
+	return table.bytes + chunks * ChunkSize * sizeof(std::vector<uint16_t>) + sizeof(Table) +
+		table.handles.size() * 6 * sizeof(void*) + table.transitions.size() * 4 * sizeof(void*);
+}
@@ -0,0 +1,49 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_ZONE_SETS_H_
+#define RME_ZONE_SETS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Every distinct set of zones on the tiles of all maps, each kept once and shared by the
+// tiles that have it. A tile only holds the handle of its set, so copying a tile doesn't
+// allocate and two tiles are in the same zones if their handles are equal.
+//
+// Sets are never removed, a handle stays valid for as long as the editor runs and reading
+// it takes no lock. Adding and removing a zone are transitions between handles, remembered
+// once they have been worked out. Any thread can intern sets.
+class ZoneSets
+{
+public:
+	using Handle = uint32_t;
+	static constexpr Handle Empty = 0;
+
+	// Sorted, without duplicates
+	static const std::vector<uint16_t>& get(Handle set);
+	static Handle intern(std::vector<uint16_t> zones);
+	static Handle add(Handle set, uint16_t zone);
+	static Handle remove(Handle set, uint16_t zone);
+
+	// The sets interned so far and the memory they take, with the lookup tables
+	static size_t count();
+	static size_t memsize();
+};
+
+#endif